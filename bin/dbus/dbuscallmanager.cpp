@@ -405,6 +405,61 @@ DBusCallManager::stopSmartInfo()
     DRing::stopSmartInfo();
 }
 
+static std::vector<std::map<std::string, std::string>>
+statsToMaps(const std::vector<DRing::MediaStreamStats>& stats)
+{
+    std::vector<std::map<std::string, std::string>> maps;
+    maps.reserve(stats.size());
+    for (const auto& s : stats) {
+        maps.push_back({
+            {"streamId", s.streamId},
+            {"mediaType", s.mediaType},
+            {"sendCodec", s.sendCodec},
+            {"receiveCodec", s.receiveCodec},
+            {"packetsSent", std::to_string(s.packetsSent)},
+            {"bytesSent", std::to_string(s.bytesSent)},
+            {"packetsReceived", std::to_string(s.packetsReceived)},
+            {"bytesReceived", std::to_string(s.bytesReceived)},
+            {"packetsLost", std::to_string(s.packetsLost)},
+            {"jitter", std::to_string(s.jitter)},
+            {"remoteFractionLost", std::to_string(s.remoteFractionLost)},
+            {"roundTripTime", std::to_string(s.roundTripTime)},
+            {"keyFramesRequested", std::to_string(s.keyFramesRequested)},
+            {"keyFrameRequestsReceived", std::to_string(s.keyFrameRequestsReceived)},
+            {"framesEncoded", std::to_string(s.framesEncoded)},
+            {"totalEncodeTime", std::to_string(s.totalEncodeTime)},
+            {"hardwareEncoding", s.hardwareEncoding ? "true" : "false"},
+            {"framesDecoded", std::to_string(s.framesDecoded)},
+            {"decodeLatency", std::to_string(s.decodeLatency)},
+            {"hardwareDecoding", s.hardwareDecoding ? "true" : "false"},
+        });
+    }
+    return maps;
+}
+
+std::vector<std::map<std::string, std::string>>
+DBusCallManager::getCallStats(const std::string& accountId, const std::string& callId)
+{
+    return statsToMaps(DRing::getCallStats(accountId, callId));
+}
+
+void
+DBusCallManager::setCallStatsInterval(const std::string& accountId,
+                                      const std::string& callId,
+                                      const uint32_t& intervalMs)
+{
+    DRing::setCallStatsInterval(accountId, callId, intervalMs);
+}
+
+void
+DBusCallManager::onCallStats(const std::string& accountId,
+                             const std::string& callId,
+                             const std::vector<DRing::MediaStreamStats>& stats)
+{
+    // Converted at the rate chosen by the client only
+    CallStats(accountId, callId, statsToMaps(stats));
+}
+
 void
 DBusCallManager::setModerator(const std::string& accountId,
                               const std::string& confId,
@@ -143,6 +143,14 @@ public:
                          const bool& isMixed);
     void startSmartInfo(const uint32_t& refreshTimeMs);
     void stopSmartInfo();
+    std::vector<std::map<std::string, std::string>> getCallStats(const std::string& accountId,
+                                                                 const std::string& callId);
+    void setCallStatsInterval(const std::string& accountId,
+                              const std::string& callId,
+                              const uint32_t& intervalMs);
+    void onCallStats(const std::string& accountId,
+                     const std::string& callId,
+                     const std::vector<DRing::MediaStreamStats>& stats);
     void setModerator(const std::string& accountId,
                       const std::string& confId,
                       const std::string& peerId,
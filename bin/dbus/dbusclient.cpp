@@ -200,6 +200,8 @@ DBusClient::initLibrary(int flags)
            exportable_callback<CallSignal::VideoMuted>(
                bind(&DBusCallManager::videoMuted, callM, _1, _2)),
            exportable_callback<CallSignal::SmartInfo>(bind(&DBusCallManager::SmartInfo, callM, _1)),
+           exportable_callback<CallSignal::CallStats>(
+               bind(&DBusCallManager::onCallStats, callM, _1, _2, _3)),
            exportable_callback<CallSignal::RemoteRecordingChanged>(
                bind(&DBusCallManager::remoteRecordingChanged, callM, _1, _2, _3)),
            exportable_callback<CallSignal::MediaNegotiationStatus>(
@@ -299,10 +301,25 @@ DBusClient::initLibrary(int flags)
     const std::map<std::string, SharedCallback> convEvHandlers = {
         exportable_callback<ConversationSignal::ConversationLoaded>(
             bind(&DBusConfigurationManager::conversationLoaded, confM, _1, _2, _3, _4)),
+        exportable_callback<ConversationSignal::ConversationLoadedPacked>(
+            [confM](uint32_t id,
+                    const std::string& accountId,
+                    const std::string& conversationId,
+                    const DRing::PackedMessages& messages) {
+                confM->conversationLoadedPacked(id,
+                                                accountId,
+                                                conversationId,
+                                                messages.keys,
+                                                messages.data,
+                                                messages.fields,
+                                                messages.messages);
+            }),
         exportable_callback<ConversationSignal::MessagesFound>(
             bind(&DBusConfigurationManager::messagesFound, confM, _1, _2, _3, _4)),
         exportable_callback<ConversationSignal::MessageReceived>(
             bind(&DBusConfigurationManager::messageReceived, confM, _1, _2, _3)),
+        exportable_callback<ConversationSignal::MessagesReceived>(
+            bind(&DBusConfigurationManager::messagesReceived, confM, _1, _2, _3)),
         exportable_callback<ConversationSignal::ConversationProfileUpdated>(
             bind(&DBusConfigurationManager::conversationProfileUpdated, confM, _1, _2, _3)),
         exportable_callback<ConversationSignal::ConversationRequestReceived>(
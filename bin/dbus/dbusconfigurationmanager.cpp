@@ -74,6 +74,19 @@ DBusConfigurationManager::monitor(const bool& continuous) -> decltype(DRing::mon
     return DRing::monitor(continuous);
 }
 
+auto
+DBusConfigurationManager::getMetrics() -> decltype(DRing::getMetrics())
+{
+    return DRing::getMetrics();
+}
+
+auto
+DBusConfigurationManager::setMetricsPort(const uint16_t& port)
+    -> decltype(DRing::setMetricsPort(port))
+{
+    return DRing::setMetricsPort(port);
+}
+
 auto
 DBusConfigurationManager::exportOnRing(const std::string& accountID, const std::string& password)
     -> decltype(DRing::exportOnRing(accountID, password))
@@ -384,6 +397,24 @@ DBusConfigurationManager::setAgcState(const bool& enabled)
     DRing::setAgcState(enabled);
 }
 
+auto
+DBusConfigurationManager::isLowLatencyAudio() -> decltype(DRing::isLowLatencyAudio())
+{
+    return DRing::isLowLatencyAudio();
+}
+
+void
+DBusConfigurationManager::setLowLatencyAudio(const bool& enabled)
+{
+    DRing::setLowLatencyAudio(enabled);
+}
+
+auto
+DBusConfigurationManager::getAudioLatency() -> decltype(DRing::getAudioLatency())
+{
+    return DRing::getAudioLatency();
+}
+
 void
 DBusConfigurationManager::muteDtmf(const bool& mute)
 {
@@ -920,6 +951,15 @@ DBusConfigurationManager::loadConversationMessages(const std::string& accountId,
     return DRing::loadConversationMessages(accountId, conversationId, fromMessage, n);
 }
 
+uint32_t
+DBusConfigurationManager::loadConversationMessagesPacked(const std::string& accountId,
+                                                         const std::string& conversationId,
+                                                         const std::string& fromMessage,
+                                                         const uint32_t& n)
+{
+    return DRing::loadConversationMessagesPacked(accountId, conversationId, fromMessage, n);
+}
+
 uint32_t
 DBusConfigurationManager::loadConversationUntil(const std::string& accountId,
                                                 const std::string& conversationId,
@@ -79,6 +79,8 @@ public:
     void setAccountActive(const std::string& accountID, const bool& active);
     std::map<std::string, std::string> getAccountTemplate(const std::string& accountType);
     void monitor(const bool& continuous);
+    std::string getMetrics();
+    bool setMetricsPort(const uint16_t& port);
     std::string addAccount(const std::map<std::string, std::string>& details);
     bool exportOnRing(const std::string& accountID, const std::string& password);
     bool exportToFile(const std::string& accountID,
@@ -146,6 +148,9 @@ public:
     void setNoiseSuppressState(const bool& state);
     bool isAgcEnabled();
     void setAgcState(const bool& enabled);
+    bool isLowLatencyAudio();
+    void setLowLatencyAudio(const bool& enabled);
+    std::map<std::string, std::string> getAudioLatency();
     void muteDtmf(const bool& mute);
     bool isDtmfMuted();
     bool isCaptureMuted();
@@ -281,6 +286,10 @@ public:
                                       const std::string& conversationId,
                                       const std::string& fromMessage,
                                       const uint32_t& n);
+    uint32_t loadConversationMessagesPacked(const std::string& accountId,
+                                            const std::string& conversationId,
+                                            const std::string& fromMessage,
+                                            const uint32_t& n);
     uint32_t loadConversationUntil(const std::string& accountId,
                                    const std::string& conversationId,
                                    const std::string& fromMessage,
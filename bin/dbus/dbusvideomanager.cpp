@@ -119,6 +119,18 @@ DBusVideoManager::startShmSink(const std::string& sinkId, const bool& value)
     DRing::startShmSink(sinkId, value);
 }
 
+bool
+DBusVideoManager::setSinkTargetSize(const std::string& sinkId, const int& width, const int& height)
+{
+    return DRing::setSinkTargetSize(sinkId, width, height);
+}
+
+bool
+DBusVideoManager::setSinkMaxFrameRate(const std::string& sinkId, const double& fps)
+{
+    return DRing::setSinkMaxFrameRate(sinkId, fps);
+}
+
 std::map<std::string, std::string>
 DBusVideoManager::getRenderer(const std::string& callId)
 {
@@ -65,6 +65,8 @@ class DRING_PUBLIC DBusVideoManager :
         void setEncodingAccelerated(const bool& state);
         void setDeviceOrientation(const std::string& deviceId, const int& angle);
         void startShmSink(const std::string& sinkId, const bool& value);
+        bool setSinkTargetSize(const std::string& sinkId, const int& width, const int& height);
+        bool setSinkMaxFrameRate(const std::string& sinkId, const double& fps);
         std::map<std::string, std::string> getRenderer(const std::string& callId);
         std::string startLocalMediaRecorder(const std::string& videoInputId, const std::string& filepath);
         void stopLocalRecorder(const std::string& filepath);
@@ -60,6 +60,7 @@ print_usage()
     "-d, --debug \t- Debug mode (more verbose)" << std::endl <<
     "-p, --persistent \t- Stay alive after client quits" << std::endl <<
     "--auto-answer \t- Force automatic answer to incoming calls" << std::endl <<
+    "--batch-signals \t- Emit the messages received per batch (messagesReceived)" << std::endl <<
     "-h, --help \t- Print help" << std::endl;
 }
 
@@ -67,13 +68,14 @@ print_usage()
 // message accordingly.
 // returns true if we should quit (i.e. help was printed), false otherwise
 static bool
-parse_args(int argc, char *argv[], bool& persistent)
+parse_args(int argc, char *argv[], bool& persistent, bool& batchSignals)
 {
     int consoleFlag = false;
     int debugFlag = false;
     int helpFlag = false;
     int versionFlag = false;
     int autoAnswer = false;
+    int batchFlag = false;
 
     const struct option long_options[] = {
         /* These options set a flag. */
@@ -83,6 +85,7 @@ parse_args(int argc, char *argv[], bool& persistent)
         {"help",        no_argument,        nullptr,    'h'},
         {"version",     no_argument,        nullptr,    'v'},
         {"auto-answer", no_argument,        &autoAnswer, true},
+        {"batch-signals", no_argument,      &batchFlag, true},
         {nullptr,       0,                  nullptr,     0} /* Sentinel */
     };
 
@@ -142,6 +145,8 @@ parse_args(int argc, char *argv[], bool& persistent)
     if (autoAnswer)
         ringFlags |= DRing::DRING_FLAG_AUTOANSWER;
 
+    batchSignals = batchFlag;
+
     return false;
 }
 
@@ -167,9 +172,12 @@ main(int argc, char *argv [])
     print_title();
 
     bool persistent = false;
-    if (parse_args(argc, argv, persistent))
+    bool batchSignals = false;
+    if (parse_args(argc, argv, persistent, batchSignals))
         return 0;
 
+    DRing::setSignalBatching(batchSignals);
+
     // TODO: Block signals for all threads but the main thread, decide how/if we should
     // handle other signals
     signal(SIGINT, signal_handler);
@@ -56,6 +56,8 @@ public:
     virtual void remoteRecordingChanged(const std::string& callId, const std::string& peer_number, bool state){}
     virtual void mediaNegotiationStatus(const std::string& callId, const std::string& event,
         const std::vector<std::map<std::string, std::string>>& mediaList){}
+    virtual void callStats(const std::string& accountId, const std::string& callId,
+        const std::vector<DRing::MediaStreamStats>& stats){}
 };
 
 
@@ -147,8 +149,37 @@ bool switchInput(const std::string& accountId, const std::string& callId, const
 /* Instant messaging */
 void sendTextMessage(const std::string& accountId, const std::string& callId, const std::map<std::string, std::string>& messages, const std::string& from, const bool& isMixed);
 
+/* Statistics */
+struct MediaStreamStats
+{
+    std::string streamId;
+    std::string mediaType;
+    std::string sendCodec;
+    std::string receiveCodec;
+    uint64_t packetsSent;
+    uint64_t bytesSent;
+    uint64_t packetsReceived;
+    uint64_t bytesReceived;
+    uint64_t packetsLost;
+    double jitter;
+    double remoteFractionLost;
+    double roundTripTime;
+    uint64_t keyFramesRequested;
+    uint64_t keyFrameRequestsReceived;
+    uint64_t framesEncoded;
+    double totalEncodeTime;
+    bool hardwareEncoding;
+    uint64_t framesDecoded;
+    double decodeLatency;
+    bool hardwareDecoding;
+};
+std::vector<DRing::MediaStreamStats> getCallStats(const std::string& accountId, const std::string& callId);
+void setCallStatsInterval(const std::string& accountId, const std::string& callId, uint32_t intervalMs);
+
 }
 
+%template(MediaStreamStatsVect) std::vector<DRing::MediaStreamStats>;
+
 class Callback {
 public:
     virtual ~Callback() {}
@@ -180,4 +211,6 @@ public:
     virtual void remoteRecordingChanged(const std::string& callId, const std::string& peer_number, bool state){}
     virtual void mediaNegotiationStatus(const std::string& callId, const std::string& event,
         const std::vector<std::map<std::string, std::string>>& mediaList){}
+    virtual void callStats(const std::string& accountId, const std::string& callId,
+        const std::vector<DRing::MediaStreamStats>& stats){}
 };
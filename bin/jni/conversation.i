@@ -26,8 +26,13 @@ class ConversationCallback {
 public:
     virtual ~ConversationCallback(){}
     virtual void conversationLoaded(uint32_t /* id */, const std::string& /*accountId*/, const std::string& /* conversationId */, std::vector<std::map<std::string, std::string>> /*messages*/){}
+    virtual void conversationLoadedPacked(uint32_t /* id */, const std::string& /*accountId*/, const std::string& /* conversationId */, const DRing::PackedMessages& /*messages*/){}
     virtual void messagesFound(uint32_t /* id */, const std::string& /*accountId*/, const std::string& /* conversationId */, std::vector<std::map<std::string, std::string>> /*messages*/){}
     virtual void messageReceived(const std::string& /*accountId*/, const std::string& /* conversationId */, std::map<std::string, std::string> /*message*/){}
+    virtual void messagesReceived(const std::string& accountId, const std::string& conversationId, std::vector<std::map<std::string, std::string>> messages){
+        for (auto& message : messages)
+            messageReceived(accountId, conversationId, std::move(message));
+    }
     virtual void conversationProfileUpdated(const std::string& /*accountId*/, const std::string& /* conversationId */, std::map<std::string, std::string> /*profile*/){}
     virtual void conversationRequestReceived(const std::string& /*accountId*/, const std::string& /* conversationId */, std::map<std::string, std::string> /*metadatas*/){}
     virtual void conversationRequestDeclined(const std::string& /*accountId*/, const std::string& /* conversationId */){}
@@ -40,8 +45,26 @@ public:
 
 %feature("director") ConversationCallback;
 
+%extend DRing::PackedMessages {
+    std::string value(size_t i, const std::string& key) const {
+        return std::string($self->value(i, key));
+    }
+}
+
 namespace DRing {
 
+  /* Only valid during ConversationCallback::conversationLoadedPacked: the offsets in data
+     are in bytes, values are to be read with value() or toMap() */
+  struct PackedMessages
+  {
+      std::vector<std::string> keys;
+      std::vector<uint32_t> fields;
+      std::vector<uint32_t> messages;
+
+      size_t size() const;
+      std::map<std::string, std::string> toMap(size_t i) const;
+  };
+
   // Conversation management
   std::string startConversation(const std::string& accountId);
   void acceptConversationRequest(const std::string& accountId, const std::string& conversationId);
@@ -60,6 +83,7 @@ namespace DRing {
   // Message send/load
   void sendMessage(const std::string& accountId, const std::string& conversationId, const std::string& message, const std::string& replyTo);
   uint32_t loadConversationMessages(const std::string& accountId, const std::string& conversationId, const std::string& fromMessage, size_t n);
+  uint32_t loadConversationMessagesPacked(const std::string& accountId, const std::string& conversationId, const std::string& fromMessage, size_t n);
   uint32_t loadConversationUntil(const std::string& accountId, const std::string& conversationId, const std::string& fromMessage, const std::string& toMessage);
   uint32_t countInteractions(const std::string& accountId, const std::string& conversationId, const std::string& toId, const std::string& fromId, const std::string& authorUri);
   uint32_t searchConversation(const std::string& accountId,
@@ -77,8 +101,13 @@ class ConversationCallback {
 public:
     virtual ~ConversationCallback(){}
     virtual void conversationLoaded(uint32_t /* id */, const std::string& /*accountId*/, const std::string& /* conversationId */, std::vector<std::map<std::string, std::string>> /*messages*/){}
+    virtual void conversationLoadedPacked(uint32_t /* id */, const std::string& /*accountId*/, const std::string& /* conversationId */, const DRing::PackedMessages& /*messages*/){}
     virtual void messagesFound(uint32_t /* id */, const std::string& /*accountId*/, const std::string& /* conversationId */, std::vector<std::map<std::string, std::string>> /*messages*/){}
     virtual void messageReceived(const std::string& /*accountId*/, const std::string& /* conversationId */, std::map<std::string, std::string> /*message*/){}
+    virtual void messagesReceived(const std::string& accountId, const std::string& conversationId, std::vector<std::map<std::string, std::string>> messages){
+        for (auto& message : messages)
+            messageReceived(accountId, conversationId, std::move(message));
+    }
     virtual void conversationProfileUpdated(const std::string& /*accountId*/, const std::string& /* conversationId */, std::map<std::string, std::string> /*profile*/){}
     virtual void conversationRequestReceived(const std::string& /*accountId*/, const std::string& /* conversationId */, std::map<std::string, std::string> /*metadatas*/){}
     virtual void conversationRequestDeclined(const std::string& /*accountId*/, const std::string& /* conversationId */){}
@@ -421,6 +421,8 @@ void addVideoDevice(const std::string &node);
 void removeVideoDevice(const std::string &node);
 void setDeviceOrientation(const std::string& name, int angle);
 bool registerSinkTarget(const std::string& sinkId, const DRing::SinkTarget& target);
+bool setSinkTargetSize(const std::string& sinkId, int width, int height);
+bool setSinkMaxFrameRate(const std::string& sinkId, double fps);
 std::string startLocalMediaRecorder(const std::string& videoInputId, const std::string& filepath);
 void stopLocalRecorder(const std::string& filepath);
 bool getDecodingAccelerated();
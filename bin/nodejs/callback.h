@@ -30,6 +30,7 @@ Persistent<Function> incomingCallWithMediaCb;
 Persistent<Function> conversationLoadedCb;
 Persistent<Function> messagesFoundCb;
 Persistent<Function> messageReceivedCb;
+Persistent<Function> messagesReceivedCb;
 Persistent<Function> conversationProfileUpdatedCb;
 Persistent<Function> conversationRequestReceivedCb;
 Persistent<Function> conversationRequestDeclinedCb;
@@ -92,6 +93,8 @@ getPresistentCb(std::string_view signal)
         return &messagesFoundCb;
     else if (signal == "MessageReceived")
         return &messageReceivedCb;
+    else if (signal == "MessagesReceived")
+        return &messagesReceivedCb;
     else if (signal == "ConversationProfileUpdated")
         return &conversationProfileUpdatedCb;
     else if (signal == "ConversationReady")
@@ -601,6 +604,35 @@ messageReceived(const std::string& accountId,
     uv_async_send(&signalAsync);
 }
 
+void
+messagesReceived(const std::string& accountId,
+                 const std::string& conversationId,
+                 const std::vector<std::map<std::string, std::string>>& messages)
+{
+    std::lock_guard<std::mutex> lock(pendingSignalsLock);
+    pendingSignals.emplace([accountId, conversationId, messages]() {
+        Local<Function> func = Local<Function>::New(Isolate::GetCurrent(), messagesReceivedCb);
+        if (!func.IsEmpty()) {
+            SWIGV8_VALUE callback_args[] = {V8_STRING_NEW_LOCAL(accountId),
+                                            V8_STRING_NEW_LOCAL(conversationId),
+                                            stringMapVecToJsMapArray(messages)};
+            func->Call(SWIGV8_CURRENT_CONTEXT(), SWIGV8_NULL(), 3, callback_args);
+            return;
+        }
+        // No handler for the batches: one call per message
+        func = Local<Function>::New(Isolate::GetCurrent(), messageReceivedCb);
+        if (!func.IsEmpty()) {
+            for (const auto& message : messages) {
+                SWIGV8_VALUE callback_args[] = {V8_STRING_NEW_LOCAL(accountId),
+                                                V8_STRING_NEW_LOCAL(conversationId),
+                                                stringMapToJsMap(message)};
+                func->Call(SWIGV8_CURRENT_CONTEXT(), SWIGV8_NULL(), 3, callback_args);
+            }
+        }
+    });
+    uv_async_send(&signalAsync);
+}
+
 void
 conversationProfileUpdated(const std::string& accountId,
                             const std::string&  conversationId ,
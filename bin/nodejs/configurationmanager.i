@@ -81,6 +81,8 @@ void setAccountDetails(const std::string& accountID, const std::map<std::string,
 void setAccountActive(const std::string& accountID, bool active);
 std::map<std::string, std::string> getAccountTemplate(const std::string& accountType);
 void monitor(bool continuous);
+std::string getMetrics();
+bool setMetricsPort(uint16_t port);
 std::string addAccount(const std::map<std::string, std::string>& details);
 void removeAccount(const std::string& accountID);
 std::vector<std::string> getAccountList();
@@ -127,6 +129,9 @@ void setNoiseSuppressState(bool state);
 
 bool isAgcEnabled();
 void setAgcState(bool enabled);
+bool isLowLatencyAudio();
+void setLowLatencyAudio(bool enabled);
+std::map<std::string, std::string> getAudioLatency();
 
 void muteDtmf(bool mute);
 bool isDtmfMuted();
@@ -31,4 +31,9 @@ namespace DRing {
  */
 void fini(void);
 
+/**
+ * Coalesce the high-frequency signals, e.g. messagesReceived instead of messageReceived.
+ */
+void setSignalBatching(bool enabled);
+
 }
@@ -52,6 +52,8 @@ std::map<std::string, std::string> getSettings(const std::string& name);
 void applySettings(const std::string& name, const std::map<std::string, std::string>& settings);
 
 void registerSinkTarget(const std::string& sinkId, const DRing::SinkTarget& target);
+bool setSinkTargetSize(const std::string& sinkId, int width, int height);
+bool setSinkMaxFrameRate(const std::string& sinkId, double fps);
 bool getDecodingAccelerated();
 void setDecodingAccelerated(bool state);
 bool getEncodingAccelerated();
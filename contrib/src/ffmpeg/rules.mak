@@ -113,6 +113,7 @@ FFMPEGCONF += \
 	--enable-encoder=mpeg4 \
 	--enable-decoder=mpeg4 \
 	--enable-encoder=libvpx_vp8 \
+	--enable-encoder=libvpx_vp9 \
 	--enable-decoder=vp8 \
 	--enable-decoder=vp9 \
 	--enable-encoder=h263 \
@@ -250,7 +251,8 @@ FFMPEGCONF += \
 	--enable-encoder=h264_vaapi \
 	--enable-encoder=vp8_vaapi \
 	--enable-encoder=mjpeg_vaapi \
-	--enable-encoder=hevc_vaapi
+	--enable-encoder=hevc_vaapi \
+	--enable-filter=scale_vaapi
 # ffnvcodec is not supported on ARM then we enable it here for i386 and x86_64
 ifeq ($(ARCH),$(filter $(ARCH),i386 x86_64))
 FFMPEGCONF += --enable-cuvid \
@@ -149,6 +149,7 @@ elif [ "$1" == "win32" ]; then
     FFMPEGCONF+='
                 --enable-libvpx
                 --enable-encoder=libvpx_vp8
+                --enable-encoder=libvpx_vp9
                 --enable-decoder=vp8
                 --enable-decoder=vp9'
     FFMPEGCONF+='
@@ -72,6 +72,7 @@ class Controller;
 class Call;
 class SystemCodecContainer;
 struct IceTransportOptions;
+struct ConnectivityChange;
 
 class VoipLinkException : public std::runtime_error
 {
@@ -310,6 +311,11 @@ public:
      * Inform the account that the network status has changed.
      */
     virtual void connectivityChanged() {};
+    /**
+     * Inform the account of what changed in the network, see Manager::connectivityChanged().
+     * Reconnects all by default.
+     */
+    virtual void networkChanged(const ConnectivityChange&) { connectivityChanged(); }
 
     virtual bool handleMessage(const std::string& /*from*/,
                                const std::pair<std::string, std::string>& /*message*/)
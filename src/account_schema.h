@@ -50,6 +50,7 @@ static const char* const CONFIG_PRESENCE_PUBLISH_SUPPORTED = "Account.presencePu
 static const char* const CONFIG_PRESENCE_SUBSCRIBE_SUPPORTED = "Account.presenceSubscribeSupported";
 static const char* const CONFIG_PRESENCE_STATUS = "Account.presenceStatus";
 static const char* const CONFIG_PRESENCE_NOTE = "Account.presenceNote";
+static const char* const CONFIG_PRESENCE_LIST_URI = "Account.presenceListUri";
 
 static const char* const CONFIG_ACCOUNT_HOSTNAME = "Account.hostname";
 static const char* const CONFIG_ACCOUNT_USERNAME = "Account.username";
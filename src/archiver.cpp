@@ -31,6 +31,9 @@
 #include <opendht/crypto.h>
 #include <json/json.h>
 #include <zlib.h>
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #ifdef ENABLE_PLUGIN
 extern "C" {
@@ -49,6 +52,7 @@ extern "C" {
 
 #include <sys/stat.h>
 #include <fstream>
+#include <memory>
 
 using namespace std::literals;
 
@@ -116,9 +120,91 @@ accountToJsonValue(const std::map<std::string, std::string>& details)
     return root;
 }
 
+#if HAVE_ZSTD
+static std::vector<uint8_t>
+compressZstd(const std::string& str)
+{
+    std::vector<uint8_t> outbuffer(ZSTD_compressBound(str.size()));
+    auto ret = ZSTD_compress(outbuffer.data(),
+                             outbuffer.size(),
+                             str.data(),
+                             str.size(),
+                             ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError(ret))
+        throw std::runtime_error("Exception during zstd compression: "s
+                                 + ZSTD_getErrorName(ret));
+    outbuffer.resize(ret);
+    return outbuffer;
+}
+#endif
+
+static bool
+isZstd(const std::vector<uint8_t>& dat)
+{
+    // Magic number of a zstd frame, zlib and gzip data can't start with it
+    return dat.size() >= 4 && dat[0] == 0x28 && dat[1] == 0xb5 && dat[2] == 0x2f
+           && dat[3] == 0xfd;
+}
+
+static std::vector<uint8_t>
+decompressZstd(const std::vector<uint8_t>& dat)
+{
+#if HAVE_ZSTD
+    std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> zs(ZSTD_createDStream(),
+                                                                   &ZSTD_freeDStream);
+    if (!zs)
+        throw std::runtime_error("ZSTD_createDStream failed while decompressing.");
+
+    // The content size is not trusted, the output grows blockwise
+    ZSTD_inBuffer in {dat.data(), dat.size(), 0};
+    std::array<uint8_t, 32768> outbuffer;
+    ZSTD_outBuffer block {outbuffer.data(), outbuffer.size(), 0};
+    std::vector<uint8_t> out;
+    size_t ret;
+    do {
+        block.pos = 0;
+        ret = ZSTD_decompressStream(zs.get(), &block, &in);
+        if (ZSTD_isError(ret))
+            throw std::runtime_error("Exception during zstd decompression: "s
+                                     + ZSTD_getErrorName(ret));
+        out.insert(out.end(), outbuffer.begin(), outbuffer.begin() + block.pos);
+    } while (in.pos < in.size || block.pos == block.size);
+    if (ret != 0)
+        throw std::runtime_error("Exception during zstd decompression: truncated data");
+    return out;
+#else
+    (void) dat;
+    throw std::runtime_error("Can't decompress zstd data: built without zstd");
+#endif
+}
+
+bool
+hasCodec(Codec codec)
+{
+#if HAVE_ZSTD
+    (void) codec;
+    return true;
+#else
+    return codec != Codec::ZSTD;
+#endif
+}
+
+Codec
+codecOf(const std::vector<uint8_t>& dat)
+{
+    return isZstd(dat) ? Codec::ZSTD : Codec::ZLIB;
+}
+
 std::vector<uint8_t>
-compress(const std::string& str)
+compress(const std::string& str, Codec codec)
 {
+#if HAVE_ZSTD
+    if (codec == Codec::ZSTD)
+        return compressZstd(str);
+#else
+    if (codec == Codec::ZSTD)
+        JAMI_WARN("Built without zstd, compressing with zlib");
+#endif
     auto destSize = compressBound(str.size());
     std::vector<uint8_t> outbuffer(destSize);
     int ret = ::compress(reinterpret_cast<Bytef*>(outbuffer.data()),
@@ -174,6 +260,9 @@ decompressGzip(const std::string& path)
 std::vector<uint8_t>
 decompress(const std::vector<uint8_t>& str)
 {
+    if (isZstd(str))
+        return decompressZstd(str);
+
     z_stream zs; // z_stream is zlib's control structure
     memset(&zs, 0, sizeof(zs));
 
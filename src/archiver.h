@@ -43,13 +43,31 @@ namespace archiver {
 using FileMatchPair = std::function<std::pair<bool, std::string_view>(std::string_view)>;
 
 /**
- * Compress a STL string using zlib with given compression level and return
- * the binary data.
+ * Compression formats, told apart by the header of the compressed data
  */
-std::vector<uint8_t> compress(const std::string& str);
+enum class Codec : uint8_t {
+    ZLIB, // Readable by all versions
+    ZSTD, // Faster, readable by the versions built with zstd
+};
 
 /**
- * Decompress an STL string using zlib and return the original data.
+ * @return false for ZSTD if zstd is not built in
+ */
+bool hasCodec(Codec codec);
+
+/**
+ * @return the codec of data compressed by compress()
+ */
+Codec codecOf(const std::vector<uint8_t>& dat);
+
+/**
+ * Compress a STL string and return the binary data.
+ * @param codec     ZSTD falls back to ZLIB, with a warning, if zstd is not built in
+ */
+std::vector<uint8_t> compress(const std::string& str, Codec codec = Codec::ZLIB);
+
+/**
+ * Decompress data compressed by compress() with any codec and return the original data.
  */
 std::vector<uint8_t> decompress(const std::vector<uint8_t>& dat);
 
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace jami {
+
+#if defined(__cpp_lib_atomic_shared_ptr) && __cpp_lib_atomic_shared_ptr >= 201711L
+
+template<typename T>
+using AtomicSharedPtr = std::atomic<std::shared_ptr<T>>;
+
+#else
+
+/**
+ * A shared_ptr loaded and replaced atomically, e.g. an immutable snapshot read
+ * without lock and replaced as a whole by the writers.
+ *
+ * The subset of std::atomic<std::shared_ptr<T>> (C++20) used by the daemon,
+ * instead of the std::atomic_load()/std::atomic_store() overloads deprecated
+ * by C++20. The pointer is guarded by a spin lock, held only to copy or swap it:
+ * the previous value is released out of it.
+ */
+template<typename T>
+class AtomicSharedPtr
+{
+public:
+    AtomicSharedPtr() noexcept = default;
+    AtomicSharedPtr(std::shared_ptr<T> ptr) noexcept
+        : ptr_(std::move(ptr))
+    {}
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+    AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+    std::shared_ptr<T> load() const noexcept
+    {
+        Guard guard(lock_);
+        return ptr_;
+    }
+    operator std::shared_ptr<T>() const noexcept { return load(); }
+
+    void store(std::shared_ptr<T> ptr) noexcept { exchange(std::move(ptr)); }
+    void operator=(std::shared_ptr<T> ptr) noexcept { store(std::move(ptr)); }
+
+    std::shared_ptr<T> exchange(std::shared_ptr<T> ptr) noexcept
+    {
+        Guard guard(lock_);
+        ptr_.swap(ptr);
+        return ptr;
+    }
+
+private:
+    class Guard
+    {
+    public:
+        explicit Guard(std::atomic_flag& lock) noexcept
+            : lock_(lock)
+        {
+            while (lock_.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+        ~Guard() { lock_.clear(std::memory_order_release); }
+
+    private:
+        std::atomic_flag& lock_;
+    };
+
+    mutable std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    std::shared_ptr<T> ptr_;
+};
+
+#endif
+
+} // namespace jami
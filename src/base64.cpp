@@ -17,50 +17,439 @@
  */
 
 #include "base64.h"
-#include "sip/sip_utils.h"
 
-#include <pjlib.h>
-#include <pjlib-util/base64.h>
+#include <array>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// Selected at runtime, the baseline being SSE2
+#define BASE64_X86 1
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define BASE64_NEON 1
+#endif
 
 namespace jami {
 namespace base64 {
 
-std::string
-encode(std::string_view dat)
+static constexpr char ALPHABET[]
+    = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static constexpr int INVALID {-1};
+
+static constexpr std::array<int, 256>
+decodingTable()
 {
-    if (dat.empty())
-        return {};
+    std::array<int, 256> table {};
+    for (auto& v : table)
+        v = INVALID;
+    for (int i = 0; i < 64; ++i)
+        table[static_cast<uint8_t>(ALPHABET[i])] = i;
+    return table;
+}
+static constexpr auto DECODING = decodingTable();
 
-    int input_length = dat.size();
-    int output_length = PJ_BASE256_TO_BASE64_LEN(input_length);
-    std::string out;
-    out.resize(output_length);
+/**
+ * Encode data[i..size[ into out[j..[
+ */
+static size_t
+encodeScalar(const uint8_t* data, size_t size, size_t i, char* out, size_t j)
+{
+    for (; i + 3 <= size; i += 3) {
+        uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out[j++] = ALPHABET[v >> 18];
+        out[j++] = ALPHABET[(v >> 12) & 0x3f];
+        out[j++] = ALPHABET[(v >> 6) & 0x3f];
+        out[j++] = ALPHABET[v & 0x3f];
+    }
+    if (i < size) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < size)
+            v |= data[i + 1] << 8;
+        out[j++] = ALPHABET[v >> 18];
+        out[j++] = ALPHABET[(v >> 12) & 0x3f];
+        out[j++] = i + 1 < size ? ALPHABET[(v >> 6) & 0x3f] : '=';
+        out[j++] = '=';
+    }
+    return j;
+}
 
-    if (pj_base64_encode((const uint8_t*)dat.data(), input_length, &(*out.begin()), &output_length) != PJ_SUCCESS) {
-        throw base64_exception();
+/**
+ * Decode str[i..size[ into out[j..[, as pj_base64_decode did: the characters out of the
+ * alphabet are skipped, the padding was removed.
+ * @return the end of the decoded data
+ */
+static size_t
+decodeScalar(const char* str, size_t size, size_t i, uint8_t* out, size_t j)
+{
+    while (i < size) {
+        int c[4];
+        int k;
+        for (k = 0; k < 4 and i < size;) {
+            auto v = DECODING[static_cast<uint8_t>(str[i++])];
+            if (v != INVALID)
+                c[k++] = v;
+        }
+        if (k < 4) {
+            if (k > 1) {
+                out[j++] = (c[0] << 2) | ((c[1] & 0x30) >> 4);
+                if (k > 2)
+                    out[j++] = ((c[1] & 0x0f) << 4) | ((c[2] & 0x3c) >> 2);
+            }
+            break;
+        }
+        out[j++] = (c[0] << 2) | ((c[1] & 0x30) >> 4);
+        out[j++] = ((c[1] & 0x0f) << 4) | ((c[2] & 0x3c) >> 2);
+        out[j++] = ((c[2] & 0x03) << 6) | (c[3] & 0x3f);
     }
+    return j;
+}
 
-    out.resize(output_length);
-    return out;
+static size_t
+encodeWithScalar(const uint8_t* data, size_t size, char* out)
+{
+    return encodeScalar(data, size, 0, out, 0);
 }
 
-std::vector<uint8_t>
-decode(std::string_view str)
+static size_t
+decodeWithScalar(const char* str, size_t size, uint8_t* out)
+{
+    return decodeScalar(str, size, 0, out, 0);
+}
+
+#ifdef BASE64_X86
+
+/*
+ * The vectorized codecs of W. Muła and D. Lemire, "Faster Base64 Encoding and Decoding
+ * Using AVX2 Instructions". A block with a character out of the alphabet ends the vector
+ * loop: it and the rest are decoded by decodeScalar().
+ */
+
+#define BASE64_TARGET(t) __attribute__((target(t)))
+
+/**
+ * 3 bytes of each 32 bits lane, reordered, to four 6 bits indices
+ */
+BASE64_TARGET("ssse3")
+static inline __m128i
+encodeIndices(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    auto t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    auto t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    auto t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    auto t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+BASE64_TARGET("ssse3")
+static inline __m128i
+encodeLookup(__m128i indices)
+{
+    // Offset to the character, by range: 0..25, 26..51, 52..61, 62, 63
+    auto range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    auto lower = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    range = _mm_or_si128(range, _mm_and_si128(lower, _mm_set1_epi8(13)));
+    // clang-format off
+    auto shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                               '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                               '/' - 63, 'A', 0, 0);
+    // clang-format on
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, range), indices);
+}
+
+BASE64_TARGET("ssse3")
+static size_t
+encodeWithSsse3(const uint8_t* data, size_t size, char* out)
+{
+    size_t i = 0, j = 0;
+    // 16 bytes read, 12 encoded
+    for (; i + 16 <= size; i += 12, j += 16) {
+        auto in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), encodeLookup(encodeIndices(in)));
+    }
+    return encodeScalar(data, size, i, out, j);
+}
+
+/**
+ * @return the 6 bits values of 16 characters, false if one is out of the alphabet
+ */
+BASE64_TARGET("ssse3")
+static inline bool
+decodeValues(__m128i& str)
+{
+    // clang-format off
+    const auto lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                     0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const auto lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                     0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    // clang-format on
+    const auto lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const auto nibble = _mm_set1_epi8(0x0f);
+
+    auto hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), nibble);
+    auto loNibbles = _mm_and_si128(str, nibble);
+    auto hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+    auto lo = _mm_shuffle_epi8(lutLo, loNibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+        return false;
+    auto slash = _mm_cmpeq_epi8(str, _mm_set1_epi8('/'));
+    str = _mm_add_epi8(str, _mm_shuffle_epi8(lutRoll, _mm_add_epi8(slash, hiNibbles)));
+    return true;
+}
+
+/**
+ * Four 6 bits values of each 32 bits lane to 3 bytes, in the 12 first bytes
+ */
+BASE64_TARGET("ssse3")
+static inline __m128i
+decodePack(__m128i values)
+{
+    auto merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    auto out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+BASE64_TARGET("ssse3")
+static size_t
+decodeWithSsse3(const char* str, size_t size, uint8_t* out)
+{
+    size_t i = 0, j = 0;
+    // 16 characters decoded, 16 bytes written: the last 4 within decodedSize(size)
+    for (; i + 24 <= size; i += 16, j += 12) {
+        auto in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+        if (not decodeValues(in))
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), decodePack(in));
+    }
+    return decodeScalar(str, size, i, out, j);
+}
+
+BASE64_TARGET("avx2")
+static size_t
+encodeWithAvx2(const uint8_t* data, size_t size, char* out)
+{
+    // clang-format off
+    const auto reorder = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                          1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const auto shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    // clang-format on
+    size_t i = 0, j = 0;
+    // 12 bytes in each lane: 28 bytes read, 24 encoded
+    for (; i + 28 <= size; i += 24, j += 32) {
+        auto in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 12)),
+            1);
+        in = _mm256_shuffle_epi8(in, reorder);
+        auto t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        auto t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        auto t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        auto t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        auto indices = _mm256_or_si256(t1, t3);
+
+        auto range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        auto lower = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        range = _mm256_or_si256(range, _mm256_and_si256(lower, _mm256_set1_epi8(13)));
+        auto chars = _mm256_add_epi8(_mm256_shuffle_epi8(shift, range), indices);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), chars);
+    }
+    return encodeScalar(data, size, i, out, j);
+}
+
+BASE64_TARGET("avx2")
+static size_t
+decodeWithAvx2(const char* str, size_t size, uint8_t* out)
+{
+    // clang-format off
+    const auto lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const auto lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const auto lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                          0, 0, 0, 0, 0, 0, 0, 0,
+                                          0, 16, 19, 4, -65, -65, -71, -71,
+                                          0, 0, 0, 0, 0, 0, 0, 0);
+    const auto pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                       2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    // clang-format on
+    const auto nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0, j = 0;
+    // 32 characters decoded, 32 bytes written: the last 8 within decodedSize(size)
+    for (; i + 48 <= size; i += 32, j += 24) {
+        auto in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+        auto hiNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+        auto loNibbles = _mm256_and_si256(in, nibble);
+        auto hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        auto lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        if (not _mm256_testz_si256(lo, hi))
+            break;
+        auto slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        in = _mm256_add_epi8(in, _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(slash, hiNibbles)));
+
+        auto merged = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+        auto bytes = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        bytes = _mm256_shuffle_epi8(bytes, pack);
+        // The 12 bytes of each lane, together
+        bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), bytes);
+    }
+    return decodeScalar(str, size, i, out, j);
+}
+
+#elif defined(BASE64_NEON)
+
+/**
+ * The 64 characters of the alphabet, for the table lookups
+ */
+static inline uint8x16x4_t
+alphabet()
 {
-    if (str.empty())
-        return {};
+    const auto* chars = reinterpret_cast<const uint8_t*>(ALPHABET);
+    return {{vld1q_u8(chars), vld1q_u8(chars + 16), vld1q_u8(chars + 32), vld1q_u8(chars + 48)}};
+}
 
-    int output_length = PJ_BASE64_TO_BASE256_LEN(str.length());
-    auto input = sip_utils::CONST_PJ_STR(str);
+static size_t
+encodeWithNeon(const uint8_t* data, size_t size, char* out)
+{
+    const auto table = alphabet();
+    const auto mask = vdupq_n_u8(0x3f);
+    size_t i = 0, j = 0;
+    for (; i + 48 <= size; i += 48, j += 64) {
+        auto in = vld3q_u8(data + i);
+        uint8x16x4_t indices;
+        indices.val[0] = vshrq_n_u8(in.val[0], 2);
+        indices.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)),
+                                  mask);
+        indices.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)),
+                                  mask);
+        indices.val[3] = vandq_u8(in.val[2], mask);
+        uint8x16x4_t chars;
+        for (int k = 0; k < 4; ++k)
+            chars.val[k] = vqtbl4q_u8(table, indices.val[k]);
+        vst4q_u8(reinterpret_cast<uint8_t*>(out + j), chars);
+    }
+    return encodeScalar(data, size, i, out, j);
+}
 
-    std::vector<uint8_t> out;
-    out.resize(output_length);
+/**
+ * Values of the characters below 128, 0xff if out of the alphabet
+ */
+static std::array<uint8_t, 128>
+neonDecodingTable()
+{
+    std::array<uint8_t, 128> table;
+    for (size_t c = 0; c < table.size(); ++c)
+        table[c] = DECODING[c] == INVALID ? 0xff : DECODING[c];
+    return table;
+}
 
-    if (pj_base64_decode(&input, &(*out.begin()), &output_length) != PJ_SUCCESS) {
-        throw base64_exception();
+static size_t
+decodeWithNeon(const char* str, size_t size, uint8_t* out)
+{
+    static const auto values = neonDecodingTable();
+    const uint8x16x4_t lo {{vld1q_u8(values.data()),
+                            vld1q_u8(values.data() + 16),
+                            vld1q_u8(values.data() + 32),
+                            vld1q_u8(values.data() + 48)}};
+    const uint8x16x4_t hi {{vld1q_u8(values.data() + 64),
+                            vld1q_u8(values.data() + 80),
+                            vld1q_u8(values.data() + 96),
+                            vld1q_u8(values.data() + 112)}};
+    const auto offset = vdupq_n_u8(64);
+    size_t i = 0, j = 0;
+    for (; i + 64 <= size; i += 64, j += 48) {
+        auto in = vld4q_u8(reinterpret_cast<const uint8_t*>(str + i));
+        uint8x16_t invalid = vdupq_n_u8(0);
+        for (int k = 0; k < 4; ++k) {
+            auto c = in.val[k];
+            // 0 for the characters from 64, then their values if below 128
+            auto v = vqtbx4q_u8(vqtbl4q_u8(lo, c), hi, vsubq_u8(c, offset));
+            // The characters from 128 are out of the alphabet
+            invalid = vorrq_u8(invalid, vorrq_u8(v, vcgeq_u8(c, vdupq_n_u8(128))));
+            in.val[k] = v;
+        }
+        if (vmaxvq_u8(invalid) >= 64)
+            break;
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+        vst3q_u8(out + j, bytes);
     }
+    return decodeScalar(str, size, i, out, j);
+}
+
+#endif
 
-    out.resize(output_length);
+struct Codec
+{
+    const char* name;
+    size_t (*encode)(const uint8_t*, size_t, char*);
+    size_t (*decode)(const char*, size_t, uint8_t*);
+};
+
+static const Codec&
+codec()
+{
+    static const Codec selected = [] {
+#ifdef BASE64_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Codec {"avx2", encodeWithAvx2, decodeWithAvx2};
+        if (__builtin_cpu_supports("ssse3"))
+            return Codec {"ssse3", encodeWithSsse3, decodeWithSsse3};
+#elif defined(BASE64_NEON)
+        return Codec {"neon", encodeWithNeon, decodeWithNeon};
+#endif
+        return Codec {"scalar", encodeWithScalar, decodeWithScalar};
+    }();
+    return selected;
+}
+
+const char*
+implementation()
+{
+    return codec().name;
+}
+
+size_t
+encode(const uint8_t* data, size_t size, char* out)
+{
+    return codec().encode(data, size, out);
+}
+
+size_t
+decode(std::string_view str, uint8_t* out)
+{
+    // The padding is not decoded
+    auto size = str.size();
+    while (size > 0 and str[size - 1] == '=')
+        --size;
+    return codec().decode(str.data(), size, out);
+}
+
+std::string
+encode(std::string_view dat)
+{
+    std::string out(encodedSize(dat.size()), '\0');
+    encode(reinterpret_cast<const uint8_t*>(dat.data()), dat.size(), out.data());
+    return out;
+}
+
+std::vector<uint8_t>
+decode(std::string_view str)
+{
+    std::vector<uint8_t> out(decodedSize(str.size()));
+    out.resize(decode(str, out.data()));
     return out;
 }
 
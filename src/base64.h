@@ -23,6 +23,7 @@
 #include <vector>
 #include <exception>
 
+#include <cstddef>
 #include <cstdint>
 
 namespace jami {
@@ -31,6 +32,42 @@ namespace base64 {
 class base64_exception : public std::exception
 {};
 
+/**
+ * Name of the implementation selected for this CPU: "avx2", "ssse3", "neon" or "scalar"
+ */
+const char* implementation();
+
+/**
+ * Size of the encoding of size bytes, padding included
+ */
+constexpr size_t
+encodedSize(size_t size)
+{
+    return (size + 2) / 3 * 4;
+}
+
+/**
+ * Largest size of the data decoded from size characters
+ */
+constexpr size_t
+decodedSize(size_t size)
+{
+    return size * 3 / 4;
+}
+
+/**
+ * Encode into out, of encodedSize(size) characters
+ * @return encodedSize(size)
+ */
+size_t encode(const uint8_t* data, size_t size, char* out);
+
+/**
+ * Decode into out, of at least decodedSize(str.size()) bytes. As before, the characters out of
+ * the alphabet, e.g. line breaks, are skipped.
+ * @return size of the decoded data
+ */
+size_t decode(std::string_view str, uint8_t* out);
+
 std::string encode(std::string_view);
 
 inline std::string encode(const std::vector<uint8_t>& data) {
@@ -458,13 +458,15 @@ Call::addSubCall(Call& subcall)
         [sub = subcall.weak(), parent = weak()](Call::CallState new_state,
                                                 Call::ConnectionState new_cstate,
                                                 int /* code */) {
-            runOnMainThread([sub, parent, new_state, new_cstate]() {
-                if (auto p = parent.lock()) {
-                    if (auto s = sub.lock()) {
-                        p->subcallStateChanged(*s, new_state, new_cstate);
+            runOnMainThread(
+                [sub, parent, new_state, new_cstate]() {
+                    if (auto p = parent.lock()) {
+                        if (auto s = sub.lock()) {
+                            p->subcallStateChanged(*s, new_state, new_cstate);
+                        }
                     }
-                }
-            });
+                },
+                ScheduledExecutor::Priority::High);
             return true;
         });
 }
@@ -643,8 +645,28 @@ Call::setConferenceInfo(const std::string& msg)
     std::string err;
     Json::CharReaderBuilder rbuilder;
     auto reader = std::unique_ptr<Json::CharReader>(rbuilder.newCharReader());
-    if (reader->parse(msg.data(), msg.data() + msg.size(), &json, &err)) {
-        if (json.isObject()) {
+    if (!reader->parse(msg.data(), msg.data() + msg.size(), &json, &err))
+        json = Json::Value();
+
+    bool apply = true;
+    bool askSnapshot = false;
+    {
+        std::lock_guard<std::mutex> lk(confInfoMutex_);
+        if (json.isObject() and json.isMember("base")) {
+            // changes since the confInfo of sequence number base
+            if (json["base"].asUInt64() != peerConfInfoSeq_ or confInfoSnapshotAsked_) {
+                JAMI_DBG("[call:%s] Missed conference infos before %s",
+                         getCallId().c_str(),
+                         json["seq"].asString().c_str());
+                apply = false;
+                askSnapshot = not confInfoSnapshotAsked_;
+                confInfoSnapshotAsked_ = true;
+            } else {
+                newInfo = peerConfInfo_;
+                ConfProtocolParser::applyConfInfoDelta(newInfo, json);
+                peerConfInfoSeq_ = json["seq"].asUInt64();
+            }
+        } else if (json.isObject()) {
             // new confInfo
             if (json.isMember("p")) {
                 for (const auto& participantInfo : json["p"]) {
@@ -663,6 +685,15 @@ Call::setConferenceInfo(const std::string& msg)
                 newInfo.w = json["w"].asInt();
             if (json.isMember("h"))
                 newInfo.h = json["h"].asInt();
+            if (json.isMember("layout"))
+                newInfo.layout = json["layout"].asInt();
+            // Without a sequence number, the host does not know this call is of the version 2
+            auto seq = json["seq"].asUInt64();
+            if (seq and seq < peerConfInfoSeq_)
+                return; // sent before the last changes
+            askSnapshot = json["v"].asInt() >= 2 and not seq;
+            peerConfInfoSeq_ = seq;
+            confInfoSnapshotAsked_ = false;
         } else {
             // old confInfo
             for (const auto& participantInfo : json) {
@@ -673,25 +704,32 @@ Call::setConferenceInfo(const std::string& msg)
                 newInfo.emplace_back(pInfo);
             }
         }
-    }
 
-    {
-        std::lock_guard<std::mutex> lk(confInfoMutex_);
-        if (not isConferenceParticipant()) {
-            // confID_ empty -> participant set confInfo with the received one
-            confInfo_ = std::move(newInfo);
+        if (apply) {
+            peerConfInfo_ = newInfo;
+            if (not isConferenceParticipant()) {
+                // confID_ empty -> participant set confInfo with the received one
+                confInfo_ = std::move(newInfo);
 
-            // Create sink for each participant
+                // Create sink for each participant
 #ifdef ENABLE_VIDEO
-            createSinks(confInfo_);
+                createSinks(confInfo_);
 #endif
-            // Inform client that layout has changed
-            jami::emitSignal<DRing::CallSignal::OnConferenceInfosUpdated>(
-                id_, confInfo_.toVectorMapStringString());
-        } else if (auto conf = conf_.lock()) {
-            conf->mergeConfInfo(newInfo, getPeerNumber());
+                // Inform client that layout has changed
+                jami::emitSignal<DRing::CallSignal::OnConferenceInfosUpdated>(
+                    id_, confInfo_.toVectorMapStringString());
+            } else if (auto conf = conf_.lock()) {
+                conf->mergeConfInfo(newInfo, getPeerNumber());
+            }
         }
     }
+
+    if (askSnapshot) {
+        // Announce the version 2, or ask for full infos after missing changes
+        Json::Value root;
+        root["version"] = 2;
+        sendConfOrder(root);
+    }
 }
 
 void
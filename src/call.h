@@ -490,6 +490,10 @@ protected:
 
     mutable std::mutex confInfoMutex_ {};
     mutable ConfInfo confInfo_ {};
+    // Of the version 2, the last conference infos received, which changes apply to
+    ConfInfo peerConfInfo_ {};
+    uint64_t peerConfInfoSeq_ {0};
+    bool confInfoSnapshotAsked_ {false};
     time_point duration_start_ {time_point::min()};
 
 private:
@@ -39,6 +39,21 @@ CallFactory::getNewCallID() const
     return random_id;
 }
 
+void
+CallFactory::update(const std::function<void(std::map<Call::LinkType, CallMap>&)>& change)
+{
+    auto calls = std::make_shared<Calls>();
+    calls->maps = this->calls()->maps;
+    change(calls->maps);
+    for (const auto& itemmap : calls->maps) {
+        const auto& map = itemmap.second;
+        calls->all.reserve(calls->all.size() + map.size());
+        for (const auto& item : map)
+            calls->all.push_back(item.second);
+    }
+    calls_.store(std::move(calls));
+}
+
 std::shared_ptr<SIPCall>
 CallFactory::newSipCall(const std::shared_ptr<SIPAccountBase>& account,
                         Call::CallType type,
@@ -49,10 +64,10 @@ CallFactory::newSipCall(const std::shared_ptr<SIPAccountBase>& account,
         return {};
     }
 
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
+    std::lock_guard<std::mutex> lk(callMapsMutex_);
     auto id = getNewCallID();
     auto call = std::make_shared<SIPCall>(account, id, type, mediaList);
-    callMaps_[call->getLinkType()].emplace(id, call);
+    update([&](auto& maps) { maps[call->getLinkType()].emplace(id, call); });
     account->attach(call);
     return call;
 }
@@ -66,20 +81,22 @@ CallFactory::forbid()
 void
 CallFactory::removeCall(Call& call)
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
+    std::lock_guard<std::mutex> lk(callMapsMutex_);
 
     const auto& id = call.getCallId();
     JAMI_DBG("Removing call %s", id.c_str());
-    auto& map = callMaps_.at(call.getLinkType());
-    map.erase(id);
-    JAMI_DBG("Remaining %zu call", map.size());
+    size_t remaining;
+    update([&](auto& maps) {
+        auto& map = maps.at(call.getLinkType());
+        map.erase(id);
+        remaining = map.size();
+    });
+    JAMI_DBG("Remaining %zu call", remaining);
 }
 
 void
 CallFactory::removeCall(const std::string& id)
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
     if (auto call = getCall(id)) {
         removeCall(*call);
     } else
@@ -89,9 +106,8 @@ CallFactory::removeCall(const std::string& id)
 bool
 CallFactory::hasCall(const std::string& id) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
-    for (const auto& item : callMaps_) {
+    auto calls = this->calls();
+    for (const auto& item : calls->maps) {
         const auto& map = item.second;
         if (map.find(id) != map.cend())
             return true;
@@ -103,29 +119,21 @@ CallFactory::hasCall(const std::string& id) const
 bool
 CallFactory::empty() const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
-    for (const auto& item : callMaps_) {
-        if (not item.second.empty())
-            return false;
-    }
-
-    return true;
+    return calls()->all.empty();
 }
 
 void
 CallFactory::clear()
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-    callMaps_.clear();
+    std::lock_guard<std::mutex> lk(callMapsMutex_);
+    calls_.store(std::make_shared<const Calls>());
 }
 
 std::shared_ptr<Call>
 CallFactory::getCall(const std::string& id) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
-    for (const auto& item : callMaps_) {
+    auto calls = this->calls();
+    for (const auto& item : calls->maps) {
         const auto& map = item.second;
         const auto& iter = map.find(id);
         if (iter != map.cend())
@@ -135,73 +143,57 @@ CallFactory::getCall(const std::string& id) const
     return nullptr;
 }
 
-std::vector<std::shared_ptr<Call>>
+CallList
 CallFactory::getAllCalls() const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-    std::vector<std::shared_ptr<Call>> v;
-
-    for (const auto& itemmap : callMaps_) {
-        const auto& map = itemmap.second;
-        v.reserve(v.size() + map.size());
-        for (const auto& item : map)
-            v.push_back(item.second);
-    }
-
-    return v;
+    // Shares the calls of the snapshot
+    auto calls = this->calls();
+    return CallList(std::shared_ptr<const CallList::Calls>(calls, &calls->all));
 }
 
 std::vector<std::string>
 CallFactory::getCallIDs() const
 {
+    auto calls = this->calls();
     std::vector<std::string> v;
+    v.reserve(calls->all.size());
 
-    for (const auto& item : callMaps_) {
+    for (const auto& item : calls->maps) {
         const auto& map = item.second;
         for (const auto& it : map)
             v.push_back(it.first);
     }
 
-    v.shrink_to_fit();
     return v;
 }
 
 std::size_t
 CallFactory::callCount() const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-    std::size_t count = 0;
-
-    for (const auto& itemmap : callMaps_)
-        count += itemmap.second.size();
-
-    return count;
+    return calls()->all.size();
 }
 
 bool
 CallFactory::hasCall(const std::string& id, Call::LinkType link) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
-    auto const map = getMap_(link);
+    auto calls = this->calls();
+    auto const map = getMap_(*calls, link);
     return map and map->find(id) != map->cend();
 }
 
 bool
 CallFactory::empty(Call::LinkType link) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
-    const auto map = getMap_(link);
+    auto calls = this->calls();
+    const auto map = getMap_(*calls, link);
     return !map or map->empty();
 }
 
 std::shared_ptr<Call>
 CallFactory::getCall(const std::string& id, Call::LinkType link) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
-    const auto map = getMap_(link);
+    auto calls = this->calls();
+    const auto map = getMap_(*calls, link);
     if (!map)
         return nullptr;
 
@@ -215,41 +207,40 @@ CallFactory::getCall(const std::string& id, Call::LinkType link) const
 std::vector<std::shared_ptr<Call>>
 CallFactory::getAllCalls(Call::LinkType link) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
+    auto calls = this->calls();
     std::vector<std::shared_ptr<Call>> v;
 
-    const auto map = getMap_(link);
+    const auto map = getMap_(*calls, link);
     if (map) {
+        v.reserve(map->size());
         for (const auto& it : *map)
             v.push_back(it.second);
     }
 
-    v.shrink_to_fit();
     return v;
 }
 
 std::vector<std::string>
 CallFactory::getCallIDs(Call::LinkType link) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
+    auto calls = this->calls();
     std::vector<std::string> v;
 
-    const auto map = getMap_(link);
+    const auto map = getMap_(*calls, link);
     if (map) {
+        v.reserve(map->size());
         for (const auto& it : *map)
             v.push_back(it.first);
     }
 
-    v.shrink_to_fit();
     return v;
 }
 
 std::size_t
 CallFactory::callCount(Call::LinkType link) const
 {
-    std::lock_guard<std::recursive_mutex> lk(callMapsMutex_);
-
-    const auto map = getMap_(link);
+    auto calls = this->calls();
+    const auto map = getMap_(*calls, link);
     if (!map)
         return 0;
 
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -27,6 +29,7 @@
 #include <string>
 #include <utility>
 
+#include "atomic_shared_ptr.h"
 #include "call.h"
 #include "account.h"
 
@@ -35,6 +38,34 @@ namespace jami {
 class SIPAccountBase;
 class SIPCall;
 
+/**
+ * Calls at the time of a lookup, shared with the factory without copy.
+ */
+class CallList
+{
+public:
+    using Calls = std::vector<std::shared_ptr<Call>>;
+    using const_iterator = Calls::const_iterator;
+
+    explicit CallList(std::shared_ptr<const Calls> calls)
+        : calls_(std::move(calls))
+    {}
+
+    const_iterator begin() const { return calls_->cbegin(); }
+    const_iterator end() const { return calls_->cend(); }
+    std::size_t size() const { return calls_->size(); }
+    bool empty() const { return calls_->empty(); }
+    const std::shared_ptr<Call>& operator[](std::size_t i) const { return (*calls_)[i]; }
+
+private:
+    std::shared_ptr<const Calls> calls_;
+};
+
+/**
+ * The calls are published as immutable snapshots, replaced as a whole on each change:
+ * the lookups only load the current snapshot, without lock, the changes being rare in
+ * comparison.
+ */
 class CallFactory
 {
 public:
@@ -102,7 +133,7 @@ public:
     /**
      * Return all calls. Type can optionally be specified.
      */
-    std::vector<std::shared_ptr<Call>> getAllCalls() const;
+    CallList getAllCalls() const;
     std::vector<std::shared_ptr<Call>> getAllCalls(Call::LinkType link) const;
 
     /**
@@ -118,27 +149,41 @@ public:
     std::size_t callCount(Call::LinkType link) const;
 
 private:
+    struct Calls
+    {
+        std::map<Call::LinkType, CallMap> maps {};
+        CallList::Calls all {};
+    };
+
+    std::shared_ptr<const Calls> calls() const { return calls_.load(); }
+
     /**
      * @brief Get the calls map
      * @param link The call type
-     * @return A pointer to the calls map instance
-     * @warning Concurrency protection must done by the caller.
+     * @return A pointer to the calls map instance, valid as long as calls
      */
-    const CallMap* getMap_(Call::LinkType link) const
+    static const CallMap* getMap_(const Calls& calls, Call::LinkType link)
     {
-        auto const& itermap = callMaps_.find(link);
-        if (itermap != callMaps_.cend())
+        auto const& itermap = calls.maps.find(link);
+        if (itermap != calls.maps.cend())
             return &itermap->second;
         return nullptr;
     }
 
+    /**
+     * Publish the calls once changed, change being applied to a copy of the current ones
+     * @warning callMapsMutex_ must be locked by the caller.
+     */
+    void update(const std::function<void(std::map<Call::LinkType, CallMap>&)>& change);
+
     std::mt19937_64& rand_;
 
-    mutable std::recursive_mutex callMapsMutex_ {};
+    // Serializes the changes
+    std::mutex callMapsMutex_ {};
 
     std::atomic_bool allowNewCall_ {true};
 
-    std::map<Call::LinkType, CallMap> callMaps_ {};
+    AtomicSharedPtr<const Calls> calls_ {std::make_shared<Calls>()};
 };
 
 } // namespace jami
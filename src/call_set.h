@@ -19,6 +19,7 @@
  */
 #pragma once
 
+#include "atomic_shared_ptr.h"
 #include "call.h"
 #include "conference.h"
 
@@ -26,61 +27,64 @@
 #include <memory>
 #include <string>
 #include <mutex>
+#include <vector>
 
 namespace jami {
 
+/**
+ * The calls and conferences are published as immutable maps, copied on each change:
+ * the lookups take no lock.
+ */
 class CallSet
 {
 public:
     std::shared_ptr<Call> getCall(const std::string& callId) const
     {
-        std::lock_guard<std::mutex> l(mutex_);
-        auto i = calls_.find(callId);
-        return i == calls_.end() ? std::shared_ptr<Call> {} : i->second.lock();
+        auto sets = this->sets();
+        auto i = sets->calls.find(callId);
+        return i == sets->calls.end() ? std::shared_ptr<Call> {} : i->second.lock();
     }
     std::shared_ptr<Conference> getConference(const std::string& conferenceId) const
     {
-        std::lock_guard<std::mutex> l(mutex_);
-        auto i = conferences_.find(conferenceId);
-        return i == conferences_.end() ? std::shared_ptr<Conference> {} : i->second;
+        auto sets = this->sets();
+        auto i = sets->conferences.find(conferenceId);
+        return i == sets->conferences.end() ? std::shared_ptr<Conference> {} : i->second;
     }
 
     void add(const std::shared_ptr<Call>& call)
     {
-        std::lock_guard<std::mutex> l(mutex_);
-        calls_.emplace(call->getCallId(), call);
+        change([&](Sets& sets) { return sets.calls.emplace(call->getCallId(), call).second; });
     }
     void add(const std::shared_ptr<Conference>& conference)
     {
-        std::lock_guard<std::mutex> l(mutex_);
-        conferences_.emplace(conference->getConfId(), conference);
+        change([&](Sets& sets) {
+            return sets.conferences.emplace(conference->getConfId(), conference).second;
+        });
     }
     bool remove(const std::shared_ptr<Call>& call)
     {
-        std::lock_guard<std::mutex> l(mutex_);
-        return calls_.erase(call->getCallId()) > 0;
+        return change([&](Sets& sets) { return sets.calls.erase(call->getCallId()) > 0; });
     }
     bool removeConference(const std::string& confId)
     {
-        std::lock_guard<std::mutex> l(mutex_);
-        return conferences_.erase(confId) > 0;
+        return change([&](Sets& sets) { return sets.conferences.erase(confId) > 0; });
     }
 
     std::vector<std::string> getCallIds() const
     {
-        std::lock_guard<std::mutex> l(mutex_);
+        auto sets = this->sets();
         std::vector<std::string> ids;
-        ids.reserve(calls_.size());
-        for (const auto& callIt : calls_)
+        ids.reserve(sets->calls.size());
+        for (const auto& callIt : sets->calls)
             ids.emplace_back(callIt.first);
         return ids;
     }
     std::vector<std::shared_ptr<Call>> getCalls() const
     {
-        std::lock_guard<std::mutex> l(mutex_);
+        auto sets = this->sets();
         std::vector<std::shared_ptr<Call>> calls;
-        calls.reserve(calls_.size());
-        for (const auto& callIt : calls_)
+        calls.reserve(sets->calls.size());
+        for (const auto& callIt : sets->calls)
             if (auto call = callIt.second.lock())
                 calls.emplace_back(std::move(call));
         return calls;
@@ -88,28 +92,49 @@ public:
 
     std::vector<std::string> getConferenceIds() const
     {
-        std::lock_guard<std::mutex> l(mutex_);
+        auto sets = this->sets();
         std::vector<std::string> ids;
-        ids.reserve(conferences_.size());
-        for (const auto& confIt : conferences_)
+        ids.reserve(sets->conferences.size());
+        for (const auto& confIt : sets->conferences)
             ids.emplace_back(confIt.first);
         return ids;
     }
     std::vector<std::shared_ptr<Conference>> getConferences() const
     {
-        std::lock_guard<std::mutex> l(mutex_);
+        auto sets = this->sets();
         std::vector<std::shared_ptr<Conference>> confs;
-        confs.reserve(conferences_.size());
-        for (const auto& confIt : conferences_)
+        confs.reserve(sets->conferences.size());
+        for (const auto& confIt : sets->conferences)
             if (const auto& conf = confIt.second)
                 confs.emplace_back(conf);
         return confs;
     }
 
 private:
-    mutable std::mutex mutex_;
-    std::map<std::string, std::weak_ptr<Call>> calls_;
-    std::map<std::string, std::shared_ptr<Conference>> conferences_;
+    struct Sets
+    {
+        std::map<std::string, std::weak_ptr<Call>> calls;
+        std::map<std::string, std::shared_ptr<Conference>> conferences;
+    };
+
+    std::shared_ptr<const Sets> sets() const { return sets_.load(); }
+
+    /**
+     * Publish a copy of the sets changed by f, if f returns true
+     */
+    template<typename F>
+    bool change(F&& f)
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        auto changed = std::make_shared<Sets>(*sets());
+        if (not f(*changed))
+            return false;
+        sets_.store(std::move(changed));
+        return true;
+    }
+
+    std::mutex mutex_; // lock the changes of sets_
+    AtomicSharedPtr<const Sets> sets_ {std::make_shared<Sets>()};
 };
 
 } // namespace jami
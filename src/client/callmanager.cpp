@@ -235,6 +235,23 @@ stopSmartInfo()
     jami::Smartools::getInstance().stop();
 }
 
+std::vector<MediaStreamStats>
+getCallStats(const std::string& accountId, const std::string& callId)
+{
+    if (const auto account = jami::Manager::instance().getAccount(accountId))
+        if (auto call = std::dynamic_pointer_cast<jami::SIPCall>(account->getCall(callId)))
+            return call->getStats();
+    return {};
+}
+
+void
+setCallStatsInterval(const std::string& accountId, const std::string& callId, uint32_t intervalMs)
+{
+    if (const auto account = jami::Manager::instance().getAccount(accountId))
+        if (auto call = std::dynamic_pointer_cast<jami::SIPCall>(account->getCall(callId)))
+            call->setStatsInterval(std::chrono::milliseconds(intervalMs));
+}
+
 bool
 addParticipant(const std::string& accountId,
                const std::string& callId,
@@ -535,7 +552,7 @@ muteStream(const std::string& accountId,
         if (auto conf = account->getConference(confId)) {
             conf->muteStream(accountUri, deviceId, streamId, state);
         } else if (auto call = account->getCall(confId)) {
-            if (call->conferenceProtocolVersion() == 1) {
+            if (call->conferenceProtocolVersion() >= 1) {
                 Json::Value sinkVal;
                 sinkVal["muteAudio"] = state;
                 Json::Value mediasObj;
@@ -589,7 +606,7 @@ setActiveStream(const std::string& accountId,
         if (auto conf = account->getConference(confId)) {
             conf->setActiveStream(streamId, state);
         } else if (auto call = account->getCall(confId)) {
-            if (call->conferenceProtocolVersion() == 1) {
+            if (call->conferenceProtocolVersion() >= 1) {
                 Json::Value sinkVal;
                 sinkVal["active"] = state;
                 Json::Value mediasObj;
@@ -623,7 +640,7 @@ hangupParticipant(const std::string& accountId,
         if (auto conf = account->getConference(confId)) {
             conf->hangupParticipant(accountUri, deviceId);
         } else if (auto call = std::static_pointer_cast<jami::SIPCall>(account->getCall(confId))) {
-            if (call->conferenceProtocolVersion() == 1) {
+            if (call->conferenceProtocolVersion() >= 1) {
                 Json::Value deviceVal;
                 deviceVal["hangup"] = jami::TRUE_STR;
                 Json::Value deviceObj;
@@ -680,7 +697,7 @@ raiseHand(const std::string& accountId,
                 device = std::string(account->currentDeviceId());
             conf->setHandRaised(device, state);
         } else if (auto call = std::static_pointer_cast<jami::SIPCall>(account->getCall(confId))) {
-            if (call->conferenceProtocolVersion() == 1) {
+            if (call->conferenceProtocolVersion() >= 1) {
                 Json::Value deviceVal;
                 deviceVal["raiseHand"] = state;
                 Json::Value deviceObj;
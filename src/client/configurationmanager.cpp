@@ -32,6 +32,7 @@
 #include "security/tlsvalidator.h"
 #include "security/certstore.h"
 #include "logger.h"
+#include "metrics.h"
 #include "fileutils.h"
 #include "archiver.h"
 #include "ip_utils.h"
@@ -41,7 +42,6 @@
 #include "system_codec_container.h"
 #include "account_const.h"
 #include "client/ring_signal.h"
-#include "upnp/upnp_context.h"
 #include "audio/ringbufferpool.h"
 
 #ifdef __APPLE__
@@ -441,6 +441,18 @@ monitor(bool continuous)
     return jami::Manager::instance().monitor(continuous);
 }
 
+std::string
+getMetrics()
+{
+    return jami::metrics::Registry::instance().openMetrics();
+}
+
+bool
+setMetricsPort(uint16_t port)
+{
+    return jami::Manager::instance().setMetricsPort(port);
+}
+
 void
 removeAccount(const std::string& accountID)
 {
@@ -674,6 +686,34 @@ setAgcState(bool enabled)
     jami::Manager::instance().setAGCState(enabled);
 }
 
+bool
+isLowLatencyAudio()
+{
+    return jami::Manager::instance().isLowLatencyAudio();
+}
+
+void
+setLowLatencyAudio(bool enabled)
+{
+    jami::Manager::instance().setLowLatencyAudio(enabled);
+}
+
+std::map<std::string, std::string>
+getAudioLatency()
+{
+    std::chrono::microseconds period {0};
+    jami::AudioLayer::Latency latency;
+    if (auto audioLayer = jami::Manager::instance().getAudioDriver()) {
+        period = audioLayer->getDevicePeriod();
+        latency = audioLayer->getLatency();
+    }
+    return {{"period", std::to_string(period.count())},
+            {"capture", std::to_string(latency.capture.count())},
+            {"playback", std::to_string(latency.playback.count())},
+            {"roundTrip", std::to_string((latency.capture + latency.playback).count())},
+            {"processing", std::to_string(latency.processing.count())}};
+}
+
 std::string
 getRecordPath()
 {
@@ -931,20 +971,9 @@ setCredentials(const std::string& accountID,
 void
 connectivityChanged()
 {
-    JAMI_WARN("received connectivity changed - trying to re-connect enabled accounts");
-
-    // reset the UPnP context
-#if !(defined(TARGET_OS_IOS) && TARGET_OS_IOS)
-    try {
-        jami::upnp::UPnPContext::getUPnPContext()->connectivityChanged();
-    } catch (std::runtime_error& e) {
-        JAMI_ERR("UPnP context error: %s", e.what());
-    }
-#endif
-
-    for (const auto& account : jami::Manager::instance().getAllAccounts()) {
-        account->connectivityChanged();
-    }
+    JAMI_WARN("received connectivity changed - checking the network");
+    jami::ip_utils::invalidateInterfaceCache();
+    jami::Manager::instance().connectivityChanged();
 }
 
 bool
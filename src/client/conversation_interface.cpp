@@ -106,6 +106,15 @@ conversationInfos(const std::string& accountId, const std::string& conversationI
     return {};
 }
 
+std::map<std::string, std::string>
+conversationPackState(const std::string& accountId, const std::string& conversationId)
+{
+    if (auto acc = jami::Manager::instance().getAccount<jami::JamiAccount>(accountId))
+        if (auto convModule = acc->convModule())
+            return convModule->packState(conversationId);
+    return {};
+}
+
 // Member management
 void
 addConversationMember(const std::string& accountId,
@@ -160,6 +169,18 @@ loadConversationMessages(const std::string& accountId,
     return 0;
 }
 
+uint32_t
+loadConversationMessagesPacked(const std::string& accountId,
+                               const std::string& conversationId,
+                               const std::string& fromMessage,
+                               size_t n)
+{
+    if (auto acc = jami::Manager::instance().getAccount<jami::JamiAccount>(accountId))
+        if (auto convModule = acc->convModule())
+            return convModule->loadConversationMessagesPacked(conversationId, fromMessage, n);
+    return 0;
+}
+
 uint32_t
 loadConversationUntil(const std::string& accountId,
                       const std::string& conversationId,
@@ -197,7 +197,7 @@ setPluginsEnabled(bool state)
     jami::Manager::instance().pluginPreferences.setPluginsEnabled(state);
     for (auto& item : jami::Manager::instance().pluginPreferences.getLoadedPlugins()) {
         if (state)
-            jami::Manager::instance().getJamiPluginManager().loadPlugin(item);
+            jami::Manager::instance().getJamiPluginManager().loadPlugin(item, true);
         else
             jami::Manager::instance().getJamiPluginManager().unloadPlugin(item);
     }
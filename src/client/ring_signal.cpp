@@ -19,6 +19,12 @@
  */
 
 #include "ring_signal.h"
+#include "manager.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <tuple>
 
 namespace jami {
 
@@ -47,6 +53,7 @@ getSignalHandlers()
         exported_callback<DRing::CallSignal::VideoMuted>(),
         exported_callback<DRing::CallSignal::AudioMuted>(),
         exported_callback<DRing::CallSignal::SmartInfo>(),
+        exported_callback<DRing::CallSignal::CallStats>(),
         exported_callback<DRing::CallSignal::ConnectionUpdate>(),
         exported_callback<DRing::CallSignal::OnConferenceInfosUpdated>(),
         exported_callback<DRing::CallSignal::RemoteRecordingChanged>(),
@@ -90,6 +97,7 @@ getSignalHandlers()
         exported_callback<DRing::ConfigurationSignal::HardwareDecodingChanged>(),
         exported_callback<DRing::ConfigurationSignal::HardwareEncodingChanged>(),
         exported_callback<DRing::ConfigurationSignal::MessageSend>(),
+        exported_callback<DRing::ConfigurationSignal::PushNotificationsHandled>(),
 
         /* Presence */
         exported_callback<DRing::PresenceSignal::NewServerSubscriptionRequest>(),
@@ -127,8 +135,10 @@ getSignalHandlers()
 
         /* Conversation */
         exported_callback<DRing::ConversationSignal::ConversationLoaded>(),
+        exported_callback<DRing::ConversationSignal::ConversationLoadedPacked>(),
         exported_callback<DRing::ConversationSignal::MessagesFound>(),
         exported_callback<DRing::ConversationSignal::MessageReceived>(),
+        exported_callback<DRing::ConversationSignal::MessagesReceived>(),
         exported_callback<DRing::ConversationSignal::ConversationProfileUpdated>(),
         exported_callback<DRing::ConversationSignal::ConversationRequestReceived>(),
         exported_callback<DRing::ConversationSignal::ConversationRequestDeclined>(),
@@ -136,6 +146,7 @@ getSignalHandlers()
         exported_callback<DRing::ConversationSignal::ConversationRemoved>(),
         exported_callback<DRing::ConversationSignal::ConversationMemberEvent>(),
         exported_callback<DRing::ConversationSignal::ConversationSyncFinished>(),
+        exported_callback<DRing::ConversationSignal::ConversationSyncProgress>(),
         exported_callback<DRing::ConversationSignal::CallConnectionRequest>(),
         exported_callback<DRing::ConversationSignal::OnConversationError>(),
 
@@ -147,6 +158,124 @@ getSignalHandlers()
     return handlers;
 }
 
+namespace signal_batching {
+
+using clock = std::chrono::steady_clock;
+// Delay of the messages queued for MessagesReceived
+static constexpr std::chrono::milliseconds SIGNAL_BATCH_TICK {100};
+// Least interval between two identical DataTransferEvent of an ongoing transfer
+static constexpr std::chrono::seconds DATA_TRANSFER_EVENT_INTERVAL {1};
+// Upper bound of the ongoing transfers tracked before pruning the expired ones
+static constexpr size_t MAX_TRACKED_TRANSFERS {256};
+
+using Messages = std::vector<std::map<std::string, std::string>>;
+// accountId, conversationId and messages, in the order received
+using Batch = std::vector<std::tuple<std::string, std::string, Messages>>;
+// accountId, conversationId, interactionId, fileId
+using TransferKey = std::tuple<std::string, std::string, std::string, std::string>;
+
+static std::atomic_bool enabled_ {false};
+// Set while messages are queued, not to lock for every signal
+static std::atomic_bool pending_ {false};
+static std::mutex mutex_;
+static Batch batch_;
+static std::map<TransferKey, clock::time_point> ongoingTransfers_;
+
+bool
+enabled()
+{
+    return enabled_;
+}
+
+void
+setEnabled(bool enabled)
+{
+    enabled_ = enabled;
+    if (not enabled)
+        flush();
+}
+
+void
+messageReceived(const std::string& accountId,
+                const std::string& conversationId,
+                std::map<std::string, std::string> message)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    // Consecutive messages of a conversation are emitted together
+    if (batch_.empty() or std::get<0>(batch_.back()) != accountId
+        or std::get<1>(batch_.back()) != conversationId)
+        batch_.emplace_back(accountId, conversationId, Messages {});
+    std::get<2>(batch_.back()).emplace_back(std::move(message));
+    if (not pending_.exchange(true))
+        Manager::instance().scheduler().scheduleIn([] { flush(); }, SIGNAL_BATCH_TICK);
+}
+
+bool
+dataTransferEvent(const std::string& accountId,
+                  const std::string& conversationId,
+                  const std::string& interactionId,
+                  const std::string& fileId,
+                  int eventCode)
+{
+    TransferKey key {accountId, conversationId, interactionId, fileId};
+    auto now = clock::now();
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (eventCode != static_cast<int>(DRing::DataTransferEventCode::ongoing)) {
+        ongoingTransfers_.erase(key);
+        return true;
+    }
+    auto it = ongoingTransfers_.find(key);
+    if (it != ongoingTransfers_.end() and now - it->second < DATA_TRANSFER_EVENT_INTERVAL)
+        return false;
+    if (ongoingTransfers_.size() >= MAX_TRACKED_TRANSFERS) {
+        for (auto i = ongoingTransfers_.begin(); i != ongoingTransfers_.end();) {
+            if (now - i->second >= DATA_TRANSFER_EVENT_INTERVAL)
+                i = ongoingTransfers_.erase(i);
+            else
+                ++i;
+        }
+    }
+    ongoingTransfers_[std::move(key)] = now;
+    return true;
+}
+
+void
+flush()
+{
+    if (not pending_)
+        return;
+    Batch batch;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        batch = std::move(batch_);
+        batch_.clear();
+        pending_ = false;
+    }
+
+    const auto& handlers = getSignalHandlers();
+    auto received = DRing::CallbackWrapper<DRing::ConversationSignal::MessagesReceived::cb_type>(
+        handlers.at(DRing::ConversationSignal::MessagesReceived::name));
+    auto single = DRing::CallbackWrapper<DRing::ConversationSignal::MessageReceived::cb_type>(
+        handlers.at(DRing::ConversationSignal::MessageReceived::name));
+    for (auto& [accountId, conversationId, messages] : batch) {
+        try {
+            if (received) {
+                (*received)(accountId, conversationId, std::move(messages));
+            } else if (single) {
+                // Client not handling MessagesReceived
+                for (auto& message : messages)
+                    (*single)(accountId, conversationId, std::move(message));
+            }
+        } catch (const std::exception& e) {
+            JAMI_ERR("Exception during emit signal %s:\n%s",
+                     DRing::ConversationSignal::MessagesReceived::name,
+                     e.what());
+        }
+    }
+}
+
+} // namespace signal_batching
+
 }; // namespace jami
 
 namespace DRing {
@@ -165,6 +294,12 @@ registerSignalHandlers(const std::map<std::string, std::shared_ptr<CallbackWrapp
     }
 }
 
+void
+setSignalBatching(bool enabled) noexcept
+{
+    jami::signal_batching::setEnabled(enabled);
+}
+
 void
 unregisterSignalHandlers()
 {
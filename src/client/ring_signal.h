@@ -50,14 +50,52 @@
 #include <exception>
 #include <memory>
 #include <map>
+#include <type_traits>
 #include <utility>
 #include <string>
+#include <vector>
 
 namespace jami {
 
 using SignalHandlerMap = std::map<std::string, std::shared_ptr<DRing::CallbackWrapperBase>>;
 extern SignalHandlerMap& getSignalHandlers();
 
+/*
+ * Batched mode, opted in by the client with DRing::setSignalBatching().
+ * The messages received by a conversation are queued and emitted per tick, as a single
+ * MessagesReceived, and the repeated DataTransferEvent of a transfer in progress are
+ * rate limited. Any other signal flushes the queue first, so that the order of the
+ * signals is kept.
+ */
+namespace signal_batching {
+
+bool enabled();
+void setEnabled(bool enabled);
+
+/**
+ * Queue a message for the next MessagesReceived
+ */
+void messageReceived(const std::string& accountId,
+                     const std::string& conversationId,
+                     std::map<std::string, std::string> message);
+
+/**
+ * @return false if the event is to be dropped: an ongoing transfer already notified
+ * during the last DATA_TRANSFER_EVENT_INTERVAL
+ */
+bool dataTransferEvent(const std::string& accountId,
+                       const std::string& conversationId,
+                       const std::string& interactionId,
+                       const std::string& fileId,
+                       int eventCode);
+
+/**
+ * Emit the queued messages, if any
+ */
+void flush();
+
+} // namespace signal_batching
+
 /*
  * Find related user given callback and call it with given
  * arguments.
@@ -69,6 +107,22 @@ void emitSignal(Args... args)
 {
     jami_tracepoint_if_enabled(emit_signal, demangle<Ts>().c_str());
 
+    if (signal_batching::enabled()) {
+        if constexpr (std::is_same_v<Ts, DRing::ConversationSignal::MessageReceived>) {
+            signal_batching::messageReceived(args...);
+            jami_tracepoint(emit_signal_end);
+            return;
+        } else {
+            if constexpr (std::is_same_v<Ts, DRing::DataTransferSignal::DataTransferEvent>) {
+                if (not signal_batching::dataTransferEvent(args...)) {
+                    jami_tracepoint(emit_signal_end);
+                    return;
+                }
+            }
+            signal_batching::flush();
+        }
+    }
+
     const auto& handlers = getSignalHandlers();
     if (auto wrap = DRing::CallbackWrapper<typename Ts::cb_type>(handlers.at(Ts::name))) {
         try {
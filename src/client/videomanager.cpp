@@ -25,6 +25,7 @@
 #include "localrecorder.h"
 #include "localrecordermanager.h"
 #include "libav_utils.h"
+#include "media_buffer.h"
 #include "video/video_input.h"
 #include "video/video_device_monitor.h"
 #include "account.h"
@@ -36,6 +37,7 @@
 #endif
 #include "client/ring_signal.h"
 #include "audio/ringbufferpool.h"
+#include "audio/audio_kernels.h"
 #include "jami/media_const.h"
 #include "libav_utils.h"
 #include "call_const.h"
@@ -138,7 +140,7 @@ AudioFrame::reserve(size_t nb_samples)
         auto d = pointer();
         d->nb_samples = nb_samples;
         int err;
-        if ((err = av_frame_get_buffer(d, 0)) < 0) {
+        if ((err = jami::FramePool::instance().getAudioBuffer(d)) < 0) {
             throw std::bad_alloc();
         }
     }
@@ -163,23 +165,15 @@ AudioFrame::mix(const AudioFrame& frame)
     unsigned samplesPerChannel = isPlanar ? f.nb_samples : f.nb_samples * f.channels;
     unsigned channels = isPlanar ? f.channels : 1;
     if (fmt == AV_SAMPLE_FMT_S16 || fmt == AV_SAMPLE_FMT_S16P) {
-        for (unsigned i = 0; i < channels; i++) {
-            auto c = (int16_t*) f.extended_data[i];
-            auto cIn = (int16_t*) fIn.extended_data[i];
-            for (unsigned s = 0; s < samplesPerChannel; s++) {
-                c[s] = std::clamp((int32_t) c[s] + (int32_t) cIn[s],
-                                  (int32_t) std::numeric_limits<int16_t>::min(),
-                                  (int32_t) std::numeric_limits<int16_t>::max());
-            }
-        }
+        for (unsigned i = 0; i < channels; i++)
+            jami::audio_kernels::mixS16((int16_t*) f.extended_data[i],
+                                        (const int16_t*) fIn.extended_data[i],
+                                        samplesPerChannel);
     } else if (fmt == AV_SAMPLE_FMT_FLT || fmt == AV_SAMPLE_FMT_FLTP) {
-        for (unsigned i = 0; i < channels; i++) {
-            auto c = (float*) f.extended_data[i];
-            auto cIn = (float*) fIn.extended_data[i];
-            for (unsigned s = 0; s < samplesPerChannel; s++) {
-                c[s] += cIn[s];
-            }
-        }
+        for (unsigned i = 0; i < channels; i++)
+            jami::audio_kernels::mixFloat((float*) f.extended_data[i],
+                                          (const float*) fIn.extended_data[i],
+                                          samplesPerChannel);
     } else {
         throw std::invalid_argument(std::string("Unsupported format for mixing: ")
                                     + av_get_sample_fmt_name(fmt));
@@ -291,7 +285,7 @@ VideoFrame::reserve(int format, int width, int height)
     }
 
     setGeometry(format, width, height);
-    if (av_frame_get_buffer(libav_frame, 32))
+    if (jami::FramePool::instance().getVideoBuffer(libav_frame, 32))
         throw std::bad_alloc();
     allocated_ = true;
     releaseBufferCb_ = {};
@@ -535,6 +529,32 @@ registerSinkTarget(const std::string& sinkId, SinkTarget target)
     return false;
 }
 
+bool
+setSinkTargetSize(const std::string& sinkId, int width, int height)
+{
+#ifdef ENABLE_VIDEO
+    if (auto sink = jami::Manager::instance().getSinkClient(sinkId)) {
+        sink->setTargetSize(width, height);
+        return true;
+    } else
+        JAMI_WARN("No sink found for id '%s'", sinkId.c_str());
+#endif
+    return false;
+}
+
+bool
+setSinkMaxFrameRate(const std::string& sinkId, double fps)
+{
+#ifdef ENABLE_VIDEO
+    if (auto sink = jami::Manager::instance().getSinkClient(sinkId)) {
+        sink->setMaxFrameRate(fps);
+        return true;
+    } else
+        JAMI_WARN("No sink found for id '%s'", sinkId.c_str());
+#endif
+    return false;
+}
+
 #ifdef ENABLE_SHM
 void
 startShmSink(const std::string& sinkId, bool value)
@@ -19,12 +19,15 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
  */
 
+#include <algorithm>
 #include <regex>
 #include <sstream>
 
 #include "conference.h"
 #include "manager.h"
 #include "audio/audiolayer.h"
+#include "audio/audio_rtp_session.h"
+#include "audio/conference_audio_mixer.h"
 #include "jamidht/jamiaccount.h"
 #include "string_utils.h"
 #include "sip/siptransport.h"
@@ -35,6 +38,9 @@
 #include "call.h"
 #include "video/video_input.h"
 #include "video/video_mixer.h"
+#include "video/video_rtp_session.h"
+#include "video/video_receive_thread.h"
+#include "video/rtp_forwarder.h"
 #endif
 
 #ifdef ENABLE_PLUGIN
@@ -54,9 +60,14 @@ using namespace std::literals;
 
 namespace jami {
 
+// To a participant of the version 2, changes between two full conference infos
+static constexpr unsigned CONF_INFO_SNAPSHOT_INTERVAL {20};
+static constexpr auto CONF_INFO_SNAPSHOT_PERIOD {10s};
+
 Conference::Conference(const std::shared_ptr<Account>& account)
     : id_(Manager::instance().callFactory.getNewCallID())
     , account_(account)
+    , confAudioMixer_(std::make_unique<ConferenceAudioMixer>(id_))
 #ifdef ENABLE_VIDEO
     , videoEnabled_(account->isVideoEnabled())
 #endif
@@ -226,9 +237,26 @@ Conference::Conference(const std::shared_ptr<Account>& account)
     } else {
         JAMI_ERR("Conference resolution is invalid");
     }
+    // Without an active participant, the layouts showing one show the speaker
+    confAudioMixer_->setOnSpeaker([this](const std::string& sourceId) {
+        runOnMainThread([w = weak(), sourceId] {
+            auto shared = w.lock();
+            if (!shared || !shared->videoMixer_)
+                return;
+            auto callId = sourceId == RingBufferPool::DEFAULT_ID ? "" : sourceId;
+            shared->videoMixer_->setSpeaker(
+                sip_utils::streamId(callId, sip_utils::DEFAULT_VIDEO_STREAMID));
+            shared->updateForwarding();
+        });
+    });
+    if (Manager::instance().videoPreferences.getConferenceForwarding()) {
+        forwarder_ = std::make_shared<video::RtpForwarder>([](const std::string& callId) {
+            if (auto rtp = getVideoRtp(callId))
+                rtp->requestKeyFrame();
+        });
+    }
 #endif
 
-    parser_.onVersion([&](uint32_t) {}); // TODO
     parser_.onCheckAuthorization([&](std::string_view peerId) { return isModerator(peerId); });
     parser_.onHangupParticipant([&](const auto& accountUri, const auto& deviceId) {
         hangupParticipant(accountUri, deviceId);
@@ -265,6 +293,7 @@ Conference::~Conference()
 
 #ifdef ENABLE_VIDEO
     foreachCall([&](auto call) {
+        stopForwarding(call->getCallId());
         call->exitConference();
         // Reset distant callInfo
         call->resetConfInfo();
@@ -308,6 +337,8 @@ Conference::~Conference()
         confAVStreams.clear();
     }
 #endif // ENABLE_PLUGIN
+    // Unbinds the participants from their mix
+    confAudioMixer_.reset();
     jami_tracepoint(conference_end, id_.c_str());
 }
 
@@ -714,6 +745,7 @@ Conference::addParticipant(const std::string& participant_id)
                                                                 sip_utils::DEFAULT_AUDIO_STREAMID));
         }
         call->enterConference(shared_from_this());
+        updateForwarding();
         // Continue the recording for the conference if one participant was recording
         if (call->isRecording()) {
             JAMI_DBG("Stop recording for call %s", call->getCallId().c_str());
@@ -740,22 +772,32 @@ Conference::setActiveParticipant(const std::string& participant_id)
         return;
     if (isHost(participant_id)) {
         videoMixer_->setActiveStream(sip_utils::streamId("", sip_utils::DEFAULT_VIDEO_STREAMID));
+        updateForwarding();
         return;
     }
     if (auto call = getCallFromPeerID(participant_id)) {
         videoMixer_->setActiveStream(
             sip_utils::streamId(call->getCallId(), sip_utils::DEFAULT_VIDEO_STREAMID));
+        updateForwarding();
         return;
     }
 
     auto remoteHost = findHostforRemoteParticipant(participant_id);
     if (not remoteHost.empty()) {
-        // This logic will be handled client side
-        JAMI_WARN("Change remote layout is not supported");
+        // Shown by its host, whose conference is shown by us
+        if (auto call = getCallFromPeerID(string_remove_suffix(remoteHost, '@'))) {
+            Json::Value root;
+            root["activeParticipant"] = participant_id;
+            call->sendConfOrder(root);
+            videoMixer_->setActiveStream(
+                sip_utils::streamId(call->getCallId(), sip_utils::DEFAULT_VIDEO_STREAMID));
+            updateForwarding();
+        }
         return;
     }
     // Unset active participant by default
     videoMixer_->resetActiveStream();
+    updateForwarding();
 #endif
 }
 
@@ -765,10 +807,37 @@ Conference::setActiveStream(const std::string& streamId, bool state)
 #ifdef ENABLE_VIDEO
     if (!videoMixer_)
         return;
-    if (state)
+    bool isLocal;
+    {
+        std::lock_guard<std::mutex> lk(confInfoMutex_);
+        isLocal = std::any_of(confInfo_.begin(), confInfo_.end(), [&](const ParticipantInfo& p) {
+            return p.sinkId == streamId;
+        });
+    }
+    ParticipantInfo remote;
+    std::shared_ptr<Call> call;
+    if (not isLocal)
+        call = findRemoteParticipant([&](const ParticipantInfo& p) { return p.sinkId == streamId; },
+                                     remote);
+    if (call) {
+        // Shown by its host, whose conference is shown by us
+        Json::Value media;
+        media["active"] = state;
+        call->sendConfOrder(
+            ConfProtocolParser::mediaOrder(std::string(string_remove_suffix(remote.uri, '@')),
+                                           remote.device,
+                                           streamId,
+                                           std::move(media)));
+        if (state)
+            videoMixer_->setActiveStream(
+                sip_utils::streamId(call->getCallId(), sip_utils::DEFAULT_VIDEO_STREAMID));
+        else
+            videoMixer_->resetActiveStream();
+    } else if (state)
         videoMixer_->setActiveStream(streamId);
     else
         videoMixer_->resetActiveStream();
+    updateForwarding();
 #endif
 }
 
@@ -787,6 +856,7 @@ Conference::setLayout(int layout)
         confInfo_.layout = layout;
     }
     videoMixer_->setVideoLayout(static_cast<video::Layout>(layout));
+    updateForwarding();
 #endif
 }
 
@@ -800,8 +870,8 @@ ConfInfo::toVectorMapStringString() const
     return infos;
 }
 
-std::string
-ConfInfo::toString() const
+Json::Value
+ConfInfo::toJson() const
 {
     Json::Value val = {};
     for (const auto& info : *this) {
@@ -811,28 +881,85 @@ ConfInfo::toString() const
     val["h"] = h;
     val["v"] = v;
     val["layout"] = layout;
-    return Json::writeString(Json::StreamWriterBuilder {}, val);
+    return val;
+}
+
+std::string
+ConfInfo::toString() const
+{
+    return Json::writeString(Json::StreamWriterBuilder {}, toJson());
+}
+
+std::string
+Conference::confInfoUpdate(const std::string& callId, const ConfInfo& info)
+{
+    auto it = confInfoUpdates_.find(callId);
+    if (it == confInfoUpdates_.end())
+        return info.toString();
+    auto& updates = it->second;
+    auto now = std::chrono::steady_clock::now();
+    Json::Value val;
+    if (updates.seq and updates.deltas < CONF_INFO_SNAPSHOT_INTERVAL
+        and now - updates.snapshot < CONF_INFO_SNAPSHOT_PERIOD) {
+        val = ConfProtocolParser::confInfoDelta(updates.sent, info);
+        if (val.isNull())
+            return {};
+        val["v"] = info.v;
+        val["base"] = Json::UInt64(updates.seq);
+        updates.deltas++;
+    } else {
+        val = info.toJson();
+        updates.deltas = 0;
+        updates.snapshot = now;
+    }
+    val["seq"] = Json::UInt64(++updates.seq);
+    updates.sent = info;
+    Json::StreamWriterBuilder wbuilder;
+    wbuilder["commentStyle"] = "None";
+    wbuilder["indentation"] = "";
+    return Json::writeString(wbuilder, val);
+}
+
+void
+Conference::onConfInfoVersion(const std::string& callId, uint32_t version)
+{
+    // The orders are of the version 1
+    if (version < 2)
+        return;
+    std::lock_guard<std::mutex> lk(confInfoMutex_);
+    // Announced, or asked after missing changes: the next infos are full
+    confInfoUpdates_[callId].snapshot = {};
+    if (auto call = getCall(callId))
+        sendConferenceInfo(call);
+}
+
+void
+Conference::sendConferenceInfo(const std::shared_ptr<Call>& call)
+{
+    // Produce specific JSON for each participant (2 separate accounts can host ...
+    // a conference on a same device, the conference is not link to one account).
+    auto w = call->getAccount();
+    auto account = w.lock();
+    if (!account)
+        return;
+
+    auto confInfo = getConfInfoHostUri(account->getUsername() + "@ring.dht",
+                                       call->getPeerNumber());
+#ifdef ENABLE_VIDEO
+    if (forwarder_ and forwarder_->hasDestination(call->getCallId()))
+        setForwardedLayout(confInfo);
+#endif
+    auto msg = confInfoUpdate(call->getCallId(), confInfo);
+    if (msg.empty())
+        return;
+    dht::ThreadPool::io().run([call, msg = std::move(msg)] { call->sendConfInfo(msg); });
 }
 
 void
 Conference::sendConferenceInfos()
 {
     // Inform calls that the layout has changed
-    foreachCall([&](auto call) {
-        // Produce specific JSON for each participant (2 separate accounts can host ...
-        // a conference on a same device, the conference is not link to one account).
-        auto w = call->getAccount();
-        auto account = w.lock();
-        if (!account)
-            return;
-
-        dht::ThreadPool::io().run(
-            [call,
-             confInfo = getConfInfoHostUri(account->getUsername() + "@ring.dht",
-                                           call->getPeerNumber())] {
-                call->sendConfInfo(confInfo.toString());
-            });
-    });
+    foreachCall([&](auto call) { sendConferenceInfo(call); });
 
     auto confInfo = getConfInfoHostUri("", "");
 #ifdef ENABLE_VIDEO
@@ -868,9 +995,14 @@ Conference::removeParticipant(const std::string& participant_id)
         if (!participants_.erase(participant_id))
             return;
     }
+    confAudioMixer_->removeParticipant(participant_id);
     if (auto call = std::dynamic_pointer_cast<SIPCall>(getCall(participant_id))) {
         const auto& peerId = getRemoteId(call);
         participantsMuted_.erase(call->getCallId());
+        {
+            std::lock_guard<std::mutex> lk(confInfoMutex_);
+            confInfoUpdates_.erase(call->getCallId());
+        }
         if (auto* transport = call->getTransport())
             handsRaised_.erase(std::string(transport->deviceId()));
 #ifdef ENABLE_VIDEO
@@ -880,9 +1012,11 @@ Conference::removeParticipant(const std::string& participant_id)
         if (videoMixer_->verifyActive(
                 sip_utils::streamId(participant_id, sip_utils::DEFAULT_VIDEO_STREAMID)))
             videoMixer_->resetActiveStream();
+        stopForwarding(participant_id);
         call->exitConference();
         if (call->isPeerRecording())
             call->peerRecording(false);
+        updateForwarding();
 #endif // ENABLE_VIDEO
     }
 }
@@ -897,18 +1031,11 @@ Conference::attachLocalParticipant()
         setLocalHostDefaultMediaSource();
 
         auto& rbPool = Manager::instance().getRingBufferPool();
-        for (const auto& participant : getParticipantList()) {
-            if (auto call = Manager::instance().getCallFromCallID(participant)) {
-                if (isMuted(call->getCallId()))
-                    rbPool.bindHalfDuplexOut(participant, RingBufferPool::DEFAULT_ID);
-                else
-                    rbPool.bindCallID(participant, RingBufferPool::DEFAULT_ID);
-                rbPool.flush(participant);
-            }
+        addHostToMixer();
 
-            // Reset ringbuffer's readpointers
+        // Reset ringbuffer's readpointers
+        for (const auto& participant : getParticipantList())
             rbPool.flush(participant);
-        }
         rbPool.flush(RingBufferPool::DEFAULT_ID);
 
 #ifdef ENABLE_VIDEO
@@ -935,10 +1062,7 @@ Conference::detachLocalParticipant()
     JAMI_INFO("Detach local participant from conference %s", id_.c_str());
 
     if (getState() == State::ACTIVE_ATTACHED) {
-        foreachCall([&](auto call) {
-            Manager::instance().getRingBufferPool().unBindCallID(call->getCallId(),
-                                                                 RingBufferPool::DEFAULT_ID);
-        });
+        confAudioMixer_->removeParticipant(RingBufferPool::DEFAULT_ID);
 
 #ifdef ENABLE_VIDEO
         if (videoMixer_)
@@ -961,35 +1085,45 @@ Conference::bindParticipant(const std::string& participant_id)
 
     auto& rbPool = Manager::instance().getRingBufferPool();
 
-    for (const auto& item : getParticipantList()) {
-        if (participant_id != item) {
-            // Do not attach muted participants
-            if (auto call = Manager::instance().getCallFromCallID(item)) {
-                if (isMuted(call->getCallId()))
-                    rbPool.bindHalfDuplexOut(item, participant_id);
-                else
-                    rbPool.bindCallID(participant_id, item);
-            }
-        }
-        rbPool.flush(item);
+    // The participant hears the mix of all the others, and is heard by them
+    // unless muted
+    confAudioMixer_->addParticipant(participant_id, participant_id);
+    confAudioMixer_->setMuted(participant_id, isMuted(participant_id));
+    // Ranked by the level of its RTP packets when it sends it, without reading the samples
+    if (auto call = std::dynamic_pointer_cast<SIPCall>(getCall(participant_id))) {
+        confAudioMixer_->setLevelSource(
+            participant_id, [w = std::weak_ptr<SIPCall>(call)]() -> std::optional<float> {
+                auto call = w.lock();
+                auto rtp = call ? call->getAudioRtp() : nullptr;
+                auto level = rtp ? rtp->getReceivedAudioLevel() : std::nullopt;
+                if (not level)
+                    return std::nullopt;
+                auto rms = rtp_audio_level::toRms(level->level);
+                return level->voice ? std::max(rms, SilenceDetector::THRESHOLD) : rms;
+            });
     }
+    rbPool.flush(participant_id);
 
-    // Bind local participant to other participants only if the
-    // local is attached to the conference.
+    // Mix the local participant only if it is attached to the conference.
     if (getState() == State::ACTIVE_ATTACHED) {
-        if (isMediaSourceMuted(MediaType::MEDIA_AUDIO))
-            rbPool.bindHalfDuplexOut(RingBufferPool::DEFAULT_ID, participant_id);
-        else
-            rbPool.bindCallID(participant_id, RingBufferPool::DEFAULT_ID);
+        addHostToMixer();
         rbPool.flush(RingBufferPool::DEFAULT_ID);
     }
 }
 
+void
+Conference::addHostToMixer()
+{
+    confAudioMixer_->addParticipant(RingBufferPool::DEFAULT_ID, RingBufferPool::DEFAULT_ID);
+    confAudioMixer_->setMuted(RingBufferPool::DEFAULT_ID,
+                              isMediaSourceMuted(MediaType::MEDIA_AUDIO) or isMuted("host"sv));
+}
+
 void
 Conference::unbindParticipant(const std::string& participant_id)
 {
     JAMI_INFO("Unbind participant %s from conference %s", participant_id.c_str(), id_.c_str());
-    Manager::instance().getRingBufferPool().unBindAllHalfDuplexOut(participant_id);
+    confAudioMixer_->setMuted(participant_id, true);
 }
 
 void
@@ -997,23 +1131,15 @@ Conference::bindHost()
 {
     JAMI_INFO("Bind host to conference %s", id_.c_str());
 
-    auto& rbPool = Manager::instance().getRingBufferPool();
-
-    for (const auto& item : getParticipantList()) {
-        if (auto call = Manager::instance().getCallFromCallID(item)) {
-            if (isMuted(call->getCallId()))
-                continue;
-            rbPool.bindCallID(item, RingBufferPool::DEFAULT_ID);
-            rbPool.flush(RingBufferPool::DEFAULT_ID);
-        }
-    }
+    confAudioMixer_->setMuted(RingBufferPool::DEFAULT_ID, false);
+    Manager::instance().getRingBufferPool().flush(RingBufferPool::DEFAULT_ID);
 }
 
 void
 Conference::unbindHost()
 {
     JAMI_INFO("Unbind host from conference %s", id_.c_str());
-    Manager::instance().getRingBufferPool().unBindAllHalfDuplexOut(RingBufferPool::DEFAULT_ID);
+    confAudioMixer_->setMuted(RingBufferPool::DEFAULT_ID, true);
 }
 
 ParticipantSet
@@ -1104,6 +1230,121 @@ Conference::getVideoMixer()
     return videoMixer_;
 }
 
+std::shared_ptr<video::VideoRtpSession>
+Conference::getVideoRtp(const std::string& callId)
+{
+    if (auto call = std::dynamic_pointer_cast<SIPCall>(getCall(callId))) {
+        auto sessions = call->getRtpSessionList(MediaType::MEDIA_VIDEO);
+        if (not sessions.empty())
+            return std::static_pointer_cast<video::VideoRtpSession>(sessions.front());
+    }
+    return {};
+}
+
+void
+Conference::updateForwarding()
+{
+    if (not forwarder_ or not videoMixer_)
+        return;
+
+    // The participant shown forwards its stream, the host is only seen in the mix
+    auto shown = videoMixer_->getShownStream();
+    std::string source;
+    std::string codec;
+    std::vector<std::pair<std::string, std::shared_ptr<video::VideoRtpSession>>> sessions;
+    for (const auto& callId : getParticipantList()) {
+        auto rtp = getVideoRtp(callId);
+        if (not rtp)
+            continue;
+        rtp->setForwardCallback([w = std::weak_ptr<video::RtpForwarder>(forwarder_),
+                                 callId](const uint8_t* packet, std::size_t size) {
+            if (auto forwarder = w.lock())
+                forwarder->onPacket(callId, packet, size);
+        });
+        auto receiveCodec = rtp->getReceiveCodec();
+        if (rtp->streamId() == shown and receiveCodec) {
+            source = callId;
+            codec = receiveCodec->systemCodecInfo.name;
+        }
+        sessions.emplace_back(callId, std::move(rtp));
+    }
+
+    auto previous = forwarder_->getSource();
+    if (source.empty())
+        forwarder_->resetSource();
+    else
+        forwarder_->setSource(source, codec);
+    for (const auto& [callId, rtp] : sessions) {
+        // The packets can only be forwarded to the participants of the same codec
+        auto sendCodec = rtp->getCodec();
+        if (source.empty() or callId == source or not sendCodec
+            or sendCodec->systemCodecInfo.name != codec) {
+            forwarder_->removeDestination(callId);
+            rtp->stopForwarding();
+            continue;
+        }
+        auto started = not rtp->isForwarding();
+        if (not rtp->startForwarding([w = std::weak_ptr<video::RtpForwarder>(forwarder_)] {
+                if (auto forwarder = w.lock())
+                    forwarder->requestKeyFrame();
+            })) {
+            forwarder_->removeDestination(callId);
+            continue;
+        }
+        // Also for the new session of a renegotiation
+        if (not started and forwarder_->hasDestination(callId))
+            continue;
+        auto send = [w = std::weak_ptr<video::VideoRtpSession>(rtp)](const uint8_t* packet,
+                                                                      std::size_t size,
+                                                                      bool newSource) {
+            if (auto rtp = w.lock())
+                rtp->forwardPacket(packet, size, newSource);
+        };
+        forwarder_->addDestination(callId, std::move(send));
+    }
+
+    if (previous != forwarder_->getSource()) {
+        // The participants forwarded another video show its layout
+        std::lock_guard<std::mutex> lk(confInfoMutex_);
+        sendConferenceInfos();
+    }
+}
+
+void
+Conference::stopForwarding(const std::string& callId)
+{
+    if (not forwarder_)
+        return;
+    forwarder_->removeDestination(callId);
+    if (auto rtp = getVideoRtp(callId)) {
+        rtp->setForwardCallback(nullptr);
+        rtp->stopForwarding();
+    }
+}
+
+void
+Conference::setForwardedLayout(ConfInfo& info) const
+{
+    auto source = forwarder_->getSource();
+    if (auto rtp = getVideoRtp(source)) {
+        if (auto& receiver = rtp->getVideoReceive()) {
+            if (receiver->getWidth() > 0 and receiver->getHeight() > 0) {
+                info.w = receiver->getWidth();
+                info.h = receiver->getHeight();
+            }
+        }
+    }
+    auto sinkId = sip_utils::streamId(source, sip_utils::DEFAULT_VIDEO_STREAMID);
+    info.layout = static_cast<int>(video::Layout::ONE_BIG);
+    for (auto& participant : info) {
+        auto shown = participant.sinkId == sinkId;
+        participant.x = 0;
+        participant.y = 0;
+        participant.w = shown ? info.w : 0;
+        participant.h = shown ? info.h : 0;
+    }
+}
+
 std::string
 Conference::getVideoInput() const
 {
@@ -1158,7 +1399,7 @@ Conference::deinitRecorder(std::shared_ptr<MediaRecorder>& rec)
     if (auto ob = rec->getStream("a:mixer"))
         audioMixer_->detach(ob);
     audioMixer_.reset();
-    Manager::instance().getRingBufferPool().unBindAll(getConfId());
+    confAudioMixer_->removeParticipant(getConfId());
     ghostRingBuffer_.reset();
 }
 
@@ -1177,8 +1418,11 @@ Conference::onConfOrder(const std::string& callId, const std::string& confOrder)
             return;
         }
 
+        uint32_t version = 0;
+        parser_.onVersion([&](uint32_t v) { version = v; });
         parser_.initData(std::move(root), peerId);
         parser_.parse();
+        onConfInfoVersion(callId, version);
     }
 }
 
@@ -1236,6 +1480,18 @@ Conference::setHandRaised(const std::string& deviceId, const bool& state)
                 }
             }
         }
+        // Else, it may be a participant of a linked host
+        ParticipantInfo remote;
+        if (auto call = findRemoteParticipant(
+                [&](const ParticipantInfo& p) { return p.device == deviceId; }, remote)) {
+            Json::Value device;
+            device["raiseHand"] = state;
+            call->sendConfOrder(
+                ConfProtocolParser::deviceOrder(std::string(string_remove_suffix(remote.uri, '@')),
+                                                deviceId,
+                                                std::move(device)));
+            return;
+        }
         JAMI_WARN("Fail to raise %s hand (participant not found)", deviceId.c_str());
     }
 }
@@ -1370,7 +1626,7 @@ Conference::isMuted(std::string_view callId) const
 void
 Conference::muteStream(const std::string& accountUri,
                        const std::string& deviceId,
-                       const std::string&,
+                       const std::string& streamId,
                        const bool& state)
 {
     if (auto acc = std::dynamic_pointer_cast<JamiAccount>(account_.lock())) {
@@ -1378,6 +1634,17 @@ Conference::muteStream(const std::string& accountUri,
             muteHost(state);
         } else if (auto call = getCallWith(accountUri, deviceId)) {
             muteCall(call->getCallId(), state);
+        } else if (auto host = findHostforRemoteParticipant(accountUri, deviceId);
+                   not host.empty()) {
+            // Muted by its host
+            if (auto hostCall = getCallFromPeerID(string_remove_suffix(host, '@'))) {
+                Json::Value media;
+                media["muteAudio"] = state;
+                hostCall->sendConfOrder(ConfProtocolParser::mediaOrder(accountUri,
+                                                                       deviceId,
+                                                                       streamId,
+                                                                       std::move(media)));
+            }
         } else {
             JAMI_WARN("No call with %s - %s", accountUri.c_str(), deviceId.c_str());
         }
@@ -1496,7 +1763,7 @@ Conference::getConfInfoHostUri(std::string_view localHostURI, std::string_view d
         // ConfA send ConfA and ConfC for ConfB
         // ...
         if (destURI != hostUri)
-            newInfo.insert(newInfo.end(), confInfo.begin(), confInfo.end());
+            ConfProtocolParser::mergeConfInfo(newInfo, confInfo);
     }
     return newInfo;
 }
@@ -1685,6 +1952,19 @@ Conference::mergeConfInfo(ConfInfo& newInfo, const std::string& peerURI)
         return;
     }
 
+    // When more than two hosts are linked, our participants come back from the others
+    auto peer = string_remove_suffix(peerURI, '@');
+    newInfo.erase(std::remove_if(newInfo.begin(),
+                                 newInfo.end(),
+                                 [&](const ParticipantInfo& p) {
+                                     auto uri = string_remove_suffix(p.uri, '@');
+                                     if (uri == peer)
+                                         return false;
+                                     return (isHost(uri) and isHostDevice(p.device))
+                                            or getCallWith(std::string(uri), p.device);
+                                 }),
+                  newInfo.end());
+
 #ifdef ENABLE_VIDEO
     resizeRemoteParticipants(newInfo, peerURI);
 #endif
@@ -1725,6 +2005,20 @@ Conference::findHostforRemoteParticipant(std::string_view uri, std::string_view
     return "";
 }
 
+std::shared_ptr<Call>
+Conference::findRemoteParticipant(const std::function<bool(const ParticipantInfo&)>& pred,
+                                  ParticipantInfo& info)
+{
+    for (const auto& [hostUri, confInfo] : remoteHosts_) {
+        auto it = std::find_if(confInfo.begin(), confInfo.end(), pred);
+        if (it == confInfo.end())
+            continue;
+        info = *it;
+        return getCallFromPeerID(string_remove_suffix(hostUri, '@'));
+    }
+    return {};
+}
+
 std::shared_ptr<Call>
 Conference::getCallFromPeerID(std::string_view peerID)
 {
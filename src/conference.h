@@ -24,6 +24,7 @@
 #include "config.h"
 #endif
 
+#include <chrono>
 #include <set>
 #include <string>
 #include <memory>
@@ -52,10 +53,13 @@ namespace jami {
 
 class Call;
 class Account;
+class ConferenceAudioMixer;
 
 #ifdef ENABLE_VIDEO
 namespace video {
 class VideoMixer;
+class VideoRtpSession;
+class RtpForwarder;
 }
 #endif
 
@@ -154,7 +158,7 @@ struct ConfInfo : public std::vector<ParticipantInfo>
 {
     int h {0};
     int w {0};
-    int v {1}; // Supported conference protocol version
+    int v {2}; // Supported conference protocol version
     int layout {0};
 
     friend bool operator==(const ConfInfo& c1, const ConfInfo& c2)
@@ -179,6 +183,7 @@ struct ConfInfo : public std::vector<ParticipantInfo>
     friend bool operator!=(const ConfInfo& c1, const ConfInfo& c2) { return !(c1 == c2); }
 
     std::vector<std::map<std::string, std::string>> toVectorMapStringString() const;
+    Json::Value toJson() const;
     std::string toString() const;
 };
 
@@ -416,13 +421,47 @@ private:
     mutable std::mutex confInfoMutex_ {};
     ConfInfo confInfo_ {};
 
+    /**
+     * Conference infos last sent to a participant of the version 2, to send it the
+     * changes since, and a full snapshot from time to time
+     */
+    struct ConfInfoUpdates
+    {
+        uint64_t seq {0};
+        ConfInfo sent {};
+        unsigned deltas {0};
+        std::chrono::steady_clock::time_point snapshot {};
+    };
+    // Per call, guarded by confInfoMutex_
+    std::map<std::string, ConfInfoUpdates> confInfoUpdates_ {};
+
     void sendConferenceInfos();
+    void sendConferenceInfo(const std::shared_ptr<Call>& call);
+    /**
+     * @return the message to send to the call, empty if it already has info
+     */
+    std::string confInfoUpdate(const std::string& callId, const ConfInfo& info);
+    void onConfInfoVersion(const std::string& callId, uint32_t version);
     std::shared_ptr<RingBuffer> ghostRingBuffer_;
+    std::unique_ptr<ConferenceAudioMixer> confAudioMixer_;
 
 #ifdef ENABLE_VIDEO
     bool videoEnabled_;
     std::shared_ptr<video::VideoMixer> videoMixer_;
     std::map<std::string, std::shared_ptr<video::SinkClient>> confSinksMap_ {};
+
+    // Forwarding mode, the participants receive the video of the one shown by the mix
+    std::shared_ptr<video::RtpForwarder> forwarder_;
+    static std::shared_ptr<video::VideoRtpSession> getVideoRtp(const std::string& callId);
+    /**
+     * Forward the video shown to the participants, or the mix if it can't be
+     */
+    void updateForwarding();
+    void stopForwarding(const std::string& callId);
+    /**
+     * Layout of the video of the source only, as forwarded
+     */
+    void setForwardedLayout(ConfInfo& info) const;
 #endif
 
     std::shared_ptr<jami::AudioInput> audioMixer_;
@@ -438,6 +477,11 @@ private:
 
     bool isMuted(std::string_view uri) const;
 
+    /**
+     * Add the local host to the audio mix, honoring its mute state
+     */
+    void addHostToMixer();
+
     ConfInfo getConfInfoHostUri(std::string_view localHostURI, std::string_view destURI);
     bool isHost(std::string_view uri) const;
     bool isHostDevice(std::string_view deviceId) const;
@@ -457,6 +501,11 @@ private:
 #endif
     std::string_view findHostforRemoteParticipant(std::string_view uri,
                                                   std::string_view deviceId = "");
+    /**
+     * Call with the linked host of a participant matching pred, which is copied to info
+     */
+    std::shared_ptr<Call> findRemoteParticipant(
+        const std::function<bool(const ParticipantInfo&)>& pred, ParticipantInfo& info);
 
     std::shared_ptr<Call> getCallWith(const std::string& accountUri, const std::string& deviceId);
 
@@ -20,8 +20,11 @@
 
 #include "conference_protocol.h"
 
+#include "conference.h"
 #include "string_utils.h"
 
+#include <algorithm>
+
 namespace jami {
 
 namespace ProtocolKeys {
@@ -45,6 +48,10 @@ constexpr static const char* MUTEAUDIO = "muteAudio";
 // Future
 constexpr static const char* MUTEVIDEO = "muteVideo";
 constexpr static const char* VOICEACTIVITY = "voiceActivity";
+// Conference infos of the version 2
+constexpr static const char* PARTICIPANTS = "p";
+constexpr static const char* UPDATED = "u";
+constexpr static const char* REMOVED = "r";
 
 } // namespace ProtocolKeys
 
@@ -55,7 +62,8 @@ ConfProtocolParser::parse()
         uint32_t version = data_[ProtocolKeys::PROTOVERSION].asUInt();
         if (version_)
             version_(version);
-        if (version == 1) {
+        // The version 2 only changes the conference infos sent back
+        if (version == 1 or version == 2) {
             parseV1();
         } else {
             JAMI_WARN() << "Unsupported protocol version " << version;
@@ -122,7 +130,7 @@ ConfProtocolParser::parseV1()
         if (isPeerModerator && key == ProtocolKeys::LAYOUT) {
             // Note: can be removed soon
             setLayout_(itr->asInt());
-        } else {
+        } else if (itr->isObject()) { // Not the version
             auto accValue = *itr;
             if (accValue.isMember(ProtocolKeys::DEVICES)) {
                 auto accountUri = key.asString();
@@ -178,4 +186,136 @@ ConfProtocolParser::parseV1()
     }
 }
 
+Json::Value
+ConfProtocolParser::deviceOrder(const std::string& accountUri,
+                                const std::string& deviceId,
+                                Json::Value&& device)
+{
+    Json::Value devices;
+    devices[deviceId] = std::move(device);
+    Json::Value account;
+    account[ProtocolKeys::DEVICES] = std::move(devices);
+    Json::Value root;
+    root[accountUri] = std::move(account);
+    root[ProtocolKeys::PROTOVERSION] = 1;
+    return root;
+}
+
+Json::Value
+ConfProtocolParser::mediaOrder(const std::string& accountUri,
+                               const std::string& deviceId,
+                               const std::string& streamId,
+                               Json::Value&& media)
+{
+    Json::Value medias;
+    medias[streamId] = std::move(media);
+    Json::Value device;
+    device[ProtocolKeys::MEDIAS] = medias;
+    auto root = deviceOrder(accountUri, deviceId, std::move(device));
+    // parseV1 reads the medias next to the devices, as sent by the clients
+    root[accountUri][ProtocolKeys::MEDIAS] = std::move(medias);
+    return root;
+}
+
+void
+ConfProtocolParser::mergeConfInfo(ConfInfo& info, const ConfInfo& remote)
+{
+    for (const auto& participant : remote) {
+        auto uri = string_remove_suffix(participant.uri, '@');
+        auto it = std::find_if(info.begin(), info.end(), [&](const ParticipantInfo& p) {
+            return p.device == participant.device and p.sinkId == participant.sinkId
+                   and string_remove_suffix(p.uri, '@') == uri;
+        });
+        if (it == info.end())
+            info.emplace_back(participant);
+    }
+}
+
+static bool
+sameStream(const ParticipantInfo& p1, const ParticipantInfo& p2)
+{
+    return p1.uri == p2.uri and p1.device == p2.device and p1.sinkId == p2.sinkId;
+}
+
+Json::Value
+ConfProtocolParser::confInfoDelta(const ConfInfo& base, const ConfInfo& info)
+{
+    Json::Value delta;
+    for (const auto& participant : info) {
+        auto it = std::find_if(base.begin(), base.end(), [&](const ParticipantInfo& p) {
+            return sameStream(p, participant);
+        });
+        if (it == base.end() or *it != participant)
+            delta[ProtocolKeys::UPDATED].append(participant.toJson());
+    }
+    for (const auto& participant : base) {
+        if (std::none_of(info.begin(), info.end(), [&](const ParticipantInfo& p) {
+                return sameStream(p, participant);
+            })) {
+            Json::Value key;
+            key["uri"] = participant.uri;
+            key["device"] = participant.device;
+            key["sinkId"] = participant.sinkId;
+            delta[ProtocolKeys::REMOVED].append(std::move(key));
+        }
+    }
+    if (base.w != info.w or base.h != info.h) {
+        delta["w"] = info.w;
+        delta["h"] = info.h;
+    }
+    if (base.layout != info.layout)
+        delta[ProtocolKeys::LAYOUT] = info.layout;
+    if (delta.isNull())
+        return delta;
+
+    // The new participants are added at the end, else all of them are sent in their order
+    ConfInfo applied = base;
+    applyConfInfoDelta(applied, delta);
+    if (not std::equal(applied.begin(), applied.end(), info.begin(), info.end(), sameStream)) {
+        delta.removeMember(ProtocolKeys::UPDATED);
+        delta.removeMember(ProtocolKeys::REMOVED);
+        for (const auto& participant : info)
+            delta[ProtocolKeys::PARTICIPANTS].append(participant.toJson());
+    }
+    return delta;
+}
+
+void
+ConfProtocolParser::applyConfInfoDelta(ConfInfo& info, const Json::Value& delta)
+{
+    if (delta.isMember(ProtocolKeys::PARTICIPANTS)) {
+        info.clear();
+        for (const auto& participantInfo : delta[ProtocolKeys::PARTICIPANTS]) {
+            ParticipantInfo participant;
+            participant.fromJson(participantInfo);
+            info.emplace_back(std::move(participant));
+        }
+    }
+    for (const auto& key : delta[ProtocolKeys::REMOVED]) {
+        ParticipantInfo removed;
+        removed.fromJson(key);
+        info.erase(std::remove_if(info.begin(),
+                                  info.end(),
+                                  [&](const ParticipantInfo& p) { return sameStream(p, removed); }),
+                   info.end());
+    }
+    for (const auto& participantInfo : delta[ProtocolKeys::UPDATED]) {
+        ParticipantInfo participant;
+        participant.fromJson(participantInfo);
+        auto it = std::find_if(info.begin(), info.end(), [&](const ParticipantInfo& p) {
+            return sameStream(p, participant);
+        });
+        if (it != info.end())
+            *it = std::move(participant);
+        else
+            info.emplace_back(std::move(participant));
+    }
+    if (delta.isMember("w"))
+        info.w = delta["w"].asInt();
+    if (delta.isMember("h"))
+        info.h = delta["h"].asInt();
+    if (delta.isMember(ProtocolKeys::LAYOUT))
+        info.layout = delta[ProtocolKeys::LAYOUT].asInt();
+}
+
 } // namespace jami
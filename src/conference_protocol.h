@@ -23,6 +23,7 @@
 #include "config.h"
 #endif
 
+#include <string>
 #include <string_view>
 #include <functional>
 #include <json/json.h>
@@ -31,6 +32,8 @@
 
 namespace jami {
 
+struct ConfInfo;
+
 /**
  * Used to parse confOrder objects
  * @note the user of this class must initialize the different lambdas.
@@ -109,6 +112,41 @@ public:
      */
     void parse();
 
+    /**
+     * Order of the version 1 for a device, e.g. to forward to a linked host the
+     * orders about its participants
+     * @param device    e.g. {"raiseHand": false}
+     */
+    static Json::Value deviceOrder(const std::string& accountUri,
+                                   const std::string& deviceId,
+                                   Json::Value&& device);
+    /**
+     * @param media     e.g. {"muteAudio": true}
+     */
+    static Json::Value mediaOrder(const std::string& accountUri,
+                                  const std::string& deviceId,
+                                  const std::string& streamId,
+                                  Json::Value&& media);
+
+    /**
+     * Add to info the participants of the conference of a linked host but the
+     * ones it already has. When several hosts link their conferences, the
+     * participants of a host are received from each of the others.
+     */
+    static void mergeConfInfo(ConfInfo& info, const ConfInfo& remote);
+
+    /**
+     * Changes from base to info, for a participant of the version 2 which received base:
+     * the participants added or updated in "u", the keys of the ones removed in "r", and
+     * the size or layout of the mixed video if different.
+     * @return null if nothing changed
+     */
+    static Json::Value confInfoDelta(const ConfInfo& base, const ConfInfo& info);
+    /**
+     * Apply to the conference infos received changes from confInfoDelta
+     */
+    static void applyConfInfoDelta(ConfInfo& info, const Json::Value& delta);
+
 private:
     void parseV0();
     void parseV1();
@@ -21,6 +21,9 @@
 #ifndef SERIALIZABLE_H__
 #define SERIALIZABLE_H__
 
+#include <atomic>
+#include <utility>
+
 namespace YAML {
 class Emitter;
 class Node;
@@ -34,6 +37,39 @@ public:
     virtual ~Serializable() {};
     virtual void serialize(YAML::Emitter& out) const = 0;
     virtual void unserialize(const YAML::Node& node) = 0;
+
+    /**
+     * @return false if serialize() would emit the same as when setClean() was last called.
+     * Always true for the classes not tracking their changes.
+     */
+    virtual bool isDirty() const { return true; }
+    virtual void setClean() {}
+    virtual void setDirty() {}
+};
+
+/**
+ * Serializable tracking its changes: setDirty() is to be called by each modification,
+ * including unserialize()
+ */
+class TrackedSerializable : public Serializable
+{
+public:
+    bool isDirty() const override { return dirty_; }
+    void setClean() override { dirty_ = false; }
+    void setDirty() override { dirty_ = true; }
+
+protected:
+    template<typename T, typename V>
+    void update(T& field, V&& value)
+    {
+        if (field != value) {
+            field = std::forward<V>(value);
+            setDirty();
+        }
+    }
+
+private:
+    std::atomic_bool dirty_ {true};
 };
 
 } // namespace jami
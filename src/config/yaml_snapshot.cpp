@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "yaml_snapshot.h"
+
+#include "fileutils.h"
+#include "logger.h"
+
+#include <opendht/infohash.h>
+
+#include <chrono>
+#include <stdexcept>
+
+namespace jami {
+namespace yaml_utils {
+
+// To be increased when the format of the snapshots changes
+static constexpr unsigned SNAPSHOT_VERSION {1};
+// Fields of a snapshot: version, modification time, size, hash, root node
+static constexpr uint32_t SNAPSHOT_FIELDS {5};
+static constexpr unsigned MAX_DEPTH {64};
+
+std::string
+snapshotPath(const std::string& path)
+{
+    return fileutils::get_cache_dir() + DIR_SEPARATOR_STR + "yaml_snapshots" + DIR_SEPARATOR_STR
+           + dht::InfoHash::get(path).toString() + ".msgpack";
+}
+
+void
+packNode(msgpack::packer<msgpack::sbuffer>& pk, const YAML::Node& node)
+{
+    switch (node.Type()) {
+    case YAML::NodeType::Scalar:
+        pk.pack(node.Scalar());
+        break;
+    case YAML::NodeType::Sequence:
+        pk.pack_array(node.size());
+        for (const auto& item : node)
+            packNode(pk, item);
+        break;
+    case YAML::NodeType::Map:
+        pk.pack_map(node.size());
+        for (const auto& item : node) {
+            packNode(pk, item.first);
+            packNode(pk, item.second);
+        }
+        break;
+    default:
+        pk.pack_nil();
+        break;
+    }
+}
+
+static YAML::Node
+unpackNode(const msgpack::object& o, unsigned depth)
+{
+    if (depth > MAX_DEPTH)
+        throw std::runtime_error("YAML snapshot too deep");
+    switch (o.type) {
+    case msgpack::type::NIL:
+        return YAML::Node(YAML::NodeType::Null);
+    case msgpack::type::STR:
+        return YAML::Node(o.as<std::string>());
+    case msgpack::type::ARRAY: {
+        YAML::Node node(YAML::NodeType::Sequence);
+        for (uint32_t i = 0; i < o.via.array.size; ++i)
+            node.push_back(unpackNode(o.via.array.ptr[i], depth + 1));
+        return node;
+    }
+    case msgpack::type::MAP: {
+        YAML::Node node(YAML::NodeType::Map);
+        for (uint32_t i = 0; i < o.via.map.size; ++i) {
+            const auto& kv = o.via.map.ptr[i];
+            node[unpackNode(kv.key, depth + 1)] = unpackNode(kv.val, depth + 1);
+        }
+        return node;
+    }
+    default:
+        throw std::runtime_error("Unexpected YAML snapshot node");
+    }
+}
+
+YAML::Node
+unpackNode(const msgpack::object& o)
+{
+    return unpackNode(o, 0);
+}
+
+YAML::Node
+loadFile(const std::string& path)
+{
+    std::string content;
+    int64_t mtime;
+    try {
+        content = fileutils::loadTextFile(path);
+        mtime = std::chrono::duration_cast<std::chrono::seconds>(
+                    fileutils::writeTime(path).time_since_epoch())
+                    .count();
+    } catch (const std::exception& e) {
+        JAMI_DBG("Can't read %s: %s", path.c_str(), e.what());
+        return {};
+    }
+    auto hash = dht::InfoHash::get(content);
+    auto snapshot = snapshotPath(path);
+
+    try {
+        std::lock_guard<std::mutex> lk(fileutils::getFileLock(snapshot));
+        auto data = fileutils::loadFile(snapshot);
+        auto oh = msgpack::unpack(reinterpret_cast<const char*>(data.data()), data.size());
+        const auto& o = oh.get();
+        if (o.type == msgpack::type::ARRAY and o.via.array.size == SNAPSHOT_FIELDS) {
+            const auto* fields = o.via.array.ptr;
+            if (fields[0].as<unsigned>() == SNAPSHOT_VERSION and fields[1].as<int64_t>() == mtime
+                and fields[2].as<uint64_t>() == content.size()
+                and fields[3].as<dht::InfoHash>() == hash)
+                return unpackNode(fields[4]);
+        }
+    } catch (const std::exception&) {
+        // Not written yet or corrupted: parsed again
+    }
+
+    auto root = YAML::Load(content);
+
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> pk(&buffer);
+    pk.pack_array(SNAPSHOT_FIELDS);
+    pk.pack(SNAPSHOT_VERSION);
+    pk.pack(mtime);
+    pk.pack(static_cast<uint64_t>(content.size()));
+    pk.pack(hash);
+    packNode(pk, root);
+    fileutils::recursive_mkdir(fileutils::get_cache_dir() + DIR_SEPARATOR_STR + "yaml_snapshots",
+                               0700);
+    fileutils::saveFileAsync(snapshot,
+                             std::vector<uint8_t>(buffer.data(), buffer.data() + buffer.size()),
+                             0600,
+                             [snapshot](bool ok) {
+                                 if (not ok)
+                                     JAMI_WARN("Can't save YAML snapshot %s", snapshot.c_str());
+                             });
+    return root;
+}
+
+} // namespace yaml_utils
+} // namespace jami
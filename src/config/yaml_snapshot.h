@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <yaml-cpp/yaml.h>
+
+#include <msgpack.hpp>
+
+#include <string>
+
+namespace jami {
+namespace yaml_utils {
+
+/**
+ * Parse a YAML file, e.g. dring.yml or the config.yml of an account.
+ *
+ * The parsed nodes are kept in a binary (msgpack) snapshot, in the cache directory, along
+ * with the modification time and the hash of the file. As long as both match, the nodes are
+ * read from the snapshot rather than parsed again. The YAML file stays the reference: the
+ * snapshot is written again once it is modified.
+ *
+ * @return the root node, null if the file can't be read
+ */
+YAML::Node loadFile(const std::string& path);
+
+/**
+ * @return the path of the snapshot of a YAML file
+ */
+std::string snapshotPath(const std::string& path);
+
+void packNode(msgpack::packer<msgpack::sbuffer>& pk, const YAML::Node& node);
+YAML::Node unpackNode(const msgpack::object& o);
+
+} // namespace yaml_utils
+} // namespace jami
@@ -39,7 +39,9 @@
 #include <unordered_map>
 #include <mutex>
 #include <future>
+#include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <charconv> // std::from_chars
 #include <cstdlib>  // mkstemp
 #include <filesystem>
@@ -57,6 +59,8 @@ generateUID()
 }
 
 constexpr const uint32_t MAX_BUFFER_SIZE {65534}; /* Channeled max packet size */
+constexpr const unsigned MAX_CHUNK_FAILURES {16}; /* Chunks asked again before failing */
+constexpr const unsigned MAX_RANGE_RETRIES {16};  /* Ranges without chunks asked again */
 //==============================================================================
 
 class DataTransfer : public Stream
@@ -145,13 +149,15 @@ DataTransfer::emit(DRing::DataTransferEventCode code) const
         stateChangedCb_(id, code);
     if (internalCompletionCb_)
         return; // VCard transfer is just for the daemon
-    runOnMainThread([id = id, code, accountId, to]() {
-        emitSignal<DRing::DataTransferSignal::DataTransferEvent>(accountId,
-                                                                 "",
-                                                                 "",
-                                                                 std::to_string(id),
-                                                                 uint32_t(code));
-    });
+    runOnMainThread(
+        [id = id, code, accountId, to]() {
+            emitSignal<DRing::DataTransferSignal::DataTransferEvent>(accountId,
+                                                                     "",
+                                                                     "",
+                                                                     std::to_string(id),
+                                                                     uint32_t(code));
+        },
+        ScheduledExecutor::Priority::Low);
 }
 
 void
@@ -340,19 +346,20 @@ private:
     void sendFile() const
     {
         dht::ThreadPool::io().run([this]() {
-            std::vector<char> buf;
-            while (!input_.eof() && onRecvCb_) {
-                buf.resize(MAX_BUFFER_SIZE);
-
-                input_.read(&buf[0], buf.size());
-                buf.resize(input_.gcount());
-                if (buf.size()) {
+            uint64_t pos = 0;
+            while (!inputClosed_ && pos < input_->size() && onRecvCb_) {
+                std::size_t len = std::min<uint64_t>(input_->size() - pos, MAX_BUFFER_SIZE);
+                auto data = input_->read(pos, len);
+                if (!data)
+                    break;
+                pos += len;
+                {
                     std::lock_guard<std::mutex> lk {infoMutex_};
-                    info_.bytesProgress += buf.size();
+                    info_.bytesProgress += len;
                     metaInfo_->updateInfo(info_);
                 }
                 if (onRecvCb_)
-                    onRecvCb_(std::string_view(buf.data(), buf.size()));
+                    onRecvCb_(std::string_view((const char*) data, len));
             }
             JAMI_DBG() << "FTP#" << getId() << ": sent " << info_.bytesProgress << " bytes";
 
@@ -367,7 +374,9 @@ private:
     }
 
     mutable std::shared_ptr<OptimisticMetaOutgoingInfo> metaInfo_;
-    mutable std::ifstream input_;
+    // Kept until destroyed, sendFile() may be reading it
+    std::unique_ptr<fileutils::FileReader> input_;
+    mutable std::atomic_bool inputClosed_ {false};
     mutable bool headerSent_ {false};
     bool peerReady_ {false};
     const std::string peerUri_;
@@ -385,8 +394,8 @@ SubOutgoingFileTransfer::SubOutgoingFileTransfer(DRing::DataTransferId tid,
     , peerUri_(peerUri)
 {
     info_ = metaInfo_->info();
-    fileutils::openStream(input_, info_.path, std::ios::in | std::ios::binary);
-    if (!input_)
+    input_ = std::make_unique<fileutils::FileReader>(info_.path);
+    if (!*input_)
         throw std::runtime_error("input file open failed");
     metaInfo_->addLinkedTransfer(this);
 }
@@ -407,7 +416,7 @@ void
 SubOutgoingFileTransfer::closeAndEmit(DRing::DataTransferEventCode code) const noexcept
 {
     started_ = false; // NOTE: replace DataTransfer::close(); which is non const
-    input_.close();
+    inputClosed_ = true;
 
     if (info_.lastEvent < DRing::DataTransferEventCode::finished)
         emit(code);
@@ -717,13 +726,15 @@ FileInfo::emit(DRing::DataTransferEventCode code)
         finishedCb_(uint32_t(code));
     if (interactionId_ != "") {
         // Else it's an internal transfer
-        runOnMainThread([info = info_, iid = interactionId_, fid = fileId_, code]() {
-            emitSignal<DRing::DataTransferSignal::DataTransferEvent>(info.accountId,
-                                                                     info.conversationId,
-                                                                     iid,
-                                                                     fid,
-                                                                     uint32_t(code));
-        });
+        runOnMainThread(
+            [info = info_, iid = interactionId_, fid = fileId_, code]() {
+                emitSignal<DRing::DataTransferSignal::DataTransferEvent>(info.accountId,
+                                                                         info.conversationId,
+                                                                         iid,
+                                                                         fid,
+                                                                         uint32_t(code));
+            },
+            ScheduledExecutor::Priority::Low);
     }
 }
 
@@ -741,8 +752,9 @@ OutgoingFile::OutgoingFile(const std::shared_ptr<ChannelSocket>& channel,
         channel_->shutdown();
         return;
     }
-    fileutils::openStream(stream_, info_.path, std::ios::binary | std::ios::in);
-    if (!stream_ || !stream_.is_open()) {
+    file_ = std::make_unique<fileutils::FileReader>(info_.path);
+    if (!*file_) {
+        file_.reset();
         channel_->shutdown();
         return;
     }
@@ -750,8 +762,6 @@ OutgoingFile::OutgoingFile(const std::shared_ptr<ChannelSocket>& channel,
 
 OutgoingFile::~OutgoingFile()
 {
-    if (stream_ && stream_.is_open())
-        stream_.close();
     if (channel_)
         channel_->shutdown();
 }
@@ -759,26 +769,26 @@ OutgoingFile::~OutgoingFile()
 void
 OutgoingFile::process()
 {
-    if (!channel_ or !stream_ or !stream_.is_open())
+    if (!channel_ or !file_)
         return;
     auto correct = false;
-    stream_.seekg(start_, std::ios::beg);
     try {
-        std::vector<char> buffer(UINT16_MAX, 0);
         std::error_code ec;
-        auto pos = start_;
-        while (!stream_.eof()) {
-            stream_.read(buffer.data(),
-                         end_ > start_ ? std::min(end_ - pos, buffer.size()) : buffer.size());
-            auto gcount = stream_.gcount();
-            pos += gcount;
-            channel_->write(reinterpret_cast<const uint8_t*>(buffer.data()), gcount, ec);
+        uint64_t end = end_ > start_ ? std::min<uint64_t>(end_, file_->size()) : file_->size();
+        uint64_t pos = start_;
+        while (pos < end) {
+            std::size_t len = std::min<uint64_t>(end - pos, UINT16_MAX);
+            auto data = file_->read(pos, len);
+            if (!data)
+                break;
+            channel_->write(data, len, ec);
             if (ec)
                 break;
+            pos += len;
         }
         if (!ec)
             correct = true;
-        stream_.close();
+        file_.reset();
     } catch (...) {
     }
     if (!isUserCancelled_) {
@@ -811,25 +821,51 @@ IncomingFile::IncomingFile(const std::shared_ptr<ChannelSocket>& channel,
                            const DRing::DataTransferInfo& info,
                            const std::string& fileId,
                            const std::string& interactionId,
-                           const std::string& sha3Sum)
+                           const std::string& sha3Sum,
+                           bool resume)
     : FileInfo(channel, fileId, interactionId, info)
     , sha3Sum_(sha3Sum)
 {
-    fileutils::openStream(stream_, info_.path, std::ios::binary | std::ios::out);
-    if (!stream_)
-        return;
+    if (!channel_) {
+        // Striped, each range is written by its own writer
+        std::ofstream stream;
+        if (resume && fileutils::isFile(info_.path))
+            fileutils::openStream(stream, info_.path, std::ios::binary | std::ios::in | std::ios::out);
+        else
+            fileutils::openStream(stream, info_.path, std::ios::binary | std::ios::out);
+        if (!stream)
+            return;
+    } else {
+        // The peer is credited once the data is written, not once received
+        writer_ = std::make_unique<fileutils::AsyncFileWriter>(
+            info_.path,
+            std::ios::binary | std::ios::out,
+            0,
+            [ch = std::weak_ptr<ChannelSocket>(channel_)](std::size_t len) {
+                if (auto channel = ch.lock())
+                    channel->consumed(len);
+            });
+        if (!*writer_)
+            return;
+        if (!sha3Sum_.empty())
+            hasher_ = std::make_unique<fileutils::Sha3Hasher>();
+    }
 
     emit(DRing::DataTransferEventCode::ongoing);
 }
 
 IncomingFile::~IncomingFile()
 {
+    if (rangesTask_)
+        rangesTask_->cancel();
     if (channel_)
         channel_->setOnRecv({});
-    if (stream_ && stream_.is_open())
-        stream_.close();
     if (channel_)
         channel_->shutdown();
+    for (auto& [_, range] : ranges_) {
+        range.channel->setOnRecv({});
+        range.channel->shutdown();
+    }
 }
 
 void
@@ -839,16 +875,467 @@ IncomingFile::cancel()
     emit(DRing::DataTransferEventCode::closed_by_peer);
     if (channel_)
         channel_->shutdown();
+    std::vector<std::shared_ptr<ChannelSocket>> channels;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        for (const auto& [_, range] : ranges_)
+            channels.emplace_back(range.channel);
+    }
+    for (const auto& channel : channels)
+        channel->shutdown();
+}
+
+void
+IncomingFile::finish(bool received, bool verified)
+{
+    auto correct = received && (sha3Sum_.empty() || verified);
+    if (received && verified) {
+        JAMI_INFO() << "New file received, all its chunks verified: " << info_.path;
+    } else if (received && !correct) {
+        // Verify shaSum. The file is only read again if it doesn't contain
+        // exactly what was received (e.g. a write failed, or a striped transfer)
+        std::string sha3Sum;
+        if (hasher_ && static_cast<int64_t>(hashed_) == fileutils::size(info_.path))
+            sha3Sum = hasher_->digest();
+        else
+            sha3Sum = fileutils::sha3File(info_.path);
+        if (sha3Sum_ == sha3Sum) {
+            JAMI_INFO() << "New file received: " << info_.path;
+            correct = true;
+        } else {
+            JAMI_WARN() << "Remove file, invalid sha3sum detected for " << info_.path;
+            fileutils::remove(info_.path, true);
+        }
+    } else if (!received && !chunks_.empty()) {
+        JAMI_WARN() << "Incomplete file kept to be resumed: " << info_.path;
+    } else if (!received) {
+        JAMI_WARN() << "Remove file, incomplete ranges received for " << info_.path;
+        fileutils::remove(info_.path, true);
+    }
+    if (isUserCancelled_)
+        return;
+    auto code = correct ? DRing::DataTransferEventCode::finished
+                        : DRing::DataTransferEventCode::closed_by_host;
+    emit(code);
+}
+
+bool
+IncomingFile::addRange(const std::shared_ptr<ChannelSocket>& channel,
+                       std::size_t start,
+                       std::size_t end)
+{
+    auto added = false;
+    auto complete = false;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        if (finished_ || rangeFailed_ || start >= end)
+            return false;
+        if (!chunks_.empty()) {
+            auto index = start / chunkSize_;
+            if (start % chunkSize_ != 0 || index >= chunks_.size()
+                || end != std::min<std::size_t>(start + chunkSize_, info_.totalSize))
+                return false;
+            auto& chunk = chunks_[index];
+            holders_.emplace(channel->deviceId().toString());
+            if (chunk.state == ChunkState::RECEIVING || chunk.state == ChunkState::RECEIVED) {
+                // Another device holding the file, give it a chunk to send
+                askNextChunk(channel->deviceId().toString());
+                // Unless all of them were received before the transfer was resumed
+                complete = rangesReceived_ >= static_cast<std::size_t>(info_.totalSize);
+                finished_ = complete;
+            } else {
+                chunk.state = ChunkState::RECEIVING;
+                chunk.deviceId = channel->deviceId().toString();
+                added = true;
+            }
+        } else {
+            added = ranges_.find(start) == ranges_.end();
+        }
+        if (added) {
+            ranges_.erase(start);
+            auto& range = ranges_[start];
+            range.channel = channel;
+            range.end = end;
+            range.pos = start;
+            range.lastData = std::chrono::steady_clock::now();
+            if (!chunks_.empty())
+                range.hasher = std::make_unique<fileutils::Sha3Hasher>();
+            range.writer = std::make_shared<fileutils::AsyncFileWriter>(
+                info_.path,
+                std::ios::binary | std::ios::in | std::ios::out,
+                start,
+                [ch = std::weak_ptr<ChannelSocket>(channel)](std::size_t len) {
+                    if (auto channel = ch.lock())
+                        channel->consumed(len);
+                });
+            if (!rangesTask_)
+                rangesTask_ = Manager::instance().scheduler().scheduleAtFixedRate(
+                    [w = weak()] {
+                        auto shared = w.lock();
+                        return shared && shared->checkRanges(std::chrono::steady_clock::now());
+                    },
+                    RANGE_TIMEOUT / 2);
+        }
+    }
+    sendRequests();
+    if (complete && verifyResumedChunks())
+        finish(true, true);
+    if (!added)
+        return false;
+    channel->setManualCredit();
+    channel->setOnRecv([w = weak(), ch = channel.get(), start](const uint8_t* buf, size_t len) {
+        auto written = std::size_t {0};
+        if (auto shared = w.lock())
+            written = shared->onRangeData(ch, start, buf, len);
+        // What is not written is done with now
+        if (written < len)
+            ch->consumed(len - written);
+        return len;
+    });
+    channel->onShutdown([w = weak(), ch = channel.get(), start] {
+        if (auto shared = w.lock())
+            shared->onRangeShutdown(ch, start);
+    });
+    return true;
+}
+
+void
+IncomingFile::setChunks(std::vector<std::string>&& chunkSums,
+                        const std::vector<bool>& received,
+                        AskRangeCb&& askRange,
+                        ChunkCb&& onChunk)
+{
+    std::lock_guard<std::mutex> lk(rangesMtx_);
+    chunkSize_ = fileChunkSize(info_.totalSize);
+    chunkSums_ = std::move(chunkSums);
+    chunks_.resize(chunkSums_.size());
+    // The chunks received must still be in the file
+    auto size = received.empty() ? 0 : fileutils::size(info_.path);
+    for (std::size_t i = 0; i < std::min(received.size(), chunks_.size()); ++i) {
+        auto start = i * chunkSize_;
+        auto end = std::min<std::size_t>(start + chunkSize_, info_.totalSize);
+        if (received[i] && static_cast<int64_t>(end) <= size) {
+            chunks_[i].state = ChunkState::RECEIVED;
+            rangesReceived_ += end - start;
+            info_.bytesProgress += end - start;
+            resumed_ = true;
+        }
+    }
+    if (resumed_)
+        JAMI_DBG() << "Resume " << info_.path << " from " << rangesReceived_ << " bytes";
+    for (std::size_t i = 0; i < std::min(TRANSFER_STRIPES, chunks_.size()); ++i)
+        if (chunks_[i].state == ChunkState::PENDING)
+            chunks_[i].state = ChunkState::ASKED;
+    askRange_ = std::move(askRange);
+    onChunk_ = std::move(onChunk);
+}
+
+void
+IncomingFile::setAskRange(AskRangeCb&& askRange)
+{
+    std::lock_guard<std::mutex> lk(rangesMtx_);
+    askRange_ = std::move(askRange);
+}
+
+bool
+IncomingFile::checkRanges(std::chrono::steady_clock::time_point now)
+{
+    std::vector<std::shared_ptr<ChannelSocket>> stuck;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        if (finished_)
+            return false;
+        for (const auto& [start, range] : ranges_) {
+            if (!range.done && now - range.lastData >= RANGE_TIMEOUT) {
+                JAMI_WARN() << "Range " << start << "-" << range.end << " of " << info_.path
+                            << " receives nothing, interrupt it";
+                stuck.emplace_back(range.channel);
+            }
+        }
+    }
+    // Asked again once closed, see onRangeClosed()
+    for (const auto& channel : stuck)
+        channel->shutdown();
+    return true;
+}
+
+void
+IncomingFile::onRangeFailed(std::size_t start, const std::string& deviceId)
+{
+    std::vector<std::shared_ptr<ChannelSocket>> others;
+    auto finished = false;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        if (chunks_.empty() || finished_ || rangeFailed_ || start % chunkSize_ != 0
+            || start / chunkSize_ >= chunks_.size())
+            return;
+        auto index = start / chunkSize_;
+        auto& chunk = chunks_[index];
+        if (chunk.state != ChunkState::ASKED)
+            return;
+        if (!deviceId.empty()) {
+            chunk.declined.emplace(deviceId);
+            // The requests sent to all the devices fail for the ones not holding the file
+            if (chunk.deviceId != deviceId)
+                return;
+            chunk.deviceId.clear();
+            requests_.emplace_back(chunkRequest({}, index));
+        } else if (chunk.deviceId.empty()) {
+            // Declined by all the devices, ask the next one holding the file
+            auto next = std::find_if(holders_.begin(), holders_.end(), [&](const auto& holder) {
+                return chunk.declined.find(holder) == chunk.declined.end();
+            });
+            if (next != holders_.end()) {
+                chunk.deviceId = *next;
+                requests_.emplace_back(chunkRequest(*next, index));
+            } else {
+                JAMI_WARN() << "Chunk " << index << " of " << info_.path
+                            << " declined by all the devices";
+                rangeFailed_ = true;
+                // The file can't be complete, stop receiving the other ranges
+                for (const auto& [_, r] : ranges_)
+                    if (!r.done)
+                        others.emplace_back(r.channel);
+                requests_.clear();
+                finished = others.empty() && closingRanges_ == 0;
+                finished_ = finished;
+            }
+        } else {
+            return;
+        }
+    }
+    sendRequests();
+    for (const auto& channel : others)
+        channel->shutdown();
+    if (finished)
+        finish(false);
+}
+
+void
+IncomingFile::askNextChunk(const std::string& deviceId)
+{
+    if (deviceId.empty() || finished_ || rangeFailed_)
+        return;
+    // A chunk not asked yet, or else asked to all the devices and not answered
+    auto next = chunks_.end();
+    for (auto it = chunks_.begin(); it != chunks_.end(); ++it) {
+        if (it->state == ChunkState::PENDING) {
+            next = it;
+            break;
+        }
+        if (next == chunks_.end() && it->state == ChunkState::ASKED && it->deviceId.empty()
+            && it->declined.find(deviceId) == it->declined.end())
+            next = it;
+    }
+    if (next == chunks_.end())
+        return;
+    next->state = ChunkState::ASKED;
+    next->deviceId = deviceId;
+    requests_.emplace_back(chunkRequest(deviceId, next - chunks_.begin()));
+}
+
+void
+IncomingFile::sendRequests()
+{
+    std::vector<Request> requests;
+    AskRangeCb askRange;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        requests = std::move(requests_);
+        requests_.clear();
+        askRange = askRange_;
+    }
+    if (!askRange)
+        return;
+    for (const auto& request : requests)
+        askRange(request.deviceId, request.start, request.end);
+}
+
+bool
+IncomingFile::verifyResumedChunks()
+{
+    if (!resumed_)
+        return true;
+    // Nothing is written anymore, the file is read once for all the chunks
+    std::vector<std::string> sums;
+    fileutils::sha3File(info_.path, chunkSize_, sums);
+    std::vector<std::size_t> corrupted;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        resumed_ = false;
+        for (std::size_t i = 0; i < chunks_.size(); ++i) {
+            if (i < sums.size() && sums[i] == chunkSums_[i])
+                continue;
+            auto start = i * chunkSize_;
+            auto len = std::min<std::size_t>(start + chunkSize_, info_.totalSize) - start;
+            rangesReceived_ -= len;
+            info_.bytesProgress -= len;
+            ranges_.erase(start);
+            chunks_[i].state = ChunkState::ASKED;
+            chunks_[i].deviceId.clear();
+            requests_.emplace_back(chunkRequest({}, i));
+            corrupted.emplace_back(i);
+        }
+        if (!corrupted.empty()) {
+            JAMI_WARN() << corrupted.size() << " chunks of " << info_.path
+                        << " are corrupted, ask them again";
+            finished_ = false;
+        }
+    }
+    if (onChunk_)
+        for (auto i : corrupted)
+            onChunk_(i, false);
+    sendRequests();
+    return corrupted.empty();
+}
+
+std::size_t
+IncomingFile::onRangeData(const ChannelSocket* channel,
+                          std::size_t start,
+                          const uint8_t* buf,
+                          std::size_t len)
+{
+    std::shared_ptr<ChannelSocket> complete;
+    std::shared_ptr<fileutils::AsyncFileWriter> writer;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        auto it = ranges_.find(start);
+        if (it == ranges_.end() || it->second.done || it->second.channel.get() != channel)
+            return 0;
+        auto& range = it->second;
+        len = std::min(len, range.end - range.pos);
+        range.lastData = std::chrono::steady_clock::now();
+        writer = range.writer;
+        if (range.hasher)
+            range.hasher->update(buf, len);
+        range.pos += len;
+        info_.bytesProgress += len;
+        if (range.pos == range.end)
+            complete = range.channel;
+    }
+    // The writes of a channel are ordered by its callback, and credited once on the disk
+    if (!writer || !writer->write(buf, len))
+        len = 0;
+    // The sender may wait for the range to be closed
+    if (complete)
+        complete->shutdown();
+    return len;
+}
+
+void
+IncomingFile::onRangeShutdown(const ChannelSocket* channel, std::size_t start)
+{
+    std::shared_ptr<fileutils::AsyncFileWriter> writer;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        auto it = ranges_.find(start);
+        if (it == ranges_.end() || it->second.done || it->second.channel.get() != channel)
+            return;
+        it->second.done = true;
+        writer = std::move(it->second.writer);
+        closingRanges_++;
+    }
+    // Once what was received is written
+    writer->close([w = weak(), channel, start](bool ok) {
+        if (auto shared = w.lock())
+            shared->onRangeClosed(channel, start, ok);
+    });
+}
+
+void
+IncomingFile::onRangeClosed(const ChannelSocket* channel, std::size_t start, bool written)
+{
+    std::vector<std::shared_ptr<ChannelSocket>> others;
+    auto finished = false;
+    auto received = false;
+    auto chunkReceived = false;
+    {
+        std::lock_guard<std::mutex> lk(rangesMtx_);
+        closingRanges_--;
+        auto it = ranges_.find(start);
+        if (it == ranges_.end() || it->second.channel.get() != channel)
+            return;
+        auto& range = it->second;
+        auto complete = range.pos == range.end && written;
+        if (!chunks_.empty()) {
+            auto index = start / chunkSize_;
+            auto& chunk = chunks_[index];
+            if (complete && range.hasher->digest() == chunkSums_[index]) {
+                chunk.state = ChunkState::RECEIVED;
+                chunkReceived = true;
+                rangesReceived_ += range.end - start;
+                // Its device holds the file, keep it busy
+                askNextChunk(chunk.deviceId);
+            } else {
+                JAMI_WARN() << "Chunk " << index << " of " << info_.path
+                            << (complete ? " is corrupted" : " is incomplete")
+                            << ", ask it again";
+                info_.bytesProgress -= range.pos - start;
+                ranges_.erase(it);
+                chunk.deviceId.clear();
+                if (++chunkFailures_ > MAX_CHUNK_FAILURES) {
+                    rangeFailed_ = true;
+                } else {
+                    chunk.state = ChunkState::ASKED;
+                    requests_.emplace_back(chunkRequest({}, index));
+                }
+            }
+        } else if (complete) {
+            rangesReceived_ += range.end - start;
+        } else if (askRange_ && ++rangeRetries_ <= MAX_RANGE_RETRIES) {
+            // Ask the rest again, what was written is kept
+            auto from = written ? range.pos : start;
+            JAMI_WARN() << "Range " << start << "-" << range.end << " of " << info_.path
+                        << " interrupted, ask it again from " << from;
+            rangesReceived_ += from - start;
+            info_.bytesProgress -= range.pos - from;
+            requests_.push_back({std::string {}, from, range.end});
+            ranges_.erase(it);
+        } else {
+            rangeFailed_ = true;
+        }
+
+        if (rangeFailed_) {
+            // The file can't be complete, stop receiving the other ranges
+            for (const auto& [_, r] : ranges_)
+                if (!r.done)
+                    others.emplace_back(r.channel);
+            requests_.clear();
+            finished = others.empty() && closingRanges_ == 0;
+        } else {
+            finished = rangesReceived_ >= static_cast<std::size_t>(info_.totalSize);
+        }
+        finished = finished && !finished_;
+        finished_ = finished_ || finished;
+        received = !rangeFailed_;
+    }
+    if (chunkReceived && onChunk_)
+        onChunk_(start / chunkSize_, true);
+    sendRequests();
+    for (const auto& channel : others)
+        channel->shutdown();
+    if (finished && received && !verifyResumedChunks())
+        return;
+    if (finished)
+        finish(received, received && !chunks_.empty());
 }
 
 void
 IncomingFile::process()
 {
+    if (!writer_)
+        return;
+    channel_->setManualCredit();
     channel_->setOnRecv([w = weak()](const uint8_t* buf, size_t len) {
         if (auto shared = w.lock()) {
-            if (shared->stream_.is_open())
-                shared->stream_.write(reinterpret_cast<const char*>(buf), len);
-            shared->info_.bytesProgress = shared->stream_.tellp();
+            // Not written yet: the peer waits for the credit of the writer if the disk is slow
+            if (shared->writer_->write(buf, len)) {
+                if (shared->hasher_) {
+                    shared->hasher_->update(buf, len);
+                    shared->hashed_ += len;
+                }
+                shared->info_.bytesProgress += len;
+            }
         }
         return len;
     });
@@ -856,30 +1343,39 @@ IncomingFile::process()
         auto shared = w.lock();
         if (!shared)
             return;
-        auto correct = shared->sha3Sum_.empty();
-        if (!correct) {
-            if (shared->stream_ && shared->stream_.is_open())
-                shared->stream_.close();
-            // Verify shaSum
-            auto sha3Sum = fileutils::sha3File(shared->info_.path);
-            if (shared->sha3Sum_ == sha3Sum) {
-                JAMI_INFO() << "New file received: " << shared->info_.path;
-                correct = true;
-            } else {
-                JAMI_WARN() << "Remove file, invalid sha3sum detected for " << shared->info_.path;
-                fileutils::remove(shared->info_.path, true);
-            }
-        }
-        if (shared->isUserCancelled_)
-            return;
-        auto code = correct ? DRing::DataTransferEventCode::finished
-                            : DRing::DataTransferEventCode::closed_by_host;
-        shared->emit(code);
+        // Verified once written
+        shared->writer_->close([w](bool) {
+            if (auto shared = w.lock())
+                shared->finish(true);
+        });
     });
 }
 
 //==============================================================================
 
+/**
+ * Range asked in the name of a file channel, as "...?start=0&end=42"
+ * @return {0, 0} for the whole file
+ */
+static std::pair<std::size_t, std::size_t>
+channelRange(std::string_view name)
+{
+    std::size_t start = 0, end = 0;
+    auto sep = name.find_last_of('?');
+    if (sep == std::string_view::npos)
+        return {0, 0};
+    for (const auto arg : split_string(name.substr(sep + 1), '&')) {
+        auto keyVal = split_string(arg, '=');
+        if (keyVal.size() == 2) {
+            if (keyVal[0] == "start")
+                std::from_chars(keyVal[1].data(), keyVal[1].data() + keyVal[1].size(), start);
+            else if (keyVal[0] == "end")
+                std::from_chars(keyVal[1].data(), keyVal[1].data() + keyVal[1].size(), end);
+        }
+    }
+    return {start, end};
+}
+
 class TransferManager::Impl
 {
 public:
@@ -893,6 +1389,8 @@ public:
                                     + to_;
             fileutils::check_dir(conversationDataPath_.c_str());
             waitingPath_ = conversationDataPath_ + DIR_SEPARATOR_STR + "waiting";
+            storePath_ = fileutils::get_data_dir() + DIR_SEPARATOR_STR + accountId_
+                         + DIR_SEPARATOR_STR + "file_store";
         }
         profilesPath_ = fileutils::get_data_dir() + DIR_SEPARATOR_STR + accountId_
                         + DIR_SEPARATOR_STR + "profiles";
@@ -929,11 +1427,46 @@ public:
         msgpack::pack(file, waitingIds_);
     }
 
+    /**
+     * @return where the file with this sum is stored, empty if the sum is invalid
+     */
+    std::string storedPath(std::string_view sha3sum) const
+    {
+        // The sum comes from the peers, it must not lead out of the store
+        if (storePath_.empty() || sha3sum.size() != 128
+            || !std::all_of(sha3sum.begin(), sha3sum.end(), [](unsigned char c) {
+                   return std::isxdigit(c);
+               }))
+            return {};
+        return fmt::format("{}{}{}", storePath_, DIR_SEPARATOR_STR, sha3sum);
+    }
+
+    /**
+     * Add a received or sent file to the account's store, as a hard link named by its sum.
+     * The files of the store are shared by all the conversations of the account, and left
+     * once the store's link is the only one.
+     */
+    void storeFile(const std::string& path, const std::string& sha3sum)
+    {
+        auto stored = storedPath(sha3sum);
+        if (stored.empty() || !fileutils::isFile(path, false))
+            return;
+        fileutils::check_dir(storePath_.c_str());
+        for (const auto& name : fileutils::readDirectory(storePath_)) {
+            auto file = storePath_ + DIR_SEPARATOR_STR + name;
+            if (fileutils::linkCount(file) == 1)
+                fileutils::remove(file);
+        }
+        if (!fileutils::isFile(stored, false))
+            fileutils::createHardlink(stored, path);
+    }
+
     std::string accountId_ {};
     std::string to_ {};
     std::string waitingPath_ {};
     std::string profilesPath_ {};
     std::string conversationDataPath_ {};
+    std::string storePath_ {};
 
     // Pre swarm
     std::map<DRing::DataTransferId, std::shared_ptr<OutgoingFileTransfer>> oMap_ {};
@@ -1191,13 +1724,14 @@ TransferManager::waitForTransfer(const std::string& fileId,
                                  const std::string& interactionId,
                                  const std::string& sha3sum,
                                  const std::string& path,
-                                 std::size_t total)
+                                 std::size_t total,
+                                 const std::vector<std::string>& chunkSums)
 {
     std::unique_lock<std::mutex> lk(pimpl_->mapMutex_);
     auto itW = pimpl_->waitingIds_.find(fileId);
     if (itW != pimpl_->waitingIds_.end())
         return;
-    pimpl_->waitingIds_[fileId] = {fileId, interactionId, sha3sum, path, total};
+    pimpl_->waitingIds_[fileId] = {fileId, interactionId, sha3sum, path, total, chunkSums};
     JAMI_DBG() << "Wait for " << fileId;
     if (!pimpl_->to_.empty())
         pimpl_->saveWaiting();
@@ -1214,11 +1748,14 @@ void
 TransferManager::onIncomingFileTransfer(const std::string& fileId,
                                         const std::shared_ptr<ChannelSocket>& channel)
 {
+    auto [start, end] = channelRange(channel->name());
     std::lock_guard<std::mutex> lk(pimpl_->mapMutex_);
     // Check if not already an incoming file for this id and that we are waiting this file
     auto itC = pimpl_->incomings_.find(fileId);
     if (itC != pimpl_->incomings_.end()) {
-        channel->shutdown();
+        // Unless it's another range of a striped transfer
+        if (end == 0 || !itC->second->addRange(channel, start, end))
+            channel->shutdown();
         return;
     }
     auto itW = pimpl_->waitingIds_.find(fileId);
@@ -1226,6 +1763,7 @@ TransferManager::onIncomingFileTransfer(const std::string& fileId,
         channel->shutdown();
         return;
     }
+    auto striped = end != 0 && (start != 0 || end < itW->second.totalSize);
 
     DRing::DataTransferInfo info;
     info.accountId = pimpl_->accountId_;
@@ -1246,18 +1784,28 @@ TransferManager::onIncomingFileTransfer(const std::string& fileId,
         fileutils::createFileLink(filePath, info.path);
     }
 
-    auto ifile = std::make_shared<IncomingFile>(std::move(channel),
+    const auto& receivedChunks = itW->second.receivedChunks;
+    auto resume = striped && !itW->second.chunkSums.empty()
+                  && std::find(receivedChunks.begin(), receivedChunks.end(), true)
+                         != receivedChunks.end();
+    auto ifile = std::make_shared<IncomingFile>(striped ? nullptr : channel,
                                                 info,
                                                 fileId,
                                                 itW->second.interactionId,
-                                                itW->second.sha3sum);
+                                                itW->second.sha3sum,
+                                                resume);
     auto res = pimpl_->incomings_.emplace(fileId, std::move(ifile));
     if (res.second) {
-        res.first->second->onFinished([w = weak(), fileId](uint32_t code) {
+        res.first->second->onFinished([w = weak(),
+                                       fileId,
+                                       path = info.path,
+                                       sha3sum = itW->second.sha3sum](uint32_t code) {
             // schedule destroy transfer as not needed
-            dht::ThreadPool().computation().run([w, fileId, code] {
+            dht::ThreadPool().computation().run([w, fileId, path, sha3sum, code] {
                 if (auto sthis_ = w.lock()) {
                     auto& pimpl = sthis_->pimpl_;
+                    if (code == uint32_t(DRing::DataTransferEventCode::finished))
+                        pimpl->storeFile(path, sha3sum);
                     std::lock_guard<std::mutex> lk {pimpl->mapMutex_};
                     auto itO = pimpl->incomings_.find(fileId);
                     if (itO != pimpl->incomings_.end())
@@ -1272,10 +1820,120 @@ TransferManager::onIncomingFileTransfer(const std::string& fileId,
                 }
             });
         });
-        res.first->second->process();
+        IncomingFile::AskRangeCb askRange =
+            [accountId = pimpl_->accountId_,
+             conversationId = pimpl_->to_,
+             interactionId = itW->second.interactionId,
+             fileId](const std::string& deviceId, std::size_t start, std::size_t end) {
+                // Not from the channel's callbacks, nor with the transfers locked
+                dht::ThreadPool::io().run([=] {
+                    if (auto acc = Manager::instance().getAccount<JamiAccount>(accountId))
+                        acc->askForFileChannel(conversationId,
+                                               deviceId,
+                                               interactionId,
+                                               fileId,
+                                               start,
+                                               end);
+                });
+            };
+        if (striped && itW->second.chunkSums.empty()) {
+            res.first->second->setAskRange(std::move(askRange));
+        } else if (striped) {
+            auto chunkSums = itW->second.chunkSums;
+            res.first->second->setChunks(
+                std::move(chunkSums),
+                resume ? receivedChunks : std::vector<bool> {},
+                std::move(askRange),
+                [w = weak(), fileId, count = itW->second.chunkSums.size()](std::size_t index,
+                                                                            bool received) {
+                    // Saved for the transfer to be resumed, not with the file locked
+                    dht::ThreadPool::io().run([w, fileId, count, index, received] {
+                        auto shared = w.lock();
+                        if (!shared)
+                            return;
+                        std::lock_guard<std::mutex> lk(shared->pimpl_->mapMutex_);
+                        auto itW = shared->pimpl_->waitingIds_.find(fileId);
+                        if (itW == shared->pimpl_->waitingIds_.end())
+                            return;
+                        itW->second.receivedChunks.resize(count);
+                        itW->second.receivedChunks[index] = received;
+                        shared->pimpl_->saveWaiting();
+                    });
+                });
+        }
+        if (striped)
+            res.first->second->addRange(channel, start, end);
+        else
+            res.first->second->process();
     }
 }
 
+bool
+TransferManager::linkStoredFile(const std::string& fileId,
+                                const std::string& interactionId,
+                                const std::string& sha3sum,
+                                const std::string& path,
+                                std::size_t total)
+{
+    auto stored = pimpl_->storedPath(sha3sum);
+    if (stored.empty() || !fileutils::isFile(stored, false))
+        return false;
+    // The other links may have been modified since
+    if (fileutils::linkCount(stored) < 2 || fileutils::size(stored) != static_cast<int64_t>(total)
+        || fileutils::sha3File(stored) != sha3sum) {
+        fileutils::remove(stored);
+        return false;
+    }
+
+    auto filePath = this->path(fileId);
+    auto dest = path.empty() ? filePath : path;
+    if (fileutils::isFile(dest, false))
+        fileutils::remove(dest);
+    if (!fileutils::createHardlink(dest, stored))
+        return false;
+    if (!path.empty())
+        fileutils::createFileLink(filePath, path);
+    JAMI_DBG() << "File " << fileId << " already stored, linked to " << dest;
+
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->mapMutex_);
+        auto itW = pimpl_->waitingIds_.find(fileId);
+        if (itW != pimpl_->waitingIds_.end()) {
+            pimpl_->waitingIds_.erase(itW);
+            pimpl_->saveWaiting();
+        }
+    }
+    emitSignal<DRing::DataTransferSignal::DataTransferEvent>(
+        pimpl_->accountId_,
+        pimpl_->to_,
+        interactionId,
+        fileId,
+        uint32_t(DRing::DataTransferEventCode::finished));
+    return true;
+}
+
+void
+TransferManager::storeFile(const std::string& path, const std::string& sha3sum)
+{
+    pimpl_->storeFile(path, sha3sum);
+}
+
+void
+TransferManager::onFileChannelFailed(const std::string& fileId,
+                                     std::size_t start,
+                                     const std::string& deviceId)
+{
+    std::shared_ptr<IncomingFile> incoming;
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->mapMutex_);
+        auto itC = pimpl_->incomings_.find(fileId);
+        if (itC == pimpl_->incomings_.end())
+            return;
+        incoming = itC->second;
+    }
+    incoming->onRangeFailed(start, deviceId);
+}
+
 std::string
 TransferManager::path(const std::string& fileId) const
 {
@@ -1379,4 +2037,12 @@ TransferManager::isWaiting(const std::string& fileId) const
     return pimpl_->waitingIds_.find(fileId) != pimpl_->waitingIds_.end();
 }
 
+bool
+TransferManager::hasTransfers() const
+{
+    std::lock_guard<std::mutex> lk(pimpl_->mapMutex_);
+    return !pimpl_->outgoings_.empty() || !pimpl_->incomings_.empty() || !pimpl_->vcards_.empty()
+           || !pimpl_->oMap_.empty() || !pimpl_->iMap_.empty();
+}
+
 } // namespace jami
@@ -21,10 +21,17 @@
 #pragma once
 
 #include "jami/datatransfer_interface.h"
+#include "fileutils.h"
 #include "jamidht/multiplexed_socket.h"
 #include "noncopyable.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <set>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <fstream>
 #include <optional>
@@ -33,7 +40,23 @@ namespace jami {
 
 DRing::DataTransferId generateUID();
 
+// Files at least this big are downloaded by ranges, asked on as many channels
+static constexpr std::size_t STRIPED_TRANSFER_MIN_SIZE {64 * 1024 * 1024};
+static constexpr std::size_t TRANSFER_STRIPES {4};
+
+// Such files are shared with the sums of their chunks (see fileChunkSize()), so that any
+// member's device holding them can send some of the chunks
+static constexpr uint64_t FILE_CHUNK_MIN_SIZE {16 * 1024 * 1024};
+static constexpr uint64_t FILE_MAX_CHUNKS {64};
+
+inline uint64_t
+fileChunkSize(uint64_t totalSize)
+{
+    return std::max(FILE_CHUNK_MIN_SIZE, (totalSize + FILE_MAX_CHUNKS - 1) / FILE_MAX_CHUNKS);
+}
+
 class Stream;
+class RepeatedTask;
 
 struct IncomingFileInfo
 {
@@ -48,7 +71,9 @@ struct WaitingRequest
     std::string sha3sum;
     std::string path;
     std::size_t totalSize;
-    MSGPACK_DEFINE(fileId, interactionId, sha3sum, path, totalSize)
+    std::vector<std::string> chunkSums {};
+    std::vector<bool> receivedChunks {}; // To resume the transfer
+    MSGPACK_DEFINE(fileId, interactionId, sha3sum, path, totalSize, chunkSums, receivedChunks)
 };
 
 typedef std::function<void(const std::string&)> InternalCompletionCb;
@@ -82,22 +107,153 @@ protected:
 class IncomingFile : public FileInfo, public std::enable_shared_from_this<IncomingFile>
 {
 public:
+    /**
+     * @param resume    For a striped transfer, keep what the file contains
+     */
     IncomingFile(const std::shared_ptr<ChannelSocket>& channel,
                  const DRing::DataTransferInfo& info,
                  const std::string& fileId,
                  const std::string& interactionId,
-                 const std::string& sha3Sum = "");
+                 const std::string& sha3Sum = "",
+                 bool resume = false);
     ~IncomingFile();
     void process() override;
     void cancel() override;
 
+    /**
+     * For a striped transfer, created without channel: receive [start, end)
+     * of the file on channel. The transfer is finished once the ranges
+     * received cover the whole file, or failed if one of them is incomplete and can't be
+     * asked again.
+     * @return false if that range is already received
+     */
+    bool addRange(const std::shared_ptr<ChannelSocket>& channel, std::size_t start, std::size_t end);
+
+    using AskRangeCb
+        = std::function<void(const std::string& deviceId, std::size_t start, std::size_t end)>;
+    using ChunkCb = std::function<void(std::size_t index, bool received)>;
+    /**
+     * Receive the file by chunks, each one verified with its sum.
+     * The first TRANSFER_STRIPES chunks are supposed asked to all the devices. Then, each
+     * device sending a chunk, or offering one already received, is asked the next chunk
+     * missing. A corrupted or interrupted chunk is asked again.
+     * If the transfer fails, the file is kept so that it can be resumed.
+     * @param chunkSums     Sums of the chunks of fileChunkSize() bytes
+     * @param received      Chunks received by a previous transfer, verified again at the end
+     * @param askRange      Ask [start, end) to deviceId, or to all the devices if empty
+     * @param onChunk       Called when a chunk is received, or found corrupted
+     */
+    void setChunks(std::vector<std::string>&& chunkSums,
+                   const std::vector<bool>& received,
+                   AskRangeCb&& askRange,
+                   ChunkCb&& onChunk);
+    /**
+     * Without chunks: a range interrupted is asked again to all the devices from where it
+     * stopped, instead of failing the transfer
+     */
+    void setAskRange(AskRangeCb&& askRange);
+
+    // A range receiving nothing for that long is interrupted, to be asked again
+    static constexpr std::chrono::seconds RANGE_TIMEOUT {30};
+    /**
+     * Interrupt the ranges receiving nothing for RANGE_TIMEOUT.
+     * Called periodically once a range is added.
+     * @return false once the transfer is finished
+     */
+    bool checkRanges(std::chrono::steady_clock::time_point now);
+    /**
+     * The range asked to a device can't be received from it
+     * @param deviceId      Empty once all the devices asked declined it
+     */
+    void onRangeFailed(std::size_t start, const std::string& deviceId);
+
 private:
     std::weak_ptr<IncomingFile> weak()
     {
         return std::static_pointer_cast<IncomingFile>(shared_from_this());
     }
-    std::ofstream stream_;
+    /**
+     * @return the bytes given to the writer of the range, credited to the channel once written
+     */
+    std::size_t onRangeData(const ChannelSocket* channel,
+                            std::size_t start,
+                            const uint8_t* buf,
+                            std::size_t len);
+    void onRangeShutdown(const ChannelSocket* channel, std::size_t start);
+    void onRangeClosed(const ChannelSocket* channel, std::size_t start, bool written);
+    /**
+     * Ask the next chunk missing to deviceId
+     * @note rangesMtx_ must be locked, the request is sent by sendRequests()
+     */
+    void askNextChunk(const std::string& deviceId);
+    void sendRequests();
+    /**
+     * Verify the chunks received before the transfer was resumed, ask again the corrupted ones
+     * @return true if the file is complete
+     */
+    bool verifyResumedChunks();
+    /**
+     * Verify the file and emit the result
+     * @param received  false if some data is missing
+     * @param verified  true if the data received was already verified
+     */
+    void finish(bool received, bool verified = false);
+
+    std::unique_ptr<fileutils::AsyncFileWriter> writer_ {};
     std::string sha3Sum_ {};
+    // Sum of what was written, avoids reading the file again when it's complete
+    std::unique_ptr<fileutils::Sha3Hasher> hasher_ {};
+    uint64_t hashed_ {0};
+
+    // Striped transfer, by start offset
+    struct Range
+    {
+        std::shared_ptr<ChannelSocket> channel;
+        std::shared_ptr<fileutils::AsyncFileWriter> writer;
+        std::size_t end;
+        std::size_t pos;
+        bool done {false};
+        std::unique_ptr<fileutils::Sha3Hasher> hasher {}; // Verified chunk
+        std::chrono::steady_clock::time_point lastData {};
+    };
+    std::mutex rangesMtx_ {};
+    std::map<std::size_t, Range> ranges_ {};
+    std::size_t rangesReceived_ {0}; // bytes of the complete ranges
+    bool rangeFailed_ {false};
+    bool finished_ {false};
+    std::size_t closingRanges_ {0}; // Still writing what they received
+    std::shared_ptr<RepeatedTask> rangesTask_ {}; // calls checkRanges()
+
+    // Chunks, when their sums are known
+    enum class ChunkState { PENDING, ASKED, RECEIVING, RECEIVED };
+    struct Chunk
+    {
+        ChunkState state {ChunkState::PENDING};
+        std::string deviceId {}; // Asked or sending it, empty if asked to all the devices
+        std::set<std::string> declined {};
+    };
+    std::vector<std::string> chunkSums_ {};
+    std::vector<Chunk> chunks_ {};
+    std::size_t chunkSize_ {0};
+    unsigned chunkFailures_ {0};
+    std::set<std::string> holders_ {}; // Devices which opened a range, so hold the file
+    bool resumed_ {false}; // Some chunks are from a previous transfer
+    AskRangeCb askRange_ {};
+    ChunkCb onChunk_ {};
+    unsigned rangeRetries_ {0};
+
+    struct Request
+    {
+        std::string deviceId; // empty to ask all the devices
+        std::size_t start;
+        std::size_t end;
+    };
+    std::vector<Request> requests_ {};
+    Request chunkRequest(const std::string& deviceId, std::size_t index) const
+    {
+        auto start = index * chunkSize_;
+        return {deviceId, start, std::min<std::size_t>(start + chunkSize_, info_.totalSize)};
+    }
 };
 
 class OutgoingFile : public FileInfo
@@ -114,7 +270,7 @@ public:
     void cancel() override;
 
 private:
-    std::ifstream stream_;
+    std::unique_ptr<fileutils::FileReader> file_;
     size_t start_ {0};
     size_t end_ {0};
 };
@@ -206,12 +362,29 @@ public:
      * @param sha3sum         attended sha3sum
      * @param path            where the file will be downloaded
      * @param total           total size of the file
+     * @param chunkSums       sums of its chunks, if known
      */
     void waitForTransfer(const std::string& fileId,
                          const std::string& interactionId,
                          const std::string& sha3sum,
                          const std::string& path,
-                         std::size_t total);
+                         std::size_t total,
+                         const std::vector<std::string>& chunkSums = {});
+
+    /**
+     * Receive the file from the account's store, if a file with this sum was already
+     * received or sent, instead of waiting for it.
+     * @return true if the file is linked to its path, and the transfer finished
+     */
+    bool linkStoredFile(const std::string& fileId,
+                        const std::string& interactionId,
+                        const std::string& sha3sum,
+                        const std::string& path,
+                        std::size_t total);
+    /**
+     * Add a file sent or received to the account's store
+     */
+    void storeFile(const std::string& path, const std::string& sha3sum);
 
     /**
      * Handle incoming transfer
@@ -220,6 +393,14 @@ public:
      */
     void onIncomingFileTransfer(const std::string& fileId,
                                 const std::shared_ptr<ChannelSocket>& channel);
+    /**
+     * The file channel asked can't be opened
+     * @param start     Of the range asked
+     * @param deviceId  Which declined it, empty once all the devices asked did
+     */
+    void onFileChannelFailed(const std::string& fileId,
+                             std::size_t start,
+                             const std::string& deviceId);
 
     /**
      * Retrieve path of a file
@@ -233,6 +414,10 @@ public:
      */
     std::vector<WaitingRequest> waitingRequests() const;
     bool isWaiting(const std::string& fileId) const;
+    /**
+     * @return true while files are being sent or received
+     */
+    bool hasTransfers() const;
     void onIncomingProfile(const std::shared_ptr<ChannelSocket>& channel);
 
     /**
@@ -26,7 +26,9 @@
 #include "fileutils.h"
 #include "archiver.h"
 #include "compiler_intrinsics.h"
+#include "security/password_keys.h"
 #include <opendht/crypto.h>
+#include <opendht/thread_pool.h>
 
 #ifdef RING_UWP
 #include <io.h> // for access and close
@@ -75,7 +77,9 @@
 #include <nettle/sha3.h>
 
 #include <sstream>
+#include <condition_variable>
 #include <fstream>
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <limits>
@@ -370,6 +374,21 @@ createFileLink(const std::string& linkFile, const std::string& target, bool hard
         createSymlink(linkFile, target);
 }
 
+unsigned
+linkCount(const std::string& path)
+{
+#if !USE_STD_FILESYSTEM
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return 0;
+    return st.st_nlink;
+#else
+    std::error_code ec;
+    auto count = std::filesystem::hard_link_count(path, ec);
+    return ec ? 0 : count;
+#endif
+}
+
 std::string_view
 getFileExtension(std::string_view filename)
 {
@@ -464,6 +483,26 @@ saveFile(const std::string& path, const uint8_t* data, size_t data_size, mode_t
 #endif
 }
 
+void
+saveFileAsync(const std::string& path,
+              std::vector<uint8_t>&& data,
+              mode_t mode,
+              std::function<void(bool)>&& cb)
+{
+    dht::ThreadPool::io().run([path, data = std::move(data), mode, cb = std::move(cb)] {
+        auto ok = false;
+        try {
+            std::lock_guard<std::mutex> lk(getFileLock(path));
+            saveFile(path, data, mode);
+            ok = isFile(path);
+        } catch (const std::exception& e) {
+            JAMI_WARN("Failed to save %s: %s", path.c_str(), e.what());
+        }
+        if (cb)
+            cb(ok);
+    });
+}
+
 std::vector<uint8_t>
 loadCacheFile(const std::string& path, std::chrono::system_clock::duration maxAge)
 {
@@ -581,7 +620,7 @@ readArchive(const std::string& path, const std::string& pwd)
     if (!pwd.empty()) {
         // Decrypt
         try {
-            data = dht::crypto::aesDecrypt(data, pwd);
+            data = secure::PasswordKeys::instance().decrypt(path, data, pwd);
         } catch (const std::exception& e) {
             JAMI_ERR("Error decrypting archive: %s", e.what());
             throw e;
@@ -595,14 +634,17 @@ readArchive(const std::string& path, const std::string& pwd)
 }
 
 void
-writeArchive(const std::string& archive_str, const std::string& path, const std::string& password)
+writeArchive(const std::string& archive_str,
+             const std::string& path,
+             const std::string& password,
+             archiver::Codec codec)
 {
     JAMI_DBG("Writing archive to %s", path.c_str());
 
     if (not password.empty()) {
         // Encrypt using provided password
-        std::vector<uint8_t> data = dht::crypto::aesEncrypt(archiver::compress(archive_str),
-                                                            password);
+        auto compressed = archiver::compress(archive_str, codec);
+        auto data = secure::PasswordKeys::instance().encrypt(path, compressed, password);
         // Write
         try {
             saveFile(path, data);
@@ -1056,32 +1098,25 @@ size(const std::string& path)
     return size;
 }
 
-std::string
-sha3File(const std::string& path)
+Sha3Hasher::Sha3Hasher()
+    : ctx_(std::make_unique<sha3_512_ctx>())
 {
-    sha3_512_ctx ctx;
-    sha3_512_init(&ctx);
+    sha3_512_init(ctx_.get());
+}
 
-    std::ifstream file;
-    try {
-        if (!fileutils::isFile(path))
-            return {};
-        openStream(file, path, std::ios::binary | std::ios::in);
-        if (!file)
-            return {};
-        std::vector<char> buffer(8192, 0);
-        while (!file.eof()) {
-            file.read(buffer.data(), buffer.size());
-            std::streamsize readSize = file.gcount();
-            sha3_512_update(&ctx, readSize, (const uint8_t*) buffer.data());
-        }
-        file.close();
-    } catch (...) {
-        return {};
-    }
+Sha3Hasher::~Sha3Hasher() {}
+
+void
+Sha3Hasher::update(const uint8_t* data, std::size_t size)
+{
+    sha3_512_update(ctx_.get(), size, data);
+}
 
+std::string
+Sha3Hasher::digest()
+{
     unsigned char digest[SHA3_512_DIGEST_SIZE];
-    sha3_512_digest(&ctx, SHA3_512_DIGEST_SIZE, digest);
+    sha3_512_digest(ctx_.get(), SHA3_512_DIGEST_SIZE, digest);
 
     char hash[SHA3_512_DIGEST_SIZE * 2];
 
@@ -1091,22 +1126,250 @@ sha3File(const std::string& path)
     return {hash, SHA3_512_DIGEST_SIZE * 2};
 }
 
+std::string
+sha3File(const std::string& path)
+{
+    if (!fileutils::isFile(path))
+        return {};
+    FileReader file(path);
+    if (!file)
+        return {};
+
+    Sha3Hasher hasher;
+    uint64_t pos = 0;
+    while (pos < file.size()) {
+        std::size_t len = std::min<uint64_t>(file.size() - pos, SIZE_MAX);
+        auto data = file.read(pos, len);
+        if (!data)
+            break;
+        hasher.update(data, len);
+        pos += len;
+    }
+    return hasher.digest();
+}
+
+std::string
+sha3File(const std::string& path, uint64_t chunkSize, std::vector<std::string>& chunkSums)
+{
+    chunkSums.clear();
+    if (chunkSize == 0 || !fileutils::isFile(path))
+        return {};
+    FileReader file(path);
+    if (!file)
+        return {};
+
+    // Both sums in one pass
+    Sha3Hasher hasher;
+    Sha3Hasher chunkHasher;
+    uint64_t pos = 0;
+    while (pos < file.size()) {
+        auto chunkEnd = std::min(pos - pos % chunkSize + chunkSize, file.size());
+        std::size_t len = std::min<uint64_t>(chunkEnd - pos, SIZE_MAX);
+        auto data = file.read(pos, len);
+        if (!data)
+            break;
+        hasher.update(data, len);
+        chunkHasher.update(data, len);
+        pos += len;
+        if (pos == chunkEnd)
+            chunkSums.emplace_back(chunkHasher.digest());
+    }
+    return hasher.digest();
+}
+
 std::string
 sha3sum(const std::vector<uint8_t>& buffer)
 {
-    sha3_512_ctx ctx;
-    sha3_512_init(&ctx);
-    sha3_512_update(&ctx, buffer.size(), (const uint8_t*) buffer.data());
+    Sha3Hasher hasher;
+    hasher.update(buffer.data(), buffer.size());
+    return hasher.digest();
+}
 
-    unsigned char digest[SHA3_512_DIGEST_SIZE];
-    sha3_512_digest(&ctx, SHA3_512_DIGEST_SIZE, digest);
+// Read at once, reused for the whole file
+static constexpr std::size_t READ_BUFFER_SIZE {256 * 1024};
 
-    char hash[SHA3_512_DIGEST_SIZE * 2];
+FileReader::FileReader(const std::string& path)
+{
+#ifndef _WIN32
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+        return;
+    struct stat st;
+    if (::fstat(fd_, &st) != 0 or not S_ISREG(st.st_mode)) {
+        ::close(fd_);
+        fd_ = -1;
+        return;
+    }
+    size_ = st.st_size;
+    open_ = true;
+#ifdef POSIX_FADV_SEQUENTIAL
+    // Files are read from the start to the end, let the kernel read ahead
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+    openStream(stream_, path, std::ios::binary | std::ios::in);
+    if (!stream_)
+        return;
+    stream_.seekg(0, std::ios::end);
+    size_ = stream_.tellg();
+    stream_.seekg(0, std::ios::beg);
+    open_ = stream_.good();
+#endif
+}
 
-    for (int i = 0; i < SHA3_512_DIGEST_SIZE; ++i)
-        pj_val_to_hex_digit(digest[i], &hash[2 * i]);
+FileReader::~FileReader()
+{
+#ifndef _WIN32
+    if (fd_ >= 0)
+        ::close(fd_);
+#endif
+}
 
-    return {hash, SHA3_512_DIGEST_SIZE * 2};
+const uint8_t*
+FileReader::read(uint64_t offset, std::size_t& len)
+{
+    if (not open_ or offset >= size_) {
+        len = 0;
+        return nullptr;
+    }
+    len = std::min<uint64_t>(len, size_ - offset);
+    buffer_.resize(std::min(len, READ_BUFFER_SIZE));
+#ifndef _WIN32
+    // A file truncated meanwhile gives a short read, or none
+    ssize_t res;
+    do {
+        res = ::pread(fd_, buffer_.data(), buffer_.size(), offset);
+    } while (res < 0 and errno == EINTR);
+    if (res <= 0) {
+        len = 0;
+        return nullptr;
+    }
+    len = res;
+#else
+    stream_.clear();
+    stream_.seekg(offset, std::ios::beg);
+    stream_.read((char*) buffer_.data(), buffer_.size());
+    len = stream_.gcount();
+    if (len == 0)
+        return nullptr;
+#endif
+    return buffer_.data();
+}
+
+// Data waiting to be written before AsyncFileWriter::write() fails. Far above the
+// window of a channel: the sender is slowed down by the credits well before.
+static constexpr std::size_t MAX_PENDING_WRITES {64 * 1024 * 1024};
+
+struct AsyncFileWriter::Impl
+{
+    std::mutex mutex;
+    std::ofstream stream;
+    std::vector<uint8_t> pending;
+    std::function<void(std::size_t)> onWritten;
+    bool writing {false}; // a task of the pool writes
+    bool failed {false};
+    bool closing {false};
+    std::function<void(bool)> onClosed;
+
+    // mutex must be locked
+    void schedule(const std::shared_ptr<Impl>& self)
+    {
+        if (writing)
+            return;
+        writing = true;
+        dht::ThreadPool::io().run([self] { self->run(); });
+    }
+
+    void run()
+    {
+        std::vector<uint8_t> data;
+        std::unique_lock<std::mutex> lk(mutex);
+        while (!pending.empty() && !failed) {
+            data.swap(pending);
+            lk.unlock();
+            stream.write(reinterpret_cast<const char*>(data.data()), data.size());
+            auto ok = static_cast<bool>(stream);
+            if (ok && onWritten)
+                onWritten(data.size());
+            data.clear();
+            lk.lock();
+            if (!ok)
+                failed = true;
+        }
+        pending.clear();
+        writing = false;
+        std::function<void(bool)> cb;
+        auto ok = !failed;
+        if (closing) {
+            if (stream.is_open()) {
+                stream.close();
+                ok = ok && !stream.fail();
+            }
+            cb = std::move(onClosed);
+            onClosed = {};
+        }
+        lk.unlock();
+        if (cb)
+            cb(ok);
+    }
+};
+
+AsyncFileWriter::AsyncFileWriter(const std::string& path,
+                                 std::ios_base::openmode mode,
+                                 uint64_t offset,
+                                 std::function<void(std::size_t)>&& onWritten)
+    : pimpl_(std::make_shared<Impl>())
+{
+    pimpl_->onWritten = std::move(onWritten);
+    openStream(pimpl_->stream, path, mode);
+    if (offset)
+        pimpl_->stream.seekp(offset);
+    pimpl_->failed = !pimpl_->stream;
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    std::lock_guard<std::mutex> lk(pimpl_->mutex);
+    if (!pimpl_->closing) {
+        pimpl_->closing = true;
+        pimpl_->schedule(pimpl_);
+    }
+}
+
+AsyncFileWriter::operator bool() const
+{
+    std::lock_guard<std::mutex> lk(pimpl_->mutex);
+    return !pimpl_->failed;
+}
+
+bool
+AsyncFileWriter::write(const uint8_t* data, std::size_t size)
+{
+    std::lock_guard<std::mutex> lk(pimpl_->mutex);
+    if (pimpl_->failed || pimpl_->closing)
+        return false;
+    if (pimpl_->pending.size() + size > MAX_PENDING_WRITES) {
+        JAMI_WARN("[file] too much data waiting to be written, abort");
+        pimpl_->failed = true;
+        return false;
+    }
+    pimpl_->pending.insert(pimpl_->pending.end(), data, data + size);
+    pimpl_->schedule(pimpl_);
+    return true;
+}
+
+void
+AsyncFileWriter::close(std::function<void(bool)>&& cb)
+{
+    std::lock_guard<std::mutex> lk(pimpl_->mutex);
+    if (pimpl_->closing) {
+        if (cb)
+            dht::ThreadPool::io().run([cb = std::move(cb)] { cb(false); });
+        return;
+    }
+    pimpl_->closing = true;
+    pimpl_->onClosed = std::move(cb);
+    pimpl_->schedule(pimpl_);
 }
 
 int
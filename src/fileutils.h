@@ -23,11 +23,15 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <cstdio>
 #include <ios>
+#include <fstream>
 
 #include "jami/def.h"
+#include "noncopyable.h"
 
 #ifndef _WIN32
 #include <sys/stat.h>               // mode_t
@@ -41,7 +45,12 @@
 #define DIR_SEPARATOR_STR_ESC "//*" // Escaped directory separator string
 #endif
 
+struct sha3_512_ctx;
+
 namespace jami {
+namespace archiver {
+enum class Codec : uint8_t;
+}
 namespace fileutils {
 
 std::string get_home_dir();
@@ -85,6 +94,11 @@ bool isSymLink(const std::string& path);
 std::chrono::system_clock::time_point writeTime(const std::string& path);
 
 void createFileLink(const std::string& src, const std::string& dest, bool hard = false);
+bool createHardlink(const std::string& linkFile, const std::string& target);
+/**
+ * @return number of hard links to the file, 0 if it doesn't exist
+ */
+unsigned linkCount(const std::string& path);
 
 std::string_view getFileExtension(std::string_view filename);
 
@@ -109,14 +123,30 @@ saveFile(const std::string& path, const std::vector<uint8_t>& data, mode_t mode
     saveFile(path, data.data(), data.size(), mode);
 }
 
+/**
+ * saveFile() out of the calling thread, with the file locked (see getFileLock())
+ * @param cb    Called once saved, with false on error
+ */
+void saveFileAsync(const std::string& path,
+                   std::vector<uint8_t>&& data,
+                   mode_t mode = 0644,
+                   std::function<void(bool)>&& cb = {});
+
 std::vector<uint8_t> loadCacheFile(const std::string& path,
                                    std::chrono::system_clock::duration maxAge);
 std::string loadCacheTextFile(const std::string& path, std::chrono::system_clock::duration maxAge);
 
+/**
+ * The key stretched from the password is kept for path, see secure::PasswordKeys
+ */
 std::vector<uint8_t> readArchive(const std::string& path, const std::string& password = {});
+/**
+ * @param codec     Used with a password, zlib by default
+ */
 void writeArchive(const std::string& data,
                   const std::string& path,
-                  const std::string& password = {});
+                  const std::string& password = {},
+                  archiver::Codec codec = {});
 
 std::mutex& getFileLock(const std::string& path);
 
@@ -148,8 +178,114 @@ std::ofstream ofstream(const std::string& path, std::ios_base::openmode mode = s
 int64_t size(const std::string& path);
 
 std::string sha3File(const std::string& path);
+/**
+ * Also give the sums of the chunks of chunkSize bytes of the file, in order
+ * @return sha3File(path)
+ */
+std::string sha3File(const std::string& path,
+                     uint64_t chunkSize,
+                     std::vector<std::string>& chunkSums);
 std::string sha3sum(const std::vector<uint8_t>& buffer);
 
+/**
+ * Compute the sum of sha3File() on data given piece by piece
+ */
+class Sha3Hasher
+{
+public:
+    Sha3Hasher();
+    ~Sha3Hasher();
+    void update(const uint8_t* data, std::size_t size);
+    /**
+     * @return hex digest of the data given so far. Further updates start a new sum.
+     */
+    std::string digest();
+
+private:
+    std::unique_ptr<sha3_512_ctx> ctx_;
+};
+
+/**
+ * Read-only access to a file, read from the start to the end.
+ *
+ * The data is read into a buffer reused by each read(), the kernel reading
+ * ahead. A file truncated while being read ends sooner.
+ */
+class FileReader
+{
+public:
+    explicit FileReader(const std::string& path);
+    ~FileReader();
+
+    explicit operator bool() const { return open_; }
+    /**
+     * @return size of the file when it was opened
+     */
+    uint64_t size() const { return size_; }
+
+    /**
+     * @param offset    Position in the file
+     * @param len       Bytes wanted, set to the bytes available (0 at the end of the file)
+     * @return data, valid until the next read(), or nullptr at the end of the file or on error
+     * @note len may be less than wanted before the end of the file
+     */
+    const uint8_t* read(uint64_t offset, std::size_t& len);
+
+private:
+    NON_COPYABLE(FileReader);
+
+    bool open_ {false};
+    uint64_t size_ {0};
+    int fd_ {-1};
+    std::ifstream stream_ {};
+    std::vector<uint8_t> buffer_ {};
+};
+
+/**
+ * Write a file out of the calling thread, in the order of the writes.
+ *
+ * Writing only copies the data, so that a network thread receiving a file is never
+ * blocked by the disk. To not fill the memory if the disk is slower than the network,
+ * the sender must be slowed down by the caller, e.g. by crediting a channel with what
+ * is written (see ChannelSocket::setManualCredit()). Past tens of megabytes waiting to
+ * be written, write() fails.
+ */
+class AsyncFileWriter
+{
+public:
+    /**
+     * @param offset        Where to write in the file
+     * @param onWritten     Called by the writing thread with the bytes written
+     */
+    AsyncFileWriter(const std::string& path,
+                    std::ios_base::openmode mode,
+                    uint64_t offset = 0,
+                    std::function<void(std::size_t)>&& onWritten = {});
+    /**
+     * The writes left are still done, and the file closed
+     */
+    ~AsyncFileWriter();
+
+    /**
+     * @return false if a write failed
+     */
+    explicit operator bool() const;
+    /**
+     * @return false if the data can't be written, e.g. a previous write failed
+     */
+    bool write(const uint8_t* data, std::size_t size);
+    /**
+     * Close the file once all the data is written, then call cb with false if a write failed.
+     * Further writes fail.
+     */
+    void close(std::function<void(bool)>&& cb);
+
+private:
+    NON_COPYABLE(AsyncFileWriter);
+    struct Impl;
+    std::shared_ptr<Impl> pimpl_;
+};
+
 /**
  * Windows compatibility wrapper for checking read-only attribute
  */
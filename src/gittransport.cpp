@@ -21,8 +21,21 @@
 #include "jamidht/multiplexed_socket.h"
 #include "jamidht/connectionmanager.h"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+
 using namespace std::string_view_literals;
 
+// Read from the socket at once, up to the window of the channel
+static constexpr std::size_t READ_AHEAD_SIZE {256 * 1024};
+// Larger requests are written without waiting for the next read
+static constexpr std::size_t WRITE_BUFFER_SIZE {64 * 1024};
+// Without any data from the peer, the fetch fails
+static constexpr std::chrono::minutes READ_TIMEOUT {2};
+// Between two checks of the socket, not kept alive while waiting
+static constexpr std::chrono::seconds POLL_INTERVAL {1};
+
 // NOTE: THIS MUST BE IN THE ROOT NAMESPACE FOR LIBGIT2
 
 int
@@ -70,21 +83,61 @@ sendCmd(P2PStream* s)
         return res;
     }
 
-    std::error_code ec;
+    // Sent with the first request of libgit2
+    s->outgoing.append(request.ptr, request.size);
+    s->sent_command = 1;
+    git_buf_dispose(&request);
+    return res;
+}
+
+int
+P2PStreamFlush(P2PStream* s)
+{
+    if (s->outgoing.empty())
+        return 0;
     auto sock = s->socket.lock();
     if (!sock) {
-        git_buf_dispose(&request);
+        giterr_set_str(GITERR_NET, "unavailable socket");
         return -1;
     }
-    if ((res = sock->write(reinterpret_cast<const unsigned char*>(request.ptr), request.size, ec))) {
-        s->sent_command = 1;
-        git_buf_dispose(&request);
-        return res;
+    std::error_code ec;
+    sock->write(reinterpret_cast<const unsigned char*>(s->outgoing.data()), s->outgoing.size(), ec);
+    s->outgoing.clear();
+    if (ec) {
+        giterr_set_str(GITERR_NET, ec.message().c_str());
+        return -1;
     }
+    return 0;
+}
 
-    s->sent_command = 1;
-    git_buf_dispose(&request);
-    return res;
+static int
+readAhead(P2PStream* s)
+{
+    if (P2PStreamFlush(s) < 0)
+        return -1;
+    auto deadline = std::chrono::steady_clock::now() + READ_TIMEOUT;
+    while (true) {
+        auto sock = s->socket.lock();
+        if (!sock) {
+            giterr_set_str(GITERR_NET, "unavailable socket");
+            return -1;
+        }
+        std::error_code ec;
+        if (sock->waitForData(POLL_INTERVAL, ec) > 0) {
+            s->incoming.resize(READ_AHEAD_SIZE);
+            s->incoming.resize(sock->read(s->incoming.data(), s->incoming.size(), ec));
+            s->incomingPos = 0;
+            return 0;
+        }
+        if (ec) {
+            giterr_set_str(GITERR_NET, ec.message().c_str());
+            return -1;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            giterr_set_str(GITERR_NET, "timeout while waiting for the peer");
+            return -1;
+        }
+    }
 }
 
 int
@@ -92,11 +145,6 @@ P2PStreamRead(git_smart_subtransport_stream* stream, char* buffer, size_t buflen
 {
     *read = 0;
     auto* fs = reinterpret_cast<P2PStream*>(stream);
-    auto sock = fs->socket.lock();
-    if (!sock) {
-        giterr_set_str(GITERR_NET, "unavailable socket");
-        return -1;
-    }
 
     int res = 0;
     // If it's the first read, we need to send
@@ -104,12 +152,30 @@ P2PStreamRead(git_smart_subtransport_stream* stream, char* buffer, size_t buflen
     if (!fs->sent_command && (res = sendCmd(fs)) < 0)
         return res;
 
-    std::error_code ec;
-    // TODO ChannelSocket needs a blocking read operation
-    size_t datalen = sock->waitForData(std::chrono::milliseconds(3600 * 1000 * 24), ec);
-    if (datalen > 0)
-        *read = sock->read(reinterpret_cast<unsigned char*>(buffer), std::min(datalen, buflen), ec);
+    if (!fs->pending.empty()) {
+        *read = std::min(fs->pending.size(), buflen);
+        std::copy_n(fs->pending.begin(), *read, buffer);
+        fs->pending.erase(0, *read);
+        return res;
+    }
+
+    if (fs->incomingPos == fs->incoming.size() && (res = readAhead(fs)) < 0)
+        return res;
+    *read = std::min(fs->incoming.size() - fs->incomingPos, buflen);
+    std::copy_n(fs->incoming.begin() + fs->incomingPos, *read, buffer);
+    fs->incomingPos += *read;
 
+    if (!fs->advertised && *read > 0) {
+        // The references and the capabilities, up to a flush
+        fs->advertisement.append(buffer, *read);
+        if (fs->advertisement.find(DEEPEN_CAPABILITY) != std::string::npos)
+            fs->deepen = true;
+        auto size = fs->advertisement.size();
+        if (fs->deepen || (size >= 4 && fs->advertisement.compare(size - 4, 4, "0000") == 0)) {
+            fs->advertised = true;
+            fs->advertisement.clear();
+        }
+    }
     return res;
 }
 
@@ -122,12 +188,34 @@ P2PStreamWrite(git_smart_subtransport_stream* stream, const char* buffer, size_t
         giterr_set_str(GITERR_NET, "unavailable socket");
         return -1;
     }
-    std::error_code ec;
-    sock->write(reinterpret_cast<const unsigned char*>(buffer), len, ec);
-    if (ec) {
-        giterr_set_str(GITERR_NET, ec.message().c_str());
-        return -1;
+    std::string filtered;
+    if (fs->advertised && !fs->deepen) {
+        // Remove the depth from the wanted commits, and answer with no shallow commits
+        std::string_view data(buffer, len);
+        std::size_t pos = 0;
+        bool deepened = false;
+        while (pos + 4 <= data.size()) {
+            unsigned pktLen = 0;
+            std::from_chars(data.data() + pos, data.data() + pos + 4, pktLen, 16);
+            // Flushes included
+            auto pkt = data.substr(pos, std::max(pktLen, 4u));
+            if (pkt.substr(4, 6) == "deepen"sv)
+                deepened = true;
+            else
+                filtered.append(pkt);
+            pos += pkt.size();
+        }
+        if (deepened) {
+            filtered.append(data.substr(pos));
+            fs->pending.append("0000");
+            buffer = filtered.data();
+            len = filtered.size();
+        }
     }
+
+    fs->outgoing.append(buffer, len);
+    if (fs->outgoing.size() >= WRITE_BUFFER_SIZE)
+        return P2PStreamFlush(fs);
     return 0;
 }
 
@@ -211,8 +299,12 @@ P2PSubTransportAction(git_smart_subtransport_stream** out,
 }
 
 int
-P2PSubTransportClose(git_smart_subtransport*)
+P2PSubTransportClose(git_smart_subtransport* transport)
 {
+    // The final flush of libgit2 tells the server the fetch is done
+    auto* sub = reinterpret_cast<P2PSubTransport*>(transport);
+    if (sub && sub->stream)
+        return P2PStreamFlush(sub->stream.get());
     return 0;
 }
 
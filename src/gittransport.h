@@ -20,6 +20,7 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <algorithm>
 #include <git2/remote.h>
 #include <git2/sys/transport.h>
@@ -41,6 +42,21 @@ struct P2PStream
     std::string cmd {};
     std::string url {};
     unsigned sent_command : 1;
+
+    // Older servers announce "shallow" but ignore "deepen", which would leave a shallow clone
+    // waiting for their shallow commits forever: for them, the depth is not sent and their
+    // answer, without shallow commits, is made up
+    std::string advertisement {};
+    bool advertised {false};
+    bool deepen {false};
+    // Read before the socket
+    std::string pending {};
+
+    // Requests, written at once before the next read: libgit2 writes them in parts
+    std::string outgoing {};
+    // Read ahead from the socket
+    std::vector<unsigned char> incoming {};
+    std::size_t incomingPos {0};
 };
 
 struct P2PSubTransport
@@ -53,6 +69,8 @@ struct P2PSubTransport
 using namespace std::string_view_literals;
 constexpr auto UPLOAD_PACK_CMD = "git-upload-pack"sv;
 constexpr auto HOST_TAG = "host="sv;
+// Announced by the servers supporting shallow fetches
+constexpr auto DEEPEN_CAPABILITY = "jami-deepen"sv;
 
 /*
  * Create a git protocol request.
@@ -66,14 +84,22 @@ constexpr auto HOST_TAG = "host="sv;
 int generateRequest(git_buf* request, const std::string& cmd, const std::string_view& url);
 
 /**
- * Send a git command on the linked socket
+ * Queue a git command, sent on the linked socket with the next read
  * @param s     Related stream
  * @return 0 on success
  */
 int sendCmd(P2PStream* s);
 
 /**
- * Read on a channel socket
+ * Write the queued requests on the socket
+ * @param s     Related stream
+ * @return 0 on success
+ */
+int P2PStreamFlush(P2PStream* s);
+
+/**
+ * Read on a channel socket, after sending the queued requests.
+ * Waits for the peer up to a timeout, the socket not being kept alive meanwhile.
  * @param stream        Related stream
  * @param buffer        Buffer to fill
  * @param buflen        Maximum buffer size
@@ -82,6 +108,13 @@ int sendCmd(P2PStream* s);
  */
 int P2PStreamRead(git_smart_subtransport_stream* stream, char* buffer, size_t buflen, size_t* read);
 
+/**
+ * Queue data to write on a channel socket
+ * @param stream        Related stream
+ * @param buffer        Data to write
+ * @param len           Data size
+ * @return 0 on success
+ */
 int P2PStreamWrite(git_smart_subtransport_stream* stream, const char* buffer, size_t len);
 
 /**
@@ -104,7 +137,7 @@ int P2PSubTransportAction(git_smart_subtransport_stream** out,
 
 /**
  * Close a subtransport
- * Because we use a channel socket, we need to do nothing here.
+ * Because we use a channel socket, only the queued requests are written here.
  * Will be shutdown by the rest of the code
  */
 int P2PSubTransportClose(git_smart_subtransport*);
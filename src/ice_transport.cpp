@@ -27,11 +27,13 @@
 #include "transport/peer_channel.h"
 #include "jami/callmanager_interface.h"
 #include "tracepoint.h"
+#include "noncopyable.h"
 
 #include <pjlib.h>
 
 #include <map>
 #include <atomic>
+#include <optional>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -67,6 +69,9 @@ static constexpr uint16_t IPV4_HEADER_SIZE = 20; ///< Size in bytes of IPV4 pack
 static constexpr int MAX_CANDIDATES {32};
 static constexpr int MAX_DESTRUCTION_TIMEOUT {3000};
 static constexpr int HANDLE_EVENT_DURATION {500};
+static constexpr std::chrono::minutes TURN_FAILURE_DELAY {1};
+// Released pools of the ICE sessions kept for reuse, up to this total capacity
+static constexpr pj_size_t POOL_CACHE_CAPACITY {1024 * 1024};
 
 //==============================================================================
 
@@ -94,6 +99,198 @@ public:
     void unlock() { pj_grp_lock_release(lk_); }
 };
 
+using PjPoolPtr = std::unique_ptr<pj_pool_t, std::function<void(pj_pool_t*)>>;
+
+/**
+ * Thread polling the sockets and the timers of many transports.
+ *
+ * The sockets of the transports share one ioqueue, while each transport keeps
+ * its own timer heap so it can flush its timers when destroyed. All the events
+ * of a transport are handled by the same thread.
+ */
+class IceEventLoop
+{
+public:
+    IceEventLoop(const std::shared_ptr<pj_caching_pool>& cp);
+    ~IceEventLoop();
+
+    pj_ioqueue_t* ioqueue() const { return ioqueue_; }
+
+    // Transports attached, or about to be
+    std::size_t transportCount() const { return transportCount_; }
+    void reserve() { ++transportCount_; }
+
+    void addTimerHeap(pj_timer_heap_t* timerHeap);
+    /**
+     * Stop polling the timers of a transport
+     * @note waits for a poll of this heap in progress on the loop thread
+     */
+    void removeTimerHeap(pj_timer_heap_t* timerHeap);
+    /**
+     * Keep polling the timers left by a destroyed transport, as its closing sockets
+     * are still registered, then destroy the heap and release its pool
+     */
+    void adoptTimerHeap(pj_timer_heap_t* timerHeap, PjPoolPtr&& pool);
+
+    /**
+     * Join the thread, destroying the timer heaps left
+     */
+    void stop();
+
+    bool isLoopThread() const { return std::this_thread::get_id() == thread_.get_id(); }
+
+private:
+    NON_COPYABLE(IceEventLoop);
+
+    void loop();
+    // Destroy the adopted timer heaps without timers, all of them if force
+    void releaseTimerHeaps(bool force);
+
+    std::shared_ptr<pj_caching_pool> cp_;
+    PjPoolPtr pool_;
+    pj_ioqueue_t* ioqueue_ {nullptr};
+
+    // Not locked while polling, as transports can be created or destroyed from a callback
+    std::mutex mutex_ {};
+    std::condition_variable cv_ {};
+    std::vector<pj_timer_heap_t*> timerHeaps_ {};
+    pj_timer_heap_t* polling_ {nullptr};
+    std::vector<std::pair<pj_timer_heap_t*, PjPoolPtr>> adopted_ {};
+    std::atomic<std::size_t> transportCount_ {0};
+
+    std::atomic_bool running_ {true};
+    std::thread thread_ {};
+};
+
+IceEventLoop::IceEventLoop(const std::shared_ptr<pj_caching_pool>& cp)
+    : cp_(cp)
+    , pool_(pj_pool_create(&cp_->factory, "IceEventLoop.pool", 512, 512, NULL),
+            [](pj_pool_t* pool) { pj_pool_release(pool); })
+{
+    if (not pool_)
+        throw std::runtime_error("pj_pool_create() failed");
+    TRY(pj_ioqueue_create(pool_.get(), PJ_IOQUEUE_MAX_HANDLES, &ioqueue_));
+    thread_ = std::thread([this] { loop(); });
+    JAMI_DBG("[ice:loop:%p] Started for %d sockets", this, PJ_IOQUEUE_MAX_HANDLES);
+}
+
+IceEventLoop::~IceEventLoop()
+{
+    stop();
+    pj_ioqueue_destroy(ioqueue_);
+}
+
+void
+IceEventLoop::stop()
+{
+    running_ = false;
+    if (thread_.joinable()) {
+        if (isLoopThread())
+            thread_.detach();
+        else
+            thread_.join();
+    }
+    releaseTimerHeaps(true);
+}
+
+void
+IceEventLoop::addTimerHeap(pj_timer_heap_t* timerHeap)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    timerHeaps_.emplace_back(timerHeap);
+}
+
+void
+IceEventLoop::removeTimerHeap(pj_timer_heap_t* timerHeap)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    auto it = std::find(timerHeaps_.begin(), timerHeaps_.end(), timerHeap);
+    if (it != timerHeaps_.end())
+        timerHeaps_.erase(it);
+    --transportCount_;
+    // Else the heap polled, if it is this one, is only destroyed by the loop
+    if (not isLoopThread())
+        cv_.wait(lk, [&] { return polling_ != timerHeap; });
+}
+
+void
+IceEventLoop::adoptTimerHeap(pj_timer_heap_t* timerHeap, PjPoolPtr&& pool)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    adopted_.emplace_back(timerHeap, std::move(pool));
+}
+
+void
+IceEventLoop::releaseTimerHeaps(bool force)
+{
+    std::vector<std::pair<pj_timer_heap_t*, PjPoolPtr>> released;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        for (auto it = adopted_.begin(); it != adopted_.end();) {
+            if (force or pj_timer_heap_count(it->first) == 0) {
+                released.emplace_back(std::move(*it));
+                it = adopted_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    // Out of the lock, as the pools go back to the caching pool
+    for (auto& [timerHeap, pool] : released) {
+        pj_timer_heap_destroy(timerHeap);
+        pool.reset();
+    }
+}
+
+void
+IceEventLoop::loop()
+{
+    while (running_) {
+        pj_time_val timeout = {0, HANDLE_EVENT_DURATION};
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            auto heaps = timerHeaps_;
+            for (const auto& adopted : adopted_)
+                heaps.emplace_back(adopted.first);
+            for (auto* timerHeap : heaps) {
+                // Removed by a callback meanwhile
+                if (std::find(timerHeaps_.begin(), timerHeaps_.end(), timerHeap)
+                        == timerHeaps_.end()
+                    and std::find_if(adopted_.begin(),
+                                     adopted_.end(),
+                                     [&](const auto& adopted) { return adopted.first == timerHeap; })
+                            == adopted_.end())
+                    continue;
+                polling_ = timerHeap;
+                lk.unlock();
+                pj_time_val next = {0, 0};
+                pj_timer_heap_poll(timerHeap, &next);
+                lk.lock();
+                polling_ = nullptr;
+                cv_.notify_all();
+                if (next.sec == PJ_MAXINT32 && next.msec == PJ_MAXINT32)
+                    continue;
+                pj_time_val_normalize(&next);
+                if (PJ_TIME_VAL_LT(next, timeout))
+                    timeout = next;
+            }
+        }
+        releaseTimerHeaps(false);
+
+        if (pj_ioqueue_poll(ioqueue_, &timeout) < 0) {
+            const auto err = pj_get_os_error();
+            // Kept as debug as some errors are "normal" in regular context
+            JAMI_DBG("[ice:loop:%p] ioqueue error %d: %s",
+                     this,
+                     err,
+                     sip_utils::sip_strerror(err).c_str());
+            std::this_thread::sleep_for(std::chrono::milliseconds(PJ_TIME_VAL_MSEC(timeout)));
+        }
+    }
+}
+
+//==============================================================================
+
 class IceTransport::Impl
 {
 public:
@@ -146,14 +343,12 @@ public:
     std::vector<std::pair<IpAddr, IpAddr>> setupUpnpReflexiveCandidates();
     void setDefaultRemoteAddress(unsigned comp_id, const IpAddr& addr);
     IpAddr getDefaultRemoteAddress(unsigned comp_id) const;
-    bool handleEvents(unsigned max_msec);
-    int flushTimerHeapAndIoQueue();
-    int checkEventQueue(int maxEventToPoll);
+    int flushTimerHeap();
 
     std::condition_variable_any iceCV_ {};
 
     std::string sessionName_ {};
-    std::unique_ptr<pj_pool_t, std::function<void(pj_pool_t*)>> pool_ {};
+    PjPoolPtr pool_ {};
     bool isTcp_ {false};
     bool upnpEnabled_ {false};
     IceTransportCompleteCb on_initdone_cb_ {};
@@ -184,6 +379,8 @@ public:
         std::condition_variable cv;
         std::deque<Packet> queue;
         IceRecvCb recvCb;
+        // Peer channel over its capacity, only used by the event loop
+        bool overflowing {false};
     };
 
     // NOTE: Component IDs start from 1, while these three vectors
@@ -221,8 +418,12 @@ public:
 
     bool onlyIPv4Private_ {true};
 
-    // IO/Timer events are handled by following thread
-    std::thread thread_ {};
+    // TURN servers this transport allocated on
+    std::shared_ptr<TurnAllocationCache> turnCache_ {};
+    std::vector<TurnServerInfo> turnAllocated_ {};
+
+    // IO/Timer events are handled by this loop, shared with other transports
+    std::shared_ptr<IceEventLoop> eventLoop_ {};
     std::atomic_bool threadTerminateFlags_ {false};
 
     // Wait data on components
@@ -328,7 +529,6 @@ add_turn_server(pj_pool_t& pool, pj_ice_strans_cfg& cfg, const TurnServerInfo& i
 IceTransport::Impl::Impl(const char* name)
     : sessionName_(name)
     , pool_(nullptr, [](pj_pool_t* pool) { pj_pool_release(pool); })
-    , thread_()
 {
     JAMI_DBG("[ice:%p] Creating IceTransport session for \"%s\"", this, name);
 }
@@ -337,12 +537,15 @@ IceTransport::Impl::~Impl()
 {
     JAMI_DBG("[ice:%p] destroying %p", this, icest_);
 
+    // No more callback from now on
     threadTerminateFlags_ = true;
+    cancelOperations();
 
-    if (thread_.joinable()) {
-        thread_.join();
-    }
+    // From now on, the timers are polled here
+    if (eventLoop_)
+        eventLoop_->removeTimerHeap(config_.stun_cfg.timer_heap);
 
+    auto orphanTimerHeap = false;
     if (icest_) {
         pj_ice_strans* strans = nullptr;
 
@@ -354,33 +557,32 @@ IceTransport::Impl::~Impl()
         pj_ice_strans_stop_ice(strans);
         pj_ice_strans_destroy(strans);
 
-        // NOTE: This last timer heap and IO queue polling is necessary to close
+        // NOTE: This last timer heap polling is necessary to close
         // TURN socket.
         // Because when destroying the TURN session pjproject creates a pj_timer
-        // to postpone the TURN destruction. This timer is only called if we poll
-        // the event queue.
-
-        int ret = flushTimerHeapAndIoQueue();
-
-        if (ret < 0) {
-            JAMI_ERR("[ice:%p] IO queue polling failed", this);
-        } else if (ret > 0) {
-            JAMI_ERR("[ice:%p] Unexpected left timer in timer heap. "
-                     "Please report the bug",
-                     this);
+        // to postpone the TURN destruction. The IO queue is still polled by the
+        // event loop meanwhile.
+
+        if (flushTimerHeap() > 0) {
+            JAMI_WARN("[ice:%p] Timers left after %d ms, polled by the event loop",
+                      this,
+                      MAX_DESTRUCTION_TIMEOUT);
+            orphanTimerHeap = true;
         }
+    }
 
-        if (checkEventQueue(1) > 0) {
-            JAMI_WARN("[ice:%p] Unexpected left events in IO queue", this);
-        }
-
-        if (config_.stun_cfg.ioqueue)
-            pj_ioqueue_destroy(config_.stun_cfg.ioqueue);
-
-        if (config_.stun_cfg.timer_heap)
-            pj_timer_heap_destroy(config_.stun_cfg.timer_heap);
+    // The IO queue belongs to the event loop. It keeps the heap while sockets
+    // of the transport are still registered, or while it may be polling it
+    if (eventLoop_ and config_.stun_cfg.timer_heap
+        and (orphanTimerHeap or eventLoop_->isLoopThread())) {
+        eventLoop_->adoptTimerHeap(config_.stun_cfg.timer_heap, std::move(pool_));
+    } else if (config_.stun_cfg.timer_heap) {
+        pj_timer_heap_destroy(config_.stun_cfg.timer_heap);
     }
 
+    for (const auto& server : turnAllocated_)
+        turnCache_->release(server);
+
     JAMI_DBG("[ice:%p] done destroying", this);
     if (scb)
         scb();
@@ -425,6 +627,8 @@ IceTransport::Impl::initIceInstance(const IceTransportOptions& options)
         config_.stun.conn_type = PJ_STUN_TP_UDP;
         config_.turn.conn_type = PJ_TURN_TP_UDP;
     }
+    if (options.aggressiveNomination)
+        config_.opt.aggressive = PJ_TRUE;
 
     pool_.reset(
         pj_pool_create(iceTransportFactory.getPoolFactory(), "IceTransport.pool", 512, 512, NULL));
@@ -524,13 +728,20 @@ IceTransport::Impl::initIceInstance(const IceTransportOptions& options)
     for (auto& server : stunServers_)
         add_stun_server(*pool_, config_, server);
 
-    // Add TURN servers
+    // Add TURN servers, but those failing for now
+    turnCache_ = iceTransportFactory.getTurnAllocationCache();
+    turnServers_.erase(std::remove_if(turnServers_.begin(),
+                                      turnServers_.end(),
+                                      [&](const auto& server) {
+                                          return not turnCache_->request(server);
+                                      }),
+                       turnServers_.end());
     for (auto& server : turnServers_)
         add_turn_server(*pool_, config_, server);
 
-    static constexpr auto IOQUEUE_MAX_HANDLES = std::min(PJ_IOQUEUE_MAX_HANDLES, 64);
     TRY(pj_timer_heap_create(pool_.get(), 100, &config_.stun_cfg.timer_heap));
-    TRY(pj_ioqueue_create(pool_.get(), IOQUEUE_MAX_HANDLES, &config_.stun_cfg.ioqueue));
+    eventLoop_ = iceTransportFactory.attachEventLoop(config_.stun_cfg.timer_heap);
+    config_.stun_cfg.ioqueue = eventLoop_->ioqueue();
     std::ostringstream sessionName {};
     // We use the instance pointer as the PJNATH session name in order
     // to easily identify the logs reported by PJNATH.
@@ -545,15 +756,6 @@ IceTransport::Impl::initIceInstance(const IceTransportOptions& options)
     if (status != PJ_SUCCESS || icest_ == nullptr) {
         throw std::runtime_error("pj_ice_strans_create() failed");
     }
-
-    // Must be created after any potential failure
-    thread_ = std::thread([this] {
-        while (not threadTerminateFlags_) {
-            // NOTE: handleEvents can return false in this case
-            // but here we don't care if there is event or not.
-            handleEvents(HANDLE_EVENT_DURATION);
-        }
-    });
 }
 
 bool
@@ -594,65 +796,22 @@ IceTransport::Impl::_isFailed() const
     return false;
 }
 
-bool
-IceTransport::Impl::handleEvents(unsigned max_msec)
-{
-    // By tests, never seen more than two events per 500ms
-    static constexpr auto MAX_NET_EVENTS = 2;
-
-    pj_time_val max_timeout = {0, static_cast<long>(max_msec)};
-    pj_time_val timeout = {0, 0};
-    unsigned net_event_count = 0;
-
-    pj_timer_heap_poll(config_.stun_cfg.timer_heap, &timeout);
-    auto hasActiveTimer = timeout.sec != PJ_MAXINT32 || timeout.msec != PJ_MAXINT32;
-
-    // timeout limitation
-    if (hasActiveTimer)
-        pj_time_val_normalize(&timeout);
-
-    if (PJ_TIME_VAL_GT(timeout, max_timeout)) {
-        timeout = max_timeout;
-    }
-
-    do {
-        auto n_events = pj_ioqueue_poll(config_.stun_cfg.ioqueue, &timeout);
-
-        // timeout
-        if (not n_events)
-            return hasActiveTimer;
-
-        // error
-        if (n_events < 0) {
-            const auto err = pj_get_os_error();
-            // Kept as debug as some errors are "normal" in regular context
-            last_errmsg_ = sip_utils::sip_strerror(err);
-            JAMI_DBG("[ice:%p] ioqueue error %d: %s", this, err, last_errmsg_.c_str());
-            std::this_thread::sleep_for(std::chrono::milliseconds(PJ_TIME_VAL_MSEC(timeout)));
-            return hasActiveTimer;
-        }
-
-        net_event_count += n_events;
-        timeout.sec = timeout.msec = 0;
-    } while (net_event_count < MAX_NET_EVENTS);
-    return hasActiveTimer;
-}
-
 int
-IceTransport::Impl::flushTimerHeapAndIoQueue()
+IceTransport::Impl::flushTimerHeap()
 {
     pj_time_val timerTimeout = {0, 0};
     pj_time_val defaultWaitTime = {0, HANDLE_EVENT_DURATION};
     bool hasActiveTimer = false;
     std::chrono::milliseconds totalWaitTime {0};
     auto const start = std::chrono::steady_clock::now();
-    // We try to process pending events as fast as possible to
-    // speed-up the release.
-    int maxEventToProcess = 10;
+    // Destroyed from a callback, no one else polls the IO queue
+    auto pollIoQueue = eventLoop_ and eventLoop_->isLoopThread();
 
     do {
-        if (checkEventQueue(maxEventToProcess) < 0)
-            return -1;
+        if (pollIoQueue) {
+            pj_time_val timeout = {0, 0};
+            pj_ioqueue_poll(config_.stun_cfg.ioqueue, &timeout);
+        }
 
         pj_timer_heap_poll(config_.stun_cfg.timer_heap, &timerTimeout);
         hasActiveTimer = !(timerTimeout.sec == PJ_MAXINT32 && timerTimeout.msec == PJ_MAXINT32);
@@ -673,33 +832,11 @@ IceTransport::Impl::flushTimerHeapAndIoQueue()
     return static_cast<int>(pj_timer_heap_count(config_.stun_cfg.timer_heap));
 }
 
-int
-IceTransport::Impl::checkEventQueue(int maxEventToPoll)
-{
-    pj_time_val timeout = {0, 0};
-    int eventCount = 0;
-    int events = 0;
-
-    do {
-        events = pj_ioqueue_poll(config_.stun_cfg.ioqueue, &timeout);
-
-        if (events < 0) {
-            const auto err = pj_get_os_error();
-            last_errmsg_ = sip_utils::sip_strerror(err);
-            JAMI_ERR("[ice:%p] ioqueue error %d: %s", this, err, last_errmsg_.c_str());
-            return events;
-        }
-
-        eventCount += events;
-
-    } while (events > 0 && eventCount < maxEventToPoll);
-
-    return eventCount;
-}
-
 void
 IceTransport::Impl::onComplete(pj_ice_strans*, pj_ice_strans_op op, pj_status_t status)
 {
+    if (threadTerminateFlags_)
+        return;
     const char* opname = op == PJ_ICE_STRANS_OP_INIT          ? "initialization"
                          : op == PJ_ICE_STRANS_OP_NEGOTIATION ? "negotiation"
                                                               : "unknown_op";
@@ -719,6 +856,25 @@ IceTransport::Impl::onComplete(pj_ice_strans*, pj_ice_strans_op op, pj_status_t
                  last_errmsg_.c_str());
     }
 
+    if (op == PJ_ICE_STRANS_OP_INIT and not turnServers_.empty()) {
+        // Candidates don't tell which server relays them, all the servers are
+        // considered alike
+        auto relayed = false;
+        for (unsigned compId = 1; compId <= compCount_ and not relayed; ++compId) {
+            std::vector<pj_ice_sess_cand> cands(MAX_CANDIDATES);
+            unsigned count = MAX_CANDIDATES;
+            if (icest_
+                and pj_ice_strans_enum_cands(icest_, compId, &count, cands.data()) == PJ_SUCCESS)
+                relayed = std::any_of(cands.begin(), cands.begin() + count, [](const auto& c) {
+                    return c.type == PJ_ICE_CAND_TYPE_RELAYED;
+                });
+        }
+        for (const auto& server : turnServers_)
+            turnCache_->onAllocation(server, relayed);
+        if (relayed)
+            turnAllocated_ = turnServers_;
+    }
+
     if (done and op == PJ_ICE_STRANS_OP_INIT) {
         if (initiatorSession_)
             setInitiatorSession();
@@ -1099,6 +1255,8 @@ void
 IceTransport::Impl::onReceiveData(unsigned comp_id, void* pkt, pj_size_t size)
 {
     ASSERT_COMP_ID(comp_id, compCount_);
+    if (threadTerminateFlags_)
+        return;
 
     jami_tracepoint_if_enabled(ice_transport_recv,
                                reinterpret_cast<uint64_t>(this),
@@ -1118,10 +1276,28 @@ IceTransport::Impl::onReceiveData(unsigned comp_id, void* pkt, pj_size_t size)
         }
     }
 
+    // Never wait for the reader, the event loop is shared with other transports
+    auto& channel = peerChannels_.at(comp_id - 1);
     std::error_code ec;
-    auto err = peerChannels_.at(comp_id - 1).write((const char*) pkt, size, ec);
-    if (err < 0) {
-        JAMI_ERR("[ice:%p] rx: channel is closed", this);
+    if (isTcp_) {
+        // A stream can't lose data. pjnath can't pause the reads of one socket of the
+        // shared ioqueue, so the channel goes past its capacity, bounded by the flow
+        // control of the peer's multiplexed socket
+        auto& overflowing = compIO_[comp_id - 1].overflowing;
+        auto wasOverflowing = overflowing;
+        if (channel.append((const char*) pkt, size, overflowing, ec) < 0) {
+            JAMI_ERR("[ice:%p] rx: channel is closed", this);
+        } else if (overflowing != wasOverflowing) {
+            JAMI_WARN("[ice:%p] rx: channel %s its capacity",
+                      this,
+                      overflowing ? "is over" : "is back under");
+        }
+    } else if (channel.write((const char*) pkt, size, ec) < 0) {
+        // As a full socket buffer
+        if (ec == std::errc::no_buffer_space)
+            JAMI_WARN("[ice:%p] rx: channel is full, dropping %lu bytes", this, size);
+        else
+            JAMI_ERR("[ice:%p] rx: channel is closed", this);
     }
 }
 
@@ -1160,6 +1336,17 @@ IceTransport::initIceInstance(const IceTransportOptions& options)
     jami_tracepoint(ice_transport_context, reinterpret_cast<uint64_t>(this));
 }
 
+void
+IceTransport::setCallbacks(IceTransportCompleteCb&& onInitDone, IceTransportCompleteCb&& onNegoDone)
+{
+    // Not to race with the callbacks of an initialized transport
+    std::optional<IceLock> lk;
+    if (pimpl_->icest_)
+        lk.emplace(pimpl_->icest_);
+    pimpl_->on_initdone_cb_ = std::move(onInitDone);
+    pimpl_->on_negodone_cb_ = std::move(onNegoDone);
+}
+
 bool
 IceTransport::isInitialized() const
 {
@@ -1823,6 +2010,57 @@ IceTransport::link() const
 
 //==============================================================================
 
+bool
+TurnAllocationCache::request(const TurnServerInfo& server)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    ++requests_;
+    auto& entry = entries_[server.uri + "|" + server.username];
+    if (entry.failed and std::chrono::steady_clock::now() - entry.failedAt < TURN_FAILURE_DELAY) {
+        ++hits_;
+        JAMI_DBG("[ice] Skip TURN server %s, its last allocation failed", server.uri.c_str());
+        return false;
+    }
+    return true;
+}
+
+void
+TurnAllocationCache::onAllocation(const TurnServerInfo& server, bool ok)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto& entry = entries_[server.uri + "|" + server.username];
+    if (ok) {
+        ++entry.active;
+        entry.failed = false;
+    } else {
+        entry.failed = true;
+        entry.failedAt = std::chrono::steady_clock::now();
+    }
+}
+
+void
+TurnAllocationCache::release(const TurnServerInfo& server)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = entries_.find(server.uri + "|" + server.username);
+    if (it != entries_.end() and it->second.active > 0)
+        --it->second.active;
+}
+
+TurnAllocationCache::Stats
+TurnAllocationCache::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    Stats stats;
+    stats.requests = requests_;
+    stats.hits = hits_;
+    for (const auto& [key, entry] : entries_)
+        stats.active += entry.active;
+    return stats;
+}
+
+//==============================================================================
+
 IceTransportFactory::IceTransportFactory()
     : cp_(new pj_caching_pool(),
           [](pj_caching_pool* p) {
@@ -1831,7 +2069,7 @@ IceTransportFactory::IceTransportFactory()
           })
     , ice_cfg_()
 {
-    pj_caching_pool_init(cp_.get(), NULL, 0);
+    pj_caching_pool_init(cp_.get(), NULL, POOL_CACHE_CAPACITY);
 
     pj_ice_strans_cfg_default(&ice_cfg_);
     ice_cfg_.stun_cfg.pf = &cp_->factory;
@@ -1848,7 +2086,53 @@ IceTransportFactory::IceTransportFactory()
     ice_cfg_.opt.aggressive = PJ_FALSE;
 }
 
-IceTransportFactory::~IceTransportFactory() {}
+IceTransportFactory::~IceTransportFactory()
+{
+    // The pooled transports first, while their loop still polls their sockets
+    decltype(pools_) pools;
+    {
+        std::lock_guard<std::mutex> lk(poolsMutex_);
+        pools = std::move(pools_);
+    }
+    pools.clear();
+
+    std::vector<std::shared_ptr<IceEventLoop>> loops;
+    {
+        std::lock_guard<std::mutex> lk(loopsMutex_);
+        loops = std::move(loops_);
+    }
+    // Out of the lock, a last callback may create a transport
+    for (const auto& loop : loops)
+        loop->stop();
+}
+
+std::shared_ptr<IceEventLoop>
+IceTransportFactory::attachEventLoop(pj_timer_heap_t* timerHeap)
+{
+    // Budget of sockets for a transport (components, STUN/TURN, TCP connections)
+    static constexpr std::size_t TRANSPORT_MAX_HANDLES {16};
+    static constexpr std::size_t LOOP_MAX_TRANSPORTS = std::max<std::size_t>(
+        1, PJ_IOQUEUE_MAX_HANDLES / TRANSPORT_MAX_HANDLES);
+    static const std::size_t MIN_LOOPS = std::max(1u, std::thread::hardware_concurrency());
+
+    std::shared_ptr<IceEventLoop> loop;
+    {
+        std::lock_guard<std::mutex> lk(loopsMutex_);
+        for (const auto& l : loops_)
+            if (not loop or l->transportCount() < loop->transportCount())
+                loop = l;
+        // Spread the transports on a loop per core, then add loops only when full
+        if (not loop or loop->transportCount() >= LOOP_MAX_TRANSPORTS
+            or (loop->transportCount() > 0 and loops_.size() < MIN_LOOPS)) {
+            loop = std::make_shared<IceEventLoop>(cp_);
+            loops_.emplace_back(loop);
+        }
+        loop->reserve();
+    }
+    // Out of the lock, the loop may be in a callback creating a transport
+    loop->addTimerHeap(timerHeap);
+    return loop;
+}
 
 std::shared_ptr<IceTransport>
 IceTransportFactory::createTransport(const char* name)
@@ -1872,6 +2156,89 @@ IceTransportFactory::createUTransport(const char* name)
     }
 }
 
+// Renewed past this age, the network may have changed without notice
+static constexpr std::chrono::minutes POOLED_TRANSPORT_MAX_AGE {10};
+
+void
+IceTransportFactory::fill(Pool& pool)
+{
+    while (pool.transports.size() < pool.count) {
+        auto transport = createTransport("pool");
+        if (not transport)
+            return;
+        transport->initIceInstance(pool.options);
+        pool.transports.emplace_back(std::move(transport), std::chrono::steady_clock::now());
+    }
+}
+
+void
+IceTransportFactory::fillPool(const std::string& accountId,
+                              const IceTransportOptions& options,
+                              std::size_t count)
+{
+    // Released once unlocked
+    decltype(Pool::transports) outdated;
+    std::lock_guard<std::mutex> lk(poolsMutex_);
+    auto& pool = pools_[accountId];
+    const auto& current = pool.options;
+    if (current.streamsCount != options.streamsCount
+        or current.compCountPerStream != options.compCountPerStream
+        or current.upnpEnable != options.upnpEnable or current.tcpEnable != options.tcpEnable
+        or current.accountLocalAddr != options.accountLocalAddr
+        or current.accountPublicAddr != options.accountPublicAddr
+        or current.stunServers.size() != options.stunServers.size()
+        or current.turnServers.size() != options.turnServers.size()) {
+        outdated = std::move(pool.transports);
+        pool.transports.clear();
+    }
+    pool.options = options;
+    pool.options.onInitDone = {};
+    pool.options.onNegoDone = {};
+    pool.count = count;
+    fill(pool);
+}
+
+void
+IceTransportFactory::clearPool(const std::string& accountId)
+{
+    decltype(pools_)::node_type pool;
+    std::lock_guard<std::mutex> lk(poolsMutex_);
+    pool = pools_.extract(accountId);
+}
+
+std::shared_ptr<IceTransport>
+IceTransportFactory::takeTransport(const std::string& accountId,
+                                   unsigned streamsCount,
+                                   unsigned compCountPerStream)
+{
+    decltype(Pool::transports) expired;
+    std::shared_ptr<IceTransport> ret;
+    std::lock_guard<std::mutex> lk(poolsMutex_);
+    auto it = pools_.find(accountId);
+    if (it == pools_.end())
+        return {};
+    auto& pool = it->second;
+    if (pool.options.streamsCount != streamsCount
+        or pool.options.compCountPerStream != compCountPerStream)
+        return {};
+
+    const auto now = std::chrono::steady_clock::now();
+    for (auto t = pool.transports.begin(); t != pool.transports.end();) {
+        const auto& transport = t->first;
+        if (transport->isFailed() or now - t->second > POOLED_TRANSPORT_MAX_AGE) {
+            expired.emplace_back(std::move(*t));
+            t = pool.transports.erase(t);
+        } else if (not ret and transport->isInitialized()) {
+            ret = std::move(t->first);
+            t = pool.transports.erase(t);
+        } else {
+            ++t;
+        }
+    }
+    fill(pool);
+    return ret;
+}
+
 //==============================================================================
 
 void
@@ -27,9 +27,12 @@
 #include <pjlib.h>
 #include <pjlib-util.h>
 
+#include <chrono>
 #include <functional>
+#include <map>
 #include <memory>
 #include <msgpack.hpp>
+#include <mutex>
 #include <vector>
 
 namespace jami {
@@ -39,6 +42,7 @@ class Controller;
 }
 
 class IceTransport;
+class IceEventLoop;
 
 using IceTransportCompleteCb = std::function<void(bool)>;
 using IceRecvCb = std::function<ssize_t(unsigned char* buf, size_t len)>;
@@ -103,6 +107,8 @@ struct IceTransportOptions
     std::vector<StunServerInfo> stunServers;
     std::vector<TurnServerInfo> turnServers;
     bool tcpEnable {false};
+    // Nominate the first valid pair, instead of waiting for the best one
+    bool aggressiveNomination {false};
     // Addresses used by the account owning the transport instance.
     IpAddr accountLocalAddr {};
     IpAddr accountPublicAddr {};
@@ -134,6 +140,13 @@ public:
 
     void initIceInstance(const IceTransportOptions& options);
 
+    /**
+     * Replace the callbacks given by initIceInstance(), e.g. for a transport initialized
+     * before its user is known (see IceTransportFactory::takeTransport()).
+     * Only before starting the negotiation.
+     */
+    void setCallbacks(IceTransportCompleteCb&& onInitDone, IceTransportCompleteCb&& onNegoDone);
+
     /**
      * Get current state
      */
@@ -262,6 +275,48 @@ private:
     std::unique_ptr<Impl> pimpl_;
 };
 
+/**
+ * Outcome of the TURN allocations of the transports, by server and username.
+ *
+ * pjnath binds an allocation to the transport that made it, so allocations
+ * are not shared. But a server whose last allocation failed is skipped by the
+ * next transports for a while, instead of each one waiting for its own
+ * allocation to fail.
+ */
+class TurnAllocationCache
+{
+public:
+    struct Stats
+    {
+        std::size_t requests {0}; // Transports asking for a server
+        std::size_t hits {0};     // Answered by the cache, without allocating
+        std::size_t active {0};   // Allocations in use by the transports
+    };
+
+    /**
+     * @return if the transport should allocate on server
+     */
+    bool request(const TurnServerInfo& server);
+    void onAllocation(const TurnServerInfo& server, bool ok);
+    // Allocation released by the transport
+    void release(const TurnServerInfo& server);
+
+    Stats stats() const;
+
+private:
+    struct Entry
+    {
+        std::size_t active {0};
+        bool failed {false};
+        std::chrono::steady_clock::time_point failedAt {};
+    };
+
+    mutable std::mutex mutex_ {};
+    std::map<std::string, Entry> entries_ {};
+    std::size_t requests_ {0};
+    std::size_t hits_ {0};
+};
+
 class IceTransportFactory
 {
 public:
@@ -279,9 +334,55 @@ public:
     pj_pool_factory* getPoolFactory() { return &cp_->factory; }
     std::shared_ptr<pj_caching_pool> getPoolCaching() { return cp_; }
 
+    /**
+     * Register the timer heap of a new transport to one of the event loops
+     * shared by the transports, created as needed.
+     * @return loop polling the timers and the sockets of the transport
+     */
+    std::shared_ptr<IceEventLoop> attachEventLoop(pj_timer_heap_t* timerHeap);
+
+    std::shared_ptr<TurnAllocationCache> getTurnAllocationCache() const { return turnCache_; }
+
+    /**
+     * Keep count transports initialized for the calls of the account, so that a call gets
+     * its candidates without waiting for STUN, TURN or UPnP.
+     * The transports are replaced if the options changed, e.g. the public address.
+     * @param options   Streams, servers and addresses of the calls of the account
+     */
+    void fillPool(const std::string& accountId,
+                  const IceTransportOptions& options,
+                  std::size_t count);
+    void clearPool(const std::string& accountId);
+    /**
+     * The pool is refilled with a new transport
+     * @return initialized transport with these streams, nullptr if none
+     */
+    std::shared_ptr<IceTransport> takeTransport(const std::string& accountId,
+                                                unsigned streamsCount,
+                                                unsigned compCountPerStream);
+
 private:
+    struct Pool
+    {
+        IceTransportOptions options;
+        std::size_t count {0};
+        std::vector<std::pair<std::shared_ptr<IceTransport>, std::chrono::steady_clock::time_point>>
+            transports;
+    };
+    /**
+     * @note poolsMutex_ must be locked
+     */
+    void fill(Pool& pool);
+
     std::shared_ptr<pj_caching_pool> cp_;
     pj_ice_strans_cfg ice_cfg_;
+    std::shared_ptr<TurnAllocationCache> turnCache_ {std::make_shared<TurnAllocationCache>()};
+
+    std::mutex loopsMutex_ {};
+    std::vector<std::shared_ptr<IceEventLoop>> loops_ {};
+
+    std::mutex poolsMutex_ {};
+    std::map<std::string, Pool> pools_ {};
 };
 
 }; // namespace jami
@@ -21,21 +21,120 @@
 #include "sip/sipaccountbase.h"
 #include "manager.h"
 #include "fileutils.h"
+#include "jamidht/map_journal.h"
 
 #include "client/ring_signal.h"
 #include "jami/account_const.h"
 
 #include <opendht/thread_pool.h>
 #include <json/json.h>
+#include <msgpack.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <optional>
 
 namespace jami {
 namespace im {
 
+const std::chrono::minutes MessageEngine::RETRY_PERIOD {10};
+
+namespace {
+
+/**
+ * A pending message as saved
+ */
+struct SavedMessage
+{
+    std::string to;
+    std::map<std::string, std::string> payloads;
+    int status {0};
+    unsigned retried {0};
+    int64_t last_op {0}; // Seconds since epoch
+    MSGPACK_DEFINE_MAP(to, payloads, status, retried, last_op)
+};
+
+std::string
+messageKey(const std::string& peer, MessageToken token)
+{
+    return to_hex_string(token) + "/" + peer;
+}
+
+/**
+ * Read the messages saved in JSON, before the journal
+ */
+std::map<std::string, SavedMessage>
+readJson(const std::vector<uint8_t>& content)
+{
+    Json::Value root;
+    std::string err;
+    Json::CharReaderBuilder rbuilder;
+    auto reader = std::unique_ptr<Json::CharReader>(rbuilder.newCharReader());
+    if (!reader->parse((const char*) content.data(),
+                       (const char*) content.data() + content.size(),
+                       &root,
+                       &err))
+        throw std::runtime_error(err);
+    std::map<std::string, SavedMessage> messages;
+    for (auto i = root.begin(); i != root.end(); ++i) {
+        auto to = i.key().asString();
+        for (auto m = i->begin(); m != i->end(); ++m) {
+            const auto& jmsg = *m;
+            SavedMessage msg;
+            msg.status = jmsg["status"].asInt();
+            msg.to = jmsg["to"].asString();
+            msg.last_op = jmsg["last_op"].asInt64();
+            msg.retried = jmsg.get("retried", 0).asUInt();
+            const auto& pl = jmsg["payload"];
+            for (auto p = pl.begin(); p != pl.end(); ++p)
+                msg.payloads[p.key().asString()] = p->asString();
+            messages.emplace(messageKey(to, from_hex_string(m.key().asString())), std::move(msg));
+        }
+    }
+    return messages;
+}
+
+} // namespace
+
+struct MessageEngine::Storage
+{
+    explicit Storage(const std::string& path)
+        : journal(path)
+    {}
+
+    /**
+     * Write the changes until there is none left
+     */
+    void write()
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        while (!changed.empty() || !removed.empty()) {
+            auto c = std::move(changed);
+            auto r = std::move(removed);
+            changed.clear();
+            removed.clear();
+            lk.unlock();
+            try {
+                journal.update(c, r);
+            } catch (const std::exception& e) {
+                JAMI_ERR("Couldn't save messages: %s", e.what());
+            }
+            lk.lock();
+        }
+        writing = false;
+    }
+
+    MapJournal<SavedMessage> journal;
+    std::mutex mutex;
+    // Not written yet, by key
+    std::map<std::string, SavedMessage> changed;
+    std::set<std::string> removed;
+    bool writing {false};
+};
+
 MessageEngine::MessageEngine(SIPAccountBase& acc, const std::string& path)
     : account_(acc)
     , savePath_(path)
+    , storage_(std::make_shared<Storage>(path))
 {
     auto found = savePath_.find_last_of(DIR_SEPARATOR_CH);
     auto dir = savePath_.substr(0, found);
@@ -68,6 +167,7 @@ MessageEngine::sendMessage(const std::string& to,
             m.first->second.to = to;
             m.first->second.payloads = payloads;
         }
+        setChanged(to, token);
         save_();
     }
     runOnMainThread([this, to]() { retrySend(to); });
@@ -86,41 +186,81 @@ MessageEngine::retrySend(const std::string& peer, bool retryOnTimeout)
     if (account_.getRegistrationState() != RegistrationState::REGISTERED) {
         return;
     }
-    struct PendingMsg
-    {
-        MessageToken token;
-        std::string to;
-        std::map<std::string, std::string> payloads;
-    };
-    std::vector<PendingMsg> pending {};
+    SIPAccountBase::OutgoingMessages pending {};
+    std::optional<clock::time_point> nextRetry;
     {
         std::lock_guard<std::mutex> lock(messagesMutex_);
         auto p = messages_.find(peer);
         if (p == messages_.end())
             return;
         auto& messages = p->second;
+        auto now = clock::now();
         for (auto m = messages.begin(); m != messages.end(); ++m) {
             if (m->second.status == MessageStatus::UNKNOWN
                 || m->second.status == MessageStatus::IDLE) {
+                // Failed messages wait before being sent again
+                auto retryTime = m->second.last_op + retryDelay(m->second.retried);
+                if (retryTime > now) {
+                    if (not nextRetry or retryTime < *nextRetry)
+                        nextRetry = retryTime;
+                    continue;
+                }
                 m->second.status = MessageStatus::SENDING;
                 m->second.retried++;
-                m->second.last_op = clock::now();
-                pending.emplace_back(PendingMsg {m->first, m->second.to, m->second.payloads});
+                m->second.last_op = now;
+                pending.emplace_back(m->first, m->second.payloads);
             }
         }
+        if (nextRetry)
+            scheduleRetry(peer, *nextRetry);
     }
+    if (pending.empty())
+        return;
     // avoid locking while calling callback
-    for (const auto& p : pending) {
-        JAMI_DBG() << "[message " << p.token << "] Retry sending";
-        if (p.payloads.find("application/im-gitmessage-id") == p.payloads.end())
+    for (const auto& [token, payloads] : pending) {
+        JAMI_DBG() << "[message " << token << "] Retry sending";
+        if (payloads.find("application/im-gitmessage-id") == payloads.end())
             emitSignal<DRing::ConfigurationSignal::AccountMessageStatusChanged>(
                 account_.getAccountID(),
                 "",
-                p.to,
-                std::to_string(p.token),
+                peer,
+                std::to_string(token),
                 (int) DRing::Account::MessageStates::SENDING);
-        account_.sendMessage(p.to, p.payloads, p.token, retryOnTimeout);
     }
+    account_.sendMessages(peer, pending, retryOnTimeout);
+}
+
+MessageEngine::clock::duration
+MessageEngine::retryDelay(unsigned retried)
+{
+    // The first retry is immediate, e.g. once reconnected after a timeout
+    if (retried <= 1)
+        return clock::duration::zero();
+    auto delay = RETRY_BACKOFF * (1u << std::min(retried - 2, 16u));
+    return std::min<clock::duration>(delay, RETRY_PERIOD);
+}
+
+void
+MessageEngine::scheduleRetry(const std::string& peer, clock::time_point time)
+{
+    auto& scheduled = retries_[peer];
+    if (scheduled != clock::time_point() and scheduled <= time)
+        return;
+    scheduled = time;
+    Manager::instance().scheduleTaskIn(
+        [this, w = account_.weak_from_this(), peer, time] {
+            if (auto acc = w.lock()) {
+                {
+                    std::lock_guard<std::mutex> lock(messagesMutex_);
+                    auto it = retries_.find(peer);
+                    if (it == retries_.end() or it->second != time)
+                        return;
+                    retries_.erase(it);
+                }
+                retrySend(peer);
+            }
+        },
+        time - clock::now());
 }
 
 MessageStatus
@@ -152,6 +292,7 @@ MessageEngine::cancel(MessageToken t)
                     m->second.to,
                     std::to_string(t),
                     static_cast<int>(DRing::Account::MessageStates::CANCELLED));
+            setChanged(p.first, t);
             save_();
             return true;
         }
@@ -184,6 +325,7 @@ MessageEngine::onMessageSent(const std::string& peer, MessageToken token, bool o
                         f->second.to,
                         std::to_string(token),
                         static_cast<int>(DRing::Account::MessageStates::SENT));
+                setChanged(peer, token);
                 save_();
             } else if (f->second.retried >= MAX_RETRIES) {
                 f->second.status = MessageStatus::FAILURE;
@@ -195,6 +337,7 @@ MessageEngine::onMessageSent(const std::string& peer, MessageToken token, bool o
                         f->second.to,
                         std::to_string(token),
                         static_cast<int>(DRing::Account::MessageStates::FAILURE));
+                setChanged(peer, token);
                 save_();
             } else {
                 f->second.status = MessageStatus::IDLE;
@@ -226,37 +369,42 @@ void
 MessageEngine::load()
 {
     try {
-        Json::Value root;
+        std::map<std::string, SavedMessage> saved;
+        bool json = false;
         {
             std::lock_guard<std::mutex> lock(fileutils::getFileLock(savePath_));
-            std::ifstream file;
-            file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-            fileutils::openStream(file, savePath_);
-            if (file.is_open())
-                file >> root;
+            if (fileutils::isFile(savePath_)) {
+                auto content = fileutils::loadFile(savePath_);
+                json = not content.empty() and content.front() == '{';
+                if (json) {
+                    saved = readJson(content);
+                    fileutils::remove(savePath_);
+                }
+            }
         }
+        if (not json)
+            saved = MapJournal<SavedMessage>::read(savePath_);
+
         std::lock_guard<std::mutex> lock(messagesMutex_);
         long unsigned loaded {0};
-        for (auto i = root.begin(); i != root.end(); ++i) {
-            auto to = i.key().asString();
-            auto& pmessages = *i;
-            auto& p = messages_[to];
-            for (auto m = pmessages.begin(); m != pmessages.end(); ++m) {
-                const auto& jmsg = *m;
-                MessageToken token = from_hex_string(m.key().asString());
-                Message msg;
-                msg.status = (MessageStatus) jmsg["status"].asInt();
-                msg.to = jmsg["to"].asString();
-                auto wall_time = std::chrono::system_clock::from_time_t(jmsg["last_op"].asInt64());
-                msg.last_op = clock::now() + (wall_time - std::chrono::system_clock::now());
-                msg.retried = jmsg.get("retried", 0).asUInt();
-                const auto& pl = jmsg["payload"];
-                for (auto p = pl.begin(); p != pl.end(); ++p)
-                    msg.payloads[p.key().asString()] = p->asString();
-                p.emplace(token, std::move(msg));
+        for (auto& [key, savedMsg] : saved) {
+            MessageToken token = from_hex_string(key.substr(0, key.find('/')));
+            Message msg;
+            msg.status = (MessageStatus) savedMsg.status;
+            msg.to = savedMsg.to;
+            auto wall_time = std::chrono::system_clock::from_time_t(savedMsg.last_op);
+            msg.last_op = clock::now() + (wall_time - std::chrono::system_clock::now());
+            msg.retried = savedMsg.retried;
+            msg.payloads = std::move(savedMsg.payloads);
+            auto to = msg.to;
+            if (messages_[to].emplace(token, std::move(msg)).second) {
+                // The messages read from JSON are saved again in the journal
+                if (json)
+                    setChanged(to, token);
                 loaded++;
             }
         }
+        save_();
         if (loaded > 0) {
             JAMI_DBG("[Account %s] loaded %lu messages from %s",
                      account_.getAccountID().c_str(),
@@ -275,71 +423,55 @@ void
 MessageEngine::save() const
 {
     std::lock_guard<std::mutex> lock(messagesMutex_);
+    for (const auto& [peer, messages] : messages_)
+        for (const auto& m : messages)
+            setChanged(peer, m.first);
     save_();
 }
 
 void
 MessageEngine::save_() const
 {
-    try {
-        Json::Value root(Json::objectValue);
-        for (auto& c : messages_) {
-            Json::Value peerRoot(Json::objectValue);
-            for (auto& m : c.second) {
-                auto& v = m.second;
-                if (v.status == MessageStatus::FAILURE || v.status == MessageStatus::SENT
-                    || v.status == MessageStatus::CANCELLED)
-                    continue;
-                Json::Value msg;
-                msg["status"] = (int) (v.status == MessageStatus::SENDING ? MessageStatus::IDLE
-                                                                          : v.status);
-                msg["to"] = v.to;
-                auto wall_time = std::chrono::system_clock::now()
-                                 + std::chrono::duration_cast<std::chrono::system_clock::duration>(
-                                     v.last_op - clock::now());
-                msg["last_op"] = (Json::Value::Int64) std::chrono::system_clock::to_time_t(
-                    wall_time);
-                msg["retried"] = v.retried;
-                auto& payloads = msg["payload"];
-                for (const auto& p : v.payloads)
-                    payloads[p.first] = p.second;
-                peerRoot[to_hex_string(m.first)] = std::move(msg);
+    if (changed_.empty())
+        return;
+    bool write;
+    {
+        std::lock_guard<std::mutex> lk(storage_->mutex);
+        for (const auto& [peer, token] : changed_) {
+            auto key = messageKey(peer, token);
+            const Message* v = nullptr;
+            auto p = messages_.find(peer);
+            if (p != messages_.end()) {
+                auto m = p->second.find(token);
+                if (m != p->second.end())
+                    v = &m->second;
             }
-            root[c.first] = std::move(peerRoot);
-        }
-        // Save asynchronously
-        dht::ThreadPool::computation().run([path = savePath_,
-                                            root = std::move(root),
-                                            accountID = account_.getAccountID(),
-                                            messageNum = messages_.size()] {
-            std::lock_guard<std::mutex> lock(fileutils::getFileLock(path));
-            try {
-                Json::StreamWriterBuilder wbuilder;
-                wbuilder["commentStyle"] = "None";
-                wbuilder["indentation"] = "";
-                const std::unique_ptr<Json::StreamWriter> writer(wbuilder.newStreamWriter());
-                std::ofstream file;
-                file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-                fileutils::openStream(file, path, std::ios::trunc);
-                if (file.is_open())
-                    writer->write(root, &file);
-            } catch (const std::exception& e) {
-                JAMI_ERR("[Account %s] Couldn't save messages to %s: %s",
-                         accountID.c_str(),
-                         path.c_str(),
-                         e.what());
+            if (not v or v->status == MessageStatus::FAILURE or v->status == MessageStatus::SENT
+                or v->status == MessageStatus::CANCELLED) {
+                storage_->changed.erase(key);
+                storage_->removed.emplace(std::move(key));
+                continue;
             }
-            JAMI_DBG("[Account %s] saved %zu messages to %s",
-                     accountID.c_str(),
-                     messageNum,
-                     path.c_str());
-        });
-    } catch (const std::exception& e) {
-        JAMI_ERR("[Account %s] couldn't save messages to %s: %s",
-                 account_.getAccountID().c_str(),
-                 savePath_.c_str(),
-                 e.what());
+            SavedMessage msg;
+            msg.status = (int) (v->status == MessageStatus::SENDING ? MessageStatus::IDLE
+                                                                    : v->status);
+            msg.to = v->to;
+            auto wall_time = std::chrono::system_clock::now()
+                             + std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                 v->last_op - clock::now());
+            msg.last_op = std::chrono::system_clock::to_time_t(wall_time);
+            msg.retried = v->retried;
+            msg.payloads = v->payloads;
+            storage_->removed.erase(key);
+            storage_->changed[key] = std::move(msg);
+        }
+        write = not storage_->writing;
+        storage_->writing = true;
     }
+    changed_.clear();
+    // The storage outlives the engine until its writes are done
+    if (write)
+        dht::ThreadPool::io().run([storage = storage_] { storage->write(); });
 }
 
 } // namespace im
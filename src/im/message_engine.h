@@ -21,6 +21,7 @@
 
 #include <string>
 #include <map>
+#include <memory>
 #include <set>
 #include <chrono>
 #include <mutex>
@@ -72,11 +73,29 @@ public:
 
 private:
     static const constexpr unsigned MAX_RETRIES = 20;
+    // Delay before the second retry, doubled for each of the next ones up to RETRY_PERIOD
+    static constexpr std::chrono::seconds RETRY_BACKOFF {5};
     static const std::chrono::minutes RETRY_PERIOD;
     using clock = std::chrono::steady_clock;
 
     void retrySend(const std::string& peer, bool retryOnTimeout = true);
+    /**
+     * @return delay before sending again a message sent retried times
+     */
+    static clock::duration retryDelay(unsigned retried);
+    /**
+     * Call retrySend() for peer at time, unless it is already planned before
+     * @note messagesMutex_ must be locked
+     */
+    void scheduleRetry(const std::string& peer, clock::time_point time);
+    /**
+     * Save the messages changed since the last save, out of the calling thread
+     */
     void save_() const;
+    void setChanged(const std::string& peer, MessageToken token) const
+    {
+        changed_.emplace(peer, token);
+    }
 
     struct Message
     {
@@ -89,9 +108,16 @@ private:
 
     SIPAccountBase& account_;
     const std::string savePath_;
+    // Journal of the pending messages, written in order by the thread pool
+    struct Storage;
+    std::shared_ptr<Storage> storage_;
 
     std::map<std::string, std::map<MessageToken, Message>> messages_;
     std::set<MessageToken> sentMessages_;
+    // Messages to save, by peer and token
+    mutable std::set<std::pair<std::string, MessageToken>> changed_;
+    // Next retry planned for the messages of a peer in backoff
+    std::map<std::string, clock::time_point> retries_;
 
     mutable std::mutex messagesMutex_ {};
 };
@@ -27,6 +27,11 @@
 #include <unistd.h>
 #include <limits.h>
 
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+
 #if defined(__ANDROID__) || defined(RING_UWP) || (defined(TARGET_OS_IOS) && TARGET_OS_IOS)
 #include "client/ring_signal.h"
 #endif
@@ -269,8 +274,90 @@ ip_utils::haveCommonAddr(const std::vector<IpAddr>& a, const std::vector<IpAddr>
     return false;
 }
 
-IpAddr
-ip_utils::getLocalAddr(pj_uint16_t family)
+/**
+ * Interfaces are looked up for each candidate, contact or connectivity check: syscalls which
+ * aren't needed until the network changes.
+ */
+struct InterfaceCache
+{
+    // Without a monitor, interfaces may change behind the cache
+    static constexpr std::chrono::seconds UNMONITORED_TTL {5};
+
+    static InterfaceCache& instance()
+    {
+        static InterfaceCache cache;
+        return cache;
+    }
+
+    // With the mutex locked
+    void clear()
+    {
+        ++generation;
+        addrs.clear();
+        allInterfaces.reset();
+    }
+    void expire(std::chrono::steady_clock::time_point now)
+    {
+        if (monitored)
+            return;
+        if (now >= expiry)
+            clear();
+        if (addrs.empty() and not allInterfaces)
+            expiry = now + UNMONITORED_TTL;
+    }
+
+    std::mutex mutex;
+    // Incremented on each change, a lookup racing with one isn't stored
+    uint64_t generation {0};
+    bool monitored {false};
+    std::chrono::steady_clock::time_point expiry {};
+    std::map<std::pair<std::string, pj_uint16_t>, IpAddr> addrs;
+    std::optional<std::vector<std::string>> allInterfaces;
+};
+
+void
+ip_utils::invalidateInterfaceCache()
+{
+    auto& cache = InterfaceCache::instance();
+    std::lock_guard<std::mutex> lk(cache.mutex);
+    cache.clear();
+}
+
+void
+ip_utils::setInterfaceCacheMonitored(bool monitored)
+{
+    auto& cache = InterfaceCache::instance();
+    std::lock_guard<std::mutex> lk(cache.mutex);
+    cache.monitored = monitored;
+    cache.clear();
+}
+
+template<typename Find>
+static IpAddr
+getCachedAddr(const std::string& interface, pj_uint16_t family, Find&& find)
+{
+    auto& cache = InterfaceCache::instance();
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lk(cache.mutex);
+        cache.expire(std::chrono::steady_clock::now());
+        auto it = cache.addrs.find({interface, family});
+        if (it != cache.addrs.end())
+            return it->second;
+        generation = cache.generation;
+    }
+    auto addr = find();
+    // Looked up again until there is one
+    if (addr and not addr.isUnspecified()) {
+        std::lock_guard<std::mutex> lk(cache.mutex);
+        if (generation == cache.generation)
+            cache.addrs.emplace(std::make_pair(interface, family), addr);
+    }
+    return addr;
+}
+
+static IpAddr
+findLocalAddr(pj_uint16_t family)
 {
     IpAddr ip_addr {};
     pj_status_t status = pj_gethostip(family, ip_addr.pjPtr());
@@ -289,11 +376,14 @@ ip_utils::getLocalAddr(pj_uint16_t family)
 }
 
 IpAddr
-ip_utils::getInterfaceAddr(const std::string& interface, pj_uint16_t family)
+ip_utils::getLocalAddr(pj_uint16_t family)
 {
-    if (interface == DEFAULT_INTERFACE)
-        return getLocalAddr(family);
+    return getCachedAddr(DEFAULT_INTERFACE, family, [&] { return findLocalAddr(family); });
+}
 
+static IpAddr
+findInterfaceAddr(const std::string& interface, pj_uint16_t family)
+{
     IpAddr addr {};
 
 #ifndef _WIN32
@@ -327,7 +417,7 @@ ip_utils::getInterfaceAddr(const std::string& interface, pj_uint16_t family)
 
     addr = ifr.ifr_addr;
     if (addr.isUnspecified())
-        return getLocalAddr(addr.getFamily());
+        return ip_utils::getLocalAddr(addr.getFamily());
 #else  // _WIN32
     struct addrinfo hints;
     struct addrinfo* result = NULL;
@@ -355,12 +445,20 @@ ip_utils::getInterfaceAddr(const std::string& interface, pj_uint16_t family)
     }
 
     if (addr.isUnspecified())
-        return getLocalAddr(addr.getFamily());
+        return ip_utils::getLocalAddr(addr.getFamily());
 #endif // !_WIN32
 
     return addr;
 }
 
+IpAddr
+ip_utils::getInterfaceAddr(const std::string& interface, pj_uint16_t family)
+{
+    if (interface == DEFAULT_INTERFACE)
+        return getLocalAddr(family);
+    return getCachedAddr(interface, family, [&] { return findInterfaceAddr(interface, family); });
+}
+
 std::vector<std::string>
 ip_utils::getAllIpInterfaceByName()
 {
@@ -392,6 +490,16 @@ ip_utils::getAllIpInterfaceByName()
 std::vector<std::string>
 ip_utils::getAllIpInterface()
 {
+    auto& cache = InterfaceCache::instance();
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lk(cache.mutex);
+        cache.expire(std::chrono::steady_clock::now());
+        if (cache.allInterfaces)
+            return *cache.allInterfaces;
+        generation = cache.generation;
+    }
+
     pj_sockaddr addrList[16];
     unsigned addrCnt = PJ_ARRAY_SIZE(addrList);
 
@@ -405,6 +513,9 @@ ip_utils::getAllIpInterface()
         }
     }
 
+    std::lock_guard<std::mutex> lk(cache.mutex);
+    if (generation == cache.generation)
+        cache.allInterfaces = ifaceList;
     return ifaceList;
 }
 
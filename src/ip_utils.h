@@ -313,6 +313,17 @@ getAnyHostAddr(pj_uint16_t family)
     return IpAddr(family);
 }
 
+/**
+ * Forget the cached addresses of the interfaces, to be called when the network changed.
+ * Unless monitored, they are also forgotten after a few seconds.
+ */
+void invalidateInterfaceCache();
+
+/**
+ * @param monitored     True while a NetworkMonitor invalidates the cache on each change
+ */
+void setInterfaceCacheMonitored(bool monitored);
+
 /**
  * Return the first host IP address of the specified family.
  * If no address of the specified family is found, another family will
@@ -322,12 +333,14 @@ getAnyHostAddr(pj_uint16_t family)
  *
  * If family is unspecified, default to pj_AF_INET6() if compiled
  * with IPv6, or pj_AF_INET() otherwise.
+ * Cached, see invalidateInterfaceCache().
  */
 IpAddr getLocalAddr(pj_uint16_t family);
 
 /**
  * Get the IP address of the network interface interface with the specified
  * address family, or of any address family if unspecified (default).
+ * Cached, see invalidateInterfaceCache().
  */
 IpAddr getInterfaceAddr(const std::string& interface, pj_uint16_t family);
 
@@ -348,6 +361,7 @@ std::vector<std::string> getAllIpInterfaceByName();
  * @return std::vector<std::string> A std::string vector
  * of IP address available on all of the interfaces on
  * the system.
+ * Cached, see invalidateInterfaceCache().
  */
 std::vector<std::string> getAllIpInterface();
 
@@ -190,6 +190,7 @@ namespace Presence {
 constexpr static const char SUPPORT_PUBLISH[] = "Account.presencePublishSupported";
 constexpr static const char SUPPORT_SUBSCRIBE[] = "Account.presenceSubscribeSupported";
 constexpr static const char ENABLED[] = "Account.presenceEnabled";
+constexpr static const char LIST_URI[] = "Account.presenceListUri";
 
 } // namespace Presence
 
@@ -60,6 +60,9 @@ constexpr static char VIDEO_SOURCE[] = "VIDEO_SOURCE";
 constexpr static char AUDIO_ONLY[] = "AUDIO_ONLY";
 constexpr static char AUDIO_CODEC[] = "AUDIO_CODEC";
 constexpr static char VIDEO_CODEC[] = "VIDEO_CODEC";
+// Milliseconds from the answer to the setup of the first remote stream
+constexpr static char AUDIO_SETUP_DELAY[] = "AUDIO_SETUP_DELAY";
+constexpr static char VIDEO_SETUP_DELAY[] = "VIDEO_SETUP_DELAY";
 
 } // namespace Details
 
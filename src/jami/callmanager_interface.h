@@ -163,6 +163,51 @@ DRING_PUBLIC void raiseHand(const std::string& accountId,
                             const bool& state);
 
 /* Statistic related methods */
+/**
+ * Statistics of a media stream of a call. The counters are cumulated since the
+ * stream started, the rates being computed by the client between two reports.
+ */
+struct DRING_PUBLIC MediaStreamStats
+{
+    std::string streamId;
+    std::string mediaType; // MediaAttributeValue::AUDIO or VIDEO
+    std::string sendCodec;
+    std::string receiveCodec;
+
+    // RTP, of the packets sent and received
+    uint64_t packetsSent {0};
+    uint64_t bytesSent {0};
+    uint64_t packetsReceived {0};
+    uint64_t bytesReceived {0};
+    uint64_t packetsLost {0};
+    double jitter {0}; // in seconds
+    // From the last RTCP report of the peer
+    double remoteFractionLost {0};
+    double roundTripTime {0}; // in seconds, 0 until measured
+
+    // Key frames requested to the peer, and by the peer (video)
+    uint64_t keyFramesRequested {0};
+    uint64_t keyFrameRequestsReceived {0};
+
+    uint64_t framesEncoded {0};
+    double totalEncodeTime {0}; // in seconds
+    bool hardwareEncoding {false};
+    uint64_t framesDecoded {0};
+    double decodeLatency {0}; // in seconds, recent average
+    bool hardwareDecoding {false};
+};
+
+DRING_PUBLIC std::vector<MediaStreamStats> getCallStats(const std::string& accountId,
+                                                        const std::string& callId);
+/**
+ * Emit CallStats for the call at this interval, until the end of the call
+ * @param intervalMs    0 to stop
+ */
+DRING_PUBLIC void setCallStatsInterval(const std::string& accountId,
+                                       const std::string& callId,
+                                       uint32_t intervalMs);
+
+/// DEPRECATED, use setCallStatsInterval
 DRING_PUBLIC void startSmartInfo(uint32_t refreshTimeMs);
 DRING_PUBLIC void stopSmartInfo();
 
@@ -305,6 +350,13 @@ struct DRING_PUBLIC CallSignal
         constexpr static const char* name = "SmartInfo";
         using cb_type = void(const std::map<std::string, std::string>&);
     };
+    struct DRING_PUBLIC CallStats
+    {
+        constexpr static const char* name = "CallStats";
+        using cb_type = void(const std::string& /*accountId*/,
+                             const std::string& /*callId*/,
+                             const std::vector<MediaStreamStats>&);
+    };
     struct DRING_PUBLIC ConnectionUpdate
     {
         constexpr static const char* name = "ConnectionUpdate";
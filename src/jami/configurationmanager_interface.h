@@ -65,6 +65,15 @@ DRING_PUBLIC std::map<std::string, std::string> getAccountTemplate(const std::st
 DRING_PUBLIC std::string addAccount(const std::map<std::string, std::string>& details,
                                     const std::string& accountID = {});
 DRING_PUBLIC void monitor(bool continuous);
+/**
+ * @return the metrics of the daemon, in the OpenMetrics text format
+ */
+DRING_PUBLIC std::string getMetrics();
+/**
+ * Serve the metrics at http://127.0.0.1:<port>/metrics, 0 to stop
+ * @return false if the port can't be bound
+ */
+DRING_PUBLIC bool setMetricsPort(uint16_t port);
 DRING_PUBLIC bool exportOnRing(const std::string& accountID, const std::string& password);
 DRING_PUBLIC bool exportToFile(const std::string& accountID,
                                const std::string& destinationPath,
@@ -141,6 +150,15 @@ DRING_PUBLIC void setNoiseSuppressState(bool state);
 DRING_PUBLIC bool isAgcEnabled();
 DRING_PUBLIC void setAgcState(bool enabled);
 
+DRING_PUBLIC bool isLowLatencyAudio();
+DRING_PUBLIC void setLowLatencyAudio(bool enabled);
+/**
+ * Latency of the audio devices, in microseconds: "period" (requested in low-latency mode, 0
+ * otherwise), "capture", "playback" and "roundTrip" (as measured on the streams, 0 if unknown),
+ * and "processing", added to the capture by the echo cancellation and noise suppression
+ */
+DRING_PUBLIC std::map<std::string, std::string> getAudioLatency();
+
 DRING_PUBLIC void muteDtmf(bool mute);
 DRING_PUBLIC bool isDtmfMuted();
 
@@ -259,6 +277,8 @@ DRING_PUBLIC void setPushNotificationToken(const std::string& pushDeviceToken);
 DRING_PUBLIC void setPushNotificationTopic(const std::string& topic);
 /**
  * To be called by clients with relevant data when a push notification is received.
+ * The push notifications received for a Jami account within a short window are handled
+ * together, PushNotificationsHandled is emitted once they are.
  */
 DRING_PUBLIC void pushNotificationReceived(const std::string& from,
                                            const std::map<std::string, std::string>& data);
@@ -541,6 +561,15 @@ struct DRING_PUBLIC ConfigurationSignal
         constexpr static const char* name = "MessageSend";
         using cb_type = void(const std::string&);
     };
+    /**
+     * The push notifications received together were handled: values fetched from
+     * the DHT proxy and conversations synced
+     */
+    struct DRING_PUBLIC PushNotificationsHandled
+    {
+        constexpr static const char* name = "PushNotificationsHandled";
+        using cb_type = void(const std::string& /*accountId*/, int /* push notifications */);
+    };
 };
 
 } // namespace DRing
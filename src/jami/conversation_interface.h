@@ -23,14 +23,55 @@
 
 #include "def.h"
 
+#include <cstdint>
 #include <vector>
 #include <map>
 #include <string>
+#include <string_view>
 
 #include "jami.h"
 
 namespace DRing {
 
+/**
+ * Messages of a conversation in a flat layout, for the clients loading long histories: the
+ * values of all the messages are concatenated in one buffer rather than stored in one map per
+ * message, so that a binding can hand over the whole history in a few arrays.
+ *
+ * Each field is described by 3 integers in fields: the index of its key in keys, and the
+ * offset and the size of its value in data. The fields of the message i are the ones from
+ * messages[i] to messages[i + 1].
+ */
+struct DRING_PUBLIC PackedMessages
+{
+    std::vector<std::string> keys;
+    std::string data;
+    std::vector<uint32_t> fields;
+    std::vector<uint32_t> messages {0};
+
+    size_t size() const { return messages.size() - 1; }
+
+    /**
+     * @return the value of key for the message i, empty if it has no such field
+     */
+    std::string_view value(size_t i, std::string_view key) const
+    {
+        for (auto f = messages[i]; f < messages[i + 1]; ++f)
+            if (keys[fields[3 * f]] == key)
+                return std::string_view(data).substr(fields[3 * f + 1], fields[3 * f + 2]);
+        return {};
+    }
+
+    std::map<std::string, std::string> toMap(size_t i) const
+    {
+        std::map<std::string, std::string> message;
+        for (auto f = messages[i]; f < messages[i + 1]; ++f)
+            message.emplace(keys[fields[3 * f]],
+                            data.substr(fields[3 * f + 1], fields[3 * f + 2]));
+        return message;
+    }
+};
+
 // Conversation management
 DRING_PUBLIC std::string startConversation(const std::string& accountId);
 DRING_PUBLIC void acceptConversationRequest(const std::string& accountId,
@@ -49,6 +90,8 @@ DRING_PUBLIC void updateConversationInfos(const std::string& accountId,
                                           const std::map<std::string, std::string>& infos);
 DRING_PUBLIC std::map<std::string, std::string> conversationInfos(const std::string& accountId,
                                                                   const std::string& conversationId);
+DRING_PUBLIC std::map<std::string, std::string> conversationPackState(
+    const std::string& accountId, const std::string& conversationId);
 
 // Member management
 DRING_PUBLIC void addConversationMember(const std::string& accountId,
@@ -69,6 +112,14 @@ DRING_PUBLIC uint32_t loadConversationMessages(const std::string& accountId,
                                                const std::string& conversationId,
                                                const std::string& fromMessage,
                                                size_t n);
+/**
+ * Same as loadConversationMessages(), the messages being emitted as PackedMessages, with
+ * ConversationLoadedPacked
+ */
+DRING_PUBLIC uint32_t loadConversationMessagesPacked(const std::string& accountId,
+                                                     const std::string& conversationId,
+                                                     const std::string& fromMessage,
+                                                     size_t n);
 DRING_PUBLIC uint32_t loadConversationUntil(const std::string& accountId,
                                             const std::string& conversationId,
                                             const std::string& fromMessage,
@@ -98,6 +149,14 @@ struct DRING_PUBLIC ConversationSignal
                              const std::string& /* conversationId */,
                              std::vector<std::map<std::string, std::string>> /*messages*/);
     };
+    struct DRING_PUBLIC ConversationLoadedPacked
+    {
+        constexpr static const char* name = "ConversationLoadedPacked";
+        using cb_type = void(uint32_t /* id */,
+                             const std::string& /*accountId*/,
+                             const std::string& /* conversationId */,
+                             const PackedMessages& /*messages*/);
+    };
     struct DRING_PUBLIC MessagesFound
     {
         constexpr static const char* name = "MessagesFound";
@@ -113,6 +172,14 @@ struct DRING_PUBLIC ConversationSignal
                              const std::string& /* conversationId */,
                              std::map<std::string, std::string> /*message*/);
     };
+    // Consecutive MessageReceived of a conversation, see setSignalBatching()
+    struct DRING_PUBLIC MessagesReceived
+    {
+        constexpr static const char* name = "MessagesReceived";
+        using cb_type = void(const std::string& /*accountId*/,
+                             const std::string& /* conversationId */,
+                             std::vector<std::map<std::string, std::string>> /*messages*/);
+    };
     struct DRING_PUBLIC ConversationProfileUpdated
     {
         constexpr static const char* name = "ConversationProfileUpdated";
@@ -160,6 +227,14 @@ struct DRING_PUBLIC ConversationSignal
         using cb_type = void(const std::string& /*accountId*/);
     };
 
+    struct DRING_PUBLIC ConversationSyncProgress
+    {
+        constexpr static const char* name = "ConversationSyncProgress";
+        using cb_type = void(const std::string& /*accountId*/,
+                             int /* fetched conversations */,
+                             int /* conversations to fetch */);
+    };
+
     struct DRING_PUBLIC CallConnectionRequest
     {
         constexpr static const char* name = "CallConnectionRequest";
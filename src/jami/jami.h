@@ -177,6 +177,15 @@ DRING_PUBLIC void registerSignalHandlers(
     const std::map<std::string, std::shared_ptr<CallbackWrapperBase>>&);
 DRING_PUBLIC void unregisterSignalHandlers();
 
+/**
+ * Coalesce the high-frequency signals, for the clients for which each signal is costly
+ * (e.g. a D-Bus message or a JNI call). When enabled, the messages received by the
+ * conversations are emitted per batch with ConversationSignal::MessagesReceived instead of
+ * MessageReceived, and a DataTransferEvent repeated for an ongoing transfer is emitted at
+ * most once per second. Disabled by default.
+ */
+DRING_PUBLIC void setSignalBatching(bool enabled) noexcept;
+
 using MediaMap = std::map<std::string, std::string>;
 
 } // namespace DRing
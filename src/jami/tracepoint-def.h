@@ -229,6 +229,188 @@ LTTNG_UST_TRACEPOINT_EVENT(
     )
 )
 
+/*
+ * Media pipeline: a frame is followed by the address of its AVFrame, from its
+ * capture to its encoding and from its decoding to its rendering. A stage
+ * making a new frame from another (resampling, mixing, scaling...) links them.
+ */
+
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(
+    jami,
+    media_frame_class,
+    LTTNG_UST_TP_ARGS(
+            const char*, media,
+            const void*, frame
+    ),
+    LTTNG_UST_TP_FIELDS(
+            lttng_ust_field_string(media, media)
+            lttng_ust_field_integer_hex(uint64_t, frame, (uintptr_t) frame)
+    )
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(
+    jami,
+    media_frame_class,
+    jami,
+    media_frame_capture,
+    LTTNG_UST_TP_ARGS(
+            const char*, media,
+            const void*, frame
+    )
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(
+    jami,
+    media_frame_class,
+    jami,
+    media_frame_render,
+    LTTNG_UST_TP_ARGS(
+            const char*, media,
+            const void*, frame
+    )
+)
+
+LTTNG_UST_TRACEPOINT_EVENT(
+    jami,
+    media_frame_link,
+    LTTNG_UST_TP_ARGS(
+            const void*, from,
+            const void*, to
+    ),
+    LTTNG_UST_TP_FIELDS(
+            lttng_ust_field_integer_hex(uint64_t, from, (uintptr_t) from)
+            lttng_ust_field_integer_hex(uint64_t, to, (uintptr_t) to)
+    )
+)
+
+/*
+ * The packets written while a frame is encoded, on the same thread, are the
+ * packets of the frame. stream is the SocketPair of the RTP session, if any.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(
+    jami,
+    media_encode_begin,
+    LTTNG_UST_TP_ARGS(
+            const void*, stream,
+            const void*, frame,
+            int64_t, pts
+    ),
+    LTTNG_UST_TP_FIELDS(
+            lttng_ust_field_integer_hex(uint64_t, stream, (uintptr_t) stream)
+            lttng_ust_field_integer_hex(uint64_t, frame, (uintptr_t) frame)
+            lttng_ust_field_integer(int64_t, pts, pts)
+    )
+)
+
+LTTNG_UST_TRACEPOINT_EVENT(
+    jami,
+    media_encode_end,
+    LTTNG_UST_TP_ARGS(
+            const void*, stream
+    ),
+    LTTNG_UST_TP_FIELDS(
+            lttng_ust_field_integer_hex(uint64_t, stream, (uintptr_t) stream)
+    )
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(
+    jami,
+    media_packet_class,
+    LTTNG_UST_TP_ARGS(
+            const void*, stream,
+            int64_t, pts,
+            int, size
+    ),
+    LTTNG_UST_TP_FIELDS(
+            lttng_ust_field_integer_hex(uint64_t, stream, (uintptr_t) stream)
+            lttng_ust_field_integer(int64_t, pts, pts)
+            lttng_ust_field_integer(int, packet_length, size)
+    )
+)
+
+/* Encoded packet given to the muxer */
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(
+    jami,
+    media_packet_class,
+    jami,
+    media_packetize,
+    LTTNG_UST_TP_ARGS(
+            const void*, stream,
+            int64_t, pts,
+            int, size
+    )
+)
+
+/* Packet out of the demuxer, reordered by its jitter buffer, pts in RTP clock */
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(
+    jami,
+    media_packet_class,
+    jami,
+    media_demux,
+    LTTNG_UST_TP_ARGS(
+            const void*, stream,
+            int64_t, pts,
+            int, size
+    )
+)
+
+/* Frame decoded from the packet of pts, on the demuxing thread */
+LTTNG_UST_TRACEPOINT_EVENT(
+    jami,
+    media_decode_end,
+    LTTNG_UST_TP_ARGS(
+            const void*, frame,
+            int64_t, pts
+    ),
+    LTTNG_UST_TP_FIELDS(
+            lttng_ust_field_integer_hex(uint64_t, frame, (uintptr_t) frame)
+            lttng_ust_field_integer(int64_t, pts, pts)
+    )
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(
+    jami,
+    rtp_packet_class,
+    LTTNG_UST_TP_ARGS(
+            const void*, socket,
+            const uint8_t*, header
+    ),
+    LTTNG_UST_TP_FIELDS(
+            lttng_ust_field_integer_hex(uint64_t, stream, (uintptr_t) socket)
+            lttng_ust_field_integer_hex(uint32_t, ssrc,
+                                        (uint32_t) header[8] << 24 | header[9] << 16
+                                        | header[10] << 8 | header[11])
+            lttng_ust_field_integer(uint16_t, seq, header[2] << 8 | header[3])
+            lttng_ust_field_integer(uint32_t, timestamp,
+                                    (uint32_t) header[4] << 24 | header[5] << 16
+                                    | header[6] << 8 | header[7])
+    )
+)
+
+#define JAMI_RTP_PACKET_EVENT(name)                                     \
+    LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(                                \
+        jami,                                                           \
+        rtp_packet_class,                                               \
+        jami,                                                           \
+        name,                                                           \
+        LTTNG_UST_TP_ARGS(                                              \
+            const void*, socket,                                        \
+            const uint8_t*, header                                      \
+        )                                                               \
+    )
+
+/* Written by the muxer */
+JAMI_RTP_PACKET_EVENT(rtp_packetize)
+/* Encrypted, once paced */
+JAMI_RTP_PACKET_EVENT(rtp_srtp_encrypt)
+/* Given to the socket or the ICE transport */
+JAMI_RTP_PACKET_EVENT(rtp_send)
+/* Read by the demuxer */
+JAMI_RTP_PACKET_EVENT(rtp_recv)
+JAMI_RTP_PACKET_EVENT(rtp_srtp_decrypt)
+
+#undef JAMI_RTP_PACKET_EVENT
+
 #endif /* TRACEPOINT_DEF_H */
 
 #include <lttng/tracepoint-event.h>
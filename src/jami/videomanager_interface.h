@@ -196,6 +196,17 @@ DRING_PUBLIC bool playerSeekToTime(const std::string& id, int time);
 int64_t getPlayerPosition(const std::string& id);
 
 DRING_PUBLIC bool registerSinkTarget(const std::string& sinkId, SinkTarget target);
+/**
+ * Size of the area a sink is shown in, for its frames to be downscaled by the daemon.
+ * 0x0 when the sink is hidden, its frames being skipped; -1x-1 to get them at their resolution
+ * (default).
+ */
+DRING_PUBLIC bool setSinkTargetSize(const std::string& sinkId, int width, int height);
+/**
+ * Maximum frame rate of a sink, e.g. in the background: its other frames are skipped before
+ * being converted. 0 pauses the sink; a negative rate sends all its frames (default).
+ */
+DRING_PUBLIC bool setSinkMaxFrameRate(const std::string& sinkId, double fps);
 #ifdef ENABLE_SHM
 DRING_PUBLIC void startShmSink(const std::string& sinkId, bool value);
 #endif
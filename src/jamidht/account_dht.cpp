@@ -0,0 +1,418 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "account_dht.h"
+
+#include "fileutils.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <opendht/securedht.h>
+#include <opendht/thread_pool.h>
+
+#include <random>
+
+namespace jami {
+
+SharedDhtNode::SharedDhtNode()
+    : runner_(std::make_shared<dht::DhtRunner>())
+{}
+
+SharedDhtNode::~SharedDhtNode()
+{
+    join();
+}
+
+void
+SharedDhtNode::attach(const void* account,
+                      in_port_t port,
+                      dht::DhtRunner::Config config,
+                      dht::DhtRunner::Context context,
+                      DhtStatusCallback&& cb)
+{
+    {
+        std::lock_guard<std::mutex> lk(startMutex_);
+        if (not runner_->isRunning()) {
+            // Nor the identity nor the push notifications of the account
+            config.dht_config.id = {};
+            config.dht_config.node_config.persist_path = fileutils::get_cache_dir()
+                                                         + DIR_SEPARATOR_STR "dhtstate";
+            config.push_node_id.clear();
+            config.push_token.clear();
+            config.push_topic.clear();
+            context.peerDiscovery = {};
+            context.identityAnnouncedCb = {};
+            context.statusChangedCallback = [this](dht::NodeStatus s4, dht::NodeStatus s6) {
+                std::lock_guard<std::mutex> lk(mutex_);
+                status4_ = s4;
+                status6_ = s6;
+                for (const auto& [account, cb] : accounts_)
+                    cb(s4, s6);
+            };
+            JAMI_DBG("Starting the shared DHT node on port %u", port);
+            runner_->run(port, config, std::move(context));
+        }
+    }
+    if (not cb)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        accounts_[account] = std::move(cb);
+    }
+    // The current status, out of the registration of the account
+    dht::ThreadPool::io().run([w = weak_from_this(), account] {
+        if (auto node = w.lock()) {
+            std::lock_guard<std::mutex> lk(node->mutex_);
+            auto it = node->accounts_.find(account);
+            if (it != node->accounts_.end())
+                it->second(node->status4_, node->status6_);
+        }
+    });
+}
+
+void
+SharedDhtNode::detach(const void* account)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    accounts_.erase(account);
+}
+
+void
+SharedDhtNode::join()
+{
+    std::lock_guard<std::mutex> lk(startMutex_);
+    runner_->join();
+}
+
+AccountDht::AccountDht(std::shared_ptr<SharedDhtNode> node)
+    : node_(std::move(node))
+    , runner_(node_ ? node_->runner() : std::make_shared<dht::DhtRunner>())
+{}
+
+AccountDht::~AccountDht()
+{
+    if (node_)
+        shutdown({});
+}
+
+bool
+AccountDht::isRunning() const
+{
+    if (node_)
+        return running_ and runner_->isRunning();
+    return runner_->isRunning();
+}
+
+void
+AccountDht::run(in_port_t port,
+                const dht::DhtRunner::Config& config,
+                dht::DhtRunner::Context&& context)
+{
+    if (not node_) {
+        runner_->run(port, config, std::move(context));
+        return;
+    }
+    identity_ = config.dht_config.id;
+    publicKey_ = identity_.first
+                     ? std::make_shared<dht::crypto::PublicKey>(identity_.first->getPublicKey())
+                     : nullptr;
+    auto onAnnounced = std::move(context.identityAnnouncedCb);
+    auto onStatus = std::move(context.statusChangedCallback);
+    node_->attach(this, port, config, std::move(context), std::move(onStatus));
+    running_ = true;
+
+    // Published as SecureDht does, for the peers to find the public key of the account
+    if (auto cert = identity_.second) {
+        auto key = cert->getPublicKey().getId();
+        auto value = std::make_shared<dht::Value>(dht::CERTIFICATE_TYPE, *cert, 1);
+        addPermanentPut(key, value);
+        runner_->put(
+            key,
+            std::move(value),
+            [onAnnounced = std::move(onAnnounced)](bool ok) {
+                if (onAnnounced)
+                    onAnnounced(ok);
+            },
+            {},
+            true);
+    }
+}
+
+void
+AccountDht::shutdown(dht::ShutdownCallback cb, bool stop)
+{
+    if (not node_) {
+        runner_->shutdown(std::move(cb), stop);
+        return;
+    }
+    running_ = false;
+    node_->detach(this);
+    decltype(listens_) listens;
+    {
+        std::lock_guard<std::mutex> lk(listensMtx_);
+        listens = std::move(listens_);
+        listens_.clear();
+    }
+    for (const auto& [token, listen] : listens)
+        runner_->cancelListen(listen.first, listen.second);
+    // Else announced by the node for as long as it runs
+    decltype(permanentPuts_) puts;
+    {
+        std::lock_guard<std::mutex> lk(putsMtx_);
+        puts = std::move(permanentPuts_);
+        permanentPuts_.clear();
+    }
+    for (const auto& [key, value] : puts)
+        runner_->cancelPut(key, value->id);
+    if (cb)
+        cb();
+}
+
+void
+AccountDht::join()
+{
+    // The shared node is joined by the Manager
+    if (not node_)
+        runner_->join();
+}
+
+void
+AccountDht::setPushNotificationToken(const std::string& token)
+{
+    // A proxy client can only notify one account
+    if (not node_)
+        runner_->setPushNotificationToken(token);
+}
+
+void
+AccountDht::setPushNotificationTopic(const std::string& topic)
+{
+    if (not node_)
+        runner_->setPushNotificationTopic(topic);
+}
+
+void
+AccountDht::pushNotificationReceived(const std::map<std::string, std::string>& data)
+{
+    runner_->pushNotificationReceived(data);
+}
+
+std::shared_ptr<dht::crypto::PublicKey>
+AccountDht::getPublicKey() const
+{
+    if (node_)
+        return publicKey_;
+    return runner_->getPublicKey();
+}
+
+void
+AccountDht::putEncrypted(const dht::InfoHash& key,
+                         const std::shared_ptr<dht::crypto::PublicKey>& to,
+                         std::shared_ptr<dht::Value> value,
+                         dht::DoneCallbackSimple cb)
+{
+    countOperation(Operation::PUT);
+    if (not node_) {
+        runner_->putEncrypted(key, to, std::move(value), std::move(cb));
+        return;
+    }
+    encryptAndPut(runner_, identity_.first, key, to, std::move(value), std::move(cb));
+}
+
+void
+AccountDht::putEncrypted(const dht::InfoHash& key,
+                         const dht::InfoHash& to,
+                         std::shared_ptr<dht::Value> value,
+                         dht::DoneCallbackSimple cb)
+{
+    countOperation(Operation::PUT);
+    if (not node_) {
+        runner_->putEncrypted(key, to, std::move(value), std::move(cb));
+        return;
+    }
+    runner_->findCertificate(
+        to,
+        [runner = runner_,
+         privateKey = identity_.first,
+         key,
+         value = std::move(value),
+         cb = std::move(cb)](const std::shared_ptr<dht::crypto::Certificate>& cert) mutable {
+            if (not cert) {
+                if (cb)
+                    cb(false);
+                return;
+            }
+            encryptAndPut(runner,
+                          privateKey,
+                          key,
+                          std::make_shared<dht::crypto::PublicKey>(cert->getPublicKey()),
+                          std::move(value),
+                          std::move(cb));
+        });
+}
+
+void
+AccountDht::encryptAndPut(const std::shared_ptr<dht::DhtRunner>& runner,
+                          const std::shared_ptr<dht::crypto::PrivateKey>& key,
+                          const dht::InfoHash& location,
+                          const std::shared_ptr<dht::crypto::PublicKey>& to,
+                          std::shared_ptr<dht::Value> value,
+                          dht::DoneCallbackSimple cb)
+{
+    if (not to or not key) {
+        if (cb)
+            cb(false);
+        return;
+    }
+    // Signed and encrypted out of the calling thread, as a node does
+    dht::ThreadPool::computation().run([runner,
+                                        key,
+                                        location,
+                                        to,
+                                        value = std::move(value),
+                                        cb = std::move(cb)]() mutable {
+        try {
+            if (value->id == dht::Value::INVALID_ID) {
+                std::random_device rd;
+                value->id = std::uniform_int_distribution<dht::Value::Id> {1}(rd);
+            }
+            value->setRecipient(to->getId());
+            value->sign(*key);
+            auto encrypted = std::make_shared<dht::Value>(value->id);
+            encrypted->setCypher(to->encrypt(value->getToEncrypt()));
+            runner->put(location, std::move(encrypted), std::move(cb));
+        } catch (const std::exception& e) {
+            JAMI_ERR("Couldn't encrypt value for %s: %s", to->getId().toString().c_str(), e.what());
+            if (cb)
+                cb(false);
+        }
+    });
+}
+
+void
+AccountDht::countOperation(Operation op)
+{
+    static auto& registry = metrics::Registry::instance();
+    static metrics::Counter* counters[] = {
+        &registry.counter("jami_dht_operations", "DHT operations requested", {{"op", "put"}}),
+        &registry.counter("jami_dht_operations", "DHT operations requested", {{"op", "get"}}),
+        &registry.counter("jami_dht_operations", "DHT operations requested", {{"op", "listen"}}),
+    };
+    counters[static_cast<size_t>(op)]->add();
+}
+
+std::shared_ptr<dht::Value>
+AccountDht::checkValue(const std::shared_ptr<dht::crypto::PrivateKey>& key,
+                       const dht::InfoHash& id,
+                       const std::shared_ptr<dht::Value>& v)
+{
+    if (v->isEncrypted()) {
+        if (not key)
+            return {};
+        try {
+            auto decrypted = key->decrypt(v->cypher);
+            auto value = std::make_shared<dht::Value>(v->id);
+            value->msgpack_unpack_body(
+                msgpack::unpack((const char*) decrypted.data(), decrypted.size()).get());
+            if (value->recipient != id or not value->checkSignature())
+                return {};
+            return value;
+        } catch (const std::exception&) {
+            // Usually for another account
+            return {};
+        }
+    }
+    if (v->isSigned() and not v->checkSignature())
+        return {};
+    return v;
+}
+
+std::future<size_t>
+AccountDht::listenShared(const dht::InfoHash& key,
+                         dht::ValueCallback&& cb,
+                         dht::Value::Filter&& filter)
+{
+    // Filtered once decrypted, encrypted values having no type
+    auto token = runner_->listen(
+        key,
+        [cb = std::move(cb),
+         filter = std::move(filter),
+         privateKey = identity_.first,
+         id = publicKey_ ? publicKey_->getId() : dht::InfoHash()](
+            const std::vector<std::shared_ptr<dht::Value>>& values, bool expired) {
+            std::vector<std::shared_ptr<dht::Value>> checked;
+            checked.reserve(values.size());
+            for (const auto& v : values) {
+                auto value = checkValue(privateKey, id, v);
+                if (value and (not filter or filter(*value)))
+                    checked.emplace_back(std::move(value));
+            }
+            return checked.empty() or cb(checked, expired);
+        });
+
+    std::lock_guard<std::mutex> lk(listensMtx_);
+    auto localToken = ++listenToken_;
+    listens_.emplace(localToken, std::make_pair(key, token.share()));
+    std::promise<size_t> ret;
+    ret.set_value(localToken);
+    return ret.get_future();
+}
+
+void
+AccountDht::cancelShared(const dht::InfoHash& key, size_t token)
+{
+    std::lock_guard<std::mutex> lk(listensMtx_);
+    auto it = listens_.find(token);
+    if (it == listens_.end())
+        return;
+    runner_->cancelListen(key, it->second.second);
+    listens_.erase(it);
+}
+
+void
+AccountDht::addPermanentPut(const dht::InfoHash& key, std::shared_ptr<dht::Value> value)
+{
+    std::lock_guard<std::mutex> lk(putsMtx_);
+    permanentPuts_.emplace_back(key, std::move(value));
+}
+
+void
+AccountDht::getShared(const dht::InfoHash& key,
+                      ValuesCallback&& cb,
+                      dht::DoneCallbackSimple&& done,
+                      dht::Value::Filter&& filter)
+{
+    runner_->get(
+        key,
+        [cb = std::move(cb),
+         filter = std::move(filter),
+         privateKey = identity_.first,
+         id = publicKey_ ? publicKey_->getId() : dht::InfoHash()](
+            const std::vector<std::shared_ptr<dht::Value>>& values) {
+            std::vector<std::shared_ptr<dht::Value>> checked;
+            checked.reserve(values.size());
+            for (const auto& v : values) {
+                auto value = checkValue(privateKey, id, v);
+                if (value and (not filter or filter(*value)))
+                    checked.emplace_back(std::move(value));
+            }
+            return checked.empty() or cb(checked);
+        },
+        std::move(done));
+}
+
+} // namespace jami
@@ -0,0 +1,312 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "noncopyable.h"
+
+#include <opendht/dhtrunner.h>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace jami {
+
+using DhtStatusCallback = std::function<void(dht::NodeStatus, dht::NodeStatus)>;
+
+/**
+ * DHT node shared by the Jami accounts of the daemon (Preferences::getSharedDht()).
+ *
+ * The node has no identity: each account signs, encrypts and checks its values
+ * (see AccountDht). The listens of the accounts on the same key share the same search.
+ */
+class SharedDhtNode : public std::enable_shared_from_this<SharedDhtNode>
+{
+public:
+    SharedDhtNode();
+    ~SharedDhtNode();
+
+    const std::shared_ptr<dht::DhtRunner>& runner() const { return runner_; }
+
+    /**
+     * Start the node if not running, with the configuration of the first account
+     * @param account   Key of the account, for detach()
+     * @param cb        Called with the status of the node, now and on changes, until detach()
+     */
+    void attach(const void* account,
+                in_port_t port,
+                dht::DhtRunner::Config config,
+                dht::DhtRunner::Context context,
+                DhtStatusCallback&& cb);
+    /**
+     * Once returned, the status callback of the account is not called anymore
+     */
+    void detach(const void* account);
+
+    /**
+     * Stop the node, once the accounts are unregistered
+     */
+    void join();
+
+private:
+    NON_COPYABLE(SharedDhtNode);
+
+    std::shared_ptr<dht::DhtRunner> runner_;
+    std::mutex startMutex_;
+    std::mutex mutex_;
+    std::map<const void*, DhtStatusCallback> accounts_;
+    dht::NodeStatus status4_ {dht::NodeStatus::Disconnected};
+    dht::NodeStatus status6_ {dht::NodeStatus::Disconnected};
+};
+
+/**
+ * DHT of a Jami account: the subset of dht::DhtRunner used by the account, on its own
+ * node or on a node shared by the accounts.
+ *
+ * On its own node, the calls are forwarded to the DhtRunner, its SecureDht using
+ * the identity of the account. On a shared node, the values are encrypted for their
+ * recipient, decrypted and their signatures checked here with the identity of the
+ * account, as SecureDht does. shutdown() then only cancels the listens of the account,
+ * the node keeping running for the others.
+ */
+class AccountDht
+{
+public:
+    using ValuesCallback = std::function<bool(const std::vector<std::shared_ptr<dht::Value>>&)>;
+
+    /**
+     * @param node  Shared node, null for an own node
+     */
+    explicit AccountDht(std::shared_ptr<SharedDhtNode> node = {});
+    ~AccountDht();
+
+    bool isShared() const { return (bool) node_; }
+    bool isRunning() const;
+
+    /**
+     * @param config    With the identity of the account
+     */
+    void run(in_port_t port,
+             const dht::DhtRunner::Config& config,
+             dht::DhtRunner::Context&& context);
+    void shutdown(dht::ShutdownCallback cb, bool stop = false);
+    void join();
+
+    template<typename... Args>
+    void bootstrap(Args&&... args)
+    {
+        runner_->bootstrap(std::forward<Args>(args)...);
+    }
+    void connectivityChanged() { runner_->connectivityChanged(); }
+    /**
+     * @return bytes and number of the values stored by the node, shared or not
+     */
+    std::pair<size_t, size_t> getStoreSize() const { return runner_->getStoreSize(); }
+    template<typename Cb>
+    void getPublicAddress(Cb&& cb)
+    {
+        runner_->getPublicAddress(std::forward<Cb>(cb));
+    }
+
+    void setPushNotificationToken(const std::string& token);
+    void setPushNotificationTopic(const std::string& topic);
+    void pushNotificationReceived(const std::map<std::string, std::string>& data);
+
+    /**
+     * @return public key of the identity of the account
+     */
+    std::shared_ptr<dht::crypto::PublicKey> getPublicKey() const;
+
+    template<typename Cb>
+    void findCertificate(const dht::InfoHash& h, Cb&& cb)
+    {
+        runner_->findCertificate(h, std::forward<Cb>(cb));
+    }
+
+    /**
+     * Values put as they are, e.g. already signed.
+     * On a shared node, the permanent puts of a dht::Value are cancelled by shutdown()
+     */
+    template<typename T, typename Cb = dht::DoneCallbackSimple>
+    void put(const dht::InfoHash& key,
+             T&& value,
+             Cb&& cb = {},
+             dht::time_point created = dht::time_point::max(),
+             bool permanent = false)
+    {
+        countOperation(Operation::PUT);
+        if constexpr (std::is_convertible_v<T, std::shared_ptr<dht::Value>>) {
+            if (node_ and permanent)
+                addPermanentPut(key, value);
+        }
+        runner_->put(key, std::forward<T>(value), std::forward<Cb>(cb), created, permanent);
+    }
+
+    void putEncrypted(const dht::InfoHash& key,
+                      const std::shared_ptr<dht::crypto::PublicKey>& to,
+                      std::shared_ptr<dht::Value> value,
+                      dht::DoneCallbackSimple cb = {});
+    /**
+     * @param to    Id of the recipient, its public key is looked up
+     */
+    void putEncrypted(const dht::InfoHash& key,
+                      const dht::InfoHash& to,
+                      std::shared_ptr<dht::Value> value,
+                      dht::DoneCallbackSimple cb = {});
+    template<typename To,
+             typename T,
+             typename = std::enable_if_t<
+                 !std::is_same_v<std::decay_t<T>, std::shared_ptr<dht::Value>>>>
+    void putEncrypted(const dht::InfoHash& key,
+                      const To& to,
+                      T&& value,
+                      dht::DoneCallbackSimple cb = {})
+    {
+        putEncrypted(key, to, std::make_shared<dht::Value>(std::forward<T>(value)), std::move(cb));
+    }
+
+    /**
+     * @param cb    Returns false to stop listening, with (T&&) or (T&&, bool expired)
+     */
+    template<typename T, typename Cb>
+    std::future<size_t> listen(const dht::InfoHash& key, Cb&& cb)
+    {
+        countOperation(Operation::LISTEN);
+        if (not node_)
+            return runner_->listen<T>(key, std::forward<Cb>(cb));
+        return listenShared(
+            key,
+            [cb = std::forward<Cb>(cb)](const std::vector<std::shared_ptr<dht::Value>>& values,
+                                        bool expired) mutable {
+                constexpr bool withExpired = std::is_invocable_v<decltype(cb)&, T&&, bool>;
+                if constexpr (not withExpired) {
+                    if (expired)
+                        return true;
+                }
+                for (const auto& v : values) {
+                    try {
+                        bool more;
+                        if constexpr (withExpired)
+                            more = cb(dht::Value::unpack<T>(*v), expired);
+                        else
+                            more = cb(dht::Value::unpack<T>(*v));
+                        if (not more)
+                            return false;
+                    } catch (const std::exception&) {
+                        continue;
+                    }
+                }
+                return true;
+            },
+            dht::getFilterSet<T>());
+    }
+    template<typename Token>
+    void cancelListen(const dht::InfoHash& key, Token&& token)
+    {
+        if (not node_)
+            runner_->cancelListen(key, std::forward<Token>(token));
+        else
+            cancelShared(key, token.get());
+    }
+
+    /**
+     * @param cb    Called with each value (T&&), returns false to stop
+     */
+    template<typename T, typename Cb>
+    void get(const dht::InfoHash& key, Cb&& cb, dht::DoneCallbackSimple done = {})
+    {
+        countOperation(Operation::GET);
+        if (not node_) {
+            runner_->get<T>(key, std::forward<Cb>(cb), std::move(done));
+            return;
+        }
+        getShared(
+            key,
+            [cb = std::forward<Cb>(cb)](
+                const std::vector<std::shared_ptr<dht::Value>>& values) mutable {
+                for (const auto& v : values) {
+                    try {
+                        if (not cb(dht::Value::unpack<T>(*v)))
+                            return false;
+                    } catch (const std::exception&) {
+                        continue;
+                    }
+                }
+                return true;
+            },
+            std::move(done),
+            dht::getFilterSet<T>());
+    }
+
+private:
+    NON_COPYABLE(AccountDht);
+
+    enum class Operation { PUT, GET, LISTEN };
+    /**
+     * Count the operations requested by the accounts in the metrics
+     */
+    static void countOperation(Operation op);
+
+    /**
+     * @return value decrypted or whose signature is valid, null if invalid or not for
+     * the account
+     */
+    static std::shared_ptr<dht::Value> checkValue(
+        const std::shared_ptr<dht::crypto::PrivateKey>& key,
+        const dht::InfoHash& id,
+        const std::shared_ptr<dht::Value>& v);
+    /**
+     * Sign the value with key, encrypt it for to and put it at location
+     */
+    static void encryptAndPut(const std::shared_ptr<dht::DhtRunner>& runner,
+                              const std::shared_ptr<dht::crypto::PrivateKey>& key,
+                              const dht::InfoHash& location,
+                              const std::shared_ptr<dht::crypto::PublicKey>& to,
+                              std::shared_ptr<dht::Value> value,
+                              dht::DoneCallbackSimple cb);
+
+    std::future<size_t> listenShared(const dht::InfoHash& key,
+                                     dht::ValueCallback&& cb,
+                                     dht::Value::Filter&& filter);
+    void cancelShared(const dht::InfoHash& key, size_t token);
+    void addPermanentPut(const dht::InfoHash& key, std::shared_ptr<dht::Value> value);
+    void getShared(const dht::InfoHash& key,
+                   ValuesCallback&& cb,
+                   dht::DoneCallbackSimple&& done,
+                   dht::Value::Filter&& filter);
+
+    std::shared_ptr<SharedDhtNode> node_;
+    std::shared_ptr<dht::DhtRunner> runner_;
+
+    // On a shared node
+    dht::crypto::Identity identity_ {};
+    std::shared_ptr<dht::crypto::PublicKey> publicKey_;
+    std::atomic_bool running_ {false};
+    std::mutex listensMtx_;
+    size_t listenToken_ {0};
+    std::map<size_t, std::pair<dht::InfoHash, std::shared_future<size_t>>> listens_;
+    // Kept announced by the node until cancelled, their id is set once put
+    std::mutex putsMtx_;
+    std::vector<std::pair<dht::InfoHash, std::shared_ptr<dht::Value>>> permanentPuts_;
+};
+
+} // namespace jami
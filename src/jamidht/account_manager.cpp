@@ -22,6 +22,7 @@
 #include "jami/account_const.h"
 #include "account_schema.h"
 #include "archiver.h"
+#include "account_dht.h"
 
 #include "libdevcrypto/Common.h"
 
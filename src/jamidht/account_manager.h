@@ -34,14 +34,11 @@
 #include <map>
 #include <string>
 
-namespace dht {
-class DhtRunner;
-}
-
 namespace jami {
 
 using DeviceId = dht::PkId;
 struct AccountArchive;
+class AccountDht;
 
 struct AccountInfo
 {
@@ -136,7 +133,7 @@ public:
                                    const std::string& username,
                                    const OnChangeCallback& onChange);
 
-    void setDht(const std::shared_ptr<dht::DhtRunner>& dht) { dht_ = dht; }
+    void setDht(const std::shared_ptr<AccountDht>& dht) { dht_ = dht; }
 
     virtual void startSync(const OnNewDeviceCb& cb, const OnDeviceAnnouncedCb& dcb);
 
@@ -263,7 +260,7 @@ protected:
     OnAsync onAsync_;
     OnChangeCallback onChange_;
     std::unique_ptr<AccountInfo> info_;
-    std::shared_ptr<dht::DhtRunner> dht_;
+    std::shared_ptr<AccountDht> dht_;
     std::reference_wrapper<NameDirectory> nameDir_;
 };
 
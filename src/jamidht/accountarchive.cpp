@@ -23,14 +23,57 @@
 #include "logger.h"
 
 #include <json/json.h>
+#include <msgpack.hpp>
 
 namespace jami {
 
+// Configuration of pack(), the other keys are the ones of serialize()
+constexpr const char* const ARCHIVE_CONFIG_KEY = "config";
+
+namespace {
+
+// msgpack output appended to a string, given as it is to writeArchive()
+struct StringBuffer
+{
+    std::string& str;
+    void write(const char* data, size_t size) { str.append(data, size); }
+};
+
+// Settings of the device, not imported along with the account
+bool
+isDeviceKey(const std::string& key)
+{
+    return key == DRing::Account::ConfProperties::TLS::CA_LIST_FILE
+           || key == DRing::Account::ConfProperties::TLS::PRIVATE_KEY_FILE
+           || key == DRing::Account::ConfProperties::TLS::CERTIFICATE_FILE
+           || key == DRing::Account::ConfProperties::DHT_PROXY_LIST_URL
+           || key == DRing::Account::ConfProperties::AUTOANSWER
+           || key == DRing::Account::ConfProperties::PROXY_ENABLED
+           || key == DRing::Account::ConfProperties::PROXY_SERVER
+           || key == DRing::Account::ConfProperties::PROXY_PUSH_TOKEN;
+}
+
+// A JSON archive starts with '{', a packed one with a msgpack map
+bool
+isPacked(const std::vector<uint8_t>& dat)
+{
+    return not dat.empty() and ((dat[0] & 0xf0) == 0x80 or dat[0] == 0xde or dat[0] == 0xdf);
+}
+
+} // namespace
+
 void
 AccountArchive::deserialize(const std::vector<uint8_t>& dat)
 {
     JAMI_DBG("Loading account archive (%lu bytes)", dat.size());
 
+    if (isPacked(dat)) {
+        unpack(dat);
+        if (not id.first)
+            throw std::runtime_error("Archive doesn't include account private key");
+        return;
+    }
+
     // Decode string
     auto* char_data = reinterpret_cast<const char*>(&dat[0]);
     std::string err;
@@ -48,17 +91,9 @@ AccountArchive::deserialize(const std::vector<uint8_t>& dat)
         for (Json::ValueIterator itr = value.begin(); itr != value.end(); itr++) {
             try {
                 const auto key = itr.key().asString();
-                if (key.empty())
+                if (key.empty() or isDeviceKey(key))
                     continue;
-                if (key.compare(DRing::Account::ConfProperties::TLS::CA_LIST_FILE) == 0) {
-                } else if (key.compare(DRing::Account::ConfProperties::TLS::PRIVATE_KEY_FILE) == 0) {
-                } else if (key.compare(DRing::Account::ConfProperties::TLS::CERTIFICATE_FILE) == 0) {
-                } else if (key.compare(DRing::Account::ConfProperties::DHT_PROXY_LIST_URL) == 0) {
-                } else if (key.compare(DRing::Account::ConfProperties::AUTOANSWER) == 0) {
-                } else if (key.compare(DRing::Account::ConfProperties::PROXY_ENABLED) == 0) {
-                } else if (key.compare(DRing::Account::ConfProperties::PROXY_SERVER) == 0) {
-                } else if (key.compare(DRing::Account::ConfProperties::PROXY_PUSH_TOKEN) == 0) {
-                } else if (key.compare(Conf::RING_CA_KEY) == 0) {
+                if (key.compare(Conf::RING_CA_KEY) == 0) {
                     ca_key = std::make_shared<dht::crypto::PrivateKey>(
                         base64::decode(itr->asString()));
                 } else if (key.compare(Conf::RING_ACCOUNT_KEY) == 0) {
@@ -106,6 +141,58 @@ AccountArchive::deserialize(const std::vector<uint8_t>& dat)
     }
 }
 
+void
+AccountArchive::unpack(const std::vector<uint8_t>& dat)
+{
+    msgpack::object_handle oh;
+    try {
+        oh = msgpack::unpack(reinterpret_cast<const char*>(dat.data()), dat.size());
+    } catch (const std::exception& ex) {
+        JAMI_ERR() << "Archive msgpack parsing error: " << ex.what();
+        throw std::runtime_error("failed to parse msgpack");
+    }
+    const auto& root = oh.get();
+    if (root.type != msgpack::type::MAP)
+        throw std::runtime_error("failed to parse msgpack");
+
+    for (uint32_t i = 0; i < root.via.map.size; ++i) {
+        const auto& item = root.via.map.ptr[i];
+        try {
+            const auto key = item.key.as<std::string>();
+            const auto& val = item.val;
+            if (key == Conf::RING_CA_KEY) {
+                ca_key = std::make_shared<dht::crypto::PrivateKey>(val.as<std::vector<uint8_t>>());
+            } else if (key == Conf::RING_ACCOUNT_KEY) {
+                id.first = std::make_shared<dht::crypto::PrivateKey>(
+                    val.as<std::vector<uint8_t>>());
+            } else if (key == Conf::RING_ACCOUNT_CERT) {
+                id.second = std::make_shared<dht::crypto::Certificate>(
+                    val.as<std::vector<uint8_t>>());
+            } else if (key == Conf::RING_ACCOUNT_CONTACTS) {
+                val.convert(contacts);
+                contacts.erase(dht::InfoHash {});
+            } else if (key == Conf::CONVERSATIONS_KEY) {
+                val.convert(conversations);
+            } else if (key == Conf::CONVERSATIONS_REQUESTS_KEY) {
+                val.convert(conversationsRequests);
+            } else if (key == Conf::ETH_KEY) {
+                eth_key = val.as<std::vector<uint8_t>>();
+            } else if (key == Conf::RING_ACCOUNT_CRL) {
+                revoked = std::make_shared<dht::crypto::RevocationList>(
+                    val.as<std::vector<uint8_t>>());
+            } else if (key == ARCHIVE_CONFIG_KEY) {
+                for (auto& [k, v] : val.as<std::map<std::string, std::string>>())
+                    if (not k.empty() and not isDeviceKey(k))
+                        config[k] = std::move(v);
+            }
+        } catch (const std::exception& ex) {
+            JAMI_ERR("Can't parse msgpack entry with value of type %d: %s",
+                     (unsigned) item.val.type,
+                     ex.what());
+        }
+    }
+}
+
 std::string
 AccountArchive::serialize() const
 {
@@ -150,4 +237,38 @@ AccountArchive::serialize() const
     return Json::writeString(wbuilder, root);
 }
 
+std::string
+AccountArchive::pack() const
+{
+    std::string ret;
+    StringBuffer buffer {ret};
+    msgpack::packer<StringBuffer> pk(&buffer);
+
+    auto hasCaKey = ca_key and *ca_key;
+    pk.pack_map(7 + (hasCaKey ? 1 : 0) + (revoked ? 1 : 0));
+    pk.pack(ARCHIVE_CONFIG_KEY);
+    pk.pack(config);
+    if (hasCaKey) {
+        pk.pack(Conf::RING_CA_KEY);
+        pk.pack(ca_key->serialize());
+    }
+    pk.pack(Conf::RING_ACCOUNT_KEY);
+    pk.pack(id.first->serialize());
+    pk.pack(Conf::RING_ACCOUNT_CERT);
+    pk.pack(id.second->getPacked());
+    pk.pack(Conf::ETH_KEY);
+    pk.pack(eth_key);
+    if (revoked) {
+        pk.pack(Conf::RING_ACCOUNT_CRL);
+        pk.pack(revoked->getPacked());
+    }
+    pk.pack(Conf::RING_ACCOUNT_CONTACTS);
+    pk.pack(contacts);
+    pk.pack(Conf::CONVERSATIONS_KEY);
+    pk.pack(conversations);
+    pk.pack(Conf::CONVERSATIONS_REQUESTS_KEY);
+    pk.pack(conversationsRequests);
+    return ret;
+}
+
 } // namespace jami
@@ -20,6 +20,7 @@
 #include "jami_contact.h"
 #include "jamidht/jamiaccount.h"
 #include "fileutils.h"
+#include "archiver.h"
 
 #include <opendht/crypto.h>
 #include <memory>
@@ -35,6 +36,12 @@ namespace jami {
  */
 struct AccountArchive
 {
+    /** Readers of a saved archive */
+    enum class Readers {
+        ANY_VERSION, // JSON compressed by zlib
+        THIS_DEVICE, // msgpack compressed by zstd, smaller and faster for the recent versions
+    };
+
     /** Account main private key and certificate chain */
     dht::crypto::Identity id;
 
@@ -64,7 +71,13 @@ struct AccountArchive
     /** Serialize structured archive data to memory. */
     std::string serialize() const;
 
-    /** Deserialize archive from memory. */
+    /**
+     * Serialize to msgpack, with the keys and certificates as they are instead of base64,
+     * and without building a JSON tree first.
+     */
+    std::string pack() const;
+
+    /** Deserialize archive from memory, given by serialize() or pack(). */
     void deserialize(const std::vector<uint8_t>& data);
 
     /** Load archive from file, optionally encrypted with provided password. */
@@ -74,10 +87,18 @@ struct AccountArchive
     }
 
     /** Save archive to file, optionally encrypted with provided password. */
-    void save(const std::string& path, const std::string& password = {}) const
+    void save(const std::string& path,
+              const std::string& password = {},
+              Readers readers = Readers::ANY_VERSION) const
     {
-        fileutils::writeArchive(serialize(), path, password);
+        if (readers == Readers::THIS_DEVICE)
+            fileutils::writeArchive(pack(), path, password, archiver::Codec::ZSTD);
+        else
+            fileutils::writeArchive(serialize(), path, password);
     }
+
+private:
+    void unpack(const std::vector<uint8_t>& data);
 };
 
 } // namespace jami
@@ -20,10 +20,12 @@
 #include "fileutils.h"
 #include "libdevcrypto/Common.h"
 #include "archiver.h"
+#include "account_dht.h"
 #include "base64.h"
 #include "jami/account_const.h"
 #include "account_schema.h"
 #include "jamidht/conversation_module.h"
+#include "security/password_keys.h"
 
 #include <opendht/dhtrunner.h>
 #include <opendht/thread_pool.h>
@@ -34,6 +36,8 @@
 namespace jami {
 
 const constexpr auto EXPORT_KEY_RENEWAL_TIME = std::chrono::minutes(20);
+// The archive of the account is rewritten often, only this device reads it
+const constexpr auto LOCAL_ARCHIVE = AccountArchive::Readers::THIS_DEVICE;
 
 void
 ArchiveAccountManager::initAuthentication(PrivateKey key,
@@ -200,7 +204,7 @@ ArchiveAccountManager::setValidity(const std::string& password,
 
     if (updated) {
         auto path = fileutils::getFullPath(path_, archivePath_);
-        archive.save(path, password);
+        archive.save(path, password, LOCAL_ARCHIVE);
     }
 
     if (updated or not id or device.second->getId() == id) {
@@ -376,7 +380,7 @@ ArchiveAccountManager::onArchiveLoaded(AuthContext& ctx,
     fileutils::check_dir(path_.c_str(), 0700);
 
     auto path = fileutils::getFullPath(path_, archivePath_);
-    a.save(path, ctx.credentials ? ctx.credentials->password : "");
+    a.save(path, ctx.credentials ? ctx.credentials->password : "", LOCAL_ARCHIVE);
 
     if (not a.id.second->isCA()) {
         JAMI_ERR("[Auth] trying to sign a certificate with a non-CA.");
@@ -679,7 +683,7 @@ ArchiveAccountManager::saveArchive(AccountArchive& archive, const std::string& p
         updateArchive(archive);
         if (archivePath_.empty())
             archivePath_ = "export.gz";
-        archive.save(fileutils::getFullPath(path_, archivePath_), pwd);
+        archive.save(fileutils::getFullPath(path_, archivePath_), pwd, LOCAL_ARCHIVE);
     } catch (const std::runtime_error& ex) {
         JAMI_ERR("[Auth] Can't export archive: %s", ex.what());
         return;
@@ -692,7 +696,10 @@ ArchiveAccountManager::changePassword(const std::string& password_old,
 {
     try {
         auto path = fileutils::getFullPath(path_, archivePath_);
-        AccountArchive(path, password_old).save(path, password_new);
+        AccountArchive archive(path, password_old);
+        // Saved with a new salt, the old key is of no use
+        secure::PasswordKeys::instance().forget(path);
+        archive.save(path, password_new, LOCAL_ARCHIVE);
         return true;
     } catch (const std::exception&) {
         return false;
@@ -819,16 +826,13 @@ ArchiveAccountManager::exportArchive(const std::string& destinationPath, const s
         // Save contacts if possible before exporting
         AccountArchive archive = readArchive(password);
         updateArchive(archive);
-        archive.save(fileutils::getFullPath(path_, archivePath_), password);
-
-        // Export the file
-        auto sourcePath = fileutils::getFullPath(path_, archivePath_);
-        std::ifstream src(sourcePath, std::ios::in | std::ios::binary);
-        if (!src)
-            return false;
-        std::ofstream dst(destinationPath, std::ios::out | std::ios::binary);
-        dst << src.rdbuf();
-        return true;
+        archive.save(fileutils::getFullPath(path_, archivePath_), password, LOCAL_ARCHIVE);
+
+        // Export the file, readable by any version
+        archive.save(destinationPath, password);
+        // Not read nor saved again by the daemon
+        secure::PasswordKeys::instance().forget(destinationPath);
+        return fileutils::isFile(destinationPath);
     } catch (const std::runtime_error& ex) {
         JAMI_ERR("[Auth] Can't export archive: %s", ex.what());
         return false;
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "jamidht/channel_handler_registry.h"
+
+#include "logger.h"
+
+namespace jami {
+
+static constexpr std::string_view SCHEME_SEPARATOR {"://"};
+
+/**
+ * @return the scheme of a pattern or a channel name ("git" for "git://..."), empty if none
+ */
+static std::string_view
+schemeOf(std::string_view name)
+{
+    auto sep = name.find(SCHEME_SEPARATOR);
+    return sep == std::string_view::npos ? std::string_view {} : name.substr(0, sep);
+}
+
+/**
+ * @return the key of a pattern, and if it's a scheme
+ */
+static std::pair<std::string_view, bool>
+parsePattern(std::string_view pattern)
+{
+    auto scheme = schemeOf(pattern);
+    // Only "scheme://" is a prefix
+    if (not scheme.empty() and scheme.size() + SCHEME_SEPARATOR.size() == pattern.size())
+        return {scheme, true};
+    return {pattern, false};
+}
+
+template<typename F>
+void
+ChannelHandlerRegistry::update(F&& f)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto table = std::make_shared<Table>(*table_.load());
+    f(*table);
+    table_.store(std::move(table));
+}
+
+void
+ChannelHandlerRegistry::add(std::string_view pattern,
+                            std::shared_ptr<ChannelHandlerInterface> handler)
+{
+    auto [key, isScheme] = parsePattern(pattern);
+    update([&, key = key, isScheme = isScheme](Table& table) {
+        (isScheme ? table.schemes : table.names).insert_or_assign(std::string(key),
+                                                                  std::move(handler));
+    });
+}
+
+void
+ChannelHandlerRegistry::remove(std::string_view pattern)
+{
+    auto [key, isScheme] = parsePattern(pattern);
+    update([key = key, isScheme = isScheme](Table& table) {
+        auto& handlers = isScheme ? table.schemes : table.names;
+        auto it = handlers.find(key);
+        if (it != handlers.end())
+            handlers.erase(it);
+    });
+}
+
+void
+ChannelHandlerRegistry::clear()
+{
+    update([](Table& table) { table = {}; });
+}
+
+std::shared_ptr<ChannelHandlerInterface>
+ChannelHandlerRegistry::find(std::string_view name) const
+{
+    auto table = table_.load();
+    auto scheme = schemeOf(name);
+    if (not scheme.empty()) {
+        auto it = table->schemes.find(scheme);
+        if (it != table->schemes.end())
+            return it->second;
+    }
+    auto it = table->names.find(name);
+    return it != table->names.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<ChannelHandlerInterface>
+ChannelHandlerRegistry::get(std::string_view pattern) const
+{
+    auto table = table_.load();
+    auto [key, isScheme] = parsePattern(pattern);
+    const auto& handlers = isScheme ? table->schemes : table->names;
+    auto it = handlers.find(key);
+    return it != handlers.end() ? it->second : nullptr;
+}
+
+void
+ChannelCallbacks::connect(const DeviceId& deviceId, const std::string& name, ConnectCb&& cb)
+{
+    JAMI_ERR("Can't open channel %s: not supported", name.c_str());
+    if (cb)
+        cb(nullptr, deviceId);
+}
+
+} // namespace jami
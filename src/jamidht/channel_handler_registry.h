@@ -0,0 +1,117 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "atomic_shared_ptr.h"
+#include "jamidht/channel_handler.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace jami {
+
+/**
+ * Handlers of the channels by name, used to dispatch the requests of ConnectionManager.
+ *
+ * A pattern ending with "://" (e.g. "git://") matches all the channels starting with it,
+ * any other pattern (e.g. "sip") the channels with this exact name.
+ * The lookups read an immutable snapshot of the table, replaced on each registration, so they
+ * never wait for each other.
+ */
+class ChannelHandlerRegistry
+{
+public:
+    /**
+     * Register handler for pattern. Replaces the previous handler of pattern if any.
+     */
+    void add(std::string_view pattern, std::shared_ptr<ChannelHandlerInterface> handler);
+    void remove(std::string_view pattern);
+    void clear();
+
+    /**
+     * @return the handler of the channel called name, null if none
+     */
+    std::shared_ptr<ChannelHandlerInterface> find(std::string_view name) const;
+
+    /**
+     * @return the handler registered for pattern, null if none
+     */
+    std::shared_ptr<ChannelHandlerInterface> get(std::string_view pattern) const;
+
+private:
+    using Handlers = std::map<std::string, std::shared_ptr<ChannelHandlerInterface>, std::less<>>;
+    struct Table
+    {
+        // By scheme, e.g. "git" for "git://"
+        Handlers schemes;
+        Handlers names;
+    };
+
+    template<typename F>
+    void update(F&& f);
+
+    std::mutex mutex_ {};
+    AtomicSharedPtr<const Table> table_ {std::make_shared<const Table>()};
+};
+
+/**
+ * Handler of channels that are only accepted, like the ones still managed by JamiAccount
+ */
+class ChannelCallbacks : public ChannelHandlerInterface
+{
+public:
+    using RequestCb
+        = std::function<bool(const std::shared_ptr<dht::crypto::Certificate>&, const std::string&)>;
+    using ReadyCb = std::function<void(const std::shared_ptr<dht::crypto::Certificate>&,
+                                       const std::string&,
+                                       std::shared_ptr<ChannelSocket>)>;
+
+    ChannelCallbacks(RequestCb&& onRequest, ReadyCb&& onReady)
+        : onRequest_(std::move(onRequest))
+        , onReady_(std::move(onReady))
+    {}
+
+    /**
+     * Not supported, cb is called with no channel
+     */
+    void connect(const DeviceId& deviceId, const std::string& name, ConnectCb&& cb) override;
+
+    bool onRequest(const std::shared_ptr<dht::crypto::Certificate>& peer,
+                   const std::string& name) override
+    {
+        return onRequest_ and onRequest_(peer, name);
+    }
+
+    void onReady(const std::shared_ptr<dht::crypto::Certificate>& peer,
+                 const std::string& name,
+                 std::shared_ptr<ChannelSocket> channel) override
+    {
+        if (onReady_)
+            onReady_(peer, name, std::move(channel));
+    }
+
+private:
+    RequestCb onRequest_;
+    ReadyCb onReady_;
+};
+
+} // namespace jami
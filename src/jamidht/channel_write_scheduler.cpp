@@ -0,0 +1,149 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "channel_write_scheduler.h"
+#include "metrics.h"
+
+#include <cstdint>
+
+namespace jami {
+
+using namespace std::literals;
+
+static constexpr std::size_t BULK_CHUNK_SIZE {16 * 1024};
+// Bytes credited to a bulk class at each round
+static constexpr std::array<std::size_t, static_cast<std::size_t>(ChannelPriority::COUNT)> QUANTUM {
+    0, 0, 0, 4 * BULK_CHUNK_SIZE, 2 * BULK_CHUNK_SIZE, BULK_CHUNK_SIZE};
+
+static bool
+startsWith(std::string_view str, std::string_view prefix)
+{
+    return str.substr(0, prefix.size()) == prefix;
+}
+
+ChannelPriority
+channelPriority(std::string_view name)
+{
+    if (name == "sip"sv)
+        return ChannelPriority::SIP;
+    if (startsWith(name, DATAGRAM_CHANNEL_PREFIX))
+        return ChannelPriority::DATAGRAM;
+    if (startsWith(name, "git://"sv))
+        return ChannelPriority::GIT;
+    if (startsWith(name, "file://"sv) or startsWith(name, "data-transfer://"sv))
+        return ChannelPriority::FILE;
+    // sync, vcard and unknown channels
+    return ChannelPriority::SYNC;
+}
+
+std::size_t
+ChannelWriteScheduler::maxChunkSize(ChannelPriority priority)
+{
+    if (priority == ChannelPriority::GIT or priority == ChannelPriority::FILE)
+        return BULK_CHUNK_SIZE;
+    return UINT16_MAX;
+}
+
+static metrics::Gauge&
+waitingWriters(ChannelPriority priority)
+{
+    static constexpr const char* NAMES[] = {"control", "datagram", "sip", "sync", "git", "file"};
+    static const auto gauges = [] {
+        std::array<metrics::Gauge*, static_cast<std::size_t>(ChannelPriority::COUNT)> gauges;
+        for (std::size_t c = 0; c < gauges.size(); ++c)
+            gauges[c] = &metrics::Registry::instance().gauge("jami_channel_waiting_writers",
+                                                             "Writers waiting for their socket",
+                                                             {{"priority", NAMES[c]}});
+        return gauges;
+    }();
+    return *gauges[static_cast<std::size_t>(priority)];
+}
+
+void
+ChannelWriteScheduler::acquire(ChannelPriority priority, std::size_t size)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    auto& queue = queues_[static_cast<std::size_t>(priority)];
+    if (not busy_) {
+        // Nobody waits when the endpoint is free
+        busy_ = true;
+        return;
+    }
+    Waiter waiter {size};
+    queue.emplace_back(&waiter);
+    auto& waiting = waitingWriters(priority);
+    waiting.add(1);
+    cv_.wait(lk, [&] { return waiter.granted; });
+    waiting.add(-1);
+}
+
+void
+ChannelWriteScheduler::release()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    busy_ = false;
+    grantNext();
+}
+
+void
+ChannelWriteScheduler::grant(std::deque<Waiter*>& queue)
+{
+    queue.front()->granted = true;
+    queue.pop_front();
+    busy_ = true;
+    cv_.notify_all();
+}
+
+void
+ChannelWriteScheduler::grantNext()
+{
+    for (std::size_t c = 0; c < FIRST_BULK; ++c) {
+        if (not queues_[c].empty()) {
+            grant(queues_[c]);
+            return;
+        }
+    }
+
+    bool waiting = false;
+    for (std::size_t c = FIRST_BULK; c < CLASSES; ++c)
+        waiting |= not queues_[c].empty();
+    if (not waiting)
+        return;
+
+    // Terminates: a non empty class gains a quantum at each visit
+    while (true) {
+        auto& queue = queues_[current_];
+        if (queue.empty()) {
+            deficit_[current_] = 0;
+        } else {
+            if (newRound_) {
+                deficit_[current_] += QUANTUM[current_];
+                newRound_ = false;
+            }
+            auto size = queue.front()->size;
+            if (size <= deficit_[current_]) {
+                deficit_[current_] -= size;
+                grant(queue);
+                return;
+            }
+        }
+        current_ = current_ + 1 < CLASSES ? current_ + 1 : FIRST_BULK;
+        newRound_ = true;
+    }
+}
+
+} // namespace jami
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "noncopyable.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string_view>
+
+namespace jami {
+
+/**
+ * Channels named with this prefix carry datagrams, see ChannelSocket::write()
+ */
+static constexpr std::string_view DATAGRAM_CHANNEL_PREFIX {"datagram://"};
+
+/**
+ * Priority classes of the channels of a MultiplexedSocket, most urgent first
+ */
+enum class ChannelPriority : unsigned { CONTROL, DATAGRAM, SIP, SYNC, GIT, FILE, COUNT };
+
+/**
+ * Deduce the priority class of a channel from its name
+ */
+ChannelPriority channelPriority(std::string_view name);
+
+/**
+ * Decide which writer gets the MultiplexedSocket's endpoint next.
+ *
+ * CONTROL, DATAGRAM and SIP writers are served first, in arrival order: they are small
+ * and latency sensitive. SYNC, GIT and FILE writers share what remains with a
+ * deficit round robin, weighted 4:2:1, so that a bulk transfer can't starve
+ * the others while still getting its share of the link.
+ */
+class ChannelWriteScheduler
+{
+public:
+    ChannelWriteScheduler() = default;
+
+    /**
+     * Block until the caller may write size bytes
+     */
+    void acquire(ChannelPriority priority, std::size_t size);
+
+    /**
+     * Must be called after each acquire(), when the write is done
+     */
+    void release();
+
+    /**
+     * Max size of a write for this class. Bulk classes write smaller
+     * chunks so that urgent writers wait less for the endpoint.
+     */
+    static std::size_t maxChunkSize(ChannelPriority priority);
+
+    class Guard
+    {
+    public:
+        Guard(ChannelWriteScheduler& scheduler, ChannelPriority priority, std::size_t size)
+            : scheduler_(scheduler)
+        {
+            scheduler_.acquire(priority, size);
+        }
+        ~Guard() { scheduler_.release(); }
+
+    private:
+        NON_COPYABLE(Guard);
+        ChannelWriteScheduler& scheduler_;
+    };
+
+private:
+    NON_COPYABLE(ChannelWriteScheduler);
+
+    static constexpr std::size_t CLASSES = static_cast<std::size_t>(ChannelPriority::COUNT);
+    static constexpr std::size_t FIRST_BULK = static_cast<std::size_t>(ChannelPriority::SYNC);
+
+    struct Waiter
+    {
+        std::size_t size;
+        bool granted {false};
+    };
+
+    void grantNext();
+    void grant(std::deque<Waiter*>& queue);
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool busy_ {false};
+    std::array<std::deque<Waiter*>, CLASSES> queues_;
+
+    // Deficit round robin state of the bulk classes
+    std::array<std::size_t, CLASSES> deficit_ {};
+    std::size_t current_ {FIRST_BULK};
+    bool newRound_ {true};
+};
+
+} // namespace jami
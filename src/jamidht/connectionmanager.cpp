@@ -20,6 +20,7 @@
 #include "account_const.h"
 #include "account_manager.h"
 #include "manager.h"
+#include "network_monitor.h"
 #include "peer_connection.h"
 #include "logger.h"
 
@@ -31,10 +32,28 @@
 #include <mutex>
 #include <map>
 #include <condition_variable>
+#include <list>
+#include <optional>
 #include <set>
 
 static constexpr std::chrono::seconds DHT_MSG_TIMEOUT {30};
 static constexpr int MAX_TENTATIVES {100};
+// A device asked this many times over the period gets its socket back when lost
+static constexpr unsigned WARM_MIN_USES {3};
+static constexpr std::chrono::hours WARM_PERIOD {1};
+static constexpr std::chrono::seconds WARM_RECONNECT_DELAY {10};
+// A socket lost this soon after a connectivity change is reconnected right away, on the new
+// network, as the beacons detect the dead sockets within SEND_BEACON_TIMEOUT
+static constexpr std::chrono::seconds MIGRATION_PERIOD {10};
+// Name of the pending request of a socket reconnected in advance, without channel
+static constexpr const char WARMUP_CHANNEL[] {"warmup"};
+// Peer devices with a TLS session kept to resume it
+static constexpr std::size_t MAX_TLS_SESSIONS {64};
+// Connection requests from the DHT negotiated at once, the others are queued
+static constexpr std::size_t MAX_NEGOTIATIONS {16};
+static constexpr std::size_t MAX_QUEUED_REQUESTS {64};
+// Requests of a device negotiated or queued: two race per connection (early and full)
+static constexpr unsigned MAX_REQUESTS_PER_DEVICE {4};
 using ValueIdDist = std::uniform_int_distribution<dht::Value::Id>;
 using CallbackId = std::pair<jami::DeviceId, dht::Value::Id>;
 
@@ -57,6 +76,10 @@ struct ConnectionInfo
     std::unique_ptr<TlsSocketEndpoint> tls_ {nullptr};
     std::shared_ptr<MultiplexedSocket> socket_ {};
     std::set<CallbackId> cbIds_ {};
+    // Other connection to the same device racing with this one, if any
+    dht::Value::Id siblingVid_ {0};
+    // Host candidates only, without waiting for the STUN/TURN ones
+    bool early_ {false};
 };
 
 class ConnectionManager::Impl : public std::enable_shared_from_this<ConnectionManager::Impl>
@@ -106,6 +129,12 @@ public:
                     pending.cb(nullptr, deviceId);
             pendingCbs_.clear();
         }
+        {
+            std::lock_guard<std::mutex> lk(admissionMtx_);
+            queuedRequests_.clear();
+            negotiating_.clear();
+            requestsPerDevice_.clear();
+        }
         removeUnusedConnections();
     }
 
@@ -114,6 +143,7 @@ public:
         std::string name;
         ConnectCallback cb;
         dht::Value::Id vid;
+        bool earlyData {false};
     };
 
     bool connectDeviceStartIce(const std::shared_ptr<dht::crypto::PublicKey>& devicePk,
@@ -128,24 +158,51 @@ public:
                        ConnectCallback cb,
                        bool noNewSocket = false,
                        bool forceNewSocket = false,
-                       const std::string& connType = "");
+                       const std::string& connType = "",
+                       bool earlyData = false);
     void connectDevice(const std::shared_ptr<dht::crypto::Certificate>& cert,
                        const std::string& name,
                        ConnectCallback cb,
                        bool noNewSocket = false,
                        bool forceNewSocket = false,
-                       const std::string& connType = "");
+                       const std::string& connType = "",
+                       bool earlyData = false);
+    /**
+     * Start an ICE connection to a device, answering to its pending callbacks
+     * @param siblingVid    vid of the other connection racing with this one
+     * @param early         if the connection uses host candidates only
+     */
+    void startConnection(IceTransportOptions&& ice_config,
+                         const std::shared_ptr<dht::crypto::PublicKey>& devicePk,
+                         const std::shared_ptr<dht::crypto::Certificate>& cert,
+                         const std::string& name,
+                         const dht::Value::Id& vid,
+                         const dht::Value::Id& siblingVid,
+                         const std::string& connType,
+                         bool early = false);
     /**
-     * Send a ChannelRequest on the TLS socket. Triggers cb when ready
-     * @param sock      socket used to send the request
-     * @param name      channel's name
-     * @param vid       channel's id
-     * @param deviceId  to identify the linked ConnectCallback
+     * Stop the connection racing with info, that is now connected
      */
-    void sendChannelRequest(std::shared_ptr<MultiplexedSocket>& sock,
-                            const std::string& name,
-                            const DeviceId& deviceId,
-                            const dht::Value::Id& vid);
+    void stopSibling(const DeviceId& deviceId, const ConnectionInfo& info);
+
+    /**
+     * Devices contacted often are reconnected when their socket is lost, so
+     * their next channels don't wait for a new negotiation.
+     */
+    void recordUse(const DeviceId& deviceId, const std::shared_ptr<dht::crypto::Certificate>& cert);
+    void scheduleWarmUp(const DeviceId& deviceId);
+
+    std::vector<uint8_t> getTlsSession(const DeviceId& deviceId);
+    void storeTlsSession(const DeviceId& deviceId, std::vector<uint8_t>&& data);
+    /**
+     * Send the ChannelRequests of pendings on the TLS socket, in one packet.
+     * Triggers their cb when ready, or right after the request with earlyData
+     * @param sock      socket used to send the requests
+     * @param deviceId  to identify the linked ConnectCallbacks
+     */
+    void sendChannelRequests(std::shared_ptr<MultiplexedSocket>& sock,
+                             const DeviceId& deviceId,
+                             const std::vector<PendingCb>& pendings);
     /**
      * Triggered when a PeerConnectionRequest comes from the DHT
      */
@@ -157,6 +214,42 @@ public:
     void onDhtPeerRequest(const PeerConnectionRequest& req,
                           const std::shared_ptr<dht::crypto::Certificate>& cert);
 
+    /**
+     * Admission of the connection requests from the DHT, before any ICE transport is created:
+     * at most MAX_NEGOTIATIONS are negotiated at once, the others wait by priority.
+     */
+    enum class RequestPriority { OWN_DEVICE, CONTACT, OTHER };
+    /**
+     * @return the priority of the requests of a peer, none if it's banned
+     */
+    std::optional<RequestPriority> requestPriority(const dht::InfoHash& peer,
+                                                   const dht::crypto::Certificate& cert) const;
+    void admitRequest(PeerConnectionRequest&& req,
+                      const std::shared_ptr<dht::crypto::Certificate>& cert,
+                      RequestPriority priority);
+    /**
+     * Called once the negotiation of an admitted request is over, to start the next ones
+     */
+    void releaseRequest(const DeviceId& deviceId, const dht::Value::Id& vid);
+
+    struct QueuedRequest
+    {
+        PeerConnectionRequest req;
+        std::shared_ptr<dht::crypto::Certificate> cert;
+        std::chrono::steady_clock::time_point queued;
+    };
+    std::mutex admissionMtx_ {};
+    std::set<CallbackId> negotiating_ {};
+    std::map<std::pair<RequestPriority, uint64_t>, QueuedRequest> queuedRequests_ {};
+    uint64_t requestSeq_ {0};
+    std::map<DeviceId, unsigned> requestsPerDevice_ {};
+    void forgetRequest(const DeviceId& deviceId)
+    {
+        auto it = requestsPerDevice_.find(deviceId);
+        if (it != requestsPerDevice_.end() && --it->second == 0)
+            requestsPerDevice_.erase(it);
+    }
+
     void addNewMultiplexedSocket(const DeviceId& deviceId, const dht::Value::Id& vid);
     void onPeerResponse(const PeerConnectionRequest& req);
     void onDhtConnected(const dht::crypto::PublicKey& devicePk);
@@ -275,6 +368,22 @@ public:
         return std::static_pointer_cast<ConnectionManager::Impl const>(shared_from_this());
     }
 
+    struct DeviceUse
+    {
+        std::shared_ptr<dht::crypto::Certificate> cert {};
+        unsigned count {0};
+        std::chrono::steady_clock::time_point since {};
+    };
+    std::mutex usesMtx_ {};
+    std::map<DeviceId, DeviceUse> uses_ {};
+    std::chrono::steady_clock::time_point connectivityChanged_ {}; // protected by usesMtx_
+
+    // TLS sessions to resume, by peer device, the most recent first
+    std::mutex tlsSessionsMtx_ {};
+    std::list<std::pair<DeviceId, std::vector<uint8_t>>> tlsSessions_ {};
+    // Encrypting the session tickets given to the peers, of this account only
+    std::shared_ptr<tls::SessionTicketKey> ticketKey_ {std::make_shared<tls::SessionTicketKey>()};
+
     std::atomic_bool isDestroying_ {false};
 };
 
@@ -312,6 +421,7 @@ ConnectionManager::Impl::connectDeviceStartIce(
     val.id = vid; /* Random id for the message unicity */
     val.ice_msg = icemsg.str();
     val.connType = connType;
+    val.early = info->early_;
 
     auto value = std::make_shared<dht::Value>(std::move(val));
     value->user_type = "peer_request";
@@ -378,10 +488,16 @@ ConnectionManager::Impl::connectDeviceOnNegoDone(
     JAMI_DBG() << account
                << "Start TLS session - Initied by connectDevice(). Launched by channel: " << name
                << " - device:" << deviceId << " - vid: " << vid;
-    info->tls_ = std::make_unique<TlsSocketEndpoint>(std::move(endpoint),
-                                                     account.identity(),
-                                                     account.dhParams(),
-                                                     *cert);
+    info->tls_ = std::make_unique<TlsSocketEndpoint>(
+        std::move(endpoint),
+        account.identity(),
+        {}, // DH parameters of RFC 7919
+        *cert,
+        getTlsSession(deviceId),
+        [w = weak(), deviceId](std::vector<uint8_t>&& data) {
+            if (auto shared = w.lock())
+                shared->storeTlsSession(deviceId, std::move(data));
+        });
 
     info->tls_->setOnReady(
         [w = weak(), deviceId = std::move(deviceId), vid = std::move(vid), name = std::move(name)](
@@ -398,7 +514,8 @@ ConnectionManager::Impl::connectDevice(const DeviceId& deviceId,
                                        ConnectCallback cb,
                                        bool noNewSocket,
                                        bool forceNewSocket,
-                                       const std::string& connType)
+                                       const std::string& connType,
+                                       bool earlyData)
 {
     if (!account.dht()) {
         cb(nullptr, deviceId);
@@ -415,7 +532,8 @@ ConnectionManager::Impl::connectDevice(const DeviceId& deviceId,
                              cb = std::move(cb),
                              noNewSocket,
                              forceNewSocket,
-                             connType](const std::shared_ptr<dht::crypto::Certificate>& cert) {
+                             connType,
+                             earlyData](const std::shared_ptr<dht::crypto::Certificate>& cert) {
                                 if (!cert) {
                                     JAMI_ERR("No valid certificate found for device %s",
                                              deviceId.to_c_str());
@@ -428,7 +546,8 @@ ConnectionManager::Impl::connectDevice(const DeviceId& deviceId,
                                                           std::move(cb),
                                                           noNewSocket,
                                                           forceNewSocket,
-                                                          connType);
+                                                          connType,
+                                                          earlyData);
                                 }
                             });
 }
@@ -439,7 +558,8 @@ ConnectionManager::Impl::connectDevice(const std::shared_ptr<dht::crypto::Certif
                                        ConnectCallback cb,
                                        bool noNewSocket,
                                        bool forceNewSocket,
-                                       const std::string& connType)
+                                       const std::string& connType,
+                                       bool earlyData)
 {
     // Avoid dht operation in a DHT callback to avoid deadlocks
     runOnMainThread([w = weak(),
@@ -448,7 +568,8 @@ ConnectionManager::Impl::connectDevice(const std::shared_ptr<dht::crypto::Certif
                      cb = std::move(cb),
                      noNewSocket,
                      forceNewSocket,
-                     connType] {
+                     connType,
+                     earlyData] {
         auto devicePk = std::make_shared<dht::crypto::PublicKey>(cert->getPublicKey());
         auto deviceId = devicePk->getLongId();
         auto sthis = w.lock();
@@ -456,6 +577,8 @@ ConnectionManager::Impl::connectDevice(const std::shared_ptr<dht::crypto::Certif
             cb(nullptr, deviceId);
             return;
         }
+        if (name != WARMUP_CHANNEL)
+            sthis->recordUse(deviceId, cert);
         dht::Value::Id vid;
         auto tentatives = 0;
         do {
@@ -474,14 +597,14 @@ ConnectionManager::Impl::connectDevice(const std::shared_ptr<dht::crypto::Certif
             // Check if already connecting
             auto pendingsIt = sthis->pendingCbs_.find(deviceId);
             isConnectingToDevice = pendingsIt != sthis->pendingCbs_.end();
-            // Save current request for sendChannelRequest.
+            // Save current request for sendChannelRequests.
             // Note: do not return here, cause we can be in a state where first
             // socket is negotiated and first channel is pending
             // so return only after we checked the info
             if (isConnectingToDevice)
-                pendingsIt->second.emplace_back(PendingCb {name, std::move(cb), vid});
+                pendingsIt->second.emplace_back(PendingCb {name, std::move(cb), vid, earlyData});
             else
-                sthis->pendingCbs_[deviceId] = {{name, std::move(cb), vid}};
+                sthis->pendingCbs_[deviceId] = {{name, std::move(cb), vid, earlyData}};
         }
 
         // Check if already negotiated
@@ -491,7 +614,9 @@ ConnectionManager::Impl::connectDevice(const std::shared_ptr<dht::crypto::Certif
             if (info->socket_) {
                 JAMI_DBG("Peer already connected to %s. Add a new channel", deviceId.to_c_str());
                 info->cbIds_.emplace(cbId);
-                sthis->sendChannelRequest(info->socket_, name, deviceId, vid);
+                sthis->sendChannelRequests(info->socket_,
+                                           deviceId,
+                                           sthis->getPendingCallbacks(deviceId, vid));
                 return;
             }
         }
@@ -507,147 +632,238 @@ ConnectionManager::Impl::connectDevice(const std::shared_ptr<dht::crypto::Certif
             return;
         }
 
-        // Note: used when the ice negotiation fails to erase
-        // all stored structures.
-        auto eraseInfo = [w, cbId] {
-            if (auto shared = w.lock()) {
-                // If no new socket is specified, we don't try to generate a new socket
-                for (const auto& pending : shared->extractPendingCallbacks(cbId.first, cbId.second))
-                    pending.cb(nullptr, cbId.first);
-                std::lock_guard<std::mutex> lk(shared->infosMtx_);
-                shared->infos_.erase(cbId);
-            }
-        };
+        // Raced by a connection with the host candidates only, ready before
+        // the STUN/TURN candidates are gathered.
+        dht::Value::Id earlyVid;
+        do {
+            earlyVid = ValueIdDist(1, JAMI_ID_MAX_VAL)(sthis->account.rand);
+        } while (earlyVid == vid);
 
         // If no socket exists, we need to initiate an ICE connection.
         sthis->account.getIceOptions([w,
-                                      deviceId = std::move(deviceId),
                                       devicePk = std::move(devicePk),
                                       name = std::move(name),
                                       cert = std::move(cert),
                                       vid,
-                                      connType,
-                                      eraseInfo](auto&& ice_config) {
+                                      earlyVid,
+                                      connType](auto&& ice_config) {
             auto sthis = w.lock();
             if (!sthis) {
-                runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
+                runOnMainThread([w, deviceId = devicePk->getLongId(), vid] {
+                    if (auto shared = w.lock())
+                        for (const auto& pending : shared->extractPendingCallbacks(deviceId, vid))
+                            pending.cb(nullptr, deviceId);
+                });
                 return;
             }
-            ice_config.tcpEnable = true;
-            ice_config.onInitDone = [w,
-                                     deviceId = std::move(deviceId),
-                                     devicePk = std::move(devicePk),
-                                     name = std::move(name),
-                                     cert = std::move(cert),
-                                     vid,
-                                     connType,
-                                     eraseInfo](bool ok) {
-                auto sthis = w.lock();
-                if (!sthis || !ok) {
-                    JAMI_ERR("Cannot initialize ICE session.");
-                    runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
-                    return;
-                }
+            auto earlyConfig = ice_config;
+            earlyConfig.stunServers.clear();
+            earlyConfig.turnServers.clear();
+            earlyConfig.upnpEnable = false;
+            earlyConfig.aggressiveNomination = true;
+            sthis->startConnection(std::move(ice_config), devicePk, cert, name, vid, earlyVid, connType);
+            sthis->startConnection(std::move(earlyConfig),
+                                   devicePk,
+                                   cert,
+                                   name,
+                                   earlyVid,
+                                   vid,
+                                   connType,
+                                   true);
+        });
+    });
+}
 
-                dht::ThreadPool::io().run([w = std::move(w),
-                                           devicePk = std::move(devicePk),
-                                           vid = std::move(vid),
-                                           eraseInfo,
-                                           connType] {
-                    auto sthis = w.lock();
-                    if (!sthis || !sthis->connectDeviceStartIce(devicePk, vid, connType))
-                        runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
-                });
-            };
-            ice_config.onNegoDone = [w,
-                                     deviceId = std::move(deviceId),
-                                     name = std::move(name),
-                                     cert = std::move(cert),
-                                     vid,
-                                     eraseInfo](bool ok) {
-                auto sthis = w.lock();
-                if (!sthis || !ok) {
-                    JAMI_ERR("ICE negotiation failed.");
-                    runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
-                    return;
-                }
+void
+ConnectionManager::Impl::startConnection(IceTransportOptions&& ice_config,
+                                         const std::shared_ptr<dht::crypto::PublicKey>& devicePk,
+                                         const std::shared_ptr<dht::crypto::Certificate>& cert,
+                                         const std::string& name,
+                                         const dht::Value::Id& vid,
+                                         const dht::Value::Id& siblingVid,
+                                         const std::string& connType,
+                                         bool early)
+{
+    auto w = weak();
+    auto deviceId = devicePk->getLongId();
+    CallbackId cbId(deviceId, vid);
+    // Note: used when the ice negotiation fails to erase
+    // all stored structures.
+    auto eraseInfo = [w, cbId, siblingVid, early] {
+        if (auto shared = w.lock()) {
+            // The callbacks are kept for the other connection while it runs
+            if (!shared->getInfo(cbId.first, siblingVid)) {
+                auto pendingVid = early ? siblingVid : cbId.second;
+                for (const auto& pending : shared->extractPendingCallbacks(cbId.first, pendingVid))
+                    pending.cb(nullptr, cbId.first);
+            }
+            std::lock_guard<std::mutex> lk(shared->infosMtx_);
+            shared->infos_.erase(cbId);
+        }
+    };
 
-                dht::ThreadPool::io().run([w = std::move(w),
-                                           deviceId = std::move(deviceId),
-                                           name = std::move(name),
-                                           cert = std::move(cert),
-                                           vid = std::move(vid),
-                                           eraseInfo = std::move(eraseInfo)] {
-                    auto sthis = w.lock();
-                    if (!sthis || !sthis->connectDeviceOnNegoDone(deviceId, name, vid, cert))
-                        runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
-                });
-            };
+    ice_config.tcpEnable = true;
+    ice_config.onInitDone = [w, devicePk, vid, connType, eraseInfo](bool ok) {
+        auto sthis = w.lock();
+        if (!sthis || !ok) {
+            JAMI_ERR("Cannot initialize ICE session.");
+            runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
+            return;
+        }
 
-            auto info = std::make_shared<ConnectionInfo>();
-            {
-                std::lock_guard<std::mutex> lk(sthis->infosMtx_);
-                sthis->infos_[{deviceId, vid}] = info;
-            }
-            std::unique_lock<std::mutex> lk {info->mutex_};
-            ice_config.master = false;
-            ice_config.streamsCount = JamiAccount::ICE_STREAMS_COUNT;
-            ice_config.compCountPerStream = JamiAccount::ICE_COMP_COUNT_PER_STREAM;
-            info->ice_ = Manager::instance().getIceTransportFactory().createUTransport(
-                sthis->account.getAccountID().c_str());
-            if (!info->ice_) {
-                JAMI_ERR("Cannot initialize ICE session.");
-                eraseInfo();
-                return;
-            }
-            // We need to detect any shutdown if the ice session is destroyed before going to the
-            // TLS session;
-            info->ice_->setOnShutdown([eraseInfo]() {
+        dht::ThreadPool::io().run([w = std::move(w),
+                                   devicePk = std::move(devicePk),
+                                   vid = std::move(vid),
+                                   eraseInfo,
+                                   connType] {
+            auto sthis = w.lock();
+            if (!sthis || !sthis->connectDeviceStartIce(devicePk, vid, connType))
+                runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
+        });
+    };
+    ice_config.onNegoDone = [w, deviceId, name, cert, vid, eraseInfo](bool ok) {
+        auto sthis = w.lock();
+        if (!sthis || !ok) {
+            JAMI_ERR("ICE negotiation failed.");
+            runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
+            return;
+        }
+
+        dht::ThreadPool::io().run([w = std::move(w),
+                                   deviceId = std::move(deviceId),
+                                   name = std::move(name),
+                                   cert = std::move(cert),
+                                   vid = std::move(vid),
+                                   eraseInfo = std::move(eraseInfo)] {
+            auto sthis = w.lock();
+            if (!sthis || !sthis->connectDeviceOnNegoDone(deviceId, name, vid, cert))
                 runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
-            });
-            info->ice_->initIceInstance(ice_config);
         });
+    };
+
+    auto info = std::make_shared<ConnectionInfo>();
+    info->siblingVid_ = siblingVid;
+    info->early_ = early;
+    {
+        std::lock_guard<std::mutex> lk(infosMtx_);
+        infos_[cbId] = info;
+    }
+    std::unique_lock<std::mutex> lk {info->mutex_};
+    ice_config.master = false;
+    ice_config.streamsCount = JamiAccount::ICE_STREAMS_COUNT;
+    ice_config.compCountPerStream = JamiAccount::ICE_COMP_COUNT_PER_STREAM;
+    info->ice_ = Manager::instance().getIceTransportFactory().createUTransport(
+        account.getAccountID().c_str());
+    if (!info->ice_) {
+        JAMI_ERR("Cannot initialize ICE session.");
+        lk.unlock();
+        eraseInfo();
+        return;
+    }
+    // We need to detect any shutdown if the ice session is destroyed before going to the
+    // TLS session;
+    info->ice_->setOnShutdown([eraseInfo]() {
+        runOnMainThread([eraseInfo = std::move(eraseInfo)] { eraseInfo(); });
     });
+    info->ice_->initIceInstance(ice_config);
 }
 
 void
-ConnectionManager::Impl::sendChannelRequest(std::shared_ptr<MultiplexedSocket>& sock,
-                                            const std::string& name,
-                                            const DeviceId& deviceId,
-                                            const dht::Value::Id& vid)
+ConnectionManager::Impl::stopSibling(const DeviceId& deviceId, const ConnectionInfo& info)
 {
-    auto channelSock = sock->addChannel(name);
-    channelSock->onShutdown([name, deviceId, vid, w = weak()] {
-        auto shared = w.lock();
-        if (shared)
-            for (const auto& pending : shared->extractPendingCallbacks(deviceId, vid))
-                pending.cb(nullptr, deviceId);
-    });
-    channelSock->onReady(
-        [wSock = std::weak_ptr<ChannelSocket>(channelSock), name, deviceId, vid, w = weak()]() {
+    if (!info.siblingVid_)
+        return;
+    auto sibling = getInfo(deviceId, info.siblingVid_);
+    if (!sibling)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(sibling->mutex_);
+        if (sibling->socket_)
+            return;
+        JAMI_DBG() << account << "Connected to " << deviceId << ", stop the "
+                   << (sibling->early_ ? "early" : "gathering") << " connection";
+        if (sibling->tls_)
+            sibling->tls_->shutdown();
+        if (sibling->ice_) {
+            sibling->ice_->cancelOperations();
+            sibling->ice_->stop();
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lk(infosMtx_);
+        infos_.erase({deviceId, info.siblingVid_});
+    }
+    // Destroying the ICE transport flushes its timers
+    dht::ThreadPool::io().run([sibling = std::move(sibling)]() mutable { sibling.reset(); });
+}
+
+void
+ConnectionManager::Impl::sendChannelRequests(std::shared_ptr<MultiplexedSocket>& sock,
+                                             const DeviceId& deviceId,
+                                             const std::vector<PendingCb>& pendings)
+{
+    msgpack::sbuffer buffer(256 * pendings.size());
+    std::vector<std::pair<std::shared_ptr<ChannelSocket>, dht::Value::Id>> early;
+    auto send = [&] {
+        std::error_code ec;
+        int res = sock->write(CONTROL_CHANNEL,
+                              reinterpret_cast<const uint8_t*>(buffer.data()),
+                              buffer.size(),
+                              ec);
+        if (res < 0) {
+            // TODO check if we should handle errors here
+            JAMI_ERR("sendChannelRequest failed - error: %s", ec.message().c_str());
+        }
+        buffer.clear();
+    };
+    for (const auto& pending : pendings) {
+        auto vid = pending.vid;
+        auto channelSock = sock->addChannel(pending.name);
+        if (!channelSock) {
+            for (const auto& failed : extractPendingCallbacks(deviceId, vid))
+                failed.cb(nullptr, deviceId);
+            continue;
+        }
+        channelSock->onShutdown([deviceId, vid, w = weak()] {
             auto shared = w.lock();
-            auto channelSock = wSock.lock();
             if (shared)
                 for (const auto& pending : shared->extractPendingCallbacks(deviceId, vid))
-                    pending.cb(channelSock, deviceId);
+                    pending.cb(nullptr, deviceId);
         });
-
-    ChannelRequest val;
-    val.name = channelSock->name();
-    val.state = ChannelRequestState::REQUEST;
-    val.channel = channelSock->channel();
-    msgpack::sbuffer buffer(256);
-    msgpack::pack(buffer, val);
-
-    std::error_code ec;
-    int res = sock->write(CONTROL_CHANNEL,
-                          reinterpret_cast<const uint8_t*>(buffer.data()),
-                          buffer.size(),
-                          ec);
-    if (res < 0) {
-        // TODO check if we should handle errors here
-        JAMI_ERR("sendChannelRequest failed - error: %s", ec.message().c_str());
+        channelSock->onReady(
+            [wSock = std::weak_ptr<ChannelSocket>(channelSock), deviceId, vid, w = weak()]() {
+                auto shared = w.lock();
+                auto channelSock = wSock.lock();
+                if (shared)
+                    for (const auto& pending : shared->extractPendingCallbacks(deviceId, vid))
+                        pending.cb(channelSock, deviceId);
+            });
+        if (pending.earlyData)
+            early.emplace_back(channelSock, vid);
+
+        ChannelRequest val;
+        val.name = channelSock->name();
+        val.state = ChannelRequestState::REQUEST;
+        val.channel = channelSock->channel();
+        msgpack::pack(buffer, val);
+        // A control packet is limited to UINT16_MAX bytes
+        if (buffer.size() > UINT16_MAX / 2)
+            send();
     }
+    if (buffer.size() != 0)
+        send();
+
+    if (early.empty())
+        return;
+    // The channels are usable before their answer, their writes wait for the peer's version
+    dht::ThreadPool::io().run([w = weak(), deviceId, early = std::move(early)] {
+        auto shared = w.lock();
+        if (!shared)
+            return;
+        for (const auto& [channelSock, vid] : early)
+            for (const auto& pending : shared->extractPendingCallbacks(deviceId, vid))
+                pending.cb(channelSock, deviceId);
+    });
 }
 
 void
@@ -707,7 +923,14 @@ ConnectionManager::Impl::onDhtConnected(const dht::crypto::PublicKey& devicePk)
                                 return;
                             }
 #endif
-                            shared->onDhtPeerRequest(req, cert);
+                            auto priority = shared->requestPriority(peer_h, *cert);
+                            if (!priority) {
+                                JAMI_WARN() << shared->account
+                                            << "Rejected connection request from banned peer "
+                                            << req.owner->getLongId();
+                                return;
+                            }
+                            shared->admitRequest(std::move(req), cert, *priority);
                         } else {
                             JAMI_WARN()
                                 << shared->account << "Rejected untrusted connection request from "
@@ -727,13 +950,15 @@ ConnectionManager::Impl::onTlsNegotiationDone(bool ok,
                                               const dht::Value::Id& vid,
                                               const std::string& name)
 {
-    auto info = getInfo(deviceId, vid);
-    if (!info)
-        return;
     // Note: only handle pendingCallbacks here for TLS initied by connectDevice()
     // Note: if not initied by connectDevice() the channel name will be empty (because no channel
     // asked yet)
     auto isDhtRequest = name.empty();
+    if (isDhtRequest)
+        releaseRequest(deviceId, vid);
+    auto info = getInfo(deviceId, vid);
+    if (!info)
+        return;
     if (!ok) {
         if (isDhtRequest) {
             JAMI_ERR() << "TLS connection failure for peer " << deviceId
@@ -744,6 +969,17 @@ ConnectionManager::Impl::onTlsNegotiationDone(bool ok,
             JAMI_ERR() << "TLS connection failure for peer " << deviceId
                        << " - Initied by connectDevice(). Initied by channel: " << name
                        << " - vid: " << vid;
+            auto siblingVid = info->siblingVid_;
+            {
+                // Else a failing sibling would wait for this one forever
+                std::lock_guard<std::mutex> lk(infosMtx_);
+                infos_.erase({deviceId, vid});
+            }
+            // Not destroyed from its own TLS callback
+            dht::ThreadPool::io().run([info = std::move(info)]() mutable { info.reset(); });
+            // The other connection may still succeed
+            if (siblingVid && getInfo(deviceId, siblingVid))
+                return;
             for (const auto& pending : extractPendingCallbacks(deviceId))
                 pending.cb(nullptr, deviceId);
         }
@@ -758,15 +994,26 @@ ConnectionManager::Impl::onTlsNegotiationDone(bool ok,
                        << " - vid: " << vid;
         }
         addNewMultiplexedSocket(deviceId, vid);
+        stopSibling(deviceId, *info);
         // Finally, open the channel and launch pending callbacks
         if (info->socket_) {
-            // Note: do not remove pending there it's done in sendChannelRequest
-            for (const auto& pending : getPendingCallbacks(deviceId)) {
+            // Note: do not remove pending there it's done in sendChannelRequests
+            std::vector<PendingCb> requests;
+            for (auto& pending : getPendingCallbacks(deviceId)) {
+                if (pending.name == WARMUP_CHANNEL) {
+                    // Only the socket was wanted
+                    for (const auto& warmup : extractPendingCallbacks(deviceId, pending.vid))
+                        warmup.cb(nullptr, deviceId);
+                    continue;
+                }
                 JAMI_DBG("Send request on TLS socket for channel %s to %s",
                          pending.name.c_str(),
                          deviceId.to_c_str());
-                sendChannelRequest(info->socket_, pending.name, deviceId, pending.vid);
+                requests.emplace_back(std::move(pending));
             }
+            // All the channels are requested at once, answered in one round trip
+            if (!requests.empty())
+                sendChannelRequests(info->socket_, deviceId, requests);
         }
     }
 }
@@ -862,7 +1109,7 @@ ConnectionManager::Impl::onRequestOnNegoDone(const PeerConnectionRequest& req)
     info->tls_ = std::make_unique<TlsSocketEndpoint>(
         std::move(endpoint),
         account.identity(),
-        account.dhParams(),
+        {}, // DH parameters of RFC 7919
         [ph, w = weak()](const dht::crypto::Certificate& cert) {
             auto shared = w.lock();
             if (!shared)
@@ -871,7 +1118,8 @@ ConnectionManager::Impl::onRequestOnNegoDone(const PeerConnectionRequest& req)
             if (!crt)
                 return false;
             return crt->getPacked() == cert.getPacked();
-        });
+        },
+        ticketKey_);
 
     info->tls_->setOnReady(
         [w = weak(), deviceId = std::move(deviceId), vid = std::move(req.id)](bool ok) {
@@ -891,6 +1139,7 @@ ConnectionManager::Impl::onDhtPeerRequest(const PeerConnectionRequest& req,
         JAMI_INFO("[Account:%s] refuse connection from %s",
                   account.getAccountID().c_str(),
                   deviceId.toString().c_str());
+        releaseRequest(deviceId, req.id);
         return;
     }
 
@@ -903,6 +1152,7 @@ ConnectionManager::Impl::onDhtPeerRequest(const PeerConnectionRequest& req,
         // all stored structures.
         auto eraseInfo = [w, id = req.id, deviceId] {
             if (auto shared = w.lock()) {
+                shared->releaseRequest(deviceId, id);
                 // If no new socket is specified, we don't try to generate a new socket
                 for (const auto& pending : shared->extractPendingCallbacks(deviceId, id))
                     pending.cb(nullptr, deviceId);
@@ -914,6 +1164,13 @@ ConnectionManager::Impl::onDhtPeerRequest(const PeerConnectionRequest& req,
         };
 
         ice_config.tcpEnable = true;
+        if (req.early) {
+            // Answered as fast as requested, the other request gathers the rest
+            ice_config.stunServers.clear();
+            ice_config.turnServers.clear();
+            ice_config.upnpEnable = false;
+            ice_config.aggressiveNomination = true;
+        }
         ice_config.onInitDone = [w, req, deviceId, eraseInfo](bool ok) {
             auto shared = w.lock();
             if (!shared)
@@ -980,6 +1237,102 @@ ConnectionManager::Impl::onDhtPeerRequest(const PeerConnectionRequest& req,
     });
 }
 
+std::optional<ConnectionManager::Impl::RequestPriority>
+ConnectionManager::Impl::requestPriority(const dht::InfoHash& peer,
+                                         const dht::crypto::Certificate& cert) const
+{
+    auto* manager = account.accountManager();
+    if (!manager)
+        return RequestPriority::OTHER;
+    using Status = tls::TrustStore::PermissionStatus;
+    if (manager->getCertificateStatus(cert.getId().toString()) == Status::BANNED)
+        return std::nullopt;
+    if (peer.toString() == account.getUsername())
+        return RequestPriority::OWN_DEVICE;
+    switch (manager->getCertificateStatus(peer.toString())) {
+    case Status::BANNED:
+        return std::nullopt;
+    case Status::ALLOWED:
+        return RequestPriority::CONTACT;
+    default:
+        return RequestPriority::OTHER;
+    }
+}
+
+void
+ConnectionManager::Impl::admitRequest(PeerConnectionRequest&& req,
+                                      const std::shared_ptr<dht::crypto::Certificate>& cert,
+                                      RequestPriority priority)
+{
+    auto deviceId = req.owner->getLongId();
+    {
+        std::lock_guard<std::mutex> lk(admissionMtx_);
+        if (isDestroying_)
+            return;
+        auto count = requestsPerDevice_.find(deviceId);
+        if (count != requestsPerDevice_.end() && count->second >= MAX_REQUESTS_PER_DEVICE) {
+            JAMI_WARN() << account << "Too many connection requests from " << deviceId
+                        << ", rejected";
+            return;
+        }
+        if (negotiating_.size() >= MAX_NEGOTIATIONS) {
+            auto key = std::make_pair(priority, requestSeq_++);
+            if (queuedRequests_.size() >= MAX_QUEUED_REQUESTS) {
+                auto last = std::prev(queuedRequests_.end());
+                if (last->first < key) {
+                    JAMI_WARN() << account << "Too many connection requests, rejected "
+                                << deviceId;
+                    return;
+                }
+                auto lastDevice = last->second.req.owner->getLongId();
+                JAMI_WARN() << account << "Too many connection requests, dropped " << lastDevice;
+                forgetRequest(lastDevice);
+                queuedRequests_.erase(last);
+            }
+            JAMI_DBG() << account << "Connection request from " << deviceId << " queued";
+            ++requestsPerDevice_[deviceId];
+            queuedRequests_.emplace(key,
+                                    QueuedRequest {std::move(req),
+                                                   cert,
+                                                   std::chrono::steady_clock::now()});
+            return;
+        }
+        negotiating_.emplace(deviceId, req.id);
+        ++requestsPerDevice_[deviceId];
+    }
+    onDhtPeerRequest(req, cert);
+}
+
+void
+ConnectionManager::Impl::releaseRequest(const DeviceId& deviceId, const dht::Value::Id& vid)
+{
+    std::vector<QueuedRequest> next;
+    {
+        std::lock_guard<std::mutex> lk(admissionMtx_);
+        if (!negotiating_.erase({deviceId, vid}))
+            return;
+        forgetRequest(deviceId);
+        auto now = std::chrono::steady_clock::now();
+        while (negotiating_.size() < MAX_NEGOTIATIONS && !queuedRequests_.empty()) {
+            auto queued = std::move(queuedRequests_.begin()->second);
+            queuedRequests_.erase(queuedRequests_.begin());
+            auto queuedDevice = queued.req.owner->getLongId();
+            if (now - queued.queued > DHT_MSG_TIMEOUT) {
+                // The peer stopped waiting for the answer
+                forgetRequest(queuedDevice);
+                continue;
+            }
+            negotiating_.emplace(queuedDevice, queued.req.id);
+            next.emplace_back(std::move(queued));
+        }
+    }
+    for (auto& queued : next)
+        dht::ThreadPool::io().run([w = weak(), queued = std::move(queued)] {
+            if (auto shared = w.lock())
+                shared->onDhtPeerRequest(queued.req, queued.cert);
+        });
+}
+
 void
 ConnectionManager::Impl::addNewMultiplexedSocket(const DeviceId& deviceId, const dht::Value::Id& vid)
 {
@@ -1022,12 +1375,90 @@ ConnectionManager::Impl::addNewMultiplexedSocket(const DeviceId& deviceId, const
                 for (const auto& pending : sthis->extractPendingCallbacks(cbId.first, cbId.second))
                     pending.cb(nullptr, deviceId);
 
-            std::lock_guard<std::mutex> lk(sthis->infosMtx_);
-            sthis->infos_.erase({deviceId, vid});
+            {
+                std::lock_guard<std::mutex> lk(sthis->infosMtx_);
+                sthis->infos_.erase({deviceId, vid});
+            }
+            if (!sthis->isDestroying_)
+                sthis->scheduleWarmUp(deviceId);
         });
     });
 }
 
+void
+ConnectionManager::Impl::recordUse(const DeviceId& deviceId,
+                                   const std::shared_ptr<dht::crypto::Certificate>& cert)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lk(usesMtx_);
+    auto& use = uses_[deviceId];
+    if (now - use.since > WARM_PERIOD) {
+        use.count = 0;
+        use.since = now;
+    }
+    use.cert = cert;
+    ++use.count;
+}
+
+void
+ConnectionManager::Impl::scheduleWarmUp(const DeviceId& deviceId)
+{
+    std::shared_ptr<dht::crypto::Certificate> cert;
+    std::chrono::seconds delay = WARM_RECONNECT_DELAY;
+    {
+        std::lock_guard<std::mutex> lk(usesMtx_);
+        auto it = uses_.find(deviceId);
+        if (it == uses_.end())
+            return;
+        auto now = std::chrono::steady_clock::now();
+        if (now - it->second.since > WARM_PERIOD) {
+            uses_.erase(it);
+            return;
+        }
+        if (it->second.count < WARM_MIN_USES)
+            return;
+        cert = it->second.cert;
+        // Lost with the previous network: the device is likely reachable by the new one
+        if (now - connectivityChanged_ < MIGRATION_PERIOD)
+            delay = std::chrono::seconds(0);
+    }
+    JAMI_DBG() << account << "Connection to " << deviceId << " lost, reconnect in "
+               << delay.count() << "s";
+    Manager::instance().scheduler().scheduleIn(
+        [w = weak(), deviceId, cert = std::move(cert)] {
+            auto sthis = w.lock();
+            if (!sthis || sthis->isDestroying_ || sthis->getConnectedInfo(deviceId))
+                return;
+            sthis->connectDevice(cert, WARMUP_CHANNEL, [](const auto&, const auto&) {});
+        },
+        delay);
+}
+
+std::vector<uint8_t>
+ConnectionManager::Impl::getTlsSession(const DeviceId& deviceId)
+{
+    std::lock_guard<std::mutex> lk(tlsSessionsMtx_);
+    auto it = std::find_if(tlsSessions_.begin(), tlsSessions_.end(), [&](const auto& session) {
+        return session.first == deviceId;
+    });
+    if (it == tlsSessions_.end())
+        return {};
+    // A ticket is only used once, the new session gives the next one
+    auto data = std::move(it->second);
+    tlsSessions_.erase(it);
+    return data;
+}
+
+void
+ConnectionManager::Impl::storeTlsSession(const DeviceId& deviceId, std::vector<uint8_t>&& data)
+{
+    std::lock_guard<std::mutex> lk(tlsSessionsMtx_);
+    tlsSessions_.remove_if([&](const auto& session) { return session.first == deviceId; });
+    tlsSessions_.emplace_front(deviceId, std::move(data));
+    if (tlsSessions_.size() > MAX_TLS_SESSIONS)
+        tlsSessions_.pop_back();
+}
+
 ConnectionManager::ConnectionManager(JamiAccount& account)
     : pimpl_ {std::make_shared<Impl>(account)}
 {}
@@ -1044,9 +1475,16 @@ ConnectionManager::connectDevice(const DeviceId& deviceId,
                                  ConnectCallback cb,
                                  bool noNewSocket,
                                  bool forceNewSocket,
-                                 const std::string& connType)
+                                 const std::string& connType,
+                                 bool earlyData)
 {
-    pimpl_->connectDevice(deviceId, name, std::move(cb), noNewSocket, forceNewSocket, connType);
+    pimpl_->connectDevice(deviceId,
+                          name,
+                          std::move(cb),
+                          noNewSocket,
+                          forceNewSocket,
+                          connType,
+                          earlyData);
 }
 
 void
@@ -1055,9 +1493,16 @@ ConnectionManager::connectDevice(const std::shared_ptr<dht::crypto::Certificate>
                                  ConnectCallback cb,
                                  bool noNewSocket,
                                  bool forceNewSocket,
-                                 const std::string& connType)
+                                 const std::string& connType,
+                                 bool earlyData)
 {
-    pimpl_->connectDevice(cert, name, std::move(cb), noNewSocket, forceNewSocket, connType);
+    pimpl_->connectDevice(cert,
+                          name,
+                          std::move(cb),
+                          noNewSocket,
+                          forceNewSocket,
+                          connType,
+                          earlyData);
 }
 
 bool
@@ -1088,6 +1533,17 @@ ConnectionManager::closeConnectionsWith(const std::string& peerUri)
             }
         }
     }
+    {
+        // Closed on purpose, not to reconnect
+        std::lock_guard<std::mutex> lk(pimpl_->usesMtx_);
+        for (const auto& deviceId : peersDevices)
+            pimpl_->uses_.erase(deviceId);
+    }
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->tlsSessionsMtx_);
+        pimpl_->tlsSessions_.remove_if(
+            [&](const auto& session) { return peersDevices.count(session.first) != 0; });
+    }
     // Stop connections to all peers devices
     for (const auto& deviceId : peersDevices) {
         for (const auto& pending : pimpl_->extractPendingCallbacks(deviceId))
@@ -1142,6 +1598,18 @@ ConnectionManager::activeSockets() const
     return pimpl_->infos_.size();
 }
 
+bool
+ConnectionManager::isIdle() const
+{
+    std::lock_guard<std::mutex> lk(pimpl_->infosMtx_);
+    for (const auto& [_, ci] : pimpl_->infos_) {
+        // Still negotiating
+        if (!ci->socket_ or !ci->socket_->isIdle())
+            return false;
+    }
+    return true;
+}
+
 void
 ConnectionManager::monitor() const
 {
@@ -1153,6 +1621,12 @@ ConnectionManager::monitor() const
         if (ci->socket_)
             ci->socket_->monitor();
     }
+    auto turn = Manager::instance().getIceTransportFactory().getTurnAllocationCache()->stats();
+    JAMI_DBG("TURN allocations: %zu active, %zu of %zu requests answered by the cache (%.0f%%)",
+             turn.active,
+             turn.hits,
+             turn.requests,
+             turn.requests ? 100. * turn.hits / turn.requests : 0.);
     JAMI_DBG("ConnectionManager for account %s (%s), end status.",
              pimpl_->account.getAccountID().c_str(),
              pimpl_->account.getUserUri().c_str());
@@ -1161,6 +1635,12 @@ ConnectionManager::monitor() const
 void
 ConnectionManager::connectivityChanged()
 {
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->usesMtx_);
+        pimpl_->connectivityChanged_ = std::chrono::steady_clock::now();
+    }
+    // The NAT bindings of the new network are unknown
+    MultiplexedSocket::resetKeepAlive();
     std::lock_guard<std::mutex> lk(pimpl_->infosMtx_);
     for (const auto& [_, ci] : pimpl_->infos_) {
         if (ci->socket_)
@@ -1168,4 +1648,26 @@ ConnectionManager::connectivityChanged()
     }
 }
 
+void
+ConnectionManager::connectivityChanged(const ConnectivityChange& change)
+{
+    if (not change.disrupts())
+        return;
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->usesMtx_);
+        pimpl_->connectivityChanged_ = std::chrono::steady_clock::now();
+    }
+    MultiplexedSocket::resetKeepAlive();
+    size_t checked = 0;
+    std::lock_guard<std::mutex> lk(pimpl_->infosMtx_);
+    for (const auto& [_, ci] : pimpl_->infos_) {
+        // The others still have their address and route
+        if (ci->socket_ and change.disrupts(ci->socket_->getLocalAddress())) {
+            ci->socket_->sendBeacon();
+            ++checked;
+        }
+    }
+    JAMI_DBG("Network changed, checking %zu of %zu socket(s)", checked, pimpl_->infos_.size());
+}
+
 } // namespace jami
@@ -31,6 +31,7 @@
 namespace jami {
 
 class JamiAccount;
+struct ConnectivityChange;
 class ChannelSocket;
 class ConnectionManager;
 
@@ -47,7 +48,8 @@ struct PeerConnectionRequest : public dht::EncryptedValue<PeerConnectionRequest>
     std::string ice_msg {};
     bool isAnswer {false};
     std::string connType {}; // Used for push notifications to know why we open a new connection
-    MSGPACK_DEFINE_MAP(id, ice_msg, isAnswer, connType)
+    bool early {false}; // Host candidates only, raced by another request with all the candidates
+    MSGPACK_DEFINE_MAP(id, ice_msg, isAnswer, connType, early)
 };
 
 /**
@@ -90,19 +92,23 @@ public:
      * @param forceNewSocket Negotiate a new socket even if there is one // todo group with previous
      * (enum)
      * @param connType       Type of the connection
+     * @param earlyData      Give the channel before the peer accepts it, for protocols
+     * that can be replayed. Its first writes may be lost if the peer declines.
      */
     void connectDevice(const DeviceId& deviceId,
                        const std::string& name,
                        ConnectCallback cb,
                        bool noNewSocket = false,
                        bool forceNewSocket = false,
-                       const std::string& connType = "");
+                       const std::string& connType = "",
+                       bool earlyData = false);
     void connectDevice(const std::shared_ptr<dht::crypto::Certificate>& cert,
                        const std::string& name,
                        ConnectCallback cb,
                        bool noNewSocket = false,
                        bool forceNewSocket = false,
-                       const std::string& connType = "");
+                       const std::string& connType = "",
+                       bool earlyData = false);
 
     /**
      * Check if we are already connecting to a device with a specific name
@@ -150,6 +156,12 @@ public:
      */
     std::size_t activeSockets() const;
 
+    /**
+     * @return if no connection is being negotiated and all the sockets are idle
+     * (see MultiplexedSocket::isIdle)
+     */
+    bool isIdle() const;
+
     /**
      * Log informations for all sockets
      */
@@ -159,6 +171,10 @@ public:
      * Send beacon on peers supporting it
      */
     void connectivityChanged();
+    /**
+     * Send beacon on the sockets which may be broken by change
+     */
+    void connectivityChanged(const ConnectivityChange& change);
 
 private:
     ConnectionManager() = delete;
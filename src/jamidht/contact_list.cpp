@@ -19,6 +19,7 @@
 #include "logger.h"
 #include "jamiaccount.h"
 #include "fileutils.h"
+#include "map_journal.h"
 
 #ifdef ENABLE_PLUGIN
 #include "manager.h"
@@ -27,15 +28,83 @@
 
 #include "account_const.h"
 
+#include <opendht/thread_pool.h>
+
 #include <fstream>
+#include <optional>
 #include <gnutls/ocsp.h>
 
 namespace jami {
 
+using KnownDevicesFile = std::map<dht::PkId, std::pair<std::string, uint64_t>>;
+
+struct ContactList::Storage
+{
+    explicit Storage(const std::string& path)
+        : contacts(path + DIR_SEPARATOR_STR "contacts")
+        , trustRequests(path + DIR_SEPARATOR_STR "incomingTrustRequests")
+        , knownDevices(path + DIR_SEPARATOR_STR "knownDevices")
+    {}
+
+    /**
+     * Write the maps changed until there is none left. A burst of changes,
+     * e.g. of device announcements, is written once.
+     */
+    void write()
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        while (changedContacts || changedTrustRequests || changedKnownDevices) {
+            auto c = std::move(changedContacts);
+            auto t = std::move(changedTrustRequests);
+            auto d = std::move(changedKnownDevices);
+            changedContacts.reset();
+            changedTrustRequests.reset();
+            changedKnownDevices.reset();
+            lk.unlock();
+            try {
+                // Only the entries changed since the last write are appended
+                if (c)
+                    contacts.save(*c);
+                if (t)
+                    trustRequests.save(*t);
+                if (d)
+                    knownDevices.save(*d);
+            } catch (const std::exception& e) {
+                JAMI_ERR("[Contacts] Couldn't save contacts: %s", e.what());
+            }
+            lk.lock();
+        }
+        writing = false;
+    }
+
+    /**
+     * To call with mutex locked
+     */
+    void writeLater(const std::shared_ptr<Storage>& self)
+    {
+        if (writing)
+            return;
+        writing = true;
+        dht::ThreadPool::io().run([self] { self->write(); });
+    }
+
+    MapJournal<Contact, dht::InfoHash> contacts;
+    MapJournal<TrustRequest, dht::InfoHash> trustRequests;
+    MapJournal<std::pair<std::string, uint64_t>, dht::PkId> knownDevices;
+
+    std::mutex mutex;
+    // Not written yet, the latest state of each map
+    std::optional<std::map<dht::InfoHash, Contact>> changedContacts;
+    std::optional<std::map<dht::InfoHash, TrustRequest>> changedTrustRequests;
+    std::optional<KnownDevicesFile> changedKnownDevices;
+    bool writing {false};
+};
+
 ContactList::ContactList(const std::shared_ptr<crypto::Certificate>& cert,
                          const std::string& path,
                          OnChangeCallback cb)
     : path_(path)
+    , storage_(std::make_shared<Storage>(path))
     , callbacks_(std::move(cb))
 {
     if (cert)
@@ -216,18 +285,7 @@ ContactList::updateContact(const dht::InfoHash& id, const Contact& contact)
 void
 ContactList::loadContacts()
 {
-    decltype(contacts_) contacts;
-    try {
-        // read file
-        auto file = fileutils::loadFile("contacts", path_);
-        // load values
-        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
-        oh.get().convert(contacts);
-    } catch (const std::exception& e) {
-        JAMI_WARN("[Contacts] error loading contacts: %s", e.what());
-        return;
-    }
-
+    auto contacts = MapJournal<Contact, dht::InfoHash>::read(path_ + DIR_SEPARATOR_STR "contacts");
     for (auto& peer : contacts)
         updateContact(peer.first, peer.second);
 }
@@ -235,35 +293,26 @@ ContactList::loadContacts()
 void
 ContactList::saveContacts() const
 {
-    std::ofstream file(path_ + DIR_SEPARATOR_STR "contacts", std::ios::trunc | std::ios::binary);
-    msgpack::pack(file, contacts_);
+    std::lock_guard<std::mutex> lk(storage_->mutex);
+    storage_->changedContacts = contacts_;
+    storage_->writeLater(storage_);
 }
 
 void
 ContactList::saveTrustRequests() const
 {
-    std::ofstream file(path_ + DIR_SEPARATOR_STR "incomingTrustRequests",
-                       std::ios::trunc | std::ios::binary);
-    msgpack::pack(file, trustRequests_);
+    std::lock_guard<std::mutex> lk(storage_->mutex);
+    storage_->changedTrustRequests = trustRequests_;
+    storage_->writeLater(storage_);
 }
 
 void
 ContactList::loadTrustRequests()
 {
-    if (!fileutils::isFile(fileutils::getFullPath(path_, "incomingTrustRequests")))
-        return;
-    std::map<dht::InfoHash, TrustRequest> requests;
-    try {
-        // read file
-        auto file = fileutils::loadFile("incomingTrustRequests", path_);
-        // load values
-        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
-        oh.get().convert(requests);
-    } catch (const std::exception& e) {
-        JAMI_WARN("[Contacts] error loading trust requests: %s", e.what());
+    auto path = path_ + DIR_SEPARATOR_STR "incomingTrustRequests";
+    if (!fileutils::isFile(path) and !fileutils::isFile(path + ".journal"))
         return;
-    }
-
+    auto requests = MapJournal<TrustRequest, dht::InfoHash>::read(path);
     for (auto& tr : requests)
         onTrustRequest(tr.first,
                        tr.second.device,
@@ -403,14 +452,9 @@ ContactList::discardTrustRequest(const dht::InfoHash& from)
 void
 ContactList::loadKnownDevices()
 {
-    try {
-        // read file
-        auto file = fileutils::loadFile("knownDevices", path_);
-        // load values
-        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
-
-        std::map<dht::PkId, std::pair<std::string, uint64_t>> knownDevices;
-        oh.get().convert(knownDevices);
+    auto path = path_ + DIR_SEPARATOR_STR "knownDevices";
+    if (fileutils::isFile(path) or fileutils::isFile(path + ".journal")) {
+        auto knownDevices = MapJournal<std::pair<std::string, uint64_t>, dht::PkId>::read(path);
         for (const auto& d : knownDevices) {
             /*JAMI_DBG("[Contacts] loading known account device %s %s",
                     d.second.first.c_str(),
@@ -423,40 +467,36 @@ ContactList::loadKnownDevices()
                           d.first.toString().c_str());
             }
         }
-    } catch (const std::exception& e) {
-        // Legacy fallback
-        try {
-            auto file = fileutils::loadFile("knownDevicesNames", path_);
-            msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
-            std::map<dht::InfoHash, std::pair<std::string, uint64_t>> knownDevices;
-            oh.get().convert(knownDevices);
-            for (const auto& d : knownDevices) {
-                if (auto crt = tls::CertificateStore::instance().getCertificate(
-                        d.first.toString())) {
-                    if (not foundAccountDevice(crt,
-                                               d.second.first,
-                                               clock::from_time_t(d.second.second)))
-                        JAMI_WARN("[Contacts] can't add device %s", d.first.toString().c_str());
-                }
+        return;
+    }
+    // Legacy fallback
+    try {
+        auto file = fileutils::loadFile("knownDevicesNames", path_);
+        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
+        std::map<dht::InfoHash, std::pair<std::string, uint64_t>> knownDevices;
+        oh.get().convert(knownDevices);
+        for (const auto& d : knownDevices) {
+            if (auto crt = tls::CertificateStore::instance().getCertificate(d.first.toString())) {
+                if (not foundAccountDevice(crt, d.second.first, clock::from_time_t(d.second.second)))
+                    JAMI_WARN("[Contacts] can't add device %s", d.first.toString().c_str());
             }
-        } catch (const std::exception& e) {
-            JAMI_WARN("[Contacts] error loading devices: %s", e.what());
         }
-        return;
+    } catch (const std::exception& e) {
+        JAMI_WARN("[Contacts] error loading devices: %s", e.what());
     }
 }
 
 void
 ContactList::saveKnownDevices() const
 {
-    std::ofstream file(path_ + DIR_SEPARATOR_STR "knownDevices", std::ios::trunc | std::ios::binary);
-
-    std::map<dht::PkId, std::pair<std::string, uint64_t>> devices;
+    KnownDevicesFile devices;
     for (const auto& id : knownDevices_)
         devices.emplace(id.first,
                         std::make_pair(id.second.name, clock::to_time_t(id.second.last_sync)));
 
-    msgpack::pack(file, devices);
+    std::lock_guard<std::mutex> lk(storage_->mutex);
+    storage_->changedKnownDevices = std::move(devices);
+    storage_->writeLater(storage_);
 }
 
 void
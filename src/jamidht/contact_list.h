@@ -26,6 +26,7 @@
 #include <opendht/crypto.h>
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include <chrono>
 
@@ -158,6 +159,13 @@ private:
     tls::TrustStore trust_;
     std::string path_;
 
+    /**
+     * Files of the contacts, trust requests and known devices, written in the background.
+     * See MapJournal.
+     */
+    struct Storage;
+    std::shared_ptr<Storage> storage_;
+
     OnChangeCallback callbacks_;
 
     void loadContacts();
@@ -22,9 +22,11 @@
 #include "account_const.h"
 #include "fileutils.h"
 #include "jamiaccount.h"
+#include "string_utils.h"
 #include "client/ring_signal.h"
 
 #include <charconv>
+#include <deque>
 #include <json/json.h>
 #include <string_view>
 #include <opendht/thread_pool.h>
@@ -138,12 +140,14 @@ public:
 
     Impl(const std::weak_ptr<JamiAccount>& account,
          const std::string& remoteDevice,
-         const std::string& conversationId)
+         const std::string& conversationId,
+         unsigned depth)
         : account_(account)
     {
         repository_ = ConversationRepository::cloneConversation(account,
                                                                 remoteDevice,
-                                                                conversationId);
+                                                                conversationId,
+                                                                depth);
         if (!repository_) {
             if (auto shared = account.lock()) {
                 emitSignal<DRing::ConversationSignal::OnConversationError>(
@@ -178,6 +182,32 @@ public:
     std::string repoPath() const;
 
     std::mutex writeMtx_ {};
+
+    // Messages waiting to be committed, in order
+    struct PendingMessage
+    {
+        std::string body;
+        // If the message is tracked in sending_
+        bool sending {true};
+        std::function<void(const std::string&)> onCommitted;
+    };
+    std::mutex pendingMessagesMtx_ {};
+    std::deque<PendingMessage> pendingMessages_ {};
+    bool committingMessages_ {false};
+    /**
+     * @return true if the caller must start committing the queue
+     */
+    bool queueMessages(std::vector<PendingMessage>&& messages)
+    {
+        std::lock_guard<std::mutex> lk(pendingMessagesMtx_);
+        for (auto& message : messages)
+            pendingMessages_.emplace_back(std::move(message));
+        if (committingMessages_)
+            return false;
+        committingMessages_ = true;
+        return true;
+    }
+
     void announce(const std::string& commitId) const
     {
         std::vector<std::string> vec;
@@ -210,6 +240,12 @@ public:
         auto lastId = ok ? commits.rbegin()->at(ConversationMapKeys::ID) : "";
         if (ok) {
             bool announceMember = false;
+#ifdef ENABLE_PLUGIN
+            // Published at once, not to block this thread while fetching the history
+            auto& pluginChatManager
+                = Manager::instance().getJamiPluginManager().getChatServicesManager();
+            std::vector<std::shared_ptr<JamiMessage>> pluginMessages;
+#endif
             for (const auto& c : commits) {
                 // Announce member events
                 if (c.at("type") == "member") {
@@ -235,8 +271,6 @@ public:
                     }
                 }
 #ifdef ENABLE_PLUGIN
-                auto& pluginChatManager
-                    = Manager::instance().getJamiPluginManager().getChatServicesManager();
                 if (pluginChatManager.hasHandlers()) {
                     auto cm = std::make_shared<JamiMessage>(shared->getAccountID(),
                                                             convId,
@@ -244,7 +278,7 @@ public:
                                                             c,
                                                             false);
                     cm->isSwarm = true;
-                    pluginChatManager.publishMessage(std::move(cm));
+                    pluginMessages.emplace_back(std::move(cm));
                 }
 #endif
                 // announce message
@@ -277,6 +311,9 @@ public:
                 }
             }
 
+#ifdef ENABLE_PLUGIN
+            pluginChatManager.publishMessages(std::move(pluginMessages));
+#endif
             if (announceMember) {
                 std::vector<std::string> members;
                 for (const auto& m : repository_->members())
@@ -372,6 +409,7 @@ public:
     std::vector<std::map<std::string, std::string>> loadMessages(const std::string& fromMessage = "",
                                                                  const std::string& toMessage = "",
                                                                  size_t n = 0);
+    DRing::PackedMessages loadPackedMessages(const std::string& fromMessage, size_t n);
     void pull();
     std::vector<std::map<std::string, std::string>> mergeHistory(const std::string& uri);
 
@@ -432,6 +470,14 @@ Conversation::Impl::loadMessages(const std::string& fromMessage,
     return repository_->convCommitToMap(convCommits);
 }
 
+DRing::PackedMessages
+Conversation::Impl::loadPackedMessages(const std::string& fromMessage, size_t n)
+{
+    if (!repository_)
+        return {};
+    return repository_->convCommitsToPacked(repository_->logN(fromMessage, n));
+}
+
 Conversation::Conversation(const std::weak_ptr<JamiAccount>& account,
                            ConversationMode mode,
                            const std::string& otherMember)
@@ -445,8 +491,9 @@ Conversation::Conversation(const std::weak_ptr<JamiAccount>& account,
 
 Conversation::Conversation(const std::weak_ptr<JamiAccount>& account,
                            const std::string& remoteDevice,
-                           const std::string& conversationId)
-    : pimpl_ {new Impl {account, remoteDevice, conversationId}}
+                           const std::string& conversationId,
+                           unsigned depth)
+    : pimpl_ {new Impl {account, remoteDevice, conversationId, depth}}
 {}
 
 Conversation::~Conversation() {}
@@ -668,24 +715,11 @@ Conversation::isMember(const std::string& uri, bool includeInvited) const
     if (!shared)
         return false;
 
-    auto invitedPath = pimpl_->repoPath() + DIR_SEPARATOR_STR + "invited";
-    auto adminsPath = pimpl_->repoPath() + DIR_SEPARATOR_STR + "admins";
-    auto membersPath = pimpl_->repoPath() + DIR_SEPARATOR_STR + "members";
-    std::vector<std::string> pathsToCheck = {adminsPath, membersPath};
-    if (includeInvited)
-        pathsToCheck.emplace_back(invitedPath);
-    for (const auto& path : pathsToCheck) {
-        for (const auto& certificate : fileutils::readDirectory(path)) {
-            if (path != invitedPath && certificate.find(".crt") == std::string::npos) {
-                JAMI_WARN("Incorrect file found: %s/%s", path.c_str(), certificate.c_str());
-                continue;
-            }
-            auto crtUri = certificate;
-            if (crtUri.find(".crt") != std::string::npos)
-                crtUri = crtUri.substr(0, crtUri.size() - std::string(".crt").size());
-            if (crtUri == uri)
-                return true;
-        }
+    if (auto role = pimpl_->repository_->memberRole(uri)) {
+        if (*role == MemberRole::ADMIN || *role == MemberRole::MEMBER)
+            return true;
+        if (*role == MemberRole::INVITED && includeInvited)
+            return true;
     }
 
     if (includeInvited && mode() == ConversationMode::ONE_TO_ONE) {
@@ -704,7 +738,7 @@ Conversation::isBanned(const std::string& uri) const
     return !pimpl_->bannedType(uri).empty();
 }
 
-void
+std::future<std::string>
 Conversation::sendMessage(std::string&& message,
                           const std::string& type,
                           const std::string& replyTo,
@@ -713,74 +747,134 @@ Conversation::sendMessage(std::string&& message,
     Json::Value json;
     json["body"] = std::move(message);
     json["type"] = type;
-    sendMessage(std::move(json), replyTo, std::move(cb));
+    return sendMessage(std::move(json), replyTo, std::move(cb));
 }
 
-void
+std::future<std::string>
 Conversation::sendMessage(Json::Value&& value, const std::string& replyTo, OnDoneCb&& cb)
 {
+    auto promise = std::make_shared<std::promise<std::string>>();
+    auto future = promise->get_future();
     if (!replyTo.empty()) {
         auto commit = pimpl_->repository_->getCommit(replyTo);
         if (commit == std::nullopt) {
             JAMI_ERR("Replying to invalid commit %s", replyTo.c_str());
-            return;
+            promise->set_value({});
+            return future;
         }
         value["reply-to"] = replyTo;
     }
-    dht::ThreadPool::io().run([w = weak(), value = std::move(value), cb = std::move(cb)] {
-        if (auto sthis = w.lock()) {
-            auto shared = sthis->pimpl_->account_.lock();
-            if (!shared)
-                return;
-            std::unique_lock<std::mutex> lk(sthis->pimpl_->writeMtx_);
-            Json::StreamWriterBuilder wbuilder;
-            wbuilder["commentStyle"] = "None";
-            wbuilder["indentation"] = "";
-            auto commit = sthis->pimpl_->repository_->commitMessage(
-                Json::writeString(wbuilder, value));
-            sthis->pimpl_->sending_.emplace_back(commit);
-            sthis->pimpl_->saveSending();
-            sthis->clearFetched();
-            lk.unlock();
-            sthis->pimpl_->announce(commit);
-            emitSignal<DRing::ConfigurationSignal::AccountMessageStatusChanged>(
-                shared->getAccountID(),
-                sthis->id(),
-                shared->getUsername(),
-                commit,
-                static_cast<int>(DRing::Account::MessageStates::SENDING));
-            if (cb)
-                cb(!commit.empty(), commit);
-        }
-    });
+    Json::StreamWriterBuilder wbuilder;
+    wbuilder["commentStyle"] = "None";
+    wbuilder["indentation"] = "";
+    std::vector<Impl::PendingMessage> messages;
+    messages.emplace_back(Impl::PendingMessage {Json::writeString(wbuilder, value),
+                                                true,
+                                                [promise, cb = std::move(cb)](
+                                                    const std::string& commit) {
+                                                    if (cb)
+                                                        cb(!commit.empty(), commit);
+                                                    promise->set_value(commit);
+                                                }});
+    // Kept alive until its messages are committed
+    if (pimpl_->queueMessages(std::move(messages)))
+        dht::ThreadPool::io().run([sthis = shared_from_this()] { sthis->commitPendingMessages(); });
+    return future;
 }
 
 void
-Conversation::sendMessages(std::vector<Json::Value>&& messages, OnMultiDoneCb&& cb)
+Conversation::sendMessages(std::vector<Json::Value>&& values, OnMultiDoneCb&& cb)
 {
-    dht::ThreadPool::io().run([w = weak(), messages = std::move(messages), cb = std::move(cb)] {
-        if (auto sthis = w.lock()) {
-            auto shared = sthis->pimpl_->account_.lock();
-            if (!shared)
+    if (values.empty())
+        return;
+    struct Replay
+    {
+        std::mutex mtx;
+        size_t done {0};
+        std::vector<std::string> commits;
+        OnMultiDoneCb cb;
+    };
+    auto replay = std::make_shared<Replay>();
+    replay->commits.reserve(values.size());
+    replay->cb = std::move(cb);
+    auto total = values.size();
+    Json::StreamWriterBuilder wbuilder;
+    wbuilder["commentStyle"] = "None";
+    wbuilder["indentation"] = "";
+    std::vector<Impl::PendingMessage> messages;
+    messages.reserve(values.size());
+    for (const auto& value : values)
+        messages.emplace_back(
+            Impl::PendingMessage {Json::writeString(wbuilder, value),
+                                  false,
+                                  [replay, total](const std::string& commit) {
+                                      std::unique_lock<std::mutex> lk(replay->mtx);
+                                      if (!commit.empty())
+                                          replay->commits.emplace_back(commit);
+                                      if (++replay->done != total)
+                                          return;
+                                      lk.unlock();
+                                      if (replay->cb)
+                                          replay->cb(replay->commits);
+                                  }});
+    // Kept alive until its messages are committed
+    if (pimpl_->queueMessages(std::move(messages)))
+        dht::ThreadPool::io().run([sthis = shared_from_this()] { sthis->commitPendingMessages(); });
+}
+
+void
+Conversation::commitPendingMessages()
+{
+    while (true) {
+        // Group all the messages queued while the previous ones were committed
+        std::vector<Impl::PendingMessage> messages;
+        {
+            std::lock_guard<std::mutex> lk(pimpl_->pendingMessagesMtx_);
+            if (pimpl_->pendingMessages_.empty()) {
+                pimpl_->committingMessages_ = false;
                 return;
-            std::vector<std::string> commits;
-            commits.reserve(messages.size());
-            Json::StreamWriterBuilder wbuilder;
-            wbuilder["commentStyle"] = "None";
-            wbuilder["indentation"] = "";
-            std::unique_lock<std::mutex> lk(sthis->pimpl_->writeMtx_);
-            for (const auto& message : messages) {
-                auto commit = sthis->pimpl_->repository_->commitMessage(
-                    Json::writeString(wbuilder, message));
-                commits.emplace_back(std::move(commit));
             }
+            messages.reserve(pimpl_->pendingMessages_.size());
+            for (auto& message : pimpl_->pendingMessages_)
+                messages.emplace_back(std::move(message));
+            pimpl_->pendingMessages_.clear();
+        }
+
+        std::vector<std::string> commits(messages.size());
+        auto shared = pimpl_->account_.lock();
+        if (shared) {
+            std::vector<std::string> bodies;
+            bodies.reserve(messages.size());
+            for (const auto& message : messages)
+                bodies.emplace_back(message.body);
+            std::unique_lock<std::mutex> lk(pimpl_->writeMtx_);
+            commits = pimpl_->repository_->commitMessages(bodies);
+            auto sending = false;
+            for (size_t i = 0; i < messages.size(); ++i) {
+                if (messages[i].sending && !commits[i].empty()) {
+                    pimpl_->sending_.emplace_back(commits[i]);
+                    sending = true;
+                }
+            }
+            if (sending)
+                pimpl_->saveSending();
+            clearFetched();
             lk.unlock();
-            sthis->pimpl_->announce(commits);
-            sthis->clearFetched();
-            if (cb)
-                cb(commits);
+            pimpl_->announce(commits);
+            for (size_t i = 0; i < messages.size(); ++i) {
+                if (messages[i].sending && !commits[i].empty())
+                    emitSignal<DRing::ConfigurationSignal::AccountMessageStatusChanged>(
+                        shared->getAccountID(),
+                        id(),
+                        shared->getUsername(),
+                        commits[i],
+                        static_cast<int>(DRing::Account::MessageStates::SENDING));
+            }
         }
-    });
+        for (size_t i = 0; i < messages.size(); ++i)
+            if (messages[i].onCommitted)
+                messages[i].onCommitted(commits[i]);
+    }
 }
 
 void
@@ -795,6 +889,20 @@ Conversation::loadMessages(const OnLoadMessages& cb, const std::string& fromMess
     });
 }
 
+void
+Conversation::loadPackedMessages(const OnLoadPackedMessages& cb,
+                                 const std::string& fromMessage,
+                                 size_t n)
+{
+    if (!cb)
+        return;
+    dht::ThreadPool::io().run([w = weak(), cb = std::move(cb), fromMessage, n] {
+        if (auto sthis = w.lock()) {
+            cb(sthis->pimpl_->loadPackedMessages(fromMessage, n));
+        }
+    });
+}
+
 std::optional<std::map<std::string, std::string>>
 Conversation::getCommit(const std::string& commitId) const
 {
@@ -982,6 +1090,62 @@ Conversation::Impl::pull()
     }
 }
 
+std::string
+Conversation::shallowOrigin() const
+{
+    return pimpl_->repository_ ? pimpl_->repository_->shallowOrigin() : std::string {};
+}
+
+void
+Conversation::backfill(const std::string& deviceId, OnPullCb&& cb)
+{
+    dht::ThreadPool::io().run([w = weak(), deviceId, cb = std::move(cb)] {
+        auto sthis_ = w.lock();
+        if (!sthis_) {
+            cb(false);
+            return;
+        }
+        auto& pimpl = sthis_->pimpl_;
+        {
+            // Not while pulling from the same remote
+            std::lock_guard<std::mutex> lk(pimpl->pullcbsMtx_);
+            if (!pimpl->fetchingRemotes_.emplace(deviceId).second) {
+                cb(false);
+                return;
+            }
+        }
+        auto ok = pimpl->repository_->backfill(deviceId);
+        {
+            std::lock_guard<std::mutex> lk(pimpl->pullcbsMtx_);
+            pimpl->fetchingRemotes_.erase(deviceId);
+        }
+        cb(ok);
+    });
+}
+
+PackState
+Conversation::packState() const
+{
+    return pimpl_->repository_ ? pimpl_->repository_->packState() : PackState {};
+}
+
+bool
+Conversation::maintain()
+{
+    if (!pimpl_->repository_)
+        return false;
+    {
+        // Packs of a fetch are only referenced once merged
+        std::lock_guard<std::mutex> lk(pimpl_->pullcbsMtx_);
+        if (!pimpl_->fetchingRemotes_.empty())
+            return false;
+    }
+    // Only pruning needs the history not to be written, not the (long) packing
+    pimpl_->repository_->maintain(
+        [this] { return std::unique_lock<std::mutex>(pimpl_->writeMtx_); });
+    return true;
+}
+
 void
 Conversation::sync(const std::string& member,
                    const std::string& deviceId,
@@ -1040,6 +1204,23 @@ Conversation::isRemoving()
     return pimpl_->isRemoving_;
 }
 
+bool
+Conversation::isIdle() const
+{
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->pullcbsMtx_);
+        if (!pimpl_->pullcbs_.empty() || !pimpl_->fetchingRemotes_.empty())
+            return false;
+    }
+    {
+        // The messages queued are not committed yet
+        std::lock_guard<std::mutex> lk(pimpl_->pendingMessagesMtx_);
+        if (pimpl_->committingMessages_ || !pimpl_->pendingMessages_.empty())
+            return false;
+    }
+    return !pimpl_->transferManager_ || !pimpl_->transferManager_->hasTransfers();
+}
+
 void
 Conversation::erase()
 {
@@ -1180,22 +1361,72 @@ Conversation::downloadFile(const std::string& interactionId,
     auto size_str = commit->at("totalSize");
     std::size_t totalSize;
     std::from_chars(size_str.data(), size_str.data() + size_str.size(), totalSize);
+    std::vector<std::string> chunkSums;
+    auto itSums = commit->find("chunkSums");
+    if (itSums != commit->end() && totalSize > 0) {
+        for (const auto& sum : split_string(itSums->second, ','))
+            chunkSums.emplace_back(sum);
+        auto chunkSize = fileChunkSize(totalSize);
+        if (chunkSums.size() != (totalSize + chunkSize - 1) / chunkSize)
+            chunkSums.clear();
+    }
 
     // Be sure to not lock conversation
-    dht::ThreadPool().io().run(
-        [w = weak(), deviceId, fileId, interactionId, sha3sum, path, totalSize, start, end] {
-            if (auto shared = w.lock()) {
-                auto acc = shared->pimpl_->account_.lock();
-                if (!acc)
-                    return;
-                shared->dataTransfer()->waitForTransfer(fileId,
-                                                        interactionId,
-                                                        sha3sum,
-                                                        path,
-                                                        totalSize);
-                acc->askForFileChannel(shared->id(), deviceId, interactionId, fileId, start, end);
+    dht::ThreadPool().io().run([w = weak(),
+                                deviceId,
+                                fileId,
+                                interactionId,
+                                sha3sum,
+                                path,
+                                totalSize,
+                                start,
+                                end,
+                                chunkSums] {
+        if (auto shared = w.lock()) {
+            auto acc = shared->pimpl_->account_.lock();
+            if (!acc)
+                return;
+            // Already received or sent, maybe in another conversation
+            if (start == 0 && end == 0
+                && shared->dataTransfer()
+                       ->linkStoredFile(fileId, interactionId, sha3sum, path, totalSize))
+                return;
+            shared->dataTransfer()->waitForTransfer(fileId,
+                                                    interactionId,
+                                                    sha3sum,
+                                                    path,
+                                                    totalSize,
+                                                    chunkSums);
+            // Older peers read the offsets on 32 bits
+            if (start == 0 && end == 0 && !chunkSums.empty() && totalSize <= UINT32_MAX) {
+                // The first chunks are asked to all the devices. Each device holding the
+                // file then gets other chunks to send, see IncomingFile::setChunks()
+                auto chunkSize = fileChunkSize(totalSize);
+                for (std::size_t i = 0; i < std::min(TRANSFER_STRIPES, chunkSums.size()); ++i)
+                    acc->askForFileChannel(shared->id(),
+                                           deviceId,
+                                           interactionId,
+                                           fileId,
+                                           i * chunkSize,
+                                           std::min<std::size_t>((i + 1) * chunkSize, totalSize));
+                return;
             }
-        });
+            if (start == 0 && end == 0 && totalSize >= STRIPED_TRANSFER_MIN_SIZE
+                && totalSize <= UINT32_MAX) {
+                // Each range is asked separately, so that it may be sent by another
+                // device, or at least on another channel
+                for (std::size_t i = 0; i < TRANSFER_STRIPES; ++i)
+                    acc->askForFileChannel(shared->id(),
+                                           deviceId,
+                                           interactionId,
+                                           fileId,
+                                           totalSize * i / TRANSFER_STRIPES,
+                                           totalSize * (i + 1) / TRANSFER_STRIPES);
+                return;
+            }
+            acc->askForFileChannel(shared->id(), deviceId, interactionId, fileId, start, end);
+        }
+    });
     return true;
 }
 
@@ -1214,6 +1445,25 @@ Conversation::needsFetch(const std::string& deviceId) const
     return pimpl_->fetchedDevices_.find(deviceId) == pimpl_->fetchedDevices_.end();
 }
 
+bool
+Conversation::needsFetch(const std::string& accountId,
+                         const std::string& conversationId,
+                         const std::string& deviceId)
+{
+    // Same file as Impl::loadFetched()
+    std::set<std::string> fetchedDevices;
+    try {
+        auto file = fileutils::loadFile(fileutils::get_data_dir() + DIR_SEPARATOR_STR + accountId
+                                        + DIR_SEPARATOR_STR + "conversation_data"
+                                        + DIR_SEPARATOR_STR + conversationId + DIR_SEPARATOR_STR
+                                        + "fetched");
+        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
+        oh.get().convert(fetchedDevices);
+    } catch (const std::exception& e) {
+    }
+    return fetchedDevices.find(deviceId) == fetchedDevices.end();
+}
+
 void
 Conversation::hasFetched(const std::string& deviceId, const std::string& commitId)
 {
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <functional>
+#include <future>
 #include <string>
 #include <vector>
 #include <map>
@@ -105,6 +106,7 @@ enum class ConversationMode;
 using OnPullCb = std::function<void(bool fetchOk)>;
 using OnLoadMessages
     = std::function<void(std::vector<std::map<std::string, std::string>>&& messages)>;
+using OnLoadPackedMessages = std::function<void(DRing::PackedMessages&& messages)>;
 using OnDoneCb = std::function<void(bool, const std::string&)>;
 using OnMultiDoneCb = std::function<void(const std::vector<std::string>&)>;
 
@@ -117,7 +119,8 @@ public:
     Conversation(const std::weak_ptr<JamiAccount>& account, const std::string& conversationId = "");
     Conversation(const std::weak_ptr<JamiAccount>& account,
                  const std::string& remoteDevice,
-                 const std::string& conversationId);
+                 const std::string& conversationId,
+                 unsigned depth = 0);
     ~Conversation();
 
     /**
@@ -178,11 +181,17 @@ public:
     bool isBanned(const std::string& uri) const;
 
     // Message send
-    void sendMessage(std::string&& message,
-                     const std::string& type = "text/plain",
-                     const std::string& replyTo = "",
-                     OnDoneCb&& cb = {});
-    void sendMessage(Json::Value&& message, const std::string& replyTo = "", OnDoneCb&& cb = {});
+    /**
+     * Queue a message to be committed, consecutive messages are committed together
+     * @return the future commit id, <empty> on failure
+     */
+    std::future<std::string> sendMessage(std::string&& message,
+                                         const std::string& type = "text/plain",
+                                         const std::string& replyTo = "",
+                                         OnDoneCb&& cb = {});
+    std::future<std::string> sendMessage(Json::Value&& message,
+                                         const std::string& replyTo = "",
+                                         OnDoneCb&& cb = {});
     // Note: used for replay. Should not be used by clients
     void sendMessages(std::vector<Json::Value>&& messages, OnMultiDoneCb&& cb = {});
     /**
@@ -201,6 +210,12 @@ public:
     void loadMessages(const OnLoadMessages& cb,
                       const std::string& fromMessage = "",
                       const std::string& toMessage = "");
+    /**
+     * Same as loadMessages(cb, fromMessage, n), without a map per message
+     */
+    void loadPackedMessages(const OnLoadPackedMessages& cb,
+                            const std::string& fromMessage = "",
+                            size_t n = 0);
     /**
      * Retrieve one commit
      * @param   commitId
@@ -238,6 +253,25 @@ public:
               OnPullCb&& cb,
               std::string commitId = "");
 
+    /**
+     * @return the device the conversation was joined from, if joined with a part of its
+     * history only
+     */
+    std::string shallowOrigin() const;
+    /**
+     * Fetch the rest of the history of a shallow conversation
+     * @param deviceId  Peer device
+     * @param cb        On backfilled callback
+     */
+    void backfill(const std::string& deviceId, OnPullCb&& cb);
+
+    PackState packState() const;
+    /**
+     * Pack the objects of the repository, see ConversationRepository::maintain()
+     * @return false if skipped, because the history is being fetched
+     */
+    bool maintain();
+
     /**
      * Generate an invitation to send to new contacts
      * @return the invite to send
@@ -262,6 +296,11 @@ public:
      * @return true if left the room
      */
     bool isRemoving();
+    /**
+     * @return true if no pull nor file transfer is in progress, so that the conversation
+     * can be closed and loaded again later
+     */
+    bool isIdle() const;
 
     /**
      * Erase all related datas
@@ -340,6 +379,12 @@ public:
      * @param deviceId
      */
     bool needsFetch(const std::string& deviceId) const;
+    /**
+     * needsFetch() of a conversation not loaded
+     */
+    static bool needsFetch(const std::string& accountId,
+                           const std::string& conversationId,
+                           const std::string& deviceId);
     /**
      * Store informations about who fetch or not. This simplify sync (sync when a device without the
      * last fetch is detected)
@@ -402,6 +447,11 @@ private:
         return std::static_pointer_cast<Conversation const>(shared_from_this());
     }
 
+    /**
+     * Commit the queued messages, from the thread pool, until the queue is empty
+     */
+    void commitPendingMessages();
+
     class Impl;
     std::unique_ptr<Impl> pimpl_;
 };
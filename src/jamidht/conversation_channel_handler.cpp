@@ -42,7 +42,11 @@ ConversationChannelHandler::connect(const DeviceId& deviceId,
                                                           const DeviceId& dev) {
                                          if (cb)
                                              cb(socket, dev);
-                                     });
+                                     },
+                                     false,
+                                     false,
+                                     "",
+                                     /* earlyData, a fetch can be retried */ true);
 }
 
 bool
@@ -0,0 +1,213 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "conversation_log_index.h"
+
+#include "conversationrepository.h"
+#include "fileutils.h"
+#include "logger.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+namespace jami {
+
+static constexpr char MAGIC[4] {'J', 'L', 'I', 1};
+static constexpr std::size_t OID_SIZE {GIT_OID_RAWSZ};
+static constexpr std::size_t HEADER_SIZE {sizeof(MAGIC) + OID_SIZE};
+static constexpr std::size_t RECORD_SIZE {OID_SIZE + sizeof(int64_t)};
+// Further, walking the new commits costs as much as a rebuild
+static constexpr std::size_t MAX_APPEND {512};
+
+static void
+writeTimestamp(uint8_t* out, int64_t timestamp)
+{
+    auto value = static_cast<uint64_t>(timestamp);
+    for (std::size_t i = 0; i < sizeof(value); ++i)
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+static int64_t
+readTimestamp(const uint8_t* in)
+{
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < sizeof(value); ++i)
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return static_cast<int64_t>(value);
+}
+
+ConversationLogIndex::ConversationLogIndex(const std::string& path)
+    : path_(path)
+{}
+
+bool
+ConversationLogIndex::update(git_repository* repo)
+{
+    if (!loaded_) {
+        loaded_ = true;
+        load();
+    }
+    git_oid head;
+    if (git_reference_name_to_id(&head, repo, "HEAD") < 0)
+        return false;
+    if (head_ and git_oid_equal(&*head_, &head))
+        return true;
+    return append(repo, head) or rebuild(repo, head);
+}
+
+std::optional<std::size_t>
+ConversationLogIndex::find(const std::string& commitId) const
+{
+    auto it = positions_.find(commitId);
+    if (it == positions_.end())
+        return std::nullopt;
+    return entries_.size() - 1 - it->second;
+}
+
+bool
+ConversationLogIndex::append(git_repository* repo, const git_oid& head)
+{
+    if (not head_)
+        return false;
+    std::vector<Entry> newEntries;
+    git_oid current = head;
+    while (not git_oid_equal(&current, &*head_)) {
+        if (newEntries.size() == MAX_APPEND)
+            return false;
+        git_commit* commit_ptr = nullptr;
+        if (git_commit_lookup(&commit_ptr, repo, &current) < 0)
+            return false;
+        GitCommit commit {commit_ptr, git_commit_free};
+        if (git_commit_parentcount(commit.get()) != 1)
+            return false;
+        newEntries.emplace_back(Entry {current, git_commit_time(commit.get())});
+        current = *git_commit_parent_id(commit.get(), 0);
+    }
+
+    auto from = entries_.size();
+    for (auto it = newEntries.rbegin(); it != newEntries.rend(); ++it)
+        add(it->id, it->timestamp);
+    head_ = head;
+    save(from);
+    return true;
+}
+
+bool
+ConversationLogIndex::rebuild(git_repository* repo, const git_oid& head)
+{
+    JAMI_DBG("Rebuild conversation log index %s", path_.c_str());
+    entries_.clear();
+    positions_.clear();
+    head_.reset();
+
+    // Same order as ConversationRepository::Impl::forEachCommit()
+    git_revwalk* walker_ptr = nullptr;
+    if (git_revwalk_new(&walker_ptr, repo) < 0) {
+        JAMI_ERR("Couldn't init revwalker for %s", path_.c_str());
+        return false;
+    }
+    GitRevWalker walker {walker_ptr, git_revwalk_free};
+    if (git_revwalk_push(walker.get(), &head) < 0) {
+        JAMI_ERR("Couldn't init revwalker for %s", path_.c_str());
+        return false;
+    }
+    git_revwalk_sorting(walker.get(), GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME);
+
+    std::vector<Entry> newestFirst;
+    git_oid oid;
+    while (!git_revwalk_next(&oid, walker.get())) {
+        git_commit* commit_ptr = nullptr;
+        if (git_commit_lookup(&commit_ptr, repo, &oid) < 0) {
+            JAMI_WARN("Failed to look up commit %s", git_oid_tostr_s(&oid));
+            return false;
+        }
+        GitCommit commit {commit_ptr, git_commit_free};
+        newestFirst.emplace_back(Entry {oid, git_commit_time(commit.get())});
+    }
+    entries_.reserve(newestFirst.size());
+    for (auto it = newestFirst.rbegin(); it != newestFirst.rend(); ++it)
+        add(it->id, it->timestamp);
+    head_ = head;
+    save(0);
+    return true;
+}
+
+void
+ConversationLogIndex::add(const git_oid& id, int64_t timestamp)
+{
+    positions_[git_oid_tostr_s(&id)] = entries_.size();
+    entries_.emplace_back(Entry {id, timestamp});
+}
+
+void
+ConversationLogIndex::load()
+{
+    std::vector<uint8_t> file;
+    try {
+        file = fileutils::loadFile(path_);
+    } catch (const std::exception&) {
+        return;
+    }
+    if (file.size() < HEADER_SIZE or std::memcmp(file.data(), MAGIC, sizeof(MAGIC)) != 0
+        or (file.size() - HEADER_SIZE) % RECORD_SIZE != 0) {
+        JAMI_WARN("Ignore invalid conversation log index %s", path_.c_str());
+        return;
+    }
+    git_oid head;
+    git_oid_fromraw(&head, file.data() + sizeof(MAGIC));
+    auto count = (file.size() - HEADER_SIZE) / RECORD_SIZE;
+    entries_.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto record = file.data() + HEADER_SIZE + i * RECORD_SIZE;
+        git_oid id;
+        git_oid_fromraw(&id, record);
+        add(id, readTimestamp(record + OID_SIZE));
+    }
+    // A partial write would leave the head in the history, never at its end
+    if (count == 0 or not git_oid_equal(&entries_.back().id, &head)) {
+        entries_.clear();
+        positions_.clear();
+        return;
+    }
+    head_ = head;
+}
+
+void
+ConversationLogIndex::save(std::size_t from) const
+{
+    // Only the new records are written, after the header
+    auto mode = std::ios::binary | std::ios::out | (from == 0 ? std::ios::trunc : std::ios::in);
+    auto file = fileutils::ofstream(path_, mode);
+    if (!file) {
+        JAMI_ERR("Couldn't save conversation log index %s", path_.c_str());
+        return;
+    }
+    std::vector<uint8_t> buffer((entries_.size() - from) * RECORD_SIZE);
+    for (std::size_t i = from; i < entries_.size(); ++i) {
+        auto record = buffer.data() + (i - from) * RECORD_SIZE;
+        std::memcpy(record, entries_[i].id.id, OID_SIZE);
+        writeTimestamp(record + OID_SIZE, entries_[i].timestamp);
+    }
+    file.seekp(HEADER_SIZE + from * RECORD_SIZE);
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    // The head is written last, so that an interrupted save is detected
+    file.seekp(0);
+    file.write(MAGIC, sizeof(MAGIC));
+    file.write(reinterpret_cast<const char*>(head_->id), OID_SIZE);
+}
+
+} // namespace jami
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "noncopyable.h"
+
+#include <git2.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace jami {
+
+/**
+ * Linearized history of a conversation, in the order of a topological walk
+ * from HEAD, so that loading a page of messages doesn't walk the whole history.
+ *
+ * The index is derived from the repository and checked against HEAD before
+ * each use: it is extended when HEAD moved forward with normal commits, and
+ * rebuilt when a merge changed the order. It is saved as fixed size records,
+ * oldest first, so that extending it only appends to the file.
+ */
+class ConversationLogIndex
+{
+public:
+    explicit ConversationLogIndex(const std::string& path);
+
+    /**
+     * Bring the index up to date with the HEAD of repo
+     * @return false if the index can't be used
+     */
+    bool update(git_repository* repo);
+
+    std::size_t size() const { return entries_.size(); }
+
+    /**
+     * Position of a commit, 0 being HEAD
+     */
+    std::optional<std::size_t> find(const std::string& commitId) const;
+
+    const git_oid& id(std::size_t pos) const { return entries_[entries_.size() - 1 - pos].id; }
+    int64_t timestamp(std::size_t pos) const
+    {
+        return entries_[entries_.size() - 1 - pos].timestamp;
+    }
+
+private:
+    NON_COPYABLE(ConversationLogIndex);
+
+    struct Entry
+    {
+        git_oid id;
+        int64_t timestamp;
+    };
+
+    /**
+     * Add the commits between the indexed head and head, if they only have
+     * one parent. Else the order of the history may change.
+     */
+    bool append(git_repository* repo, const git_oid& head);
+    bool rebuild(git_repository* repo, const git_oid& head);
+    void add(const git_oid& id, int64_t timestamp);
+
+    void load();
+    void save(std::size_t from) const;
+
+    const std::string path_;
+    bool loaded_ {false};
+    std::optional<git_oid> head_ {};
+    std::vector<Entry> entries_ {}; // Oldest first
+    std::unordered_map<std::string, std::size_t> positions_ {};
+};
+
+} // namespace jami
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "conversation_maintenance.h"
+
+#include <algorithm>
+
+namespace jami {
+
+ConversationMaintenance::ConversationMaintenance(clock::duration interval, clock::duration budget)
+    : interval_(interval)
+    , budget_(budget)
+{}
+
+std::vector<std::string>
+ConversationMaintenance::pass(const std::vector<std::string>& conversations,
+                              clock::time_point now)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    spent_ = {};
+    // Forget the removed conversations
+    std::map<std::string, clock::time_point> maintained;
+    std::vector<std::pair<clock::time_point, std::string>> due;
+    for (const auto& id : conversations) {
+        auto it = maintained_.find(id);
+        if (it == maintained_.end()) {
+            due.emplace_back(clock::time_point::min(), id);
+            continue;
+        }
+        maintained.emplace(id, it->second);
+        if (now - it->second >= interval_)
+            due.emplace_back(it->second, id);
+    }
+    maintained_ = std::move(maintained);
+
+    std::sort(due.begin(), due.end());
+    std::vector<std::string> result;
+    result.reserve(due.size());
+    for (auto& [time, id] : due)
+        result.emplace_back(std::move(id));
+    return result;
+}
+
+bool
+ConversationMaintenance::done(const std::string& conversationId,
+                              clock::duration took,
+                              clock::time_point now)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    maintained_[conversationId] = now;
+    spent_ += took;
+    return spent_ < budget_;
+}
+
+} // namespace jami
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "noncopyable.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace jami {
+
+/**
+ * Choose the conversations whose repository is maintained (see
+ * ConversationRepository::maintain()), during the idle time of the account.
+ *
+ * Each pass maintains the conversations not maintained for the longest time,
+ * the ones never maintained first, until it spent its budget. A conversation
+ * is maintained at most once per interval, so that a pass with nothing due
+ * costs nothing.
+ */
+class ConversationMaintenance
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    ConversationMaintenance(clock::duration interval, clock::duration budget);
+
+    /**
+     * Start a pass
+     * @param conversations     All the conversations of the account
+     * @param now
+     * @return the conversations due, in the order to maintain them
+     */
+    std::vector<std::string> pass(const std::vector<std::string>& conversations,
+                                  clock::time_point now);
+
+    /**
+     * A conversation of the pass was maintained
+     * @param conversationId
+     * @param took      Time the maintenance took
+     * @param now
+     * @return false if the budget of the pass is spent
+     */
+    bool done(const std::string& conversationId, clock::duration took, clock::time_point now);
+
+private:
+    NON_COPYABLE(ConversationMaintenance);
+
+    const clock::duration interval_;
+    const clock::duration budget_;
+
+    std::mutex mutex_;
+    std::map<std::string, clock::time_point> maintained_ {};
+    clock::duration spent_ {};
+};
+
+} // namespace jami
@@ -20,7 +20,9 @@
 
 #include "conversation_module.h"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
 
 #include <opendht/thread_pool.h>
 
@@ -28,14 +30,82 @@
 #include "client/ring_signal.h"
 #include "fileutils.h"
 #include "jamidht/account_manager.h"
+#include "jamidht/conversation_maintenance.h"
+#include "jamidht/conversation_sync_scheduler.h"
+#include "jamidht/map_journal.h"
 #include "jamidht/jamiaccount.h"
 #include "manager.h"
-#include "vcard.h"
 
 namespace jami {
 
 using ConvInfoMap = std::map<std::string, ConvInfo>;
 
+// Concurrent fetches, so that an account with many conversations doesn't open them all at once
+static constexpr std::size_t MAX_FETCH_PER_DEVICE {4};
+static constexpr std::size_t MAX_FETCH {16};
+// Conversations kept open, the idle ones past this are closed until used again
+static constexpr std::size_t MAX_LOADED_CONVERSATIONS {64};
+// Swarms with more members announce their commits through a tree of the members
+static constexpr std::size_t ANNOUNCE_MESH_MAX {8};
+// Members notified by the author of a commit, then by each member notified
+static constexpr std::size_t ANNOUNCE_FANOUT {4};
+// The commits of a conversation are announced at most once per window, the newest one
+static constexpr std::chrono::milliseconds ANNOUNCE_WINDOW {200};
+// Commits cloned when joining a conversation, the older ones are fetched when scrolled to
+static constexpr unsigned JOIN_DEPTH {256};
+// While no conversation is fetched, the repositories are maintained by passes of at most the
+// budget, each one at most once per interval
+static constexpr std::chrono::minutes MAINTENANCE_PERIOD {5};
+static constexpr std::chrono::seconds MAINTENANCE_BUDGET {2};
+static constexpr std::chrono::hours MAINTENANCE_INTERVAL {1};
+
+/**
+ * Members a member announces a commit to, in a tree of the members rooted at the author of the
+ * announcement. The members are ordered by the hash of the commit with their URI, so that every
+ * member computes the same tree and each commit is relayed by different members.
+ * @param members   Members of the conversation
+ * @param commitId
+ * @param origin    Root of the tree
+ * @param relay     Member announcing the commit
+ */
+static std::vector<std::string>
+announceTargets(const std::vector<std::string>& members,
+                const std::string& commitId,
+                const std::string& origin,
+                const std::string& relay)
+{
+    std::vector<std::pair<dht::InfoHash, std::string>> order;
+    order.reserve(members.size());
+    for (const auto& member : members)
+        if (member != origin)
+            order.emplace_back(dht::InfoHash::get(commitId + member), member);
+    std::sort(order.begin(), order.end());
+
+    std::size_t first = 0;
+    if (relay != origin) {
+        auto it = std::find_if(order.begin(), order.end(), [&](const auto& node) {
+            return node.second == relay;
+        });
+        if (it == order.end())
+            return {};
+        first = (std::distance(order.begin(), it) + 1) * ANNOUNCE_FANOUT;
+    }
+    std::vector<std::string> targets;
+    for (auto i = first; i < std::min(first + ANNOUNCE_FANOUT, order.size()); ++i)
+        targets.emplace_back(std::move(order[i].second));
+    return targets;
+}
+
+static std::string
+accountDataPath(const std::weak_ptr<JamiAccount>& account)
+{
+    auto shared = account.lock();
+    if (!shared)
+        return {};
+    return fileutils::get_data_dir() + DIR_SEPARATOR_STR + shared->getAccountID()
+           + DIR_SEPARATOR_STR;
+}
+
 struct PendingConversationFetch
 {
     bool ready {false};
@@ -72,17 +142,40 @@ public:
      * @param deviceId          Contact's device
      * @param conversationId
      * @param commitId (optional)
+     * @param origin            Author of the announcement to relay once fetched (optional)
      */
     void fetchNewCommits(const std::string& peer,
                          const std::string& deviceId,
                          const std::string& conversationId,
-                         const std::string& commitId = "");
+                         const std::string& commitId = "",
+                         const std::string& origin = "");
     /**
      * Handle events to receive new commits
      */
     void checkConversationsEvents();
     bool handlePendingConversations();
     void handlePendingConversation(const std::string& conversationId, const std::string& deviceId);
+    /**
+     * Fetch the rest of the history of a conversation joined with a part of it
+     * @param conversationId
+     * @param deviceId      Device it was joined from
+     * @param cb
+     */
+    void backfillConversation(const std::string& conversationId,
+                              const std::string& deviceId,
+                              OnPullCb&& cb);
+
+    /**
+     * Load n messages of a conversation, the older commits of a shallow clone being fetched
+     * first if there are not enough
+     * @param Messages  std::vector of maps or DRing::PackedMessages
+     */
+    template<typename Messages>
+    void loadMessages(const std::shared_ptr<Conversation>& conversation,
+                      const std::string& conversationId,
+                      const std::string& fromMessage,
+                      size_t n,
+                      std::function<void(Messages&&)>&& emitLoaded);
 
     // Requests
     std::optional<ConversationRequest> getRequest(const std::string& id) const;
@@ -94,7 +187,8 @@ public:
      * @return a map of members with their role and details
      */
     std::vector<std::map<std::string, std::string>> getConversationMembers(
-        const std::string& conversationId) const;
+        const std::string& conversationId);
+    std::vector<std::string> getConversationMemberUris(const std::string& conversationId);
 
     /**
      * Remove a repository and all files
@@ -121,6 +215,33 @@ public:
     void sendMessageNotification(const Conversation& conversation,
                                  const std::string& commitId,
                                  bool sync);
+    /**
+     * Forward the announcement of a swarm commit to the next members of the tree
+     * @param conversationId
+     * @param commitId
+     * @param origin    Author of the announcement
+     */
+    void relayMessageNotification(const std::string& conversationId,
+                                  const std::string& commitId,
+                                  const std::string& origin);
+    void notifyMembers(const std::string& conversationId,
+                       const std::string& commitId,
+                       const std::string& origin,
+                       const std::vector<std::string>& members);
+    /**
+     * Announce the newest commit of a conversation at the end of its window
+     */
+    void flushMessageNotification(const std::string& conversationId);
+
+    struct Announcement
+    {
+        std::chrono::steady_clock::time_point last {};
+        // Newest commit, announced at the end of the window, if any
+        std::string commitId;
+        bool sync {false};
+    };
+    std::mutex announcementsMtx_;
+    std::map<std::string, Announcement> announcements_;
 
     /**
      * @return if a convId is a valid conversation (repository cloned & usable)
@@ -128,9 +249,30 @@ public:
     bool isConversation(const std::string& convId) const
     {
         std::lock_guard<std::mutex> lk(conversationsMtx_);
-        return conversations_.find(convId) != conversations_.end();
+        return conversations_.find(convId) != conversations_.end()
+               || unloadedConversations_.find(convId) != unloadedConversations_.end();
     }
 
+    /**
+     * @return the conversation, loaded from its repository on first use
+     * @note conversationsMtx_ must be locked
+     */
+    std::shared_ptr<Conversation> getConversation(const std::string& convId);
+    /**
+     * Open the repository of a conversation
+     */
+    std::shared_ptr<Conversation> loadConversation(const std::string& convId);
+    /**
+     * Keep a conversation created or cloned
+     * @note conversationsMtx_ must be locked
+     */
+    void addConversation(const std::string& convId, std::shared_ptr<Conversation> conversation);
+    /**
+     * Close the least recently used conversations past MAX_LOADED_CONVERSATIONS, if idle
+     * @note conversationsMtx_ must be locked
+     */
+    void closeIdleConversations();
+
     void addConvInfo(const ConvInfo& info)
     {
         std::lock_guard<std::mutex> lk(convInfosMtx_);
@@ -177,11 +319,31 @@ public:
 
     // Conversations
     mutable std::mutex conversationsMtx_ {};
+    // Loaded conversations, getConversation() loads the others
     std::map<std::string, std::shared_ptr<Conversation>> conversations_;
+    std::set<std::string> unloadedConversations_;
+    // Last use of the loaded conversations, the least recently used are closed first
+    std::map<std::string, uint64_t> lastUse_;
+    uint64_t useCount_ {0};
     std::mutex pendingConversationsFetchMtx_ {};
     std::map<std::string, PendingConversationFetch> pendingConversationsFetch_;
+    ConversationSyncScheduler syncScheduler_ {MAX_FETCH_PER_DEVICE, MAX_FETCH};
+    // Commit announced by a device while fetching from it
+    struct PendingCommit
+    {
+        std::string peer;
+        std::string commitId;
+        std::string origin;
+    };
+    // By conversation and device, the newest one, fetched once the current fetch is done
+    std::map<std::pair<std::string, std::string>, PendingCommit> pendingCommits_;
 
-    bool startFetch(const std::string& convId, const std::string& deviceId)
+    /**
+     * @param pending   Kept if already fetching from the device
+     */
+    bool startFetch(const std::string& convId,
+                    const std::string& deviceId,
+                    PendingCommit* pending = nullptr)
     {
         std::lock_guard<std::mutex> lk(pendingConversationsFetchMtx_);
         auto it = pendingConversationsFetch_.find(convId);
@@ -194,14 +356,19 @@ public:
         auto& pf = it->second;
         if (pf.ready)
             return false; // Already doing stuff
-        if (pf.connectingTo.find(deviceId) != pf.connectingTo.end())
-            return false; // Already connecting to this device
+        if (pf.connectingTo.find(deviceId) != pf.connectingTo.end()) {
+            // Already connecting to this device
+            if (pending and not pending->commitId.empty())
+                pendingCommits_[{convId, deviceId}] = std::move(*pending);
+            return false;
+        }
         pf.connectingTo.insert(deviceId);
         return true;
     }
 
     void stopFetch(const std::string& convId, const std::string& deviceId)
     {
+        pendingCommits_.erase({convId, deviceId});
         auto it = pendingConversationsFetch_.find(convId);
         if (it == pendingConversationsFetch_.end())
             return;
@@ -228,18 +395,18 @@ public:
     // The following informations are stored on the disk
     mutable std::mutex convInfosMtx_; // Note, should be locked after conversationsMtx_ if needed
     std::map<std::string, ConvInfo> convInfos_;
+    // Only write what changed since the last save
+    MapJournal<ConvInfo> convInfosJournal_;
+    MapJournal<ConversationRequest> convRequestsJournal_;
     // The following methods modify what is stored on the disk
     /**
      * @note convInfosMtx_ should be locked
      */
-    void saveConvInfos() const { ConversationModule::saveConvInfos(accountId_, convInfos_); }
+    void saveConvInfos() { convInfosJournal_.save(convInfos_); }
     /**
      * @note conversationsRequestsMtx_ should be locked
      */
-    void saveConvRequests() const
-    {
-        ConversationModule::saveConvRequests(accountId_, conversationsRequests_);
-    }
+    void saveConvRequests() { convRequestsJournal_.save(conversationsRequests_); }
     bool addConversationRequest(const std::string& id, const ConversationRequest& req)
     {
         std::lock_guard<std::mutex> lk(conversationsRequestsMtx_);
@@ -270,6 +437,44 @@ public:
     std::map<std::string, std::vector<std::map<std::string, std::string>>> replay_;
     std::map<std::string, uint64_t> refreshMessage;
     std::atomic_int syncCnt {0};
+    std::mutex syncFinishedMtx_;
+    std::vector<std::function<void()>> onSyncFinished_;
+    /**
+     * Once the last fetch ended
+     */
+    void syncFinished()
+    {
+        decltype(onSyncFinished_) cbs;
+        {
+            std::lock_guard<std::mutex> lk(syncFinishedMtx_);
+            cbs = std::move(onSyncFinished_);
+            onSyncFinished_.clear();
+        }
+        for (auto& cb : cbs)
+            cb();
+    }
+    /**
+     * Once a fetch ended, or was dropped by clearPendingFetch()
+     */
+    void fetchEnded()
+    {
+        if (syncCnt.fetch_sub(1) == 1) {
+            if (auto account = account_.lock())
+                emitSignal<DRing::ConversationSignal::ConversationSyncFinished>(
+                    account->getAccountID().c_str());
+            syncFinished();
+        }
+    }
+
+    // Repository maintenance
+    ConversationMaintenance maintenance_ {MAINTENANCE_INTERVAL, MAINTENANCE_BUDGET};
+    std::shared_ptr<RepeatedTask> maintenanceTask_ {};
+    std::atomic_bool maintaining_ {false};
+    /**
+     * Maintain the repositories of the loaded conversations which are due. The others get no
+     * new commit until loaded.
+     */
+    void maintainConversations();
 };
 
 ConversationModule::Impl::Impl(std::weak_ptr<JamiAccount>&& account,
@@ -282,6 +487,8 @@ ConversationModule::Impl::Impl(std::weak_ptr<JamiAccount>&& account,
     , sendMsgCb_(sendMsgCb)
     , onNeedSocket_(onNeedSocket)
     , updateConvReqCb_(updateConvReqCb)
+    , convInfosJournal_(accountDataPath(account) + "convInfo")
+    , convRequestsJournal_(accountDataPath(account) + "convRequests")
 {
     if (auto shared = account.lock()) {
         accountId_ = shared->getAccountID();
@@ -291,6 +498,78 @@ ConversationModule::Impl::Impl(std::weak_ptr<JamiAccount>&& account,
                 username_ = info->accountId;
     }
     conversationsRequests_ = convRequests(accountId_);
+    syncScheduler_.onProgress([accountId = accountId_](auto done, auto total) {
+        emitSignal<DRing::ConversationSignal::ConversationSyncProgress>(accountId,
+                                                                        static_cast<int>(done),
+                                                                        static_cast<int>(total));
+    });
+}
+
+std::shared_ptr<Conversation>
+ConversationModule::Impl::getConversation(const std::string& convId)
+{
+    auto it = conversations_.find(convId);
+    if (it != conversations_.end()) {
+        if (it->second)
+            lastUse_[convId] = ++useCount_;
+        return it->second;
+    }
+    auto unloaded = unloadedConversations_.find(convId);
+    if (unloaded == unloadedConversations_.end())
+        return {};
+    unloadedConversations_.erase(unloaded);
+    auto conversation = loadConversation(convId);
+    if (conversation)
+        addConversation(convId, conversation);
+    return conversation;
+}
+
+std::shared_ptr<Conversation>
+ConversationModule::Impl::loadConversation(const std::string& convId)
+{
+    try {
+        auto conversation = std::make_shared<Conversation>(account_, convId);
+        conversation->onLastDisplayedUpdated(
+            [&](auto convId, auto lastId) { onLastDisplayedUpdated(convId, lastId); });
+        return conversation;
+    } catch (const std::logic_error& e) {
+        JAMI_WARN("[Account %s] Conversation %s not loaded: %s",
+                  accountId_.c_str(),
+                  convId.c_str(),
+                  e.what());
+    }
+    return {};
+}
+
+void
+ConversationModule::Impl::addConversation(const std::string& convId,
+                                          std::shared_ptr<Conversation> conversation)
+{
+    unloadedConversations_.erase(convId);
+    conversations_[convId] = std::move(conversation);
+    lastUse_[convId] = ++useCount_;
+    closeIdleConversations();
+}
+
+void
+ConversationModule::Impl::closeIdleConversations()
+{
+    if (conversations_.size() <= MAX_LOADED_CONVERSATIONS)
+        return;
+    // Not used elsewhere, nothing in progress. The removed ones are kept until erased.
+    std::vector<std::pair<uint64_t, std::string>> idle;
+    for (const auto& [convId, conversation] : conversations_)
+        if (conversation && conversation.use_count() == 1 && !conversation->isRemoving()
+            && conversation->isIdle())
+            idle.emplace_back(lastUse_[convId], convId);
+    std::sort(idle.begin(), idle.end());
+    auto toClose = std::min(idle.size(), conversations_.size() - MAX_LOADED_CONVERSATIONS);
+    for (std::size_t i = 0; i < toClose; ++i) {
+        const auto& convId = idle[i].second;
+        conversations_.erase(convId);
+        lastUse_.erase(convId);
+        unloadedConversations_.emplace(convId);
+    }
 }
 
 void
@@ -354,9 +633,8 @@ ConversationModule::Impl::cloneConversation(const std::string& deviceId,
         saveConvInfos();
     } else {
         std::unique_lock<std::mutex> lk(conversationsMtx_);
-        auto conversation = conversations_.find(convId);
-        if (conversation != conversations_.end() && conversation->second)
-            conversation->second->updateLastDisplayed(lastDisplayed);
+        if (auto conversation = getConversation(convId))
+            conversation->updateLastDisplayed(lastDisplayed);
         JAMI_INFO("[Account %s] Already have conversation %s", accountId_.c_str(), convId.c_str());
     }
 }
@@ -365,7 +643,8 @@ void
 ConversationModule::Impl::fetchNewCommits(const std::string& peer,
                                           const std::string& deviceId,
                                           const std::string& conversationId,
-                                          const std::string& commitId)
+                                          const std::string& commitId,
+                                          const std::string& origin)
 {
     JAMI_DBG("[Account %s] fetch commits for peer %s on device %s",
              accountId_.c_str(),
@@ -373,87 +652,153 @@ ConversationModule::Impl::fetchNewCommits(const std::string& peer,
              deviceId.c_str());
 
     std::unique_lock<std::mutex> lk(conversationsMtx_);
-    auto conversation = conversations_.find(conversationId);
-    if (conversation != conversations_.end() && conversation->second) {
-        if (!conversation->second->isMember(peer, true)) {
+    auto conversation = getConversation(conversationId);
+    if (conversation) {
+        if (!conversation->isMember(peer, true)) {
             JAMI_WARN("[Account %s] %s is not a member of %s",
                       accountId_.c_str(),
                       peer.c_str(),
                       conversationId.c_str());
             return;
         }
-        if (conversation->second->isBanned(deviceId)) {
+        if (conversation->isBanned(deviceId)) {
             JAMI_WARN("[Account %s] %s is a banned device in conversation %s",
                       accountId_.c_str(),
                       deviceId.c_str(),
                       conversationId.c_str());
             return;
         }
+        if (!commitId.empty() && conversation->getCommit(commitId)) {
+            // Already fetched, e.g. announced by another relay
+            JAMI_DBG("[Account %s] Commit %s already fetched",
+                     accountId_.c_str(),
+                     commitId.c_str());
+            return;
+        }
 
         // Retrieve current last message
-        auto lastMessageId = conversation->second->lastCommitId();
+        auto lastMessageId = conversation->lastCommitId();
         if (lastMessageId.empty()) {
             JAMI_ERR("[Account %s] No message detected. This is a bug", accountId_.c_str());
             return;
         }
 
-        if (!startFetch(conversationId, deviceId)) {
-            JAMI_WARN("[Account %s] Already fetching %s",
-                      accountId_.c_str(),
-                      conversationId.c_str());
+        // A commit announced by the peer is fetched first, then the most recent conversations
+        auto priority = std::numeric_limits<int64_t>::max();
+        if (commitId.empty()) {
+            priority = 0;
+            if (auto lastCommit = conversation->getCommit(lastMessageId)) {
+                auto timestamp = lastCommit->find("timestamp");
+                if (timestamp != lastCommit->end())
+                    priority = std::strtoll(timestamp->second.c_str(), nullptr, 10);
+            }
+        }
+
+        // Announced during a fetch from the device: fetched once it's done, if still missing,
+        // so that a burst of announcements is fetched at most twice
+        PendingCommit pending {peer, commitId, origin};
+        if (!startFetch(conversationId, deviceId, &pending)) {
+            JAMI_DBG("[Account %s] Already fetching %s",
+                     accountId_.c_str(),
+                     conversationId.c_str());
             return;
         }
+        // The fetch is accounted once in syncCnt: ended by its completion, or dropped.
+        // Once a channel is used, the socket callback is called again without one: the fetch
+        // ends with the sync, not there
+        auto ended = std::make_shared<std::atomic_bool>(false);
+        auto connected = std::make_shared<std::atomic_bool>(false);
         syncCnt.fetch_add(1);
-        onNeedSocket_(
-            conversationId,
+        syncScheduler_.schedule(
             deviceId,
-            [this,
-             conversationId = std::move(conversationId),
-             peer = std::move(peer),
-             deviceId = std::move(deviceId),
-             commitId = std::move(commitId)](const auto& channel) {
-                auto conversation = conversations_.find(conversationId);
-                auto acc = account_.lock();
-                if (!channel || !acc || conversation == conversations_.end()
-                    || !conversation->second) {
-                    std::lock_guard<std::mutex> lk(pendingConversationsFetchMtx_);
-                    stopFetch(conversationId, deviceId);
-                    syncCnt.fetch_sub(1);
-                    return false;
-                }
-                acc->addGitSocket(channel->deviceId(), conversationId, channel);
-                conversation->second->sync(
-                    peer,
+            priority,
+            [=](auto&& done) {
+                onNeedSocket_(
+                    conversationId,
                     deviceId,
                     [this,
-                     conversationId = std::move(conversationId),
-                     peer = std::move(peer),
-                     deviceId = std::move(deviceId),
-                     commitId = std::move(commitId)](bool ok) {
-                        if (!ok) {
-                            JAMI_WARN("[Account %s] Could not fetch new commit from "
-                                      "%s for %s, other "
-                                      "peer may be disconnected",
-                                      accountId_.c_str(),
-                                      deviceId.c_str(),
-                                      conversationId.c_str());
-                            JAMI_INFO("[Account %s] Relaunch sync with %s for %s",
-                                      accountId_.c_str(),
-                                      deviceId.c_str(),
-                                      conversationId.c_str());
-                        }
+                     conversationId,
+                     peer,
+                     deviceId,
+                     commitId,
+                     origin,
+                     ended,
+                     connected,
+                     done = std::move(done)](const auto& channel) {
+                        if (!channel && connected->load())
+                            return false;
+                        std::shared_ptr<Conversation> conversation;
                         {
-                            std::lock_guard<std::mutex> lk(pendingConversationsFetchMtx_);
-                            pendingConversationsFetch_.erase(conversationId);
+                            std::lock_guard<std::mutex> lk(conversationsMtx_);
+                            conversation = getConversation(conversationId);
                         }
-                        if (syncCnt.fetch_sub(1) == 1) {
-                            if (auto account = account_.lock())
-                                emitSignal<DRing::ConversationSignal::ConversationSyncFinished>(
-                                    account->getAccountID().c_str());
+                        auto acc = account_.lock();
+                        if (!channel || !acc || !conversation) {
+                            if (!ended->exchange(true)) {
+                                {
+                                    std::lock_guard<std::mutex> lk(pendingConversationsFetchMtx_);
+                                    stopFetch(conversationId, deviceId);
+                                }
+                                fetchEnded();
+                                done();
+                            }
+                            return false;
                         }
-                    },
-                    commitId);
-                return true;
+                        connected->store(true);
+                        acc->addGitSocket(channel->deviceId(), conversationId, channel);
+                        conversation->sync(
+                            peer,
+                            deviceId,
+                            [this, conversationId, peer, deviceId, commitId, origin, ended, done](
+                                bool ok) {
+                                // Dropped by clearPendingFetch()
+                                if (ended->exchange(true))
+                                    return;
+                                if (!ok) {
+                                    JAMI_WARN("[Account %s] Could not fetch new commit from "
+                                              "%s for %s, other "
+                                              "peer may be disconnected",
+                                              accountId_.c_str(),
+                                              deviceId.c_str(),
+                                              conversationId.c_str());
+                                    JAMI_INFO("[Account %s] Relaunch sync with %s for %s",
+                                              accountId_.c_str(),
+                                              deviceId.c_str(),
+                                              conversationId.c_str());
+                                }
+                                std::optional<PendingCommit> next;
+                                {
+                                    std::lock_guard<std::mutex> lk(pendingConversationsFetchMtx_);
+                                    pendingConversationsFetch_.erase(conversationId);
+                                    auto it = pendingCommits_.find({conversationId, deviceId});
+                                    if (it != pendingCommits_.end()) {
+                                        next = std::move(it->second);
+                                        pendingCommits_.erase(it);
+                                    }
+                                }
+                                done();
+                                if (ok && !origin.empty())
+                                    relayMessageNotification(conversationId, commitId, origin);
+                                if (next)
+                                    fetchNewCommits(next->peer,
+                                                    deviceId,
+                                                    conversationId,
+                                                    next->commitId,
+                                                    next->origin);
+                                fetchEnded();
+                            },
+                            commitId);
+                        return true;
+                    });
+            },
+            [this, conversationId, deviceId, ended] {
+                if (ended->exchange(true))
+                    return;
+                {
+                    std::lock_guard<std::mutex> lk(pendingConversationsFetchMtx_);
+                    stopFetch(conversationId, deviceId);
+                }
+                fetchEnded();
             });
     } else {
         if (getRequest(conversationId) != std::nullopt)
@@ -516,7 +861,10 @@ ConversationModule::Impl::handlePendingConversation(const std::string& conversat
         pendingConversationsFetch_.erase(conversationId);
     };
     try {
-        auto conversation = std::make_shared<Conversation>(account_, deviceId, conversationId);
+        auto conversation = std::make_shared<Conversation>(account_,
+                                                           deviceId,
+                                                           conversationId,
+                                                           JOIN_DEPTH);
         conversation->onLastDisplayedUpdated(
             std::move([&](auto convId, auto lastId) { onLastDisplayedUpdated(convId, lastId); }));
         if (!conversation->isMember(username_, true)) {
@@ -536,7 +884,7 @@ ConversationModule::Impl::handlePendingConversation(const std::string& conversat
             if (itConv != convInfos_.end() && !itConv->second.lastDisplayed.empty()) {
                 conversation->updateLastDisplayed(itConv->second.lastDisplayed);
             }
-            conversations_.emplace(conversationId, conversation);
+            addConversation(conversationId, conversation);
         }
         if (removeRepo) {
             removeRepository(conversationId, false, true);
@@ -642,12 +990,11 @@ ConversationModule::Impl::getOneToOneConversation(const std::string& uri) const
 }
 
 std::vector<std::map<std::string, std::string>>
-ConversationModule::Impl::getConversationMembers(const std::string& conversationId) const
+ConversationModule::Impl::getConversationMembers(const std::string& conversationId)
 {
     std::unique_lock<std::mutex> lk(conversationsMtx_);
-    auto conversation = conversations_.find(conversationId);
-    if (conversation != conversations_.end() && conversation->second)
-        return conversation->second->getMembers(true, true);
+    if (auto conversation = getConversation(conversationId))
+        return conversation->getMembers(true, true);
 
     lk.unlock();
     std::lock_guard<std::mutex> lkCI(convInfosMtx_);
@@ -663,17 +1010,32 @@ ConversationModule::Impl::getConversationMembers(const std::string& conversation
     return {};
 }
 
+std::vector<std::string>
+ConversationModule::Impl::getConversationMemberUris(const std::string& conversationId)
+{
+    std::unique_lock<std::mutex> lk(conversationsMtx_);
+    if (auto conversation = getConversation(conversationId))
+        return conversation->memberUris("", {MemberRole::BANNED});
+
+    lk.unlock();
+    std::lock_guard<std::mutex> lkCI(convInfosMtx_);
+    auto convIt = convInfos_.find(conversationId);
+    if (convIt != convInfos_.end())
+        return convIt->second.members;
+    return {};
+}
+
 void
 ConversationModule::Impl::removeRepository(const std::string& conversationId, bool sync, bool force)
 {
     std::unique_lock<std::mutex> lk(conversationsMtx_);
-    auto it = conversations_.find(conversationId);
-    if (it != conversations_.end() && it->second && (force || it->second->isRemoving())) {
+    auto conversation = getConversation(conversationId);
+    if (conversation && (force || conversation->isRemoving())) {
         JAMI_DBG() << "Remove conversation: " << conversationId;
         try {
-            if (it->second->mode() == ConversationMode::ONE_TO_ONE) {
+            if (conversation->mode() == ConversationMode::ONE_TO_ONE) {
                 auto account = account_.lock();
-                for (const auto& member : it->second->getInitialMembers()) {
+                for (const auto& member : conversation->getInitialMembers()) {
                     if (member != account->getUsername()) {
                         // Note: this can happen while re-adding a contact.
                         // In this case, check that we are removing the linked conversation.
@@ -686,8 +1048,9 @@ ConversationModule::Impl::removeRepository(const std::string& conversationId, bo
         } catch (const std::exception& e) {
             JAMI_ERR() << e.what();
         }
-        it->second->erase();
-        conversations_.erase(it);
+        conversation->erase();
+        conversations_.erase(conversationId);
+        lastUse_.erase(conversationId);
         lk.unlock();
 
         if (!sync)
@@ -705,7 +1068,7 @@ ConversationModule::Impl::removeRepository(const std::string& conversationId, bo
 bool
 ConversationModule::Impl::removeConversation(const std::string& conversationId)
 {
-    auto members = getConversationMembers(conversationId);
+    auto members = getConversationMemberUris(conversationId);
     std::unique_lock<std::mutex> lk(conversationsMtx_);
     // Update convInfos
     std::unique_lock<std::mutex> lockCi(convInfosMtx_);
@@ -714,9 +1077,9 @@ ConversationModule::Impl::removeConversation(const std::string& conversationId)
         JAMI_ERR("Conversation %s doesn't exist", conversationId.c_str());
         return false;
     }
-    auto it = conversations_.find(conversationId);
-    auto isSyncing = it == conversations_.end();
-    auto hasMembers = !isSyncing && !(members.size() == 1 && username_ == members[0]["uri"]);
+    auto conversation = getConversation(conversationId);
+    auto isSyncing = !conversation;
+    auto hasMembers = !isSyncing && !(members.size() == 1 && username_ == members[0]);
     itConv->second.removed = std::time(nullptr);
     if (isSyncing)
         itConv->second.erased = std::time(nullptr);
@@ -728,17 +1091,17 @@ ConversationModule::Impl::removeConversation(const std::string& conversationId)
     emitSignal<DRing::ConversationSignal::ConversationRemoved>(accountId_, conversationId);
     if (isSyncing)
         return true;
-    if (it->second->mode() != ConversationMode::ONE_TO_ONE) {
+    if (conversation->mode() != ConversationMode::ONE_TO_ONE) {
         // For one to one, we do not notify the leave. The other can still generate request
         // and this is managed by the banned part. If we re-accept, the old conversation will be
         // retrieven
-        auto commitId = it->second->leave();
+        auto commitId = conversation->leave();
         if (hasMembers) {
             JAMI_DBG() << "Wait that someone sync that user left conversation " << conversationId;
             // Commit that we left
             if (!commitId.empty()) {
                 // Do not sync as it's synched by convInfos
-                sendMessageNotification(*it->second, commitId, false);
+                sendMessageNotification(*conversation, commitId, false);
             } else {
                 JAMI_ERR("Failed to send message to conversation %s", conversationId.c_str());
             }
@@ -764,26 +1127,172 @@ ConversationModule::Impl::sendMessageNotification(const std::string& conversatio
                                                   const std::string& commitId,
                                                   bool sync)
 {
+    {
+        // A burst of commits, e.g. pasted lines, is announced twice: the first and the last
+        std::lock_guard<std::mutex> lk(announcementsMtx_);
+        auto& announcement = announcements_[conversationId];
+        auto now = std::chrono::steady_clock::now();
+        if (!announcement.commitId.empty()) {
+            announcement.commitId = commitId;
+            announcement.sync |= sync;
+            return;
+        }
+        if (now - announcement.last < ANNOUNCE_WINDOW) {
+            announcement.commitId = commitId;
+            announcement.sync = sync;
+            Manager::instance().scheduler().scheduleIn(
+                [w = weak(), conversationId] {
+                    if (auto sthis = w.lock())
+                        sthis->flushMessageNotification(conversationId);
+                },
+                announcement.last + ANNOUNCE_WINDOW - now);
+            return;
+        }
+        announcement.last = now;
+    }
     std::lock_guard<std::mutex> lk(conversationsMtx_);
-    auto it = conversations_.find(conversationId);
-    if (it != conversations_.end() && it->second) {
-        sendMessageNotification(*it->second, commitId, sync);
+    if (auto conversation = getConversation(conversationId))
+        sendMessageNotification(*conversation, commitId, sync);
+}
+
+void
+ConversationModule::Impl::flushMessageNotification(const std::string& conversationId)
+{
+    std::string commitId;
+    bool sync;
+    {
+        std::lock_guard<std::mutex> lk(announcementsMtx_);
+        auto it = announcements_.find(conversationId);
+        if (it == announcements_.end() || it->second.commitId.empty())
+            return;
+        commitId = std::move(it->second.commitId);
+        it->second.commitId.clear();
+        sync = it->second.sync;
+        it->second.last = std::chrono::steady_clock::now();
     }
+    std::lock_guard<std::mutex> lk(conversationsMtx_);
+    if (auto conversation = getConversation(conversationId))
+        sendMessageNotification(*conversation, commitId, sync);
 }
 
 void
 ConversationModule::Impl::sendMessageNotification(const Conversation& conversation,
                                                   const std::string& commitId,
                                                   bool sync)
+{
+    auto members = conversation.memberUris();
+    if (members.size() <= ANNOUNCE_MESH_MAX) {
+        // Announce to all members that a new message is sent
+        notifyMembers(conversation.id(),
+                      commitId,
+                      {},
+                      conversation.memberUris(sync ? "" : username_));
+        return;
+    }
+    // The members notified fetch the commit, then announce it in turn
+    auto targets = announceTargets(members, commitId, username_, username_);
+    if (sync)
+        targets.emplace_back(username_);
+    notifyMembers(conversation.id(), commitId, username_, targets);
+}
+
+void
+ConversationModule::Impl::backfillConversation(const std::string& conversationId,
+                                               const std::string& deviceId,
+                                               OnPullCb&& cb)
+{
+    onNeedSocket_(conversationId,
+                  deviceId,
+                  [this, conversationId, cb = std::move(cb)](const auto& channel) {
+                      std::shared_ptr<Conversation> conversation;
+                      {
+                          std::lock_guard<std::mutex> lk(conversationsMtx_);
+                          conversation = getConversation(conversationId);
+                      }
+                      auto acc = account_.lock();
+                      if (!channel || !acc || !conversation) {
+                          cb(false);
+                          return false;
+                      }
+                      acc->addGitSocket(channel->deviceId(), conversationId, channel);
+                      conversation->backfill(channel->deviceId(), OnPullCb(cb));
+                      return true;
+                  });
+}
+
+void
+ConversationModule::Impl::maintainConversations()
+{
+    using clock = ConversationMaintenance::clock;
+    std::vector<std::string> loaded;
+    {
+        std::lock_guard<std::mutex> lk(conversationsMtx_);
+        loaded.reserve(conversations_.size());
+        for (const auto& [id, conversation] : conversations_)
+            if (conversation)
+                loaded.emplace_back(id);
+    }
+    for (const auto& id : maintenance_.pass(loaded, clock::now())) {
+        // Not idle anymore
+        if (syncCnt.load() != 0)
+            break;
+        std::shared_ptr<Conversation> conversation;
+        {
+            std::lock_guard<std::mutex> lk(conversationsMtx_);
+            auto it = conversations_.find(id);
+            if (it != conversations_.end())
+                conversation = it->second;
+        }
+        auto start = clock::now();
+        // Retried by the next pass if fetching
+        if (!conversation or !conversation->maintain())
+            continue;
+        auto end = clock::now();
+        if (!maintenance_.done(id, end - start, end))
+            break;
+    }
+    maintaining_ = false;
+}
+
+void
+ConversationModule::Impl::relayMessageNotification(const std::string& conversationId,
+                                                   const std::string& commitId,
+                                                   const std::string& origin)
+{
+    // Announced by another of our devices, which notified the tree itself
+    if (origin == username_)
+        return;
+    std::lock_guard<std::mutex> lk(conversationsMtx_);
+    auto conversation = getConversation(conversationId);
+    if (!conversation)
+        return;
+    auto targets = announceTargets(conversation->memberUris(), commitId, origin, username_);
+    if (targets.empty())
+        return;
+    JAMI_DBG("[Account %s] Relay commit %s of %s to %zu members",
+             accountId_.c_str(),
+             commitId.c_str(),
+             origin.c_str(),
+             targets.size());
+    notifyMembers(conversationId, commitId, origin, targets);
+}
+
+void
+ConversationModule::Impl::notifyMembers(const std::string& conversationId,
+                                        const std::string& commitId,
+                                        const std::string& origin,
+                                        const std::vector<std::string>& members)
 {
     Json::Value message;
-    message["id"] = conversation.id();
+    message["id"] = conversationId;
     message["commit"] = commitId;
+    // The commit is fetched from the device announcing it
     message["deviceId"] = deviceId_;
+    if (!origin.empty())
+        message["origin"] = origin;
     Json::StreamWriterBuilder builder;
     const auto text = Json::writeString(builder, message);
-    for (const auto& member : conversation.memberUris(sync ? "" : username_)) {
-        // Announce to all members that a new message is sent
+    for (const auto& member : members) {
         refreshMessage[member] = sendMsgCb_(member,
                                             std::map<std::string, std::string> {
                                                 {"application/im-gitmessage-id", text}},
@@ -813,9 +1322,8 @@ ConversationModule::Impl::sendMessage(const std::string& conversationId,
                                       OnDoneCb&& cb)
 {
     std::lock_guard<std::mutex> lk(conversationsMtx_);
-    auto conversation = conversations_.find(conversationId);
-    if (conversation != conversations_.end() && conversation->second) {
-        conversation->second->sendMessage(
+    if (auto conversation = getConversation(conversationId)) {
+        conversation->sendMessage(
             std::move(value),
             replyTo,
             [this, conversationId, announce, cb = std::move(cb)](bool ok,
@@ -847,11 +1355,8 @@ void
 ConversationModule::saveConvRequestsToPath(
     const std::string& path, const std::map<std::string, ConversationRequest>& conversationsRequests)
 {
-    std::lock_guard<std::mutex> lock(
-        fileutils::getFileLock(path + DIR_SEPARATOR_STR + "convRequests"));
-    std::ofstream file(path + DIR_SEPARATOR_STR + "convRequests",
-                       std::ios::trunc | std::ios::binary);
-    msgpack::pack(file, conversationsRequests);
+    MapJournal<ConversationRequest>::write(path + DIR_SEPARATOR_STR + "convRequests",
+                                           conversationsRequests);
 }
 
 void
@@ -864,8 +1369,7 @@ ConversationModule::saveConvInfos(const std::string& accountId, const ConvInfoMa
 void
 ConversationModule::saveConvInfosToPath(const std::string& path, const ConvInfoMap& conversations)
 {
-    std::ofstream file(path + DIR_SEPARATOR_STR + "convInfo", std::ios::trunc | std::ios::binary);
-    msgpack::pack(file, conversations);
+    MapJournal<ConvInfo>::write(path + DIR_SEPARATOR_STR + "convInfo", conversations);
 }
 
 ////////////////////////////////////////////////////////////////
@@ -882,6 +1386,20 @@ ConversationModule::ConversationModule(std::weak_ptr<JamiAccount>&& account,
                                      std::move(updateConvReqCb))}
 {
     loadConversations();
+    pimpl_->maintenanceTask_ = Manager::instance().scheduler().scheduleAtFixedRate(
+        [w = pimpl_->weak()] {
+            auto sthis = w.lock();
+            if (!sthis)
+                return false;
+            if (sthis->syncCnt.load() == 0 and not sthis->maintaining_.exchange(true)) {
+                dht::ThreadPool::io().run([w] {
+                    if (auto sthis = w.lock())
+                        sthis->maintainConversations();
+                });
+            }
+            return true;
+        },
+        MAINTENANCE_PERIOD);
 }
 
 void
@@ -897,27 +1415,28 @@ ConversationModule::loadConversations()
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
     pimpl_->convInfos_ = convInfos(pimpl_->accountId_);
     pimpl_->conversations_.clear();
+    pimpl_->unloadedConversations_.clear();
+    pimpl_->lastUse_.clear();
     for (const auto& repository : conversationsRepositories) {
-        try {
-            auto conv = std::make_shared<Conversation>(pimpl_->account_, repository);
-            conv->onLastDisplayedUpdated(std::move(
-                [&](auto convId, auto lastId) { pimpl_->onLastDisplayedUpdated(convId, lastId); }));
-            auto convInfo = pimpl_->convInfos_.find(repository);
-            if (convInfo == pimpl_->convInfos_.end()) {
-                JAMI_ERR() << "Missing conv info for " << repository << ". This is a bug!";
-                ConvInfo info;
-                info.id = repository;
-                info.created = std::time(nullptr);
-                info.members = conv->memberUris();
-                info.lastDisplayed = conv->infos()[ConversationMapKeys::LAST_DISPLAYED];
-                addConvInfo(info);
-            }
-            pimpl_->conversations_.emplace(repository, std::move(conv));
-        } catch (const std::logic_error& e) {
-            JAMI_WARN("[Account %s] Conversations not loaded : %s",
-                      pimpl_->accountId_.c_str(),
-                      e.what());
+        auto convInfo = pimpl_->convInfos_.find(repository);
+        if (convInfo != pimpl_->convInfos_.end() && !convInfo->second.removed) {
+            // The members are in the conv info, the repository is opened on first use
+            pimpl_->unloadedConversations_.emplace(repository);
+            continue;
         }
+        auto conv = pimpl_->loadConversation(repository);
+        if (!conv)
+            continue;
+        if (convInfo == pimpl_->convInfos_.end()) {
+            JAMI_ERR() << "Missing conv info for " << repository << ". This is a bug!";
+            ConvInfo info;
+            info.id = repository;
+            info.created = std::time(nullptr);
+            info.members = conv->memberUris();
+            info.lastDisplayed = conv->infos()[ConversationMapKeys::LAST_DISPLAYED];
+            addConvInfo(info);
+        }
+        pimpl_->conversations_.emplace(repository, std::move(conv));
     }
 
     // Prune any invalid conversations without members and
@@ -962,6 +1481,8 @@ ConversationModule::clearPendingFetch()
         JAMI_ERR("This is a bug, seems to still fetch to some device on initializing");
         pimpl_->pendingConversationsFetch_.clear();
     }
+    // Same for the fetches waiting for them, which are ended as dropped
+    pimpl_->syncScheduler_.clear();
 }
 
 std::vector<std::string>
@@ -1011,15 +1532,11 @@ ConversationModule::onTrustRequest(const std::string& uri,
                   "clone the old one");
         return;
     }
-    {
-        std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-        auto itConv = pimpl_->conversations_.find(conversationId);
-        if (itConv != pimpl_->conversations_.end()) {
-            JAMI_INFO("[Account %s] Received a request for a conversation "
-                      "already handled. Ignore",
-                      pimpl_->accountId_.c_str());
-            return;
-        }
+    if (pimpl_->isConversation(conversationId)) {
+        JAMI_INFO("[Account %s] Received a request for a conversation "
+                  "already handled. Ignore",
+                  pimpl_->accountId_.c_str());
+        return;
     }
     if (pimpl_->getRequest(conversationId) != std::nullopt) {
         JAMI_INFO("[Account %s] Received a request for a conversation "
@@ -1036,8 +1553,8 @@ ConversationModule::onTrustRequest(const std::string& uri,
     req.from = uri;
     req.conversationId = conversationId;
     req.received = std::time(nullptr);
-    req.metadatas = ConversationRepository::infosFromVCard(vCard::utils::toMap(
-        std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size())));
+    req.metadatas = ConversationRepository::infosFromVCard(
+        std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size()));
     auto reqMap = req.toMap();
     pimpl_->addConversationRequest(conversationId, std::move(req));
     emitSignal<DRing::ConversationSignal::ConversationRequestReceived>(pimpl_->accountId_,
@@ -1079,9 +1596,9 @@ ConversationModule::onNeedConversationRequest(const std::string& from,
 {
     // Check if the conversation exists
     std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto itConv = pimpl_->conversations_.find(conversationId);
-    if (itConv != pimpl_->conversations_.end() && !itConv->second->isRemoving()) {
-        if (!itConv->second->isMember(from, true)) {
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (conversation && !conversation->isRemoving()) {
+        if (!conversation->isMember(from, true)) {
             JAMI_WARN("%s is asking a new invite for %s, but not a member",
                       from.c_str(),
                       conversationId.c_str());
@@ -1089,7 +1606,7 @@ ConversationModule::onNeedConversationRequest(const std::string& from,
         }
 
         // Send new invite
-        auto invite = itConv->second->generateInvitation();
+        auto invite = conversation->generateInvitation();
         lk.unlock();
         JAMI_DBG("%s is asking a new invite for %s", from.c_str(), conversationId.c_str());
         pimpl_->sendMsgCb_(from, std::move(invite), 0);
@@ -1145,7 +1662,7 @@ ConversationModule::startConversation(ConversationMode mode, const std::string&
     auto convId = conversation->id();
     {
         std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-        pimpl_->conversations_[convId] = std::move(conversation);
+        pimpl_->addConversation(convId, std::move(conversation));
     }
 
     // Update convInfo
@@ -1261,12 +1778,72 @@ ConversationModule::onMessageDisplayed(const std::string& peer,
                                        const std::string& interactionId)
 {
     std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto conversation = pimpl_->conversations_.find(conversationId);
-    if (conversation != pimpl_->conversations_.end() && conversation->second)
-        return conversation->second->setMessageDisplayed(peer, interactionId);
+    if (auto conversation = pimpl_->getConversation(conversationId))
+        return conversation->setMessageDisplayed(peer, interactionId);
     return false;
 }
 
+template<typename Messages>
+static void
+loadFrom(Conversation& conversation,
+         const std::function<void(Messages&&)>& cb,
+         const std::string& fromMessage,
+         size_t n)
+{
+    if constexpr (std::is_same_v<Messages, DRing::PackedMessages>)
+        conversation.loadPackedMessages(cb, fromMessage, n);
+    else
+        conversation.loadMessages(cb, fromMessage, n);
+}
+
+template<typename Messages>
+void
+ConversationModule::Impl::loadMessages(const std::shared_ptr<Conversation>& conversation,
+                                       const std::string& conversationId,
+                                       const std::string& fromMessage,
+                                       size_t n,
+                                       std::function<void(Messages&&)>&& emitLoaded)
+{
+    loadFrom<Messages>(
+        *conversation,
+        [w = weak(),
+         conversation = std::weak_ptr<Conversation>(conversation),
+         conversationId,
+         fromMessage,
+         n,
+         emitLoaded = std::move(emitLoaded)](Messages&& messages) {
+            // Scrolled to the oldest commit of a shallow clone: the older ones are
+            // fetched first
+            auto sthis = w.lock();
+            auto conv = conversation.lock();
+            auto origin = conv ? conv->shallowOrigin() : std::string {};
+            if (!sthis || origin.empty() || n == 0 || messages.size() >= n) {
+                emitLoaded(std::move(messages));
+                return;
+            }
+            sthis->backfillConversation(
+                conversationId,
+                origin,
+                [w, conversationId, fromMessage, n, emitLoaded, messages](bool ok) mutable {
+                    auto sthis = w.lock();
+                    std::shared_ptr<Conversation> conversation;
+                    if (ok && sthis) {
+                        std::lock_guard<std::mutex> lk(sthis->conversationsMtx_);
+                        conversation = sthis->getConversation(conversationId);
+                    }
+                    if (!conversation) {
+                        JAMI_WARN("Could not fetch the older commits of %s",
+                                  conversationId.c_str());
+                        emitLoaded(std::move(messages));
+                        return;
+                    }
+                    loadFrom<Messages>(*conversation, emitLoaded, fromMessage, n);
+                });
+        },
+        fromMessage,
+        n);
+}
+
 uint32_t
 ConversationModule::loadConversationMessages(const std::string& conversationId,
                                              const std::string& fromMessage,
@@ -1274,18 +1851,44 @@ ConversationModule::loadConversationMessages(const std::string& conversationId,
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
     auto acc = pimpl_->account_.lock();
-    auto conversation = pimpl_->conversations_.find(conversationId);
-    if (acc && conversation != pimpl_->conversations_.end() && conversation->second) {
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (acc && conversation) {
         const uint32_t id = std::uniform_int_distribution<uint32_t> {}(acc->rand);
-        conversation->second->loadMessages(
+        pimpl_->loadMessages<std::vector<std::map<std::string, std::string>>>(
+            conversation,
+            conversationId,
+            fromMessage,
+            n,
             [accountId = pimpl_->accountId_, conversationId, id](auto&& messages) {
                 emitSignal<DRing::ConversationSignal::ConversationLoaded>(id,
                                                                           accountId,
                                                                           conversationId,
                                                                           messages);
-            },
+            });
+        return id;
+    }
+    return 0;
+}
+
+uint32_t
+ConversationModule::loadConversationMessagesPacked(const std::string& conversationId,
+                                                   const std::string& fromMessage,
+                                                   size_t n)
+{
+    std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
+    auto acc = pimpl_->account_.lock();
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (acc && conversation) {
+        const uint32_t id = std::uniform_int_distribution<uint32_t> {}(acc->rand);
+        pimpl_->loadMessages<DRing::PackedMessages>(
+            conversation,
+            conversationId,
             fromMessage,
-            n);
+            n,
+            [accountId = pimpl_->accountId_, conversationId, id](auto&& messages) {
+                emitSignal<DRing::ConversationSignal::ConversationLoadedPacked>(
+                    id, accountId, conversationId, std::move(messages));
+            });
         return id;
     }
     return 0;
@@ -1298,10 +1901,10 @@ ConversationModule::loadConversationUntil(const std::string& conversationId,
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
     auto acc = pimpl_->account_.lock();
-    auto conversation = pimpl_->conversations_.find(conversationId);
-    if (acc && conversation != pimpl_->conversations_.end() && conversation->second) {
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (acc && conversation) {
         const uint32_t id = std::uniform_int_distribution<uint32_t> {}(acc->rand);
-        conversation->second->loadMessages(
+        conversation->loadMessages(
             [accountId = pimpl_->accountId_, conversationId, id](auto&& messages) {
                 emitSignal<DRing::ConversationSignal::ConversationLoaded>(id,
                                                                           accountId,
@@ -1319,9 +1922,8 @@ std::shared_ptr<TransferManager>
 ConversationModule::dataTransfer(const std::string& id) const
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto conversation = pimpl_->conversations_.find(id);
-    if (conversation != pimpl_->conversations_.end() && conversation->second)
-        return conversation->second->dataTransfer();
+    if (auto conversation = pimpl_->getConversation(id))
+        return conversation->dataTransfer();
     return {};
 }
 
@@ -1332,9 +1934,8 @@ ConversationModule::onFileChannelRequest(const std::string& conversationId,
                                          bool verifyShaSum) const
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto conversation = pimpl_->conversations_.find(conversationId);
-    if (conversation != pimpl_->conversations_.end() && conversation->second)
-        return conversation->second->onFileChannelRequest(member, fileId, verifyShaSum);
+    if (auto conversation = pimpl_->getConversation(conversationId))
+        return conversation->onFileChannelRequest(member, fileId, verifyShaSum);
     return false;
 }
 
@@ -1347,11 +1948,11 @@ ConversationModule::downloadFile(const std::string& conversationId,
                                  size_t end)
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto conversation = pimpl_->conversations_.find(conversationId);
-    if (conversation == pimpl_->conversations_.end() || !conversation->second)
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (!conversation)
         return false;
 
-    return conversation->second->downloadFile(interactionId, fileId, path, "", "", start, end);
+    return conversation->downloadFile(interactionId, fileId, path, "", "", start, end);
 }
 
 void
@@ -1371,8 +1972,11 @@ ConversationModule::syncConversations(const std::string& peer, const std::string
             } else if (!ci.removed
                        && std::find(ci.members.begin(), ci.members.end(), peer)
                               != ci.members.end()) {
-                // In this case the conversation was never cloned (can be after an import)
-                toClone.emplace(key);
+                if (pimpl_->unloadedConversations_.count(key))
+                    toFetch.emplace(key); // Loaded by the fetch
+                else
+                    // In this case the conversation was never cloned (can be after an import)
+                    toClone.emplace(key);
             }
         }
     }
@@ -1387,6 +1991,19 @@ ConversationModule::syncConversations(const std::string& peer, const std::string
     }
 }
 
+void
+ConversationModule::onSyncFinished(std::function<void()>&& cb)
+{
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->syncFinishedMtx_);
+        if (pimpl_->syncCnt.load() != 0) {
+            pimpl_->onSyncFinished_.emplace_back(std::move(cb));
+            return;
+        }
+    }
+    cb();
+}
+
 void
 ConversationModule::onSyncData(const SyncMsg& msg,
                                const std::string& peerId,
@@ -1411,11 +2028,11 @@ ConversationModule::onSyncData(const SyncMsg& msg,
         } else {
             {
                 std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-                auto itConv = pimpl_->conversations_.find(convId);
-                if (itConv != pimpl_->conversations_.end() && !itConv->second->isRemoving()) {
+                auto conversation = pimpl_->getConversation(convId);
+                if (conversation && !conversation->isRemoving()) {
                     emitSignal<DRing::ConversationSignal::ConversationRemoved>(pimpl_->accountId_,
                                                                                convId);
-                    itConv->second->setRemovingFlag();
+                    conversation->setRemovingFlag();
                 }
             }
             std::unique_lock<std::mutex> lk(pimpl_->convInfosMtx_);
@@ -1482,7 +2099,10 @@ ConversationModule::needsSyncingWith(const std::string& memberUri, const std::st
                    && std::find(ci.members.begin(), ci.members.end(), memberUri)
                           != ci.members.end()) {
             // In this case the conversation was never cloned (can be after an import)
-            return true;
+            if (!pimpl_->unloadedConversations_.count(key))
+                return true;
+            if (Conversation::needsFetch(pimpl_->accountId_, key, deviceId))
+                return true;
         }
     }
     return false;
@@ -1496,10 +2116,9 @@ ConversationModule::setFetched(const std::string& conversationId,
     auto remove = false;
     {
         std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
-        auto it = pimpl_->conversations_.find(conversationId);
-        if (it != pimpl_->conversations_.end() && it->second) {
-            remove = it->second->isRemoving();
-            it->second->hasFetched(deviceId, commitId);
+        if (auto conversation = pimpl_->getConversation(conversationId)) {
+            remove = conversation->isRemoving();
+            conversation->hasFetched(deviceId, commitId);
         }
     }
     if (remove)
@@ -1510,7 +2129,8 @@ void
 ConversationModule::onNewCommit(const std::string& peer,
                                 const std::string& deviceId,
                                 const std::string& conversationId,
-                                const std::string& commitId)
+                                const std::string& commitId,
+                                const std::string& origin)
 {
     std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
     auto itConv = pimpl_->convInfos_.find(conversationId);
@@ -1533,7 +2153,7 @@ ConversationModule::onNewCommit(const std::string& peer,
              conversationId.c_str(),
              commitId.c_str());
     lk.unlock();
-    pimpl_->fetchNewCommits(peer, deviceId, conversationId, commitId);
+    pimpl_->fetchNewCommits(peer, deviceId, conversationId, commitId, origin);
 }
 
 void
@@ -1543,37 +2163,37 @@ ConversationModule::addConversationMember(const std::string& conversationId,
 {
     std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
     // Add a new member in the conversation
-    auto it = pimpl_->conversations_.find(conversationId);
-    if (it == pimpl_->conversations_.end()) {
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (!conversation) {
         JAMI_ERR("Conversation %s doesn't exist", conversationId.c_str());
         return;
     }
 
-    if (it->second->isMember(contactUri, true)) {
+    if (conversation->isMember(contactUri, true)) {
         JAMI_DBG("%s is already a member of %s, resend invite",
                  contactUri.c_str(),
                  conversationId.c_str());
         // Note: This should not be necessary, but if for whatever reason the other side didn't join
         // we should not forbid new invites
-        auto invite = it->second->generateInvitation();
+        auto invite = conversation->generateInvitation();
         lk.unlock();
         pimpl_->sendMsgCb_(contactUri, std::move(invite), 0);
         return;
     }
 
-    it->second
+    conversation
         ->addMember(contactUri,
                     [this, conversationId, sendRequest, contactUri](bool ok,
                                                                     const std::string& commitId) {
                         if (ok) {
                             std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
-                            auto it = pimpl_->conversations_.find(conversationId);
-                            if (it != pimpl_->conversations_.end() && it->second) {
-                                pimpl_->sendMessageNotification(*it->second,
+                            auto conversation = pimpl_->getConversation(conversationId);
+                            if (conversation) {
+                                pimpl_->sendMessageNotification(*conversation,
                                                                 commitId,
                                                                 true); // For the other members
                                 if (sendRequest) {
-                                    auto invite = it->second->generateInvitation();
+                                    auto invite = conversation->generateInvitation();
                                     lk.unlock();
                                     pimpl_->sendMsgCb_(contactUri, std::move(invite), 0);
                                 }
@@ -1588,9 +2208,8 @@ ConversationModule::removeConversationMember(const std::string& conversationId,
                                              bool isDevice)
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto it = pimpl_->conversations_.find(conversationId);
-    if (it != pimpl_->conversations_.end() && it->second) {
-        it->second->removeMember(contactUri,
+    if (auto conversation = pimpl_->getConversation(conversationId)) {
+        conversation->removeMember(contactUri,
                                  isDevice,
                                  [this, conversationId](bool ok, const std::string& commitId) {
                                      if (ok) {
@@ -1608,6 +2227,12 @@ ConversationModule::getConversationMembers(const std::string& conversationId) co
     return pimpl_->getConversationMembers(conversationId);
 }
 
+std::vector<std::string>
+ConversationModule::getConversationMemberUris(const std::string& conversationId) const
+{
+    return pimpl_->getConversationMemberUris(conversationId);
+}
+
 uint32_t
 ConversationModule::countInteractions(const std::string& convId,
                                       const std::string& toId,
@@ -1615,9 +2240,8 @@ ConversationModule::countInteractions(const std::string& convId,
                                       const std::string& authorUri) const
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto conversation = pimpl_->conversations_.find(convId);
-    if (conversation != pimpl_->conversations_.end() && conversation->second) {
-        return conversation->second->countInteractions(toId, fromId, authorUri);
+    if (auto conversation = pimpl_->getConversation(convId)) {
+        return conversation->countInteractions(toId, fromId, authorUri);
     }
     return 0;
 }
@@ -1626,9 +2250,18 @@ void
 ConversationModule::search(uint32_t req, const std::string& convId, const Filter& filter) const
 {
     std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto finishedFlag = std::make_shared<std::atomic_int>(pimpl_->conversations_.size());
-    for (const auto& [cid, conversation] : pimpl_->conversations_) {
-        if (!conversation || (!convId.empty() && convId != cid)) {
+    // Loading a conversation may close others, iterate on the ids
+    std::vector<std::string> convIds;
+    for (const auto& [cid, conversation] : pimpl_->conversations_)
+        convIds.emplace_back(cid);
+    convIds.insert(convIds.end(),
+                   pimpl_->unloadedConversations_.begin(),
+                   pimpl_->unloadedConversations_.end());
+    auto finishedFlag = std::make_shared<std::atomic_int>(convIds.size());
+    for (const auto& cid : convIds) {
+        auto conversation = convId.empty() || convId == cid ? pimpl_->getConversation(cid)
+                                                            : nullptr;
+        if (!conversation) {
             if ((*finishedFlag)-- == 1) {
                 emitSignal<DRing::ConversationSignal::MessagesFound>(
                     req,
@@ -1649,13 +2282,13 @@ ConversationModule::updateConversationInfos(const std::string& conversationId,
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
     // Add a new member in the conversation
-    auto it = pimpl_->conversations_.find(conversationId);
-    if (it == pimpl_->conversations_.end()) {
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (!conversation) {
         JAMI_ERR("Conversation %s doesn't exist", conversationId.c_str());
         return;
     }
 
-    it->second->updateInfos(infos,
+    conversation->updateInfos(infos,
                             [this, conversationId, sync](bool ok, const std::string& commitId) {
                                 if (ok && sync) {
                                     pimpl_->sendMessageNotification(conversationId, commitId, true);
@@ -1675,8 +2308,8 @@ ConversationModule::conversationInfos(const std::string& conversationId) const
     }
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
     // Add a new member in the conversation
-    auto it = pimpl_->conversations_.find(conversationId);
-    if (it == pimpl_->conversations_.end() or not it->second) {
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (not conversation) {
         std::lock_guard<std::mutex> lkCi(pimpl_->convInfosMtx_);
         auto itConv = pimpl_->convInfos_.find(conversationId);
         if (itConv == pimpl_->convInfos_.end()) {
@@ -1686,7 +2319,20 @@ ConversationModule::conversationInfos(const std::string& conversationId) const
         return {{"syncing", "true"}};
     }
 
-    return it->second->infos();
+    return conversation->infos();
+}
+
+std::map<std::string, std::string>
+ConversationModule::packState(const std::string& conversationId) const
+{
+    std::shared_ptr<Conversation> conversation;
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
+        conversation = pimpl_->getConversation(conversationId);
+    }
+    if (!conversation)
+        return {};
+    return conversation->packState().map();
 }
 
 std::vector<uint8_t>
@@ -1694,22 +2340,21 @@ ConversationModule::conversationVCard(const std::string& conversationId) const
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
     // Add a new member in the conversation
-    auto it = pimpl_->conversations_.find(conversationId);
-    if (it == pimpl_->conversations_.end() || !it->second) {
+    auto conversation = pimpl_->getConversation(conversationId);
+    if (!conversation) {
         JAMI_ERR("Conversation %s doesn't exist", conversationId.c_str());
         return {};
     }
 
-    return it->second->vCard();
+    return conversation->vCard();
 }
 
 bool
 ConversationModule::isBannedDevice(const std::string& convId, const std::string& deviceId) const
 {
     std::unique_lock<std::mutex> lk(pimpl_->conversationsMtx_);
-    auto conversation = pimpl_->conversations_.find(convId);
-    return conversation == pimpl_->conversations_.end() || !conversation->second
-           || conversation->second->isBanned(deviceId);
+    auto conversation = pimpl_->getConversation(convId);
+    return !conversation || conversation->isBanned(deviceId);
 }
 
 void
@@ -1748,13 +2393,23 @@ ConversationModule::removeContact(const std::string& uri, bool banned)
         std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
         std::lock_guard<std::mutex> lkCi(pimpl_->convInfosMtx_);
         for (auto& [convId, conv] : pimpl_->convInfos_) {
+            auto isMember = std::find(conv.members.begin(), conv.members.end(), uri)
+                            != conv.members.end();
+            // Only load the conversations that can be the one to one with uri
+            std::shared_ptr<Conversation> conversation;
             auto itConv = pimpl_->conversations_.find(convId);
-            if (itConv != pimpl_->conversations_.end() && itConv->second) {
+            if (itConv != pimpl_->conversations_.end())
+                conversation = itConv->second;
+            else if (isSelf || isMember)
+                conversation = pimpl_->getConversation(convId);
+            else if (pimpl_->unloadedConversations_.count(convId))
+                continue;
+            if (conversation) {
                 try {
                     // Note it's important to check getUsername(), else
                     // removing self can remove all conversations
-                    if (itConv->second->mode() == ConversationMode::ONE_TO_ONE) {
-                        auto initMembers = itConv->second->getInitialMembers();
+                    if (conversation->mode() == ConversationMode::ONE_TO_ONE) {
+                        auto initMembers = conversation->getInitialMembers();
                         if ((isSelf && initMembers.size() == 1)
                             || (!isSelf
                                 && std::find(initMembers.begin(), initMembers.end(), uri)
@@ -1768,8 +2423,7 @@ ConversationModule::removeContact(const std::string& uri, bool banned)
                 } catch (const std::exception& e) {
                     JAMI_WARN("%s", e.what());
                 }
-            } else if (std::find(conv.members.begin(), conv.members.end(), uri)
-                       != conv.members.end()) {
+            } else if (isMember) {
                 // It's syncing with uri, mark as removed!
                 conv.removed = std::time(nullptr);
                 updated.emplace_back(convId);
@@ -1796,12 +2450,12 @@ ConversationModule::initReplay(const std::string& oldConvId, const std::string&
 {
     std::lock_guard<std::mutex> lk(pimpl_->conversationsMtx_);
     auto acc = pimpl_->account_.lock();
-    auto conversation = pimpl_->conversations_.find(oldConvId);
-    if (acc && conversation != pimpl_->conversations_.end() && conversation->second) {
+    auto conversation = pimpl_->getConversation(oldConvId);
+    if (acc && conversation) {
         std::promise<bool> waitLoad;
         std::future<bool> fut = waitLoad.get_future();
         // we should wait for loadMessage, because it will be deleted after this.
-        conversation->second->loadMessages(
+        conversation->loadMessages(
             [&](auto&& messages) {
                 std::reverse(messages.begin(),
                              messages.end()); // Log is inverted as we want to replay
@@ -1825,19 +2479,7 @@ ConversationModule::convInfos(const std::string& accountId)
 std::map<std::string, ConvInfo>
 ConversationModule::convInfosFromPath(const std::string& path)
 {
-    std::map<std::string, ConvInfo> convInfos;
-    try {
-        // read file
-        std::lock_guard<std::mutex> lock(
-            fileutils::getFileLock(path + DIR_SEPARATOR_STR + "convInfo"));
-        auto file = fileutils::loadFile("convInfo", path);
-        // load values
-        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
-        oh.get().convert(convInfos);
-    } catch (const std::exception& e) {
-        JAMI_WARN("[convInfo] error loading convInfo: %s", e.what());
-    }
-    return convInfos;
+    return MapJournal<ConvInfo>::read(path + DIR_SEPARATOR_STR + "convInfo");
 }
 
 std::map<std::string, ConversationRequest>
@@ -1850,19 +2492,7 @@ ConversationModule::convRequests(const std::string& accountId)
 std::map<std::string, ConversationRequest>
 ConversationModule::convRequestsFromPath(const std::string& path)
 {
-    std::map<std::string, ConversationRequest> convRequests;
-    try {
-        // read file
-        std::lock_guard<std::mutex> lock(
-            fileutils::getFileLock(path + DIR_SEPARATOR_STR + "convRequests"));
-        auto file = fileutils::loadFile("convRequests", path);
-        // load values
-        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
-        oh.get().convert(convRequests);
-    } catch (const std::exception& e) {
-        JAMI_WARN("[convInfo] error loading convInfo: %s", e.what());
-    }
-    return convRequests;
+    return MapJournal<ConversationRequest>::read(path + DIR_SEPARATOR_STR + "convRequests");
 }
 
 void
@@ -35,7 +35,16 @@ struct SyncMsg
     jami::DeviceSync ds;
     std::map<std::string, jami::ConvInfo> c;
     std::map<std::string, jami::ConversationRequest> cr;
-    MSGPACK_DEFINE(ds, c, cr)
+    // Delta sync: version of the state sent, and the acknowledged version it is relative to
+    // (0 for the whole state). 0 for the devices that don't support it.
+    uint64_t v {0};
+    uint64_t base {0};
+    // Acknowledgement of the version v of the peer: the conversations not cloned yet are to be
+    // sent again, resync asks for the whole state
+    uint64_t ack {0};
+    bool resync {false};
+    std::vector<std::string> missing;
+    MSGPACK_DEFINE(ds, c, cr, v, base, ack, resync, missing)
 };
 
 using ChannelCb = std::function<bool(const std::shared_ptr<ChannelSocket>&)>;
@@ -177,6 +186,12 @@ public:
     uint32_t loadConversationMessages(const std::string& conversationId,
                                       const std::string& fromMessage = "",
                                       size_t n = 0);
+    /**
+     * Same as loadConversationMessages(), emitting ConversationLoadedPacked
+     */
+    uint32_t loadConversationMessagesPacked(const std::string& conversationId,
+                                            const std::string& fromMessage = "",
+                                            size_t n = 0);
     uint32_t loadConversationUntil(const std::string& conversationId,
                                    const std::string& fromMessage,
                                    const std::string& to);
@@ -220,6 +235,10 @@ public:
      * Sync conversations with detected peer
      */
     void syncConversations(const std::string& peer, const std::string& deviceId);
+    /**
+     * Call cb once no conversation is being fetched, now if none is
+     */
+    void onSyncFinished(std::function<void()>&& cb);
 
     /**
      * Detect new conversations and request from other devices
@@ -254,11 +273,13 @@ public:
      * @param deviceId          Who sent the notification
      * @param conversationId    Related conversation
      * @param commitId          Commit to retrieve
+     * @param origin            Author of a relayed announcement, to relay in turn (optional)
      */
     void onNewCommit(const std::string& peer,
                      const std::string& deviceId,
                      const std::string& conversationId,
-                     const std::string& commitId);
+                     const std::string& commitId,
+                     const std::string& origin = {});
 
     // Conversation's member
     /**
@@ -286,6 +307,13 @@ public:
      */
     std::vector<std::map<std::string, std::string>> getConversationMembers(
         const std::string& conversationId) const;
+    /**
+     * Get the uris of the members, as getConversationMembers() without the details.
+     * To use when routing to each member.
+     * @param conversationId
+     * @return members' uris
+     */
+    std::vector<std::string> getConversationMemberUris(const std::string& conversationId) const;
     /**
      * Retrieve the number of interactions from interactionId to HEAD
      * @param convId
@@ -318,6 +346,12 @@ public:
                                  const std::map<std::string, std::string>& infos,
                                  bool sync = true);
     std::map<std::string, std::string> conversationInfos(const std::string& conversationId) const;
+    /**
+     * Object storage of the repository of a conversation
+     * @param conversationId
+     * @return looseObjects, packs and packSize (in bytes)
+     */
+    std::map<std::string, std::string> packState(const std::string& conversationId) const;
     // Get the map into a VCard format for storing
     std::vector<uint8_t> conversationVCard(const std::string& conversationId) const;
 
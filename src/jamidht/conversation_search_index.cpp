@@ -0,0 +1,287 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "conversation_search_index.h"
+
+#include "conversationrepository.h"
+#include "fileutils.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <regex>
+
+namespace jami {
+
+static constexpr unsigned VERSION {1};
+// With one of them, the pattern is a regular expression which may match across words
+static constexpr const char* REGEX_CHARS {"\\^$.|?*+()[]{}"};
+
+static bool
+isSearchable(const std::string& type)
+{
+    return type == "text/plain" || type == "application/data-transfer+json";
+}
+
+ConversationSearchIndex::ConversationSearchIndex(const std::string& path)
+    : path_(path)
+{}
+
+bool
+ConversationSearchIndex::update(git_repository* repo, const Describe& describe)
+{
+    if (!loaded_) {
+        loaded_ = true;
+        load();
+    }
+    git_oid head;
+    if (git_reference_name_to_id(&head, repo, "HEAD") < 0)
+        return false;
+    if (head_ and git_oid_equal(&*head_, &head))
+        return true;
+
+    git_revwalk* walker_ptr = nullptr;
+    if (git_revwalk_new(&walker_ptr, repo) < 0 or git_revwalk_push(walker_ptr, &head) < 0) {
+        git_revwalk_free(walker_ptr);
+        JAMI_ERR("Couldn't init revwalker for %s", path_.c_str());
+        return false;
+    }
+    GitRevWalker walker {walker_ptr, git_revwalk_free};
+    if (head_ and git_revwalk_hide(walker.get(), &*head_) < 0) {
+        // The indexed head is not in the repository anymore
+        head_.reset();
+    }
+    if (not head_) {
+        JAMI_DBG("Rebuild conversation search index %s", path_.c_str());
+        entries_.clear();
+        postings_.clear();
+    }
+
+    std::vector<Entry> newEntries;
+    git_oid oid;
+    while (!git_revwalk_next(&oid, walker.get())) {
+        git_commit* commit_ptr = nullptr;
+        if (git_commit_lookup(&commit_ptr, repo, &oid) < 0) {
+            JAMI_WARN("Failed to look up commit %s", git_oid_tostr_s(&oid));
+            return false;
+        }
+        GitCommit commit {commit_ptr, git_commit_free};
+        if (auto entry = describe(commit.get()))
+            newEntries.emplace_back(std::move(*entry));
+    }
+
+    auto from = entries_.size();
+    for (auto& entry : newEntries)
+        add(std::move(entry));
+    head_ = head;
+    save(from);
+    return true;
+}
+
+std::vector<const ConversationSearchIndex::Entry*>
+ConversationSearchIndex::search(
+    const Filter& filter,
+    const std::function<std::string(const std::string&)>& uriFromDevice) const
+{
+    std::regex regex;
+    try {
+        regex = std::regex(filter.regexSearch);
+    } catch (const std::regex_error& e) {
+        JAMI_WARN("Invalid search pattern %s: %s", filter.regexSearch.c_str(), e.what());
+        return {};
+    }
+
+    std::unordered_map<std::string, bool> authorMatches;
+    std::vector<const Entry*> results;
+    auto match = [&](const Entry& entry) {
+        if (not filter.type.empty() and entry.type != filter.type)
+            return;
+        auto searchable = isSearchable(entry.type);
+        if (filter.type.empty() and not searchable)
+            return; // Not searchable, at least for now
+        if (filter.before and filter.before < entry.timestamp)
+            return;
+        if (filter.after and filter.after > entry.timestamp)
+            return;
+        if (not filter.author.empty()) {
+            auto it = authorMatches.find(entry.device);
+            if (it == authorMatches.end())
+                it = authorMatches
+                         .emplace(entry.device, uriFromDevice(entry.device) == filter.author)
+                         .first;
+            if (not it->second)
+                return;
+        }
+        // Only the text is matched, other types are returned when requested
+        if (searchable and not std::regex_search(entry.text, regex))
+            return;
+        results.emplace_back(&entry);
+    };
+
+    if (auto ids = candidates(filter.regexSearch)) {
+        for (auto id : *ids)
+            match(entries_[id]);
+    } else {
+        for (const auto& entry : entries_)
+            match(entry);
+    }
+    return results;
+}
+
+std::vector<std::string>
+ConversationSearchIndex::tokenize(std::string_view text)
+{
+    std::vector<std::string> words;
+    std::string word;
+    for (unsigned char c : text) {
+        // Bytes of UTF-8 sequences are kept in the words
+        if (c >= 0x80 or (c >= '0' and c <= '9') or (c >= 'a' and c <= 'z')) {
+            word += static_cast<char>(c);
+        } else if (c >= 'A' and c <= 'Z') {
+            word += static_cast<char>(c - 'A' + 'a');
+        } else if (not word.empty()) {
+            words.emplace_back(std::move(word));
+            word.clear();
+        }
+    }
+    if (not word.empty())
+        words.emplace_back(std::move(word));
+    return words;
+}
+
+void
+ConversationSearchIndex::add(Entry&& entry)
+{
+    auto id = static_cast<uint32_t>(entries_.size());
+    if (isSearchable(entry.type)) {
+        auto words = tokenize(entry.text);
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+        for (auto& word : words)
+            postings_[std::move(word)].emplace_back(id);
+    }
+    entries_.emplace_back(std::move(entry));
+}
+
+std::optional<std::set<uint32_t>>
+ConversationSearchIndex::candidates(const std::string& pattern) const
+{
+    if (pattern.find_first_of(REGEX_CHARS) != std::string::npos)
+        return std::nullopt;
+    auto words = tokenize(pattern);
+    if (words.empty())
+        return std::nullopt;
+
+    std::optional<std::set<uint32_t>> result;
+    for (const auto& word : words) {
+        // The word may be a part of the indexed ones
+        std::set<uint32_t> ids;
+        for (const auto& [indexed, postings] : postings_)
+            if (indexed.find(word) != std::string::npos)
+                ids.insert(postings.begin(), postings.end());
+        if (result) {
+            std::set<uint32_t> intersection;
+            std::set_intersection(result->begin(),
+                                  result->end(),
+                                  ids.begin(),
+                                  ids.end(),
+                                  std::inserter(intersection, intersection.end()));
+            result = std::move(intersection);
+        } else {
+            result = std::move(ids);
+        }
+        if (result->empty())
+            break;
+    }
+    return result;
+}
+
+void
+ConversationSearchIndex::load()
+{
+    std::vector<uint8_t> file;
+    try {
+        file = fileutils::loadFile(path_);
+    } catch (const std::exception&) {
+        return;
+    }
+    msgpack::unpacker pac;
+    pac.reserve_buffer(file.size());
+    std::memcpy(pac.buffer(), file.data(), file.size());
+    pac.buffer_consumed(file.size());
+
+    // Entries of an update are only kept if followed by its head
+    std::vector<Entry> pending;
+    std::size_t valid = 0;
+    try {
+        msgpack::object_handle oh;
+        if (not pac.next(oh) or oh.get().type != msgpack::type::POSITIVE_INTEGER
+            or oh.get().as<unsigned>() != VERSION) {
+            JAMI_WARN("Ignore invalid conversation search index %s", path_.c_str());
+            truncated_ = true;
+            return;
+        }
+        while (pac.next(oh)) {
+            const auto& o = oh.get();
+            if (o.type == msgpack::type::BIN and o.via.bin.size == GIT_OID_RAWSZ) {
+                for (auto& entry : pending)
+                    add(std::move(entry));
+                pending.clear();
+                git_oid head;
+                git_oid_fromraw(&head, reinterpret_cast<const unsigned char*>(o.via.bin.ptr));
+                head_ = head;
+                valid = pac.parsed_size();
+            } else {
+                pending.emplace_back(o.as<Entry>());
+            }
+        }
+    } catch (const std::exception& e) {
+        JAMI_WARN("Error while loading conversation search index %s: %s", path_.c_str(), e.what());
+    }
+    // An interrupted update is ignored, and overwritten by the next one
+    truncated_ = valid != file.size();
+}
+
+void
+ConversationSearchIndex::save(std::size_t from)
+{
+    auto rewrite = from == 0 or truncated_;
+    if (rewrite)
+        from = 0;
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> pk(&buffer);
+    if (rewrite)
+        pk.pack(VERSION);
+    for (auto i = from; i < entries_.size(); ++i)
+        pk.pack(entries_[i]);
+    // The head is written last, so that an interrupted save is detected
+    pk.pack_bin(GIT_OID_RAWSZ);
+    pk.pack_bin_body(reinterpret_cast<const char*>(head_->id), GIT_OID_RAWSZ);
+
+    auto mode = std::ios::binary | std::ios::out | (rewrite ? std::ios::trunc : std::ios::app);
+    auto file = fileutils::ofstream(path_, mode);
+    if (!file) {
+        JAMI_ERR("Couldn't save conversation search index %s", path_.c_str());
+        return;
+    }
+    file.write(buffer.data(), buffer.size());
+    truncated_ = false;
+}
+
+} // namespace jami
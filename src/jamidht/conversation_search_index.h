@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "noncopyable.h"
+
+#include <git2.h>
+#include <msgpack.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace jami {
+
+struct Filter;
+
+/**
+ * Messages of a conversation, with an inverted index of their words, so that
+ * searching them doesn't parse the whole history.
+ *
+ * Like the log index, it is derived from the repository and brought up to date
+ * with HEAD before each use: the commits which are not ancestors of the indexed
+ * head are added, whether they come from a commit or a merge. Each update is
+ * appended to the file, followed by the new head.
+ */
+class ConversationSearchIndex
+{
+public:
+    struct Entry
+    {
+        std::string id;
+        std::string device; // Email of the author
+        std::string type;
+        int64_t timestamp {0};
+        // Searched text: the body of a text, the name of a file
+        std::string text;
+        MSGPACK_DEFINE(id, device, type, timestamp, text)
+    };
+    /**
+     * Entry of a commit, std::nullopt if it's not a message
+     */
+    using Describe = std::function<std::optional<Entry>(git_commit*)>;
+
+    explicit ConversationSearchIndex(const std::string& path);
+
+    /**
+     * Bring the index up to date with the HEAD of repo
+     * @return false if the index can't be used
+     */
+    bool update(git_repository* repo, const Describe& describe);
+
+    /**
+     * Messages matching filter, in no particular order. filter.lastId and
+     * filter.maxResult depend on the order of the history and are ignored.
+     * @param uriFromDevice     Account of a device, for filter.author
+     */
+    std::vector<const Entry*> search(
+        const Filter& filter,
+        const std::function<std::string(const std::string&)>& uriFromDevice) const;
+
+    std::size_t size() const { return entries_.size(); }
+
+    /**
+     * Lowercase words of text, as indexed
+     */
+    static std::vector<std::string> tokenize(std::string_view text);
+
+private:
+    NON_COPYABLE(ConversationSearchIndex);
+
+    void add(Entry&& entry);
+    /**
+     * Entries containing all the words of pattern, std::nullopt if it can't be
+     * narrowed by the index (regular expression)
+     */
+    std::optional<std::set<uint32_t>> candidates(const std::string& pattern) const;
+
+    void load();
+    void save(std::size_t from);
+
+    const std::string path_;
+    bool loaded_ {false};
+    // The file ends with an interrupted update and must be rewritten
+    bool truncated_ {false};
+    std::optional<git_oid> head_ {};
+    std::vector<Entry> entries_ {};
+    std::unordered_map<std::string, std::vector<uint32_t>> postings_ {};
+};
+
+} // namespace jami
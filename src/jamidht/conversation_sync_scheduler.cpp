@@ -0,0 +1,134 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "conversation_sync_scheduler.h"
+
+namespace jami {
+
+ConversationSyncScheduler::ConversationSyncScheduler(std::size_t maxPerDevice,
+                                                     std::size_t maxTotal)
+    : maxPerDevice_(maxPerDevice)
+    , maxTotal_(maxTotal)
+{}
+
+void
+ConversationSyncScheduler::onProgress(ProgressCb&& cb)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    progressCb_ = std::move(cb);
+}
+
+void
+ConversationSyncScheduler::schedule(const std::string& deviceId,
+                                    int64_t priority,
+                                    Task&& task,
+                                    CancelCb&& cancel)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    queue_.emplace_back(Entry {deviceId, priority, std::move(task), std::move(cancel)});
+    total_++;
+    dispatch(lk);
+}
+
+void
+ConversationSyncScheduler::clear()
+{
+    std::vector<CancelCb> cancels;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        for (auto& entry : queue_)
+            if (entry.cancel)
+                cancels.emplace_back(std::move(entry.cancel));
+        for (auto& [id, running] : runningTasks_)
+            if (running.cancel)
+                cancels.emplace_back(std::move(running.cancel));
+        queue_.clear();
+        runningTasks_.clear();
+        running_.clear();
+        done_ = 0;
+        total_ = 0;
+    }
+    for (auto& cancel : cancels)
+        cancel();
+}
+
+std::size_t
+ConversationSyncScheduler::pending() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return queue_.size() + runningTasks_.size();
+}
+
+void
+ConversationSyncScheduler::dispatch(std::unique_lock<std::mutex>& lk)
+{
+    if (dispatching_)
+        return;
+    dispatching_ = true;
+    while (runningTasks_.size() < maxTotal_) {
+        // Most recent first, then arrival order
+        auto next = queue_.end();
+        for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+            auto running = running_.find(it->deviceId);
+            if (running != running_.end() && running->second >= maxPerDevice_)
+                continue;
+            if (next == queue_.end() || it->priority > next->priority)
+                next = it;
+        }
+        if (next == queue_.end())
+            break;
+
+        auto entry = std::move(*next);
+        queue_.erase(next);
+        auto id = nextId_++;
+        running_[entry.deviceId]++;
+        runningTasks_.emplace(id, Running {entry.deviceId, std::move(entry.cancel)});
+
+        lk.unlock();
+        entry.task([this, id] { finish(id); });
+        lk.lock();
+    }
+    dispatching_ = false;
+}
+
+void
+ConversationSyncScheduler::finish(uint64_t id)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    // Already finished, or forgotten by clear()
+    auto task = runningTasks_.find(id);
+    if (task == runningTasks_.end())
+        return;
+    auto it = running_.find(task->second.deviceId);
+    if (it != running_.end() && --it->second == 0)
+        running_.erase(it);
+    runningTasks_.erase(task);
+    done_++;
+    auto done = done_;
+    auto total = total_;
+    if (queue_.empty() && runningTasks_.empty()) {
+        done_ = 0;
+        total_ = 0;
+    }
+    auto cb = progressCb_;
+    dispatch(lk);
+    lk.unlock();
+    if (cb)
+        cb(done, total);
+}
+
+} // namespace jami
@@ -0,0 +1,121 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "noncopyable.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace jami {
+
+/**
+ * Limit how many conversations are fetched at the same time.
+ *
+ * When an account comes online, all its conversations want to sync with the
+ * connected devices. Fetches are queued here, and started when both the device
+ * and the account are below their limit. The most recently active
+ * conversations are fetched first.
+ */
+class ConversationSyncScheduler
+{
+public:
+    using DoneCb = std::function<void()>;
+    /**
+     * A fetch, that must call done when it's finished. It may be called more than
+     * once, and from any thread.
+     */
+    using Task = std::function<void(DoneCb&& done)>;
+    using CancelCb = std::function<void()>;
+    using ProgressCb = std::function<void(std::size_t done, std::size_t total)>;
+
+    ConversationSyncScheduler(std::size_t maxPerDevice, std::size_t maxTotal);
+
+    /**
+     * Called each time a task is finished, with the number of tasks done and
+     * scheduled since the scheduler was last idle.
+     */
+    void onProgress(ProgressCb&& cb);
+
+    /**
+     * Queue a task
+     * @param deviceId      Device to fetch from
+     * @param priority      Higher first, e.g. the time of the last activity
+     * @param task
+     * @param cancel        Called instead of finishing the task if it's dropped by clear()
+     */
+    void schedule(const std::string& deviceId,
+                  int64_t priority,
+                  Task&& task,
+                  CancelCb&& cancel = {});
+
+    /**
+     * Drop the queued tasks and forget the running ones, whose done callbacks are
+     * then ignored. To use if some fetches may never finish.
+     * The cancel callbacks of all of them are called, without the lock.
+     */
+    void clear();
+
+    /**
+     * @return number of tasks queued or running
+     */
+    std::size_t pending() const;
+
+private:
+    NON_COPYABLE(ConversationSyncScheduler);
+
+    struct Entry
+    {
+        std::string deviceId;
+        int64_t priority;
+        Task task;
+        CancelCb cancel;
+    };
+    struct Running
+    {
+        std::string deviceId;
+        CancelCb cancel;
+    };
+
+    /**
+     * Start the tasks that can run. Tasks are called without the lock, and
+     * tasks finished from a task are handled by the caller's loop.
+     */
+    void dispatch(std::unique_lock<std::mutex>& lk);
+    void finish(uint64_t id);
+
+    const std::size_t maxPerDevice_;
+    const std::size_t maxTotal_;
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> queue_ {}; // Arrival order
+    std::map<uint64_t, Running> runningTasks_ {};
+    std::map<std::string, std::size_t> running_ {}; // By device
+    bool dispatching_ {false};
+    uint64_t nextId_ {0};
+
+    // Progress since the scheduler was last idle
+    std::size_t done_ {0};
+    std::size_t total_ {0};
+    ProgressCb progressCb_ {};
+};
+
+} // namespace jami
@@ -19,26 +19,55 @@
 
 #include "account_const.h"
 #include "base64.h"
+#include "conversation_log_index.h"
+#include "conversation_search_index.h"
 #include "jamiaccount.h"
 #include "fileutils.h"
 #include "gittransport.h"
+#include "metrics.h"
 #include "string_utils.h"
 #include "client/ring_signal.h"
 #include "vcard.h"
 
 using random_device = dht::crypto::random_device;
 
+#include <opendht/thread_pool.h>
+#include <git2/sys/odb_backend.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <ctime>
 #include <fstream>
 #include <future>
 #include <json/json.h>
+#include <limits>
 #include <regex>
 #include <exception>
 #include <optional>
+#include <thread>
+#include <tuple>
 
 using namespace std::string_view_literals;
 constexpr auto DIFF_REGEX = " +\\| +[0-9]+.*"sv;
 constexpr size_t MAX_FETCH_SIZE {256 * 1024 * 1024}; // 256Mb
+// Below, a validation task costs more than it saves
+constexpr size_t MIN_COMMITS_PER_RANGE {32};
+// Certificates of the trees kept parsed for the validations
+constexpr size_t MAX_PARSED_CERTIFICATES {256};
+
+// Shallow fetches (fetch_opts.depth) are not supported by older versions of libgit2, which
+// clone the whole history
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 7)
+#define LIBGIT2_HAS_SHALLOW 1
+#endif
+
+// Past this, the loose objects of a repository are packed
+constexpr size_t MAX_LOOSE_OBJECTS {256};
+// Past this, the packs are packed into one, without the unreachable objects
+constexpr size_t MAX_PACKS {16};
+// More recent packs and loose objects may belong to a fetch or a commit not referenced yet
+constexpr std::chrono::hours PRUNE_EXPIRY {1};
 
 namespace jami {
 
@@ -96,6 +125,11 @@ public:
     std::string createMergeCommit(git_index* index, const std::string& wanted_ref);
 
     bool validCommits(const std::vector<ConversationCommit>& commits) const;
+    /**
+     * Check one commit against its parents
+     * @param error     Set to the reason of the failure
+     */
+    bool validCommit(const ConversationCommit& commit, std::string& error) const;
     bool checkValidUserDiff(const std::string& userDevice,
                             const std::string& commitId,
                             const std::string& parentId) const;
@@ -132,6 +166,11 @@ public:
     // Verify that the device in the repository is still valid
     bool validateDevice();
     std::string commit(const std::string& msg);
+    /**
+     * Chain one commit per message on the same tree, and move main once
+     * @return the commits' ids, empty from the first failure
+     */
+    std::vector<std::string> commits(const std::vector<std::string>& msgs);
     ConversationMode mode() const;
 
     // NOTE! GitDiff needs to be deteleted before repo
@@ -152,6 +191,26 @@ public:
                                         bool fastLog = false,
                                         const std::string& authorUri = "") const;
     std::vector<std::map<std::string, std::string>> search(const Filter& filter) const;
+    ConversationCommit parseCommit(git_repository* repo, git_commit* commit) const;
+    /**
+     * Same as log(), from the log index
+     * @return std::nullopt if the index can't answer, e.g. from is not merged
+     */
+    /**
+     * Same as search(), from the search index, without parsing the history
+     * @return std::nullopt if the index can't answer
+     */
+    std::optional<std::vector<std::map<std::string, std::string>>> indexedSearch(
+        const Filter& filter) const;
+    /**
+     * Bring logIndex_ up to date, with logIndexMtx_ locked
+     */
+    bool updateLogIndex(git_repository* repo) const;
+    std::optional<std::vector<ConversationCommit>> indexedLog(const std::string& from,
+                                                              const std::string& to,
+                                                              unsigned n,
+                                                              bool fastLog,
+                                                              const std::string& authorUri) const;
 
     GitObject fileAtTree(const std::string& path, const GitTree& tree) const;
     GitObject memberCertificate(std::string_view memberUri, const GitTree& tree) const;
@@ -172,12 +231,39 @@ public:
     mutable std::mutex membersMtx_ {};
     std::vector<ConversationMember> members_ {};
 
+    // The initial commit never changes, so its members are only resolved once
+    mutable std::mutex initialMembersMtx_ {};
+    mutable std::vector<std::string> initialMembers_ {};
+
     std::vector<ConversationMember> members() const
     {
         std::lock_guard<std::mutex> lk(membersMtx_);
         return members_;
     }
 
+    std::optional<MemberRole> memberRole(std::string_view uri) const
+    {
+        std::lock_guard<std::mutex> lk(membersMtx_);
+        for (const auto& member : members_)
+            if (member.uri == uri)
+                return member.role;
+        return std::nullopt;
+    }
+
+    /**
+     * Must be called with membersMtx_ locked
+     */
+    void setMemberRole(const std::string& uri, MemberRole role)
+    {
+        for (auto& member : members_) {
+            if (member.uri == uri) {
+                member.role = role;
+                return;
+            }
+        }
+        members_.emplace_back(ConversationMember {uri, role});
+    }
+
     bool resolveConflicts(git_index* index, const std::string& other_id);
 
     std::vector<std::string> memberUris(std::string_view filter,
@@ -196,6 +282,13 @@ public:
 
     void initMembers();
 
+    /**
+     * Call field for each field of the message of a commit, as given to the client
+     * @return false if the commit is not a message for the client
+     */
+    bool convCommitFields(
+        const ConversationCommit& commit,
+        const std::function<void(std::string_view, std::string_view)>& field) const;
     std::optional<std::map<std::string, std::string>> convCommitToMap(
         const ConversationCommit& commit) const;
 
@@ -236,6 +329,69 @@ public:
     mutable std::mutex deviceToUriMtx_;
     mutable std::map<std::string, std::string> deviceToUri_;
 
+    /**
+     * Each commit is validated with the certificates of its tree, which are the
+     * same blobs for most of the commits of a device: parse them once.
+     * The certificates returned are shared, they must not be modified.
+     */
+    std::shared_ptr<const dht::crypto::Certificate> blobCertificate(const GitObject& blob) const
+    {
+        char id[GIT_OID_HEXSZ + 1];
+        git_oid_tostr(id, sizeof(id), git_object_id(blob.get()));
+        {
+            std::lock_guard<std::mutex> lk(parsedCertsMtx_);
+            auto it = parsedCerts_.find(id);
+            if (it != parsedCerts_.end())
+                return it->second;
+        }
+        auto* b = reinterpret_cast<git_blob*>(blob.get());
+        auto cert = std::make_shared<const dht::crypto::Certificate>(
+            static_cast<const uint8_t*>(git_blob_rawcontent(b)), git_blob_rawsize(b));
+        std::lock_guard<std::mutex> lk(parsedCertsMtx_);
+        if (parsedCerts_.size() >= MAX_PARSED_CERTIFICATES)
+            parsedCerts_.clear();
+        parsedCerts_.emplace(id, cert);
+        return cert;
+    }
+    // By blob id
+    mutable std::mutex parsedCertsMtx_;
+    mutable std::map<std::string, std::shared_ptr<const dht::crypto::Certificate>> parsedCerts_;
+
+    /**
+     * Commits already validated, persisted in conversation_data so that
+     * no commit is validated twice, even across restarts
+     */
+    struct ValidatedCommits
+    {
+        // Newest commit whose whole history is valid
+        std::string head;
+        // Valid commits which are not ancestors of head
+        std::set<std::string> commits;
+        MSGPACK_DEFINE_MAP(head, commits)
+    };
+    // Linearized history, read by log()
+    mutable std::mutex logIndexMtx_;
+    mutable std::unique_ptr<ConversationLogIndex> logIndex_;
+    // Messages, read by search(). Protected by logIndexMtx_, as they are used together
+    mutable std::unique_ptr<ConversationSearchIndex> searchIndex_;
+
+    mutable std::mutex validationMtx_;
+    mutable bool validatedLoaded_ {false};
+    mutable std::string validatedHead_;
+    mutable std::set<std::string> validated_;
+    void loadValidated() const;
+    void saveValidated() const;
+    void setValidatedHead(const std::string& head) const;
+    // Oldest commits of a shallow clone, whose parents are not fetched yet
+    mutable std::set<std::string> shallow_;
+    void loadShallow() const;
+    bool isValidated(git_repository* repo, const std::string& commitId) const;
+    bool isAncestor(git_repository* repo,
+                    const std::string& ancestor,
+                    const std::string& commitId) const;
+    // Where the data of the conversation which is not in the repository is saved
+    std::string dataPath() const;
+
     /**
      * Verify that a certificate modification is correct
      * @param certPath      Where the certificate is saved (relative path)
@@ -1378,11 +1534,8 @@ ConversationRepository::Impl::isValidUserAtCommit(const std::string& userDevice,
         JAMI_ERR("%s announced but not found", deviceFile.c_str());
         return false;
     }
-    auto* blob = reinterpret_cast<git_blob*>(blob_device.get());
-    auto deviceCert = dht::crypto::Certificate(static_cast<const uint8_t*>(
-                                                   git_blob_rawcontent(blob)),
-                                               git_blob_rawsize(blob));
-    auto userUri = deviceCert.getIssuerUID();
+    auto deviceCert = blobCertificate(blob_device);
+    auto userUri = deviceCert->getIssuerUID();
     if (userUri.empty()) {
         JAMI_ERR("%s got no issuer UID", deviceFile.c_str());
         if (not hasPinnedCert) {
@@ -1404,10 +1557,7 @@ ConversationRepository::Impl::isValidUserAtCommit(const std::string& userDevice,
     }
 
     // Check that certificates were still valid
-    blob = reinterpret_cast<git_blob*>(blob_parent.get());
-    auto parentCert = dht::crypto::Certificate(static_cast<const uint8_t*>(
-                                                   git_blob_rawcontent(blob)),
-                                               git_blob_rawsize(blob));
+    auto parentCert = blobCertificate(blob_parent);
 
     git_oid oid;
     git_commit* commit_ptr = nullptr;
@@ -1419,19 +1569,20 @@ ConversationRepository::Impl::isValidUserAtCommit(const std::string& userDevice,
     GitCommit commit = {commit_ptr, git_commit_free};
 
     auto commitTime = std::chrono::system_clock::from_time_t(git_commit_time(commit.get()));
-    if (deviceCert.getExpiration() < commitTime) {
-        JAMI_ERR("Certificate %s expired", deviceCert.getId().to_c_str());
+    if (deviceCert->getExpiration() < commitTime) {
+        JAMI_ERR("Certificate %s expired", deviceCert->getId().to_c_str());
         return false;
     }
-    if (parentCert.getExpiration() < commitTime) {
-        JAMI_ERR("Certificate %s expired", parentCert.getId().to_c_str());
+    if (parentCert->getExpiration() < commitTime) {
+        JAMI_ERR("Certificate %s expired", parentCert->getId().to_c_str());
         return false;
     }
 
-    auto res = parentCert.getId().toString() == userUri;
+    auto res = parentCert->getId().toString() == userUri;
     if (res && not hasPinnedCert) {
-        tls::CertificateStore::instance().pinCertificate(std::move(deviceCert));
-        tls::CertificateStore::instance().pinCertificate(std::move(parentCert));
+        // The store links its certificates together, give it its own copies
+        tls::CertificateStore::instance().pinCertificate(deviceCert->getPacked());
+        tls::CertificateStore::instance().pinCertificate(parentCert->getPacked());
     }
     return res;
 }
@@ -1594,11 +1745,18 @@ ConversationRepository::Impl::validateDevice()
 std::string
 ConversationRepository::Impl::commit(const std::string& msg)
 {
-    if (!validateDevice())
-        return {};
+    return commits({msg}).front();
+}
+
+std::vector<std::string>
+ConversationRepository::Impl::commits(const std::vector<std::string>& msgs)
+{
+    std::vector<std::string> ret(msgs.size());
+    if (msgs.empty() || !validateDevice())
+        return ret;
     auto account = account_.lock();
     if (!account)
-        return {};
+        return ret;
     auto deviceId = std::string(account->currentDeviceId());
     auto name = account->getDisplayName();
     if (name.empty())
@@ -1608,7 +1766,7 @@ ConversationRepository::Impl::commit(const std::string& msg)
     // Sign commit's buffer
     if (git_signature_new(&sig_ptr, name.c_str(), deviceId.c_str(), std::time(nullptr), 0) < 0) {
         JAMI_ERR("Unable to create a commit signature.");
-        return {};
+        return ret;
     }
     GitSignature sig {sig_ptr, git_signature_free};
 
@@ -1616,84 +1774,104 @@ ConversationRepository::Impl::commit(const std::string& msg)
     git_index* index_ptr = nullptr;
     auto repo = repository();
     if (!repo)
-        return {};
+        return ret;
     if (git_repository_index(&index_ptr, repo.get()) < 0) {
         JAMI_ERR("Could not open repository index");
-        return {};
+        return ret;
     }
     GitIndex index {index_ptr, git_index_free};
 
+    // The index is not modified between the messages, they all share its tree
     git_oid tree_id;
     if (git_index_write_tree(&tree_id, index.get()) < 0) {
         JAMI_ERR("Unable to write initial tree from index");
-        return {};
+        return ret;
     }
 
     git_tree* tree_ptr = nullptr;
     if (git_tree_lookup(&tree_ptr, repo.get(), &tree_id) < 0) {
         JAMI_ERR("Could not look up initial tree");
-        return {};
+        return ret;
     }
     GitTree tree = {tree_ptr, git_tree_free};
 
     git_oid commit_id;
     if (git_reference_name_to_id(&commit_id, repo.get(), "HEAD") < 0) {
         JAMI_ERR("Cannot get reference for HEAD");
-        return {};
+        return ret;
     }
 
     git_commit* head_ptr = nullptr;
     if (git_commit_lookup(&head_ptr, repo.get(), &commit_id) < 0) {
         JAMI_ERR("Could not look up HEAD commit");
-        return {};
+        return ret;
     }
     GitCommit head_commit {head_ptr, git_commit_free};
 
-    git_buf to_sign = {};
-    const git_commit* head_ref[1] = {head_commit.get()};
-    if (git_commit_create_buffer(&to_sign,
-                                 repo.get(),
-                                 sig.get(),
-                                 sig.get(),
-                                 nullptr,
-                                 msg.c_str(),
-                                 tree.get(),
-                                 1,
-                                 &head_ref[0])
-        < 0) {
-        JAMI_ERR("Could not create commit buffer");
-        return {};
-    }
+    auto committed = 0u;
+    for (; committed < msgs.size(); ++committed) {
+        git_buf to_sign = {};
+        const git_commit* head_ref[1] = {head_commit.get()};
+        if (git_commit_create_buffer(&to_sign,
+                                     repo.get(),
+                                     sig.get(),
+                                     sig.get(),
+                                     nullptr,
+                                     msgs[committed].c_str(),
+                                     tree.get(),
+                                     1,
+                                     &head_ref[0])
+            < 0) {
+            JAMI_ERR("Could not create commit buffer");
+            break;
+        }
 
-    // git commit -S
-    auto to_sign_vec = std::vector<uint8_t>(to_sign.ptr, to_sign.ptr + to_sign.size);
-    auto signed_buf = account->identity().first->sign(to_sign_vec);
-    std::string signed_str = base64::encode(signed_buf);
-    if (git_commit_create_with_signature(&commit_id,
-                                         repo.get(),
-                                         to_sign.ptr,
-                                         signed_str.c_str(),
-                                         "signature")
-        < 0) {
-        JAMI_ERR("Could not sign commit");
+        // git commit -S
+        auto to_sign_vec = std::vector<uint8_t>(to_sign.ptr, to_sign.ptr + to_sign.size);
+        auto signed_buf = account->identity().first->sign(to_sign_vec);
+        std::string signed_str = base64::encode(signed_buf);
+        if (git_commit_create_with_signature(&commit_id,
+                                             repo.get(),
+                                             to_sign.ptr,
+                                             signed_str.c_str(),
+                                             "signature")
+            < 0) {
+            JAMI_ERR("Could not sign commit");
+            git_buf_dispose(&to_sign);
+            break;
+        }
         git_buf_dispose(&to_sign);
-        return {};
+
+        // The next message is chained on this one
+        if (git_commit_lookup(&head_ptr, repo.get(), &commit_id) < 0) {
+            JAMI_ERR("Could not look up new commit");
+            break;
+        }
+        head_commit.reset(head_ptr);
+
+        auto commit_str = git_oid_tostr_s(&commit_id);
+        if (commit_str) {
+            JAMI_INFO("New message added with id: %s", commit_str);
+            ret[committed] = commit_str;
+        }
     }
-    git_buf_dispose(&to_sign);
 
-    // Move commit to main branch
+    if (committed == 0)
+        return ret;
+
+    // Move the last commit to main branch
     git_reference* ref_ptr = nullptr;
-    if (git_reference_create(&ref_ptr, repo.get(), "refs/heads/main", &commit_id, true, nullptr)
+    if (git_reference_create(&ref_ptr,
+                             repo.get(),
+                             "refs/heads/main",
+                             git_commit_id(head_commit.get()),
+                             true,
+                             nullptr)
         < 0) {
         JAMI_WARN("Could not move commit to main");
     }
     git_reference_free(ref_ptr);
-
-    auto commit_str = git_oid_tostr_s(&commit_id);
-    if (commit_str) {
-        JAMI_INFO("New message added with id: %s", commit_str);
-    }
-    return commit_str ? commit_str : "";
+    return ret;
 }
 
 ConversationMode
@@ -1935,41 +2113,13 @@ ConversationRepository::Impl::forEachCommit(PreConditionCb&& preCondition,
         author.name = sig->name;
         author.email = sig->email;
 
-        std::vector<std::string> parents;
-        auto parentsCount = git_commit_parentcount(commit.get());
-        for (unsigned int p = 0; p < parentsCount; ++p) {
-            std::string parent {};
-            const git_oid* pid = git_commit_parent_id(commit.get(), p);
-            if (pid) {
-                parent = git_oid_tostr_s(pid);
-                parents.emplace_back(parent);
-            }
-        }
-
         auto result = preCondition(id, author, commit);
         if (result == CallbackResult::Skip)
             continue;
         else if (result == CallbackResult::Break)
             break;
 
-        ConversationCommit cc;
-        cc.id = id;
-        cc.commit_msg = git_commit_message(commit.get());
-        cc.author = std::move(author);
-        cc.parents = std::move(parents);
-        git_buf signature = {}, signed_data = {};
-        if (git_commit_extract_signature(&signature, &signed_data, repo.get(), &oid, "signature")
-            < 0) {
-            JAMI_WARN("Could not extract signature for commit %s", id.c_str());
-        } else {
-            cc.signature = base64::decode(
-                std::string(signature.ptr, signature.ptr + signature.size));
-            cc.signed_content = std::vector<uint8_t>(signed_data.ptr,
-                                                     signed_data.ptr + signed_data.size);
-        }
-        git_buf_dispose(&signature);
-        git_buf_dispose(&signed_data);
-        cc.timestamp = git_commit_time(commit.get());
+        auto cc = parseCommit(repo.get(), commit.get());
 
         auto post = postCondition(id, author, cc);
         emplaceCb(std::move(cc));
@@ -1979,6 +2129,117 @@ ConversationRepository::Impl::forEachCommit(PreConditionCb&& preCondition,
     }
 }
 
+ConversationCommit
+ConversationRepository::Impl::parseCommit(git_repository* repo, git_commit* commit) const
+{
+    const git_oid* oid = git_commit_id(commit);
+    ConversationCommit cc;
+    cc.id = git_oid_tostr_s(oid);
+    cc.commit_msg = git_commit_message(commit);
+    const git_signature* sig = git_commit_author(commit);
+    cc.author.name = sig->name;
+    cc.author.email = sig->email;
+    auto parentsCount = git_commit_parentcount(commit);
+    for (unsigned int p = 0; p < parentsCount; ++p) {
+        const git_oid* pid = git_commit_parent_id(commit, p);
+        if (pid)
+            cc.parents.emplace_back(git_oid_tostr_s(pid));
+    }
+    git_buf signature = {}, signed_data = {};
+    if (git_commit_extract_signature(&signature, &signed_data, repo, oid, "signature") < 0) {
+        JAMI_WARN("Could not extract signature for commit %s", cc.id.c_str());
+    } else {
+        cc.signature = base64::decode(std::string(signature.ptr, signature.ptr + signature.size));
+        cc.signed_content = std::vector<uint8_t>(signed_data.ptr,
+                                                 signed_data.ptr + signed_data.size);
+    }
+    git_buf_dispose(&signature);
+    git_buf_dispose(&signed_data);
+    cc.timestamp = git_commit_time(commit);
+    return cc;
+}
+
+bool
+ConversationRepository::Impl::updateLogIndex(git_repository* repo) const
+{
+    if (!logIndex_) {
+        auto path = dataPath();
+        if (path.empty() or !fileutils::recursive_mkdir(path, 0700))
+            return false;
+        logIndex_ = std::make_unique<ConversationLogIndex>(path + DIR_SEPARATOR_STR + "log_index");
+    }
+    return logIndex_->update(repo);
+}
+
+std::optional<std::vector<ConversationCommit>>
+ConversationRepository::Impl::indexedLog(const std::string& from,
+                                         const std::string& to,
+                                         unsigned n,
+                                         bool fastLog,
+                                         const std::string& authorUri) const
+{
+    auto repo = repository();
+    if (!repo)
+        return std::nullopt;
+
+    // Commits to log, with their linearized parent
+    std::vector<std::pair<git_oid, std::string>> toLog;
+    {
+        std::lock_guard<std::mutex> lk(logIndexMtx_);
+        if (!updateLogIndex(repo.get()))
+            return std::nullopt;
+
+        std::size_t start = 0, end = logIndex_->size();
+        if (!from.empty()) {
+            auto pos = logIndex_->find(from);
+            if (!pos)
+                return std::nullopt; // Not merged, its own branch is walked
+            start = *pos;
+        }
+        if (!to.empty()) {
+            if (auto pos = logIndex_->find(to)) {
+                if (*pos <= start)
+                    return std::vector<ConversationCommit> {};
+                end = *pos;
+            }
+        }
+        if (n != 0)
+            end = std::min<std::size_t>(end, start + n);
+        toLog.reserve(end - start);
+        for (auto pos = start; pos < end; ++pos)
+            toLog.emplace_back(logIndex_->id(pos),
+                               pos + 1 < logIndex_->size()
+                                   ? git_oid_tostr_s(&logIndex_->id(pos + 1))
+                                   : "");
+    }
+
+    std::vector<ConversationCommit> commits {};
+    commits.reserve(toLog.size());
+    for (auto& [oid, linearizedParent] : toLog) {
+        if (fastLog and authorUri.empty()) {
+            // Used to only count commit
+            commits.emplace_back();
+            continue;
+        }
+        git_commit* commit_ptr = nullptr;
+        if (git_commit_lookup(&commit_ptr, repo.get(), &oid) < 0) {
+            JAMI_WARN("Failed to look up commit %s", git_oid_tostr_s(&oid));
+            break;
+        }
+        GitCommit commit {commit_ptr, git_commit_free};
+        if (fastLog) {
+            if (authorUri == uriFromDevice(git_commit_author(commit.get())->email))
+                break; // Found author, stop
+            commits.emplace_back();
+            continue;
+        }
+        auto cc = parseCommit(repo.get(), commit.get());
+        cc.linearized_parent = std::move(linearizedParent);
+        commits.emplace_back(std::move(cc));
+    }
+    return commits;
+}
+
 std::vector<ConversationCommit>
 ConversationRepository::Impl::log(const std::string& from,
                                   const std::string& to,
@@ -1987,6 +2248,10 @@ ConversationRepository::Impl::log(const std::string& from,
                                   bool fastLog,
                                   const std::string& authorUri) const
 {
+    // Only the requested page is read when the history is indexed
+    if (auto commits = indexedLog(from, to, n, fastLog, authorUri))
+        return std::move(*commits);
+
     std::vector<ConversationCommit> commits {};
     auto startLogging = from == "";
     forEachCommit(
@@ -2024,9 +2289,94 @@ ConversationRepository::Impl::log(const std::string& from,
     return commits;
 }
 
+std::optional<std::vector<std::map<std::string, std::string>>>
+ConversationRepository::Impl::indexedSearch(const Filter& filter) const
+{
+    auto repo = repository();
+    if (!repo)
+        return std::nullopt;
+
+    // Matching commits, by position in the history, with their linearized parent
+    std::vector<std::tuple<std::size_t, git_oid, std::string>> matches;
+    {
+        std::lock_guard<std::mutex> lk(logIndexMtx_);
+        if (!updateLogIndex(repo.get()))
+            return std::nullopt;
+        if (!searchIndex_)
+            searchIndex_ = std::make_unique<ConversationSearchIndex>(dataPath() + DIR_SEPARATOR_STR
+                                                                     + "search_index");
+        auto describe = [&](git_commit* commit) -> std::optional<ConversationSearchIndex::Entry> {
+            auto cc = parseCommit(repo.get(), commit);
+            ConversationSearchIndex::Entry entry {cc.id, cc.author.email, {}, cc.timestamp, {}};
+            std::string body, displayName;
+            if (!convCommitFields(cc, [&](auto key, auto value) {
+                    if (key == "type")
+                        entry.type = value;
+                    else if (key == "body")
+                        body = value;
+                    else if (key == "displayName")
+                        displayName = value;
+                }))
+                return std::nullopt;
+            if (entry.type == "text/plain")
+                entry.text = std::move(body);
+            else if (entry.type == "application/data-transfer+json")
+                entry.text = std::move(displayName);
+            return entry;
+        };
+        if (!searchIndex_->update(repo.get(), describe))
+            return std::nullopt;
+
+        std::optional<std::size_t> last;
+        if (!filter.lastId.empty())
+            last = logIndex_->find(filter.lastId);
+        auto entries = searchIndex_->search(filter, [&](const std::string& device) {
+            return uriFromDevice(device);
+        });
+        matches.reserve(entries.size());
+        for (const auto* entry : entries) {
+            auto pos = logIndex_->find(entry->id);
+            if (!pos)
+                return std::nullopt; // Not up to date with the log index
+            if (last && *pos > *last)
+                continue;
+            matches.emplace_back(*pos,
+                                 logIndex_->id(*pos),
+                                 *pos + 1 < logIndex_->size()
+                                     ? git_oid_tostr_s(&logIndex_->id(*pos + 1))
+                                     : "");
+        }
+    }
+    std::sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
+        return std::get<0>(a) < std::get<0>(b);
+    });
+    if (filter.maxResult != 0 && matches.size() > filter.maxResult)
+        matches.resize(filter.maxResult);
+
+    // Only the results are read from the repository
+    std::vector<std::map<std::string, std::string>> commits {};
+    commits.reserve(matches.size());
+    for (auto& [pos, oid, linearizedParent] : matches) {
+        git_commit* commit_ptr = nullptr;
+        if (git_commit_lookup(&commit_ptr, repo.get(), &oid) < 0) {
+            JAMI_WARN("Failed to look up commit %s", git_oid_tostr_s(&oid));
+            return std::nullopt;
+        }
+        GitCommit commit {commit_ptr, git_commit_free};
+        auto cc = parseCommit(repo.get(), commit.get());
+        cc.linearized_parent = std::move(linearizedParent);
+        if (auto content = convCommitToMap(cc))
+            commits.emplace_back(std::move(*content));
+    }
+    return commits;
+}
+
 std::vector<std::map<std::string, std::string>>
 ConversationRepository::Impl::search(const Filter& filter) const
 {
+    if (auto commits = indexedSearch(filter))
+        return std::move(*commits);
+
     std::vector<std::map<std::string, std::string>> commits {};
     forEachCommit(
         [&](const auto& id, const auto& author, auto& commit) {
@@ -2149,6 +2499,11 @@ ConversationRepository::Impl::getCommitType(const std::string& commitMsg) const
 std::vector<std::string>
 ConversationRepository::Impl::getInitialMembers() const
 {
+    {
+        std::lock_guard<std::mutex> lk(initialMembersMtx_);
+        if (!initialMembers_.empty())
+            return initialMembers_;
+    }
     auto firstCommit = log(id_, "", 1);
     if (firstCommit.size() == 0) {
         return {};
@@ -2159,22 +2514,23 @@ ConversationRepository::Impl::getInitialMembers() const
     auto cert = tls::CertificateStore::instance().getCertificate(authorDevice);
     if (!cert || !cert->issuer)
         return {};
-    auto authorId = cert->issuer->getId().toString();
+    std::vector<std::string> initialMembers {cert->issuer->getId().toString()};
     if (mode() == ConversationMode::ONE_TO_ONE) {
         std::string err;
         Json::Value root;
         Json::CharReaderBuilder rbuilder;
         auto reader = std::unique_ptr<Json::CharReader>(rbuilder.newCharReader());
-        if (!reader->parse(commit.commit_msg.data(),
-                           commit.commit_msg.data() + commit.commit_msg.size(),
-                           &root,
-                           &err)) {
-            return {authorId};
-        }
-        if (root.isMember("invited") && root["invited"].asString() != authorId)
-            return {authorId, root["invited"].asString()};
-    }
-    return {authorId};
+        if (reader->parse(commit.commit_msg.data(),
+                          commit.commit_msg.data() + commit.commit_msg.size(),
+                          &root,
+                          &err)
+            && root.isMember("invited") && root["invited"].asString() != initialMembers[0])
+            initialMembers.emplace_back(root["invited"].asString());
+    }
+    // Not cached when the author's certificate is missing, it may be pinned later
+    std::lock_guard<std::mutex> lk(initialMembersMtx_);
+    initialMembers_ = initialMembers;
+    return initialMembers;
 }
 
 bool
@@ -2291,12 +2647,14 @@ ConversationRepository::Impl::initMembers()
     }
 }
 
-std::optional<std::map<std::string, std::string>>
-ConversationRepository::Impl::convCommitToMap(const ConversationCommit& commit) const
+bool
+ConversationRepository::Impl::convCommitFields(
+    const ConversationCommit& commit,
+    const std::function<void(std::string_view, std::string_view)>& field) const
 {
     auto authorId = uriFromDevice(commit.author.email);
     if (authorId.empty())
-        return std::nullopt;
+        return false;
     std::string parents;
     auto parentsSize = commit.parents.size();
     for (std::size_t i = 0; i < parentsSize; ++i) {
@@ -2307,44 +2665,70 @@ ConversationRepository::Impl::convCommitToMap(const ConversationCommit& commit)
     std::string type {};
     if (parentsSize > 1)
         type = "merge";
-    std::string body {};
-    std::map<std::string, std::string> message;
+    Json::Value cm;
     if (type.empty()) {
         std::string err;
-        Json::Value cm;
         Json::CharReaderBuilder rbuilder;
         auto reader = std::unique_ptr<Json::CharReader>(rbuilder.newCharReader());
         if (reader->parse(commit.commit_msg.data(),
                           commit.commit_msg.data() + commit.commit_msg.size(),
                           &cm,
                           &err)) {
-            for (auto const& id : cm.getMemberNames()) {
-                if (id == "type") {
-                    type = cm[id].asString();
-                    continue;
-                }
-                message.insert({id, cm[id].asString()});
-            }
+            if (cm.isObject())
+                type = cm["type"].asString();
         } else {
             JAMI_WARN("%s", err.c_str());
         }
     }
-    if (type.empty()) {
-        return std::nullopt;
-    } else if (type == "application/data-transfer+json") {
+    if (type.empty())
+        return false;
+    auto isTransfer = type == "application/data-transfer+json";
+
+    // The fields of the commit replace the ones of the message
+    static constexpr std::string_view COMMIT_FIELDS[] {
+        "id", "parents", "linearizedParent", "author", "type", "timestamp"};
+    if (cm.isObject()) {
+        for (auto it = cm.begin(); it != cm.end(); ++it) {
+            const char* nameEnd;
+            const char* nameBegin = it.memberName(&nameEnd);
+            std::string_view name(nameBegin, nameEnd - nameBegin);
+            if ((isTransfer and name == "fileId")
+                or std::find(std::begin(COMMIT_FIELDS), std::end(COMMIT_FIELDS), name)
+                       != std::end(COMMIT_FIELDS))
+                continue;
+            const char* begin;
+            const char* end;
+            if (it->getString(&begin, &end))
+                field(name, std::string_view(begin, end - begin));
+            else
+                field(name, it->asString());
+        }
+    }
+    if (isTransfer) {
         // Avoid the client to do the concatenation
-        message["fileId"] = commit.id + "_" + message["tid"];
-        auto extension = fileutils::getFileExtension(message["displayName"]);
+        auto fileId = commit.id + "_" + cm["tid"].asString();
+        auto extension = fileutils::getFileExtension(cm["displayName"].asString());
         if (!extension.empty())
-            message["fileId"] += "." + extension;
-    }
-    message["id"] = commit.id;
-    message["parents"] = parents;
-    message["linearizedParent"] = commit.linearized_parent;
-    message["author"] = authorId;
-    message["type"] = type;
-    message["timestamp"] = std::to_string(commit.timestamp);
+            fileId += "." + extension;
+        field("fileId", fileId);
+    }
+    field("id", commit.id);
+    field("parents", parents);
+    field("linearizedParent", commit.linearized_parent);
+    field("author", authorId);
+    field("type", type);
+    field("timestamp", std::to_string(commit.timestamp));
+    return true;
+}
 
+std::optional<std::map<std::string, std::string>>
+ConversationRepository::Impl::convCommitToMap(const ConversationCommit& commit) const
+{
+    std::map<std::string, std::string> message;
+    if (not convCommitFields(commit, [&](std::string_view key, std::string_view value) {
+            message.emplace(key, value);
+        }))
+        return std::nullopt;
     return message;
 }
 
@@ -2431,7 +2815,8 @@ ConversationRepository::createConversation(const std::weak_ptr<JamiAccount>& acc
 std::unique_ptr<ConversationRepository>
 ConversationRepository::cloneConversation(const std::weak_ptr<JamiAccount>& account,
                                           const std::string& deviceId,
-                                          const std::string& conversationId)
+                                          const std::string& conversationId,
+                                          unsigned depth)
 {
     auto shared = account.lock();
     if (!shared)
@@ -2459,6 +2844,11 @@ ConversationRepository::cloneConversation(const std::weak_ptr<JamiAccount>& acco
         }
         return 0;
     };
+#ifdef LIBGIT2_HAS_SHALLOW
+    clone_options.fetch_opts.depth = depth;
+#else
+    (void) depth;
+#endif
 
     if (fileutils::isDirectory(path)) {
         // If a crash occurs during a previous clone, just in case
@@ -2467,7 +2857,7 @@ ConversationRepository::cloneConversation(const std::weak_ptr<JamiAccount>& acco
     }
 
     JAMI_INFO("Start clone in %s", path.c_str());
-    if (git_clone(&rep, url.str().c_str(), path.c_str(), nullptr) < 0) {
+    if (git_clone(&rep, url.str().c_str(), path.c_str(), &clone_options) < 0) {
         const git_error* err = giterr_last();
         if (err)
             JAMI_ERR("Error when retrieving remote conversation: %s %s", err->message, path.c_str());
@@ -2486,205 +2876,346 @@ ConversationRepository::cloneConversation(const std::weak_ptr<JamiAccount>& acco
 }
 
 bool
-ConversationRepository::Impl::validCommits(
-    const std::vector<ConversationCommit>& commitsToValidate) const
+ConversationRepository::Impl::validCommit(const ConversationCommit& commit, std::string& error) const
 {
-    for (const auto& commit : commitsToValidate) {
-        auto userDevice = commit.author.email;
-        auto validUserAtCommit = commit.id;
-        if (commit.parents.size() == 0) {
-            if (!checkInitialCommit(userDevice, commit.id, commit.commit_msg)) {
-                JAMI_WARN("Malformed initial commit %s. Please check you use the latest "
-                          "version of Jami, or that your contact is not doing unwanted stuff.",
+    auto userDevice = commit.author.email;
+    auto validUserAtCommit = commit.id;
+    if (shallow_.find(commit.id) != shallow_.end()) {
+        // Without its parents, only its author is checked. Its tree is known as
+        // valid once the history is backfilled
+        if (!isValidUserAtCommit(userDevice, validUserAtCommit)) {
+            JAMI_WARN("Malformed shallow commit %s", commit.id.c_str());
+            error = "Malformed commit";
+            return false;
+        }
+        return true;
+    }
+    if (commit.parents.size() == 0) {
+        if (!checkInitialCommit(userDevice, commit.id, commit.commit_msg)) {
+            JAMI_WARN("Malformed initial commit %s. Please check you use the latest "
+                      "version of Jami, or that your contact is not doing unwanted stuff.",
+                      commit.id.c_str());
+            error = "Malformed initial commit";
+            return false;
+        }
+    } else if (commit.parents.size() == 1) {
+        auto type = getCommitType(commit.commit_msg);
+        if (type == "vote") {
+            // Check that vote is valid
+            if (!checkVote(userDevice, commit.id, commit.parents[0])) {
+                JAMI_WARN("Malformed vote commit %s. Please check you use the latest version "
+                          "of Jami, or that your contact is not doing unwanted stuff.",
                           commit.id.c_str());
-                if (auto shared = account_.lock()) {
-                    emitSignal<DRing::ConversationSignal::OnConversationError>(
-                        shared->getAccountID(), id_, EVALIDFETCH, "Malformed initial commit");
-                }
+                error = "Malformed vote";
                 return false;
             }
-        } else if (commit.parents.size() == 1) {
-            auto type = getCommitType(commit.commit_msg);
-            if (type == "vote") {
-                // Check that vote is valid
-                if (!checkVote(userDevice, commit.id, commit.parents[0])) {
-                    JAMI_WARN("Malformed vote commit %s. Please check you use the latest version "
-                              "of Jami, or that your contact is not doing unwanted stuff.",
-                              commit.id.c_str());
-                    if (auto shared = account_.lock()) {
-                        emitSignal<DRing::ConversationSignal::OnConversationError>(
-                            shared->getAccountID(), id_, EVALIDFETCH, "Malformed vote");
-                    }
+        } else if (type == "member") {
+            std::string err;
+            Json::Value root;
+            Json::CharReaderBuilder rbuilder;
+            auto reader = std::unique_ptr<Json::CharReader>(rbuilder.newCharReader());
+            if (!reader->parse(commit.commit_msg.data(),
+                               commit.commit_msg.data() + commit.commit_msg.size(),
+                               &root,
+                               &err)) {
+                JAMI_ERR() << "Failed to parse " << err;
+                error = "Malformed member commit";
+                return false;
+            }
+            std::string action = root["action"].asString();
+            std::string uriMember = root["uri"].asString();
+            if (action == "add") {
+                if (!checkValidAdd(userDevice, uriMember, commit.id, commit.parents[0])) {
+                    JAMI_WARN(
+                        "Malformed add commit %s. Please check you use the latest version "
+                        "of Jami, or that your contact is not doing unwanted stuff.",
+                        commit.id.c_str());
+                    error = "Malformed add member commit";
                     return false;
                 }
-            } else if (type == "member") {
-                std::string err;
-                Json::Value root;
-                Json::CharReaderBuilder rbuilder;
-                auto reader = std::unique_ptr<Json::CharReader>(rbuilder.newCharReader());
-                if (!reader->parse(commit.commit_msg.data(),
-                                   commit.commit_msg.data() + commit.commit_msg.size(),
-                                   &root,
-                                   &err)) {
-                    JAMI_ERR() << "Failed to parse " << err;
-                    if (auto shared = account_.lock()) {
-                        emitSignal<DRing::ConversationSignal::OnConversationError>(
-                            shared->getAccountID(), id_, EVALIDFETCH, "Malformed member commit");
-                    }
+            } else if (action == "join") {
+                if (!checkValidJoins(userDevice, uriMember, commit.id, commit.parents[0])) {
+                    JAMI_WARN(
+                        "Malformed joins commit %s. Please check you use the latest version "
+                        "of Jami, or that your contact is not doing unwanted stuff.",
+                        commit.id.c_str());
+                    error = "Malformed join member commit";
                     return false;
                 }
-                std::string action = root["action"].asString();
-                std::string uriMember = root["uri"].asString();
-                if (action == "add") {
-                    if (!checkValidAdd(userDevice, uriMember, commit.id, commit.parents[0])) {
-                        JAMI_WARN(
-                            "Malformed add commit %s. Please check you use the latest version "
-                            "of Jami, or that your contact is not doing unwanted stuff.",
-                            commit.id.c_str());
-                        if (auto shared = account_.lock()) {
-                            emitSignal<DRing::ConversationSignal::OnConversationError>(
-                                shared->getAccountID(),
-                                id_,
-                                EVALIDFETCH,
-                                "Malformed add member commit");
-                        }
-                        return false;
-                    }
-                } else if (action == "join") {
-                    if (!checkValidJoins(userDevice, uriMember, commit.id, commit.parents[0])) {
-                        JAMI_WARN(
-                            "Malformed joins commit %s. Please check you use the latest version "
-                            "of Jami, or that your contact is not doing unwanted stuff.",
-                            commit.id.c_str());
-                        if (auto shared = account_.lock()) {
-                            emitSignal<DRing::ConversationSignal::OnConversationError>(
-                                shared->getAccountID(),
-                                id_,
-                                EVALIDFETCH,
-                                "Malformed join member commit");
-                        }
-                        return false;
-                    }
-                } else if (action == "remove") {
-                    // In this case, we remove the user. So if self, the user will not be
-                    // valid for this commit. Check previous commit
-                    validUserAtCommit = commit.parents[0];
-                    if (!checkValidRemove(userDevice, uriMember, commit.id, commit.parents[0])) {
-                        JAMI_WARN(
-                            "Malformed removes commit %s. Please check you use the latest version "
-                            "of Jami, or that your contact is not doing unwanted stuff.",
-                            commit.id.c_str());
-                        if (auto shared = account_.lock()) {
-                            emitSignal<DRing::ConversationSignal::OnConversationError>(
-                                shared->getAccountID(),
-                                id_,
-                                EVALIDFETCH,
-                                "Malformed remove member commit");
-                        }
-                        return false;
-                    }
-                } else if (action == "ban" || action == "unban") {
-                    // Note device.size() == "member".size()
-                    if (!checkValidVoteResolution(userDevice,
-                                                  uriMember,
-                                                  commit.id,
-                                                  commit.parents[0],
-                                                  action)) {
-                        JAMI_WARN(
-                            "Malformed removes commit %s. Please check you use the latest version "
-                            "of Jami, or that your contact is not doing unwanted stuff.",
-                            commit.id.c_str());
-                        if (auto shared = account_.lock()) {
-                            emitSignal<DRing::ConversationSignal::OnConversationError>(
-                                shared->getAccountID(),
-                                id_,
-                                EVALIDFETCH,
-                                "Malformed ban member commit");
-                        }
-                        return false;
-                    }
-                } else {
-                    JAMI_WARN("Malformed member commit %s with action %s. Please check you use the "
-                              "latest "
-                              "version of Jami, or that your contact is not doing unwanted stuff.",
-                              commit.id.c_str(),
-                              action.c_str());
-                    if (auto shared = account_.lock()) {
-                        emitSignal<DRing::ConversationSignal::OnConversationError>(
-                            shared->getAccountID(), id_, EVALIDFETCH, "Malformed member commit");
-                    }
+            } else if (action == "remove") {
+                // In this case, we remove the user. So if self, the user will not be
+                // valid for this commit. Check previous commit
+                validUserAtCommit = commit.parents[0];
+                if (!checkValidRemove(userDevice, uriMember, commit.id, commit.parents[0])) {
+                    JAMI_WARN(
+                        "Malformed removes commit %s. Please check you use the latest version "
+                        "of Jami, or that your contact is not doing unwanted stuff.",
+                        commit.id.c_str());
+                    error = "Malformed remove member commit";
                     return false;
                 }
-            } else if (type == "application/update-profile") {
-                if (!checkValidProfileUpdate(userDevice, commit.id, commit.parents[0])) {
-                    JAMI_WARN("Malformed profile updates commit %s. Please check you use the "
-                              "latest version "
-                              "of Jami, or that your contact is not doing unwanted stuff.",
-                              commit.id.c_str());
-                    if (auto shared = account_.lock()) {
-                        emitSignal<DRing::ConversationSignal::OnConversationError>(
-                            shared->getAccountID(),
-                            id_,
-                            EVALIDFETCH,
-                            "Malformed profile updates commit");
-                    }
+            } else if (action == "ban" || action == "unban") {
+                // Note device.size() == "member".size()
+                if (!checkValidVoteResolution(userDevice,
+                                              uriMember,
+                                              commit.id,
+                                              commit.parents[0],
+                                              action)) {
+                    JAMI_WARN(
+                        "Malformed removes commit %s. Please check you use the latest version "
+                        "of Jami, or that your contact is not doing unwanted stuff.",
+                        commit.id.c_str());
+                    error = "Malformed ban member commit";
                     return false;
                 }
             } else {
-                // Note: accept all mimetype here, as we can have new mimetypes
-                // Just avoid to add weird files
-                // Check that no weird file is added outside device cert nor removed
-                if (!checkValidUserDiff(userDevice, commit.id, commit.parents[0])) {
-                    JAMI_WARN("Malformed %s commit %s. Please check you use the latest "
-                              "version of Jami, or that your contact is not doing unwanted stuff.",
-                              type.c_str(),
-                              commit.id.c_str());
-                    if (auto shared = account_.lock()) {
-                        emitSignal<DRing::ConversationSignal::OnConversationError>(
-                            shared->getAccountID(), id_, EVALIDFETCH, "Malformed commit");
-                    }
-                    return false;
-                }
+                JAMI_WARN("Malformed member commit %s with action %s. Please check you use the "
+                          "latest "
+                          "version of Jami, or that your contact is not doing unwanted stuff.",
+                          commit.id.c_str(),
+                          action.c_str());
+                error = "Malformed member commit";
+                return false;
             }
-
-            // For all commit, check that user is valid,
-            // So that user certificate MUST be in /members or /admins
-            // and device cert MUST be in /devices
-            if (!isValidUserAtCommit(userDevice, validUserAtCommit)) {
-                JAMI_WARN(
-                    "Malformed commit %s. Please check you use the latest version of Jami, or "
-                    "that your contact is not doing unwanted stuff. %s",
-                    validUserAtCommit.c_str(),
-                    commit.commit_msg.c_str());
-                if (auto shared = account_.lock()) {
-                    emitSignal<DRing::ConversationSignal::OnConversationError>(shared->getAccountID(),
-                                                                               id_,
-                                                                               EVALIDFETCH,
-                                                                               "Malformed commit");
-                }
+        } else if (type == "application/update-profile") {
+            if (!checkValidProfileUpdate(userDevice, commit.id, commit.parents[0])) {
+                JAMI_WARN("Malformed profile updates commit %s. Please check you use the "
+                          "latest version "
+                          "of Jami, or that your contact is not doing unwanted stuff.",
+                          commit.id.c_str());
+                error = "Malformed profile updates commit";
                 return false;
             }
         } else {
-            // Merge commit, for now, check user
-            if (!isValidUserAtCommit(userDevice, validUserAtCommit)) {
-                JAMI_WARN("Malformed merge commit %s. Please check you use the latest version of "
-                          "Jami, or "
-                          "that your contact is not doing unwanted stuff.",
-                          validUserAtCommit.c_str());
-                if (auto shared = account_.lock()) {
-                    emitSignal<DRing::ConversationSignal::OnConversationError>(shared->getAccountID(),
-                                                                               id_,
-                                                                               EVALIDFETCH,
-                                                                               "Malformed commit");
-                }
+            // Note: accept all mimetype here, as we can have new mimetypes
+            // Just avoid to add weird files
+            // Check that no weird file is added outside device cert nor removed
+            if (!checkValidUserDiff(userDevice, commit.id, commit.parents[0])) {
+                JAMI_WARN("Malformed %s commit %s. Please check you use the latest "
+                          "version of Jami, or that your contact is not doing unwanted stuff.",
+                          type.c_str(),
+                          commit.id.c_str());
+                error = "Malformed commit";
                 return false;
             }
         }
-        JAMI_DBG("Validate commit %s", commit.id.c_str());
+
+        // For all commit, check that user is valid,
+        // So that user certificate MUST be in /members or /admins
+        // and device cert MUST be in /devices
+        if (!isValidUserAtCommit(userDevice, validUserAtCommit)) {
+            JAMI_WARN(
+                "Malformed commit %s. Please check you use the latest version of Jami, or "
+                "that your contact is not doing unwanted stuff. %s",
+                validUserAtCommit.c_str(),
+                commit.commit_msg.c_str());
+            error = "Malformed commit";
+            return false;
+        }
+    } else {
+        // Merge commit, for now, check user
+        if (!isValidUserAtCommit(userDevice, validUserAtCommit)) {
+            JAMI_WARN("Malformed merge commit %s. Please check you use the latest version of "
+                      "Jami, or "
+                      "that your contact is not doing unwanted stuff.",
+                      validUserAtCommit.c_str());
+            error = "Malformed commit";
+            return false;
+        }
     }
+    JAMI_DBG("Validate commit %s", commit.id.c_str());
     return true;
 }
 
+bool
+ConversationRepository::Impl::validCommits(
+    const std::vector<ConversationCommit>& commitsToValidate) const
+{
+    std::lock_guard<std::mutex> lkValidation(validationMtx_);
+    loadValidated();
+    loadShallow();
+
+    // The same commits are fetched from each device of the conversation,
+    // only validate them once
+    std::vector<const ConversationCommit*> commits;
+    commits.reserve(commitsToValidate.size());
+    auto repo = repository();
+    for (const auto& commit : commitsToValidate)
+        if (not isValidated(repo.get(), commit.id))
+            commits.emplace_back(&commit);
+    if (commits.empty())
+        return true;
+
+    // Checks read mode_, resolve it before they run concurrently
+    try {
+        mode();
+    } catch (...) {
+    }
+
+    // Each check only reads the trees of a commit and its parents, never the
+    // result of the previous checks, so ranges of commits are validated in
+    // parallel. The caller also takes ranges, so that it never waits for a
+    // task that didn't start.
+    auto rangeCount = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                            (commits.size() + MIN_COMMITS_PER_RANGE - 1)
+                                                / MIN_COMMITS_PER_RANGE);
+    auto rangeSize = (commits.size() + rangeCount - 1) / rangeCount;
+    struct Validation
+    {
+        std::atomic<std::size_t> nextRange {0};
+        std::atomic<std::size_t> firstInvalid {std::numeric_limits<std::size_t>::max()};
+        std::vector<std::string> errors;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::size_t done {0};
+    };
+    auto validation = std::make_shared<Validation>();
+    validation->errors.resize(commits.size());
+    auto validateRanges = [&commits, rangeCount, rangeSize, validation, this] {
+        for (auto range = validation->nextRange++; range < rangeCount;
+             range = validation->nextRange++) {
+            auto end = std::min(commits.size(), (range + 1) * rangeSize);
+            // Later commits are useless once an earlier one is invalid
+            for (auto i = range * rangeSize; i < end and i < validation->firstInvalid; ++i) {
+                if (!validCommit(*commits[i], validation->errors[i])) {
+                    auto first = validation->firstInvalid.load();
+                    while (i < first and !validation->firstInvalid.compare_exchange_weak(first, i))
+                        ;
+                    break;
+                }
+            }
+            std::lock_guard<std::mutex> lk(validation->mtx);
+            validation->done++;
+            validation->cv.notify_all();
+        }
+    };
+    for (std::size_t i = 1; i < rangeCount; ++i)
+        dht::ThreadPool::computation().run(validateRanges);
+    validateRanges();
+    {
+        std::unique_lock<std::mutex> lk(validation->mtx);
+        validation->cv.wait(lk, [&] { return validation->done == rangeCount; });
+    }
+
+    // All the commits before the first invalid one are valid
+    auto firstInvalid = std::min(validation->firstInvalid.load(), commits.size());
+    for (std::size_t i = 0; i < firstInvalid; ++i)
+        if (shallow_.find(commits[i]->id) == shallow_.end())
+            validated_.emplace(commits[i]->id);
+    if (firstInvalid == commits.size() and shallow_.empty()) {
+        // The whole history of the newest commit is now valid
+        setValidatedHead(commitsToValidate.back().id);
+    }
+    saveValidated();
+
+    if (firstInvalid != commits.size()) {
+        if (auto shared = account_.lock()) {
+            emitSignal<DRing::ConversationSignal::OnConversationError>(
+                shared->getAccountID(), id_, EVALIDFETCH, validation->errors[firstInvalid]);
+        }
+        return false;
+    }
+    return true;
+}
+
+void
+ConversationRepository::Impl::loadValidated() const
+{
+    if (validatedLoaded_)
+        return;
+    validatedLoaded_ = true;
+    try {
+        auto file = fileutils::loadFile(dataPath() + DIR_SEPARATOR_STR + "validated");
+        msgpack::object_handle oh = msgpack::unpack((const char*) file.data(), file.size());
+        ValidatedCommits cache;
+        oh.get().convert(cache);
+        validatedHead_ = std::move(cache.head);
+        validated_ = std::move(cache.commits);
+    } catch (const std::exception& e) {
+        return;
+    }
+}
+
+void
+ConversationRepository::Impl::loadShallow() const
+{
+    shallow_.clear();
+    auto repo = repository();
+    if (!repo)
+        return;
+    // One commit id per line, written by libgit2
+    std::ifstream file(std::string(git_repository_path(repo.get())) + "shallow");
+    std::string line;
+    while (std::getline(file, line))
+        if (!line.empty())
+            shallow_.emplace(std::move(line));
+}
+
+void
+ConversationRepository::Impl::saveValidated() const
+{
+    auto path = dataPath();
+    if (path.empty())
+        return;
+    if (!fileutils::recursive_mkdir(path, 0700)) {
+        JAMI_ERR("Error when creating %s", path.c_str());
+        return;
+    }
+    std::ofstream file(path + DIR_SEPARATOR_STR + "validated", std::ios::trunc | std::ios::binary);
+    msgpack::pack(file, ValidatedCommits {validatedHead_, validated_});
+}
+
+bool
+ConversationRepository::Impl::isAncestor(git_repository* repo,
+                                         const std::string& ancestor,
+                                         const std::string& commitId) const
+{
+    git_oid oidAncestor, oidCommit;
+    if (git_oid_fromstr(&oidAncestor, ancestor.c_str()) < 0
+        or git_oid_fromstr(&oidCommit, commitId.c_str()) < 0)
+        return false;
+    return git_oid_equal(&oidAncestor, &oidCommit)
+           or git_graph_descendant_of(repo, &oidCommit, &oidAncestor) == 1;
+}
+
+bool
+ConversationRepository::Impl::isValidated(git_repository* repo, const std::string& commitId) const
+{
+    if (validated_.find(commitId) != validated_.end())
+        return true;
+    return repo and not validatedHead_.empty() and isAncestor(repo, commitId, validatedHead_);
+}
+
+void
+ConversationRepository::Impl::setValidatedHead(const std::string& head) const
+{
+    auto repo = repository();
+    if (!repo)
+        return;
+    // Only move forward, else the history of the previous head wouldn't be
+    // known as valid anymore. Commits of other branches stay in validated_
+    if (!validatedHead_.empty() and !isAncestor(repo.get(), validatedHead_, head))
+        return;
+    validatedHead_ = head;
+    // The ancestors of the head don't need an entry anymore
+    for (auto it = validated_.begin(); it != validated_.end();) {
+        if (isAncestor(repo.get(), *it, head))
+            it = validated_.erase(it);
+        else
+            ++it;
+    }
+}
+
+std::string
+ConversationRepository::Impl::dataPath() const
+{
+    auto shared = account_.lock();
+    if (!shared)
+        return {};
+    return fileutils::get_data_dir() + DIR_SEPARATOR_STR + shared->getAccountID()
+           + DIR_SEPARATOR_STR + "conversation_data" + DIR_SEPARATOR_STR + id_;
+}
+
 /////////////////////////////////////////////////////////////////////////////////
 
 ConversationRepository::ConversationRepository(const std::weak_ptr<JamiAccount>& account,
@@ -2737,7 +3268,7 @@ ConversationRepository::addMember(const std::string& uri)
 
     {
         std::lock_guard<std::mutex> lk(pimpl_->membersMtx_);
-        pimpl_->members_.emplace_back(ConversationMember {uri, MemberRole::INVITED});
+        pimpl_->setMemberRole(uri, MemberRole::INVITED);
     }
 
     Json::Value json;
@@ -2805,7 +3336,7 @@ ConversationRepository::amend(const std::string& id, const std::string& msg)
 }
 
 bool
-ConversationRepository::fetch(const std::string& remoteDeviceId)
+ConversationRepository::fetch(const std::string& remoteDeviceId, int depth)
 {
     // Fetch distant repository
     git_remote* remote_ptr = nullptr;
@@ -2848,7 +3379,23 @@ ConversationRepository::fetch(const std::string& remoteDeviceId)
         }
         return 0;
     };
-    if (git_remote_fetch(remote.get(), nullptr, &fetch_opts, "fetch") < 0) {
+#ifdef LIBGIT2_HAS_SHALLOW
+    fetch_opts.depth = depth;
+#else
+    (void) depth;
+#endif
+    static auto& fetchDuration = metrics::Registry::instance()
+                                     .histogram("jami_git_fetch_duration_seconds",
+                                                "Duration of the fetches of the conversations",
+                                                {.05, .1, .25, .5, 1, 2.5, 5, 10, 30, 60});
+    static auto& fetchErrors = metrics::Registry::instance()
+                                   .counter("jami_git_fetch_errors",
+                                            "Fetches of the conversations failed");
+    auto start = std::chrono::steady_clock::now();
+    auto ret = git_remote_fetch(remote.get(), nullptr, &fetch_opts, "fetch");
+    fetchDuration.observe(std::chrono::steady_clock::now() - start);
+    if (ret < 0) {
+        fetchErrors.add();
         const git_error* err = giterr_last();
         if (err) {
             JAMI_ERR("Could not fetch remote repository for conversation %s: %s",
@@ -2938,11 +3485,7 @@ std::vector<std::string>
 ConversationRepository::commitMessages(const std::vector<std::string>& msgs)
 {
     pimpl_->addUserDevice();
-    std::vector<std::string> ret;
-    ret.reserve(msgs.size());
-    for (const auto& msg : msgs)
-        ret.emplace_back(pimpl_->commit(msg));
-    return ret;
+    return pimpl_->commits(msgs);
 }
 
 std::vector<ConversationCommit>
@@ -3179,17 +3722,7 @@ ConversationRepository::join()
 
     {
         std::lock_guard<std::mutex> lk(pimpl_->membersMtx_);
-        auto updated = false;
-
-        for (auto& member : pimpl_->members_) {
-            if (member.uri == uri) {
-                updated = true;
-                member.role = MemberRole::MEMBER;
-                break;
-            }
-        }
-        if (!updated)
-            pimpl_->members_.emplace_back(ConversationMember {uri, MemberRole::MEMBER});
+        pimpl_->setMemberRole(uri, MemberRole::MEMBER);
     }
 
     return commitMessage(Json::writeString(wbuilder, json));
@@ -3266,9 +3799,13 @@ ConversationRepository::leave()
 
     {
         std::lock_guard<std::mutex> lk(pimpl_->membersMtx_);
-        std::remove_if(pimpl_->members_.begin(), pimpl_->members_.end(), [&](auto& member) {
-            return member.uri == account->getUsername();
-        });
+        auto& members = pimpl_->members_;
+        members.erase(std::remove_if(members.begin(),
+                                     members.end(),
+                                     [&](auto& member) {
+                                         return member.uri == account->getUsername();
+                                     }),
+                      members.end());
     }
 
     return commitMessage(Json::writeString(wbuilder, json));
@@ -3421,17 +3958,7 @@ ConversationRepository::Impl::resolveBan(const std::string& type, const std::str
             }
         }
         std::lock_guard<std::mutex> lk(membersMtx_);
-        auto updated = false;
-
-        for (auto& member : members_) {
-            if (member.uri == uri) {
-                updated = true;
-                member.role = MemberRole::BANNED;
-                break;
-            }
-        }
-        if (!updated)
-            members_.emplace_back(ConversationMember {uri, MemberRole::BANNED});
+        setMemberRole(uri, MemberRole::BANNED);
     }
     return true;
 }
@@ -3457,24 +3984,14 @@ ConversationRepository::Impl::resolveUnban(const std::string& type, const std::s
         return false;
     }
 
-    std::lock_guard<std::mutex> lk(membersMtx_);
-    auto updated = false;
-
     auto role = MemberRole::MEMBER;
     if (type == "invited")
         role = MemberRole::INVITED;
     else if (type == "admins")
         role = MemberRole::ADMIN;
 
-    for (auto& member : members_) {
-        if (member.uri == uri) {
-            updated = true;
-            member.role = role;
-            break;
-        }
-    }
-    if (!updated)
-        members_.emplace_back(ConversationMember {uri, role});
+    std::lock_guard<std::mutex> lk(membersMtx_);
+    setMemberRole(uri, role);
     return true;
 }
 
@@ -3554,7 +4071,212 @@ ConversationRepository::validFetch(const std::string& remoteDevice) const
 bool
 ConversationRepository::validClone() const
 {
-    return pimpl_->validCommits(logN("", 0));
+    // Oldest first, as for validFetch()
+    auto commits = logN("", 0);
+    std::reverse(std::begin(commits), std::end(commits));
+    return pimpl_->validCommits(commits);
+}
+
+bool
+ConversationRepository::isShallow() const
+{
+    auto repo = pimpl_->repository();
+    return repo and git_repository_is_shallow(repo.get()) == 1;
+}
+
+std::string
+ConversationRepository::shallowOrigin() const
+{
+    if (!isShallow())
+        return {};
+    auto repo = pimpl_->repository();
+    git_remote* remote_ptr = nullptr;
+    if (!repo || git_remote_lookup(&remote_ptr, repo.get(), "origin") < 0)
+        return {};
+    GitRemote remote {remote_ptr, git_remote_free};
+    // git://deviceId/conversationId
+    std::string_view url = git_remote_url(remote.get());
+    if (url.substr(0, 6) != "git://"sv)
+        return {};
+    url = url.substr(6);
+    return std::string(url.substr(0, url.find('/')));
+}
+
+struct ObjectFiles
+{
+    std::vector<std::pair<git_oid, std::string>> loose;
+    std::vector<std::string> packs;
+    uint64_t packSize {0};
+};
+
+static ObjectFiles
+listObjects(const std::string& objectsDir)
+{
+    ObjectFiles files;
+    for (const auto& dir : fileutils::readDirectory(objectsDir)) {
+        // Two hexadecimal digits, then the rest of the id
+        if (dir.size() != 2)
+            continue;
+        auto dirPath = objectsDir + dir;
+        for (const auto& file : fileutils::readDirectory(dirPath)) {
+            git_oid oid;
+            if (file.size() != GIT_OID_HEXSZ - 2
+                or git_oid_fromstr(&oid, (dir + file).c_str()) < 0)
+                continue;
+            files.loose.emplace_back(oid, dirPath + DIR_SEPARATOR_STR + file);
+        }
+    }
+    auto packDir = objectsDir + "pack";
+    for (const auto& file : fileutils::readDirectory(packDir)) {
+        if (file.size() > 5 and file.compare(file.size() - 5, 5, ".pack") == 0) {
+            auto path = packDir + DIR_SEPARATOR_STR + file;
+            files.packSize += std::max<int64_t>(0, fileutils::size(path));
+            files.packs.emplace_back(std::move(path));
+        }
+    }
+    return files;
+}
+
+static bool
+expired(const std::string& path)
+{
+    try {
+        return std::chrono::system_clock::now() - fileutils::writeTime(path) > PRUNE_EXPIRY;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+PackState
+ConversationRepository::packState() const
+{
+    auto repo = pimpl_->repository();
+    if (!repo)
+        return {};
+    auto files = listObjects(std::string(git_repository_path(repo.get())) + "objects"
+                             + DIR_SEPARATOR_STR);
+    return {files.loose.size(), files.packs.size(), files.packSize};
+}
+
+PackState
+ConversationRepository::maintain(const std::function<std::unique_lock<std::mutex>()>& lockWrites)
+{
+    auto repo = pimpl_->repository();
+    if (!repo)
+        return {};
+    auto objectsDir = std::string(git_repository_path(repo.get())) + "objects" + DIR_SEPARATOR_STR;
+    auto packDir = objectsDir + "pack";
+    auto files = listObjects(objectsDir);
+    auto full = files.packs.size() >= MAX_PACKS;
+    if (not full and files.loose.size() < MAX_LOOSE_OBJECTS)
+        return {files.loose.size(), files.packs.size(), files.packSize};
+
+    git_packbuilder* pb_ptr = nullptr;
+    if (git_packbuilder_new(&pb_ptr, repo.get()) < 0) {
+        JAMI_ERR("Couldn't create packbuilder for %s", pimpl_->id_.c_str());
+        return {files.loose.size(), files.packs.size(), files.packSize};
+    }
+    GitPackBuilder pb {pb_ptr, git_packbuilder_free};
+    if (full) {
+        // What the branches reference only
+        git_revwalk* walker_ptr = nullptr;
+        if (git_revwalk_new(&walker_ptr, repo.get()) < 0) {
+            JAMI_ERR("Couldn't create revwalker for %s", pimpl_->id_.c_str());
+            return {files.loose.size(), files.packs.size(), files.packSize};
+        }
+        GitRevWalker walker {walker_ptr, git_revwalk_free};
+        if (git_revwalk_push_glob(walker.get(), "refs/*") < 0
+            or git_packbuilder_insert_walk(pb.get(), walker.get()) < 0) {
+            JAMI_ERR("Couldn't walk the history of %s", pimpl_->id_.c_str());
+            return {files.loose.size(), files.packs.size(), files.packSize};
+        }
+    } else {
+        for (const auto& [oid, path] : files.loose) {
+            if (git_packbuilder_insert(pb.get(), &oid, nullptr) < 0) {
+                JAMI_ERR("Couldn't pack %s", git_oid_tostr_s(&oid));
+                return {files.loose.size(), files.packs.size(), files.packSize};
+            }
+        }
+    }
+    if (git_packbuilder_write(pb.get(), packDir.c_str(), 0, nullptr, nullptr) < 0) {
+        const git_error* err = giterr_last();
+        JAMI_ERR("Couldn't write pack for %s: %s", pimpl_->id_.c_str(), err ? err->message : "");
+        return {files.loose.size(), files.packs.size(), files.packSize};
+    }
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 5)
+    std::string newPack = packDir + DIR_SEPARATOR_STR + "pack-" + git_packbuilder_name(pb.get())
+                          + ".pack";
+#else
+    std::string newPack = packDir + DIR_SEPARATOR_STR + "pack-"
+                          + git_oid_tostr_s(git_packbuilder_hash(pb.get())) + ".pack";
+#endif
+
+    // The objects written meanwhile are loose and recent, so kept
+    std::unique_lock<std::mutex> lk;
+    if (lockWrites)
+        lk = lockWrites();
+    // Objects are removed once found in the packs
+    git_odb* odb_ptr = nullptr;
+    git_odb_backend* backend = nullptr;
+    if (git_odb_new(&odb_ptr) < 0)
+        return packState();
+    std::unique_ptr<git_odb, decltype(&git_odb_free)> packs {odb_ptr, git_odb_free};
+    if (git_odb_backend_pack(&backend, objectsDir.c_str()) < 0)
+        return packState();
+    if (git_odb_add_backend(packs.get(), backend, 1) < 0) {
+        backend->free(backend);
+        return packState();
+    }
+    for (const auto& [oid, path] : files.loose)
+        if (git_odb_exists(packs.get(), &oid) or (full and expired(path)))
+            fileutils::remove(path);
+    for (const auto& dir : fileutils::readDirectory(objectsDir))
+        if (dir.size() == 2 and fileutils::readDirectory(objectsDir + dir).empty())
+            fileutils::remove(objectsDir + dir);
+    if (full) {
+        for (const auto& pack : files.packs) {
+            auto base = pack.substr(0, pack.size() - 5);
+            if (pack == newPack or fileutils::isFile(base + ".keep") or not expired(pack))
+                continue;
+            fileutils::remove(base + ".idx");
+            fileutils::remove(pack);
+        }
+    }
+
+    if (lk)
+        lk.unlock();
+
+    auto state = packState();
+    JAMI_DBG("Repository %s maintained: %zu loose objects, %zu packs (%llu bytes)",
+             pimpl_->id_.c_str(),
+             state.looseObjects,
+             state.packs,
+             static_cast<unsigned long long>(state.packSize));
+    return state;
+}
+
+bool
+ConversationRepository::backfill(const std::string& remoteDeviceId)
+{
+#ifdef LIBGIT2_HAS_SHALLOW
+    if (!isShallow())
+        return true;
+    if (!fetch(remoteDeviceId, GIT_FETCH_DEPTH_UNSHALLOW))
+        return false;
+    {
+        // The index was built without the older commits
+        std::lock_guard<std::mutex> lk(pimpl_->logIndexMtx_);
+        pimpl_->logIndex_.reset();
+        pimpl_->searchIndex_.reset();
+        fileutils::remove(pimpl_->dataPath() + DIR_SEPARATOR_STR + "log_index");
+        fileutils::remove(pimpl_->dataPath() + DIR_SEPARATOR_STR + "search_index");
+    }
+    // Also validates the trees of the previous shallow commits
+    return validClone();
+#else
+    (void) remoteDeviceId;
+    return true;
+#endif
 }
 
 void
@@ -3583,6 +4305,12 @@ ConversationRepository::members() const
     return pimpl_->members();
 }
 
+std::optional<MemberRole>
+ConversationRepository::memberRole(std::string_view uri) const
+{
+    return pimpl_->memberRole(uri);
+}
+
 std::vector<std::string>
 ConversationRepository::memberUris(std::string_view filter,
                                    const std::set<MemberRole>& filteredRoles) const
@@ -3719,7 +4447,7 @@ ConversationRepository::infos() const
             std::map<std::string, std::string> result;
             if (fileutils::isFile(profilePath)) {
                 auto content = fileutils::loadTextFile(profilePath);
-                result = ConversationRepository::infosFromVCard(vCard::utils::toMap(content));
+                result = ConversationRepository::infosFromVCard(content);
             }
             result["mode"] = std::to_string(static_cast<int>(mode()));
             return result;
@@ -3730,17 +4458,22 @@ ConversationRepository::infos() const
 }
 
 std::map<std::string, std::string>
-ConversationRepository::infosFromVCard(std::map<std::string, std::string>&& details)
+ConversationRepository::infosFromVCard(std::string_view content)
 {
     std::map<std::string, std::string> result;
-    for (auto&& [k, v] : details) {
-        if (k == vCard::Property::FORMATTED_NAME) {
-            result["title"] = std::move(v);
-        } else if (k == vCard::Property::DESCRIPTION) {
-            result["description"] = std::move(v);
-        } else if (k.find(vCard::Property::PHOTO) == 0) {
-            result["avatar"] = std::move(v);
+    vCard::utils::Parser parser(content);
+    while (auto field = parser.next()) {
+        const char* info = nullptr;
+        if (field->key == vCard::Property::FORMATTED_NAME) {
+            info = "title";
+        } else if (field->key == vCard::Property::DESCRIPTION) {
+            info = "description";
+        } else if (field->name() == vCard::Property::PHOTO) {
+            info = "avatar";
         }
+        // As toMap(), the first occurrence of a field is kept
+        if (info)
+            result.emplace(info, field->value);
     }
     return result;
 }
@@ -3786,4 +4519,33 @@ ConversationRepository::convCommitToMap(const std::vector<ConversationCommit>& c
     return result;
 }
 
+DRing::PackedMessages
+ConversationRepository::convCommitsToPacked(const std::vector<ConversationCommit>& commits) const
+{
+    DRing::PackedMessages result;
+    result.messages.reserve(commits.size() + 1);
+    for (const auto& commit : commits) {
+        auto fields = result.fields.size();
+        auto dataSize = result.data.size();
+        auto field = [&](std::string_view key, std::string_view value) {
+            auto k = std::find(result.keys.begin(), result.keys.end(), key);
+            if (k == result.keys.end())
+                k = result.keys.emplace(result.keys.end(), key);
+            result.fields.insert(result.fields.end(),
+                                 {static_cast<uint32_t>(k - result.keys.begin()),
+                                  static_cast<uint32_t>(result.data.size()),
+                                  static_cast<uint32_t>(value.size())});
+            result.data += value;
+        };
+        auto valid = pimpl_->convCommitFields(commit, field);
+        if (valid) {
+            result.messages.emplace_back(result.fields.size() / 3);
+        } else {
+            result.fields.resize(fields);
+            result.data.resize(dataSize);
+        }
+    }
+    return result;
+}
+
 } // namespace jami
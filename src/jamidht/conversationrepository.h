@@ -17,6 +17,8 @@
  */
 #pragma once
 
+#include <functional>
+#include <mutex>
 #include <optional>
 #include <git2.h>
 #include <memory>
@@ -25,6 +27,7 @@
 #include <vector>
 
 #include "def.h"
+#include "jami/conversation_interface.h"
 
 using GitPackBuilder = std::unique_ptr<git_packbuilder, decltype(&git_packbuilder_free)>;
 using GitRepository = std::unique_ptr<git_repository, decltype(&git_repository_free)>;
@@ -110,6 +113,24 @@ struct ConversationMember
     }
 };
 
+/**
+ * Object storage of a repository, see ConversationRepository::maintain()
+ */
+struct PackState
+{
+    std::size_t looseObjects {0};
+    std::size_t packs {0};
+    // Size of the packs, in bytes
+    uint64_t packSize {0};
+
+    std::map<std::string, std::string> map() const
+    {
+        return {{"looseObjects", std::to_string(looseObjects)},
+                {"packs", std::to_string(packs)},
+                {"packSize", std::to_string(packSize)}};
+    }
+};
+
 /**
  * This class gives access to the git repository that represents the conversation
  */
@@ -134,12 +155,13 @@ public:
      * @param account           The account getting the conversation
      * @param deviceId          Remote device
      * @param conversationId    Conversation to clone
-     * @param socket            Socket used to clone
+     * @param depth             Commits to clone, 0 for the whole history
      */
     static DRING_TESTABLE std::unique_ptr<ConversationRepository> cloneConversation(
         const std::weak_ptr<JamiAccount>& account,
         const std::string& deviceId,
-        const std::string& conversationId);
+        const std::string& conversationId,
+        unsigned depth = 0);
 
     /**
      * Open a conversation repository for an account and an id
@@ -161,9 +183,10 @@ public:
      * @note This will use the socket registered for the conversation with JamiAccount::addGitSocket()
      * @note will create a remote identified by the deviceId
      * @param remoteDeviceId    Remote device id to fetch
+     * @param depth             Commits to fetch, 0 for the new commits
      * @return if the operation was successful
      */
-    bool fetch(const std::string& remoteDeviceId);
+    bool fetch(const std::string& remoteDeviceId, int depth = 0);
 
     /**
      * Retrieve remote head. Can be useful after a fetch operation
@@ -186,6 +209,11 @@ public:
      */
     std::string commitMessage(const std::string& msg);
 
+    /**
+     * Add consecutive commits, sharing the same tree, with one update of main
+     * @param msgs    The commit messages, in order
+     * @return the messages ids, <empty> for the failed ones
+     */
     std::vector<std::string> commitMessages(const std::vector<std::string>& msgs);
 
     /**
@@ -325,6 +353,34 @@ public:
         const std::string& remoteDevice) const;
     bool validClone() const;
 
+    /**
+     * @return if the history was cloned with a depth, and not backfilled yet
+     */
+    bool isShallow() const;
+    /**
+     * @return the device a shallow clone was cloned from, empty if the history is complete
+     */
+    std::string shallowOrigin() const;
+    /**
+     * Fetch the older commits of a shallow clone, then validate the whole history
+     * @note This will use the socket registered for the conversation with JamiAccount::addGitSocket()
+     * @param remoteDeviceId    Remote device id to fetch
+     * @return if the operation was successful
+     */
+    bool backfill(const std::string& remoteDeviceId);
+
+    PackState packState() const;
+    /**
+     * Pack the loose objects once they are too many, as each message is written as loose
+     * objects. Once the packs are too many, the reachable objects are packed into one and the
+     * older packs and unreachable loose objects are pruned, as git gc does.
+     * @param lockWrites    Called once the pack is written, to prune the objects while the
+     *                      history is not written (see Conversation::maintain()). The pack is
+     *                      built without it, the history can be written meanwhile.
+     * @return the state after the maintenance
+     */
+    PackState maintain(const std::function<std::unique_lock<std::mutex>()>& lockWrites = {});
+
     /**
      * Delete branch with remote
      * @param remoteDevice
@@ -343,6 +399,13 @@ public:
      */
     std::vector<ConversationMember> members() const;
 
+    /**
+     * Role of a member, from the members in memory, without reading the repository
+     * @param uri
+     * @return the role, or nullopt if uri is not in the conversation
+     */
+    std::optional<MemberRole> memberRole(std::string_view uri) const;
+
     /**
      * @param filter           If we want to remove one member
      * @param filteredRoles    If we want to ignore some roles
@@ -375,8 +438,11 @@ public:
      * @return infos
      */
     std::map<std::string, std::string> infos() const;
-    static std::map<std::string, std::string> infosFromVCard(
-        std::map<std::string, std::string>&& details);
+    /**
+     * Infos (title, description, avatar) of a vCard, the other fields being skipped
+     * @param content   The vCard
+     */
+    static std::map<std::string, std::string> infosFromVCard(std::string_view content);
 
     /**
      * Retrieve account's URI from deviceId
@@ -391,6 +457,10 @@ public:
         const std::vector<ConversationCommit>& commits) const;
     std::optional<std::map<std::string, std::string>> convCommitToMap(
         const ConversationCommit& commit) const;
+    /**
+     * Same as convCommitToMap(), without a map nor a string per field
+     */
+    DRing::PackedMessages convCommitsToPacked(const std::vector<ConversationCommit>& commits) const;
 
     /**
      * Get current HEAD hash
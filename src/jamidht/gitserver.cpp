@@ -24,11 +24,14 @@
 #include "multiplexed_socket.h"
 #include "opendht/thread_pool.h"
 
+#include <algorithm>
 #include <charconv>
 #include <ctime>
 #include <fstream>
 #include <git2.h>
 #include <iomanip>
+#include <list>
+#include <set>
 
 using namespace std::string_view_literals;
 constexpr auto FLUSH_PKT = "0000"sv;
@@ -36,11 +39,62 @@ constexpr auto NAK_PKT = "0008NAK\n"sv;
 constexpr auto DONE_PKT = "0009done\n"sv;
 constexpr auto WANT_CMD = "want"sv;
 constexpr auto HAVE_CMD = "have"sv;
+constexpr auto DEEPEN_CMD = "deepen"sv;
+constexpr auto SHALLOW_CMD = "shallow"sv;
+// jami-deepen: older servers announce "shallow" but ignore "deepen", see gittransport.h
 constexpr auto SERVER_CAPABILITIES
-    = " HEAD\0side-band side-band-64k shallow no-progress include-tag"sv;
+    = " HEAD\0side-band side-band-64k shallow no-progress include-tag jami-deepen"sv;
 
 namespace jami {
 
+/**
+ * Packs recently sent. When a device sends a new commit, all the devices of the
+ * conversation fetch it, with the same common commits, so the same pack.
+ */
+class PackCache
+{
+public:
+    static PackCache& instance()
+    {
+        static PackCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const std::string> get(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto it = std::find_if(packs_.begin(), packs_.end(), [&](const auto& entry) {
+            return entry.first == key;
+        });
+        if (it == packs_.end())
+            return {};
+        packs_.splice(packs_.begin(), packs_, it);
+        return it->second;
+    }
+
+    void put(const std::string& key, const std::shared_ptr<const std::string>& pack)
+    {
+        if (pack->size() > MAX_PACK_SIZE)
+            return;
+        std::lock_guard<std::mutex> lk(mutex_);
+        packs_.emplace_front(key, pack);
+        size_ += pack->size();
+        while (size_ > MAX_CACHE_SIZE || packs_.size() > MAX_PACKS) {
+            size_ -= packs_.back().second->size();
+            packs_.pop_back();
+        }
+    }
+
+private:
+    static constexpr std::size_t MAX_PACKS {32};
+    static constexpr std::size_t MAX_PACK_SIZE {1024 * 1024};
+    static constexpr std::size_t MAX_CACHE_SIZE {8 * 1024 * 1024};
+
+    std::mutex mutex_;
+    std::list<std::pair<std::string, std::shared_ptr<const std::string>>> packs_; // Most recent first
+    std::size_t size_ {0};
+};
+
 class GitServer::Impl
 {
 public:
@@ -80,14 +134,33 @@ public:
     void ACKCommon();
     bool ACKFirst();
     void sendPackData();
+    /**
+     * Send the shallow commits of a deepened request, and the client's ones which are not
+     * shallow anymore, then compute the commits to send
+     */
+    bool sendShallowUpdate();
+    std::shared_ptr<const std::string> buildPack(git_repository* repo);
+    std::shared_ptr<const std::string> buildShallowPack(git_repository* repo, git_packbuilder* pb);
     std::map<std::string, std::string> getParameters(const std::string& pkt_line);
+    /**
+     * The repository is kept open during a negotiation
+     */
+    git_repository* repository();
 
     std::string repositoryId_ {};
     std::string repository_ {};
     std::shared_ptr<ChannelSocket> socket_ {};
+    GitRepository repo_ {nullptr, git_repository_free};
     std::string wantedReference_ {};
+    std::vector<std::string> wantedRefs_ {};
     std::string common_ {};
-    std::vector<std::string> haveRefs_ {};
+    std::vector<std::string> haveRefs_ {}; // Only the commits we have too
+    // Shallow fetches: commits from the wanted ones, 0 for their whole history
+    int depth_ {0};
+    std::vector<std::string> clientShallows_ {};
+    bool shallowSent_ {false};
+    // Within the depth, from the wanted commits
+    std::vector<git_oid> deepened_ {};
     std::string cachedPkt_ {};
     std::mutex destroyMtx_ {};
     std::atomic_bool isDestroying_ {false};
@@ -143,32 +216,37 @@ GitServer::Impl::parseOrder(const uint8_t* buf, std::size_t len)
     } else if (pkt.find(WANT_CMD) == 4) {
         // Reference:
         // https://github.com/git/git/blob/master/Documentation/technical/pack-protocol.txt#L229
-        // TODO can have more want
         auto content = pkt.substr(5, pkt_len - 5);
         auto commit = content.substr(4, 40);
         wantedReference_ = commit;
+        if (std::find(wantedRefs_.begin(), wantedRefs_.end(), commit) == wantedRefs_.end())
+            wantedRefs_.emplace_back(commit);
         JAMI_INFO("Peer want ref: %s", wantedReference_.c_str());
     } else if (pkt.find(HAVE_CMD) == 4) {
         auto content = pkt.substr(5, pkt_len - 5);
         auto commit = content.substr(4, 40);
-        haveRefs_.emplace_back(commit);
-        if (common_.empty()) {
-            // Detect first common commit
-            // Reference:
-            // https://github.com/git/git/blob/master/Documentation/technical/pack-protocol.txt#L390
-            // TODO do not open repository every time
-            git_repository* repo;
-            if (git_repository_open(&repo, repository_.c_str()) != 0) {
-                JAMI_WARN("Couldn't open %s", repository_.c_str());
-                return !cachedPkt_.empty();
-            }
-            GitRepository rep {repo, git_repository_free};
-            git_oid commit_id;
-            if (git_oid_fromstr(&commit_id, commit.c_str()) == 0) {
-                // Reference found
+        // Only the commits we have are common, and their history is not sent.
+        // Reference:
+        // https://github.com/git/git/blob/master/Documentation/technical/pack-protocol.txt#L390
+        git_oid commit_id;
+        git_commit* commit_ptr = nullptr;
+        auto repo = repository();
+        if (repo && git_oid_fromstr(&commit_id, commit.c_str()) == 0
+            && git_commit_lookup(&commit_ptr, repo, &commit_id) == 0) {
+            git_commit_free(commit_ptr);
+            haveRefs_.emplace_back(commit);
+            if (common_.empty())
                 common_ = commit;
-            }
         }
+    } else if (pkt.find(DEEPEN_CMD) == 4) {
+        // Reference:
+        // https://github.com/git/git/blob/master/Documentation/technical/pack-protocol.txt#L245
+        auto depth = pkt.substr(4 + DEEPEN_CMD.size() + 1);
+        std::from_chars(depth.data(), depth.data() + depth.size(), depth_);
+        JAMI_INFO("Peer wants %d commits", depth_);
+    } else if (pkt.find(SHALLOW_CMD) == 4) {
+        // A shallow commit of the peer, whose parents it doesn't have
+        clientShallows_.emplace_back(pkt.substr(4 + SHALLOW_CMD.size() + 1, 40));
     } else if (pkt == DONE_PKT) {
         // Reference:
         // https://github.com/git/git/blob/master/Documentation/technical/pack-protocol.txt#L390 Do
@@ -183,7 +261,11 @@ GitServer::Impl::parseOrder(const uint8_t* buf, std::size_t len)
         if (sendData)
             sendPackData();
     } else if (pkt == FLUSH_PKT) {
-        if (!haveRefs_.empty()) {
+        if (depth_ > 0 && !shallowSent_) {
+            // End of the wanted commits: the shallow update comes before the negotiation
+            shallowSent_ = true;
+            sendShallowUpdate();
+        } else if (!haveRefs_.empty()) {
             // Reference:
             // https://github.com/git/git/blob/master/Documentation/technical/pack-protocol.txt#L390
             // Do not do multi-ack, just send ACK + pack file In case of no common base ACK
@@ -318,82 +400,209 @@ GitServer::Impl::NAK()
     return true;
 }
 
-void
-GitServer::Impl::sendPackData()
+git_repository*
+GitServer::Impl::repository()
 {
-    git_repository* repo_ptr;
-    if (git_repository_open(&repo_ptr, repository_.c_str()) != 0) {
-        JAMI_WARN("Couldn't open %s", repository_.c_str());
-        return;
+    if (!repo_) {
+        git_repository* repo_ptr = nullptr;
+        if (git_repository_open(&repo_ptr, repository_.c_str()) != 0) {
+            JAMI_WARN("Couldn't open %s", repository_.c_str());
+            return nullptr;
+        }
+        repo_.reset(repo_ptr);
+    }
+    return repo_.get();
+}
+
+bool
+GitServer::Impl::sendShallowUpdate()
+{
+    auto repo = repository();
+    if (!repo)
+        return false;
+
+    // Generations of the history of the wanted commits, walked up to the depth
+    std::set<std::string> seen;
+    std::vector<git_oid> generation;
+    git_oid oid;
+    for (const auto& want : wantedRefs_)
+        if (git_oid_fromstr(&oid, want.c_str()) == 0 && seen.emplace(want).second)
+            generation.emplace_back(oid);
+    std::set<std::string> clientShallows(clientShallows_.begin(), clientShallows_.end());
+    std::stringstream packet;
+    auto addLine = [&](std::string_view cmd, const git_oid& id) {
+        packet << std::setw(4) << std::setfill('0') << std::hex
+               << ((4 + cmd.size() + 1 + GIT_OID_HEXSZ + 1) & 0x0FFFF);
+        packet << cmd << " " << git_oid_tostr_s(&id) << "\n";
+    };
+    deepened_.clear();
+    for (int depth = 1; !generation.empty(); ++depth) {
+        std::vector<git_oid> next;
+        for (const auto& id : generation) {
+            git_commit* commit_ptr = nullptr;
+            if (git_commit_lookup(&commit_ptr, repo, &id) < 0)
+                continue;
+            GitCommit commit {commit_ptr, git_commit_free};
+            deepened_.emplace_back(id);
+            auto parents = git_commit_parentcount(commit.get());
+            std::string idStr = git_oid_tostr_s(&id);
+            if (depth == depth_) {
+                // The client doesn't get the parents
+                if (parents > 0 && !clientShallows.count(idStr))
+                    addLine(SHALLOW_CMD, id);
+                continue;
+            }
+            if (parents > 0 && clientShallows.count(idStr))
+                addLine("unshallow"sv, id);
+            for (unsigned i = 0; i < parents; ++i) {
+                auto parent = git_commit_parent_id(commit.get(), i);
+                if (seen.emplace(git_oid_tostr_s(parent)).second)
+                    next.emplace_back(*parent);
+            }
+        }
+        generation = std::move(next);
     }
-    GitRepository repo {repo_ptr, git_repository_free};
+    packet << FLUSH_PKT;
 
+    auto toSend = packet.str();
+    std::error_code ec;
+    socket_->write(reinterpret_cast<const unsigned char*>(toSend.c_str()), toSend.size(), ec);
+    if (ec) {
+        JAMI_WARN("Couldn't send data for %s: %s", repository_.c_str(), ec.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const std::string>
+GitServer::Impl::buildPack(git_repository* repo)
+{
     git_packbuilder* pb_ptr;
-    if (git_packbuilder_new(&pb_ptr, repo.get()) != 0) {
+    if (git_packbuilder_new(&pb_ptr, repo) != 0) {
         JAMI_WARN("Couldn't open packbuilder for %s", repository_.c_str());
-        return;
+        return {};
     }
     GitPackBuilder pb {pb_ptr, git_packbuilder_free};
 
-    std::string fetched = wantedReference_;
-    git_oid oid;
-    if (git_oid_fromstr(&oid, wantedReference_.c_str()) < 0) {
-        JAMI_ERR("Cannot get reference for commit %s", wantedReference_.c_str());
-        return;
-    }
+    if (depth_ > 0)
+        return buildShallowPack(repo, pb.get());
 
     git_revwalk* walker_ptr = nullptr;
-    if (git_revwalk_new(&walker_ptr, repo.get()) < 0 || git_revwalk_push(walker_ptr, &oid) < 0) {
-        if (walker_ptr)
-            git_revwalk_free(walker_ptr);
-        return;
+    if (git_revwalk_new(&walker_ptr, repo) < 0) {
+        JAMI_WARN("Couldn't init revwalker for %s", repository_.c_str());
+        return {};
     }
     GitRevWalker walker {walker_ptr, git_revwalk_free};
-    git_revwalk_sorting(walker.get(), GIT_SORT_TOPOLOGICAL);
-    // Add first commit
-    std::set<std::string> parents;
-    auto haveCommit = false;
-
-    while (!git_revwalk_next(&oid, walker.get())) {
-        // log until have refs
-        std::string id = git_oid_tostr_s(&oid);
-        haveCommit |= std::find(haveRefs_.begin(), haveRefs_.end(), id) != haveRefs_.end();
-        auto itParents = std::find(parents.begin(), parents.end(), id);
-        if (itParents != parents.end())
-            parents.erase(itParents);
-        if (haveCommit && parents.size() == 0 /* We are sure that all commits are there */)
-            break;
-        if (git_packbuilder_insert_commit(pb.get(), &oid) != 0) {
-            JAMI_WARN("Couldn't open insert commit %s for %s",
-                      git_oid_tostr_s(&oid),
-                      repository_.c_str());
-            return;
+    git_oid oid;
+    for (const auto& want : wantedRefs_) {
+        if (git_oid_fromstr(&oid, want.c_str()) < 0 || git_revwalk_push(walker.get(), &oid) < 0) {
+            JAMI_ERR("Cannot get reference for commit %s", want.c_str());
+            return {};
         }
+    }
+    // Everything reachable from the common commits is already on the peer
+    for (const auto& have : haveRefs_) {
+        if (git_oid_fromstr(&oid, have.c_str()) == 0)
+            git_revwalk_hide(walker.get(), &oid);
+    }
+    // Only inserts the objects not reachable from the hidden commits
+    if (git_packbuilder_insert_walk(pb.get(), walker.get()) != 0) {
+        JAMI_WARN("Couldn't insert commits for %s", repository_.c_str());
+        return {};
+    }
 
-        // Get next commit to pack
-        git_commit* commit_ptr;
-        if (git_commit_lookup(&commit_ptr, repo.get(), &oid) < 0) {
-            JAMI_ERR("Could not look up current commit");
-            return;
-        }
+    git_buf data = {};
+    if (git_packbuilder_write_buf(&data, pb.get()) != 0) {
+        JAMI_WARN("Couldn't write pack data for %s", repository_.c_str());
+        return {};
+    }
+    auto pack = std::make_shared<const std::string>(data.ptr, data.size);
+    git_buf_dispose(&data);
+    return pack;
+}
+
+std::shared_ptr<const std::string>
+GitServer::Impl::buildShallowPack(git_repository* repo, git_packbuilder* pb)
+{
+    // The commits the client has: the common ones and their history, down to its shallow
+    // commits, whose parents it doesn't have
+    std::set<std::string> clientShallows(clientShallows_.begin(), clientShallows_.end());
+    std::set<std::string> common;
+    std::vector<std::string> toWalk(haveRefs_.begin(), haveRefs_.end());
+    while (!toWalk.empty()) {
+        auto id = std::move(toWalk.back());
+        toWalk.pop_back();
+        if (!common.emplace(id).second || clientShallows.count(id))
+            continue;
+        git_oid oid;
+        git_commit* commit_ptr = nullptr;
+        if (git_oid_fromstr(&oid, id.c_str()) < 0 || git_commit_lookup(&commit_ptr, repo, &oid) < 0)
+            continue;
         GitCommit commit {commit_ptr, git_commit_free};
-        auto parentsCount = git_commit_parentcount(commit.get());
-        for (unsigned int p = 0; p < parentsCount; ++p) {
-            // make sure to explore all branches
-            const git_oid* pid = git_commit_parent_id(commit.get(), p);
-            if (pid)
-                parents.emplace(git_oid_tostr_s(pid));
+        for (unsigned i = 0; i < git_commit_parentcount(commit.get()); ++i)
+            toWalk.emplace_back(git_oid_tostr_s(git_commit_parent_id(commit.get(), i)));
+    }
+
+    // Each commit with its tree, the objects already in the pack being skipped
+    for (const auto& id : deepened_) {
+        if (common.count(git_oid_tostr_s(&id)))
+            continue;
+        if (git_packbuilder_insert_commit(pb, &id) != 0) {
+            JAMI_WARN("Couldn't insert commit for %s", repository_.c_str());
+            return {};
         }
     }
 
     git_buf data = {};
-    if (git_packbuilder_write_buf(&data, pb.get()) != 0) {
+    if (git_packbuilder_write_buf(&data, pb) != 0) {
         JAMI_WARN("Couldn't write pack data for %s", repository_.c_str());
+        return {};
+    }
+    auto pack = std::make_shared<const std::string>(data.ptr, data.size);
+    git_buf_dispose(&data);
+    return pack;
+}
+
+void
+GitServer::Impl::sendPackData()
+{
+    if (wantedRefs_.empty()) {
+        JAMI_ERR("No commit wanted for %s", repository_.c_str());
         return;
     }
+    auto repo = repository();
+    if (!repo)
+        return;
+    std::string fetched = wantedReference_;
+
+    // The pack only depends on the wanted and common commits
+    std::sort(wantedRefs_.begin(), wantedRefs_.end());
+    std::sort(haveRefs_.begin(), haveRefs_.end());
+    haveRefs_.erase(std::unique(haveRefs_.begin(), haveRefs_.end()), haveRefs_.end());
+    auto key = repository_;
+    for (const auto& want : wantedRefs_)
+        key += " " + want;
+    key += " -";
+    for (const auto& have : haveRefs_)
+        key += " " + have;
+    if (depth_ > 0) {
+        std::sort(clientShallows_.begin(), clientShallows_.end());
+        key += " - " + std::to_string(depth_);
+        for (const auto& shallow : clientShallows_)
+            key += " " + shallow;
+    }
+
+    auto pack = PackCache::instance().get(key);
+    if (!pack) {
+        pack = buildPack(repo);
+        if (!pack)
+            return;
+        PackCache::instance().put(key, pack);
+    }
+    repo_.reset();
 
     std::size_t sent = 0;
-    std::size_t len = data.size;
+    std::size_t len = pack->size();
     std::error_code ec;
     do {
         // cf https://github.com/git/git/blob/master/Documentation/technical/pack-protocol.txt#L166
@@ -402,7 +611,7 @@ GitServer::Impl::sendPackData()
         std::size_t pkt_size = std::min(static_cast<std::size_t>(65515), len - sent);
         std::stringstream toSend;
         toSend << std::setw(4) << std::setfill('0') << std::hex << ((pkt_size + 5) & 0x0FFFF);
-        toSend << "\x1" << std::string_view(data.ptr + sent, pkt_size);
+        toSend << "\x1" << std::string_view(pack->data() + sent, pkt_size);
         std::string toSendStr = toSend.str();
 
         socket_->write(reinterpret_cast<const unsigned char*>(toSendStr.c_str()),
@@ -410,12 +619,10 @@ GitServer::Impl::sendPackData()
                        ec);
         if (ec) {
             JAMI_WARN("Couldn't send data for %s: %s", repository_.c_str(), ec.message().c_str());
-            git_buf_dispose(&data);
             return;
         }
         sent += pkt_size;
     } while (sent < len);
-    git_buf_dispose(&data);
 
     // And finish by a little FLUSH
     socket_->write(reinterpret_cast<const uint8_t*>(FLUSH_PKT.data()), FLUSH_PKT.size(), ec);
@@ -426,7 +633,12 @@ GitServer::Impl::sendPackData()
     // Clear sent data
     haveRefs_.clear();
     wantedReference_.clear();
+    wantedRefs_.clear();
     common_.clear();
+    depth_ = 0;
+    clientShallows_.clear();
+    shallowSent_ = false;
+    deepened_.clear();
     if (onFetchedCb_)
         onFetchedCb_(fetched);
 }
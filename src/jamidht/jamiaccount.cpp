@@ -41,6 +41,7 @@
 #include "conversation_channel_handler.h"
 #include "sync_channel_handler.h"
 #include "transfer_channel_handler.h"
+#include "channel_handler_registry.h"
 
 #include "sip/sdp.h"
 #include "sip/sipvoiplink.h"
@@ -60,6 +61,7 @@
 
 #include "account_schema.h"
 #include "manager.h"
+#include "network_monitor.h"
 #include "utf8_utils.h"
 
 #ifdef ENABLE_PLUGIN
@@ -114,12 +116,41 @@ static constexpr const char MIME_TYPE_IM_COMPOSING[] {"application/im-iscomposin
 static constexpr const char MIME_TYPE_INVITE[] {"application/invite"};
 static constexpr const char MIME_TYPE_INVITE_JSON[] {"application/invite+json"};
 static constexpr const char MIME_TYPE_GIT[] {"application/im-gitmessage-id"};
+static constexpr const char MIME_TYPE_IM_BATCH[] {"application/im-batch+msgpack"};
 static constexpr const char FILE_URI[] {"file://"};
 static constexpr const char VCARD_URI[] {"vcard://"};
 static constexpr const char DATA_TRANSFER_URI[] {"data-transfer://"};
 static constexpr const char DEVICE_ID_PATH[] {"ring_device"};
 static constexpr std::chrono::steady_clock::duration COMPOSING_TIMEOUT {std::chrono::seconds(12)};
 
+// Presence: at most MAX_PRESENCE_LISTENS buddies are listened on the DHT, the others polled
+static constexpr size_t MAX_PRESENCE_LISTENS {256};
+static constexpr size_t PRESENCE_LISTENS_PER_UPDATE {16};
+static constexpr size_t PRESENCE_POLLS_PER_UPDATE {4};
+static constexpr std::chrono::seconds PRESENCE_STAGGER_DELAY {1};
+static constexpr std::chrono::seconds PRESENCE_UPDATE_PERIOD {15};
+static constexpr std::chrono::minutes PRESENCE_POLL_PERIOD {10};
+
+// Messages put on the DHT at once, a value being limited to 64 KiB
+static constexpr size_t MAX_BATCH_MESSAGES {32};
+static constexpr size_t MAX_BATCH_SIZE {32 * 1024};
+
+// Push notifications received within the window are handled at once
+static constexpr std::chrono::milliseconds PUSH_BATCH_WINDOW {300};
+// For the values got from the proxy to start their connections and fetches
+static constexpr std::chrono::seconds PUSH_SETTLE_DELAY {2};
+
+/**
+ * A message of a batch (MIME_TYPE_IM_BATCH), acknowledged with the batch
+ */
+struct BatchedMessage
+{
+    dht::Value::Id id;
+    std::string datatype;
+    std::string msg;
+    MSGPACK_DEFINE_MAP(id, datatype, msg)
+};
+
 struct PendingConfirmation
 {
     std::mutex lock;
@@ -185,12 +216,40 @@ struct JamiAccount::BuddyInfo
     /* number of devices connected on the DHT */
     uint32_t devices_cnt {};
 
-    /* The disposable object to update buddy info */
+    /* The disposable object to update buddy info, valid while listening */
     std::future<size_t> listenToken;
 
+    /* Incremented for each listen, to ignore the values of the ones cancelled */
+    unsigned listenId {0};
+
+    /* A SIP connection is open with one of the devices */
+    bool connected {false};
+
+    /* Presence last notified */
+    bool online {false};
+
+    /* Last message or connection, the most active buddies being listened */
+    std::chrono::steady_clock::time_point lastActive {};
+
+    /* Last presence poll, for the buddies not listened */
+    std::chrono::steady_clock::time_point lastPoll {};
+
     BuddyInfo(dht::InfoHash id)
         : id(id)
     {}
+
+    /**
+     * Set online from the devices and connections
+     * @return true if it changed
+     */
+    bool updateOnline()
+    {
+        bool isOnline = devices_cnt > 0 or connected;
+        if (isOnline == online)
+            return false;
+        online = isOnline;
+        return true;
+    }
 };
 
 struct JamiAccount::PendingCall
@@ -273,6 +332,18 @@ parseJamiUri(std::string_view toUrl)
     return toUri;
 }
 
+/**
+ * Payloads of a text message received on the DHT
+ */
+static std::map<std::string, std::string>
+textPayloads(const std::string& datatype, const std::string& msg)
+{
+    auto type = utf8_make_valid(datatype);
+    if (type.empty())
+        type = "text/plain";
+    return {{std::move(type), utf8_make_valid(msg)}};
+}
+
 static constexpr const char*
 dhtStatusStr(dht::NodeStatus status)
 {
@@ -299,12 +370,13 @@ JamiAccount::createIceTransport(const Args&... args)
 
 JamiAccount::JamiAccount(const std::string& accountID, bool /* presenceEnabled */)
     : SIPAccountBase(accountID)
-    , dht_(new dht::DhtRunner)
+    , dht_(std::make_shared<AccountDht>())
     , idPath_(fileutils::get_data_dir() + DIR_SEPARATOR_STR + getAccountID())
     , cachePath_(fileutils::get_cache_dir() + DIR_SEPARATOR_STR + getAccountID())
     , dataPath_(cachePath_ + DIR_SEPARATOR_STR "values")
     , dhtPeerConnector_ {}
     , connectionManager_ {}
+    , gitStrand_(Manager::instance().workers())
 {
     // Force the SFL turn server if none provided yet
     turnServer_ = DEFAULT_TURN_SERVER;
@@ -336,7 +408,7 @@ JamiAccount::~JamiAccount() noexcept
         peerDiscovery_->stopPublish(PEER_DISCOVERY_JAMI_SERVICE);
         peerDiscovery_->stopDiscovery(PEER_DISCOVERY_JAMI_SERVICE);
     }
-    if (auto dht = dht_)
+    if (auto dht = this->dht())
         dht->join();
 }
 
@@ -366,6 +438,14 @@ JamiAccount::shutdownConnections()
     sipConns_.clear();
 }
 
+std::string
+JamiAccount::getArchivePath() const
+{
+    if (not managerUri_.empty())
+        return {};
+    return fileutils::getFullPath(idPath_, archivePath_.empty() ? "archive.gz" : archivePath_);
+}
+
 void
 JamiAccount::flush()
 {
@@ -500,7 +580,7 @@ JamiAccount::createSubCall(const std::shared_ptr<SIPCall>& mainCall)
 void
 JamiAccount::startOutgoingCall(const std::shared_ptr<SIPCall>& call, const std::string& toUri)
 {
-    if (not accountManager_ or not dht_) {
+    if (not accountManager_ or not dht()) {
         call->onFailure(ENETDOWN);
         return;
     }
@@ -1678,7 +1758,7 @@ JamiAccount::registerAsyncOps()
                                       accId.c_str(),
                                       accPtr->dhtPortUsed());
 
-                            accPtr->dht_->connectivityChanged();
+                            accPtr->dht()->connectivityChanged();
 
                         } else {
                             // Only update the mapping.
@@ -1739,10 +1819,6 @@ JamiAccount::doRegister()
         || registrationState_ == RegistrationState::ERROR_NEED_MIGRATION)
         return;
 
-    if (not dhParams_.valid()) {
-        generateDhParams();
-    }
-
     setRegistrationState(RegistrationState::TRYING);
     /* if UPnP is enabled, then wait for IGD to complete registration */
     if (upnpCtrl_ or proxyServerCached_.empty()) {
@@ -1788,14 +1864,18 @@ JamiAccount::trackBuddyPresence(const std::string& buddy_id, bool track)
     if (track) {
         auto buddy = trackedBuddies_.emplace(h, BuddyInfo {h});
         if (buddy.second) {
-            trackPresence(buddy.first->first, buddy.first->second);
+            schedulePresenceUpdate({});
         }
     } else {
         auto buddy = trackedBuddies_.find(h);
         if (buddy != trackedBuddies_.end()) {
-            if (auto dht = dht_)
-                if (dht->isRunning())
-                    dht->cancelListen(h, std::move(buddy->second.listenToken));
+            if (buddy->second.listenToken.valid()) {
+                if (auto dht = this->dht())
+                    if (dht->isRunning())
+                        dht->cancelListen(h, std::move(buddy->second.listenToken));
+                // Another buddy can be listened
+                schedulePresenceUpdate({});
+            }
             trackedBuddies_.erase(buddy);
         }
     }
@@ -1804,28 +1884,33 @@ JamiAccount::trackBuddyPresence(const std::string& buddy_id, bool track)
 void
 JamiAccount::trackPresence(const dht::InfoHash& h, BuddyInfo& buddy)
 {
-    auto dht = dht_;
+    auto dht = this->dht();
     if (not dht or not dht->isRunning()) {
         return;
     }
+    auto listenId = ++buddy.listenId;
+    buddy.devices_cnt = 0;
     buddy.listenToken = dht->listen<
-        DeviceAnnouncement>(h, [this, h](DeviceAnnouncement&& dev, bool expired) {
-        bool wasConnected, isConnected;
+        DeviceAnnouncement>(h, [this, h, listenId](DeviceAnnouncement&& dev, bool expired) {
+        std::optional<bool> online;
         {
             std::lock_guard<std::mutex> lock(buddyInfoMtx);
             auto buddy = trackedBuddies_.find(h);
             if (buddy == trackedBuddies_.end())
                 return true;
-            wasConnected = buddy->second.devices_cnt > 0;
-            if (expired)
-                --buddy->second.devices_cnt;
-            else
+            // Cancelled since
+            if (buddy->second.listenId != listenId)
+                return false;
+            if (not expired)
                 ++buddy->second.devices_cnt;
-            isConnected = buddy->second.devices_cnt > 0;
+            else if (buddy->second.devices_cnt > 0)
+                --buddy->second.devices_cnt;
+            if (buddy->second.updateOnline())
+                online = buddy->second.online;
         }
         // NOTE: the rest can use configurationMtx_, that can be locked during unregister so
         // do not retrigger on dht
-        runOnMainThread([w = weak(), h, dev, expired, isConnected, wasConnected]() {
+        runOnMainThread([w = weak(), h, dev, expired, online]() {
             auto sthis = w.lock();
             if (!sthis)
                 return;
@@ -1845,10 +1930,11 @@ JamiAccount::trackPresence(const dht::InfoHash& h, BuddyInfo& buddy)
                         }
                     });
             }
-            if (isConnected and not wasConnected) {
-                sthis->onTrackedBuddyOnline(h);
-            } else if (not isConnected and wasConnected) {
-                sthis->onTrackedBuddyOffline(h);
+            if (online) {
+                if (*online)
+                    sthis->onTrackedBuddyOnline(h);
+                else
+                    sthis->onTrackedBuddyOffline(h);
             }
         });
 
@@ -1856,13 +1942,198 @@ JamiAccount::trackPresence(const dht::InfoHash& h, BuddyInfo& buddy)
     });
 }
 
+void
+JamiAccount::pollPresence(BuddyInfo& buddy)
+{
+    auto dht = this->dht();
+    if (not dht or not dht->isRunning()) {
+        return;
+    }
+    buddy.lastPoll = std::chrono::steady_clock::now();
+    auto h = buddy.id;
+    auto devices = std::make_shared<std::set<dht::InfoHash>>();
+    dht->get<DeviceAnnouncement>(
+        h,
+        [devices, h](DeviceAnnouncement&& dev) {
+            if (dev.from == h)
+                devices->emplace(dev.dev);
+            return true;
+        },
+        [w = weak(), h, listenId = buddy.listenId, devices](bool ok) {
+            auto sthis = w.lock();
+            if (not sthis or not ok)
+                return;
+            std::optional<bool> online;
+            {
+                std::lock_guard<std::mutex> lock(sthis->buddyInfoMtx);
+                auto buddy = sthis->trackedBuddies_.find(h);
+                // Untracked or listened since
+                if (buddy == sthis->trackedBuddies_.end() or buddy->second.listenId != listenId)
+                    return;
+                buddy->second.devices_cnt = devices->size();
+                if (buddy->second.updateOnline())
+                    online = buddy->second.online;
+            }
+            if (online) {
+                runOnMainThread([w, h, online = *online]() {
+                    auto sthis = w.lock();
+                    if (!sthis)
+                        return;
+                    if (online) {
+                        sthis->messageEngine_.onPeerOnline(h.toString());
+                        sthis->onTrackedBuddyOnline(h);
+                    } else {
+                        sthis->onTrackedBuddyOffline(h);
+                    }
+                });
+            }
+        });
+}
+
+void
+JamiAccount::updatePresence()
+{
+    auto dht = this->dht();
+    if (not dht or not dht->isRunning()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(buddyInfoMtx);
+    presenceTask_.reset();
+
+    // The most recently active buddies are listened. The connected ones come last, their
+    // connections already telling they are online
+    std::vector<BuddyInfo*> buddies;
+    buddies.reserve(trackedBuddies_.size());
+    for (auto& [h, buddy] : trackedBuddies_)
+        buddies.emplace_back(&buddy);
+    std::stable_sort(buddies.begin(), buddies.end(), [](const BuddyInfo* a, const BuddyInfo* b) {
+        if (a->connected != b->connected)
+            return b->connected;
+        return a->lastActive > b->lastActive;
+    });
+
+    size_t started = 0;
+    bool pending = false;
+    std::vector<BuddyInfo*> polled;
+    for (size_t i = 0; i < buddies.size(); ++i) {
+        auto& buddy = *buddies[i];
+        if (i < MAX_PRESENCE_LISTENS) {
+            if (buddy.listenToken.valid())
+                continue;
+            // Not thousands of listens at once, e.g. when registering
+            if (started < PRESENCE_LISTENS_PER_UPDATE) {
+                trackPresence(buddy.id, buddy);
+                ++started;
+            } else {
+                pending = true;
+            }
+        } else {
+            if (buddy.listenToken.valid()) {
+                dht->cancelListen(buddy.id, std::move(buddy.listenToken));
+                ++buddy.listenId;
+                buddy.devices_cnt = 0;
+                buddy.lastPoll = {};
+            }
+            if (not buddy.connected)
+                polled.emplace_back(&buddy);
+        }
+    }
+
+    // The least recently polled first
+    std::sort(polled.begin(), polled.end(), [](const BuddyInfo* a, const BuddyInfo* b) {
+        return a->lastPoll < b->lastPoll;
+    });
+    for (size_t i = 0; i < std::min(polled.size(), PRESENCE_POLLS_PER_UPDATE); ++i) {
+        if (now - polled[i]->lastPoll < PRESENCE_POLL_PERIOD)
+            break;
+        pollPresence(*polled[i]);
+    }
+
+    if (pending)
+        schedulePresenceUpdate(PRESENCE_STAGGER_DELAY);
+    else if (not polled.empty())
+        schedulePresenceUpdate(PRESENCE_UPDATE_PERIOD);
+}
+
+void
+JamiAccount::schedulePresenceUpdate(std::chrono::steady_clock::duration delay)
+{
+    auto time = std::chrono::steady_clock::now() + delay;
+    if (presenceTask_) {
+        if (presenceUpdateTime_ <= time)
+            return;
+        presenceTask_->cancel();
+    }
+    presenceUpdateTime_ = time;
+    presenceTask_ = Manager::instance().scheduleTaskIn(
+        [w = weak()] {
+            if (auto sthis = w.lock())
+                sthis->updatePresence();
+        },
+        delay);
+}
+
+void
+JamiAccount::onBuddyActivity(const std::string& peerId)
+{
+    std::lock_guard<std::mutex> lock(buddyInfoMtx);
+    auto buddy = trackedBuddies_.find(dht::InfoHash(peerId));
+    if (buddy == trackedBuddies_.end())
+        return;
+    buddy->second.lastActive = std::chrono::steady_clock::now();
+    // Now among the most active buddies, maybe
+    if (not buddy->second.listenToken.valid())
+        schedulePresenceUpdate(PRESENCE_STAGGER_DELAY);
+}
+
+void
+JamiAccount::onBuddyConnectionChanged(const std::string& peerId)
+{
+    auto h = dht::InfoHash(peerId);
+    std::optional<bool> online;
+    {
+        std::lock_guard<std::mutex> lock(buddyInfoMtx);
+        auto buddy = trackedBuddies_.find(h);
+        if (buddy == trackedBuddies_.end())
+            return;
+        bool connected = false;
+        {
+            std::lock_guard<std::mutex> lk(sipConnsMtx_);
+            for (auto it = sipConns_.lower_bound(SipConnectionKey(peerId, DeviceId()));
+                 it != sipConns_.end() and it->first.first == peerId;
+                 ++it)
+                connected |= not it->second.empty();
+        }
+        if (connected == buddy->second.connected)
+            return;
+        buddy->second.connected = connected;
+        buddy->second.lastActive = std::chrono::steady_clock::now();
+        if (buddy->second.updateOnline())
+            online = buddy->second.online;
+        // Its listen can be given to another buddy, or is needed again
+        schedulePresenceUpdate(PRESENCE_STAGGER_DELAY);
+    }
+    if (online) {
+        runOnMainThread([w = weak(), h, online = *online]() {
+            auto sthis = w.lock();
+            if (!sthis)
+                return;
+            if (online)
+                sthis->onTrackedBuddyOnline(h);
+            else
+                sthis->onTrackedBuddyOffline(h);
+        });
+    }
+}
+
 std::map<std::string, bool>
 JamiAccount::getTrackedBuddyPresence() const
 {
     std::lock_guard<std::mutex> lock(buddyInfoMtx);
     std::map<std::string, bool> presence_info;
     for (const auto& buddy_info_p : trackedBuddies_)
-        presence_info.emplace(buddy_info_p.first.toString(), buddy_info_p.second.devices_cnt > 0);
+        presence_info.emplace(buddy_info_p.first.toString(), buddy_info_p.second.online);
     return presence_info;
 }
 
@@ -1927,10 +2198,20 @@ JamiAccount::doRegister_()
             throw std::runtime_error("No identity configured for this account.");
 
         loadTreatedMessages();
-        if (dht_->isRunning()) {
+        auto accountDht = dht();
+        if (accountDht->isRunning()) {
             JAMI_ERR("[Account %s] DHT already running (stopping it first).",
                      getAccountID().c_str());
-            dht_->join();
+            accountDht->join();
+        }
+        // A new registration on the shared node, or the preference changed
+        auto sharedNode = Manager::instance().sharedDhtNode();
+        if (accountDht->isShared() or sharedNode) {
+            if (accountDht->isShared())
+                accountDht->shutdown({});
+            accountDht = std::make_shared<AccountDht>(std::move(sharedNode));
+            std::lock_guard<std::mutex> lk(dhtMtx_);
+            dht_ = accountDht;
         }
 
         convModule()->clearPendingFetch();
@@ -2081,7 +2362,7 @@ JamiAccount::doRegister_()
 
                     std::unique_lock<std::mutex> lk(connManagerMtx_);
                     initConnectionManager();
-                    channelHandlers_[Uri::Scheme::SYNC]
+                    channelHandlers_.get("sync://")
                         ->connect(crt->getLongId(),
                                   "",
                                   [this](std::shared_ptr<ChannelSocket> socket,
@@ -2103,12 +2384,12 @@ JamiAccount::doRegister_()
         };
 
         setRegistrationState(RegistrationState::TRYING);
-        dht_->run(dhtPortUsed(), config, std::move(context));
+        accountDht->run(dhtPortUsed(), config, std::move(context));
 
         for (const auto& bootstrap : loadBootstrap())
-            dht_->bootstrap(bootstrap);
+            accountDht->bootstrap(bootstrap);
 
-        accountManager_->setDht(dht_);
+        accountManager_->setDht(accountDht);
 
         std::unique_lock<std::mutex> lkCM(connManagerMtx_);
         initConnectionManager();
@@ -2147,130 +2428,19 @@ JamiAccount::doRegister_()
                     cacheTurnServers();
                 }
 
-                auto uri = Uri(name);
-                auto itHandler = channelHandlers_.find(uri.scheme());
-                if (itHandler != channelHandlers_.end() && itHandler->second)
-                    return itHandler->second->onRequest(cert, name);
-                // TODO replace
-                auto isFile = name.substr(0, 7) == FILE_URI;
-                auto isVCard = name.substr(0, 8) == VCARD_URI;
-
-                if (name == "sip") {
-                    return true;
-                } else if (isFile or isVCard) {
-                    auto tid = isFile ? name.substr(7) : name.substr(8);
-                    std::lock_guard<std::mutex> lk(transfersMtx_);
-                    incomingFileTransfers_.emplace(tid);
-                    return true;
-                }
+                if (auto handler = channelHandlers_.find(name))
+                    return handler->onRequest(cert, name);
                 return false;
             });
-        connectionManager_->onConnectionReady([this](const DeviceId& deviceId,
+        connectionManager_->onConnectionReady([this](const DeviceId&,
                                                      const std::string& name,
                                                      std::shared_ptr<ChannelSocket> channel) {
             if (channel) {
                 auto cert = channel->peerCertificate();
                 if (!cert || !cert->issuer)
                     return;
-                auto peerId = cert->issuer->getId().toString();
-                auto isFile = name.substr(0, 7) == FILE_URI;
-                auto isVCard = name.substr(0, 8) == VCARD_URI;
-                if (name == "sip") {
-                    cacheSIPConnection(std::move(channel), peerId, deviceId);
-                } else if (isFile or isVCard) {
-                    auto tid = isFile ? name.substr(7) : name.substr(8);
-                    std::unique_lock<std::mutex> lk(transfersMtx_);
-                    auto it = incomingFileTransfers_.find(tid);
-                    // Note, outgoing file transfers are ignored.
-                    if (it == incomingFileTransfers_.end())
-                        return;
-                    incomingFileTransfers_.erase(it);
-                    lk.unlock();
-                    InternalCompletionCb cb;
-                    if (isVCard)
-                        cb = [peerId, accountId = getAccountID()](const std::string& path) {
-                            emitSignal<DRing::ConfigurationSignal::ProfileReceived>(accountId,
-                                                                                    peerId,
-                                                                                    path);
-                        };
-
-                    DRing::DataTransferInfo info;
-                    info.accountId = getAccountID();
-                    info.peer = peerId;
-                    try {
-                        dhtPeerConnector_->onIncomingConnection(info,
-                                                                std::stoull(tid),
-                                                                std::move(channel),
-                                                                std::move(cb));
-                    } catch (...) {
-                        JAMI_ERR() << "Invalid tid: " << tid;
-                    }
-
-                } else if (name.find("git://") == 0) {
-                    auto sep = name.find_last_of('/');
-                    auto conversationId = name.substr(sep + 1);
-                    auto remoteDevice = name.substr(6, sep - 6);
-
-                    if (channel->isInitiator()) {
-                        // Check if wanted remote it's our side (git://remoteDevice/conversationId)
-                        return;
-                    }
-
-                    // Check if pull from banned device
-                    if (convModule()->isBannedDevice(conversationId, remoteDevice)) {
-                        JAMI_WARN("[Account %s] Git server requested for conversation %s, but the "
-                                  "device is "
-                                  "unauthorized (%s) ",
-                                  getAccountID().c_str(),
-                                  conversationId.c_str(),
-                                  remoteDevice.c_str());
-                        channel->shutdown();
-                        return;
-                    }
-
-                    auto sock = gitSocket(deviceId, conversationId);
-                    if (sock != std::nullopt && sock->lock() == channel) {
-                        // The onConnectionReady is already used as client (for retrieving messages)
-                        // So it's not the server socket
-                        return;
-                    }
-                    auto accountId = this->accountID_;
-                    JAMI_WARN("[Account %s] Git server requested for conversation %s, device %s, "
-                              "channel %u",
-                              accountId.c_str(),
-                              conversationId.c_str(),
-                              deviceId.to_c_str(),
-                              channel->channel());
-                    auto gs = std::make_unique<GitServer>(accountId, conversationId, channel);
-                    gs->setOnFetched(
-                        [w = weak(), conversationId, deviceId](const std::string& commit) {
-                            if (auto shared = w.lock())
-                                shared->convModule()->setFetched(conversationId,
-                                                                 deviceId.toString(),
-                                                                 commit);
-                        });
-                    const dht::Value::Id serverId = ValueIdDist()(rand);
-                    {
-                        std::lock_guard<std::mutex> lk(gitServersMtx_);
-                        gitServers_[serverId] = std::move(gs);
-                    }
-                    channel->onShutdown([w = weak(), serverId]() {
-                        // Run on main thread to avoid to be in mxSock's eventLoop
-                        runOnMainThread([serverId, w]() {
-                            auto shared = w.lock();
-                            if (!shared)
-                                return;
-                            std::lock_guard<std::mutex> lk(shared->gitServersMtx_);
-                            shared->gitServers_.erase(serverId);
-                        });
-                    });
-                } else {
-                    // TODO move git://
-                    auto uri = Uri(name);
-                    auto itHandler = channelHandlers_.find(uri.scheme());
-                    if (itHandler != channelHandlers_.end() && itHandler->second)
-                        itHandler->second->onReady(cert, name, std::move(channel));
-                }
+                if (auto handler = channelHandlers_.find(name))
+                    handler->onReady(cert, name, std::move(channel));
             }
         });
         lkCM.unlock();
@@ -2278,7 +2448,7 @@ JamiAccount::doRegister_()
         // Note: this code should be unused unless for DHT text messages
         auto inboxDeviceKey = dht::InfoHash::get(
             "inbox:" + accountManager_->getInfo()->devicePk->getId().toString());
-        dht_->listen<dht::ImMessage>(inboxDeviceKey, [this, inboxDeviceKey](dht::ImMessage&& v) {
+        dht()->listen<dht::ImMessage>(inboxDeviceKey, [this, inboxDeviceKey](dht::ImMessage&& v) {
             auto msgId = to_hex_string(v.id);
             if (isMessageTreated(msgId))
                 return true;
@@ -2291,20 +2461,35 @@ JamiAccount::doRegister_()
                                  msgId](const std::shared_ptr<dht::crypto::Certificate>& cert,
                                         const dht::InfoHash& peer_account) {
                                     auto now = clock::to_time_t(clock::now());
-                                    std::string datatype = utf8_make_valid(v.datatype);
-                                    if (datatype.empty()) {
-                                        datatype = "text/plain";
-                                    }
-                                    std::map<std::string, std::string> payloads = {
-                                        {datatype, utf8_make_valid(v.msg)}};
                                     auto pk = std::make_shared<dht::crypto::PublicKey>(
                                         cert->getPublicKey());
-                                    onTextMessage(msgId,
-                                                  peer_account.toString(),
-                                                  pk->getLongId().toString(),
-                                                  payloads);
+                                    if (v.datatype == MIME_TYPE_IM_BATCH) {
+                                        std::vector<BatchedMessage> batch;
+                                        try {
+                                            msgpack::unpack(v.msg.data(), v.msg.size())
+                                                .get()
+                                                .convert(batch);
+                                        } catch (const std::exception& e) {
+                                            JAMI_WARN("Invalid batch of messages: %s", e.what());
+                                            return;
+                                        }
+                                        for (const auto& m : batch) {
+                                            auto id = to_hex_string(m.id);
+                                            if (isMessageTreated(id))
+                                                continue;
+                                            onTextMessage(id,
+                                                          peer_account.toString(),
+                                                          pk->getLongId().toString(),
+                                                          textPayloads(m.datatype, m.msg));
+                                        }
+                                    } else {
+                                        onTextMessage(msgId,
+                                                      peer_account.toString(),
+                                                      pk->getLongId().toString(),
+                                                      textPayloads(v.datatype, v.msg));
+                                    }
                                     JAMI_DBG() << "Sending message confirmation " << v.id;
-                                    dht_->putEncrypted(inboxDeviceKey,
+                                    dht()->putEncrypted(inboxDeviceKey,
                                                        v.from,
                                                        dht::ImMessage(v.id, std::string(), now));
                                 });
@@ -2316,9 +2501,13 @@ JamiAccount::doRegister_()
 
         std::lock_guard<std::mutex> lock(buddyInfoMtx);
         for (auto& buddy : trackedBuddies_) {
+            // The listens of the previous DHT are gone
             buddy.second.devices_cnt = 0;
-            trackPresence(buddy.first, buddy.second);
+            buddy.second.listenToken = {};
+            ++buddy.second.listenId;
+            buddy.second.lastPoll = {};
         }
+        schedulePresenceUpdate({});
     } catch (const std::exception& e) {
         JAMI_ERR("Error registering DHT account: %s", e.what());
         setRegistrationState(RegistrationState::ERROR_GENERIC);
@@ -2350,7 +2539,7 @@ JamiAccount::convModule()
                 return sendTextMessage(uri, msg, token);
             },
             [this](const auto& convId, const auto& deviceId, auto&& cb) {
-                runOnMainThread([w = weak(), convId, deviceId, cb = std::move(cb)] {
+                gitStrand_.run([w = weak(), convId, deviceId, cb = std::move(cb)] {
                     auto shared = w.lock();
                     if (!shared)
                         return;
@@ -2420,6 +2609,7 @@ JamiAccount::onTextMessage(const std::string& id,
 {
     try {
         const std::string fromUri {parseJamiUri(from)};
+        onBuddyActivity(fromUri);
         SIPAccountBase::onTextMessage(id, fromUri, deviceId, payloads);
     } catch (...) {
     }
@@ -2441,7 +2631,7 @@ JamiAccount::doUnregister(std::function<void(bool)> released_cb)
     bool shutdown_complete {false};
 
     JAMI_WARN("[Account %s] unregistering account %p", getAccountID().c_str(), this);
-    dht_->shutdown(
+    dht()->shutdown(
         [&] {
             JAMI_WARN("[Account %s] dht shutdown complete", getAccountID().c_str());
             std::lock_guard<std::mutex> lock(mtx);
@@ -2470,7 +2660,7 @@ JamiAccount::doUnregister(std::function<void(bool)> released_cb)
         std::unique_lock<std::mutex> lock(mtx);
         cv.wait(lock, [&] { return shutdown_complete; });
     }
-    dht_->join();
+    dht()->join();
     setRegistrationState(RegistrationState::UNREGISTERED);
 
     lock.unlock();
@@ -2512,7 +2702,7 @@ JamiAccount::connectivityChanged()
         // nothing to do
         return;
     }
-    dht_->connectivityChanged();
+    dht()->connectivityChanged();
     {
         std::lock_guard<std::mutex> lkCM(connManagerMtx_);
         if (connectionManager_)
@@ -2522,6 +2712,22 @@ JamiAccount::connectivityChanged()
     setPublishedAddress({});
 }
 
+void
+JamiAccount::networkChanged(const ConnectivityChange& change)
+{
+    // With new addresses only, the DHT and the connections keep their sockets and routes
+    if (not isUsable() or not change.disrupts())
+        return;
+    JAMI_WARN("[Account %s] network changed", getAccountID().c_str());
+    dht()->connectivityChanged();
+    {
+        std::lock_guard<std::mutex> lkCM(connManagerMtx_);
+        if (connectionManager_)
+            connectionManager_->connectivityChanged(change);
+    }
+    setPublishedAddress({});
+}
+
 bool
 JamiAccount::findCertificate(
     const dht::InfoHash& h,
@@ -2665,34 +2871,6 @@ JamiAccount::getKnownDevices() const
     return ids;
 }
 
-tls::DhParams
-JamiAccount::loadDhParams(std::string path)
-{
-    std::lock_guard<std::mutex> l(fileutils::getFileLock(path));
-    try {
-        // writeTime throw exception if file doesn't exist
-        auto duration = clock::now() - fileutils::writeTime(path);
-        if (duration >= std::chrono::hours(24 * 3)) // file is valid only 3 days
-            throw std::runtime_error("file too old");
-
-        JAMI_DBG("Loading DhParams from file '%s'", path.c_str());
-        return {fileutils::loadFile(path)};
-    } catch (const std::exception& e) {
-        JAMI_DBG("Failed to load DhParams file '%s': %s", path.c_str(), e.what());
-        if (auto params = tls::DhParams::generate()) {
-            try {
-                fileutils::saveFile(path, params.serialize(), 0600);
-                JAMI_DBG("Saved DhParams to file '%s'", path.c_str());
-            } catch (const std::exception& ex) {
-                JAMI_WARN("Failed to save DhParams in file '%s': %s", path.c_str(), ex.what());
-            }
-            return params;
-        }
-        JAMI_ERR("Can't generate DH params.");
-        return {};
-    }
-}
-
 void
 JamiAccount::loadCachedUrl(const std::string& url,
                            const std::string& cachePath,
@@ -2724,21 +2902,21 @@ JamiAccount::loadCachedUrl(const std::string& url,
                     url,
                     [cb, cachePath, w](const dht::http::Response& response) {
                         if (response.status_code == 200) {
-                            try {
-                                std::lock_guard<std::mutex> lk(fileutils::getFileLock(cachePath));
-                                fileutils::saveFile(cachePath,
-                                                    (const uint8_t*) response.body.data(),
-                                                    response.body.size(),
-                                                    0600);
-                                JAMI_DBG("Cached result to '%.*s'",
-                                         (int) cachePath.size(),
-                                         cachePath.c_str());
-                            } catch (const std::exception& ex) {
-                                JAMI_WARN("Failed to save result to %.*s: %s",
-                                          (int) cachePath.size(),
-                                          cachePath.c_str(),
-                                          ex.what());
-                            }
+                            // Not on the network thread
+                            fileutils::saveFileAsync(
+                                cachePath,
+                                std::vector<uint8_t>(response.body.begin(), response.body.end()),
+                                0600,
+                                [cachePath](bool saved) {
+                                    if (saved)
+                                        JAMI_DBG("Cached result to '%.*s'",
+                                                 (int) cachePath.size(),
+                                                 cachePath.c_str());
+                                    else
+                                        JAMI_WARN("Failed to save result to %.*s",
+                                                  (int) cachePath.size(),
+                                                  cachePath.c_str());
+                                });
                         } else {
                             JAMI_WARN("Failed to download url");
                         }
@@ -2825,15 +3003,6 @@ JamiAccount::getDhtProxyServer(const std::string& serverList)
     return proxyServerCached_;
 }
 
-void
-JamiAccount::generateDhParams()
-{
-    // make sure cachePath_ is writable
-    fileutils::check_dir(cachePath_.c_str(), 0700);
-    dhParams_ = dht::ThreadPool::computation().get<tls::DhParams>(
-        std::bind(loadDhParams, cachePath_ + DIR_SEPARATOR_STR "dhParams"));
-}
-
 MatchRank
 JamiAccount::matches(std::string_view userName, std::string_view server) const
 {
@@ -3160,6 +3329,7 @@ JamiAccount::sendTextMessage(const std::string& to,
         JAMI_ERR("Multi-part im is not supported yet by JamiAccount");
         return 0;
     }
+    onBuddyActivity(toUri);
     return SIPAccountBase::sendTextMessage(toUri, payloads, refreshToken);
 }
 
@@ -3188,15 +3358,102 @@ JamiAccount::sendMessage(const std::string& to,
         return;
     }
 
-    auto toH = dht::InfoHash(toUri);
-    auto now = clock::to_time_t(clock::now());
-
     auto confirm = std::make_shared<PendingConfirmation>();
     if (onlyConnected) {
         confirm->replied = true;
     }
 
-    std::shared_ptr<std::set<DeviceId>> devices = std::make_shared<std::set<DeviceId>>();
+    auto devices = std::make_shared<std::set<DeviceId>>(
+        sendMessageOnChannels(to, payloads, token, retryOnTimeout, onlyConnected, confirm));
+    if (onlyConnected)
+        return;
+
+    sendDhtMessages(to,
+                    dht::InfoHash(toUri),
+                    std::make_shared<OutgoingMessages>(OutgoingMessages {{token, payloads}}),
+                    devices,
+                    confirm);
+}
+
+void
+JamiAccount::sendMessages(const std::string& to,
+                          const OutgoingMessages& messages,
+                          bool retryOnTimeout)
+{
+    if (messages.size() == 1) {
+        sendMessage(to, messages.front().second, messages.front().first, retryOnTimeout);
+        return;
+    }
+    std::string toUri;
+    try {
+        toUri = parseJamiUri(to);
+    } catch (...) {
+        JAMI_ERR("Failed to send text messages due to an invalid URI %s", to.c_str());
+        for (const auto& m : messages)
+            messageEngine_.onMessageSent(to, m.first, false);
+        return;
+    }
+
+    // The connected devices get the messages one by one
+    std::optional<std::set<DeviceId>> connected;
+    OutgoingMessages dhtMessages;
+    for (const auto& [token, payloads] : messages) {
+        if (payloads.size() != 1) {
+            JAMI_ERR("Multi-part im is not supported yet by JamiAccount");
+            messageEngine_.onMessageSent(toUri, token, false);
+            continue;
+        }
+        auto devices = sendMessageOnChannels(to,
+                                             payloads,
+                                             token,
+                                             retryOnTimeout,
+                                             false,
+                                             std::make_shared<PendingConfirmation>());
+        if (not connected) {
+            connected = std::move(devices);
+        } else {
+            for (auto it = connected->begin(); it != connected->end();)
+                it = devices.count(*it) ? std::next(it) : connected->erase(it);
+        }
+        dhtMessages.emplace_back(token, payloads);
+    }
+    if (dhtMessages.empty())
+        return;
+
+    // The others get them in batches, one per put
+    auto toH = dht::InfoHash(toUri);
+    auto batch = std::make_shared<OutgoingMessages>();
+    size_t batchSize = 0;
+    auto sendBatch = [&] {
+        sendDhtMessages(to,
+                        toH,
+                        batch,
+                        std::make_shared<std::set<DeviceId>>(*connected),
+                        std::make_shared<PendingConfirmation>());
+        batch = std::make_shared<OutgoingMessages>();
+        batchSize = 0;
+    };
+    for (auto& m : dhtMessages) {
+        const auto& payload = *m.second.cbegin();
+        auto size = payload.first.size() + payload.second.size();
+        if (not batch->empty()
+            and (batch->size() >= MAX_BATCH_MESSAGES or batchSize + size > MAX_BATCH_SIZE))
+            sendBatch();
+        batchSize += size;
+        batch->emplace_back(std::move(m));
+    }
+    sendBatch();
+}
+
+std::set<DeviceId>
+JamiAccount::sendMessageOnChannels(const std::string& to,
+                                   const std::map<std::string, std::string>& payloads,
+                                   uint64_t token,
+                                   bool retryOnTimeout,
+                                   bool onlyConnected,
+                                   const std::shared_ptr<PendingConfirmation>& confirm)
+{
+    std::set<DeviceId> devices;
     std::unique_lock<std::mutex> lk(sipConnsMtx_);
 
     for (auto it = sipConns_.begin(); it != sipConns_.end();) {
@@ -3265,18 +3522,53 @@ JamiAccount::sendMessage(const std::string& to,
             continue;
         }
 
-        devices->emplace(key.second);
+        devices.emplace(key.second);
         ++it;
     }
-    lk.unlock();
+    return devices;
+}
 
-    if (onlyConnected)
-        return;
+void
+JamiAccount::sendDhtMessages(const std::string& to,
+                             const dht::InfoHash& toH,
+                             const std::shared_ptr<OutgoingMessages>& messages,
+                             const std::shared_ptr<std::set<DeviceId>>& devices,
+                             const std::shared_ptr<PendingConfirmation>& confirm)
+{
+    auto now = clock::to_time_t(clock::now());
+
+    // A single message is put as it is, several in a batch acknowledged at once
+    dht::Value::Id token;
+    std::string datatype;
+    std::string content;
+    if (messages->size() == 1) {
+        const auto& [id, payloads] = messages->front();
+        token = id;
+        datatype = payloads.cbegin()->first;
+        content = payloads.cbegin()->second;
+    } else {
+        token = std::uniform_int_distribution<dht::Value::Id> {1, JAMI_ID_MAX_VAL}(rand);
+        datatype = MIME_TYPE_IM_BATCH;
+        std::vector<BatchedMessage> batch;
+        batch.reserve(messages->size());
+        for (const auto& [id, payloads] : *messages)
+            batch.emplace_back(
+                BatchedMessage {id, payloads.cbegin()->first, payloads.cbegin()->second});
+        msgpack::sbuffer buffer;
+        msgpack::pack(buffer, batch);
+        content.assign(buffer.data(), buffer.size());
+        JAMI_DBG() << "[Account " << getAccountID() << "] [message " << token << "] Batch of "
+                   << messages->size() << " messages";
+    }
+    auto onSent = [this, to, messages](bool ok) {
+        for (const auto& m : *messages)
+            messageEngine_.onMessageSent(to, m.first, ok);
+    };
 
     // Find listening devices for this account
     accountManager_->forEachDevice(
         toH,
-        [this, confirm, to, token, payloads, now, devices](
+        [this, confirm, to, token, datatype, content, messages, now, devices, onSent](
             const std::shared_ptr<dht::crypto::PublicKey>& dev) {
             // Test if already sent
             auto deviceId = dev->getLongId();
@@ -3289,7 +3581,7 @@ JamiAccount::sendMessage(const std::string& to,
             }
 
             // Else, ask for a channel and send a DHT message
-            auto payload_type = payloads.cbegin()->first;
+            auto payload_type = messages->front().second.cbegin()->first;
             requestSIPConnection(to, deviceId, payload_type);
             {
                 std::lock_guard<std::mutex> lock(messageMutex_);
@@ -3298,51 +3590,51 @@ JamiAccount::sendMessage(const std::string& to,
 
             auto h = dht::InfoHash::get("inbox:" + dev->getId().toString());
             std::lock_guard<std::mutex> l(confirm->lock);
-            auto list_token
-                = dht_->listen<dht::ImMessage>(h, [this, to, token, confirm](dht::ImMessage&& msg) {
-                      // check expected message confirmation
-                      if (msg.id != token)
-                          return true;
-
-                      {
-                          std::lock_guard<std::mutex> lock(messageMutex_);
-                          auto e = sentMessages_.find(msg.id);
-                          if (e == sentMessages_.end()
-                              or e->second.to.find(msg.owner->getLongId()) == e->second.to.end()) {
-                              JAMI_DBG() << "[Account " << getAccountID() << "] [message " << token
-                                         << "] Message not found";
-                              return true;
-                          }
-                          sentMessages_.erase(e);
-                          JAMI_DBG() << "[Account " << getAccountID() << "] [message " << token
-                                     << "] Received text message reply";
-
-                          // add treated message
-                          auto res = treatedMessages_.emplace(to_hex_string(msg.id));
-                          if (!res.second)
-                              return true;
-                      }
-                      saveTreatedMessages();
-
-                      // report message as confirmed received
-                      {
-                          std::lock_guard<std::mutex> l(confirm->lock);
-                          for (auto& t : confirm->listenTokens)
-                              dht_->cancelListen(t.first, std::move(t.second));
-                          confirm->listenTokens.clear();
-                          confirm->replied = true;
-                      }
-                      messageEngine_.onMessageSent(to, token, true);
-                      return false;
-                  });
+            auto list_token = dht()->listen<dht::ImMessage>(
+                h, [this, token, confirm, onSent](dht::ImMessage&& msg) {
+                    // check expected message confirmation
+                    if (msg.id != token)
+                        return true;
+
+                    {
+                        std::lock_guard<std::mutex> lock(messageMutex_);
+                        auto e = sentMessages_.find(msg.id);
+                        if (e == sentMessages_.end()
+                            or e->second.to.find(msg.owner->getLongId()) == e->second.to.end()) {
+                            JAMI_DBG() << "[Account " << getAccountID() << "] [message " << token
+                                       << "] Message not found";
+                            return true;
+                        }
+                        sentMessages_.erase(e);
+                        JAMI_DBG() << "[Account " << getAccountID() << "] [message " << token
+                                   << "] Received text message reply";
+
+                        // add treated message
+                        auto res = treatedMessages_.emplace(to_hex_string(msg.id));
+                        if (!res.second)
+                            return true;
+                    }
+                    saveTreatedMessages();
+
+                    // report message as confirmed received
+                    {
+                        std::lock_guard<std::mutex> l(confirm->lock);
+                        for (auto& t : confirm->listenTokens)
+                            dht()->cancelListen(t.first, std::move(t.second));
+                        confirm->listenTokens.clear();
+                        confirm->replied = true;
+                    }
+                    onSent(true);
+                    return false;
+                });
             confirm->listenTokens.emplace(h, std::move(list_token));
-            dht_->putEncrypted(h,
+            dht()->putEncrypted(h,
                                dev,
                                dht::ImMessage(token,
-                                              std::string(payloads.begin()->first),
-                                              std::string(payloads.begin()->second),
+                                              std::string(datatype),
+                                              std::string(content),
                                               now),
-                               [this, to, token, confirm, h](bool ok) {
+                               [this, token, confirm, h, onSent](bool ok) {
                                    JAMI_DBG()
                                        << "[Account " << getAccountID() << "] [message " << token
                                        << "] Put encrypted " << (ok ? "ok" : "failed");
@@ -3352,11 +3644,11 @@ JamiAccount::sendMessage(const std::string& to,
                                        if (lt != confirm->listenTokens.end()) {
                                            std::shared_future<size_t> tok = std::move(lt->second);
                                            confirm->listenTokens.erase(lt);
-                                           dht_->cancelListen(h, tok);
+                                           dht()->cancelListen(h, tok);
                                        }
                                        if (confirm->listenTokens.empty() and not confirm->replied) {
                                            l.unlock();
-                                           messageEngine_.onMessageSent(to, token, false);
+                                           onSent(false);
                                        }
                                    }
                                });
@@ -3364,36 +3656,36 @@ JamiAccount::sendMessage(const std::string& to,
             JAMI_DBG() << "[Account " << getAccountID() << "] [message " << token
                        << "] Sending message for device " << deviceId.toString();
         },
-        [this, to, token, devices, confirm](bool ok) {
+        [this, devices, confirm, onSent](bool ok) {
             if (devices->size() == 1 && devices->begin()->toString() == currentDeviceId()) {
                 // Current user only have devices, so no message are sent
                 {
                     std::lock_guard<std::mutex> l(confirm->lock);
                     for (auto& t : confirm->listenTokens)
-                        dht_->cancelListen(t.first, std::move(t.second));
+                        dht()->cancelListen(t.first, std::move(t.second));
                     confirm->listenTokens.clear();
                     confirm->replied = true;
                 }
-                messageEngine_.onMessageSent(to, token, true);
+                onSent(true);
             } else if (not ok) {
-                messageEngine_.onMessageSent(to, token, false);
+                onSent(false);
             }
         });
 
     // Timeout cleanup
     Manager::instance().scheduleTaskIn(
-        [w = weak(), confirm, to, token]() {
+        [w = weak(), confirm, token, onSent]() {
             std::unique_lock<std::mutex> l(confirm->lock);
             if (not confirm->replied) {
                 if (auto this_ = w.lock()) {
                     JAMI_DBG() << "[Account " << this_->getAccountID() << "] [message " << token
                                << "] Timeout";
                     for (auto& t : confirm->listenTokens)
-                        this_->dht_->cancelListen(t.first, std::move(t.second));
+                        this_->dht()->cancelListen(t.first, std::move(t.second));
                     confirm->listenTokens.clear();
                     confirm->replied = true;
                     l.unlock();
-                    this_->messageEngine_.onMessageSent(to, token, false);
+                    onSent(false);
                 }
             }
         },
@@ -3439,7 +3731,7 @@ JamiAccount::getIceOptions(std::function<void(IceTransportOptions&&)> cb) noexce
 void
 JamiAccount::storeActiveIpAddress(std::function<void()>&& cb)
 {
-    dht_->getPublicAddress([this, cb = std::move(cb)](std::vector<dht::SockAddr>&& results) {
+    dht()->getPublicAddress([this, cb = std::move(cb)](std::vector<dht::SockAddr>&& results) {
         bool hasIpv4 {false}, hasIpv6 {false};
         for (auto& result : results) {
             auto family = result.getFamily();
@@ -3503,14 +3795,14 @@ JamiAccount::setPushNotificationToken(const std::string& token)
 {
     JAMI_WARN("[Account %s] setPushNotificationToken: %s", getAccountID().c_str(), token.c_str());
     deviceKey_ = token;
-    dht_->setPushNotificationToken(deviceKey_);
+    dht()->setPushNotificationToken(deviceKey_);
 }
 
 void
 JamiAccount::setPushNotificationTopic(const std::string& topic)
 {
     notificationTopic_ = topic;
-    dht_->setPushNotificationTopic(notificationTopic_);
+    dht()->setPushNotificationTopic(notificationTopic_);
 }
 
 /**
@@ -3521,7 +3813,61 @@ JamiAccount::pushNotificationReceived(const std::string& from,
                                       const std::map<std::string, std::string>& data)
 {
     JAMI_WARN("[Account %s] pushNotificationReceived: %s", getAccountID().c_str(), from.c_str());
-    dht_->pushNotificationReceived(data);
+    // Several pushes for a key only need one refresh of it
+    std::string key;
+    auto it = data.find("key");
+    if (it != data.end())
+        key = it->second;
+    if (data.find("timeout") != data.end())
+        key += "/timeout";
+
+    std::lock_guard<std::mutex> lk(pushMtx_);
+    pendingPushes_.emplace(std::move(key), data);
+    pendingPushCount_++;
+    if (not pushTask_)
+        pushTask_ = Manager::instance().scheduler().scheduleIn(
+            [w = weak()] {
+                if (auto shared = w.lock())
+                    shared->handlePushNotifications();
+            },
+            PUSH_BATCH_WINDOW);
+}
+
+void
+JamiAccount::handlePushNotifications()
+{
+    decltype(pendingPushes_) pushes;
+    unsigned count;
+    {
+        std::lock_guard<std::mutex> lk(pushMtx_);
+        pushes = std::move(pendingPushes_);
+        pendingPushes_.clear();
+        count = std::exchange(pendingPushCount_, 0);
+        pushTask_.reset();
+    }
+    JAMI_WARN("[Account %s] handling %u push notifications for %zu keys",
+              getAccountID().c_str(),
+              count,
+              pushes.size());
+    for (const auto& push : pushes)
+        dht()->pushNotificationReceived(push.second);
+
+    Manager::instance().scheduler().scheduleIn(
+        [w = weak(), count] {
+            auto shared = w.lock();
+            if (not shared)
+                return;
+            auto done = [w, count] {
+                if (auto shared = w.lock())
+                    emitSignal<DRing::ConfigurationSignal::PushNotificationsHandled>(
+                        shared->getAccountID(), (int) count);
+            };
+            if (auto cm = shared->convModule())
+                cm->onSyncFinished(std::move(done));
+            else
+                done();
+        },
+        PUSH_SETTLE_DELAY);
 }
 
 std::string
@@ -3624,14 +3970,13 @@ void
 JamiAccount::sendInstantMessage(const std::string& convId,
                                 const std::map<std::string, std::string>& msg)
 {
-    auto members = convModule()->getConversationMembers(convId);
+    auto members = convModule()->getConversationMemberUris(convId);
     if (members.empty()) {
         // TODO remove, it's for old API for contacts
         sendTextMessage(convId, msg);
         return;
     }
-    for (const auto& m : members) {
-        auto uri = m.at("uri");
+    for (const auto& uri : members) {
         auto token = std::uniform_int_distribution<uint64_t> {1, JAMI_ID_MAX_VAL}(rand);
         // Announce to all members that a new message is sent
         sendMessage(uri, msg, token, false, true);
@@ -3657,7 +4002,8 @@ JamiAccount::handleMessage(const std::string& from, const std::pair<std::string,
         convModule()->onNewCommit(from,
                                   json["deviceId"].asString(),
                                   json["id"].asString(),
-                                  json["commit"].asString());
+                                  json["commit"].asString(),
+                                  json["origin"].asString());
         return true;
     } else if (m.first == MIME_TYPE_INVITE) {
         convModule()->onNeedConversationRequest(from, m.second);
@@ -3937,23 +4283,43 @@ JamiAccount::requestSIPConnection(const std::string& peerId,
 bool
 JamiAccount::needToSendProfile(const std::string& peerUri, const std::string& deviceId)
 {
-    auto vCardMd5 = fileutils::sha3File(fmt::format("{}/profile.vcf", idPath_));
-    std::string currentMd5 {};
     auto vCardPath = fmt::format("{}/vcard", cachePath_);
-    auto sha3Path = fmt::format("{}/sha3", vCardPath);
-    fileutils::check_dir(vCardPath.c_str(), 0700);
-    try {
-        currentMd5 = fileutils::loadTextFile(sha3Path);
-    } catch (...) {
-        fileutils::saveFile(sha3Path, {vCardMd5.begin(), vCardMd5.end()}, 0600);
-        return true;
-    }
-    if (currentMd5 != vCardMd5) {
-        // Incorrect sha3 stored. Update it
-        fileutils::removeAll(vCardPath, true);
-        fileutils::check_dir(vCardPath.c_str(), 0700);
-        fileutils::saveFile(sha3Path, {vCardMd5.begin(), vCardMd5.end()}, 0600);
-        return true;
+    {
+        std::lock_guard<std::mutex> lk(profileHashMtx_);
+        auto profile = profilePath();
+        // Both are set to an error value if there is no profile
+        std::error_code ec;
+        auto writeTime = std::filesystem::last_write_time(profile, ec);
+        auto size = std::filesystem::file_size(profile, ec);
+        if (profileHash_.sha3.empty() or writeTime != profileHash_.writeTime
+            or size != profileHash_.size) {
+            profileHash_.writeTime = writeTime;
+            profileHash_.size = size;
+            profileHash_.sha3 = fileutils::sha3File(profile);
+            profileHash_.stored = false;
+        }
+        if (not profileHash_.stored) {
+            const auto& vCardMd5 = profileHash_.sha3;
+            std::string currentMd5 {};
+            auto sha3Path = fmt::format("{}/sha3", vCardPath);
+            fileutils::check_dir(vCardPath.c_str(), 0700);
+            try {
+                currentMd5 = fileutils::loadTextFile(sha3Path);
+            } catch (...) {
+                fileutils::saveFile(sha3Path, {vCardMd5.begin(), vCardMd5.end()}, 0600);
+                profileHash_.stored = true;
+                return true;
+            }
+            if (currentMd5 != vCardMd5) {
+                // Incorrect sha3 stored. Update it
+                fileutils::removeAll(vCardPath, true);
+                fileutils::check_dir(vCardPath.c_str(), 0700);
+                fileutils::saveFile(sha3Path, {vCardMd5.begin(), vCardMd5.end()}, 0600);
+                profileHash_.stored = true;
+                return true;
+            }
+            profileHash_.stored = true;
+        }
     }
     fileutils::recursive_mkdir(fmt::format("{}/{}/", vCardPath, peerUri));
     return not fileutils::isFile(fmt::format("{}/{}/{}", vCardPath, peerUri, deviceId));
@@ -4133,6 +4499,8 @@ JamiAccount::cacheSIPConnection(std::shared_ptr<ChannelSocket>&& socket,
               deviceId.to_c_str());
     lk.unlock();
 
+    onBuddyConnectionChanged(peerId);
+
     sendProfile(peerId, deviceId.toString());
 
     convModule()->syncConversations(peerId, deviceId.toString());
@@ -4179,6 +4547,7 @@ JamiAccount::shutdownSIPConnection(const std::shared_ptr<ChannelSocket>& channel
             sipConns_.erase(it);
     }
     lk.unlock();
+    onBuddyConnectionChanged(peerId);
     // Shutdown after removal to let the callbacks do stuff if needed
     if (channel)
         channel->shutdown();
@@ -4230,8 +4599,24 @@ JamiAccount::sendFile(const std::string& conversationId,
             value["tid"] = std::to_string(tid);
             std::size_t found = path.find_last_of(DIR_SEPARATOR_CH);
             value["displayName"] = name.empty() ? path.substr(found + 1) : name;
-            value["totalSize"] = std::to_string(fileutils::size(path));
-            value["sha3sum"] = fileutils::sha3File(path);
+            auto totalSize = fileutils::size(path);
+            value["totalSize"] = std::to_string(totalSize);
+            std::string sha3sum;
+            if (totalSize >= static_cast<int64_t>(STRIPED_TRANSFER_MIN_SIZE)) {
+                // Lets the members holding the file send some of its chunks
+                std::vector<std::string> chunkSums;
+                sha3sum = fileutils::sha3File(path, fileChunkSize(totalSize), chunkSums);
+                std::string sums;
+                for (const auto& sum : chunkSums) {
+                    if (!sums.empty())
+                        sums += ',';
+                    sums += sum;
+                }
+                value["chunkSums"] = sums;
+            } else {
+                sha3sum = fileutils::sha3File(path);
+            }
+            value["sha3sum"] = sha3sum;
             value["type"] = "application/data-transfer+json";
 
             shared->convModule()
@@ -4239,10 +4624,12 @@ JamiAccount::sendFile(const std::string& conversationId,
                               std::move(value),
                               replyTo,
                               true,
-                              [accId = shared->getAccountID(),
+                              [w,
+                               accId = shared->getAccountID(),
                                conversationId,
                                tid,
-                               path](bool, const std::string& commitId) {
+                               path,
+                               sha3sum](bool, const std::string& commitId) {
                                   // Create a symlink to answer to re-ask
                                   auto filelinkPath = fileutils::get_data_dir() + DIR_SEPARATOR_STR
                                                       + accId + DIR_SEPARATOR_STR
@@ -4254,6 +4641,10 @@ JamiAccount::sendFile(const std::string& conversationId,
                                       filelinkPath += "." + extension;
                                   if (path != filelinkPath && !fileutils::isSymLink(filelinkPath))
                                       fileutils::createFileLink(filelinkPath, path, true);
+                                  // Lets the other conversations reuse it
+                                  if (auto shared = w.lock())
+                                      if (auto dt = shared->dataTransfer(conversationId))
+                                          dt->storeFile(filelinkPath, sha3sum);
                               });
         }
     });
@@ -4319,10 +4710,36 @@ JamiAccount::askForFileChannel(const std::string& conversationId,
                                size_t start,
                                size_t end)
 {
+    // Ranges asked to all the devices: the transfer is told once they all declined
+    struct Declines
+    {
+        std::mutex mtx;
+        std::size_t members {0}; // whose devices are still listed
+        std::size_t devices {0};
+        std::size_t declined {0};
+
+        // mtx must be locked
+        bool all() const { return members == 0 && declined == devices; }
+    };
+    auto declines = deviceId.empty() && !interactionId.empty() && end != 0
+                        ? std::make_shared<Declines>()
+                        : std::shared_ptr<Declines> {};
+    auto onDeclined = [w = weak(), conversationId, fileId, start](const std::string& did) {
+        dht::ThreadPool::io().run([w, conversationId, fileId, start, did] {
+            if (auto shared = w.lock())
+                if (auto dt = shared->dataTransfer(conversationId))
+                    dt->onFileChannelFailed(fileId, start, did);
+        });
+    };
+
     auto tryDevice = [=](const auto& did) {
         std::lock_guard<std::mutex> lkCM(connManagerMtx_);
         if (!connectionManager_)
             return;
+        if (declines) {
+            std::lock_guard<std::mutex> lk(declines->mtx);
+            declines->devices++;
+        }
 
         auto channelName = fmt::format("{}{}/{}/{}",
                                        DATA_TRANSFER_URI,
@@ -4337,10 +4754,21 @@ JamiAccount::askForFileChannel(const std::string& conversationId,
         connectionManager_->connectDevice(
             did,
             channelName,
-            [this, conversationId, fileId, interactionId](std::shared_ptr<ChannelSocket> channel,
-                                                          const DeviceId&) {
-                if (!channel)
+            [this, conversationId, fileId, interactionId, start, end, declines, onDeclined](
+                std::shared_ptr<ChannelSocket> channel, const DeviceId& did) {
+                if (!channel) {
+                    // Another device may send that range
+                    if (!interactionId.empty() && end != 0) {
+                        onDeclined(did.toString());
+                        if (declines) {
+                            std::lock_guard<std::mutex> lk(declines->mtx);
+                            declines->declined++;
+                            if (declines->all())
+                                onDeclined({});
+                        }
+                    }
                     return;
+                }
                 dht::ThreadPool::io().run(
                     [w = weak(), conversationId, channel, fileId, interactionId] {
                         auto shared = w.lock();
@@ -4364,12 +4792,27 @@ JamiAccount::askForFileChannel(const std::string& conversationId,
     } else {
         // Only ask for connected devices. For others we will try
         // on new peer online
-        for (const auto& m : convModule()->getConversationMembers(conversationId)) {
-            accountManager_->forEachDevice(dht::InfoHash(m.at("uri")),
-                                           [tryDevice = std::move(tryDevice)](
-                                               const std::shared_ptr<dht::crypto::PublicKey>& dev) {
-                                               tryDevice(dev->getLongId());
-                                           });
+        auto members = convModule()->getConversationMemberUris(conversationId);
+        if (declines) {
+            std::lock_guard<std::mutex> lk(declines->mtx);
+            declines->members = members.size();
+            if (declines->all())
+                onDeclined({});
+        }
+        for (const auto& uri : members) {
+            accountManager_->forEachDevice(
+                dht::InfoHash(uri),
+                [tryDevice](const std::shared_ptr<dht::crypto::PublicKey>& dev) {
+                    tryDevice(dev->getLongId());
+                },
+                [declines, onDeclined](bool) {
+                    if (!declines)
+                        return;
+                    std::lock_guard<std::mutex> lk(declines->mtx);
+                    declines->members--;
+                    if (declines->all())
+                        onDeclined({});
+                });
         }
     }
 }
@@ -4404,17 +4847,158 @@ JamiAccount::askForProfile(const std::string& conversationId,
         false);
 }
 
+bool
+JamiAccount::onTransferChannelRequest(const std::string& name)
+{
+    auto isFile = name.rfind(FILE_URI, 0) == 0;
+    auto tid = name.substr(isFile ? sizeof(FILE_URI) - 1 : sizeof(VCARD_URI) - 1);
+    std::lock_guard<std::mutex> lk(transfersMtx_);
+    incomingFileTransfers_.emplace(tid);
+    return true;
+}
+
+void
+JamiAccount::onTransferChannelReady(const std::string& peerId,
+                                    const std::string& name,
+                                    std::shared_ptr<ChannelSocket>&& channel)
+{
+    auto isVCard = name.rfind(VCARD_URI, 0) == 0;
+    auto tid = name.substr(isVCard ? sizeof(VCARD_URI) - 1 : sizeof(FILE_URI) - 1);
+    std::unique_lock<std::mutex> lk(transfersMtx_);
+    auto it = incomingFileTransfers_.find(tid);
+    // Note, outgoing file transfers are ignored.
+    if (it == incomingFileTransfers_.end())
+        return;
+    incomingFileTransfers_.erase(it);
+    lk.unlock();
+    InternalCompletionCb cb;
+    if (isVCard)
+        cb = [peerId, accountId = getAccountID()](const std::string& path) {
+            emitSignal<DRing::ConfigurationSignal::ProfileReceived>(accountId, peerId, path);
+        };
+
+    DRing::DataTransferInfo info;
+    info.accountId = getAccountID();
+    info.peer = peerId;
+    try {
+        dhtPeerConnector_->onIncomingConnection(info,
+                                                std::stoull(tid),
+                                                std::move(channel),
+                                                std::move(cb));
+    } catch (...) {
+        JAMI_ERR() << "Invalid tid: " << tid;
+    }
+}
+
+void
+JamiAccount::onGitChannelReady(const DeviceId& deviceId,
+                               const std::string& name,
+                               std::shared_ptr<ChannelSocket>&& channel)
+{
+    auto sep = name.find_last_of('/');
+    auto conversationId = name.substr(sep + 1);
+    auto remoteDevice = name.substr(6, sep - 6);
+
+    if (channel->isInitiator()) {
+        // Check if wanted remote it's our side (git://remoteDevice/conversationId)
+        return;
+    }
+
+    // Check if pull from banned device
+    if (convModule()->isBannedDevice(conversationId, remoteDevice)) {
+        JAMI_WARN("[Account %s] Git server requested for conversation %s, but the "
+                  "device is "
+                  "unauthorized (%s) ",
+                  getAccountID().c_str(),
+                  conversationId.c_str(),
+                  remoteDevice.c_str());
+        channel->shutdown();
+        return;
+    }
+
+    auto sock = gitSocket(deviceId, conversationId);
+    if (sock != std::nullopt && sock->lock() == channel) {
+        // The onConnectionReady is already used as client (for retrieving messages)
+        // So it's not the server socket
+        return;
+    }
+    auto accountId = this->accountID_;
+    JAMI_WARN("[Account %s] Git server requested for conversation %s, device %s, "
+              "channel %u",
+              accountId.c_str(),
+              conversationId.c_str(),
+              deviceId.to_c_str(),
+              channel->channel());
+    auto gs = std::make_unique<GitServer>(accountId, conversationId, channel);
+    gs->setOnFetched([w = weak(), conversationId, deviceId](const std::string& commit) {
+        if (auto shared = w.lock())
+            shared->convModule()->setFetched(conversationId, deviceId.toString(), commit);
+    });
+    const dht::Value::Id serverId = ValueIdDist()(rand);
+    {
+        std::lock_guard<std::mutex> lk(gitServersMtx_);
+        gitServers_[serverId] = std::move(gs);
+    }
+    channel->onShutdown([w = weak(), serverId]() {
+        // Run on main thread to avoid to be in mxSock's eventLoop
+        runOnMainThread([serverId, w]() {
+            auto shared = w.lock();
+            if (!shared)
+                return;
+            std::lock_guard<std::mutex> lk(shared->gitServersMtx_);
+            shared->gitServers_.erase(serverId);
+        });
+    });
+}
+
 void
 JamiAccount::initConnectionManager()
 {
     if (!connectionManager_) {
         connectionManager_ = std::make_unique<ConnectionManager>(*this);
-        channelHandlers_[Uri::Scheme::GIT]
-            = std::make_unique<ConversationChannelHandler>(shared(), *connectionManager_.get());
-        channelHandlers_[Uri::Scheme::SYNC]
-            = std::make_unique<SyncChannelHandler>(shared(), *connectionManager_.get());
-        channelHandlers_[Uri::Scheme::DATA_TRANSFER]
-            = std::make_unique<TransferChannelHandler>(shared(), *connectionManager_.get());
+        // The git servers are still managed by the account
+        auto gitHandler = std::make_shared<ConversationChannelHandler>(shared(),
+                                                                       *connectionManager_.get());
+        channelHandlers_.add(
+            "git://",
+            std::make_shared<ChannelCallbacks>(
+                [gitHandler](const auto& cert, const auto& name) {
+                    return gitHandler->onRequest(cert, name);
+                },
+                [w = weak()](const auto& cert, const auto& name, auto channel) {
+                    if (auto shared = w.lock())
+                        shared->onGitChannelReady(cert->getLongId(), name, std::move(channel));
+                }));
+        channelHandlers_.add("sync://",
+                             std::make_shared<SyncChannelHandler>(shared(),
+                                                                  *connectionManager_.get()));
+        channelHandlers_.add("data-transfer://",
+                             std::make_shared<TransferChannelHandler>(shared(),
+                                                                      *connectionManager_.get()));
+        channelHandlers_.add(
+            "sip",
+            std::make_shared<ChannelCallbacks>(
+                [](const auto&, const auto&) { return true; },
+                [w = weak()](const auto& cert, const auto&, auto channel) {
+                    if (auto shared = w.lock())
+                        shared->cacheSIPConnection(std::move(channel),
+                                                   cert->issuer->getId().toString(),
+                                                   cert->getLongId());
+                }));
+        // Non swarm file transfers and profiles
+        auto transferHandler = std::make_shared<ChannelCallbacks>(
+            [w = weak()](const auto&, const auto& name) {
+                auto shared = w.lock();
+                return shared and shared->onTransferChannelRequest(name);
+            },
+            [w = weak()](const auto& cert, const auto& name, auto channel) {
+                if (auto shared = w.lock())
+                    shared->onTransferChannelReady(cert->issuer->getId().toString(),
+                                                   name,
+                                                   std::move(channel));
+            });
+        channelHandlers_.add(FILE_URI, transferHandler);
+        channelHandlers_.add(VCARD_URI, transferHandler);
     }
 }
 
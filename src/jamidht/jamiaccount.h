@@ -28,7 +28,6 @@
 #endif
 
 #include "security/tls_session.h"
-#include "security/diffie-hellman.h"
 #include "sip/sipaccountbase.h"
 #include "jami/datatransfer_interface.h"
 #include "jamidht/conversation.h"
@@ -44,9 +43,11 @@
 #include "connectionmanager.h"
 #include "gitserver.h"
 #include "channel_handler.h"
+#include "channel_handler_registry.h"
 #include "conversation_module.h"
 #include "sync_module.h"
 #include "conversationrepository.h"
+#include "account_dht.h"
 
 #include <opendht/dhtrunner.h>
 #include <opendht/default_types.h>
@@ -56,6 +57,7 @@
 #include <pjsip/sip_types.h>
 
 #include <chrono>
+#include <filesystem>
 #include <future>
 #include <json/json.h>
 #include <list>
@@ -90,6 +92,7 @@ struct AccountInfo;
 class SipTransport;
 class ChanneledOutgoingTransfer;
 class SyncModule;
+struct PendingConfirmation;
 
 using SipConnectionKey = std::pair<std::string /* accountId */, DeviceId>;
 using GitSocketList = std::map<DeviceId,                               /* device Id */
@@ -136,6 +139,10 @@ public:
     }
 
     const std::string& getPath() const { return idPath_; }
+    /**
+     * Path of the account's archive, empty if managed by a server
+     */
+    std::string getArchivePath() const;
 
     /**
      * Constructor
@@ -337,6 +344,9 @@ public:
                      uint64_t id,
                      bool retryOnTimeout = true,
                      bool onlyConnected = false) override;
+    void sendMessages(const std::string& to,
+                      const OutgoingMessages& messages,
+                      bool retryOnTimeout = true) override;
     uint64_t sendTextMessage(const std::string& to,
                              const std::map<std::string, std::string>& payloads,
                              uint64_t refreshToken = 0) override;
@@ -362,6 +372,7 @@ public:
     bool changeArchivePassword(const std::string& password_old, const std::string& password_new);
 
     void connectivityChanged() override;
+    void networkChanged(const ConnectivityChange& change) override;
 
     // overloaded methods
     void flush() override;
@@ -402,8 +413,9 @@ public:
     /// further calls
     bool isMessageTreated(std::string_view id);
 
-    std::shared_ptr<dht::DhtRunner> dht()
+    std::shared_ptr<AccountDht> dht()
     {
+        std::lock_guard<std::mutex> lk(dhtMtx_);
         return dht_;
     }
 
@@ -412,11 +424,6 @@ public:
         return id_;
     }
 
-    const std::shared_future<tls::DhParams> dhParams() const
-    {
-        return dhParams_;
-    }
-
     void forEachDevice(const dht::InfoHash& to,
                        std::function<void(const std::shared_ptr<dht::crypto::PublicKey>&)>&& op,
                        std::function<void(bool)>&& end = {});
@@ -427,6 +434,7 @@ public:
 
     /**
      * To be called by clients with relevant data when a push notification is received.
+     * Handled with the ones received within PUSH_BATCH_WINDOW.
      */
     void pushNotificationReceived(const std::string& from,
                                   const std::map<std::string, std::string>& data);
@@ -652,6 +660,28 @@ private:
                                                                       bool previous = false);
 
     void trackPresence(const dht::InfoHash& h, BuddyInfo& buddy);
+    /**
+     * Get the devices announced once, for a buddy not listened
+     */
+    void pollPresence(BuddyInfo& buddy);
+    /**
+     * Listen to the most active buddies, up to MAX_PRESENCE_LISTENS and a few
+     * at a time, and poll the others now and then
+     */
+    void updatePresence();
+    /**
+     * Call updatePresence() after delay, unless planned before
+     * @note buddyInfoMtx must be locked
+     */
+    void schedulePresenceUpdate(std::chrono::steady_clock::duration delay);
+    /**
+     * A message was sent to or received from a buddy
+     */
+    void onBuddyActivity(const std::string& peerId);
+    /**
+     * A SIP connection was opened or closed with a device of the buddy
+     */
+    void onBuddyConnectionChanged(const std::string& peerId);
 
     void doRegister_();
 
@@ -721,8 +751,6 @@ private:
                                const std::shared_ptr<dht::crypto::Certificate>& from_cert,
                                const dht::InfoHash& from);
 
-    static tls::DhParams loadDhParams(std::string path);
-
     void loadCachedUrl(const std::string& url,
                        const std::string& cachePath,
                        const std::chrono::seconds& cacheDuration,
@@ -731,11 +759,6 @@ private:
     std::string getDhtProxyServer(const std::string& serverList);
     void loadCachedProxyServer(std::function<void(const std::string&)> cb);
 
-    /**
-     * The TLS settings, used only if tls is chosen as a sip transport.
-     */
-    void generateDhParams();
-
     template<class... Args>
     std::shared_ptr<IceTransport> createIceTransport(const Args&... args);
     void newOutgoingCallHelper(const std::shared_ptr<SIPCall>& call, std::string_view toUri);
@@ -749,7 +772,9 @@ private:
 #endif
     std::shared_ptr<dht::Logger> logger_;
 
-    std::shared_ptr<dht::DhtRunner> dht_ {};
+    // Replaced by doRegister_() when switching to or from the shared node: use dht()
+    mutable std::mutex dhtMtx_ {};
+    std::shared_ptr<AccountDht> dht_ {};
     std::unique_ptr<AccountManager> accountManager_;
     dht::crypto::Identity id_ {};
 
@@ -771,6 +796,15 @@ private:
     /* tracked buddies presence */
     mutable std::mutex buddyInfoMtx;
     std::map<dht::InfoHash, BuddyInfo> trackedBuddies_;
+    std::shared_ptr<Task> presenceTask_;
+    std::chrono::steady_clock::time_point presenceUpdateTime_;
+
+    /* push notifications handled together, by key */
+    std::mutex pushMtx_;
+    std::map<std::string, std::map<std::string, std::string>> pendingPushes_;
+    unsigned pendingPushCount_ {0};
+    std::shared_ptr<Task> pushTask_;
+    void handlePushNotifications();
 
     mutable std::mutex dhtValuesMtx_;
     bool dhtPublicInCalls_ {true};
@@ -806,10 +840,6 @@ private:
     std::string proxyServer_ {};
     std::string proxyServerCached_ {};
 
-    std::mutex dhParamsMtx_ {};
-    std::shared_future<tls::DhParams> dhParams_;
-    std::condition_variable dhParamsCv_;
-
     bool allowPeersFromHistory_ {true};
     bool allowPeersFromContact_ {true};
     bool allowPeersFromTrusted_ {true};
@@ -828,6 +858,8 @@ private:
     mutable std::mutex connManagerMtx_ {};
     std::unique_ptr<ConnectionManager> connectionManager_;
     GitSocketList gitSocketList_ {};
+    // Fetches of the conversations, beside the main loop
+    Strand gitStrand_;
 
     std::mutex discoveryMapMtx_;
     std::shared_ptr<dht::PeerDiscovery> peerDiscovery_;
@@ -908,9 +940,36 @@ private:
                                const std::string& peerId,
                                const DeviceId& deviceId);
 
+    /**
+     * Serve a conversation on a git:// channel asked by a device
+     */
+    void onGitChannelReady(const DeviceId& deviceId,
+                           const std::string& name,
+                           std::shared_ptr<ChannelSocket>&& channel);
+
     // File transfers
     std::mutex transfersMtx_ {};
     std::set<std::string> incomingFileTransfers_ {};
+    // Channels of the non swarm file transfers and profiles (file://tid, vcard://tid)
+    bool onTransferChannelRequest(const std::string& name);
+    void onTransferChannelReady(const std::string& peerId,
+                                const std::string& name,
+                                std::shared_ptr<ChannelSocket>&& channel);
+
+    /**
+     * sha3 of profile.vcf, hashed again once the file is written (by the client), i.e. its
+     * modification time or its size changed
+     */
+    struct ProfileHash
+    {
+        std::filesystem::file_time_type writeTime {};
+        std::uintmax_t size {0};
+        std::string sha3 {};
+        // Whether <cache>/vcard/sha3 is known to match
+        bool stored {false};
+    };
+    std::mutex profileHashMtx_ {};
+    ProfileHash profileHash_ {};
 
     /**
      * Helper used to send SIP messages on a channeled connection
@@ -929,6 +988,25 @@ private:
                         uint64_t token,
                         const std::map<std::string, std::string>& data,
                         pjsip_endpt_send_callback cb);
+    /**
+     * Send a message on the SIP connections open with the peer
+     * @return the devices the message is sent to
+     */
+    std::set<DeviceId> sendMessageOnChannels(const std::string& to,
+                                             const std::map<std::string, std::string>& payloads,
+                                             uint64_t token,
+                                             bool retryOnTimeout,
+                                             bool onlyConnected,
+                                             const std::shared_ptr<PendingConfirmation>& confirm);
+    /**
+     * Put messages in the inbox of the devices of the peer not in devices.
+     * Several messages are put at once, in a batch acknowledged as a whole.
+     */
+    void sendDhtMessages(const std::string& to,
+                         const dht::InfoHash& toH,
+                         const std::shared_ptr<OutgoingMessages>& messages,
+                         const std::shared_ptr<std::set<DeviceId>>& devices,
+                         const std::shared_ptr<PendingConfirmation>& confirm);
 
     std::mutex gitServersMtx_ {};
     std::map<dht::Value::Id, std::unique_ptr<GitServer>> gitServers_ {};
@@ -942,7 +1020,8 @@ private:
 
     bool noSha3sumVerification_ {false};
 
-    std::map<Uri::Scheme, std::unique_ptr<ChannelHandlerInterface>> channelHandlers_ {};
+    // Handlers of the channels requested by the peers, by name
+    ChannelHandlerRegistry channelHandlers_ {};
 
     std::unique_ptr<ConversationModule> convModule_;
     std::mutex moduleMtx_;
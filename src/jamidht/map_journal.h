@@ -0,0 +1,312 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "fileutils.h"
+#include "logger.h"
+#include "noncopyable.h"
+
+#include <msgpack.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace jami {
+
+/**
+ * Store a map on the disk as a msgpack snapshot, followed by a journal of the
+ * entries changed since.
+ *
+ * Saving the map only appends the entries that changed since the last save, so
+ * updating one conversation out of thousands doesn't rewrite them all. When
+ * the journal grows bigger than the map, it is merged into a new snapshot.
+ *
+ * The snapshot keeps the format of the map alone, so read() is also able to
+ * load files written before the journal existed. Keys are packed as msgpack
+ * packs them, e.g. as binary for dht::InfoHash.
+ */
+template<typename Value, typename Key = std::string>
+class MapJournal
+{
+public:
+    using Map = std::map<Key, Value>;
+
+    /**
+     * @param path  Of the snapshot, the journal is next to it
+     */
+    explicit MapJournal(const std::string& path)
+        : path_(path)
+    {}
+
+    /**
+     * Save the changes between map and what was last saved
+     */
+    void save(const Map& map)
+    {
+        std::lock_guard<std::mutex> lk(fileutils::getFileLock(path_));
+        loadLocked();
+
+        auto packed = packMap(map);
+
+        msgpack::sbuffer records;
+        msgpack::packer<msgpack::sbuffer> pk(&records);
+        std::size_t changes = 0;
+        for (const auto& [key, value] : packed) {
+            auto it = saved_.find(key);
+            if (it != saved_.end() && it->second == value)
+                continue;
+            pk.pack_array(2);
+            records.write(key.data(), key.size());
+            records.write(value.data(), value.size());
+            changes++;
+        }
+        for (const auto& [key, value] : saved_) {
+            if (packed.find(key) == packed.end()) {
+                pk.pack_array(1);
+                records.write(key.data(), key.size());
+                changes++;
+            }
+        }
+        saved_ = std::move(packed);
+        appendLocked(records, changes);
+    }
+
+    /**
+     * Save the changes of some entries only, for maps too big to be compared
+     * on each save
+     * @param changed   New values of the entries changed, or added
+     * @param removed   Keys of the entries removed
+     */
+    void update(const Map& changed, const std::set<Key>& removed)
+    {
+        std::lock_guard<std::mutex> lk(fileutils::getFileLock(path_));
+        loadLocked();
+
+        msgpack::sbuffer records;
+        msgpack::packer<msgpack::sbuffer> pk(&records);
+        std::size_t changes = 0;
+        for (const auto& [key, value] : changed) {
+            auto packedKey = pack(key);
+            auto packed = pack(value);
+            auto& saved = saved_[packedKey];
+            if (saved == packed)
+                continue;
+            pk.pack_array(2);
+            records.write(packedKey.data(), packedKey.size());
+            records.write(packed.data(), packed.size());
+            saved = std::move(packed);
+            changes++;
+        }
+        for (const auto& key : removed) {
+            auto packedKey = pack(key);
+            if (saved_.erase(packedKey) == 0)
+                continue;
+            pk.pack_array(1);
+            records.write(packedKey.data(), packedKey.size());
+            changes++;
+        }
+        appendLocked(records, changes);
+    }
+
+    /**
+     * Load the snapshot and replay the journal
+     */
+    static Map read(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lk(fileutils::getFileLock(path));
+        std::map<std::string, std::string> packed;
+        readLocked(path, &packed);
+        Map map;
+        for (const auto& [packedKey, value] : packed) {
+            try {
+                Key key;
+                msgpack::unpack(packedKey.data(), packedKey.size()).get().convert(key);
+                Value v;
+                msgpack::unpack(value.data(), value.size()).get().convert(v);
+                map.emplace(std::move(key), std::move(v));
+            } catch (const std::exception& e) {
+                JAMI_WARN("[journal] Ignore invalid entry in %s: %s", path.c_str(), e.what());
+            }
+        }
+        return map;
+    }
+
+    /**
+     * Replace what is stored by map, without a journal.
+     * Saving with an existing MapJournal for this path is then undefined.
+     */
+    static void write(const std::string& path, const Map& map)
+    {
+        std::lock_guard<std::mutex> lk(fileutils::getFileLock(path));
+        writeSnapshotLocked(path, packMap(map));
+    }
+
+private:
+    NON_COPYABLE(MapJournal);
+
+    static constexpr std::size_t MIN_COMPACTION {64};
+
+    static std::string journalPath(const std::string& path) { return path + ".journal"; }
+
+    template<typename T>
+    static std::string pack(const T& value)
+    {
+        msgpack::sbuffer buffer;
+        msgpack::pack(buffer, value);
+        return std::string(buffer.data(), buffer.size());
+    }
+
+    /**
+     * Keys and values packed
+     */
+    static std::map<std::string, std::string> packMap(const Map& map)
+    {
+        std::map<std::string, std::string> packed;
+        for (const auto& [key, value] : map)
+            packed.emplace(pack(key), pack(value));
+        return packed;
+    }
+
+    void loadLocked()
+    {
+        if (loaded_)
+            return;
+        loaded_ = true;
+        saved_.clear();
+        journalSize_ = 0;
+        readLocked(path_, &saved_, &journalSize_, &compact_);
+    }
+
+    /**
+     * Append records to the journal, or merge it in a new snapshot if it grew too big
+     * @param changes   Number of records
+     */
+    void appendLocked(const msgpack::sbuffer& records, std::size_t changes)
+    {
+        if (changes == 0 && !compact_)
+            return;
+
+        journalSize_ += changes;
+        if (compact_ || journalSize_ > std::max(MIN_COMPACTION, saved_.size())) {
+            writeSnapshotLocked(path_, saved_);
+            journalSize_ = 0;
+            compact_ = false;
+            return;
+        }
+        auto file = fileutils::ofstream(journalPath(path_), std::ios::app | std::ios::binary);
+        file.write(records.data(), records.size());
+        if (!file) {
+            JAMI_WARN("[journal] Couldn't append to %s", journalPath(path_).c_str());
+            compact_ = true;
+        }
+    }
+
+    /**
+     * Read the values, still packed, as they are stored
+     * @param journalSize   Records in the journal
+     * @param compact       Set if the journal ends with a partial record
+     */
+    static void readLocked(const std::string& path,
+                           std::map<std::string, std::string>* packed,
+                           std::size_t* journalSize = nullptr,
+                           bool* compact = nullptr)
+    {
+        try {
+            auto file = fileutils::loadFile(path);
+            auto oh = msgpack::unpack((const char*) file.data(), file.size());
+            if (oh.get().type == msgpack::type::MAP) {
+                const auto& map = oh.get().via.map;
+                for (uint32_t i = 0; i < map.size; ++i)
+                    (*packed)[pack(map.ptr[i].key)] = pack(map.ptr[i].val);
+            }
+        } catch (const std::exception& e) {
+            JAMI_WARN("[journal] error loading %s: %s", path.c_str(), e.what());
+        }
+
+        std::vector<uint8_t> journal;
+        try {
+            journal = fileutils::loadFile(journalPath(path));
+        } catch (const std::exception&) {
+            return;
+        }
+        std::size_t offset = 0;
+        std::size_t records = 0;
+        try {
+            while (offset < journal.size()) {
+                auto oh = msgpack::unpack((const char*) journal.data(), journal.size(), offset);
+                const auto& record = oh.get();
+                if (record.type != msgpack::type::ARRAY || record.via.array.size == 0)
+                    throw msgpack::type_error();
+                auto key = pack(record.via.array.ptr[0]);
+                if (record.via.array.size == 1)
+                    packed->erase(key);
+                else
+                    (*packed)[key] = pack(record.via.array.ptr[1]);
+                records++;
+            }
+        } catch (const std::exception&) {
+            // Interrupted append, the next save rewrites the files
+            JAMI_WARN("[journal] Ignore the end of %s", journalPath(path).c_str());
+            if (compact)
+                *compact = true;
+        }
+        if (journalSize)
+            *journalSize = records;
+    }
+
+    static void writeSnapshotLocked(const std::string& path,
+                                    const std::map<std::string, std::string>& packed)
+    {
+        auto tmpPath = path + ".tmp";
+        {
+            auto file = fileutils::ofstream(tmpPath, std::ios::trunc | std::ios::binary);
+            msgpack::packer<std::ofstream> pk(&file);
+            pk.pack_map(packed.size());
+            for (const auto& [key, value] : packed) {
+                file.write(key.data(), key.size());
+                file.write(value.data(), value.size());
+            }
+            if (!file) {
+                JAMI_ERR("[journal] Couldn't write %s", tmpPath.c_str());
+                return;
+            }
+        }
+#ifdef _WIN32
+        // rename() doesn't replace existing files
+        fileutils::remove(path);
+#endif
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            JAMI_ERR("[journal] Couldn't replace %s", path.c_str());
+            return;
+        }
+        // Replaying the journal over the new snapshot would give the same map
+        fileutils::remove(journalPath(path));
+    }
+
+    const std::string path_;
+    bool loaded_ {false};
+    bool compact_ {false};
+    std::size_t journalSize_ {0};
+    std::map<std::string, std::string> saved_ {}; // Keys and values as packed on the disk
+};
+
+} // namespace jami
@@ -18,23 +18,22 @@
 
 #include "logger.h"
 #include "manager.h"
+#include "metrics.h"
 #include "multiplexed_socket.h"
 #include "peer_connection.h"
 #include "ice_transport.h"
 #include "security/certstore.h"
 
 #include <deque>
+#include <limits>
 #include <opendht/thread_pool.h>
 
 static constexpr std::size_t IO_BUFFER_SIZE {8192}; ///< Size of char buffer used by IO operations
-static constexpr int MULTIPLEXED_SOCKET_VERSION {1};
-
-struct ChanneledMessage
-{
-    uint16_t channel;
-    std::vector<uint8_t> data;
-    MSGPACK_DEFINE(channel, data)
-};
+static constexpr int MULTIPLEXED_SOCKET_VERSION {3};
+// First version supporting the per channel flow control
+static constexpr int FLOW_CONTROL_VERSION {2};
+// First version keeping the data sent on a channel before accepting it
+static constexpr int EARLY_DATA_VERSION {3};
 
 struct BeaconMsg
 {
@@ -45,7 +44,20 @@ struct BeaconMsg
 struct VersionMsg
 {
     int v;
-    MSGPACK_DEFINE_MAP(v)
+    // Receive window of each channel, in bytes. Absent before FLOW_CONTROL_VERSION
+    uint64_t w {0};
+    MSGPACK_DEFINE_MAP(v, w)
+};
+
+/**
+ * Sent when the consumer of channel c consumed n bytes, allowing the peer
+ * to send n more bytes on that channel
+ */
+struct CreditMsg
+{
+    uint16_t c;
+    uint64_t n;
+    MSGPACK_DEFINE_MAP(c, n)
 };
 
 namespace jami {
@@ -53,15 +65,26 @@ namespace jami {
 using clock = std::chrono::steady_clock;
 using time_point = clock::time_point;
 
+// Set on the event loop thread, which must never wait for credits:
+// it is the one reading them
+static thread_local bool isEventLoopThread {false};
+
+// Shortest idle time after which a keepalive beacon was lost on the current network, in ms:
+// the NAT bindings don't live longer
+static std::atomic<int64_t> natBindingLifetime {
+    std::chrono::duration_cast<std::chrono::milliseconds>(KEEPALIVE_MAX).count()};
+
 class MultiplexedSocket::Impl
 {
 public:
     Impl(MultiplexedSocket& parent,
          const DeviceId& deviceId,
-         std::unique_ptr<TlsSocketEndpoint> endpoint)
+         std::unique_ptr<TlsSocketEndpoint> endpoint,
+         std::size_t channelWindow)
         : parent_(parent)
         , deviceId(deviceId)
         , endpoint(std::move(endpoint))
+        , channelWindow_(channelWindow)
         , eventLoopThread_ {[this] {
             try {
                 eventLoop();
@@ -111,6 +134,11 @@ public:
         isShutdown_ = true;
         if (beaconTask_)
             beaconTask_->cancel();
+        {
+            std::lock_guard<std::mutex> lk(keepAliveMtx_);
+            if (keepAliveTask_)
+                keepAliveTask_->cancel();
+        }
         if (onShutdown_)
             onShutdown_();
         if (endpoint) {
@@ -125,12 +153,15 @@ public:
                                               bool isInitiator = false)
     {
         auto& channelSocket = sockets[channel];
-        if (not channelSocket)
+        if (not channelSocket) {
             channelSocket = std::make_shared<ChannelSocket>(parent_.weak(),
                                                             name,
                                                             channel,
                                                             isInitiator);
-        else {
+            channelSocket->setFlowControl(peerWindow_, flowControl_ ? channelWindow_ : 0);
+            if (isInitiator and peerEarlyData_)
+                channelSocket->enableEarlyData();
+        } else {
             JAMI_WARN("A channel is already present on that socket, accepting "
                       "the request will close the previous one %s",
                       name.c_str());
@@ -151,7 +182,7 @@ public:
     /**
      * Triggered when a new packet on a channel is received
      */
-    void handleChannelPacket(uint16_t channel, std::vector<uint8_t>&& pkt);
+    void handleChannelPacket(uint16_t channel, const uint8_t* data, std::size_t len);
     void onRequest(const std::string& name, uint16_t channel);
     void onAccept(const std::string& name, uint16_t channel);
 
@@ -164,6 +195,26 @@ public:
     void handleBeaconResponse();
     std::atomic_int beaconCounter_ {0};
 
+    // Keepalive
+    void scheduleKeepAlive();
+    void onKeepAlive();
+    void onKeepAliveLost();
+    std::chrono::milliseconds currentKeepAliveInterval() const
+    {
+        return std::min(keepAliveInterval_, std::chrono::milliseconds(natBindingLifetime.load()));
+    }
+    std::atomic<clock::rep> lastReceived_ {clock::now().time_since_epoch().count()};
+    std::atomic<clock::rep> lastSent_ {clock::now().time_since_epoch().count()};
+    std::mutex keepAliveMtx_ {};
+    std::shared_ptr<Task> keepAliveTask_ {};
+    std::chrono::milliseconds keepAliveInterval_ {KEEPALIVE_MIN}; // protected by keepAliveMtx_
+    // Idle time after which the pending keepalive beacon was sent, 0 if none
+    std::chrono::milliseconds keepAliveIdle_ {0}; // protected by keepAliveMtx_
+
+    // Flow control
+    void sendCredit(uint16_t channel, uint64_t credit);
+    void handleCredit(uint16_t channel, uint64_t credit);
+
     bool writeProtocolMessage(const msgpack::sbuffer& buffer);
 
     msgpack::unpacker pac_ {};
@@ -181,6 +232,14 @@ public:
     std::mutex socketsMutex {};
     std::map<uint16_t, std::shared_ptr<ChannelSocket>> sockets {};
 
+    // Data received on the requested channels, until the request is answered
+    struct EarlyData
+    {
+        std::vector<uint8_t> data {};
+        bool eof {false};
+    };
+    std::map<uint16_t, EarlyData> earlyData_ {}; // protected by socketsMutex
+
     // Main loop to parse incoming packets
     std::atomic_bool stop {false};
     std::thread eventLoopThread_ {};
@@ -188,16 +247,23 @@ public:
     std::atomic_bool isShutdown_ {false};
 
     std::mutex writeMtx {};
+    // Order the writers of the channels, taken before writeMtx
+    ChannelWriteScheduler writeScheduler_ {};
 
     time_point start_ {clock::now()};
     std::shared_ptr<Task> beaconTask_ {};
 
     // version related stuff
     void sendVersion();
-    void onVersion(int version);
+    void onVersion(int version, uint64_t window);
     std::atomic_bool canSendBeacon_ {false};
     std::atomic_bool answerBeacon_ {true};
     int version_ {MULTIPLEXED_SOCKET_VERSION};
+    // Negotiated with the version, protected by socketsMutex
+    const std::size_t channelWindow_;
+    bool flowControl_ {false};
+    std::size_t peerWindow_ {0};
+    bool peerEarlyData_ {false};
     std::function<void(bool)> onBeaconCb_ {};
     std::function<void(int)> onVersionCb_ {};
 };
@@ -213,6 +279,7 @@ MultiplexedSocket::Impl::eventLoop()
         }
         return true;
     });
+    isEventLoopThread = true;
     sendVersion();
     std::error_code ec;
     while (!stop) {
@@ -233,17 +300,35 @@ MultiplexedSocket::Impl::eventLoop()
             break;
         }
 
+        lastReceived_ = clock::now().time_since_epoch().count();
         pac_.buffer_consumed(size);
         msgpack::object_handle oh;
         while (pac_.next(oh) && !stop) {
             try {
-                auto msg = oh.get().as<ChanneledMessage>();
-                if (msg.channel == CONTROL_CHANNEL)
-                    handleControlPacket(std::move(msg.data));
-                else if (msg.channel == PROTOCOL_CHANNEL)
-                    handleProtocolPacket(std::move(msg.data));
+                // [channel, data]. The data is not copied out of the unpacker:
+                // bin objects reference its buffer, kept alive by oh
+                const auto& o = oh.get();
+                if (o.type != msgpack::type::ARRAY or o.via.array.size != 2)
+                    throw msgpack::type_error();
+                auto channel = o.via.array.ptr[0].as<uint16_t>();
+                const auto& body = o.via.array.ptr[1];
+                const uint8_t* data;
+                std::size_t len;
+                if (body.type == msgpack::type::BIN) {
+                    data = reinterpret_cast<const uint8_t*>(body.via.bin.ptr);
+                    len = body.via.bin.size;
+                } else if (body.type == msgpack::type::STR) {
+                    data = reinterpret_cast<const uint8_t*>(body.via.str.ptr);
+                    len = body.via.str.size;
+                } else {
+                    throw msgpack::type_error();
+                }
+                if (channel == CONTROL_CHANNEL)
+                    handleControlPacket(std::vector<uint8_t>(data, data + len));
+                else if (channel == PROTOCOL_CHANNEL)
+                    handleProtocolPacket(std::vector<uint8_t>(data, data + len));
                 else
-                    handleChannelPacket(msg.channel, std::move(msg.data));
+                    handleChannelPacket(channel, data, len);
             } catch (const std::exception& E) {
                 JAMI_WARN("Failed to unpacked message of %d bytes: %s", size, E.what());
             } catch (...) {
@@ -263,6 +348,7 @@ MultiplexedSocket::Impl::onAccept(const std::string& name, uint16_t channel)
         return;
     }
 
+    socket->enableWrites();
     onChannelReady_(deviceId, socket);
     socket->ready();
     // Due to the callbacks that can take some time, onAccept can arrive after
@@ -292,6 +378,7 @@ MultiplexedSocket::Impl::sendBeacon(const std::chrono::milliseconds& timeout)
             if (auto shared = w.lock()) {
                 if (shared->pimpl_->beaconCounter_ != 0) {
                     JAMI_ERR() << "Beacon doesn't get any response. Stopping socket";
+                    shared->pimpl_->onKeepAliveLost();
                     shared->shutdown();
                 }
             }
@@ -321,6 +408,74 @@ MultiplexedSocket::Impl::handleBeaconResponse()
 {
     JAMI_DBG("Get beacon response from peer %s", deviceId.to_c_str());
     beaconCounter_--;
+    {
+        std::lock_guard<std::mutex> lk(keepAliveMtx_);
+        if (keepAliveIdle_.count() != 0) {
+            // The bindings lived at least this long, try a longer interval
+            keepAliveInterval_ = std::min(keepAliveInterval_ * 2,
+                                          std::chrono::milliseconds(KEEPALIVE_MAX));
+            keepAliveIdle_ = {};
+        }
+    }
+    scheduleKeepAlive();
+}
+
+void
+MultiplexedSocket::Impl::scheduleKeepAlive()
+{
+    if (!canSendBeacon_ || isShutdown_)
+        return;
+    std::lock_guard<std::mutex> lk(keepAliveMtx_);
+    if (keepAliveIdle_.count() != 0)
+        return; // Rescheduled once answered
+    auto next = time_point(clock::duration(lastReceived_.load())) + currentKeepAliveInterval();
+    if (keepAliveTask_)
+        keepAliveTask_->cancel();
+    keepAliveTask_ = Manager::instance().scheduleTaskIn(
+        [w = parent_.weak()]() {
+            if (auto shared = w.lock())
+                shared->pimpl_->onKeepAlive();
+        },
+        std::max(next - clock::now(), clock::duration::zero()));
+}
+
+void
+MultiplexedSocket::Impl::onKeepAlive()
+{
+    if (isShutdown_)
+        return;
+    // A beacon is already pending, its response reschedules the keepalive
+    if (beaconCounter_ != 0)
+        return;
+    auto idle = clock::now() - time_point(clock::duration(lastReceived_.load()));
+    bool expired;
+    {
+        std::lock_guard<std::mutex> lk(keepAliveMtx_);
+        expired = idle >= currentKeepAliveInterval();
+        if (expired)
+            keepAliveIdle_ = std::chrono::duration_cast<std::chrono::milliseconds>(idle);
+    }
+    // Data received meanwhile: the connection is alive
+    if (!expired) {
+        scheduleKeepAlive();
+        return;
+    }
+    sendBeacon(SEND_BEACON_TIMEOUT);
+}
+
+void
+MultiplexedSocket::Impl::onKeepAliveLost()
+{
+    std::lock_guard<std::mutex> lk(keepAliveMtx_);
+    if (keepAliveIdle_.count() == 0)
+        return;
+    auto lifetime = std::max(std::chrono::milliseconds(KEEPALIVE_MIN), keepAliveIdle_ * 3 / 4);
+    if (lifetime.count() < natBindingLifetime) {
+        natBindingLifetime = lifetime.count();
+        JAMI_WARN("Keepalive lost after %lld s idle, interval limited to %lld s",
+                  static_cast<long long>(keepAliveIdle_.count() / 1000),
+                  static_cast<long long>(lifetime.count() / 1000));
+    }
 }
 
 bool
@@ -340,21 +495,44 @@ MultiplexedSocket::Impl::sendVersion()
     dht::ThreadPool::io().run([w = parent_.weak()]() {
         if (auto shared = w.lock()) {
             auto version = shared->pimpl_->version_;
-            msgpack::sbuffer buffer(8);
+            msgpack::sbuffer buffer(16);
             msgpack::packer<msgpack::sbuffer> pk(&buffer);
-            pk.pack(VersionMsg {version});
+            pk.pack(VersionMsg {version, shared->pimpl_->channelWindow_});
             shared->pimpl_->writeProtocolMessage(buffer);
         }
     });
 }
 
 void
-MultiplexedSocket::Impl::onVersion(int version)
+MultiplexedSocket::Impl::onVersion(int version, uint64_t window)
 {
+    // Both sides must understand credits, else the writes are not limited
+    auto flowControl = version >= FLOW_CONTROL_VERSION and version_ >= FLOW_CONTROL_VERSION
+                       and window > 0;
+    {
+        std::lock_guard<std::mutex> lkSockets(socketsMutex);
+        flowControl_ = flowControl;
+        peerWindow_ = flowControl ? window : 0;
+        // The channels requested before still wait for their answer
+        peerEarlyData_ = version >= EARLY_DATA_VERSION and version_ >= EARLY_DATA_VERSION;
+        for (const auto& [_, socket] : sockets) {
+            if (!socket)
+                continue;
+            socket->setFlowControl(peerWindow_, flowControl ? channelWindow_ : 0);
+            if (peerEarlyData_ and socket->isInitiator())
+                socket->enableEarlyData();
+        }
+    }
+    if (flowControl)
+        JAMI_DBG("Enable flow control for %s, peer window: %zu bytes",
+                 deviceId.to_c_str(),
+                 static_cast<std::size_t>(window));
+
     // Check if version > 1
     if (version >= 1) {
         JAMI_INFO() << "Enable beacon support for " << deviceId;
         canSendBeacon_ = true;
+        scheduleKeepAlive();
     } else {
         JAMI_WARN("Peer %s uses an old version which doesn't support all the features (%d)",
                   deviceId.to_c_str(),
@@ -368,9 +546,21 @@ MultiplexedSocket::Impl::onRequest(const std::string& name, uint16_t channel)
 {
     auto accept = onRequest_(endpoint->peerCertificate(), channel, name);
     std::shared_ptr<ChannelSocket> channelSocket;
-    if (accept) {
+    bool eof = false;
+    {
         std::lock_guard<std::mutex> lkSockets(socketsMutex);
-        channelSocket = makeSocket(name, channel);
+        auto early = earlyData_.find(channel);
+        if (accept) {
+            channelSocket = makeSocket(name, channel);
+            // Delivered before what the socket receives next
+            if (early != earlyData_.end()) {
+                if (!early->second.data.empty())
+                    channelSocket->onRecv(early->second.data.data(), early->second.data.size());
+                eof = early->second.eof;
+            }
+        }
+        if (early != earlyData_.end())
+            earlyData_.erase(early);
     }
 
     // Answer to ChannelRequest if accepted
@@ -395,24 +585,48 @@ MultiplexedSocket::Impl::onRequest(const std::string& name, uint16_t channel)
     if (accept) {
         onChannelReady_(deviceId, channelSocket);
         channelSocket->ready();
+        if (eof)
+            handleChannelPacket(channel, nullptr, 0);
     }
 }
 
 void
 MultiplexedSocket::Impl::handleControlPacket(std::vector<uint8_t>&& pkt)
 {
+    // Unpacked by the event loop, so that it keeps the data sent on the
+    // requested channels before they are accepted
+    auto msgs = std::make_shared<std::vector<msgpack::object_handle>>();
+    try {
+        size_t off = 0;
+        while (off != pkt.size())
+            msgs->emplace_back(msgpack::unpack((const char*) pkt.data(), pkt.size(), off));
+    } catch (const std::exception& e) {
+        JAMI_ERR("Error on the control channel: %s", e.what());
+    }
+    {
+        std::lock_guard<std::mutex> lkSockets(socketsMutex);
+        for (const auto& msg : *msgs) {
+            if (msg.get().type != msgpack::type::ARRAY)
+                continue;
+            try {
+                auto req = msg.get().as<ChannelRequest>();
+                if (req.state == ChannelRequestState::REQUEST
+                    and sockets.find(req.channel) == sockets.end())
+                    earlyData_.emplace(req.channel, EarlyData {});
+            } catch (const std::exception&) {
+            }
+        }
+    }
+
     // Run this on dedicated thread because some callbacks can take time
-    dht::ThreadPool::io().run([w = parent_.weak(), pkt = std::move(pkt)]() {
+    dht::ThreadPool::io().run([w = parent_.weak(), msgs = std::move(msgs)]() {
         auto shared = w.lock();
         if (!shared)
             return;
-        try {
-            size_t off = 0;
-            while (off != pkt.size()) {
-                msgpack::unpacked result;
-                msgpack::unpack(result, (const char*) pkt.data(), pkt.size(), off);
-                auto object = result.get();
-                auto& pimpl = *shared->pimpl_;
+        auto& pimpl = *shared->pimpl_;
+        for (const auto& msg : *msgs) {
+            try {
+                const auto& object = msg.get();
                 if (pimpl.handleProtocolMsg(object))
                     continue;
                 auto req = object.as<ChannelRequest>();
@@ -427,21 +641,24 @@ MultiplexedSocket::Impl::handleControlPacket(std::vector<uint8_t>&& pkt)
                     }
                 } else if (pimpl.onRequest_) {
                     pimpl.onRequest(req.name, req.channel);
+                } else {
+                    std::lock_guard<std::mutex> lkSockets(pimpl.socketsMutex);
+                    pimpl.earlyData_.erase(req.channel);
                 }
+            } catch (const std::exception& e) {
+                JAMI_ERR("Error on the control channel: %s", e.what());
             }
-        } catch (const std::exception& e) {
-            JAMI_ERR("Error on the control channel: %s", e.what());
         }
     });
 }
 
 void
-MultiplexedSocket::Impl::handleChannelPacket(uint16_t channel, std::vector<uint8_t>&& pkt)
+MultiplexedSocket::Impl::handleChannelPacket(uint16_t channel, const uint8_t* data, std::size_t len)
 {
     std::lock_guard<std::mutex> lkSockets(socketsMutex);
     auto sockIt = sockets.find(channel);
-    if (channel > 0 && sockIt->second) {
-        if (pkt.size() == 0) {
+    if (channel > 0 && sockIt != sockets.end() && sockIt->second) {
+        if (len == 0) {
             sockIt->second->stop();
             if (sockIt->second->isAnswered())
                 sockets.erase(sockIt);
@@ -449,9 +666,17 @@ MultiplexedSocket::Impl::handleChannelPacket(uint16_t channel, std::vector<uint8
                 sockIt->second->removable(); // This means that onAccept didn't happen yet, will be
                                              // removed later.
         } else {
-            sockIt->second->onRecv(std::move(pkt));
+            sockIt->second->onRecv(data, len);
         }
-    } else if (pkt.size() != 0) {
+    } else if (auto early = earlyData_.find(channel); early != earlyData_.end()) {
+        // Sent before the request is accepted
+        if (len == 0)
+            early->second.eof = true;
+        else if (early->second.data.size() + len <= EARLY_DATA_SIZE)
+            early->second.data.insert(early->second.data.end(), data, data + len);
+        else
+            JAMI_WARN("Too much early data on channel %u", channel);
+    } else if (len != 0) {
         JAMI_WARN("Non existing channel: %u", channel);
     }
 }
@@ -473,10 +698,14 @@ MultiplexedSocket::Impl::handleProtocolMsg(const msgpack::object& o)
                 return true;
             } else if (key == "v") {
                 auto msg = o.as<VersionMsg>();
-                onVersion(msg.v);
+                onVersion(msg.v, msg.w);
                 if (onVersionCb_)
                     onVersionCb_(msg.v);
                 return true;
+            } else if (key == "c") {
+                auto msg = o.as<CreditMsg>();
+                handleCredit(msg.c, msg.n);
+                return true;
             } else {
                 JAMI_WARN("Unknown message type");
             }
@@ -487,6 +716,29 @@ MultiplexedSocket::Impl::handleProtocolMsg(const msgpack::object& o)
     return false;
 }
 
+void
+MultiplexedSocket::Impl::sendCredit(uint16_t channel, uint64_t credit)
+{
+    // May be called from the event loop, which must not wait for the endpoint
+    dht::ThreadPool::io().run([w = parent_.weak(), channel, credit]() {
+        if (auto shared = w.lock()) {
+            msgpack::sbuffer buffer(16);
+            msgpack::packer<msgpack::sbuffer> pk(&buffer);
+            pk.pack(CreditMsg {channel, credit});
+            shared->pimpl_->writeProtocolMessage(buffer);
+        }
+    });
+}
+
+void
+MultiplexedSocket::Impl::handleCredit(uint16_t channel, uint64_t credit)
+{
+    std::lock_guard<std::mutex> lkSockets(socketsMutex);
+    auto sockIt = sockets.find(channel);
+    if (sockIt != sockets.end() && sockIt->second)
+        sockIt->second->onCredit(credit);
+}
+
 void
 MultiplexedSocket::Impl::handleProtocolPacket(std::vector<uint8_t>&& pkt)
 {
@@ -511,8 +763,9 @@ MultiplexedSocket::Impl::handleProtocolPacket(std::vector<uint8_t>&& pkt)
 }
 
 MultiplexedSocket::MultiplexedSocket(const DeviceId& deviceId,
-                                     std::unique_ptr<TlsSocketEndpoint> endpoint)
-    : pimpl_(std::make_unique<Impl>(*this, deviceId, std::move(endpoint)))
+                                     std::unique_ptr<TlsSocketEndpoint> endpoint,
+                                     std::size_t channelWindow)
+    : pimpl_(std::make_unique<Impl>(*this, deviceId, std::move(endpoint), channelWindow))
 {}
 
 MultiplexedSocket::~MultiplexedSocket() {}
@@ -585,7 +838,8 @@ std::size_t
 MultiplexedSocket::write(const uint16_t& channel,
                          const uint8_t* buf,
                          std::size_t len,
-                         std::error_code& ec)
+                         std::error_code& ec,
+                         ChannelPriority priority)
 {
     assert(nullptr != buf);
 
@@ -597,25 +851,28 @@ MultiplexedSocket::write(const uint16_t& channel,
         ec = std::make_error_code(std::errc::message_size);
         return -1;
     }
-    bool oneShot = len < 8192;
-    msgpack::sbuffer buffer(oneShot ? 16 + len : 16);
+    // Only the header is packed, the payload is written from the caller's buffer
+    msgpack::sbuffer buffer(16);
     msgpack::packer<msgpack::sbuffer> pk(&buffer);
     pk.pack_array(2);
     pk.pack(channel);
     pk.pack_bin(len);
-    if (oneShot)
-        pk.pack_bin_body((const char*) buf, len);
 
-    std::unique_lock<std::mutex> lk(pimpl_->writeMtx);
-    if (!pimpl_->endpoint) {
-        JAMI_WARN("No endpoint found for socket");
-        ec = std::make_error_code(std::errc::broken_pipe);
-        return -1;
+    int res;
+    {
+        ChannelWriteScheduler::Guard turn(pimpl_->writeScheduler_, priority, len);
+        std::lock_guard<std::mutex> lk(pimpl_->writeMtx);
+        if (!pimpl_->endpoint) {
+            JAMI_WARN("No endpoint found for socket");
+            ec = std::make_error_code(std::errc::broken_pipe);
+            return -1;
+        }
+        res = pimpl_->endpoint->writev({{(const uint8_t*) buffer.data(), buffer.size()},
+                                        {buf, len}},
+                                       ec);
     }
-    int res = pimpl_->endpoint->write((const unsigned char*) buffer.data(), buffer.size(), ec);
-    if (not oneShot and res >= 0)
-        res = pimpl_->endpoint->write(buf, len, ec);
-    lk.unlock();
+    if (res >= 0)
+        pimpl_->lastSent_ = clock::now().time_since_epoch().count();
     if (res < 0) {
         if (ec)
             JAMI_ERR("Error when writing on socket: %s", ec.message().c_str());
@@ -624,6 +881,13 @@ MultiplexedSocket::write(const uint16_t& channel,
     return res;
 }
 
+void
+MultiplexedSocket::sendCredit(uint16_t channel, uint64_t credit)
+{
+    if (!pimpl_->isShutdown_)
+        pimpl_->sendCredit(channel, credit);
+}
+
 void
 MultiplexedSocket::shutdown()
 {
@@ -669,6 +933,30 @@ MultiplexedSocket::sendBeacon(const std::chrono::milliseconds& timeout)
     pimpl_->sendBeacon(timeout);
 }
 
+bool
+MultiplexedSocket::isIdle() const
+{
+    auto last = time_point(
+        clock::duration(std::max(pimpl_->lastReceived_.load(), pimpl_->lastSent_.load())));
+    return pimpl_->beaconCounter_ == 0 and clock::now() - last >= IDLE_DELAY;
+}
+
+std::chrono::milliseconds
+MultiplexedSocket::keepAliveInterval() const
+{
+    if (!pimpl_->canSendBeacon_)
+        return {};
+    std::lock_guard<std::mutex> lk(pimpl_->keepAliveMtx_);
+    return pimpl_->currentKeepAliveInterval();
+}
+
+void
+MultiplexedSocket::resetKeepAlive()
+{
+    natBindingLifetime = std::chrono::duration_cast<std::chrono::milliseconds>(KEEPALIVE_MAX)
+                             .count();
+}
+
 std::shared_ptr<dht::crypto::Certificate>
 MultiplexedSocket::peerCertificate() const
 {
@@ -738,27 +1026,184 @@ public:
          bool isInitiator)
         : name(name)
         , channel(channel)
+        , priority(channelPriority(name))
         , endpoint(std::move(endpoint))
         , isInitiator_(isInitiator)
+        , datagram(priority == ChannelPriority::DATAGRAM)
+        , writable(not isInitiator)
     {}
 
-    ~Impl() {}
+    ~Impl()
+    {
+        bufferedBytes().add(-static_cast<int64_t>(buffered));
+        reservedBytes().add(-static_cast<int64_t>(reserved));
+    }
+
+    static metrics::Gauge& bufferedBytes()
+    {
+        static auto& gauge = metrics::Registry::instance().gauge(
+            "jami_channel_buffered_bytes", "Bytes received by the channels, not read yet");
+        return gauge;
+    }
+    static metrics::Gauge& reservedBytes()
+    {
+        static auto& gauge = metrics::memoryBytes("channel_buffers");
+        return gauge;
+    }
+
+    // Kept by an empty buf, a burst doesn't hold its memory once read
+    static constexpr std::size_t MAX_IDLE_CAPACITY {64 * 1024};
+
+    /**
+     * Report the size and capacity of buf, with mutex locked
+     */
+    void onBufferChanged()
+    {
+        if (buf.empty() and buf.capacity() > MAX_IDLE_CAPACITY)
+            std::vector<uint8_t>().swap(buf);
+        bufferedBytes().add(static_cast<int64_t>(buf.size()) - static_cast<int64_t>(buffered));
+        buffered = buf.size();
+        reservedBytes().add(static_cast<int64_t>(buf.capacity())
+                            - static_cast<int64_t>(reserved));
+        reserved = buf.capacity();
+    }
 
     ChannelReadyCb readyCb_ {};
     OnShutdownCb shutdownCb_ {};
     std::atomic_bool isShutdown_ {false};
     std::string name {};
     uint16_t channel {};
+    ChannelPriority priority {ChannelPriority::SYNC};
     std::weak_ptr<MultiplexedSocket> endpoint {};
     bool isInitiator_ {false};
+    const bool datagram {false};
 
     bool isAnswered_ {false};
     bool isRemovable_ {false};
 
     std::vector<uint8_t> buf {};
+    std::size_t buffered {0}; // size of buf in the metrics
+    std::size_t reserved {0}; // capacity of buf in the metrics
     std::mutex mutex {};
     std::condition_variable cv {};
     GenericSocket<uint8_t>::RecvCb cb {};
+    bool manualCredit {false}; // the consumer credits the bytes given to cb
+
+    // Flow control, counted in bytes since the channel was opened so that
+    // both sides agree even if it is enabled after the first packets
+    std::mutex flowMtx {};
+    std::condition_variable flowCv {};
+    std::size_t sendWindow {0}; // 0 when the writes are not limited
+    uint64_t sent {0};
+    uint64_t granted {0};
+    std::size_t recvWindow {0}; // 0 when the peer doesn't understand credits
+    uint64_t consumed {0};      // Not yet credited to the peer
+    bool writable {true};       // false until the peer accepts a requested channel
+    bool earlyData {false};     // the peer keeps what is sent before it accepts
+
+    // Datagram channels, protected by flowMtx
+    bool sendingDatagram {false};         // a writer is sending, the others leave their message
+    std::vector<uint8_t> nextDatagram {}; // latest message left, sent by that writer
+
+    /**
+     * Bytes that can be sent now, with flowMtx locked
+     */
+    uint64_t allowedLocked() const
+    {
+        auto allowed = std::numeric_limits<uint64_t>::max();
+        if (sendWindow != 0)
+            allowed = sent < sendWindow + granted ? sendWindow + granted - sent : 0;
+        if (not writable)
+            allowed = std::min<uint64_t>(allowed,
+                                         earlyData and sent < EARLY_DATA_SIZE
+                                             ? EARLY_DATA_SIZE - sent
+                                             : 0);
+        return allowed;
+    }
+
+    /**
+     * Wait until some of len bytes can be sent, and return how many
+     * Return 0 if the channel is shut down
+     */
+    std::size_t waitForCredit(std::size_t len)
+    {
+        std::unique_lock<std::mutex> lk(flowMtx);
+        if (isEventLoopThread) {
+            sent += len;
+            return len;
+        }
+        flowCv.wait(lk, [&] { return isShutdown_ or allowedLocked() > 0; });
+        if (isShutdown_)
+            return 0;
+        len = std::min<uint64_t>(len, allowedLocked());
+        sent += len;
+        return len;
+    }
+
+    /**
+     * Send a message, or leave it to the writer already sending on the channel
+     */
+    std::size_t writeDatagram(MultiplexedSocket& ep,
+                              const uint8_t* buf,
+                              std::size_t len,
+                              std::error_code& ec)
+    {
+        if (len > UINT16_MAX) {
+            ec = std::make_error_code(std::errc::message_size);
+            return -1;
+        }
+        // An empty packet would close the channel
+        if (len == 0)
+            return 0;
+        {
+            std::lock_guard<std::mutex> lk(flowMtx);
+            if (not writable) {
+                // The peer drops what it can't keep until it accepts
+                if (not earlyData or sent + len > EARLY_DATA_SIZE)
+                    return len;
+                sent += len;
+            }
+            if (sendingDatagram) {
+                nextDatagram.assign(buf, buf + len);
+                return len;
+            }
+            sendingDatagram = true;
+        }
+        // Not counted by the flow control: the datagrams are never waited for.
+        // The peer still credits them, as older versions do for any channel.
+        std::vector<uint8_t> message;
+        while (true) {
+            ep.write(channel, buf, len, ec, priority);
+            std::lock_guard<std::mutex> lk(flowMtx);
+            if (ec or nextDatagram.empty()) {
+                sendingDatagram = false;
+                nextDatagram.clear();
+                return ec ? -1 : len;
+            }
+            message.swap(nextDatagram);
+            nextDatagram.clear();
+            buf = message.data();
+            len = message.size();
+        }
+    }
+
+    /**
+     * Credit consumed bytes to the peer by batches of half a window
+     */
+    void onConsumed(std::size_t len)
+    {
+        uint64_t credit = 0;
+        {
+            std::lock_guard<std::mutex> lk(flowMtx);
+            consumed += len;
+            if (recvWindow == 0 or consumed == 0 or consumed < recvWindow / 2)
+                return;
+            credit = consumed;
+            consumed = 0;
+        }
+        if (auto ep = endpoint.lock())
+            ep->sendCredit(channel, credit);
+    }
 };
 
 ChannelSocket::ChannelSocket(std::weak_ptr<MultiplexedSocket> endpoint,
@@ -791,9 +1236,17 @@ ChannelSocket::channel() const
     return pimpl_->channel;
 }
 
+ChannelPriority
+ChannelSocket::priority() const
+{
+    return pimpl_->priority;
+}
+
 bool
 ChannelSocket::isReliable() const
 {
+    if (pimpl_->datagram)
+        return false;
     if (auto ep = pimpl_->endpoint.lock()) {
         return ep->isReliable();
     }
@@ -826,24 +1279,91 @@ ChannelSocket::setOnRecv(RecvCb&& cb)
     pimpl_->cb = std::move(cb);
     if (!pimpl_->buf.empty() && pimpl_->cb) {
         pimpl_->cb(pimpl_->buf.data(), pimpl_->buf.size());
+        if (not pimpl_->manualCredit)
+            pimpl_->onConsumed(pimpl_->buf.size());
         pimpl_->buf.clear();
+        pimpl_->onBufferChanged();
     }
 }
 
 void
-ChannelSocket::onRecv(std::vector<uint8_t>&& pkt)
+ChannelSocket::onRecv(const uint8_t* data, std::size_t len)
 {
     std::lock_guard<std::mutex> lkSockets(pimpl_->mutex);
     if (pimpl_->cb) {
-        pimpl_->cb(&pkt[0], pkt.size());
+        pimpl_->cb(data, len);
+        if (not pimpl_->manualCredit)
+            pimpl_->onConsumed(len);
         return;
     }
-    pimpl_->buf.insert(pimpl_->buf.end(),
-                       std::make_move_iterator(pkt.begin()),
-                       std::make_move_iterator(pkt.end()));
+    if (pimpl_->datagram) {
+        // Only the latest message is worth reading
+        if (not pimpl_->buf.empty())
+            pimpl_->onConsumed(pimpl_->buf.size());
+        pimpl_->buf.assign(data, data + len);
+    } else {
+        pimpl_->buf.insert(pimpl_->buf.end(), data, data + len);
+    }
+    pimpl_->onBufferChanged();
     pimpl_->cv.notify_all();
 }
 
+void
+ChannelSocket::setManualCredit()
+{
+    std::lock_guard<std::mutex> lkSockets(pimpl_->mutex);
+    pimpl_->manualCredit = true;
+}
+
+void
+ChannelSocket::consumed(std::size_t len)
+{
+    pimpl_->onConsumed(len);
+}
+
+void
+ChannelSocket::setFlowControl(std::size_t sendWindow, std::size_t recvWindow)
+{
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->flowMtx);
+        pimpl_->sendWindow = sendWindow;
+        pimpl_->recvWindow = recvWindow;
+    }
+    pimpl_->flowCv.notify_all();
+    // Credit what was consumed before the negotiation, the peer may wait for it
+    pimpl_->onConsumed(0);
+}
+
+void
+ChannelSocket::onCredit(uint64_t credit)
+{
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->flowMtx);
+        pimpl_->granted += credit;
+    }
+    pimpl_->flowCv.notify_all();
+}
+
+void
+ChannelSocket::enableEarlyData()
+{
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->flowMtx);
+        pimpl_->earlyData = true;
+    }
+    pimpl_->flowCv.notify_all();
+}
+
+void
+ChannelSocket::enableWrites()
+{
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->flowMtx);
+        pimpl_->writable = true;
+    }
+    pimpl_->flowCv.notify_all();
+}
+
 #ifdef DRING_TESTABLE
 std::shared_ptr<MultiplexedSocket>
 ChannelSocket::underlyingSocket() const
@@ -894,6 +1414,11 @@ ChannelSocket::stop()
     if (pimpl_->shutdownCb_)
         pimpl_->shutdownCb_();
     pimpl_->cv.notify_all();
+    {
+        // Lock so that a writer can't miss the notification
+        std::lock_guard<std::mutex> lk(pimpl_->flowMtx);
+    }
+    pimpl_->flowCv.notify_all();
 }
 
 void
@@ -905,20 +1430,26 @@ ChannelSocket::shutdown()
     if (auto ep = pimpl_->endpoint.lock()) {
         std::error_code ec;
         const uint8_t dummy = '\0';
-        ep->write(pimpl_->channel, &dummy, 0, ec);
+        ep->write(pimpl_->channel, &dummy, 0, ec, pimpl_->priority);
     }
 }
 
 std::size_t
 ChannelSocket::read(ValueType* outBuf, std::size_t len, std::error_code& ec)
 {
-    std::lock_guard<std::mutex> lkSockets(pimpl_->mutex);
-    std::size_t size = std::min(len, pimpl_->buf.size());
+    std::size_t size;
+    {
+        std::lock_guard<std::mutex> lkSockets(pimpl_->mutex);
+        size = std::min(len, pimpl_->buf.size());
 
-    for (std::size_t i = 0; i < size; ++i)
-        outBuf[i] = pimpl_->buf[i];
+        for (std::size_t i = 0; i < size; ++i)
+            outBuf[i] = pimpl_->buf[i];
 
-    pimpl_->buf.erase(pimpl_->buf.begin(), pimpl_->buf.begin() + size);
+        pimpl_->buf.erase(pimpl_->buf.begin(), pimpl_->buf.begin() + size);
+        pimpl_->onBufferChanged();
+    }
+    if (size)
+        pimpl_->onConsumed(size);
     return size;
 }
 
@@ -930,10 +1461,21 @@ ChannelSocket::write(const ValueType* buf, std::size_t len, std::error_code& ec)
         return -1;
     }
     if (auto ep = pimpl_->endpoint.lock()) {
+        if (pimpl_->datagram)
+            return pimpl_->writeDatagram(*ep, buf, len, ec);
         std::size_t sent = 0;
         do {
-            std::size_t toSend = std::min(static_cast<std::size_t>(UINT16_MAX), len - sent);
-            auto res = ep->write(pimpl_->channel, buf + sent, toSend, ec);
+            std::size_t toSend = std::min(ChannelWriteScheduler::maxChunkSize(pimpl_->priority),
+                                          len - sent);
+            // Blocks while the peer's window for the channel is full
+            if (toSend > 0) {
+                toSend = pimpl_->waitForCredit(toSend);
+                if (toSend == 0) {
+                    ec = std::make_error_code(std::errc::broken_pipe);
+                    return -1;
+                }
+            }
+            auto res = ep->write(pimpl_->channel, buf + sent, toSend, ec, pimpl_->priority);
             if (ec) {
                 JAMI_ERR("Error when writing on channel: %s", ec.message().c_str());
                 return res;
@@ -951,6 +1493,8 @@ ChannelSocket::waitForData(std::chrono::milliseconds timeout, std::error_code& e
 {
     std::unique_lock<std::mutex> lk {pimpl_->mutex};
     pimpl_->cv.wait_for(lk, timeout, [&] { return !pimpl_->buf.empty() or pimpl_->isShutdown_; });
+    if (pimpl_->buf.empty() and pimpl_->isShutdown_)
+        ec = std::make_error_code(std::errc::broken_pipe);
     return pimpl_->buf.size();
 }
 
@@ -20,6 +20,7 @@
 #include <opendht/default_types.h>
 
 #include "generic_io.h"
+#include "channel_write_scheduler.h"
 
 namespace jami {
 
@@ -38,8 +39,19 @@ using ChannelReadyCb = std::function<void(void)>;
 using OnShutdownCb = std::function<void(void)>;
 
 static constexpr auto SEND_BEACON_TIMEOUT = std::chrono::milliseconds(3000);
+// Keepalive: a beacon is sent once nothing was received for an interval, starting at
+// KEEPALIVE_MIN and doubled each time the beacon is answered, up to KEEPALIVE_MAX or to the
+// lifetime of the NAT bindings learned from the lost beacons
+static constexpr auto KEEPALIVE_MIN = std::chrono::seconds(25);
+static constexpr auto KEEPALIVE_MAX = std::chrono::minutes(5);
+// Without traffic for this delay and no beacon pending, a socket is idle
+static constexpr auto IDLE_DELAY = std::chrono::seconds(10);
 static constexpr uint16_t CONTROL_CHANNEL {0};
 static constexpr uint16_t PROTOCOL_CHANNEL {0xffff};
+// Bytes buffered for a channel before its writer has to wait for the consumer
+static constexpr std::size_t DEFAULT_CHANNEL_WINDOW {512 * 1024};
+// Bytes a channel may send before its request is accepted, kept by the peer until then
+static constexpr std::size_t EARLY_DATA_SIZE {64 * 1024};
 
 enum class ChannelRequestState {
     REQUEST,
@@ -65,7 +77,12 @@ struct ChannelRequest
 class MultiplexedSocket : public std::enable_shared_from_this<MultiplexedSocket>
 {
 public:
-    MultiplexedSocket(const DeviceId& deviceId, std::unique_ptr<TlsSocketEndpoint> endpoint);
+    /**
+     * @param channelWindow     Receive window of each channel, advertised to the peer
+     */
+    MultiplexedSocket(const DeviceId& deviceId,
+                      std::unique_ptr<TlsSocketEndpoint> endpoint,
+                      std::size_t channelWindow = DEFAULT_CHANNEL_WINDOW);
     ~MultiplexedSocket();
     std::shared_ptr<ChannelSocket> addChannel(const std::string& name);
 
@@ -100,10 +117,20 @@ public:
      */
     void setOnRequest(OnConnectionRequestCb&& cb);
 
+    /**
+     * @param priority  Of the channel, cached by its ChannelSocket: the writers may be
+     *                  receive callbacks, the sockets' map can't be locked here
+     */
     std::size_t write(const uint16_t& channel,
                       const uint8_t* buf,
                       std::size_t len,
-                      std::error_code& ec);
+                      std::error_code& ec,
+                      ChannelPriority priority = ChannelPriority::CONTROL);
+
+    /**
+     * Allow the peer to send credit more bytes on a channel
+     */
+    void sendCredit(uint16_t channel, uint64_t credit);
 
     /**
      * This will close all channels and send a TLS EOF on the main socket.
@@ -129,6 +156,20 @@ public:
      */
     void sendBeacon(const std::chrono::milliseconds& timeout = SEND_BEACON_TIMEOUT);
 
+    /**
+     * @return if nothing was sent nor received for IDLE_DELAY and no beacon is pending:
+     * the socket has nothing to send before its next keepalive, the radio can be suspended
+     */
+    bool isIdle() const;
+    /**
+     * @return the current interval of the keepalive beacons (0 if the peer doesn't support them)
+     */
+    std::chrono::milliseconds keepAliveInterval() const;
+    /**
+     * Forget the lifetime of the NAT bindings learned, on a new network
+     */
+    static void resetKeepAlive();
+
     /**
      * Get peer's certificate
      */
@@ -191,6 +232,10 @@ public:
     DeviceId deviceId() const;
     std::string name() const;
     uint16_t channel() const;
+    ChannelPriority priority() const;
+    /**
+     * @return false for the datagram channels
+     */
     bool isReliable() const override;
     bool isInitiator() const override;
     int maxPayload() const override;
@@ -220,6 +265,11 @@ public:
     std::size_t read(ValueType* buf, std::size_t len, std::error_code& ec) override;
     /**
      * @note len should be < UINT8_MAX, else you will get ec = EMSGSIZE
+     * @note blocks while the peer's receive window for the channel is full
+     * @note on a datagram channel (named DATAGRAM_CHANNEL_PREFIX...), each write is one
+     * message, delivered whole or not at all, and never blocks for long: the message is
+     * dropped if a newer one is written before it could be sent, or if the channel is not
+     * accepted yet. Only the last message received is kept for read().
      */
     std::size_t write(const ValueType* buf, std::size_t len, std::error_code& ec) override;
     int waitForData(std::chrono::milliseconds timeout, std::error_code&) const override;
@@ -230,8 +280,41 @@ public:
      * but you can move it in a thread
      */
     void setOnRecv(RecvCb&&) override;
+    /**
+     * Credit the peer only for the bytes given to consumed(), instead of once
+     * the receive callback returns. Lets a consumer that can't keep up, e.g.
+     * a file written to a slow disk, slow down the peer without blocking the callback.
+     * @note To call before setOnRecv()
+     */
+    void setManualCredit();
+    /**
+     * With setManualCredit(), len bytes given to the receive callback are processed
+     */
+    void consumed(std::size_t len);
+
+    /**
+     * Deliver received data. data is only valid during the call:
+     * it points into the MultiplexedSocket's receive buffer
+     */
+    void onRecv(const uint8_t* data, std::size_t len);
 
-    void onRecv(std::vector<uint8_t>&& pkt);
+    /**
+     * Used by MultiplexedSocket once the peer's version is known
+     * @param sendWindow    Peer's window, 0 to not limit the writes
+     * @param recvWindow    Our window, 0 if the peer doesn't understand credits
+     */
+    void setFlowControl(std::size_t sendWindow, std::size_t recvWindow);
+    /**
+     * Triggered when the peer consumed credit bytes, unblocks the writers
+     */
+    void onCredit(uint64_t credit);
+    /**
+     * Used by MultiplexedSocket for the channels it requested. Until the
+     * peer accepts them, the writers wait, or send up to EARLY_DATA_SIZE bytes
+     * once early data is enabled.
+     */
+    void enableEarlyData();
+    void enableWrites();
 
     /**
      * Send a beacon on the socket and close if no response come
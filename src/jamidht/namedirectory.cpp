@@ -27,6 +27,7 @@
 #include "fileutils.h"
 #include "base64.h"
 #include "scheduled_executor.h"
+#include "map_journal.h"
 
 #include <asio.hpp>
 
@@ -42,6 +43,7 @@
 
 /* for visual studio */
 #include <ciso646>
+#include <algorithm>
 #include <sstream>
 #include <regex>
 #include <fstream>
@@ -50,11 +52,19 @@ namespace jami {
 
 constexpr const char* const QUERY_NAME {"/name/"};
 constexpr const char* const QUERY_ADDR {"/addr/"};
-constexpr const char* const CACHE_DIRECTORY {"namecache"};
+constexpr const char* const CACHE_DIRECTORY {"names"};
+// Before the entries expired, replaced by CACHE_DIRECTORY
+constexpr const char* const OLD_CACHE_DIRECTORY {"namecache"};
 constexpr const char DEFAULT_SERVER_HOST[] = "https://ns.jami.net";
 
 const std::string HEX_PREFIX = "0x";
 constexpr std::chrono::seconds SAVE_INTERVAL {5};
+// Registered names don't change, an unknown one may be registered soon
+constexpr std::chrono::hours FOUND_TTL {24 * 30};
+constexpr std::chrono::hours NOT_FOUND_TTL {6};
+constexpr size_t MAX_CACHED_NAMES {4096};
+// Connections to the server kept open between the requests
+constexpr size_t MAX_IDLE_CONNECTIONS {4};
 
 /** Parser for URIs.         ( protocol        )    ( username         ) ( hostname ) */
 const std::regex URI_VALIDATOR {
@@ -105,6 +115,9 @@ NameDirectory::NameDirectory(const std::string& serverUrl, std::shared_ptr<dht::
     resolver_ = std::make_shared<dht::http::Resolver>(*httpContext_, serverUrl, logger_);
     cachePath_ = fileutils::get_cache_dir() + DIR_SEPARATOR_STR + CACHE_DIRECTORY
                  + DIR_SEPARATOR_STR + resolver_->get_url().host;
+    cacheJournal_ = std::make_unique<MapJournal<CacheEntry>>(cachePath_);
+    fileutils::remove(fileutils::get_cache_dir() + DIR_SEPARATOR_STR + OLD_CACHE_DIRECTORY
+                      + DIR_SEPARATOR_STR + resolver_->get_url().host);
 }
 
 NameDirectory::~NameDirectory()
@@ -151,23 +164,173 @@ NameDirectory::setHeaderFields(Request& request)
     request.set_header_field(restinio::http_field_t::content_type, "application/json");
 }
 
+std::shared_ptr<Request>
+NameDirectory::makeRequest(const std::string& target)
+{
+    auto request = std::make_shared<Request>(*httpContext_, resolver_, serverUrl_ + target);
+    request->set_connection_type(restinio::http_connection_header_t::keep_alive);
+    std::lock_guard<std::mutex> lk(requestsMtx_);
+    while (not idleConnections_.empty()) {
+        auto connection = std::move(idleConnections_.back());
+        idleConnections_.pop_back();
+        if (connection and connection->is_open()) {
+            request->set_connection(std::move(connection));
+            break;
+        }
+    }
+    return request;
+}
+
+void
+NameDirectory::requestDone(const dht::http::Response& response)
+{
+    std::lock_guard<std::mutex> lk(requestsMtx_);
+    auto req = response.request.lock();
+    if (not req)
+        return;
+    requests_.erase(req);
+    // A complete response leaves the connection ready for the next request
+    if (response.status_code != 0 and idleConnections_.size() < MAX_IDLE_CONNECTIONS) {
+        auto connection = req->get_connection();
+        if (connection and connection->is_open())
+            idleConnections_.emplace_back(std::move(connection));
+    }
+}
+
+bool
+NameDirectory::addPendingLookup(PendingLookups& pending, const std::string& key, LookupCallback&& cb)
+{
+    std::lock_guard<std::mutex> lk(requestsMtx_);
+    auto& cbs = pending[key];
+    cbs.emplace_back(std::move(cb));
+    return cbs.size() == 1;
+}
+
+void
+NameDirectory::pendingLookupDone(PendingLookups& pending,
+                                 const std::string& key,
+                                 const std::string& result,
+                                 Response response)
+{
+    std::vector<LookupCallback> cbs;
+    {
+        std::lock_guard<std::mutex> lk(requestsMtx_);
+        auto it = pending.find(key);
+        if (it == pending.end())
+            return;
+        cbs = std::move(it->second);
+        pending.erase(it);
+    }
+    for (const auto& cb : cbs)
+        cb(result, response);
+}
+
+std::optional<std::string>
+NameDirectory::nameCache(const std::string& addr)
+{
+    std::lock_guard<std::mutex> l(cacheLock_);
+    auto cacheRes = nameCache_.find(addr);
+    if (cacheRes == nameCache_.end()
+        or clock::from_time_t(cacheRes->second.expiration) < clock::now())
+        return std::nullopt;
+    lastUse_[addr] = ++useCount_;
+    return cacheRes->second.name;
+}
+
+std::optional<std::string>
+NameDirectory::addrCache(const std::string& name)
+{
+    std::lock_guard<std::mutex> l(cacheLock_);
+    auto cacheRes = addrCache_.find(name);
+    if (cacheRes != addrCache_.end()) {
+        auto entry = nameCache_.find(cacheRes->second);
+        if (entry != nameCache_.end()
+            and clock::from_time_t(entry->second.expiration) >= clock::now()) {
+            lastUse_[cacheRes->second] = ++useCount_;
+            return cacheRes->second;
+        }
+        return std::nullopt;
+    }
+    auto unknown = unknownNames_.find(name);
+    if (unknown == unknownNames_.end())
+        return std::nullopt;
+    if (unknown->second < clock::now()) {
+        unknownNames_.erase(unknown);
+        return std::nullopt;
+    }
+    return std::string {};
+}
+
+void
+NameDirectory::cacheName(const std::string& addr, const std::string& name)
+{
+    {
+        std::lock_guard<std::mutex> l(cacheLock_);
+        auto& entry = nameCache_[addr];
+        if (not entry.name.empty() and entry.name != name)
+            addrCache_.erase(entry.name);
+        entry.name = name;
+        entry.expiration = clock::to_time_t(clock::now()
+                                            + (name.empty() ? NOT_FOUND_TTL : FOUND_TTL));
+        if (not name.empty()) {
+            addrCache_[name] = addr;
+            unknownNames_.erase(name);
+        }
+        lastUse_[addr] = ++useCount_;
+
+        // Forget the least recently used
+        while (nameCache_.size() > MAX_CACHED_NAMES) {
+            auto oldest = std::min_element(lastUse_.begin(),
+                                           lastUse_.end(),
+                                           [](const auto& a, const auto& b) {
+                                               return a.second < b.second;
+                                           });
+            auto it = nameCache_.find(oldest->first);
+            if (it != nameCache_.end()) {
+                if (not it->second.name.empty())
+                    addrCache_.erase(it->second.name);
+                nameCache_.erase(it);
+            }
+            lastUse_.erase(oldest);
+        }
+    }
+    scheduleCacheSave();
+}
+
+void
+NameDirectory::cacheUnknownName(const std::string& name)
+{
+    std::lock_guard<std::mutex> l(cacheLock_);
+    if (unknownNames_.size() >= MAX_CACHED_NAMES)
+        unknownNames_.clear();
+    unknownNames_[name] = clock::now() + NOT_FOUND_TTL;
+}
+
 void
 NameDirectory::lookupAddress(const std::string& addr, LookupCallback cb)
 {
-    std::string cacheResult = nameCache(addr);
-    if (not cacheResult.empty()) {
-        cb(cacheResult, Response::found);
+    if (auto cacheResult = nameCache(addr)) {
+        if (cacheResult->empty())
+            cb({}, Response::notFound);
+        else
+            cb(*cacheResult, Response::found);
         return;
     }
-    auto request = std::make_shared<Request>(*httpContext_,
-                                             resolver_,
-                                             serverUrl_ + QUERY_ADDR + addr);
+    // A contact list asks for the same addresses from several places
+    if (not addPendingLookup(pendingAddrLookups_, addr, std::move(cb)))
+        return;
+    auto done = [this, addr](const std::string& name, Response response) {
+        pendingLookupDone(pendingAddrLookups_, addr, name, response);
+    };
+    auto request = makeRequest(QUERY_ADDR + addr);
     try {
         request->set_method(restinio::http_method_get());
         setHeaderFields(*request);
         request->add_on_done_callback(
-            [this, cb = std::move(cb), addr](const dht::http::Response& response) {
+            [this, cb = done, addr](const dht::http::Response& response) {
+                requestDone(response);
                 if (response.status_code >= 400 && response.status_code < 500) {
+                    cacheName(addr, {});
                     cb("", Response::notFound);
                 } else if (response.status_code != 200) {
                     JAMI_ERR("Address lookup for %s failed with code=%i",
@@ -191,26 +354,18 @@ NameDirectory::lookupAddress(const std::string& addr, LookupCallback cb)
                             return;
                         }
                         auto name = json["name"].asString();
+                        cacheName(addr, name);
                         if (name.empty()) {
                             cb(name, Response::notFound);
                             return;
                         }
                         JAMI_DBG("Found name for %s: %s", addr.c_str(), name.c_str());
-                        {
-                            std::lock_guard<std::mutex> l(cacheLock_);
-                            addrCache_.emplace(name, addr);
-                            nameCache_.emplace(addr, name);
-                        }
                         cb(name, Response::found);
-                        scheduleCacheSave();
                     } catch (const std::exception& e) {
                         JAMI_ERR("Error when performing address lookup: %s", e.what());
                         cb("", Response::error);
                     }
                 }
-                std::lock_guard<std::mutex> lk(requestsMtx_);
-                if (auto req = response.request.lock())
-                    requests_.erase(req);
             });
         {
             std::lock_guard<std::mutex> lk(requestsMtx_);
@@ -219,6 +374,7 @@ NameDirectory::lookupAddress(const std::string& addr, LookupCallback cb)
         request->send();
     } catch (const std::exception& e) {
         JAMI_ERR("Error when performing address lookup: %s", e.what());
+        done({}, Response::error);
         std::lock_guard<std::mutex> lk(requestsMtx_);
         if (request)
             requests_.erase(request);
@@ -243,22 +399,29 @@ NameDirectory::lookupName(const std::string& n, LookupCallback cb)
         return;
     }
     toLower(name);
-    std::string cacheResult = addrCache(name);
-    if (not cacheResult.empty()) {
-        cb(cacheResult, Response::found);
+    if (auto cacheResult = addrCache(name)) {
+        if (cacheResult->empty())
+            cb({}, Response::notFound);
+        else
+            cb(*cacheResult, Response::found);
         return;
     }
-    auto request = std::make_shared<Request>(*httpContext_,
-                                             resolver_,
-                                             serverUrl_ + QUERY_NAME + name);
+    if (not addPendingLookup(pendingNameLookups_, name, std::move(cb)))
+        return;
+    auto done = [this, name](const std::string& addr, Response response) {
+        pendingLookupDone(pendingNameLookups_, name, addr, response);
+    };
+    auto request = makeRequest(QUERY_NAME + name);
     try {
         request->set_method(restinio::http_method_get());
         setHeaderFields(*request);
-        request->add_on_done_callback([this, name, cb = std::move(cb)](
+        request->add_on_done_callback([this, name, cb = done](
                                           const dht::http::Response& response) {
-            if (response.status_code >= 400 && response.status_code < 500)
+            requestDone(response);
+            if (response.status_code >= 400 && response.status_code < 500) {
+                cacheUnknownName(name);
                 cb("", Response::notFound);
-            else if (response.status_code < 200 || response.status_code > 299)
+            } else if (response.status_code < 200 || response.status_code > 299)
                 cb("", Response::error);
             else {
                 try {
@@ -283,6 +446,7 @@ NameDirectory::lookupName(const std::string& n, LookupCallback cb)
                     if (!addr.compare(0, HEX_PREFIX.size(), HEX_PREFIX))
                         addr = addr.substr(HEX_PREFIX.size());
                     if (addr.empty()) {
+                        cacheUnknownName(name);
                         cb("", Response::notFound);
                         return;
                     }
@@ -299,20 +463,13 @@ NameDirectory::lookupName(const std::string& n, LookupCallback cb)
                         }
                     }
                     JAMI_DBG("Found address for %s: %s", name.c_str(), addr.c_str());
-                    {
-                        std::lock_guard<std::mutex> l(cacheLock_);
-                        addrCache_.emplace(name, addr);
-                        nameCache_.emplace(addr, name);
-                    }
+                    cacheName(addr, name);
                     cb(addr, Response::found);
-                    scheduleCacheSave();
                 } catch (const std::exception& e) {
                     JAMI_ERR("Error when performing name lookup: %s", e.what());
                     cb("", Response::error);
                 }
             }
-            if (auto req = response.request.lock())
-                requests_.erase(req);
         });
         {
             std::lock_guard<std::mutex> lk(requestsMtx_);
@@ -321,6 +478,7 @@ NameDirectory::lookupName(const std::string& n, LookupCallback cb)
         request->send();
     } catch (const std::exception& e) {
         JAMI_ERR("Name lookup for %s failed: %s", name.c_str(), e.what());
+        done({}, Response::error);
         std::lock_guard<std::mutex> lk(requestsMtx_);
         if (request)
             requests_.erase(request);
@@ -349,8 +507,8 @@ NameDirectory::registerName(const std::string& addr,
     }
     toLower(name);
     auto cacheResult = addrCache(name);
-    if (not cacheResult.empty()) {
-        if (cacheResult == addr)
+    if (cacheResult and not cacheResult->empty()) {
+        if (*cacheResult == addr)
             cb(RegistrationResponse::success);
         else
             cb(RegistrationResponse::alreadyTaken);
@@ -363,9 +521,7 @@ NameDirectory::registerName(const std::string& addr,
            << signedname << "\",\"publickey\":\"" << base64::encode(publickey) << "\"}";
         body = ss.str();
     }
-    auto request = std::make_shared<Request>(*httpContext_,
-                                             resolver_,
-                                             serverUrl_ + QUERY_NAME + name);
+    auto request = makeRequest(QUERY_NAME + name);
     try {
         request->set_method(restinio::http_method_post());
         setHeaderFields(*request);
@@ -375,6 +531,7 @@ NameDirectory::registerName(const std::string& addr,
 
         request->add_on_done_callback(
             [this, name, addr, cb = std::move(cb)](const dht::http::Response& response) {
+                requestDone(response);
                 if (response.status_code == 400) {
                     cb(RegistrationResponse::incompleteRequest);
                     JAMI_ERR("RegistrationResponse::incompleteRequest");
@@ -411,16 +568,10 @@ NameDirectory::registerName(const std::string& addr,
                              name.c_str(),
                              addr.c_str(),
                              success ? "success" : "failure");
-                    if (success) {
-                        std::lock_guard<std::mutex> l(cacheLock_);
-                        addrCache_.emplace(name, addr);
-                        nameCache_.emplace(addr, name);
-                    }
+                    if (success)
+                        cacheName(addr, name);
                     cb(success ? RegistrationResponse::success : RegistrationResponse::error);
                 }
-                std::lock_guard<std::mutex> lk(requestsMtx_);
-                if (auto req = response.request.lock())
-                    requests_.erase(req);
             });
         {
             std::lock_guard<std::mutex> lk(requestsMtx_);
@@ -451,46 +602,31 @@ void
 NameDirectory::saveCache()
 {
     fileutils::recursive_mkdir(fileutils::get_cache_dir() + DIR_SEPARATOR_STR + CACHE_DIRECTORY);
-    std::lock_guard<std::mutex> lock(fileutils::getFileLock(cachePath_));
-    std::ofstream file = fileutils::ofstream(cachePath_, std::ios::trunc | std::ios::binary);
+    decltype(nameCache_) cache;
     {
         std::lock_guard<std::mutex> l(cacheLock_);
-        msgpack::pack(file, nameCache_);
+        cache = nameCache_;
     }
-    JAMI_DBG("Saved %lu name-address mappings to %s",
-             (long unsigned) nameCache_.size(),
-             cachePath_.c_str());
+    // Only the entries changed since the last save are written
+    cacheJournal_->save(cache);
+    JAMI_DBG("Saved %zu name-address mappings to %s", cache.size(), cachePath_.c_str());
 }
 
 void
 NameDirectory::loadCache()
 {
-    msgpack::unpacker pac;
-
-    // read file
-    {
-        std::lock_guard<std::mutex> lock(fileutils::getFileLock(cachePath_));
-        std::ifstream file = fileutils::ifstream(cachePath_);
-        if (!file.is_open()) {
-            JAMI_DBG("Could not load %s", cachePath_.c_str());
-            return;
-        }
-        std::string line;
-        while (std::getline(file, line)) {
-            pac.reserve_buffer(line.size());
-            memcpy(pac.buffer(), line.data(), line.size());
-            pac.buffer_consumed(line.size());
-        }
-    }
-
-    // load values
+    auto cache = MapJournal<CacheEntry>::read(cachePath_);
+    auto now = clock::now();
     std::lock_guard<std::mutex> l(cacheLock_);
-    msgpack::object_handle oh;
-    if (pac.next(oh))
-        oh.get().convert(nameCache_);
-    for (const auto& m : nameCache_)
-        addrCache_.emplace(m.second, m.first);
-    JAMI_DBG("Loaded %lu name-address mappings", (long unsigned) nameCache_.size());
+    for (auto& [addr, entry] : cache) {
+        if (clock::from_time_t(entry.expiration) < now)
+            continue;
+        if (not entry.name.empty())
+            addrCache_.emplace(entry.name, addr);
+        lastUse_.emplace(addr, 0);
+        nameCache_.emplace(addr, std::move(entry));
+    }
+    JAMI_DBG("Loaded %zu name-address mappings", nameCache_.size());
 }
 
 } // namespace jami
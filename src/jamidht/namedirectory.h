@@ -21,14 +21,18 @@
 #include "noncopyable.h"
 
 #include <asio/io_context.hpp>
+#include <msgpack.hpp>
 
+#include <chrono>
 #include <functional>
 #include <map>
+#include <optional>
 #include <set>
 #include <string>
 #include <mutex>
 #include <memory>
 #include <thread>
+#include <vector>
 
 namespace dht {
 class Executor;
@@ -36,6 +40,7 @@ namespace crypto {
 struct PublicKey;
 }
 namespace http {
+class Connection;
 class Request;
 struct Response;
 class Resolver;
@@ -47,6 +52,9 @@ namespace jami {
 
 class Task;
 
+template<typename Value, typename Key>
+class MapJournal;
+
 class NameDirectory
 {
 public:
@@ -97,11 +105,24 @@ private:
     NameDirectory(NameDirectory&&) = delete;
     NameDirectory& operator=(NameDirectory&&) = delete;
 
+    using clock = std::chrono::system_clock;
+
+    /**
+     * Name of an address, or its absence, as cached on the disk
+     */
+    struct CacheEntry
+    {
+        std::string name;       // Empty if the address has no name
+        int64_t expiration {0}; // Seconds since epoch
+        MSGPACK_DEFINE_MAP(name, expiration)
+    };
+
     std::string serverUrl_;
     std::string serverToken_;
     std::string cachePath_;
 
     std::mutex cacheLock_ {};
+    std::unique_ptr<MapJournal<CacheEntry, std::string>> cacheJournal_;
     std::shared_ptr<dht::Logger> logger_;
 
     /*
@@ -112,26 +133,56 @@ private:
     std::shared_ptr<dht::http::Resolver> resolver_;
     std::mutex requestsMtx_ {};
     std::set<std::shared_ptr<dht::http::Request>> requests_;
-
-    std::map<std::string, std::string> nameCache_ {};
+    std::vector<std::shared_ptr<dht::http::Connection>> idleConnections_;
+    // Callbacks of the lookups waiting for the same request, by address or name
+    using PendingLookups = std::map<std::string, std::vector<LookupCallback>>;
+    PendingLookups pendingAddrLookups_;
+    PendingLookups pendingNameLookups_;
+
+    // By address
+    std::map<std::string, CacheEntry> nameCache_ {};
+    std::map<std::string, uint64_t> lastUse_ {};
+    uint64_t useCount_ {0};
+    // Addresses of the names of nameCache_
     std::map<std::string, std::string> addrCache_ {};
+    // Names not registered, until when
+    std::map<std::string, clock::time_point> unknownNames_ {};
 
     std::weak_ptr<Task> saveTask_;
 
     void setHeaderFields(dht::http::Request& request);
+    /**
+     * @param target    Path on the server
+     * @return request keeping its connection alive, over an idle one if any
+     */
+    std::shared_ptr<dht::http::Request> makeRequest(const std::string& target);
+    /**
+     * Forget the request of response, and keep its connection for the next ones
+     */
+    void requestDone(const dht::http::Response& response);
 
-    std::string nameCache(const std::string& addr)
-    {
-        std::lock_guard<std::mutex> l(cacheLock_);
-        auto cacheRes = nameCache_.find(addr);
-        return cacheRes != nameCache_.end() ? cacheRes->second : std::string {};
-    }
-    std::string addrCache(const std::string& name)
-    {
-        std::lock_guard<std::mutex> l(cacheLock_);
-        auto cacheRes = addrCache_.find(name);
-        return cacheRes != addrCache_.end() ? cacheRes->second : std::string {};
-    }
+    /**
+     * @return true if cb is the first callback waiting for key, then the request is sent
+     */
+    bool addPendingLookup(PendingLookups& pending, const std::string& key, LookupCallback&& cb);
+    void pendingLookupDone(PendingLookups& pending,
+                           const std::string& key,
+                           const std::string& result,
+                           Response response);
+
+    /**
+     * @return name of addr, empty if it has none, or nullopt if unknown
+     */
+    std::optional<std::string> nameCache(const std::string& addr);
+    /**
+     * @return address of name, empty if it is not registered, or nullopt if unknown
+     */
+    std::optional<std::string> addrCache(const std::string& name);
+    /**
+     * @param name  Empty if addr has no name
+     */
+    void cacheName(const std::string& addr, const std::string& name);
+    void cacheUnknownName(const std::string& name);
 
     bool validateName(const std::string& name) const;
     static bool verify(const std::string& name,
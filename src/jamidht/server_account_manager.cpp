@@ -27,6 +27,7 @@
 #include "manager.h"
 
 #include <algorithm>
+#include <cctype>
 #include <string_view>
 
 using namespace std::literals;
@@ -42,6 +43,24 @@ constexpr std::string_view PATH_DEVICES = JAMI_PATH_AUTH "/devices";
 constexpr std::string_view PATH_SEARCH = JAMI_PATH_AUTH "/directory/search";
 constexpr std::string_view PATH_CONTACTS = JAMI_PATH_AUTH "/contacts";
 
+// Kept open between requests to the server
+constexpr size_t MAX_IDLE_CONNECTIONS = 4;
+// Get a new device token before the current one expires
+constexpr std::chrono::seconds TOKEN_REFRESH_MARGIN {60};
+
+static const std::string*
+getHeaderField(const dht::http::Response& response, std::string_view name)
+{
+    for (const auto& field : response.headers)
+        if (std::equal(field.first.begin(),
+                       field.first.end(),
+                       name.begin(),
+                       name.end(),
+                       [](char a, char b) { return std::tolower(a) == std::tolower(b); }))
+            return &field.second;
+    return nullptr;
+}
+
 ServerAccountManager::ServerAccountManager(const std::string& path,
                                            OnAsync&& onAsync,
                                            const std::string& managerHostname,
@@ -205,7 +224,7 @@ ServerAccountManager::initAuthentication(PrivateKey key,
 
                     onAsync([response](AccountManager& accountManager) {
                         auto& this_ = *static_cast<ServerAccountManager*>(&accountManager);
-                        this_.clearRequest(response.request);
+                        this_.clearRequest(response);
                     });
                 },
                 this_.logger_);
@@ -232,7 +251,7 @@ ServerAccountManager::onAuthEnded(const Json::Value& json,
     } else {
         authFailed(expectedScope, response.status_code);
     }
-    clearRequest(response.request);
+    clearRequest(response);
 }
 
 void
@@ -256,7 +275,7 @@ ServerAccountManager::authenticateDevice()
         logger_);
     request->set_identity(info_->identity);
     // request->set_certificate_authority(info_->identity.second->issuer->issuer);
-    sendRequest(request);
+    sendRequest(request, false);
 }
 
 void
@@ -280,25 +299,59 @@ ServerAccountManager::authenticateAccount(const std::string& username, const std
 }
 
 void
-ServerAccountManager::sendRequest(const std::shared_ptr<dht::http::Request>& request)
+ServerAccountManager::sendRequest(const std::shared_ptr<dht::http::Request>& request,
+                                  bool reuseConnection)
 {
     request->set_header_field(restinio::http_field_t::user_agent, "Jami");
+    request->set_connection_type(restinio::http_connection_header_t::keep_alive);
     {
         std::lock_guard<std::mutex> lock(requestLock_);
         requests_.emplace(request);
+        while (reuseConnection and not idleConnections_.empty()) {
+            auto conn = std::move(idleConnections_.back());
+            idleConnections_.pop_back();
+            if (conn->is_open()) {
+                request->set_connection(std::move(conn));
+                break;
+            }
+        }
     }
     request->send();
 }
 
 void
-ServerAccountManager::clearRequest(const std::weak_ptr<dht::http::Request>& request)
+ServerAccountManager::clearRequest(const dht::http::Response& response)
 {
-    if (auto req = request.lock()) {
+    if (auto req = response.request.lock()) {
         std::lock_guard<std::mutex> lock(requestLock_);
         requests_.erase(req);
+        if (response.status_code != 0 and not response.aborted) {
+            auto conn = req->get_connection();
+            if (conn and conn->is_open() and idleConnections_.size() < MAX_IDLE_CONNECTIONS)
+                idleConnections_.emplace_back(std::move(conn));
+        }
     }
 }
 
+void
+ServerAccountManager::setConditionalHeaderFields(Request& request, std::string_view path)
+{
+    std::lock_guard<std::mutex> lock(syncLock_);
+    auto it = etags_.find(path);
+    if (it != etags_.end())
+        request.set_header_field(restinio::http_field_t::if_none_match, it->second);
+}
+
+void
+ServerAccountManager::setETag(std::string_view path, std::string etag)
+{
+    std::lock_guard<std::mutex> lock(syncLock_);
+    if (etag.empty())
+        etags_.erase(path);
+    else
+        etags_[path] = std::move(etag);
+}
+
 void
 ServerAccountManager::authFailed(TokenScope scope, int code)
 {
@@ -306,6 +359,8 @@ ServerAccountManager::authFailed(TokenScope scope, int code)
     {
         std::lock_guard<std::mutex> lock(tokenLock_);
         requests = std::move(getRequestQueue(scope));
+        if (scope == TokenScope::Device)
+            refreshingToken_ = false;
     }
     JAMI_DBG("[Auth] Failed auth with scope %d, ending %zu pending requests",
              (int) scope,
@@ -340,6 +395,7 @@ ServerAccountManager::setToken(std::string token,
     token_ = std::move(token);
     tokenScope_ = scope;
     tokenExpire_ = expiration;
+    refreshingToken_ = false;
 
     nameDir_.get().setToken(token_);
     if (not token_.empty() and scope != TokenScope::None) {
@@ -363,6 +419,12 @@ ServerAccountManager::sendDeviceRequest(const std::shared_ptr<dht::http::Request
     if (hasAuthorization(TokenScope::Device)) {
         setAuthHeaderFields(*req);
         sendRequest(req);
+        // Renew the token in the background so that the next requests don't wait for it
+        if (not refreshingToken_ and tokenScope_ == TokenScope::Device
+            and tokenExpire_ - TOKEN_REFRESH_MARGIN < std::chrono::steady_clock::now()) {
+            refreshingToken_ = true;
+            authenticateDevice();
+        }
     } else {
         auto& rQueue = getRequestQueue(TokenScope::Device);
         if (rQueue.empty())
@@ -387,62 +449,120 @@ ServerAccountManager::sendAccountRequest(const std::shared_ptr<dht::http::Reques
     }
 }
 
+void
+ServerAccountManager::onContactsSynced(const Json::Value& json,
+                                       const dht::http::Response& response,
+                                       const ContactsJson& sent)
+{
+    if (response.status_code == 304) {
+        JAMI_DBG("[Auth] Contacts unchanged on server");
+    } else if (response.status_code >= 200 && response.status_code < 300) {
+        try {
+            JAMI_WARN("[Auth] Got server response: %s", response.body.c_str());
+            if (not json.isArray()) {
+                JAMI_ERR("[Auth] Can't parse server response: not an array");
+            } else {
+                std::vector<dht::InfoHash> received;
+                received.reserve(json.size());
+                for (unsigned i = 0, n = json.size(); i < n; i++) {
+                    const auto& e = json[i];
+                    received.emplace_back(e["uri"].asString());
+                    info_->contacts->updateContact(received.back(), Contact(e));
+                }
+                info_->contacts->saveContacts();
+
+                std::lock_guard<std::mutex> lock(syncLock_);
+                for (const auto& c : sent)
+                    syncedContacts_[c.first] = c.second;
+                // Don't send back what the server just gave us
+                const auto& contacts = info_->contacts->getContacts();
+                for (const auto& uri : received) {
+                    auto c = contacts.find(uri);
+                    if (c != contacts.end())
+                        syncedContacts_[uri] = c->second.toJson();
+                }
+            }
+            auto etag = getHeaderField(response, "etag"sv);
+            setETag(PATH_CONTACTS, etag ? *etag : std::string {});
+        } catch (const std::exception& e) {
+            JAMI_ERR("Error when iterating contact list: %s", e.what());
+        }
+    } else if (response.status_code == 401)
+        authError(TokenScope::Device);
+
+    clearRequest(response);
+}
+
 void
 ServerAccountManager::syncDevices()
 {
     const std::string urlDevices = managerHostname_ + PATH_DEVICES;
     const std::string urlContacts = managerHostname_ + PATH_CONTACTS;
 
-    JAMI_WARN("[Auth] syncContacts %s", urlContacts.c_str());
-    Json::Value jsonContacts(Json::arrayValue);
-    for (const auto& contact : info_->contacts->getContacts()) {
-        auto jsonContact = contact.second.toJson();
-        jsonContact["uri"] = contact.first.toString();
-        jsonContacts.append(std::move(jsonContact));
+    // Only send the contacts changed since the last sync, the server merges them
+    ContactsJson changed;
+    {
+        std::lock_guard<std::mutex> lock(syncLock_);
+        for (const auto& contact : info_->contacts->getContacts()) {
+            auto jsonContact = contact.second.toJson();
+            auto synced = syncedContacts_.find(contact.first);
+            if (synced == syncedContacts_.end() or synced->second != jsonContact)
+                changed.emplace(contact.first, std::move(jsonContact));
+        }
     }
-    sendDeviceRequest(std::make_shared<Request>(
-        *Manager::instance().ioContext(),
-        urlContacts,
-        jsonContacts,
-        [onAsync = onAsync_](Json::Value json, const dht::http::Response& response) {
-            onAsync([=](AccountManager& accountManager) {
-                JAMI_DBG("[Auth] Got contact sync request callback with status code=%u",
-                         response.status_code);
-                auto& this_ = *static_cast<ServerAccountManager*>(&accountManager);
-                if (response.status_code >= 200 && response.status_code < 300) {
-                    try {
-                        JAMI_WARN("[Auth] Got server response: %s", response.body.c_str());
-                        if (not json.isArray()) {
-                            JAMI_ERR("[Auth] Can't parse server response: not an array");
-                        } else {
-                            for (unsigned i = 0, n = json.size(); i < n; i++) {
-                                const auto& e = json[i];
-                                Contact contact(e);
-                                this_.info_->contacts
-                                    ->updateContact(dht::InfoHash {e["uri"].asString()}, contact);
-                            }
-                            this_.info_->contacts->saveContacts();
-                        }
-                    } catch (const std::exception& e) {
-                        JAMI_ERR("Error when iterating contact list: %s", e.what());
-                    }
-                } else if (response.status_code == 401)
-                    this_.authError(TokenScope::Device);
 
-                this_.clearRequest(response.request);
-            });
-        },
-        logger_));
+    std::shared_ptr<Request> contactsRequest;
+    if (changed.empty()) {
+        JAMI_WARN("[Auth] syncContacts (get) %s", urlContacts.c_str());
+        contactsRequest = std::make_shared<Request>(
+            *Manager::instance().ioContext(),
+            urlContacts,
+            [onAsync = onAsync_](Json::Value json, const dht::http::Response& response) {
+                onAsync([=](AccountManager& accountManager) {
+                    JAMI_DBG("[Auth] Got contact sync request callback with status code=%u",
+                             response.status_code);
+                    static_cast<ServerAccountManager*>(&accountManager)
+                        ->onContactsSynced(json, response, {});
+                });
+            },
+            logger_);
+        setConditionalHeaderFields(*contactsRequest, PATH_CONTACTS);
+    } else {
+        JAMI_WARN("[Auth] syncContacts %s: %zu changed", urlContacts.c_str(), changed.size());
+        Json::Value jsonContacts(Json::arrayValue);
+        for (const auto& contact : changed) {
+            auto jsonContact = contact.second;
+            jsonContact["uri"] = contact.first.toString();
+            jsonContacts.append(std::move(jsonContact));
+        }
+        contactsRequest = std::make_shared<Request>(
+            *Manager::instance().ioContext(),
+            urlContacts,
+            jsonContacts,
+            [onAsync = onAsync_, changed = std::move(changed)](Json::Value json,
+                                                               const dht::http::Response& response) {
+                onAsync([=](AccountManager& accountManager) {
+                    JAMI_DBG("[Auth] Got contact sync request callback with status code=%u",
+                             response.status_code);
+                    static_cast<ServerAccountManager*>(&accountManager)
+                        ->onContactsSynced(json, response, changed);
+                });
+            },
+            logger_);
+    }
+    sendDeviceRequest(contactsRequest);
 
     JAMI_WARN("[Auth] syncDevices %s", urlDevices.c_str());
-    sendDeviceRequest(std::make_shared<Request>(
+    auto devicesRequest = std::make_shared<Request>(
         *Manager::instance().ioContext(),
         urlDevices,
         [onAsync = onAsync_](Json::Value json, const dht::http::Response& response) {
             onAsync([=](AccountManager& accountManager) {
                 JAMI_DBG("[Auth] Got request callback with status code=%u", response.status_code);
                 auto& this_ = *static_cast<ServerAccountManager*>(&accountManager);
-                if (response.status_code >= 200 && response.status_code < 300) {
+                if (response.status_code == 304) {
+                    JAMI_DBG("[Auth] Devices unchanged on server");
+                } else if (response.status_code >= 200 && response.status_code < 300) {
                     try {
                         JAMI_WARN("[Auth] Got server response: %s", response.body.c_str());
                         if (not json.isArray()) {
@@ -458,16 +578,20 @@ ServerAccountManager::syncDevices()
                                 }
                             }
                         }
+                        auto etag = getHeaderField(response, "etag"sv);
+                        this_.setETag(PATH_DEVICES, etag ? *etag : std::string {});
                     } catch (const std::exception& e) {
                         JAMI_ERR("Error when iterating device list: %s", e.what());
                     }
                 } else if (response.status_code == 401)
                     this_.authError(TokenScope::Device);
 
-                this_.clearRequest(response.request);
+                this_.clearRequest(response);
             });
         },
-        logger_));
+        logger_);
+    setConditionalHeaderFields(*devicesRequest, PATH_DEVICES);
+    sendDeviceRequest(devicesRequest);
 }
 
 bool
@@ -502,7 +626,7 @@ ServerAccountManager::revokeDevice(const std::string& password,
                     }
                 } else if (cb)
                     cb(RevokeDeviceResult::ERROR_NETWORK);
-                this_.clearRequest(response.request);
+                this_.clearRequest(response);
             });
         },
         logger_);
@@ -558,7 +682,7 @@ ServerAccountManager::searchUser(const std::string& query, SearchCallback cb)
                     if (cb)
                         cb({}, SearchResponse::error);
                 }
-                this_.clearRequest(response.request);
+                this_.clearRequest(response);
             });
         },
         logger_));
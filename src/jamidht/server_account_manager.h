@@ -23,6 +23,9 @@
 #include <queue>
 #include <set>
 #include <chrono>
+#include <map>
+#include <string_view>
+#include <vector>
 
 namespace jami {
 
@@ -80,10 +83,38 @@ private:
 
     std::mutex requestLock_;
     std::set<std::shared_ptr<dht::http::Request>> requests_;
+    std::vector<std::shared_ptr<dht::http::Connection>> idleConnections_;
     std::unique_ptr<ServerAccountCredentials> creds_;
 
-    void sendRequest(const std::shared_ptr<dht::http::Request>& request);
-    void clearRequest(const std::weak_ptr<dht::http::Request>& request);
+    /**
+     * @param reuseConnection   Over an idle connection if any, false if the request
+     *                          authenticates with the TLS handshake
+     */
+    void sendRequest(const std::shared_ptr<dht::http::Request>& request,
+                     bool reuseConnection = true);
+    /**
+     * Forget the request of response, and keep its connection for the next ones
+     */
+    void clearRequest(const dht::http::Response& response);
+
+    using ContactsJson = std::map<dht::InfoHash, Json::Value>;
+    std::mutex syncLock_;
+    // Of the last responses, by path
+    std::map<std::string_view, std::string> etags_;
+    // Contacts as known by the server since the last sync
+    ContactsJson syncedContacts_;
+
+    /**
+     * Send If-None-Match with the entity tag of the last response for path
+     */
+    void setConditionalHeaderFields(dht::http::Request& request, std::string_view path);
+    void setETag(std::string_view path, std::string etag);
+    /**
+     * @param sent  Contacts of the request, none if only got
+     */
+    void onContactsSynced(const Json::Value& json,
+                          const dht::http::Response& response,
+                          const ContactsJson& sent);
 
     enum class TokenScope : unsigned { None = 0, Device, User, Admin };
     std::mutex tokenLock_;
@@ -92,6 +123,8 @@ private:
     std::chrono::steady_clock::time_point tokenExpire_ {
         std::chrono::steady_clock::time_point::min()};
     unsigned authErrorCount {0};
+    // A device token is being fetched while the current one is still valid
+    bool refreshingToken_ {false};
 
     using RequestQueue = std::queue<std::shared_ptr<dht::http::Request>>;
     RequestQueue pendingDeviceRequests_;
@@ -47,7 +47,11 @@ SyncChannelHandler::connect(const DeviceId& deviceId, const std::string&, Connec
                                                           const DeviceId& dev) {
                                          if (cb)
                                              cb(socket, dev);
-                                     });
+                                     },
+                                     false,
+                                     false,
+                                     "",
+                                     /* earlyData, syncing again is harmless */ true);
 }
 
 bool
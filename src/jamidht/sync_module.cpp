@@ -24,8 +24,20 @@
 #include "jamidht/conversation_module.h"
 #include "jamidht/archive_account_manager.h"
 
+#include <opendht/thread_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+
 namespace jami {
 
+// Digest of each entry of the state (contact, conversation, request...) sent to a device
+using Digests = std::map<std::string, dht::InfoHash>;
+
+// Versions sent but not acknowledged yet kept per device
+static constexpr size_t MAX_PENDING_VERSIONS {8};
+
 class SyncModule::Impl : public std::enable_shared_from_this<Impl>
 {
 public:
@@ -37,49 +49,156 @@ public:
     std::mutex syncConnectionsMtx_;
     std::map<DeviceId /* deviceId */, std::vector<std::shared_ptr<ChannelSocket>>> syncConnections_;
 
+    /**
+     * What a device is known to have: the state of the last version it acknowledged
+     */
+    struct PeerState
+    {
+        uint64_t acked {0};
+        Digests ackedDigests;
+        std::map<uint64_t, Digests> pending;
+    };
+    std::mutex stateMtx_;
+    std::map<DeviceId, PeerState> peerStates_;
+    // Last version applied, per device sending its state
+    std::map<DeviceId, uint64_t> applied_;
+    // Time based, so that the versions sent keep increasing after a restart
+    std::atomic<uint64_t> version_ {static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count())};
+
     std::weak_ptr<Impl> weak() { return std::static_pointer_cast<Impl>(shared_from_this()); }
 
     /**
      * Build SyncMsg and send it on socket
+     * Only the entries modified since the last version acknowledged by the device are sent.
      * @param socket
+     * @param deviceId
+     */
+    void syncInfos(const std::shared_ptr<ChannelSocket>& socket, const DeviceId& deviceId);
+
+    /**
+     * Handle the data received on a sync channel: the state of the device, or the
+     * acknowledgement of the state sent
      */
-    void syncInfos(const std::shared_ptr<ChannelSocket>& socket);
+    void onSyncMsg(SyncMsg&& msg,
+                   const std::weak_ptr<ChannelSocket>& socket,
+                   const std::string& peerId,
+                   const DeviceId& deviceId);
+    void onAck(const SyncMsg& msg,
+               const std::weak_ptr<ChannelSocket>& socket,
+               const DeviceId& deviceId);
+
+    void setOnRecv(const std::shared_ptr<ChannelSocket>& socket,
+                   const std::string& peerId,
+                   const DeviceId& deviceId);
 };
 
 SyncModule::Impl::Impl(std::weak_ptr<JamiAccount>&& account)
     : account_(account)
 {}
 
+static std::string
+keyOf(const std::string& key)
+{
+    return key;
+}
+
+template<size_t N>
+static std::string
+keyOf(const dht::Hash<N>& key)
+{
+    return key.toString();
+}
+
+/**
+ * Keep in entries the ones that differ from acked, and store their digests
+ * @return if entries are left
+ */
+template<typename K, typename V>
+static bool
+diff(std::map<K, V>& entries, char kind, const Digests& acked, Digests& digests)
+{
+    msgpack::sbuffer buffer;
+    for (auto it = entries.begin(); it != entries.end();) {
+        buffer.clear();
+        msgpack::pack(buffer, it->second);
+        auto digest = dht::InfoHash::get(reinterpret_cast<const uint8_t*>(buffer.data()),
+                                         buffer.size());
+        auto key = kind + keyOf(it->first);
+        auto a = acked.find(key);
+        auto unchanged = a != acked.end() and a->second == digest;
+        digests.emplace(std::move(key), digest);
+        if (unchanged)
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+    return not entries.empty();
+}
+
 void
-SyncModule::Impl::syncInfos(const std::shared_ptr<ChannelSocket>& socket)
+SyncModule::Impl::syncInfos(const std::shared_ptr<ChannelSocket>& socket, const DeviceId& deviceId)
 {
     auto acc = account_.lock();
     if (!acc)
         return;
-    Json::Value syncValue;
-    msgpack::sbuffer buffer(UINT16_MAX); // Use max pkt size
-    std::error_code ec;
-    // Send contacts infos
+    std::optional<DeviceSync> ds;
+    if (auto info = acc->accountManager()->getInfo())
+        if (info->contacts)
+            ds = info->contacts->getSyncData();
+    auto c = ConversationModule::convInfos(acc->getAccountID());
+    auto cr = ConversationModule::convRequests(acc->getAccountID());
+
     // This message can be big. TODO rewrite to only take UINT16_MAX bytes max or split it multiple
     // messages. For now, write 3 messages (UINT16_MAX*3 should be enough for all informations).
-    if (auto info = acc->accountManager()->getInfo()) {
-        if (info->contacts) {
-            SyncMsg msg;
-            msg.ds = info->contacts->getSyncData();
-            msgpack::pack(buffer, msg);
-            socket->write(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size(), ec);
-            if (ec) {
-                JAMI_ERR("%s", ec.message().c_str());
-                return;
+    std::vector<SyncMsg> msgs;
+    auto version = ++version_;
+    uint64_t base;
+    {
+        std::lock_guard<std::mutex> lk(stateMtx_);
+        auto& state = peerStates_[deviceId];
+        base = state.acked;
+        const auto& acked = state.ackedDigests;
+        Digests digests;
+        // Send contacts infos
+        if (ds) {
+            auto modified = diff(ds->peers, 'p', acked, digests);
+            modified |= diff(ds->trust_requests, 't', acked, digests);
+            modified |= diff(ds->devices, 'd', acked, digests);
+            modified |= diff(ds->devices_known, 'k', acked, digests);
+            if (modified or base == 0) {
+                msgs.emplace_back();
+                msgs.back().ds = std::move(*ds);
             }
         }
+        // Sync conversations
+        if (diff(c, 'c', acked, digests)) {
+            msgs.emplace_back();
+            msgs.back().c = std::move(c);
+        }
+        // Sync requests
+        if (diff(cr, 'r', acked, digests)) {
+            msgs.emplace_back();
+            msgs.back().cr = std::move(cr);
+        }
+        if (msgs.empty())
+            return;
+        state.pending.emplace(version, std::move(digests));
+        if (state.pending.size() > MAX_PENDING_VERSIONS)
+            state.pending.erase(state.pending.begin());
     }
-    buffer.clear();
-    // Sync conversations
-    auto c = ConversationModule::convInfos(acc->getAccountID());
-    if (!c.empty()) {
-        SyncMsg msg;
-        msg.c = std::move(c);
+    if (base != 0)
+        JAMI_DBG("[Sync] send %zu modified parts to %s", msgs.size(), deviceId.to_c_str());
+    // The versions are carried by the last message, once all parts are received
+    msgs.back().v = version;
+    msgs.back().base = base;
+
+    msgpack::sbuffer buffer(UINT16_MAX); // Use max pkt size
+    std::error_code ec;
+    for (const auto& msg : msgs) {
+        buffer.clear();
         msgpack::pack(buffer, msg);
         socket->write(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size(), ec);
         if (ec) {
@@ -87,19 +206,120 @@ SyncModule::Impl::syncInfos(const std::shared_ptr<ChannelSocket>& socket)
             return;
         }
     }
-    buffer.clear();
-    // Sync requests
-    auto cr = ConversationModule::convRequests(acc->getAccountID());
-    if (!cr.empty()) {
-        SyncMsg msg;
-        msg.cr = std::move(cr);
-        msgpack::pack(buffer, msg);
-        socket->write(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size(), ec);
-        if (ec) {
-            JAMI_ERR("%s", ec.message().c_str());
+}
+
+void
+SyncModule::Impl::onSyncMsg(SyncMsg&& msg,
+                            const std::weak_ptr<ChannelSocket>& socket,
+                            const std::string& peerId,
+                            const DeviceId& deviceId)
+{
+    if (msg.ack) {
+        onAck(msg, socket, deviceId);
+        return;
+    }
+    auto acc = account_.lock();
+    if (!acc)
+        return;
+
+    if (auto manager = dynamic_cast<ArchiveAccountManager*>(acc->accountManager()))
+        manager->onSyncData(std::move(msg.ds), false);
+
+    if (!msg.c.empty() || !msg.cr.empty())
+        acc->convModule()->onSyncData(msg, peerId, deviceId.toString());
+
+    if (!msg.v)
+        return;
+    SyncMsg ack {};
+    ack.ack = msg.v;
+    {
+        std::lock_guard<std::mutex> lk(stateMtx_);
+        auto& applied = applied_[deviceId];
+        // The previous state is unknown, e.g. after a restart
+        ack.resync = msg.base != 0 and msg.base > applied;
+        if (not ack.resync)
+            applied = std::max(applied, msg.v);
+    }
+    if (ack.resync)
+        JAMI_WARN("[Sync] unknown version from %s, asking for the whole state",
+                  deviceId.to_c_str());
+    if (!msg.c.empty()) {
+        auto conversations = acc->convModule()->getConversations();
+        for (const auto& [convId, convInfo] : msg.c)
+            if (not convInfo.removed
+                and std::find(conversations.begin(), conversations.end(), convId)
+                        == conversations.end())
+                ack.missing.emplace_back(convId);
+    }
+    dht::ThreadPool::io().run([socket, ack = std::move(ack)] {
+        auto s = socket.lock();
+        if (!s)
+            return;
+        msgpack::sbuffer buffer;
+        msgpack::pack(buffer, ack);
+        std::error_code ec;
+        s->write(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size(), ec);
+        if (ec)
+            JAMI_WARN("[Sync] can't acknowledge: %s", ec.message().c_str());
+    });
+}
+
+void
+SyncModule::Impl::onAck(const SyncMsg& msg,
+                        const std::weak_ptr<ChannelSocket>& socket,
+                        const DeviceId& deviceId)
+{
+    {
+        std::lock_guard<std::mutex> lk(stateMtx_);
+        auto it = peerStates_.find(deviceId);
+        if (it == peerStates_.end())
+            return;
+        auto& state = it->second;
+        if (not msg.resync) {
+            auto p = state.pending.find(msg.ack);
+            if (p == state.pending.end())
+                return;
+            if (msg.ack > state.acked) {
+                state.acked = msg.ack;
+                state.ackedDigests = std::move(p->second);
+                for (const auto& convId : msg.missing)
+                    state.ackedDigests.erase('c' + convId);
+            }
+            state.pending.erase(state.pending.begin(), std::next(p));
             return;
         }
+        state = {};
     }
+    dht::ThreadPool::io().run([w = weak(), socket, deviceId] {
+        auto shared = w.lock();
+        auto s = socket.lock();
+        if (shared && s)
+            shared->syncInfos(s, deviceId);
+    });
+}
+
+void
+SyncModule::Impl::setOnRecv(const std::shared_ptr<ChannelSocket>& socket,
+                            const std::string& peerId,
+                            const DeviceId& deviceId)
+{
+    std::weak_ptr<ChannelSocket> wsocket = socket;
+    socket->setOnRecv([w = weak(), wsocket, deviceId, peerId](const uint8_t* buf, size_t len) {
+        auto shared = w.lock();
+        if (!buf || !shared)
+            return len;
+
+        SyncMsg msg;
+        try {
+            msgpack::object_handle oh = msgpack::unpack(reinterpret_cast<const char*>(buf), len);
+            oh.get().convert(msg);
+        } catch (const std::exception& e) {
+            JAMI_WARN("[convInfo] error on sync: %s", e.what());
+            return len;
+        }
+        shared->onSyncMsg(std::move(msg), wsocket, peerId, deviceId);
+        return len;
+    });
 }
 
 ////////////////////////////////////////////////////////////////
@@ -131,28 +351,7 @@ SyncModule::cacheSyncConnection(std::shared_ptr<ChannelSocket>&& socket,
         }
     });
 
-    socket->setOnRecv([acc = pimpl_->account_.lock(), device, peerId](const uint8_t* buf,
-                                                                      size_t len) {
-        if (!buf || !acc)
-            return len;
-
-        SyncMsg msg;
-        try {
-            msgpack::unpacked result;
-            msgpack::object_handle oh = msgpack::unpack(reinterpret_cast<const char*>(buf), len);
-            oh.get().convert(msg);
-        } catch (const std::exception& e) {
-            JAMI_WARN("[convInfo] error on sync: %s", e.what());
-            return len;
-        }
-
-        if (auto manager = dynamic_cast<ArchiveAccountManager*>(acc->accountManager()))
-            manager->onSyncData(std::move(msg.ds), false);
-
-        if (!msg.c.empty() || !msg.cr.empty())
-            acc->convModule()->onSyncData(msg, peerId, device.toString());
-        return len;
-    });
+    pimpl_->setOnRecv(socket, peerId, device);
 }
 
 void
@@ -182,16 +381,19 @@ SyncModule::syncWith(const DeviceId& deviceId, const std::shared_ptr<ChannelSock
         });
         pimpl_->syncConnections_[deviceId].emplace_back(socket);
     }
-    pimpl_->syncInfos(socket);
+    // The acknowledgements of the device are received on the same channel
+    if (auto acc = pimpl_->account_.lock())
+        pimpl_->setOnRecv(socket, acc->getUsername(), deviceId);
+    pimpl_->syncInfos(socket, deviceId);
 }
 
 void
 SyncModule::syncWithConnected()
 {
     std::lock_guard<std::mutex> lk(pimpl_->syncConnectionsMtx_);
-    for (auto& [_deviceId, sockets] : pimpl_->syncConnections_) {
+    for (auto& [deviceId, sockets] : pimpl_->syncConnections_) {
         if (not sockets.empty())
-            pimpl_->syncInfos(sockets[0]);
+            pimpl_->syncInfos(sockets[0], deviceId);
     }
 }
 } // namespace jami
\ No newline at end of file
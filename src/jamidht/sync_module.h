@@ -42,6 +42,8 @@ public:
 
     /**
      * Send sync informations to connected device
+     * Once the device acknowledged a version of the informations, only the ones modified since
+     * are sent. The whole informations are sent again if the device doesn't know this version.
      * @param deviceId      Connected device
      * @param socket        Related socket
      */
@@ -68,9 +68,8 @@ TransferChannelHandler::onRequest(const std::shared_ptr<dht::crypto::Certificate
 
     // Check if peer is member of the conversation
     if (fileId == fmt::format("{}.vcf", acc->getUsername())) {
-        auto members = acc->convModule()->getConversationMembers(conversationId);
-        return std::find_if(members.begin(), members.end(), [&](auto m) { return m["uri"] == uri; })
-               != members.end();
+        auto members = acc->convModule()->getConversationMemberUris(conversationId);
+        return std::find(members.begin(), members.end(), uri) != members.end();
     } else if (fileHost == "profile") {
         // If a profile is sent, check if it's from another device
         return uri == acc->getUsername();
@@ -131,7 +130,7 @@ TransferChannelHandler::onReady(const std::shared_ptr<dht::crypto::Certificate>&
     }
     auto interactionId = fileId.substr(0, sep);
     std::string path = dt->path(fileId);
-    auto start = 0u, end = 0u;
+    std::size_t start = 0, end = 0;
     for (const auto arg : split_string(arguments, '&')) {
         auto keyVal = split_string(arg, '=');
         if (keyVal.size() == 2) {
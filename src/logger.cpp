@@ -51,6 +51,8 @@
 #include <mutex>
 #include <thread>
 #include <array>
+#include <memory>
+#include <vector>
 
 #include "fileutils.h"
 #include "logger.h"
@@ -143,25 +145,22 @@ stripDirName(const char* path)
     return occur ? occur + 1 : path;
 }
 
-static std::string
-contextHeader(const char* const file, int line)
+static auto
+currentTid()
 {
 #ifdef __linux__
-    auto tid = syscall(__NR_gettid) & 0xffff;
+    thread_local const auto tid = syscall(__NR_gettid) & 0xffff;
 #else
-    auto tid = std::this_thread::get_id();
+    thread_local const auto tid = std::this_thread::get_id();
 #endif // __linux__
+    return tid;
+}
 
-    unsigned int secs, milli;
-    struct timeval tv;
-    if (!gettimeofday(&tv, NULL)) {
-        secs = tv.tv_sec;
-        milli = tv.tv_usec / 1000; // suppose that milli < 1000
-    } else {
-        secs = time(NULL);
-        milli = 0;
-    }
+using Tid = decltype(currentTid());
 
+static std::string
+contextHeader(const char* const file, int line, Tid tid, unsigned secs, unsigned milli)
+{
     if (file) {
         return fmt::format(FMT_COMPILE("[{: >3d}.{:0<3d}|{: >4}|{: <24s}:{: <4d}] "), secs, milli, tid, stripDirName(file), line);
     } else {
@@ -197,36 +196,62 @@ formatPrintfArgs(const char* format, va_list ap)
     return ret;
 }
 
+/**
+ * The context of the message is captured by the caller, its header formatted
+ * by the log thread (see LogRing)
+ */
 struct Logger::Msg
 {
-    Msg() = delete;
+    Msg() = default;
 
     Msg(int level, const char* file, int line, bool linefeed, std::string&& message)
         : payload_(std::move(message))
-        , header_(contextHeader(file, line))
         , level_(level)
         , linefeed_(linefeed)
-    {}
+        , file_(file)
+        , line_(line)
+    {
+        captureContext();
+    }
 
     Msg(int level, const char* file, int line, bool linefeed, const char* fmt, va_list ap)
         : payload_(formatPrintfArgs(fmt, ap))
-        , header_(contextHeader(file, line))
         , level_(level)
         , linefeed_(linefeed)
-    {}
+        , file_(file)
+        , line_(line)
+    {
+        captureContext();
+    }
+
+    Msg(Msg&&) = default;
+    Msg& operator=(Msg&&) = default;
 
-    Msg(Msg&& other)
+    void captureContext()
     {
-        payload_ = std::move(other.payload_);
-        header_ = std::move(other.header_);
-        level_ = other.level_;
-        linefeed_ = other.linefeed_;
+        tid_ = currentTid();
+        struct timeval tv;
+        if (!gettimeofday(&tv, NULL)) {
+            secs_ = tv.tv_sec;
+            milli_ = tv.tv_usec / 1000; // suppose that milli < 1000
+        } else {
+            secs_ = time(NULL);
+            milli_ = 0;
+        }
     }
 
+    void formatHeader() { header_ = contextHeader(file_, line_, tid_, secs_, milli_); }
+
     std::string payload_;
     std::string header_;
-    int level_;
-    bool linefeed_;
+    int level_ {LOG_DEBUG};
+    bool linefeed_ {true};
+
+    const char* file_ {nullptr};
+    int line_ {0};
+    Tid tid_ {};
+    unsigned secs_ {0};
+    unsigned milli_ {0};
 };
 
 class Logger::Handler
@@ -235,6 +260,10 @@ public:
     virtual ~Handler() = default;
 
     virtual void consume(Msg& msg) = 0;
+    /**
+     * Once the messages given so far are consumed
+     */
+    virtual void flush() {}
 
     void enable(bool en) { enabled_.store(en, std::memory_order_relaxed); }
     bool isEnable() { return enabled_.load(std::memory_order_relaxed); }
@@ -449,104 +478,316 @@ public:
 
     void setFile(const std::string& path)
     {
-        if (thread_.joinable()) {
-            notify([this] { enable(false); });
-            thread_.join();
-        }
-
-        std::ofstream file;
-        if (not path.empty()) {
-            file.open(path, std::ofstream::out | std::ofstream::app);
-            enable(true);
-        } else {
+        std::lock_guard lk(mtx_);
+        if (file_.is_open())
+            file_.close();
+        if (path.empty()) {
             enable(false);
             return;
         }
+        file_.open(path, std::ofstream::out | std::ofstream::app);
+        enable(true);
+    }
 
-        thread_ = std::thread([this, file = std::move(file)]() mutable {
-            std::vector<Logger::Msg> pendingQ_;
-            while (isEnable()) {
-                {
-                    std::unique_lock lk(mtx_);
-                    cv_.wait(lk, [&] { return not isEnable() or not currentQ_.empty(); });
-                    if (not isEnable())
-                        break;
+    // Called by the log thread only
+    virtual void consume(Logger::Msg& msg) override
+    {
+        std::lock_guard lk(mtx_);
+        file_ << msg.header_ << msg.payload_;
 
-                    std::swap(currentQ_, pendingQ_);
-                }
+        if (msg.linefeed_)
+            file_ << ENDL;
+    }
 
-                do_consume(file, pendingQ_);
-                pendingQ_.clear();
-            }
-        });
+    virtual void flush() override
+    {
+        std::lock_guard lk(mtx_);
+        file_.flush();
     }
 
-    ~FileLog()
+private:
+    std::ofstream file_;
+    std::mutex mtx_;
+};
+
+void
+Logger::setFileLog(const std::string& path)
+{
+    FileLog::instance().setFile(path);
+}
+
+template<typename T>
+void
+log_to_if_enabled(T& handler, Logger::Msg& msg)
+{
+    if (handler.isEnable()) {
+        handler.consume(msg);
+    }
+}
+
+/**
+ * Bounded lock-free queue of the messages of the threads, consumed by a log thread
+ * formatting their header and giving them to the handlers.
+ *
+ * Logging only moves the message into the ring: a thread doesn't wait for the console,
+ * the syslog or the file. A message is dropped if the ring is full.
+ * Each cell holds its sequence: pos for a free cell at pos, pos + 1 once written.
+ */
+class LogRing
+{
+public:
+    static LogRing& instance()
     {
-        notify([=] { enable(false); });
-        if (thread_.joinable())
-            thread_.join();
+        // Intentional memory leak:
+        // Some thread can still be logging even during static destructors.
+        static LogRing* self = new LogRing();
+        return *self;
     }
 
-    virtual void consume(Logger::Msg& msg) override
+    void push(Logger::Msg&& msg)
     {
-        notify([&, this] { currentQ_.emplace_back(std::move(msg)); });
+        auto pos = head_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & MASK];
+            auto seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->msg = std::move(msg);
+        cell->seq.store(pos + 1, std::memory_order_release);
+
+        // Only locked to wake the log thread up
+        if (sleeping_.exchange(false)) {
+            std::lock_guard lk(mtx_);
+            cv_.notify_one();
+        }
     }
 
-private:
-    template<typename T>
-    void notify(T func)
+    /**
+     * Wait until the messages given so far are consumed
+     */
+    void flush()
     {
-        std::lock_guard lk(mtx_);
-        func();
+        auto pos = head_.load();
+        std::unique_lock lk(mtx_);
+        sleeping_ = false;
         cv_.notify_one();
+        flushedCv_.wait_for(lk, std::chrono::seconds(1), [&] { return consumed_ >= pos; });
     }
 
-    void do_consume(std::ofstream& file, const std::vector<Logger::Msg>& messages)
+private:
+    static constexpr std::size_t SIZE {8192};
+    static constexpr std::size_t MASK {SIZE - 1};
+
+    struct Cell
+    {
+        std::atomic<std::size_t> seq;
+        Logger::Msg msg;
+    };
+
+    LogRing()
+        : cells_(new Cell[SIZE])
     {
-        for (const auto& msg : messages) {
-            file << msg.header_ << msg.payload_;
+        for (std::size_t i = 0; i < SIZE; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        thread_ = std::thread([this] { loop(); });
+        thread_.detach();
+    }
 
-            if (msg.linefeed_)
-                file << ENDL;
+    bool pop(Logger::Msg& msg)
+    {
+        auto& cell = cells_[tail_ & MASK];
+        if (cell.seq.load(std::memory_order_acquire) != tail_ + 1)
+            return false;
+        msg = std::move(cell.msg);
+        cell.seq.store(tail_ + SIZE, std::memory_order_release);
+        ++tail_;
+        return true;
+    }
+
+    void dispatch(Logger::Msg& msg)
+    {
+        msg.formatHeader();
+        log_to_if_enabled(ConsoleLog::instance(), msg);
+        log_to_if_enabled(SysLog::instance(), msg);
+        log_to_if_enabled(MonitorLog::instance(), msg);
+        log_to_if_enabled(FileLog::instance(), msg);
+    }
+
+    void loop()
+    {
+        Logger::Msg msg;
+        while (true) {
+            while (pop(msg))
+                dispatch(msg);
+            if (auto dropped = dropped_.exchange(0)) {
+                Logger::Msg lost(LOG_WARNING,
+                                 nullptr,
+                                 0,
+                                 true,
+                                 fmt::format("{} log messages dropped", dropped));
+                dispatch(lost);
+            }
+            FileLog::instance().flush();
+
+            std::unique_lock lk(mtx_);
+            consumed_ = tail_;
+            flushedCv_.notify_all();
+            sleeping_ = true;
+            // Pushed before sleeping_ was set
+            if (cells_[tail_ & MASK].seq.load(std::memory_order_acquire) == tail_ + 1) {
+                sleeping_ = false;
+                continue;
+            }
+            cv_.wait(lk, [&] { return not sleeping_.load(); });
         }
-        file.flush();
     }
 
-    std::vector<Logger::Msg> currentQ_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<std::size_t> head_ {0};
+    alignas(64) std::size_t tail_ {0};
+    std::atomic<uint64_t> dropped_ {0};
+
+    std::atomic_bool sleeping_ {false};
     std::mutex mtx_;
     std::condition_variable cv_;
+    std::condition_variable flushedCv_;
+    std::size_t consumed_ {0};
     std::thread thread_;
 };
 
-void
-Logger::setFileLog(const std::string& path)
+static bool
+handlersEnabled()
 {
-    FileLog::instance().setFile(path);
+    return ConsoleLog::instance().isEnable() or SysLog::instance().isEnable()
+           or MonitorLog::instance().isEnable() or FileLog::instance().isEnable();
 }
 
+// Their level already checked by the log macros
 DRING_PUBLIC void
 Logger::log(int level, const char* file, int line, bool linefeed, const char* fmt, ...)
 {
+    if (not handlersEnabled())
+        return;
+
     va_list ap;
 
     va_start(ap, fmt);
 
-    vlog(level, file, line, linefeed, fmt, ap);
+    /* Timestamp is generated here. */
+    LogRing::instance().push(Msg(level, file, line, linefeed, fmt, ap));
 
     va_end(ap);
 }
 
-template<typename T>
+static std::atomic_bool debugEnabled_ {false};
+
+static constexpr unsigned MAX_MODULES {64};
+static constexpr int MODULE_DEFAULT {-1};
+
+/**
+ * Modules registered by the first log of their files, or by setModuleLevel()
+ */
+struct LogModules
+{
+    std::mutex mutex;
+    std::vector<std::string> names {"core"};
+    // Least severe logged, or MODULE_DEFAULT
+    std::array<std::atomic_int, MAX_MODULES> severities;
+
+    LogModules()
+    {
+        for (auto& severity : severities)
+            severity.store(MODULE_DEFAULT, std::memory_order_relaxed);
+    }
+
+    unsigned get(std::string_view name)
+    {
+        std::lock_guard lk(mutex);
+        for (unsigned i = 0; i < names.size(); ++i)
+            if (names[i] == name)
+                return i;
+        if (names.size() == MAX_MODULES)
+            return 0;
+        names.emplace_back(name);
+        return names.size() - 1;
+    }
+};
+
+static LogModules&
+logModules()
+{
+    // Intentional memory leak:
+    // Some thread can still be logging even during static destructors.
+    static LogModules* modules = new LogModules();
+    return *modules;
+}
+
+unsigned
+Logger::moduleOf(const char* file)
+{
+    if (not file)
+        return 0;
+    std::string_view path(file);
+    auto src = path.rfind("src" DIR_SEPARATOR_STR);
+    if (src == std::string_view::npos)
+        return 0;
+    path.remove_prefix(src + 4);
+    auto sep = path.find(DIR_SEPARATOR_CH);
+    if (sep == std::string_view::npos)
+        return 0;
+    return logModules().get(path.substr(0, sep));
+}
+
 void
-log_to_if_enabled(T& handler, Logger::Msg& msg)
+Logger::setModuleLevel(std::string_view module, int level)
 {
-    if (handler.isEnable()) {
-        handler.consume(msg);
+    auto& modules = logModules();
+    modules.severities[modules.get(module)].store(level < 0 ? MODULE_DEFAULT
+                                                            : logSeverity(level),
+                                                  std::memory_order_relaxed);
+}
+
+void
+Logger::setModuleLevels(std::string_view levels)
+{
+    for (const auto& entry : split_string(levels, ',')) {
+        auto sep = entry.find('=');
+        if (sep == std::string_view::npos)
+            continue;
+        auto module = entry.substr(0, sep);
+        auto level = entry.substr(sep + 1);
+        if (level == "error")
+            setModuleLevel(module, LOG_ERR);
+        else if (level == "warning")
+            setModuleLevel(module, LOG_WARNING);
+        else if (level == "info")
+            setModuleLevel(module, LOG_INFO);
+        else if (level == "debug")
+            setModuleLevel(module, LOG_DEBUG);
+        else if (level == "default")
+            setModuleLevel(module, MODULE_DEFAULT);
     }
 }
 
-static std::atomic_bool debugEnabled_ {false};
+bool
+Logger::enabled(int level, unsigned module)
+{
+    auto severity = logModules().severities[module].load(std::memory_order_relaxed);
+    if (severity == MODULE_DEFAULT)
+        severity = debugEnabled_.load(std::memory_order_relaxed) ? logSeverity(LOG_DEBUG)
+                                                                 : logSeverity(LOG_WARNING);
+    return logSeverity(level) <= severity;
+}
 
 void
 Logger::setDebugMode(bool enable)
@@ -563,39 +804,24 @@ Logger::debugEnabled()
 void
 Logger::vlog(int level, const char* file, int line, bool linefeed, const char* fmt, va_list ap)
 {
-    if (not debugEnabled_.load(std::memory_order_relaxed) and level < LOG_WARNING) {
+    if (not enabled(level, 0) or not handlersEnabled())
         return;
-    }
-
-    if (not(ConsoleLog::instance().isEnable() or SysLog::instance().isEnable()
-            or MonitorLog::instance().isEnable() or FileLog::instance().isEnable())) {
-        return;
-    }
 
     /* Timestamp is generated here. */
-    Msg msg(level, file, line, linefeed, fmt, ap);
-
-    log_to_if_enabled(ConsoleLog::instance(), msg);
-    log_to_if_enabled(SysLog::instance(), msg);
-    log_to_if_enabled(MonitorLog::instance(), msg);
-    log_to_if_enabled(FileLog::instance(), msg); // Takes ownership of msg if enabled
+    LogRing::instance().push(Msg(level, file, line, linefeed, fmt, ap));
 }
 
 void
 Logger::write(int level, const char* file, int line, std::string&& message) {
     /* Timestamp is generated here. */
-    Msg msg(level, file, line, true, std::move(message));
-
-    log_to_if_enabled(ConsoleLog::instance(), msg);
-    log_to_if_enabled(SysLog::instance(), msg);
-    log_to_if_enabled(MonitorLog::instance(), msg);
-    log_to_if_enabled(FileLog::instance(), msg); // Takes ownership of msg if enabled
+    LogRing::instance().push(Msg(level, file, line, true, std::move(message)));
 }
 
 void
 Logger::fini()
 {
-    // Force close on file and join thread
+    // Write the messages left, then close the file
+    LogRing::instance().flush();
     FileLog::instance().setFile({});
 
 #ifdef _WIN32
@@ -33,6 +33,7 @@
 #include <atomic>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include "string_utils.h" // to_string
 
 #ifdef __ANDROID__
@@ -65,6 +66,17 @@
 #define PRINTF_ATTRIBUTE(a, b)
 #endif
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * Messages less severe than this are compiled out (0: errors, 1: warnings, 2: infos, 3: debug)
+ */
+#ifndef JAMI_LOG_MAX_SEVERITY
+#define JAMI_LOG_MAX_SEVERITY 3
+#endif
+
 namespace jami {
 
 /**
@@ -72,6 +84,25 @@ namespace jami {
  */
 void strErr();
 
+/**
+ * @return severity of a LOG_XXX level, whose values depend on the platform:
+ * 0 for errors to 3 for debug
+ */
+constexpr int
+logSeverity(int level)
+{
+    switch (level) {
+    case LOG_ERR:
+        return 0;
+    case LOG_WARNING:
+        return 1;
+    case LOG_INFO:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
 ///
 /// Level-driven logging class that support printf and C++ stream logging fashions.
 ///
@@ -128,6 +159,28 @@ public:
     static void setDebugMode(bool enable);
     static bool debugEnabled();
 
+    /**
+     * Module of a source file: the directory under src/ (e.g. "sip" for src/sip/sipcall.cpp,
+     * "media" for src/media/audio/audiolayer.cpp), "core" for the files of src/
+     */
+    DRING_PUBLIC
+    static unsigned moduleOf(const char* file);
+    /**
+     * @param level     Least severe LOG_XXX level logged for the module,
+     *                  whatever the debug mode; -1 to follow the debug mode
+     */
+    static void setModuleLevel(std::string_view module, int level);
+    /**
+     * @param levels    Comma-separated list of module=level, the level being
+     *                  error, warning, info, debug or default, e.g. "media=warning,sip=debug"
+     */
+    static void setModuleLevels(std::string_view levels);
+    /**
+     * Without debug mode, only the warnings and errors are logged
+     */
+    DRING_PUBLIC
+    static bool enabled(int level, unsigned module);
+
     static void fini();
 
     ///
@@ -150,6 +203,22 @@ private:
     std::ostringstream os_; ///< string stream used with C++ stream style (stream operator<<)
 };
 
+/**
+ * Call site of a log macro, to check its level before the arguments are evaluated
+ */
+class LogSite
+{
+public:
+    explicit LogSite(const char* file)
+        : module_(Logger::moduleOf(file))
+    {}
+
+    bool enabled(int level) const { return Logger::enabled(level, module_); }
+
+private:
+    const unsigned module_;
+};
+
 namespace log {
 
 template<typename S, typename... Args>
@@ -169,19 +238,26 @@ void error(const char* file, int line, S&& format, Args&&... args) {
 
 }
 
+// The arguments are evaluated only if the level is compiled in and enabled for the module.
+// The statement that follows is the else branch, for a macro followed by else to keep its meaning.
+#define JAMI_LOG_IF(level) \
+    if (static const ::jami::LogSite jami_log_site_ {__FILE__}; \
+        ::jami::logSeverity(level) > JAMI_LOG_MAX_SEVERITY or not jami_log_site_.enabled(level)) { \
+    } else
+
 // We need to use macros for contextual information
-#define JAMI_INFO(...) ::jami::Logger::log(LOG_INFO, __FILE__, __LINE__, true, ##__VA_ARGS__)
-#define JAMI_DBG(...)  ::jami::Logger::log(LOG_DEBUG, __FILE__, __LINE__, true, ##__VA_ARGS__)
-#define JAMI_WARN(...) ::jami::Logger::log(LOG_WARNING, __FILE__, __LINE__, true, ##__VA_ARGS__)
-#define JAMI_ERR(...)  ::jami::Logger::log(LOG_ERR, __FILE__, __LINE__, true, ##__VA_ARGS__)
-
-#define JAMI_XINFO(...) ::jami::Logger::log(LOG_INFO, __FILE__, __LINE__, false, ##__VA_ARGS__)
-#define JAMI_XDBG(...)  ::jami::Logger::log(LOG_DEBUG, __FILE__, __LINE__, false, ##__VA_ARGS__)
-#define JAMI_XWARN(...) ::jami::Logger::log(LOG_WARNING, __FILE__, __LINE__, false, ##__VA_ARGS__)
-#define JAMI_XERR(...)  ::jami::Logger::log(LOG_ERR, __FILE__, __LINE__, false, ##__VA_ARGS__)
-
-#define JAMI_DEBUG(formatstr, ...) if(::jami::Logger::debugEnabled()) { ::jami::log::dbg(__FILE__, __LINE__, FMT_STRING(formatstr), ##__VA_ARGS__); }
-#define JAMI_WARNING(formatstr, ...) ::jami::log::warn(__FILE__, __LINE__, FMT_STRING(formatstr), ##__VA_ARGS__)
-#define JAMI_ERROR(formatstr, ...) ::jami::log::error(__FILE__, __LINE__, FMT_STRING(formatstr), ##__VA_ARGS__)
+#define JAMI_INFO(...) JAMI_LOG_IF(LOG_INFO) ::jami::Logger::log(LOG_INFO, __FILE__, __LINE__, true, ##__VA_ARGS__)
+#define JAMI_DBG(...)  JAMI_LOG_IF(LOG_DEBUG) ::jami::Logger::log(LOG_DEBUG, __FILE__, __LINE__, true, ##__VA_ARGS__)
+#define JAMI_WARN(...) JAMI_LOG_IF(LOG_WARNING) ::jami::Logger::log(LOG_WARNING, __FILE__, __LINE__, true, ##__VA_ARGS__)
+#define JAMI_ERR(...)  JAMI_LOG_IF(LOG_ERR) ::jami::Logger::log(LOG_ERR, __FILE__, __LINE__, true, ##__VA_ARGS__)
+
+#define JAMI_XINFO(...) JAMI_LOG_IF(LOG_INFO) ::jami::Logger::log(LOG_INFO, __FILE__, __LINE__, false, ##__VA_ARGS__)
+#define JAMI_XDBG(...)  JAMI_LOG_IF(LOG_DEBUG) ::jami::Logger::log(LOG_DEBUG, __FILE__, __LINE__, false, ##__VA_ARGS__)
+#define JAMI_XWARN(...) JAMI_LOG_IF(LOG_WARNING) ::jami::Logger::log(LOG_WARNING, __FILE__, __LINE__, false, ##__VA_ARGS__)
+#define JAMI_XERR(...)  JAMI_LOG_IF(LOG_ERR) ::jami::Logger::log(LOG_ERR, __FILE__, __LINE__, false, ##__VA_ARGS__)
+
+#define JAMI_DEBUG(formatstr, ...) JAMI_LOG_IF(LOG_DEBUG) ::jami::log::dbg(__FILE__, __LINE__, FMT_STRING(formatstr), ##__VA_ARGS__)
+#define JAMI_WARNING(formatstr, ...) JAMI_LOG_IF(LOG_WARNING) ::jami::log::warn(__FILE__, __LINE__, FMT_STRING(formatstr), ##__VA_ARGS__)
+#define JAMI_ERROR(formatstr, ...) JAMI_LOG_IF(LOG_ERR) ::jami::log::error(__FILE__, __LINE__, FMT_STRING(formatstr), ##__VA_ARGS__)
 
 } // namespace jami
@@ -43,6 +43,9 @@
 #include "account.h"
 #include "string_utils.h"
 #include "jamidht/jamiaccount.h"
+#include "jamidht/account_dht.h"
+#include "security/certstore.h"
+#include "security/password_keys.h"
 #include "sip/sipvoiplink.h"
 #include "account.h"
 #include <opendht/rng.h>
@@ -56,6 +59,7 @@ using random_device = dht::crypto::random_device;
 #include "im/instant_messaging.h"
 
 #include "config/yamlparser.h"
+#include "config/yaml_snapshot.h"
 
 #if HAVE_ALSA
 #include "audio/alsa/alsalayer.h"
@@ -79,8 +83,11 @@ using random_device = dht::crypto::random_device;
 #include "client/ring_signal.h"
 #include "jami/call_const.h"
 #include "jami/account_const.h"
+#include "jami/configurationmanager_interface.h"
 
 #include "libav_utils.h"
+#include "metrics.h"
+#include "network_monitor.h"
 #ifdef ENABLE_VIDEO
 #include "video/video_scaler.h"
 #include "video/sinkclient.h"
@@ -134,6 +141,8 @@ namespace jami {
 using CallIDSet = std::set<std::string>;
 
 static constexpr const char* PACKAGE_OLD = "ring";
+// Changes made in a row, e.g. a client setting several details, are written at once
+static constexpr std::chrono::milliseconds CONFIG_SAVE_DELAY {500};
 
 std::atomic_bool Manager::initialized = {false};
 
@@ -299,6 +308,62 @@ setGnuTlsLogLevel()
     gnutls_global_set_log_function(tls_print_logs);
 }
 
+/**
+ * Set the size of libgit2's object cache, shared by the repositories, from the
+ * JAMI_GIT_CACHE_MAX_SIZE environment variable, in bytes.
+ */
+static constexpr int64_t GIT_CACHE_MAX_SIZE {64 * 1024 * 1024};
+
+static void
+setGitCacheMaxSize()
+{
+    int64_t size = GIT_CACHE_MAX_SIZE;
+#ifndef RING_UWP
+    if (auto envvar = getenv("JAMI_GIT_CACHE_MAX_SIZE")) {
+        int64_t var_size;
+        if (std::istringstream(envvar) >> var_size and var_size >= 0)
+            size = var_size;
+    }
+#endif
+    if (git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, static_cast<ssize_t>(size)) < 0)
+        JAMI_WARN("Unable to set the size of the git cache");
+}
+
+/**
+ * Set the gauges of the memory only read on demand, when the metrics are exported
+ */
+static void
+collectMemoryMetrics()
+{
+    auto& registry = metrics::Registry::instance();
+    ssize_t gitCached = 0, gitAllowed = 0;
+    if (git_libgit2_opts(GIT_OPT_GET_CACHED_MEMORY, &gitCached, &gitAllowed) == 0) {
+        metrics::memoryBytes("git_cache").set(gitCached);
+        static auto& limit = registry.gauge("jami_memory_limit_bytes",
+                                            "Memory a cache may hold, by subsystem",
+                                            {{"pool", "git_cache"}});
+        limit.set(gitAllowed);
+    }
+
+    static auto& certificates = registry.gauge("jami_cache_entries",
+                                               "Entries of the caches",
+                                               {{"cache", "certificates"}});
+    certificates.set(tls::CertificateStore::instance().parsedCertificates());
+
+    if (not Manager::initialized)
+        return;
+    // The values of the shared node are counted once
+    size_t dhtBytes = 0;
+    bool sharedCounted = false;
+    for (const auto& account : Manager::instance().getAllAccounts<JamiAccount>()) {
+        auto dht = account->dht();
+        if (not dht or (dht->isShared() and std::exchange(sharedCounted, true)))
+            continue;
+        dhtBytes += dht->getStoreSize().first;
+    }
+    metrics::memoryBytes("dht_storage").set(dhtBytes);
+}
+
 //==============================================================================
 
 struct Manager::ManagerPimpl
@@ -307,6 +372,25 @@ struct Manager::ManagerPimpl
 
     bool parseConfiguration();
 
+    /**
+     * Load the plugins enabled by the preferences, once the accounts are registered
+     */
+    void loadPlugins();
+
+    /**
+     * Write the configuration file, replaced atomically. The preferences are emitted again
+     * only if modified since the last write.
+     */
+    void writeConfig();
+    const std::string& emitSection(Serializable& section);
+
+    /**
+     * Log the time taken by a phase of Manager::init, recorded as jami_startup_phase_seconds
+     * @return now, the start of the next phase
+     */
+    std::chrono::steady_clock::time_point startupPhase(
+        const char* phase, std::chrono::steady_clock::time_point start);
+
     /*
      * Play one tone
      * @return false if the driver is uninitialize
@@ -369,8 +453,17 @@ struct Manager::ManagerPimpl
     std::shared_ptr<asio::io_context> ioContext_;
     std::thread ioContextRunner_;
 
+    // A write of the configuration is scheduled by saveConfig()
+    std::mutex configMutex_;
+    bool configSavePending_ {false};
+    // Held while writing the configuration, with the emitted preferences
+    std::mutex configWriteMutex_;
+    std::map<const Serializable*, std::string> configSections_;
+
     /** Main scheduler */
     ScheduledExecutor scheduler_ {"manager"};
+    ScheduledExecutor workers_ {"workers",
+                               std::clamp(std::thread::hardware_concurrency(), 2u, 4u)};
 
     std::atomic_bool autoAnswer_ {false};
 
@@ -450,6 +543,17 @@ struct Manager::ManagerPimpl
 
     std::mutex gitTransportsMtx_ {};
     std::map<git_smart_subtransport*, std::unique_ptr<P2PSubTransport>> gitTransports_ {};
+
+    std::mutex sharedDhtMtx_ {};
+    std::shared_ptr<SharedDhtNode> sharedDhtNode_ {};
+
+    std::mutex metricsMtx_ {};
+    std::unique_ptr<metrics::Server> metricsServer_ {};
+
+    std::unique_ptr<NetworkMonitor> networkMonitor_ {};
+    std::mutex connectivityMtx_ {};
+    ConnectivityFilter connectivity_ {};
+    void applyConnectivityChange();
 };
 
 Manager::ManagerPimpl::ManagerPimpl(Manager& base)
@@ -480,9 +584,7 @@ Manager::ManagerPimpl::parseConfiguration()
     bool result = true;
 
     try {
-        std::ifstream file = fileutils::ifstream(path_);
-        YAML::Node parsedFile = YAML::Load(file);
-        file.close();
+        YAML::Node parsedFile = yaml_utils::loadFile(path_);
         const int error_count = base_.loadAccountMap(parsedFile);
 
         if (error_count > 0) {
@@ -497,6 +599,36 @@ Manager::ManagerPimpl::parseConfiguration()
     return result;
 }
 
+void
+Manager::ManagerPimpl::loadPlugins()
+{
+#ifdef ENABLE_PLUGIN
+    if (base_.pluginPreferences.getPluginsEnabled()) {
+        std::vector<std::string> loadedPlugins = base_.pluginPreferences.getLoadedPlugins();
+        // Their libraries are loaded when their handlers are first used, if possible
+        for (const std::string& plugin : loadedPlugins) {
+            jami_plugin_manager.loadPlugin(plugin, true);
+        }
+    }
+#endif
+}
+
+std::chrono::steady_clock::time_point
+Manager::ManagerPimpl::startupPhase(const char* phase, std::chrono::steady_clock::time_point start)
+{
+    auto now = std::chrono::steady_clock::now();
+    JAMI_DBG("Startup: %s in %.1f ms",
+             phase,
+             std::chrono::duration<double, std::milli>(now - start).count());
+    metrics::Registry::instance()
+        .histogram("jami_startup_phase_seconds",
+                   "Time taken by the phases of the start of the daemon",
+                   metrics::durationBuckets(),
+                   {{"phase", phase}})
+        .observe(now - start);
+    return now;
+}
+
 /**
  * Multi Thread
  */
@@ -752,8 +884,10 @@ Manager::init(const std::string& config_file)
 {
     // FIXME: this is no good
     initialized = true;
+    auto initStart = std::chrono::steady_clock::now();
 
     git_libgit2_init();
+    setGitCacheMaxSize();
     auto res = git_transport_register("git", p2p_transport_cb, nullptr);
     if (res < 0) {
         const git_error* error = giterr_last();
@@ -799,6 +933,23 @@ Manager::init(const std::string& config_file)
 
     setDhtLogLevel();
 
+    // Manager can restart without being recreated (Unit tests)
+    static std::once_flag memoryCollector;
+    std::call_once(memoryCollector, [] {
+        metrics::Registry::instance().addCollector(collectMemoryMetrics);
+    });
+    if (auto port = getenv("JAMI_METRICS_PORT"))
+        setMetricsPort(std::atoi(port));
+
+    // The accounts reconnect when the addresses change, without waiting for the client
+    {
+        std::lock_guard<std::mutex> lk(pimpl_->connectivityMtx_);
+        pimpl_->connectivity_ = ConnectivityFilter(NetworkState::current());
+    }
+    pimpl_->networkMonitor_ = std::make_unique<NetworkMonitor>(*pimpl_->ioContext_, [this] {
+        connectivityChanged();
+    });
+
     // Manager can restart without being recreated (Unit tests)
     // So only create the SipLink once
     pimpl_->sipLink_ = std::make_unique<SIPVoIPLink>();
@@ -816,6 +967,9 @@ Manager::init(const std::string& config_file)
 
     // manager can restart without being recreated (Unit tests)
     pimpl_->finished_ = false;
+    pimpl_->configSavePending_ = false;
+
+    auto phaseStart = pimpl_->startupPhase("libraries", initStart);
 
     try {
         no_errors = pimpl_->parseConfiguration();
@@ -829,6 +983,7 @@ Manager::init(const std::string& config_file)
     if (voipPreferences.getDisableSecureDlgCheck()) {
         pjsip_cfg()->endpt.disable_secure_dlg_check = PJ_TRUE;
     }
+    pimpl_->sipLink_->setEventThreads(voipPreferences.getSipEventThreads());
 
     // always back up last error-free configuration
     if (no_errors) {
@@ -847,6 +1002,7 @@ Manager::init(const std::string& config_file)
             JAMI_WARN("Restoring backup failed");
         }
     }
+    phaseStart = pimpl_->startupPhase("configuration", phaseStart);
 
     {
         std::lock_guard<std::mutex> lock(pimpl_->audioLayerMutex_);
@@ -856,7 +1012,13 @@ Manager::init(const std::string& config_file)
             pimpl_->dtmfKey_.reset(new DTMF(getRingBufferPool().getInternalSamplingRate()));
         }
     }
+    phaseStart = pimpl_->startupPhase("audio", phaseStart);
     registerAccounts();
+    phaseStart = pimpl_->startupPhase("accounts", phaseStart);
+    // Not needed to start the accounts: the handlers of the plugins are enabled once loaded
+    pimpl_->loadPlugins();
+    pimpl_->startupPhase("plugins", phaseStart);
+    pimpl_->startupPhase("total", initStart);
 }
 
 void
@@ -884,21 +1046,32 @@ Manager::finish() noexcept
                 removeAccount(account->getAccountID(), true);
         }
 
-        saveConfig();
+        // Now, rather than once scheduled
+        pimpl_->writeConfig();
 
         // Disconnect accounts, close link stacks and free allocated ressources
         unregisterAccounts();
         accountFactory.clear();
 
+        {
+            std::lock_guard<std::mutex> lock(pimpl_->sharedDhtMtx_);
+            if (auto node = std::move(pimpl_->sharedDhtNode_))
+                node->join();
+        }
+
         {
             std::lock_guard<std::mutex> lock(pimpl_->audioLayerMutex_);
             pimpl_->audiodriver_.reset();
         }
 
+        setMetricsPort(0);
+        pimpl_->networkMonitor_.reset();
+
         JAMI_DBG("Stopping schedulers and worker threads");
 
         // Flush remaining tasks (free lambda' with capture)
         pimpl_->scheduler_.stop();
+        pimpl_->workers_.stop();
         dht::ThreadPool::io().join();
         dht::ThreadPool::computation().join();
 
@@ -918,6 +1091,7 @@ Manager::finish() noexcept
         pj_shutdown();
         pimpl_->gitTransports_.clear();
         git_libgit2_shutdown();
+        secure::PasswordKeys::instance().clear();
 
         if (!pimpl_->ioContext_->stopped()) {
             pimpl_->ioContext_->reset(); // allow to finish
@@ -957,6 +1131,63 @@ Manager::monitor(bool continuous)
     Logger::setMonitorLog(continuous);
 }
 
+bool
+Manager::setMetricsPort(uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(pimpl_->metricsMtx_);
+    pimpl_->metricsServer_.reset();
+    if (port == 0)
+        return true;
+    try {
+        pimpl_->metricsServer_ = std::make_unique<metrics::Server>(*pimpl_->ioContext_, port);
+        return true;
+    } catch (const std::exception& e) {
+        JAMI_ERR("Unable to serve the metrics on port %u: %s", port, e.what());
+        return false;
+    }
+}
+
+void
+Manager::connectivityChanged()
+{
+    auto state = NetworkState::current();
+    std::lock_guard<std::mutex> lk(pimpl_->connectivityMtx_);
+    auto due = pimpl_->connectivity_.observe(std::move(state),
+                                             ConnectivityFilter::clock::now());
+    // Earlier tasks find it not due, if it was postponed
+    if (due)
+        scheduler().schedule([this] { pimpl_->applyConnectivityChange(); }, *due);
+}
+
+void
+Manager::ManagerPimpl::applyConnectivityChange()
+{
+    std::unique_lock<std::mutex> lk(connectivityMtx_);
+    auto change = connectivity_.apply(ConnectivityFilter::clock::now());
+    lk.unlock();
+    if (not change)
+        return;
+    JAMI_WARN("Connectivity changed: %zu address(es) added, %zu removed%s%s",
+              change->added.size(),
+              change->removed.size(),
+              change->local4Changed ? ", new IPv4 route" : "",
+              change->local6Changed ? ", new IPv6 route" : "");
+
+#if !(defined(TARGET_OS_IOS) && TARGET_OS_IOS)
+    // IGDs are only searched with IPv4
+    if (change->disrupts(pj_AF_INET())) {
+        try {
+            upnp::UPnPContext::getUPnPContext()->connectivityChanged();
+        } catch (std::runtime_error& e) {
+            JAMI_ERR("UPnP context error: %s", e.what());
+        }
+    }
+#endif
+
+    for (const auto& account : base_.getAllAccounts())
+        account->networkChanged(*change);
+}
+
 bool
 Manager::isCurrentCall(const Call& call) const
 {
@@ -1655,12 +1886,29 @@ Manager::scheduler()
     return pimpl_->scheduler_;
 }
 
+ScheduledExecutor&
+Manager::workers()
+{
+    return pimpl_->workers_;
+}
+
 std::shared_ptr<asio::io_context>
 Manager::ioContext() const
 {
     return pimpl_->ioContext_;
 }
 
+std::shared_ptr<SharedDhtNode>
+Manager::sharedDhtNode()
+{
+    std::lock_guard<std::mutex> lock(pimpl_->sharedDhtMtx_);
+    if (not preferences.getSharedDht() or pimpl_->finished_)
+        return {};
+    if (not pimpl_->sharedDhtNode_)
+        pimpl_->sharedDhtNode_ = std::make_shared<SharedDhtNode>();
+    return pimpl_->sharedDhtNode_;
+}
+
 void
 Manager::addTask(std::function<bool()>&& task, const char* filename, uint32_t linum)
 {
@@ -1707,13 +1955,53 @@ Manager::saveConfig(const std::shared_ptr<Account>& acc)
 void
 Manager::saveConfig()
 {
-    JAMI_DBG("Saving Configuration to XDG directory %s", pimpl_->path_.c_str());
+    {
+        std::lock_guard<std::mutex> lock(pimpl_->configMutex_);
+        if (pimpl_->configSavePending_)
+            return;
+        pimpl_->configSavePending_ = true;
+    }
+    pimpl_->scheduler_.scheduleIn([this] { pimpl_->writeConfig(); }, CONFIG_SAVE_DELAY);
+}
+
+const std::string&
+Manager::ManagerPimpl::emitSection(Serializable& section)
+{
+    auto& emitted = configSections_[&section];
+    if (section.isDirty() or emitted.empty()) {
+        // Before emitting, not to miss a concurrent change
+        section.setClean();
+        try {
+            YAML::Emitter out;
+            out << YAML::BeginMap;
+            section.serialize(out);
+            out << YAML::EndMap;
+            emitted = out.c_str();
+            emitted += '\n';
+        } catch (...) {
+            section.setDirty();
+            emitted.clear();
+            throw;
+        }
+    }
+    return emitted;
+}
 
-    if (pimpl_->audiodriver_) {
-        audioPreference.setVolumemic(pimpl_->audiodriver_->getCaptureGain());
-        audioPreference.setVolumespkr(pimpl_->audiodriver_->getPlaybackGain());
-        audioPreference.setCaptureMuted(pimpl_->audiodriver_->isCaptureMuted());
-        audioPreference.setPlaybackMuted(pimpl_->audiodriver_->isPlaybackMuted());
+void
+Manager::ManagerPimpl::writeConfig()
+{
+    std::lock_guard<std::mutex> writeLock(configWriteMutex_);
+    {
+        std::lock_guard<std::mutex> lock(configMutex_);
+        configSavePending_ = false;
+    }
+    JAMI_DBG("Saving Configuration to XDG directory %s", path_.c_str());
+
+    if (audiodriver_) {
+        base_.audioPreference.setVolumemic(audiodriver_->getCaptureGain());
+        base_.audioPreference.setVolumespkr(audiodriver_->getPlaybackGain());
+        base_.audioPreference.setCaptureMuted(audiodriver_->isCaptureMuted());
+        base_.audioPreference.setPlaybackMuted(audiodriver_->isPlaybackMuted());
     }
 
     try {
@@ -1723,33 +2011,46 @@ Manager::saveConfig()
         out << YAML::BeginMap << YAML::Key << "accounts";
         out << YAML::Value << YAML::BeginSeq;
 
-        for (const auto& account : accountFactory.getAllAccounts()) {
+        for (const auto& account : base_.accountFactory.getAllAccounts()) {
             if (auto ringAccount = std::dynamic_pointer_cast<JamiAccount>(account)) {
                 auto accountConfig = ringAccount->getPath() + DIR_SEPARATOR_STR + "config.yml";
                 if (not fileutils::isFile(accountConfig)) {
-                    saveConfig(ringAccount);
+                    base_.saveConfig(ringAccount);
                 }
             } else {
                 account->serialize(out);
             }
         }
-        out << YAML::EndSeq;
+        out << YAML::EndSeq << YAML::EndMap;
 
+        std::string config(out.c_str());
+        config += '\n';
         // FIXME: this is a hack until we get rid of accountOrder
-        preferences.verifyAccountOrder(getAccountList());
-        preferences.serialize(out);
-        voipPreferences.serialize(out);
-        audioPreference.serialize(out);
+        base_.preferences.verifyAccountOrder(base_.getAccountList());
+        config += emitSection(base_.preferences);
+        config += emitSection(base_.voipPreferences);
+        config += emitSection(base_.audioPreference);
 #ifdef ENABLE_VIDEO
-        videoPreferences.serialize(out);
+        config += emitSection(base_.videoPreferences);
 #endif
 #ifdef ENABLE_PLUGIN
-        pluginPreferences.serialize(out);
+        config += emitSection(base_.pluginPreferences);
 #endif
 
-        std::lock_guard<std::mutex> lock(fileutils::getFileLock(pimpl_->path_));
-        std::ofstream fout = fileutils::ofstream(pimpl_->path_);
-        fout << out.c_str();
+        std::lock_guard<std::mutex> lock(fileutils::getFileLock(path_));
+        auto tmpPath = path_ + ".tmp";
+        {
+            std::ofstream fout = fileutils::ofstream(tmpPath);
+            fout << config;
+            if (!fout)
+                throw std::runtime_error("Couldn't write " + tmpPath);
+        }
+#ifdef _WIN32
+        // rename() doesn't replace existing files
+        fileutils::remove(path_);
+#endif
+        if (std::rename(tmpPath.c_str(), path_.c_str()) != 0)
+            throw std::runtime_error("Couldn't replace " + path_);
     } catch (const YAML::Exception& e) {
         JAMI_ERR("%s", e.what());
     } catch (const std::runtime_error& e) {
@@ -2176,9 +2477,11 @@ Manager::setAudioDevice(int index, AudioDeviceType type)
 
     pimpl_->audiodriver_->updatePreference(audioPreference, index, type);
 
-    // Recreate audio driver with new settings
-    pimpl_->audiodriver_.reset();
-    pimpl_->initAudioDriver();
+    // Move the running stream if possible, recreate audio driver with new settings otherwise
+    if (not pimpl_->audiodriver_->switchDevice(type)) {
+        pimpl_->audiodriver_.reset();
+        pimpl_->initAudioDriver();
+    }
     saveConfig();
 }
 
@@ -2456,6 +2759,29 @@ Manager::setAGCState(bool state)
     audioPreference.setAGCState(state);
 }
 
+bool
+Manager::isLowLatencyAudio() const
+{
+    return audioPreference.getLowLatency();
+}
+
+void
+Manager::setLowLatencyAudio(bool enabled)
+{
+    {
+        std::lock_guard<std::mutex> lock(pimpl_->audioLayerMutex_);
+        if (enabled == audioPreference.getLowLatency())
+            return;
+        audioPreference.setLowLatency(enabled);
+        // The period of the devices is set when their streams are opened
+        if (pimpl_->audiodriver_) {
+            pimpl_->audiodriver_.reset();
+            pimpl_->initAudioDriver();
+        }
+    }
+    saveConfig();
+}
+
 /**
  * Initialization: Main Thread
  */
@@ -2761,6 +3087,10 @@ Manager::removeAccount(const std::string& accountID, bool flush)
         if (auto acc = std::dynamic_pointer_cast<JamiAccount>(remAccount)) {
             acc->hangupCalls();
             acc->shutdownConnections();
+            // Not given to another account at the same path
+            auto archivePath = acc->getArchivePath();
+            if (not archivePath.empty())
+                secure::PasswordKeys::instance().forget(archivePath);
         }
         remAccount->doUnregister();
         if (flush)
@@ -2845,10 +3175,7 @@ Manager::loadAccountMap(const YAML::Node& node)
             if (fileutils::isFile(configFile)) {
                 try {
                     if (auto a = accountFactory.createAccount(JamiAccount::ACCOUNT_TYPE, dir)) {
-                        std::ifstream file = fileutils::ifstream(configFile);
-                        YAML::Node parsedConfig = YAML::Load(file);
-                        file.close();
-                        a->unserialize(parsedConfig);
+                        a->unserialize(yaml_utils::loadFile(configFile));
                     }
                 } catch (const std::exception& e) {
                     JAMI_ERR("Can't import account %s: %s", dir.c_str(), e.what());
@@ -2861,15 +3188,6 @@ Manager::loadAccountMap(const YAML::Node& node)
     }
     cv.wait(l, [&remaining] { return remaining == 0; });
 
-#ifdef ENABLE_PLUGIN
-    if (pluginPreferences.getPluginsEnabled()) {
-        std::vector<std::string> loadedPlugins = pluginPreferences.getLoadedPlugins();
-        for (const std::string& plugin : loadedPlugins) {
-            jami::Manager::instance().getJamiPluginManager().loadPlugin(plugin);
-        }
-    }
-#endif
-
     return errorCount;
 }
 
@@ -2889,6 +3207,11 @@ Manager::registerAccounts()
 {
     auto allAccounts(getAccountList());
 
+    // The Jami accounts are started in parallel, as when loaded (see loadAccountMap).
+    // The SIP accounts stay on this thread, registered to pjlib.
+    std::condition_variable cv;
+    std::mutex lock;
+    size_t remaining {0};
     for (auto& item : allAccounts) {
         const auto a = getAccount(item);
 
@@ -2897,9 +3220,27 @@ Manager::registerAccounts()
 
         a->loadConfig();
 
-        if (a->isUsable())
+        if (not a->isUsable())
+            continue;
+        if (std::dynamic_pointer_cast<JamiAccount>(a)) {
+            std::lock_guard<std::mutex> l(lock);
+            remaining++;
+            dht::ThreadPool::computation().run([a, &cv, &remaining, &lock] {
+                try {
+                    a->doRegister();
+                } catch (const std::exception& e) {
+                    JAMI_ERR("Can't register account %s: %s", a->getAccountID().c_str(), e.what());
+                }
+                std::lock_guard<std::mutex> l(lock);
+                remaining--;
+                cv.notify_one();
+            });
+        } else {
             a->doRegister();
+        }
     }
+    std::unique_lock<std::mutex> l(lock);
+    cv.wait(l, [&remaining] { return remaining == 0; });
 }
 
 void
@@ -65,6 +65,7 @@ class Conference;
 class AudioLoop;
 class IceTransportFactory;
 class JamiAccount;
+class SharedDhtNode;
 class SIPVoIPLink;
 class JamiPluginManager;
 
@@ -131,6 +132,18 @@ public:
 
     void monitor(bool continuous);
 
+    /**
+     * Serve the metrics on the loopback interface, 0 to stop
+     * @return false if the port can't be bound
+     */
+    bool setMetricsPort(uint16_t port);
+
+    /**
+     * Look at the addresses of the host, and once their change settled, tell the accounts and
+     * the UPnP context what changed (see ConnectivityFilter)
+     */
+    void connectivityChanged();
+
     /**
      * Accessor to audiodriver.
      * it's multi-thread and use mutex internally
@@ -307,7 +320,7 @@ public:
     void removeAudio(Call& call);
 
     /**
-     * Save config to file
+     * Save config to file, shortly: the changes made in the meantime are saved at once
      */
     void saveConfig();
     void saveConfig(const std::shared_ptr<Account>& acc);
@@ -520,6 +533,12 @@ public:
     bool isAGCEnabled() const;
     void setAGCState(bool enabled);
 
+    /**
+     * Low-latency mode of the audio devices, restarting the audio layer when it changes
+     */
+    bool isLowLatencyAudio() const;
+    void setLowLatencyAudio(bool enabled);
+
     /**
      * Get is always recording functionality
      */
@@ -786,9 +805,19 @@ public:
     IceTransportFactory& getIceTransportFactory();
 
     ScheduledExecutor& scheduler();
+    /**
+     * Executor of the jobs that can run beside the main loop, in order in a Strand
+     */
+    ScheduledExecutor& workers();
 
     std::shared_ptr<asio::io_context> ioContext() const;
 
+    /**
+     * @return DHT node of the Jami accounts, null if each account runs its own
+     * (see Preferences::getSharedDht())
+     */
+    std::shared_ptr<SharedDhtNode> sharedDhtNode();
+
     void addTask(std::function<bool()>&& task,
                  const char* filename = CURRENT_FILENAME(),
                  uint32_t linum = CURRENT_LINE());
@@ -905,4 +934,18 @@ runOnMainThread(Callback&& cb,
                                         linum);
 }
 
+// Same, before or after the other callbacks depending on priority
+template<typename Callback>
+static void
+runOnMainThread(Callback&& cb,
+                ScheduledExecutor::Priority priority,
+                const char* filename = CURRENT_FILENAME(),
+                uint32_t linum = CURRENT_LINE())
+{
+    Manager::instance().scheduler().run([cb = std::forward<Callback>(cb)]() mutable { cb(); },
+                                        priority,
+                                        filename,
+                                        linum);
+}
+
 } // namespace jami
@@ -30,6 +30,7 @@
 #include "audio/ringbuffer.h"
 #include "audio/audioloop.h"
 #include "libav_utils.h"
+#include "threadloop.h"
 
 #include <fmt/core.h>
 
@@ -39,6 +40,9 @@
 
 namespace jami {
 
+// Of the playback, when switching devices
+static constexpr std::chrono::milliseconds CROSSFADE_DURATION {100};
+
 AlsaLayer::AlsaLayer(const AudioPreference& pref)
     : AudioLayer(pref)
     , indexIn_(pref.getAlsaCardin())
@@ -68,12 +72,15 @@ AlsaLayer::~AlsaLayer()
 void
 AlsaLayer::run()
 {
+    setCurrentThreadRole(ThreadRole::AUDIO_IO, "jami:alsa");
     if (playbackHandle_)
         playbackChanged(true);
     if (captureHandle_)
         recordChanged(true);
 
     while (status_ == Status::Started and running_) {
+        if (hasNextDevice_)
+            takeNextDevices();
         playback();
         ringtone();
         capture();
@@ -243,6 +250,14 @@ AlsaLayer::closeCaptureStream()
     if (is_capture_prepared_ and is_capture_running_)
         stopCaptureStream();
 
+    {
+        std::lock_guard<std::mutex> lk(switchMutex_);
+        if (nextCaptureHandle_) {
+            snd_pcm_close(nextCaptureHandle_);
+            nextCaptureHandle_ = nullptr;
+        }
+    }
+
     JAMI_DBG("Alsa: Closing capture stream");
     if (is_capture_open_
         && ALSA_CALL(snd_pcm_close(captureHandle_), "Couldn't close capture") >= 0) {
@@ -275,6 +290,15 @@ AlsaLayer::closePlaybackStream()
     if (is_playback_running_)
         stopPlaybackStream();
 
+    closeFadingStream();
+    {
+        std::lock_guard<std::mutex> lk(switchMutex_);
+        if (nextPlaybackHandle_) {
+            snd_pcm_close(nextPlaybackHandle_);
+            nextPlaybackHandle_ = nullptr;
+        }
+    }
+
     if (is_playback_open_) {
         JAMI_DBG("Alsa: Closing playback stream");
         if (ALSA_CALL(snd_pcm_close(playbackHandle_), "Coulnd't close playback") >= 0)
@@ -293,6 +317,124 @@ AlsaLayer::closeRingtoneStream()
     }
 }
 
+void
+AlsaLayer::closeFadingStream()
+{
+    if (fadingPlaybackHandle_) {
+        ALSA_CALL(snd_pcm_drop(fadingPlaybackHandle_), "Couldn't stop previous playback");
+        ALSA_CALL(snd_pcm_close(fadingPlaybackHandle_), "Couldn't close previous playback");
+        fadingPlaybackHandle_ = nullptr;
+    }
+}
+
+bool
+AlsaLayer::switchDevice(AudioDeviceType type)
+{
+    if (type == AudioDeviceType::RINGTONE)
+        return false;
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    bool dsnop = audioPlugin_ == PCM_DMIX_DSNOOP;
+    snd_pcm_t* handle = nullptr;
+    if (type == AudioDeviceType::PLAYBACK) {
+        indexOut_ = pref_.getAlsaCardout();
+        if (not is_playback_open_ or status_ != Status::Started)
+            return true; // Opened on the new device by startStream
+        auto format = audioFormat_;
+        if (not openDevice(&handle,
+                           buildDeviceTopo(dsnop ? PCM_DMIX : audioPlugin_, indexOut_),
+                           SND_PCM_STREAM_PLAYBACK,
+                           format))
+            return false;
+        // The buffers and the audio processor follow the format of the device
+        if (format != audioFormat_) {
+            snd_pcm_close(handle);
+            return false;
+        }
+        std::lock_guard<std::mutex> lkSwitch(switchMutex_);
+        if (nextPlaybackHandle_)
+            snd_pcm_close(nextPlaybackHandle_);
+        nextPlaybackHandle_ = handle;
+    } else {
+        indexIn_ = pref_.getAlsaCardin();
+        if (not is_capture_open_ or status_ != Status::Started)
+            return true;
+        auto format = audioInputFormat_;
+        if (not openDevice(&handle,
+                           buildDeviceTopo(dsnop ? PCM_DSNOOP : audioPlugin_, indexIn_),
+                           SND_PCM_STREAM_CAPTURE,
+                           format))
+            return false;
+        if (format != audioInputFormat_) {
+            snd_pcm_close(handle);
+            return false;
+        }
+        std::lock_guard<std::mutex> lkSwitch(switchMutex_);
+        if (nextCaptureHandle_)
+            snd_pcm_close(nextCaptureHandle_);
+        nextCaptureHandle_ = handle;
+    }
+    hasNextDevice_ = true;
+    return true;
+}
+
+void
+AlsaLayer::takeNextDevices()
+{
+    std::lock_guard<std::mutex> lk(switchMutex_);
+    hasNextDevice_ = false;
+    if (nextPlaybackHandle_) {
+        JAMI_DBG("Alsa: Switching playback device");
+        closeFadingStream();
+        fadingPlaybackHandle_ = std::exchange(playbackHandle_, nextPlaybackHandle_);
+        nextPlaybackHandle_ = nullptr;
+        crossfadePos_ = 0;
+        crossfadeFrames_ = audioFormat_.sample_rate * CROSSFADE_DURATION.count() / 1000;
+    }
+    if (nextCaptureHandle_) {
+        JAMI_DBG("Alsa: Switching capture device");
+        if (is_capture_running_)
+            stopCaptureStream();
+        if (captureHandle_)
+            ALSA_CALL(snd_pcm_close(captureHandle_), "Couldn't close capture");
+        captureHandle_ = std::exchange(nextCaptureHandle_, nullptr);
+        is_capture_prepared_ = false;
+        prepareCaptureStream();
+        startCaptureStream();
+    }
+}
+
+void
+AlsaLayer::crossfade(const AudioFrame& frame)
+{
+    const auto frames = frame.pointer()->nb_samples;
+    const auto channels = audioFormat_.nb_channels;
+    AudioFrame fadeIn(audioFormat_, frames);
+    AudioFrame fadeOut(audioFormat_, frames);
+    auto src = reinterpret_cast<const AudioSample*>(frame.pointer()->data[0]);
+    auto in = reinterpret_cast<AudioSample*>(fadeIn.pointer()->data[0]);
+    auto out = reinterpret_cast<AudioSample*>(fadeOut.pointer()->data[0]);
+    for (int i = 0; i < frames; i++) {
+        auto gain = std::min(1.f, (float) (crossfadePos_ + i) / crossfadeFrames_);
+        for (unsigned c = 0; c < channels; c++, src++) {
+            *in++ = *src * gain;
+            *out++ = *src * (1.f - gain);
+        }
+    }
+    write(fadeIn, playbackHandle_);
+
+    // Without blocking the new device
+    auto available = snd_pcm_avail_update(fadingPlaybackHandle_);
+    if (available >= frames)
+        write(fadeOut, fadingPlaybackHandle_);
+    else if (available < 0)
+        crossfadePos_ = crossfadeFrames_;
+
+    crossfadePos_ += frames;
+    if (crossfadePos_ >= crossfadeFrames_)
+        closeFadingStream();
+}
+
 void
 AlsaLayer::startPlaybackStream()
 {
@@ -351,6 +493,12 @@ AlsaLayer::alsa_set_params(snd_pcm_t* pcm_handle, AudioFormat& format)
     snd_pcm_hw_params_get_buffer_size_max(hwparams, &buffer_size_max);
     snd_pcm_hw_params_get_period_size_min(hwparams, &period_size_min, nullptr);
     snd_pcm_hw_params_get_period_size_max(hwparams, &period_size_max, nullptr);
+    if (auto lowLatencyPeriod = devicePeriodFrames(format.sample_rate)) {
+        // Two periods: one played while the next one is written
+        period_size = lowLatencyPeriod;
+        periods = 2;
+        buffer_size = period_size * periods;
+    }
     JAMI_DBG("Buffer size range from %lu to %lu", buffer_size_min, buffer_size_max);
     JAMI_DBG("Period size range from %lu to %lu", period_size_min, period_size_max);
     buffer_size = buffer_size > buffer_size_max ? buffer_size_max : buffer_size;
@@ -389,7 +537,8 @@ AlsaLayer::alsa_set_params(snd_pcm_t* pcm_handle, AudioFormat& format)
 
 #define SW pcm_handle, swparams /* software parameters */
     snd_pcm_sw_params_current(SW);
-    TRY(snd_pcm_sw_params_set_start_threshold(SW, period_size * 2), "start threshold");
+    TRY(snd_pcm_sw_params_set_start_threshold(SW, std::min(period_size * 2, buffer_size)),
+        "start threshold");
     TRY(snd_pcm_sw_params(SW), "sw parameters");
 #undef SW
 
@@ -675,6 +824,9 @@ AlsaLayer::capture()
 
     const int framesPerBufferAlsa = 2048;
     toGetFrames = std::min(framesPerBufferAlsa, toGetFrames);
+    snd_pcm_sframes_t delay = 0;
+    if (snd_pcm_delay(captureHandle_, &delay) == 0)
+        setCaptureLatency(framesDuration(delay, audioInputFormat_.sample_rate));
     if (auto r = read(toGetFrames)) {
         putRecorded(std::move(r));
     } else
@@ -694,7 +846,13 @@ AlsaLayer::playback()
         return;
 
     if (auto toPlay = getToPlay(audioFormat_, maxFrames)) {
-        write(*toPlay, playbackHandle_);
+        if (fadingPlaybackHandle_)
+            crossfade(*toPlay);
+        else
+            write(*toPlay, playbackHandle_);
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(playbackHandle_, &delay) == 0)
+            setPlaybackLatency(framesDuration(delay, audioFormat_.sample_rate));
     }
 }
 
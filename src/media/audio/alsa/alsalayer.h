@@ -210,6 +210,11 @@ private:
     std::unique_ptr<AudioFrame> read(unsigned frames);
 
     virtual void updatePreference(AudioPreference& pref, int index, AudioDeviceType type);
+    /**
+     * Open the new device while the current one keeps running, the audio thread
+     * then swaps them, crossfading the playback
+     */
+    virtual bool switchDevice(AudioDeviceType type);
 
     /**
      * Handles to manipulate playback stream
@@ -246,6 +251,24 @@ private:
 
     std::atomic_bool running_ {false};
     std::thread audioThread_;
+
+    /**
+     * Devices opened by switchDevice(), taken by the audio thread
+     */
+    std::mutex switchMutex_;
+    std::atomic_bool hasNextDevice_ {false};
+    snd_pcm_t* nextPlaybackHandle_ {nullptr};
+    snd_pcm_t* nextCaptureHandle_ {nullptr};
+    void takeNextDevices();
+
+    /**
+     * Previous playback device, faded out while the new one is faded in
+     */
+    snd_pcm_t* fadingPlaybackHandle_ {nullptr};
+    unsigned crossfadePos_ {0};
+    unsigned crossfadeFrames_ {0};
+    void crossfade(const AudioFrame& frame);
+    void closeFadingStream();
 };
 
 } // namespace jami
@@ -91,8 +91,8 @@ protected:
     AudioFrameResizer playbackQueue_;
     AudioFrameResizer recordQueue_;
     std::unique_ptr<Resampler> resampler_;
-    std::atomic_bool playbackStarted_;
-    std::atomic_bool recordStarted_;
+    std::atomic_bool playbackStarted_ {false};
+    std::atomic_bool recordStarted_ {false};
     AudioFormat format_;
     unsigned int frameSize_;
     unsigned int frameDurationMs_;
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "dsp_stage.h"
+#include "metrics.h"
+
+namespace jami {
+
+// Longest wait of a frame pushed while the thread was about to sleep: pushing doesn't lock, so
+// the notification can be missed
+static constexpr std::chrono::milliseconds MAX_WAKEUP {5};
+// Averaging of the latency over about 16 frames
+static constexpr int64_t SMOOTHING {16};
+
+static metrics::Histogram&
+latencyHistogram()
+{
+    static auto& histogram = metrics::Registry::instance().histogram(
+        "jami_audio_processing_latency_seconds",
+        "Time of the captured frames in the audio processing stage",
+        {.0005, .001, .0025, .005, .01, .02, .05, .1});
+    return histogram;
+}
+
+static metrics::Counter&
+droppedCounter()
+{
+    static auto& counter = metrics::Registry::instance().counter(
+        "jami_audio_processing_dropped_frames_total",
+        "Frames dropped by the audio processing stage, its thread being late");
+    return counter;
+}
+
+DspStage::DspStage(std::unique_ptr<AudioProcessor>&& processor, Output&& output)
+    : processor_(std::move(processor))
+    , output_(std::move(output))
+    , loop_([] { return true; }, [this] { process(); }, [] {}, ThreadRole::AUDIO, "jami:dsp")
+{
+    loop_.start();
+}
+
+DspStage::~DspStage()
+{
+    loop_.join();
+}
+
+bool
+DspStage::putRecorded(std::shared_ptr<AudioFrame>&& frame)
+{
+    if (!recorded_.push({std::move(frame), clock::now()})) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        droppedCounter().add();
+        return false;
+    }
+    loop_.interrupt();
+    return true;
+}
+
+bool
+DspStage::putPlayback(const std::shared_ptr<AudioFrame>& frame)
+{
+    auto copy = frame;
+    if (!playback_.push(std::move(copy)))
+        return false;
+    loop_.interrupt();
+    return true;
+}
+
+void
+DspStage::configure(const std::function<void(AudioProcessor&)>& cb)
+{
+    std::lock_guard<std::mutex> lock(processorMutex_);
+    cb(*processor_);
+}
+
+void
+DspStage::process()
+{
+    loop_.wait_for(MAX_WAKEUP, [this] { return !recorded_.empty() || !playback_.empty(); });
+
+    std::lock_guard<std::mutex> lock(processorMutex_);
+    // The echo first, so that it is there when processing the capture
+    while (auto frame = playback_.pop())
+        processor_->putPlayback(*frame);
+
+    while (auto recorded = recorded_.pop()) {
+        processor_->putRecorded(std::move(recorded->frame));
+        while (auto processed = processor_->getProcessed()) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now()
+                                                                                 - recorded->time);
+            auto average = latency_.load(std::memory_order_relaxed);
+            latency_.store(average + (elapsed.count() - average) / SMOOTHING,
+                           std::memory_order_relaxed);
+            latencyHistogram().observe(elapsed);
+            output_(std::move(processed));
+        }
+    }
+}
+
+} // namespace jami
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "audio_processor.h"
+#include "media_buffer.h"
+#include "noncopyable.h"
+#include "spsc_queue.h"
+#include "threadloop.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace jami {
+
+/**
+ * Runs an AudioProcessor (echo cancellation, noise suppression, AGC...) on its own thread.
+ *
+ * The capture and playback callbacks of the audio devices only push their frames to wait-free
+ * queues, instead of processing them synchronously: heavy processing no longer makes the
+ * devices overrun. The processed frames are passed to the output from the processing thread.
+ *
+ * The queues hold QUEUE_FRAMES frames each, frames pushed to a full queue are dropped: the
+ * added latency is bounded by the duration of the queued frames and the wake-up of the thread.
+ */
+class DspStage
+{
+public:
+    using Output = std::function<void(std::shared_ptr<AudioFrame>&&)>;
+
+    static constexpr size_t QUEUE_FRAMES {8};
+
+    DspStage(std::unique_ptr<AudioProcessor>&& processor, Output&& output);
+    ~DspStage();
+
+    /**
+     * From the capture thread.
+     * @return false if the frame was dropped, the processing thread being too late
+     */
+    bool putRecorded(std::shared_ptr<AudioFrame>&& frame);
+
+    /**
+     * From the playback thread, the frames played being the echo to cancel
+     */
+    bool putPlayback(const std::shared_ptr<AudioFrame>& frame);
+
+    /**
+     * Call @cb with the processor, synchronized with the processing thread (e.g. to enable echo
+     * cancellation). Not from the audio callbacks.
+     */
+    void configure(const std::function<void(AudioProcessor&)>& cb);
+
+    /**
+     * Time between a captured frame being pushed and the processed frame it completed being
+     * output, averaged over the recent frames
+     */
+    std::chrono::microseconds latency() const
+    {
+        return std::chrono::microseconds(latency_.load(std::memory_order_relaxed));
+    }
+
+    /**
+     * Captured frames dropped since the start
+     */
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    NON_COPYABLE(DspStage);
+
+    using clock = std::chrono::steady_clock;
+
+    struct Recorded
+    {
+        std::shared_ptr<AudioFrame> frame;
+        clock::time_point time;
+    };
+
+    void process();
+
+    std::mutex processorMutex_;
+    const std::unique_ptr<AudioProcessor> processor_;
+    const Output output_;
+
+    SpscQueue<Recorded> recorded_ {QUEUE_FRAMES};
+    SpscQueue<std::shared_ptr<AudioFrame>> playback_ {QUEUE_FRAMES};
+
+    std::atomic<int64_t> latency_ {0};
+    std::atomic<uint64_t> dropped_ {0};
+
+    InterruptedThreadLoop loop_;
+};
+
+} // namespace jami
@@ -21,12 +21,14 @@
 #include "audio_frame_resizer.h"
 #include "libav_deps.h"
 #include "logger.h"
+#include "tracepoint.h"
 
 extern "C" {
 #include <libavutil/audio_fifo.h>
 }
 
 #include <stdexcept>
+#include <vector>
 
 namespace jami {
 
@@ -47,7 +49,7 @@ AudioFrameResizer::~AudioFrameResizer()
 int
 AudioFrameResizer::samples() const
 {
-    return av_audio_fifo_size(queue_);
+    return av_audio_fifo_size(queue_) + chunkSamples_ - chunkOffset_;
 }
 
 int
@@ -70,6 +72,9 @@ AudioFrameResizer::setFormat(const AudioFormat& format, int size)
     if (format != format_) {
         if (auto discarded = samples())
             JAMI_WARN("Discarding %d samples", discarded);
+        chunks_.clear();
+        chunkOffset_ = 0;
+        chunkSamples_ = 0;
         av_audio_fifo_free(queue_);
         format_ = format;
         queue_ = av_audio_fifo_alloc(format.sampleFormat, format.nb_channels, frameSize_);
@@ -80,6 +85,8 @@ void
 AudioFrameResizer::setFrameSize(int frameSize)
 {
     if (frameSize_ != frameSize) {
+        // Chunks may no longer be split in whole frames
+        flushChunks();
         frameSize_ = frameSize;
         if (cb_)
             while (auto frame = dequeue())
@@ -109,21 +116,109 @@ AudioFrameResizer::enqueue(std::shared_ptr<AudioFrame>&& frame)
         return; // return if frame was just passed through
     }
 
-    // voice activity
-    hasVoice_ = frame->has_voice;
-
-    // queue reallocates itself if need be
-    if ((ret = av_audio_fifo_write(queue_, reinterpret_cast<void**>(f->data), f->nb_samples)) < 0) {
-        JAMI_ERR() << "Audio resizer error: " << libav_utils::getError(ret);
-        throw std::runtime_error("Failed to add audio to frame resizer");
-    }
-
     if (nextOutputPts_ == 0)
         nextOutputPts_ = frame->pointer()->pts - nb_samples;
 
+    // Split without copy if aligned. Views of a frame held elsewhere could see it change.
+    if (av_audio_fifo_size(queue_) == 0 && frameSize_ > 0 && f->nb_samples > 0
+        && f->nb_samples % frameSize_ == 0 && frame.use_count() == 1) {
+        chunkSamples_ += f->nb_samples;
+        chunks_.emplace_back(std::move(frame));
+    } else {
+        flushChunks();
+
+        // voice activity
+        hasVoice_ = frame->has_voice;
+
+        // queue reallocates itself if need be
+        if ((ret = av_audio_fifo_write(queue_, reinterpret_cast<void**>(f->data), f->nb_samples))
+            < 0) {
+            JAMI_ERR() << "Audio resizer error: " << libav_utils::getError(ret);
+            throw std::runtime_error("Failed to add audio to frame resizer");
+        }
+    }
+
+    // Linked to the frame completing them
     if (cb_)
-        while (auto frame = dequeue())
+        while (auto frame = dequeue()) {
+            jami_tracepoint(media_frame_link, f, frame->pointer());
             cb_(std::move(frame));
+        }
+}
+
+static int
+planeCount(const AVFrame* f)
+{
+    return av_sample_fmt_is_planar((AVSampleFormat) f->format) ? f->channels : 1;
+}
+
+/**
+ * Offset in bytes of sample @samples in each plane of @f
+ */
+static int
+planeOffset(const AVFrame* f, int samples)
+{
+    return av_get_bytes_per_sample((AVSampleFormat) f->format) * samples * f->channels
+           / planeCount(f);
+}
+
+void
+AudioFrameResizer::flushChunks()
+{
+    for (auto& chunk : chunks_) {
+        auto f = chunk->pointer();
+        auto offset = planeOffset(f, chunkOffset_);
+        std::vector<uint8_t*> planes(f->extended_data, f->extended_data + planeCount(f));
+        for (auto& plane : planes)
+            plane += offset;
+        int ret = av_audio_fifo_write(queue_,
+                                      reinterpret_cast<void**>(planes.data()),
+                                      f->nb_samples - chunkOffset_);
+        if (ret < 0) {
+            JAMI_ERR() << "Audio resizer error: " << libav_utils::getError(ret);
+            throw std::runtime_error("Failed to add audio to frame resizer");
+        }
+        hasVoice_ = chunk->has_voice;
+        chunkOffset_ = 0;
+    }
+    chunks_.clear();
+    chunkSamples_ = 0;
+}
+
+std::shared_ptr<AudioFrame>
+AudioFrameResizer::dequeueChunk()
+{
+    auto chunk = chunks_.front();
+    auto f = chunk->pointer();
+    std::shared_ptr<AudioFrame> frame;
+    if (f->nb_samples == frameSize_) {
+        frame = chunk;
+    } else {
+        frame = std::make_shared<AudioFrame>();
+        auto view = frame->pointer();
+        int ret;
+        if ((ret = av_frame_ref(view, f)) < 0) {
+            JAMI_ERR() << "Could not reference queued frame: " << libav_utils::getError(ret);
+            return {};
+        }
+        auto offset = planeOffset(f, chunkOffset_);
+        for (int p = 0; p < planeCount(f); ++p) {
+            view->extended_data[p] += offset;
+            // Distinct arrays above AV_NUM_DATA_POINTERS channels
+            if (p < AV_NUM_DATA_POINTERS && view->data != view->extended_data)
+                view->data[p] = view->extended_data[p];
+        }
+        view->nb_samples = frameSize_;
+        frame->has_voice = chunk->has_voice;
+    }
+
+    chunkOffset_ += frameSize_;
+    if (chunkOffset_ == f->nb_samples) {
+        chunks_.pop_front();
+        chunkSamples_ -= chunkOffset_;
+        chunkOffset_ = 0;
+    }
+    return frame;
 }
 
 std::shared_ptr<AudioFrame>
@@ -132,6 +227,15 @@ AudioFrameResizer::dequeue()
     if (samples() < frameSize_)
         return {};
 
+    if (!chunks_.empty() && av_audio_fifo_size(queue_) == 0) {
+        auto frame = dequeueChunk();
+        if (frame) {
+            frame->pointer()->pts = nextOutputPts_;
+            nextOutputPts_ += frameSize_;
+        }
+        return frame;
+    }
+
     auto frame = std::make_shared<AudioFrame>(format_, frameSize_);
     int ret;
     if ((ret = av_audio_fifo_read(queue_,
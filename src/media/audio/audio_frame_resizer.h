@@ -24,6 +24,7 @@
 #include "media_buffer.h"
 #include "noncopyable.h"
 
+#include <deque>
 #include <mutex>
 
 extern "C" {
@@ -38,6 +39,10 @@ namespace jami {
  * samples until a frame can be read. Will call passed in callback once a frame is output.
  *
  * Works at frame-level instead of sample- or byte-level like FFmpeg's FIFO buffers.
+ *
+ * Input frames holding a whole number of output frames (e.g. 20 ms split into 10 ms) are not
+ * copied when nothing else is queued and no one else holds them: output frames are views
+ * referencing their samples.
  */
 class AudioFrameResizer
 {
@@ -78,12 +83,26 @@ public:
 
     /**
      * Notifies owner of a new frame.
+     *
+     * NOTE the frame may reference the samples of an enqueued frame, it must not be written to
+     * unless av_frame_is_writable.
      */
     std::shared_ptr<AudioFrame> dequeue();
 
 private:
     NON_COPYABLE(AudioFrameResizer);
 
+    /**
+     * Moves the samples of @chunks_ to @queue_, e.g. before enqueuing a frame that can't be
+     * split without copy.
+     */
+    void flushChunks();
+
+    /**
+     * Output frame @chunkOffset_ samples into the first chunk.
+     */
+    std::shared_ptr<AudioFrame> dequeueChunk();
+
     /**
      * Format used for input and output audio frames.
      */
@@ -103,6 +122,15 @@ private:
      * Audio queue operating on the sample level instead of byte level.
      */
     AVAudioFifo* queue_;
+
+    /**
+     * Frames of a whole number of output frames, queued after @queue_ (only if it is empty).
+     * Output frames are views into them.
+     */
+    std::deque<std::shared_ptr<AudioFrame>> chunks_;
+    int chunkOffset_ {0};
+    int chunkSamples_ {0};
+
     int64_t nextOutputPts_ {0};
     bool hasVoice_ {false};
 };
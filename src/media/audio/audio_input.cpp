@@ -25,7 +25,7 @@
 #include "fileutils.h" // access
 #include "manager.h"
 #include "media_decoder.h"
-#include "resampler.h"
+#include "drift_compensator.h"
 #include "ringbuffer.h"
 #include "ringbufferpool.h"
 #include "smartools.h"
@@ -42,7 +42,7 @@ AudioInput::AudioInput(const std::string& id)
     : id_(id)
     , format_(Manager::instance().getRingBufferPool().getInternalAudioFormat())
     , frameSize_(format_.sample_rate * MS_PER_PACKET.count() / 1000)
-    , resampler_(new Resampler)
+    , drift_(new DriftCompensator)
     , resizer_(new AudioFrameResizer(format_,
                                      frameSize_,
                                      [this](std::shared_ptr<AudioFrame>&& f) {
@@ -50,7 +50,7 @@ AudioInput::AudioInput(const std::string& id)
                                      }))
     , fileId_(id + "_file")
     , deviceGuard_()
-    , loop_([] { return true; }, [this] { process(); }, [] {})
+    , loop_([this] { return process(); }, ThreadRole::AUDIO)
 {
     JAMI_DBG() << "Creating audio input with id: " << id;
 }
@@ -69,10 +69,11 @@ AudioInput::~AudioInput()
     loop_.join();
 }
 
-void
+MediaLoop::clock::time_point
 AudioInput::process()
 {
     readFromDevice();
+    return wakeUp_;
 }
 
 void
@@ -110,6 +111,7 @@ AudioInput::readFromDevice()
             while (fileBuf_->isEmpty())
                 readFromFile();
         if (playingFile_) {
+            wakeUp_ = MediaLoop::clock::now();
             readFromQueue();
             return;
         }
@@ -119,14 +121,24 @@ AudioInput::readFromDevice()
     // want to have a loop which takes 100% of the CPU.
     // Here, we basically want to mix available data without any glitch
     // and even if one buffer doesn't have audio data (call in hold,
-    // connections issues, etc). So mix every MS_PER_PACKET
-    std::this_thread::sleep_until(wakeUp_);
-    wakeUp_ += MS_PER_PACKET;
-
+    // connections issues, etc). So mix every frame of the ring buffers
+    // (MS_PER_PACKET, or the period of a low-latency device)
+    // The loop runs it again at wakeUp_
     auto& bufferPool = Manager::instance().getRingBufferPool();
-    auto audioFrame = bufferPool.getData(id_);
-    if (not audioFrame)
+    // Shortened when frames accumulate, i.e. when the device is faster than our clock
+    const auto period = std::chrono::duration<double, std::micro>(bufferPool.getFrameDuration());
+    wakeUp_ += std::chrono::duration_cast<std::chrono::microseconds>(
+        period * (1 + drift_->correction() * 1e-6));
+
+    if (not bufferPool.isValid(binding_)) {
+        binding_ = bufferPool.getBindingHandle(id_);
+        drift_->reset();
+    }
+    auto audioFrame = bufferPool.getData(binding_);
+    if (not audioFrame) {
+        drift_->underrun();
         return;
+    }
 
     if (muteState_) {
         libav_utils::fillWithSilence(audioFrame->pointer());
@@ -134,8 +146,9 @@ AudioInput::readFromDevice()
     }
 
     std::lock_guard<std::mutex> lk(fmtMutex_);
-    if (bufferPool.getInternalAudioFormat() != format_)
-        audioFrame = resampler_->resample(std::move(audioFrame), format_);
+    audioFrame = drift_->resample(std::move(audioFrame),
+                                  format_,
+                                  bufferPool.availableForGet(binding_));
     resizer_->enqueue(std::move(audioFrame));
 
     jami_tracepoint(audio_input_read_from_device_end, id_.c_str());
@@ -147,7 +160,7 @@ AudioInput::readFromQueue()
     if (!decoder_)
         return;
     if (paused_) {
-        std::this_thread::sleep_for(MS_PER_PACKET);
+        wakeUp_ += MS_PER_PACKET;
         return;
     }
     decoder_->emitFrame(true);
@@ -233,6 +246,10 @@ AudioInput::flushBuffers()
     if (decoder_) {
         decoder_->flushBuffers();
     }
+    // Not to play the audio decoded before a seek
+    if (fileBuf_) {
+        fileBuf_->flushAll();
+    }
 }
 
 bool
@@ -313,9 +330,9 @@ AudioInput::switchInput(const std::string& resource)
     }
 
     futureDevOpts_ = foundDevOpts_.get_future().share();
-    wakeUp_ = std::chrono::high_resolution_clock::now() + MS_PER_PACKET;
+    wakeUp_ = MediaLoop::clock::now() + MS_PER_PACKET;
     lk.unlock();
-    loop_.start();
+    loop_.start(wakeUp_);
     if (onSuccessfulSetup_)
         onSuccessfulSetup_(MEDIA_AUDIO, 0);
     return futureDevOpts_;
@@ -27,10 +27,11 @@
 #include <chrono>
 
 #include "audio/audiobuffer.h"
+#include "audio/ringbufferpool.h"
 #include "media_device.h"
 #include "media_buffer.h"
 #include "observer.h"
-#include "threadloop.h"
+#include "media_executor.h"
 #include "media_codec.h"
 
 namespace jami {
@@ -41,6 +42,7 @@ class MediaDecoder;
 class MediaRecorder;
 struct MediaStream;
 class Resampler;
+class DriftCompensator;
 class RingBuffer;
 
 class AudioInput : public Observable<std::shared_ptr<MediaFrame>>
@@ -81,6 +83,7 @@ private:
     void frameResized(std::shared_ptr<AudioFrame>&& ptr);
 
     std::string id_;
+    RingBufferPool::BindingHandle binding_ {RingBufferPool::INVALID_BINDING};
     bool muteState_ = false;
     uint64_t sent_samples = 0;
     mutable std::mutex fmtMutex_ {};
@@ -88,7 +91,8 @@ private:
     int frameSize_;
     std::atomic_bool paused_ {true};
 
-    std::unique_ptr<Resampler> resampler_;
+    // Resampling following the clock of the capture device
+    std::unique_ptr<DriftCompensator> drift_;
     std::unique_ptr<AudioFrameResizer> resizer_;
     std::unique_ptr<MediaDecoder> decoder_;
 
@@ -108,10 +112,10 @@ private:
     std::atomic_bool playingFile_ {false};
     std::unique_ptr<AudioDeviceGuard> deviceGuard_;
 
-    ThreadLoop loop_;
-    void process();
+    MediaLoop loop_;
+    MediaLoop::clock::time_point process();
 
-    std::chrono::time_point<std::chrono::high_resolution_clock> wakeUp_;
+    MediaLoop::clock::time_point wakeUp_;
 
     std::function<void(MediaType, bool)> onSuccessfulSetup_;
 };
@@ -0,0 +1,527 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#include "audio_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// Selected at runtime, the baseline being SSE2 when the compiler targets it
+#define AUDIO_KERNELS_AVX2 1
+#if defined(__SSE2__)
+#define AUDIO_KERNELS_SSE2 1
+#endif
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIO_KERNELS_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AUDIO_KERNELS_NEON 1
+#endif
+
+namespace jami {
+namespace audio_kernels {
+
+static inline int16_t
+saturate16(int32_t v)
+{
+    return std::clamp(v,
+                      (int32_t) std::numeric_limits<int16_t>::min(),
+                      (int32_t) std::numeric_limits<int16_t>::max());
+}
+
+/**
+ * Gain as a Q15 factor. -32768 is excluded so that the product always fits
+ * 16 bits after the shift, which lets every implementation skip saturation.
+ */
+static inline int16_t
+gainToQ15(double gain)
+{
+    return std::clamp<long>(std::lround(gain * 32768.), -32767, 32767);
+}
+
+/**
+ * The kernels of an instruction set. The vectorized ones process whole vectors,
+ * and leave the rest to the scalar ones, whose results they give bit for bit.
+ */
+struct Kernels
+{
+    const char* name;
+    void (*mixS16)(int16_t* dst, const int16_t* src, size_t n);
+    void (*mixFloat)(float* dst, const float* src, size_t n);
+    void (*applyGainS16)(int16_t* data, size_t n, int16_t q);
+    void (*applyGainFloat)(float* data, size_t n, float gain);
+    void (*interleaveStereoS16)(const int16_t* l, const int16_t* r, size_t frames, int16_t* out);
+    void (*deinterleaveStereoS16)(const int16_t* in, size_t frames, int16_t* l, int16_t* r);
+    int32_t (*dotS16)(const int16_t* a, const int16_t* b, size_t n);
+};
+
+//
+// Scalar
+//
+
+static void
+mixS16Scalar(int16_t* dst, const int16_t* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = saturate16((int32_t) dst[i] + (int32_t) src[i]);
+}
+
+static void
+mixFloatScalar(float* dst, const float* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] += src[i];
+}
+
+static void
+applyGainS16Scalar(int16_t* data, size_t n, int16_t q)
+{
+    for (size_t i = 0; i < n; ++i)
+        data[i] = ((int32_t) data[i] * q) >> 15;
+}
+
+static void
+applyGainFloatScalar(float* data, size_t n, float gain)
+{
+    for (size_t i = 0; i < n; ++i)
+        data[i] *= gain;
+}
+
+static void
+interleaveStereoS16Scalar(const int16_t* l, const int16_t* r, size_t frames, int16_t* out)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        out[2 * i] = l[i];
+        out[2 * i + 1] = r[i];
+    }
+}
+
+static void
+deinterleaveStereoS16Scalar(const int16_t* in, size_t frames, int16_t* l, int16_t* r)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        l[i] = in[2 * i];
+        r[i] = in[2 * i + 1];
+    }
+}
+
+static int32_t
+dotS16Scalar(const int16_t* a, const int16_t* b, size_t n)
+{
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += (int32_t) a[i] * (int32_t) b[i];
+    return sum;
+}
+
+static const Kernels SCALAR {"scalar",
+                             mixS16Scalar,
+                             mixFloatScalar,
+                             applyGainS16Scalar,
+                             applyGainFloatScalar,
+                             interleaveStereoS16Scalar,
+                             deinterleaveStereoS16Scalar,
+                             dotS16Scalar};
+
+//
+// SSE2 or NEON, when targeted by the compiler
+//
+
+#if defined(AUDIO_KERNELS_SSE2)
+
+static void
+mixS16Sse2(int16_t* dst, const int16_t* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epi16(a, b));
+    }
+    mixS16Scalar(dst + i, src + i, n - i);
+}
+
+static void
+mixFloatSse2(float* dst, const float* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+    mixFloatScalar(dst + i, src + i, n - i);
+}
+
+static void
+applyGainS16Sse2(int16_t* data, size_t n, int16_t q)
+{
+    const auto qv = _mm_set1_epi16(q);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        auto lo = _mm_mullo_epi16(a, qv);
+        auto hi = _mm_mulhi_epi16(a, qv);
+        auto p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+        auto p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_packs_epi32(p0, p1));
+    }
+    applyGainS16Scalar(data + i, n - i, q);
+}
+
+static void
+applyGainFloatSse2(float* data, size_t n, float gain)
+{
+    const auto g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g));
+    applyGainFloatScalar(data + i, n - i, gain);
+}
+
+static void
+interleaveStereoS16Sse2(const int16_t* l, const int16_t* r, size_t frames, int16_t* out)
+{
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        auto vl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(l + i));
+        auto vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi16(vl, vr));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 8), _mm_unpackhi_epi16(vl, vr));
+    }
+    interleaveStereoS16Scalar(l + i, r + i, frames - i, out + 2 * i);
+}
+
+static void
+deinterleaveStereoS16Sse2(const int16_t* in, size_t frames, int16_t* l, int16_t* r)
+{
+    size_t i = 0;
+    // Each 32 bits lane holds one (left, right) pair; split it with shifts.
+    // Values are already 16 bits so the saturating pack is exact.
+    for (; i + 8 <= frames; i += 8) {
+        auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 8));
+        auto l0 = _mm_srai_epi32(_mm_slli_epi32(v0, 16), 16);
+        auto l1 = _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16);
+        auto r0 = _mm_srai_epi32(v0, 16);
+        auto r1 = _mm_srai_epi32(v1, 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(l + i), _mm_packs_epi32(l0, l1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r + i), _mm_packs_epi32(r0, r1));
+    }
+    deinterleaveStereoS16Scalar(in + 2 * i, frames - i, l + i, r + i);
+}
+
+static int32_t
+dotS16Sse2(const int16_t* a, const int16_t* b, size_t n)
+{
+    size_t i = 0;
+    auto acc = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        auto va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc) + dotS16Scalar(a + i, b + i, n - i);
+}
+
+static const Kernels BASELINE {"sse2",
+                               mixS16Sse2,
+                               mixFloatSse2,
+                               applyGainS16Sse2,
+                               applyGainFloatSse2,
+                               interleaveStereoS16Sse2,
+                               deinterleaveStereoS16Sse2,
+                               dotS16Sse2};
+
+#elif defined(AUDIO_KERNELS_NEON)
+
+static void
+mixS16Neon(int16_t* dst, const int16_t* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+    mixS16Scalar(dst + i, src + i, n - i);
+}
+
+static void
+mixFloatNeon(float* dst, const float* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+    mixFloatScalar(dst + i, src + i, n - i);
+}
+
+static void
+applyGainS16Neon(int16_t* data, size_t n, int16_t q)
+{
+    // (2 * a * q) >> 16 == (a * q) >> 15
+    const auto qv = vdupq_n_s16(q);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        vst1q_s16(data + i, vqdmulhq_s16(vld1q_s16(data + i), qv));
+    applyGainS16Scalar(data + i, n - i, q);
+}
+
+static void
+applyGainFloatNeon(float* data, size_t n, float gain)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(data + i, vmulq_n_f32(vld1q_f32(data + i), gain));
+    applyGainFloatScalar(data + i, n - i, gain);
+}
+
+static void
+interleaveStereoS16Neon(const int16_t* l, const int16_t* r, size_t frames, int16_t* out)
+{
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v {{vld1q_s16(l + i), vld1q_s16(r + i)}};
+        vst2q_s16(out + 2 * i, v);
+    }
+    interleaveStereoS16Scalar(l + i, r + i, frames - i, out + 2 * i);
+}
+
+static void
+deinterleaveStereoS16Neon(const int16_t* in, size_t frames, int16_t* l, int16_t* r)
+{
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        auto v = vld2q_s16(in + 2 * i);
+        vst1q_s16(l + i, v.val[0]);
+        vst1q_s16(r + i, v.val[1]);
+    }
+    deinterleaveStereoS16Scalar(in + 2 * i, frames - i, l + i, r + i);
+}
+
+static int32_t
+dotS16Neon(const int16_t* a, const int16_t* b, size_t n)
+{
+    size_t i = 0;
+    auto acc = vdupq_n_s32(0);
+    for (; i + 8 <= n; i += 8) {
+        auto va = vld1q_s16(a + i);
+        auto vb = vld1q_s16(b + i);
+        acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+        acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+    }
+    auto acc2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(acc2, acc2), 0) + dotS16Scalar(a + i, b + i, n - i);
+}
+
+static const Kernels BASELINE {"neon",
+                               mixS16Neon,
+                               mixFloatNeon,
+                               applyGainS16Neon,
+                               applyGainFloatNeon,
+                               interleaveStereoS16Neon,
+                               deinterleaveStereoS16Neon,
+                               dotS16Neon};
+
+#else
+
+static const Kernels& BASELINE = SCALAR;
+
+#endif
+
+//
+// AVX2, if supported by the CPU
+//
+
+#ifdef AUDIO_KERNELS_AVX2
+
+#define AUDIO_KERNELS_TARGET(t) __attribute__((target(t)))
+
+AUDIO_KERNELS_TARGET("avx2")
+static void
+mixS16Avx2(int16_t* dst, const int16_t* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_adds_epi16(a, b));
+    }
+    BASELINE.mixS16(dst + i, src + i, n - i);
+}
+
+AUDIO_KERNELS_TARGET("avx2")
+static void
+mixFloatAvx2(float* dst, const float* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    BASELINE.mixFloat(dst + i, src + i, n - i);
+}
+
+AUDIO_KERNELS_TARGET("avx2")
+static void
+applyGainS16Avx2(int16_t* data, size_t n, int16_t q)
+{
+    const auto qv = _mm256_set1_epi16(q);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        auto lo = _mm256_mullo_epi16(a, qv);
+        auto hi = _mm256_mulhi_epi16(a, qv);
+        // unpack and pack both work per 128 bits lane, so samples keep their order
+        auto p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 15);
+        auto p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 15);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_packs_epi32(p0, p1));
+    }
+    BASELINE.applyGainS16(data + i, n - i, q);
+}
+
+AUDIO_KERNELS_TARGET("avx2")
+static void
+applyGainFloatAvx2(float* data, size_t n, float gain)
+{
+    const auto g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), g));
+    BASELINE.applyGainFloat(data + i, n - i, gain);
+}
+
+AUDIO_KERNELS_TARGET("avx2")
+static int32_t
+dotS16Avx2(const int16_t* a, const int16_t* b, size_t n)
+{
+    size_t i = 0;
+    auto acc8 = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc8 = _mm256_add_epi32(acc8, _mm256_madd_epi16(va, vb));
+    }
+    auto acc = _mm_add_epi32(_mm256_castsi256_si128(acc8), _mm256_extracti128_si256(acc8, 1));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc) + BASELINE.dotS16(a + i, b + i, n - i);
+}
+
+#endif
+
+static std::atomic_bool scalarForced {false};
+
+static const Kernels&
+kernels()
+{
+    static const Kernels selected = [] {
+#ifdef AUDIO_KERNELS_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            // Interleaving is bound by the memory, the baseline one is kept
+            return Kernels {"avx2",
+                            mixS16Avx2,
+                            mixFloatAvx2,
+                            applyGainS16Avx2,
+                            applyGainFloatAvx2,
+                            BASELINE.interleaveStereoS16,
+                            BASELINE.deinterleaveStereoS16,
+                            dotS16Avx2};
+#endif
+        return BASELINE;
+    }();
+    return scalarForced ? SCALAR : selected;
+}
+
+const char*
+implementation()
+{
+    return kernels().name;
+}
+
+void
+forceScalar(bool scalar)
+{
+    scalarForced = scalar;
+}
+
+void
+mixS16(int16_t* dst, const int16_t* src, size_t n)
+{
+    kernels().mixS16(dst, src, n);
+}
+
+void
+mixFloat(float* dst, const float* src, size_t n)
+{
+    kernels().mixFloat(dst, src, n);
+}
+
+void
+applyGainS16(int16_t* data, size_t n, double gain)
+{
+    kernels().applyGainS16(data, n, gainToQ15(gain));
+}
+
+void
+applyGainFloat(float* data, size_t n, float gain)
+{
+    kernels().applyGainFloat(data, n, gain);
+}
+
+void
+interleaveS16(const int16_t* const* in, unsigned channels, size_t frames, int16_t* out)
+{
+    if (channels == 1) {
+        std::memcpy(out, in[0], frames * sizeof(int16_t));
+        return;
+    }
+    if (channels == 2) {
+        kernels().interleaveStereoS16(in[0], in[1], frames, out);
+        return;
+    }
+    for (size_t i = 0; i < frames; ++i)
+        for (unsigned c = 0; c < channels; ++c)
+            out[i * channels + c] = in[c][i];
+}
+
+void
+deinterleaveS16(const int16_t* in, unsigned channels, size_t frames, int16_t* const* out)
+{
+    if (channels == 1) {
+        std::memcpy(out[0], in, frames * sizeof(int16_t));
+        return;
+    }
+    if (channels == 2) {
+        kernels().deinterleaveStereoS16(in, frames, out[0], out[1]);
+        return;
+    }
+    for (size_t i = 0; i < frames; ++i)
+        for (unsigned c = 0; c < channels; ++c)
+            out[c][i] = in[i * channels + c];
+}
+
+int32_t
+dotS16(const int16_t* a, const int16_t* b, size_t n)
+{
+    return kernels().dotS16(a, b, n);
+}
+
+} // namespace audio_kernels
+} // namespace jami
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace jami {
+
+/**
+ * Vectorized sample processing used on the audio mixing paths.
+ * The implementation is selected at runtime on x86 (AVX2, then SSE2 when
+ * targeted by the compiler), and at compile time elsewhere (NEON). All of
+ * them give bit-exact identical results to the scalar one.
+ */
+namespace audio_kernels {
+
+/**
+ * Name of the instruction set selected for this CPU: "avx2", "sse2", "neon"
+ * or "scalar"
+ */
+const char* implementation();
+
+/**
+ * Use the scalar implementation, whatever the CPU, e.g. to compare both in tests
+ */
+void forceScalar(bool scalar);
+
+/**
+ * dst[i] = saturate(dst[i] + src[i])
+ */
+void mixS16(int16_t* dst, const int16_t* src, size_t n);
+
+/**
+ * dst[i] += src[i] (no clamping, float has enough headroom)
+ */
+void mixFloat(float* dst, const float* src, size_t n);
+
+/**
+ * data[i] = data[i] * gain, gain must be in [-1, 1]
+ */
+void applyGainS16(int16_t* data, size_t n, double gain);
+void applyGainFloat(float* data, size_t n, float gain);
+
+/**
+ * Interleave planar channels: out[frame * channels + c] = in[c][frame]
+ */
+void interleaveS16(const int16_t* const* in, unsigned channels, size_t frames, int16_t* out);
+
+/**
+ * De-interleave into planar channels: out[c][frame] = in[frame * channels + c]
+ */
+void deinterleaveS16(const int16_t* in, unsigned channels, size_t frames, int16_t* const* out);
+
+/**
+ * sum(a[i] * b[i]), e.g. one output sample of a FIR filter with fixed point taps.
+ * The caller guarantees the sum fits 32 bits, e.g. sum(|b[i]|) < 65536.
+ */
+int32_t dotS16(const int16_t* a, const int16_t* b, size_t n);
+
+} // namespace audio_kernels
+} // namespace jami
@@ -0,0 +1,182 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "audio_profiler.h"
+
+#include "logger.h"
+#include "metrics.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+namespace jami {
+
+// Frames followed at once: the ones discarded by a full ring buffer are forgotten past it
+static constexpr size_t MAX_FRAMES {256};
+// Without any frame received for this delay, the playback is not expected to have data
+static constexpr std::chrono::seconds IDLE_DELAY {1};
+// Until the first call of the device
+static constexpr std::chrono::milliseconds DEFAULT_PERIOD {20};
+
+static bool
+enabledByEnv()
+{
+    auto env = std::getenv("JAMI_AUDIO_PROFILING");
+    return env and std::strcmp(env, "0") != 0;
+}
+
+std::atomic_bool AudioProfiler::enabled_ {enabledByEnv()};
+
+namespace {
+
+using clock = AudioProfiler::clock;
+
+metrics::Histogram&
+stageHistogram(const char* stage)
+{
+    return metrics::Registry::instance().histogram("jami_audio_profile_stage_seconds",
+                                                   "Time spent by the audio frames per stage "
+                                                   "of the playback path",
+                                                   {.0005, .001, .0025, .005, .01, .02, .05, .1},
+                                                   {{"stage", stage}});
+}
+
+metrics::Counter&
+underrunCounter(const char* cause)
+{
+    return metrics::Registry::instance().counter("jami_audio_profile_underruns",
+                                                 "Silence played by the device, by cause",
+                                                 {{"cause", cause}});
+}
+
+struct State
+{
+    metrics::Histogram& decode {stageHistogram("decode")};
+    metrics::Histogram& ringBuffer {stageHistogram("ring_buffer")};
+    metrics::Histogram& mix {stageHistogram("mix")};
+    metrics::Histogram& playback {stageHistogram("playback")};
+    // Delay of the calls of the device after the end of the samples it got before
+    metrics::Histogram& device {stageHistogram("device")};
+    metrics::Counter& idle {underrunCounter("idle")};
+    metrics::Counter& late {underrunCounter("late")};
+    metrics::Counter& drained {underrunCounter("drained")};
+
+    std::mutex mutex;
+    // Frames in the ring buffers, by pointer as the tracepoints do
+    std::map<const AVFrame*, clock::time_point> queued;
+
+    std::atomic<clock::rep> lastReceived {0};
+    std::atomic<clock::rep> period {clock::duration(DEFAULT_PERIOD).count()};
+    // End of the samples the device got last
+    std::atomic<clock::rep> nextCall {0};
+};
+
+State&
+state()
+{
+    static State s;
+    return s;
+}
+
+} // namespace
+
+void
+AudioProfiler::setEnabled(bool enabled)
+{
+    if (enabled_.exchange(enabled) == enabled)
+        return;
+    JAMI_DBG("Audio profiling %s", enabled ? "enabled" : "disabled");
+    if (not enabled) {
+        auto& s = state();
+        std::lock_guard<std::mutex> lk(s.mutex);
+        s.queued.clear();
+    }
+}
+
+void
+AudioProfiler::frameReceived(const AVFrame* frame, clock::duration decodeTime)
+{
+    auto& s = state();
+    auto now = clock::now();
+    s.decode.observe(decodeTime);
+    s.lastReceived = now.time_since_epoch().count();
+    std::lock_guard<std::mutex> lk(s.mutex);
+    if (s.queued.size() >= MAX_FRAMES)
+        s.queued.erase(s.queued.begin());
+    s.queued[frame] = now;
+}
+
+void
+AudioProfiler::frameRead(const AVFrame* frame)
+{
+    auto& s = state();
+    clock::time_point queued;
+    {
+        std::lock_guard<std::mutex> lk(s.mutex);
+        auto it = s.queued.find(frame);
+        if (it == s.queued.end())
+            return; // Not received from a call (tone, file, capture...)
+        queued = it->second;
+        s.queued.erase(it);
+    }
+    s.ringBuffer.observe(clock::now() - queued);
+}
+
+void
+AudioProfiler::framesMixed(clock::duration mixTime)
+{
+    state().mix.observe(mixTime);
+}
+
+void
+AudioProfiler::played(clock::time_point start, size_t samples, unsigned sampleRate)
+{
+    auto& s = state();
+    auto now = clock::now();
+    s.playback.observe(now - start);
+    if (auto nextCall = s.nextCall.load())
+        s.device.observe(std::max(start - clock::time_point(clock::duration(nextCall)),
+                                  clock::duration::zero()));
+    if (sampleRate == 0)
+        return;
+    auto period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(samples) / sampleRate));
+    s.period = period.count();
+    s.nextCall = (start + period).time_since_epoch().count();
+}
+
+AudioProfiler::UnderrunCause
+AudioProfiler::underrun()
+{
+    auto& s = state();
+    auto lastReceived = s.lastReceived.load();
+    auto since = clock::now() - clock::time_point(clock::duration(lastReceived));
+    if (lastReceived == 0 or since > IDLE_DELAY) {
+        s.idle.add();
+        return UnderrunCause::IDLE;
+    }
+    if (since > 2 * clock::duration(s.period.load())) {
+        s.late.add();
+        return UnderrunCause::LATE;
+    }
+    s.drained.add();
+    return UnderrunCause::DRAINED;
+}
+
+} // namespace jami
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+struct AVFrame;
+
+namespace jami {
+
+/**
+ * Opt-in profiling of the audio playback path, enabled with JAMI_AUDIO_PROFILING=1.
+ *
+ * The received frames are followed through the stages instrumented by the audio tracepoints:
+ * decoding (AudioReceiveThread), wait in the ring buffer until read by RingBufferPool::getData,
+ * mixing, and AudioLayer::getToPlay, called by the device. The latency of each stage is
+ * observed in the jami_audio_profile_stage_seconds histogram, the underruns of the playback
+ * in the jami_audio_profile_underruns counter, by cause. Both are exported with the other
+ * metrics (DRing::getMetrics).
+ *
+ * When disabled, the instrumented code only loads a flag.
+ */
+class AudioProfiler
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum class UnderrunCause {
+        IDLE,    // Nothing received for a while (no call, on hold, remote muted...)
+        LATE,    // The receive path didn't deliver the frames in time (network, decoding)
+        DRAINED, // The frames were delivered, but the device consumed them faster
+    };
+
+    static bool enabled() noexcept { return enabled_.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    /**
+     * A frame was decoded, in @decodeTime, and put in a ring buffer
+     */
+    static void frameReceived(const AVFrame* frame, clock::duration decodeTime);
+    /**
+     * A frame was read from a ring buffer
+     */
+    static void frameRead(const AVFrame* frame);
+    static void framesMixed(clock::duration mixTime);
+    /**
+     * The device got @samples at @sampleRate from AudioLayer::getToPlay, called at @start
+     */
+    static void played(clock::time_point start, size_t samples, unsigned sampleRate);
+    /**
+     * The device is about to play silence
+     */
+    static UnderrunCause underrun();
+
+private:
+    static std::atomic_bool enabled_;
+};
+
+} // namespace jami
@@ -20,6 +20,7 @@
  */
 
 #include "audio_receive_thread.h"
+#include "audio_profiler.h"
 #include "libav_deps.h"
 #include "logger.h"
 #include "manager.h"
@@ -45,7 +46,9 @@ AudioReceiveThread::AudioReceiveThread(const std::string& id,
     , mtu_(mtu)
     , loop_(std::bind(&AudioReceiveThread::setup, this),
             std::bind(&AudioReceiveThread::process, this),
-            std::bind(&AudioReceiveThread::cleanup, this))
+            std::bind(&AudioReceiveThread::cleanup, this),
+            ThreadRole::AUDIO,
+            "jami:audio_recv")
 {}
 
 AudioReceiveThread::~AudioReceiveThread()
@@ -59,9 +62,21 @@ AudioReceiveThread::setup()
 {
     audioDecoder_.reset(new MediaDecoder([this](std::shared_ptr<MediaFrame>&& frame) mutable {
         notify(frame);
+        if (AudioProfiler::enabled())
+            AudioProfiler::frameReceived(frame->pointer(),
+                                         AudioProfiler::clock::now() - decodeStart_);
         ringbuffer_->put(std::static_pointer_cast<AudioFrame>(frame));
     }));
     audioDecoder_->setInterruptCallback(interruptCb, this);
+    audioDecoder_->setPacketObserver(
+        [this](const AVPacket& packet, const AVCodecParameters& par, AVRational timeBase) {
+            // Just before decoding the packet
+            if (AudioProfiler::enabled())
+                decodeStart_ = AudioProfiler::clock::now();
+            std::lock_guard<std::mutex> lk(packetObserverMutex_);
+            if (packetObserver_)
+                packetObserver_(packet, par, timeBase);
+        });
 
     // custom_io so the SDP demuxer will not open any UDP connections
     args_.input = SDP_FILENAME;
@@ -131,6 +146,11 @@ void
 AudioReceiveThread::addIOContext(SocketPair& socketPair)
 {
     demuxContext_.reset(socketPair.createIOContext(mtu_));
+    // Called while demuxing, from the thread of the loop
+    socketPair.setJitterDelayCallback(format_.sample_rate, [this](std::chrono::microseconds delay) {
+        if (audioDecoder_)
+            audioDecoder_->setMaxDelay(delay);
+    });
 }
 
 MediaStream
@@ -139,6 +159,13 @@ AudioReceiveThread::getInfo() const
     return audioDecoder_->getStream("a:remote");
 }
 
+void
+AudioReceiveThread::setPacketObserver(PacketObserver&& cb)
+{
+    std::lock_guard<std::mutex> lk(packetObserverMutex_);
+    packetObserver_ = std::move(cb);
+}
+
 void
 AudioReceiveThread::startReceiver()
 {
@@ -29,7 +29,9 @@
 #include "socket_pair.h"
 #include "threadloop.h"
 
+#include <chrono>
 #include <functional>
+#include <mutex>
 #include <sstream>
 
 namespace jami {
@@ -49,6 +51,12 @@ public:
     ~AudioReceiveThread();
 
     MediaStream getInfo() const;
+    const MediaDecoder* getDecoder() const { return audioDecoder_.get(); }
+
+    /**
+     * Also give the received packets to cb before they are decoded, e.g. to record them
+     */
+    void setPacketObserver(PacketObserver&& cb);
 
     void addIOContext(SocketPair& socketPair);
     void startReceiver();
@@ -90,6 +98,12 @@ private:
     void cleanup();
 
     std::function<void(MediaType, bool)> onSuccessfulSetup_;
+
+    // Set by another thread than the decoding one
+    std::mutex packetObserverMutex_;
+    // Of the packet being decoded, when profiled
+    std::chrono::steady_clock::time_point decodeStart_ {};
+    PacketObserver packetObserver_;
 };
 
 } // namespace jami
@@ -44,10 +44,29 @@
 #include "manager.h"
 #include "observer.h"
 #include "smartools.h"
+#include <array>
 #include <sstream>
 
 namespace jami {
 
+struct OpusProfile
+{
+    unsigned minLoss;  // percent
+    unsigned frameMs;  // frame duration
+    unsigned bitrate;  // Kbps, 0 for the default of libopus
+};
+
+// Fewer, longer packets at a lower bitrate when the peer loses more packets,
+// leaving room for the FEC data
+static constexpr std::array<OpusProfile, 4> OPUS_PROFILES {{
+    {0, 20, 0},
+    {10, 20, 32},
+    {25, 40, 24},
+    {40, 60, 16},
+}};
+// Each change restarts the encoder
+static constexpr auto OPUS_PROFILE_MIN_DURATION = std::chrono::seconds(20);
+
 AudioRtpSession::AudioRtpSession(const std::string& callId, const std::string& streamId)
     : RtpSession(callId, streamId, MediaType::MEDIA_AUDIO)
     , rtcpCheckerThread_([] { return true; }, [this] { processRtcpChecker(); }, [] {})
@@ -56,7 +75,9 @@ AudioRtpSession::AudioRtpSession(const std::string& callId, const std::string& s
     JAMI_DBG("Created Audio RTP session: %p - call Id %s", this, callId_.c_str());
 
     // don't move this into the initializer list or Cthulus will emerge
-    ringbuffer_ = Manager::instance().getRingBufferPool().createRingBuffer(callId_);
+    // Only fed by the receive thread, but read by every call bound to this one
+    ringbuffer_ = Manager::instance().getRingBufferPool().createRingBuffer(callId_,
+                                                                           RingBuffer::Mode::LOCK_FREE);
 }
 
 AudioRtpSession::~AudioRtpSession()
@@ -109,6 +130,7 @@ AudioRtpSession::startSender()
     }
 
     send_.fecEnabled = true;
+    applyOpusProfile();
 
     // be sure to not send any packets before saving last RTP seq value
     socketPair_->stopSendOp();
@@ -137,6 +159,41 @@ AudioRtpSession::startSender()
         rtcpCheckerThread_.start();
 }
 
+void
+AudioRtpSession::applyOpusProfile()
+{
+    if (not send_.codec or send_.codec->systemCodecInfo.avcodecId != AV_CODEC_ID_OPUS)
+        return;
+    const auto& profile = OPUS_PROFILES[opusProfile_];
+    auto codec = std::static_pointer_cast<AccountAudioCodecInfo>(send_.codec);
+    send_.bitrate = profile.bitrate;
+    send_.frame_size = codec->audioformat.sample_rate * profile.frameMs / 1000;
+}
+
+void
+AudioRtpSession::resetSender()
+{
+    if (not sender_ or not audioInput_)
+        return;
+    applyOpusProfile();
+    socketPair_->stopSendOp();
+    initSeqVal_ = sender_->getLastSeqValue() + 1;
+    audioInput_->detach(sender_.get());
+    try {
+        sender_.reset();
+        socketPair_->stopSendOp(false);
+        sender_.reset(new AudioSender(getRemoteRtpUri(), send_, *socketPair_, initSeqVal_, mtu_));
+    } catch (const MediaEncoderException& e) {
+        JAMI_ERR("%s", e.what());
+        send_.enabled = false;
+        return;
+    }
+    if (voiceCallback_)
+        sender_->setVoiceCallback(voiceCallback_);
+    sender_->setPacketLoss(packetLoss_);
+    audioInput_->attach(sender_.get());
+}
+
 void
 AudioRtpSession::restartSender()
 {
@@ -199,6 +256,9 @@ AudioRtpSession::start(std::unique_ptr<IceSocket> rtp_sock, std::unique_ptr<IceS
         } else {
             socketPair_.reset(new SocketPair(getRemoteRtpUri().c_str(), receive_.addr.getPort()));
         }
+        socketPair_->setMetrics("audio");
+        // Sent with the id of the peer, if it supports it
+        socketPair_->setAudioLevelExtension(send_.audioLevelExtId, receive_.audioLevelExtId);
 
         if (send_.crypto and receive_.crypto) {
             socketPair_->createSRTP(receive_.crypto.getCryptoSuite().c_str(),
@@ -304,6 +364,36 @@ AudioRtpSession::dropProcessing(RTCPInfo* rtcpi)
 {
     auto pondLoss = getPonderateLoss(rtcpi->packetLoss);
     setNewPacketLoss(pondLoss);
+    setNewOpusProfile(pondLoss);
+}
+
+void
+AudioRtpSession::setNewOpusProfile(float loss)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (not send_.codec or send_.codec->systemCodecInfo.avcodecId != AV_CODEC_ID_OPUS)
+        return;
+
+    // Up as soon as the loss reaches a profile, down once it's under half of it
+    auto profile = opusProfile_;
+    while (profile + 1 < OPUS_PROFILES.size() and loss >= OPUS_PROFILES[profile + 1].minLoss)
+        ++profile;
+    while (profile > 0 and loss < OPUS_PROFILES[profile].minLoss / 2.f)
+        --profile;
+
+    auto now = std::chrono::steady_clock::now();
+    if (profile == opusProfile_ or now - lastOpusProfileChange_ < OPUS_PROFILE_MIN_DURATION)
+        return;
+
+    JAMI_DBG("[%p] Opus profile %zu for %.1f%% of loss: %u ms frames at %u Kbps",
+             this,
+             profile,
+             loss,
+             OPUS_PROFILES[profile].frameMs,
+             OPUS_PROFILES[profile].bitrate);
+    opusProfile_ = profile;
+    lastOpusProfileChange_ = now;
+    resetSender();
 }
 
 void
@@ -342,9 +432,50 @@ AudioRtpSession::processRtcpChecker()
     socketPair_->waitForRTCP(std::chrono::seconds(rtcp_checking_interval));
 }
 
+std::optional<SocketPair::AudioLevel>
+AudioRtpSession::getReceivedAudioLevel()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (not socketPair_ or not receive_.audioLevelExtId)
+        return std::nullopt;
+    auto level = socketPair_->getReceivedAudioLevel();
+    if (std::chrono::steady_clock::now() - level.received > AUDIO_LEVEL_TIMEOUT)
+        return std::nullopt;
+    return level;
+}
+
+DRing::MediaStreamStats
+AudioRtpSession::getStats()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto stats = RtpSession::getStats();
+    if (auto encoder = sender_ ? sender_->getEncoder() : nullptr) {
+        auto encoding = encoder->getStats();
+        stats.framesEncoded = encoding.frames;
+        stats.totalEncodeTime = std::chrono::duration<double>(encoding.encodeTime).count();
+        stats.hardwareEncoding = encoding.hardware;
+    }
+    if (auto decoder = receiveThread_ ? receiveThread_->getDecoder() : nullptr) {
+        auto decoding = decoder->getStats();
+        stats.framesDecoded = decoding.frames;
+        stats.decodeLatency = std::chrono::duration<double>(decoding.latency).count();
+        stats.hardwareDecoding = decoding.hardware;
+    }
+    return stats;
+}
+
 void
 AudioRtpSession::initRecorder(std::shared_ptr<MediaRecorder>& rec)
 {
+    if (rec->isPassthrough()) {
+        if (receiveThread_)
+            receiveThread_->setPacketObserver(
+                rec->addPacketStream(receiveThread_->getInfo().name, false));
+        // As sent, without the frames skipped by the discontinuous transmission
+        if (sender_)
+            sender_->setPacketObserver(rec->addPacketStream("a:local", false));
+        return;
+    }
     if (receiveThread_)
         receiveThread_->attach(rec->addStream(receiveThread_->getInfo()));
     if (auto input = jami::getAudioInput(callId_))
@@ -354,6 +485,10 @@ AudioRtpSession::initRecorder(std::shared_ptr<MediaRecorder>& rec)
 void
 AudioRtpSession::deinitRecorder(std::shared_ptr<MediaRecorder>& rec)
 {
+    if (receiveThread_)
+        receiveThread_->setPacketObserver({});
+    if (sender_)
+        sender_->setPacketObserver({});
     if (receiveThread_) {
         if (auto ob = rec->getStream(receiveThread_->getInfo().name)) {
             receiveThread_->detach(ob);
@@ -366,4 +501,14 @@ AudioRtpSession::deinitRecorder(std::shared_ptr<MediaRecorder>& rec)
     }
 }
 
+bool
+AudioRtpSession::canRecordPackets() const
+{
+    auto canRecord = [](const MediaDescription& media) {
+        return media.codec
+               and MediaRecorder::canPassthrough(media.codec->systemCodecInfo.avcodecId);
+    };
+    return (not receiveThread_ or canRecord(receive_)) and (not sender_ or canRecord(send_));
+}
+
 } // namespace jami
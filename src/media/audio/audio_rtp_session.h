@@ -27,8 +27,10 @@
 
 #include "threadloop.h"
 
-#include <string>
+#include <chrono>
 #include <memory>
+#include <optional>
+#include <string>
 
 namespace jami {
 
@@ -58,21 +60,35 @@ public:
     void stop() override;
     void setMuted(bool muted, Direction dir = Direction::SEND) override;
 
+    DRing::MediaStreamStats getStats() override;
+
     void initRecorder(std::shared_ptr<MediaRecorder>& rec) override;
     void deinitRecorder(std::shared_ptr<MediaRecorder>& rec) override;
+    bool canRecordPackets() const override;
 
     std::shared_ptr<AudioInput>& getAudioLocal() { return audioInput_; }
     std::unique_ptr<AudioReceiveThread>& getAudioReceive() { return receiveThread_; }
 
     void setVoiceCallback(std::function<void(bool)> cb);
 
+    /**
+     * Level of the audio received, read from the RTP headers if the peer sends it (RFC 6464)
+     * @return nullopt if not received for AUDIO_LEVEL_TIMEOUT
+     */
+    std::optional<SocketPair::AudioLevel> getReceivedAudioLevel();
+    static constexpr std::chrono::milliseconds AUDIO_LEVEL_TIMEOUT {200};
+
 private:
     void startSender();
+    // Restart the encoder only, keeping the input
+    void resetSender();
     void startReceiver();
     bool check_RCTP_Info_RR(RTCPInfo& rtcpi);
     void adaptQualityAndBitrate();
     void dropProcessing(RTCPInfo* rtcpi);
     void setNewPacketLoss(unsigned int newPL);
+    void applyOpusProfile();
+    void setNewOpusProfile(float loss);
     float getPonderateLoss(float lastLoss);
 
     std::unique_ptr<AudioSender> sender_;
@@ -82,6 +98,8 @@ private:
     uint16_t initSeqVal_ {0};
     bool muteState_ {false};
     unsigned packetLoss_ {10};
+    std::size_t opusProfile_ {0};
+    std::chrono::steady_clock::time_point lastOpusProfileChange_ {};
     DeviceParams localAudioParams_;
 
     InterruptedThreadLoop rtcpCheckerThread_;
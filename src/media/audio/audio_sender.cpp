@@ -20,6 +20,7 @@
  */
 
 #include "audio_sender.h"
+#include "audio_frame_resizer.h"
 #include "client/videomanager.h"
 #include "libav_deps.h"
 #include "logger.h"
@@ -33,6 +34,9 @@
 
 namespace jami {
 
+// In silence, a frame every DTX_INTERVAL keeps the stream and the comfort noise alive
+static constexpr auto DTX_INTERVAL = std::chrono::milliseconds(400);
+
 AudioSender::AudioSender(const std::string& dest,
                          const MediaDescription& args,
                          SocketPair& socketPair,
@@ -40,6 +44,7 @@ AudioSender::AudioSender(const std::string& dest,
                          const uint16_t mtu)
     : dest_(dest)
     , args_(args)
+    , socketPair_(socketPair)
     , seqVal_(seqVal)
     , mtu_(mtu)
 {
@@ -48,6 +53,7 @@ AudioSender::AudioSender(const std::string& dest,
 
 AudioSender::~AudioSender()
 {
+    resizer_.reset();
     audioEncoder_.reset();
     muxContext_.reset();
     micData_.clear();
@@ -67,6 +73,15 @@ AudioSender::setup(SocketPair& socketPair)
         audioEncoder_->setOptions(args_);
         auto codec = std::static_pointer_cast<AccountAudioCodecInfo>(args_.codec);
         auto ms = MediaStream("audio sender", codec->audioformat);
+        ms.bitrate = args_.bitrate;
+        if (args_.frame_size > 0 and (int) args_.frame_size != ms.frameSize) {
+            ms.frameSize = args_.frame_size;
+            resizer_ = std::make_unique<AudioFrameResizer>(codec->audioformat,
+                                                           ms.frameSize,
+                                                           [this](std::shared_ptr<AudioFrame>&& f) {
+                                                               encode(std::move(f));
+                                                           });
+        }
         audioEncoder_->setOptions(ms);
         audioEncoder_->addStream(args_.codec->systemCodecInfo);
         audioEncoder_->setInitSeqVal(seqVal_);
@@ -89,13 +104,14 @@ void
 AudioSender::update(Observable<std::shared_ptr<jami::MediaFrame>>* /*obs*/,
                     const std::shared_ptr<jami::MediaFrame>& framePtr)
 {
-    auto frame = framePtr->pointer();
-    frame->pts = sent_samples;
-    sent_samples += frame->nb_samples;
+    auto frame = std::dynamic_pointer_cast<AudioFrame>(framePtr);
+    if (not frame)
+        return;
+    frame->pointer()->pts = sent_samples;
+    sent_samples += frame->pointer()->nb_samples;
 
     // check for change in voice activity, if so, call callback
-    // downcast MediaFrame to AudioFrame
-    bool hasVoice = std::dynamic_pointer_cast<AudioFrame>(framePtr)->has_voice;
+    bool hasVoice = frame->has_voice;
     if (hasVoice != voice_) {
         voice_ = hasVoice;
         if (voiceCallback_) {
@@ -105,7 +121,43 @@ AudioSender::update(Observable<std::shared_ptr<jami::MediaFrame>>* /*obs*/,
         }
     }
 
-    if (audioEncoder_->encodeAudio(*std::static_pointer_cast<AudioFrame>(framePtr)) < 0)
+    if (resizer_)
+        resizer_->enqueue(std::move(frame));
+    else
+        encode(std::move(frame));
+}
+
+void
+AudioSender::encode(std::shared_ptr<AudioFrame>&& frame)
+{
+    auto nbSamples = frame->pointer()->nb_samples;
+    const bool opus = args_.codec->systemCodecInfo.avcodecId == AV_CODEC_ID_OPUS;
+    // Without voice detection, frames are never marked as voice: their level tells the silence
+    const bool silent = opus and not dtx_ and silence_.silent(*frame);
+    if (frame->has_voice) {
+        dtx_ = opus;
+        silentSamples_ = 0;
+        lastSilentSent_ = 0;
+    } else if (dtx_ or silent) {
+        auto interval = frame->pointer()->sample_rate * DTX_INTERVAL.count() / 1000;
+        silentSamples_ += nbSamples;
+        if (silentSamples_ > interval) {
+            if (silentSamples_ - lastSilentSent_ < interval) {
+                audioEncoder_->skipAudio(nbSamples);
+                return;
+            }
+            lastSilentSent_ = silentSamples_;
+        }
+    } else {
+        silentSamples_ = 0;
+        lastSilentSent_ = 0;
+    }
+
+    // Of the packets of the frame, for the conference hosts
+    if (args_.audioLevelExtId)
+        socketPair_.setAudioLevel(rtp_audio_level::fromRms(frame->calcRMS()), frame->has_voice);
+
+    if (audioEncoder_->encodeAudio(*frame) < 0)
         JAMI_ERR("encoding failed");
 }
 
@@ -136,4 +188,11 @@ AudioSender::setPacketLoss(uint64_t pl)
     return audioEncoder_->setPacketLoss(pl);
 }
 
+void
+AudioSender::setPacketObserver(PacketObserver&& cb)
+{
+    if (audioEncoder_)
+        audioEncoder_->setPacketObserver(std::move(cb));
+}
+
 } // namespace jami
@@ -25,10 +25,12 @@
 #include "media_codec.h"
 #include "noncopyable.h"
 #include "observer.h"
+#include "silence_detector.h"
 #include "socket_pair.h"
 
 namespace jami {
 
+class AudioFrameResizer;
 class AudioInput;
 class MediaEncoder;
 class MediaIOHandle;
@@ -46,6 +48,12 @@ public:
 
     uint16_t getLastSeqValue();
     int setPacketLoss(uint64_t pl);
+    const MediaEncoder* getEncoder() const { return audioEncoder_.get(); }
+
+    /**
+     * Also give the sent packets to cb, e.g. to record them. Thread-safe.
+     */
+    void setPacketObserver(PacketObserver&& cb);
 
     void setVoiceCallback(std::function<void(bool)> cb);
 
@@ -56,12 +64,16 @@ private:
     NON_COPYABLE(AudioSender);
 
     bool setup(SocketPair& socketPair);
+    void encode(std::shared_ptr<AudioFrame>&& frame);
 
     std::string dest_;
     MediaDescription args_;
+    SocketPair& socketPair_;
     std::unique_ptr<MediaEncoder> audioEncoder_;
     std::unique_ptr<MediaIOHandle> muxContext_;
     std::unique_ptr<Resampler> resampler_;
+    // To the frame size of the encoder, when it isn't the one of the input
+    std::unique_ptr<AudioFrameResizer> resizer_;
 
     uint64_t sent_samples = 0;
 
@@ -72,6 +84,13 @@ private:
 
     // last voice activity state
     bool voice_ {false};
+
+    // Discontinuous transmission, once voice was detected at least once,
+    // or on the frames under the silence threshold
+    bool dtx_ {false};
+    SilenceDetector silence_;
+    int silentSamples_ {0};
+    int lastSilentSent_ {0};
     std::function<void(bool)> voiceCallback_;
 };
 
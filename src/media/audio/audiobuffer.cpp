@@ -20,6 +20,7 @@
 
 #include "libav_deps.h"
 #include "audiobuffer.h"
+#include "audio_kernels.h"
 #include "logger.h"
 #include <string.h>
 #include <cstring> // memset
@@ -158,8 +159,7 @@ AudioBuffer::applyGain(double gain)
         JAMI_DBG("Normalizing %f to [-1.0, 1.0]", gain);
 
     for (auto& channel : samples_)
-        for (auto& sample : channel)
-            sample *= g;
+        audio_kernels::applyGainS16(channel.data(), channel.size(), g);
 }
 
 size_t
@@ -174,9 +174,15 @@ AudioBuffer::channelToFloat(float* out, const int& channel) const
 size_t
 AudioBuffer::interleave(AudioSample* out) const
 {
-    for (unsigned i = 0, f = frames(), c = channels(); i < f; ++i)
-        for (unsigned j = 0; j < c; ++j)
-            *out++ = samples_[j][i];
+    const unsigned c = channels();
+    if (c > 0 and c <= 2) {
+        const AudioSample* in[2] = {samples_[0].data(), samples_[c - 1].data()};
+        audio_kernels::interleaveS16(in, c, frames(), out);
+    } else {
+        for (unsigned i = 0, f = frames(); i < f; ++i)
+            for (unsigned j = 0; j < c; ++j)
+                *out++ = samples_[j][i];
+    }
 
     return frames() * channels();
 }
@@ -224,9 +230,15 @@ AudioBuffer::deinterleave(const AudioSample* in, size_t frame_num, unsigned nb_c
     setChannelNum(nb_channels);
     resize(frame_num);
 
-    for (unsigned i = 0, f = frames(), c = channels(); i < f; i++)
-        for (unsigned j = 0; j < c; j++)
-            samples_[j][i] = *in++;
+    const unsigned c = channels();
+    if (c > 0 and c <= 2) {
+        AudioSample* out[2] = {samples_[0].data(), samples_[c - 1].data()};
+        audio_kernels::deinterleaveS16(in, c, frames(), out);
+    } else {
+        for (unsigned i = 0, f = frames(); i < f; i++)
+            for (unsigned j = 0; j < c; j++)
+                samples_[j][i] = *in++;
+    }
 }
 
 void
@@ -269,18 +281,8 @@ AudioBuffer::mix(const AudioBuffer& other, bool up /* = true */)
 
     for (unsigned i = 0; i < chan_num; i++) {
         unsigned src_chan = upmix ? std::min<unsigned>(i, other.samples_.size() - 1) : i;
-
-        for (unsigned j = 0; j < samp_num; j++) {
-            // clamp result to min/max
-            // result must be larger than 16 bits to check for over/underflow
-            int32_t n = static_cast<int32_t>(samples_[i][j])
-                        + static_cast<int32_t>(other.samples_[src_chan][j]);
-            if (n < std::numeric_limits<AudioSample>::min())
-                n = std::numeric_limits<AudioSample>::min();
-            else if (n > std::numeric_limits<AudioSample>::max())
-                n = std::numeric_limits<AudioSample>::max();
-            samples_[i][j] = n;
-        }
+        // saturating add, clamps the result to min/max
+        audio_kernels::mixS16(samples_[i].data(), other.samples_[src_chan].data(), samp_num);
     }
 
     return samp_num;
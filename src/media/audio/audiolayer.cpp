@@ -24,10 +24,13 @@
 #include "logger.h"
 #include "manager.h"
 #include "audio/ringbufferpool.h"
+#include "audio/audio_profiler.h"
 #include "audio/resampler.h"
+#include "audio/drift_compensator.h"
 #include "tonecontrol.h"
 #include "client/ring_signal.h"
 
+#include "audio-processing/dsp_stage.h"
 #include "audio-processing/null_audio_processor.h"
 #include "tracepoint.h"
 #if HAVE_WEBRTC_AP
@@ -38,6 +41,7 @@
 #endif
 
 #include <ctime>
+#include <thread>
 #include <algorithm>
 
 namespace jami {
@@ -51,13 +55,22 @@ AudioLayer::AudioLayer(const AudioPreference& pref)
           Manager::instance().getRingBufferPool().getRingBuffer(RingBufferPool::DEFAULT_ID))
     , audioFormat_(Manager::instance().getRingBufferPool().getInternalAudioFormat())
     , audioInputFormat_(Manager::instance().getRingBufferPool().getInternalAudioFormat())
+    , devicePeriod_(pref.getDevicePeriod())
     , urgentRingBuffer_("urgentRingBuffer_id", SIZEBUF, audioFormat_)
     , resampler_(new Resampler)
+    , playbackDrift_(new DriftCompensator)
     , lastNotificationTime_()
     , pref_(pref)
 {
     urgentRingBuffer_.createReadOffset(RingBufferPool::DEFAULT_ID);
 
+    // The readers of the ring buffers follow the period of the devices
+    Manager::instance().getRingBufferPool().setFrameDuration(
+        devicePeriod_.count() ? devicePeriod_ : std::chrono::milliseconds(20));
+    if (devicePeriod_.count())
+        JAMI_INFO("[audiolayer] low-latency mode, device period: %lld ms",
+                  (long long) devicePeriod_.count());
+
     JAMI_INFO("[audiolayer] AGC: %d, noiseReduce: %d, VAD: %d, echoCancel: %s, audioProcessor: %s",
               pref_.isAGCEnabled(),
               pref.getNoiseReduce(),
@@ -68,6 +81,30 @@ AudioLayer::AudioLayer(const AudioPreference& pref)
 
 AudioLayer::~AudioLayer() {}
 
+/**
+ * The published DSP stage, not destroyed while in scope. Wait-free, for the audio threads
+ */
+class AudioLayer::DspStageRef
+{
+public:
+    explicit DspStageRef(const AudioLayer& layer)
+        : users_(layer.dspStageUsers_)
+    {
+        // Counted before loaded, see destroyAudioProcessor()
+        users_.fetch_add(1);
+        stage_ = layer.activeDspStage_.load();
+    }
+    ~DspStageRef() { users_.fetch_sub(1); }
+
+    explicit operator bool() const { return stage_; }
+    DspStage* operator->() const { return stage_; }
+
+private:
+    NON_COPYABLE(DspStageRef);
+    std::atomic_uint& users_;
+    DspStage* stage_ {nullptr};
+};
+
 void
 AudioLayer::hardwareFormatAvailable(AudioFormat playback, size_t bufSize)
 {
@@ -108,6 +145,16 @@ AudioLayer::flush()
     urgentRingBuffer_.flushAll();
 }
 
+AudioLayer::Latency
+AudioLayer::getLatency() const
+{
+    Latency latency {std::chrono::microseconds(captureLatency_.load(std::memory_order_relaxed)),
+                     std::chrono::microseconds(playbackLatency_.load(std::memory_order_relaxed))};
+    if (DspStageRef dspStage {*this})
+        latency.processing = dspStage->latency();
+    return latency;
+}
+
 void
 AudioLayer::playbackChanged(bool started)
 {
@@ -146,9 +193,11 @@ AudioLayer::setHasNativeAEC(bool hasNativeAEC)
     std::lock_guard<std::mutex> lock(audioProcessorMutex);
     hasNativeAEC_ = hasNativeAEC;
     // if we have a current audio processor, tell it to enable/disable its own AEC
-    if (audioProcessor) {
-        audioProcessor->enableEchoCancel(
-            shouldUseAudioProcessorEchoCancel(hasNativeAEC, pref_.getEchoCanceller()));
+    if (dspStage_) {
+        dspStage_->configure([&](AudioProcessor& processor) {
+            processor.enableEchoCancel(
+                shouldUseAudioProcessorEchoCancel(hasNativeAEC, pref_.getEchoCanceller()));
+        });
     }
 }
 
@@ -180,6 +229,7 @@ AudioLayer::createAudioProcessor()
               nb_channels,
               frame_size);
 
+    std::unique_ptr<AudioProcessor> audioProcessor;
     if (pref_.getAudioProcessor() == "webrtc") {
 #if HAVE_WEBRTC_AP
         JAMI_WARN("[audiolayer] using WebRTCAudioProcessor");
@@ -215,14 +265,32 @@ AudioLayer::createAudioProcessor()
         shouldUseAudioProcessorEchoCancel(hasNativeAEC_, pref_.getEchoCanceller()));
 
     audioProcessor->enableVoiceActivityDetection(pref_.getVadEnabled());
+
+    destroyAudioProcessor();
+    // Processed off the capture callbacks
+    dspStage_ = std::make_unique<DspStage>(std::move(audioProcessor),
+                                           [this](std::shared_ptr<AudioFrame>&& frame) {
+                                               jami_tracepoint(media_frame_capture,
+                                                               "audio",
+                                                               frame->pointer());
+                                               mainRingBuffer_->put(std::move(frame));
+                                           });
+    activeDspStage_ = dspStage_.get();
 }
 
 // must acquire lock beforehand
 void
 AudioLayer::destroyAudioProcessor()
 {
-    // delete it
-    audioProcessor.reset();
+    if (!dspStage_)
+        return;
+    // The audio threads see it unpublished, or are counted (see DspStageRef):
+    // wait for them to leave it, they only push a frame
+    activeDspStage_ = nullptr;
+    while (dspStageUsers_.load() != 0)
+        std::this_thread::yield();
+    // delete it, joining its thread
+    dspStage_.reset();
 }
 
 void
@@ -259,7 +327,6 @@ AudioLayer::notifyIncomingCall()
 std::shared_ptr<AudioFrame>
 AudioLayer::getToRing(AudioFormat format, size_t writableSamples)
 {
-    ringtoneBuffer_.resize(0);
     if (auto fileToPlay = Manager::instance().getTelephoneFile()) {
         auto fileformat = fileToPlay->getFormat();
         bool resample = format != fileformat;
@@ -269,10 +336,12 @@ AudioLayer::getToRing(AudioFormat format, size_t writableSamples)
                                                 .real<size_t>()
                                           : writableSamples;
 
-        ringtoneBuffer_.setFormat(fileformat);
-        ringtoneBuffer_.resize(readableSamples);
-        fileToPlay->getNext(ringtoneBuffer_, isRingtoneMuted_ ? 0. : 1.);
-        return resampler_->resample(ringtoneBuffer_.toAVFrame(), format);
+        std::shared_ptr<AudioFrame> frame = fileToPlay->getNext(readableSamples);
+        if (isRingtoneMuted_) {
+            frame = std::make_shared<AudioFrame>(fileformat, readableSamples);
+            libav_utils::fillWithSilence(frame->pointer());
+        }
+        return resampler_->resample(std::move(frame), format);
     }
     return {};
 }
@@ -280,6 +349,8 @@ AudioLayer::getToRing(AudioFormat format, size_t writableSamples)
 std::shared_ptr<AudioFrame>
 AudioLayer::getToPlay(AudioFormat format, size_t writableSamples)
 {
+    auto profiled = AudioProfiler::enabled();
+    auto start = profiled ? AudioProfiler::clock::now() : AudioProfiler::clock::time_point {};
     notifyIncomingCall();
     auto& bufferPool = Manager::instance().getRingBufferPool();
 
@@ -288,38 +359,48 @@ AudioLayer::getToPlay(AudioFormat format, size_t writableSamples)
     else
         playbackQueue_->setFrameSize(writableSamples);
 
+    if (not bufferPool.isValid(mainBinding_)) {
+        mainBinding_ = bufferPool.getBindingHandle(RingBufferPool::DEFAULT_ID);
+        playbackDrift_->reset();
+    }
+
     std::shared_ptr<AudioFrame> playbackBuf {};
     while (!(playbackBuf = playbackQueue_->dequeue())) {
         std::shared_ptr<AudioFrame> resampled;
 
         if (auto urgentSamples = urgentRingBuffer_.get(RingBufferPool::DEFAULT_ID)) {
-            bufferPool.discard(1, RingBufferPool::DEFAULT_ID);
+            bufferPool.discard(1, mainBinding_);
             resampled = resampler_->resample(std::move(urgentSamples), format);
         } else if (auto toneToPlay = Manager::instance().getTelephoneTone()) {
             resampled = resampler_->resample(toneToPlay->getNext(), format);
-        } else if (auto buf = bufferPool.getData(RingBufferPool::DEFAULT_ID)) {
-            resampled = resampler_->resample(std::move(buf), format);
+        } else if (auto buf = bufferPool.getData(mainBinding_)) {
+            resampled = playbackDrift_->resample(std::move(buf),
+                                                 format,
+                                                 bufferPool.availableForGet(mainBinding_));
         } else {
-            std::lock_guard<std::mutex> lock(audioProcessorMutex);
-            if (audioProcessor) {
+            playbackDrift_->underrun();
+            if (profiled)
+                AudioProfiler::underrun();
+            if (DspStageRef dspStage {*this}) {
                 auto silence = std::make_shared<AudioFrame>(format, writableSamples);
                 libav_utils::fillWithSilence(silence->pointer());
-                audioProcessor->putPlayback(silence);
+                dspStage->putPlayback(silence);
             }
             break;
         }
 
         if (resampled) {
-            std::lock_guard<std::mutex> lock(audioProcessorMutex);
-            if (audioProcessor) {
-                audioProcessor->putPlayback(resampled);
-            }
+            if (DspStageRef dspStage {*this})
+                dspStage->putPlayback(resampled);
+            jami_tracepoint(media_frame_render, "audio", resampled->pointer());
             playbackQueue_->enqueue(std::move(resampled));
         } else
             break;
     }
 
     jami_tracepoint(audio_layer_get_to_play_end);
+    if (profiled)
+        AudioProfiler::played(start, writableSamples, format.sample_rate);
 
     return playbackBuf;
 }
@@ -327,14 +408,12 @@ AudioLayer::getToPlay(AudioFormat format, size_t writableSamples)
 void
 AudioLayer::putRecorded(std::shared_ptr<AudioFrame>&& frame)
 {
-    std::lock_guard<std::mutex> lock(audioProcessorMutex);
-    if (audioProcessor && playbackStarted_ && recordStarted_) {
-        audioProcessor->putRecorded(std::move(frame));
-        while (auto rec = audioProcessor->getProcessed()) {
-            mainRingBuffer_->put(std::move(rec));
-        }
-
+    DspStageRef dspStage {*this};
+    if (dspStage && playbackStarted_ && recordStarted_) {
+        // Put in the main ring buffer once processed
+        dspStage->putRecorded(std::move(frame));
     } else {
+        jami_tracepoint(media_frame_capture, "audio", frame->pointer());
         mainRingBuffer_->put(std::move(frame));
     }
 
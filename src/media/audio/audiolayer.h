@@ -23,6 +23,7 @@
 #pragma once
 
 #include "ringbuffer.h"
+#include "ringbufferpool.h"
 #include "dcblocker.h"
 #include "noncopyable.h"
 #include "audio_frame_resizer.h"
@@ -61,6 +62,8 @@ namespace jami {
 
 class AudioPreference;
 class Resampler;
+class DriftCompensator;
+class DspStage;
 
 enum class AudioDeviceType { ALL = -1, PLAYBACK = 0, CAPTURE, RINGTONE };
 
@@ -191,6 +194,32 @@ public:
 
     virtual void updatePreference(AudioPreference& pref, int index, AudioDeviceType type) = 0;
 
+    /**
+     * Move the running stream of type to the device of the preferences, without
+     * flushing the buffers nor resetting the audio processor (echo canceller state).
+     * @return false if the streams have to be restarted instead, e.g. as the format changes
+     */
+    virtual bool switchDevice(AudioDeviceType /* type */) { return false; }
+
+    /**
+     * Period requested to the devices by the low-latency mode, zero for the driver default
+     */
+    std::chrono::milliseconds getDevicePeriod() const { return devicePeriod_; }
+
+    struct Latency
+    {
+        std::chrono::microseconds capture {0};
+        std::chrono::microseconds playback {0};
+        // Added to the capture by the audio processing, zero without
+        std::chrono::microseconds processing {0};
+    };
+
+    /**
+     * Latency of the capture and playback devices, as last measured on their streams.
+     * Their sum is the round-trip latency added by the devices, zero if unknown.
+     */
+    Latency getLatency() const;
+
 protected:
     /**
      * Callback to be called by derived classes when the audio output is opened.
@@ -208,6 +237,31 @@ protected:
     void recordChanged(bool started);
     void setHasNativeAEC(bool hasEAC);
 
+    /**
+     * Called by derived classes with the delay of the samples in the devices
+     */
+    void setCaptureLatency(std::chrono::microseconds latency)
+    {
+        captureLatency_.store(latency.count(), std::memory_order_relaxed);
+    }
+    void setPlaybackLatency(std::chrono::microseconds latency)
+    {
+        playbackLatency_.store(latency.count(), std::memory_order_relaxed);
+    }
+
+    static std::chrono::microseconds framesDuration(long frames, unsigned sampleRate)
+    {
+        return std::chrono::microseconds(sampleRate ? frames * 1000000LL / sampleRate : 0);
+    }
+
+    /**
+     * Frames of the period to request to a device, zero for the driver default
+     */
+    unsigned devicePeriodFrames(unsigned sampleRate) const
+    {
+        return sampleRate * devicePeriod_.count() / 1000;
+    }
+
     std::shared_ptr<AudioFrame> getToPlay(AudioFormat format, size_t writableSamples);
     std::shared_ptr<AudioFrame> getToRing(AudioFormat format, size_t writableSamples);
     std::shared_ptr<AudioFrame> getPlayback(AudioFormat format, size_t samples)
@@ -236,8 +290,8 @@ protected:
      */
     bool isRingtoneMuted_ {false};
 
-    bool playbackStarted_ {false};
-    bool recordStarted_ {false};
+    std::atomic_bool playbackStarted_ {false};
+    std::atomic_bool recordStarted_ {false};
     bool hasNativeAEC_ {true};
 
     /**
@@ -257,7 +311,7 @@ protected:
      * Buffers for audio processing
      */
     std::shared_ptr<RingBuffer> mainRingBuffer_;
-    AudioBuffer ringtoneBuffer_;
+    RingBufferPool::BindingHandle mainBinding_ {RingBufferPool::INVALID_BINDING};
     std::unique_ptr<AudioFrameResizer> playbackQueue_;
 
     /**
@@ -278,6 +332,11 @@ protected:
 
     size_t nativeFrameSize_ {0};
 
+    /**
+     * Period of the devices in low-latency mode, zero otherwise
+     */
+    const std::chrono::milliseconds devicePeriod_;
+
     /**
      * Urgent ring buffer used for ringtones
      */
@@ -298,9 +357,23 @@ protected:
      */
     std::unique_ptr<Resampler> resampler_;
 
+    /**
+     * Resampling of the main ring buffer following the clock of the playback device
+     */
+    std::unique_ptr<DriftCompensator> playbackDrift_;
+
 private:
+    // To create, configure and destroy the DSP stage, never taken by the audio threads
     std::mutex audioProcessorMutex {};
-    std::unique_ptr<AudioProcessor> audioProcessor;
+    std::unique_ptr<DspStage> dspStage_;
+    /**
+     * dspStage_, published to the audio threads without a lock: they count
+     * themselves in dspStageUsers_ while they use it (see DspStageRef), and it
+     * is only destroyed once unpublished and unused
+     */
+    std::atomic<DspStage*> activeDspStage_ {nullptr};
+    mutable std::atomic_uint dspStageUsers_ {0};
+    class DspStageRef;
 
     void createAudioProcessor();
     void destroyAudioProcessor();
@@ -309,6 +382,9 @@ private:
     // when the playback is on (typically when there is already an
     // active call).
     std::atomic_bool playIncomingCallBeep_ {false};
+
+    std::atomic<int64_t> captureLatency_ {0};
+    std::atomic<int64_t> playbackLatency_ {0};
     /**
      * Time of the last incoming call notification
      */
@@ -27,20 +27,54 @@
 #endif
 
 #include "audioloop.h"
+#include "libav_deps.h"
 #include "logger.h"
 
 #include <algorithm> // std::min
+#include <list>
+#include <mutex>
 
 namespace jami {
 
+// Rendered loops kept: the tones, DTMF and ringtone of about two sample rates
+static constexpr size_t MAX_CACHED = 48;
+
 AudioLoop::AudioLoop(unsigned int sampleRate)
-    : buffer_(new AudioBuffer(0, AudioFormat(sampleRate, 1)))
+    : buffer_(std::make_shared<AudioBuffer>(0, AudioFormat(sampleRate, 1)))
     , pos_(0)
 {}
 
-AudioLoop::~AudioLoop()
+AudioLoop::~AudioLoop() {}
+
+std::shared_ptr<AudioBuffer>
+AudioLoop::getCached(const std::string& key,
+                     unsigned sampleRate,
+                     const std::function<std::shared_ptr<AudioBuffer>()>& render)
 {
-    delete buffer_;
+    struct Entry
+    {
+        std::string key;
+        unsigned sampleRate;
+        std::shared_ptr<AudioBuffer> buffer;
+    };
+    static std::mutex mutex;
+    // Most recently used first
+    static std::list<Entry> cache;
+
+    // Rendered with the lock, not to render the same loop twice
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = std::find_if(cache.begin(), cache.end(), [&](const Entry& e) {
+        return e.sampleRate == sampleRate and e.key == key;
+    });
+    if (it != cache.end()) {
+        cache.splice(cache.begin(), cache, it);
+        return cache.front().buffer;
+    }
+    auto buffer = render();
+    cache.emplace_front(Entry {key, sampleRate, buffer});
+    if (cache.size() > MAX_CACHED)
+        cache.pop_back();
+    return buffer;
 }
 
 void
@@ -93,6 +127,33 @@ AudioLoop::getNext(size_t samples)
     if (samples == 0) {
         samples = buffer_->getSampleRate() / 50;
     }
+
+    // A view of the samples, keeping them alive
+    if (buffer_->channels() == 1 and pos_ + samples <= buffer_->frames()) {
+        auto data = buffer_->getChannel(0)->data() + pos_;
+        auto size = samples * sizeof(AudioSample);
+        auto owner = new std::shared_ptr<AudioBuffer>(buffer_);
+        auto buf = av_buffer_create(
+            reinterpret_cast<uint8_t*>(data),
+            size,
+            [](void* opaque, uint8_t*) { delete static_cast<std::shared_ptr<AudioBuffer>*>(opaque); },
+            owner,
+            AV_BUFFER_FLAG_READONLY);
+        if (buf) {
+            auto frame = std::make_unique<AudioFrame>(buffer_->getFormat());
+            auto f = frame->pointer();
+            f->nb_samples = samples;
+            f->buf[0] = buf;
+            f->data[0] = buf->data;
+            f->extended_data = f->data;
+            f->linesize[0] = size;
+            pos_ = (pos_ + samples) % buffer_->frames();
+            onBufferFinish();
+            return frame;
+        }
+        delete owner;
+    }
+
     AudioBuffer buff(samples, buffer_->getFormat());
     getNext(buff, 1);
     return buff.toAVFrame();
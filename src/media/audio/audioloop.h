@@ -26,6 +26,10 @@
 #include "noncopyable.h"
 #include "audiobuffer.h"
 
+#include <functional>
+#include <memory>
+#include <string>
+
 /**
  * @file audioloop.h
  * @brief Loop on a sound file
@@ -57,6 +61,11 @@ public:
      * @param gain The gain [-1.0, 1.0]
      */
     void getNext(AudioBuffer& output, double gain);
+
+    /**
+     * Get the next fragment of the tone as a frame, 20 ms by default.
+     * It is a read-only view of the samples, copied only across the end of the loop.
+     */
     std::unique_ptr<AudioFrame> getNext(size_t samples = 0);
 
     void seek(double relative_position);
@@ -73,9 +82,23 @@ public:
     size_t getSize() const { return buffer_->frames(); }
     AudioFormat getFormat() const { return buffer_->getFormat(); }
 
+    /**
+     * Samples of the first channel, e.g. to read them from another position
+     */
+    const AudioSample* data() const { return buffer_->getChannel(0)->data(); }
+
 protected:
-    /** The data buffer */
-    AudioBuffer* buffer_ {nullptr};
+    /**
+     * Samples already rendered for @key at @sampleRate, e.g. by the loop of another call,
+     * otherwise the ones returned by @render, which are kept for the next loops.
+     */
+    static std::shared_ptr<AudioBuffer> getCached(
+        const std::string& key,
+        unsigned sampleRate,
+        const std::function<std::shared_ptr<AudioBuffer>()>& render);
+
+    /** The data buffer, shared between the loops and not modified once rendered */
+    std::shared_ptr<AudioBuffer> buffer_;
 
     /** current position, set to 0, when initialize */
     size_t pos_ {0};
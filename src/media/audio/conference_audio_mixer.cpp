@@ -0,0 +1,370 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#include "conference_audio_mixer.h"
+#include "libav_deps.h"
+#include "libav_utils.h"
+#include "logger.h"
+#include "manager.h"
+#include "ringbufferpool.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace jami {
+
+// Frames kept per source, older ones are dropped to bound the latency
+static constexpr size_t MAX_BACKLOG = 2;
+
+ConferenceAudioMixer::ConferenceAudioMixer(const std::string& id, size_t maxSpeakers)
+    : id_(id)
+    , readerId_(id + "_mix")
+    , maxSpeakers_(maxSpeakers)
+    , loop_(
+          [this] {
+              process();
+              return wakeUp_;
+          },
+          ThreadRole::AUDIO)
+{}
+
+ConferenceAudioMixer::~ConferenceAudioMixer()
+{
+    loop_.join();
+
+    auto& rbPool = Manager::instance().getRingBufferPool();
+    for (const auto& item : participants_) {
+        const auto& participant = item.second;
+        rbPool.unBindHalfDuplexOut(participant.readerId, participant.output->getId());
+        if (auto source = participant.source.lock())
+            source->removeReadOffset(readerId_);
+    }
+}
+
+std::string
+ConferenceAudioMixer::outputId(const std::string& readerId) const
+{
+    return readerId_ + "_" + readerId;
+}
+
+void
+ConferenceAudioMixer::addParticipant(const std::string& sourceId, const std::string& readerId)
+{
+    JAMI_DBG("[mixer:%s] add participant %s", id_.c_str(), sourceId.c_str());
+    auto& rbPool = Manager::instance().getRingBufferPool();
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto& participant = participants_[sourceId];
+        if (participant.output and participant.readerId != readerId)
+            rbPool.unBindHalfDuplexOut(participant.readerId, participant.output->getId());
+        participant.readerId = readerId;
+        participant.output = rbPool.createRingBuffer(outputId(readerId),
+                                                     RingBuffer::Mode::LOCK_FREE);
+        // Idempotent, also restores the binding if the reader was unbound meanwhile
+        rbPool.bindHalfDuplexOut(readerId, participant.output->getId());
+        rbPool.flush(readerId);
+    }
+    if (not loop_.isRunning()) {
+        wakeUp_ = MediaLoop::clock::now() + rbPool.getFrameDuration();
+        loop_.start(wakeUp_);
+    }
+}
+
+void
+ConferenceAudioMixer::removeParticipant(const std::string& sourceId)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = participants_.find(sourceId);
+    if (it == participants_.end())
+        return;
+    JAMI_DBG("[mixer:%s] remove participant %s", id_.c_str(), sourceId.c_str());
+    auto& participant = it->second;
+    if (participant.output)
+        Manager::instance().getRingBufferPool().unBindHalfDuplexOut(participant.readerId,
+                                                                    participant.output->getId());
+    if (auto source = participant.source.lock())
+        source->removeReadOffset(readerId_);
+    participants_.erase(it);
+    if (speaker_ == sourceId)
+        speaker_.clear();
+}
+
+bool
+ConferenceAudioMixer::hasParticipant(const std::string& sourceId) const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return participants_.find(sourceId) != participants_.end();
+}
+
+void
+ConferenceAudioMixer::setMuted(const std::string& sourceId, bool muted)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = participants_.find(sourceId);
+    if (it != participants_.end())
+        it->second.muted = muted;
+}
+
+void
+ConferenceAudioMixer::setLevelSource(const std::string& sourceId, LevelSource&& source)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = participants_.find(sourceId);
+    if (it != participants_.end())
+        it->second.levelSource = std::move(source);
+}
+
+void
+ConferenceAudioMixer::setOnSpeaker(std::function<void(const std::string& sourceId)>&& cb)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    onSpeaker_ = std::move(cb);
+}
+
+void
+ConferenceAudioMixer::process()
+{
+    // Mix at a fixed rate, whatever the participants send: run again at wakeUp_
+    wakeUp_ += Manager::instance().getRingBufferPool().getFrameDuration();
+
+    std::string speaker;
+    std::function<void(const std::string&)> onSpeaker;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto ref = readSources();
+        if (not ref)
+            return;
+        mix(*ref);
+        speaker = updateSpeaker();
+        if (not speaker.empty())
+            onSpeaker = onSpeaker_;
+    }
+    if (onSpeaker)
+        onSpeaker(speaker);
+}
+
+std::string
+ConferenceAudioMixer::updateSpeaker()
+{
+    const Participant* loudest = nullptr;
+    const std::string* loudestId = nullptr;
+    for (const auto& item : participants_) {
+        if (item.second.mixed and (not loudest or item.second.level > loudest->level)) {
+            loudest = &item.second;
+            loudestId = &item.first;
+        }
+    }
+    // Nobody speaking: the last speaker stays
+    if (not loudest or *loudestId == speaker_) {
+        nextSpeakerTicks_ = 0;
+        return {};
+    }
+    if (*loudestId != nextSpeaker_) {
+        nextSpeaker_ = *loudestId;
+        nextSpeakerTicks_ = 0;
+    }
+    const auto frameDuration = Manager::instance().getRingBufferPool().getFrameDuration();
+    if (++nextSpeakerTicks_ * frameDuration < SPEAKER_HOLD)
+        return {};
+    speaker_ = nextSpeaker_;
+    nextSpeakerTicks_ = 0;
+    return speaker_;
+}
+
+std::shared_ptr<AudioFrame>
+ConferenceAudioMixer::readSources()
+{
+    auto& rbPool = Manager::instance().getRingBufferPool();
+    std::shared_ptr<AudioFrame> ref;
+    std::vector<Participant*> speakers;
+    speakers.reserve(participants_.size());
+
+    for (auto& item : participants_) {
+        auto& participant = item.second;
+        participant.frame.reset();
+        participant.mixed = false;
+
+        // The ring buffer of a call is replaced when its audio restarts
+        auto source = rbPool.getRingBuffer(item.first);
+        if (source != participant.source.lock()) {
+            participant.source = source;
+            if (source) {
+                source->createReadOffset(readerId_);
+                participant.handle = source->getReadHandle(readerId_);
+            }
+        }
+        if (not source)
+            continue;
+
+        auto available = source->availableForGet(participant.handle);
+        if (available > MAX_BACKLOG)
+            source->discard(available - MAX_BACKLOG, participant.handle);
+        auto frame = source->get(participant.handle);
+        // Muted participants are still consumed to avoid a burst on unmute
+        if (not frame or participant.muted)
+            continue;
+
+        if (not ref) {
+            ref = frame;
+        } else {
+            auto& f = *frame->pointer();
+            auto& r = *ref->pointer();
+            if (f.format != r.format or f.channels != r.channels or f.nb_samples != r.nb_samples
+                or f.sample_rate != r.sample_rate)
+                continue;
+        }
+        // Silent participants are consumed but not mixed
+        std::optional<float> level;
+        if (participant.levelSource)
+            level = participant.levelSource();
+        const bool silent = level ? participant.silence.silent(*frame, *level)
+                                  : participant.silence.silent(*frame);
+        participant.frame = std::move(frame);
+        participant.level = participant.silence.level();
+        if (not silent)
+            speakers.emplace_back(&participant);
+    }
+
+    // Only keep the loudest participants
+    const size_t maxSpeakers = maxSpeakers_;
+    if (maxSpeakers and speakers.size() > maxSpeakers)
+        std::nth_element(speakers.begin(),
+                         speakers.begin() + maxSpeakers,
+                         speakers.end(),
+                         [](const Participant* a, const Participant* b) {
+                             return a->level > b->level;
+                         });
+    const auto end = maxSpeakers ? speakers.begin() + std::min(maxSpeakers, speakers.size())
+                                 : speakers.end();
+    for (auto it = speakers.begin(); it != end; ++it)
+        (*it)->mixed = true;
+
+    return ref;
+}
+
+void
+ConferenceAudioMixer::mix(const AudioFrame& ref)
+{
+    const auto& r = *ref.pointer();
+    const auto fmt = static_cast<AVSampleFormat>(r.format);
+    const bool isS16 = fmt == AV_SAMPLE_FMT_S16 || fmt == AV_SAMPLE_FMT_S16P;
+    if (not isS16 and fmt != AV_SAMPLE_FMT_FLT and fmt != AV_SAMPLE_FMT_FLTP) {
+        JAMI_ERR("[mixer:%s] unsupported format for mixing: %s",
+                 id_.c_str(),
+                 av_get_sample_fmt_name(fmt));
+        return;
+    }
+    const bool isPlanar = av_sample_fmt_is_planar(fmt);
+    const size_t planes = isPlanar ? r.channels : 1;
+    const size_t perPlane = isPlanar ? r.nb_samples : r.nb_samples * r.channels;
+    const size_t total = planes * perPlane;
+
+    const auto format = ref.getFormat();
+    size_t mixed = 0;
+    for (const auto& item : participants_)
+        mixed += item.second.mixed;
+
+    // Shared by the participants hearing nobody, e.g. all of them when everybody is silent
+    std::shared_ptr<AudioFrame> silence;
+    if (mixed <= 1) {
+        silence = std::make_shared<AudioFrame>(format, r.nb_samples);
+        libav_utils::fillWithSilence(silence->pointer());
+        silence->has_voice = false;
+    }
+    if (mixed == 0) {
+        for (auto& item : participants_)
+            if (item.second.output)
+                item.second.output->put(std::shared_ptr<AudioFrame>(silence));
+        return;
+    }
+
+    // Full mix, computed once for everybody
+    size_t voices = 0;
+    if (isS16)
+        mixS16_.assign(total, 0);
+    else
+        mixFloat_.assign(total, 0.f);
+    for (const auto& item : participants_) {
+        const auto& participant = item.second;
+        if (not participant.mixed)
+            continue;
+        const auto& f = *participant.frame->pointer();
+        for (size_t p = 0; p < planes; ++p) {
+            if (isS16) {
+                auto in = reinterpret_cast<const int16_t*>(f.extended_data[p]);
+                auto acc = mixS16_.data() + p * perPlane;
+                for (size_t i = 0; i < perPlane; ++i)
+                    acc[i] += in[i];
+            } else {
+                auto in = reinterpret_cast<const float*>(f.extended_data[p]);
+                auto acc = mixFloat_.data() + p * perPlane;
+                for (size_t i = 0; i < perPlane; ++i)
+                    acc[i] += in[i];
+            }
+        }
+        voices += participant.frame->has_voice;
+    }
+
+    // The full mix minus the contribution of @self, if not null
+    auto render = [&](const AudioFrame* self) {
+        auto out = std::make_shared<AudioFrame>(format, r.nb_samples);
+        auto& o = *out->pointer();
+        const AVFrame* s = self ? self->pointer() : nullptr;
+        for (size_t p = 0; p < planes; ++p) {
+            if (isS16) {
+                auto acc = mixS16_.data() + p * perPlane;
+                auto in = s ? reinterpret_cast<const int16_t*>(s->extended_data[p]) : nullptr;
+                auto dst = reinterpret_cast<int16_t*>(o.extended_data[p]);
+                for (size_t i = 0; i < perPlane; ++i)
+                    dst[i] = std::clamp<int32_t>(acc[i] - (in ? in[i] : 0),
+                                                 std::numeric_limits<int16_t>::min(),
+                                                 std::numeric_limits<int16_t>::max());
+            } else {
+                auto acc = mixFloat_.data() + p * perPlane;
+                auto in = s ? reinterpret_cast<const float*>(s->extended_data[p]) : nullptr;
+                auto dst = reinterpret_cast<float*>(o.extended_data[p]);
+                for (size_t i = 0; i < perPlane; ++i)
+                    dst[i] = std::clamp(acc[i] - (in ? in[i] : 0.f), -1.f, 1.f);
+            }
+        }
+        out->has_voice = voices > (self and self->has_voice);
+        return out;
+    };
+
+    // Each mixed participant gets the full mix minus its own contribution,
+    // the others share the full mix
+    std::shared_ptr<AudioFrame> full;
+    for (auto& item : participants_) {
+        auto& participant = item.second;
+        if (not participant.output)
+            continue;
+        std::shared_ptr<AudioFrame> out;
+        if (not participant.mixed) {
+            if (not full)
+                full = render(nullptr);
+            out = full;
+        } else if (mixed == 1) {
+            out = silence;
+        } else {
+            out = render(participant.frame.get());
+        }
+        participant.output->put(std::move(out));
+    }
+}
+
+} // namespace jami
@@ -0,0 +1,157 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#pragma once
+
+#include "ringbuffer.h"
+#include "noncopyable.h"
+#include "silence_detector.h"
+#include "media_executor.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jami {
+
+/**
+ * Audio mixer of a conference.
+ *
+ * Every tick, one frame is read from each participant, the full mix is computed
+ * once, and each participant receives the full mix minus its own contribution.
+ * The cost grows linearly with the number of participants, where binding every
+ * pair of participants in the RingBufferPool grows quadratically.
+ *
+ * The mix of a participant is written in a dedicated ring buffer which is bound
+ * to the participant's reader in the RingBufferPool.
+ *
+ * Silent participants are not mixed, and the participants receiving the same
+ * audio (e.g. everybody when nobody speaks) share the same frame.
+ */
+class ConferenceAudioMixer
+{
+public:
+    /**
+     * @param id            Unique id, used to name the ring buffers of the mixer
+     * @param maxSpeakers   If not 0, only the maxSpeakers loudest participants are mixed
+     */
+    ConferenceAudioMixer(const std::string& id, size_t maxSpeakers = 0);
+    ~ConferenceAudioMixer();
+
+    /**
+     * Add a participant to the mix, or update its reader.
+     * @param sourceId  Ring buffer carrying the audio of the participant
+     * @param readerId  Reader bound to the mix of the other participants
+     */
+    void addParticipant(const std::string& sourceId, const std::string& readerId);
+
+    void removeParticipant(const std::string& sourceId);
+
+    bool hasParticipant(const std::string& sourceId) const;
+
+    /**
+     * A muted participant still receives the mix, but is not mixed to the others
+     */
+    void setMuted(const std::string& sourceId, bool muted);
+
+    /**
+     * RMS level, from 0 to 1, of the audio of a participant known without decoding it, e.g.
+     * from the RTP headers. Called from the mixer thread for each frame, nullopt to measure
+     * the level of the frame instead.
+     */
+    using LevelSource = std::function<std::optional<float>()>;
+    void setLevelSource(const std::string& sourceId, LevelSource&& source);
+
+    /**
+     * Limit the mix to the N loudest participants (0 for no limit)
+     */
+    void setMaxSpeakers(size_t maxSpeakers) { maxSpeakers_ = maxSpeakers; }
+    size_t getMaxSpeakers() const { return maxSpeakers_; }
+
+    /**
+     * Called from the mixer thread when another participant has been the loudest for
+     * SPEAKER_HOLD, e.g. to show it in the video layout
+     */
+    void setOnSpeaker(std::function<void(const std::string& sourceId)>&& cb);
+
+    static constexpr std::chrono::seconds SPEAKER_HOLD {1};
+
+private:
+    NON_COPYABLE(ConferenceAudioMixer);
+
+    struct Participant
+    {
+        std::string readerId;
+        std::weak_ptr<RingBuffer> source;
+        RingBuffer::ReadHandle handle {RingBuffer::INVALID_HANDLE};
+        std::shared_ptr<RingBuffer> output;
+        bool muted {false};
+        SilenceDetector silence;
+        LevelSource levelSource;
+
+        // Current tick
+        std::shared_ptr<AudioFrame> frame;
+        float level {0};
+        bool mixed {false};
+    };
+
+    void process();
+
+    /**
+     * Read one frame from each participant and select the ones to mix.
+     * Return the first frame read, which gives the format of the tick,
+     * or nullptr if no participant produced audio.
+     */
+    std::shared_ptr<AudioFrame> readSources();
+
+    void mix(const AudioFrame& ref);
+
+    /**
+     * Return the new speaker, if it changed
+     */
+    std::string updateSpeaker();
+
+    std::string outputId(const std::string& readerId) const;
+
+    const std::string id_;
+    const std::string readerId_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Participant> participants_;
+    std::atomic<size_t> maxSpeakers_;
+
+    // Mix accumulators, large enough to never saturate
+    std::vector<int32_t> mixS16_;
+    std::vector<float> mixFloat_;
+
+    std::function<void(const std::string&)> onSpeaker_;
+    std::string speaker_;
+    std::string nextSpeaker_;
+    unsigned nextSpeakerTicks_ {0};
+
+    MediaLoop::clock::time_point wakeUp_;
+    MediaLoop loop_;
+};
+
+} // namespace jami
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "drift_compensator.h"
+#include "libav_deps.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace jami {
+
+// Averaging of the fill level over about 50 reads (1 s of 20 ms frames)
+static constexpr double SMOOTHING {1. / 50};
+// Reads before the level is taken as the target
+static constexpr unsigned WARMUP {250};
+// Correction per frame of difference with the target, in ppm
+static constexpr double GAIN {1000};
+// Difference with the target ignored, in frames
+static constexpr double DEADBAND {.25};
+
+void
+DriftCompensator::observe(double fill)
+{
+    level_ = observations_ ? level_ + SMOOTHING * (fill - level_) : fill;
+    if (observations_ < WARMUP) {
+        if (++observations_ == WARMUP)
+            target_ = level_;
+        return;
+    }
+
+    // Frames accumulating: the reader must consume faster, thus shrink its output
+    auto error = level_ - target_;
+    if (std::abs(error) < DEADBAND)
+        error = 0;
+    correction_ = std::clamp(-GAIN * error, -MAX_CORRECTION, MAX_CORRECTION);
+}
+
+std::shared_ptr<AudioFrame>
+DriftCompensator::resample(std::shared_ptr<AudioFrame>&& in, const AudioFormat& out, size_t fill)
+{
+    if (not in)
+        return {};
+    observe(fill);
+
+    if (correction_ != 0) {
+        const auto& f = *in->pointer();
+        const auto outSamples = (double) f.nb_samples * out.sample_rate / f.sample_rate;
+        pending_ += correction_ * 1e-6 * outSamples;
+        const auto delta = static_cast<int>(pending_);
+        if (delta != 0) {
+            pending_ -= delta;
+            resampler_.setCompensation(delta, std::max(1, static_cast<int>(outSamples)));
+        }
+    }
+    return resampler_.resample(std::move(in), out);
+}
+
+void
+DriftCompensator::underrun()
+{
+    // Counted as a missing frame, so that a reader always finding an empty buffer is slowed down
+    observe(-1);
+}
+
+void
+DriftCompensator::reset()
+{
+    observations_ = 0;
+    level_ = 0;
+    target_ = 0;
+    correction_ = 0;
+    pending_ = 0;
+}
+
+} // namespace jami
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "media_buffer.h"
+#include "noncopyable.h"
+#include "resampler.h"
+
+#include <memory>
+
+namespace jami {
+
+/**
+ * Adaptive resampling of the frames read from a ring buffer, compensating the drift between the
+ * clock of its writer and the one of its reader (e.g. a USB microphone and HDMI speakers).
+ *
+ * The frames left in the ring buffer after each read are averaged. When they grow, the reader is
+ * slower than the writer: its frames are shrunk by a few samples. When they decrease, they are
+ * stretched. The latency of the reader thus stays at the level it settled to, instead of drifting
+ * until frames are dropped (overrun) or silence is played (underrun).
+ */
+class DriftCompensator
+{
+public:
+    /**
+     * Maximum correction, in parts per million: 0.2%, about 3 cents of pitch
+     */
+    static constexpr double MAX_CORRECTION {2000};
+
+    DriftCompensator() = default;
+
+    /**
+     * Resample a frame read from the ring buffer to the format of the reader
+     * @param fill  Frames left in the ring buffer for this reader
+     */
+    std::shared_ptr<AudioFrame> resample(std::shared_ptr<AudioFrame>&& in,
+                                         const AudioFormat& out,
+                                         size_t fill);
+
+    /**
+     * To be called when a read found no frame
+     */
+    void underrun();
+
+    /**
+     * Correction applied to the output, in parts per million: positive if it is stretched.
+     * A reader waking up at a fixed period should shorten it by as much, to consume the frames
+     * at the rate of the writer.
+     */
+    double correction() const { return correction_; }
+
+    /**
+     * Forget the settled level, e.g. when the writer changed
+     */
+    void reset();
+
+private:
+    NON_COPYABLE(DriftCompensator);
+
+    void observe(double fill);
+
+    Resampler resampler_;
+    unsigned observations_ {0};
+    double level_ {0};
+    double target_ {0};
+    double correction_ {0};
+    // Fraction of sample not compensated yet
+    double pending_ {0};
+};
+
+} // namespace jami
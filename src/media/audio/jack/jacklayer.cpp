@@ -30,6 +30,7 @@
 #include "audio/ringbuffer.h"
 #include "audio/audioloop.h"
 #include "manager.h"
+#include "threadloop.h"
 
 #include <unistd.h>
 
@@ -66,13 +67,6 @@ connectPorts(jack_client_t* client, int portType, const std::vector<jack_port_t*
     }
     jack_free(physical_ports);
 }
-
-bool
-ringbuffer_ready_for_read(const jack_ringbuffer_t* rb)
-{
-    // XXX 512 is arbitrary
-    return jack_ringbuffer_read_space(rb) > 512;
-}
 } // namespace
 
 void
@@ -131,6 +125,7 @@ JackLayer::read()
     if (not toRead)
         return {};
 
+    // Converted to the format of the ring buffer when put
     auto format = audioInputFormat_;
     format.sampleFormat = AV_SAMPLE_FMT_FLTP;
     auto buffer = std::make_unique<AudioFrame>(format, toRead / sizeof(jack_default_audio_sample_t));
@@ -143,35 +138,55 @@ JackLayer::read()
     return buffer;
 }
 
-/* This thread can lock, do whatever it wants, and read from/write to the jack
- * ring buffers
- * XXX: Access to shared state (i.e. member variables) should be synchronized if needed */
+/* This thread can lock, allocate, and read from/write to the jack ring buffers,
+ * the realtime callbacks only copying between them and the ports */
 void
 JackLayer::ringbuffer_worker()
 {
+    setCurrentThreadRole(ThreadRole::AUDIO, "jami:jack_rb");
     flushMain();
     flushUrgent();
 
-    while (true) {
-        std::unique_lock<std::mutex> lock(ringbuffer_thread_mutex_);
-
-        // may have changed, we don't want to wait for a notification we won't get
-        if (status_ != Status::Started)
-            return;
-
-        // FIXME this is all kinds of evil
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
-
+    const auto period = devicePeriod_.count() ? devicePeriod_ : std::chrono::milliseconds(20);
+    auto next = std::chrono::steady_clock::now();
+    while (status_ == Status::Started) {
         capture();
         playback();
+        updateLatency();
+
+        if (auto dropped = droppedFrames_.exchange(0))
+            JAMI_WARN("[jack] Dropped %zu captured frames", dropped);
+        if (auto underrun = underrunFrames_.exchange(0))
+            JAMI_DBG("[jack] Played %zu frames of silence", underrun);
+
+        // The ring buffers hold several periods of the server
+        next += period;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now)
+            next = now;
+        std::this_thread::sleep_until(next);
+    }
+}
 
-        // wait until process() signals more data
-        // FIXME: this checks for spurious wakes, but the predicate
-        // is rather arbitrary. We should wait until ring has/needs data
-        // and jack has/needs data.
-        data_ready_.wait(lock, [&] {
-            return status_ != Status::Started or ringbuffer_ready_for_read(in_ringbuffers_[0]);
-        });
+/**
+ * The period of JACK is the one of its server: only the latency of the ports is reported, with
+ * the samples waiting in our ring buffers
+ */
+void
+JackLayer::updateLatency()
+{
+    jack_latency_range_t range;
+    if (not in_ports_.empty()) {
+        jack_port_get_latency_range(in_ports_[0], JackCaptureLatency, &range);
+        const auto pending = jack_ringbuffer_read_space(in_ringbuffers_[0])
+                             / sizeof(jack_default_audio_sample_t);
+        setCaptureLatency(framesDuration(range.max + pending, audioInputFormat_.sample_rate));
+    }
+    if (not out_ports_.empty()) {
+        jack_port_get_latency_range(out_ports_[0], JackPlaybackLatency, &range);
+        const auto pending = jack_ringbuffer_read_space(out_ringbuffers_[0])
+                             / sizeof(jack_default_audio_sample_t);
+        setPlaybackLatency(framesDuration(range.max + pending, audioFormat_.sample_rate));
     }
 }
 
@@ -328,23 +343,10 @@ JackLayer::process_capture(jack_nframes_t frames, void* arg)
                                                    (char*) in_buffers,
                                                    bytes_to_read);
 
-        // fill the rest with silence
-        if (bytes_to_rb < bytes_to_read) {
-            // TODO: set some flag for underrun?
-            JAMI_WARN("Dropped %lu bytes", bytes_to_read - bytes_to_rb);
-        }
-    }
-
-    /* Tell the ringbuffer thread there is work to do.  If it is already
-     * running, the lock will not be available.  We can't wait
-     * here in the process() thread, but we don't need to signal
-     * in that case, because the ringbuffer thread will read all the
-     * data queued before waiting again. */
-    if (context->ringbuffer_thread_mutex_.try_lock()) {
-        context->data_ready_.notify_one();
-        context->ringbuffer_thread_mutex_.unlock();
+        if (i == 0 and bytes_to_rb < bytes_to_read)
+            context->droppedFrames_.fetch_add((bytes_to_read - bytes_to_rb) / sizeof(*in_buffers),
+                                              std::memory_order_relaxed);
     }
-
     return 0;
 }
 
@@ -367,6 +369,9 @@ JackLayer::process_playback(jack_nframes_t frames, void* arg)
         if (bytes_from_rb < bytes_to_write) {
             const size_t frames_read = bytes_from_rb / sizeof(*out_buffers);
             memset(out_buffers + frames_read, 0, bytes_to_write - bytes_from_rb);
+            if (i == 0)
+                context->underrunFrames_.fetch_add(frames - frames_read,
+                                                   std::memory_order_relaxed);
         }
     }
 
@@ -409,7 +414,6 @@ void JackLayer::stopStream(AudioDeviceType)
     if (status_ != Status::Started)
         return;
     status_ = Status::Idle;
-    data_ready_.notify_one();
 
     if (jack_deactivate(playbackClient_) or jack_deactivate(captureClient_)) {
         JAMI_ERR("JACK client could not deactivate");
@@ -27,10 +27,10 @@
 #include <jack/jack.h>
 #include <jack/ringbuffer.h>
 
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <vector>
-#include <condition_variable>
 #include <memory>
 
 namespace jami {
@@ -48,15 +48,22 @@ private:
     std::vector<jack_ringbuffer_t*> out_ringbuffers_;
     std::vector<jack_ringbuffer_t*> in_ringbuffers_;
     std::thread ringbuffer_thread_;
-    std::mutex ringbuffer_thread_mutex_;
-    std::condition_variable data_ready_;
 
+    /**
+     * Realtime callbacks: only copy between the ports and the ring buffers, in the
+     * native format of JACK. They don't allocate, lock, log nor wake the worker,
+     * which runs at the period of the devices and does the conversions.
+     */
     static int process_capture(jack_nframes_t frames, void* arg);
     static int process_playback(jack_nframes_t frames, void* arg);
+    // Counted by the callbacks, logged by the worker
+    std::atomic<size_t> droppedFrames_ {0};
+    std::atomic<size_t> underrunFrames_ {0};
 
     void ringbuffer_worker();
     void playback();
     void capture();
+    void updateLatency();
 
     std::unique_ptr<AudioFrame> read();
     void write(const AudioFrame& buffer);
@@ -28,6 +28,7 @@
 #include "libav_utils.h"
 #include "manager.h"
 #include "logger.h"
+#include "threadloop.h"
 
 #include <SLES/OpenSLES_AndroidConfiguration.h>
 
@@ -342,6 +343,7 @@ OpenSLLayer::startAudioCapture()
     if (recThread.joinable())
         return;
     recThread = std::thread([&]() {
+        setCurrentThreadRole(ThreadRole::AUDIO_IO, "jami:opensl_rec");
         std::unique_lock<std::mutex> lck(recMtx);
         if (recorder_)
             recorder_->start();
@@ -30,6 +30,7 @@
 
 #include <portaudio.h>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 
 namespace jami {
@@ -517,10 +518,14 @@ PortAudioLayer::PortAudioLayerImpl::terminate() const
         JAMI_ERR("PortAudioLayer error : %s", Pa_GetErrorText(err));
 }
 
+/**
+ * @param period    Period of the device in low-latency mode, zero for its default low latency
+ */
 static void
 openStreamDevice(PaStream** stream,
                  PaDeviceIndex device,
                  Direction direction,
+                 std::chrono::milliseconds period,
                  PaStreamCallback* callback,
                  void* user_data)
 {
@@ -534,12 +539,17 @@ openStreamDevice(PaStream** stream,
     params.suggestedLatency = is_out ? device_info->defaultLowOutputLatency
                                      : device_info->defaultLowInputLatency;
     params.hostApiSpecificStreamInfo = nullptr;
+    unsigned long framesPerBuffer = paFramesPerBufferUnspecified;
+    if (period.count()) {
+        params.suggestedLatency = std::chrono::duration<PaTime>(period).count();
+        framesPerBuffer = device_info->defaultSampleRate * period.count() / 1000;
+    }
 
     auto err = Pa_OpenStream(stream,
                              is_out ? nullptr : &params,
                              is_out ? &params : nullptr,
                              device_info->defaultSampleRate,
-                             paFramesPerBufferUnspecified,
+                             framesPerBuffer,
                              paNoFlag,
                              callback,
                              user_data);
@@ -552,6 +562,7 @@ static void
 openFullDuplexStream(PaStream** stream,
                      PaDeviceIndex inputDeviceIndex,
                      PaDeviceIndex ouputDeviceIndex,
+                     std::chrono::milliseconds period,
                      PaStreamCallback* callback,
                      void* user_data)
 {
@@ -572,12 +583,20 @@ openFullDuplexStream(PaStream** stream,
     outputParams.suggestedLatency = output_device_info->defaultLowOutputLatency;
     outputParams.hostApiSpecificStreamInfo = nullptr;
 
+    const auto sampleRate = std::min(input_device_info->defaultSampleRate,
+                                     input_device_info->defaultSampleRate);
+    unsigned long framesPerBuffer = paFramesPerBufferUnspecified;
+    if (period.count()) {
+        inputParams.suggestedLatency = std::chrono::duration<PaTime>(period).count();
+        outputParams.suggestedLatency = inputParams.suggestedLatency;
+        framesPerBuffer = sampleRate * period.count() / 1000;
+    }
+
     auto err = Pa_OpenStream(stream,
                              &inputParams,
                              &outputParams,
-                             std::min(input_device_info->defaultSampleRate,
-                                      input_device_info->defaultSampleRate),
-                             paFramesPerBufferUnspecified,
+                             sampleRate,
+                             framesPerBuffer,
                              paNoFlag,
                              callback,
                              user_data);
@@ -597,6 +616,7 @@ PortAudioLayer::PortAudioLayerImpl::initInputStream(PortAudioLayer& parent)
             &streams_[Direction::Input],
             apiIndex,
             Direction::Input,
+            parent.devicePeriod_,
             [](const void* inputBuffer,
                void* outputBuffer,
                unsigned long framesPerBuffer,
@@ -639,6 +659,7 @@ PortAudioLayer::PortAudioLayerImpl::initOutputStream(PortAudioLayer& parent)
             &stream,
             apiIndex,
             Direction::Output,
+            parent.devicePeriod_,
             [](const void* inputBuffer,
                void* outputBuffer,
                unsigned long framesPerBuffer,
@@ -688,6 +709,7 @@ PortAudioLayer::PortAudioLayerImpl::initFullDuplexStream(PortAudioLayer& parent)
         &stream,
         apiIndexRecord,
         apiIndexPlayback,
+        parent.devicePeriod_,
         [](const void* inputBuffer,
            void* outputBuffer,
            unsigned long framesPerBuffer,
@@ -726,9 +748,12 @@ PortAudioLayer::PortAudioLayerImpl::paOutputCallback(PortAudioLayer& parent,
 {
     // unused arguments
     (void) inputBuffer;
-    (void) timeInfo;
     (void) statusFlags;
 
+    if (timeInfo and timeInfo->outputBufferDacTime > timeInfo->currentTime)
+        parent.setPlaybackLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::duration<PaTime>(timeInfo->outputBufferDacTime - timeInfo->currentTime)));
+
     auto toPlay = parent.getPlayback(parent.audioFormat_, framesPerBuffer);
     if (!toPlay) {
         std::fill_n(outputBuffer, framesPerBuffer * parent.audioFormat_.nb_channels, 0);
@@ -750,9 +775,13 @@ PortAudioLayer::PortAudioLayerImpl::paInputCallback(PortAudioLayer& parent,
 {
     // unused arguments
     (void) outputBuffer;
-    (void) timeInfo;
     (void) statusFlags;
 
+    if (timeInfo and timeInfo->inputBufferAdcTime > 0
+        and timeInfo->currentTime > timeInfo->inputBufferAdcTime)
+        parent.setCaptureLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::duration<PaTime>(timeInfo->currentTime - timeInfo->inputBufferAdcTime)));
+
     if (framesPerBuffer == 0) {
         JAMI_WARN("No frames for input.");
         return paContinue;
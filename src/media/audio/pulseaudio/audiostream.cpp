@@ -35,6 +35,7 @@ AudioStream::AudioStream(pa_context* c,
                          unsigned samplrate,
                          const PaDeviceInfos& infos,
                          bool ec,
+                         std::chrono::milliseconds period,
                          OnReady onReady,
                          OnData onData)
     : onReady_(std::move(onReady))
@@ -76,6 +77,13 @@ AudioStream::AudioStream(pa_context* c,
     attributes.prebuf = 0;
     attributes.fragsize = pa_usec_to_bytes(80 * PA_USEC_PER_MSEC, &sample_spec);
     attributes.minreq = (uint32_t) -1;
+    if (period.count()) {
+        // Requested one period at a time, with a period of margin for the playback
+        const pa_usec_t periodUsec = period.count() * PA_USEC_PER_MSEC;
+        attributes.tlength = pa_usec_to_bytes(2 * periodUsec, &sample_spec);
+        attributes.minreq = pa_usec_to_bytes(periodUsec, &sample_spec);
+        attributes.fragsize = pa_usec_to_bytes(periodUsec, &sample_spec);
+    }
 
     pa_stream_set_state_callback(
         audiostream_,
@@ -170,6 +178,32 @@ AudioStream::stop()
     audiostream_ = nullptr;
 }
 
+bool
+AudioStream::moveTo(const PaDeviceInfos& device)
+{
+    if (not audiostream_ or not isReady())
+        return false;
+    JAMI_DBG("Moving stream %s to %s", getDeviceName().c_str(), device.name.c_str());
+    auto context = pa_stream_get_context(audiostream_);
+    auto index = pa_stream_get_index(audiostream_);
+    // The server resamples to the new device, the stream is not interrupted
+    auto op = audioType_ == AudioDeviceType::CAPTURE
+                  ? pa_context_move_source_output_by_index(context,
+                                                           index,
+                                                           device.index,
+                                                           nullptr,
+                                                           nullptr)
+                  : pa_context_move_sink_input_by_index(context,
+                                                        index,
+                                                        device.index,
+                                                        nullptr,
+                                                        nullptr);
+    if (not op)
+        return false;
+    pa_operation_unref(op);
+    return true;
+}
+
 void
 AudioStream::moved(pa_stream* s)
 {
@@ -44,6 +44,7 @@ public:
      * @param audio sampling rate
      * @param pointer to pa_source_info or pa_sink_info (depending on type).
      * @param true if echo cancelling should be used with this stream
+     * @param period of the device in low-latency mode, zero for the default latency (80 ms)
      */
     AudioStream(pa_context*,
                 pa_threaded_mainloop*,
@@ -52,6 +53,7 @@ public:
                 unsigned,
                 const PaDeviceInfos&,
                 bool,
+                std::chrono::milliseconds period,
                 OnReady onReady,
                 OnData onData);
 
@@ -89,6 +91,12 @@ public:
 
     bool isReady();
 
+    /**
+     * Move the stream to another device, keeping its format. To be called with the
+     * mainloop locked.
+     */
+    bool moveTo(const PaDeviceInfos& device);
+
     void setEchoCancelCb(std::function<void(bool)>&& cb) { echoCancelCb = cb; }
 
 private:
@@ -30,6 +30,7 @@
 #include "libav_utils.h"
 #include "logger.h"
 #include "manager.h"
+#include "threadloop.h"
 
 #include <algorithm> // for std::find
 #include <stdexcept>
@@ -409,6 +410,7 @@ PulseLayer::createStream(std::unique_ptr<AudioStream>& stream,
                                  audioFormat_.sample_rate,
                                  dev_infos,
                                  ec,
+                                 devicePeriod_,
                                  std::bind(&PulseLayer::onStreamReady, this),
                                  std::move(onData)));
 }
@@ -491,6 +493,8 @@ PulseLayer::stopStream(AudioDeviceType type)
 void
 PulseLayer::writeToSpeaker()
 {
+    // Called on the thread of the pulseaudio mainloop
+    setCurrentThreadRole(ThreadRole::AUDIO_IO, "jami:pulse");
     if (!playback_ or !playback_->isReady())
         return;
 
@@ -509,11 +513,17 @@ PulseLayer::writeToSpeaker()
                         buff->pointer()->nb_samples * playback_->frameSize());
         pa_stream_write(playback_->stream(), data, writableBytes, nullptr, 0, PA_SEEK_RELATIVE);
     }
+
+    pa_usec_t latency = 0;
+    int negative = 0;
+    if (pa_stream_get_latency(playback_->stream(), &latency, &negative) == 0 and not negative)
+        setPlaybackLatency(std::chrono::microseconds(latency));
 }
 
 void
 PulseLayer::readFromMic()
 {
+    setCurrentThreadRole(ThreadRole::AUDIO_IO, "jami:pulse");
     if (!record_ or !record_->isReady())
         return;
 
@@ -537,6 +547,11 @@ PulseLayer::readFromMic()
     if (pa_stream_drop(record_->stream()) < 0)
         JAMI_ERR("Capture stream drop failed: %s", pa_strerror(pa_context_errno(context_)));
 
+    pa_usec_t latency = 0;
+    int negative = 0;
+    if (pa_stream_get_latency(record_->stream(), &latency, &negative) == 0 and not negative)
+        setCaptureLatency(std::chrono::microseconds(latency));
+
     putRecorded(std::move(out));
 }
 
@@ -658,12 +673,12 @@ PulseLayer::waitForDeviceList()
 
         if (status_ != Status::Started)
             return;
-        if (playbackDeviceChanged) {
+        if (playbackDeviceChanged and not switchDevice(AudioDeviceType::PLAYBACK)) {
             JAMI_WARN("Playback devices changed, restarting streams.");
             stopStream(AudioDeviceType::PLAYBACK);
             startStream(AudioDeviceType::PLAYBACK);
         }
-        if (recordDeviceChanged) {
+        if (recordDeviceChanged and not switchDevice(AudioDeviceType::CAPTURE)) {
             JAMI_WARN("Record devices changed, restarting streams.");
             stopStream(AudioDeviceType::CAPTURE);
             startStream(AudioDeviceType::CAPTURE);
@@ -828,6 +843,25 @@ PulseLayer::updatePreference(AudioPreference& preference, int index, AudioDevice
     }
 }
 
+bool
+PulseLayer::switchDevice(AudioDeviceType type)
+{
+    waitForDevices();
+    PulseMainLoopLock lock(mainloop_.get());
+    auto& stream = getStream(type);
+    if (not stream)
+        return true; // Created on the new device by startStream
+
+    const PaDeviceInfos* infos;
+    if (type == AudioDeviceType::CAPTURE)
+        infos = getDeviceInfos(sourceList_, getPreferredCaptureDevice());
+    else if (type == AudioDeviceType::RINGTONE)
+        infos = getDeviceInfos(sinkList_, getPreferredRingtoneDevice());
+    else
+        infos = getDeviceInfos(sinkList_, getPreferredPlaybackDevice());
+    return infos and stream->moveTo(*infos);
+}
+
 int
 PulseLayer::getIndexCapture() const
 {
@@ -163,6 +163,7 @@ private:
     static void server_info_callback(pa_context*, const pa_server_info* i, void* userdata);
 
     virtual void updatePreference(AudioPreference& pref, int index, AudioDeviceType type);
+    virtual bool switchDevice(AudioDeviceType type);
 
     virtual int getIndexCapture() const;
     virtual int getIndexPlayback() const;
@@ -20,9 +20,15 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
  */
 
+#include "audio_kernels.h"
 #include "libav_deps.h"
 #include "logger.h"
 #include "resampler.h"
+#include "tracepoint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
 
 extern "C" {
 #include <libswresample/swresample.h>
@@ -30,18 +36,288 @@ extern "C" {
 
 namespace jami {
 
-Resampler::Resampler()
-    : swrCtx_(swr_alloc())
-    , initCount_(0)
-{}
+// Routes whose context is kept, e.g. the formats of the participants of a conference
+static constexpr size_t MAX_CONTEXTS {4};
+
+/**
+ * Formats converted by a context: libswresample reinitializes when any of them changes
+ */
+struct Resampler::Route
+{
+    Route(const AVFrame* in, const AVFrame* out)
+        : inRate(in->sample_rate)
+        , inChannels(in->channels)
+        , inFormat(in->format)
+        , inLayout(in->channel_layout)
+        , outRate(out->sample_rate)
+        , outChannels(out->channels)
+        , outFormat(out->format)
+        , outLayout(out->channel_layout)
+    {}
+
+    bool operator==(const Route& o) const
+    {
+        return std::tie(inRate,
+                        inChannels,
+                        inFormat,
+                        inLayout,
+                        outRate,
+                        outChannels,
+                        outFormat,
+                        outLayout)
+               == std::tie(o.inRate,
+                           o.inChannels,
+                           o.inFormat,
+                           o.inLayout,
+                           o.outRate,
+                           o.outChannels,
+                           o.outFormat,
+                           o.outLayout);
+    }
+    bool operator!=(const Route& o) const { return !(*this == o); }
+
+    /**
+     * Channels are the same, only labelled differently (e.g. an unset layout and mono)
+     */
+    bool sameChannels() const
+    {
+        return inChannels == outChannels
+               && (inLayout == outLayout || inLayout == 0 || outLayout == 0);
+    }
+
+    /**
+     * Same samples, the frame can be passed through
+     */
+    bool passthrough() const
+    {
+        return sameChannels() && inRate == outRate && inFormat == outFormat;
+    }
+
+    /**
+     * @return the ratio between the rates if the samples only need a fixed ratio filter:
+     * 16 bits samples, same channels, one rate 2 to 6 times the other. 0 otherwise.
+     */
+    unsigned fixedRatio() const
+    {
+        if (!sameChannels() || inFormat != outFormat
+            || (inFormat != AV_SAMPLE_FMT_S16 && inFormat != AV_SAMPLE_FMT_S16P) || inRate <= 0
+            || outRate <= 0)
+            return 0;
+        auto high = std::max(inRate, outRate);
+        auto low = std::min(inRate, outRate);
+        auto ratio = high / low;
+        return high % low == 0 && ratio >= 2 && ratio <= 6 ? ratio : 0;
+    }
+
+    int inRate;
+    int inChannels;
+    int inFormat;
+    uint64_t inLayout;
+    int outRate;
+    int outChannels;
+    int outFormat;
+    uint64_t outLayout;
+};
+
+/**
+ * Polyphase FIR filter resampling 16 bits samples by an integer ratio, e.g. between 48 kHz and
+ * the 16 or 8 kHz of the narrowband codecs.
+ *
+ * The low-pass filter is a Kaiser windowed sinc, flat within 0.005 dB up to 80% of the lower
+ * Nyquist frequency and attenuating by 58 dB or more above it. Its taps are in Q14: the sum of
+ * their absolute values is about 2, so that the products of any 16 bits input fit 32 bits.
+ */
+class Resampler::FixedRatio
+{
+public:
+    static constexpr unsigned TAPS_PER_PHASE {48};
+
+    explicit FixedRatio(const Route& route)
+        : down_(route.inRate > route.outRate)
+        , ratio_(route.fixedRatio())
+        , channels_(route.inChannels)
+        , planar_(route.inFormat == AV_SAMPLE_FMT_S16P)
+    {
+        design();
+        // Starts with silence as history
+        history_.assign(channels_, std::vector<int16_t>(taps() - 1));
+    }
+
+    int resample(const AVFrame* input, AVFrame* output);
+
+private:
+    size_t taps() const { return down_ ? filters_[0].size() : TAPS_PER_PHASE; }
+    void design();
+
+    bool down_;
+    unsigned ratio_;
+    unsigned channels_;
+    bool planar_;
+    // Decimation: one filter. Interpolation: one reversed filter per output phase
+    std::vector<std::vector<int16_t>> filters_;
+    // Input samples of each channel not consumed yet, the oldest first
+    std::vector<std::vector<int16_t>> history_;
+};
+
+static double
+besselI0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+void
+Resampler::FixedRatio::design()
+{
+    static constexpr double BETA {7};
+    static constexpr double PI {3.14159265358979323846};
+    static constexpr int32_t ONE {1 << 14};
+    const size_t n = TAPS_PER_PHASE * ratio_;
+    // Cutoff in cycles per sample of the higher rate
+    const double cutoff = .455 / ratio_;
+    const double center = (n - 1) / 2.;
+    std::vector<double> h(n);
+    for (size_t i = 0; i < n; ++i) {
+        double t = i - center;
+        double x = 2 * PI * cutoff * t;
+        double sinc = 2 * cutoff * (x == 0 ? 1 : std::sin(x) / x);
+        double r = t / center;
+        h[i] = sinc * besselI0(BETA * std::sqrt(std::max(0., 1 - r * r))) / besselI0(BETA);
+    }
+
+    if (down_) {
+        filters_.assign(1, std::vector<int16_t>(n));
+    } else {
+        // Phase p of output sample i * ratio + p uses the taps p + j * ratio, applied to the
+        // input samples i - j: reversed, they are applied to contiguous input samples
+        filters_.assign(ratio_, std::vector<int16_t>(TAPS_PER_PHASE));
+    }
+    for (size_t p = 0; p < filters_.size(); ++p) {
+        auto& filter = filters_[p];
+        std::vector<double> taps(filter.size());
+        double sum = 0;
+        for (size_t j = 0; j < taps.size(); ++j) {
+            taps[j] = down_ ? h[j] : h[p + (taps.size() - 1 - j) * ratio_];
+            sum += taps[j];
+        }
+        // Unity gain at DC, exact after quantization: the rounding error goes to the largest tap
+        int32_t total = 0;
+        size_t largest = 0;
+        for (size_t j = 0; j < taps.size(); ++j) {
+            filter[j] = std::lround(taps[j] / sum * ONE);
+            total += filter[j];
+            if (filter[j] > filter[largest])
+                largest = j;
+        }
+        filter[largest] += ONE - total;
+    }
+}
 
-Resampler::~Resampler()
+int
+Resampler::FixedRatio::resample(const AVFrame* input, AVFrame* output)
 {
-    swr_free(&swrCtx_);
+    const size_t n = taps();
+    const size_t inSamples = input->nb_samples;
+    const size_t available = history_[0].size() + inSamples;
+    size_t outSamples;
+    if (down_)
+        outSamples = available >= n ? (available - n) / ratio_ + 1 : 0;
+    else
+        outSamples = (available - (n - 1)) * ratio_;
+
+    output->nb_samples = outSamples;
+    if (outSamples && av_frame_get_buffer(output, 0) < 0) {
+        JAMI_ERR() << "Failed to allocate resampled frame";
+        return -1;
+    }
+
+    for (unsigned c = 0; c < channels_; ++c) {
+        auto& x = history_[c];
+        const auto in = reinterpret_cast<const int16_t*>(planar_ ? input->extended_data[c]
+                                                                   : input->extended_data[0]);
+        auto out = reinterpret_cast<int16_t*>(planar_ ? output->extended_data[c]
+                                                      : output->extended_data[0]);
+        // Samples of the channel are contiguous if planar, interleaved otherwise
+        const size_t step = planar_ ? 1 : channels_;
+        const size_t offset = planar_ ? 0 : c;
+
+        auto old = x.size();
+        x.resize(old + inSamples);
+        for (size_t i = 0; i < inSamples; ++i)
+            x[old + i] = in[i * step + offset];
+
+        auto write = [&](size_t k, int32_t acc) {
+            out[k * step + offset] = std::clamp((acc + (1 << 13)) >> 14,
+                                                (int32_t) INT16_MIN,
+                                                (int32_t) INT16_MAX);
+        };
+
+        size_t consumed;
+        if (down_) {
+            const auto& h = filters_[0];
+            for (size_t k = 0; k < outSamples; ++k)
+                write(k, audio_kernels::dotS16(x.data() + k * ratio_, h.data(), n));
+            consumed = outSamples * ratio_;
+        } else {
+            const size_t inputs = outSamples / ratio_;
+            for (size_t i = 0; i < inputs; ++i)
+                for (unsigned p = 0; p < ratio_; ++p)
+                    write(i * ratio_ + p,
+                          audio_kernels::dotS16(x.data() + i, filters_[p].data(), n));
+            consumed = inputs;
+        }
+        x.erase(x.begin(), x.begin() + consumed);
+    }
+    return 0;
 }
 
+/**
+ * Conversion of a route: through the fixed ratio filter if it applies, libswresample otherwise
+ */
+struct Resampler::Context
+{
+    explicit Context(const Route& r)
+        : route(r)
+    {
+        if (route.fixedRatio())
+            fixed = std::make_unique<FixedRatio>(route);
+    }
+    ~Context() { swr_free(&swr); }
+
+    Route route;
+    std::unique_ptr<FixedRatio> fixed;
+    SwrContext* swr {nullptr};
+};
+
+Resampler::Resampler()
+    : initCount_(0)
+{}
+
+Resampler::~Resampler() = default;
+
 void
 Resampler::reinit(const AVFrame* in, const AVFrame* out)
+{
+    const Route route(in, out);
+    auto it = std::find_if(contexts_.begin(), contexts_.end(), [&](const auto& ctx) {
+        return ctx->route == route;
+    });
+    if (it == contexts_.end()) {
+        if (contexts_.size() == MAX_CONTEXTS)
+            contexts_.pop_back();
+        it = contexts_.emplace(contexts_.end(), std::make_unique<Context>(route));
+    }
+    // The most recently used first
+    std::rotate(contexts_.begin(), it, it + 1);
+    initCount_ = 0;
+}
+
+SwrContext*
+Resampler::createSwrContext(const AVFrame* in, const AVFrame* out)
 {
     // NOTE swr_set_matrix should be called on an uninitialized context
     auto swrCtx = swr_alloc();
@@ -104,24 +380,42 @@ Resampler::reinit(const AVFrame* in, const AVFrame* out)
         }
     }
 
-    if (swr_init(swrCtx) >= 0) {
-        std::swap(swrCtx_, swrCtx);
+    if (swr_init(swrCtx) < 0) {
         swr_free(&swrCtx);
-        ++initCount_;
-    } else {
         std::string msg = "Failed to initialize resampler context";
         JAMI_ERR() << msg;
         throw std::runtime_error(msg);
     }
+    return swrCtx;
 }
 
 int
 Resampler::resample(const AVFrame* input, AVFrame* output)
 {
-    if (!initCount_)
+    const Route route(input, output);
+    if (!compensated_ && route.passthrough() && !output->buf[0]) {
+        // Only the label of the channels differs: reference the samples of the input
+        const auto layout = output->channel_layout;
+        av_frame_unref(output);
+        if (av_frame_ref(output, input) < 0) {
+            JAMI_ERR() << "Failed to reference frame";
+            return -1;
+        }
+        output->channel_layout = layout;
+        return 0;
+    }
+
+    if (contexts_.empty() || contexts_.front()->route != route)
         reinit(input, output);
+    auto& ctx = *contexts_.front();
+    if (ctx.fixed && !compensated_)
+        return ctx.fixed->resample(input, output);
 
-    int ret = swr_convert_frame(swrCtx_, output, input);
+    if (!ctx.swr) {
+        ctx.swr = createSwrContext(input, output);
+        ++initCount_;
+    }
+    int ret = swr_convert_frame(ctx.swr, output, input);
     if (ret & AVERROR_INPUT_CHANGED || ret & AVERROR_OUTPUT_CHANGED) {
         // Under certain conditions, the resampler reinits itself in an infinite loop. This is
         // indicative of an underlying problem in the code. This check is so the backtrace
@@ -132,7 +426,7 @@ Resampler::resample(const AVFrame* input, AVFrame* output)
             JAMI_ERR() << msg;
             throw std::runtime_error(msg);
         }
-        reinit(input, output);
+        swr_free(&ctx.swr);
         return resample(input, output);
     } else if (ret < 0) {
         JAMI_ERR() << "Failed to resample frame";
@@ -144,6 +438,16 @@ Resampler::resample(const AVFrame* input, AVFrame* output)
     return 0;
 }
 
+void
+Resampler::setCompensation(int sampleDelta, int distance)
+{
+    compensated_ = true;
+    if (contexts_.empty() || !contexts_.front()->swr)
+        return; // ignored until the first frame gives the formats
+    if (swr_set_compensation(contexts_.front()->swr, sampleDelta, distance) < 0)
+        JAMI_WARN() << "Unable to compensate the drift of the resampler";
+}
+
 void
 Resampler::resample(const AudioBuffer& dataIn, AudioBuffer& dataOut)
 {
@@ -168,7 +472,7 @@ Resampler::resample(const AudioBuffer& dataIn, AudioBuffer& dataOut)
 std::unique_ptr<AudioFrame>
 Resampler::resample(std::unique_ptr<AudioFrame>&& in, const AudioFormat& format)
 {
-    if (in->pointer()->sample_rate == (int) format.sample_rate
+    if (!compensated_ && in->pointer()->sample_rate == (int) format.sample_rate
         && in->pointer()->channels == (int) format.nb_channels
         && (AVSampleFormat) in->pointer()->format == format.sampleFormat) {
         return std::move(in);
@@ -190,7 +494,7 @@ Resampler::resample(std::shared_ptr<AudioFrame>&& in, const AudioFormat& format)
         return {};
     }
 
-    if (inPtr->sample_rate == (int) format.sample_rate
+    if (!compensated_ && inPtr->sample_rate == (int) format.sample_rate
         && inPtr->channels == (int) format.nb_channels
         && (AVSampleFormat) inPtr->format == format.sampleFormat) {
         return std::move(in);
@@ -199,6 +503,7 @@ Resampler::resample(std::shared_ptr<AudioFrame>&& in, const AudioFormat& format)
     auto output = std::make_shared<AudioFrame>(format);
     if (auto outPtr = output->pointer()) {
         resample(inPtr, outPtr);
+        jami_tracepoint(media_frame_link, inPtr, outPtr);
         output->has_voice = in->has_voice;
         return output;
     }
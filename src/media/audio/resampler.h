@@ -26,6 +26,9 @@
 #include "media_buffer.h"
 #include "noncopyable.h"
 
+#include <memory>
+#include <vector>
+
 extern "C" {
 struct AVFrame;
 struct SwrContext;
@@ -35,6 +38,10 @@ namespace jami {
 
 /**
  * @brief Wrapper class for libswresample
+ *
+ * Conversions of 16 bits samples between rates with an integer ratio (e.g. 48 kHz to 16 or 8 kHz
+ * and back) use a vectorized polyphase filter instead. Frames differing only by an unset channel
+ * layout are passed through.
  */
 class Resampler
 {
@@ -66,32 +73,57 @@ public:
      */
     std::shared_ptr<AudioFrame> resample(std::shared_ptr<AudioFrame>&& in, const AudioFormat& out);
 
+    /**
+     * @brief Stretch (or shrink if negative) the output by @sampleDelta samples over the next
+     * @distance output samples.
+     *
+     * Compensates a drift between the clocks of the input and of the output. From then on,
+     * frames go through libswresample even when their formats are the same, or when a fixed
+     * ratio filter could be used.
+     */
+    void setCompensation(int sampleDelta, int distance);
+
 private:
     NON_COPYABLE(Resampler);
 
+    struct Route;
+    class FixedRatio;
+    struct Context;
+
     /**
-     * @brief Reinitializes filter according to new format.
+     * @brief Selects the context converting @in to @out, creating it if needed.
      *
-     * Reinitializes the resampler when new settings are detected. As long as both input and
-     * output formats don't change, this will only be called once.
+     * Contexts of the routes used recently are kept, so that inputs alternating between formats
+     * (e.g. the participants of a conference) don't reinitialize libswresample at each frame.
      */
     void reinit(const AVFrame* in, const AVFrame* out);
 
     /**
-     * @brief Libswresample resampler context.
+     * @brief Allocates and initializes a libswresample context converting @in to @out.
      *
      * NOTE SwrContext is an imcomplete type and cannot be stored in a smart pointer.
      */
-    SwrContext* swrCtx_;
+    static SwrContext* createSwrContext(const AVFrame* in, const AVFrame* out);
 
     /**
-     * @brief Number of times @swrCtx_ has been initialized with no successful audio resampling.
+     * @brief Contexts of the last routes, the current one first, at most MAX_CONTEXTS.
+     */
+    std::vector<std::unique_ptr<Context>> contexts_;
+
+    /**
+     * @brief Number of times the libswresample context of the current route has been
+     * initialized with no successful audio resampling.
      *
      * 0: Uninitialized
      * 1: Initialized
      * >1: Invalid frames or formats, reinit is going to be called in an infinite loop
      */
     unsigned initCount_;
+
+    /**
+     * @brief Whether setCompensation was called, to keep the delay of the filter constant.
+     */
+    bool compensated_ {false};
 };
 
 } // namespace jami
@@ -28,8 +28,11 @@
 #include "client/ring_signal.h"
 #include "media_buffer.h"
 #include "libav_deps.h"
+#include "libav_utils.h"
+#include "metrics.h"
 
 #include <chrono>
+#include <cinttypes>
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
@@ -41,119 +44,210 @@ static const size_t MIN_BUFFER_SIZE = 1024;
 
 static constexpr const int RMS_SIGNAL_INTERVAL = 5;
 
-RingBuffer::RingBuffer(const std::string& rbuf_id, size_t /*size*/, AudioFormat format)
+static metrics::Gauge&
+bufferedBytes()
+{
+    static auto& gauge = metrics::memoryBytes("ringbuffers");
+    return gauge;
+}
+
+static int64_t
+frameBytes(const std::shared_ptr<AudioFrame>& frame)
+{
+    if (not frame)
+        return 0;
+    auto f = frame->pointer();
+    auto size = av_samples_get_buffer_size(nullptr,
+                                           f->channels,
+                                           f->nb_samples,
+                                           static_cast<AVSampleFormat>(f->format),
+                                           1);
+    return std::max(size, 0);
+}
+
+RingBuffer::RingBuffer(const std::string& rbuf_id, size_t /*size*/, AudioFormat format, Mode mode)
     : id(rbuf_id)
-    , endPos_(0)
+    , mode_(mode)
     , format_(format)
     , lock_()
     , not_empty_()
-    , readoffsets_()
     , resizer_(format_, format_.sample_rate / 50, [this](std::shared_ptr<AudioFrame>&& frame) {
         putToBuffer(std::move(frame));
     })
 {
-    JAMI_INFO("Create new RingBuffer %s", id.c_str());
+    JAMI_INFO("Create new %sRingBuffer %s", mode_ == Mode::LOCK_FREE ? "lock-free " : "", id.c_str());
 }
 
 RingBuffer::~RingBuffer()
 {
     JAMI_INFO("Destroy RingBuffer %s", id.c_str());
+    int64_t bytes = 0;
+    for (const auto& frame : buffer_)
+        bytes += frameBytes(frame.load());
+    bufferedBytes().add(-bytes);
+}
+
+std::unique_lock<std::mutex>
+RingBuffer::lockIfNeeded() const
+{
+    if (mode_ == Mode::LOCKED)
+        return std::unique_lock<std::mutex>(lock_);
+    return std::unique_lock<std::mutex>(lock_, std::defer_lock);
+}
+
+RingBuffer::ReaderRef<RingBuffer::ReadOffset>
+RingBuffer::getReader(ReadHandle handle)
+{
+    if (handle == INVALID_HANDLE)
+        return {};
+    return {readoffsets_[handle % MAX_READERS], handle / MAX_READERS};
+}
+
+RingBuffer::ReaderRef<const RingBuffer::ReadOffset>
+RingBuffer::getReader(ReadHandle handle) const
+{
+    if (handle == INVALID_HANDLE)
+        return {};
+    return {readoffsets_[handle % MAX_READERS], handle / MAX_READERS};
+}
+
+RingBuffer::ReadHandle
+RingBuffer::getReadHandle(const std::string& call_id) const
+{
+    std::lock_guard<std::mutex> l(lock_);
+    auto iter = readHandles_.find(call_id);
+    return iter != readHandles_.end() ? iter->second : INVALID_HANDLE;
+}
+
+size_t
+RingBuffer::readOffsetCount() const
+{
+    std::lock_guard<std::mutex> l(lock_);
+    return readHandles_.size();
 }
 
 void
 RingBuffer::flush(const std::string& call_id)
 {
-    storeReadOffset(endPos_, call_id);
+    flush(getReadHandle(call_id));
+}
+
+void
+RingBuffer::flush(ReadHandle handle)
+{
+    auto l = lockIfNeeded();
+    if (auto reader = getReader(handle))
+        reader->offset.store(endPos_.load());
 }
 
 void
 RingBuffer::flushAll()
 {
-    for (auto& offset : readoffsets_)
-        offset.second.offset = endPos_;
+    auto l = lockIfNeeded();
+    const auto end = endPos_.load();
+    const auto readersEnd = readersEnd_.load();
+    for (size_t i = 0; i < readersEnd; ++i)
+        if (readoffsets_[i].active)
+            readoffsets_[i].offset.store(end);
 }
 
 size_t
 RingBuffer::putLength() const
 {
-    const size_t buffer_size = buffer_.size();
-    if (buffer_size == 0)
-        return 0;
-    const size_t startPos = getSmallestReadOffset();
-    return (endPos_ + buffer_size - startPos) % buffer_size;
+    auto l = lockIfNeeded();
+    return endPos_.load() - getSmallestReadOffset();
 }
 
 size_t
 RingBuffer::getLength(const std::string& call_id) const
 {
-    const size_t buffer_size = buffer_.size();
-    if (buffer_size == 0)
-        return 0;
-    return (endPos_ + buffer_size - getReadOffset(call_id)) % buffer_size;
+    return getLength(getReadHandle(call_id));
 }
 
-void
-RingBuffer::debug()
+size_t
+RingBuffer::getLength(ReadHandle handle) const
 {
-    JAMI_DBG("Start=%zu; End=%zu; BufferSize=%zu", getSmallestReadOffset(), endPos_, buffer_.size());
+    auto l = lockIfNeeded();
+    auto reader = getReader(handle);
+    if (not reader)
+        return 0;
+    const auto offset = reader->offset.load();
+    const auto end = endPos_.load();
+    return end > offset ? end - offset : 0;
 }
 
-size_t
-RingBuffer::getReadOffset(const std::string& call_id) const
+void
+RingBuffer::debug()
 {
-    auto iter = readoffsets_.find(call_id);
-    return (iter != readoffsets_.end()) ? iter->second.offset : 0;
+    JAMI_DBG("Start=%" PRIu64 "; End=%" PRIu64 "; BufferSize=%zu",
+             getSmallestReadOffset(),
+             endPos_.load(),
+             buffer_.size());
 }
 
-size_t
+uint64_t
 RingBuffer::getSmallestReadOffset() const
 {
-    if (hasNoReadOffsets())
-        return 0;
-    size_t smallest = buffer_.size();
-    for (auto const& iter : readoffsets_)
-        smallest = std::min(smallest, iter.second.offset);
+    const auto end = endPos_.load();
+    auto smallest = end;
+    const auto readersEnd = readersEnd_.load();
+    for (size_t i = 0; i < readersEnd; ++i)
+        if (readoffsets_[i].active)
+            smallest = std::min(smallest, readoffsets_[i].offset.load());
     return smallest;
 }
 
 void
-RingBuffer::storeReadOffset(size_t offset, const std::string& call_id)
+RingBuffer::createReadOffset(const std::string& call_id)
 {
-    ReadOffsetMap::iterator iter = readoffsets_.find(call_id);
-
-    if (iter != readoffsets_.end())
-        iter->second.offset = offset;
-    else
-        JAMI_ERR("RingBuffer::storeReadOffset() failed: unknown call '%s'", call_id.c_str());
+    createReadOffset(call_id, {});
 }
 
 void
-RingBuffer::createReadOffset(const std::string& call_id)
+RingBuffer::createReadOffset(const std::string& call_id, FrameCallback cb)
 {
     std::lock_guard<std::mutex> l(lock_);
-    if (!hasThisReadOffset(call_id))
-        readoffsets_.emplace(call_id, ReadOffset {endPos_, {}});
+    if (readHandles_.find(call_id) != readHandles_.end())
+        return;
+
+    // Not a slot still used through the handle of a removed read offset
+    size_t index = 0;
+    while (index < MAX_READERS and (readoffsets_[index].active or readoffsets_[index].users))
+        ++index;
+    if (index == MAX_READERS) {
+        JAMI_ERR("RingBuffer %s: too many read offsets, can't add '%s'",
+                 id.c_str(),
+                 call_id.c_str());
+        return;
+    }
+
+    auto& reader = readoffsets_[index];
+    if (cb)
+        ++callbacks_;
+    reader.callback = std::move(cb);
+    reader.offset.store(endPos_.load());
+    const auto generation = ++reader.generation;
+    reader.active = true;
+    readHandles_.emplace(call_id, generation * MAX_READERS + index);
+    if (index >= readersEnd_)
+        readersEnd_.store(index + 1);
 }
 
 void
 RingBuffer::removeReadOffset(const std::string& call_id)
 {
     std::lock_guard<std::mutex> l(lock_);
-    auto iter = readoffsets_.find(call_id);
-    if (iter != readoffsets_.end())
-        readoffsets_.erase(iter);
-}
-
-bool
-RingBuffer::hasThisReadOffset(const std::string& call_id) const
-{
-    return readoffsets_.find(call_id) != readoffsets_.end();
-}
+    auto iter = readHandles_.find(call_id);
+    if (iter == readHandles_.end())
+        return;
 
-bool
-RingBuffer::hasNoReadOffsets() const
-{
-    return readoffsets_.empty();
+    auto& reader = readoffsets_[iter->second % MAX_READERS];
+    reader.active = false;
+    if (reader.callback) {
+        --callbacks_;
+        reader.callback = {};
+    }
+    readHandles_.erase(iter);
 }
 
 //
@@ -164,29 +258,42 @@ void
 RingBuffer::put(std::shared_ptr<AudioFrame>&& data)
 {
     std::lock_guard<std::mutex> l(writeLock_);
-    resizer_.enqueue(resampler_.resample(std::move(data), format_));
+    if (data and data->getFormat() != format_ and silence_.silent(*data)) {
+        // Not worth resampling: the same duration of silence, in the format of the buffer
+        silenceSamples_ += (int64_t) data->pointer()->nb_samples * format_.sample_rate;
+        const auto inRate = data->pointer()->sample_rate;
+        const auto samples = silenceSamples_ / inRate;
+        silenceSamples_ %= inRate;
+        if (samples == 0)
+            return;
+        auto silence = std::make_shared<AudioFrame>(format_, samples);
+        libav_utils::fillWithSilence(silence->pointer());
+        silence->has_voice = false;
+        data = std::move(silence);
+    } else {
+        silenceSamples_ = 0;
+        data = resampler_.resample(std::move(data), format_);
+    }
+    resizer_.enqueue(std::move(data));
 }
 
 // This one puts some data inside the ring buffer.
+// Called with writeLock_ held, so there is only one writer at a time.
 void
 RingBuffer::putToBuffer(std::shared_ptr<AudioFrame>&& data)
 {
-    std::lock_guard<std::mutex> l(lock_);
+    auto l = lockIfNeeded();
     const size_t buffer_size = buffer_.size();
     if (buffer_size == 0)
         return;
 
-    size_t len = buffer_size - putLength();
-    if (len == 0)
-        discard(1);
-
-    size_t pos = endPos_;
-
-    buffer_[pos] = std::move(data);
-    const auto& newBuf = buffer_[pos];
-    pos = (pos + 1) % buffer_size;
+    makeRoom();
 
-    endPos_ = pos;
+    const auto pos = endPos_.load(std::memory_order_relaxed);
+    const std::shared_ptr<AudioFrame> newBuf = data;
+    auto oldBuf = buffer_[pos % buffer_size].exchange(std::move(data));
+    bufferedBytes().add(frameBytes(newBuf) - frameBytes(oldBuf));
+    endPos_.store(pos + 1);
 
     if (rmsSignal_) {
         ++rmsFrameCount_;
@@ -198,14 +305,44 @@ RingBuffer::putToBuffer(std::shared_ptr<AudioFrame>&& data)
         }
     }
 
-    for (auto& offset : readoffsets_) {
-        if (offset.second.callback)
-            offset.second.callback(newBuf);
+    // In lock-free mode, only take the lock if someone needs it
+    if (not l.owns_lock()) {
+        if (callbacks_ == 0 and waiters_ == 0)
+            return;
+        l.lock();
+    }
+
+    if (callbacks_ > 0) {
+        const auto readersEnd = readersEnd_.load();
+        for (size_t i = 0; i < readersEnd; ++i) {
+            const auto& reader = readoffsets_[i];
+            if (reader.active and reader.callback)
+                reader.callback(newBuf);
+        }
     }
 
     not_empty_.notify_all();
 }
 
+void
+RingBuffer::makeRoom()
+{
+    // After the next write, a reader can't be more than buffer_size frames late
+    const auto end = endPos_.load(std::memory_order_relaxed) + 1;
+    const uint64_t buffer_size = buffer_.size();
+    if (end <= buffer_size)
+        return;
+    const auto oldest = end - buffer_size;
+    const auto readersEnd = readersEnd_.load();
+    for (size_t i = 0; i < readersEnd; ++i) {
+        auto& reader = readoffsets_[i];
+        if (not reader.active.load(std::memory_order_acquire))
+            continue;
+        auto offset = reader.offset.load();
+        while (offset < oldest and not reader.offset.compare_exchange_weak(offset, oldest)) {}
+    }
+}
+
 //
 // For the reader only:
 //
@@ -217,56 +354,81 @@ RingBuffer::availableForGet(const std::string& call_id) const
     return getLength(call_id);
 }
 
+size_t
+RingBuffer::availableForGet(ReadHandle handle) const
+{
+    return getLength(handle);
+}
+
 std::shared_ptr<AudioFrame>
 RingBuffer::get(const std::string& call_id)
 {
-    std::lock_guard<std::mutex> l(lock_);
+    return get(getReadHandle(call_id));
+}
 
-    auto offset = readoffsets_.find(call_id);
-    if (offset == readoffsets_.end())
+std::shared_ptr<AudioFrame>
+RingBuffer::get(ReadHandle handle)
+{
+    auto l = lockIfNeeded();
+    auto reader = getReader(handle);
+    if (not reader)
         return {};
+    return getFrom(*reader);
+}
 
+std::shared_ptr<AudioFrame>
+RingBuffer::getFrom(ReadOffset& reader)
+{
     const size_t buffer_size = buffer_.size();
     if (buffer_size == 0)
         return {};
 
-    size_t startPos = offset->second.offset;
-    size_t len = (endPos_ + buffer_size - startPos) % buffer_size;
-    if (len == 0)
-        return {};
-
-    auto ret = buffer_[startPos];
-    offset->second.offset = (startPos + 1) % buffer_size;
-    return ret;
+    auto offset = reader.offset.load();
+    while (offset < endPos_.load()) {
+        auto ret = buffer_[offset % buffer_size].load();
+        // If the writer moved us forward meanwhile, the slot may have been overwritten: retry
+        if (reader.offset.compare_exchange_weak(offset, offset + 1))
+            return ret;
+    }
+    return {};
 }
 
 size_t
 RingBuffer::waitForDataAvailable(const std::string& call_id, const time_point& deadline) const
+{
+    return waitForDataAvailable(getReadHandle(call_id), deadline);
+}
+
+size_t
+RingBuffer::waitForDataAvailable(ReadHandle handle, const time_point& deadline) const
 {
     std::unique_lock<std::mutex> l(lock_);
 
     if (buffer_.empty())
         return 0;
-    if (readoffsets_.find(call_id) == readoffsets_.end())
+    const auto reader = getReader(handle);
+    if (not reader)
         return 0;
 
     size_t getl = 0;
-    auto check = [=, &getl] {
-        // Re-find read_ptr: it may be destroyed during the wait
-        const size_t buffer_size = buffer_.size();
-        const auto read_ptr = readoffsets_.find(call_id);
-        if (buffer_size == 0 || read_ptr == readoffsets_.end())
+    auto check = [&] {
+        // The read offset may be removed during the wait
+        if (not reader->active)
             return true;
-        getl = (endPos_ + buffer_size - read_ptr->second.offset) % buffer_size;
+        const auto offset = reader->offset.load();
+        const auto end = endPos_.load();
+        getl = end > offset ? end - offset : 0;
         return getl != 0;
     };
 
+    ++waiters_;
     if (deadline == time_point::max()) {
         // no timeout provided, wait as long as necessary
         not_empty_.wait(l, check);
     } else {
         not_empty_.wait_until(l, deadline, check);
     }
+    --waiters_;
 
     return getl;
 }
@@ -274,36 +436,25 @@ RingBuffer::waitForDataAvailable(const std::string& call_id, const time_point& d
 size_t
 RingBuffer::discard(size_t toDiscard, const std::string& call_id)
 {
-    std::lock_guard<std::mutex> l(lock_);
-
-    const size_t buffer_size = buffer_.size();
-    if (buffer_size == 0)
-        return 0;
-
-    auto offset = readoffsets_.find(call_id);
-    if (offset == readoffsets_.end())
-        return 0;
-
-    size_t len = (endPos_ + buffer_size - offset->second.offset) % buffer_size;
-    toDiscard = std::min(toDiscard, len);
-
-    offset->second.offset = (offset->second.offset + toDiscard) % buffer_size;
-    return toDiscard;
+    return discard(toDiscard, getReadHandle(call_id));
 }
 
 size_t
-RingBuffer::discard(size_t toDiscard)
+RingBuffer::discard(size_t toDiscard, ReadHandle handle)
 {
-    const size_t buffer_size = buffer_.size();
-    if (buffer_size == 0)
+    auto l = lockIfNeeded();
+    auto reader = getReader(handle);
+    if (not reader)
         return 0;
 
-    for (auto& r : readoffsets_) {
-        size_t dst = (r.second.offset + buffer_size - endPos_) % buffer_size;
-        if (dst < toDiscard)
-            r.second.offset = (r.second.offset + toDiscard - dst) % buffer_size;
-    }
-    return toDiscard;
+    auto offset = reader->offset.load();
+    uint64_t next;
+    do {
+        next = std::min<uint64_t>(offset + toDiscard, endPos_.load());
+        if (next <= offset)
+            return 0;
+    } while (not reader->offset.compare_exchange_weak(offset, next));
+    return next - offset;
 }
 
 } // namespace jami
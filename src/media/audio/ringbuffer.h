@@ -24,14 +24,18 @@
 #pragma once
 
 #include "audiobuffer.h"
+#include "atomic_shared_ptr.h"
 #include "noncopyable.h"
 #include "audio_frame_resizer.h"
 #include "resampler.h"
+#include "silence_detector.h"
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <chrono>
+#include <limits>
 #include <map>
 #include <vector>
 #include <fstream>
@@ -48,11 +52,37 @@ public:
     using time_point = clock::time_point;
     using FrameCallback = std::function<void(const std::shared_ptr<AudioFrame>&)>;
 
+    /**
+     * Synchronization between the writer and the readers.
+     * LOCKED: every access is serialized on the buffer mutex.
+     * LOCK_FREE: writes are published through an atomic head and each reader
+     * advances its own atomic cursor, so readers never block the writer
+     * (and vice versa). Writers are still serialized between themselves.
+     */
+    enum class Mode { LOCKED, LOCK_FREE };
+
+    /**
+     * Slot and generation of a read offset, valid until the read offset is removed.
+     * Obtained with getReadHandle() to avoid the call id lookup on hot paths.
+     * The handle of a removed read offset stays invalid once its slot is reused,
+     * and a slot is not reused while a call through one of its handles is running.
+     */
+    using ReadHandle = size_t;
+    static constexpr ReadHandle INVALID_HANDLE = std::numeric_limits<ReadHandle>::max();
+
+    /**
+     * Maximum number of read offsets per ring buffer
+     */
+    static constexpr size_t MAX_READERS = 128;
+
     /**
      * Constructor
      * @param size  Size of the buffer to create
      */
-    RingBuffer(const std::string& id, size_t size, AudioFormat format = AudioFormat::MONO());
+    RingBuffer(const std::string& id,
+               size_t size,
+               AudioFormat format = AudioFormat::MONO(),
+               Mode mode = Mode::LOCKED);
 
     /**
      * Destructor
@@ -61,10 +91,13 @@ public:
 
     const std::string& getId() const { return id; }
 
+    Mode getMode() const { return mode_; }
+
     /**
      * Reset the counters to 0 for this read offset
      */
     void flush(const std::string& call_id);
+    void flush(ReadHandle handle);
 
     void flushAll();
 
@@ -74,7 +107,17 @@ public:
     {
         std::lock_guard<std::mutex> l(writeLock_);
         format_ = format;
-        resizer_.setFormat(format, format.sample_rate / 50);
+        resizer_.setFormat(format, format.sample_rate * frameDuration_.count() / 1000);
+    }
+
+    /**
+     * Duration of the frames returned to the readers, 20 ms by default
+     */
+    inline void setFrameDuration(std::chrono::milliseconds duration)
+    {
+        std::lock_guard<std::mutex> l(writeLock_);
+        frameDuration_ = duration;
+        resizer_.setFrameSize(format_.sample_rate * duration.count() / 1000);
     }
 
     /**
@@ -89,7 +132,12 @@ public:
      */
     void removeReadOffset(const std::string& call_id);
 
-    size_t readOffsetCount() const { return readoffsets_.size(); }
+    /**
+     * Return the handle of the read offset of call_id or INVALID_HANDLE
+     */
+    ReadHandle getReadHandle(const std::string& call_id) const;
+
+    size_t readOffsetCount() const;
 
     /**
      * Write data in the ring buffer
@@ -103,6 +151,7 @@ public:
      * @return int The available (multichannel) samples number
      */
     size_t availableForGet(const std::string& call_id) const;
+    size_t availableForGet(ReadHandle handle) const;
 
     /**
      * Get data in the ring buffer
@@ -111,6 +160,7 @@ public:
      * @return size_t Number of bytes copied
      */
     std::shared_ptr<AudioFrame> get(const std::string& call_id);
+    std::shared_ptr<AudioFrame> get(ReadHandle handle);
 
     /**
      * Discard data from the buffer
@@ -118,6 +168,7 @@ public:
      * @return size_t Number of samples discarded
      */
     size_t discard(size_t toDiscard, const std::string& call_id);
+    size_t discard(size_t toDiscard, ReadHandle handle);
 
     /**
      * Total length of the ring buffer which is available for "putting"
@@ -126,6 +177,7 @@ public:
     size_t putLength() const;
 
     size_t getLength(const std::string& call_id) const;
+    size_t getLength(ReadHandle handle) const;
 
     inline bool isFull() const { return putLength() == buffer_.size(); }
 
@@ -144,6 +196,8 @@ public:
      */
     size_t waitForDataAvailable(const std::string& call_id,
                                 const time_point& deadline = time_point::max()) const;
+    size_t waitForDataAvailable(ReadHandle handle,
+                                const time_point& deadline = time_point::max()) const;
 
     /**
      * Debug function print mEnd, mStart, mBufferSize
@@ -154,60 +208,106 @@ public:
     void setAudioMeterState(bool state) { rmsSignal_ = state; }
 
 private:
+    /**
+     * Read cursors are monotonic frame counters (slot is cursor % buffer size),
+     * so the writer can push a lagging reader forward with a CAS without ABA issues.
+     */
     struct ReadOffset
     {
-        size_t offset;
+        std::atomic<uint64_t> offset {0};
+        std::atomic_bool active {false};
+        // Incremented each time the slot is used by a new read offset
+        std::atomic<size_t> generation {0};
+        // Calls running through a handle of the slot
+        mutable std::atomic<unsigned> users {0};
         FrameCallback callback;
     };
-    using ReadOffsetMap = std::map<std::string, ReadOffset>;
+
+    /**
+     * Read offset of a handle, whose slot is not reused while referenced
+     */
+    template<typename T>
+    class ReaderRef
+    {
+    public:
+        ReaderRef() = default;
+        ReaderRef(T& reader, size_t generation)
+            : reader_(&reader)
+        {
+            // Before checking the slot, for a new read offset to not take it meanwhile
+            ++reader.users;
+            if (not reader.active or reader.generation != generation) {
+                --reader.users;
+                reader_ = nullptr;
+            }
+        }
+        ~ReaderRef()
+        {
+            if (reader_)
+                --reader_->users;
+        }
+        NON_COPYABLE(ReaderRef);
+
+        explicit operator bool() const { return reader_ != nullptr; }
+        T* operator->() const { return reader_; }
+        T& operator*() const { return *reader_; }
+
+    private:
+        T* reader_ {nullptr};
+    };
     NON_COPYABLE(RingBuffer);
 
     void putToBuffer(std::shared_ptr<AudioFrame>&& data);
 
-    bool hasNoReadOffsets() const;
-
     /**
      * Return the smalest readoffset. Useful to evaluate if ringbuffer is full
      */
-    size_t getSmallestReadOffset() const;
+    uint64_t getSmallestReadOffset() const;
 
     /**
-     * Get read offset coresponding to this call
+     * Lock the buffer mutex in LOCKED mode, return a deferred lock otherwise
      */
-    size_t getReadOffset(const std::string& call_id) const;
+    std::unique_lock<std::mutex> lockIfNeeded() const;
 
-    /**
-     * Move readoffset forward by offset
-     */
-    void storeReadOffset(size_t offset, const std::string& call_id);
+    ReaderRef<ReadOffset> getReader(ReadHandle handle);
+    ReaderRef<const ReadOffset> getReader(ReadHandle handle) const;
 
     /**
-     * Test if readoffset coresponding to this call is still active
+     * Pop the next frame of a reader, lock-free with respect to the writer
      */
-    bool hasThisReadOffset(const std::string& call_id) const;
+    std::shared_ptr<AudioFrame> getFrom(ReadOffset& reader);
 
     /**
      * Discard data from all read offsets to make place for new data.
      */
-    size_t discard(size_t toDiscard);
+    void makeRoom();
 
     const std::string id;
+    const Mode mode_;
 
-    /** Offset on the last data */
-    size_t endPos_;
+    /** Number of frames written so far */
+    std::atomic<uint64_t> endPos_ {0};
 
     /** Data */
     AudioFormat format_ {AudioFormat::DEFAULT()};
-    std::vector<std::shared_ptr<AudioFrame>> buffer_ {16};
+    std::chrono::milliseconds frameDuration_ {20};
+    std::vector<AtomicSharedPtr<AudioFrame>> buffer_ = std::vector<AtomicSharedPtr<AudioFrame>>(16);
 
     mutable std::mutex lock_;
     mutable std::condition_variable not_empty_;
+    mutable std::atomic<unsigned> waiters_ {0};
     std::mutex writeLock_;
 
-    ReadOffsetMap readoffsets_;
+    std::array<ReadOffset, MAX_READERS> readoffsets_;
+    std::map<std::string, ReadHandle> readHandles_;
+    std::atomic<size_t> readersEnd_ {0};
+    std::atomic<unsigned> callbacks_ {0};
 
     Resampler resampler_;
     AudioFrameResizer resizer_;
+    // Silent frames of another format are replaced instead of resampled
+    SilenceDetector silence_;
+    int64_t silenceSamples_ {0};
 
     std::atomic_bool rmsSignal_ {false};
     double rmsLevel_ {0};
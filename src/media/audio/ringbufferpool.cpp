@@ -21,8 +21,11 @@
 
 #include "ringbufferpool.h"
 #include "ringbuffer.h"
+#include "audio_profiler.h"
 #include "ring_types.h" // for SIZEBUF
 #include "logger.h"
+#include "metrics.h"
+#include "tracepoint.h"
 
 #include <limits>
 #include <utility> // for std::pair
@@ -34,12 +37,14 @@ namespace jami {
 const char* const RingBufferPool::DEFAULT_ID = "audiolayer_id";
 
 RingBufferPool::RingBufferPool()
-    : defaultRingBuffer_(createRingBuffer(DEFAULT_ID))
+    : defaultRingBuffer_(createRingBuffer(DEFAULT_ID, RingBuffer::Mode::LOCK_FREE))
 {}
 
 RingBufferPool::~RingBufferPool()
 {
-    readBindingsMap_.clear();
+    readerIndex_.clear();
+    for (auto& reader : readers_)
+        reader.bindings.store({});
     defaultRingBuffer_.reset();
 
     // Verify ringbuffer not removed yet
@@ -76,6 +81,21 @@ RingBufferPool::setInternalAudioFormat(AudioFormat format)
     }
 }
 
+void
+RingBufferPool::setFrameDuration(std::chrono::milliseconds duration)
+{
+    std::lock_guard<std::recursive_mutex> lk(stateLock_);
+
+    if (duration != frameDuration_.load()) {
+        JAMI_DBG("Ring buffers frame duration: %lld ms", (long long) duration.count());
+        frameDuration_ = duration;
+        for (auto& wrb : ringBufferMap_)
+            if (auto rb = wrb.second.lock())
+                rb->setFrameDuration(duration);
+        flushAllBuffers();
+    }
+}
+
 std::shared_ptr<RingBuffer>
 RingBufferPool::getRingBuffer(const std::string& id)
 {
@@ -104,7 +124,7 @@ RingBufferPool::getRingBuffer(const std::string& id) const
 }
 
 std::shared_ptr<RingBuffer>
-RingBufferPool::createRingBuffer(const std::string& id)
+RingBufferPool::createRingBuffer(const std::string& id, RingBuffer::Mode mode)
 {
     std::lock_guard<std::recursive_mutex> lk(stateLock_);
 
@@ -114,61 +134,143 @@ RingBufferPool::createRingBuffer(const std::string& id)
         return rbuf;
     }
 
-    rbuf.reset(new RingBuffer(id, SIZEBUF, internalAudioFormat_));
+    rbuf.reset(new RingBuffer(id, SIZEBUF, internalAudioFormat_, mode));
+    if (frameDuration_.load() != std::chrono::milliseconds(20))
+        rbuf->setFrameDuration(frameDuration_.load());
     ringBufferMap_.emplace(id, std::weak_ptr<RingBuffer>(rbuf));
     return rbuf;
 }
 
-const RingBufferPool::ReadBindings*
+static constexpr unsigned BINDING_INDEX_BITS = 32;
+
+static inline size_t
+bindingIndex(RingBufferPool::BindingHandle handle)
+{
+    return handle & ((RingBufferPool::BindingHandle(1) << BINDING_INDEX_BITS) - 1);
+}
+
+static inline uint32_t
+bindingGeneration(RingBufferPool::BindingHandle handle)
+{
+    return handle >> BINDING_INDEX_BITS;
+}
+
+std::shared_ptr<const RingBufferPool::ReadBindings>
 RingBufferPool::getReadBindings(const std::string& call_id) const
 {
-    const auto& iter = readBindingsMap_.find(call_id);
-    return iter != readBindingsMap_.cend() ? &iter->second : nullptr;
+    const auto& iter = readerIndex_.find(call_id);
+    return iter != readerIndex_.cend() ? readers_[iter->second].bindings.load() : nullptr;
+}
+
+std::shared_ptr<const RingBufferPool::ReadBindings>
+RingBufferPool::getReadBindings(BindingHandle handle) const
+{
+    const auto index = bindingIndex(handle);
+    if (index >= MAX_BINDINGS)
+        return {};
+
+    // A slot may be released and reused while we read it: check the
+    // generation before and after loading the bindings.
+    const auto& reader = readers_[index];
+    const auto generation = bindingGeneration(handle);
+    if (reader.generation.load(std::memory_order_acquire) != generation)
+        return {};
+    auto bindings = reader.bindings.load();
+    if (reader.generation.load(std::memory_order_acquire) != generation)
+        return {};
+    return bindings;
 }
 
-RingBufferPool::ReadBindings*
-RingBufferPool::getReadBindings(const std::string& call_id)
+RingBufferPool::BindingHandle
+RingBufferPool::getBindingHandle(const std::string& call_id) const
 {
-    const auto& iter = readBindingsMap_.find(call_id);
-    return iter != readBindingsMap_.cend() ? &iter->second : nullptr;
+    std::lock_guard<std::recursive_mutex> lk(stateLock_);
+
+    const auto& iter = readerIndex_.find(call_id);
+    if (iter == readerIndex_.cend())
+        return INVALID_BINDING;
+    return (BindingHandle(readers_[iter->second].generation.load()) << BINDING_INDEX_BITS)
+           | iter->second;
 }
 
-void
-RingBufferPool::removeReadBindings(const std::string& call_id)
+bool
+RingBufferPool::isValid(BindingHandle handle) const
 {
-    if (not readBindingsMap_.erase(call_id))
-        JAMI_ERR("CallID set %s does not exist!", call_id.c_str());
+    return handle != INVALID_BINDING and getReadBindings(handle) != nullptr;
 }
 
 /**
  * Make given call ID a reader of given ring buffer
  */
-void
+RingBufferPool::BindingHandle
 RingBufferPool::addReaderToRingBuffer(const std::shared_ptr<RingBuffer>& rbuf,
                                       const std::string& call_id)
 {
     if (call_id != DEFAULT_ID and rbuf->getId() == call_id)
         JAMI_WARN("RingBuffer has a readoffset on itself");
 
+    auto iter = readerIndex_.find(call_id);
+    if (iter == readerIndex_.end()) {
+        // bindings list created if not existing
+        size_t index = 0;
+        while (index < MAX_BINDINGS and readers_[index].bindings.load())
+            ++index;
+        if (index == MAX_BINDINGS) {
+            JAMI_ERR("Too many readers, can't bind callid '%s'", call_id.c_str());
+            return INVALID_BINDING;
+        }
+        iter = readerIndex_.emplace(call_id, index).first;
+        ++readers_[index].generation;
+        readers_[index].bindings.store(std::make_shared<const ReadBindings>());
+    }
+
+    auto& reader = readers_[iter->second];
+    const BindingHandle handle = (BindingHandle(reader.generation.load()) << BINDING_INDEX_BITS)
+                                 | iter->second;
+
+    const auto current = reader.bindings.load();
+    for (const auto& binding : *current)
+        if (binding.rbuf == rbuf)
+            return handle;
+
     rbuf->createReadOffset(call_id);
-    readBindingsMap_[call_id].insert(rbuf); // bindings list created if not existing
+    auto readHandle = rbuf->getReadHandle(call_id);
+    if (readHandle == RingBuffer::INVALID_HANDLE)
+        return handle;
+
+    auto bindings = std::make_shared<ReadBindings>(*current);
+    bindings->emplace_back(ReadBinding {rbuf, readHandle});
+    reader.bindings.store(std::shared_ptr<const ReadBindings>(std::move(bindings)));
     JAMI_DBG("Bind rbuf '%s' to callid '%s'", rbuf->getId().c_str(), call_id.c_str());
+    return handle;
 }
 
 void
 RingBufferPool::removeReaderFromRingBuffer(const std::shared_ptr<RingBuffer>& rbuf,
                                            const std::string& call_id)
 {
-    if (auto bindings = getReadBindings(call_id)) {
-        bindings->erase(rbuf);
-        if (bindings->empty())
-            removeReadBindings(call_id);
+    auto iter = readerIndex_.find(call_id);
+    if (iter != readerIndex_.end()) {
+        auto& reader = readers_[iter->second];
+        auto bindings = std::make_shared<ReadBindings>(*reader.bindings.load());
+        bindings->erase(std::remove_if(bindings->begin(),
+                                       bindings->end(),
+                                       [&](const ReadBinding& b) { return b.rbuf == rbuf; }),
+                        bindings->end());
+        if (bindings->empty()) {
+            // Invalidate handles before releasing the slot
+            ++reader.generation;
+            reader.bindings.store(std::shared_ptr<const ReadBindings>());
+            readerIndex_.erase(iter);
+        } else {
+            reader.bindings.store(std::shared_ptr<const ReadBindings>(std::move(bindings)));
+        }
     }
 
     rbuf->removeReadOffset(call_id);
 }
 
-void
+RingBufferPool::BindingHandle
 RingBufferPool::bindCallID(const std::string& call_id1, const std::string& call_id2)
 {
     JAMI_INFO("Bind call %s to call %s", call_id1.c_str(), call_id2.c_str());
@@ -176,22 +278,22 @@ RingBufferPool::bindCallID(const std::string& call_id1, const std::string& call_
     const auto& rb_call1 = getRingBuffer(call_id1);
     if (not rb_call1) {
         JAMI_ERR("No ringbuffer associated with call '%s'", call_id1.c_str());
-        return;
+        return INVALID_BINDING;
     }
 
     const auto& rb_call2 = getRingBuffer(call_id2);
     if (not rb_call2) {
         JAMI_ERR("No ringbuffer associated to call '%s'", call_id2.c_str());
-        return;
+        return INVALID_BINDING;
     }
 
     std::lock_guard<std::recursive_mutex> lk(stateLock_);
 
     addReaderToRingBuffer(rb_call1, call_id2);
-    addReaderToRingBuffer(rb_call2, call_id1);
+    return addReaderToRingBuffer(rb_call2, call_id1);
 }
 
-void
+RingBufferPool::BindingHandle
 RingBufferPool::bindHalfDuplexOut(const std::string& process_id, const std::string& call_id)
 {
     /* This method is used only for active calls, if this call does not exist,
@@ -199,8 +301,9 @@ RingBufferPool::bindHalfDuplexOut(const std::string& process_id, const std::stri
     if (const auto& rb = getRingBuffer(call_id)) {
         std::lock_guard<std::recursive_mutex> lk(stateLock_);
 
-        addReaderToRingBuffer(rb, process_id);
+        return addReaderToRingBuffer(rb, process_id);
     }
+    return INVALID_BINDING;
 }
 
 void
@@ -250,9 +353,8 @@ RingBufferPool::unBindAllHalfDuplexOut(const std::string& call_id)
     if (not bindings)
         return;
 
-    const auto bindings_copy = *bindings; // temporary copy
-    for (const auto& rbuf : bindings_copy) {
-        removeReaderFromRingBuffer(rb_call, rbuf->getId());
+    for (const auto& binding : *bindings) {
+        removeReaderFromRingBuffer(rb_call, binding.rbuf->getId());
     }
 }
 
@@ -273,60 +375,86 @@ RingBufferPool::unBindAll(const std::string& call_id)
     if (not bindings)
         return;
 
-    const auto bindings_copy = *bindings; // temporary copy
-    for (const auto& rbuf : bindings_copy) {
-        removeReaderFromRingBuffer(rbuf, call_id);
-        removeReaderFromRingBuffer(rb_call, rbuf->getId());
+    for (const auto& binding : *bindings) {
+        removeReaderFromRingBuffer(binding.rbuf, call_id);
+        removeReaderFromRingBuffer(rb_call, binding.rbuf->getId());
     }
 }
 
 std::shared_ptr<AudioFrame>
 RingBufferPool::getData(const std::string& call_id)
 {
-    std::lock_guard<std::recursive_mutex> lk(stateLock_);
+    return getData(getBindingHandle(call_id));
+}
 
-    const auto bindings = getReadBindings(call_id);
-    if (not bindings)
+std::shared_ptr<AudioFrame>
+RingBufferPool::getData(BindingHandle handle)
+{
+    const auto bindings = getReadBindings(handle);
+    if (not bindings or bindings->empty())
         return {};
 
+    static auto& underruns = metrics::Registry::instance()
+                                 .counter("jami_ringbuffer_underruns",
+                                          "Reads of bound ring buffers finding no data");
+
     // No mixing
-    if (bindings->size() == 1)
-        return (*bindings->cbegin())->get(call_id);
+    if (bindings->size() == 1) {
+        auto data = bindings->front().rbuf->get(bindings->front().handle);
+        if (not data)
+            underruns.add();
+        else if (AudioProfiler::enabled())
+            AudioProfiler::frameRead(data->pointer());
+        return data;
+    }
 
-    auto mixBuffer = std::make_shared<AudioFrame>(internalAudioFormat_);
-    auto mixed = false;
-    for (const auto& rbuf : *bindings) {
-        if (auto b = rbuf->get(call_id)) {
-            mixed = true;
+    auto profiled = AudioProfiler::enabled();
+    auto mixStart = profiled ? AudioProfiler::clock::now() : AudioProfiler::clock::time_point {};
+    std::shared_ptr<AudioFrame> mixBuffer;
+    for (const auto& binding : *bindings) {
+        if (auto b = binding.rbuf->get(binding.handle)) {
+            if (profiled)
+                AudioProfiler::frameRead(b->pointer());
+            if (not mixBuffer)
+                mixBuffer = std::make_shared<AudioFrame>(b->getFormat());
+            else if (b->pointer()->nb_samples != mixBuffer->pointer()->nb_samples)
+                continue; // queued before a change of the frame duration
             mixBuffer->mix(*b);
+            jami_tracepoint(media_frame_link, b->pointer(), mixBuffer->pointer());
 
             // voice is true if any of mixed frames has voice
             mixBuffer->has_voice |= b->has_voice;
         }
     }
+    if (not mixBuffer)
+        underruns.add();
+    else if (profiled)
+        AudioProfiler::framesMixed(AudioProfiler::clock::now() - mixStart);
 
-    return mixed ? mixBuffer : nullptr;
+    return mixBuffer;
 }
 
 bool
 RingBufferPool::waitForDataAvailable(const std::string& call_id,
                                      const std::chrono::microseconds& max_wait) const
 {
-    std::unique_lock<std::recursive_mutex> lk(stateLock_);
+    return waitForDataAvailable(getBindingHandle(call_id), max_wait);
+}
 
+bool
+RingBufferPool::waitForDataAvailable(BindingHandle handle,
+                                     const std::chrono::microseconds& max_wait) const
+{
     // convert to absolute time
     const auto deadline = std::chrono::high_resolution_clock::now() + max_wait;
 
-    auto bindings = getReadBindings(call_id);
+    const auto bindings = getReadBindings(handle);
     if (not bindings)
-        return 0;
+        return false;
 
-    const auto bindings_copy = *bindings; // temporary copy
-    for (const auto& rbuf : bindings_copy) {
-        lk.unlock();
-        if (rbuf->waitForDataAvailable(call_id, deadline) == 0)
+    for (const auto& binding : *bindings) {
+        if (binding.rbuf->waitForDataAvailable(binding.handle, deadline) == 0)
             return false;
-        lk.lock();
     }
     return true;
 }
@@ -334,28 +462,32 @@ RingBufferPool::waitForDataAvailable(const std::string& call_id,
 std::shared_ptr<AudioFrame>
 RingBufferPool::getAvailableData(const std::string& call_id)
 {
-    std::lock_guard<std::recursive_mutex> lk(stateLock_);
+    return getAvailableData(getBindingHandle(call_id));
+}
 
-    auto bindings = getReadBindings(call_id);
-    if (not bindings)
-        return 0;
+std::shared_ptr<AudioFrame>
+RingBufferPool::getAvailableData(BindingHandle handle)
+{
+    const auto bindings = getReadBindings(handle);
+    if (not bindings or bindings->empty())
+        return {};
 
     // No mixing
-    if (bindings->size() == 1) {
-        return (*bindings->cbegin())->get(call_id);
-    }
-
-    size_t availableFrames = 0;
+    if (bindings->size() == 1)
+        return bindings->front().rbuf->get(bindings->front().handle);
 
-    for (const auto& rbuf : *bindings)
-        availableFrames = std::min(availableFrames, rbuf->availableForGet(call_id));
+    size_t availableFrames = std::numeric_limits<size_t>::max();
+    for (const auto& binding : *bindings)
+        availableFrames = std::min(availableFrames, binding.rbuf->availableForGet(binding.handle));
 
     if (availableFrames == 0)
         return {};
 
-    auto buf = std::make_shared<AudioFrame>(internalAudioFormat_);
-    for (const auto& rbuf : *bindings) {
-        if (auto b = rbuf->get(call_id)) {
+    std::shared_ptr<AudioFrame> buf;
+    for (const auto& binding : *bindings) {
+        if (auto b = binding.rbuf->get(binding.handle)) {
+            if (not buf)
+                buf = std::make_shared<AudioFrame>(b->getFormat());
             buf->mix(*b);
 
             // voice is true if any of mixed frames has voice
@@ -369,21 +501,24 @@ RingBufferPool::getAvailableData(const std::string& call_id)
 size_t
 RingBufferPool::availableForGet(const std::string& call_id) const
 {
-    std::lock_guard<std::recursive_mutex> lk(stateLock_);
+    return availableForGet(getBindingHandle(call_id));
+}
 
-    const auto bindings = getReadBindings(call_id);
-    if (not bindings)
+size_t
+RingBufferPool::availableForGet(BindingHandle handle) const
+{
+    const auto bindings = getReadBindings(handle);
+    if (not bindings or bindings->empty())
         return 0;
 
     // No mixing
-    if (bindings->size() == 1) {
-        return (*bindings->begin())->availableForGet(call_id);
-    }
+    if (bindings->size() == 1)
+        return bindings->front().rbuf->availableForGet(bindings->front().handle);
 
     size_t availableSamples = std::numeric_limits<size_t>::max();
 
-    for (const auto& rbuf : *bindings) {
-        const size_t nbSamples = rbuf->availableForGet(call_id);
+    for (const auto& binding : *bindings) {
+        const size_t nbSamples = binding.rbuf->availableForGet(binding.handle);
         if (nbSamples != 0)
             availableSamples = std::min(availableSamples, nbSamples);
     }
@@ -394,14 +529,18 @@ RingBufferPool::availableForGet(const std::string& call_id) const
 size_t
 RingBufferPool::discard(size_t toDiscard, const std::string& call_id)
 {
-    std::lock_guard<std::recursive_mutex> lk(stateLock_);
+    return discard(toDiscard, getBindingHandle(call_id));
+}
 
-    const auto bindings = getReadBindings(call_id);
+size_t
+RingBufferPool::discard(size_t toDiscard, BindingHandle handle)
+{
+    const auto bindings = getReadBindings(handle);
     if (not bindings)
         return 0;
 
-    for (const auto& rbuf : *bindings)
-        rbuf->discard(toDiscard, call_id);
+    for (const auto& binding : *bindings)
+        binding.rbuf->discard(toDiscard, binding.handle);
 
     return toDiscard;
 }
@@ -409,14 +548,18 @@ RingBufferPool::discard(size_t toDiscard, const std::string& call_id)
 void
 RingBufferPool::flush(const std::string& call_id)
 {
-    std::lock_guard<std::recursive_mutex> lk(stateLock_);
+    flush(getBindingHandle(call_id));
+}
 
-    const auto bindings = getReadBindings(call_id);
+void
+RingBufferPool::flush(BindingHandle handle)
+{
+    const auto bindings = getReadBindings(handle);
     if (not bindings)
         return;
 
-    for (const auto& rbuf : *bindings)
-        rbuf->flush(call_id);
+    for (const auto& binding : *bindings)
+        binding.rbuf->flush(binding.handle);
 }
 
 void
@@ -21,24 +21,41 @@
 
 #pragma once
 
+#include "atomic_shared_ptr.h"
 #include "audiobuffer.h"
 #include "noncopyable.h"
+#include "ringbuffer.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <map>
-#include <set>
 #include <string>
 #include <mutex>
 #include <memory>
+#include <vector>
 
 namespace jami {
 
-class RingBuffer;
-
 class RingBufferPool
 {
 public:
     static const char* const DEFAULT_ID;
 
+    /**
+     * Opaque identifier of a reader and of the ringbuffers it is bound to.
+     * Resolving a handle is a lock-free indexed lookup, meant for the audio paths
+     * that read every few milliseconds. A handle is invalidated when its reader
+     * loses its last binding.
+     */
+    using BindingHandle = uint64_t;
+    static constexpr BindingHandle INVALID_BINDING = 0;
+
+    /**
+     * Maximum number of readers bound at the same time
+     */
+    static constexpr size_t MAX_BINDINGS = 256;
+
     RingBufferPool();
     ~RingBufferPool();
 
@@ -50,18 +67,39 @@ public:
 
     void setInternalAudioFormat(AudioFormat format);
 
+    std::chrono::milliseconds getFrameDuration() const { return frameDuration_.load(); }
+
+    /**
+     * Set the duration of the frames of all the ring buffers, i.e. the period at which their
+     * readers consume them: shorter than the default 20 ms with a low-latency audio device.
+     * Flushes the buffers when it changes.
+     */
+    void setFrameDuration(std::chrono::milliseconds duration);
+
     /**
      * Bind together two audio streams so that a client will be able
      * to put and get data specifying its callid only.
+     * @return the handle used by call_id1 to read its data
      */
-    void bindCallID(const std::string& call_id1, const std::string& call_id2);
+    BindingHandle bindCallID(const std::string& call_id1, const std::string& call_id2);
 
     /**
      * Add a new call_id to unidirectional outgoing stream
      * \param call_id New call id to be added for this stream
      * \param process_id Process that require this stream
+     * @return the handle used by process_id to read its data
+     */
+    BindingHandle bindHalfDuplexOut(const std::string& process_id, const std::string& call_id);
+
+    /**
+     * Return the current handle of a reader, or INVALID_BINDING if it has no binding
      */
-    void bindHalfDuplexOut(const std::string& process_id, const std::string& call_id);
+    BindingHandle getBindingHandle(const std::string& call_id) const;
+
+    /**
+     * Lock-free check that a handle still refers to its reader
+     */
+    bool isValid(BindingHandle handle) const;
 
     /**
      * Unbind two calls
@@ -79,16 +117,22 @@ public:
 
     bool waitForDataAvailable(const std::string& call_id,
                               const std::chrono::microseconds& max_wait) const;
+    bool waitForDataAvailable(BindingHandle handle, const std::chrono::microseconds& max_wait) const;
 
     std::shared_ptr<AudioFrame> getData(const std::string& call_id);
+    std::shared_ptr<AudioFrame> getData(BindingHandle handle);
 
     std::shared_ptr<AudioFrame> getAvailableData(const std::string& call_id);
+    std::shared_ptr<AudioFrame> getAvailableData(BindingHandle handle);
 
     size_t availableForGet(const std::string& call_id) const;
+    size_t availableForGet(BindingHandle handle) const;
 
     size_t discard(size_t toDiscard, const std::string& call_id);
+    size_t discard(size_t toDiscard, BindingHandle handle);
 
     void flush(const std::string& call_id);
+    void flush(BindingHandle handle);
 
     void flushAllBuffers();
 
@@ -96,8 +140,12 @@ public:
      * Create a new ringbuffer with a default readoffset.
      * This class keeps a weak reference on returned pointer,
      * so the caller is responsible of the referred instance.
+     * @param mode  Synchronization backend, LOCK_FREE is meant for buffers
+     *              fed by a single realtime producer and read by many calls.
+     *              Ignored if the ringbuffer already exists.
      */
-    std::shared_ptr<RingBuffer> createRingBuffer(const std::string& id);
+    std::shared_ptr<RingBuffer> createRingBuffer(const std::string& id,
+                                                 RingBuffer::Mode mode = RingBuffer::Mode::LOCKED);
 
     /**
      * Obtain a shared pointer on a RingBuffer given by its ID.
@@ -118,16 +166,27 @@ public:
 private:
     NON_COPYABLE(RingBufferPool);
 
-    // A set of RingBuffers readable by a call
-    using ReadBindings
-        = std::set<std::shared_ptr<RingBuffer>, std::owner_less<std::shared_ptr<RingBuffer>>>;
+    // A RingBuffer readable by a call, with the call's read offset in it
+    struct ReadBinding
+    {
+        std::shared_ptr<RingBuffer> rbuf;
+        RingBuffer::ReadHandle handle;
+    };
+    // The RingBuffers readable by a call. Immutable once published,
+    // it is replaced as a whole when bindings change.
+    using ReadBindings = std::vector<ReadBinding>;
 
-    const ReadBindings* getReadBindings(const std::string& call_id) const;
-    ReadBindings* getReadBindings(const std::string& call_id);
+    struct Reader
+    {
+        std::atomic<uint32_t> generation {0};
+        AtomicSharedPtr<const ReadBindings> bindings;
+    };
 
-    void removeReadBindings(const std::string& call_id);
+    std::shared_ptr<const ReadBindings> getReadBindings(const std::string& call_id) const;
+    std::shared_ptr<const ReadBindings> getReadBindings(BindingHandle handle) const;
 
-    void addReaderToRingBuffer(const std::shared_ptr<RingBuffer>& rbuf, const std::string& call_id);
+    BindingHandle addReaderToRingBuffer(const std::shared_ptr<RingBuffer>& rbuf,
+                                        const std::string& call_id);
 
     void removeReaderFromRingBuffer(const std::shared_ptr<RingBuffer>& rbuf,
                                     const std::string& call_id);
@@ -135,12 +194,16 @@ private:
     // A cache of created RingBuffers listed by IDs.
     std::map<std::string, std::weak_ptr<RingBuffer>> ringBufferMap_ {};
 
-    // A map of which RingBuffers a call has some ReadOffsets
-    std::map<std::string, ReadBindings> readBindingsMap_ {};
+    // Readers slots, indexed by the low part of a BindingHandle
+    std::array<Reader, MAX_BINDINGS> readers_ {};
+
+    // Which reader slot a call uses
+    std::map<std::string, size_t> readerIndex_ {};
 
     mutable std::recursive_mutex stateLock_ {};
 
     AudioFormat internalAudioFormat_ {AudioFormat::DEFAULT()};
+    std::atomic<std::chrono::milliseconds> frameDuration_ {std::chrono::milliseconds(20)};
 
     std::shared_ptr<RingBuffer> defaultRingBuffer_;
 };
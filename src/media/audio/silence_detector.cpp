@@ -0,0 +1,42 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "silence_detector.h"
+#include "libav_deps.h"
+
+namespace jami {
+
+bool
+SilenceDetector::silent(const AudioFrame& frame)
+{
+    return silent(frame, frame.calcRMS());
+}
+
+bool
+SilenceDetector::silent(const AudioFrame& frame, float level)
+{
+    const auto& f = *frame.pointer();
+    level_ = level;
+    if (frame.has_voice || level_ >= THRESHOLD) {
+        silentSamples_ = 0;
+        return false;
+    }
+    silentSamples_ += f.nb_samples;
+    return silentSamples_ >= (uint64_t) f.sample_rate * HANGOVER.count() / 1000;
+}
+
+} // namespace jami
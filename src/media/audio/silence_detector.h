@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "media_buffer.h"
+
+#include <chrono>
+#include <cstdint>
+
+namespace jami {
+
+/**
+ * Tells the frames of an audio source that can be skipped: no voice detected on them and
+ * their level under THRESHOLD since HANGOVER, not to cut the end of the words.
+ *
+ * Cheaper than resampling, mixing or encoding them, it runs where the voice activity detection
+ * of the audio processor is not available (e.g. the remote participants of a conference).
+ */
+class SilenceDetector
+{
+public:
+    // RMS level, -60 dBFS
+    static constexpr float THRESHOLD {.001f};
+    static constexpr std::chrono::milliseconds HANGOVER {300};
+
+    /**
+     * To be called with each frame of the source, in order
+     */
+    bool silent(const AudioFrame& frame);
+    /**
+     * Same, with the level of the frame known from elsewhere, e.g. the RTP headers of the
+     * packets it was decoded from: the samples are not read
+     */
+    bool silent(const AudioFrame& frame, float level);
+
+    /**
+     * RMS level of the last frame, from 0 to 1
+     */
+    float level() const { return level_; }
+
+private:
+    float level_ {0};
+    uint64_t silentSamples_ {0};
+};
+
+} // namespace jami
@@ -32,6 +32,7 @@
 #include "manager.h"
 #include "media_decoder.h"
 #include "client/ring_signal.h"
+#include "fileutils.h"
 
 #include "logger.h"
 
@@ -61,28 +62,37 @@ AudioFile::AudioFile(const std::string& fileName, unsigned int sampleRate)
     , filepath_(fileName)
     , updatePlaybackScale_(0)
 {
-    const auto& format = getFormat();
-    auto buf = std::make_unique<AudioBuffer>(0, format);
-    Resampler r {};
-    auto decoder = std::make_unique<MediaDecoder>(
-        [&r, &format, &buf](const std::shared_ptr<MediaFrame>& frame) mutable {
-            buf->append(*r.resample(std::static_pointer_cast<AudioFrame>(frame), format));
-        });
-    DeviceParams dev;
-    dev.input = fileName;
-    dev.name = fileName;
-
-    if (decoder->openInput(dev) < 0)
+    // Decoded once per sample rate, unless the file changed
+    std::string key;
+    try {
+        key = fmt::format("file:{}:{}",
+                          fileName,
+                          fileutils::writeTime(fileName).time_since_epoch().count());
+    } catch (const std::exception&) {
         throw AudioFileException("File could not be opened: " + fileName);
+    }
+    buffer_ = getCached(key, sampleRate, [&] {
+        const auto& format = getFormat();
+        auto buf = std::make_shared<AudioBuffer>(0, format);
+        Resampler r {};
+        auto decoder = std::make_unique<MediaDecoder>(
+            [&r, &format, &buf](const std::shared_ptr<MediaFrame>& frame) mutable {
+                buf->append(*r.resample(std::static_pointer_cast<AudioFrame>(frame), format));
+            });
+        DeviceParams dev;
+        dev.input = fileName;
+        dev.name = fileName;
 
-    if (decoder->setupAudio() < 0)
-        throw AudioFileException("Decoder setup failed: " + fileName);
+        if (decoder->openInput(dev) < 0)
+            throw AudioFileException("File could not be opened: " + fileName);
 
-    while (decoder->decode() != MediaDemuxer::Status::EndOfFile)
-        ;
+        if (decoder->setupAudio() < 0)
+            throw AudioFileException("Decoder setup failed: " + fileName);
 
-    delete buffer_;
-    buffer_ = buf.release();
+        while (decoder->decode() != MediaDemuxer::Status::EndOfFile)
+            ;
+        return buf;
+    });
 }
 
 } // namespace jami
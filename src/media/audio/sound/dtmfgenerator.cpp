@@ -53,7 +53,6 @@ const DTMFGenerator::DTMFTone DTMFGenerator::tones_[] = {{'0', 941, 1336},
 DTMFGenerator::DTMFGenerator(unsigned int sampleRate)
     : state()
     , sampleRate_(sampleRate)
-    , tone_("", sampleRate)
 {
     state.offset = 0;
     state.sample = 0;
@@ -62,11 +61,7 @@ DTMFGenerator::DTMFGenerator(unsigned int sampleRate)
         toneBuffers_[i] = fillToneBuffer(i);
 }
 
-DTMFGenerator::~DTMFGenerator()
-{
-    for (int i = 0; i < NUM_TONES; i++)
-        delete[] toneBuffers_[i];
-}
+DTMFGenerator::~DTMFGenerator() {}
 
 using std::vector;
 
@@ -79,17 +74,17 @@ DTMFGenerator::getSamples(vector<AudioSample>& buffer, unsigned char code)
     code = toupper(code);
 
     if (code >= '0' and code <= '9')
-        state.sample = toneBuffers_[code - '0'];
+        state.sample = toneBuffers_[code - '0']->data();
     else if (code >= 'A' and code <= 'D')
-        state.sample = toneBuffers_[code - 'A' + 10];
+        state.sample = toneBuffers_[code - 'A' + 10]->data();
     else {
         switch (code) {
         case '*':
-            state.sample = toneBuffers_[NUM_TONES - 2];
+            state.sample = toneBuffers_[NUM_TONES - 2]->data();
             break;
 
         case '#':
-            state.sample = toneBuffers_[NUM_TONES - 1];
+            state.sample = toneBuffers_[NUM_TONES - 1]->data();
             break;
 
         default:
@@ -126,13 +121,14 @@ DTMFGenerator::getNextSamples(vector<AudioSample>& buffer)
     state.offset = (state.offset + i) % sampleRate_;
 }
 
-AudioSample*
+std::unique_ptr<Tone>
 DTMFGenerator::fillToneBuffer(int index)
 {
     assert(index >= 0 and index < NUM_TONES);
-    AudioSample* ptr = new AudioSample[sampleRate_];
-    tone_.genSin(ptr, tones_[index].higher, tones_[index].lower, sampleRate_);
-    return ptr;
+    // Without duration, a tone lasts one second
+    return std::make_unique<Tone>(std::to_string(tones_[index].higher) + "+"
+                                      + std::to_string(tones_[index].lower),
+                                  sampleRate_);
 }
 
 } // namespace jami
@@ -24,6 +24,8 @@
 #ifndef DTMFGENERATOR_H
 #define DTMFGENERATOR_H
 
+#include <array>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -65,7 +67,7 @@ private:
     struct DTMFState
     {
         unsigned int offset; /** Offset in the sample currently being played */
-        AudioSample* sample; /** Currently generated code */
+        const AudioSample* sample; /** Currently generated code */
     };
 
     /** State of the DTMF generator */
@@ -74,15 +76,12 @@ private:
     /** The different kind of tones */
     static const DTMFTone tones_[NUM_TONES];
 
-    /** Generated samples for each tone */
-    AudioSample* toneBuffers_[NUM_TONES];
+    /** Generated samples for each tone, shared with the generators of the same rate */
+    std::array<std::unique_ptr<Tone>, NUM_TONES> toneBuffers_;
 
     /** Sampling rate of generated dtmf */
     int sampleRate_;
 
-    /** A tone object */
-    Tone tone_;
-
 public:
     /**
      * DTMF Generator contains frequency of each keys
@@ -113,9 +112,9 @@ private:
     /**
      * Fill tone buffer for a given index of the array of tones.
      * @param index of the tone in the array tones_
-     * @return AudioSample* The generated data
+     * @return The tone of one second of both frequencies
      */
-    AudioSample* fillToneBuffer(int index);
+    std::unique_ptr<Tone> fillToneBuffer(int index);
 };
 
 } // namespace jami
@@ -35,7 +35,11 @@ namespace jami {
 Tone::Tone(const std::string& definition, unsigned int sampleRate)
     : AudioLoop(sampleRate)
 {
-    genBuffer(definition); // allocate memory with definition parameter
+    // Generated once per definition and sample rate
+    buffer_ = getCached(definition, sampleRate, [&] {
+        genBuffer(definition); // allocate memory with definition parameter
+        return buffer_;
+    });
 }
 
 void
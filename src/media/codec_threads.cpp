@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "codec_threads.h"
+
+#include "logger.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+namespace jami {
+
+// Pixels of a weight of 1, a 360p stream
+static constexpr int REFERENCE_PIXELS {640 * 360};
+
+static metrics::Gauge&
+threadsGauge()
+{
+    static auto& gauge = metrics::Registry::instance()
+                             .gauge("jami_codec_threads", "Threads of the running video codecs");
+    return gauge;
+}
+
+CodecThreads&
+CodecThreads::instance()
+{
+    static CodecThreads threads([] {
+        if (auto envvar = getenv("JAMI_CODEC_THREADS")) {
+            auto budget = std::atoi(envvar);
+            if (budget > 0)
+                return static_cast<unsigned>(budget);
+        }
+        return std::max(1u, std::thread::hardware_concurrency());
+    }());
+    return threads;
+}
+
+CodecThreads::CodecThreads(unsigned budget)
+    : budget_(std::max(1u, budget))
+{}
+
+unsigned
+CodecThreads::acquire(const void* codec, int pixels, bool encoder)
+{
+    // Audio codecs don't gain from threads
+    if (pixels <= 0)
+        return 1;
+    unsigned weight = (pixels + REFERENCE_PIXELS - 1) / REFERENCE_PIXELS * (encoder ? 2 : 1);
+    unsigned max = encoder ? MAX_ENCODER_THREADS : MAX_DECODER_THREADS;
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    // Reopened without being released
+    auto it = codecs_.find(codec);
+    if (it != codecs_.end()) {
+        weights_ -= it->second.weight;
+        used_ -= it->second.threads;
+        codecs_.erase(it);
+    }
+    auto share = static_cast<unsigned>(uint64_t(budget_) * weight / (weights_ + weight));
+    auto threads = std::clamp(share, 1u, max);
+    codecs_.emplace(codec, Codec {weight, threads});
+    weights_ += weight;
+    used_ += threads;
+    threadsGauge().set(used_);
+    JAMI_DBG("[codec:%p] %u threads of %u, %zu codecs running",
+             codec,
+             threads,
+             budget_,
+             codecs_.size());
+    return threads;
+}
+
+void
+CodecThreads::release(const void* codec)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = codecs_.find(codec);
+    if (it == codecs_.end())
+        return;
+    weights_ -= it->second.weight;
+    used_ -= it->second.threads;
+    codecs_.erase(it);
+    threadsGauge().set(used_);
+}
+
+unsigned
+CodecThreads::used() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return used_;
+}
+
+} // namespace jami
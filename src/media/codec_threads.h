@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+
+#include <map>
+#include <mutex>
+
+namespace jami {
+
+/**
+ * Threads of the codecs, shared by the codecs of the daemon so that the calls don't
+ * oversubscribe the cores: a conference used to start a dozen threads per participant.
+ *
+ * A codec gets a share of the budget by its weight (pixels coded, encoders counting twice
+ * as their output goes to every receiver) relative to the other running codecs. A codec
+ * keeps its threads until closed, as FFmpeg can't change them once opened: the shares
+ * follow the calls joining and leaving as the codecs are reopened (new streams, size
+ * changes).
+ */
+class CodecThreads
+{
+public:
+    static constexpr unsigned MAX_ENCODER_THREADS {16};
+    static constexpr unsigned MAX_DECODER_THREADS {8};
+
+    /**
+     * Budget of the cores, or JAMI_CODEC_THREADS
+     */
+    static CodecThreads& instance();
+
+    explicit CodecThreads(unsigned budget);
+
+    /**
+     * @param codec     Key of the codec, e.g. its AVCodecContext, for release()
+     * @param pixels    Width * height, 0 for audio
+     * @return number of threads of the codec, at least 1
+     */
+    unsigned acquire(const void* codec, int pixels, bool encoder);
+    void release(const void* codec);
+
+    unsigned budget() const { return budget_; }
+    /**
+     * @return threads of the running codecs
+     */
+    unsigned used() const;
+
+private:
+    NON_COPYABLE(CodecThreads);
+
+    struct Codec
+    {
+        unsigned weight;
+        unsigned threads;
+    };
+
+    const unsigned budget_;
+    mutable std::mutex mutex_;
+    std::map<const void*, Codec> codecs_;
+    unsigned weights_ {0};
+    unsigned used_ {0};
+};
+
+} // namespace jami
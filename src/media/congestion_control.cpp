@@ -21,6 +21,7 @@
 #include "logger.h"
 #include "media/congestion_control.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <utility>
 #include <cmath>
@@ -31,13 +32,17 @@ static constexpr uint8_t packetFMT = 15;
 static constexpr uint8_t packetType = 206;
 static constexpr uint32_t uniqueIdentifier = 0x52454D42; // 'R' 'E' 'M' 'B'.
 
-static constexpr float Q = 0.5f;
-static constexpr float beta = 0.95f;
+static constexpr unsigned TRENDLINE_WINDOW = 20;
+static constexpr float SMOOTHING_COEF = 0.9f;
+static constexpr float TRENDLINE_GAIN = 4.0f;
+static constexpr unsigned MAX_DELTAS = 60;
 
-static constexpr float ku = 0.004f;
-static constexpr float kd = 0.002f;
+static constexpr float ku = 0.01f;
+static constexpr float kd = 0.00018f;
+static constexpr float MIN_THRESH = 6.0f;
+static constexpr float MAX_THRESH = 600.0f;
 
-constexpr auto OVERUSE_THRESH = std::chrono::milliseconds(100);
+constexpr auto OVERUSE_THRESH = std::chrono::milliseconds(10);
 
 // Receiver Estimated Max Bitrate (REMB) (draft-alvestrand-rmcat-remb).
 //
@@ -124,66 +129,51 @@ CongestionControl::createREMB(uint64_t bitrate_bps)
 }
 
 float
-CongestionControl::kalmanFilter(uint64_t gradiant_delay)
+CongestionControl::trendlineFilter(int gradient, int deltaT)
 {
-    float var_n = get_var_n(gradiant_delay);
-    float k = get_gain_k(Q, var_n);
-    float m = get_estimate_m(k, gradiant_delay);
-    last_var_p_ = get_sys_var_p(k, Q);
-    last_estimate_m_ = m;
-    last_var_n_ = var_n;
-
-    return m;
-}
-
-float
-CongestionControl::get_estimate_m(float k, int d_m)
-{
-    // JAMI_WARN("[get_estimate_m]k:%f, last_estimate_m_:%f, d_m:%f", k, last_estimate_m_, d_m);
-    // JAMI_WARN("m: %f", ((1-k) * last_estimate_m_) + (k * d_m));
-    return ((1 - k) * last_estimate_m_) + (k * d_m);
-}
-
-float
-CongestionControl::get_gain_k(float q, float dev_n)
-{
-    // JAMI_WARN("k: %f", (last_var_p_ + q) / (last_var_p_ + q + dev_n));
-    return (last_var_p_ + q) / (last_var_p_ + q + dev_n);
-}
-
-float
-CongestionControl::get_sys_var_p(float k, float q)
-{
-    // JAMI_WARN("var_p: %f", ((1-k) * (last_var_p_ + q)));
-    return ((1 - k) * (last_var_p_ + q));
-}
-
-float
-CongestionControl::get_var_n(int d_m)
-{
-    float z = get_residual_z(d_m);
-    // JAMI_WARN("var_n: %f", (beta * last_var_n_) + ((1.0f - beta) * z * z));
-    return (beta * last_var_n_) + ((1.0f - beta) * z * z);
-}
-
-float
-CongestionControl::get_residual_z(float d_m)
-{
-    // JAMI_WARN("z: %f", d_m - last_estimate_m_);
-    return (d_m - last_estimate_m_);
+    accumulatedDelay_ += gradient;
+    smoothedDelay_ = SMOOTHING_COEF * smoothedDelay_ + (1 - SMOOTHING_COEF) * accumulatedDelay_;
+    arrivalTime_ += deltaT;
+    numDeltas_ = std::min(numDeltas_ + 1, MAX_DELTAS);
+
+    delays_.emplace_back(arrivalTime_, smoothedDelay_);
+    if (delays_.size() > TRENDLINE_WINDOW)
+        delays_.pop_front();
+    if (delays_.size() < TRENDLINE_WINDOW)
+        return 0.0f;
+
+    double meanX = 0.0, meanY = 0.0;
+    for (const auto& [x, y] : delays_) {
+        meanX += x;
+        meanY += y;
+    }
+    meanX /= delays_.size();
+    meanY /= delays_.size();
+    double num = 0.0, den = 0.0;
+    for (const auto& [x, y] : delays_) {
+        num += (x - meanX) * (y - meanY);
+        den += (x - meanX) * (x - meanX);
+    }
+    if (den == 0.0)
+        return 0.0f;
+    return static_cast<float>(num / den) * numDeltas_ * TRENDLINE_GAIN;
 }
 
 float
 CongestionControl::update_thresh(float m, int deltaT)
 {
+    // Ignore the spikes, such as the delay of a keyframe
+    if (std::fabs(m) - last_thresh_y_ > 15.0f)
+        return last_thresh_y_;
     float ky = 0.0f;
     if (std::fabs(m) < last_thresh_y_)
         ky = kd;
     else
         ky = ku;
+    deltaT = std::min(deltaT, 100);
     float res = last_thresh_y_ + ((deltaT * ky) * (std::fabs(m) - last_thresh_y_));
-    last_thresh_y_ = res;
-    return res;
+    last_thresh_y_ = std::clamp(res, MIN_THRESH, MAX_THRESH);
+    return last_thresh_y_;
 }
 
 float
@@ -195,6 +185,8 @@ CongestionControl::get_thresh()
 BandwidthUsage
 CongestionControl::get_bw_state(float estimation, float thresh)
 {
+    auto increasing = estimation >= last_estimate_;
+    last_estimate_ = estimation;
     if (estimation > thresh) {
         // JAMI_WARN("Enter overuse state");
         if (not overuse_counter_) {
@@ -205,7 +197,7 @@ CongestionControl::get_bw_state(float estimation, float thresh)
         overuse_counter_++;
         time_point now = clock::now();
         auto overuse_timer = now - t0_overuse;
-        if ((overuse_timer >= OVERUSE_THRESH) and (overuse_counter_ > 1)) {
+        if ((overuse_timer >= OVERUSE_THRESH) and (overuse_counter_ > 1) and increasing) {
             overuse_counter_ = 0;
             last_state_ = bwOverusing;
         }
@@ -23,6 +23,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <deque>
 
 #include "socket_pair.h"
 
@@ -39,7 +40,15 @@ public:
 
     uint64_t parseREMB(const rtcpREMBHeader& packet);
     std::vector<uint8_t> createREMB(uint64_t bitrate_bps);
-    float kalmanFilter(uint64_t gradiant_delay);
+
+    /**
+     * Trendline filter (draft-ietf-rmcat-gcc): slope of the accumulated one-way
+     * delay over the last frames, by least squares.
+     * @param gradient  Variation of the one-way delay since the last frame, in ms
+     * @param deltaT    Time since the last frame, in ms
+     * @return modified trend, to compare to the threshold
+     */
+    float trendlineFilter(int gradient, int deltaT);
     float update_thresh(float m, int deltaT);
     float get_thresh();
     BandwidthUsage get_bw_state(float estimation, float thresh);
@@ -48,22 +57,19 @@ private:
     using clock = std::chrono::steady_clock;
     using time_point = clock::time_point;
 
-    float get_estimate_m(float k, int d_m);
-    float get_gain_k(float q, float dev_n);
-    float get_sys_var_p(float k, float q);
-    float get_var_n(int d_m);
-    float get_residual_z(float d_m);
-
-    float last_estimate_m_ {0.0f};
-    float last_var_p_ {0.1f};
-    float last_var_n_ {0.0f};
+    double accumulatedDelay_ {0.0};
+    double smoothedDelay_ {0.0};
+    double arrivalTime_ {0.0};
+    unsigned numDeltas_ {0};
+    std::deque<std::pair<double, double>> delays_; // arrival time, smoothed delay
 
-    float last_thresh_y_ {2.0f};
+    float last_thresh_y_ {12.5f};
 
-    unsigned overuse_counter_;
+    unsigned overuse_counter_ {0};
     time_point t0_overuse {time_point::min()};
+    float last_estimate_ {0.0f};
 
-    BandwidthUsage last_state_;
+    BandwidthUsage last_state_ {bwNormal};
 };
 
 } // namespace jami
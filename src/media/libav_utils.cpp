@@ -275,5 +275,11 @@ fillWithSilence(AVFrame* frame)
         JAMI_ERR() << "Failed to fill frame with silence";
 }
 
+const void*
+getIOOpaque(const AVFormatContext* ctx)
+{
+    return ctx and ctx->pb ? ctx->pb->opaque : nullptr;
+}
+
 } // namespace libav_utils
 } // namespace jami
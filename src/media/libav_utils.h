@@ -29,6 +29,7 @@
 extern "C" {
 struct AVDictionary;
 struct AVFrame;
+struct AVFormatContext;
 struct AVPixFmtDescriptor;
 struct AVBufferRef;
 void av_buffer_unref(AVBufferRef **buf);
@@ -54,6 +55,11 @@ void fillWithBlack(AVFrame* frame);
 
 void fillWithSilence(AVFrame* frame);
 
+/**
+ * @return opaque of the custom IO of ctx, the SocketPair of an RTP session, or nullptr
+ */
+const void* getIOOpaque(const AVFormatContext* ctx);
+
 struct AVBufferRef_deleter {
     void operator()(AVBufferRef* buf) const { av_buffer_unref(&buf); }
 };
@@ -21,8 +21,10 @@
 #include "libav_deps.h" // MUST BE INCLUDED FIRST
 #include "libav_utils.h"
 #include "media_buffer.h"
+#include "metrics.h"
 #include "jami/videomanager_interface.h"
 
+#include <algorithm>
 #include <new> // std::bad_alloc
 #include <cstdlib>
 #include <cstring> // std::memset
@@ -42,4 +44,155 @@ videoFrameSize(int format, int width, int height)
 
 #endif // ENABLE_VIDEO
 
+//=== FramePool ================================================================
+
+FramePool&
+FramePool::instance()
+{
+    static FramePool pool;
+    return pool;
+}
+
+FramePool::~FramePool()
+{
+    // Buffers still used are freed when released
+    for (auto& pool : pools_)
+        av_buffer_pool_uninit(&pool.pool);
+}
+
+static metrics::Gauge&
+poolBytes()
+{
+    static auto& gauge = metrics::memoryBytes("frame_pool");
+    return gauge;
+}
+
+// Called once the pool holding the buffer is uninitialized and the buffer released
+static void
+freeBuffer(void* opaque, uint8_t* data)
+{
+    poolBytes().add(-static_cast<int64_t>(reinterpret_cast<uintptr_t>(opaque)));
+    av_free(data);
+}
+
+AVBufferRef*
+FramePool::alloc(void* opaque, std::size_t size)
+{
+    // Called with the lock of the pool, don't lock mutex_
+    static_cast<FramePool*>(opaque)->misses_++;
+    auto data = static_cast<uint8_t*>(av_malloc(size));
+    if (not data)
+        return nullptr;
+    // The size is given to the free callback, as its opaque
+    auto buf = av_buffer_create(data, size, freeBuffer, reinterpret_cast<void*>(size), 0);
+    if (not buf) {
+        av_free(data);
+        return nullptr;
+    }
+    poolBytes().add(static_cast<int64_t>(size));
+    return buf;
+}
+
+AVBufferRef*
+FramePool::getBuffer(const Key& key, int size)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    gets_++;
+    auto it = std::find_if(pools_.begin(), pools_.end(), [&](const Pool& p) {
+        return p.key == key;
+    });
+    if (it != pools_.end()) {
+        pools_.splice(pools_.begin(), pools_, it);
+    } else {
+        // The size is an int before libavutil 57
+        auto pool = av_buffer_pool_init2(
+            size,
+            this,
+            [](void* opaque, auto size) { return alloc(opaque, size); },
+            nullptr);
+        if (not pool)
+            return nullptr;
+        pools_.emplace_front(Pool {key, pool});
+        if (pools_.size() > MAX_POOLS) {
+            av_buffer_pool_uninit(&pools_.back().pool);
+            pools_.pop_back();
+        }
+    }
+    // Got with the lock, as the pool may be uninitialized by another thread
+    return av_buffer_pool_get(pools_.front().pool);
+}
+
+int
+FramePool::getVideoBuffer(AVFrame* frame, int align)
+{
+    auto format = static_cast<AVPixelFormat>(frame->format);
+    auto desc = av_pix_fmt_desc_get(format);
+    if (not desc or (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) or frame->width <= 0
+        or frame->height <= 0 or align <= 0)
+        return av_frame_get_buffer(frame, align);
+
+    // Same layout as av_frame_get_buffer()
+    int ret = av_image_fill_linesizes(frame->linesize, format, FFALIGN(frame->width, align));
+    if (ret < 0)
+        return ret;
+    for (int i = 0; i < 4; i++)
+        frame->linesize[i] = FFALIGN(frame->linesize[i], align);
+    auto paddedHeight = FFALIGN(frame->height, 32);
+    int size = av_image_fill_pointers(frame->data, format, paddedHeight, nullptr, frame->linesize);
+    if (size < 0)
+        return size;
+
+    frame->buf[0] = getBuffer({frame->format, frame->width, frame->height, align},
+                              size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (not frame->buf[0])
+        return AVERROR(ENOMEM);
+    av_image_fill_pointers(frame->data, format, paddedHeight, frame->buf[0]->data, frame->linesize);
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+int
+FramePool::getAudioBuffer(AVFrame* frame)
+{
+    auto format = static_cast<AVSampleFormat>(frame->format);
+    // Planes after AV_NUM_DATA_POINTERS need extended_data to be allocated
+    if (frame->channels <= 0 or frame->channels > AV_NUM_DATA_POINTERS or frame->nb_samples <= 0
+        or format == AV_SAMPLE_FMT_NONE)
+        return av_frame_get_buffer(frame, 0);
+
+    int linesize;
+    int size = av_samples_get_buffer_size(&linesize,
+                                          frame->channels,
+                                          frame->nb_samples,
+                                          format,
+                                          0);
+    if (size < 0)
+        return size;
+
+    frame->buf[0] = getBuffer({frame->format, frame->channels, frame->nb_samples, 0}, size);
+    if (not frame->buf[0])
+        return AVERROR(ENOMEM);
+    int ret = av_samples_fill_arrays(frame->data,
+                                     &frame->linesize[0],
+                                     frame->buf[0]->data,
+                                     frame->channels,
+                                     frame->nb_samples,
+                                     format,
+                                     0);
+    if (ret < 0) {
+        av_buffer_unref(&frame->buf[0]);
+        return ret;
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+FramePool::Stats
+FramePool::stats() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    uint64_t misses = misses_;
+    return {gets_ - misses, misses};
+}
+
 } // namespace jami
@@ -23,15 +23,33 @@
 #include "config.h"
 #include "videomanager_interface.h"
 #include "observer.h"
+#include "noncopyable.h"
 
+#include <atomic>
+#include <cstdint>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <functional>
+#include <tuple>
+
+extern "C" {
+struct AVBufferPool;
+struct AVBufferRef;
+struct AVCodecParameters;
+struct AVFrame;
+struct AVPacket;
+struct AVRational;
+}
 
 namespace jami {
 
 using MediaFrame = DRing::MediaFrame;
 using AudioFrame = DRing::AudioFrame;
 using MediaObserver = std::function<void(std::shared_ptr<MediaFrame>&&)>;
+// Encoded packets of a stream, with its codec parameters, their timestamps being in timeBase
+using PacketObserver = std::function<
+    void(const AVPacket& packet, const AVCodecParameters& par, AVRational timeBase)>;
 
 #ifdef ENABLE_VIDEO
 
@@ -42,4 +60,62 @@ int videoFrameSize(int format, int width, int height);
 
 #endif // ENABLE_VIDEO
 
+/**
+ * Buffers of the frames allocated by VideoFrame::reserve and AudioFrame::reserve.
+ *
+ * Frames of the same format and size reuse the buffers of the frames released
+ * before, so the pipeline stops allocating once running. The pools of the
+ * sizes not used recently are released.
+ */
+class FramePool
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    static FramePool& instance();
+
+    ~FramePool();
+
+    /**
+     * Set the buffers of a video frame, of the format and size of the frame
+     * @return 0 or a negative AVERROR
+     */
+    int getVideoBuffer(AVFrame* frame, int align);
+
+    /**
+     * Set the buffers of an audio frame, of the format, channels and number
+     * of samples of the frame
+     * @return 0 or a negative AVERROR
+     */
+    int getAudioBuffer(AVFrame* frame);
+
+    Stats stats() const;
+
+private:
+    FramePool() = default;
+    NON_COPYABLE(FramePool);
+
+    static constexpr std::size_t MAX_POOLS {16};
+
+    // Format, width or channels, height or samples, alignment
+    using Key = std::tuple<int, int, int, int>;
+    struct Pool
+    {
+        Key key;
+        AVBufferPool* pool;
+    };
+
+    AVBufferRef* getBuffer(const Key& key, int size);
+    static AVBufferRef* alloc(void* opaque, std::size_t size);
+
+    mutable std::mutex mutex_;
+    std::list<Pool> pools_ {}; // Most recently used first
+    uint64_t gets_ {0};
+    std::atomic<uint64_t> misses_ {0};
+};
+
 } // namespace jami
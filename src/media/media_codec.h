@@ -295,11 +295,19 @@ struct MediaDescription
     /** Audio parameters */
     unsigned frame_size {};
     bool fecEnabled {false};
+    // Of the audio level header extension (RFC 6464), 0 if not negotiated
+    uint8_t audioLevelExtId {0};
 
     /** Video parameters */
     std::string parameters {};
     RateMode mode {RateMode::CRF_CONSTRAINED};
     bool linkableHW {false};
+    // Shared screen, mostly static with sharp text
+    bool screenContent {false};
+    // Of the retransmissions (RFC 4588) of the lost packets, 0 if not negotiated
+    uint8_t rtxPayloadType {0};
+    // Of the FlexFEC repair packets, 0 if not negotiated
+    uint8_t fecPayloadType {0};
 
     /** Crypto parameters */
     CryptoAttribute crypto {};
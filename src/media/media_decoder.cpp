@@ -24,6 +24,7 @@
 #include "media_decoder.h"
 #include "media_device.h"
 #include "media_buffer.h"
+#include "codec_threads.h"
 #include "media_io_handle.h"
 #include "audio/audiobuffer.h"
 #include "audio/ringbuffer.h"
@@ -38,10 +39,11 @@
 #include "string_utils.h"
 #include "logger.h"
 #include "client/ring_signal.h"
+#include "tracepoint.h"
 
 #include <iostream>
 #include <unistd.h>
-#include <thread> // hardware_concurrency
+#include <thread>
 #include <chrono>
 #include <algorithm>
 
@@ -183,10 +185,37 @@ MediaDemuxer::getDuration() const
     return inputCtx_->duration;
 }
 
+void
+MediaDemuxer::setMaxDelay(std::chrono::microseconds delay)
+{
+    // Read by the RTP demuxer for each packet
+    if (inputCtx_)
+        inputCtx_->max_delay = delay.count();
+}
+
 bool
-MediaDemuxer::seekFrame(int, int64_t timestamp)
+MediaDemuxer::seekFrame(int stream_index, int64_t timestamp)
 {
-    if (av_seek_frame(inputCtx_, -1, timestamp, AVSEEK_FLAG_BACKWARD) >= 0) {
+    int ret = -1;
+    if (stream_index >= 0 and static_cast<unsigned>(stream_index) < inputCtx_->nb_streams) {
+        auto stream = inputCtx_->streams[stream_index];
+        auto ts = av_rescale_q(timestamp, {1, AV_TIME_BASE}, stream->time_base);
+        if (stream->start_time != AV_NOPTS_VALUE)
+            ts += stream->start_time;
+        auto idx = av_index_search_timestamp(stream, ts, AVSEEK_FLAG_BACKWARD);
+        if (idx >= 0) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+            auto keyFrame = avformat_index_get_entry(stream, idx)->timestamp;
+#else
+            auto keyFrame = stream->index_entries[idx].timestamp;
+#endif
+            ret = av_seek_frame(inputCtx_, stream_index, keyFrame, AVSEEK_FLAG_BACKWARD);
+        }
+    }
+    // Without index, searched by the demuxer
+    if (ret < 0)
+        ret = av_seek_frame(inputCtx_, -1, timestamp, AVSEEK_FLAG_BACKWARD);
+    if (ret >= 0) {
         clearFrames();
         return true;
     }
@@ -251,21 +280,48 @@ MediaDemuxer::clearFrames()
     }
 }
 
-void
+bool
 MediaDemuxer::emitFrame(bool isAudio)
 {
     if (isAudio) {
-        pushFrameFrom(audioBuffer_, isAudio, audioBufferMutex_);
+        return pushFrameFrom(audioBuffer_, isAudio, audioBufferMutex_);
     } else {
-        pushFrameFrom(videoBuffer_, isAudio, videoBufferMutex_);
+        return pushFrameFrom(videoBuffer_, isAudio, videoBufferMutex_);
     }
 }
 
-void
-MediaDemuxer::pushFrameFrom(
-    std::queue<std::unique_ptr<AVPacket, std::function<void(AVPacket*)>>>& buffer,
-    bool isAudio,
-    std::mutex& mutex)
+bool
+MediaDemuxer::hasFrame(bool isAudio)
+{
+    std::lock_guard<std::mutex> lk(isAudio ? audioBufferMutex_ : videoBufferMutex_);
+    return not(isAudio ? audioBuffer_ : videoBuffer_).empty();
+}
+
+std::chrono::microseconds
+MediaDemuxer::bufferedDuration(const PacketQueue& buffer) const
+{
+    if (buffer.empty())
+        return {};
+    const auto& first = *buffer.front();
+    const auto& last = *buffer.back();
+    if (first.pts == AV_NOPTS_VALUE or last.pts == AV_NOPTS_VALUE)
+        return {};
+    return std::chrono::microseconds(av_rescale_q(last.pts + last.duration - first.pts,
+                                                  inputCtx_->streams[first.stream_index]->time_base,
+                                                  {1, AV_TIME_BASE}));
+}
+
+bool
+MediaDemuxer::isFull(const PacketQueue& buffer, size_t maxPackets) const
+{
+    if (prefetch_.count() > 0)
+        // The packet count still bounding the memory of the files without timestamps
+        return bufferedDuration(buffer) >= prefetch_ or buffer.size() >= 10 * maxPackets;
+    return buffer.size() >= maxPackets;
+}
+
+bool
+MediaDemuxer::pushFrameFrom(PacketQueue& buffer, bool isAudio, std::mutex& mutex)
 {
     std::unique_lock<std::mutex> lock(mutex);
     if (buffer.empty()) {
@@ -274,23 +330,29 @@ MediaDemuxer::pushFrameFrom(
         } else {
             needFrameCb_();
         }
-        return;
+        return false;
     }
     auto packet = std::move(buffer.front());
     if (!packet) {
-        return;
+        return false;
     }
     auto streamIndex = packet->stream_index;
     if (static_cast<unsigned>(streamIndex) >= streams_.size() || streamIndex < 0) {
-        return;
+        return false;
     }
     auto& cb = streams_[streamIndex];
     if (!cb) {
-        return;
+        return false;
     }
     buffer.pop();
+    // Demuxing resumes before the buffer runs out
+    const bool low = prefetch_.count() > 0 and currentState_ != MediaDemuxer::CurrentState::Finished
+                     and bufferedDuration(buffer) < prefetch_ / 2;
     lock.unlock();
+    if (low and needFrameCb_)
+        needFrameCb_();
     cb(*packet.get());
+    return true;
 }
 
 MediaDemuxer::Status
@@ -322,13 +384,13 @@ MediaDemuxer::demuxe()
     if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
         std::lock_guard<std::mutex> lk {videoBufferMutex_};
         videoBuffer_.push(std::move(packet));
-        if (videoBuffer_.size() >= 90) {
+        if (isFull(videoBuffer_, 90)) {
             return Status::ReadBufferOverflow;
         }
     } else {
         std::lock_guard<std::mutex> lk {audioBufferMutex_};
         audioBuffer_.push(std::move(packet));
-        if (audioBuffer_.size() >= 300) {
+        if (isFull(audioBuffer_, 300)) {
             return Status::ReadBufferOverflow;
         }
     }
@@ -403,6 +465,10 @@ MediaDemuxer::decode()
     }
 
     lastReadPacketTime_ = av_gettime_relative();
+    jami_tracepoint(media_demux,
+                    libav_utils::getIOOpaque(inputCtx_),
+                    packet->pts,
+                    packet->size);
 
     auto& cb = streams_[streamIndex];
     if (cb) {
@@ -435,7 +501,67 @@ MediaDecoder::MediaDecoder(const std::shared_ptr<MediaDemuxer>& demuxer,
 void
 MediaDecoder::emitFrame(bool isAudio)
 {
-    demuxer_->emitFrame(isAudio);
+    if (not emulateRate_ or decodeAhead_.count() <= 0) {
+        demuxer_->emitFrame(isAudio);
+        return;
+    }
+    // Up to the budget, the demuxer being asked for packets only when nothing is left to show
+    while (aheadDuration() < decodeAhead_) {
+        {
+            std::lock_guard<std::mutex> lk(aheadMutex_);
+            if (not ahead_.empty() and not demuxer_->hasFrame(isAudio))
+                break;
+        }
+        if (not demuxer_->emitFrame(isAudio))
+            break;
+    }
+    emitAhead();
+}
+
+std::chrono::microseconds
+MediaDecoder::aheadDuration()
+{
+    std::lock_guard<std::mutex> lk(aheadMutex_);
+    if (ahead_.empty())
+        return {};
+    return std::chrono::microseconds(ahead_.back().first - ahead_.front().first);
+}
+
+bool
+MediaDecoder::emitAhead()
+{
+    int64_t target;
+    {
+        std::lock_guard<std::mutex> lk(aheadMutex_);
+        if (ahead_.empty())
+            return false;
+        target = ahead_.front().first;
+    }
+    // By steps, to follow a seek or a pause meanwhile
+    static constexpr int64_t MAX_WAIT {20000};
+    auto wait = startTime_ + target - av_gettime();
+    if (wait > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(std::min(wait, MAX_WAIT)));
+        if (wait > MAX_WAIT)
+            return false;
+    }
+    std::shared_ptr<MediaFrame> frame;
+    {
+        std::lock_guard<std::mutex> lk(aheadMutex_);
+        // Flushed meanwhile
+        if (ahead_.empty() or ahead_.front().first != target)
+            return false;
+        frame = std::move(ahead_.front().second);
+        ahead_.pop_front();
+    }
+    frame->pointer()->pts = av_rescale_q_rnd(av_gettime() - startTime_,
+                                             {1, AV_TIME_BASE},
+                                             decoderCtx_->time_base,
+                                             static_cast<AVRounding>(AV_ROUND_NEAR_INF
+                                                                     | AV_ROUND_PASS_MINMAX));
+    if (callback_)
+        callback_(std::move(frame));
+    return true;
 }
 
 MediaDecoder::MediaDecoder()
@@ -453,14 +579,18 @@ MediaDecoder::~MediaDecoder()
     if (decoderCtx_ && decoderCtx_->hw_device_ctx)
         av_buffer_unref(&decoderCtx_->hw_device_ctx);
 #endif
-    if (decoderCtx_)
+    if (decoderCtx_) {
+        CodecThreads::instance().release(decoderCtx_);
         avcodec_free_context(&decoderCtx_);
+    }
 }
 
 void
 MediaDecoder::flushBuffers()
 {
     avcodec_flush_buffers(decoderCtx_);
+    std::lock_guard<std::mutex> lk(aheadMutex_);
+    ahead_.clear();
 }
 
 int
@@ -503,6 +633,7 @@ int
 MediaDecoder::setupStream()
 {
     int ret = 0;
+    CodecThreads::instance().release(decoderCtx_);
     avcodec_free_context(&decoderCtx_);
 
     if (prepareDecoderContext() < 0)
@@ -553,7 +684,19 @@ MediaDecoder::setupStream()
     JAMI_DBG() << "Decoding " << av_get_media_type_string(avStream_->codecpar->codec_type)
                << " using " << inputDecoder_->long_name << " (" << inputDecoder_->name << ")";
 
-    decoderCtx_->thread_count = std::max(1u, std::min(8u, std::thread::hardware_concurrency() / 2));
+    int pixels = 0;
+    if (avStream_->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        pixels = decoderCtx_->width * decoderCtx_->height;
+        // Until the first frame, if the stream doesn't tell
+        if (pixels <= 0)
+            pixels = 1280 * 720;
+    }
+#ifdef RING_ACCEL
+    // Hardware decoders don't use the threads
+    if (accel_)
+        pixels = 0;
+#endif
+    decoderCtx_->thread_count = CodecThreads::instance().acquire(decoderCtx_, pixels, false);
     if (emulateRate_)
         JAMI_DBG() << "Using framerate emulation";
     startTime_ = av_gettime(); // used to set pts after decoding, and for rate emulation
@@ -600,6 +743,11 @@ MediaDecoder::prepareDecoderContext()
         if (decoderCtx_->framerate.num == 0 || decoderCtx_->framerate.den == 0)
             decoderCtx_->framerate = {30, 1};
     }
+    if (avStream_->codecpar->codec_type == AVMEDIA_TYPE_VIDEO and lowLatency_) {
+        // Frame threading delays the output by one frame per thread
+        decoderCtx_->thread_type = FF_THREAD_SLICE;
+        decoderCtx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
     if (avStream_->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
         if (decoderCtx_->codec_id == AV_CODEC_ID_OPUS) {
             av_opt_set_int(decoderCtx_, "decode_fec", fecEnabled_ ? 1 : 0, AV_OPT_SEARCH_CHILDREN);
@@ -614,10 +762,40 @@ MediaDecoder::updateStartTime(int64_t startTime)
     startTime_ = startTime;
 }
 
+void
+MediaDecoder::updateDecodeLatency(int64_t pts)
+{
+    // Packets without a frame (dropped or corrupted) are forgotten
+    while (not sendTimes_.empty()) {
+        auto sent = sendTimes_.front();
+        sendTimes_.pop_front();
+        if (sent.first == pts) {
+            auto latency = av_gettime_relative() - sent.second;
+            auto average = decodeLatency_.load();
+            decodeLatency_ = average ? (7 * average + latency) / 8 : latency;
+            return;
+        }
+    }
+}
+
 DecodeStatus
 MediaDecoder::decode(AVPacket& packet)
 {
     int frameFinished = 0;
+    if (packetObserver_) {
+        auto& par = *avStream_->codecpar;
+        if (par.codec_type == AVMEDIA_TYPE_VIDEO and not par.width and decoderCtx_->width) {
+            // Not in the SDP, known once decoded
+            par.width = decoderCtx_->width;
+            par.height = decoderCtx_->height;
+        }
+        packetObserver_(packet, par, avStream_->time_base);
+    }
+    if (packet.pts != AV_NOPTS_VALUE) {
+        if (sendTimes_.size() >= 32)
+            sendTimes_.pop_front();
+        sendTimes_.emplace_back(packet.pts, av_gettime_relative());
+    }
     auto ret = avcodec_send_packet(decoderCtx_, &packet);
     if (ret < 0 && ret != AVERROR(EAGAIN)) {
 #ifdef RING_ACCEL
@@ -668,7 +846,13 @@ MediaDecoder::decode(AVPacket& packet)
             frame->channel_layout = av_get_default_channel_layout(frame->channels);
 
         frame->format = (AVPixelFormat) correctPixFmt(frame->format);
+        ++decodedFrames_;
+#ifdef RING_ACCEL
+        hardware_ = accel_ != nullptr;
+#endif
         auto packetTimestamp = frame->pts; // in stream time base
+        if (packetTimestamp != AV_NOPTS_VALUE)
+            updateDecodeLatency(packetTimestamp);
         frame->pts = av_rescale_q_rnd(av_gettime() - startTime_,
                                       {1, AV_TIME_BASE},
                                       decoderCtx_->time_base,
@@ -688,12 +872,29 @@ MediaDecoder::decode(AVPacket& packet)
             if (target_relative >= seekTime_) {
                 resetSeekTime();
             }
+            if (decodeAhead_.count() > 0) {
+#if defined(ENABLE_VIDEO) && defined(RING_ACCEL)
+                if (accel_ and inputDecoder_->type == AVMEDIA_TYPE_VIDEO) {
+                    try {
+                        f = video::HardwareAccel::transferToMainMemory(
+                            *std::static_pointer_cast<VideoFrame>(f), AV_PIX_FMT_NV12);
+                    } catch (const std::runtime_error& e) {
+                        JAMI_ERR("Accel failure: %s", e.what());
+                        return DecodeStatus::DecodeError;
+                    }
+                }
+#endif
+                std::lock_guard<std::mutex> lk(aheadMutex_);
+                ahead_.emplace_back(target_relative, std::move(f));
+                return DecodeStatus::FrameFinished;
+            }
             auto now = av_gettime();
             if (target_absolute > now) {
                 std::this_thread::sleep_for(std::chrono::microseconds(target_absolute - now));
             }
         }
 
+        jami_tracepoint(media_decode_end, frame, packetTimestamp);
         if (callback_)
             callback_(std::move(f));
         return DecodeStatus::FrameFinished;
@@ -40,10 +40,14 @@
 #include "media_stream.h"
 #include "noncopyable.h"
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <memory>
 #include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <queue>
 
 extern "C" {
@@ -135,9 +139,32 @@ public:
     Status demuxe();
 
     int64_t getDuration() const;
+    /**
+     * Seek to the key frame at or before @timestamp (in AV_TIME_BASE) of @stream_index, found
+     * in the index of the file, all the streams resuming from it. The decoders then skip the
+     * frames before the time (see MediaDecoder::setSeekTime). -1 for the default stream.
+     */
     bool seekFrame(int stream_index, int64_t timestamp);
+
+    /**
+     * Demux up to @budget ahead of the decoding for each media of a file: demuxe() reports
+     * ReadBufferOverflow beyond it, and the need of packets (see setNeedFrameCb) is signaled
+     * when less than half of it is left, before the decoders run out of packets.
+     */
+    void setPrefetch(std::chrono::microseconds budget) { prefetch_ = budget; }
+
+    /**
+     * Set how long the RTP demuxer waits for a missing packet before
+     * giving up reordering. Called from the demuxing thread.
+     */
+    void setMaxDelay(std::chrono::microseconds delay);
     void setNeedFrameCb(std::function<void()> cb);
-    void emitFrame(bool isAudio);
+    /**
+     * Give the next packet of the media to its decoder
+     * @return false if there was none
+     */
+    bool emitFrame(bool isAudio);
+    bool hasFrame(bool isAudio);
 
 private:
     bool streamInfoFound_ {false};
@@ -150,14 +177,17 @@ private:
     MediaDemuxer::CurrentState currentState_;
     std::mutex audioBufferMutex_ {};
     std::mutex videoBufferMutex_ {};
-    std::queue<std::unique_ptr<AVPacket, std::function<void(AVPacket*)>>> videoBuffer_ {};
-    std::queue<std::unique_ptr<AVPacket, std::function<void(AVPacket*)>>> audioBuffer_ {};
+    using PacketQueue = std::queue<std::unique_ptr<AVPacket, std::function<void(AVPacket*)>>>;
+    PacketQueue videoBuffer_ {};
+    PacketQueue audioBuffer_ {};
+    std::chrono::microseconds prefetch_ {0};
     std::function<void()> needFrameCb_;
     std::function<void(bool)> fileFinishedCb_;
     void clearFrames();
-    void pushFrameFrom(std::queue<std::unique_ptr<AVPacket, std::function<void(AVPacket*)>>>& buffer,
-                       bool isAudio,
-                       std::mutex& mutex);
+    bool pushFrameFrom(PacketQueue& buffer, bool isAudio, std::mutex& mutex);
+    // Of the packets of the buffer, under its mutex
+    std::chrono::microseconds bufferedDuration(const PacketQueue& buffer) const;
+    bool isFull(const PacketQueue& buffer, size_t maxPackets) const;
     int baseWidth_ {};
     int baseHeight_ {};
 };
@@ -199,6 +229,14 @@ public:
     void emitFrame(bool isAudio);
     void flushBuffers();
     void setSeekTime(int64_t time);
+
+    /**
+     * With emulateRate, decode up to @budget ahead of the presentation of the frames, emitted
+     * at their time by emitFrame: a frame slow to decode (e.g. a key frame) is absorbed by the
+     * frames decoded before it, instead of delaying the next ones. The hardware frames are
+     * downloaded when decoded, not to hold the surfaces of the decoder.
+     */
+    void setDecodeAhead(std::chrono::microseconds budget) { decodeAhead_ = budget; }
 #ifdef RING_ACCEL
     void enableAccel(bool enableAccel);
 #endif
@@ -210,7 +248,40 @@ public:
         resolutionChangedCallback_ = std::move(cb);
     }
 
+    /**
+     * Also give the packets to cb before they are decoded, e.g. to record them as they are.
+     * Set before decoding.
+     */
+    void setPacketObserver(PacketObserver&& cb) { packetObserver_ = std::move(cb); }
+
     void setFEC(bool enable) { fecEnabled_ = enable; }
+    void setMaxDelay(std::chrono::microseconds delay) { demuxer_->setMaxDelay(delay); }
+
+    /**
+     * Decode for interactive calls: no frame threading nor reordering, so each
+     * frame is emitted as soon as its packet is decoded. Set before setup().
+     */
+    void setLowLatency(bool enable) { lowLatency_ = enable; }
+
+    /**
+     * @return average time between sending a packet to the decoder and getting
+     * its frame, in microseconds
+     */
+    int64_t getDecodeLatency() const { return decodeLatency_; }
+
+    struct Stats
+    {
+        uint64_t frames {0};
+        std::chrono::microseconds latency {0}; // see getDecodeLatency()
+        bool hardware {false};
+    };
+    /**
+     * Thread-safe
+     */
+    Stats getStats() const
+    {
+        return {decodedFrames_, std::chrono::microseconds(decodeLatency_.load()), hardware_};
+    }
 
 private:
     NON_COPYABLE(MediaDecoder);
@@ -241,6 +312,7 @@ private:
     unsigned short accelFailures_ = 0;
 #endif
     MediaObserver callback_;
+    PacketObserver packetObserver_;
     int prepareDecoderContext();
     int64_t seekTime_ = -1;
     void resetSeekTime() { seekTime_ = -1; }
@@ -250,6 +322,21 @@ private:
     int height_;
 
     bool fecEnabled_ {false};
+    bool lowLatency_ {false};
+
+    std::chrono::microseconds decodeAhead_ {0};
+    std::mutex aheadMutex_;
+    // Decoded ahead, with their time relative to startTime_, in microseconds
+    std::deque<std::pair<int64_t, std::shared_ptr<MediaFrame>>> ahead_;
+    std::chrono::microseconds aheadDuration();
+    bool emitAhead();
+
+    // pts and time of the packets sent to the decoder, waiting for their frame
+    std::deque<std::pair<int64_t, int64_t>> sendTimes_;
+    std::atomic<int64_t> decodeLatency_ {0};
+    std::atomic<uint64_t> decodedFrames_ {0};
+    std::atomic_bool hardware_ {false};
+    void updateDecodeLatency(int64_t pts);
 
 protected:
     AVDictionary* options_ = nullptr;
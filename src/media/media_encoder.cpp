@@ -24,13 +24,16 @@
 #include "media_codec.h"
 #include "media_encoder.h"
 #include "media_buffer.h"
+#include "codec_threads.h"
 
 #include "client/ring_signal.h"
 #include "fileutils.h"
 #include "logger.h"
 #include "manager.h"
+#include "metrics.h"
 #include "string_utils.h"
 #include "system_codec_container.h"
+#include "tracepoint.h"
 
 #ifdef RING_ACCEL
 #include "video/accel.h"
@@ -48,6 +51,7 @@ extern "C" {
 #include <thread> // hardware_concurrency
 #include <string_view>
 #include <cmath>
+#include <cstring>
 
 // Define following line if you need to debug libav SDP
 //#define DEBUG_SDP 1
@@ -56,6 +60,11 @@ using namespace std::literals;
 
 namespace jami {
 
+// Unchanged screen frames are still encoded at this interval, refining the quality
+constexpr auto SCREEN_IDLE_INTERVAL = std::chrono::seconds(1);
+// Of a refresh of the whole picture
+constexpr auto INTRA_REFRESH_PERIOD = std::chrono::seconds(1);
+
 constexpr double LOGREG_PARAM_A {101};
 constexpr double LOGREG_PARAM_B {-5.};
 
@@ -78,6 +87,7 @@ MediaEncoder::~MediaEncoder()
         }
         for (auto encoderCtx : encoders_) {
             if (encoderCtx) {
+                CodecThreads::instance().release(encoderCtx);
 #ifndef _MSC_VER
                 avcodec_free_context(&encoderCtx);
 #else
@@ -135,6 +145,7 @@ MediaEncoder::setOptions(const MediaDescription& args)
     mode_ = args.mode;
     linkableHW_ = args.linkableHW;
     fecEnabled_ = args.fecEnabled;
+    screenContent_ = args.screenContent;
 }
 
 void
@@ -176,6 +187,31 @@ MediaEncoder::openOutput(const std::string& filename, const std::string& format)
         JAMI_ERR() << "Cannot open " << filename << ": " << libav_utils::getError(-result);
 }
 
+void
+MediaEncoder::setFragmentDuration(std::chrono::milliseconds duration)
+{
+    if (not outputCtx_ or not outputCtx_->oformat)
+        return;
+    std::string_view name = outputCtx_->oformat->name;
+    auto ms = std::to_string(duration.count());
+    auto us = std::to_string(
+        std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    if (name == "matroska" or name == "webm") {
+        libav_utils::setDictValue(&options_, "cluster_time_limit", ms);
+    } else if (name == "mp4" or name == "mov" or name == "ipod") {
+        // Without the index at the end, written with the trailer
+        libav_utils::setDictValue(&options_,
+                                  "movflags",
+                                  "frag_keyframe+empty_moov+default_base_moof");
+        libav_utils::setDictValue(&options_, "frag_duration", us);
+    } else if (name == "ogg" or name == "opus") {
+        libav_utils::setDictValue(&options_, "page_duration", us);
+    } else {
+        JAMI_WARN() << "No fragments for the " << name << " format";
+    }
+    libav_utils::setDictValue(&options_, "flush_packets", "1");
+}
+
 int
 MediaEncoder::addStream(const SystemCodecInfo& systemCodecInfo)
 {
@@ -289,10 +325,11 @@ MediaEncoder::initStream(const SystemCodecInfo& systemCodecInfo, AVBufferRef* fr
             encoderCtx->opaque = accel_.get();
             // Check if pixel format from encoder match pixel format from decoder frame context
             // if it mismatch, it means that we are using two different hardware API (nvenc and
-            // vaapi for example) in this case we don't want link the APIs
+            // vaapi for example) in this case we don't want link the APIs.
+            // Neither are the surfaces of another layout, e.g. 4:2:2 of a MJPEG camera
             if (framesCtx) {
                 auto hw = reinterpret_cast<AVHWFramesContext*>(framesCtx->data);
-                if (encoderCtx->pix_fmt != hw->format)
+                if (encoderCtx->pix_fmt != hw->format or hw->sw_format != it.getSoftwareFormat())
                     linkableHW_ = false;
             }
             auto ret = accel_->initAPI(linkableHW_, framesCtx);
@@ -398,8 +435,16 @@ MediaEncoder::openIOContext()
 void
 MediaEncoder::startIO()
 {
+    if (onPacket_) {
+        initialized_ = true;
+        return;
+    }
     if (!outputCtx_->pb)
         openIOContext();
+    // FFmpeg's packetization of VP9 follows a draft
+    for (unsigned i = 0; i < outputCtx_->nb_streams; i++)
+        if (outputCtx_->streams[i]->codecpar->codec_id == AV_CODEC_ID_VP9)
+            outputCtx_->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
     if (avformat_write_header(outputCtx_, options_ ? &options_ : nullptr)) {
         JAMI_ERR("Could not write header for output file... check codec parameters");
         throw MediaEncoderException("Failed to write output file header");
@@ -425,16 +470,37 @@ MediaEncoder::encode(const std::shared_ptr<VideoFrame>& input,
         resetStreams(width, height);
         is_keyframe = true;
     }
+#ifdef RING_ACCEL
+    // Hardware frames of another frames context, e.g. once the conference mixer scales
+    // its source on the device: linked to it instead of transferred to main memory
+    auto framesCtx = input->pointer()->hw_frames_ctx;
+    if (initialized_ && linkableHW_ && accel_ && framesCtx && !accel_->isLinkedTo(framesCtx)) {
+        JAMI_DBG("[%p] Linking the encoder to new hardware frames", this);
+        resetStreams(width, height);
+        is_keyframe = true;
+    }
+#endif
 
     if (!initialized_) {
         initStream(videoCodec_, input->pointer()->hw_frames_ctx);
         startIO();
     }
 
+    if (screenContent_) {
+        auto now = std::chrono::steady_clock::now();
+        if (not is_keyframe and lastScreenFrame_ and sameFrame(*lastScreenFrame_, *input)
+            and now - lastScreenEncode_ < SCREEN_IDLE_INTERVAL)
+            return 0;
+        lastScreenFrame_ = input;
+        lastScreenEncode_ = now;
+    }
+
     std::shared_ptr<VideoFrame> output;
 #ifdef RING_ACCEL
     if (getHWFrame(input, output) < 0) {
         JAMI_ERR("Fail to get hardware frame");
+        if (switchEncoder())
+            return encode(input, true, frame_number);
         return -1;
     }
 #else
@@ -461,7 +527,13 @@ MediaEncoder::encode(const std::shared_ptr<VideoFrame>& input,
         avframe->key_frame = 0;
     }
 
-    return encode(avframe, currentStreamIdx_);
+    jami_tracepoint(media_frame_link, input->pointer(), avframe);
+    auto ret = encode(avframe, currentStreamIdx_);
+#ifdef RING_ACCEL
+    if (ret < 0 && switchEncoder())
+        return encode(input, true, frame_number);
+#endif
+    return ret;
 }
 #endif // ENABLE_VIDEO
 
@@ -481,13 +553,46 @@ MediaEncoder::encodeAudio(AudioFrame& frame)
     return 0;
 }
 
+void
+MediaEncoder::skipAudio(int nbSamples)
+{
+    sent_samples += nbSamples;
+}
+
+struct EncoderMetrics
+{
+    explicit EncoderMetrics(const std::string& media)
+        : frames(metrics::Registry::instance().counter("jami_encoder_frames",
+                                                       "Frames encoded",
+                                                       {{"media", media}}))
+        , latency(metrics::Registry::instance().histogram("jami_encoder_latency_seconds",
+                                                          "Time to encode a frame",
+                                                          metrics::durationBuckets(),
+                                                          {{"media", media}}))
+    {}
+
+    metrics::Counter& frames;
+    metrics::Histogram& latency;
+};
+
+static EncoderMetrics&
+encoderMetrics(AVMediaType type)
+{
+    static EncoderMetrics audio("audio");
+    static EncoderMetrics video("video");
+    return type == AVMEDIA_TYPE_VIDEO ? video : audio;
+}
+
 int
 MediaEncoder::encode(AVFrame* frame, int streamIdx)
 {
     if (!initialized_ && frame) {
         // Initialize on first video frame, or first audio frame if no video stream
+        std::lock_guard<std::mutex> lk(outputMutex_);
         bool isVideo = (frame->width > 0 && frame->height > 0);
-        if (isVideo and videoOpts_.isValid()) {
+        if (initialized_) {
+            // By the thread of another stream meanwhile
+        } else if (isVideo and videoOpts_.isValid()) {
             // Has video stream, so init with video frame
             streamIdx = initStream(videoCodec_, frame->hw_frames_ctx);
             startIO();
@@ -498,6 +603,25 @@ MediaEncoder::encode(AVFrame* frame, int streamIdx)
             return 0;
         }
     }
+#if defined(ENABLE_VIDEO) && defined(RING_ACCEL) && !defined(__APPLE__)
+    // Software frames for a hardware encoder, e.g. the filtered frames of MediaRecorder
+    std::shared_ptr<VideoFrame> uploaded;
+    if (accel_ and frame and frame->width > 0) {
+        auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+        if (desc and not (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            try {
+                VideoFrame input;
+                av_frame_ref(input.pointer(), frame);
+                uploaded = getHWFrameFromSWFrame(input);
+                uploaded->pointer()->pts = frame->pts;
+                frame = uploaded->pointer();
+            } catch (const std::runtime_error& e) {
+                JAMI_ERR("Accel failure: %s", e.what());
+                return -1;
+            }
+        }
+    }
+#endif
     int ret = 0;
     AVCodecContext* encoderCtx = encoders_[streamIdx];
     AVPacket pkt;
@@ -505,6 +629,11 @@ MediaEncoder::encode(AVFrame* frame, int streamIdx)
     pkt.data = nullptr; // packet data will be allocated by the encoder
     pkt.size = 0;
 
+    jami_tracepoint(media_encode_begin,
+                    libav_utils::getIOOpaque(outputCtx_),
+                    frame,
+                    frame ? frame->pts : AV_NOPTS_VALUE);
+    auto start = std::chrono::steady_clock::now();
     ret = avcodec_send_frame(encoderCtx, frame);
     if (ret < 0)
         return -1;
@@ -523,14 +652,49 @@ MediaEncoder::encode(AVFrame* frame, int streamIdx)
                 break;
         }
     }
+    jami_tracepoint(media_encode_end, libav_utils::getIOOpaque(outputCtx_));
+    if (frame) {
+        auto encodeTime = std::chrono::steady_clock::now() - start;
+        auto& m = encoderMetrics(encoderCtx->codec_type);
+        m.frames.add();
+        m.latency.observe(encodeTime);
+        ++encodedFrames_;
+        encodeTimeUs_ += std::chrono::duration_cast<std::chrono::microseconds>(encodeTime).count();
+#ifdef RING_ACCEL
+        hardware_ = accel_ != nullptr;
+#endif
+    }
 
     av_packet_unref(&pkt);
     return 0;
 }
 
+MediaEncoder::Stats
+MediaEncoder::getStats() const
+{
+    Stats stats;
+    stats.frames = encodedFrames_;
+    stats.encodeTime = std::chrono::microseconds(encodeTimeUs_.load());
+    stats.hardware = hardware_;
+    return stats;
+}
+
+void
+MediaEncoder::setPacketObserver(PacketObserver&& cb)
+{
+    std::lock_guard<std::mutex> lk(outputMutex_);
+    packetObserver_ = std::move(cb);
+}
+
 bool
 MediaEncoder::send(AVPacket& pkt, int streamIdx)
 {
+    jami_tracepoint(media_packetize, libav_utils::getIOOpaque(outputCtx_), pkt.pts, pkt.size);
+    if (onPacket_) {
+        onPacket_(pkt);
+        return true;
+    }
+    std::lock_guard<std::mutex> lk(outputMutex_);
     if (!initialized_) {
         streamIdx = initStream(videoCodec_);
         startIO();
@@ -540,6 +704,8 @@ MediaEncoder::send(AVPacket& pkt, int streamIdx)
     if (streamIdx >= 0 and static_cast<size_t>(streamIdx) < encoders_.size()
         and static_cast<unsigned int>(streamIdx) < outputCtx_->nb_streams) {
         auto encoderCtx = encoders_[streamIdx];
+        if (packetObserver_)
+            packetObserver_(pkt, *outputCtx_->streams[streamIdx]->codecpar, encoderCtx->time_base);
         pkt.stream_index = streamIdx;
         if (pkt.pts != AV_NOPTS_VALUE)
             pkt.pts = av_rescale_q(pkt.pts,
@@ -550,8 +716,9 @@ MediaEncoder::send(AVPacket& pkt, int streamIdx)
                                    encoderCtx->time_base,
                                    outputCtx_->streams[streamIdx]->time_base);
     }
-    // write the compressed frame
-    auto ret = av_write_frame(outputCtx_, &pkt);
+    // write the compressed frame, files interleaving the packets of their streams by timestamp
+    auto ret = fileIO_ ? av_interleaved_write_frame(outputCtx_, &pkt)
+                       : av_write_frame(outputCtx_, &pkt);
     if (ret < 0) {
         JAMI_ERR() << "av_write_frame failed: " << libav_utils::getError(ret);
     }
@@ -601,7 +768,13 @@ MediaEncoder::prepareEncoderContext(const AVCodec* outputCodec, bool is_video)
 
     auto encoderName = outputCodec->name; // guaranteed to be non null if AVCodec is not null
 
-    encoderCtx->thread_count = std::min(std::thread::hardware_concurrency(), is_video ? 16u : 4u);
+    // Hardware encoders don't use the threads
+    int pixels = is_video ? videoOpts_.width * videoOpts_.height : 0;
+#ifdef RING_ACCEL
+    if (accel_)
+        pixels = 0;
+#endif
+    encoderCtx->thread_count = CodecThreads::instance().acquire(encoderCtx, pixels, true);
     JAMI_DBG("[%s] Using %d threads", encoderName, encoderCtx->thread_count);
 
     if (is_video) {
@@ -682,7 +855,10 @@ MediaEncoder::forcePresetX2645(AVCodecContext* encoderCtx)
 #endif
         if (av_opt_set(encoderCtx, "preset", speedPreset, AV_OPT_SEARCH_CHILDREN))
             JAMI_WARN("Failed to set preset '%s'", speedPreset);
-        const char* tune = "zerolatency";
+        // x265 has no tune for screen content
+        const char* tune = (screenContent_ and encoderCtx->codec_id == AV_CODEC_ID_H264)
+                               ? "stillimage,zerolatency"
+                               : "zerolatency";
         if (av_opt_set(encoderCtx, "tune", tune, AV_OPT_SEARCH_CHILDREN))
             JAMI_WARN("Failed to set tune '%s'", tune);
     }
@@ -751,6 +927,22 @@ MediaEncoder::enableAccel(bool enableAccel)
             enc->opaque = nullptr;
     }
 }
+
+bool
+MediaEncoder::switchEncoder()
+{
+    if (not accel_)
+        return false;
+    JAMI_WARN("[%p] Hardware encoder %s failed, switching encoder",
+              this,
+              accel_->getCodecName().c_str());
+    // Excluded from getCompatibleAccel, the next one or a software encoder
+    // is opened for the same stream, the peer only sees a new keyframe
+    accel_->markFailed();
+    resetStreams(videoOpts_.width, videoOpts_.height);
+    accel_.reset();
+    return true;
+}
 #endif
 
 unsigned
@@ -845,12 +1037,16 @@ MediaEncoder::initCodec(AVMediaType mediaType, AVCodecID avcodecId, uint64_t br)
         initH265(encoderCtx, br);
     } else if (avcodecId == AV_CODEC_ID_VP8) {
         initVP8(encoderCtx, br);
+    } else if (avcodecId == AV_CODEC_ID_VP9) {
+        initVP9(encoderCtx, br);
     } else if (avcodecId == AV_CODEC_ID_MPEG4) {
         initMPEG4(encoderCtx, br);
     } else if (avcodecId == AV_CODEC_ID_H263) {
         initH263(encoderCtx, br);
     }
     initAccel(encoderCtx, br);
+    if (mediaType == AVMEDIA_TYPE_VIDEO)
+        initIntraRefresh(encoderCtx);
     return encoderCtx;
 }
 
@@ -878,7 +1074,7 @@ MediaEncoder::setBitrate(uint64_t br)
     else if (codecId == AV_CODEC_ID_MPEG4)
         initMPEG4(encoderCtx, br);
     else {
-        // restart encoder on runtime doesn't work for VP8
+        // restart encoder on runtime doesn't work for VP8 and VP9
         // stopEncoder();
         // encoderCtx = initCodec(codecType, codecId, br);
         // if (avcodec_open2(encoderCtx, outputCodec_, &options_) < 0)
@@ -1013,6 +1209,8 @@ MediaEncoder::initVP8(AVCodecContext* encoderCtx, uint64_t br)
         av_opt_set_int(encoderCtx, "slices", 2, AV_OPT_SEARCH_CHILDREN); // VP8E_SET_TOKEN_PARTITIONS
         av_opt_set_int(encoderCtx, "qmax", 56, AV_OPT_SEARCH_CHILDREN);
         av_opt_set_int(encoderCtx, "qmin", 4, AV_OPT_SEARCH_CHILDREN);
+        if (screenContent_)
+            av_opt_set_int(encoderCtx, "screen-content-mode", 1, AV_OPT_SEARCH_CHILDREN);
         crf = std::clamp((int) crf, 4, 56);
         av_opt_set_int(encoderCtx, "crf", crf, AV_OPT_SEARCH_CHILDREN);
         av_opt_set_int(encoderCtx, "b", maxBitrate, AV_OPT_SEARCH_CHILDREN);
@@ -1025,6 +1223,48 @@ MediaEncoder::initVP8(AVCodecContext* encoderCtx, uint64_t br)
     }
 }
 
+void
+MediaEncoder::initVP9(AVCodecContext* encoderCtx, uint64_t br)
+{
+    // Constrained quality as VP8, so fewer frames take fewer bits, split between the
+    // temporal layers
+    uint64_t maxBitrate = 1000 * br;
+    uint8_t crf = (uint8_t) std::round(LOGREG_PARAM_A + LOGREG_PARAM_B * std::log(maxBitrate));
+    crf = std::clamp((int) crf, 4, 56);
+    uint64_t bufSize = maxBitrate / 2;
+
+    av_opt_set(encoderCtx, "quality", "realtime", AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "speed", 8, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "row-mt", 1, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "tile-columns", 2, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "lag-in-frames", 0, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "error-resilient", 1, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "drop-frame", 25, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "undershoot-pct", 95, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "qmax", 56, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "qmin", 4, AV_OPT_SEARCH_CHILDREN);
+    if (screenContent_)
+        av_opt_set_int(encoderCtx, "tune-content", 1, AV_OPT_SEARCH_CHILDREN); // screen
+    av_opt_set_int(encoderCtx, "crf", crf, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "b", maxBitrate, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "maxrate", maxBitrate, AV_OPT_SEARCH_CHILDREN);
+    av_opt_set_int(encoderCtx, "bufsize", bufSize, AV_OPT_SEARCH_CHILDREN);
+
+    // Three temporal layers, of a quarter, half then all of the frames: no frame refers
+    // to one of a higher layer, so a lost frame of the higher ones doesn't prevent the
+    // next ones from being decoded
+    auto ts = fmt::format("ts_number_layers=3:ts_target_bitrate={},{},{}:ts_rate_decimator=4,2,1"
+                          ":ts_periodicity=4:ts_layer_id=0,2,1,2",
+                          br * 6 / 10,
+                          br * 8 / 10,
+                          br);
+    av_opt_set(encoderCtx, "ts-parameters", ts.c_str(), AV_OPT_SEARCH_CHILDREN);
+    JAMI_DBG("VP9 encoder setup: crf=%u, maxrate=%lu, bufsize=%lu, 3 temporal layers",
+             crf,
+             maxBitrate / 1000,
+             bufSize / 1000);
+}
+
 void
 MediaEncoder::initMPEG4(AVCodecContext* encoderCtx, uint64_t br)
 {
@@ -1055,6 +1295,14 @@ MediaEncoder::initOpus(AVCodecContext* encoderCtx)
     // Enable FEC support by default with 10% packet loss
     av_opt_set_int(encoderCtx, "fec", fecEnabled_ ? 1 : 0, AV_OPT_SEARCH_CHILDREN);
     av_opt_set_int(encoderCtx, "packet_loss", 10, AV_OPT_SEARCH_CHILDREN);
+    // Longer frames and lower bitrates are chosen by AudioRtpSession for bad networks
+    if (audioOpts_.frameSize > 0 and audioOpts_.sampleRate > 0)
+        av_opt_set_double(encoderCtx,
+                          "frame_duration",
+                          1000. * audioOpts_.frameSize / audioOpts_.sampleRate,
+                          AV_OPT_SEARCH_CHILDREN);
+    if (audioOpts_.bitrate > 0)
+        encoderCtx->bit_rate = audioOpts_.bitrate * 1000;
 }
 
 void
@@ -1079,6 +1327,33 @@ MediaEncoder::initAccel(AVCodecContext* encoderCtx, uint64_t br)
 #endif
 }
 
+void
+MediaEncoder::initIntraRefresh(AVCodecContext* encoderCtx)
+{
+    intraRefreshing_ = false;
+    if (not intraRefresh_)
+        return;
+    std::string_view name = encoderCtx->codec->name;
+    if (name == "libvpx"sv) {
+        // A lost partition doesn't prevent the next ones from being decoded
+        av_opt_set(encoderCtx, "error-resilient", "default+partitions", AV_OPT_SEARCH_CHILDREN);
+        return;
+    }
+    int ret = AVERROR_OPTION_NOT_FOUND;
+    if (name == "libx264"sv or name == "h264_nvenc"sv or name == "hevc_nvenc"sv)
+        ret = av_opt_set_int(encoderCtx, "intra-refresh", 1, AV_OPT_SEARCH_CHILDREN);
+    else if (name == "h264_qsv"sv or name == "hevc_qsv"sv)
+        ret = av_opt_set(encoderCtx, "int_ref_type", "vertical", AV_OPT_SEARCH_CHILDREN);
+    if (ret < 0)
+        return;
+    // The wave covers the picture in gop_size frames
+    encoderCtx->gop_size = std::max(1,
+                                    static_cast<int>(av_q2d(encoderCtx->framerate)
+                                                     * INTRA_REFRESH_PERIOD.count()));
+    intraRefreshing_ = true;
+    JAMI_DBG("[%s] Intra refresh every %d frames", name.data(), encoderCtx->gop_size);
+}
+
 AVCodecContext*
 MediaEncoder::getCurrentVideoAVCtx()
 {
@@ -1110,6 +1385,7 @@ MediaEncoder::stopEncoder()
         }
     }
     AVCodecContext* encoderCtx = getCurrentVideoAVCtx();
+    CodecThreads::instance().release(encoderCtx);
     avcodec_close(encoderCtx);
     avcodec_free_context(&encoderCtx);
     av_free(encoderCtx);
@@ -1123,7 +1399,7 @@ MediaEncoder::isDynBitrateSupported(AVCodecID codecid)
         return accel_->dynBitrate();
     }
 #endif
-    if (codecid != AV_CODEC_ID_VP8)
+    if (codecid != AV_CODEC_ID_VP8 and codecid != AV_CODEC_ID_VP9)
         return true;
 
     return false;
@@ -1327,6 +1603,37 @@ MediaEncoder::getHWFrameFromSWFrame(const VideoFrame& input)
     return framePtr;
 }
 
+bool
+MediaEncoder::sameFrame(const VideoFrame& a, const VideoFrame& b)
+{
+    auto fa = a.pointer();
+    auto fb = b.pointer();
+    if (fa == fb)
+        return true;
+    if (fa->format != fb->format or fa->width != fb->width or fa->height != fb->height)
+        return false;
+    auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(fa->format));
+    if (not desc or (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+        return false;
+
+    // Stops at the first difference, so changing frames cost little
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS and fa->data[plane]; ++plane) {
+        auto rowSize = av_image_get_linesize(static_cast<AVPixelFormat>(fa->format),
+                                             fa->width,
+                                             plane);
+        if (rowSize <= 0)
+            break;
+        int rows = (plane == 1 or plane == 2) ? AV_CEIL_RSHIFT(fa->height, desc->log2_chroma_h)
+                                              : fa->height;
+        for (int y = 0; y < rows; ++y)
+            if (std::memcmp(fa->data[plane] + y * fa->linesize[plane],
+                            fb->data[plane] + y * fb->linesize[plane],
+                            rowSize))
+                return false;
+    }
+    return true;
+}
+
 std::shared_ptr<VideoFrame>
 MediaEncoder::getScaledSWFrame(const VideoFrame& input)
 {
@@ -1348,6 +1655,7 @@ MediaEncoder::resetStreams(int width, int height)
         if (outputCtx_) {
             for (auto encoderCtx : encoders_) {
                 if (encoderCtx) {
+                    CodecThreads::instance().release(encoderCtx);
 #ifndef _MSC_VER
                     avcodec_free_context(&encoderCtx);
 #else
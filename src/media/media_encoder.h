@@ -34,6 +34,9 @@
 #include "media_codec.h"
 #include "media_stream.h"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -77,15 +80,37 @@ public:
     void setOptions(const MediaDescription& args);
     int addStream(const SystemCodecInfo& codec);
     void setIOContext(AVIOContext* ioctx) { ioCtx_ = ioctx; }
+
+    /**
+     * Write a file output as fragments of about @duration (Matroska clusters, fragmented MP4,
+     * Ogg pages), each flushed to the file: a crash loses the last fragment, not the file.
+     * To be called after openOutput.
+     */
+    void setFragmentDuration(std::chrono::milliseconds duration);
     void resetStreams(int width, int height);
 
     bool send(AVPacket& packet, int streamIdx = -1);
 
+    /**
+     * Give the encoded packets to cb instead of writing them to the output,
+     * which is then not opened. The packets' timestamps are in the time base
+     * of the encoder.
+     */
+    void setOnPacket(std::function<void(AVPacket&)>&& cb) { onPacket_ = std::move(cb); }
+
+    /**
+     * Also give the packets written to the output to cb, before they are rescaled to the time
+     * base of the output, e.g. to record them as they are. Thread-safe.
+     */
+    void setPacketObserver(PacketObserver&& cb);
+
 #ifdef ENABLE_VIDEO
     int encode(const std::shared_ptr<VideoFrame>& input, bool is_keyframe, int64_t frame_number);
 #endif // ENABLE_VIDEO
 
     int encodeAudio(AudioFrame& frame);
+    // Samples not sent, for discontinuous transmission, the timestamps still advance
+    void skipAudio(int nbSamples);
 
     // frame should be ready to be sent to the encoder at this point
     int encode(AVFrame* frame, int streamIdx);
@@ -112,8 +137,31 @@ public:
     void enableAccel(bool enableAccel);
 #endif
 
+    /**
+     * Recover the decoders from the losses with a wave of intra blocks moving over the
+     * frames, rather than with keyframes bursting the bitrate, where the encoder of the
+     * codec supports it (x264, NVENC and QSV). VP8 makes its partitions independent
+     * instead. Before the first frame.
+     */
+    void setIntraRefresh(bool enable) { intraRefresh_ = enable; }
+    /**
+     * Whether the encoder refreshes the picture, once the first frame is encoded. Thread-safe.
+     */
+    bool isIntraRefreshing() const { return intraRefreshing_; }
+
     static std::string testH265Accel();
 
+    struct Stats
+    {
+        uint64_t frames {0};
+        std::chrono::microseconds encodeTime {0}; // total, of all the frames
+        bool hardware {false};
+    };
+    /**
+     * Thread-safe
+     */
+    Stats getStats() const;
+
     unsigned getStreamCount() const;
     MediaStream getStream(const std::string& name, int streamIdx = -1) const;
 
@@ -133,17 +181,28 @@ private:
     void initH264(AVCodecContext* encoderCtx, uint64_t br);
     void initH265(AVCodecContext* encoderCtx, uint64_t br);
     void initVP8(AVCodecContext* encoderCtx, uint64_t br);
+    void initVP9(AVCodecContext* encoderCtx, uint64_t br);
     void initMPEG4(AVCodecContext* encoderCtx, uint64_t br);
     void initH263(AVCodecContext* encoderCtx, uint64_t br);
     void initOpus(AVCodecContext* encoderCtx);
     bool isDynBitrateSupported(AVCodecID codecid);
     bool isDynPacketLossSupported(AVCodecID codecid);
     void initAccel(AVCodecContext* encoderCtx, uint64_t br);
+    void initIntraRefresh(AVCodecContext* encoderCtx);
+#ifdef RING_ACCEL
+    /**
+     * Replace the failed hardware encoder, without changing the stream
+     * @return false if not using a hardware encoder
+     */
+    bool switchEncoder();
+#endif
 #ifdef ENABLE_VIDEO
     int getHWFrame(const std::shared_ptr<VideoFrame>& input, std::shared_ptr<VideoFrame>& output);
     std::shared_ptr<VideoFrame> getUnlinkedHWFrame(const VideoFrame& input);
     std::shared_ptr<VideoFrame> getHWFrameFromSWFrame(const VideoFrame& input);
     std::shared_ptr<VideoFrame> getScaledSWFrame(const VideoFrame& input);
+    // For screen content, false for hardware frames
+    static bool sameFrame(const VideoFrame& a, const VideoFrame& b);
 #endif
 
     std::vector<AVCodecContext*> encoders_;
@@ -151,18 +210,30 @@ private:
     AVIOContext* ioCtx_ = nullptr;
     int currentStreamIdx_ = -1;
     unsigned sent_samples = 0;
-    bool initialized_ {false};
+    std::atomic_bool initialized_ {false};
     bool fileIO_ {false};
     unsigned int currentVideoCodecID_ {0};
     const AVCodec* outputCodec_ = nullptr;
     std::mutex encMutex_;
+    // Initialization of and writes to the output, the streams being encoded by different
+    // threads, e.g. for MediaRecorder
+    std::mutex outputMutex_;
     bool linkableHW_ {false};
     RateMode mode_ {RateMode::CRF_CONSTRAINED};
     bool fecEnabled_ {false};
+    bool screenContent_ {false};
+    bool intraRefresh_ {false};
+    std::atomic_bool intraRefreshing_ {false};
+    std::function<void(AVPacket&)> onPacket_;
+    // Under outputMutex_
+    PacketObserver packetObserver_;
 
 #ifdef ENABLE_VIDEO
     video::VideoScaler scaler_;
     std::shared_ptr<VideoFrame> scaledFrame_;
+    // Screen content: unchanged frames are skipped, but one every SCREEN_IDLE_INTERVAL
+    std::shared_ptr<VideoFrame> lastScreenFrame_;
+    std::chrono::steady_clock::time_point lastScreenEncode_ {};
 #endif // ENABLE_VIDEO
 
     std::vector<uint8_t> scaledFrameBuffer_;
@@ -173,6 +244,10 @@ private:
     std::unique_ptr<video::HardwareAccel> accel_;
 #endif
 
+    std::atomic<uint64_t> encodedFrames_ {0};
+    std::atomic<int64_t> encodeTimeUs_ {0};
+    std::atomic_bool hardware_ {false};
+
 protected:
     void readConfig(AVCodecContext* encoderCtx);
     AVDictionary* options_ = nullptr;
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "media_executor.h"
+
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace jami {
+
+struct MediaExecutor::Job
+{
+    Job(std::function<clock::time_point()>&& p, ThreadRole r)
+        : process(std::move(p))
+        , role(r)
+    {}
+
+    const std::function<clock::time_point()> process;
+    const ThreadRole role;
+    std::atomic_bool active {false};
+    // Protected by the mutex of the executor
+    bool running {false};
+    uint64_t generation {0}; ///< of the entry of the next step, the older ones are skipped
+    std::thread::id worker {};
+    std::condition_variable done {};
+};
+
+MediaExecutor&
+MediaExecutor::instance()
+{
+    static MediaExecutor executor(std::max(2u, std::thread::hardware_concurrency()));
+    return executor;
+}
+
+MediaExecutor::MediaExecutor(unsigned workers)
+{
+    workers_.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i)
+        workers_.emplace_back([this] { work(); });
+}
+
+MediaExecutor::~MediaExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void
+MediaExecutor::schedule(const std::shared_ptr<Job>& job, clock::time_point at)
+{
+    // With the lock held
+    auto earliest = queue_.empty() or at < queue_.top().at;
+    queue_.emplace(Entry {at, ++job->generation, job});
+    if (earliest)
+        cv_.notify_one();
+}
+
+void
+MediaExecutor::work()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (not stopping_) {
+        if (queue_.empty()) {
+            cv_.wait(lk);
+            continue;
+        }
+        const auto& entry = queue_.top();
+        if (entry.generation != entry.job->generation or not entry.job->active) {
+            queue_.pop();
+            continue;
+        }
+        if (entry.at > clock::now()) {
+            cv_.wait_until(lk, entry.at);
+            continue;
+        }
+        auto job = entry.job;
+        queue_.pop();
+        // Another worker may take the next entry meanwhile
+        if (not queue_.empty())
+            cv_.notify_one();
+        job->running = true;
+        job->worker = std::this_thread::get_id();
+        lk.unlock();
+
+        setCurrentThreadRole(job->role, "jami:media");
+        clock::time_point next;
+        try {
+            next = job->process();
+        } catch (const std::exception& e) {
+            JAMI_ERR("Media job failed: %s", e.what());
+            job->active = false;
+        }
+
+        lk.lock();
+        job->running = false;
+        job->worker = {};
+        if (job->active)
+            schedule(job, next);
+        job->done.notify_all();
+    }
+}
+
+MediaLoop::MediaLoop(std::function<clock::time_point()>&& process,
+                     ThreadRole role,
+                     MediaExecutor& executor)
+    : executor_(executor)
+    , job_(std::make_shared<MediaExecutor::Job>(std::move(process), role))
+{}
+
+MediaLoop::~MediaLoop()
+{
+    join();
+}
+
+void
+MediaLoop::start(clock::time_point at)
+{
+    std::lock_guard<std::mutex> lk(executor_.mutex_);
+    if (job_->active)
+        return;
+    job_->active = true;
+    // Else scheduled at the end of the current step
+    if (not job_->running)
+        executor_.schedule(job_, at);
+}
+
+void
+MediaLoop::stop()
+{
+    job_->active = false;
+}
+
+void
+MediaLoop::join()
+{
+    std::unique_lock<std::mutex> lk(executor_.mutex_);
+    job_->active = false;
+    if (job_->worker == std::this_thread::get_id())
+        return;
+    job_->done.wait(lk, [this] { return not job_->running; });
+}
+
+bool
+MediaLoop::isRunning() const noexcept
+{
+    return job_->active;
+}
+
+} // namespace jami
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include "threadloop.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace jami {
+
+/**
+ * Workers shared by the periodic media jobs (mixers, audio inputs), one per core, instead
+ * of a thread per job.
+ *
+ * The jobs are cooperative: rather than sleeping until their next period, they return the
+ * time it is due and are run again then, the earliest deadline first. They must not block.
+ */
+class MediaExecutor
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static MediaExecutor& instance();
+
+    explicit MediaExecutor(unsigned workers);
+    ~MediaExecutor();
+
+    std::size_t workers() const { return workers_.size(); }
+
+private:
+    NON_COPYABLE(MediaExecutor);
+    friend class MediaLoop;
+
+    struct Job;
+    struct Entry
+    {
+        clock::time_point at;
+        uint64_t generation;
+        std::shared_ptr<Job> job;
+        bool operator>(const Entry& o) const { return at > o.at; }
+    };
+
+    void schedule(const std::shared_ptr<Job>& job, clock::time_point at);
+    void work();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue_;
+    bool stopping_ {false};
+    std::vector<std::thread> workers_;
+};
+
+/**
+ * A job of the media executor, with the interface of a ThreadLoop
+ */
+class MediaLoop
+{
+public:
+    using clock = MediaExecutor::clock;
+
+    /**
+     * @param process   Does a step of the job, and returns when the next one is due
+     * @param role      Taken by the worker while running the job
+     */
+    explicit MediaLoop(std::function<clock::time_point()>&& process,
+                       ThreadRole role = ThreadRole::DEFAULT,
+                       MediaExecutor& executor = MediaExecutor::instance());
+    ~MediaLoop();
+
+    /**
+     * Run the first step at @at, if not running yet
+     */
+    void start(clock::time_point at = clock::now());
+    /**
+     * No further step, the current one may still be running
+     */
+    void stop();
+    /**
+     * Stop, and wait for the end of the current step unless called by it
+     */
+    void join();
+    bool isRunning() const noexcept;
+
+private:
+    NON_COPYABLE(MediaLoop);
+
+    MediaExecutor& executor_;
+    const std::shared_ptr<MediaExecutor::Job> job_;
+};
+
+} // namespace jami
@@ -27,11 +27,17 @@
 namespace jami {
 
 static constexpr auto MS_PER_PACKET = std::chrono::milliseconds(20);
+// Packets read ahead, demuxing resuming when half of them were decoded
+static constexpr auto PREFETCH = std::chrono::seconds(2);
+// Video frames decoded before they are shown, absorbing the decoding time of the large ones
+static constexpr auto DECODE_AHEAD = std::chrono::milliseconds(500);
 
 MediaPlayer::MediaPlayer(const std::string& path)
     : loop_(std::bind(&MediaPlayer::configureMediaInputs, this),
             std::bind(&MediaPlayer::process, this),
-            [] {})
+            [] {},
+            ThreadRole::DEFAULT,
+            "jami:player")
 {
     static const std::string& sep = DRing::Media::VideoProtocolPrefix::SEPARATOR;
     const auto pos = path.find(sep);
@@ -73,6 +79,7 @@ MediaPlayer::configureMediaInputs()
         return false;
     }
     demuxer_->findStreamInfo();
+    demuxer_->setPrefetch(PREFETCH);
 
     pauseInterval_ = 0;
     startTime_ = av_gettime();
@@ -93,7 +100,7 @@ MediaPlayer::configureMediaInputs()
         videoStream_ = demuxer_->selectStream(AVMEDIA_TYPE_VIDEO);
         if (hasVideo()) {
             videoInput_->setSink(id_);
-            videoInput_->configureFilePlayback(path_, demuxer_, videoStream_);
+            videoInput_->configureFilePlayback(path_, demuxer_, videoStream_, DECODE_AHEAD);
             videoInput_->updateStartTime(startTime_);
             muteAudio(true);
         }
@@ -217,10 +224,12 @@ MediaPlayer::seekToTime(int64_t time)
         playFileFromBeginning();
         return true;
     }
-    if (!demuxer_->seekFrame(-1, time)) {
+    // From the key frame preceding the time in the stream shown, the decoders skipping up to it
+    if (!demuxer_->seekFrame(hasVideo() ? videoStream_ : audioStream_, time)) {
         return false;
     }
     flushMediaBuffers();
+    readBufferOverflow_ = false;
     demuxer_->updateCurrentState(MediaDemuxer::CurrentState::Demuxing);
     startTime_ = av_gettime() - pauseInterval_ - time;
     if (hasAudio()) {
@@ -244,6 +253,7 @@ MediaPlayer::playFileFromBeginning()
         return;
     }
     flushMediaBuffers();
+    readBufferOverflow_ = false;
     startTime_ = av_gettime();
     lastPausedTime_ = startTime_;
     pauseInterval_ = 0;
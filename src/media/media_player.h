@@ -68,7 +68,7 @@ private:
 
     void playFileFromBeginning();
     std::atomic_bool paused_ {true};
-    bool readBufferOverflow_ = false;
+    std::atomic_bool readBufferOverflow_ {false};
     bool audioStreamEnded_ {false};
     bool videoStreamEnded_ {false};
 
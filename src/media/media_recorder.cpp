@@ -36,6 +36,7 @@
 #include <opendht/thread_pool.h>
 
 #include <algorithm>
+#include <deque>
 #include <iomanip>
 #include <sstream>
 #include <sys/types.h>
@@ -60,6 +61,326 @@ replaceAll(const std::string& str, const std::string& from, const std::string& t
     return copy;
 }
 
+// Decoded video frames waiting to be recorded, the oldest being dropped
+static constexpr std::size_t VIDEO_QUEUE_CAPACITY {2};
+
+// Filtered frames waiting to be encoded, the oldest being dropped: about 250 ms of video
+// (25 MB in 1080p), 1 s of audio
+static constexpr std::size_t VIDEO_ENCODE_CAPACITY {8};
+static constexpr std::size_t AUDIO_ENCODE_CAPACITY {50};
+
+// Packets waiting to be written in passthrough, the oldest being dropped: a few seconds
+static constexpr std::size_t PACKET_QUEUE_CAPACITY {500};
+
+// Written to the file at once, lost on a crash
+static constexpr std::chrono::seconds FRAGMENT_DURATION {1};
+
+// In passthrough, the streams without packets by then are not recorded, e.g. a muted camera
+static constexpr std::chrono::seconds STREAM_START_TIMEOUT {3};
+
+template<typename T>
+struct MediaRecorder::RecordQueue
+{
+    RecordQueue(const char* media, std::size_t capacity)
+        : media(media)
+        , capacity(capacity)
+    {}
+
+    void push(std::unique_ptr<T>&& item)
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (stopped_)
+                return;
+            if (items_.size() == capacity) {
+                items_.pop_front();
+                ++dropped_;
+            }
+            items_.emplace_back(std::move(item));
+        }
+        cv_.notify_one();
+    }
+
+    /**
+     * @return the next item, null once stopped and drained
+     */
+    std::unique_ptr<T> pop()
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        cv_.wait(lk, [this] { return stopped_ or not items_.empty(); });
+        if (items_.empty())
+            return {};
+        auto item = std::move(items_.front());
+        items_.pop_front();
+        return item;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stopped_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    std::size_t dropped() const
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return dropped_;
+    }
+
+    const char* const media;
+    const std::size_t capacity;
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::unique_ptr<T>> items_;
+    bool stopped_ {false};
+    std::size_t dropped_ {0};
+};
+
+/**
+ * Writes the packets of the sources to a Matroska file as they are, a track per stream.
+ *
+ * The timestamps of each stream are translated to the time of arrival of its first packet, the
+ * streams of a call having independent clocks (e.g. the RTP timestamps of the peer).
+ */
+struct MediaRecorder::Remuxer
+{
+    struct Packet
+    {
+        Packet(unsigned stream, const AVPacket& packet, AVRational timeBase, int64_t time)
+            : stream(stream)
+            , packet(av_packet_clone(&packet))
+            , timeBase(timeBase)
+            , time(time)
+        {}
+        ~Packet()
+        {
+            av_packet_free(&packet);
+            avcodec_parameters_free(&par);
+        }
+
+        const unsigned stream;
+        AVPacket* packet;
+        const AVRational timeBase;
+        // Of its arrival, since the start of the recording, in microseconds
+        const int64_t time;
+        // Of the stream, with its first packet
+        AVCodecParameters* par {nullptr};
+
+    private:
+        NON_COPYABLE(Packet);
+    };
+
+    struct Stream
+    {
+        std::string name;
+        bool isVideo;
+        // By the thread of its source
+        bool started {false};
+        // By the writing thread
+        int index {-1};
+        AVRational timeBase {};
+        int64_t offset {0};
+        int64_t lastDts {AV_NOPTS_VALUE};
+    };
+
+    Remuxer() = default;
+    ~Remuxer() { close(); }
+
+    /**
+     * From the thread of the source of the stream
+     */
+    void onPacket(unsigned idx,
+                  const AVPacket& packet,
+                  const AVCodecParameters& par,
+                  AVRational timeBase);
+
+    bool open(const std::string& path, const std::string& title, const std::string& description);
+
+    /**
+     * Write the packets until the queue is stopped, then finalize the file
+     */
+    void run();
+
+    // Added before the recording starts
+    std::vector<Stream> streams;
+    RecordQueue<Packet> queue {"packet", PACKET_QUEUE_CAPACITY};
+    std::atomic_bool recording {false};
+    int64_t startTime {0};
+
+private:
+    NON_COPYABLE(Remuxer);
+
+    bool addStream(Stream& stream, const Packet& first);
+    bool writeHeader();
+    void write(Packet& p);
+    void close();
+
+    AVFormatContext* output_ {nullptr};
+    AVDictionary* options_ {nullptr};
+    bool header_ {false};
+    bool failed_ {false};
+};
+
+void
+MediaRecorder::Remuxer::onPacket(unsigned idx,
+                                 const AVPacket& packet,
+                                 const AVCodecParameters& par,
+                                 AVRational timeBase)
+{
+    if (not recording or idx >= streams.size())
+        return;
+    auto& stream = streams[idx];
+    // A video is decodable from a key frame only
+    if (not stream.started and stream.isVideo and not(packet.flags & AV_PKT_FLAG_KEY))
+        return;
+    auto p = std::make_unique<Packet>(idx, packet, timeBase, av_gettime() - startTime);
+    if (not p->packet)
+        return;
+    if (not stream.started) {
+        p->par = avcodec_parameters_alloc();
+        if (not p->par or avcodec_parameters_copy(p->par, &par) < 0)
+            return;
+        stream.started = true;
+    }
+    queue.push(std::move(p));
+}
+
+bool
+MediaRecorder::Remuxer::open(const std::string& path,
+                             const std::string& title,
+                             const std::string& description)
+{
+    auto ret = avformat_alloc_output_context2(&output_, nullptr, "matroska", path.c_str());
+    if (ret < 0) {
+        JAMI_ERR() << "Cannot open " << path << ": " << libav_utils::getError(ret);
+        return false;
+    }
+    libav_utils::setDictValue(&output_->metadata, "title", title);
+    libav_utils::setDictValue(&output_->metadata, "description", description);
+    // As MediaEncoder::setFragmentDuration
+    libav_utils::setDictValue(&options_,
+                              "cluster_time_limit",
+                              std::to_string(
+                                  std::chrono::milliseconds(FRAGMENT_DURATION).count()));
+    libav_utils::setDictValue(&options_, "flush_packets", "1");
+    if ((ret = avio_open(&output_->pb, path.c_str(), AVIO_FLAG_WRITE)) < 0) {
+        JAMI_ERR() << "Could not open IO context for '" << path
+                   << "': " << libav_utils::getError(ret);
+        return false;
+    }
+    return true;
+}
+
+void
+MediaRecorder::Remuxer::run()
+{
+    // Until the header is written, once all the streams gave their parameters
+    std::deque<std::unique_ptr<Packet>> pending;
+    unsigned ready = 0;
+    const auto timeout = std::chrono::microseconds(STREAM_START_TIMEOUT).count();
+    while (auto p = queue.pop()) {
+        if (header_) {
+            if (p->par)
+                JAMI_WARN() << "Recorder got the stream " << streams[p->stream].name
+                            << " too late, not recorded";
+            write(*p);
+            continue;
+        }
+        if (p->par and addStream(streams[p->stream], *p))
+            ++ready;
+        const auto time = p->time;
+        pending.emplace_back(std::move(p));
+        if (ready == streams.size() or (ready > 0 and time >= timeout)) {
+            if (writeHeader())
+                for (auto& q : pending)
+                    write(*q);
+            pending.clear();
+        }
+    }
+    if (not header_ and ready > 0 and writeHeader())
+        for (auto& q : pending)
+            write(*q);
+    if (auto dropped = queue.dropped())
+        JAMI_WARN() << "Recorder dropped " << dropped << " packets waiting to be written";
+    close();
+}
+
+bool
+MediaRecorder::Remuxer::addStream(Stream& stream, const Packet& first)
+{
+    auto st = avformat_new_stream(output_, nullptr);
+    if (not st or avcodec_parameters_copy(st->codecpar, first.par) < 0) {
+        JAMI_ERR() << "Failed to add the stream " << stream.name << " to the recording";
+        return false;
+    }
+    // The tags of the input format are not the ones of Matroska
+    st->codecpar->codec_tag = 0;
+    st->time_base = first.timeBase;
+    libav_utils::setDictValue(&st->metadata, "title", stream.name);
+    stream.index = st->index;
+    stream.timeBase = first.timeBase;
+    // Its first packet is at its time of arrival
+    auto ts = first.packet->dts != AV_NOPTS_VALUE ? first.packet->dts : first.packet->pts;
+    stream.offset = av_rescale_q(first.time, {1, AV_TIME_BASE}, first.timeBase)
+                    - (ts != AV_NOPTS_VALUE ? ts : 0);
+    JAMI_DBG() << "Recording " << stream.name << " as it is: "
+               << avcodec_get_name(st->codecpar->codec_id);
+    return true;
+}
+
+bool
+MediaRecorder::Remuxer::writeHeader()
+{
+    header_ = true;
+    if (auto ret = avformat_write_header(output_, &options_); ret < 0) {
+        JAMI_ERR() << "Failed to write the recording header: " << libav_utils::getError(ret);
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+void
+MediaRecorder::Remuxer::write(Packet& p)
+{
+    auto& stream = streams[p.stream];
+    if (failed_ or stream.index < 0)
+        return;
+    auto& pkt = *p.packet;
+    if (pkt.pts != AV_NOPTS_VALUE)
+        pkt.pts += stream.offset;
+    else
+        pkt.pts = av_rescale_q(p.time, {1, AV_TIME_BASE}, stream.timeBase);
+    pkt.dts = pkt.dts != AV_NOPTS_VALUE ? pkt.dts + stream.offset : pkt.pts;
+    pkt.stream_index = stream.index;
+    av_packet_rescale_ts(&pkt, stream.timeBase, output_->streams[stream.index]->time_base);
+    // Reordered RTP packets, or timestamps merged by the time base of the output
+    if (stream.lastDts != AV_NOPTS_VALUE and pkt.dts <= stream.lastDts)
+        pkt.dts = stream.lastDts + 1;
+    pkt.pts = std::max(pkt.pts, pkt.dts);
+    stream.lastDts = pkt.dts;
+    if (auto ret = av_interleaved_write_frame(output_, &pkt); ret < 0)
+        JAMI_ERR() << "Failed to record packet: " << libav_utils::getError(ret);
+}
+
+void
+MediaRecorder::Remuxer::close()
+{
+    if (not output_)
+        return;
+    if (header_ and not failed_)
+        av_write_trailer(output_);
+    avio_closep(&output_->pb);
+    avformat_free_context(output_);
+    output_ = nullptr;
+    av_dict_free(&options_);
+}
+
 struct MediaRecorder::StreamObserver : public Observer<std::shared_ptr<MediaFrame>>
 {
     const MediaStream info;
@@ -67,9 +388,30 @@ struct MediaRecorder::StreamObserver : public Observer<std::shared_ptr<MediaFram
     StreamObserver(const MediaStream& ms,
                    std::function<void(const std::shared_ptr<MediaFrame>&)> func)
         : info(ms)
-        , cb_(func) {};
+        , cb_(func)
+    {
+        // Encoding must not delay the decoding or the capture. The audio frames are all kept.
+        if (info.isVideo)
+            async_ = std::make_unique<AsyncObserver<std::shared_ptr<MediaFrame>>>(
+                *this, VIDEO_QUEUE_CAPACITY);
+    };
 
-    ~StreamObserver() {};
+    ~StreamObserver()
+    {
+        if (async_ and async_->dropped() > 0)
+            JAMI_WARN() << "Recorder dropped " << async_->dropped() << " frames of "
+                        << info.name;
+    };
+
+    /**
+     * @return observer to attach to the source of the stream
+     */
+    Observer<std::shared_ptr<MediaFrame>>* observer()
+    {
+        if (async_)
+            return async_.get();
+        return this;
+    }
 
     void update(Observable<std::shared_ptr<MediaFrame>>* /*ob*/,
                 const std::shared_ptr<MediaFrame>& m) override
@@ -121,6 +463,8 @@ private:
     std::function<void(const std::shared_ptr<MediaFrame>&)> cb_;
     std::unique_ptr<MediaFilter> videoRotationFilter_ {};
     int rotation_ = 0;
+    // Last, to stop updating before the rest is destroyed
+    std::unique_ptr<AsyncObserver<std::shared_ptr<MediaFrame>>> async_ {};
 };
 
 MediaRecorder::MediaRecorder() {}
@@ -136,6 +480,8 @@ MediaRecorder::isRecording() const
 std::string
 MediaRecorder::getPath() const
 {
+    if (passthrough_)
+        return path_ + (audioOnly_ ? ".mka" : ".mkv");
     if (audioOnly_)
         return path_ + ".ogg";
     else
@@ -148,6 +494,24 @@ MediaRecorder::audioOnly(bool audioOnly)
     audioOnly_ = audioOnly;
 }
 
+void
+MediaRecorder::passthrough(bool passthrough)
+{
+    if (isRecording_)
+        return;
+    passthrough_ = passthrough;
+    remuxer_ = passthrough ? std::make_shared<Remuxer>() : nullptr;
+}
+
+bool
+MediaRecorder::canPassthrough(unsigned avcodecId)
+{
+    static const auto format = av_guess_format("matroska", nullptr, nullptr);
+    return format
+           and avformat_query_codec(format, static_cast<AVCodecID>(avcodecId), FF_COMPLIANCE_NORMAL)
+                   == 1;
+}
+
 void
 MediaRecorder::setPath(const std::string& path)
 {
@@ -171,51 +535,72 @@ MediaRecorder::startRecording()
     encoder_.reset(new MediaEncoder);
 
     JAMI_DBG() << "Start recording '" << getPath() << "'";
-    if (initRecord() >= 0) {
+    if (initRecord() < 0)
+        return 0;
+
+    if (remuxer_) {
+        remuxer_->startTime = startTimeStamp_;
+        remuxer_->recording = true;
         isRecording_ = true;
-        // start thread after isRecording_ is set to true
-        dht::ThreadPool::computation().run([rec = shared_from_this()] {
-            while (rec->isRecording()) {
-                std::shared_ptr<MediaFrame> frame;
-                // get frame from queue
-                {
-                    std::unique_lock<std::mutex> lk(rec->mutexFrameBuff_);
-                    rec->cv_.wait(lk, [rec] {
-                        return rec->interrupted_ or not rec->frameBuff_.empty();
-                    });
-                    if (rec->interrupted_) {
-                        break;
-                    }
-                    frame = std::move(rec->frameBuff_.front());
-                    rec->frameBuff_.pop_front();
-                }
-                try {
-                    // encode frame
-                    if (frame && frame->pointer()) {
-#ifdef ENABLE_VIDEO
-                        bool isVideo = (frame->pointer()->width > 0 && frame->pointer()->height > 0);
-                        rec->encoder_->encode(frame->pointer(),
-                                              isVideo ? rec->videoIdx_ : rec->audioIdx_);
-#else
-                        rec->encoder_->encode(frame->pointer(), rec->audioIdx_);
-#endif // ENABLE_VIDEO
-                    }
-                } catch (const MediaEncoderException& e) {
-                    JAMI_ERR() << "Failed to record frame: " << e.what();
-                }
-            }
-            rec->flush();
+        dht::ThreadPool::io().run([rec = shared_from_this(), remuxer = remuxer_] {
+            remuxer->run();
             rec->reset(); // allows recorder to be reused in same call
         });
+        return 0;
+    }
+
+    // The audio and the video are encoded in parallel
+    audioQueue_ = audioIdx_ >= 0 ? std::make_shared<EncodeQueue>("audio", AUDIO_ENCODE_CAPACITY)
+                                 : nullptr;
+    videoQueue_ = videoIdx_ >= 0 ? std::make_shared<EncodeQueue>("video", VIDEO_ENCODE_CAPACITY)
+                                 : nullptr;
+    runningEncoders_ = (audioQueue_ != nullptr) + (videoQueue_ != nullptr);
+    isRecording_ = true;
+    // start threads after isRecording_ is set to true
+    for (const auto& [queue, idx] :
+         {std::make_pair(audioQueue_, audioIdx_), std::make_pair(videoQueue_, videoIdx_)}) {
+        if (queue)
+            dht::ThreadPool::computation().run(
+                [rec = shared_from_this(), queue = queue, idx = idx] {
+                    rec->encodeFrames(*queue, idx);
+                });
     }
     return 0;
 }
 
+void
+MediaRecorder::encodeFrames(EncodeQueue& queue, int streamIdx)
+{
+    while (auto frame = queue.pop()) {
+        try {
+            if (frame->pointer())
+                encoder_->encode(frame->pointer(), streamIdx);
+        } catch (const MediaEncoderException& e) {
+            JAMI_ERR() << "Failed to record frame: " << e.what();
+        }
+    }
+    if (auto dropped = queue.dropped())
+        JAMI_WARN() << "Recorder dropped " << dropped << " " << queue.media
+                    << " frames waiting to be encoded";
+
+    if (--runningEncoders_ == 0) {
+        flush();
+        reset(); // allows recorder to be reused in same call
+    }
+}
+
 void
 MediaRecorder::stopRecording()
 {
-    interrupted_ = true;
-    cv_.notify_all();
+    if (remuxer_) {
+        remuxer_->recording = false;
+        remuxer_->queue.stop();
+    }
+    // The frames already filtered are still encoded
+    if (audioQueue_)
+        audioQueue_->stop();
+    if (videoQueue_)
+        videoQueue_->stop();
     if (isRecording_) {
         JAMI_DBG() << "Stop recording '" << getPath() << "'";
         isRecording_ = false;
@@ -243,11 +628,37 @@ MediaRecorder::addStream(const MediaStream& ms)
             hasVideo_ = true;
         else
             hasAudio_ = true;
-        return p.first->second.get();
+        return p.first->second->observer();
     } else {
         JAMI_WARN() << "Recorder already has '" << ms.name << "' as input";
-        return p.first->second.get();
+        return p.first->second->observer();
+    }
+}
+
+PacketObserver
+MediaRecorder::addPacketStream(const std::string& name, bool isVideo)
+{
+    if (not remuxer_) {
+        JAMI_ERR() << "Trying to add packet stream to a recording not in passthrough";
+        return {};
+    }
+    if (audioOnly_ && isVideo) {
+        JAMI_ERR() << "Trying to add video stream to audio only recording";
+        return {};
     }
+
+    const unsigned idx = remuxer_->streams.size();
+    remuxer_->streams.push_back({name, isVideo});
+    JAMI_DBG() << "Recorder passthrough input #" << idx + 1 << ": " << name;
+    if (isVideo)
+        hasVideo_ = true;
+    else
+        hasAudio_ = true;
+    return [remuxer = std::weak_ptr<Remuxer>(remuxer_),
+            idx](const AVPacket& packet, const AVCodecParameters& par, AVRational timeBase) {
+        if (auto r = remuxer.lock())
+            r->onPacket(idx, packet, par, timeBase);
+    };
 }
 
 Observer<std::shared_ptr<MediaFrame>>*
@@ -255,7 +666,7 @@ MediaRecorder::getStream(const std::string& name) const
 {
     const auto it = streams_.find(name);
     if (it != streams_.cend())
-        return it->second.get();
+        return it->second->observer();
     return nullptr;
 }
 
@@ -313,9 +724,8 @@ MediaRecorder::onFrame(const std::string& name, const std::shared_ptr<MediaFrame
 #endif // ENABLE_VIDEO
 
     if (filteredFrame) {
-        std::lock_guard<std::mutex> lk(mutexFrameBuff_);
-        frameBuff_.emplace_back(std::move(filteredFrame));
-        cv_.notify_one();
+        if (auto queue = ms.isVideo ? videoQueue_ : audioQueue_)
+            queue->push(std::move(filteredFrame));
     }
 }
 
@@ -338,11 +748,22 @@ MediaRecorder::initRecord()
     }
     description_ = replaceAll(description_, "%TIMESTAMP", timestampString.str());
 
+    if (remuxer_) {
+        if (remuxer_->streams.empty()) {
+            JAMI_ERR() << "Trying to record in passthrough without streams";
+            return -1;
+        }
+        return remuxer_->open(getPath(), title_, description_) ? 0 : -1;
+    }
+
     encoder_->setMetadata(title_, description_);
     encoder_->openOutput(getPath());
+    encoder_->setFragmentDuration(FRAGMENT_DURATION);
 #ifdef ENABLE_VIDEO
 #ifdef RING_ACCEL
-    encoder_->enableAccel(false); // TODO recorder has problems with hardware encoding
+    // Off by default: the software encoders give the smaller files
+    const auto& prefs = Manager::instance().videoPreferences;
+    encoder_->enableAccel(prefs.getEncodingAccelerated() and prefs.getRecordEncodingAccelerated());
 #endif
 
     videoFilter_.reset();
@@ -608,13 +1029,11 @@ MediaRecorder::flush()
 void
 MediaRecorder::reset()
 {
-    {
-        std::lock_guard<std::mutex> lk(mutexFrameBuff_);
-        frameBuff_.clear();
-    }
     streams_.clear();
     videoIdx_ = audioIdx_ = -1;
     audioOnly_ = false;
+    passthrough_ = false;
+    remuxer_.reset();
     videoFilter_.reset();
     audioFilter_.reset();
     encoder_.reset();
@@ -69,6 +69,21 @@ public:
      */
     void audioOnly(bool audioOnly);
 
+    /**
+     * @brief Records the encoded streams as they are, without decoding nor encoding them.
+     *
+     * Each stream is a track of a Matroska file (.mka if audio only, else .mkv): the videos
+     * are not overlaid nor the audios mixed. The streams must then be added by
+     * @addPacketStream. Must be set before adding the streams.
+     */
+    void passthrough(bool passthrough);
+    bool isPassthrough() const { return passthrough_; }
+
+    /**
+     * @brief Whether the packets of a codec can be recorded as they are.
+     */
+    static bool canPassthrough(unsigned avcodecId);
+
     /**
      * @brief Sets output file path.
      *
@@ -101,6 +116,14 @@ public:
      */
     Observer<std::shared_ptr<MediaFrame>>* getStream(const std::string& name) const;
 
+    /**
+     * @brief Adds an encoded stream to a passthrough recording.
+     *
+     * Caller must then give the packets of the stream to the returned observer, until the
+     * stream is removed from the source. The videos are recorded from their next key frame.
+     */
+    PacketObserver addPacketStream(const std::string& name, bool isVideo);
+
     /**
      * @brief Initializes the file.
      *
@@ -119,9 +142,18 @@ private:
     NON_COPYABLE(MediaRecorder);
 
     struct StreamObserver;
+    template<typename T>
+    struct RecordQueue;
+    struct Remuxer;
+    using EncodeQueue = RecordQueue<MediaFrame>;
 
     void onFrame(const std::string& name, const std::shared_ptr<MediaFrame>& frame);
 
+    /**
+     * Encode the frames of @queue until it is stopped, from a thread per stream
+     */
+    void encodeFrames(EncodeQueue& queue, int streamIdx);
+
     void flush();
     void reset();
 
@@ -133,7 +165,6 @@ private:
     std::string buildAudioFilter(const std::vector<MediaStream>& peers,
                                  const MediaStream& local) const;
 
-    std::mutex mutexFrameBuff_;
     std::mutex mutexFilterVideo_;
     std::mutex mutexFilterAudio_;
 
@@ -155,11 +186,16 @@ private:
     int audioIdx_ = -1;
     bool isRecording_ = false;
     bool audioOnly_ = false;
+    bool passthrough_ = false;
 
-    std::condition_variable cv_;
-    std::atomic_bool interrupted_ {false};
+    // Filtered frames, encoded by a thread per stream
+    std::shared_ptr<EncodeQueue> audioQueue_;
+    std::shared_ptr<EncodeQueue> videoQueue_;
+    // The last one finalizes the file
+    std::atomic<unsigned> runningEncoders_ {0};
 
-    std::list<std::shared_ptr<MediaFrame>> frameBuff_;
+    // Writes the packet streams, in passthrough
+    std::shared_ptr<Remuxer> remuxer_;
 };
 
 }; // namespace jami
@@ -0,0 +1,244 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rtp_fec.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace jami {
+namespace flexfec {
+
+static constexpr size_t RTP_HEADER_SIZE {12};
+// Of the repair packet, its protected SSRC in the CSRC list
+static constexpr size_t REPAIR_HEADER_SIZE {RTP_HEADER_SIZE + 4};
+
+static inline uint16_t
+readU16(const uint8_t* p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static inline uint32_t
+readU32(const uint8_t* p)
+{
+    return uint32_t(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void
+writeU16(uint8_t* p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static inline void
+writeU32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+/**
+ * XOR the FEC bit string of an RTP packet into header: its first 2 bytes, the length
+ * after the fixed header and the timestamp
+ */
+static void
+xorHeader(std::array<uint8_t, 8>& header, const uint8_t* packet, size_t len)
+{
+    auto length = len - RTP_HEADER_SIZE;
+    header[0] ^= packet[0];
+    header[1] ^= packet[1];
+    header[2] ^= length >> 8;
+    header[3] ^= length & 0xff;
+    for (unsigned i = 0; i < 4; ++i)
+        header[4 + i] ^= packet[4 + i];
+}
+
+unsigned
+groupSize(double fractionLost)
+{
+    if (fractionLost < 0.01)
+        return 0;
+    if (fractionLost < 0.03)
+        return 10;
+    if (fractionLost < 0.06)
+        return 5;
+    if (fractionLost < 0.12)
+        return 3;
+    return 2;
+}
+
+Encoder::Encoder(uint32_t ssrc, uint16_t seq, uint8_t payloadType)
+    : ssrc_(ssrc)
+    , payloadType_(payloadType & 0x7f)
+    , seq_(seq)
+{}
+
+void
+Encoder::setGroupSize(unsigned size)
+{
+    // Counted on a byte in the FEC header
+    groupSize_ = std::min(size, 255u);
+    if (not groupSize_)
+        reset();
+}
+
+void
+Encoder::reset()
+{
+    count_ = 0;
+    header_.fill(0);
+    std::fill_n(payload_.begin(), maxLen_, 0);
+    maxLen_ = 0;
+}
+
+size_t
+Encoder::protect(
+    const uint8_t* packet, size_t len, uint8_t* out, size_t outSize, clock::time_point now)
+{
+    if (not groupSize_)
+        return 0;
+    if (len < RTP_HEADER_SIZE or (packet[0] >> 6) != 2
+        or len - RTP_HEADER_SIZE > SLOT_SIZE - OVERHEAD) {
+        reset();
+        return 0;
+    }
+    auto seq = readU16(packet + 2);
+    auto ssrc = readU32(packet + 8);
+    // The group is of consecutive packets
+    if (count_ and (ssrc != protectedSsrc_ or seq != uint16_t(baseSeq_ + count_)))
+        reset();
+    if (not count_) {
+        baseSeq_ = seq;
+        protectedSsrc_ = ssrc;
+        start_ = now;
+    }
+    xorHeader(header_, packet, len);
+    auto length = len - RTP_HEADER_SIZE;
+    for (size_t i = 0; i < length; ++i)
+        payload_[i] ^= packet[RTP_HEADER_SIZE + i];
+    maxLen_ = std::max(maxLen_, length);
+    lastTimestamp_ = readU32(packet + 4);
+    ++count_;
+
+    bool marker = packet[1] & 0x80;
+    if (count_ < groupSize_ and not(marker and now - start_ >= MAX_GROUP_DELAY))
+        return 0;
+    auto repairLen = OVERHEAD + maxLen_;
+    if (repairLen > outSize) {
+        reset();
+        return 0;
+    }
+    out[0] = 0x80 | 1; // CC = 1
+    out[1] = payloadType_;
+    writeU16(out + 2, seq_++);
+    writeU32(out + 4, lastTimestamp_);
+    writeU32(out + 8, ssrc_);
+    writeU32(out + 12, protectedSsrc_);
+    auto* fec = out + REPAIR_HEADER_SIZE;
+    // R = 0, F = 1: L packets from SN base, D = 0 for a single row
+    fec[0] = 0x40 | (header_[0] & 0x3f);
+    std::copy_n(header_.begin() + 1, 7, fec + 1);
+    writeU16(fec + 8, baseSeq_);
+    fec[10] = count_;
+    fec[11] = 0;
+    std::copy_n(payload_.begin(), maxLen_, out + OVERHEAD);
+    reset();
+    return repairLen;
+}
+
+Decoder::Decoder()
+    : slots_(CAPACITY)
+{}
+
+void
+Decoder::onPacket(const uint8_t* packet, size_t len)
+{
+    if (len < RTP_HEADER_SIZE or len > SLOT_SIZE)
+        return;
+    auto& slot = slots_[readU16(packet + 2) % CAPACITY];
+    std::memcpy(slot.data.data(), packet, len);
+    slot.len = len;
+}
+
+const Decoder::Slot*
+Decoder::find(uint32_t ssrc, uint16_t seq) const
+{
+    const auto& slot = slots_[seq % CAPACITY];
+    if (slot.len < RTP_HEADER_SIZE or readU16(slot.data.data() + 2) != seq
+        or readU32(slot.data.data() + 8) != ssrc)
+        return nullptr;
+    return &slot;
+}
+
+size_t
+Decoder::recover(uint8_t* packet, size_t len)
+{
+    if (len < OVERHEAD or (packet[0] >> 6) != 2 or (packet[0] & 0x0f) != 1)
+        return 0;
+    auto* fec = packet + REPAIR_HEADER_SIZE;
+    auto count = fec[10];
+    if ((fec[0] & 0xc0) != 0x40 or fec[11] != 0 or not count)
+        return 0;
+    auto ssrc = readU32(packet + 12);
+    auto baseSeq = readU16(fec + 8);
+    auto repairLen = len - OVERHEAD;
+
+    int missing = -1;
+    for (unsigned i = 0; i < count; ++i) {
+        auto slot = find(ssrc, baseSeq + i);
+        if (slot and slot->len - RTP_HEADER_SIZE > repairLen)
+            return 0;
+        if (slot)
+            continue;
+        if (missing >= 0)
+            return 0;
+        missing = i;
+    }
+    if (missing < 0)
+        return 0;
+
+    std::array<uint8_t, 8> header;
+    std::copy_n(fec, header.size(), header.begin());
+    auto* payload = packet + OVERHEAD;
+    for (unsigned i = 0; i < count; ++i) {
+        if (auto slot = find(ssrc, baseSeq + i)) {
+            const auto* data = slot->data.data();
+            xorHeader(header, data, slot->len);
+            for (size_t j = RTP_HEADER_SIZE; j < slot->len; ++j)
+                payload[j - RTP_HEADER_SIZE] ^= data[j];
+        }
+    }
+    size_t length = readU16(header.data() + 2);
+    if (length > repairLen)
+        return 0;
+    std::memmove(packet + RTP_HEADER_SIZE, payload, length);
+    packet[0] = 0x80 | (header[0] & 0x3f);
+    packet[1] = header[1];
+    writeU16(packet + 2, baseSeq + missing);
+    std::copy_n(header.begin() + 4, 4, packet + 4);
+    writeU32(packet + 8, ssrc);
+    len = RTP_HEADER_SIZE + length;
+    onPacket(packet, len);
+    return len;
+}
+
+} // namespace flexfec
+} // namespace jami
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jami {
+
+/**
+ * Forward error correction of an RTP stream with FlexFEC (RFC 8627), in its
+ * 1-D non-interleaved form: a repair packet, sent on its own SSRC and payload
+ * type, is the XOR of a group of consecutive packets, so a packet lost in the
+ * group is recovered from the others without waiting for a retransmission.
+ */
+namespace flexfec {
+
+constexpr const char* ENCODING_NAME {"flexfec"};
+// Of the repair packet, in bytes: RTP header with the protected SSRC, then the FEC header
+constexpr size_t OVERHEAD {12 + 4 + 12};
+constexpr size_t SLOT_SIZE {2048};
+
+/**
+ * Packets per repair packet, the more the peer loses the smaller the groups.
+ * @param fractionLost  Reported by the peer, from 0 to 1
+ * @return 0 below the loss the retransmissions are enough for
+ */
+unsigned groupSize(double fractionLost);
+
+class Encoder
+{
+public:
+    using clock = std::chrono::steady_clock;
+    // A group stops at the end of a frame older than this, so small frames share a repair
+    // packet and are still recovered before their playout
+    static constexpr auto MAX_GROUP_DELAY = std::chrono::milliseconds(40);
+
+    /**
+     * @param seq   Of the first repair packet
+     */
+    Encoder(uint32_t ssrc, uint16_t seq, uint8_t payloadType);
+
+    /**
+     * Packets per repair packet, 0 to stop the protection
+     */
+    void setGroupSize(unsigned size);
+    unsigned groupSize() const { return groupSize_; }
+
+    /**
+     * Add an RTP packet of the stream, before its encryption.
+     * @return length of the repair packet written to out if packet closed a group, else 0
+     */
+    size_t protect(const uint8_t* packet,
+                   size_t len,
+                   uint8_t* out,
+                   size_t outSize,
+                   clock::time_point now = clock::now());
+
+private:
+    void reset();
+
+    const uint32_t ssrc_;
+    const uint8_t payloadType_;
+    uint16_t seq_;
+    unsigned groupSize_ {0};
+
+    // Of the current group
+    unsigned count_ {0};
+    uint16_t baseSeq_ {0};
+    uint32_t protectedSsrc_ {0};
+    uint32_t lastTimestamp_ {0};
+    clock::time_point start_ {};
+    std::array<uint8_t, 8> header_ {}; // XOR of the FEC bit strings
+    size_t maxLen_ {0};
+    std::array<uint8_t, SLOT_SIZE> payload_ {};
+};
+
+/**
+ * Recent packets of the stream, to recover a packet missing from the group of a repair
+ * packet. Not thread-safe.
+ */
+class Decoder
+{
+public:
+    static constexpr size_t CAPACITY {256};
+
+    Decoder();
+
+    /**
+     * Keep a copy of an RTP packet of the stream, after its decryption
+     */
+    void onPacket(const uint8_t* packet, size_t len);
+
+    /**
+     * Replace a repair packet, decrypted, with the only packet missing from its group,
+     * shorter than the repair packet.
+     * @return length of the packet recovered, 0 if none is missing, or more than one
+     */
+    size_t recover(uint8_t* packet, size_t len);
+
+private:
+    struct Slot
+    {
+        size_t len {0};
+        std::array<uint8_t, SLOT_SIZE> data;
+    };
+    const Slot* find(uint32_t ssrc, uint16_t seq) const;
+
+    std::vector<Slot> slots_;
+};
+
+} // namespace flexfec
+
+} // namespace jami
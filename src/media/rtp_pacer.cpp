@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#include "rtp_pacer.h"
+
+#include <algorithm>
+#include <array>
+
+namespace jami {
+
+RtpPacer::RtpPacer(SendCb send)
+    : send_(std::move(send))
+{}
+
+RtpPacer::~RtpPacer()
+{
+    stop();
+}
+
+void
+RtpPacer::setBitrate(unsigned kbps)
+{
+    if (kbps == 0)
+        return;
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (state_ == State::Stopped)
+        return;
+    rate_ = PACING_FACTOR * kbps * 1000 / 8;
+    if (state_ == State::Idle) {
+        queue_ = PacketRing(QUEUE_SIZE);
+        state_ = State::Running;
+        thread_ = std::thread([this] { loop(); });
+    }
+}
+
+bool
+RtpPacer::enabled() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return state_ == State::Running;
+}
+
+bool
+RtpPacer::push(const uint8_t* buf, int len)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    if (state_ == State::Idle)
+        return false;
+    cv_.wait(lk, [&] { return state_ != State::Running or queue_.size() < QUEUE_SIZE; });
+    // Dropped once stopped, the thread may still be sending
+    if (state_ == State::Running and queue_.push(buf, len)) {
+        queuedBytes_ += len;
+        // Kept until the queue is empty, so this packet leaves in time
+        drainRate_ = std::max(drainRate_,
+                              queuedBytes_ / std::chrono::duration<double>(MAX_QUEUE_DELAY).count());
+        cv_.notify_all();
+    }
+    return true;
+}
+
+void
+RtpPacer::flush()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    queue_.clear();
+    queuedBytes_ = 0;
+    drainRate_ = 0;
+    cv_.notify_all();
+    cv_.wait(lk, [&] { return not sending_; });
+}
+
+void
+RtpPacer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        state_ = State::Stopped;
+    }
+    cv_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void
+RtpPacer::loop()
+{
+    std::array<uint8_t, PacketRing::SLOT_SIZE> packet;
+    double budget = 0; // in bytes, negative after sending
+    auto last = clock::now();
+
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (state_ == State::Running) {
+        if (queue_.empty()) {
+            drainRate_ = 0;
+            cv_.wait(lk, [&] { return state_ != State::Running or not queue_.empty(); });
+            continue;
+        }
+
+        // Faster when the packets would wait too long
+        auto rate = std::max(rate_, drainRate_);
+        auto now = clock::now();
+        budget = std::min(budget + rate * std::chrono::duration<double>(now - last).count(),
+                          rate * std::chrono::duration<double>(MAX_BURST).count());
+        last = now;
+        if (budget < 0) {
+            cv_.wait_for(lk, std::chrono::duration<double>(-budget / rate));
+            continue;
+        }
+
+        auto len = queue_.pop(packet.data(), packet.size());
+        queuedBytes_ -= len;
+        budget -= len;
+        sending_ = true;
+        cv_.notify_all();
+        lk.unlock();
+        send_(packet.data(), len);
+        lk.lock();
+        sending_ = false;
+        cv_.notify_all();
+    }
+}
+
+} // namespace jami
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include "socket_pair.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace jami {
+
+/**
+ * Spread the RTP packets of a stream over time, so the packets of a large
+ * frame, such as a keyframe, don't leave in a burst overflowing the queues of
+ * the routers.
+ *
+ * Token bucket at PACING_FACTOR times the target bitrate, sped up when the
+ * queue would delay the packets by more than MAX_QUEUE_DELAY.
+ */
+class RtpPacer
+{
+public:
+    using SendCb = std::function<void(uint8_t* buf, int len)>;
+
+    static constexpr double PACING_FACTOR {2.5};
+    static constexpr auto MAX_QUEUE_DELAY = std::chrono::milliseconds(100);
+    static constexpr auto MAX_BURST = std::chrono::milliseconds(5);
+    static constexpr size_t QUEUE_SIZE {256};
+
+    /**
+     * @param send  Called by the thread of the pacer for each packet, buf having room for
+     * PacketRing::SLOT_SIZE bytes
+     */
+    explicit RtpPacer(SendCb send);
+    ~RtpPacer();
+
+    /**
+     * Set the target bitrate, in Kbps. The first call starts the pacer.
+     */
+    void setBitrate(unsigned kbps);
+
+    bool enabled() const;
+
+    /**
+     * Queue a packet, waiting for a slot when the queue is full.
+     * @return false if the pacer is not started, the caller sends the packet
+     */
+    bool push(const uint8_t* buf, int len);
+
+    /**
+     * Drop the queued packets, and wait for the one being sent
+     */
+    void flush();
+
+    void stop();
+
+private:
+    NON_COPYABLE(RtpPacer);
+    using clock = std::chrono::steady_clock;
+
+    enum class State { Idle, Running, Stopped };
+
+    void loop();
+
+    const SendCb send_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    State state_ {State::Idle};
+    bool sending_ {false};
+    double rate_ {0};      // bytes per second
+    double drainRate_ {0}; // to send the queue in MAX_QUEUE_DELAY
+    PacketRing queue_;
+    size_t queuedBytes_ {0};
+    std::thread thread_;
+};
+
+} // namespace jami
@@ -0,0 +1,206 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rtp_retransmission.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace jami {
+
+static constexpr size_t RTP_HEADER_SIZE {12};
+static constexpr size_t OSN_SIZE {2};
+
+static inline uint16_t
+readU16(const uint8_t* p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static inline uint32_t
+readU32(const uint8_t* p)
+{
+    return uint32_t(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void
+writeU16(uint8_t* p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static inline void
+writeU32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+/**
+ * Of the fixed header, the CSRCs and the header extension, 0 if truncated
+ */
+static size_t
+rtpHeaderLength(const uint8_t* packet, size_t len)
+{
+    if (len < RTP_HEADER_SIZE or (packet[0] >> 6) != 2)
+        return 0;
+    size_t offset = RTP_HEADER_SIZE + 4 * (packet[0] & 0x0f);
+    if (packet[0] & 0x10) {
+        if (len < offset + 4)
+            return 0;
+        offset += 4 + 4 * readU16(packet + offset + 2);
+    }
+    return offset <= len ? offset : 0;
+}
+
+namespace rtcp_nack {
+
+static constexpr size_t HEADER_SIZE {12};
+static constexpr size_t FCI_SIZE {4};
+
+bool
+parse(const uint8_t* buf, size_t len, uint32_t& mediaSsrc, std::vector<uint16_t>& seqs)
+{
+    if (len < HEADER_SIZE or (buf[0] >> 6) != 2 or (buf[0] & 0x1f) != FMT or buf[1] != PT)
+        return false;
+    size_t size = 4 * (readU16(buf + 2) + 1);
+    if (size > len)
+        return false;
+    mediaSsrc = readU32(buf + 8);
+    for (size_t i = HEADER_SIZE; i + FCI_SIZE <= size; i += FCI_SIZE) {
+        uint16_t pid = readU16(buf + i);
+        uint16_t blp = readU16(buf + i + 2);
+        seqs.emplace_back(pid);
+        for (unsigned bit = 0; bit < 16; ++bit)
+            if (blp & (1 << bit))
+                seqs.emplace_back(pid + bit + 1);
+    }
+    return true;
+}
+
+size_t
+write(uint32_t senderSsrc,
+      uint32_t mediaSsrc,
+      const std::vector<uint16_t>& seqs,
+      uint8_t* out,
+      size_t outSize)
+{
+    if (seqs.empty() or outSize < HEADER_SIZE + FCI_SIZE)
+        return 0;
+    size_t size = HEADER_SIZE;
+    for (size_t i = 0; i < seqs.size() and size + FCI_SIZE <= outSize;) {
+        uint16_t pid = seqs[i];
+        uint16_t blp = 0;
+        // The next 16 packets are in the bitmask
+        for (++i; i < seqs.size(); ++i) {
+            uint16_t d = seqs[i] - pid;
+            if (d == 0 or d > 16)
+                break;
+            blp |= 1 << (d - 1);
+        }
+        writeU16(out + size, pid);
+        writeU16(out + size + 2, blp);
+        size += FCI_SIZE;
+    }
+    out[0] = 0x80 | FMT;
+    out[1] = PT;
+    writeU16(out + 2, size / 4 - 1);
+    writeU32(out + 4, senderSsrc);
+    writeU32(out + 8, mediaSsrc);
+    return size;
+}
+
+} // namespace rtcp_nack
+
+RtxSender::RtxSender(uint32_t ssrc, uint16_t seq, uint8_t payloadType)
+    : ssrc_(ssrc)
+    , payloadType_(payloadType & 0x7f)
+    , seq_(seq)
+    , slots_(CAPACITY)
+{}
+
+void
+RtxSender::setBitrate(unsigned kbps)
+{
+    rate_ = kbps * 1000. / 8 * BUDGET_SHARE;
+}
+
+void
+RtxSender::onSent(const uint8_t* packet, size_t len)
+{
+    if (len < RTP_HEADER_SIZE or len > SLOT_SIZE)
+        return;
+    auto& slot = slots_[readU16(packet + 2) % CAPACITY];
+    std::memcpy(slot.data.data(), packet, len);
+    slot.len = len;
+    slot.retransmitted = {};
+}
+
+size_t
+RtxSender::retransmit(
+    uint32_t mediaSsrc, uint16_t seq, uint8_t* out, size_t outSize, clock::time_point now)
+{
+    auto& slot = slots_[seq % CAPACITY];
+    const auto* packet = slot.data.data();
+    if (slot.len < RTP_HEADER_SIZE or readU16(packet + 2) != seq
+        or readU32(packet + 8) != mediaSsrc)
+        return 0;
+    if (now - slot.retransmitted < MIN_INTERVAL)
+        return 0;
+    auto headerLen = rtpHeaderLength(packet, slot.len);
+    auto len = slot.len + OSN_SIZE;
+    if (not headerLen or len > outSize)
+        return 0;
+
+    auto elapsed = std::chrono::duration<double>(now - refilled_).count();
+    budget_ = std::min(budget_ + rate_ * elapsed,
+                       rate_ * std::chrono::duration<double>(MAX_BURST).count());
+    refilled_ = now;
+    if (budget_ < len)
+        return 0;
+    budget_ -= len;
+    slot.retransmitted = now;
+
+    std::memcpy(out, packet, headerLen);
+    out[1] = (packet[1] & 0x80) | payloadType_;
+    writeU16(out + 2, seq_++);
+    writeU32(out + 8, ssrc_);
+    writeU16(out + headerLen, seq);
+    std::memcpy(out + headerLen + OSN_SIZE, packet + headerLen, slot.len - headerLen);
+    return len;
+}
+
+size_t
+restoreRtxPacket(uint8_t* packet, size_t len, uint8_t payloadType, uint32_t ssrc)
+{
+    auto headerLen = rtpHeaderLength(packet, len);
+    if (not headerLen or len < headerLen + OSN_SIZE)
+        return 0;
+    auto seq = readU16(packet + headerLen);
+    std::memmove(packet + headerLen,
+                 packet + headerLen + OSN_SIZE,
+                 len - headerLen - OSN_SIZE);
+    packet[1] = (packet[1] & 0x80) | (payloadType & 0x7f);
+    writeU16(packet + 2, seq);
+    writeU32(packet + 8, ssrc);
+    return len - OSN_SIZE;
+}
+
+} // namespace jami
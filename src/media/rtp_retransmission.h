@@ -0,0 +1,124 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jami {
+
+/**
+ * RTCP generic NACK (RFC 4585 6.2.1), reporting the RTP packets lost by a receiver.
+ */
+namespace rtcp_nack {
+
+constexpr uint8_t PT {205}; // Transport layer feedback
+constexpr uint8_t FMT {1};
+
+/**
+ * Append to seqs the sequence numbers of the packets reported lost.
+ * @return false if buf is not a generic NACK
+ */
+bool parse(const uint8_t* buf, size_t len, uint32_t& mediaSsrc, std::vector<uint16_t>& seqs);
+
+/**
+ * Report the packets seqs, in increasing order, as lost.
+ * @return length of the packet written to out, 0 if out is too small
+ */
+size_t write(uint32_t senderSsrc,
+             uint32_t mediaSsrc,
+             const std::vector<uint16_t>& seqs,
+             uint8_t* out,
+             size_t outSize);
+
+} // namespace rtcp_nack
+
+/**
+ * Recently sent RTP packets of a stream, to retransmit the ones reported lost
+ * in RTX packets (RFC 4588): on their own SSRC and payload type, the original
+ * sequence number heading the payload.
+ *
+ * The retransmissions can't use more than BUDGET_SHARE of the target bitrate of
+ * the congestion control, so the recovery doesn't add to the congestion causing
+ * the losses. Not thread-safe.
+ */
+class RtxSender
+{
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr size_t CAPACITY {256};
+    static constexpr size_t SLOT_SIZE {2048};
+    static constexpr double BUDGET_SHARE {0.25};
+    // Budget kept for a burst of losses
+    static constexpr auto MAX_BURST = std::chrono::milliseconds(200);
+    // A packet reported again by the receiver before its retransmission could reach it
+    static constexpr auto MIN_INTERVAL = std::chrono::milliseconds(20);
+
+    /**
+     * @param seq   Of the first RTX packet
+     */
+    RtxSender(uint32_t ssrc, uint16_t seq, uint8_t payloadType);
+
+    /**
+     * Target bitrate of the stream, in Kbps, no retransmission until set
+     */
+    void setBitrate(unsigned kbps);
+
+    /**
+     * Keep a copy of an RTP packet, before its encryption
+     */
+    void onSent(const uint8_t* packet, size_t len);
+
+    /**
+     * Write to out the RTX packet of the packet seq of mediaSsrc.
+     * @return its length, 0 if the packet is not kept, was just retransmitted or is off budget
+     */
+    size_t retransmit(uint32_t mediaSsrc,
+                      uint16_t seq,
+                      uint8_t* out,
+                      size_t outSize,
+                      clock::time_point now = clock::now());
+
+private:
+    struct Slot
+    {
+        size_t len {0};
+        clock::time_point retransmitted {};
+        std::array<uint8_t, SLOT_SIZE> data;
+    };
+
+    const uint32_t ssrc_;
+    const uint8_t payloadType_;
+    uint16_t seq_;
+    std::vector<Slot> slots_;
+    double rate_ {0};   // bytes per second
+    double budget_ {0}; // bytes
+    clock::time_point refilled_ {};
+};
+
+/**
+ * Restore in place the original packet of an RTX packet, with the payload type and
+ * SSRC of its stream.
+ * @return length of the original packet, 0 if packet is not an RTX packet
+ */
+size_t restoreRtxPacket(uint8_t* packet, size_t len, uint8_t payloadType, uint32_t ssrc);
+
+} // namespace jami
@@ -25,6 +25,8 @@
 #include "socket_pair.h"
 #include "sip/sip_utils.h"
 #include "media/media_codec.h"
+#include "jami/callmanager_interface.h"
+#include "jami/media_const.h"
 
 #include <functional>
 #include <string>
@@ -73,12 +75,47 @@ public:
 
     virtual void initRecorder(std::shared_ptr<MediaRecorder>& rec) = 0;
     virtual void deinitRecorder(std::shared_ptr<MediaRecorder>& rec) = 0;
+    /**
+     * Whether the streams can be recorded as they are sent and received, see
+     * MediaRecorder::passthrough
+     */
+    virtual bool canRecordPackets() const = 0;
     std::shared_ptr<AccountCodecInfo> getCodec() const { return send_.codec; }
+    std::shared_ptr<AccountCodecInfo> getReceiveCodec() const { return receive_.codec; }
     const IpAddr& getSendAddr() const { return send_.addr; };
     const IpAddr& getRecvAddr() const { return receive_.addr; };
 
     inline std::string streamId() const { return streamId_; }
 
+    /**
+     * Codecs and RTP statistics, completed by the sessions with their encoder
+     * and decoder
+     */
+    virtual DRing::MediaStreamStats getStats()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        DRing::MediaStreamStats stats;
+        stats.streamId = streamId_;
+        stats.mediaType = mediaType_ == MEDIA_VIDEO ? DRing::Media::MediaAttributeValue::VIDEO
+                                                    : DRing::Media::MediaAttributeValue::AUDIO;
+        if (send_.codec)
+            stats.sendCodec = send_.codec->systemCodecInfo.name;
+        if (receive_.codec)
+            stats.receiveCodec = receive_.codec->systemCodecInfo.name;
+        if (socketPair_) {
+            auto rtp = socketPair_->getRtpStats();
+            stats.packetsSent = rtp.packetsSent;
+            stats.bytesSent = rtp.bytesSent;
+            stats.packetsReceived = rtp.packetsReceived;
+            stats.bytesReceived = rtp.bytesReceived;
+            stats.packetsLost = rtp.packetsLost;
+            stats.jitter = std::chrono::duration<double>(rtp.jitter).count();
+            stats.remoteFractionLost = rtp.remoteFractionLost;
+            stats.roundTripTime = rtp.roundTripTime;
+        }
+        return stats;
+    }
+
 protected:
     std::recursive_mutex mutex_;
     const std::string callId_;
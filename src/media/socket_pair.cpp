@@ -24,21 +24,30 @@
 #include "libav_deps.h" // THEN THIS ONE AFTER
 
 #include "socket_pair.h"
+#include "rtp_pacer.h"
+#include "rtp_retransmission.h"
+#include "rtp_fec.h"
 #include "ice_socket.h"
 #include "libav_utils.h"
 #include "logger.h"
+#include "metrics.h"
 #include "security/memory.h"
+#include "tracepoint.h"
 
 #include <iostream>
 #include <string>
 #include <algorithm>
 #include <iterator>
 
+#include <opendht/rng.h>
+
 extern "C" {
 #include "srtp.h"
 }
 
+#include <cmath>
 #include <cstring>
+#include <map>
 #include <stdexcept>
 #include <unistd.h>
 #include <sys/types.h>
@@ -59,6 +68,11 @@ extern "C" {
 #include <fcntl.h>
 #endif
 
+#ifdef __linux__
+#include <netinet/udp.h> // UDP_SEGMENT
+#include <sys/socket.h>
+#endif
+
 // Swap 2 byte, 16 bit values:
 #define Swap2Bytes(val) ((((val) >> 8) & 0x00FF) | (((val) << 8) & 0xFF00))
 
@@ -79,12 +93,131 @@ namespace jami {
 static constexpr int NET_POLL_TIMEOUT = 100; /* poll() timeout in ms */
 static constexpr int RTP_MAX_PACKET_LENGTH = 2048;
 static constexpr auto UDP_HEADER_SIZE = 8;
-static constexpr auto SRTP_OVERHEAD = 10;
 static constexpr uint32_t RTCP_RR_FRACTION_MASK = 0xFF000000;
 static constexpr unsigned MINIMUM_RTP_HEADER_SIZE = 16;
+// Packets queued from ICE, about half a second of 4 Mbps video
+static constexpr size_t RTP_QUEUE_SIZE = 256;
+// Between the NTP and Unix epochs
+static constexpr uint64_t NTP_OFFSET_US = 2208988800ULL * 1000000;
+static constexpr size_t RTCP_QUEUE_SIZE = 32;
+
+static_assert(PacketRing::SLOT_SIZE >= RTP_MAX_PACKET_LENGTH, "slots can't hold RTP packets");
 
 enum class DataType : unsigned { RTP = 1 << 0, RTCP = 1 << 1 };
 
+namespace rtp_audio_level {
+
+// Profile of the one-byte header extensions
+static constexpr uint16_t ONE_BYTE_PROFILE {0xBEDE};
+static constexpr size_t RTP_HEADER_SIZE {12};
+
+uint8_t
+fromRms(float rms)
+{
+    if (rms <= 0)
+        return SILENCE;
+    auto dbov = -20 * std::log10(std::min(rms, 1.f));
+    return static_cast<uint8_t>(std::min(std::lround(dbov), static_cast<long>(SILENCE)));
+}
+
+float
+toRms(uint8_t level)
+{
+    if (level >= SILENCE)
+        return 0;
+    return std::pow(10.f, -static_cast<float>(level) / 20);
+}
+
+/**
+ * @return offset of the extensions of the packet, 0 if it has none, -1 if malformed
+ */
+static int
+extensionOffset(const uint8_t* packet, size_t len)
+{
+    size_t offset = RTP_HEADER_SIZE + 4 * (packet[0] & 0x0f);
+    if (len < offset)
+        return -1;
+    if (not(packet[0] & 0x10))
+        return 0;
+    if (len < offset + 4 or ((packet[offset] << 8) | packet[offset + 1]) != ONE_BYTE_PROFILE)
+        return -1;
+    return offset;
+}
+
+size_t
+add(const uint8_t* packet,
+    size_t len,
+    uint8_t id,
+    uint8_t level,
+    bool voice,
+    uint8_t* out,
+    size_t outSize)
+{
+    if (len < RTP_HEADER_SIZE or id == 0 or id >= 15 or outSize < len + 8)
+        return 0;
+    auto offset = extensionOffset(packet, len);
+    if (offset < 0)
+        return 0;
+    size_t insertAt, extLength;
+    const uint8_t element[4] {static_cast<uint8_t>(id << 4),
+                              static_cast<uint8_t>((voice ? 0x80 : 0) | (level & 0x7f)),
+                              0,
+                              0};
+    if (offset) {
+        // After the elements already there
+        extLength = (packet[offset + 2] << 8) | packet[offset + 3];
+        insertAt = offset + 4 + 4 * extLength;
+        if (len < insertAt)
+            return 0;
+        std::memcpy(out, packet, insertAt);
+        std::memcpy(out + insertAt, element, sizeof(element));
+        std::memcpy(out + insertAt + 4, packet + insertAt, len - insertAt);
+        ++extLength;
+        out[offset + 2] = extLength >> 8;
+        out[offset + 3] = extLength & 0xff;
+        return len + 4;
+    }
+    insertAt = RTP_HEADER_SIZE + 4 * (packet[0] & 0x0f);
+    std::memcpy(out, packet, insertAt);
+    out[0] |= 0x10;
+    out[insertAt] = ONE_BYTE_PROFILE >> 8;
+    out[insertAt + 1] = ONE_BYTE_PROFILE & 0xff;
+    out[insertAt + 2] = 0;
+    out[insertAt + 3] = 1;
+    std::memcpy(out + insertAt + 4, element, sizeof(element));
+    std::memcpy(out + insertAt + 8, packet + insertAt, len - insertAt);
+    return len + 8;
+}
+
+int
+find(const uint8_t* packet, size_t len, uint8_t id)
+{
+    if (len < RTP_HEADER_SIZE)
+        return -1;
+    auto offset = extensionOffset(packet, len);
+    if (offset <= 0)
+        return -1;
+    size_t end = offset + 4 + 4 * ((packet[offset + 2] << 8) | packet[offset + 3]);
+    if (len < end)
+        return -1;
+    for (size_t i = offset + 4; i < end;) {
+        if (packet[i] == 0) { // Padding
+            ++i;
+            continue;
+        }
+        uint8_t elementId = packet[i] >> 4;
+        size_t elementLen = (packet[i] & 0x0f) + 1;
+        if (elementId == 15 or i + 1 + elementLen > end)
+            return -1;
+        if (elementId == id)
+            return packet[i + 1];
+        i += 1 + elementLen;
+    }
+    return -1;
+}
+
+} // namespace rtp_audio_level
+
 class SRTPProtoContext
 {
 public:
@@ -95,16 +228,24 @@ public:
     {
         ring_secure_memzero(&srtp_out, sizeof(srtp_out));
         ring_secure_memzero(&srtp_in, sizeof(srtp_in));
+        ring_secure_memzero(&rtx_out, sizeof(rtx_out));
+        ring_secure_memzero(&rtx_in, sizeof(rtx_in));
+        ring_secure_memzero(&fec_out, sizeof(fec_out));
+        ring_secure_memzero(&fec_in, sizeof(fec_in));
         if (out_suite && out_key) {
             // XXX: see srtp_open from libavformat/srtpproto.c
-            if (ff_srtp_set_crypto(&srtp_out, out_suite, out_key) < 0) {
+            if (ff_srtp_set_crypto(&srtp_out, out_suite, out_key) < 0
+                or ff_srtp_set_crypto(&rtx_out, out_suite, out_key) < 0
+                or ff_srtp_set_crypto(&fec_out, out_suite, out_key) < 0) {
                 srtp_close();
                 throw std::runtime_error("Could not set crypto on output");
             }
         }
 
         if (in_suite && in_key) {
-            if (ff_srtp_set_crypto(&srtp_in, in_suite, in_key) < 0) {
+            if (ff_srtp_set_crypto(&srtp_in, in_suite, in_key) < 0
+                or ff_srtp_set_crypto(&rtx_in, in_suite, in_key) < 0
+                or ff_srtp_set_crypto(&fec_in, in_suite, in_key) < 0) {
                 srtp_close();
                 throw std::runtime_error("Could not set crypto on input");
             }
@@ -115,6 +256,12 @@ public:
 
     SRTPContext srtp_out {};
     SRTPContext srtp_in {};
+    // The retransmissions and repair packets have their own sequence numbers, and so
+    // rollover counter
+    SRTPContext rtx_out {};
+    SRTPContext rtx_in {};
+    SRTPContext fec_out {};
+    SRTPContext fec_in {};
     uint8_t encryptbuf[RTP_MAX_PACKET_LENGTH];
 
 private:
@@ -122,6 +269,10 @@ private:
     {
         ff_srtp_free(&srtp_out);
         ff_srtp_free(&srtp_in);
+        ff_srtp_free(&rtx_out);
+        ff_srtp_free(&rtx_in);
+        ff_srtp_free(&fec_out);
+        ff_srtp_free(&fec_in);
     }
 };
 
@@ -180,14 +331,174 @@ udp_socket_create(int family, int port)
     return udp_fd;
 }
 
+bool
+PacketRing::push(const uint8_t* data, size_t len)
+{
+    if (len > SLOT_SIZE or slots_.empty())
+        return false;
+    if (count_ == slots_.size()) {
+        // Drop the oldest packet, latency matters more than completeness
+        head_ = (head_ + 1) % slots_.size();
+        --count_;
+    }
+    auto& slot = slots_[(head_ + count_) % slots_.size()];
+    std::memcpy(slot.data.data(), data, len);
+    slot.len = len;
+    ++count_;
+    return true;
+}
+
+int
+PacketRing::pop(void* buf, int buf_size)
+{
+    if (count_ == 0)
+        return 0;
+    const auto& slot = slots_[head_];
+    int len = std::min<int>(slot.len, buf_size);
+    std::memcpy(buf, slot.data.data(), len);
+    head_ = (head_ + 1) % slots_.size();
+    --count_;
+    return len;
+}
+
+unsigned
+JitterTracker::onPacket(uint16_t seq, uint32_t timestamp, clock::time_point arrival)
+{
+    newlyMissing_.clear();
+    if (not started_) {
+        started_ = true;
+        expectedSeq_ = seq + 1;
+        lastTimestamp_ = timestamp;
+        lastArrival_ = arrival;
+        return 0;
+    }
+
+    if (clockRate_) {
+        // Difference of the relative transit times of the last two packets
+        auto d = std::chrono::duration<double>(arrival - lastArrival_).count()
+                 - static_cast<int32_t>(timestamp - lastTimestamp_) / static_cast<double>(clockRate_);
+        jitter_ += (std::abs(d) - jitter_) / 16;
+    }
+    lastTimestamp_ = timestamp;
+    lastArrival_ = arrival;
+
+    unsigned lost = 0;
+    auto gap = static_cast<int16_t>(seq - expectedSeq_);
+    if (gap >= MAX_GAP or gap <= -MAX_GAP) {
+        missing_.clear();
+        expectedSeq_ = seq + 1;
+        return 1;
+    } else if (gap >= 0) {
+        for (; expectedSeq_ != seq; ++expectedSeq_) {
+            missing_.emplace_back(expectedSeq_, arrival);
+            newlyMissing_.emplace_back(expectedSeq_);
+        }
+        expectedSeq_ = seq + 1;
+    } else {
+        // Late or duplicated
+        onRecovered(seq);
+    }
+
+    auto deadline = arrival - delayTarget();
+    while (not missing_.empty() and missing_.front().second < deadline) {
+        missing_.pop_front();
+        ++lost;
+    }
+    return lost;
+}
+
+void
+JitterTracker::onRecovered(uint16_t seq)
+{
+    auto it = std::find_if(missing_.begin(), missing_.end(), [&](const auto& m) {
+        return m.first == seq;
+    });
+    if (it != missing_.end())
+        missing_.erase(it);
+}
+
+std::chrono::microseconds
+JitterTracker::jitter() const
+{
+    return std::chrono::microseconds(static_cast<int64_t>(jitter_ * 1e6));
+}
+
+std::chrono::microseconds
+JitterTracker::delayTarget() const
+{
+    // Covers most of the packets for a normal distribution of the transit times
+    auto target = 4 * jitter();
+    auto floor = std::clamp<std::chrono::microseconds>(minDelay_, MIN_DELAY, MAX_DELAY);
+    return std::clamp<std::chrono::microseconds>(target, floor, MAX_DELAY);
+}
+
+#ifdef __linux__
+static constexpr size_t MAX_BATCH_PACKETS = 32;
+// Under the 64 KiB a single UDP GSO send can carry
+static constexpr size_t MAX_BATCH_BYTES = 60000;
+
+struct SocketPair::SendBatch
+{
+    std::vector<uint8_t> data = std::vector<uint8_t>(MAX_BATCH_BYTES);
+    std::array<size_t, MAX_BATCH_PACKETS> lengths;
+    size_t count {0};
+    size_t size {0};
+    // Disabled at the first failure (old kernel, unsupported interface)
+    bool gso {true};
+
+    // GSO needs all the segments but the last one to have the same size
+    bool canSegment() const
+    {
+        if (not gso or count < 2)
+            return false;
+        for (size_t i = 1; i < count - 1; ++i)
+            if (lengths[i] != lengths[0])
+                return false;
+        return lengths[count - 1] <= lengths[0];
+    }
+};
+
+struct SocketPair::RecvBatch
+{
+    std::vector<uint8_t> data = std::vector<uint8_t>(MAX_BATCH_PACKETS * RTP_MAX_PACKET_LENGTH);
+    std::array<mmsghdr, MAX_BATCH_PACKETS> msgs;
+    std::array<iovec, MAX_BATCH_PACKETS> iovs;
+    size_t count {0};
+    size_t next {0};
+
+    RecvBatch()
+    {
+        for (size_t i = 0; i < MAX_BATCH_PACKETS; ++i) {
+            iovs[i] = {data.data() + i * RTP_MAX_PACKET_LENGTH, RTP_MAX_PACKET_LENGTH};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    bool pending() const { return next < count; }
+};
+#else
+struct SocketPair::SendBatch
+{};
+struct SocketPair::RecvBatch
+{
+    bool pending() const { return false; }
+};
+#endif
+
 SocketPair::SocketPair(const char* uri, int localPort)
+    : pacer_(new RtpPacer([this](uint8_t* buf, int len) { sendPaced(buf, len); }))
 {
     openSockets(uri, localPort);
 }
 
 SocketPair::SocketPair(std::unique_ptr<IceSocket> rtp_sock, std::unique_ptr<IceSocket> rtcp_sock)
-    : rtp_sock_(std::move(rtp_sock))
+    : rtpDataBuff_(RTP_QUEUE_SIZE)
+    , rtcpDataBuff_(RTCP_QUEUE_SIZE)
+    , rtp_sock_(std::move(rtp_sock))
     , rtcp_sock_(std::move(rtcp_sock))
+    , pacer_(new RtpPacer([this](uint8_t* buf, int len) { sendPaced(buf, len); }))
 {
     JAMI_DBG("[%p] Creating instance using ICE sockets for comp %d and %d",
              this,
@@ -196,13 +507,15 @@ SocketPair::SocketPair(std::unique_ptr<IceSocket> rtp_sock, std::unique_ptr<IceS
 
     rtp_sock_->setOnRecv([this](uint8_t* buf, size_t len) {
         std::lock_guard<std::mutex> l(dataBuffMutex_);
-        rtpDataBuff_.emplace_back(buf, buf + len);
+        if (not rtpDataBuff_.push(buf, len))
+            JAMI_WARN("[%p] Dropping oversized RTP packet (%zu bytes)", this, len);
         cv_.notify_one();
         return len;
     });
     rtcp_sock_->setOnRecv([this](uint8_t* buf, size_t len) {
         std::lock_guard<std::mutex> l(dataBuffMutex_);
-        rtcpDataBuff_.emplace_back(buf, buf + len);
+        if (not rtcpDataBuff_.push(buf, len))
+            JAMI_WARN("[%p] Dropping oversized RTCP packet (%zu bytes)", this, len);
         cv_.notify_one();
         return len;
     });
@@ -211,6 +524,7 @@ SocketPair::SocketPair(std::unique_ptr<IceSocket> rtp_sock, std::unique_ptr<IceS
 SocketPair::~SocketPair()
 {
     interrupt();
+    pacer_->stop();
     closeSockets();
     JAMI_DBG("[%p] Instance destroyed", this);
 }
@@ -235,6 +549,17 @@ SocketPair::saveRtcpRRPacket(uint8_t* buf, size_t len)
     if (header->pt != 201) // 201 = RR PT
         return;
 
+    remoteFractionLost_ = header->fraction_lost / 256.;
+    // RFC 3550 6.4.1, in the middle 32 bits of the NTP time of the SR the report is for
+    if (auto lsr = Swap4Bytes(header->lsr)) {
+        uint64_t us = av_gettime() + NTP_OFFSET_US;
+        uint32_t now = ((us / 1000000) << 16) | (((us % 1000000) << 16) / 1000000);
+        uint32_t rtt = now - lsr - Swap4Bytes(header->dlsr);
+        // Clocks of the sender report and of now can't be apart by more than a minute
+        if (rtt < (60u << 16))
+            roundTripTime_ = rtt / 65536.;
+    }
+
     std::lock_guard<std::mutex> lock(rtcpInfo_mutex_);
 
     if (listRtcpRRHeader_.size() >= MAX_LIST_SIZE) {
@@ -319,6 +644,9 @@ void
 SocketPair::stopSendOp(bool state)
 {
     noWrite_ = state;
+    // Not sent, so the sequence number read after is the last one sent
+    if (state)
+        pacer_->flush();
 }
 
 void
@@ -357,6 +685,11 @@ SocketPair::openSockets(const char* uri, int local_rtp_port)
         throw std::runtime_error("Sockets creation failed");
     }
 
+#ifdef __linux__
+    sendBatch_ = std::make_unique<SendBatch>();
+    recvBatch_ = std::make_unique<RecvBatch>();
+#endif
+
     JAMI_WARN("SocketPair: local{%d,%d} / %s{%d,%d}",
               local_rtp_port,
               local_rtcp_port,
@@ -376,7 +709,8 @@ SocketPair::createIOContext(const uint16_t mtu)
     else
         ip_header_size = 20;
     return new MediaIOHandle(
-        mtu - (srtpContext_ ? SRTP_OVERHEAD : 0) - UDP_HEADER_SIZE - ip_header_size,
+        mtu - (srtpContext_ ? ff_srtp_overhead(&srtpContext_->srtp_out) : 0) - UDP_HEADER_SIZE
+            - ip_header_size,
         true,
         [](void* sp, uint8_t* buf, int len) {
             return static_cast<SocketPair*>(sp)->readCallback(buf, len);
@@ -400,6 +734,10 @@ SocketPair::waitForData()
                 return -1;
             }
 
+            // packets left from the last recvmmsg
+            if (recvBatch_ and recvBatch_->pending())
+                return static_cast<int>(DataType::RTP);
+
             if (not readBlockingMode_) {
                 return 0;
             }
@@ -441,8 +779,12 @@ SocketPair::readRtpData(void* buf, int buf_size)
 {
     // handle system socket
     if (rtpHandle_ >= 0) {
+        if (recvBatch_)
+            return recvRtpBatch(buf, buf_size);
         struct sockaddr_storage from;
         socklen_t from_len = sizeof(from);
+        ++recvCalls_;
+        ++receivedPackets_;
         return recvfrom(rtpHandle_,
                         static_cast<char*>(buf),
                         buf_size,
@@ -451,19 +793,9 @@ SocketPair::readRtpData(void* buf, int buf_size)
                         &from_len);
     }
 
-    // handle ICE
-    std::unique_lock<std::mutex> lk(dataBuffMutex_);
-    if (not rtpDataBuff_.empty()) {
-        auto pkt = std::move(rtpDataBuff_.front());
-        rtpDataBuff_.pop_front();
-        lk.unlock(); // to not block our ICE callbacks
-        int pkt_size = pkt.size();
-        int len = std::min(pkt_size, buf_size);
-        std::copy_n(pkt.begin(), len, static_cast<char*>(buf));
-        return len;
-    }
-
-    return 0;
+    // handle ICE, copy the slot straight into the demuxer buffer
+    std::lock_guard<std::mutex> lk(dataBuffMutex_);
+    return rtpDataBuff_.pop(buf, buf_size);
 }
 
 int
@@ -482,18 +814,8 @@ SocketPair::readRtcpData(void* buf, int buf_size)
     }
 
     // handle ICE
-    std::unique_lock<std::mutex> lk(dataBuffMutex_);
-    if (not rtcpDataBuff_.empty()) {
-        auto pkt = std::move(rtcpDataBuff_.front());
-        rtcpDataBuff_.pop_front();
-        lk.unlock();
-        int pkt_size = pkt.size();
-        int len = std::min(pkt_size, buf_size);
-        std::copy_n(pkt.begin(), len, static_cast<char*>(buf));
-        return len;
-    }
-
-    return 0;
+    std::lock_guard<std::mutex> lk(dataBuffMutex_);
+    return rtcpDataBuff_.pop(buf, buf_size);
 }
 
 int
@@ -520,6 +842,8 @@ SocketPair::readCallback(uint8_t* buf, int buf_size)
             // 206 = REMB PT
             else if (header->pt == 206)
                 saveRtcpREMBPacket(buf, len);
+            else if (header->pt == rtcp_nack::PT)
+                onRtcpNack(buf, len);
             // 200 = SR PT
             else if (header->pt == 200) {
                 // not used yet
@@ -542,15 +866,40 @@ SocketPair::readCallback(uint8_t* buf, int buf_size)
     if (not fromRTCP && (buf_size < static_cast<int>(MINIMUM_RTP_HEADER_SIZE)))
         return len;
 
+    bool isRtx = false;
+    bool isFec = false;
+    if (not fromRTCP) {
+        auto rtxPayloadType = rtxRecvPayloadType_.load();
+        isRtx = rtxPayloadType and (buf[1] & 0x7f) == rtxPayloadType;
+        auto fecPayloadType = fecRecvPayloadType_.load();
+        isFec = fecPayloadType and (buf[1] & 0x7f) == fecPayloadType;
+        // Late by design, the retransmissions would bias the jitter
+        if (not isRtx and not isFec) {
+            trackRtpPacket(buf, len);
+            recvPayloadType_ = buf[1] & 0x7f;
+            recvSsrc_ = uint32_t(buf[8]) << 24 | buf[9] << 16 | buf[10] << 8 | buf[11];
+        }
+        // The header extensions are not encrypted
+        if (auto id = audioLevelRecvId_.load()) {
+            auto level = rtp_audio_level::find(buf, len, id);
+            if (level >= 0) {
+                recvAudioLevel_ = level;
+                recvAudioLevelTime_ = clock::now().time_since_epoch().count();
+            }
+        }
+    }
+
     // SRTP decrypt
-    if (not fromRTCP and srtpContext_ and srtpContext_->srtp_in.aes) {
+    bool decrypted = true;
+    if (not fromRTCP and srtpContext_ and srtpContext_->srtp_in.suite) {
         int32_t gradient = 0;
         int32_t deltaT = 0;
         float abs = 0.0f;
         bool res_parse = false;
         bool res_delay = false;
 
-        res_parse = parse_RTP_ext(buf, &abs);
+        // The send time of a retransmission is the one of the original packet
+        res_parse = not isRtx and not isFec and parse_RTP_ext(buf, &abs);
         bool marker = (buf[1] & 0x80) >> 7;
 
         if (res_parse)
@@ -560,12 +909,40 @@ SocketPair::readCallback(uint8_t* buf, int buf_size)
         if (rtpDelayCallback_ and res_delay)
             rtpDelayCallback_(gradient, deltaT);
 
-        auto err = ff_srtp_decrypt(&srtpContext_->srtp_in, buf, &len);
-        if (packetLossCallback_ and (buf[2] << 8 | buf[3]) != lastSeqNumIn_ + 1)
-            packetLossCallback_();
-        lastSeqNumIn_ = buf[2] << 8 | buf[3];
-        if (err < 0)
+        auto* context = isRtx   ? &srtpContext_->rtx_in
+                        : isFec ? &srtpContext_->fec_in
+                                : &srtpContext_->srtp_in;
+        auto err = ff_srtp_decrypt(context, buf, &len);
+        if (err < 0) {
             JAMI_WARN("decrypt error %d", err);
+            decrypted = false;
+        }
+    }
+    // Of the stream, once received
+    if (isRtx and decrypted and recvPayloadType_) {
+        if (auto restored = restoreRtxPacket(buf, len, recvPayloadType_, recvSsrc_)) {
+            len = restored;
+            jitter_.onRecovered(buf[2] << 8 | buf[3]);
+        }
+    }
+    // Else dropped by the demuxer, of another payload type than the stream
+    if (isFec and decrypted and fecDecoder_) {
+        if (auto recovered = fecDecoder_->recover(buf, len)) {
+            len = recovered;
+            isFec = false;
+            jitter_.onRecovered(buf[2] << 8 | buf[3]);
+            ++rtpPacketsRecovered_;
+        }
+    } else if (not fromRTCP and decrypted and fecDecoder_) {
+        fecDecoder_->onPacket(buf, len);
+    }
+    if (not fromRTCP and len > 0) {
+        jami_tracepoint(rtp_srtp_decrypt, this, buf);
+        if (forwarding_ and decrypted and not isFec) {
+            std::lock_guard<std::mutex> lk(forwardMutex_);
+            if (rtpForwardCallback_)
+                rtpForwardCallback_(buf, len);
+        }
     }
 
     if (len != 0)
@@ -574,6 +951,81 @@ SocketPair::readCallback(uint8_t* buf, int buf_size)
         return AVERROR_EOF;
 }
 
+void
+SocketPair::trackRtpPacket(const uint8_t* buf, int len)
+{
+    if (len < static_cast<int>(MINIMUM_RTP_HEADER_SIZE) or RTP_PT_IS_RTCP(buf[1]))
+        return;
+    jami_tracepoint(rtp_recv, this, buf);
+    // Sequence number and timestamp aren't encrypted
+    uint16_t seq = buf[2] << 8 | buf[3];
+    uint32_t timestamp = buf[4] << 24 | buf[5] << 16 | buf[6] << 8 | buf[7];
+    // Time for the retransmissions to come
+    if (rtxRecvPayloadType_)
+        jitter_.setMinDelay(
+            std::chrono::microseconds(static_cast<int64_t>(roundTripTime_ * 1.5e6)));
+    auto lost = jitter_.onPacket(seq, timestamp, clock::now());
+    ++rtpPacketsReceived_;
+    rtpBytesReceived_ += len;
+    rtpPacketsLost_ += lost;
+    jitterUs_ = jitter_.jitter().count();
+    if (metrics_) {
+        metrics_->receivedPackets.add();
+        metrics_->receivedBytes.add(len);
+        if (lost)
+            metrics_->lostPackets.add(lost);
+        metrics_->jitter.observe(jitter_.jitter());
+    }
+    if (lost and packetLossCallback_)
+        packetLossCallback_();
+    if (rtxRecvPayloadType_ and not jitter_.newlyMissing().empty())
+        sendRtcpNack(uint32_t(buf[8]) << 24 | buf[9] << 16 | buf[10] << 8 | buf[11],
+                     jitter_.newlyMissing());
+
+    if (jitterDelayCallback_) {
+        // Avoid updating the demuxer for each packet
+        auto delay = jitter_.delayTarget();
+        if (std::chrono::abs(delay - jitterDelay_) >= std::chrono::milliseconds(5)) {
+            jitterDelay_ = delay;
+            jitterDelayCallback_(delay);
+        }
+    }
+}
+
+struct SocketPair::Metrics
+{
+    metrics::Counter& sentPackets;
+    metrics::Counter& sentBytes;
+    metrics::Counter& receivedPackets;
+    metrics::Counter& receivedBytes;
+    metrics::Counter& lostPackets;
+    metrics::Histogram& jitter;
+};
+
+void
+SocketPair::setMetrics(const std::string& media)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::unique_ptr<Metrics>> byMedia;
+    std::lock_guard<std::mutex> lk(mutex);
+    auto& m = byMedia[media];
+    if (not m) {
+        auto& registry = metrics::Registry::instance();
+        metrics::Labels labels {{"media", media}};
+        m.reset(new Metrics {
+            registry.counter("jami_rtp_sent_packets", "RTP packets sent", labels),
+            registry.counter("jami_rtp_sent_bytes", "Bytes of the RTP packets sent", labels),
+            registry.counter("jami_rtp_received_packets", "RTP packets received", labels),
+            registry.counter("jami_rtp_received_bytes", "Bytes of the RTP packets received", labels),
+            registry.counter("jami_rtp_lost_packets", "RTP packets lost on reception", labels),
+            registry.histogram("jami_rtp_jitter_seconds",
+                               "Interarrival jitter of the RTP packets received",
+                               {.001, .0025, .005, .01, .02, .03, .05, .1, .25},
+                               labels)});
+    }
+    metrics_ = m.get();
+}
+
 int
 SocketPair::writeData(uint8_t* buf, int buf_size)
 {
@@ -592,12 +1044,18 @@ SocketPair::writeData(uint8_t* buf, int buf_size)
             dest_addr = &rtpDestAddr_;
         }
 
+        if (noWrite_)
+            return buf_size;
+
+        if (not isRTCP and batching_ and buf_size <= RTP_MAX_PACKET_LENGTH)
+            return queueRtpData(buf, buf_size);
+
         auto ret = ff_network_wait_fd(fd);
         if (ret < 0)
             return ret;
 
-        if (noWrite_)
-            return buf_size;
+        ++sendCalls_;
+        ++sentPackets_;
         return ::sendto(fd,
                         reinterpret_cast<const char*>(buf),
                         buf_size,
@@ -610,14 +1068,272 @@ SocketPair::writeData(uint8_t* buf, int buf_size)
         return buf_size;
 
     // IceSocket
+    ++sendCalls_;
+    ++sentPackets_;
     if (isRTCP)
         return rtcp_sock_->send(buf, buf_size);
     else
         return rtp_sock_->send(buf, buf_size);
 }
 
+void
+SocketPair::beginSendBatch()
+{
+    // Paced packets are sent one by one
+    batching_ = sendBatch_ != nullptr and not pacer_->enabled();
+}
+
+void
+SocketPair::endSendBatch()
+{
+    if (not batching_)
+        return;
+    flushSendBatch();
+    batching_ = false;
+}
+
+void
+SocketPair::setPacingBitrate(unsigned kbps)
+{
+    pacer_->setBitrate(kbps);
+    std::lock_guard<std::mutex> lk(rtxMutex_);
+    if (rtxSender_)
+        rtxSender_->setBitrate(kbps);
+}
+
+SocketPair::BatchStats
+SocketPair::getBatchStats() const
+{
+    BatchStats stats;
+    stats.sentPackets = sentPackets_;
+    stats.sendCalls = sendCalls_;
+    stats.receivedPackets = receivedPackets_;
+    stats.recvCalls = recvCalls_;
+    return stats;
+}
+
+SocketPair::RtpStats
+SocketPair::getRtpStats() const
+{
+    RtpStats stats;
+    stats.packetsSent = rtpPacketsSent_;
+    stats.bytesSent = rtpBytesSent_;
+    stats.packetsReceived = rtpPacketsReceived_;
+    stats.bytesReceived = rtpBytesReceived_;
+    stats.packetsLost = rtpPacketsLost_;
+    stats.jitter = std::chrono::microseconds(jitterUs_.load());
+    stats.remoteFractionLost = remoteFractionLost_;
+    stats.roundTripTime = roundTripTime_;
+    stats.packetsRetransmitted = rtpPacketsRetransmitted_;
+    stats.packetsRecovered = rtpPacketsRecovered_;
+    return stats;
+}
+
+#ifdef __linux__
+int
+SocketPair::queueRtpData(const uint8_t* buf, int buf_size)
+{
+    auto& batch = *sendBatch_;
+    if (batch.count == MAX_BATCH_PACKETS or batch.size + buf_size > MAX_BATCH_BYTES)
+        flushSendBatch();
+    std::memcpy(batch.data.data() + batch.size, buf, buf_size);
+    batch.lengths[batch.count++] = buf_size;
+    batch.size += buf_size;
+    return buf_size;
+}
+
+void
+SocketPair::flushSendBatch()
+{
+    auto& batch = *sendBatch_;
+    if (batch.count == 0)
+        return;
+
+    auto dest = const_cast<sockaddr*>(static_cast<const sockaddr*>(rtpDestAddr_));
+    size_t sent = 0;
+
+#ifdef UDP_SEGMENT
+    if (batch.canSegment()) {
+        // One datagram split by the kernel (or the NIC) in equal segments
+        iovec iov {batch.data.data(), batch.size};
+        char control[CMSG_SPACE(sizeof(uint16_t))] {};
+        msghdr msg {};
+        msg.msg_name = dest;
+        msg.msg_namelen = rtpDestAddr_.getLength();
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        auto cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segment = batch.lengths[0];
+        std::memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+
+        ssize_t ret;
+        do {
+            ret = ::sendmsg(rtpHandle_, &msg, 0);
+        } while (ret < 0 and errno == EAGAIN and not interrupted_
+                 and ff_network_wait_fd(rtpHandle_) == 0);
+        ++sendCalls_;
+        if (ret >= 0) {
+            sent = batch.count;
+        } else if (errno == EIO or errno == EINVAL or errno == ENOPROTOOPT
+                   or errno == EOPNOTSUPP) {
+            JAMI_WARN("[%p] UDP GSO unavailable (%s), using sendmmsg", this, strerror(errno));
+            batch.gso = false;
+        }
+    }
+#endif
+
+    std::array<mmsghdr, MAX_BATCH_PACKETS> msgs;
+    std::array<iovec, MAX_BATCH_PACKETS> iovs;
+    size_t offset = 0;
+    for (size_t i = 0; i < batch.count; ++i) {
+        iovs[i] = {batch.data.data() + offset, batch.lengths[i]};
+        offset += batch.lengths[i];
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_name = dest;
+        msgs[i].msg_hdr.msg_namelen = rtpDestAddr_.getLength();
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < batch.count) {
+        auto ret = ::sendmmsg(rtpHandle_, msgs.data() + sent, batch.count - sent, 0);
+        ++sendCalls_;
+        if (ret < 0) {
+            if (errno == EAGAIN and not interrupted_ and ff_network_wait_fd(rtpHandle_) == 0)
+                continue;
+            JAMI_WARN("[%p] Dropping %zu RTP packets: %s",
+                      this,
+                      batch.count - sent,
+                      strerror(errno));
+            break;
+        }
+        sent += ret;
+    }
+
+    sentPackets_ += sent;
+    batch.count = 0;
+    batch.size = 0;
+}
+
+int
+SocketPair::recvRtpBatch(void* buf, int buf_size)
+{
+    auto& batch = *recvBatch_;
+    if (not batch.pending()) {
+        auto ret = ::recvmmsg(rtpHandle_, batch.msgs.data(), batch.msgs.size(), MSG_DONTWAIT, nullptr);
+        ++recvCalls_;
+        if (ret <= 0)
+            return ret;
+        receivedPackets_ += ret;
+        batch.count = ret;
+        batch.next = 0;
+    }
+    const auto& msg = batch.msgs[batch.next];
+    int len = std::min<int>(msg.msg_len, buf_size);
+    std::memcpy(buf, msg.msg_hdr.msg_iov->iov_base, len);
+    ++batch.next;
+    return len;
+}
+#else
+int
+SocketPair::queueRtpData(const uint8_t*, int)
+{
+    return -1;
+}
+
+void
+SocketPair::flushSendBatch()
+{}
+
+int
+SocketPair::recvRtpBatch(void*, int)
+{
+    return -1;
+}
+#endif
+
 int
 SocketPair::writeCallback(uint8_t* buf, int buf_size)
+{
+    if (noWrite_)
+        return 0;
+
+    bool isRTP = not RTP_PT_IS_RTCP(buf[1]);
+    if (isRTP) {
+        jami_tracepoint(rtp_packetize, this, buf);
+        if (buf_size >= static_cast<int>(MINIMUM_RTP_HEADER_SIZE))
+            lastSsrcOut_ = uint32_t(buf[8]) << 24 | buf[9] << 16 | buf[10] << 8 | buf[11];
+    }
+
+    // The muxer only knows its own extensions
+    auto written = buf_size;
+    if (isRTP) {
+        if (auto id = audioLevelSendId_.load()) {
+            uint8_t level = sendAudioLevel_;
+            if (auto len = rtp_audio_level::add(buf,
+                                                buf_size,
+                                                id,
+                                                level & 0x7f,
+                                                level & 0x80,
+                                                extendedPacket_.data(),
+                                                extendedPacket_.size())) {
+                buf = extendedPacket_.data();
+                buf_size = len;
+            }
+        }
+    }
+
+    // Before the encryption, sent after the packet closing its group
+    size_t repairLen = 0;
+    if (isRTP and fecSendPayloadType_) {
+        std::lock_guard<std::mutex> lk(fecMutex_);
+        if (fecEncoder_)
+            repairLen = fecEncoder_->protect(buf, buf_size, fecPacket_.data(), fecPacket_.size());
+    }
+
+    // Encrypted when sent by the pacer, with its send time
+    int ret = written;
+    if (not isRTP or not pacer_->push(buf, buf_size)) {
+        ret = sendPacket(buf, buf_size);
+        ret = ret <= 0 ? ret : written;
+    }
+    if (repairLen and not pacer_->push(fecPacket_.data(), repairLen))
+        sendRepair(fecPacket_.data(), repairLen, fecPacket_.size());
+    return ret;
+}
+
+void
+SocketPair::sendPaced(uint8_t* buf, int len)
+{
+    // Rewrite the abs-send-time extension of the muxer with the time the
+    // packet really leaves, so the peer doesn't take the pacing for congestion
+    if (len >= 20 and (buf[0] & 0x10) and ((buf[12] << 8) | buf[13]) == 0xBEDE
+        and (buf[16] >> 4) == 3) {
+        // Same clock as ff_ntp_time(), in 6.18 fixed point seconds
+        uint64_t us = (av_gettime() / 1000) * 1000 + NTP_OFFSET_US;
+        uint64_t ntp = (us / 1000000) << 32 | ((us % 1000000) << 32) / 1000000;
+        uint32_t absSendTime = (ntp >> 14) & 0x00ffffff;
+        buf[17] = absSendTime >> 16;
+        buf[18] = (absSendTime >> 8) & 0xff;
+        buf[19] = absSendTime & 0xff;
+    }
+    // Protected in the slot of the pacer
+    auto payloadType = buf[1] & 0x7f;
+    auto rtxPayloadType = rtxSendPayloadType_.load();
+    auto fecPayloadType = fecSendPayloadType_.load();
+    if ((rtxPayloadType and payloadType == rtxPayloadType)
+        or (fecPayloadType and payloadType == fecPayloadType))
+        sendRepair(buf, len, PacketRing::SLOT_SIZE);
+    else
+        sendPacket(buf, len, PacketRing::SLOT_SIZE);
+}
+
+int
+SocketPair::sendPacket(uint8_t* buf, int buf_size, int capacity)
 {
     if (noWrite_)
         return 0;
@@ -627,20 +1343,31 @@ SocketPair::writeCallback(uint8_t* buf, int buf_size)
     unsigned int ts_LSB, ts_MSB;
     double currentSRTS, currentLatency;
 
+    if (not isRTCP and rtxSendPayloadType_) {
+        std::lock_guard<std::mutex> lk(rtxMutex_);
+        if (rtxSender_)
+            rtxSender_->onSent(buf, buf_size);
+    }
+
     // Encrypt?
-    if (not isRTCP and srtpContext_ and srtpContext_->srtp_out.aes) {
-        buf_size = ff_srtp_encrypt(&srtpContext_->srtp_out,
-                                   buf,
-                                   buf_size,
-                                   srtpContext_->encryptbuf,
-                                   sizeof(srtpContext_->encryptbuf));
+    if (not isRTCP and srtpContext_ and srtpContext_->srtp_out.suite) {
+        if (capacity > 0) {
+            buf_size = ff_srtp_protect(&srtpContext_->srtp_out, buf, buf_size, capacity);
+        } else {
+            buf_size = ff_srtp_encrypt(&srtpContext_->srtp_out,
+                                       buf,
+                                       buf_size,
+                                       srtpContext_->encryptbuf,
+                                       sizeof(srtpContext_->encryptbuf));
+            buf = srtpContext_->encryptbuf;
+        }
         if (buf_size < 0) {
             JAMI_WARN("encrypt error %d", buf_size);
             return buf_size;
         }
-
-        buf = srtpContext_->encryptbuf;
     }
+    if (not isRTCP)
+        jami_tracepoint(rtp_srtp_encrypt, this, buf);
 
     // check if we're sending an RR, if so, detect packet loss
     // buf_size gives length of buffer, not just header
@@ -655,6 +1382,15 @@ SocketPair::writeCallback(uint8_t* buf, int buf_size)
             return -EINTR;
         ret = writeData(buf, buf_size);
     } while (ret < 0 and errno == EAGAIN);
+    if (not isRTCP and ret >= 0) {
+        jami_tracepoint(rtp_send, this, buf);
+        ++rtpPacketsSent_;
+        rtpBytesSent_ += buf_size;
+        if (metrics_) {
+            metrics_->sentPackets.add();
+            metrics_->sentBytes.add(buf_size);
+        }
+    }
 
     if (buf[1] == 200) // Sender Report
     {
@@ -701,6 +1437,122 @@ SocketPair::setRtpDelayCallback(std::function<void(int, int)> cb)
     rtpDelayCallback_ = std::move(cb);
 }
 
+void
+SocketPair::setRtpForwardCallback(std::function<void(const uint8_t*, std::size_t)> cb)
+{
+    std::lock_guard<std::mutex> lk(forwardMutex_);
+    forwarding_ = static_cast<bool>(cb);
+    rtpForwardCallback_ = std::move(cb);
+}
+
+void
+SocketPair::setRtx(uint8_t sendPayloadType, uint8_t recvPayloadType)
+{
+    {
+        std::lock_guard<std::mutex> lk(rtxMutex_);
+        if (sendPayloadType) {
+            dht::crypto::random_device rd;
+            rtxSender_ = std::make_unique<RtxSender>(rd(), rd(), sendPayloadType);
+            rtxPacket_.resize(RtxSender::SLOT_SIZE);
+        } else {
+            rtxSender_.reset();
+        }
+    }
+    rtxSendPayloadType_ = sendPayloadType & 0x7f;
+    rtxRecvPayloadType_ = recvPayloadType & 0x7f;
+}
+
+void
+SocketPair::setFec(uint8_t sendPayloadType, uint8_t recvPayloadType)
+{
+    {
+        std::lock_guard<std::mutex> lk(fecMutex_);
+        if (sendPayloadType) {
+            dht::crypto::random_device rd;
+            fecEncoder_ = std::make_unique<flexfec::Encoder>(rd(), rd(), sendPayloadType);
+        } else {
+            fecEncoder_.reset();
+        }
+    }
+    if (recvPayloadType)
+        fecDecoder_ = std::make_unique<flexfec::Decoder>();
+    else
+        fecDecoder_.reset();
+    fecSendPayloadType_ = sendPayloadType & 0x7f;
+    fecRecvPayloadType_ = recvPayloadType & 0x7f;
+}
+
+void
+SocketPair::setFecProtection(double fractionLost)
+{
+    std::lock_guard<std::mutex> lk(fecMutex_);
+    if (not fecEncoder_)
+        return;
+    auto size = flexfec::groupSize(fractionLost);
+    if (size != fecEncoder_->groupSize())
+        JAMI_DBG("[%p] FEC of groups of %u packets, for %.1f%% lost",
+                 this,
+                 size,
+                 fractionLost * 100);
+    fecEncoder_->setGroupSize(size);
+}
+
+void
+SocketPair::onRtcpNack(const uint8_t* buf, size_t len)
+{
+    uint32_t mediaSsrc;
+    nackedSeqs_.clear();
+    if (not rtcp_nack::parse(buf, len, mediaSsrc, nackedSeqs_))
+        return;
+    for (auto seq : nackedSeqs_) {
+        size_t rtxLen = 0;
+        {
+            std::lock_guard<std::mutex> lk(rtxMutex_);
+            if (not rtxSender_)
+                return;
+            rtxLen = rtxSender_->retransmit(mediaSsrc, seq, rtxPacket_.data(), rtxPacket_.size());
+        }
+        // Paced with the media, retransmissions being only budgeted when the pacer runs
+        if (rtxLen)
+            pacer_->push(rtxPacket_.data(), rtxLen);
+    }
+}
+
+void
+SocketPair::sendRtcpNack(uint32_t mediaSsrc, const std::vector<uint16_t>& seqs)
+{
+    // Up to 64 reports of 17 packets
+    std::array<uint8_t, 12 + 4 * 64> packet;
+    auto len = rtcp_nack::write(lastSsrcOut_, mediaSsrc, seqs, packet.data(), packet.size());
+    if (len)
+        sendPacket(packet.data(), len);
+}
+
+void
+SocketPair::sendRepair(uint8_t* buf, int len, int capacity)
+{
+    if (noWrite_)
+        return;
+    auto rtxPayloadType = rtxSendPayloadType_.load();
+    bool isRtx = rtxPayloadType and (buf[1] & 0x7f) == rtxPayloadType;
+    if (srtpContext_ and srtpContext_->rtx_out.suite) {
+        auto* context = isRtx ? &srtpContext_->rtx_out : &srtpContext_->fec_out;
+        len = ff_srtp_protect(context, buf, len, capacity);
+        if (len <= 0) {
+            JAMI_WARN("encrypt error %d", len);
+            return;
+        }
+    }
+    int ret;
+    do {
+        if (interrupted_)
+            return;
+        ret = writeData(buf, len);
+    } while (ret < 0 and errno == EAGAIN);
+    if (ret >= 0 and isRtx)
+        ++rtpPacketsRetransmitted_;
+}
+
 bool
 SocketPair::getOneWayDelayGradient(float sendTS, bool marker, int32_t* gradient, int32_t* deltaT)
 {
@@ -750,6 +1602,24 @@ SocketPair::parse_RTP_ext(uint8_t* buf, float* abs)
     return true;
 }
 
+void
+SocketPair::setAudioLevelExtension(uint8_t sendId, uint8_t recvId)
+{
+    audioLevelSendId_ = sendId;
+    audioLevelRecvId_ = recvId;
+}
+
+SocketPair::AudioLevel
+SocketPair::getReceivedAudioLevel() const
+{
+    AudioLevel level;
+    uint8_t value = recvAudioLevel_;
+    level.level = value & 0x7f;
+    level.voice = value & 0x80;
+    level.received = time_point(clock::duration(recvAudioLevelTime_.load()));
+    return level;
+}
+
 uint16_t
 SocketPair::lastSeqValOut()
 {
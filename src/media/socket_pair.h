@@ -41,8 +41,12 @@ using socklen_t = int;
 #include <cstdint>
 #include <mutex>
 #include <memory>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <list>
+#include <string>
 #include <vector>
 #include <condition_variable>
 #include <functional>
@@ -51,6 +55,12 @@ namespace jami {
 
 class IceSocket;
 class SRTPProtoContext;
+class RtpPacer;
+class RtxSender;
+namespace flexfec {
+class Encoder;
+class Decoder;
+} // namespace flexfec
 
 typedef struct
 {
@@ -129,6 +139,142 @@ typedef struct
     std::chrono::steady_clock::time_point receive_ts;
 } TS_Frame;
 
+/**
+ * Fixed capacity FIFO of received packets.
+ * Slots are allocated once and recycled, so queuing a packet never allocates.
+ * When full, the oldest packet is dropped. Not thread-safe.
+ */
+class PacketRing
+{
+public:
+    static constexpr size_t SLOT_SIZE = 2048;
+
+    explicit PacketRing(size_t capacity = 0)
+        : slots_(capacity)
+    {}
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+    void clear()
+    {
+        head_ = 0;
+        count_ = 0;
+    }
+
+    /**
+     * Copy a packet in the next slot.
+     * Return false if the packet is larger than a slot or if there is no slot.
+     */
+    bool push(const uint8_t* data, size_t len);
+
+    /**
+     * Copy the oldest packet to buf (truncated to buf_size) and recycle its slot.
+     * Return the copied length, 0 if empty.
+     */
+    int pop(void* buf, int buf_size);
+
+private:
+    struct Slot
+    {
+        size_t len {0};
+        std::array<uint8_t, SLOT_SIZE> data;
+    };
+    std::vector<Slot> slots_;
+    size_t head_ {0};
+    size_t count_ {0};
+};
+
+/**
+ * Audio level header extension (RFC 6464), in the one-byte header format of RFC 8285. The
+ * muxer already adds abs-send-time to every packet, the level is appended to its extensions.
+ */
+namespace rtp_audio_level {
+
+constexpr const char* URI {"urn:ietf:params:rtp-hdrext:ssrc-audio-level"};
+// Level of the silence, in -dBov
+constexpr uint8_t SILENCE {127};
+
+/**
+ * @param rms   From 0 to 1
+ * @return level in -dBov, from 0 (loudest) to 127
+ */
+uint8_t fromRms(float rms);
+float toRms(uint8_t level);
+
+/**
+ * Copy an RTP packet to out with the level of its audio added.
+ * @return the length of the copy, 0 if out is too small or the packet can't be extended
+ */
+size_t add(const uint8_t* packet,
+           size_t len,
+           uint8_t id,
+           uint8_t level,
+           bool voice,
+           uint8_t* out,
+           size_t outSize);
+
+/**
+ * @return the extension, with the voice activity in its high bit, -1 if not in the packet
+ */
+int find(const uint8_t* packet, size_t len, uint8_t id);
+
+} // namespace rtp_audio_level
+
+/**
+ * Follow the incoming RTP packets to measure their interarrival jitter
+ * (RFC 3550) and detect the missing ones.
+ * A missing packet is only lost once it is late by more than the delay target,
+ * the time the demuxer waits for it to reorder the packets. Not thread-safe.
+ */
+class JitterTracker
+{
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr auto MIN_DELAY = std::chrono::milliseconds(10);
+    static constexpr auto MAX_DELAY = std::chrono::milliseconds(250);
+
+    explicit JitterTracker(unsigned clockRate = 0)
+        : clockRate_(clockRate)
+    {}
+
+    /**
+     * @return number of packets found lost since the last call
+     */
+    unsigned onPacket(uint16_t seq, uint32_t timestamp, clock::time_point arrival);
+    /**
+     * A missing packet was retransmitted, not accounted in the jitter
+     */
+    void onRecovered(uint16_t seq);
+
+    std::chrono::microseconds jitter() const;
+    std::chrono::microseconds delayTarget() const;
+    /**
+     * Wait at least delay for the missing packets, e.g. for their retransmission
+     */
+    void setMinDelay(std::chrono::microseconds delay) { minDelay_ = delay; }
+
+    /**
+     * Sequence numbers of the packets found missing by the last call to onPacket
+     */
+    const std::vector<uint16_t>& newlyMissing() const { return newlyMissing_; }
+
+private:
+    // Beyond, the sender is considered restarted
+    static constexpr uint16_t MAX_GAP {128};
+    // Delay target of 50 ms until measured
+    static constexpr double INITIAL_JITTER {0.0125};
+
+    unsigned clockRate_;
+    bool started_ {false};
+    uint16_t expectedSeq_ {0};
+    uint32_t lastTimestamp_ {0};
+    clock::time_point lastArrival_ {};
+    double jitter_ {INITIAL_JITTER}; // in seconds
+    std::chrono::microseconds minDelay_ {MIN_DELAY};
+    std::deque<std::pair<uint16_t, clock::time_point>> missing_;
+    std::vector<uint16_t> newlyMissing_;
+};
+
 class SocketPair
 {
 public:
@@ -182,8 +328,129 @@ public:
     {
         packetLossCallback_ = std::move(cb);
     }
+
+    /**
+     * Follow the jitter of the incoming RTP packets, cb being called with the
+     * delay to wait for the missing packets when it changes. Called by the
+     * demuxing thread.
+     * @param clockRate     Of the RTP timestamps of the incoming packets
+     */
+    void setJitterDelayCallback(unsigned clockRate,
+                                std::function<void(std::chrono::microseconds)> cb)
+    {
+        jitter_ = JitterTracker(clockRate);
+        jitterDelayCallback_ = std::move(cb);
+        jitterDelay_ = {};
+    }
+
+    /**
+     * Queue the RTP packets written until endSendBatch() and send them with as
+     * few system calls as possible (sendmmsg, or one GSO send if supported).
+     * Only effective on system sockets, ICE sends packet by packet.
+     */
+    void beginSendBatch();
+    void endSendBatch();
+
+    struct RtpStats
+    {
+        uint64_t packetsSent {0};
+        uint64_t bytesSent {0};
+        uint64_t packetsReceived {0};
+        uint64_t bytesReceived {0};
+        uint64_t packetsLost {0}; // of the received packets, see JitterTracker
+        std::chrono::microseconds jitter {0};
+        // Last RTCP receiver report of the peer
+        double remoteFractionLost {0};
+        double roundTripTime {0}; // in seconds, 0 until measured
+        uint64_t packetsRetransmitted {0}; // see setRtx
+        uint64_t packetsRecovered {0};     // see setFec
+    };
+    /**
+     * RTP only, since the pair was created. Thread-safe.
+     */
+    RtpStats getRtpStats() const;
+
+    struct BatchStats
+    {
+        uint64_t sentPackets {0};
+        uint64_t sendCalls {0};
+        uint64_t receivedPackets {0};
+        uint64_t recvCalls {0};
+    };
+    BatchStats getBatchStats() const;
+
+    /**
+     * Pace the RTP packets sent for a target bitrate, in Kbps (see RtpPacer).
+     * The first call starts pacing, the rate can then only be changed.
+     */
+    void setPacingBitrate(unsigned kbps);
+
     void setRtpDelayCallback(std::function<void(int, int)> cb);
 
+    /**
+     * Receive the RTP packets as they are read, once decrypted, e.g. to forward
+     * them. Called by the demuxing thread, nullptr to stop.
+     */
+    void setRtpForwardCallback(std::function<void(const uint8_t*, std::size_t)> cb);
+    /**
+     * Send an RTP packet of another stream, paced and encrypted as the ones of
+     * the muxer
+     */
+    int writeForwarded(uint8_t* buf, int buf_size) { return writeCallback(buf, buf_size); }
+    /**
+     * SSRC of the last RTP packet sent, 0 if none
+     */
+    uint32_t lastSsrcOut() const { return lastSsrcOut_; }
+
+    /**
+     * Add the audio level (see rtp_audio_level) to the RTP packets sent, with the extension
+     * id negotiated by the peer, and read it from the packets received with ours.
+     * 0 not to send or read it. Before the session starts.
+     */
+    void setAudioLevelExtension(uint8_t sendId, uint8_t recvId);
+    /**
+     * Level of the next packets sent, from the encoding thread
+     */
+    void setAudioLevel(uint8_t level, bool voice)
+    {
+        sendAudioLevel_ = (voice ? 0x80 : 0) | (level & 0x7f);
+    }
+
+    struct AudioLevel
+    {
+        uint8_t level {rtp_audio_level::SILENCE}; // in -dBov
+        bool voice {false};
+        std::chrono::steady_clock::time_point received {};
+    };
+    /**
+     * Level of the last packet received with it. Thread-safe.
+     */
+    AudioLevel getReceivedAudioLevel() const;
+
+    /**
+     * Retransmit the RTP packets the peer reports lost (RFC 4585 generic NACK) in RTX packets
+     * (RFC 4588) of sendPayloadType, and report the packets we lose to the peer, which
+     * retransmits them in recvPayloadType. 0 if not negotiated. Before the session starts.
+     */
+    void setRtx(uint8_t sendPayloadType, uint8_t recvPayloadType);
+
+    /**
+     * Send FlexFEC repair packets (see rtp_fec) of sendPayloadType with the RTP packets, and
+     * recover the packets lost from the ones of the peer, in recvPayloadType. 0 if not
+     * negotiated. Before the session starts.
+     */
+    void setFec(uint8_t sendPayloadType, uint8_t recvPayloadType);
+    /**
+     * Protect the packets sent against the loss reported by the peer, from 0 to 1
+     */
+    void setFecProtection(double fractionLost);
+
+    /**
+     * Count the RTP packets, their bytes and losses and the jitter in the
+     * metrics of media ("audio" or "video"). Before the session starts.
+     */
+    void setMetrics(const std::string& media);
+
     int writeData(uint8_t* buf, int buf_size);
 
     uint16_t lastSeqValOut();
@@ -195,21 +462,57 @@ private:
 
     int readCallback(uint8_t* buf, int buf_size);
     int writeCallback(uint8_t* buf, int buf_size);
+    /**
+     * @param capacity  Size of buf if the packet can be protected in place, else 0
+     */
+    int sendPacket(uint8_t* buf, int buf_size, int capacity = 0);
+    void sendPaced(uint8_t* buf, int len);
 
     int waitForData();
     int readRtpData(void* buf, int buf_size);
     int readRtcpData(void* buf, int buf_size);
     void saveRtcpRRPacket(uint8_t* buf, size_t len);
     void saveRtcpREMBPacket(uint8_t* buf, size_t len);
+    void onRtcpNack(const uint8_t* buf, size_t len);
+    void sendRtcpNack(uint32_t mediaSsrc, const std::vector<uint16_t>& seqs);
+    /**
+     * Of an RTX or FEC packet, on its own stream
+     */
+    void sendRepair(uint8_t* buf, int len, int capacity);
 
     std::mutex dataBuffMutex_;
     std::condition_variable cv_;
-    std::list<std::vector<uint8_t>> rtpDataBuff_;
-    std::list<std::vector<uint8_t>> rtcpDataBuff_;
+    PacketRing rtpDataBuff_;
+    PacketRing rtcpDataBuff_;
 
     std::unique_ptr<IceSocket> rtp_sock_;
     std::unique_ptr<IceSocket> rtcp_sock_;
 
+    // System sockets batching (see beginSendBatch)
+    struct SendBatch;
+    struct RecvBatch;
+    std::unique_ptr<SendBatch> sendBatch_;
+    std::unique_ptr<RecvBatch> recvBatch_;
+    std::atomic_bool batching_ {false};
+    std::unique_ptr<RtpPacer> pacer_;
+    int queueRtpData(const uint8_t* buf, int buf_size);
+    void flushSendBatch();
+    int recvRtpBatch(void* buf, int buf_size);
+
+    std::atomic<uint64_t> sentPackets_ {0};
+    std::atomic<uint64_t> sendCalls_ {0};
+    std::atomic<uint64_t> receivedPackets_ {0};
+    std::atomic<uint64_t> recvCalls_ {0};
+
+    std::atomic<uint64_t> rtpPacketsSent_ {0};
+    std::atomic<uint64_t> rtpBytesSent_ {0};
+    std::atomic<uint64_t> rtpPacketsReceived_ {0};
+    std::atomic<uint64_t> rtpBytesReceived_ {0};
+    std::atomic<uint64_t> rtpPacketsLost_ {0};
+    std::atomic<int64_t> jitterUs_ {0};
+    std::atomic<double> remoteFractionLost_ {0};
+    std::atomic<double> roundTripTime_ {0};
+
     int rtpHandle_ {-1};
     int rtcpHandle_ {-1};
     IpAddr rtpDestAddr_;
@@ -221,10 +524,51 @@ private:
     std::atomic_bool noWrite_ {false};
     std::unique_ptr<SRTPProtoContext> srtpContext_;
     std::function<void(void)> packetLossCallback_;
+    std::function<void(std::chrono::microseconds)> jitterDelayCallback_;
+    JitterTracker jitter_;
+    std::chrono::microseconds jitterDelay_ {};
+    void trackRtpPacket(const uint8_t* buf, int len);
+    struct Metrics;
+    Metrics* metrics_ {nullptr};
     std::function<void(int, int)> rtpDelayCallback_;
+    std::mutex forwardMutex_;
+    std::function<void(const uint8_t*, std::size_t)> rtpForwardCallback_;
+    std::atomic_bool forwarding_ {false};
+    std::atomic<uint32_t> lastSsrcOut_ {0};
+
+    // Retransmissions (see setRtx)
+    std::mutex rtxMutex_;
+    std::unique_ptr<RtxSender> rtxSender_;
+    std::atomic<uint8_t> rtxSendPayloadType_ {0};
+    std::atomic<uint8_t> rtxRecvPayloadType_ {0};
+    std::atomic<uint64_t> rtpPacketsRetransmitted_ {0};
+    // Of the demuxing thread
+    std::vector<uint8_t> rtxPacket_;
+    std::vector<uint16_t> nackedSeqs_;
+    uint8_t recvPayloadType_ {0};
+    uint32_t recvSsrc_ {0};
+
+    // Forward error correction (see setFec)
+    std::mutex fecMutex_;
+    std::unique_ptr<flexfec::Encoder> fecEncoder_;
+    std::atomic<uint8_t> fecSendPayloadType_ {0};
+    std::atomic<uint8_t> fecRecvPayloadType_ {0};
+    std::atomic<uint64_t> rtpPacketsRecovered_ {0};
+    // Of the demuxing thread
+    std::unique_ptr<flexfec::Decoder> fecDecoder_;
+    // Of the encoding thread
+    std::array<uint8_t, 2048> fecPacket_;
     bool getOneWayDelayGradient(float sendTS, bool marker, int32_t* gradient, int32_t* deltaR);
     bool parse_RTP_ext(uint8_t* buf, float* abs);
 
+    std::atomic<uint8_t> audioLevelSendId_ {0};
+    std::atomic<uint8_t> audioLevelRecvId_ {0};
+    std::atomic<uint8_t> sendAudioLevel_ {rtp_audio_level::SILENCE};
+    std::atomic<uint8_t> recvAudioLevel_ {rtp_audio_level::SILENCE};
+    std::atomic<clock::rep> recvAudioLevelTime_ {0};
+    // Packets extended with their audio level, from the encoding thread
+    std::array<uint8_t, 2048> extendedPacket_;
+
     std::list<rtcpRRHeader> listRtcpRRHeader_;
     std::list<rtcpREMBHeader> listRtcpREMBHeader_;
     std::mutex rtcpInfo_mutex_;
@@ -238,7 +582,6 @@ private:
     std::list<double> histoLatency_;
 
     time_point lastRR_time;
-    uint16_t lastSeqNumIn_ {0};
     float lastSendTS_ {0.0f};
     time_point lastReceiveTS_ {};
     time_point arrival_TS {};
@@ -20,54 +20,37 @@
  */
 
 #include <stdlib.h>
-#include <assert.h>
+#include <string.h>
 #include <libavutil/common.h>
 #include <libavutil/base64.h>
-#include <libavutil/aes.h>
-#include <libavutil/hmac.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/log.h>
+#include <nettle/ctr.h>
 #include "srtp.h"
 
 #include "security/memory.h"
 
+// RFC 7714
+#define GCM_TAG_SIZE  16
+#define GCM_SALT_SIZE 12
+
 void ff_srtp_free(struct SRTPContext *s)
 {
-    uint8_t zero_buffer[32] = {0}; // WARNING: must be long enough to handle any key length
-    assert(sizeof(zero_buffer) >= sizeof(s->master_key));
-    assert(sizeof(zero_buffer) >= sizeof(s->rtp_key));
-    assert(sizeof(zero_buffer) >= sizeof(s->rtp_auth));
-
     if (!s)
         return;
-    // aes and hmac have an opaque pointer type.
-    // No API to safely erase them, so just re-init with "dummy keys" to sanitize them
-    if (s->aes) {
-        av_aes_init(s->aes, zero_buffer, 128, 0);
-        av_freep(&s->aes);
-    }
-    if (s->hmac) {
-        av_hmac_init(s->hmac, zero_buffer, sizeof(s->rtp_auth));
-        av_hmac_free(s->hmac);
-    }
+    // The expanded keys live in the context
     ring_secure_memzero(s, sizeof(*s));
 }
 
-static void encrypt_counter(struct AVAES *aes, uint8_t *iv, uint8_t *outbuf,
-                            int outlen)
+static void encrypt_counter(const struct aes128_ctx *aes, uint8_t *iv,
+                            uint8_t *buf, int len)
 {
-    int i, j, outpos;
-    for (i = 0, outpos = 0; outpos < outlen; i++) {
-        uint8_t keystream[16];
-        AV_WB16(&iv[14], i);
-        av_aes_crypt(aes, keystream, iv, 1, NULL, 0);
-        for (j = 0; j < 16 && outpos < outlen; j++, outpos++)
-            outbuf[outpos] ^= keystream[j];
-    }
+    ctr_crypt(aes, (nettle_cipher_func *)aes128_encrypt, AES_BLOCK_SIZE,
+              iv, len, buf, buf);
 }
 
-static void derive_key(struct AVAES *aes, const uint8_t *salt, int label,
-                       uint8_t *out, int outlen)
+static void derive_key(const struct aes128_ctx *aes, const uint8_t *salt,
+                       int label, uint8_t *out, int outlen)
 {
     uint8_t input[16] = { 0 };
     memcpy(input, salt, 14);
@@ -80,7 +63,11 @@ static void derive_key(struct AVAES *aes, const uint8_t *salt, int label,
 int ff_srtp_set_crypto(struct SRTPContext *s, const char *suite,
                        const char *params)
 {
-    uint8_t buf[30];
+    // The master salt of AES-GCM is zero padded for the key derivation
+    uint8_t buf[30], master_salt[14] = { 0 }, key[20];
+    struct aes128_ctx master;
+    enum SRTPSuite srtp_suite = SRTP_SUITE_AES_CM;
+    int salt_size = 14;
 
     ff_srtp_free(s);
 
@@ -94,38 +81,59 @@ int ff_srtp_set_crypto(struct SRTPContext *s, const char *suite,
         // RFC 5764 section 4.1.2
         s->rtp_hmac_size  = 4;
         s->rtcp_hmac_size = 10;
+    } else if (!strcmp(suite, "AEAD_AES_128_GCM") ||
+               !strcmp(suite, "SRTP_AEAD_AES_128_GCM")) {
+        // RFC 7714 section 12
+        srtp_suite = SRTP_SUITE_AEAD_AES_128_GCM;
+        s->rtp_hmac_size = s->rtcp_hmac_size = GCM_TAG_SIZE;
+        salt_size = GCM_SALT_SIZE;
     } else {
         av_log(NULL, AV_LOG_WARNING, "SRTP Crypto suite %s not supported\n",
                                      suite);
         return AVERROR(EINVAL);
     }
-    if (av_base64_decode(buf, params, sizeof(buf)) != sizeof(buf)) {
+    if (av_base64_decode(buf, params, sizeof(buf)) != 16 + salt_size) {
         av_log(NULL, AV_LOG_WARNING, "Incorrect amount of SRTP params\n");
         ring_secure_memzero(buf, sizeof(buf));
         return AVERROR(EINVAL);
     }
     // MKI and lifetime not handled yet
-    s->aes  = av_aes_alloc();
-    s->hmac = av_hmac_alloc(AV_HMAC_SHA1);
-    if (!s->aes || !s->hmac)
-        return AVERROR(ENOMEM);
-    memcpy(s->master_key, buf, 16);
-    memcpy(s->master_salt, buf + 16, 14);
+    aes128_set_encrypt_key(&master, buf);
+    memcpy(master_salt, buf + 16, salt_size);
     ring_secure_memzero(buf, sizeof(buf));
 
     // RFC 3711
-    av_aes_init(s->aes, s->master_key, 128, 0);
-
-    derive_key(s->aes, s->master_salt, 0x00, s->rtp_key, sizeof(s->rtp_key));
-    derive_key(s->aes, s->master_salt, 0x02, s->rtp_salt, sizeof(s->rtp_salt));
-    derive_key(s->aes, s->master_salt, 0x01, s->rtp_auth, sizeof(s->rtp_auth));
+    if (srtp_suite == SRTP_SUITE_AES_CM) {
+        derive_key(&master, master_salt, 0x00, key, 16);
+        aes128_set_encrypt_key(&s->rtp_aes, key);
+        derive_key(&master, master_salt, 0x01, key, 20);
+        hmac_sha1_set_key(&s->rtp_hmac, 20, key);
+
+        derive_key(&master, master_salt, 0x03, key, 16);
+        aes128_set_encrypt_key(&s->rtcp_aes, key);
+        derive_key(&master, master_salt, 0x04, key, 20);
+        hmac_sha1_set_key(&s->rtcp_hmac, 20, key);
+    } else {
+        derive_key(&master, master_salt, 0x00, key, 16);
+        gcm_aes128_set_key(&s->rtp_gcm, key);
+        derive_key(&master, master_salt, 0x03, key, 16);
+        gcm_aes128_set_key(&s->rtcp_gcm, key);
+    }
+    derive_key(&master, master_salt, 0x02, s->rtp_salt, salt_size);
+    derive_key(&master, master_salt, 0x05, s->rtcp_salt, salt_size);
+    s->suite = srtp_suite;
 
-    derive_key(s->aes, s->master_salt, 0x03, s->rtcp_key, sizeof(s->rtcp_key));
-    derive_key(s->aes, s->master_salt, 0x05, s->rtcp_salt, sizeof(s->rtcp_salt));
-    derive_key(s->aes, s->master_salt, 0x04, s->rtcp_auth, sizeof(s->rtcp_auth));
+    ring_secure_memzero(key, sizeof(key));
+    ring_secure_memzero(master_salt, sizeof(master_salt));
+    ring_secure_memzero(&master, sizeof(master));
     return 0;
 }
 
+int ff_srtp_overhead(const struct SRTPContext *s)
+{
+    return s->suite == SRTP_SUITE_NONE ? 0 : s->rtp_hmac_size;
+}
+
 static void create_iv(uint8_t *iv, const uint8_t *salt, uint64_t index,
                       uint32_t ssrc)
 {
@@ -141,40 +149,89 @@ static void create_iv(uint8_t *iv, const uint8_t *salt, uint64_t index,
     ring_secure_memzero(indexbuf, sizeof(indexbuf));
 }
 
+/*
+ * RFC 7714 sections 8.1 and 9.1: 00 00 | SSRC | ROC | SEQ for RTP,
+ * 00 00 | SSRC | 00 00 | SRTCP index for RTCP, XORed with the salt
+ */
+static void create_gcm_iv(uint8_t *iv, const uint8_t *salt, uint64_t index,
+                          uint32_t ssrc)
+{
+    int i;
+    AV_WB16(&iv[0], 0);
+    AV_WB32(&iv[2], ssrc);
+    AV_WB16(&iv[6], index >> 32);
+    AV_WB32(&iv[8], index);
+    for (i = 0; i < GCM_SALT_SIZE; i++)
+        iv[i] ^= salt[i];
+}
+
+/*
+ * Size of the RTP header, with the CSRCs and the extension
+ */
+static int rtp_header_size(const uint8_t *buf, int len)
+{
+    int size = 12 + 4 * (buf[0] & 0x0f);
+    if (len < size)
+        return AVERROR_INVALIDDATA;
+    if (buf[0] & 0x10) {
+        if (len < size + 4)
+            return AVERROR_INVALIDDATA;
+        size += (AV_RB16(buf + size + 2) + 1) * 4;
+        if (len < size)
+            return AVERROR_INVALIDDATA;
+    }
+    return size;
+}
+
+/*
+ * In constant time, not to leak how much of a forged tag is right
+ */
+static int tag_equal(const uint8_t *a, const uint8_t *b, int size)
+{
+    uint8_t diff = 0;
+    int i;
+    for (i = 0; i < size; i++)
+        diff |= a[i] ^ b[i];
+    return !diff;
+}
+
 int ff_srtp_decrypt(struct SRTPContext *s, uint8_t *buf, int *lenptr)
 {
-    uint8_t iv[16] = { 0 }, hmac[20];
+    uint8_t iv[16] = { 0 }, hmac[20], tag[20];
     int len = *lenptr;
-#ifdef _MSC_VER
-#pragma message (__FILE__ "(" STR2(__LINE__) ") : -NOTE- " seq_largest and roc may be unitialized)
-#else
-#warning seq_largest and roc may be unitialized
-#endif
-    int av_uninit(seq_largest);
-    uint32_t ssrc, av_uninit(roc);
+    int seq_largest = 0, hdr, encrypted = 1;
+    uint32_t ssrc, roc = 0, v = 0, srtcp_index = 0;
     uint64_t index;
     int rtcp, hmac_size;
+    int gcm = s->suite == SRTP_SUITE_AEAD_AES_128_GCM;
 
     // TODO: Missing replay protection
 
+    if (s->suite == SRTP_SUITE_NONE)
+        return AVERROR(EINVAL);
     if (len < 2)
         return AVERROR_INVALIDDATA;
 
     rtcp = RTP_PT_IS_RTCP(buf[1]);
     hmac_size = rtcp ? s->rtcp_hmac_size : s->rtp_hmac_size;
 
-    if (len < hmac_size)
+    // At least the 12 bytes of the RTP header, or the 8 of the RTCP one and the SRTCP index
+    if (len < hmac_size + 12)
         return AVERROR_INVALIDDATA;
 
-    // Authentication HMAC
-    av_hmac_init(s->hmac, rtcp ? s->rtcp_auth : s->rtp_auth, sizeof(s->rtp_auth));
-    // If MKI is used, this should exclude the MKI as well
-    av_hmac_update(s->hmac, buf, len - hmac_size);
+    if (rtcp) {
+        // RFC 3711 appends the tag to the SRTCP index, RFC 7714 the index to the tag
+        const uint8_t *index_word = gcm ? buf + len - 4 : buf + len - hmac_size - 4;
+        srtcp_index = AV_RB32(index_word);
+        memcpy(tag, gcm ? buf + len - 4 - hmac_size : buf + len - hmac_size, hmac_size);
 
-    if (!rtcp) {
+        ssrc = AV_RB32(buf + 4);
+        index = srtcp_index & 0x7fffffff;
+        encrypted = srtcp_index >> 31;
+        hdr = 8;
+    } else {
         int seq = AV_RB16(buf + 2);
-        uint32_t v;
-        uint8_t rocbuf[4];
+        memcpy(tag, buf + len - hmac_size, hmac_size);
 
         // RFC 3711 section 3.3.1, appendix A
         seq_largest = s->seq_initialized ? s->seq_largest : seq;
@@ -194,155 +251,167 @@ int ff_srtp_decrypt(struct SRTPContext *s, uint8_t *buf, int *lenptr)
         }
         index = seq + (((uint64_t)v) << 16);
 
-        AV_WB32(rocbuf, roc);
-        av_hmac_update(s->hmac, rocbuf, 4);
-    }
-
-    av_hmac_final(s->hmac, hmac, sizeof(hmac));
-    if (memcmp(hmac, buf + len - hmac_size, hmac_size)) {
-        av_log(NULL, AV_LOG_WARNING, "HMAC mismatch\n");
-        return AVERROR_INVALIDDATA;
+        ssrc = AV_RB32(buf + 8);
+        hdr = rtp_header_size(buf, len - hmac_size);
+        if (hdr < 0)
+            return hdr;
     }
 
-    len -= hmac_size;
-    *lenptr = len;
-
-    if (len < 12)
-        return AVERROR_INVALIDDATA;
-
-    if (rtcp) {
-        uint32_t srtcp_index = AV_RB32(buf + len - 4);
-        len -= 4;
-        *lenptr = len;
+    if (gcm) {
+        struct gcm_aes128_ctx *ctx = rtcp ? &s->rtcp_gcm : &s->rtp_gcm;
+        len -= hmac_size + (rtcp ? 4 : 0);
 
-        ssrc = AV_RB32(buf + 4);
-        index = srtcp_index & 0x7fffffff;
-
-        buf += 8;
-        len -= 8;
-        if (!(srtcp_index & 0x80000000))
-            return 0;
+        create_gcm_iv(iv, rtcp ? s->rtcp_salt : s->rtp_salt, index, ssrc);
+        gcm_aes128_set_iv(ctx, GCM_SALT_SIZE, iv);
+        if (rtcp && !encrypted) {
+            // RFC 7714 section 9.3: the whole packet is authenticated, then the index
+            AV_WB32(buf + len, srtcp_index);
+            gcm_aes128_update(ctx, len + 4, buf);
+        } else {
+            if (rtcp) {
+                uint8_t aad[12];
+                memcpy(aad, buf, 8);
+                AV_WB32(aad + 8, srtcp_index);
+                gcm_aes128_update(ctx, sizeof(aad), aad);
+            } else {
+                gcm_aes128_update(ctx, hdr, buf);
+            }
+            gcm_aes128_decrypt(ctx, len - hdr, buf + hdr, buf + hdr);
+        }
+        gcm_aes128_digest(ctx, hmac_size, hmac);
+        if (!tag_equal(hmac, tag, hmac_size)) {
+            av_log(NULL, AV_LOG_WARNING, "GCM tag mismatch\n");
+            if (encrypted)
+                ring_secure_memzero(buf + hdr, len - hdr);
+            return AVERROR_INVALIDDATA;
+        }
     } else {
-        int ext, csrc;
-        s->seq_initialized = 1;
-        s->seq_largest     = seq_largest;
-        s->roc             = roc;
-
-        csrc = buf[0] & 0x0f;
-        ext  = buf[0] & 0x10;
-        ssrc = AV_RB32(buf + 8);
-
-        buf += 12;
-        len -= 12;
-
-        buf += 4 * csrc;
-        len -= 4 * csrc;
-        if (len < 0)
+        struct hmac_sha1_ctx *ctx = rtcp ? &s->rtcp_hmac : &s->rtp_hmac;
+        len -= hmac_size;
+
+        // Authentication HMAC
+        // If MKI is used, this should exclude the MKI as well
+        hmac_sha1_update(ctx, len, buf);
+        if (!rtcp) {
+            uint8_t rocbuf[4];
+            AV_WB32(rocbuf, v);
+            hmac_sha1_update(ctx, 4, rocbuf);
+        }
+        // Back to the keyed state for the next packet
+        hmac_sha1_digest(ctx, hmac_size, hmac);
+        if (!tag_equal(hmac, tag, hmac_size)) {
+            av_log(NULL, AV_LOG_WARNING, "HMAC mismatch\n");
             return AVERROR_INVALIDDATA;
+        }
+        if (rtcp)
+            len -= 4;
 
-        if (ext) {
-            if (len < 4)
-                return AVERROR_INVALIDDATA;
-            ext = (AV_RB16(buf + 2) + 1) * 4;
-            if (len < ext)
-                return AVERROR_INVALIDDATA;
-            len -= ext;
-            buf += ext;
+        if (encrypted) {
+            create_iv(iv, rtcp ? s->rtcp_salt : s->rtp_salt, index, ssrc);
+            encrypt_counter(rtcp ? &s->rtcp_aes : &s->rtp_aes, iv, buf + hdr, len - hdr);
         }
     }
 
-    create_iv(iv, rtcp ? s->rtcp_salt : s->rtp_salt, index, ssrc);
-    av_aes_init(s->aes, rtcp ? s->rtcp_key : s->rtp_key, 128, 0);
-    encrypt_counter(s->aes, iv, buf, len);
-
+    if (!rtcp) {
+        s->seq_initialized = 1;
+        s->seq_largest     = seq_largest;
+        s->roc             = roc;
+    }
+    *lenptr = len;
     return 0;
 }
 
-int ff_srtp_encrypt(struct SRTPContext *s, const uint8_t *in, int len,
-                    uint8_t *out, int outlen)
+int ff_srtp_protect(struct SRTPContext *s, uint8_t *buf, int len, int size)
 {
-    uint8_t iv[16] = { 0 }, hmac[20];
+    uint8_t iv[16] = { 0 };
     uint64_t index;
     uint32_t ssrc;
-    int rtcp, hmac_size, padding;
-    uint8_t *buf;
+    int rtcp, hmac_size, padding, hdr;
 
+    if (s->suite == SRTP_SUITE_NONE)
+        return AVERROR(EINVAL);
     if (len < 8)
         return AVERROR_INVALIDDATA;
 
-    rtcp = RTP_PT_IS_RTCP(in[1]);
+    rtcp = RTP_PT_IS_RTCP(buf[1]);
     hmac_size = rtcp ? s->rtcp_hmac_size : s->rtp_hmac_size;
     padding = hmac_size;
     if (rtcp)
         padding += 4; // For the RTCP index
 
-    if (len + padding > outlen)
+    if (len + padding > size)
         return 0;
 
-    memcpy(out, in, len);
-    buf = out;
-
     if (rtcp) {
         ssrc = AV_RB32(buf + 4);
-        index = s->rtcp_index++;
-
-        buf += 8;
-        len -= 8;
+        index = s->rtcp_index++ & 0x7fffffff;
+        hdr = 8;
     } else {
-        int ext, csrc;
-        int seq = AV_RB16(buf + 2);
+        int seq;
 
-        if (len < 12)
-            return AVERROR_INVALIDDATA;
+        hdr = rtp_header_size(buf, len);
+        if (hdr < 0)
+            return hdr;
 
+        seq = AV_RB16(buf + 2);
         ssrc = AV_RB32(buf + 8);
 
         if (seq < s->seq_largest)
             s->roc++;
         s->seq_largest = seq;
         index = seq + (((uint64_t)s->roc) << 16);
+    }
 
-        csrc = buf[0] & 0x0f;
-        ext = buf[0] & 0x10;
-
-        buf += 12;
-        len -= 12;
+    if (s->suite == SRTP_SUITE_AEAD_AES_128_GCM) {
+        struct gcm_aes128_ctx *ctx = rtcp ? &s->rtcp_gcm : &s->rtp_gcm;
 
-        buf += 4 * csrc;
-        len -= 4 * csrc;
-        if (len < 0)
-            return AVERROR_INVALIDDATA;
-
-        if (ext) {
-            if (len < 4)
-                return AVERROR_INVALIDDATA;
-            ext = (AV_RB16(buf + 2) + 1) * 4;
-            if (len < ext)
-                return AVERROR_INVALIDDATA;
-            len -= ext;
-            buf += ext;
+        create_gcm_iv(iv, rtcp ? s->rtcp_salt : s->rtp_salt, index, ssrc);
+        gcm_aes128_set_iv(ctx, GCM_SALT_SIZE, iv);
+        if (rtcp) {
+            uint8_t aad[12];
+            memcpy(aad, buf, 8);
+            AV_WB32(aad + 8, 0x80000000 | index);
+            gcm_aes128_update(ctx, sizeof(aad), aad);
+        } else {
+            gcm_aes128_update(ctx, hdr, buf);
+        }
+        gcm_aes128_encrypt(ctx, len - hdr, buf + hdr, buf + hdr);
+        gcm_aes128_digest(ctx, hmac_size, buf + len);
+        len += hmac_size;
+        if (rtcp) {
+            AV_WB32(buf + len, 0x80000000 | index);
+            len += 4;
         }
+        return len;
     }
 
     create_iv(iv, rtcp ? s->rtcp_salt : s->rtp_salt, index, ssrc);
-    av_aes_init(s->aes, rtcp ? s->rtcp_key : s->rtp_key, 128, 0);
-    encrypt_counter(s->aes, iv, buf, len);
+    encrypt_counter(rtcp ? &s->rtcp_aes : &s->rtp_aes, iv, buf + hdr, len - hdr);
 
     if (rtcp) {
         AV_WB32(buf + len, 0x80000000 | index);
         len += 4;
     }
 
-    av_hmac_init(s->hmac, rtcp ? s->rtcp_auth : s->rtp_auth, sizeof(s->rtp_auth));
-    av_hmac_update(s->hmac, out, buf + len - out);
-    if (!rtcp) {
-        uint8_t rocbuf[4];
-        AV_WB32(rocbuf, s->roc);
-        av_hmac_update(s->hmac, rocbuf, 4);
+    {
+        struct hmac_sha1_ctx *ctx = rtcp ? &s->rtcp_hmac : &s->rtp_hmac;
+        hmac_sha1_update(ctx, len, buf);
+        if (!rtcp) {
+            uint8_t rocbuf[4];
+            AV_WB32(rocbuf, s->roc);
+            hmac_sha1_update(ctx, 4, rocbuf);
+        }
+        // Truncated tag, back to the keyed state for the next packet
+        hmac_sha1_digest(ctx, hmac_size, buf + len);
     }
-    av_hmac_final(s->hmac, hmac, sizeof(hmac));
+    return len + hmac_size;
+}
 
-    memcpy(buf + len, hmac, hmac_size);
-    len += hmac_size;
-    return buf + len - out;
+int ff_srtp_encrypt(struct SRTPContext *s, const uint8_t *in, int len,
+                    uint8_t *out, int outlen)
+{
+    if (len > outlen)
+        return 0;
+    memcpy(out, in, len);
+    return ff_srtp_protect(s, out, len, outlen);
 }
@@ -24,19 +24,32 @@
 
 #include <stdint.h>
 
-struct AVAES;
-struct AVHMAC;
+#include <nettle/aes.h>
+#include <nettle/gcm.h>
+#include <nettle/hmac.h>
 
+enum SRTPSuite {
+    SRTP_SUITE_NONE = 0,
+    // RFC 3711, AES-CM with HMAC-SHA1
+    SRTP_SUITE_AES_CM,
+    // RFC 7714
+    SRTP_SUITE_AEAD_AES_128_GCM,
+};
+
+/*
+ * The session keys are expanded once, when set, rather than for each packet, so that the
+ * AES-NI or ARMv8 code of nettle only encrypts the packets.
+ */
 struct SRTPContext
 {
-    struct AVAES* aes;
-    struct AVHMAC* hmac;
+    enum SRTPSuite suite;
+    // Size of the authentication tag
     int rtp_hmac_size, rtcp_hmac_size;
-    uint8_t master_key[16];
-    uint8_t master_salt[14];
-    uint8_t rtp_key[16], rtcp_key[16];
+    struct aes128_ctx rtp_aes, rtcp_aes;
+    struct hmac_sha1_ctx rtp_hmac, rtcp_hmac;
+    struct gcm_aes128_ctx rtp_gcm, rtcp_gcm;
+    // 14 bytes for AES-CM, 12 for AES-GCM
     uint8_t rtp_salt[14], rtcp_salt[14];
-    uint8_t rtp_auth[20], rtcp_auth[20];
     int seq_largest, seq_initialized;
     uint32_t roc;
 
@@ -45,8 +58,16 @@ struct SRTPContext
 
 int ff_srtp_set_crypto(struct SRTPContext* s, const char* suite, const char* params);
 void ff_srtp_free(struct SRTPContext* s);
+/* Decrypts a packet in place, *lenptr being set to the length of the plain packet */
 int ff_srtp_decrypt(struct SRTPContext* s, uint8_t* buf, int* lenptr);
 int ff_srtp_encrypt(struct SRTPContext* s, const uint8_t* in, int len, uint8_t* out, int outlen);
+/*
+ * Encrypts a packet in place, buf having room for size bytes.
+ * Returns the length of the protected packet, 0 if it doesn't fit, or a negative error code.
+ */
+int ff_srtp_protect(struct SRTPContext* s, uint8_t* buf, int len, int size);
+/* Bytes appended to an RTP packet when protected */
+int ff_srtp_overhead(const struct SRTPContext* s);
 
 /* RTCP packet types */
 enum RTCPType { RTCP_FIR = 192, RTCP_IJ = 195, RTCP_SR = 200, RTCP_TOKEN = 210, RTCP_REMB = 206 };
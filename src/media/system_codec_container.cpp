@@ -91,6 +91,16 @@ SystemCodecContainer::initCodecConfig()
                                                defaultBitrate,
                                                minVP8,
                                                maxVP8),
+
+        std::make_shared<SystemVideoCodecInfo>(AV_CODEC_ID_VP9,
+                                               AV_CODEC_ID_VP9,
+                                               "VP9",
+                                               "VP9",
+                                               "libvpx-vp9",
+                                               CODEC_ENCODER_DECODER,
+                                               defaultBitrate,
+                                               minVP8,
+                                               maxVP8),
 #if !(defined(TARGET_OS_IOS) && TARGET_OS_IOS)
         std::make_shared<SystemVideoCodecInfo>(AV_CODEC_ID_MPEG4,
                                                AV_CODEC_ID_MPEG4,
@@ -20,6 +20,13 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <tuple>
 
 #include "media_buffer.h"
 #include "string_utils.h"
@@ -27,6 +34,14 @@
 #include "logger.h"
 #include "accel.h"
 #include "config.h"
+#include "manager.h"
+
+#include <opendht/thread_pool.h>
+
+extern "C" {
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+}
 
 namespace jami {
 namespace video {
@@ -55,7 +70,8 @@ static std::list<HardwareAPI> apiListDec = {
      AV_HWDEVICE_TYPE_VAAPI,
      AV_PIX_FMT_VAAPI,
      AV_PIX_FMT_NV12,
-     {AV_CODEC_ID_H264, AV_CODEC_ID_MPEG4, AV_CODEC_ID_VP8},
+     // MJPEG for the cameras, their frames then passed to a VAAPI encoder without copy
+     {AV_CODEC_ID_H264, AV_CODEC_ID_MPEG4, AV_CODEC_ID_VP8, AV_CODEC_ID_MJPEG},
      {{"default", DeviceState::NOT_TESTED}, {"/dev/dri/renderD128", DeviceState::NOT_TESTED},
       {"/dev/dri/renderD129", DeviceState::NOT_TESTED}, {":0", DeviceState::NOT_TESTED}},
      false},
@@ -116,6 +132,67 @@ static std::list<HardwareAPI> apiListEnc = {
     // false},
 };
 
+// Length of the clip encoded by benchmark()
+static constexpr int BENCHMARK_FRAMES {30};
+// Slower than real time, the encoder is no use for calls
+static constexpr double MIN_BENCHMARK_FPS {30.};
+
+// Frames per second, by codec, API (and so device), width and height
+static std::mutex benchmarkMutex;
+static std::map<std::tuple<AVCodecID, std::string, int, int>, double> benchmarks;
+// Measured in the background meanwhile
+static std::set<std::tuple<AVCodecID, std::string, int, int>> benchmarksRunning;
+
+// Opening a device takes long enough to stall a renegotiation, so a released one is kept
+// open for the next accelerator of the same type and device
+static constexpr auto WARM_DEVICE_TIMEOUT = std::chrono::seconds(10);
+
+struct WarmDevice
+{
+    AVBufferRef* ctx {nullptr};
+    std::chrono::steady_clock::time_point released {};
+};
+static std::mutex warmDevicesMutex;
+static std::map<std::pair<AVHWDeviceType, std::string>, WarmDevice> warmDevices;
+
+// Close the devices nobody took back in time, called with warmDevicesMutex held
+static void
+purgeWarmDevices()
+{
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = warmDevices.begin(); it != warmDevices.end();) {
+        auto& warm = it->second;
+        if (av_buffer_get_ref_count(warm.ctx) == 1
+            && now - warm.released >= WARM_DEVICE_TIMEOUT) {
+            JAMI_DBG("Closing unused %s device", av_hwdevice_get_type_name(it->first.first));
+            av_buffer_unref(&warm.ctx);
+            it = warmDevices.erase(it);
+        } else
+            ++it;
+    }
+}
+
+static void
+releaseDevice(AVBufferRef** deviceCtx)
+{
+    std::lock_guard<std::mutex> lk(warmDevicesMutex);
+    bool warm = false;
+    for (auto& device : warmDevices) {
+        if (device.second.ctx->data == (*deviceCtx)->data) {
+            device.second.released = std::chrono::steady_clock::now();
+            warm = true;
+        }
+    }
+    av_buffer_unref(deviceCtx);
+    if (warm)
+        Manager::instance().scheduler().scheduleIn(
+            [] {
+                std::lock_guard<std::mutex> lk(warmDevicesMutex);
+                purgeWarmDevices();
+            },
+            WARM_DEVICE_TIMEOUT);
+}
+
 HardwareAccel::HardwareAccel(AVCodecID id,
                              const std::string& name,
                              AVHWDeviceType hwType,
@@ -134,10 +211,11 @@ HardwareAccel::HardwareAccel(AVCodecID id,
 
 HardwareAccel::~HardwareAccel()
 {
-    if (deviceCtx_)
-        av_buffer_unref(&deviceCtx_);
+    // The frames hold a reference to the device
     if (framesCtx_)
         av_buffer_unref(&framesCtx_);
+    if (deviceCtx_)
+        releaseDevice(&deviceCtx_);
 }
 
 static AVPixelFormat
@@ -163,6 +241,19 @@ int
 HardwareAccel::init_device(const char* name, const char* device, int flags)
 {
     const AVHWDeviceContext* dev = nullptr;
+    std::lock_guard<std::mutex> lk(warmDevicesMutex);
+    purgeWarmDevices();
+
+    // An idle device is taken back, one in use is left to its accelerator
+    auto key = std::make_pair(hwType_, std::string(device ? device : ""));
+    auto warm = warmDevices.find(key);
+    if (warm != warmDevices.end() && av_buffer_get_ref_count(warm->second.ctx) == 1) {
+        deviceCtx_ = av_buffer_ref(warm->second.ctx);
+        if (deviceCtx_) {
+            JAMI_DBG("Reusing %s device", name);
+            return 0;
+        }
+    }
 
     // Create device ctx
     int err;
@@ -181,6 +272,10 @@ HardwareAccel::init_device(const char* name, const char* device, int flags)
     }
     JAMI_DBG("Device type %s successfully created.", name);
 
+    if (warm == warmDevices.end() && flags == 0) {
+        if (auto ref = av_buffer_ref(deviceCtx_))
+            warmDevices.emplace(key, WarmDevice {ref, std::chrono::steady_clock::now()});
+    }
     return 0;
 }
 
@@ -422,6 +517,129 @@ HardwareAccel::initAPI(bool linkable, AVBufferRef* framesCtx)
     return -1;
 }
 
+double
+HardwareAccel::measureEncoding()
+{
+    auto codec = avcodec_find_encoder_by_name(getCodecName().c_str());
+    if (!codec || width_ <= 0 || height_ <= 0 || initAPI(false, nullptr) < 0)
+        return 0;
+
+    // videotoolbox takes software frames, the others are uploaded by transfer()
+    bool upload = hwType_ != AV_HWDEVICE_TYPE_VIDEOTOOLBOX;
+    AVCodecContext* encoderCtx = avcodec_alloc_context3(codec);
+    if (!encoderCtx)
+        return 0;
+    encoderCtx->width = width_;
+    encoderCtx->height = height_;
+    encoderCtx->framerate = {30, 1};
+    encoderCtx->time_base = av_inv_q(encoderCtx->framerate);
+    encoderCtx->pix_fmt = upload ? format_ : swFormat_;
+    encoderCtx->max_b_frames = 0;
+    encoderCtx->bit_rate = SystemCodecInfo::DEFAULT_VIDEO_BITRATE * 1000;
+    encoderCtx->opaque = this;
+    setDetails(encoderCtx);
+    if (avcodec_open2(encoderCtx, codec, nullptr) < 0) {
+        avcodec_free_context(&encoderCtx);
+        return 0;
+    }
+
+    VideoFrame input;
+    input.reserve(swFormat_, width_, height_);
+    auto frame = input.pointer();
+    for (int i = 1; i < AV_NUM_DATA_POINTERS && frame->data[i]; ++i)
+        std::memset(frame->data[i], 128, frame->linesize[i] * ((height_ + 1) / 2));
+
+    auto pkt = av_packet_alloc();
+    int encoded = 0;
+    std::chrono::steady_clock::duration elapsed {};
+    auto receive = [&] {
+        while (avcodec_receive_packet(encoderCtx, pkt) == 0) {
+            ++encoded;
+            av_packet_unref(pkt);
+        }
+    };
+    for (int i = 0; i <= BENCHMARK_FRAMES; ++i) {
+        // Moving gradient, so the frames don't encode to nothing
+        for (int y = 0; y < height_; ++y)
+            for (int x = 0; x < width_; ++x)
+                frame->data[0][y * frame->linesize[0] + x] = x + y + 4 * i;
+        frame->pts = i;
+
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<VideoFrame> hwFrame;
+        if (i < BENCHMARK_FRAMES && upload && !(hwFrame = transfer(input)))
+            break;
+        // The last one flushes the encoder
+        auto sent = i < BENCHMARK_FRAMES ? (upload ? hwFrame->pointer() : frame) : nullptr;
+        if (avcodec_send_frame(encoderCtx, sent) < 0)
+            break;
+        receive();
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+    av_packet_free(&pkt);
+    avcodec_free_context(&encoderCtx);
+
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    if (encoded < BENCHMARK_FRAMES / 2 || seconds <= 0)
+        return 0;
+    return encoded / seconds;
+}
+
+std::optional<double>
+HardwareAccel::benchmark() const
+{
+    auto key = std::make_tuple(id_, name_, width_, height_);
+    {
+        std::lock_guard<std::mutex> lk(benchmarkMutex);
+        auto it = benchmarks.find(key);
+        if (it != benchmarks.end())
+            return it->second;
+        if (not benchmarksRunning.emplace(key).second)
+            return std::nullopt;
+    }
+
+    // Not in the setup of the encoder, that would wait for it. With its own copy of the
+    // states of the devices, the list is shared with the encoders
+    dht::ThreadPool::computation().run([key,
+                                        id = id_,
+                                        name = name_,
+                                        hwType = hwType_,
+                                        format = format_,
+                                        swFormat = swFormat_,
+                                        type = type_,
+                                        dynBitrate = dynBitrate_,
+                                        width = width_,
+                                        height = height_,
+                                        devices = *possible_devices_]() mutable {
+        // Measured with its own device, the one of the accelerator is left to the encoder
+        HardwareAccel probe(id, name, hwType, format, swFormat, type, dynBitrate);
+        probe.width_ = width;
+        probe.height_ = height;
+        probe.possible_devices_ = &devices;
+        auto fps = probe.measureEncoding();
+        JAMI_DBG("[accel] %s encodes %dx%d at %.0f fps",
+                 probe.getCodecName().c_str(),
+                 width,
+                 height,
+                 fps);
+        if (fps < MIN_BENCHMARK_FPS)
+            fps = 0;
+        std::lock_guard<std::mutex> lk(benchmarkMutex);
+        benchmarksRunning.erase(key);
+        // Unless it failed meanwhile
+        benchmarks.emplace(key, fps);
+    });
+    return std::nullopt;
+}
+
+void
+HardwareAccel::markFailed() const
+{
+    JAMI_WARN("[accel] Not using %s at %dx%d anymore", getCodecName().c_str(), width_, height_);
+    std::lock_guard<std::mutex> lk(benchmarkMutex);
+    benchmarks[std::make_tuple(id_, name_, width_, height_)] = 0;
+}
+
 std::list<HardwareAccel>
 HardwareAccel::getCompatibleAccel(AVCodecID id, int width, int height, CodecType type)
 {
@@ -448,8 +666,143 @@ HardwareAccel::getCompatibleAccel(AVCodecID id, int width, int height, CodecType
             }
         }
     }
+    if (type == CODEC_ENCODER) {
+        std::map<const HardwareAccel*, std::optional<double>> fps;
+        for (const auto& accel : l)
+            fps[&accel] = accel.benchmark();
+        l.remove_if([&](const HardwareAccel& accel) {
+            const auto& f = fps[&accel];
+            return f and *f == 0;
+        });
+        // Stable: those not measured yet stay in the order of the API table, after the others
+        l.sort([&](const HardwareAccel& a, const HardwareAccel& b) {
+            const auto &fa = fps[&a], &fb = fps[&b];
+            return fa and (not fb or *fa > *fb);
+        });
+    }
     return l;
 }
 
+HardwareScaler::~HardwareScaler()
+{
+    reset();
+}
+
+static const AVFilter*
+scaleFilter(const AVFrame* frame)
+{
+    if (!frame->hw_frames_ctx)
+        return nullptr;
+    auto frames = reinterpret_cast<const AVHWFramesContext*>(frame->hw_frames_ctx->data);
+    const char* name = nullptr;
+    switch (frames->device_ctx->type) {
+    case AV_HWDEVICE_TYPE_VAAPI:
+        name = "scale_vaapi";
+        break;
+    case AV_HWDEVICE_TYPE_CUDA:
+        name = "scale_cuda";
+        break;
+    case AV_HWDEVICE_TYPE_QSV:
+        name = "scale_qsv";
+        break;
+    default:
+        break;
+    }
+    // Not every build of FFmpeg has them
+    return name ? avfilter_get_by_name(name) : nullptr;
+}
+
+bool
+HardwareScaler::canScale(const VideoFrame& frame)
+{
+    return scaleFilter(frame.pointer()) != nullptr;
+}
+
+void
+HardwareScaler::reset()
+{
+    // Frees the filters
+    avfilter_graph_free(&graph_);
+    source_ = nullptr;
+    sink_ = nullptr;
+    if (inputFrames_)
+        av_buffer_unref(&inputFrames_);
+}
+
+bool
+HardwareScaler::init(const AVFrame* input, int width, int height, AVPixelFormat format)
+{
+    reset();
+    auto filter = scaleFilter(input);
+    if (!filter || !(graph_ = avfilter_graph_alloc()))
+        return false;
+
+    int ret = AVERROR(ENOMEM);
+    AVFilterContext* scale = nullptr;
+    auto args = fmt::format("w={}:h={}", width, height);
+    if (format != AV_PIX_FMT_NONE)
+        args += fmt::format(":format={}", av_get_pix_fmt_name(format));
+    source_ = avfilter_graph_alloc_filter(graph_, avfilter_get_by_name("buffer"), "in");
+    if (auto params = source_ ? av_buffersrc_parameters_alloc() : nullptr) {
+        params->format = input->format;
+        params->width = input->width;
+        params->height = input->height;
+        // Timestamps are kept by scale()
+        params->time_base = {1, 1000};
+        params->hw_frames_ctx = input->hw_frames_ctx;
+        ret = av_buffersrc_parameters_set(source_, params);
+        av_free(params);
+    }
+    if (ret < 0 || (ret = avfilter_init_str(source_, nullptr)) < 0
+        || (ret = avfilter_graph_create_filter(
+                &scale, filter, "scale", args.c_str(), nullptr, graph_))
+               < 0
+        || (ret = avfilter_graph_create_filter(
+                &sink_, avfilter_get_by_name("buffersink"), "out", nullptr, nullptr, graph_))
+               < 0
+        || (ret = avfilter_link(source_, 0, scale, 0)) < 0
+        || (ret = avfilter_link(scale, 0, sink_, 0)) < 0
+        || (ret = avfilter_graph_config(graph_, nullptr)) < 0) {
+        JAMI_WARN("Failed to set up %s: %s", filter->name, libav_utils::getError(ret).c_str());
+        reset();
+        return false;
+    }
+
+    inputFrames_ = av_buffer_ref(input->hw_frames_ctx);
+    inputWidth_ = input->width;
+    inputHeight_ = input->height;
+    width_ = width;
+    height_ = height;
+    format_ = format;
+    JAMI_DBG("Scaling %dx%d with %s=%s", inputWidth_, inputHeight_, filter->name, args.c_str());
+    return true;
+}
+
+std::unique_ptr<VideoFrame>
+HardwareScaler::scale(const VideoFrame& frame, int width, int height, AVPixelFormat format)
+{
+    auto input = frame.pointer();
+    if (!input->hw_frames_ctx)
+        return {};
+    if (!graph_ || !inputFrames_ || inputFrames_->data != input->hw_frames_ctx->data
+        || inputWidth_ != input->width || inputHeight_ != input->height || width_ != width
+        || height_ != height || format_ != format) {
+        if (!init(input, width, height, format))
+            return {};
+    }
+
+    auto output = std::make_unique<VideoFrame>();
+    int ret = av_buffersrc_add_frame_flags(source_, input, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (ret >= 0)
+        ret = av_buffersink_get_frame(sink_, output->pointer());
+    if (ret < 0) {
+        JAMI_ERR("Failed to scale on the device: %s", libav_utils::getError(ret).c_str());
+        reset();
+        return {};
+    }
+    output->pointer()->pts = input->pts;
+    return output;
+}
+
 } // namespace video
 } // namespace jami
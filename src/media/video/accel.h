@@ -25,6 +25,7 @@
 #include "media_codec.h"
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 #include <list>
@@ -122,6 +123,14 @@ public:
      */
     bool isLinked() const { return linked_; }
 
+    /**
+     * @brief If linked to the frames context, so its frames are encoded as they are.
+     */
+    bool isLinkedTo(const AVBufferRef* framesCtx) const
+    {
+        return linked_ && framesCtx_ && framesCtx && framesCtx_->data == framesCtx->data;
+    }
+
     /**
      * @brief Set some extra details in the codec context.
      *
@@ -153,6 +162,13 @@ public:
      */
     bool linkHardware(AVBufferRef* framesCtx);
 
+    /**
+     * @brief Lists the accelerators of the codec.
+     *
+     * Encoders are sorted from the fastest measured by benchmark(), without
+     * the ones that can't encode at this resolution. Those not measured yet
+     * come last, in the order of the API table.
+     */
     static std::list<HardwareAccel> getCompatibleAccel(AVCodecID id,
                                                        int width,
                                                        int height,
@@ -160,9 +176,27 @@ public:
     int initAPI(bool linkable, AVBufferRef* framesCtx);
     bool dynBitrate() { return dynBitrate_; }
 
+    /**
+     * @brief Measures the encoding speed, in frames per second.
+     *
+     * Encodes a short synthetic clip at the resolution of the accelerator, in
+     * the background on the first call. Measured once per codec, API and
+     * resolution, then cached. Decoders are not measured: they already fall
+     * back to software when they fail to open.
+     *
+     * @returns 0 if the accelerator can't encode, nullopt until measured
+     */
+    std::optional<double> benchmark() const;
+
+    /**
+     * @brief Excludes the encoder from getCompatibleAccel after it failed mid-call.
+     */
+    void markFailed() const;
+
 private:
     bool initDevice(const std::string& device);
     bool initFrame();
+    double measureEncoding();
 
     AVCodecID id_ {AV_CODEC_ID_NONE};
     std::string name_;
@@ -184,5 +218,54 @@ private:
     std::list<std::pair<std::string, DeviceState>>* possible_devices_;
 };
 
+/**
+ * @brief Scales hardware frames on their device.
+ *
+ * A hardware decoded frame then reaches a hardware encoder at another resolution
+ * without being transferred to main memory. Not thread-safe.
+ */
+class HardwareScaler
+{
+public:
+    HardwareScaler() = default;
+    ~HardwareScaler();
+
+    /**
+     * @brief If the frame is on a device whose API has a scaling filter.
+     */
+    static bool canScale(const VideoFrame& frame);
+
+    /**
+     * @brief Scales a hardware frame, the output stays on the same device.
+     *
+     * The filter is set up again when the input frames context or a parameter changes.
+     *
+     * @param format    Software format of the output, AV_PIX_FMT_NONE for the one of the input
+     * @returns Hardware frame of width x height, nullptr on failure.
+     */
+    std::unique_ptr<VideoFrame> scale(const VideoFrame& frame,
+                                      int width,
+                                      int height,
+                                      AVPixelFormat format = AV_PIX_FMT_NONE);
+
+private:
+    HardwareScaler(const HardwareScaler&) = delete;
+    HardwareScaler& operator=(const HardwareScaler&) = delete;
+
+    bool init(const AVFrame* input, int width, int height, AVPixelFormat format);
+    void reset();
+
+    AVFilterGraph* graph_ {nullptr};
+    AVFilterContext* source_ {nullptr};
+    AVFilterContext* sink_ {nullptr};
+    // Of the input the graph is set up for
+    AVBufferRef* inputFrames_ {nullptr};
+    int inputWidth_ {0};
+    int inputHeight_ {0};
+    int width_ {0};
+    int height_ {0};
+    AVPixelFormat format_ {AV_PIX_FMT_NONE};
+};
+
 } // namespace video
 } // namespace jami
@@ -18,12 +18,125 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
  */
 
+#include "libav_deps.h" // MUST BE INCLUDED FIRST
 #include "filter_transpose.h"
 #include "logger.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace jami {
 namespace video {
 
+// Pixels rotated by square blocks, so that the rows read and written stay in cache
+static constexpr int BLOCK {32};
+
+/**
+ * Rotate a plane of @width x @height pixels of @N bytes: 90 counterclockwise (as transpose=2),
+ * 180 or 270 (as transpose=1)
+ */
+template<int N, int Rotation>
+static void
+rotatePlane(const uint8_t* src, int srcStride, int width, int height, uint8_t* dst, int dstStride)
+{
+    for (int by = 0; by < height; by += BLOCK) {
+        const int ey = std::min(by + BLOCK, height);
+        for (int bx = 0; bx < width; bx += BLOCK) {
+            const int ex = std::min(bx + BLOCK, width);
+            for (int y = by; y < ey; ++y) {
+                const auto* in = src + y * srcStride;
+                for (int x = bx; x < ex; ++x) {
+                    uint8_t* out;
+                    if constexpr (Rotation == 90)
+                        out = dst + (width - 1 - x) * dstStride + y * N;
+                    else if constexpr (Rotation == 180)
+                        out = dst + (height - 1 - y) * dstStride + (width - 1 - x) * N;
+                    else
+                        out = dst + x * dstStride + (height - 1 - y) * N;
+                    std::memcpy(out, in + x * N, N);
+                }
+            }
+        }
+    }
+}
+
+template<int Rotation>
+static bool
+rotatePlane(const uint8_t* src,
+            int srcStride,
+            int width,
+            int height,
+            int bytes,
+            uint8_t* dst,
+            int dstStride)
+{
+    switch (bytes) {
+    case 1:
+        rotatePlane<1, Rotation>(src, srcStride, width, height, dst, dstStride);
+        return true;
+    case 2:
+        rotatePlane<2, Rotation>(src, srcStride, width, height, dst, dstStride);
+        return true;
+    case 3:
+        rotatePlane<3, Rotation>(src, srcStride, width, height, dst, dstStride);
+        return true;
+    case 4:
+        rotatePlane<4, Rotation>(src, srcStride, width, height, dst, dstStride);
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::shared_ptr<VideoFrame>
+rotateFrame(const VideoFrame& frame, int rotation)
+{
+    rotation = ((rotation % 360) + 360) % 360;
+    if (rotation != 90 and rotation != 180 and rotation != 270)
+        return {};
+    const auto in = frame.pointer();
+    const auto format = static_cast<AVPixelFormat>(in->format);
+    const auto desc = av_pix_fmt_desc_get(format);
+    constexpr auto unsupported = AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM
+                                 | AV_PIX_FMT_FLAG_PAL;
+    if (not desc or desc->log2_chroma_w != desc->log2_chroma_h or (desc->flags & unsupported))
+        return {};
+    for (int c = 0; c < desc->nb_components; ++c)
+        if (desc->comp[c].depth != 8)
+            return {};
+
+    const bool swap = rotation != 180;
+    auto out = std::make_shared<VideoFrame>();
+    try {
+        out->reserve(format, swap ? in->height : in->width, swap ? in->width : in->height);
+    } catch (const std::bad_alloc&) {
+        return {};
+    }
+    auto o = out->pointer();
+    const int planes = av_pix_fmt_count_planes(format);
+    for (int p = 0; p < planes; ++p) {
+        const bool chroma = (p == 1 or p == 2) and not(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        const int width = chroma ? AV_CEIL_RSHIFT(in->width, desc->log2_chroma_w) : in->width;
+        const int height = chroma ? AV_CEIL_RSHIFT(in->height, desc->log2_chroma_h) : in->height;
+        const int bytes = av_image_get_linesize(format, in->width, p) / width;
+        bool done;
+        if (rotation == 90)
+            done = rotatePlane<90>(
+                in->data[p], in->linesize[p], width, height, bytes, o->data[p], o->linesize[p]);
+        else if (rotation == 180)
+            done = rotatePlane<180>(
+                in->data[p], in->linesize[p], width, height, bytes, o->data[p], o->linesize[p]);
+        else
+            done = rotatePlane<270>(
+                in->data[p], in->linesize[p], width, height, bytes, o->data[p], o->linesize[p]);
+        if (not done)
+            return {};
+    }
+    av_frame_copy_props(o, in);
+    av_frame_remove_side_data(o, AV_FRAME_DATA_DISPLAYMATRIX);
+    return out;
+}
+
 std::unique_ptr<MediaFilter>
 getTransposeFilter(
     int rotation, std::string inputName, int width, int height, int format, bool rescale)
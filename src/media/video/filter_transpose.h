@@ -21,6 +21,7 @@
 #pragma once
 
 #include "../media_filter.h"
+#include "../media_buffer.h"
 
 namespace jami {
 namespace video {
@@ -28,5 +29,15 @@ namespace video {
 std::unique_ptr<MediaFilter> getTransposeFilter(
     int rotation, std::string inputName, int width, int height, int format, bool rescale);
 
+/**
+ * Rotate @frame by @rotation, as the filter of getTransposeFilter without rescale, into a frame
+ * of the pool of buffers, without filter graph to build for each size and format. The display
+ * matrix of the output is removed.
+ * Supports the software formats of 8 bits components whose chroma is subsampled as much
+ * horizontally as vertically (e.g. YUV420P, NV12, YUV444P, RGB).
+ * @return nullptr for another rotation than 90, 180 and 270 or a format not supported
+ */
+std::shared_ptr<VideoFrame> rotateFrame(const VideoFrame& frame, int rotation);
+
 }
 } // namespace jami
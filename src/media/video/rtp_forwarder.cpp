@@ -0,0 +1,360 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rtp_forwarder.h"
+
+#include "logger.h"
+
+#include <algorithm>
+
+namespace jami {
+namespace video {
+
+static constexpr std::size_t RTP_HEADER_SIZE {12};
+
+static inline uint16_t
+readU16(const uint8_t* p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static inline uint32_t
+readU32(const uint8_t* p)
+{
+    return uint32_t(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void
+writeU16(uint8_t* p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static inline void
+writeU32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+RtpRewriter::RtpRewriter(uint32_t ssrc, uint16_t seq, uint8_t payloadType)
+    : ssrc_(ssrc)
+    , payloadType_(payloadType & 0x7f)
+    , seq_(seq)
+{}
+
+void
+RtpRewriter::rewrite(uint8_t* packet, clock::time_point now)
+{
+    auto seq = readU16(packet + 2);
+    auto timestamp = readU32(packet + 4);
+    if (newSource_) {
+        newSource_ = false;
+        if (started_) {
+            // Continue the stream, as if the new source had sent the packets of the old one
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - sent_);
+            auto ticks = std::max<int64_t>(1, elapsed.count() * CLOCK_RATE / 1000000);
+            seqOffset_ = uint16_t(seq_ + 1 - seq);
+            timestampOffset_ = uint32_t(timestamp_ + ticks - timestamp);
+        } else {
+            seqOffset_ = uint16_t(seq_ - seq);
+            timestampOffset_ = 0;
+        }
+    }
+    uint16_t outSeq = seq + seqOffset_;
+    uint32_t outTimestamp = timestamp + timestampOffset_;
+    // Reordered packets don't move the stream back
+    if (not started_ or int16_t(outSeq - seq_) > 0)
+        seq_ = outSeq;
+    if (not started_ or int32_t(outTimestamp - timestamp_) > 0) {
+        timestamp_ = outTimestamp;
+        sent_ = now;
+    }
+    started_ = true;
+
+    packet[1] = (packet[1] & 0x80) | payloadType_;
+    writeU16(packet + 2, outSeq);
+    writeU32(packet + 4, outTimestamp);
+    writeU32(packet + 8, ssrc_);
+}
+
+RtpForwarder::RtpForwarder(std::function<void(const std::string&)>&& requestKeyFrame)
+    : requestKeyFrame_(std::move(requestKeyFrame))
+{}
+
+void
+RtpForwarder::setSource(const std::string& id, const std::string& codec)
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (pending_.empty() ? source_ == id : pending_ == id)
+            return;
+        if (source_ == id) {
+            // Back to the source before the keyframe of the pending one
+            pending_.clear();
+            return;
+        }
+        JAMI_DBG("Forward the video of %s", id.c_str());
+        pending_ = id;
+        pendingCodec_ = codec;
+        pendingSince_ = clock::now();
+    }
+    if (requestKeyFrame_)
+        requestKeyFrame_(id);
+}
+
+void
+RtpForwarder::resetSource()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    source_.clear();
+    pending_.clear();
+}
+
+std::string
+RtpForwarder::getSource() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return pending_.empty() ? source_ : pending_;
+}
+
+void
+RtpForwarder::addDestination(const std::string& id, Send&& send)
+{
+    std::string source;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        destinations_[id] = Destination {std::move(send)};
+        source = source_;
+    }
+    // The destination can't decode the stream before
+    if (not source.empty() and requestKeyFrame_)
+        requestKeyFrame_(source);
+}
+
+void
+RtpForwarder::removeDestination(const std::string& id)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    destinations_.erase(id);
+}
+
+bool
+RtpForwarder::hasDestination(const std::string& id) const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return destinations_.find(id) != destinations_.end();
+}
+
+void
+RtpForwarder::requestKeyFrame()
+{
+    auto source = getSource();
+    if (not source.empty() and requestKeyFrame_)
+        requestKeyFrame_(source);
+}
+
+void
+RtpForwarder::onPacket(const std::string& from,
+                       const uint8_t* packet,
+                       std::size_t size,
+                       clock::time_point now)
+{
+    if (size < RTP_HEADER_SIZE)
+        return;
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (not pending_.empty() and from == pending_) {
+        if (not startsKeyFrame(pendingCodec_, packet, size)
+            and now - pendingSince_ < SWITCH_TIMEOUT)
+            return;
+        source_ = std::move(pending_);
+        pending_.clear();
+        for (auto& [id, destination] : destinations_)
+            destination.newSource = true;
+    }
+    if (from != source_)
+        return;
+    for (auto& [id, destination] : destinations_) {
+        if (id == from)
+            continue;
+        destination.send(packet, size, destination.newSource);
+        destination.newSource = false;
+    }
+}
+
+/**
+ * Payload of the RTP packet, nullptr if there is none
+ */
+static const uint8_t*
+rtpPayload(const uint8_t* packet, std::size_t size, std::size_t& len)
+{
+    if (size < RTP_HEADER_SIZE or (packet[0] >> 6) != 2)
+        return nullptr;
+    std::size_t offset = RTP_HEADER_SIZE + 4 * (packet[0] & 0x0f);
+    if (packet[0] & 0x10) {
+        if (size < offset + 4)
+            return nullptr;
+        offset += 4 + 4 * readU16(packet + offset + 2);
+    }
+    auto end = size;
+    if (packet[0] & 0x20)
+        end -= std::min<std::size_t>(packet[size - 1], end);
+    if (offset >= end)
+        return nullptr;
+    len = end - offset;
+    return packet + offset;
+}
+
+// RFC 6184
+static bool
+h264KeyFrame(const uint8_t* p, std::size_t len)
+{
+    auto isKey = [](uint8_t type) {
+        return type == 5 or type == 7; // IDR slice or SPS
+    };
+    auto type = p[0] & 0x1f;
+    if (type == 24) { // STAP-A
+        for (std::size_t i = 1; i + 2 < len;) {
+            auto n = readU16(p + i);
+            if (n == 0 or i + 2 + n > len)
+                break;
+            if (isKey(p[i + 2] & 0x1f))
+                return true;
+            i += 2 + n;
+        }
+        return false;
+    }
+    if (type == 28) // FU-A, from its first fragment
+        return len >= 2 and (p[1] & 0x80) and isKey(p[1] & 0x1f);
+    return isKey(type);
+}
+
+// RFC 7798
+static bool
+h265KeyFrame(const uint8_t* p, std::size_t len)
+{
+    auto isKey = [](uint8_t type) {
+        return (type >= 16 and type <= 21) or type == 32; // IRAP or VPS
+    };
+    if (len < 2)
+        return false;
+    auto type = (p[0] >> 1) & 0x3f;
+    if (type == 48) { // Aggregation packet
+        for (std::size_t i = 2; i + 3 < len;) {
+            auto n = readU16(p + i);
+            if (n == 0 or i + 2 + n > len)
+                break;
+            if (isKey((p[i + 2] >> 1) & 0x3f))
+                return true;
+            i += 2 + n;
+        }
+        return false;
+    }
+    if (type == 49) // Fragmentation unit
+        return len >= 3 and (p[2] & 0x80) and isKey(p[2] & 0x3f);
+    return isKey(type);
+}
+
+// RFC 7741
+static bool
+vp8KeyFrame(const uint8_t* p, std::size_t len)
+{
+    // Only the first partition of a frame has the payload header
+    if (not(p[0] & 0x10) or (p[0] & 0x07))
+        return false;
+    std::size_t i = 1;
+    if (p[0] & 0x80) {
+        if (i >= len)
+            return false;
+        auto ext = p[i++];
+        if (ext & 0x80) {
+            if (i >= len)
+                return false;
+            i += (p[i] & 0x80) ? 2 : 1;
+        }
+        if (ext & 0x40)
+            ++i;
+        if (ext & 0x30)
+            ++i;
+    }
+    return i < len and not(p[i] & 0x01);
+}
+
+// draft-ietf-payload-vp9, then the uncompressed header of the frame
+static bool
+vp9KeyFrame(const uint8_t* p, std::size_t len)
+{
+    // Only the first packet of a frame has its header, e.g. not FFmpeg's one in P
+    if (not(p[0] & 0x08))
+        return false;
+    std::size_t i = 1;
+    if (p[0] & 0x80) // Picture id
+        i += (i < len and (p[i] & 0x80)) ? 2 : 1;
+    if (p[0] & 0x20) // Layer indices, and TL0PICIDX in non-flexible mode
+        i += (p[0] & 0x10) ? 1 : 2;
+    if ((p[0] & 0x50) == 0x50) { // Reference indices
+        while (i < len and (p[i] & 0x01))
+            ++i;
+        ++i;
+    }
+    if (p[0] & 0x02) { // Scalability structure
+        if (i >= len)
+            return false;
+        auto ss = p[i++];
+        if (ss & 0x10)
+            i += 4 * ((ss >> 5) + 1);
+        if (ss & 0x08) {
+            if (i >= len)
+                return false;
+            auto pictures = p[i++];
+            for (unsigned n = 0; n < pictures and i < len; ++n)
+                i += 1 + ((p[i] >> 2) & 0x03);
+        }
+    }
+    if (i >= len)
+        return false;
+    auto header = p[i];
+    if ((header >> 6) != 2) // Frame marker
+        return false;
+    // Of the profile 3, a reserved bit follows the profile
+    unsigned shift = (header & 0x30) == 0x30 ? 2 : 3;
+    bool showExisting = header & (1 << shift);
+    bool interFrame = header & (1 << (shift - 1));
+    return not showExisting and not interFrame;
+}
+
+bool
+RtpForwarder::startsKeyFrame(std::string_view codec, const uint8_t* packet, std::size_t size)
+{
+    std::size_t len = 0;
+    auto payload = rtpPayload(packet, size, len);
+    if (codec == "H264")
+        return payload and h264KeyFrame(payload, len);
+    if (codec == "H265")
+        return payload and h265KeyFrame(payload, len);
+    if (codec == "VP8")
+        return payload and vp8KeyFrame(payload, len);
+    if (codec == "VP9")
+        return payload and vp9KeyFrame(payload, len);
+    return true;
+}
+
+} // namespace video
+} // namespace jami
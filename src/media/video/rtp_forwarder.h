@@ -0,0 +1,150 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace jami {
+namespace video {
+
+/**
+ * Rewrite the headers of the RTP packets of successive sources into one
+ * stream: its SSRC and payload type, and continuous sequence numbers and
+ * timestamps, the losses of a source being kept.
+ */
+class RtpRewriter
+{
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr unsigned CLOCK_RATE {90000};
+
+    /**
+     * @param seq   Of the first packet, following the ones already sent
+     */
+    RtpRewriter(uint32_t ssrc, uint16_t seq, uint8_t payloadType);
+
+    /**
+     * The next packet comes from another source
+     */
+    void switchSource() { newSource_ = true; }
+
+    /**
+     * @param packet    RTP packet of the current source, of at least 12 bytes
+     */
+    void rewrite(uint8_t* packet, clock::time_point now = clock::now());
+
+private:
+    const uint32_t ssrc_;
+    const uint8_t payloadType_;
+    bool started_ {false};
+    bool newSource_ {true};
+    uint16_t seq_;          ///< last sent, or the first one before started_
+    uint32_t timestamp_ {0}; ///< last sent
+    clock::time_point sent_ {};
+    uint16_t seqOffset_ {0};
+    uint32_t timestampOffset_ {0};
+};
+
+/**
+ * Selective forwarding of a conference: the RTP packets received from the
+ * source are sent as they are to the other participants, rather than being
+ * decoded, mixed and encoded for each of them.
+ *
+ * The packets of a new source are forwarded from its next keyframe, the
+ * previous source being forwarded meanwhile.
+ */
+class RtpForwarder
+{
+public:
+    using clock = std::chrono::steady_clock;
+    // The keyframe may never come, e.g. if the request is lost
+    static constexpr std::chrono::seconds SWITCH_TIMEOUT {2};
+
+    /**
+     * Send a packet of the source, with newSource on the first one of a source
+     */
+    using Send = std::function<void(const uint8_t* packet, std::size_t size, bool newSource)>;
+
+    /**
+     * @param requestKeyFrame   Ask a source for a keyframe
+     */
+    explicit RtpForwarder(std::function<void(const std::string&)>&& requestKeyFrame);
+
+    /**
+     * @param codec     Of the packets of the source, to find its keyframes
+     */
+    void setSource(const std::string& id, const std::string& codec);
+    void resetSource();
+    /**
+     * The source, or the pending one, empty if none
+     */
+    std::string getSource() const;
+
+    /**
+     * Forward the packets of the sources but its own to a participant
+     */
+    void addDestination(const std::string& id, Send&& send);
+    void removeDestination(const std::string& id);
+    bool hasDestination(const std::string& id) const;
+
+    /**
+     * Requested by a destination
+     */
+    void requestKeyFrame();
+
+    /**
+     * Called by the receiving thread of each participant, with the decrypted packets
+     */
+    void onPacket(const std::string& from,
+                  const uint8_t* packet,
+                  std::size_t size,
+                  clock::time_point now = clock::now());
+
+    /**
+     * Whether packet starts a keyframe, true if it can't be told for codec
+     */
+    static bool startsKeyFrame(std::string_view codec, const uint8_t* packet, std::size_t size);
+
+private:
+    NON_COPYABLE(RtpForwarder);
+
+    struct Destination
+    {
+        Send send;
+        bool newSource {true};
+    };
+
+    const std::function<void(const std::string&)> requestKeyFrame_;
+    mutable std::mutex mutex_;
+    std::string source_ {};
+    std::string pending_ {};
+    std::string pendingCodec_ {};
+    clock::time_point pendingSince_ {};
+    std::map<std::string, Destination> destinations_ {};
+};
+
+} // namespace video
+} // namespace jami
@@ -24,13 +24,32 @@
 #include <cstdint>
 #include <semaphore.h>
 
-/* Implementation note: double-buffering
- * Shared memory is divided in two regions, each representing one frame.
+/* Implementation note: ring of frames
+ * Shared memory starts with a SHMRing, followed by SHM_RING_SLOTS regions,
+ * each representing one frame.
  * First byte of each frame is guaranteed to be aligned on 16 bytes.
- * One region is marked as readable: this region can be safely read.
- * The other region is writeable: only the producer can use it.
+ * The producer writes the regions in turn, readOffset being the offset of the
+ * last one written and writeOffset the one being written.
+ * The sequence of a slot is odd while the producer writes it: a client reading
+ * a frame without keeping the mutex compares the sequence before and after.
  */
 
+#define SHM_RING_SLOTS 3
+
+struct SHMSlot
+{
+    unsigned offset;   // offset of the frame in data
+    unsigned sequence; // incremented before and after writing the frame
+    unsigned frameGen; // frameGen of the frame
+};
+
+struct SHMRing
+{
+    unsigned slotCount; // number of the slots used
+    unsigned lastSlot;  // index of the slot at readOffset
+    SHMSlot slots[SHM_RING_SLOTS];
+};
+
 struct SHMHeader
 {
     sem_t mutex;          // lock it before any operations on these fields
@@ -40,7 +59,7 @@ struct SHMHeader
     unsigned mapSize;     // size to map if you need all the data
     unsigned readOffset;  // offset of readable frame in data
     unsigned writeOffset; // offset of writable frame in data
-    uint8_t data[];       // the whole shared memory
+    uint8_t data[];       // the whole shared memory, starting with the SHMRing
 };
 
 #endif
@@ -32,6 +32,7 @@
 
 #include "media_buffer.h"
 #include "logger.h"
+#include "tracepoint.h"
 #include "noncopyable.h"
 #include "client/ring_signal.h"
 #include "jami/videomanager_interface.h"
@@ -48,6 +49,7 @@
 #ifndef _WIN32
 #include <sys/mman.h>
 #endif
+#include <algorithm>
 #include <ciso646> // fix windows compiler bug
 #include <fcntl.h>
 #include <cstdio>
@@ -99,6 +101,8 @@ private:
     bool resizeArea(std::size_t desired_length) noexcept;
     char* getShmAreaDataPtr() noexcept;
 
+    SHMRing& getRing() noexcept { return *reinterpret_cast<SHMRing*>(area_->data); }
+
     void unMapShmArea() noexcept
     {
         if (area_ != MAP_FAILED and ::munmap(area_, areaSize_) < 0) {
@@ -113,6 +117,7 @@ private:
     std::size_t areaSize_ {0};
     std::string openedName_;
     int fd_ {-1};
+    VideoScaler scaler_;
 };
 
 ShmHolder::ShmHolder(const std::string& name)
@@ -187,7 +192,7 @@ ShmHolder::resizeArea(std::size_t frameSize) noexcept
         return true;
 
     // full area size: +15 to take care of maximum padding size
-    const auto areaSize = sizeof(SHMHeader) + 2 * frameSize + 15;
+    const auto areaSize = sizeof(SHMHeader) + sizeof(SHMRing) + SHM_RING_SLOTS * frameSize + 15;
     JAMI_DBG("[ShmHolder:%s] New size: f=%zu, a=%zu", openedName_.c_str(), frameSize, areaSize);
 
     unMapShmArea();
@@ -224,8 +229,16 @@ ShmHolder::resizeArea(std::size_t frameSize) noexcept
         // Note: we not using std::align as not implemented in 4.9
         // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=57350
         auto p = reinterpret_cast<std::uintptr_t>(area_->data);
-        area_->writeOffset = ((p + 15) & ~15) - p;
-        area_->readOffset = area_->writeOffset + frameSize;
+        unsigned offset = ((p + sizeof(SHMRing) + 15) & ~15) - p;
+        auto& ring = getRing();
+        ring.slotCount = SHM_RING_SLOTS;
+        ring.lastSlot = 0;
+        for (auto& slot : ring.slots) {
+            slot = {offset, 0, 0};
+            offset += frameSize;
+        }
+        area_->readOffset = ring.slots[0].offset;
+        area_->writeOffset = ring.slots[1].offset;
     }
 
     return true;
@@ -248,19 +261,33 @@ ShmHolder::renderFrame(const VideoFrame& src) noexcept
         return;
     }
 
+    // Only the producer changes lastSlot
+    auto& ring = getRing();
+    auto& slot = ring.slots[(ring.lastSlot + 1) % ring.slotCount];
+    {
+        SemGuardLock lk {area_->mutex};
+
+        ++slot.sequence;
+        area_->writeOffset = slot.offset;
+    }
+
     {
         VideoFrame dst;
-        VideoScaler scaler;
 
-        dst.setFromMemory(area_->data + area_->writeOffset, format, width, height);
-        scaler.scale(src, dst);
+        dst.setFromMemory(area_->data + slot.offset, format, width, height);
+        if (src.format() == format)
+            av_frame_copy(dst.pointer(), src.pointer());
+        else
+            scaler_.scale(src, dst);
     }
 
     {
         SemGuardLock lk {area_->mutex};
 
-        ++area_->frameGen;
-        std::swap(area_->readOffset, area_->writeOffset);
+        ++slot.sequence;
+        slot.frameGen = ++area_->frameGen;
+        ring.lastSlot = &slot - ring.slots;
+        area_->readOffset = slot.offset;
         ::sem_post(&area_->frameGenMutex);
     }
 }
@@ -328,6 +355,7 @@ SinkClient::SinkClient(const std::string& id, bool mixer)
     : id_ {id}
     , mixer_(mixer)
     , scaler_(new VideoScaler())
+    , fitScaler_(new VideoScaler())
 #ifdef DEBUG_FPS
     , frameCount_(0u)
     , lastFrameDebug_(std::chrono::steady_clock::now())
@@ -369,7 +397,7 @@ SinkClient::sendFrameTransformed(AVFrame* frame)
 }
 
 std::shared_ptr<VideoFrame>
-SinkClient::applyTransform(VideoFrame& frame_p)
+SinkClient::applyTransform(VideoFrame& frame_p, bool fit)
 {
     std::shared_ptr<VideoFrame> frame = std::make_shared<VideoFrame>();
 #ifdef RING_ACCEL
@@ -388,25 +416,63 @@ SinkClient::applyTransform(VideoFrame& frame_p)
         frame->copyFrom(frame_p);
 
     int angle = frame->getOrientation();
-    if (angle != rotation_) {
-        filter_ = getTransposeFilter(angle,
-                                     FILTER_INPUT_NAME,
-                                     frame->width(),
-                                     frame->height(),
-                                     frame->format(),
-                                     false);
-        rotation_ = angle;
+    // Size shown, by which crop_ is given
+    const bool swap = angle % 180 != 0;
+    const int shownWidth = swap ? frame->height() : frame->width();
+    const int shownHeight = swap ? frame->width() : frame->height();
+    if (fit and targetWidth_ > 0 and targetHeight_ > 0) {
+        // Before the rotation and the crop, then done on fewer pixels
+        auto w = crop_.w ? crop_.w : shownWidth;
+        auto h = crop_.h ? crop_.h : shownHeight;
+        auto ratio = std::min((double) targetWidth_ / w, (double) targetHeight_ / h);
+        if (ratio < 1) {
+            auto scaled = std::make_shared<VideoFrame>();
+            try {
+                scaled->reserve(frame->format(),
+                                std::max(2, static_cast<int>(frame->width() * ratio) & ~1),
+                                std::max(2, static_cast<int>(frame->height() * ratio) & ~1));
+            } catch (const std::bad_alloc&) {
+                return {};
+            }
+            fitScaler_->scale(*frame, *scaled);
+            av_frame_copy_props(scaled->pointer(), frame->pointer());
+            frame = std::move(scaled);
+        }
     }
-    if (filter_) {
-        filter_->feedInput(frame->pointer(), FILTER_INPUT_NAME);
-        frame = std::static_pointer_cast<VideoFrame>(
-            std::shared_ptr<MediaFrame>(filter_->readOutput()));
+
+    if (auto rotated = rotateFrame(*frame, angle)) {
+        frame = std::move(rotated);
+    } else {
+        if (angle != rotation_) {
+            filter_ = getTransposeFilter(angle,
+                                         FILTER_INPUT_NAME,
+                                         frame->width(),
+                                         frame->height(),
+                                         frame->format(),
+                                         false);
+            rotation_ = angle;
+        }
+        if (filter_) {
+            filter_->feedInput(frame->pointer(), FILTER_INPUT_NAME);
+            frame = std::static_pointer_cast<VideoFrame>(
+                std::shared_ptr<MediaFrame>(filter_->readOutput()));
+        }
     }
     if (crop_.w || crop_.h) {
-        frame->pointer()->crop_top = crop_.y;
-        frame->pointer()->crop_bottom = (size_t) frame->height() - crop_.y - crop_.h;
-        frame->pointer()->crop_left = crop_.x;
-        frame->pointer()->crop_right = (size_t) frame->width() - crop_.x - crop_.w;
+        Rect crop = crop_;
+        if (frame->width() != shownWidth or frame->height() != shownHeight) {
+            // Downscaled
+            auto rx = (double) frame->width() / shownWidth;
+            auto ry = (double) frame->height() / shownHeight;
+            crop.x = std::min<int>(crop.x * rx, frame->width());
+            crop.y = std::min<int>(crop.y * ry, frame->height());
+            crop.w = std::min<int>(crop.w * rx, frame->width() - crop.x);
+            crop.h = std::min<int>(crop.h * ry, frame->height() - crop.y);
+        }
+        frame->pointer()->crop_top = crop.y;
+        frame->pointer()->crop_bottom = (size_t) frame->height() - crop.y - crop.h;
+        frame->pointer()->crop_left = crop.x;
+        frame->pointer()->crop_right = (size_t) frame->width() - crop.x - crop.w;
         av_frame_apply_cropping(frame->pointer(), AV_FRAME_CROP_UNALIGNED);
     }
     return frame;
@@ -429,23 +495,29 @@ SinkClient::update(Observable<std::shared_ptr<MediaFrame>>* /*obs*/,
     }
 #endif
 
+    jami_tracepoint(media_frame_render, "video", frame_p->pointer());
     std::unique_lock<std::mutex> lock(mtx_);
     bool hasObservers = getObserversCount() != 0;
     bool hasDirectListener = target_.push and not target_.pull;
     bool hasTransformedListener = target_.push and target_.pull;
+    bool hidden = skipFrame();
 
     if (hasDirectListener) {
-        sendFrameDirect(frame_p);
+        if (not hidden)
+            sendFrameDirect(frame_p);
         return;
     }
 
-    bool doTransfer = hasTransformedListener or hasObservers;
+    bool toClient = hasTransformedListener;
 #ifdef ENABLE_SHM
-    doTransfer |= (shm_ && doShmTransfer_);
+    toClient |= (shm_ && doShmTransfer_);
 #endif
+    toClient &= not hidden;
 
-    if (doTransfer) {
-        auto frame = applyTransform(*std::static_pointer_cast<VideoFrame>(frame_p));
+    if (toClient or hasObservers) {
+        // The observers getting the frames at their resolution
+        auto frame = applyTransform(*std::static_pointer_cast<VideoFrame>(frame_p),
+                                    not hasObservers);
         if (not frame)
             return;
 
@@ -456,6 +528,8 @@ SinkClient::update(Observable<std::shared_ptr<MediaFrame>>* /*obs*/,
             setFrameSize(frame->width(), frame->height());
             return;
         }
+        if (not toClient)
+            return;
 #ifdef ENABLE_SHM
         if (shm_ && doShmTransfer_)
             shm_->renderFrame(*frame);
@@ -489,6 +563,41 @@ SinkClient::setFrameSize(int width, int height)
     }
 }
 
+bool
+SinkClient::skipFrame()
+{
+    if (targetWidth_ == 0 or targetHeight_ == 0 or maxFrameRate_ == 0)
+        return true;
+    if (maxFrameRate_ < 0)
+        return false;
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1 / maxFrameRate_));
+    const auto now = std::chrono::steady_clock::now();
+    // With some tolerance, for the frames arriving slightly before their time
+    if (now + period / 4 < nextFrame_)
+        return true;
+    nextFrame_ = nextFrame_ + period < now - period ? now + period : nextFrame_ + period;
+    return false;
+}
+
+void
+SinkClient::setMaxFrameRate(double fps)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    JAMI_DBG("[Sink:%p] Maximum frame rate %f", this, fps);
+    maxFrameRate_ = fps;
+    nextFrame_ = {};
+}
+
+void
+SinkClient::setTargetSize(int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    JAMI_DBG("[Sink:%p] Target size %dx%d", this, width, height);
+    targetWidth_ = width;
+    targetHeight_ = height;
+}
+
 void
 SinkClient::setCrop(int x, int y, int w, int h)
 {
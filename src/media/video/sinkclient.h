@@ -31,6 +31,7 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
 #include <memory>
 
 #define DEBUG_FPS
@@ -76,6 +77,21 @@ public:
     void setFrameSize(int width, int height);
     void setCrop(int x, int y, int w, int h);
 
+    /**
+     * Size of the area the client shows the frames in. They are downscaled to fit in it,
+     * keeping their aspect ratio, before being rotated, cropped and sent. An empty area (e.g.
+     * 0x0 for a hidden sink) skips them, unless the sink has observers; -1x-1 (default) keeps
+     * them at their resolution.
+     */
+    void setTargetSize(int width, int height);
+
+    /**
+     * Maximum rate of the frames sent to the client, the others being skipped before any
+     * transform, e.g. for a sink in the background. 0 pauses the sink, as a hidden one; a negative
+     * rate (default) sends all the frames.
+     */
+    void setMaxFrameRate(double fps);
+
     void registerTarget(DRing::SinkTarget target) noexcept
     {
         std::lock_guard<std::mutex> lock(mtx_);
@@ -102,20 +118,29 @@ private:
     bool started_ {false}; // used to arbitrate client's stop signal.
     int rotation_ {0};
     DRing::SinkTarget target_;
+    int targetWidth_ {-1};
+    int targetHeight_ {-1};
+    double maxFrameRate_ {-1};
+    std::chrono::steady_clock::time_point nextFrame_ {};
     std::unique_ptr<VideoScaler> scaler_;
+    // Not to rebuild the context of scaler_ at each frame
+    std::unique_ptr<VideoScaler> fitScaler_;
     std::unique_ptr<MediaFilter> filter_;
     std::mutex mtx_;
 
+    // If the client does not get the frame, hidden or above the maximum rate
+    bool skipFrame();
     void sendFrameDirect(const std::shared_ptr<jami::MediaFrame>&);
     void sendFrameTransformed(AVFrame* frame);
 
     /**
      * Apply required transformations before sending frames to clients/observers:
      * - Transfer the frame from gpu to main memory, if needed.
+     * - Downscale the frame to the target size, if @fit.
      * - Rotate the frame as needed.
      * - Apply cropping as needed
      */
-    std::shared_ptr<VideoFrame> applyTransform(VideoFrame& frame);
+    std::shared_ptr<VideoFrame> applyTransform(VideoFrame& frame, bool fit);
 
 #ifdef DEBUG_FPS
     unsigned frameCount_;
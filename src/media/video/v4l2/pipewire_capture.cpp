@@ -0,0 +1,494 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pipewire_capture.h"
+#include "logger.h"
+#include "libav_utils.h"
+
+#include <spa/param/format-utils.h>
+#include <spa/pod/builder.h>
+
+#ifdef RING_ACCEL
+extern "C" {
+#include <libavutil/hwcontext_drm.h>
+}
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace jami {
+namespace video {
+
+static constexpr auto NEGOTIATION_TIMEOUT = std::chrono::seconds(3);
+// DRM_FORMAT_MOD_LINEAR, the only layout which can also be read from main memory
+static constexpr uint64_t MODIFIER_LINEAR {0};
+
+static AVPixelFormat
+pixelFormat(uint32_t format)
+{
+    switch (format) {
+    case SPA_VIDEO_FORMAT_BGRx:
+        return AV_PIX_FMT_BGR0;
+    case SPA_VIDEO_FORMAT_RGBx:
+        return AV_PIX_FMT_RGB0;
+    case SPA_VIDEO_FORMAT_BGRA:
+        return AV_PIX_FMT_BGRA;
+    case SPA_VIDEO_FORMAT_RGBA:
+        return AV_PIX_FMT_RGBA;
+    default:
+        return AV_PIX_FMT_NONE;
+    }
+}
+
+#ifdef RING_ACCEL
+static constexpr uint32_t
+fourcc(char a, char b, char c, char d)
+{
+    return uint32_t(a) | uint32_t(b) << 8 | uint32_t(c) << 16 | uint32_t(d) << 24;
+}
+
+// DRM formats are named from the most significant byte
+static uint32_t
+drmFormat(uint32_t format)
+{
+    switch (format) {
+    case SPA_VIDEO_FORMAT_BGRx:
+        return fourcc('X', 'R', '2', '4');
+    case SPA_VIDEO_FORMAT_RGBx:
+        return fourcc('X', 'B', '2', '4');
+    case SPA_VIDEO_FORMAT_BGRA:
+        return fourcc('A', 'R', '2', '4');
+    case SPA_VIDEO_FORMAT_RGBA:
+        return fourcc('A', 'B', '2', '4');
+    default:
+        return 0;
+    }
+}
+#endif
+
+static const spa_pod*
+buildFormat(spa_pod_builder* b, bool dmabuf)
+{
+    spa_rectangle size {1920, 1080};
+    spa_rectangle minSize {1, 1};
+    spa_rectangle maxSize {8192, 8192};
+    spa_fraction rate {30, 1};
+    spa_fraction minRate {0, 1};
+    spa_fraction maxRate {240, 1};
+
+    spa_pod_frame f;
+    spa_pod_builder_push_object(b, &f, SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+    spa_pod_builder_add(b,
+                        SPA_FORMAT_mediaType,
+                        SPA_POD_Id(SPA_MEDIA_TYPE_video),
+                        SPA_FORMAT_mediaSubtype,
+                        SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+                        SPA_FORMAT_VIDEO_format,
+                        SPA_POD_CHOICE_ENUM_Id(5,
+                                               SPA_VIDEO_FORMAT_BGRx,
+                                               SPA_VIDEO_FORMAT_BGRx,
+                                               SPA_VIDEO_FORMAT_RGBx,
+                                               SPA_VIDEO_FORMAT_BGRA,
+                                               SPA_VIDEO_FORMAT_RGBA),
+                        SPA_FORMAT_VIDEO_size,
+                        SPA_POD_CHOICE_RANGE_Rectangle(&size, &minSize, &maxSize),
+                        SPA_FORMAT_VIDEO_framerate,
+                        SPA_POD_CHOICE_RANGE_Fraction(&rate, &minRate, &maxRate),
+                        0);
+    if (dmabuf) {
+        spa_pod_builder_prop(b, SPA_FORMAT_VIDEO_modifier, SPA_POD_PROP_FLAG_MANDATORY);
+        spa_pod_builder_long(b, MODIFIER_LINEAR);
+    }
+    return static_cast<const spa_pod*>(spa_pod_builder_pop(b, &f));
+}
+
+PipeWireCapture::PipeWireCapture(rational<double> framerate)
+    : framerate_(framerate)
+{
+    interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>((1 / framerate).real()));
+}
+
+PipeWireCapture::~PipeWireCapture()
+{
+    if (loop_)
+        pw_thread_loop_stop(loop_);
+    if (stream_)
+        pw_stream_destroy(stream_);
+    if (core_)
+        pw_core_disconnect(core_);
+    if (context_)
+        pw_context_destroy(context_);
+    if (loop_)
+        pw_thread_loop_destroy(loop_);
+#ifdef RING_ACCEL
+    av_buffer_unref(&vaapiFrames_);
+    av_buffer_unref(&drmFrames_);
+    av_buffer_unref(&vaapiDevice_);
+    av_buffer_unref(&drmDevice_);
+#endif
+}
+
+std::unique_ptr<PipeWireCapture>
+PipeWireCapture::open(int fd, uint32_t node, rational<double> framerate)
+{
+    pw_init(nullptr, nullptr);
+    std::unique_ptr<PipeWireCapture> capture(new PipeWireCapture(framerate));
+    if (!capture->connect(fd, node)) {
+        JAMI_ERR("Failed to connect to the screen cast %u", node);
+        return {};
+    }
+    std::unique_lock<std::mutex> lk(capture->mutex_);
+    if (!capture->cv_.wait_for(lk,
+                               NEGOTIATION_TIMEOUT,
+                               [&] { return capture->negotiated_ || capture->failed_; })
+        || capture->failed_) {
+        JAMI_ERR("Failed to negotiate the screen cast %u", node);
+        return {};
+    }
+    JAMI_DBG("Screen cast %u: %ux%u%s",
+             node,
+             capture->info_.size.width,
+             capture->info_.size.height,
+             capture->dmabuf_ ? " with DMA-BUF" : "");
+    return capture;
+}
+
+bool
+PipeWireCapture::connect(int fd, uint32_t node)
+{
+    loop_ = pw_thread_loop_new("jami-screencast", nullptr);
+    if (!loop_)
+        return false;
+    context_ = pw_context_new(pw_thread_loop_get_loop(loop_), nullptr, 0);
+    if (!context_ || pw_thread_loop_start(loop_) < 0)
+        return false;
+
+    static const pw_stream_events events = [] {
+        pw_stream_events e {};
+        e.version = PW_VERSION_STREAM_EVENTS;
+        e.state_changed = &PipeWireCapture::onStateChanged;
+        e.param_changed = &PipeWireCapture::onParamChanged;
+        e.process = &PipeWireCapture::onProcess;
+        return e;
+    }();
+
+    pw_thread_loop_lock(loop_);
+    auto connected = [&] {
+        // The remote stays owned by the client
+        auto remote = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (remote < 0 || !(core_ = pw_context_connect_fd(context_, remote, nullptr, 0)))
+            return false;
+        stream_ = pw_stream_new(core_,
+                                "Jami screen sharing",
+                                pw_properties_new(PW_KEY_MEDIA_TYPE,
+                                                  "Video",
+                                                  PW_KEY_MEDIA_CATEGORY,
+                                                  "Capture",
+                                                  PW_KEY_MEDIA_ROLE,
+                                                  "Screen",
+                                                  nullptr));
+        if (!stream_)
+            return false;
+        pw_stream_add_listener(stream_, &listener_, &events, this);
+
+        uint8_t buffer[1024];
+        spa_pod_builder b;
+        spa_pod_builder_init(&b, buffer, sizeof(buffer));
+        // Preferably DMA-BUF, which the compositor doesn't have to copy
+        const spa_pod* params[] = {buildFormat(&b, true), buildFormat(&b, false)};
+        return pw_stream_connect(stream_,
+                                 PW_DIRECTION_INPUT,
+                                 node,
+                                 static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT
+                                                              | PW_STREAM_FLAG_MAP_BUFFERS),
+                                 params,
+                                 2)
+               >= 0;
+    }();
+    pw_thread_loop_unlock(loop_);
+    return connected;
+}
+
+void
+PipeWireCapture::onStateChanged(void* data,
+                                pw_stream_state,
+                                pw_stream_state state,
+                                const char* error)
+{
+    if (state != PW_STREAM_STATE_ERROR && state != PW_STREAM_STATE_UNCONNECTED)
+        return;
+    auto self = static_cast<PipeWireCapture*>(data);
+    JAMI_WARN("Screen cast stopped: %s", error ? error : pw_stream_state_as_string(state));
+    std::lock_guard<std::mutex> lk(self->mutex_);
+    self->failed_ = true;
+    self->cv_.notify_all();
+}
+
+void
+PipeWireCapture::onParamChanged(void* data, uint32_t id, const spa_pod* param)
+{
+    if (id != SPA_PARAM_Format || !param)
+        return;
+    auto self = static_cast<PipeWireCapture*>(data);
+    uint32_t mediaType, mediaSubtype;
+    spa_video_info_raw info {};
+    if (spa_format_parse(param, &mediaType, &mediaSubtype) < 0
+        || mediaType != SPA_MEDIA_TYPE_video || mediaSubtype != SPA_MEDIA_SUBTYPE_raw
+        || spa_format_video_raw_parse(param, &info) < 0
+        || pixelFormat(info.format) == AV_PIX_FMT_NONE)
+        return;
+    bool dmabuf = spa_pod_find_prop(param, nullptr, SPA_FORMAT_VIDEO_modifier) != nullptr;
+
+    uint8_t buffer[256];
+    spa_pod_builder b;
+    spa_pod_builder_init(&b, buffer, sizeof(buffer));
+    int dataType = dmabuf ? 1 << SPA_DATA_DmaBuf : (1 << SPA_DATA_MemFd) | (1 << SPA_DATA_MemPtr);
+    const spa_pod* params[] = {static_cast<const spa_pod*>(
+        spa_pod_builder_add_object(&b,
+                                   SPA_TYPE_OBJECT_ParamBuffers,
+                                   SPA_PARAM_Buffers,
+                                   SPA_PARAM_BUFFERS_dataType,
+                                   SPA_POD_Int(dataType)))};
+    pw_stream_update_params(self->stream_, params, 1);
+
+    std::lock_guard<std::mutex> lk(self->mutex_);
+    self->info_ = info;
+    self->dmabuf_ = dmabuf;
+    self->negotiated_ = true;
+    self->cv_.notify_all();
+}
+
+void
+PipeWireCapture::onProcess(void* data)
+{
+    auto self = static_cast<PipeWireCapture*>(data);
+    // Only the most recent buffer is of use
+    pw_buffer* b = nullptr;
+    while (auto next = pw_stream_dequeue_buffer(self->stream_)) {
+        if (b)
+            pw_stream_queue_buffer(self->stream_, b);
+        b = next;
+    }
+    if (!b)
+        return;
+
+    std::shared_ptr<VideoFrame> frame;
+    const auto& buffer = *b->buffer;
+    if (buffer.n_datas > 0) {
+        const auto& d = buffer.datas[0];
+        if (d.type == SPA_DATA_DmaBuf) {
+#ifdef RING_ACCEL
+            frame = self->importDmaBuf(buffer);
+#endif
+            if (!frame)
+                frame = self->copyBuffer(buffer);
+        } else if (d.chunk->size > 0) {
+            // Empty for the updates of the cursor only
+            frame = self->copyBuffer(buffer);
+        }
+    }
+    pw_stream_queue_buffer(self->stream_, b);
+
+    if (frame) {
+        std::lock_guard<std::mutex> lk(self->mutex_);
+        self->frame_ = std::move(frame);
+        self->fresh_ = true;
+        self->cv_.notify_all();
+    }
+}
+
+std::shared_ptr<VideoFrame>
+PipeWireCapture::copyBuffer(const spa_buffer& buffer)
+{
+    const auto& d = buffer.datas[0];
+    int width = info_.size.width;
+    int height = info_.size.height;
+    int stride = d.chunk->stride > 0 ? d.chunk->stride : width * 4;
+
+    void* map = nullptr;
+    size_t mapSize = 0;
+    const uint8_t* src = static_cast<const uint8_t*>(d.data);
+    if (d.type == SPA_DATA_DmaBuf) {
+        // Linear, see buildFormat()
+        mapSize = d.chunk->offset + size_t(stride) * height;
+        map = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, d.fd, 0);
+        if (map == MAP_FAILED)
+            return {};
+        src = static_cast<const uint8_t*>(map);
+    }
+    if (!src)
+        return {};
+
+    auto frame = std::make_shared<VideoFrame>();
+    frame->reserve(pixelFormat(info_.format), width, height);
+    auto f = frame->pointer();
+    av_image_copy_plane(
+        f->data[0], f->linesize[0], src + d.chunk->offset, stride, width * 4, height);
+    if (map)
+        munmap(map, mapSize);
+    return frame;
+}
+
+#ifdef RING_ACCEL
+bool
+PipeWireCapture::initDevice()
+{
+    if (deviceFailed_)
+        return false;
+    int width = info_.size.width;
+    int height = info_.size.height;
+    auto format = pixelFormat(info_.format);
+    if (drmFrames_) {
+        auto frames = reinterpret_cast<AVHWFramesContext*>(drmFrames_->data);
+        if (frames->width == width && frames->height == height && frames->sw_format == format)
+            return true;
+        av_buffer_unref(&vaapiFrames_);
+        av_buffer_unref(&drmFrames_);
+    }
+
+    int ret = 0;
+    if (!drmDevice_
+        && ((ret = av_hwdevice_ctx_create(
+                 &drmDevice_, AV_HWDEVICE_TYPE_DRM, "/dev/dri/renderD128", nullptr, 0))
+                < 0
+            || (ret = av_hwdevice_ctx_create_derived(
+                    &vaapiDevice_, AV_HWDEVICE_TYPE_VAAPI, drmDevice_, 0))
+                   < 0)) {
+        JAMI_WARN("Screen cast buffers will be copied: %s", libav_utils::getError(ret).c_str());
+        deviceFailed_ = true;
+        return false;
+    }
+
+    if ((drmFrames_ = av_hwframe_ctx_alloc(drmDevice_))) {
+        auto frames = reinterpret_cast<AVHWFramesContext*>(drmFrames_->data);
+        frames->format = AV_PIX_FMT_DRM_PRIME;
+        frames->sw_format = format;
+        frames->width = width;
+        frames->height = height;
+        ret = av_hwframe_ctx_init(drmFrames_);
+    } else
+        ret = AVERROR(ENOMEM);
+    if (ret < 0
+        || (ret = av_hwframe_ctx_create_derived(
+                &vaapiFrames_, AV_PIX_FMT_VAAPI, vaapiDevice_, drmFrames_, 0))
+               < 0) {
+        JAMI_WARN("VAAPI can't import the screen cast: %s", libav_utils::getError(ret).c_str());
+        av_buffer_unref(&drmFrames_);
+        deviceFailed_ = true;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<VideoFrame>
+PipeWireCapture::importDmaBuf(const spa_buffer& buffer)
+{
+    if (!initDevice())
+        return {};
+    const auto& d = buffer.datas[0];
+    int width = info_.size.width;
+    int height = info_.size.height;
+
+    auto desc = static_cast<AVDRMFrameDescriptor*>(av_mallocz(sizeof(AVDRMFrameDescriptor)));
+    if (!desc)
+        return {};
+    desc->nb_objects = 1;
+    desc->objects[0].fd = d.fd;
+    desc->objects[0].size = d.chunk->offset + size_t(d.chunk->stride) * height;
+    desc->objects[0].format_modifier = MODIFIER_LINEAR;
+    desc->nb_layers = 1;
+    desc->layers[0].format = drmFormat(info_.format);
+    desc->layers[0].nb_planes = 1;
+    desc->layers[0].planes[0].object_index = 0;
+    desc->layers[0].planes[0].offset = d.chunk->offset;
+    desc->layers[0].planes[0].pitch = d.chunk->stride;
+
+    VideoFrame prime;
+    auto src = prime.pointer();
+    src->buf[0] = av_buffer_create(
+        reinterpret_cast<uint8_t*>(desc),
+        sizeof(*desc),
+        [](void*, uint8_t* data) { av_free(data); },
+        nullptr,
+        0);
+    if (!src->buf[0]) {
+        av_free(desc);
+        return {};
+    }
+    src->data[0] = reinterpret_cast<uint8_t*>(desc);
+    src->format = AV_PIX_FMT_DRM_PRIME;
+    src->width = width;
+    src->height = height;
+    src->hw_frames_ctx = av_buffer_ref(drmFrames_);
+
+    VideoFrame surface;
+    auto dst = surface.pointer();
+    dst->format = AV_PIX_FMT_VAAPI;
+    dst->hw_frames_ctx = av_buffer_ref(vaapiFrames_);
+    int ret = av_hwframe_map(dst, src, AV_HWFRAME_MAP_READ);
+    if (ret < 0) {
+        JAMI_WARN("Failed to import the screen cast: %s", libav_utils::getError(ret).c_str());
+        deviceFailed_ = true;
+        return {};
+    }
+    // Converted to a surface of our own, the buffer goes back to the compositor
+    std::shared_ptr<VideoFrame> frame = scaler_.scale(surface, width, height, AV_PIX_FMT_NV12);
+    if (!frame)
+        deviceFailed_ = true;
+    return frame;
+}
+#endif
+
+std::shared_ptr<VideoFrame>
+PipeWireCapture::nextFrame()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    // The first buffer may come after a while, the next ones only on changes
+    auto timeout = frame_ ? interval_ : std::chrono::steady_clock::duration(NEGOTIATION_TIMEOUT);
+    cv_.wait_for(lk, timeout, [&] { return fresh_ || failed_; });
+    if (failed_)
+        return {};
+    fresh_ = false;
+    return frame_;
+}
+
+int
+PipeWireCapture::width() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return info_.size.width;
+}
+
+int
+PipeWireCapture::height() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return info_.size.height;
+}
+
+AVPixelFormat
+PipeWireCapture::format() const
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return pixelFormat(info_.format);
+}
+
+} // namespace video
+} // namespace jami
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "screen_capture.h"
+#include "noncopyable.h"
+#ifdef RING_ACCEL
+#include "video/accel.h"
+#endif
+
+#include <pipewire/pipewire.h>
+#include <spa/param/video/format-utils.h>
+
+#include <condition_variable>
+#include <mutex>
+
+namespace jami {
+namespace video {
+
+/**
+ * Screen cast stream of the xdg-desktop-portal, e.g. on Wayland. The client opens the
+ * portal session and gives the PipeWire remote and node of the stream.
+ *
+ * DMA-BUF buffers are imported with VAAPI and converted on the device, for the hardware
+ * encoders. The others, or without VAAPI, are copied to main memory.
+ */
+class PipeWireCapture : public ScreenCapture
+{
+public:
+    /**
+     * @param fd    PipeWire remote of the portal, duplicated
+     * @param node  Of the screen cast stream
+     * @return nullptr if the stream couldn't be negotiated
+     */
+    static std::unique_ptr<PipeWireCapture> open(int fd,
+                                                 uint32_t node,
+                                                 rational<double> framerate);
+    ~PipeWireCapture();
+
+    std::shared_ptr<VideoFrame> nextFrame() override;
+
+    int width() const override;
+    int height() const override;
+    AVPixelFormat format() const override;
+    rational<double> framerate() const override { return framerate_; }
+
+private:
+    NON_COPYABLE(PipeWireCapture);
+    explicit PipeWireCapture(rational<double> framerate);
+
+    bool connect(int fd, uint32_t node);
+    // On the thread of the loop
+    static void onStateChanged(void* data,
+                               pw_stream_state old,
+                               pw_stream_state state,
+                               const char* error);
+    static void onParamChanged(void* data, uint32_t id, const spa_pod* param);
+    static void onProcess(void* data);
+    std::shared_ptr<VideoFrame> copyBuffer(const spa_buffer& buffer);
+#ifdef RING_ACCEL
+    std::shared_ptr<VideoFrame> importDmaBuf(const spa_buffer& buffer);
+    bool initDevice();
+#endif
+
+    pw_thread_loop* loop_ {nullptr};
+    pw_context* context_ {nullptr};
+    pw_core* core_ {nullptr};
+    pw_stream* stream_ {nullptr};
+    spa_hook listener_ {};
+
+    rational<double> framerate_;
+    std::chrono::steady_clock::duration interval_ {};
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool negotiated_ {false};
+    bool failed_ {false};
+    spa_video_info_raw info_ {};
+    bool dmabuf_ {false};
+    std::shared_ptr<VideoFrame> frame_;
+    bool fresh_ {false};
+
+#ifdef RING_ACCEL
+    // Of the negotiated size, null if VAAPI can't import the buffers
+    AVBufferRef* drmDevice_ {nullptr};
+    AVBufferRef* drmFrames_ {nullptr};
+    AVBufferRef* vaapiDevice_ {nullptr};
+    AVBufferRef* vaapiFrames_ {nullptr};
+    bool deviceFailed_ {false};
+    HardwareScaler scaler_;
+#endif
+};
+
+} // namespace video
+} // namespace jami
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "screen_capture.h"
+#include "logger.h"
+#include "string_utils.h"
+
+#if HAVE_PIPEWIRE
+#include "pipewire_capture.h"
+#endif
+#if HAVE_XSHM
+#include "x11_capture.h"
+#endif
+
+namespace jami {
+namespace video {
+
+std::unique_ptr<ScreenCapture>
+createScreenCapture(const DeviceParams& params)
+{
+    if (params.format == "pipewire") {
+#if HAVE_PIPEWIRE
+        // <remote fd>:<node>
+        auto ids = split_string_to_unsigned(params.input, ':');
+        if (ids.size() == 2)
+            return PipeWireCapture::open(ids[0], ids[1], params.framerate);
+        JAMI_ERR("Invalid screen cast: %s", params.input.c_str());
+#else
+        JAMI_ERR("Screen cast not supported, built without PipeWire");
+#endif
+        return {};
+    }
+#if HAVE_XSHM
+    // XDamage only tracks the screen, windows are still read by x11grab
+    if (params.format == "x11grab" && params.window_id.empty())
+        return X11Capture::open(params);
+#endif
+    return {};
+}
+
+} // namespace video
+} // namespace jami
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "libav_deps.h"
+#include "media_device.h"
+#include "media/media_buffer.h"
+
+#include <memory>
+
+namespace jami {
+namespace video {
+
+/**
+ * Capture of a Linux desktop which only copies what changed: the damaged regions of an
+ * X11 screen, or the buffers a PipeWire screen cast (Wayland) sends on changes.
+ */
+class ScreenCapture
+{
+public:
+    virtual ~ScreenCapture() = default;
+
+    /**
+     * Wait for the next frame, at most a frame interval.
+     * @return the previous frame if the screen didn't change, nullptr once the capture failed
+     */
+    virtual std::shared_ptr<VideoFrame> nextFrame() = 0;
+
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    // Of the frames in main memory, the ones on a device are converted from it
+    virtual AVPixelFormat format() const = 0;
+    virtual rational<double> framerate() const = 0;
+};
+
+/**
+ * @param params    Of a screen, see VideoInput::initX11()
+ * @return nullptr if not a screen sharing, or not supported: x11grab is used instead
+ */
+std::unique_ptr<ScreenCapture> createScreenCapture(const DeviceParams& params);
+
+} // namespace video
+} // namespace jami
@@ -25,6 +25,8 @@
 #include <climits>
 #include <cstring>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -45,6 +47,8 @@ extern "C" {
 #include "../video_device.h"
 #include "string_utils.h"
 
+#include <fmt/core.h>
+
 #define ZEROVAR(x) std::memset(&(x), 0, sizeof(x))
 
 namespace jami {
@@ -124,9 +128,10 @@ class VideoDeviceImpl
 {
 public:
     /**
+     * @param revision  Of the firmware of the device, if known
      * @throw std::runtime_error
      */
-    VideoDeviceImpl(const std::string& id, const std::string& path);
+    VideoDeviceImpl(const std::string& id, const std::string& path, const std::string& revision);
 
     std::string unique_id;
     std::string path;
@@ -149,6 +154,40 @@ private:
     VideoV4l2Rate rate_;
 };
 
+/**
+ * Channels of the devices probed so far, by device, bus and firmware. Some cameras
+ * take seconds to enumerate their sizes and rates, they are probed again only if
+ * they change.
+ */
+class V4l2CapabilitiesCache
+{
+public:
+    static V4l2CapabilitiesCache& instance()
+    {
+        static V4l2CapabilitiesCache cache;
+        return cache;
+    }
+
+    std::optional<std::vector<VideoV4l2Channel>> get(const std::string& key) const
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto it = channels_.find(key);
+        if (it == channels_.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    void set(const std::string& key, std::vector<VideoV4l2Channel> channels)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        channels_[key] = std::move(channels);
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, std::vector<VideoV4l2Channel>> channels_;
+};
+
 static const unsigned pixelformats_supported[] = {
     /* pixel format        depth  description   */
 
@@ -432,7 +471,9 @@ VideoV4l2Channel::getSize(VideoSize s) const
     return sizes_.front();
 }
 
-VideoDeviceImpl::VideoDeviceImpl(const string& id, const std::string& path)
+VideoDeviceImpl::VideoDeviceImpl(const string& id,
+                                 const std::string& path,
+                                 const std::string& revision)
     : unique_id(id)
     , path(path)
     , name()
@@ -462,6 +503,20 @@ VideoDeviceImpl::VideoDeviceImpl(const string& id, const std::string& path)
 
     name = string(reinterpret_cast<const char*>(cap.card));
 
+    const auto cacheKey = fmt::format("{}/{}/{}/{}/{}",
+                                      id,
+                                      name,
+                                      reinterpret_cast<const char*>(cap.bus_info),
+                                      cap.version,
+                                      revision);
+    auto& cache = V4l2CapabilitiesCache::instance();
+    if (auto channels = cache.get(cacheKey)) {
+        JAMI_DBG("Using the cached capabilities of %s", name.c_str());
+        channels_ = std::move(*channels);
+        ::close(fd);
+        return;
+    }
+
     v4l2_input input;
     ZEROVAR(input);
     unsigned idx;
@@ -481,6 +536,7 @@ VideoDeviceImpl::VideoDeviceImpl(const string& id, const std::string& path)
     }
 
     ::close(fd);
+    cache.set(cacheKey, channels_);
 }
 
 string
@@ -609,9 +665,14 @@ VideoDevice::VideoDevice(const std::string& id,
                          const std::vector<std::map<std::string, std::string>>& devInfo)
     : id_(id)
 {
-    deviceImpl_ = std::make_shared<VideoDeviceImpl>(id,
-                                                    devInfo.empty() ? id
-                                                                    : devInfo.at(0).at("devPath"));
+    std::string path = id, revision;
+    if (not devInfo.empty()) {
+        path = devInfo.at(0).at("devPath");
+        auto it = devInfo.at(0).find("revision");
+        if (it != devInfo.at(0).end())
+            revision = it->second;
+    }
+    deviceImpl_ = std::make_shared<VideoDeviceImpl>(id, path, revision);
     name = deviceImpl_->name;
 }
 
@@ -21,10 +21,12 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <libudev.h>
+#include <map>
 #include <mutex>
 #include <sstream>
 #include <stdexcept> // for std::runtime_error
@@ -73,12 +75,17 @@ private:
     VideoDeviceMonitor* monitor_;
 
     void run();
+    /**
+     * Probe the devices already plugged, from the monitoring thread as some
+     * cameras are slow to enumerate their capabilities.
+     */
+    void enumerateDevices();
     std::thread thread_;
     mutable std::mutex mutex_;
 
     udev* udev_;
     udev_monitor* udev_mon_;
-    bool probing_;
+    std::atomic_bool probing_;
 };
 
 std::string
@@ -97,6 +104,16 @@ is_v4l2(struct udev_device* dev)
     return version and strcmp(version, "1");
 }
 
+static std::vector<std::map<std::string, std::string>>
+getDeviceInfo(struct udev_device* dev, const char* path)
+{
+    std::map<std::string, std::string> info {{"devPath", path}};
+    // lets the cached capabilities be probed again after a firmware update
+    if (auto revision = udev_device_get_property_value(dev, "ID_REVISION"))
+        info.emplace("revision", revision);
+    return {std::move(info)};
+}
+
 VideoDeviceMonitorImpl::VideoDeviceMonitorImpl(VideoDeviceMonitor* monitor)
     : monitor_(monitor)
     , thread_()
@@ -105,9 +122,6 @@ VideoDeviceMonitorImpl::VideoDeviceMonitorImpl(VideoDeviceMonitor* monitor)
     , udev_mon_(0)
     , probing_(false)
 {
-    udev_list_entry* devlist;
-    udev_enumerate* devenum;
-
     udev_ = udev_new();
     if (!udev_)
         goto udev_failed;
@@ -118,6 +132,30 @@ VideoDeviceMonitorImpl::VideoDeviceMonitorImpl(VideoDeviceMonitor* monitor)
     if (udev_monitor_filter_add_match_subsystem_devtype(udev_mon_, "video4linux", NULL))
         goto udev_failed;
 
+    udev_monitor_enable_receiving(udev_mon_);
+    return;
+
+udev_failed:
+
+    JAMI_ERR("udev initialization failed");
+
+    if (udev_mon_)
+        udev_monitor_unref(udev_mon_);
+    if (udev_)
+        udev_unref(udev_);
+    udev_mon_ = NULL;
+    udev_ = NULL;
+}
+
+void
+VideoDeviceMonitorImpl::enumerateDevices()
+{
+    udev_list_entry* devlist;
+    udev_enumerate* devenum;
+
+    if (!udev_)
+        goto udev_failed;
+
     /* Enumerate existing devices */
     devenum = udev_enumerate_new(udev_);
     if (devenum == NULL)
@@ -127,7 +165,6 @@ VideoDeviceMonitorImpl::VideoDeviceMonitorImpl(VideoDeviceMonitor* monitor)
         goto udev_failed;
     }
 
-    udev_monitor_enable_receiving(udev_mon_);
     /* Note that we enumerate _after_ monitoring is enabled so that we do not
      * loose device events occuring while we are enumerating. We could still
      * loose events if the Netlink socket receive buffer overflows. */
@@ -136,6 +173,8 @@ VideoDeviceMonitorImpl::VideoDeviceMonitorImpl(VideoDeviceMonitor* monitor)
     struct udev_list_entry* deventry;
     udev_list_entry_foreach(deventry, devlist)
     {
+        if (!probing_)
+            break;
         const char* path = udev_list_entry_get_name(deventry);
         struct udev_device* dev = udev_device_new_from_syspath(udev_, path);
 
@@ -143,16 +182,17 @@ VideoDeviceMonitorImpl::VideoDeviceMonitorImpl(VideoDeviceMonitor* monitor)
             const char* path = udev_device_get_devnode(dev);
             if (path && std::string(path).find("/dev") != 0) {
                 // udev_device_get_devnode will fail
+                udev_device_unref(dev);
                 continue;
             }
             try {
                 auto unique_name = getDeviceString(dev);
                 JAMI_DBG("udev: adding device with id %s", unique_name.c_str());
-                if (monitor_->addDevice(unique_name, {{{"devPath", path}}}))
+                if (monitor_->addDevice(unique_name, getDeviceInfo(dev, path)))
                     currentPathToId_.emplace(path, unique_name);
             } catch (const std::exception& e) {
                 JAMI_WARN("udev: %s, fallback on path (your camera may be a fake camera)", e.what());
-                if (monitor_->addDevice(path, {{{"devPath", path}}}))
+                if (monitor_->addDevice(path, getDeviceInfo(dev, path)))
                     currentPathToId_.emplace(path, path);
             }
         }
@@ -166,15 +206,8 @@ udev_failed:
 
     JAMI_ERR("udev enumeration failed");
 
-    if (udev_mon_)
-        udev_monitor_unref(udev_mon_);
-    if (udev_)
-        udev_unref(udev_);
-    udev_mon_ = NULL;
-    udev_ = NULL;
-
     /* fallback : go through /dev/video* */
-    for (int idx = 0;; ++idx) {
+    for (int idx = 0; probing_; ++idx) {
         try {
             if (!monitor_->addDevice("/dev/video" + std::to_string(idx)))
                 break;
@@ -206,6 +239,8 @@ VideoDeviceMonitorImpl::~VideoDeviceMonitorImpl()
 void
 VideoDeviceMonitorImpl::run()
 {
+    enumerateDevices();
+
     if (!udev_mon_) {
         probing_ = false;
         return;
@@ -236,7 +271,7 @@ VideoDeviceMonitorImpl::run()
                     const char* action = udev_device_get_action(dev);
                     if (!strcmp(action, "add")) {
                         JAMI_DBG("udev: adding device with id %s", unique_name.c_str());
-                        if (monitor_->addDevice(unique_name, {{{"devPath", path}}}))
+                        if (monitor_->addDevice(unique_name, getDeviceInfo(dev, path)))
                             currentPathToId_.emplace(path, unique_name);
                     } else if (!strcmp(action, "remove")) {
                         auto it = currentPathToId_.find(path);
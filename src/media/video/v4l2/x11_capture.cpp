@@ -0,0 +1,335 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "x11_capture.h"
+#include "logger.h"
+#include "string_utils.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace jami {
+namespace video {
+
+static constexpr int BYTES_PER_PIXEL {4};
+
+std::unique_ptr<X11Capture>
+X11Capture::open(const DeviceParams& params)
+{
+    std::unique_ptr<X11Capture> capture(new X11Capture);
+    if (not capture->init(params))
+        return {};
+    JAMI_DBG("[x11:%p] Capturing %dx%d from %d,%d with XDamage",
+             capture.get(),
+             capture->width_,
+             capture->height_,
+             capture->x_,
+             capture->y_);
+    return capture;
+}
+
+X11Capture::~X11Capture()
+{
+    if (conn_) {
+        if (seg_)
+            xcb_shm_detach(conn_, seg_);
+        if (damage_)
+            xcb_damage_destroy(conn_, damage_);
+        if (region_)
+            xcb_xfixes_destroy_region(conn_, region_);
+        xcb_disconnect(conn_);
+    }
+    if (shm_)
+        shmdt(shm_);
+}
+
+bool
+X11Capture::init(const DeviceParams& params)
+{
+    // e.g. ":1+882,211", the area starting at 882,211 of the display :1
+    const auto& input = params.input;
+    auto plus = input.find('+');
+    auto display = input.substr(0, plus);
+    if (plus != std::string::npos) {
+        auto offset = split_string_to_unsigned(input.substr(plus + 1), ',');
+        if (offset.size() == 2) {
+            x_ = offset[0];
+            y_ = offset[1];
+        }
+    }
+
+    int screenNum = 0;
+    conn_ = xcb_connect(display.empty() ? nullptr : display.c_str(), &screenNum);
+    if (xcb_connection_has_error(conn_)) {
+        JAMI_WARN("Unable to connect to the X11 display %s", display.c_str());
+        return false;
+    }
+    auto it = xcb_setup_roots_iterator(xcb_get_setup(conn_));
+    for (int i = 0; i < screenNum && it.rem; ++i)
+        xcb_screen_next(&it);
+    if (not it.rem)
+        return false;
+    auto screen = it.data;
+    root_ = screen->root;
+    if (screen->root_depth != 24 && screen->root_depth != 32)
+        return false;
+    if (x_ >= screen->width_in_pixels || y_ >= screen->height_in_pixels)
+        return false;
+    width_ = params.width ? params.width : screen->width_in_pixels;
+    height_ = params.height ? params.height : screen->height_in_pixels;
+    // Within the screen, of 8 pixel blocks
+    width_ = std::min(width_, screen->width_in_pixels - x_) & ~7;
+    height_ = std::min(height_, screen->height_in_pixels - y_) & ~7;
+    if (width_ <= 0 || height_ <= 0)
+        return false;
+
+    auto shm = xcb_get_extension_data(conn_, &xcb_shm_id);
+    auto damage = xcb_get_extension_data(conn_, &xcb_damage_id);
+    auto xfixes = xcb_get_extension_data(conn_, &xcb_xfixes_id);
+    if (!shm || !shm->present || !damage || !damage->present || !xfixes || !xfixes->present) {
+        JAMI_WARN("The X11 display doesn't have the MIT-SHM, XDamage or XFixes extensions");
+        return false;
+    }
+    damageEvent_ = damage->first_event;
+    // Required before using them
+    free(xcb_xfixes_query_version_reply(conn_, xcb_xfixes_query_version(conn_, 2, 0), nullptr));
+    free(xcb_damage_query_version_reply(conn_, xcb_damage_query_version(conn_, 1, 1), nullptr));
+
+    damage_ = xcb_generate_id(conn_);
+    xcb_damage_create(conn_, damage_, root_, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+    region_ = xcb_generate_id(conn_);
+    xcb_xfixes_create_region(conn_, region_, 0, nullptr);
+
+    // Of the largest region, the whole area
+    shmId_ = shmget(IPC_PRIVATE, width_ * height_ * BYTES_PER_PIXEL, IPC_CREAT | 0600);
+    if (shmId_ < 0)
+        return false;
+    auto addr = shmat(shmId_, nullptr, 0);
+    if (addr == reinterpret_cast<void*>(-1)) {
+        shmctl(shmId_, IPC_RMID, nullptr);
+        return false;
+    }
+    shm_ = static_cast<uint8_t*>(addr);
+    auto seg = xcb_generate_id(conn_);
+    auto error = xcb_request_check(conn_, xcb_shm_attach_checked(conn_, seg, shmId_, false));
+    // Released once detached by both
+    shmctl(shmId_, IPC_RMID, nullptr);
+    if (error) {
+        // e.g. a remote display
+        JAMI_WARN("Unable to share memory with the X11 server");
+        free(error);
+        return false;
+    }
+    seg_ = seg;
+
+    if (params.framerate.real() > 0)
+        framerate_ = params.framerate;
+    interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1. / framerate_.real()));
+    next_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+void
+X11Capture::addDamage(std::vector<Rect>& damage, Rect rect, int width, int height)
+{
+    auto x0 = std::max(rect.x, 0);
+    auto y0 = std::max(rect.y, 0);
+    auto x1 = std::min(rect.x + rect.w, width);
+    auto y1 = std::min(rect.y + rect.h, height);
+    if (x1 <= x0 || y1 <= y0)
+        return;
+    if (damage.size() >= MAX_RECTS) {
+        for (const auto& r : damage) {
+            x0 = std::min(x0, r.x);
+            y0 = std::min(y0, r.y);
+            x1 = std::max(x1, r.x + r.w);
+            y1 = std::max(y1, r.y + r.h);
+        }
+        damage.clear();
+    }
+    damage.emplace_back(Rect {x0, y0, x1 - x0, y1 - y0});
+}
+
+std::vector<X11Capture::Rect>
+X11Capture::fetchDamage()
+{
+    bool damaged = false;
+    while (auto event = xcb_poll_for_event(conn_)) {
+        if ((event->response_type & ~0x80) == damageEvent_ + XCB_DAMAGE_NOTIFY)
+            damaged = true;
+        free(event);
+    }
+    std::vector<Rect> damage;
+    if (not damaged)
+        return damage;
+
+    // Moves the damage to region_, the next one is notified again
+    xcb_damage_subtract(conn_, damage_, XCB_NONE, region_);
+    auto reply = xcb_xfixes_fetch_region_reply(conn_,
+                                               xcb_xfixes_fetch_region(conn_, region_),
+                                               nullptr);
+    if (not reply) {
+        damage.emplace_back(Rect {0, 0, width_, height_});
+        return damage;
+    }
+    auto rects = xcb_xfixes_fetch_region_rectangles(reply);
+    auto count = xcb_xfixes_fetch_region_rectangles_length(reply);
+    for (int i = 0; i < count; ++i)
+        addDamage(damage,
+                  {rects[i].x - x_, rects[i].y - y_, rects[i].width, rects[i].height},
+                  width_,
+                  height_);
+    free(reply);
+    return damage;
+}
+
+X11Capture::Buffer*
+X11Capture::takeBuffer()
+{
+    // Not held by the consumers anymore
+    for (auto& buffer : buffers_)
+        if (buffer.frame.use_count() == 1 && av_frame_is_writable(buffer.frame->pointer()))
+            return &buffer;
+    if (buffers_.size() >= MAX_BUFFERS)
+        return nullptr;
+    try {
+        auto frame = std::make_shared<VideoFrame>();
+        frame->reserve(AV_PIX_FMT_BGR0, width_, height_);
+        buffers_.emplace_back(Buffer {std::move(frame), {{0, 0, width_, height_}}});
+    } catch (const std::exception& e) {
+        JAMI_ERR("[x11:%p] Unable to allocate a frame: %s", this, e.what());
+        return nullptr;
+    }
+    return &buffers_.back();
+}
+
+bool
+X11Capture::copyRect(VideoFrame& frame, const Rect& rect)
+{
+    auto cookie = xcb_shm_get_image(conn_,
+                                    root_,
+                                    x_ + rect.x,
+                                    y_ + rect.y,
+                                    rect.w,
+                                    rect.h,
+                                    ~0u,
+                                    XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                    seg_,
+                                    0);
+    auto reply = xcb_shm_get_image_reply(conn_, cookie, nullptr);
+    if (not reply)
+        return false;
+    free(reply);
+
+    auto f = frame.pointer();
+    auto rowSize = rect.w * BYTES_PER_PIXEL;
+    for (int row = 0; row < rect.h; ++row)
+        std::memcpy(f->data[0] + (rect.y + row) * f->linesize[0] + rect.x * BYTES_PER_PIXEL,
+                    shm_ + row * rowSize,
+                    rowSize);
+    return true;
+}
+
+void
+X11Capture::drawCursor(Buffer& buffer, const xcb_xfixes_get_cursor_image_reply_t& cursor)
+{
+    Rect rect {cursor.x - cursor.xhot - x_,
+               cursor.y - cursor.yhot - y_,
+               cursor.width,
+               cursor.height};
+    buffer.cursor = rect;
+    // Premultiplied ARGB
+    auto image = xcb_xfixes_get_cursor_image_cursor_image(&cursor);
+    auto f = buffer.frame->pointer();
+    auto x0 = std::max(rect.x, 0);
+    auto y0 = std::max(rect.y, 0);
+    auto x1 = std::min(rect.x + rect.w, width_);
+    auto y1 = std::min(rect.y + rect.h, height_);
+    for (int y = y0; y < y1; ++y) {
+        auto src = image + (y - rect.y) * rect.w + (x0 - rect.x);
+        auto dst = f->data[0] + y * f->linesize[0] + x0 * BYTES_PER_PIXEL;
+        for (int x = x0; x < x1; ++x, ++src, dst += BYTES_PER_PIXEL) {
+            uint32_t alpha = *src >> 24;
+            if (not alpha)
+                continue;
+            // B, G then R, as in the frame
+            for (int c = 0; c < 3; ++c)
+                dst[c] = ((*src >> (8 * c)) & 0xff) + dst[c] * (255 - alpha) / 255;
+        }
+    }
+}
+
+std::shared_ptr<VideoFrame>
+X11Capture::nextFrame()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (next_ > now)
+        std::this_thread::sleep_until(next_);
+    // A late frame doesn't shorten the next interval
+    next_ = std::max(next_, now) + interval_;
+    if (xcb_connection_has_error(conn_)) {
+        JAMI_ERR("[x11:%p] Lost the connection to the display", this);
+        return {};
+    }
+
+    auto damage = fetchDamage();
+    std::unique_ptr<xcb_xfixes_get_cursor_image_reply_t, decltype(&free)>
+        cursor(xcb_xfixes_get_cursor_image_reply(conn_,
+                                                 xcb_xfixes_get_cursor_image(conn_),
+                                                 nullptr),
+               &free);
+    bool cursorMoved = cursor
+                       and (cursor->cursor_serial != cursorSerial_
+                            or cursor->x - cursor->xhot - x_ != lastCursor_.x
+                            or cursor->y - cursor->yhot - y_ != lastCursor_.y);
+    if (damage.empty() and not cursorMoved and last_)
+        return last_;
+
+    for (auto& buffer : buffers_)
+        for (const auto& rect : damage)
+            addDamage(buffer.damage, rect, width_, height_);
+    auto buffer = takeBuffer();
+    if (not buffer) {
+        // Every frame is still used, the damage is kept for later
+        return last_;
+    }
+    addDamage(buffer->damage, buffer->cursor, width_, height_);
+    for (const auto& rect : buffer->damage) {
+        if (not copyRect(*buffer->frame, rect)) {
+            JAMI_ERR("[x11:%p] Unable to read the screen", this);
+            return {};
+        }
+    }
+    buffer->damage.clear();
+    buffer->cursor = {0, 0, 0, 0};
+    if (cursor) {
+        drawCursor(*buffer, *cursor);
+        cursorSerial_ = cursor->cursor_serial;
+    }
+    lastCursor_ = buffer->cursor;
+    last_ = buffer->frame;
+    return last_;
+}
+
+} // namespace video
+} // namespace jami
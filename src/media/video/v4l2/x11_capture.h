@@ -0,0 +1,113 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "screen_capture.h"
+#include "noncopyable.h"
+
+#include <xcb/xcb.h>
+#include <xcb/damage.h>
+#include <xcb/shm.h>
+#include <xcb/xfixes.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace jami {
+namespace video {
+
+/**
+ * Area of an X11 screen, read through MIT-SHM. XDamage tells which regions changed,
+ * only those are copied into the frame, which is republished as is while nothing changes.
+ */
+class X11Capture : public ScreenCapture
+{
+public:
+    // Frames kept for the consumers, each one updated with the damage since its last use
+    static constexpr size_t MAX_BUFFERS {4};
+    // Beyond, the damage of a buffer is merged into its bounding box
+    static constexpr size_t MAX_RECTS {16};
+
+    struct Rect
+    {
+        int x, y, w, h;
+    };
+
+    /**
+     * @param params    x11grab input, e.g. ":1+882,211" with its size
+     * @return nullptr if the display doesn't have the MIT-SHM, XFixes or XDamage extensions
+     */
+    static std::unique_ptr<X11Capture> open(const DeviceParams& params);
+    ~X11Capture();
+
+    std::shared_ptr<VideoFrame> nextFrame() override;
+
+    int width() const override { return width_; }
+    int height() const override { return height_; }
+    AVPixelFormat format() const override { return AV_PIX_FMT_BGR0; }
+    rational<double> framerate() const override { return framerate_; }
+
+    /**
+     * Add a rectangle to a damage list, clipped to width x height
+     */
+    static void addDamage(std::vector<Rect>& damage, Rect rect, int width, int height);
+
+private:
+    NON_COPYABLE(X11Capture);
+    X11Capture() = default;
+
+    struct Buffer
+    {
+        std::shared_ptr<VideoFrame> frame;
+        std::vector<Rect> damage;
+        // Of the cursor drawn in the frame, captured again before the frame is reused
+        Rect cursor {0, 0, 0, 0};
+    };
+
+    bool init(const DeviceParams& params);
+    std::vector<Rect> fetchDamage();
+    Buffer* takeBuffer();
+    bool copyRect(VideoFrame& frame, const Rect& rect);
+    void drawCursor(Buffer& buffer, const xcb_xfixes_get_cursor_image_reply_t& cursor);
+
+    xcb_connection_t* conn_ {nullptr};
+    xcb_window_t root_ {};
+    uint8_t damageEvent_ {0};
+    xcb_damage_damage_t damage_ {};
+    xcb_xfixes_region_t region_ {};
+    xcb_shm_seg_t seg_ {};
+    int shmId_ {-1};
+    uint8_t* shm_ {nullptr};
+
+    int x_ {0};
+    int y_ {0};
+    int width_ {0};
+    int height_ {0};
+    rational<double> framerate_ {30};
+    std::chrono::steady_clock::duration interval_ {};
+    std::chrono::steady_clock::time_point next_ {};
+
+    std::vector<Buffer> buffers_;
+    std::shared_ptr<VideoFrame> last_;
+    uint32_t cursorSerial_ {0};
+    Rect lastCursor_ {0, 0, 0, 0};
+};
+
+} // namespace video
+} // namespace jami
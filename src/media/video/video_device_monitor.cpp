@@ -192,16 +192,21 @@ VideoDeviceMonitor::addDevice(const string& id,
                               const std::vector<std::map<std::string, std::string>>& devInfo)
 {
     try {
-        std::lock_guard<std::mutex> l(lock_);
-        if (findDeviceById(id) != devices_.end())
-            return false;
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            if (findDeviceById(id) != devices_.end())
+                return false;
+        }
 
-        // instantiate a new unique device
+        // instantiate a new unique device, probing it can take seconds
         VideoDevice dev {id, devInfo};
 
         if (dev.getChannelList().empty())
             return false;
 
+        std::lock_guard<std::mutex> l(lock_);
+        if (findDeviceById(id) != devices_.end())
+            return false;
         giveUniqueName(dev, devices_);
 
         // restore its preferences if any, or store the defaults
@@ -213,8 +218,10 @@ VideoDeviceMonitor::addDevice(const string& id,
             preferences_.emplace_back(dev.getSettings());
         }
 
-        // in case there is no default device on a fresh run
-        if (defaultDevice_.empty() && id != DEVICE_DESKTOP)
+        // in case there is no default device on a fresh run, or the preferred one is
+        // probed after the preferences were loaded
+        if (id != DEVICE_DESKTOP
+            and (defaultDevice_.empty() or preferences_.front().unique_id == id))
             defaultDevice_ = dev.getDeviceId();
 
         devices_.emplace_back(std::move(dev));
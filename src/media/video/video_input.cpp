@@ -34,6 +34,10 @@
 #include "sinkclient.h"
 #include "logger.h"
 #include "media/media_buffer.h"
+#include "tracepoint.h"
+#if defined(__linux__) && !defined(__ANDROID__)
+#include "v4l2/screen_capture.h"
+#endif
 
 #include <libavformat/avio.h>
 
@@ -59,7 +63,9 @@ VideoInput::VideoInput(VideoInputMode inputMode, const std::string& id_)
     : VideoGenerator::VideoGenerator()
     , loop_(std::bind(&VideoInput::setup, this),
             std::bind(&VideoInput::process, this),
-            std::bind(&VideoInput::cleanup, this))
+            std::bind(&VideoInput::cleanup, this),
+            ThreadRole::VIDEO,
+            "jami:video_in")
 {
     inputMode_ = inputMode;
     if (inputMode_ == VideoInputMode::Undefined) {
@@ -119,7 +125,7 @@ VideoInput::switchDevice()
 int
 VideoInput::getWidth() const
 {
-    if (videoManagedByClient()) {
+    if (videoManagedByClient() or not decoder_) {
         return decOpts_.width;
     }
     return decoder_->getWidth();
@@ -128,7 +134,7 @@ VideoInput::getWidth() const
 int
 VideoInput::getHeight() const
 {
-    if (videoManagedByClient()) {
+    if (videoManagedByClient() or not decoder_) {
         return decOpts_.height;
     }
     return decoder_->getHeight();
@@ -138,6 +144,8 @@ AVPixelFormat
 VideoInput::getPixelFormat() const
 {
     if (!videoManagedByClient()) {
+        if (not decoder_)
+            return av_get_pix_fmt(decOpts_.pixel_format.c_str());
         return decoder_->getPixelFormat();
     }
     return (AVPixelFormat) std::stoi(decOpts_.format);
@@ -212,6 +220,10 @@ bool
 VideoInput::captureFrame()
 {
     // Return true if capture could continue, false if must be stop
+#if defined(__linux__) && !defined(__ANDROID__)
+    if (screen_)
+        return captureScreen();
+#endif
     if (not decoder_)
         return false;
 
@@ -226,6 +238,28 @@ VideoInput::captureFrame()
         return true;
     }
 }
+
+#if defined(__linux__) && !defined(__ANDROID__)
+bool
+VideoInput::captureScreen()
+{
+    auto frame = screen_->nextFrame();
+    if (not frame) {
+        JAMI_ERR() << "Failed to capture the screen";
+        return false;
+    }
+    // A screen cast follows the size of the shared window or output
+    if (frame->width() != (int) decOpts_.width || frame->height() != (int) decOpts_.height) {
+        decOpts_.width = frame->width();
+        decOpts_.height = frame->height();
+        sink_->setFrameSize(decOpts_.width, decOpts_.height);
+    }
+    jami_tracepoint(media_frame_capture, "video", frame->pointer());
+    publishFrame(std::move(frame));
+    return true;
+}
+#endif
+
 void
 VideoInput::flushBuffers()
 {
@@ -237,7 +271,8 @@ VideoInput::flushBuffers()
 void
 VideoInput::configureFilePlayback(const std::string&,
                                   std::shared_ptr<MediaDemuxer>& demuxer,
-                                  int index)
+                                  int index,
+                                  std::chrono::microseconds decodeAhead)
 {
     deleteDecoder();
     clearOptions();
@@ -252,6 +287,7 @@ VideoInput::configureFilePlayback(const std::string&,
     decoder->setInterruptCallback(
         [](void* data) -> int { return not static_cast<VideoInput*>(data)->isCapturing(); }, this);
     decoder->emulateRate();
+    decoder->setDecodeAhead(decodeAhead);
 
     decoder_ = std::move(decoder);
     playingFile_ = true;
@@ -273,8 +309,33 @@ VideoInput::createDecoder()
         return;
     }
 
+#if defined(__linux__) && !defined(__ANDROID__)
+    if ((screen_ = createScreenCapture(decOpts_))) {
+        decOpts_.width = screen_->width();
+        decOpts_.height = screen_->height();
+        decOpts_.framerate = screen_->framerate();
+        decOpts_.pixel_format = av_get_pix_fmt_name(screen_->format());
+        JAMI_DBG("Capturing the screen: size=%dX%d, fps=%lf pix=%s",
+                 decOpts_.width,
+                 decOpts_.height,
+                 decOpts_.framerate.real(),
+                 decOpts_.pixel_format.c_str());
+        if (onSuccessfulSetup_)
+            onSuccessfulSetup_(MEDIA_VIDEO, 0);
+        foundDecOpts(decOpts_);
+        sink_->setFrameSize(decOpts_.width, decOpts_.height);
+        return;
+    }
+    if (decOpts_.format == "pipewire") {
+        // Not readable by libavdevice
+        foundDecOpts(decOpts_);
+        return;
+    }
+#endif
+
     auto decoder = std::make_unique<MediaDecoder>(
         [this](const std::shared_ptr<MediaFrame>& frame) mutable {
+            jami_tracepoint(media_frame_capture, "video", frame->pointer());
             publishFrame(std::static_pointer_cast<VideoFrame>(frame));
         });
 
@@ -355,6 +416,9 @@ VideoInput::createDecoder()
 void
 VideoInput::deleteDecoder()
 {
+#if defined(__linux__) && !defined(__ANDROID__)
+    screen_.reset();
+#endif
     if (not decoder_)
         return;
     flushFrames();
@@ -404,6 +468,17 @@ VideoInput::initX11(const std::string& display)
     // full screen sharing : :1+0,0 2560x1440 - SCREEN 1, POSITION 0X0, RESOLUTION 2560X1440
     // area sharing : :1+882,211 1532x779 - SCREEN 1, POSITION 882x211, RESOLUTION 1532x779
     // window sharing : :+1,0 0x0 window-id:0x0340021e - POSITION 0X0
+    // screen cast of the portal : pipewire:27:54 - PIPEWIRE REMOTE FD 27, NODE 54
+    static constexpr std::string_view pipewire {"pipewire:"};
+    if (display.compare(0, pipewire.size(), pipewire) == 0) {
+        clearOptions();
+        decOpts_ = jami::getVideoDeviceMonitor().getDeviceParams(DEVICE_DESKTOP);
+        decOpts_.format = "pipewire";
+        decOpts_.input = display.substr(pipewire.size());
+        // Its size is known once opened by createDecoder()
+        return false;
+    }
+
     size_t space = display.find(' ');
     std::string windowIdStr = "window-id:";
     size_t winIdPos = display.find(windowIdStr);
@@ -27,6 +27,7 @@
 #include "media_stream.h"
 #include "media/media_device.h" // DeviceParams
 #include "media/video/video_base.h"
+#include "media/video/video_tier_encoder.h"
 #include "media_codec.h"
 
 #include <map>
@@ -36,6 +37,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <array>
+#include <chrono>
 
 #if __APPLE__
 #import "TargetConditionals.h"
@@ -50,6 +52,9 @@ namespace jami {
 namespace video {
 
 class SinkClient;
+#if defined(__linux__) && !defined(__ANDROID__)
+class ScreenCapture;
+#endif
 
 enum class VideoInputMode { ManagedByClient, ManagedByDaemon, Undefined };
 
@@ -77,9 +82,14 @@ public:
 
     void setSink(const std::string& sinkId);
     void updateStartTime(int64_t startTime);
+    /**
+     * @param decodeAhead  Duration of frames decoded before they are due, 0 to decode each frame
+     *                     when it is shown
+     */
     void configureFilePlayback(const std::string& path,
                                std::shared_ptr<MediaDemuxer>& demuxer,
-                               int index);
+                               int index,
+                               std::chrono::microseconds decodeAhead = {});
     void flushBuffers();
     void setPaused(bool paused) { paused_ = paused; }
     void setSeekTime(int64_t time);
@@ -110,6 +120,17 @@ public:
      */
     void restart();
 
+    /**
+     * @return encoder of the input, shared by the calls of the same codec,
+     * resolution and tier
+     */
+    std::shared_ptr<VideoTierEncoder> getTierEncoder(const MediaStream& stream,
+                                                     const MediaDescription& args,
+                                                     unsigned tier)
+    {
+        return tierEncoders_.get(stream, args, tier);
+    }
+
 private:
     NON_COPYABLE(VideoInput);
 
@@ -145,6 +166,11 @@ private:
     void createDecoder();
     void deleteDecoder();
     std::unique_ptr<MediaDecoder> decoder_;
+#if defined(__linux__) && !defined(__ANDROID__)
+    // Instead of the decoder, for the screens it supports
+    std::unique_ptr<ScreenCapture> screen_;
+    bool captureScreen();
+#endif
     std::shared_ptr<SinkClient> sink_;
     ThreadLoop loop_;
 
@@ -167,6 +193,8 @@ private:
     std::atomic_bool paused_ {true};
 
     std::function<void(MediaType, bool)> onSuccessfulSetup_;
+
+    VideoTierEncoders tierEncoders_ {*this};
 };
 
 } // namespace video
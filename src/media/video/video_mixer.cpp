@@ -29,14 +29,21 @@
 #include "sinkclient.h"
 #include "logger.h"
 #include "filter_transpose.h"
+#include "video_tier_encoder.h"
+#include "tracepoint.h"
+#include "metrics.h"
 #ifdef RING_ACCEL
 #include "accel.h"
 #endif
 #include "sip/sip_utils.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
 #include <unistd.h>
 #include <mutex>
+#include <thread>
 
 #include "videomanager_interface.h"
 #include <opendht/thread_pool.h>
@@ -47,23 +54,43 @@ static constexpr auto MIN_LINE_ZOOM
 namespace jami {
 namespace video {
 
+#ifdef RING_ACCEL
+static metrics::Gauge&
+deviceScaledMixers()
+{
+    static auto& gauge = metrics::Registry::instance().gauge(
+        "jami_mixer_device_scaled", "Mixers sending their only source as scaled on its device");
+    return gauge;
+}
+#endif
+
 struct VideoMixer::VideoMixerSource
 {
     Observable<std::shared_ptr<MediaFrame>>* source {nullptr};
     int rotation {0};
     std::unique_ptr<MediaFilter> rotationFilter {nullptr};
     std::shared_ptr<VideoFrame> render_frame;
+    // One per source, tiles are scaled concurrently and the contexts are kept
+    // between frames
+    VideoScaler scaler;
     void atomic_copy(const VideoFrame& other)
     {
         std::lock_guard<std::mutex> lock(mutex_);
         auto newFrame = std::make_shared<VideoFrame>();
         newFrame->copyFrom(other);
+        jami_tracepoint(media_frame_link, other.pointer(), newFrame->pointer());
         render_frame = newFrame;
+        generation_++;
     }
 
-    std::shared_ptr<VideoFrame> getRenderFrame()
+    /**
+     * @param generation    Set to the number of frames received
+     */
+    std::shared_ptr<VideoFrame> getRenderFrame(uint64_t* generation = nullptr)
     {
         std::lock_guard<std::mutex> lock(mutex_);
+        if (generation)
+            *generation = generation_;
         return render_frame;
     }
 
@@ -74,8 +101,14 @@ struct VideoMixer::VideoMixerSource
     int h {};
     bool hasVideo {true};
 
+    // What is drawn on the canvas
+    uint64_t renderedGeneration {0};
+    int renderedWidth {0};
+    int renderedHeight {0};
+
 private:
     std::mutex mutex_;
+    uint64_t generation_ {0};
 };
 
 static constexpr const auto MIXER_FRAMERATE = 30;
@@ -85,7 +118,14 @@ VideoMixer::VideoMixer(const std::string& id, const std::string& localInput, boo
     : VideoGenerator::VideoGenerator()
     , id_(id)
     , sink_(Manager::instance().createSinkClient(id, true))
-    , loop_([] { return true; }, std::bind(&VideoMixer::process, this), [] {})
+    , loop_(
+          [this] {
+              process();
+              nextProcess_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                  FRAME_DURATION);
+              return nextProcess_;
+          },
+          ThreadRole::VIDEO)
 {
     // Local video camera is the main participant
     if (not localInput.empty() && attachHost) {
@@ -95,8 +135,8 @@ VideoMixer::VideoMixer(const std::string& id, const std::string& localInput, boo
                     "",
                     sip_utils::streamId("", sip_utils::DEFAULT_VIDEO_STREAMID));
     }
-    loop_.start();
-    nextProcess_ = std::chrono::steady_clock::now();
+    nextProcess_ = MediaLoop::clock::now();
+    loop_.start(nextProcess_);
 
     JAMI_DBG("[mixer:%s] New instance created", id_.c_str());
 }
@@ -108,6 +148,12 @@ VideoMixer::~VideoMixer()
 
     loop_.join();
 
+    tiers_.clear();
+#ifdef RING_ACCEL
+    if (deviceFrame_)
+        deviceScaledMixers().add(-1);
+#endif
+
     JAMI_DBG("[mixer:%s] Instance destroyed", id_.c_str());
 }
 
@@ -168,6 +214,37 @@ VideoMixer::setActiveStream(const std::string& id)
     updateLayout();
 }
 
+void
+VideoMixer::setSpeaker(const std::string& id)
+{
+    {
+        std::lock_guard<std::mutex> lk(speakerMtx_);
+        if (speakerStream_ == id)
+            return;
+        speakerStream_ = id;
+    }
+    if (activeStream_.empty())
+        layoutUpdated_ += 1;
+}
+
+std::string
+VideoMixer::getShownStream()
+{
+    if (not activeStream_.empty())
+        return activeStream_;
+    std::lock_guard<std::mutex> lk(speakerMtx_);
+    return speakerStream_;
+}
+
+bool
+VideoMixer::verifyShown(const std::string& id)
+{
+    if (not activeStream_.empty())
+        return activeStream_ == id;
+    std::lock_guard<std::mutex> lk(speakerMtx_);
+    return speakerStream_ == id;
+}
+
 void
 VideoMixer::updateLayout()
 {
@@ -251,20 +328,9 @@ VideoMixer::update(Observable<std::shared_ptr<MediaFrame>>* ob,
 
     for (const auto& x : sources_) {
         if (x->source == ob) {
-#ifdef RING_ACCEL
-            std::shared_ptr<VideoFrame> frame;
-            try {
-                frame = HardwareAccel::transferToMainMemory(*std::static_pointer_cast<VideoFrame>(
-                                                                frame_p),
-                                                            AV_PIX_FMT_NV12);
-                x->atomic_copy(*std::static_pointer_cast<VideoFrame>(frame));
-            } catch (const std::runtime_error& e) {
-                JAMI_ERR("[mixer:%s] Accel failure: %s", id_.c_str(), e.what());
-                return;
-            }
-#else
+            // Hardware frames are kept on the device, and only transferred
+            // by render_frame() if the tile needs to be drawn
             x->atomic_copy(*std::static_pointer_cast<VideoFrame>(frame_p));
-#endif
             return;
         }
     }
@@ -273,26 +339,11 @@ VideoMixer::update(Observable<std::shared_ptr<MediaFrame>>* ob,
 void
 VideoMixer::process()
 {
-    nextProcess_ += std::chrono::duration_cast<std::chrono::microseconds>(FRAME_DURATION);
-    const auto delay = nextProcess_ - std::chrono::steady_clock::now();
-    if (delay.count() > 0)
-        std::this_thread::sleep_for(delay);
-
     // Nothing to do.
     if (width_ == 0 or height_ == 0) {
         return;
     }
 
-    VideoFrame& output = getNewFrame();
-    try {
-        output.reserve(format_, width_, height_);
-    } catch (const std::bad_alloc& e) {
-        JAMI_ERR("[mixer:%s] VideoFrame::allocBuffer() failed", id_.c_str());
-        return;
-    }
-
-    libav_utils::fillWithBlack(output.pointer());
-
     {
         std::lock_guard<std::mutex> lk(audioOnlySourcesMtx_);
         std::shared_lock lock(rwMutex_);
@@ -303,9 +354,11 @@ VideoMixer::process()
         bool successfullyRendered = audioOnlySources_.size() != 0 && sources_.size() == 0;
         std::vector<SourceInfo> sourcesInfo;
         sourcesInfo.reserve(sources_.size() + audioOnlySources_.size());
+        std::vector<Tile> tiles;
+        tiles.reserve(sources_.size());
         // add all audioonlysources
         for (auto& [callId, streamId] : audioOnlySources_) {
-            auto active = verifyActive(streamId);
+            auto active = verifyShown(streamId);
             if (currentLayout_ != Layout::ONE_BIG or active) {
                 sourcesInfo.emplace_back(SourceInfo {{}, 0, 0, 10, 10, false, callId, streamId});
             }
@@ -319,11 +372,12 @@ VideoMixer::process()
                 return;
 
             auto sinfo = streamInfo(x->source);
-            auto activeSource = verifyActive(sinfo.streamId);
+            auto activeSource = verifyShown(sinfo.streamId);
             if (currentLayout_ != Layout::ONE_BIG or activeSource) {
                 // make rendered frame temporarily unavailable for update()
                 // to avoid concurrent access.
-                std::shared_ptr<VideoFrame> input = x->getRenderFrame();
+                uint64_t generation;
+                std::shared_ptr<VideoFrame> input = x->getRenderFrame(&generation);
                 std::shared_ptr<VideoFrame> fooInput = std::make_shared<VideoFrame>();
 
                 auto wantedIndex = i;
@@ -361,9 +415,13 @@ VideoMixer::process()
                     calc_position(x, fooInput, wantedIndex);
 
                 if (!blackFrame) {
-                    if (fooInput)
-                        successfullyRendered |= render_frame(output, fooInput, x);
-                    else
+                    // Rendered after the loop, once every position is known
+                    if (fooInput) {
+                        if (canRender(fooInput)) {
+                            tiles.emplace_back(Tile {x.get(), fooInput, generation});
+                            successfullyRendered = true;
+                        }
+                    } else
                         JAMI_WARN("[mixer:%s] Nothing to render for %p", id_.c_str(), x->source);
                 }
 
@@ -382,6 +440,51 @@ VideoMixer::process()
 
             ++i;
         }
+        std::shared_ptr<VideoFrame> deviceFrame;
+#ifdef RING_ACCEL
+        // A source alone on the canvas is scaled on its device, so hardware encoders
+        // take it without a transfer to main memory
+        if (tiles.size() == 1)
+            deviceFrame = scaleOnDevice(tiles.front());
+        if (bool(deviceFrame) != bool(deviceFrame_)) {
+            JAMI_DBG("[mixer:%s] Hardware transcoding %s",
+                     id_.c_str(),
+                     deviceFrame ? "started" : "stopped");
+            deviceScaledMixers().add(deviceFrame ? 1 : -1);
+        }
+        // The canvas wasn't drawn meanwhile
+        bool stale = deviceFrame_ and not deviceFrame;
+        deviceFrame_ = deviceFrame;
+#else
+        bool stale = false;
+#endif
+        // The canvas is kept between frames, only the sources which received a
+        // frame are drawn again unless the layout changed
+        bool redraw = needsUpdate or stale or !canvas_ or canvas_->width() != width_
+                      or canvas_->height() != height_ or canvas_->format() != format_;
+        for (const auto& tile : tiles)
+            redraw |= tile.frame->width() != tile.source->renderedWidth
+                      or tile.frame->height() != tile.source->renderedHeight;
+        if (not redraw)
+            tiles.erase(std::remove_if(tiles.begin(),
+                                       tiles.end(),
+                                       [](const Tile& tile) {
+                                           return tile.generation
+                                                  == tile.source->renderedGeneration;
+                                       }),
+                        tiles.end());
+        // Left as is while on the device
+        if (not deviceFrame and (redraw or not tiles.empty())) {
+            if (not prepareCanvas(redraw))
+                return;
+            render_tiles(*canvas_, tiles);
+            for (const auto& tile : tiles) {
+                jami_tracepoint(media_frame_link, tile.frame->pointer(), canvas_->pointer());
+                tile.source->renderedGeneration = tile.generation;
+                tile.source->renderedWidth = tile.frame->width();
+                tile.source->renderedHeight = tile.frame->height();
+            }
+        }
         if (needsUpdate and successfullyRendered) {
             layoutUpdated_ -= 1;
             if (layoutUpdated_ == 0) {
@@ -402,6 +505,16 @@ VideoMixer::process()
         }
     }
 
+    // Shares the canvas buffer, copied by prepareCanvas() if still used when
+    // the canvas changes
+    VideoFrame& output = getNewFrame();
+#ifdef RING_ACCEL
+    const auto& source = deviceFrame_ ? *deviceFrame_ : *canvas_;
+#else
+    const auto& source = *canvas_;
+#endif
+    output.copyFrom(source);
+    jami_tracepoint(media_frame_link, source.pointer(), output.pointer());
     output.pointer()->pts = av_rescale_q_rnd(av_gettime() - startTime_,
                                              {1, AV_TIME_BASE},
                                              {1, MIXER_FRAMERATE},
@@ -411,41 +524,163 @@ VideoMixer::process()
     publishFrame();
 }
 
+#ifdef RING_ACCEL
+std::shared_ptr<VideoFrame>
+VideoMixer::scaleOnDevice(const Tile& tile)
+{
+    auto& source = *tile.source;
+    if (source.x != 0 or source.y != 0 or source.w != width_ or source.h != height_
+        or tile.frame->getOrientation() != 0 or not HardwareScaler::canScale(*tile.frame))
+        return {};
+    // No new frame from the source
+    if (deviceFrame_ and tile.generation == source.renderedGeneration)
+        return deviceFrame_;
+
+    if (not hwScaler_)
+        hwScaler_ = std::make_unique<HardwareScaler>();
+    std::shared_ptr<VideoFrame> frame = hwScaler_->scale(*tile.frame, width_, height_);
+    if (frame) {
+        jami_tracepoint(media_frame_link, tile.frame->pointer(), frame->pointer());
+        source.renderedGeneration = tile.generation;
+    }
+    return frame;
+}
+#endif
+
 bool
-VideoMixer::render_frame(VideoFrame& output,
-                         const std::shared_ptr<VideoFrame>& input,
-                         std::unique_ptr<VideoMixerSource>& source)
+VideoMixer::prepareCanvas(bool clear)
 {
-    if (!width_ or !height_ or !input->pointer() or input->pointer()->format == -1)
+    try {
+        if (!canvas_ or canvas_->width() != width_ or canvas_->height() != height_
+            or canvas_->format() != format_) {
+            canvas_ = std::make_unique<VideoFrame>();
+            canvas_->reserve(format_, width_, height_);
+            clear = true;
+        } else if (av_frame_make_writable(canvas_->pointer()) < 0) {
+            throw std::bad_alloc();
+        }
+    } catch (const std::bad_alloc& e) {
+        JAMI_ERR("[mixer:%s] VideoFrame::allocBuffer() failed", id_.c_str());
+        canvas_.reset();
         return false;
+    }
+    if (clear)
+        libav_utils::fillWithBlack(canvas_->pointer());
+    return true;
+}
 
-    int cell_width = source->w;
-    int cell_height = source->h;
-    int xoff = source->x;
-    int yoff = source->y;
+bool
+VideoMixer::canRender(const std::shared_ptr<VideoFrame>& input) const
+{
+    return width_ and height_ and input->pointer() and input->pointer()->format != -1;
+}
+
+void
+VideoMixer::render_frame(VideoFrame& output,
+                         const std::shared_ptr<VideoFrame>& hwInput,
+                         VideoMixerSource& source)
+{
+    int cell_width = source.w;
+    int cell_height = source.h;
+    int xoff = source.x;
+    int yoff = source.y;
+
+#ifdef RING_ACCEL
+    std::shared_ptr<VideoFrame> input;
+    try {
+        input = HardwareAccel::transferToMainMemory(*hwInput, AV_PIX_FMT_NV12);
+    } catch (const std::runtime_error& e) {
+        JAMI_ERR("[mixer:%s] Accel failure: %s", id_.c_str(), e.what());
+        return;
+    }
+#else
+    const auto& input = hwInput;
+#endif
 
     int angle = input->getOrientation();
     const constexpr char filterIn[] = "mixin";
-    if (angle != source->rotation) {
-        source->rotationFilter = video::getTransposeFilter(angle,
-                                                           filterIn,
-                                                           input->width(),
-                                                           input->height(),
-                                                           input->format(),
-                                                           false);
-        source->rotation = angle;
+    std::shared_ptr<VideoFrame> frame = video::rotateFrame(*input, angle);
+    if (not frame) {
+        // Formats not rotated by rotateFrame
+        if (angle != source.rotation) {
+            source.rotationFilter = video::getTransposeFilter(angle,
+                                                              filterIn,
+                                                              input->width(),
+                                                              input->height(),
+                                                              input->format(),
+                                                              false);
+            source.rotation = angle;
+        }
+        if (source.rotationFilter) {
+            source.rotationFilter->feedInput(input->pointer(), filterIn);
+            frame = std::static_pointer_cast<VideoFrame>(
+                std::shared_ptr<MediaFrame>(source.rotationFilter->readOutput()));
+        } else {
+            frame = input;
+        }
     }
-    std::shared_ptr<VideoFrame> frame;
-    if (source->rotationFilter) {
-        source->rotationFilter->feedInput(input->pointer(), filterIn);
-        frame = std::static_pointer_cast<VideoFrame>(
-            std::shared_ptr<MediaFrame>(source->rotationFilter->readOutput()));
-    } else {
-        frame = input;
+
+    source.scaler.scale_and_pad(*frame, output, xoff, yoff, cell_width, cell_height, true);
+}
+
+bool
+VideoMixer::tilesOverlap(const std::vector<Tile>& tiles)
+{
+    // Bounds rounded to even pixels, as subsampled chroma rows are shared by
+    // two pixels
+    auto lower = [](int v) { return v & ~1; };
+    auto upper = [](int v) { return (v + 1) & ~1; };
+    for (auto a = tiles.begin(); a != tiles.end(); ++a) {
+        const auto& s = *a->source;
+        for (auto b = std::next(a); b != tiles.end(); ++b) {
+            const auto& o = *b->source;
+            if (lower(s.x) < upper(o.x + o.w) and lower(o.x) < upper(s.x + s.w)
+                and lower(s.y) < upper(o.y + o.h) and lower(o.y) < upper(s.y + s.h))
+                return true;
+        }
+    }
+    return false;
+}
+
+void
+VideoMixer::render_tiles(VideoFrame& output, const std::vector<Tile>& tiles)
+{
+    auto helpers = std::min<std::size_t>(tiles.size() - 1, std::thread::hardware_concurrency());
+    if (tiles.size() < 2 or helpers == 0 or tilesOverlap(tiles)) {
+        for (const auto& tile : tiles)
+            render_frame(output, tile.frame, *tile.source);
+        return;
     }
 
-    scaler_.scale_and_pad(*frame, output, xoff, yoff, cell_width, cell_height, true);
-    return true;
+    // Tiles are claimed one by one by this thread and the helpers. A helper
+    // started after the last tile is claimed only touches the shared state.
+    struct State
+    {
+        std::atomic_size_t next {0};
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::size_t rendered {0};
+    };
+    auto state = std::make_shared<State>();
+    auto work = [this, state, size = tiles.size(), &output, &tiles] {
+        std::size_t count = 0;
+        for (auto i = state->next++; i < size; i = state->next++) {
+            render_frame(output, tiles[i].frame, *tiles[i].source);
+            count++;
+        }
+        if (count == 0)
+            return;
+        std::lock_guard<std::mutex> lk(state->mutex);
+        state->rendered += count;
+        if (state->rendered == size)
+            state->cv.notify_all();
+    };
+    auto& pool = dht::ThreadPool::computation();
+    for (std::size_t i = 0; i < helpers; ++i)
+        pool.run(work);
+    work();
+    std::unique_lock<std::mutex> lk(state->mutex);
+    state->cv.wait(lk, [&] { return state->rendered == tiles.size(); });
 }
 
 void
@@ -596,5 +831,11 @@ VideoMixer::getStream(const std::string& name) const
     return ms;
 }
 
+std::shared_ptr<VideoTierEncoder>
+VideoMixer::getTierEncoder(const MediaDescription& args, unsigned tier)
+{
+    return tiers_.get(getStream("Video Tier"), args, tier);
+}
+
 } // namespace video
 } // namespace jami
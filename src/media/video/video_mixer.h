@@ -24,18 +24,25 @@
 #include "noncopyable.h"
 #include "video_base.h"
 #include "video_scaler.h"
-#include "threadloop.h"
+#include "media_executor.h"
 #include "media_stream.h"
+#include "video_tier_encoder.h"
 
 #include <list>
 #include <chrono>
+#include <map>
 #include <memory>
 #include <shared_mutex>
+#include <vector>
 
 namespace jami {
+
+struct MediaDescription;
+
 namespace video {
 
 class SinkClient;
+class HardwareScaler;
 
 struct StreamInfo
 {
@@ -94,7 +101,17 @@ public:
         updateLayout();
     }
 
+    /**
+     * Stream shown instead of the active one while there is none, e.g. the one of the
+     * participant speaking
+     */
+    void setSpeaker(const std::string& id);
+
     bool verifyActive(const std::string& id) { return activeStream_ == id; }
+    /**
+     * The active stream, or the one of the speaker, empty if none
+     */
+    std::string getShownStream();
 
     void setVideoLayout(Layout newLayout)
     {
@@ -110,6 +127,11 @@ public:
 
     MediaStream getStream(const std::string& name) const;
 
+    /**
+     * @return encoder of the mix, shared by the senders of the same codec and tier
+     */
+    std::shared_ptr<VideoTierEncoder> getTierEncoder(const MediaDescription& args, unsigned tier);
+
     std::shared_ptr<VideoFrameActiveWriter> getVideoLocal() const
     {
         if (!localInputs_.empty())
@@ -156,9 +178,46 @@ private:
     NON_COPYABLE(VideoMixer);
     struct VideoMixerSource;
 
-    bool render_frame(VideoFrame& output,
+    struct Tile
+    {
+        VideoMixerSource* source;
+        std::shared_ptr<VideoFrame> frame;
+        uint64_t generation;
+    };
+
+    /**
+     * The active stream, or the one of the speaker while there is no active stream
+     */
+    bool verifyShown(const std::string& id);
+
+    /**
+     * Make the canvas writable, allocate it if the parameters changed
+     * @param clear     Fill it with black
+     */
+    bool prepareCanvas(bool clear);
+
+    bool canRender(const std::shared_ptr<VideoFrame>& input) const;
+    /**
+     * Draw the tile of the source
+     * @param input    May be on the device, it's then transferred to main memory
+     */
+    void render_frame(VideoFrame& output,
                       const std::shared_ptr<VideoFrame>& input,
-                      std::unique_ptr<VideoMixerSource>& source);
+                      VideoMixerSource& source);
+    /**
+     * Scale the tiles into the output, concurrently if they don't overlap.
+     * Return once all are rendered.
+     */
+    void render_tiles(VideoFrame& output, const std::vector<Tile>& tiles);
+    static bool tilesOverlap(const std::vector<Tile>& tiles);
+
+#ifdef RING_ACCEL
+    /**
+     * The frame of a tile filling the canvas, scaled on its device
+     * @return nullptr if the tile is not on a device, or not alone on the canvas
+     */
+    std::shared_ptr<VideoFrame> scaleOnDevice(const Tile& tile);
+#endif
 
     void calc_position(std::unique_ptr<VideoMixerSource>& source,
                        const std::shared_ptr<VideoFrame>& input,
@@ -177,14 +236,20 @@ private:
 
     std::shared_ptr<SinkClient> sink_;
 
-    std::chrono::time_point<std::chrono::steady_clock> nextProcess_;
+    MediaLoop::clock::time_point nextProcess_;
     std::mutex localInputsMtx_;
     std::vector<std::shared_ptr<VideoFrameActiveWriter>> localInputs_ {};
     void stopInput(const std::shared_ptr<VideoFrameActiveWriter>& input);
 
-    VideoScaler scaler_;
+    // Composed frame, kept between ticks so unchanged tiles are not rendered again
+    std::unique_ptr<VideoFrame> canvas_;
+#ifdef RING_ACCEL
+    // Sent instead of the canvas while set
+    std::shared_ptr<VideoFrame> deviceFrame_;
+    std::unique_ptr<HardwareScaler> hwScaler_;
+#endif
 
-    ThreadLoop loop_; // as to be last member
+    MediaLoop loop_; // as to be last member
 
     Layout currentLayout_ {Layout::GRID};
     std::list<std::unique_ptr<VideoMixerSource>> sources_;
@@ -196,6 +261,10 @@ private:
     std::mutex audioOnlySourcesMtx_;
     std::set<std::pair<std::string, std::string>> audioOnlySources_;
     std::string activeStream_ {};
+    std::mutex speakerMtx_;
+    std::string speakerStream_ {};
+
+    VideoTierEncoders tiers_ {*this};
 
     std::atomic_int layoutUpdated_ {0};
     OnSourcesUpdatedCb onSourcesUpdated_ {};
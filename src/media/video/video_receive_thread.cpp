@@ -42,6 +42,9 @@ namespace video {
 
 using std::string;
 
+// Of the RTP timestamps, for every video payload
+static constexpr unsigned VIDEO_CLOCK_RATE {90000};
+
 VideoReceiveThread::VideoReceiveThread(const std::string& id,
                                        bool useSink,
                                        const std::string& sdp,
@@ -56,7 +59,9 @@ VideoReceiveThread::VideoReceiveThread(const std::string& id,
     , mtu_(mtu)
     , loop_(std::bind(&VideoReceiveThread::setup, this),
             std::bind(&VideoReceiveThread::decodeFrame, this),
-            std::bind(&VideoReceiveThread::cleanup, this))
+            std::bind(&VideoReceiveThread::cleanup, this),
+            ThreadRole::VIDEO,
+            "jami:video_recv")
 {
     JAMI_DBG("[%p] Instance created", this);
 }
@@ -104,6 +109,13 @@ VideoReceiveThread::setup()
                                             displayMatrix.release());
         publishFrame(std::static_pointer_cast<VideoFrame>(frame));
     }));
+    videoDecoder_->setLowLatency(true);
+    videoDecoder_->setPacketObserver(
+        [this](const AVPacket& packet, const AVCodecParameters& par, AVRational timeBase) {
+            std::lock_guard<std::mutex> lk(packetObserverMutex_);
+            if (packetObserver_)
+                packetObserver_(packet, par, timeBase);
+        });
     videoDecoder_->setResolutionChangedCallback([this](int width, int height) {
         dstWidth_ = width;
         dstHeight_ = height;
@@ -187,6 +199,11 @@ void
 VideoReceiveThread::addIOContext(SocketPair& socketPair)
 {
     demuxContext_.reset(socketPair.createIOContext(mtu_));
+    // Called while demuxing, from the thread of the loop
+    socketPair.setJitterDelayCallback(VIDEO_CLOCK_RATE, [this](std::chrono::microseconds delay) {
+        if (videoDecoder_)
+            videoDecoder_->setMaxDelay(delay);
+    });
 }
 
 void
@@ -211,6 +228,13 @@ VideoReceiveThread::decodeFrame()
         if (keyFrameRequestCallback_)
             keyFrameRequestCallback_();
     }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastLatencyReport_ > std::chrono::seconds(1)) {
+        // Send the decoding latency in smartInfo
+        Smartools::getInstance().setDecodeLatency(id_, videoDecoder_->getDecodeLatency());
+        lastLatencyReport_ = now;
+    }
 }
 
 bool
@@ -310,6 +334,13 @@ VideoReceiveThread::getInfo() const
     return {};
 }
 
+void
+VideoReceiveThread::setPacketObserver(PacketObserver&& cb)
+{
+    std::lock_guard<std::mutex> lk(packetObserverMutex_);
+    packetObserver_ = std::move(cb);
+}
+
 void
 VideoReceiveThread::setRotation(int angle)
 {
@@ -33,6 +33,7 @@
 #include "noncopyable.h"
 #include "libav_utils.h"
 
+#include <chrono>
 #include <functional>
 #include <map>
 #include <string>
@@ -73,6 +74,12 @@ public:
     int getHeight() const;
     AVPixelFormat getPixelFormat() const;
     MediaStream getInfo() const;
+    const MediaDecoder* getDecoder() const { return videoDecoder_.get(); }
+
+    /**
+     * Also give the received packets to cb before they are decoded, e.g. to record them
+     */
+    void setPacketObserver(PacketObserver&& cb);
 
     /**
      * Set angle of rotation to apply to the video by the decoder
@@ -106,6 +113,7 @@ private:
     bool isVideoConfigured_ {false};
     uint16_t mtu_;
     int rotation_ {0};
+    std::chrono::steady_clock::time_point lastLatencyReport_ {};
 
     std::mutex rotationMtx_;
     libav_utils::AVBufferPtr displayMatrix_;
@@ -123,6 +131,10 @@ private:
 
     std::function<void(void)> keyFrameRequestCallback_;
     std::function<void(MediaType, bool)> onSuccessfulSetup_;
+
+    // Set by another thread than the decoding one
+    std::mutex packetObserverMutex_;
+    PacketObserver packetObserver_;
 };
 
 } // namespace video
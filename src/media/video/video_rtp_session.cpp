@@ -23,7 +23,12 @@
 #include "client/videomanager.h"
 #include "video_rtp_session.h"
 #include "video_sender.h"
+#include "video_tier_encoder.h"
+#include "rtp_forwarder.h"
 #include "video_receive_thread.h"
+#include "media_decoder.h"
+#include "media_encoder.h"
+#include "media_recorder.h"
 #include "video_mixer.h"
 #include "ice_socket.h"
 #include "socket_pair.h"
@@ -40,7 +45,11 @@
 #include "congestion_control.h"
 
 #include "account_const.h"
+#include "media_const.h"
 
+#include <opendht/rng.h>
+
+#include <algorithm>
 #include <sstream>
 #include <map>
 #include <string>
@@ -59,6 +68,18 @@ constexpr auto EXPIRY_TIME_RTCP = std::chrono::seconds(2);
 constexpr auto DELAY_AFTER_REMB_INC = std::chrono::seconds(1);
 constexpr auto DELAY_AFTER_REMB_DEC = std::chrono::milliseconds(500);
 
+static DegradationPreference
+degradationPreference(std::string_view preference, bool screenContent)
+{
+    if (preference == "maintain-framerate")
+        return DegradationPreference::MAINTAIN_FRAMERATE;
+    if (preference == "maintain-resolution")
+        return DegradationPreference::MAINTAIN_RESOLUTION;
+    // The text of a screen stays readable
+    return screenContent ? DegradationPreference::MAINTAIN_RESOLUTION
+                         : DegradationPreference::BALANCED;
+}
+
 VideoRtpSession::VideoRtpSession(const string& callId,
                                  const string& streamId,
                                  const DeviceParams& localVideoParams)
@@ -93,6 +114,14 @@ VideoRtpSession::setRequestKeyFrameCallback(std::function<void(void)> cb)
     cbKeyFrameRequest_ = std::move(cb);
 }
 
+void
+VideoRtpSession::requestKeyFrame()
+{
+    ++keyFramesRequested_;
+    if (cbKeyFrameRequest_)
+        cbKeyFrameRequest_();
+}
+
 void
 VideoRtpSession::startSender()
 {
@@ -109,12 +138,17 @@ VideoRtpSession::startSender()
         return;
     }
 
+    // The packets of the forwarded participant are sent instead
+    if (forwarding_) {
+        socketPair_->stopSendOp(not send_.enabled or send_.onHold);
+        return;
+    }
+
     if (send_.enabled and not send_.onHold) {
         if (sender_) {
             if (videoLocal_)
                 videoLocal_->detach(sender_.get());
-            if (videoMixer_)
-                videoMixer_->detach(sender_.get());
+            detachSenderFromMixer();
             JAMI_WARN("[%p] Restarting video sender", this);
         }
 
@@ -154,13 +188,23 @@ VideoRtpSession::startSender()
         auto codecVideo = std::static_pointer_cast<jami::AccountVideoCodecInfo>(send_.codec);
         auto autoQuality = codecVideo->isAutoQualityEnabled;
 
-        send_.linkableHW = conference_ == nullptr;
+        // In a conference, the mixer sends hardware frames while it scales its only source
+        // on the device
+        send_.linkableHW = true;
+        send_.screenContent = not conference_
+                              and input_.rfind(DRing::Media::VideoProtocolPrefix::DISPLAY, 0) == 0;
         send_.bitrate = videoBitrateInfo_.videoBitrateCurrent;
+        degradation_ = degradationPreference(
+            Manager::instance().videoPreferences.getDegradationPreference(),
+            send_.screenContent);
         // NOTE:
         // Current implementation does not handle resolution change
         // (needed by window sharing feature) with HW codecs, so HW
         // codecs will be disabled for now.
         bool allowHwAccel = (localVideoParams_.format != "x11grab");
+        // With tiers, the sender only sends the packets of its tier
+        if (useEncodingTiers())
+            allowHwAccel = false;
 
         if (socketPair_)
             initSeqVal_ = socketPair_->lastSeqValOut();
@@ -168,22 +212,19 @@ VideoRtpSession::startSender()
         try {
             sender_.reset();
             socketPair_->stopSendOp(false);
-            MediaStream ms
-                = !videoMixer_
-                      ? MediaStream("video sender",
-                                    AV_PIX_FMT_YUV420P,
-                                    1 / static_cast<rational<int>>(localVideoParams_.framerate),
-                                    localVideoParams_.width,
-                                    localVideoParams_.height,
-                                    send_.bitrate,
-                                    static_cast<rational<int>>(localVideoParams_.framerate))
-                      : videoMixer_->getStream("Video Sender");
+            MediaStream ms = !videoMixer_ ? getLocalStream("video sender")
+                                          : videoMixer_->getStream("Video Sender");
             sender_.reset(new VideoSender(
                 getRemoteRtpUri(), ms, send_, *socketPair_, initSeqVal_ + 1, mtu_, allowHwAccel));
             if (changeOrientationCallback_)
                 sender_->setChangeOrientationCallback(changeOrientationCallback_);
-            if (socketPair_)
+            sentPixelRate_ = ms.width * ms.height * ms.frameRate.real();
+            frameRateDivider_ = 1;
+            setFrameRateDivider(frameRateDivider(send_.bitrate));
+            if (socketPair_) {
                 socketPair_->setPacketLossCallback([this]() { cbKeyFrameRequest_(); });
+                socketPair_->setPacingBitrate(send_.bitrate);
+            }
 
         } catch (const MediaEncoderException& e) {
             JAMI_ERR("%s", e.what());
@@ -229,8 +270,7 @@ VideoRtpSession::stopSender()
     if (sender_) {
         if (videoLocal_)
             videoLocal_->detach(sender_.get());
-        if (videoMixer_)
-            videoMixer_->detach(sender_.get());
+        detachSenderFromMixer();
         sender_.reset();
     }
 
@@ -255,7 +295,10 @@ VideoRtpSession::startReceiver()
         receiveThread_->addIOContext(*socketPair_);
         receiveThread_->setSuccessfulSetupCb(onSuccessfulSetup_);
         receiveThread_->startLoop();
-        receiveThread_->setRequestKeyFrameCallback([this]() { cbKeyFrameRequest_(); });
+        receiveThread_->setRequestKeyFrameCallback([this]() {
+            ++keyFramesRequested_;
+            cbKeyFrameRequest_();
+        });
         receiveThread_->setRotation(rotation_.load());
         if (videoMixer_ and conference_) {
             // Note, this should be managed differently, this is a bit hacky
@@ -324,6 +367,10 @@ VideoRtpSession::start(std::unique_ptr<IceSocket> rtp_sock, std::unique_ptr<IceS
         return;
     }
 
+    {
+        std::lock_guard<std::mutex> lk(forwardMutex_);
+        rewriter_.reset();
+    }
     try {
         if (rtp_sock and rtcp_sock) {
             if (send_.addr) {
@@ -338,12 +385,17 @@ VideoRtpSession::start(std::unique_ptr<IceSocket> rtp_sock, std::unique_ptr<IceS
         } else {
             socketPair_.reset(new SocketPair(getRemoteRtpUri().c_str(), receive_.addr.getPort()));
         }
+        socketPair_->setMetrics("video");
+        socketPair_->setRtx(send_.rtxPayloadType, receive_.rtxPayloadType);
+        socketPair_->setFec(send_.fecPayloadType, receive_.fecPayloadType);
 
         last_REMB_inc_ = clock::now();
         last_REMB_dec_ = clock::now();
 
         socketPair_->setRtpDelayCallback(
             [&](int gradient, int deltaT) { delayMonitor(gradient, deltaT); });
+        if (forwardCallback_)
+            socketPair_->setRtpForwardCallback(forwardCallback_);
 
         if (send_.crypto and receive_.crypto) {
             socketPair_->createSRTP(receive_.crypto.getCryptoSuite().c_str(),
@@ -356,6 +408,8 @@ VideoRtpSession::start(std::unique_ptr<IceSocket> rtp_sock, std::unique_ptr<IceS
         return;
     }
 
+    if (forwarding_)
+        initRewriter();
     startSender();
     startReceiver();
 
@@ -390,6 +444,10 @@ VideoRtpSession::stop()
 
     if (socketPair_)
         socketPair_->interrupt();
+    {
+        std::lock_guard<std::mutex> lk(forwardMutex_);
+        rewriter_.reset();
+    }
     socketPair_.reset();
     videoLocal_.reset();
 }
@@ -434,11 +492,30 @@ void
 VideoRtpSession::forceKeyFrame()
 {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
+    ++keyFrameRequestsReceived_;
+    if (forwarding_) {
+        // Only the forwarded participant can send one
+        if (onForwardedKeyFrameRequest_)
+            onForwardedKeyFrameRequest_();
+        return;
+    }
+    const MediaEncoder* encoder = tierEncoder_ ? tierEncoder_->getEncoder()
+                                  : sender_    ? sender_->getEncoder()
+                                               : nullptr;
+    auto interval = encoder and encoder->isIntraRefreshing() ? INTRA_REFRESH_KEY_FRAME_INTERVAL
+                                                             : KEY_FRAME_REQUEST_INTERVAL;
+    // The keyframes burst the bitrate, adding to the loss they answer
+    auto now = clock::now();
+    if (lastRequestedKeyFrame_ != time_point::min() and now - lastRequestedKeyFrame_ < interval)
+        return;
+    lastRequestedKeyFrame_ = now;
 #if __ANDROID__
     if (videoLocal_)
         emitSignal<DRing::VideoSignal::RequestKeyFrame>(videoLocal_->getName());
 #else
-    if (sender_)
+    if (tierEncoder_)
+        tierEncoder_->forceKeyFrame();
+    else if (sender_)
         sender_->forceKeyFrame();
 #endif
 }
@@ -457,7 +534,12 @@ VideoRtpSession::setupVideoPipeline()
     if (sender_) {
         if (videoLocal_) {
             JAMI_DBG("[%p] Setup video pipeline on local capture device", this);
-            videoLocal_->attach(sender_.get());
+            if (useEncodingTiers())
+                attachSenderToTier(
+                    VideoTierEncoder::tierFor(videoBitrateInfo_.videoBitrateCurrent,
+                                              send_.codec->systemCodecInfo));
+            else
+                videoLocal_->attach(sender_.get());
         }
     } else {
         videoLocal_.reset();
@@ -477,8 +559,8 @@ VideoRtpSession::setupConferenceVideoPipeline(Conference& conference, Direction
             // Swap sender from local video to conference video mixer
             if (videoLocal_)
                 videoLocal_->detach(sender_.get());
-            if (videoMixer_)
-                videoMixer_->attach(sender_.get());
+            detachSenderFromMixer();
+            attachSenderToMixer();
         } else {
             JAMI_WARN("[%p] no sender", this);
         }
@@ -497,6 +579,73 @@ VideoRtpSession::setupConferenceVideoPipeline(Conference& conference, Direction
     }
 }
 
+bool
+VideoRtpSession::useEncodingTiers() const
+{
+    if (not send_.codec)
+        return false;
+    const auto& prefs = Manager::instance().videoPreferences;
+    return conference_ ? prefs.getConferenceEncodingTiers() : prefs.getSharedCallEncoders();
+}
+
+MediaStream
+VideoRtpSession::getLocalStream(const std::string& name) const
+{
+    return MediaStream(name,
+                       AV_PIX_FMT_YUV420P,
+                       1 / static_cast<rational<int>>(localVideoParams_.framerate),
+                       localVideoParams_.width,
+                       localVideoParams_.height,
+                       send_.bitrate,
+                       static_cast<rational<int>>(localVideoParams_.framerate));
+}
+
+void
+VideoRtpSession::attachSenderToMixer()
+{
+    if (not videoMixer_ or not sender_)
+        return;
+    if (useEncodingTiers()) {
+        attachSenderToTier(
+            VideoTierEncoder::tierFor(videoBitrateInfo_.videoBitrateCurrent,
+                                      send_.codec->systemCodecInfo));
+    } else {
+        videoMixer_->attach(sender_.get());
+    }
+}
+
+void
+VideoRtpSession::detachSenderFromMixer()
+{
+    if (tierEncoder_) {
+        if (sender_)
+            tierEncoder_->detach(sender_.get());
+        tierEncoder_.reset();
+    }
+    if (videoMixer_ and sender_)
+        videoMixer_->detach(sender_.get());
+}
+
+void
+VideoRtpSession::attachSenderToTier(unsigned tier)
+{
+    std::shared_ptr<VideoTierEncoder> encoder;
+    if (videoMixer_)
+        encoder = videoMixer_->getTierEncoder(send_, tier);
+    else if (videoLocal_)
+        encoder = videoLocal_->getTierEncoder(getLocalStream("Video Tier"), send_, tier);
+    else
+        return;
+    // Packets of two tiers can't be mixed in the same stream
+    if (tierEncoder_)
+        tierEncoder_->detach(sender_.get());
+    tierEncoder_ = std::move(encoder);
+    tier_ = tier;
+    JAMI_DBG("[%p] Sending %s tier %u", this, videoMixer_ ? "conference" : "local", tier_);
+    tierEncoder_->attach(sender_.get());
+    tierEncoder_->forceKeyFrame();
+}
+
 void
 VideoRtpSession::enterConference(Conference& conference)
 {
@@ -529,7 +678,7 @@ VideoRtpSession::exitConference()
 
     if (videoMixer_) {
         if (sender_)
-            videoMixer_->detach(sender_.get());
+            detachSenderFromMixer();
 
         if (receiveThread_) {
             auto activeStream = videoMixer_->verifyActive(streamId_);
@@ -545,6 +694,85 @@ VideoRtpSession::exitConference()
     conference_ = nullptr;
 }
 
+void
+VideoRtpSession::setForwardCallback(std::function<void(const uint8_t*, std::size_t)> cb)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    forwardCallback_ = std::move(cb);
+    if (socketPair_)
+        socketPair_->setRtpForwardCallback(forwardCallback_);
+}
+
+bool
+VideoRtpSession::startForwarding(std::function<void()>&& onKeyFrameRequest)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (not socketPair_ or not send_.enabled or send_.onHold)
+        return false;
+    onForwardedKeyFrameRequest_ = std::move(onKeyFrameRequest);
+    if (forwarding_)
+        return true;
+
+    JAMI_DBG("[%p] Forward the video of the conference", this);
+    // No more encoding, but the socket keeps sending
+    if (sender_) {
+        detachSenderFromMixer();
+        sender_.reset();
+    }
+    forwarding_ = true;
+    initRewriter();
+    return true;
+}
+
+void
+VideoRtpSession::stopForwarding()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    if (not forwarding_)
+        return;
+
+    JAMI_DBG("[%p] Stop forwarding, send the mix", this);
+    {
+        std::lock_guard<std::mutex> lk(forwardMutex_);
+        rewriter_.reset();
+        forwarding_ = false;
+    }
+    onForwardedKeyFrameRequest_ = {};
+    // The new sender follows the sequence numbers forwarded
+    restartSender();
+}
+
+void
+VideoRtpSession::initRewriter()
+{
+    // Concurrency protection must be done by caller.
+    if (not socketPair_)
+        return;
+    // The stream of the peer goes on with the forwarded packets
+    auto ssrc = socketPair_->lastSsrcOut();
+    if (ssrc == 0) {
+        thread_local dht::crypto::random_device rd;
+        ssrc = std::uniform_int_distribution<uint32_t>(1)(rd);
+    }
+    std::lock_guard<std::mutex> lk(forwardMutex_);
+    rewriter_ = std::make_unique<RtpRewriter>(ssrc,
+                                              socketPair_->lastSeqValOut() + 1,
+                                              send_.payload_type);
+}
+
+void
+VideoRtpSession::forwardPacket(const uint8_t* packet, std::size_t size, bool newSource)
+{
+    std::lock_guard<std::mutex> lk(forwardMutex_);
+    if (not rewriter_ or not socketPair_ or size > forwardBuffer_.size())
+        return;
+    std::copy_n(packet, size, forwardBuffer_.begin());
+    if (newSource)
+        rewriter_->switchSource();
+    rewriter_->rewrite(forwardBuffer_.data());
+    socketPair_->writeForwarded(forwardBuffer_.data(), static_cast<int>(size));
+}
+
 bool
 VideoRtpSession::check_RCTP_Info_RR(RTCPInfo& rtcpi)
 {
@@ -573,17 +801,15 @@ VideoRtpSession::check_RCTP_Info_RR(RTCPInfo& rtcpi)
 }
 
 bool
-VideoRtpSession::check_RCTP_Info_REMB(uint64_t* br)
+VideoRtpSession::check_RCTP_Info_REMB(std::vector<uint64_t>* brs)
 {
     auto rtcpInfoVect = socketPair_->getRtcpREMB();
 
-    if (!rtcpInfoVect.empty()) {
-        auto pkt = rtcpInfoVect.back();
+    for (const auto& pkt : rtcpInfoVect) {
         auto temp = cc->parseREMB(pkt);
-        *br = (temp >> 10) | ((temp << 6) & 0xff00) | ((temp << 16) & 0x30000);
-        return true;
+        brs->emplace_back((temp >> 10) | ((temp << 6) & 0xff00) | ((temp << 16) & 0x30000));
     }
-    return false;
+    return not brs->empty();
 }
 
 void
@@ -591,14 +817,20 @@ VideoRtpSession::adaptQualityAndBitrate()
 {
     setupVideoBitrateInfo();
 
-    uint64_t br;
-    if (check_RCTP_Info_REMB(&br)) {
-        delayProcessing(br);
+    std::vector<uint64_t> brs;
+    if (check_RCTP_Info_REMB(&brs)) {
+        // All the requests received since the last check, in one change
+        unsigned newBitrate = videoBitrateInfo_.videoBitrateCurrent;
+        for (auto br : brs)
+            newBitrate = delayProcessing(newBitrate, br);
+        setNewBitrate(newBitrate);
     }
 
     RTCPInfo rtcpi {};
     if (check_RCTP_Info_RR(rtcpi)) {
         dropProcessing(&rtcpi);
+        // The random losses, not fixed by the bitrate, are recovered without retransmission
+        socketPair_->setFecProtection(rtcpi.packetLoss / 100.);
     }
 }
 
@@ -628,8 +860,9 @@ VideoRtpSession::dropProcessing(RTCPInfo* rtcpi)
         // If ponderate drops are inferior to 10% that mean drop are not from congestion but from
         // network...
         // ... we can increase
-        if (pondLoss >= 5.0f && rtcpi->packetLoss > 0.0f) {
-            newBitrate *= 1.0f - rtcpi->packetLoss / 150.0f;
+        if (pondLoss > 10.0f && rtcpi->packetLoss > 0.0f) {
+            // Loss-based controller of draft-ietf-rmcat-gcc
+            newBitrate *= 1.0f - 0.5f * rtcpi->packetLoss / 100.0f;
             histoLoss_.clear();
             lastMediaRestart_ = now;
             JAMI_DBG(
@@ -646,18 +879,22 @@ VideoRtpSession::dropProcessing(RTCPInfo* rtcpi)
     setNewBitrate(newBitrate);
 }
 
-void
-VideoRtpSession::delayProcessing(int br)
+unsigned
+VideoRtpSession::delayProcessing(unsigned bitrate, uint64_t br)
 {
-    int newBitrate = videoBitrateInfo_.videoBitrateCurrent;
-    if (br == 0x6803)
-        newBitrate *= 0.85f;
-    else if (br == 0x7378)
-        newBitrate *= 1.05f;
-    else
-        return;
-
-    setNewBitrate(newBitrate);
+    if (br == 0x6803) {
+        overuseBitrate_ = bitrate;
+        return bitrate * 0.85f;
+    } else if (br == 0x7378) {
+        // Forget an overuse the bitrate went well beyond
+        if (bitrate > overuseBitrate_ * 1.1f)
+            overuseBitrate_ = 0;
+        // Increase fast until close to the bitrate of the last overuse, then slowly
+        if (overuseBitrate_ and bitrate > overuseBitrate_ * 0.9f)
+            return bitrate * 1.02f + 1;
+        return bitrate * 1.08f + 1;
+    }
+    return bitrate;
 }
 
 void
@@ -669,24 +906,70 @@ VideoRtpSession::setNewBitrate(unsigned int newBR)
     if (videoBitrateInfo_.videoBitrateCurrent != newBR) {
         videoBitrateInfo_.videoBitrateCurrent = newBR;
         storeVideoBitrateInfo();
+        if (socketPair_)
+            socketPair_->setPacingBitrate(newBR);
 
 #if __ANDROID__
         if (auto input_device = std::dynamic_pointer_cast<VideoInput>(videoLocal_))
             emitSignal<DRing::VideoSignal::SetBitrate>(input_device->getConfig().name, (int) newBR);
 #endif
 
-        if (sender_) {
+        if (useEncodingTiers()) {
+            // Follow the bitrate by changing of tier, the encoder is shared
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            auto tier = VideoTierEncoder::tierFor(newBR, send_.codec->systemCodecInfo);
+            if (tierEncoder_ and tier != tier_)
+                attachSenderToTier(tier);
+        } else if (sender_) {
             auto ret = sender_->setBitrate(newBR);
+            auto divider = frameRateDivider(newBR);
+            if (ret == 0 and degradation_ != DegradationPreference::MAINTAIN_FRAMERATE
+                and newBR < send_.bitrate and newBR * MAX_FRAME_RATE_DIVIDER >= send_.bitrate) {
+                // Rather than restarting the encoder, stalling the video, it sends fewer
+                // frames, of its bitrate
+                while (divider < MAX_FRAME_RATE_DIVIDER and newBR * divider < send_.bitrate)
+                    divider *= 2;
+                ret = 1;
+            }
+            setFrameRateDivider(divider);
             if (ret == -1)
                 JAMI_ERR("Fail to access the encoder");
             else if (ret == 0)
                 restartSender();
-        } else {
+        } else if (not forwarding_) {
             JAMI_ERR("Fail to access the sender");
         }
     }
 }
 
+unsigned
+VideoRtpSession::frameRateDivider(unsigned br) const
+{
+    if (degradation_ == DegradationPreference::MAINTAIN_FRAMERATE or sentPixelRate_ <= 0)
+        return 1;
+    // Balanced, the frame rate only drops once the picture is very blurred
+    auto minBitsPerPixel = degradation_ == DegradationPreference::BALANCED
+                               ? MIN_BITS_PER_PIXEL / 2
+                               : MIN_BITS_PER_PIXEL;
+    auto bitsPerPixel = 1000. * br / sentPixelRate_;
+    unsigned divider = 1;
+    while (divider < MAX_FRAME_RATE_DIVIDER and bitsPerPixel * divider < minBitsPerPixel)
+        divider *= 2;
+    return divider;
+}
+
+void
+VideoRtpSession::setFrameRateDivider(unsigned divider)
+{
+    if (not sender_ or divider == frameRateDivider_)
+        return;
+    JAMI_DBG("[BandwidthAdapt] Send one frame out of %u instead of %u",
+             divider,
+             frameRateDivider_);
+    frameRateDivider_ = divider;
+    sender_->setFrameRateDivider(divider);
+}
+
 void
 VideoRtpSession::setupVideoBitrateInfo()
 {
@@ -726,9 +1009,54 @@ VideoRtpSession::processRtcpChecker()
     socketPair_->waitForRTCP(std::chrono::seconds(rtcp_checking_interval));
 }
 
+DRing::MediaStreamStats
+VideoRtpSession::getStats()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto stats = RtpSession::getStats();
+    stats.keyFramesRequested = keyFramesRequested_;
+    stats.keyFrameRequestsReceived = keyFrameRequestsReceived_;
+    // The sender only muxes the packets of the tier encoder
+    const MediaEncoder* encoder = nullptr;
+    if (tierEncoder_)
+        encoder = tierEncoder_->getEncoder();
+    else if (sender_)
+        encoder = sender_->getEncoder();
+    if (encoder) {
+        auto encoding = encoder->getStats();
+        stats.framesEncoded = encoding.frames;
+        stats.totalEncodeTime = std::chrono::duration<double>(encoding.encodeTime).count();
+        stats.hardwareEncoding = encoding.hardware;
+    }
+    if (auto decoder = receiveThread_ ? receiveThread_->getDecoder() : nullptr) {
+        auto decoding = decoder->getStats();
+        stats.framesDecoded = decoding.frames;
+        stats.decodeLatency = std::chrono::duration<double>(decoding.latency).count();
+        stats.hardwareDecoding = decoding.hardware;
+    }
+    return stats;
+}
+
 void
 VideoRtpSession::initRecorder(std::shared_ptr<MediaRecorder>& rec)
 {
+    if (rec->isPassthrough()) {
+        // Recorded from their next key frames
+        if (receiveThread_) {
+            receiveThread_->setPacketObserver(
+                rec->addPacketStream(receiveThread_->getInfo().name, true));
+            if (cbKeyFrameRequest_)
+                cbKeyFrameRequest_();
+        }
+        if (sender_ and Manager::instance().videoPreferences.getRecordPreview()) {
+            sender_->setPacketObserver(rec->addPacketStream("v:local", true));
+            if (tierEncoder_)
+                tierEncoder_->forceKeyFrame();
+            else
+                sender_->forceKeyFrame();
+        }
+        return;
+    }
     if (receiveThread_) {
         if (auto ob = rec->addStream(receiveThread_->getInfo())) {
             receiveThread_->attach(ob);
@@ -748,6 +1076,10 @@ VideoRtpSession::deinitRecorder(std::shared_ptr<MediaRecorder>& rec)
 {
     if (!rec)
         return;
+    if (receiveThread_)
+        receiveThread_->setPacketObserver({});
+    if (sender_)
+        sender_->setPacketObserver({});
     if (receiveThread_) {
         if (auto ob = rec->getStream(receiveThread_->getInfo().name)) {
             receiveThread_->detach(ob);
@@ -760,6 +1092,16 @@ VideoRtpSession::deinitRecorder(std::shared_ptr<MediaRecorder>& rec)
     }
 }
 
+bool
+VideoRtpSession::canRecordPackets() const
+{
+    auto canRecord = [](const MediaDescription& media) {
+        return media.codec
+               and MediaRecorder::canPassthrough(media.codec->systemCodecInfo.avcodecId);
+    };
+    return (not receiveThread_ or canRecord(receive_)) and (not sender_ or canRecord(send_));
+}
+
 void
 VideoRtpSession::setChangeOrientationCallback(std::function<void(int)> cb)
 {
@@ -804,7 +1146,7 @@ VideoRtpSession::getPonderateLoss(float lastLoss)
 void
 VideoRtpSession::delayMonitor(int gradient, int deltaT)
 {
-    float estimation = cc->kalmanFilter(gradient);
+    float estimation = cc->trendlineFilter(gradient, deltaT);
     float thresh = cc->get_thresh();
 
     cc->update_thresh(estimation, deltaT);
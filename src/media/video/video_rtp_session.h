@@ -23,12 +23,16 @@
 
 #include "media/rtp_session.h"
 #include "media/media_device.h"
+#include "media/media_stream.h"
 
 #include "video_base.h"
 #include "threadloop.h"
 
+#include <array>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace jami {
 class CongestionControl;
@@ -43,6 +47,8 @@ class VideoInput;
 class VideoMixer;
 class VideoSender;
 class VideoReceiveThread;
+class VideoTierEncoder;
+class RtpRewriter;
 
 struct RTCPInfo
 {
@@ -52,6 +58,9 @@ struct RTCPInfo
     float latency;
 };
 
+// What the video keeps below the bitrate its picture needs, as WebRTC's
+enum class DegradationPreference { BALANCED, MAINTAIN_FRAMERATE, MAINTAIN_RESOLUTION };
+
 struct VideoBitrateInfo
 {
     unsigned videoBitrateCurrent;
@@ -74,6 +83,10 @@ public:
     ~VideoRtpSession();
 
     void setRequestKeyFrameCallback(std::function<void(void)> cb);
+    /**
+     * Ask the peer for a keyframe
+     */
+    void requestKeyFrame();
 
     void updateMedia(const MediaDescription& send, const MediaDescription& receive) override;
 
@@ -96,9 +109,34 @@ public:
     void enterConference(Conference& conference);
     void exitConference();
 
+    /**
+     * Receive the packets of the peer, as they are decoded, for the forwarding of
+     * a conference (see RtpForwarder). Called by the receiving thread, nullptr to stop.
+     */
+    void setForwardCallback(std::function<void(const uint8_t*, std::size_t)> cb);
+    /**
+     * Send the packets of another participant (see forwardPacket) instead of
+     * encoding the mix
+     * @param onKeyFrameRequest     For the keyframes requested by the peer meanwhile
+     * @return false if nothing is sent to the peer
+     */
+    bool startForwarding(std::function<void()>&& onKeyFrameRequest);
+    /**
+     * Encode the mix again
+     */
+    void stopForwarding();
+    bool isForwarding() const { return forwarding_; }
+    /**
+     * @param newSource     The packet comes from another participant than the previous one
+     */
+    void forwardPacket(const uint8_t* packet, std::size_t size, bool newSource);
+
     void setChangeOrientationCallback(std::function<void(int)> cb);
+    DRing::MediaStreamStats getStats() override;
+
     void initRecorder(std::shared_ptr<MediaRecorder>& rec) override;
     void deinitRecorder(std::shared_ptr<MediaRecorder>& rec) override;
+    bool canRecordPackets() const override;
 
     bool hasConference() { return conference_; }
 
@@ -111,10 +149,17 @@ public:
 private:
     void setupConferenceVideoPipeline(Conference& conference, Direction dir);
     void setupVideoPipeline();
+    // The mix, or the local input, is encoded once per tier instead of by each sender
+    bool useEncodingTiers() const;
+    MediaStream getLocalStream(const std::string& name) const;
+    void attachSenderToMixer();
+    void detachSenderFromMixer();
+    void attachSenderToTier(unsigned tier);
     void startSender();
     void stopSender();
     void startReceiver();
     void stopReceiver();
+    void initRewriter();
     using clock = std::chrono::steady_clock;
     using time_point = clock::time_point;
 
@@ -124,13 +169,23 @@ private:
     std::shared_ptr<VideoReceiveThread> receiveThread_;
     Conference* conference_ {nullptr};
     std::shared_ptr<VideoMixer> videoMixer_;
+    std::shared_ptr<VideoTierEncoder> tierEncoder_;
+    unsigned tier_ {0};
     std::shared_ptr<VideoInput> videoLocal_;
     uint16_t initSeqVal_ = 0;
 
     std::function<void(void)> requestKeyFrameCallback_;
 
+    std::function<void(const uint8_t*, std::size_t)> forwardCallback_;
+    std::function<void()> onForwardedKeyFrameRequest_;
+    std::atomic_bool forwarding_ {false};
+    // Protects the forwarded packets from the changes of the sockets
+    std::mutex forwardMutex_;
+    std::unique_ptr<RtpRewriter> rewriter_;
+    std::array<uint8_t, 2048> forwardBuffer_;
+
     bool check_RCTP_Info_RR(RTCPInfo&);
-    bool check_RCTP_Info_REMB(uint64_t*);
+    bool check_RCTP_Info_REMB(std::vector<uint64_t>*);
     void adaptQualityAndBitrate();
     void storeVideoBitrateInfo();
     void setupVideoBitrateInfo();
@@ -138,8 +193,14 @@ private:
     float getPonderateLoss(float lastLoss);
     void delayMonitor(int gradient, int deltaT);
     void dropProcessing(RTCPInfo* rtcpi);
-    void delayProcessing(int br);
+    unsigned delayProcessing(unsigned bitrate, uint64_t br);
     void setNewBitrate(unsigned int newBR);
+    /**
+     * Of the frames encoded by the sender, one out of the divider returned, for the
+     * bits per pixel of the picture at br
+     */
+    unsigned frameRateDivider(unsigned br) const;
+    void setFrameRateDivider(unsigned divider);
 
     // no packet loss can be calculated as no data in input
     static constexpr float NO_INFO_CALCULATED {-1.0};
@@ -167,12 +228,31 @@ private:
     time_point last_REMB_dec_ {time_point::min()};
 
     unsigned remb_dec_cnt_ {0};
+    // Bitrate when the receiver last found an overuse, 0 if far from it
+    unsigned overuseBitrate_ {0};
 
     std::unique_ptr<CongestionControl> cc;
 
     std::function<void(void)> cbKeyFrameRequest_;
 
     std::atomic<int> rotation_ {0};
+
+    std::atomic<uint64_t> keyFramesRequested_ {0};
+    std::atomic<uint64_t> keyFrameRequestsReceived_ {0};
+
+    // Between the keyframes sent for the requests of the peer, the encoders refreshing the
+    // picture only sending them for the decoders that can't start, e.g. missing the SPS
+    static constexpr std::chrono::milliseconds KEY_FRAME_REQUEST_INTERVAL {500};
+    static constexpr std::chrono::seconds INTRA_REFRESH_KEY_FRAME_INTERVAL {5};
+    time_point lastRequestedKeyFrame_ {time_point::min()};
+
+    // Below, the encoders blur the picture: for 640x480 at 30 fps, 370 kbit/s
+    static constexpr double MIN_BITS_PER_PIXEL {0.04};
+    // Down to a quarter of the frames, like dropping two temporal layers
+    static constexpr unsigned MAX_FRAME_RATE_DIVIDER {4};
+    DegradationPreference degradation_ {DegradationPreference::BALANCED};
+    double sentPixelRate_ {0}; // pixels per second of the picture a sender encodes
+    unsigned frameRateDivider_ {1};
 };
 
 } // namespace video
@@ -24,11 +24,179 @@
 #include "media_buffer.h"
 #include "logger.h"
 
+#include <opendht/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 namespace jami {
 namespace video {
 
+// Frames from this size are converted by bands, concurrently
+static constexpr int MIN_THREADED_PIXELS {1280 * 720};
+static constexpr int MIN_BAND_ROWS {32};
+
+/**
+ * Call @fn(begin, end) over bands of [0, rows). For large frames, the bands are claimed one by
+ * one by this thread and helpers of the computation pool, as for the tiles of the mixer: a helper
+ * started after the last band is claimed only touches the shared state.
+ */
+template<typename F>
+static void
+forEachBand(int rows, int pixels, const F& fn)
+{
+    const int bands = pixels < MIN_THREADED_PIXELS
+                          ? 1
+                          : std::clamp(rows / MIN_BAND_ROWS,
+                                       1,
+                                       static_cast<int>(std::thread::hardware_concurrency()));
+    if (bands < 2) {
+        fn(0, rows);
+        return;
+    }
+
+    struct State
+    {
+        std::atomic_int next {0};
+        std::mutex mutex;
+        std::condition_variable cv;
+        int done {0};
+    };
+    auto state = std::make_shared<State>();
+    auto work = [state, bands, rows, &fn] {
+        int count = 0;
+        for (auto i = state->next++; i < bands; i = state->next++) {
+            fn(rows * i / bands, rows * (i + 1) / bands);
+            count++;
+        }
+        if (count == 0)
+            return;
+        std::lock_guard<std::mutex> lk(state->mutex);
+        state->done += count;
+        if (state->done == bands)
+            state->cv.notify_all();
+    };
+    auto& pool = dht::ThreadPool::computation();
+    for (int i = 1; i < bands; ++i)
+        pool.run(work);
+    work();
+    std::unique_lock<std::mutex> lk(state->mutex);
+    state->cv.wait(lk, [&] { return state->done == bands; });
+}
+
+// Loops simple enough to be vectorized by the compiler
+
+static void
+splitChroma(const uint8_t* __restrict uv, uint8_t* __restrict u, uint8_t* __restrict v, int width)
+{
+    for (int x = 0; x < width; ++x) {
+        u[x] = uv[2 * x];
+        v[x] = uv[2 * x + 1];
+    }
+}
+
+static void
+mergeChroma(const uint8_t* __restrict u,
+            const uint8_t* __restrict v,
+            uint8_t* __restrict uv,
+            int width)
+{
+    for (int x = 0; x < width; ++x) {
+        uv[2 * x] = u[x];
+        uv[2 * x + 1] = v[x];
+    }
+}
+
+// Average of each 2x2 block, as the bilinear filter of swscale at this exact ratio
+static void
+halveRow(const uint8_t* __restrict row0,
+         const uint8_t* __restrict row1,
+         uint8_t* __restrict out,
+         int width)
+{
+    for (int x = 0; x < width; ++x)
+        out[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2;
+}
+
+/**
+ * Conversions without swscale, the most frequent between the decoders, the encoders and the
+ * layouts of the mixer: NV12 <-> YUV420P at the same size, and YUV420P halved.
+ * @return false if none applies
+ */
+static bool
+fastScale(const AVFrame* in,
+          uint8_t* const out[4],
+          const int outStride[4],
+          int outWidth,
+          int outHeight,
+          AVPixelFormat outFormat)
+{
+    const auto inFormat = static_cast<AVPixelFormat>(in->format);
+    const int width = in->width;
+    const int height = in->height;
+    const auto* const* src = in->data;
+    const auto* srcStride = in->linesize;
+    const int pixels = outWidth * outHeight;
+
+    if (outWidth == width and outHeight == height and width % 2 == 0 and height % 2 == 0) {
+        const int cw = width / 2;
+        if (inFormat == AV_PIX_FMT_NV12 and outFormat == AV_PIX_FMT_YUV420P) {
+            forEachBand(height / 2, pixels, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y) {
+                    for (int l = 2 * y; l < 2 * y + 2; ++l)
+                        std::memcpy(out[0] + l * outStride[0], src[0] + l * srcStride[0], width);
+                    splitChroma(src[1] + y * srcStride[1],
+                                out[1] + y * outStride[1],
+                                out[2] + y * outStride[2],
+                                cw);
+                }
+            });
+            return true;
+        }
+        if (inFormat == AV_PIX_FMT_YUV420P and outFormat == AV_PIX_FMT_NV12) {
+            forEachBand(height / 2, pixels, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y) {
+                    for (int l = 2 * y; l < 2 * y + 2; ++l)
+                        std::memcpy(out[0] + l * outStride[0], src[0] + l * srcStride[0], width);
+                    mergeChroma(src[1] + y * srcStride[1],
+                                src[2] + y * srcStride[2],
+                                out[1] + y * outStride[1],
+                                cw);
+                }
+            });
+            return true;
+        }
+        return false;
+    }
+
+    if (inFormat == AV_PIX_FMT_YUV420P and outFormat == AV_PIX_FMT_YUV420P
+        and outWidth * 2 == width and outHeight * 2 == height and width % 4 == 0
+        and height % 4 == 0) {
+        // By rows of the output chroma, each of two rows of the output luma
+        forEachBand(outHeight / 2, pixels, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                for (int l = 2 * y; l < 2 * y + 2; ++l)
+                    halveRow(src[0] + 2 * l * srcStride[0],
+                             src[0] + (2 * l + 1) * srcStride[0],
+                             out[0] + l * outStride[0],
+                             outWidth);
+                for (int p = 1; p < 3; ++p)
+                    halveRow(src[p] + 2 * y * srcStride[p],
+                             src[p] + (2 * y + 1) * srcStride[p],
+                             out[p] + y * outStride[p],
+                             outWidth / 2);
+            }
+        });
+        return true;
+    }
+    return false;
+}
+
 VideoScaler::VideoScaler()
     : ctx_(0)
     , mode_(SWS_FAST_BILINEAR)
@@ -48,6 +216,14 @@ VideoScaler::scale(const VideoFrame& input, VideoFrame& output){
 void
 VideoScaler::scale(const AVFrame* input_frame, AVFrame* output_frame)
 {
+    if (fastScale(input_frame,
+                  output_frame->data,
+                  output_frame->linesize,
+                  output_frame->width,
+                  output_frame->height,
+                  (AVPixelFormat) output_frame->format))
+        return;
+
     ctx_ = sws_getCachedContext(ctx_,
                                 input_frame->width,
                                 input_frame->height,
@@ -126,6 +302,28 @@ VideoScaler::scale_and_pad(const VideoFrame& input,
         return;
     }
 
+    // Make an offset'ed copy of output data from xoff and yoff
+    const auto out_desc = av_pix_fmt_desc_get((AVPixelFormat) output_frame->format);
+    memset(tmp_data_, 0, sizeof(tmp_data_));
+    for (int i = 0; i < 4 && output_frame->linesize[i]; i++) {
+        signed x_shift = xoff, y_shift = yoff;
+        if (i == 1 || i == 2) {
+            x_shift = -((-x_shift) >> out_desc->log2_chroma_w);
+            y_shift = -((-y_shift) >> out_desc->log2_chroma_h);
+        }
+        auto x_step = out_desc->comp[i].step;
+        tmp_data_[i] = output_frame->data[i] + y_shift * output_frame->linesize[i]
+                       + x_shift * x_step;
+    }
+
+    if (fastScale(input_frame,
+                  tmp_data_,
+                  output_frame->linesize,
+                  dest_width,
+                  dest_height,
+                  (AVPixelFormat) output_frame->format))
+        return;
+
     ctx_ = sws_getCachedContext(ctx_,
                                 input_frame->width,
                                 input_frame->height,
@@ -142,20 +340,6 @@ VideoScaler::scale_and_pad(const VideoFrame& input,
         return;
     }
 
-    // Make an offset'ed copy of output data from xoff and yoff
-    const auto out_desc = av_pix_fmt_desc_get((AVPixelFormat) output_frame->format);
-    memset(tmp_data_, 0, sizeof(tmp_data_));
-    for (int i = 0; i < 4 && output_frame->linesize[i]; i++) {
-        signed x_shift = xoff, y_shift = yoff;
-        if (i == 1 || i == 2) {
-            x_shift = -((-x_shift) >> out_desc->log2_chroma_w);
-            y_shift = -((-y_shift) >> out_desc->log2_chroma_h);
-        }
-        auto x_step = out_desc->comp[i].step;
-        tmp_data_[i] = output_frame->data[i] + y_shift * output_frame->linesize[i]
-                       + x_shift * x_step;
-    }
-
     sws_scale(ctx_,
               input_frame->data,
               input_frame->linesize,
@@ -21,6 +21,8 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
  */
 
+#include "libav_deps.h" // MUST BE INCLUDED FIRST
+
 #include "video_sender.h"
 #include "video_mixer.h"
 #include "socket_pair.h"
@@ -49,13 +51,15 @@ VideoSender::VideoSender(const std::string& dest,
                          const uint16_t seqVal,
                          uint16_t mtu,
                          bool enableHwAccel)
-    : muxContext_(socketPair.createIOContext(mtu))
+    : socketPair_(socketPair)
+    , muxContext_(socketPair.createIOContext(mtu))
     , videoEncoder_(new MediaEncoder)
 {
     keyFrameFreq_ = opts.frameRate.numerator() * KEY_FRAME_PERIOD;
     videoEncoder_->openOutput(dest, "rtp");
     videoEncoder_->setOptions(opts);
     videoEncoder_->setOptions(args);
+    videoEncoder_->setIntraRefresh(true);
 #ifdef RING_ACCEL
     videoEncoder_->enableAccel(enableHwAccel
                                and Manager::instance().videoPreferences.getEncodingAccelerated());
@@ -79,18 +83,44 @@ VideoSender::encodeAndSendVideo(const std::shared_ptr<VideoFrame>& input_frame)
             changeOrientationCallback_(rotation_);
     }
 
-    if (auto packet = input_frame->packet()) {
-        videoEncoder_->send(*packet);
-    } else {
-        bool is_keyframe = forceKeyFrame_ > 0
-                           or (keyFrameFreq_ > 0 and (frameNumber_ % keyFrameFreq_) == 0);
+    auto packet = input_frame->packet();
+    bool is_keyframe = false;
+    if (not packet) {
+        is_keyframe = forceKeyFrame_ > 0
+                      or (keyFrameFreq_ > 0 and (frameNumber_ % keyFrameFreq_) == 0);
+        // The frames skipped keep their timestamps, so the rate control sees the frame rate
+        auto divider = frameRateDivider_.load();
+        if (not is_keyframe and divider > 1 and frameNumber_ % divider) {
+            ++frameNumber_;
+            return;
+        }
+    }
 
+    // All the packets of a frame are sent at once
+    socketPair_.beginSendBatch();
+    if (packet) {
+        // Encoded by a VideoTierEncoder, shared with the other senders of the
+        // tier, and modified by send()
+        if (auto copy = av_packet_clone(packet)) {
+            videoEncoder_->send(*copy);
+            av_packet_free(&copy);
+        }
+    } else {
         if (is_keyframe)
             --forceKeyFrame_;
 
         if (videoEncoder_->encode(input_frame, is_keyframe, frameNumber_++) < 0)
             JAMI_ERR("encoding failed");
     }
+    socketPair_.endSendBatch();
+
+    if (++sentFrames_ % BATCH_STATS_PERIOD == 0) {
+        auto stats = socketPair_.getBatchStats();
+        Smartools::getInstance().setPacketBatching(stats.sentPackets,
+                                                   stats.sendCalls,
+                                                   stats.receivedPackets,
+                                                   stats.recvCalls);
+    }
 #ifdef DEBUG_SDP
     if (frameNumber_ == 1) // video stream is lazy initialized, wait for first frame
         videoEncoder_->print_sdp();
@@ -25,6 +25,7 @@
 #include "media_encoder.h"
 #include "media_io_handle.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <memory>
@@ -63,15 +64,29 @@ public:
 
     void setChangeOrientationCallback(std::function<void(int)> cb);
     int setBitrate(uint64_t br);
+    /**
+     * Encode one frame out of divider, the keyframes always, without restarting
+     * the encoder. Not applied to the packets of a VideoTierEncoder.
+     */
+    void setFrameRateDivider(unsigned divider) { frameRateDivider_ = std::max(divider, 1u); }
+    // Only muxes the packets of the VideoTierEncoder of the session, if any
+    const MediaEncoder* getEncoder() const { return videoEncoder_.get(); }
+
+    /**
+     * Also give the sent packets to cb, e.g. to record them. Thread-safe.
+     */
+    void setPacketObserver(PacketObserver&& cb) { videoEncoder_->setPacketObserver(std::move(cb)); }
 
 private:
     static constexpr int KEYFRAMES_AT_START {1}; // Number of keyframes to enforce at stream startup
     static constexpr unsigned KEY_FRAME_PERIOD {0}; // seconds before forcing a keyframe
+    static constexpr unsigned BATCH_STATS_PERIOD {100}; // frames between socket stats updates
 
     NON_COPYABLE(VideoSender);
 
     void encodeAndSendVideo(const std::shared_ptr<VideoFrame>&);
 
+    SocketPair& socketPair_;
     // encoder MUST be deleted before muxContext
     std::unique_ptr<MediaIOHandle> muxContext_ = nullptr;
     std::unique_ptr<MediaEncoder> videoEncoder_ = nullptr;
@@ -79,6 +94,8 @@ private:
     std::atomic<int> forceKeyFrame_ {KEYFRAMES_AT_START};
     int keyFrameFreq_ {0}; // Set keyframe rate, 0 to disable auto-keyframe. Computed in constructor
     int64_t frameNumber_ = 0;
+    unsigned sentFrames_ {0};
+    std::atomic<unsigned> frameRateDivider_ {1};
 
     int rotation_ = -1;
     std::function<void(int)> changeOrientationCallback_;
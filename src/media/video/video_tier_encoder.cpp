@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#include "libav_deps.h" // MUST BE INCLUDED FIRST
+
+#include "video_tier_encoder.h"
+#include "media_encoder.h"
+#include "client/videomanager.h"
+#include "logger.h"
+#include "manager.h"
+
+#include <algorithm>
+
+namespace jami {
+namespace video {
+
+unsigned
+VideoTierEncoder::tierBitrate(unsigned tier, const SystemCodecInfo& codec)
+{
+    // 1600, 800 and 400 Kbps, in the range of the codec
+    unsigned bitrate = (SystemCodecInfo::DEFAULT_VIDEO_BITRATE * 2)
+                       >> std::min(tier, TIER_COUNT - 1);
+    bitrate = std::min(bitrate, codec.maxBitrate);
+    return std::max(bitrate, codec.minBitrate);
+}
+
+unsigned
+VideoTierEncoder::tierFor(unsigned bitrate, const SystemCodecInfo& codec)
+{
+    unsigned tier = 0;
+    while (tier < TIER_COUNT - 1 and tierBitrate(tier, codec) > bitrate)
+        ++tier;
+    return tier;
+}
+
+VideoTierEncoder::VideoTierEncoder(const MediaStream& opts, const MediaDescription& args)
+    : encoder_(new MediaEncoder)
+{
+    // The payload type is set by each sender's muxer
+    auto codecArgs = args;
+    codecArgs.payload_type = 0;
+    encoder_->setOptions(opts);
+    encoder_->setOptions(codecArgs);
+    encoder_->setIntraRefresh(true);
+#ifdef RING_ACCEL
+    encoder_->enableAccel(Manager::instance().videoPreferences.getEncodingAccelerated());
+#endif
+    encoder_->addStream(args.codec->systemCodecInfo);
+    encoder_->setOnPacket([this](AVPacket& packet) {
+        std::unique_ptr<AVPacket, void (*)(AVPacket*)> copy(av_packet_clone(&packet),
+                                                            [](AVPacket* p) {
+                                                                av_packet_free(&p);
+                                                            });
+        if (not copy)
+            return;
+        auto frame = std::make_shared<VideoFrame>();
+        frame->setPacket(std::move(copy));
+        notify(std::static_pointer_cast<MediaFrame>(frame));
+    });
+    JAMI_DBG("[tier:%p] Encoding %s at %d Kbps",
+             this,
+             args.codec->systemCodecInfo.name.c_str(),
+             opts.bitrate);
+}
+
+VideoTierEncoder::~VideoTierEncoder()
+{
+    JAMI_DBG("[tier:%p] Instance destroyed", this);
+}
+
+void
+VideoTierEncoder::forceKeyFrame()
+{
+    ++forceKeyFrame_;
+}
+
+void
+VideoTierEncoder::update(Observable<std::shared_ptr<MediaFrame>>* /*obs*/,
+                         const std::shared_ptr<MediaFrame>& frame_p)
+{
+    // No sender left, waiting to be released by the mixer
+    if (getObserversCount() == 0)
+        return;
+
+    auto frame = std::dynamic_pointer_cast<VideoFrame>(frame_p);
+    if (not frame)
+        return;
+
+    bool is_keyframe = forceKeyFrame_ > 0;
+    if (is_keyframe)
+        --forceKeyFrame_;
+
+    try {
+        if (encoder_->encode(frame, is_keyframe, frameNumber_++) < 0)
+            JAMI_ERR("[tier:%p] encoding failed", this);
+    } catch (const MediaEncoderException& e) {
+        JAMI_ERR("[tier:%p] %s", this, e.what());
+    }
+}
+
+VideoTierEncoders::~VideoTierEncoders()
+{
+    clear();
+}
+
+std::shared_ptr<VideoTierEncoder>
+VideoTierEncoders::get(const MediaStream& stream, const MediaDescription& args, unsigned tier)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    // Release the encoders no sender uses anymore
+    for (auto it = encoders_.begin(); it != encoders_.end();) {
+        if (it->second.use_count() == 1) {
+            source_.detach(it->second.get());
+            it = encoders_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    const auto& codec = args.codec->systemCodecInfo;
+    auto key = fmt::format("{}:{}:{}:{}x{}:{}",
+                           codec.name,
+                           args.parameters,
+                           (int) args.mode,
+                           stream.width,
+                           stream.height,
+                           tier);
+    auto& encoder = encoders_[key];
+    if (not encoder) {
+        auto ms = stream;
+        ms.bitrate = VideoTierEncoder::tierBitrate(tier, codec);
+        encoder = std::make_shared<VideoTierEncoder>(ms, args);
+        source_.attach(encoder.get());
+    }
+    return encoder;
+}
+
+void
+VideoTierEncoders::clear()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (const auto& [key, encoder] : encoders_)
+        source_.detach(encoder.get());
+    encoders_.clear();
+}
+
+} // namespace video
+} // namespace jami
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include "video_base.h"
+#include "media_codec.h"
+#include "media_stream.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace jami {
+
+class MediaEncoder;
+
+namespace video {
+
+/**
+ * Encode the conference mix once for all the participants of the same
+ * codec and quality tier.
+ *
+ * Attached to the mixer, it publishes frames carrying the encoded packets
+ * instead of pictures. VideoSender sends those packets as they are.
+ */
+class VideoTierEncoder : public VideoFramePassiveReader, public VideoFrameActiveWriter
+{
+public:
+    static constexpr unsigned TIER_COUNT {3};
+
+    /**
+     * @return bitrate (in Kbps) of the tier, from the highest (0) to the lowest
+     */
+    static unsigned tierBitrate(unsigned tier, const SystemCodecInfo& codec);
+
+    /**
+     * @return highest tier that fits in bitrate
+     */
+    static unsigned tierFor(unsigned bitrate, const SystemCodecInfo& codec);
+
+    /**
+     * @param opts  Mixer stream, with the bitrate of the tier
+     * @param args  Codec of the senders
+     */
+    VideoTierEncoder(const MediaStream& opts, const MediaDescription& args);
+    ~VideoTierEncoder();
+
+    // Required by senders joining the tier
+    void forceKeyFrame();
+    const MediaEncoder* getEncoder() const { return encoder_.get(); }
+
+    // as VideoFramePassiveReader
+    void update(Observable<std::shared_ptr<MediaFrame>>* obs,
+                const std::shared_ptr<MediaFrame>& frame_p) override;
+
+private:
+    NON_COPYABLE(VideoTierEncoder);
+
+    std::unique_ptr<MediaEncoder> encoder_;
+    std::atomic<int> forceKeyFrame_ {1};
+    int64_t frameNumber_ {0};
+};
+
+/**
+ * Tier encoders of a video source, created on demand and shared by the senders
+ * of the same codec, resolution and tier.
+ */
+class VideoTierEncoders
+{
+public:
+    explicit VideoTierEncoders(VideoFrameActiveWriter& source)
+        : source_(source)
+    {}
+    ~VideoTierEncoders();
+
+    /**
+     * @param stream  Output of the source
+     */
+    std::shared_ptr<VideoTierEncoder> get(const MediaStream& stream,
+                                          const MediaDescription& args,
+                                          unsigned tier);
+
+    // Detach the encoders from the source
+    void clear();
+
+private:
+    NON_COPYABLE(VideoTierEncoders);
+
+    VideoFrameActiveWriter& source_;
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<VideoTierEncoder>> encoders_ {};
+};
+
+} // namespace video
+} // namespace jami
@@ -0,0 +1,378 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+#include "logger.h"
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/post.hpp>
+#include <asio/read_until.hpp>
+#include <asio/streambuf.hpp>
+#include <asio/write.hpp>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace jami {
+namespace metrics {
+
+namespace detail {
+
+unsigned
+threadShard()
+{
+    static std::atomic_uint next {0};
+    thread_local const unsigned shard = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    return shard;
+}
+
+} // namespace detail
+
+uint64_t
+Counter::value() const
+{
+    int64_t sum = 0;
+    for (const auto& shard : shards_)
+        sum += shard.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+int64_t
+Gauge::value() const
+{
+    auto sum = base_.load(std::memory_order_relaxed);
+    for (const auto& shard : shards_)
+        sum += shard.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+struct alignas(64) Histogram::Shard
+{
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::atomic<double> sum {0};
+};
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds))
+    , shards_(new Shard[detail::SHARDS])
+{
+    for (unsigned i = 0; i < detail::SHARDS; ++i) {
+        shards_[i].counts.reset(new std::atomic<uint64_t>[bounds_.size() + 1]);
+        for (size_t b = 0; b <= bounds_.size(); ++b)
+            shards_[i].counts[b].store(0, std::memory_order_relaxed);
+    }
+}
+
+Histogram::~Histogram() = default;
+
+void
+Histogram::observe(double v)
+{
+    auto& shard = shards_[detail::threadShard()];
+    auto bucket = std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin();
+    shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    // Only concurrent with the threads of the same shard
+    auto sum = shard.sum.load(std::memory_order_relaxed);
+    while (not shard.sum.compare_exchange_weak(sum, sum + v, std::memory_order_relaxed))
+        ;
+}
+
+Histogram::Snapshot
+Histogram::snapshot() const
+{
+    Snapshot s;
+    s.counts.resize(bounds_.size() + 1);
+    for (unsigned i = 0; i < detail::SHARDS; ++i) {
+        for (size_t b = 0; b <= bounds_.size(); ++b)
+            s.counts[b] += shards_[i].counts[b].load(std::memory_order_relaxed);
+        s.sum += shards_[i].sum.load(std::memory_order_relaxed);
+    }
+    for (auto c : s.counts)
+        s.count += c;
+    return s;
+}
+
+const std::vector<double>&
+durationBuckets()
+{
+    static const std::vector<double> buckets {
+        .001, .0025, .005, .01, .025, .05, .1, .25, .5, 1, 2.5, 5, 10};
+    return buckets;
+}
+
+enum Type : int { COUNTER, GAUGE, HISTOGRAM };
+
+struct Registry::Family
+{
+    Type type;
+    std::string help;
+    std::map<Labels, std::unique_ptr<Counter>> counters;
+    std::map<Labels, std::unique_ptr<Gauge>> gauges;
+    std::map<Labels, std::unique_ptr<Histogram>> histograms;
+};
+
+Registry&
+Registry::instance()
+{
+    // Intentional memory leak: metrics are updated until the threads are joined
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+Registry::Family&
+Registry::family(const std::string& name, const std::string& help, int type)
+{
+    auto& family = families_[name];
+    if (not family) {
+        family = std::make_unique<Family>();
+        family->type = static_cast<Type>(type);
+        family->help = help;
+    } else if (family->type != type) {
+        throw std::invalid_argument("Metric " + name + " registered with another type");
+    }
+    return *family;
+}
+
+Counter&
+Registry::counter(const std::string& name, const std::string& help, const Labels& labels)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto& counter = family(name, help, COUNTER).counters[labels];
+    if (not counter)
+        counter = std::make_unique<Counter>();
+    return *counter;
+}
+
+Gauge&
+Registry::gauge(const std::string& name, const std::string& help, const Labels& labels)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto& gauge = family(name, help, GAUGE).gauges[labels];
+    if (not gauge)
+        gauge = std::make_unique<Gauge>();
+    return *gauge;
+}
+
+Histogram&
+Registry::histogram(const std::string& name,
+                    const std::string& help,
+                    const std::vector<double>& bounds,
+                    const Labels& labels)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto& histogram = family(name, help, HISTOGRAM).histograms[labels];
+    if (not histogram)
+        histogram = std::make_unique<Histogram>(bounds);
+    return *histogram;
+}
+
+Gauge&
+memoryBytes(const std::string& pool)
+{
+    return Registry::instance().gauge("jami_memory_bytes",
+                                      "Memory held, by subsystem",
+                                      {{"pool", pool}});
+}
+
+static std::string
+escape(const std::string& s)
+{
+    std::string ret;
+    ret.reserve(s.size());
+    for (auto c : s) {
+        if (c == '\\' or c == '"')
+            ret += '\\';
+        if (c == '\n')
+            ret += "\\n";
+        else
+            ret += c;
+    }
+    return ret;
+}
+
+/**
+ * @param extra     Label added to labels, e.g. le="0.5" for a bucket
+ */
+static std::string
+formatLabels(const Labels& labels, const std::string& extra = {})
+{
+    if (labels.empty() and extra.empty())
+        return {};
+    std::string ret = "{";
+    for (const auto& [name, value] : labels) {
+        if (ret.size() > 1)
+            ret += ',';
+        ret += fmt::format("{}=\"{}\"", name, escape(value));
+    }
+    if (not extra.empty()) {
+        if (ret.size() > 1)
+            ret += ',';
+        ret += extra;
+    }
+    ret += '}';
+    return ret;
+}
+
+void
+Registry::addCollector(std::function<void()> collector)
+{
+    std::lock_guard<std::mutex> lk(collectorsMutex_);
+    collectors_.emplace_back(std::move(collector));
+}
+
+std::string
+Registry::openMetrics() const
+{
+    static constexpr const char* TYPES[] = {"counter", "gauge", "histogram"};
+    {
+        std::lock_guard<std::mutex> lk(collectorsMutex_);
+        for (const auto& collect : collectors_)
+            collect();
+    }
+    std::string out;
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (const auto& [name, family] : families_) {
+        out += fmt::format("# TYPE {} {}\n", name, TYPES[family->type]);
+        out += fmt::format("# HELP {} {}\n", name, escape(family->help));
+        for (const auto& [labels, counter] : family->counters)
+            out += fmt::format("{}_total{} {}\n", name, formatLabels(labels), counter->value());
+        for (const auto& [labels, gauge] : family->gauges)
+            out += fmt::format("{}{} {}\n", name, formatLabels(labels), gauge->value());
+        for (const auto& [labels, histogram] : family->histograms) {
+            auto s = histogram->snapshot();
+            uint64_t cumulated = 0;
+            for (size_t b = 0; b < s.counts.size(); ++b) {
+                cumulated += s.counts[b];
+                auto le = b < histogram->bounds().size()
+                              ? fmt::format("le=\"{}\"", histogram->bounds()[b])
+                              : std::string("le=\"+Inf\"");
+                out += fmt::format("{}_bucket{} {}\n", name, formatLabels(labels, le), cumulated);
+            }
+            out += fmt::format("{}_sum{} {}\n", name, formatLabels(labels), s.sum);
+            out += fmt::format("{}_count{} {}\n", name, formatLabels(labels), s.count);
+        }
+    }
+    out += "# EOF\n";
+    return out;
+}
+
+struct Server::Impl : public std::enable_shared_from_this<Impl>
+{
+    Impl(asio::io_context& ctx, uint16_t port)
+        : acceptor(ctx, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), port))
+    {}
+
+    void accept();
+
+    asio::ip::tcp::acceptor acceptor;
+};
+
+/**
+ * One request per connection, the response being the whole body
+ */
+struct Connection : public std::enable_shared_from_this<Connection>
+{
+    static constexpr size_t MAX_REQUEST_SIZE {8192};
+
+    explicit Connection(asio::ip::tcp::socket&& s)
+        : socket(std::move(s))
+        , request(MAX_REQUEST_SIZE)
+    {}
+
+    void serve()
+    {
+        asio::async_read_until(socket,
+                               request,
+                               "\r\n\r\n",
+                               [self = shared_from_this()](const asio::error_code& ec, size_t) {
+                                   if (not ec)
+                                       self->respond();
+                               });
+    }
+
+    void respond()
+    {
+        std::string line;
+        std::istream is(&request);
+        std::getline(is, line);
+        if (line.rfind("GET /metrics ", 0) == 0) {
+            auto body = Registry::instance().openMetrics();
+            response = fmt::format("HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: application/openmetrics-text; "
+                                   "version=1.0.0; charset=utf-8\r\n"
+                                   "Content-Length: {}\r\n"
+                                   "Connection: close\r\n\r\n{}",
+                                   body.size(),
+                                   body);
+        } else {
+            response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+        asio::async_write(socket,
+                          asio::buffer(response),
+                          [self = shared_from_this()](const asio::error_code&, size_t) {
+                              asio::error_code ec;
+                              self->socket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+                          });
+    }
+
+    asio::ip::tcp::socket socket;
+    asio::streambuf request;
+    std::string response;
+};
+
+void
+Server::Impl::accept()
+{
+    acceptor.async_accept(
+        [w = weak_from_this()](const asio::error_code& ec, asio::ip::tcp::socket socket) {
+            if (ec == asio::error::operation_aborted)
+                return;
+            auto self = w.lock();
+            if (not self)
+                return;
+            if (not ec)
+                std::make_shared<Connection>(std::move(socket))->serve();
+            self->accept();
+        });
+}
+
+Server::Server(asio::io_context& ctx, uint16_t port)
+    : pimpl_(std::make_shared<Impl>(ctx, port))
+{
+    pimpl_->accept();
+    JAMI_DBG("Serving the metrics on http://127.0.0.1:%u/metrics", this->port());
+}
+
+Server::~Server()
+{
+    // The acceptor is only used on the thread of its context
+    asio::post(pimpl_->acceptor.get_executor(), [impl = pimpl_] {
+        asio::error_code ec;
+        impl->acceptor.close(ec);
+    });
+}
+
+uint16_t
+Server::port() const
+{
+    return pimpl_->acceptor.local_endpoint().port();
+}
+
+} // namespace metrics
+} // namespace jami
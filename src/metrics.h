@@ -0,0 +1,224 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "noncopyable.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace asio {
+class io_context;
+}
+
+namespace jami {
+namespace metrics {
+
+using Labels = std::map<std::string, std::string>;
+
+namespace detail {
+
+constexpr unsigned SHARDS {16};
+
+/**
+ * @return shard of the calling thread, in [0, SHARDS)
+ */
+unsigned threadShard();
+
+struct alignas(64) Cell
+{
+    std::atomic<int64_t> value {0};
+};
+
+} // namespace detail
+
+/**
+ * Count of events, e.g. packets sent. Each thread increments its own shard,
+ * the shards being only summed when exported.
+ */
+class Counter
+{
+public:
+    Counter() = default;
+
+    void add(uint64_t n = 1)
+    {
+        shards_[detail::threadShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+private:
+    NON_COPYABLE(Counter);
+    std::array<detail::Cell, detail::SHARDS> shards_ {};
+};
+
+/**
+ * Value going up and down, e.g. a queue depth. A gauge is either set, by its
+ * owner, or adjusted from any thread with add().
+ */
+class Gauge
+{
+public:
+    Gauge() = default;
+
+    void set(int64_t v) { base_.store(v, std::memory_order_relaxed); }
+    void add(int64_t delta)
+    {
+        shards_[detail::threadShard()].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int64_t value() const;
+
+private:
+    NON_COPYABLE(Gauge);
+    std::atomic<int64_t> base_ {0};
+    std::array<detail::Cell, detail::SHARDS> shards_ {};
+};
+
+/**
+ * Distribution of observed values, e.g. durations in seconds, counted in
+ * buckets of fixed upper bounds.
+ */
+class Histogram
+{
+public:
+    /**
+     * @param bounds    Upper bounds of the buckets, increasing
+     */
+    explicit Histogram(std::vector<double> bounds);
+    ~Histogram();
+
+    void observe(double v);
+    template<typename Rep, typename Period>
+    void observe(std::chrono::duration<Rep, Period> d)
+    {
+        observe(std::chrono::duration<double>(d).count());
+    }
+
+    const std::vector<double>& bounds() const { return bounds_; }
+
+    struct Snapshot
+    {
+        // Per bucket, the last one for the values above the bounds
+        std::vector<uint64_t> counts;
+        double sum {0};
+        uint64_t count {0};
+    };
+    Snapshot snapshot() const;
+
+private:
+    NON_COPYABLE(Histogram);
+    struct Shard;
+    const std::vector<double> bounds_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+/**
+ * Buckets from 1 ms to 10 s, for the latencies and durations
+ */
+const std::vector<double>& durationBuckets();
+
+/**
+ * Metrics of the daemon, exported in the OpenMetrics text format.
+ *
+ * A metric is created at its first request and lives as long as the process,
+ * so that its users can keep a reference to it. Its labels must take a few
+ * values only (media type, priority class...), not per call or per peer.
+ */
+class Registry
+{
+public:
+    static Registry& instance();
+
+    /**
+     * @param name  Without the "_total" suffix, added when exported
+     * @throw std::invalid_argument if name is registered with another type
+     */
+    Counter& counter(const std::string& name, const std::string& help, const Labels& labels = {});
+    Gauge& gauge(const std::string& name, const std::string& help, const Labels& labels = {});
+    /**
+     * @param bounds    Used when the histogram is created
+     */
+    Histogram& histogram(const std::string& name,
+                         const std::string& help,
+                         const std::vector<double>& bounds = durationBuckets(),
+                         const Labels& labels = {});
+
+    /**
+     * Add a function called before each export, setting the gauges of the values only
+     * read on demand (e.g. the size of a cache). It lives as long as the process, and
+     * must not add collectors itself.
+     */
+    void addCollector(std::function<void()> collector);
+
+    /**
+     * @return the metrics in the OpenMetrics text format
+     */
+    std::string openMetrics() const;
+
+private:
+    Registry() = default;
+    NON_COPYABLE(Registry);
+    struct Family;
+    Family& family(const std::string& name, const std::string& help, int type);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Family>> families_;
+    // Not called with mutex_, they update the metrics
+    mutable std::mutex collectorsMutex_;
+    std::vector<std::function<void()>> collectors_;
+};
+
+/**
+ * Memory held by a subsystem, as jami_memory_bytes{pool="<pool>"}. The pools are the
+ * subsystems that may hold a lot of it (frame_pool, ringbuffers, channel_buffers,
+ * git_cache, dht_storage...), one may be part of another: the frames of the ring buffers
+ * come from the frame pool.
+ */
+Gauge& memoryBytes(const std::string& pool);
+
+/**
+ * HTTP endpoint serving Registry::openMetrics() at /metrics, on the loopback
+ * interface only.
+ */
+class Server
+{
+public:
+    /**
+     * @param port  0 for any port
+     * @throw std::system_error if the port can't be bound
+     */
+    Server(asio::io_context& ctx, uint16_t port);
+    ~Server();
+
+    uint16_t port() const;
+
+private:
+    NON_COPYABLE(Server);
+    struct Impl;
+    std::shared_ptr<Impl> pimpl_;
+};
+
+} // namespace metrics
+} // namespace jami
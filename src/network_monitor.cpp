@@ -0,0 +1,295 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "network_monitor.h"
+#include "ip_utils.h"
+#include "logger.h"
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define NETLINK_MONITOR 1
+#include <asio/generic/raw_protocol.hpp>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+namespace jami {
+
+// Interfaces come up in steps: link, then IPv4 and IPv6 addresses
+static constexpr std::chrono::seconds BURST_DELAY {1};
+
+static IpAddr
+localAddr(pj_uint16_t family)
+{
+    // getLocalAddr() falls back to the other family
+    auto addr = ip_utils::getLocalAddr(family);
+    return addr.getFamily() == family and not addr.isUnspecified() ? addr : IpAddr {};
+}
+
+NetworkState
+NetworkState::current()
+{
+    NetworkState state;
+    for (const auto& addr : ip_utils::getAllIpInterface())
+        state.addresses.emplace_back(addr);
+    std::sort(state.addresses.begin(), state.addresses.end());
+    state.addresses.erase(std::unique(state.addresses.begin(), state.addresses.end()),
+                          state.addresses.end());
+    state.local4 = localAddr(pj_AF_INET());
+    state.local6 = localAddr(pj_AF_INET6());
+    return state;
+}
+
+// Unspecified addresses can't be compared by pjlib
+static bool
+sameAddr(const IpAddr& a, const IpAddr& b)
+{
+    return (not a and not b) or (a and b and a == b);
+}
+
+bool
+NetworkState::operator==(const NetworkState& o) const
+{
+    return addresses == o.addresses and sameAddr(local4, o.local4) and sameAddr(local6, o.local6);
+}
+
+ConnectivityChange
+ConnectivityChange::diff(const NetworkState& from, const NetworkState& to)
+{
+    ConnectivityChange change;
+    std::set_difference(to.addresses.begin(),
+                        to.addresses.end(),
+                        from.addresses.begin(),
+                        from.addresses.end(),
+                        std::back_inserter(change.added));
+    std::set_difference(from.addresses.begin(),
+                        from.addresses.end(),
+                        to.addresses.begin(),
+                        to.addresses.end(),
+                        std::back_inserter(change.removed));
+    change.local4Changed = not sameAddr(from.local4, to.local4);
+    change.local6Changed = not sameAddr(from.local6, to.local6);
+    return change;
+}
+
+static bool
+hasFamily(const std::vector<IpAddr>& addrs, pj_uint16_t family)
+{
+    return std::any_of(addrs.begin(), addrs.end(), [&](const IpAddr& addr) {
+        return family == pj_AF_UNSPEC() or addr.getFamily() == family;
+    });
+}
+
+bool
+ConnectivityChange::disrupts(pj_uint16_t family) const
+{
+    if ((family != pj_AF_INET6() and local4Changed) or (family != pj_AF_INET() and local6Changed))
+        return true;
+    return hasFamily(removed, family);
+}
+
+bool
+ConnectivityChange::disrupts(const IpAddr& local) const
+{
+    if (not local or local.isUnspecified())
+        return disrupts();
+    auto family = local.getFamily();
+    if ((family == pj_AF_INET() and local4Changed) or (family == pj_AF_INET6() and local6Changed))
+        return true;
+    auto host = local.toString();
+    return std::any_of(removed.begin(), removed.end(), [&](const IpAddr& addr) {
+        return addr.toString() == host;
+    });
+}
+
+bool
+ConnectivityChange::affects(pj_uint16_t family) const
+{
+    return disrupts(family) or hasFamily(added, family);
+}
+
+std::optional<ConnectivityFilter::clock::time_point>
+ConnectivityFilter::observe(NetworkState state, clock::time_point now)
+{
+    if (state == applied_) {
+        if (pending_)
+            JAMI_DBG("Network back to its previous state, ignoring the change");
+        pending_.reset();
+        return std::nullopt;
+    }
+    // Waiting for it already, without postponing
+    if (pending_ and *pending_ == state)
+        return due_;
+    due_ = std::max(now + (state.offline() ? OFFLINE_GRACE : SETTLE_DELAY),
+                    lastApplied_ + MIN_INTERVAL);
+    pending_ = std::move(state);
+    return due_;
+}
+
+std::optional<ConnectivityChange>
+ConnectivityFilter::apply(clock::time_point now)
+{
+    if (not pending_ or now < due_)
+        return std::nullopt;
+    auto change = ConnectivityChange::diff(applied_, *pending_);
+    applied_ = std::move(*pending_);
+    pending_.reset();
+    lastApplied_ = now;
+    return change;
+}
+
+struct NetworkMonitor::Impl : public std::enable_shared_from_this<Impl>
+{
+    Impl(asio::io_context& ctx, std::function<void()>&& cb)
+        : timer(ctx)
+        , onChange(std::move(cb))
+#if NETLINK_MONITOR
+        , socket(ctx)
+#endif
+    {}
+
+    void start();
+    void receive();
+    void changed();
+    void close();
+
+    asio::steady_timer timer;
+    std::function<void()> onChange;
+    bool active {false};
+#if NETLINK_MONITOR
+    asio::generic::raw_protocol::socket socket;
+    std::array<char, 8192> buffer;
+#endif
+};
+
+void
+NetworkMonitor::Impl::start()
+{
+#if NETLINK_MONITOR
+    sockaddr_nl addr {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    asio::error_code ec;
+    socket.open(asio::generic::raw_protocol(AF_NETLINK, NETLINK_ROUTE), ec);
+    if (not ec)
+        socket.bind(asio::generic::raw_protocol::endpoint(&addr, sizeof(addr)), ec);
+    if (ec) {
+        JAMI_WARN("Unable to watch the network interfaces: %s", ec.message().c_str());
+        socket.close(ec);
+        return;
+    }
+    active = true;
+    ip_utils::setInterfaceCacheMonitored(true);
+    receive();
+#endif
+}
+
+#if NETLINK_MONITOR
+static bool
+isInterfaceEvent(const char* data, size_t len)
+{
+    int left = len;
+    for (auto msg = reinterpret_cast<const nlmsghdr*>(data); NLMSG_OK(msg, left);
+         msg = NLMSG_NEXT(msg, left)) {
+        switch (msg->nlmsg_type) {
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+void
+NetworkMonitor::Impl::receive()
+{
+    socket.async_receive(asio::buffer(buffer),
+                         [w = weak_from_this()](const asio::error_code& ec, size_t len) {
+                             if (ec == asio::error::operation_aborted)
+                                 return;
+                             auto self = w.lock();
+                             if (not self)
+                                 return;
+                             if (ec) {
+                                 // e.g. ENOBUFS when events were dropped: check anyway
+                                 JAMI_WARN("Netlink error: %s", ec.message().c_str());
+                                 self->changed();
+                             } else if (isInterfaceEvent(self->buffer.data(), len)) {
+                                 self->changed();
+                             }
+                             self->receive();
+                         });
+}
+#endif
+
+void
+NetworkMonitor::Impl::changed()
+{
+    // Lookups until it settles see the current state
+    ip_utils::invalidateInterfaceCache();
+    timer.expires_after(BURST_DELAY);
+    timer.async_wait([w = weak_from_this()](const asio::error_code& ec) {
+        if (ec == asio::error::operation_aborted)
+            return;
+        if (auto self = w.lock())
+            self->onChange();
+    });
+}
+
+void
+NetworkMonitor::Impl::close()
+{
+    asio::error_code ec;
+    timer.cancel();
+#if NETLINK_MONITOR
+    socket.close(ec);
+#endif
+}
+
+NetworkMonitor::NetworkMonitor(asio::io_context& ctx, std::function<void()> onChange)
+    : pimpl_(std::make_shared<Impl>(ctx, std::move(onChange)))
+{
+    pimpl_->start();
+}
+
+NetworkMonitor::~NetworkMonitor()
+{
+    if (pimpl_->active)
+        ip_utils::setInterfaceCacheMonitored(false);
+    // The socket is only used on the thread of its context
+    asio::post(pimpl_->timer.get_executor(), [impl = pimpl_] { impl->close(); });
+}
+
+bool
+NetworkMonitor::active() const
+{
+    return pimpl_->active;
+}
+
+} // namespace jami
@@ -0,0 +1,140 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+#include "ip_utils.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace asio {
+class io_context;
+}
+
+namespace jami {
+
+/**
+ * Addresses of the host, as seen by the subsystems reacting to their changes
+ */
+struct NetworkState
+{
+    // Of all the interfaces, sorted
+    std::vector<IpAddr> addresses;
+    // Preferred sources, of the default routes
+    IpAddr local4;
+    IpAddr local6;
+
+    static NetworkState current();
+
+    bool offline() const { return not local4 and not local6; }
+    bool operator==(const NetworkState& o) const;
+    bool operator!=(const NetworkState& o) const { return not(*this == o); }
+};
+
+struct ConnectivityChange
+{
+    std::vector<IpAddr> added;
+    std::vector<IpAddr> removed;
+    bool local4Changed {false};
+    bool local6Changed {false};
+
+    static ConnectivityChange diff(const NetworkState& from, const NetworkState& to);
+
+    /**
+     * @param family    pj_AF_UNSPEC() for any
+     * @return true if anything changed for family
+     */
+    bool affects(pj_uint16_t family = pj_AF_UNSPEC()) const;
+    /**
+     * @return true if the sockets of family may be broken: an address went away, or the
+     * default route changed. Addresses only added don't break them.
+     */
+    bool disrupts(pj_uint16_t family = pj_AF_UNSPEC()) const;
+    /**
+     * @return true if a socket bound to local may be broken: it went away, or the default
+     * route of its family changed
+     */
+    bool disrupts(const IpAddr& local) const;
+};
+
+/**
+ * Hysteresis of the connectivity changes. An observed state is applied once it lasted
+ * SETTLE_DELAY, or OFFLINE_GRACE when every address is lost (e.g. roaming between access
+ * points), and not within MIN_INTERVAL of the previous one. Going back to the applied state
+ * in the meantime cancels it, so a flapping network doesn't restart anything.
+ */
+class ConnectivityFilter
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::seconds SETTLE_DELAY {2};
+    static constexpr std::chrono::seconds OFFLINE_GRACE {10};
+    static constexpr std::chrono::seconds MIN_INTERVAL {10};
+
+    explicit ConnectivityFilter(NetworkState applied = {})
+        : applied_(std::move(applied))
+    {}
+
+    /**
+     * @return when apply() should be called, nullopt if state is the applied one
+     */
+    std::optional<clock::time_point> observe(NetworkState state, clock::time_point now);
+
+    /**
+     * @return the change to the observed state, nullopt if not due yet
+     */
+    std::optional<ConnectivityChange> apply(clock::time_point now);
+
+    const NetworkState& applied() const { return applied_; }
+
+private:
+    NetworkState applied_;
+    std::optional<NetworkState> pending_;
+    clock::time_point due_ {};
+    clock::time_point lastApplied_ {};
+};
+
+/**
+ * Watches the addresses of the network interfaces, through netlink on Linux. The cache of
+ * ip_utils is invalidated on each event, and onChange called once a burst of events is over.
+ * Elsewhere, and on the mobile platforms where the client notifies the connectivity changes,
+ * it does nothing.
+ */
+class NetworkMonitor
+{
+public:
+    NetworkMonitor(asio::io_context& ctx, std::function<void()> onChange);
+    ~NetworkMonitor();
+
+    /**
+     * @return false if changes are not monitored on this platform
+     */
+    bool active() const;
+
+private:
+    NON_COPYABLE(NetworkMonitor);
+    struct Impl;
+    std::shared_ptr<Impl> pimpl_;
+};
+
+} // namespace jami
@@ -21,15 +21,20 @@
 
 #pragma once
 
+#include "atomic_shared_ptr.h"
 #include "noncopyable.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <cstdlib>
 #include <cstdint>
 #include <memory>
-#include <set>
-#include <list>
 #include <mutex>
 #include <functional>
+#include <thread>
+#include <vector>
 #include <ciso646> // fix windows compiler bug
 #ifndef __DEBUG__ // this is only defined on plugins build for debugging
 #include "logger.h"
@@ -44,13 +49,23 @@ class Observable;
 
 /*=== Observable =============================================================*/
 
+namespace detail {
+// Observables notifying from this thread, see Observable::waitNotified()
+inline thread_local std::vector<const void*> notifying {};
+} // namespace detail
+
+/**
+ * The observers are published as immutable lists, copied on attach or detach: notify()
+ * takes no lock, and a change doesn't wait for a slow observer of another thread,
+ * except a detach for the notifications that may still call the detached observer.
+ */
 template<typename T>
 class Observable
 {
 public:
     Observable()
         : mutex_()
-        , observers_()
+        , observers_(std::make_shared<Observers>())
     {}
 
     /**
@@ -61,21 +76,28 @@ public:
     virtual ~Observable()
     {
         std::lock_guard<std::mutex> lk(mutex_);
+        auto observers = observers_.exchange(std::make_shared<const Observers>());
+        waitNotified();
 
-        for (auto& pobs : priority_observers_) {
+        for (auto& pobs : observers->priority) {
             if (auto so = pobs.lock()) {
                 so->detached(this);
             }
         }
 
-        for (auto& o : observers_)
+        for (auto& o : observers->observers)
             o->detached(this);
     }
 
     bool attach(Observer<T>* o)
     {
         std::lock_guard<std::mutex> lk(mutex_);
-        if (o and observers_.insert(o).second) {
+        auto observers = observers_.load();
+        const auto& list = observers->observers;
+        if (o and std::find(list.begin(), list.end(), o) == list.end()) {
+            auto changed = std::make_shared<Observers>(*observers);
+            changed->observers.emplace_back(o);
+            observers_.store(std::move(changed));
             o->attached(this);
             return true;
         }
@@ -85,18 +107,24 @@ public:
     void attachPriorityObserver(std::shared_ptr<Observer<T>> o)
     {
         std::lock_guard<std::mutex> lk(mutex_);
-        priority_observers_.push_back(o);
+        auto changed = std::make_shared<Observers>(*observers_.load());
+        changed->priority.emplace_back(o);
+        observers_.store(std::move(changed));
         o->attached(this);
     }
 
     void detachPriorityObserver(Observer<T>* o)
     {
         std::lock_guard<std::mutex> lk(mutex_);
-        for (auto it = priority_observers_.begin(); it != priority_observers_.end(); it++) {
+        auto changed = std::make_shared<Observers>(*observers_.load());
+        auto& list = changed->priority;
+        for (auto it = list.begin(); it != list.end(); it++) {
             if (auto so = it->lock()) {
                 if (so.get() == o) {
+                    list.erase(it);
+                    observers_.store(std::move(changed));
+                    waitNotified();
                     so->detached(this);
-                    priority_observers_.erase(it);
                     return;
                 }
             }
@@ -106,7 +134,17 @@ public:
     bool detach(Observer<T>* o)
     {
         std::lock_guard<std::mutex> lk(mutex_);
-        if (o and observers_.erase(o)) {
+        auto observers = observers_.load();
+        const auto& list = observers->observers;
+        auto it = std::find(list.begin(), list.end(), o);
+        if (o and it != list.end()) {
+            auto changed = std::make_shared<Observers>();
+            changed->priority = observers->priority;
+            changed->observers.reserve(list.size() - 1);
+            changed->observers.insert(changed->observers.end(), list.begin(), it);
+            changed->observers.insert(changed->observers.end(), std::next(it), list.end());
+            observers_.store(std::move(changed));
+            waitNotified();
             o->detached(this);
             return true;
         }
@@ -115,41 +153,93 @@ public:
 
     size_t getObserversCount()
     {
-        std::lock_guard<std::mutex> lk(mutex_);
-        return observers_.size() + priority_observers_.size();
+        auto observers = observers_.load();
+        return observers->observers.size() + observers->priority.size();
     }
 
 protected:
     void notify(T data)
     {
-        std::lock_guard<std::mutex> lk(mutex_);
-        for (auto it = priority_observers_.begin(); it != priority_observers_.end();) {
-            if (auto so = it->lock()) {
-                it++;
-                try {
-                    so->update(this, data);
-                } catch (std::exception& e) {
+        struct Notifying
+        {
+            Observable& o;
+            Notifying(Observable& o)
+                : o(o)
+            {
+                ++o.notifying_;
+                detail::notifying.emplace_back(&o);
+            }
+            ~Notifying()
+            {
+                detail::notifying.pop_back();
+                --o.notifying_;
+            }
+        };
+
+        bool expired = false;
+        {
+            Notifying notifying {*this};
+            auto observers = observers_.load();
+            for (const auto& pobs : observers->priority) {
+                if (auto so = pobs.lock()) {
+                    try {
+                        so->update(this, data);
+                    } catch (std::exception& e) {
 #ifndef __DEBUG__
-                    JAMI_ERR() << e.what();
+                        JAMI_ERR() << e.what();
 #endif
+                    }
+                } else {
+                    expired = true;
                 }
-            } else {
-                it = priority_observers_.erase(it);
             }
-        }
 
-        for (auto observer : observers_) {
-            observer->update(this, data);
+            for (auto observer : observers->observers) {
+                observer->update(this, data);
+            }
         }
+
+        if (expired)
+            removeExpired();
+    }
+
+    struct Observers
+    {
+        std::vector<std::weak_ptr<Observer<T>>> priority {};
+        std::vector<Observer<T>*> observers {};
+    };
+
+    /**
+     * Wait for the notifications of the other threads started before the last change,
+     * e.g. so that a detached observer can be destroyed. The notifications of this
+     * thread, if changing from an update, are left running.
+     */
+    void waitNotified() const
+    {
+        auto own = std::count(detail::notifying.begin(), detail::notifying.end(), this);
+        while (notifying_.load() > (unsigned) own)
+            std::this_thread::yield();
     }
 
 private:
     NON_COPYABLE(Observable<T>);
 
+    void removeExpired()
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto changed = std::make_shared<Observers>(*observers_.load());
+        auto& list = changed->priority;
+        list.erase(std::remove_if(list.begin(),
+                                  list.end(),
+                                  [](const auto& pobs) { return pobs.expired(); }),
+                   list.end());
+        observers_.store(std::move(changed));
+    }
+
 protected:
-    std::mutex mutex_; // lock observers_
-    std::list<std::weak_ptr<Observer<T>>> priority_observers_;
-    std::set<Observer<T>*> observers_;
+    std::mutex mutex_; // lock the changes of observers_
+    AtomicSharedPtr<const Observers> observers_;
+    std::atomic_uint notifying_ {0};
 };
 
 template<typename T>
@@ -186,6 +276,111 @@ private:
     F f_;
 };
 
+/*=== AsyncObserver ========================================================*/
+
+/**
+ * Observer updating another one from its own thread, so that a slow observer (a recorder,
+ * a plugin) never delays the producer.
+ *
+ * At most capacity updates wait: the oldest ones are dropped, and counted (see dropped()).
+ * Once detached from an observable, no update from it is left waiting nor running.
+ */
+template<typename T>
+class AsyncObserver : public Observer<T>
+{
+public:
+    AsyncObserver(Observer<T>& target, std::size_t capacity)
+        : target_(target)
+        , capacity_(std::max<std::size_t>(capacity, 1))
+        , thread_([this] { run(); })
+    {}
+
+    /**
+     * The updates still waiting are dropped
+     */
+    ~AsyncObserver()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void update(Observable<T>* obs, const T& data) override
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if (queue_.size() >= capacity_) {
+                queue_.pop_front();
+                ++dropped_;
+            }
+            queue_.emplace_back(obs, data);
+        }
+        cv_.notify_one();
+    }
+
+    void attached(Observable<T>* obs) override { target_.attached(obs); }
+
+    void detached(Observable<T>* obs) override
+    {
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            queue_.erase(std::remove_if(queue_.begin(),
+                                        queue_.end(),
+                                        [obs](const auto& item) { return item.first == obs; }),
+                         queue_.end());
+            if (std::this_thread::get_id() != thread_.get_id())
+                cv_.wait(lk, [&] { return running_ != obs; });
+        }
+        target_.detached(obs);
+    }
+
+    /**
+     * @return count of the updates dropped so far
+     */
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    NON_COPYABLE(AsyncObserver<T>);
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        while (true) {
+            cv_.wait(lk, [this] { return stop_ or not queue_.empty(); });
+            if (stop_)
+                return;
+            auto item = std::move(queue_.front());
+            queue_.pop_front();
+            running_ = item.first;
+            lk.unlock();
+            try {
+                target_.update(item.first, item.second);
+            } catch (const std::exception& e) {
+#ifndef __DEBUG__
+                JAMI_ERR() << e.what();
+#endif
+            }
+            item.second = {};
+            lk.lock();
+            running_ = nullptr;
+            cv_.notify_all();
+        }
+    }
+
+    Observer<T>& target_;
+    const std::size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::pair<Observable<T>*, T>> queue_;
+    Observable<T>* running_ {nullptr};
+    std::atomic<uint64_t> dropped_ {0};
+    bool stop_ {false};
+    std::thread thread_;
+};
+
 /*=== PublishMapSubject ====================================================*/
 
 template<typename T1, typename T2>
@@ -222,12 +417,13 @@ public:
     virtual void detached(Observable<T1>*) override
     {
         std::lock_guard<std::mutex> lk(this->mutex_);
-        for (auto& pobs : this->priority_observers_) {
+        auto observers = this->observers_.load();
+        for (auto& pobs : observers->priority) {
             if (auto so = pobs.lock()) {
                 so->detached(this);
             }
         }
-        for (auto& o : this->observers_)
+        for (auto& o : observers->observers)
             o->detached(this);
     }
 
@@ -172,7 +172,9 @@ public:
     Impl(std::unique_ptr<IceSocketEndpoint>&& ep,
          const dht::crypto::Certificate& peer_cert,
          const Identity& local_identity,
-         const std::shared_future<tls::DhParams>& dh_params)
+         const std::shared_future<tls::DhParams>& dh_params,
+         std::vector<uint8_t>&& session_data,
+         tls::TlsSession::OnSessionData&& on_session)
         : peerCertificate {peer_cert}
         , ep_ {ep.get()}
     {
@@ -186,7 +188,8 @@ public:
                /*.verifyCertificate = */
                [this](gnutls_session_t session) {
                    return verifyCertificate(session);
-               }};
+               },
+               /*.onSessionData = */ std::move(on_session)};
         tls::TlsParams tls_param = {
             /*.ca_list = */ "",
             /*.peer_ca = */ nullptr,
@@ -195,6 +198,7 @@ public:
             /*.dh_params = */ dh_params,
             /*.timeout = */ TLS_TIMEOUT,
             /*.cert_check = */ nullptr,
+            /*.session_data = */ std::move(session_data),
         };
         tls = std::make_unique<tls::TlsSession>(std::move(ep), tls_param, tls_cbs);
     }
@@ -202,7 +206,8 @@ public:
     Impl(std::unique_ptr<IceSocketEndpoint>&& ep,
          std::function<bool(const dht::crypto::Certificate&)>&& cert_check,
          const Identity& local_identity,
-         const std::shared_future<tls::DhParams>& dh_params)
+         const std::shared_future<tls::DhParams>& dh_params,
+         std::shared_ptr<tls::SessionTicketKey>&& ticket_key)
         : peerCertificateCheckFunc {std::move(cert_check)}
         , peerCertificate {null_cert}
         , ep_ {ep.get()}
@@ -226,6 +231,8 @@ public:
             /*.dh_params = */ dh_params,
             /*.timeout = */ std::chrono::duration_cast<decltype(tls::TlsParams::timeout)>(TLS_TIMEOUT),
             /*.cert_check = */ nullptr,
+            /*.session_data = */ {},
+            /*.ticket_key = */ std::move(ticket_key),
         };
         tls = std::make_unique<tls::TlsSession>(std::move(ep), tls_param, tls_cbs);
     }
@@ -316,17 +323,28 @@ TlsSocketEndpoint::Impl::onTlsCertificatesUpdate(UNUSED const gnutls_datum_t* lo
 TlsSocketEndpoint::TlsSocketEndpoint(std::unique_ptr<IceSocketEndpoint>&& tr,
                                      const Identity& local_identity,
                                      const std::shared_future<tls::DhParams>& dh_params,
-                                     const dht::crypto::Certificate& peer_cert)
-    : pimpl_ {std::make_unique<Impl>(std::move(tr), peer_cert, local_identity, dh_params)}
+                                     const dht::crypto::Certificate& peer_cert,
+                                     std::vector<uint8_t>&& session_data,
+                                     tls::TlsSession::OnSessionData&& on_session)
+    : pimpl_ {std::make_unique<Impl>(std::move(tr),
+                                     peer_cert,
+                                     local_identity,
+                                     dh_params,
+                                     std::move(session_data),
+                                     std::move(on_session))}
 {}
 
 TlsSocketEndpoint::TlsSocketEndpoint(
     std::unique_ptr<IceSocketEndpoint>&& tr,
     const Identity& local_identity,
     const std::shared_future<tls::DhParams>& dh_params,
-    std::function<bool(const dht::crypto::Certificate&)>&& cert_check)
-    : pimpl_ {
-        std::make_unique<Impl>(std::move(tr), std::move(cert_check), local_identity, dh_params)}
+    std::function<bool(const dht::crypto::Certificate&)>&& cert_check,
+    std::shared_ptr<tls::SessionTicketKey> ticket_key)
+    : pimpl_ {std::make_unique<Impl>(std::move(tr),
+                                     std::move(cert_check),
+                                     local_identity,
+                                     dh_params,
+                                     std::move(ticket_key))}
 {}
 
 TlsSocketEndpoint::~TlsSocketEndpoint() {}
@@ -369,6 +387,17 @@ TlsSocketEndpoint::write(const ValueType* buf, std::size_t len, std::error_code&
     return pimpl_->tls->write(buf, len, ec);
 }
 
+std::size_t
+TlsSocketEndpoint::writev(std::initializer_list<tls::TlsSession::ConstBuffer> bufs,
+                          std::error_code& ec)
+{
+    if (!pimpl_->tls) {
+        ec = std::make_error_code(std::errc::broken_pipe);
+        return -1;
+    }
+    return pimpl_->tls->writev(bufs, ec);
+}
+
 std::shared_ptr<dht::crypto::Certificate>
 TlsSocketEndpoint::peerCertificate() const
 {
@@ -117,14 +117,24 @@ public:
     using Identity = std::pair<std::shared_ptr<dht::crypto::PrivateKey>,
                                std::shared_ptr<dht::crypto::Certificate>>;
 
+    /**
+     * @param session_data  Of a previous session with the peer, to resume it
+     * @param on_session    Called with the data to resume this session later
+     */
     TlsSocketEndpoint(std::unique_ptr<IceSocketEndpoint>&& tr,
                       const Identity& local_identity,
                       const std::shared_future<tls::DhParams>& dh_params,
-                      const dht::crypto::Certificate& peer_cert);
+                      const dht::crypto::Certificate& peer_cert,
+                      std::vector<uint8_t>&& session_data = {},
+                      tls::TlsSession::OnSessionData&& on_session = {});
+    /**
+     * @param ticket_key    To give the peer a session ticket, to resume this session later
+     */
     TlsSocketEndpoint(std::unique_ptr<IceSocketEndpoint>&& tr,
                       const Identity& local_identity,
                       const std::shared_future<tls::DhParams>& dh_params,
-                      std::function<bool(const dht::crypto::Certificate&)>&& cert_check);
+                      std::function<bool(const dht::crypto::Certificate&)>&& cert_check,
+                      std::shared_ptr<tls::SessionTicketKey> ticket_key = {});
     ~TlsSocketEndpoint();
 
     bool isReliable() const override { return true; }
@@ -133,6 +143,8 @@ public:
     void shutdown() override;
     std::size_t read(ValueType* buf, std::size_t len, std::error_code& ec) override;
     std::size_t write(const ValueType* buf, std::size_t len, std::error_code& ec) override;
+    std::size_t writev(std::initializer_list<tls::TlsSession::ConstBuffer> bufs,
+                       std::error_code& ec);
 
     std::shared_ptr<dht::crypto::Certificate> peerCertificate() const;
 
@@ -20,6 +20,7 @@
 
 #include "callservicesmanager.h"
 
+#include "mediaframeadapter.h"
 #include "pluginmanager.h"
 #include "pluginpreferencesutils.h"
 
@@ -30,6 +31,80 @@
 
 namespace jami {
 
+namespace {
+
+/**
+ * MediaHandler of a plugin not loaded yet, standing for the one the plugin registers once
+ * loaded.
+ */
+class DeferredCallMediaHandler : public CallMediaHandler
+{
+public:
+    DeferredCallMediaHandler(const PluginIndex::Handler& handler, std::function<bool()> load)
+        : details_(handler.details)
+        , load_(std::move(load))
+    {
+        setId(handler.id);
+        details_["attached"] = "0";
+    }
+
+    void notifyAVFrameSubject(const StreamData& data, avSubjectPtr subject) override
+    {
+        if (not handler_ and load_) {
+            // Once, the handler being then adopted
+            auto load = std::move(load_);
+            load_ = nullptr;
+            load();
+        }
+        if (handler_)
+            handler_->notifyAVFrameSubject(data, subject);
+    }
+
+    std::map<std::string, std::string> getCallMediaHandlerDetails() override
+    {
+        return handler_ ? handler_->getCallMediaHandlerDetails() : details_;
+    }
+
+    void detach() override
+    {
+        if (handler_)
+            handler_->detach();
+    }
+
+    void setPreferenceAttribute(const std::string& key, const std::string& value) override
+    {
+        if (handler_)
+            handler_->setPreferenceAttribute(key, value);
+    }
+
+    bool preferenceMapHasKey(const std::string& key) override
+    {
+        // Until loaded, the plugin reads the saved preferences
+        return handler_ and handler_->preferenceMapHasKey(key);
+    }
+
+    /**
+     * Takes the place of @handler if registered by the plugin for this one
+     */
+    bool adopt(CallMediaHandlerPtr& handler)
+    {
+        if (handler_ or handler->id() != id()
+            or handler->getCallMediaHandlerDetails()["name"] != details_["name"])
+            return false;
+        handler_ = std::move(handler);
+        return true;
+    }
+
+    const CallMediaHandler* handler() const { return handler_.get(); }
+
+private:
+    std::map<std::string, std::string> details_;
+    std::function<bool()> load_;
+    CallMediaHandlerPtr handler_;
+};
+
+} // namespace
+
 CallServicesManager::CallServicesManager(PluginManager& pluginManager)
 {
     registerComponentsLifeCycleManagers(pluginManager);
@@ -38,6 +113,7 @@ CallServicesManager::CallServicesManager(PluginManager& pluginManager)
 CallServicesManager::~CallServicesManager()
 {
     callMediaHandlers_.clear();
+    callAdapters_.clear();
     callAVsubjects_.clear();
     mediaHandlerToggled_.clear();
 }
@@ -87,6 +163,7 @@ CallServicesManager::createAVSubject(const StreamData& data, AVSubjectSPtr subje
 void
 CallServicesManager::clearAVSubject(const std::string& callId)
 {
+    callAdapters_.erase(callId);
     callAVsubjects_.erase(callId);
 }
 
@@ -105,6 +182,11 @@ CallServicesManager::registerComponentsLifeCycleManagers(PluginManager& pluginMa
         PluginPreferencesUtils::addAlwaysHandlerPreference(ptr->getCallMediaHandlerDetails().at(
                                                                "name"),
                                                            ptr->id().substr(0, found));
+        // Registered before the plugin was loaded
+        for (auto& handler : callMediaHandlers_)
+            if (auto deferred = dynamic_cast<DeferredCallMediaHandler*>(handler.get()))
+                if (deferred->adopt(ptr))
+                    return 0;
         callMediaHandlers_.emplace_back(std::move(ptr));
         return 0;
     };
@@ -115,6 +197,9 @@ CallServicesManager::registerComponentsLifeCycleManagers(PluginManager& pluginMa
         auto handlerIt = std::find_if(callMediaHandlers_.begin(),
                                       callMediaHandlers_.end(),
                                       [data](CallMediaHandlerPtr& handler) {
+                                          if (auto deferred = dynamic_cast<
+                                                  DeferredCallMediaHandler*>(handler.get()))
+                                              return deferred->handler() == data;
                                           return (handler.get() == data);
                                       });
 
@@ -237,6 +322,29 @@ CallServicesManager::setPreference(const std::string& key,
     return status;
 }
 
+void
+CallServicesManager::registerDeferredHandlers(const std::vector<PluginIndex::Handler>& handlers,
+                                              const std::function<bool()>& load)
+{
+    for (const auto& handler : handlers)
+        callMediaHandlers_.emplace_back(std::make_unique<DeferredCallMediaHandler>(handler, load));
+}
+
+void
+CallServicesManager::removeDeferredHandlers(const std::string& rootPath)
+{
+    for (auto it = callMediaHandlers_.begin(); it != callMediaHandlers_.end();) {
+        auto deferred = dynamic_cast<DeferredCallMediaHandler*>(it->get());
+        if (deferred and not deferred->handler() and deferred->id().find(rootPath) == 0) {
+            for (auto& toggledList : mediaHandlerToggled_)
+                toggledList.second.erase((uintptr_t) deferred);
+            it = callMediaHandlers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void
 CallServicesManager::clearCallHandlerMaps(const std::string& callId)
 {
@@ -248,8 +356,49 @@ CallServicesManager::notifyAVSubject(CallMediaHandlerPtr& callMediaHandlerPtr,
                                      const StreamData& data,
                                      AVSubjectSPtr& subject)
 {
-    if (auto soSubject = subject.lock())
-        callMediaHandlerPtr->notifyAVFrameSubject(data, soSubject);
+    auto soSubject = subject.lock();
+    if (not soSubject)
+        return;
+#ifdef ENABLE_VIDEO
+    if (data.type == StreamType::video) {
+        auto format = MediaHandlerFormat::fromDetails(
+            callMediaHandlerPtr->getCallMediaHandlerDetails());
+        if (format.readOnly()) {
+            // The handler reads converted copies, the stream stays untouched
+            auto adapter = std::make_shared<MediaFrameAdapter>(format);
+            soSubject->attach(adapter.get());
+            callAdapters_[data.id].emplace_back((uintptr_t) callMediaHandlerPtr.get(), adapter);
+            callMediaHandlerPtr->notifyAVFrameSubject(data, adapter);
+            return;
+        }
+        if (not format.hardwareFrames and format.budget.count() > 0) {
+            // The handler processes the frames from its own thread, within its budget
+            const auto& details = callMediaHandlerPtr->getCallMediaHandlerDetails();
+            auto name = details.find("name");
+            auto worker = std::make_shared<MediaHandlerWorker>(name != details.end()
+                                                                   ? name->second
+                                                                   : std::string {},
+                                                               format);
+            soSubject->attach(worker.get());
+            callAdapters_[data.id].emplace_back((uintptr_t) callMediaHandlerPtr.get(), worker);
+            callMediaHandlerPtr->notifyAVFrameSubject(data, worker);
+            return;
+        }
+    }
+#endif
+    callMediaHandlerPtr->notifyAVFrameSubject(data, soSubject);
+}
+
+void
+CallServicesManager::releaseAdapters(const uintptr_t mediaHandlerId, const std::string& callId)
+{
+    auto it = callAdapters_.find(callId);
+    if (it == callAdapters_.end())
+        return;
+    it->second.remove_if(
+        [mediaHandlerId](const auto& adapter) { return adapter.first == mediaHandlerId; });
+    if (it->second.empty())
+        callAdapters_.erase(it);
 }
 
 void
@@ -260,26 +409,34 @@ CallServicesManager::toggleCallMediaHandler(const uintptr_t mediaHandlerId,
     auto& handlers = mediaHandlerToggled_[callId];
     bool applyRestart = false;
 
-    for (auto subject : callAVsubjects_[callId]) {
-        auto handlerIt = std::find_if(callMediaHandlers_.begin(),
-                                      callMediaHandlers_.end(),
-                                      [mediaHandlerId](CallMediaHandlerPtr& handler) {
-                                          return ((uintptr_t) handler.get() == mediaHandlerId);
-                                      });
+    auto handlerIt = std::find_if(callMediaHandlers_.begin(),
+                                  callMediaHandlers_.end(),
+                                  [mediaHandlerId](CallMediaHandlerPtr& handler) {
+                                      return ((uintptr_t) handler.get() == mediaHandlerId);
+                                  });
+    if (handlerIt == callMediaHandlers_.end())
+        return;
+    // Handlers mapping the hardware frames or reading copies don't need them in main memory
+    auto format = MediaHandlerFormat::fromDetails((*handlerIt)->getCallMediaHandlerDetails());
+    bool keepsPipeline = format.hardwareFrames or format.readOnly();
+    if (toggle)
+        releaseAdapters(mediaHandlerId, callId);
 
-        if (handlerIt != callMediaHandlers_.end()) {
-            if (toggle) {
-                notifyAVSubject((*handlerIt), subject.first, subject.second);
-                if (isAttached((*handlerIt)))
-                    handlers[mediaHandlerId] = true;
-            } else {
-                (*handlerIt)->detach();
-                handlers[mediaHandlerId] = false;
-            }
-            if (subject.first.type == StreamType::video && isVideoType((*handlerIt)))
-                applyRestart = true;
+    for (auto subject : callAVsubjects_[callId]) {
+        if (toggle) {
+            notifyAVSubject((*handlerIt), subject.first, subject.second);
+            if (isAttached((*handlerIt)))
+                handlers[mediaHandlerId] = true;
+        } else {
+            (*handlerIt)->detach();
+            handlers[mediaHandlerId] = false;
         }
+        if (subject.first.type == StreamType::video && isVideoType((*handlerIt))
+            && not keepsPipeline)
+            applyRestart = true;
     }
+    if (not toggle)
+        releaseAdapters(mediaHandlerId, callId);
 #ifndef __ANDROID__
 #ifdef ENABLE_VIDEO
     if (applyRestart) {
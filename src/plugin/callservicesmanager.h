@@ -21,10 +21,12 @@
 #pragma once
 
 #include "mediahandler.h"
+#include "pluginindex.h"
 #include "streamdata.h"
 
 #include "noncopyable.h"
 
+#include <functional>
 #include <list>
 #include <map>
 #include <tuple>
@@ -32,6 +34,7 @@
 namespace jami {
 
 class PluginManager;
+class MediaHandlerSubject;
 
 using CallMediaHandlerPtr = std::unique_ptr<CallMediaHandler>;
 using AVSubjectSPtr = std::weak_ptr<Observable<AVFrame*>>;
@@ -86,6 +89,9 @@ public:
      * we need to restart the sender to unlink our encoder and decoder.
      * When we deactivate a MediaHandler, we try to relink the encoder
      * and decoder by restarting the sender.
+     * The MediaHandlers mapping the hardware frames themselves, or reading
+     * copies (see MediaHandlerFormat), keep them linked. The others process
+     * the video frames from a MediaHandlerWorker, unless their budget is 0.
      *
      * @param mediaHandlerId
      * @param callId
@@ -121,6 +127,23 @@ public:
                        const std::string& value,
                        const std::string& rootPath);
 
+    /**
+     * @brief Registers the MediaHandlers of a plugin not loaded yet, from the plugin index.
+     * The plugin is loaded when one of them is first attached to a stream, the MediaHandlers
+     * it registers then taking their place, with the same ids.
+     * @param handlers
+     * @param load Loads the plugin
+     */
+    void registerDeferredHandlers(const std::vector<PluginIndex::Handler>& handlers,
+                                  const std::function<bool()>& load);
+
+    /**
+     * @brief Removes the MediaHandlers registered by registerDeferredHandlers() for a plugin
+     * that was not loaded since.
+     * @param rootPath
+     */
+    void removeDeferredHandlers(const std::string& rootPath);
+
     /**
      * @brief Removes call from mediaHandlerToggled_ mapping.
      * @param callId
@@ -149,6 +172,13 @@ private:
                                 const std::string& callId,
                                 const bool toggle);
 
+    /**
+     * @brief Detaches from their streams the adapters of a MediaHandler for a call.
+     * @param mediaHandlerId
+     * @param callId
+     */
+    void releaseAdapters(const uintptr_t mediaHandlerId, const std::string& callId);
+
     /**
      * @brief Checks if the MediaHandler being (de)activated expects a video stream.
      * It's used to reduce restartSender call.
@@ -174,6 +204,12 @@ private:
     // For easy access they are mapped with the call they belong to.
     std::map<std::string, std::list<std::pair<const StreamData, AVSubjectSPtr>>> callAVsubjects_;
 
+    // Subjects of the MediaHandlers for the video frames (copies or processed by a worker),
+    // between them and the subjects of callAVsubjects_, mapped with the call and the
+    // MediaHandler they belong to.
+    std::map<std::string, std::list<std::pair<uintptr_t, std::shared_ptr<MediaHandlerSubject>>>>
+        callAdapters_;
+
     // Component that stores MediaHandlers' status for each existing call.
     // A map of callIds and MediaHandler-status pairs.
     std::map<std::string, std::map<uintptr_t, bool>> mediaHandlerToggled_;
@@ -23,8 +23,84 @@
 #include "jamidht/jamiaccount.h"
 #include "fileutils.h"
 
+#include <algorithm>
+
 namespace jami {
 
+namespace {
+
+/**
+ * ChatHandler of a plugin not loaded yet, standing for the one the plugin registers once
+ * loaded.
+ */
+class DeferredChatHandler : public ChatHandler
+{
+public:
+    DeferredChatHandler(const PluginIndex::Handler& handler, std::function<bool()> load)
+        : details_(handler.details)
+        , load_(std::move(load))
+    {
+        setId(handler.id);
+    }
+
+    void notifyChatSubject(std::pair<std::string, std::string>& subjectConnection,
+                           chatSubjectPtr subject) override
+    {
+        if (not handler_ and load_) {
+            // Once, the handler being then adopted
+            auto load = std::move(load_);
+            load_ = nullptr;
+            load();
+        }
+        if (handler_)
+            handler_->notifyChatSubject(subjectConnection, subject);
+    }
+
+    std::map<std::string, std::string> getChatHandlerDetails() override
+    {
+        return handler_ ? handler_->getChatHandlerDetails() : details_;
+    }
+
+    void detach(chatSubjectPtr subject) override
+    {
+        if (handler_)
+            handler_->detach(subject);
+    }
+
+    void setPreferenceAttribute(const std::string& key, const std::string& value) override
+    {
+        if (handler_)
+            handler_->setPreferenceAttribute(key, value);
+    }
+
+    bool preferenceMapHasKey(const std::string& key) override
+    {
+        // Until loaded, the plugin reads the saved preferences
+        return handler_ and handler_->preferenceMapHasKey(key);
+    }
+
+    /**
+     * Takes the place of @handler if registered by the plugin for this one
+     */
+    bool adopt(ChatHandlerPtr& handler)
+    {
+        if (handler_ or handler->id() != id()
+            or handler->getChatHandlerDetails()["name"] != details_["name"])
+            return false;
+        handler_ = std::move(handler);
+        return true;
+    }
+
+    const ChatHandler* handler() const { return handler_.get(); }
+
+private:
+    std::map<std::string, std::string> details_;
+    std::function<bool()> load_;
+    ChatHandlerPtr handler_;
+};
+
+} // namespace
+
 ChatServicesManager::ChatServicesManager(PluginManager& pluginManager)
 {
     registerComponentsLifeCycleManagers(pluginManager);
@@ -42,11 +118,16 @@ ChatServicesManager::registerComponentsLifeCycleManagers(PluginManager& pluginMa
 
         if (!ptr)
             return -1;
-        handlersNameMap_[ptr->getChatHandlerDetails().at("name")] = (uintptr_t) ptr.get();
         std::size_t found = ptr->id().find_last_of(DIR_SEPARATOR_CH);
         // Adding preference that tells us to automatically activate a ChatHandler.
         PluginPreferencesUtils::addAlwaysHandlerPreference(ptr->getChatHandlerDetails().at("name"),
                                                            ptr->id().substr(0, found));
+        // Registered before the plugin was loaded, under the address of the deferred one
+        for (auto& handler : chatHandlers_)
+            if (auto deferred = dynamic_cast<DeferredChatHandler*>(handler.get()))
+                if (deferred->adopt(ptr))
+                    return 0;
+        handlersNameMap_[ptr->getChatHandlerDetails().at("name")] = (uintptr_t) ptr.get();
         chatHandlers_.emplace_back(std::move(ptr));
         return 0;
     };
@@ -57,6 +138,9 @@ ChatServicesManager::registerComponentsLifeCycleManagers(PluginManager& pluginMa
         auto handlerIt = std::find_if(chatHandlers_.begin(),
                                       chatHandlers_.end(),
                                       [data](ChatHandlerPtr& handler) {
+                                          if (auto deferred = dynamic_cast<DeferredChatHandler*>(
+                                                  handler.get()))
+                                              return deferred->handler() == data;
                                           return (handler.get() == data);
                                       });
 
@@ -136,10 +220,43 @@ ChatServicesManager::publishMessage(pluginMessagePtr message)
 {
     if (message->fromPlugin or chatHandlers_.empty())
         return;
+    std::vector<pluginMessagePtr> messages {std::move(message)};
+    publishMessages(messages.cbegin(), messages.cend());
+}
+
+void
+ChatServicesManager::publishMessages(std::vector<pluginMessagePtr>&& messages)
+{
+    messages.erase(std::remove_if(messages.begin(),
+                                  messages.end(),
+                                  [](const pluginMessagePtr& message) {
+                                      return not message or message->fromPlugin;
+                                  }),
+                   messages.end());
+    if (messages.empty() or chatHandlers_.empty())
+        return;
+    dispatcher_.run([this, messages = std::move(messages)] {
+        // By accountId, peerId pair
+        for (auto begin = messages.cbegin(); begin != messages.cend();) {
+            auto end = std::find_if(begin, messages.cend(), [&](const pluginMessagePtr& message) {
+                return message->accountId != (*begin)->accountId
+                       or message->peerId != (*begin)->peerId;
+            });
+            publishMessages(begin, end);
+            begin = end;
+        }
+    });
+}
 
-    std::pair<std::string, std::string> mPair(message->accountId, message->peerId);
+void
+ChatServicesManager::publishMessages(std::vector<pluginMessagePtr>::const_iterator begin,
+                                     std::vector<pluginMessagePtr>::const_iterator end)
+{
+    const auto& accountId = (*begin)->accountId;
+    std::pair<std::string, std::string> mPair(accountId, (*begin)->peerId);
     auto& handlers = chatHandlerToggled_[mPair];
     auto& chatAllowDenySet = allowDenyList_[mPair];
+    chatSubjectPtr subject;
 
     // Search for activation flag.
     for (auto& chatHandler : chatHandlers_) {
@@ -148,7 +265,7 @@ ChatServicesManager::publishMessage(pluginMessagePtr message)
         // toggle is true if we should automatically activate the ChatHandler.
         bool toggle = PluginPreferencesUtils::getAlwaysPreference(chatHandler->id().substr(0, found),
                                                                   chatHandlerName,
-                                                                  message->accountId);
+                                                                  accountId);
         // toggle is overwritten if we have previously activated/deactivated the ChatHandler
         // for the given conversation.
         auto allowedIt = chatAllowDenySet.find(chatHandlerName);
@@ -157,7 +274,9 @@ ChatServicesManager::publishMessage(pluginMessagePtr message)
         bool toggled = handlers.find((uintptr_t) chatHandler.get()) != handlers.end();
         if (toggle || toggled) {
             // Creates chat subjects if it doesn't exist yet.
-            auto& subject = chatSubjects_.emplace(mPair, std::make_shared<PublishObservable<pluginMessagePtr>>()).first->second;
+            subject = chatSubjects_
+                          .emplace(mPair, std::make_shared<PublishObservable<pluginMessagePtr>>())
+                          .first->second;
             if (!toggled) {
                 // If activation is expected, and not yet performed, we perform activation
                 handlers.insert((uintptr_t) chatHandler.get());
@@ -165,10 +284,13 @@ ChatServicesManager::publishMessage(pluginMessagePtr message)
                 chatAllowDenySet[chatHandlerName] = true;
                 PluginPreferencesUtils::setAllowDenyListPreferences(allowDenyList_);
             }
-            // Finally we feed Chat subject with the message.
-            subject->publish(message);
         }
     }
+
+    // Finally we feed Chat subject with the messages, observed by every active ChatHandler.
+    if (subject)
+        for (auto it = begin; it != end; ++it)
+            subject->publish(*it);
 }
 
 void
@@ -238,6 +360,38 @@ ChatServicesManager::setPreference(const std::string& key,
     return status;
 }
 
+void
+ChatServicesManager::registerDeferredHandlers(const std::vector<PluginIndex::Handler>& handlers,
+                                              const std::function<bool()>& load)
+{
+    for (const auto& handler : handlers) {
+        auto ptr = std::make_unique<DeferredChatHandler>(handler, load);
+        auto name = handler.details.find("name");
+        if (name != handler.details.end())
+            handlersNameMap_[name->second] = (uintptr_t) ptr.get();
+        chatHandlers_.emplace_back(std::move(ptr));
+    }
+}
+
+void
+ChatServicesManager::removeDeferredHandlers(const std::string& rootPath)
+{
+    for (auto it = chatHandlers_.begin(); it != chatHandlers_.end();) {
+        auto deferred = dynamic_cast<DeferredChatHandler*>(it->get());
+        if (deferred and not deferred->handler() and deferred->id().find(rootPath) == 0) {
+            for (auto& toggledList : chatHandlerToggled_)
+                toggledList.second.erase((uintptr_t) deferred);
+            auto details = deferred->getChatHandlerDetails();
+            auto name = details.find("name");
+            if (name != details.end())
+                handlersNameMap_.erase(name->second);
+            it = chatHandlers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void
 ChatServicesManager::toggleChatHandler(const uintptr_t chatHandlerId,
                                        const std::string& accountId,
@@ -19,7 +19,11 @@
 
 #include "noncopyable.h"
 #include "chathandler.h"
+#include "pluginindex.h"
 #include "pluginpreferencesutils.h"
+#include "scheduled_executor.h"
+
+#include <functional>
 
 namespace jami {
 
@@ -64,6 +68,15 @@ public:
      */
     void publishMessage(pluginMessagePtr message);
 
+    /**
+     * @brief Publishes a set of messages, e.g. loaded from the history of a conversation, from
+     * the thread of the ChatServicesManager rather than the caller's. The messages are
+     * published in order, after the ones published before, each ChatHandler being activated
+     * once by accountId, peerId pair of the set.
+     * @param messages Moved to the ChatHandlers, which share them
+     */
+    void publishMessages(std::vector<pluginMessagePtr>&& messages);
+
     /**
      * @brief If an account is unregistered or a contact is erased, we clear all chat subjects
      * related to that accountId or to the accountId, peerId pair.
@@ -111,6 +124,23 @@ public:
                        const std::string& value,
                        const std::string& rootPath);
 
+    /**
+     * @brief Registers the ChatHandlers of a plugin not loaded yet, from the plugin index.
+     * The plugin is loaded when one of them is first activated, the ChatHandlers it registers
+     * then taking their place, with the same ids.
+     * @param handlers
+     * @param load Loads the plugin
+     */
+    void registerDeferredHandlers(const std::vector<PluginIndex::Handler>& handlers,
+                                  const std::function<bool()>& load);
+
+    /**
+     * @brief Removes the ChatHandlers registered by registerDeferredHandlers() for a plugin
+     * that was not loaded since.
+     * @param rootPath
+     */
+    void removeDeferredHandlers(const std::string& rootPath);
+
 private:
     /**
      * @brief Exposes ChatHandlers' life cycle managers services to the main API.
@@ -130,6 +160,12 @@ private:
                            const std::string& peerId,
                            const bool toggle);
 
+    /**
+     * @brief Publishes messages of the same accountId, peerId pair.
+     */
+    void publishMessages(std::vector<pluginMessagePtr>::const_iterator begin,
+                         std::vector<pluginMessagePtr>::const_iterator end);
+
     // Components that a plugin can register through registerChatHandler service.
     // These objects can then be activated with toggleChatHandler.
     std::list<ChatHandlerPtr> chatHandlers_;
@@ -151,5 +187,8 @@ private:
     // accountId, peerId pair.
     // A map of accountId, peerId pairs and ChatHandler-status pairs.
     ChatHandlerList allowDenyList_ {};
+
+    // Publishes the sets of messages, in order. Destroyed first, as its jobs use the above.
+    ScheduledExecutor dispatcher_ {"plugins-chat"};
 };
 } // namespace jami
@@ -58,12 +58,17 @@ JamiPluginManager::getPluginDetails(const std::string& rootPath)
         return detailsIt->second;
     }
 
+    // Not parsed again until the plugin is reinstalled
+    if (auto entry = index_.get(rootPath))
+        return pluginDetailsMap_.emplace(rootPath, entry->details).first->second;
+
     std::map<std::string, std::string> details = PluginUtils::parseManifestFile(
         PluginUtils::manifestPath(rootPath));
     if (!details.empty()) {
         auto it = details.find("iconPath");
         it->second.insert(0, rootPath + DIR_SEPARATOR_CH + "data" + DIR_SEPARATOR_CH);
         details["soPath"] = rootPath + DIR_SEPARATOR_CH + LIB_PREFIX + details["name"] + LIB_TYPE;
+        index_.setDetails(rootPath, details);
         detailsIt = pluginDetailsMap_.emplace(rootPath, std::move(details)).first;
         return detailsIt->second;
     }
@@ -79,10 +84,14 @@ JamiPluginManager::getInstalledPlugins()
     std::for_each(pluginsPaths.begin(), pluginsPaths.end(), [&pluginsPath](std::string& x) {
         x = pluginsPath + DIR_SEPARATOR_CH + x;
     });
+    // The indexed plugins were checked when installed
+    auto isValid = [this](const std::string& path) {
+        return index_.get(path) or PluginUtils::checkPluginValidity(path);
+    };
     auto returnIterator = std::remove_if(pluginsPaths.begin(),
                                          pluginsPaths.end(),
-                                         [](const std::string& path) {
-                                             return !PluginUtils::checkPluginValidity(path);
+                                         [&isValid](const std::string& path) {
+                                             return !isValid(path);
                                          });
     pluginsPaths.erase(returnIterator, std::end(pluginsPaths));
 
@@ -90,7 +99,7 @@ JamiPluginManager::getInstalledPlugins()
     std::vector<std::string> nonStandardInstalls = jami::Manager::instance()
                                                        .pluginPreferences.getInstalledPlugins();
     for (auto& path : nonStandardInstalls) {
-        if (PluginUtils::checkPluginValidity(path))
+        if (isValid(path))
             pluginsPaths.emplace_back(path);
     }
 
@@ -157,6 +166,10 @@ JamiPluginManager::uninstallPlugin(const std::string& rootPath)
         auto detailsIt = pluginDetailsMap_.find(rootPath);
         if (detailsIt != pluginDetailsMap_.end()) {
             bool loaded = pm_.checkLoadedPlugin(rootPath);
+            {
+                std::lock_guard<std::mutex> lk(deferredMutex_);
+                loaded |= deferred_.count(rootPath) != 0;
+            }
             if (loaded) {
                 JAMI_INFO() << "PLUGIN: unloading before uninstall.";
                 bool status = DRing::unloadPlugin(rootPath);
@@ -171,6 +184,7 @@ JamiPluginManager::uninstallPlugin(const std::string& rootPath)
                                      + detailsIt->second.at("name"));
             pluginDetailsMap_.erase(detailsIt);
         }
+        index_.remove(rootPath);
         return fileutils::removeAll(rootPath);
     } else {
         JAMI_INFO() << "PLUGIN: not installed.";
@@ -179,12 +193,36 @@ JamiPluginManager::uninstallPlugin(const std::string& rootPath)
 }
 
 bool
-JamiPluginManager::loadPlugin(const std::string& rootPath)
+JamiPluginManager::loadPlugin(const std::string& rootPath, bool lazy)
 {
 #ifdef ENABLE_PLUGIN
     try {
-        bool status = pm_.load(getPluginDetails(rootPath).at("soPath"));
+        const auto soPath = getPluginDetails(rootPath).at("soPath");
+        if (lazy and not pm_.checkLoadedPlugin(rootPath)) {
+            auto entry = index_.get(rootPath);
+            if (entry and entry->lazy()) {
+                std::lock_guard<std::mutex> lk(deferredMutex_);
+                if (deferred_.emplace(rootPath).second) {
+                    auto load = [this, rootPath] {
+                        return loadPlugin(rootPath);
+                    };
+                    callsm_.registerDeferredHandlers(entry->callMediaHandlers, load);
+                    chatsm_.registerDeferredHandlers(entry->chatHandlers, load);
+                }
+                JAMI_INFO() << "PLUGIN: load deferred - " << rootPath;
+                return true;
+            }
+        }
+
+        bool status = pm_.load(soPath);
         JAMI_INFO() << "PLUGIN: load status - " << status;
+        if (status) {
+            {
+                std::lock_guard<std::mutex> lk(deferredMutex_);
+                deferred_.erase(rootPath);
+            }
+            indexComponents(rootPath, soPath);
+        }
 
         return status;
 
@@ -201,6 +239,15 @@ JamiPluginManager::unloadPlugin(const std::string& rootPath)
 {
 #ifdef ENABLE_PLUGIN
     try {
+        {
+            std::lock_guard<std::mutex> lk(deferredMutex_);
+            if (deferred_.erase(rootPath)) {
+                callsm_.removeDeferredHandlers(rootPath);
+                chatsm_.removeDeferredHandlers(rootPath);
+                if (not pm_.checkLoadedPlugin(rootPath))
+                    return true;
+            }
+        }
         bool status = pm_.unload(getPluginDetails(rootPath).at("soPath"));
         JAMI_INFO() << "PLUGIN: unload status - " << status;
 
@@ -225,6 +272,10 @@ JamiPluginManager::getLoadedPlugins() const
                    [](const std::string& soPath) {
                        return PluginUtils::getRootPathFromSoPath(soPath);
                    });
+    std::lock_guard<std::mutex> lk(deferredMutex_);
+    for (const auto& rootPath : deferred_)
+        if (std::find(loadedPlugins.begin(), loadedPlugins.end(), rootPath) == loadedPlugins.end())
+            loadedPlugins.emplace_back(rootPath);
     return loadedPlugins;
 }
 
@@ -328,6 +379,28 @@ JamiPluginManager::resetPluginPreferencesValuesMap(const std::string& rootPath,
     return status;
 }
 
+void
+JamiPluginManager::indexComponents(const std::string& rootPath, const std::string& soPath)
+{
+    std::vector<std::string> components;
+    std::vector<PluginIndex::Handler> callMediaHandlers;
+    std::vector<PluginIndex::Handler> chatHandlers;
+    for (const auto& component : pm_.getPluginComponents(soPath)) {
+        components.emplace_back(component.first);
+        if (component.first == "CallMediaHandlerManager") {
+            auto handler = static_cast<CallMediaHandler*>(component.second);
+            callMediaHandlers.push_back({handler->id(), handler->getCallMediaHandlerDetails()});
+        } else if (component.first == "ChatHandlerManager") {
+            auto handler = static_cast<ChatHandler*>(component.second);
+            chatHandlers.push_back({handler->id(), handler->getChatHandlerDetails()});
+        }
+    }
+    index_.setComponents(rootPath,
+                         std::move(components),
+                         std::move(callMediaHandlers),
+                         std::move(chatHandlers));
+}
+
 void
 JamiPluginManager::registerServices()
 {
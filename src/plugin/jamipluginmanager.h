@@ -22,6 +22,7 @@
 
 #include "noncopyable.h"
 #include "plugin/webviewservicesmanager.h"
+#include "pluginindex.h"
 #include "pluginmanager.h"
 #include "pluginpreferencesutils.h"
 
@@ -32,6 +33,8 @@
 #include <vector>
 #include <map>
 #include <list>
+#include <mutex>
+#include <set>
 #include <algorithm>
 
 namespace jami {
@@ -91,8 +94,11 @@ public:
     /**
      * @brief Returns True if success
      * @param rootPath of the plugin folder
+     * @param lazy If true and the plugin only registers call media and chat handlers, as
+     * previously indexed, its handlers are registered from the index and its library is
+     * loaded when one of them is first used.
      */
-    bool loadPlugin(const std::string& rootPath);
+    bool loadPlugin(const std::string& rootPath, bool lazy = false);
 
     /**
      * @brief Returns True if success
@@ -160,12 +166,23 @@ private:
      */
     void registerServices();
 
+    /**
+     * @brief Indexes the components registered by a plugin once its library is loaded.
+     */
+    void indexComponents(const std::string& rootPath, const std::string& soPath);
+
     // PluginManager instance
     PluginManager pm_;
 
     // Map between plugins installation path and manifest infos.
     std::map<std::string, std::map<std::string, std::string>> pluginDetailsMap_;
 
+    PluginIndex index_;
+
+    // Plugins loaded lazily, whose library is not loaded yet.
+    mutable std::mutex deferredMutex_;
+    std::set<std::string> deferred_;
+
     // Services instances
     CallServicesManager callsm_;
     ChatServicesManager chatsm_;
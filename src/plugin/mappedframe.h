@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+}
+
+namespace jami {
+
+/**
+ * @class MappedFrame
+ * @brief Main memory view of a video frame received by a CallMediaHandler, for the handlers
+ * declaring "hardwareFrames" in their details: their frames may then be hardware surfaces.
+ *
+ * A software frame is used as is. A hardware frame is mapped when its API allows it, the
+ * surface being read and written in place, else copied to main memory and, if writable, copied
+ * back when unmapped. It is unmapped when destroyed, at the latest before returning from
+ * Observer::update(), the surface being then given to the encoder.
+ */
+class MappedFrame
+{
+public:
+    /**
+     * @param frame  Frame received by the handler
+     * @param flags  AV_HWFRAME_MAP_READ and/or AV_HWFRAME_MAP_WRITE
+     */
+    explicit MappedFrame(AVFrame* frame, int flags = AV_HWFRAME_MAP_READ | AV_HWFRAME_MAP_WRITE)
+        : source_(frame)
+        , flags_(flags)
+    {
+        if (not frame)
+            return;
+        auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+        if (not desc or not(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            mapped_ = frame;
+            return;
+        }
+        mapped_ = av_frame_alloc();
+        if (not mapped_)
+            return;
+        if (av_hwframe_map(mapped_, frame, flags) < 0) {
+            // Not supported by the API, e.g. CUDA
+            av_frame_unref(mapped_);
+            if (av_hwframe_transfer_data(mapped_, frame, 0) < 0) {
+                av_frame_free(&mapped_);
+                return;
+            }
+            copied_ = true;
+        }
+        av_frame_copy_props(mapped_, frame);
+    }
+
+    ~MappedFrame() { unmap(); }
+
+    MappedFrame(const MappedFrame&) = delete;
+    MappedFrame& operator=(const MappedFrame&) = delete;
+
+    /**
+     * Frame in main memory, null if it could not be mapped
+     */
+    AVFrame* get() const { return mapped_; }
+    explicit operator bool() const { return mapped_; }
+
+    /**
+     * True if the frame is a copy of the surface rather than a mapping
+     */
+    bool isCopy() const { return copied_; }
+
+    void unmap()
+    {
+        if (mapped_ and mapped_ != source_) {
+            if (copied_ and (flags_ & AV_HWFRAME_MAP_WRITE))
+                av_hwframe_transfer_data(source_, mapped_, 0);
+            av_frame_free(&mapped_);
+        }
+        mapped_ = nullptr;
+    }
+
+private:
+    AVFrame* source_;
+    AVFrame* mapped_ {nullptr};
+    int flags_;
+    bool copied_ {false};
+};
+
+} // namespace jami
@@ -0,0 +1,331 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "libav_deps.h" // MUST BE INCLUDED FIRST
+#include "mediaframeadapter.h"
+
+#include "media_buffer.h"
+#include "logger.h"
+#include "metrics.h"
+#ifdef ENABLE_VIDEO
+#include "video/video_scaler.h"
+#ifdef RING_ACCEL
+#include "video/accel.h"
+#endif
+#endif
+
+#include <algorithm>
+#include <sstream>
+
+namespace jami {
+
+MediaHandlerFormat
+MediaHandlerFormat::fromDetails(const std::map<std::string, std::string>& details)
+{
+    auto get = [&details](const char* key, auto& value) {
+        auto it = details.find(key);
+        if (it != details.end())
+            std::istringstream(it->second) >> value;
+    };
+    MediaHandlerFormat format;
+    get("hardwareFrames", format.hardwareFrames);
+    get("width", format.width);
+    get("height", format.height);
+    get("async", format.async);
+    auto budget = format.budget.count();
+    get("budget", budget);
+    format.budget = std::chrono::milliseconds(std::max<decltype(budget)>(budget, 0));
+    auto fallback = details.find("fallback");
+    if (fallback != details.end())
+        format.keepLast = fallback->second != "input";
+    auto it = details.find("pixelFormat");
+    if (it != details.end()) {
+        format.pixelFormat = av_get_pix_fmt(it->second.c_str());
+        if (format.pixelFormat < 0)
+            JAMI_WARN("Unknown pixel format for media handler: %s", it->second.c_str());
+    }
+    return format;
+}
+
+void
+MediaHandlerSubject::attached(Observable<AVFrame*>* source)
+{
+    std::lock_guard<std::mutex> lk(sourceMutex_);
+    source_ = source;
+}
+
+void
+MediaHandlerSubject::detached(Observable<AVFrame*>* source)
+{
+    std::lock_guard<std::mutex> lk(sourceMutex_);
+    if (source_ == source)
+        source_ = nullptr;
+}
+
+void
+MediaHandlerSubject::detachSource()
+{
+    std::unique_lock<std::mutex> lk(sourceMutex_);
+    if (auto source = source_) {
+        lk.unlock();
+        source->detach(this);
+    }
+}
+
+#ifdef ENABLE_VIDEO
+
+/**
+ * Frame of the stream in main memory, referenced or downloaded
+ */
+static std::shared_ptr<VideoFrame>
+mainMemoryFrame(AVFrame* frame)
+{
+    auto input = std::make_shared<VideoFrame>();
+    if (av_frame_ref(input->pointer(), frame) < 0)
+        return {};
+#ifdef RING_ACCEL
+    auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (desc and (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+        input = video::HardwareAccel::transferToMainMemory(*input, AV_PIX_FMT_NV12);
+#endif
+    return input;
+}
+
+struct MediaFrameAdapter::Notifier : public Observer<std::shared_ptr<VideoFrame>>
+{
+    Notifier(MediaFrameAdapter& adapter)
+        : adapter(adapter)
+    {}
+
+    void update(Observable<std::shared_ptr<VideoFrame>>*,
+                const std::shared_ptr<VideoFrame>& frame) override
+    {
+        try {
+            adapter.notify(frame->pointer());
+        } catch (...) {
+            adapter.busy_ = false;
+            throw;
+        }
+        adapter.busy_ = false;
+    }
+
+    MediaFrameAdapter& adapter;
+};
+
+MediaFrameAdapter::MediaFrameAdapter(const MediaHandlerFormat& format)
+    : format_(format)
+    , scaler_(std::make_unique<video::VideoScaler>())
+{
+    if (format_.async) {
+        notifier_ = std::make_unique<Notifier>(*this);
+        async_ = std::make_unique<AsyncObserver<std::shared_ptr<VideoFrame>>>(*notifier_, 1);
+    }
+}
+
+MediaFrameAdapter::~MediaFrameAdapter()
+{
+    detachSource();
+}
+
+void
+MediaFrameAdapter::update(Observable<AVFrame*>*, AVFrame* const& frame)
+{
+    if (not frame)
+        return;
+    // The previous copy is still processed
+    if (async_ and busy_.exchange(true)) {
+        ++dropped_;
+        return;
+    }
+
+    std::shared_ptr<VideoFrame> copy;
+    try {
+        copy = convert(frame);
+    } catch (const std::exception& e) {
+        JAMI_ERR("Unable to convert frame for media handler: %s", e.what());
+    }
+    if (not copy) {
+        busy_ = false;
+        ++dropped_;
+        return;
+    }
+
+    if (async_)
+        async_->update(nullptr, copy);
+    else
+        notify(copy->pointer());
+}
+
+std::shared_ptr<VideoFrame>
+MediaFrameAdapter::convert(AVFrame* frame)
+{
+    auto input = mainMemoryFrame(frame);
+    if (not input)
+        return {};
+
+    // Downscaled to fit, keeping the aspect ratio
+    int width = input->width();
+    int height = input->height();
+    double ratio = 1.;
+    if (format_.width > 0 and width > format_.width)
+        ratio = static_cast<double>(format_.width) / width;
+    if (format_.height > 0 and height > format_.height)
+        ratio = std::min(ratio, static_cast<double>(format_.height) / height);
+    if (ratio < 1.) {
+        width = std::max(2, static_cast<int>(width * ratio) & ~1);
+        height = std::max(2, static_cast<int>(height * ratio) & ~1);
+    }
+    auto format = format_.pixelFormat >= 0 ? format_.pixelFormat : input->format();
+
+    // A reference to the frame of the stream, read only as the copies
+    if (width == input->width() and height == input->height() and format == input->format())
+        return input;
+
+    auto output = std::make_shared<VideoFrame>();
+    output->reserve(format, width, height);
+    scaler_->scale(*input, *output);
+    output->pointer()->pts = frame->pts;
+    return output;
+}
+
+MediaHandlerWorker::MediaHandlerWorker(const std::string& name, const MediaHandlerFormat& format)
+    : budget_(format.budget)
+    , keepLast_(format.keepLast)
+    , processing_(metrics::Registry::instance().histogram(
+          "jami_plugin_media_processing_seconds",
+          "Time taken by the media handlers to process a video frame",
+          metrics::durationBuckets(),
+          {{"handler", name}}))
+    , missed_(metrics::Registry::instance().counter("jami_plugin_media_missed_budgets",
+                                                    "Video frames not processed in time by "
+                                                    "the media handlers",
+                                                    {{"handler", name}}))
+    , thread_([this] { run(); })
+{}
+
+MediaHandlerWorker::~MediaHandlerWorker()
+{
+    detachSource();
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+/**
+ * Replace the content of @frame by a reference to @result, keeping its timestamps
+ */
+static void
+replaceFrame(AVFrame* frame, const VideoFrame& result)
+{
+    auto ref = av_frame_alloc();
+    if (not ref)
+        return;
+    if (av_frame_ref(ref, result.pointer()) == 0) {
+        ref->pts = frame->pts;
+        ref->pkt_dts = frame->pkt_dts;
+        av_frame_unref(frame);
+        av_frame_move_ref(frame, ref);
+    }
+    av_frame_free(&ref);
+}
+
+void
+MediaHandlerWorker::update(Observable<AVFrame*>*, AVFrame* const& frame)
+{
+    if (not frame)
+        return;
+
+    std::unique_lock<std::mutex> lk(mutex_);
+    std::shared_ptr<VideoFrame> result;
+    if (not busy_) {
+        busy_ = true;
+        lk.unlock();
+        // The copy, in a buffer of the pool, is written by the handler
+        std::shared_ptr<VideoFrame> copy;
+        try {
+            auto input = mainMemoryFrame(frame);
+            if (input and input->pointer()->buf[0] != frame->buf[0]) {
+                // Downloaded from the GPU
+                copy = std::move(input);
+            } else if (input) {
+                copy = std::make_shared<VideoFrame>();
+                copy->reserve(input->format(), input->width(), input->height());
+                if (av_frame_copy(copy->pointer(), input->pointer()) < 0)
+                    copy.reset();
+                else
+                    av_frame_copy_props(copy->pointer(), input->pointer());
+            }
+        } catch (const std::exception& e) {
+            JAMI_ERR("Unable to copy frame for media handler: %s", e.what());
+            copy.reset();
+        }
+        lk.lock();
+        if (copy) {
+            input_ = std::move(copy);
+            auto seq = ++queued_;
+            cv_.notify_all();
+            if (cv_.wait_for(lk, budget_, [&] { return done_ >= seq or stop_; }) and done_ >= seq)
+                result = last_;
+        } else {
+            busy_ = false;
+        }
+    }
+    if (not result) {
+        missed_.add();
+        if (keepLast_ and last_ and last_->width() == frame->width
+            and last_->height() == frame->height)
+            result = last_;
+    }
+    lk.unlock();
+    if (result)
+        replaceFrame(frame, *result);
+}
+
+void
+MediaHandlerWorker::run()
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (true) {
+        cv_.wait(lk, [this] { return stop_ or input_; });
+        if (stop_)
+            return;
+        auto input = std::move(input_);
+        auto seq = queued_;
+        lk.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            notify(input->pointer());
+        } catch (const std::exception& e) {
+            JAMI_ERR("Media handler failed: %s", e.what());
+        }
+        processing_.observe(std::chrono::steady_clock::now() - start);
+
+        lk.lock();
+        last_ = std::move(input);
+        done_ = seq;
+        busy_ = false;
+        cv_.notify_all();
+    }
+}
+
+#endif // ENABLE_VIDEO
+
+} // namespace jami
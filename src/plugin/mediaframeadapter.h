@@ -0,0 +1,182 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "mediahandler.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace DRing {
+class VideoFrame;
+}
+
+namespace jami {
+
+using VideoFrame = DRing::VideoFrame;
+namespace video {
+class VideoScaler;
+}
+namespace metrics {
+class Counter;
+class Histogram;
+} // namespace metrics
+
+/**
+ * Video frames wanted by a CallMediaHandler, from the keys of its details
+ * (see CallMediaHandler::getCallMediaHandlerDetails).
+ */
+struct MediaHandlerFormat
+{
+    // Maps the hardware frames itself: the pipeline stays on the GPU
+    bool hardwareFrames {false};
+    // AV_PIX_FMT_NONE for the format of the stream
+    int pixelFormat {-1};
+    // Largest size, 0 for the size of the stream
+    int width {0};
+    int height {0};
+    // Copies processed in the background, the latest one only
+    bool async {false};
+
+    static constexpr std::chrono::milliseconds DEFAULT_BUDGET {20};
+    // Time given to process a frame from a worker thread, 0 to process it inline
+    std::chrono::milliseconds budget {DEFAULT_BUDGET};
+    // After a missed budget, the last frame processed rather than the unprocessed one,
+    // which would make the effect flicker
+    bool keepLast {true};
+
+    static MediaHandlerFormat fromDetails(const std::map<std::string, std::string>& details);
+
+    /**
+     * True if the handler only reads copies of the frames, through a MediaFrameAdapter
+     */
+    bool readOnly() const { return pixelFormat >= 0 or width > 0 or height > 0 or async; }
+};
+
+/**
+ * Subject of a CallMediaHandler, between it and the subject of a video stream, which it is
+ * attached to as long as it lives.
+ */
+class MediaHandlerSubject : public Observer<AVFrame*>, public Observable<AVFrame*>
+{
+public:
+    void attached(Observable<AVFrame*>* source) override;
+    void detached(Observable<AVFrame*>* source) override;
+
+protected:
+    /**
+     * To be called first when destroyed, so that the source doesn't update a partially
+     * destroyed subject
+     */
+    void detachSource();
+
+private:
+    std::mutex sourceMutex_;
+    Observable<AVFrame*>* source_ {nullptr};
+};
+
+/**
+ * Subject of a read-only CallMediaHandler, between it and the subject of a video stream.
+ * It hands the handler copies of the frames, in main memory, in the preferred format and
+ * downscaled to the preferred size, so that e.g. a segmentation network doesn't read the
+ * full resolution frames. The frames of the stream are left untouched: the hardware decoder
+ * and encoder stay linked.
+ *
+ * When asynchronous, the handler is updated from the thread of an AsyncObserver. The frames
+ * arriving while it processes a copy are dropped, before being copied, instead of delaying
+ * the stream.
+ */
+class MediaFrameAdapter : public MediaHandlerSubject
+{
+public:
+    explicit MediaFrameAdapter(const MediaHandlerFormat& format);
+    ~MediaFrameAdapter();
+
+    void update(Observable<AVFrame*>*, AVFrame* const& frame) override;
+
+    /**
+     * @return count of the frames not handed to the handler so far
+     */
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    NON_COPYABLE(MediaFrameAdapter);
+
+    struct Notifier;
+
+    std::shared_ptr<VideoFrame> convert(AVFrame* frame);
+
+    const MediaHandlerFormat format_;
+    std::unique_ptr<video::VideoScaler> scaler_;
+    std::atomic_bool busy_ {false};
+    std::atomic<uint64_t> dropped_ {0};
+    std::unique_ptr<Notifier> notifier_;
+    std::unique_ptr<AsyncObserver<std::shared_ptr<VideoFrame>>> async_;
+};
+
+/**
+ * Subject of a CallMediaHandler modifying the frames, processing them from its own thread so
+ * that a slow handler doesn't lower the frame rate of the stream.
+ *
+ * The handler processes a copy of each frame. The thread of the stream waits for the result
+ * until the budget of the handler, then replaces the frame by it. Past the budget, the frame
+ * is left unprocessed, or replaced by the last frame processed, and the frames arriving until
+ * the handler is done are not handed to it. The processing times and missed budgets are
+ * recorded by handler, as jami_plugin_media_processing_seconds and
+ * jami_plugin_media_missed_budgets.
+ */
+class MediaHandlerWorker : public MediaHandlerSubject
+{
+public:
+    MediaHandlerWorker(const std::string& name, const MediaHandlerFormat& format);
+    ~MediaHandlerWorker();
+
+    void update(Observable<AVFrame*>*, AVFrame* const& frame) override;
+
+private:
+    NON_COPYABLE(MediaHandlerWorker);
+
+    void run();
+
+    const std::chrono::milliseconds budget_;
+    const bool keepLast_;
+    metrics::Histogram& processing_;
+    metrics::Counter& missed_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // Copy to be processed, until taken by the thread
+    std::shared_ptr<VideoFrame> input_;
+    // A copy is waiting or being processed
+    bool busy_ {false};
+    // Copies handed to the thread, and processed
+    uint64_t queued_ {0};
+    uint64_t done_ {0};
+    std::shared_ptr<VideoFrame> last_;
+    bool stop_ {false};
+    std::thread thread_;
+};
+
+} // namespace jami
@@ -82,6 +82,21 @@ public:
      *      "attached" -> 1 if handler is attached;
      *      "dataType" -> 1 if data processed is video;
      *      "dataType" -> 0 if data processed is audio;
+     * Optionally, for video:
+     *      "hardwareFrames" -> 1 if the frames may be hardware surfaces, the handler
+     *                          accessing them through a MappedFrame (see mappedframe.h);
+     *      "pixelFormat" -> format of the frames wanted, e.g. "rgb24" or "nv12";
+     *      "width", "height" -> largest size of the frames wanted;
+     *      "async" -> 1 if the frames may be processed in the background, the frames
+     *                 arriving meanwhile being dropped;
+     *      "budget" -> time to process a frame, in milliseconds, 20 by default, from a
+     *                  thread of the daemon; the stream doesn't wait past it, 0 to
+     *                  process the frames from the thread of the stream;
+     *      "fallback" -> "input" to let the frames unprocessed once the budget is missed,
+     *                    "last" (default) to replace them by the last frame processed.
+     * With "pixelFormat", "width", "height" or "async", the handler receives copies of the
+     * frames in main memory, its writes being ignored: e.g. a mask is computed from
+     * downscaled copies, then applied by a "hardwareFrames" handler.
      * @return Map with CallMediaHandler details.
      */
     virtual std::map<std::string, std::string> getCallMediaHandlerDetails() = 0;
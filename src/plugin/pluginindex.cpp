@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pluginindex.h"
+#include "pluginsutils.h"
+
+#include "fileutils.h"
+#include "logger.h"
+
+#include <algorithm>
+
+namespace jami {
+
+// Component managers of the handlers that can be registered before the library is loaded
+static constexpr const char* LAZY_COMPONENTS[] {"CallMediaHandlerManager", "ChatHandlerManager"};
+
+/**
+ * @return modification time of a file, in seconds, 0 if it doesn't exist
+ */
+static int64_t
+fileTime(const std::string& path)
+{
+    try {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+                   fileutils::writeTime(path).time_since_epoch())
+            .count();
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
+
+bool
+PluginIndex::Entry::lazy() const
+{
+    if (not indexed or (callMediaHandlers.empty() and chatHandlers.empty()))
+        return false;
+    return std::all_of(components.begin(), components.end(), [](const std::string& component) {
+        return std::find(std::begin(LAZY_COMPONENTS), std::end(LAZY_COMPONENTS), component)
+               != std::end(LAZY_COMPONENTS);
+    });
+}
+
+PluginIndex::PluginIndex()
+    : path_(fileutils::get_data_dir() + DIR_SEPARATOR_CH + "plugins" + DIR_SEPARATOR_CH
+            + "index.msgpack")
+{}
+
+std::optional<PluginIndex::Entry>
+PluginIndex::get(const std::string& rootPath)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (not loaded_) {
+        loaded_ = true;
+        try {
+            std::lock_guard<std::mutex> fileLock(fileutils::getFileLock(path_));
+            auto data = fileutils::loadFile(path_);
+            msgpack::unpack(reinterpret_cast<const char*>(data.data()), data.size())
+                .get()
+                .convert(entries_);
+        } catch (const std::exception& e) {
+            // First start, or another version of the index: the plugins are indexed again
+            JAMI_DBG("Plugin index not loaded: %s", e.what());
+            entries_.clear();
+        }
+    }
+    auto it = entries_.find(rootPath);
+    if (it == entries_.end())
+        return std::nullopt;
+    if (not isValid(rootPath, it->second)) {
+        entries_.erase(it);
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+bool
+PluginIndex::isValid(const std::string& rootPath, const Entry& entry) const
+{
+    if (entry.manifestTime == 0
+        or entry.manifestTime != fileTime(PluginUtils::manifestPath(rootPath)))
+        return false;
+    auto soPath = entry.details.find("soPath");
+    return soPath != entry.details.end() and entry.libraryTime == fileTime(soPath->second);
+}
+
+void
+PluginIndex::setDetails(const std::string& rootPath,
+                        const std::map<std::string, std::string>& details)
+{
+    auto soPath = details.find("soPath");
+    if (soPath == details.end())
+        return;
+    // Loads the index if needed
+    get(rootPath);
+
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto& entry = entries_[rootPath];
+    auto manifestTime = fileTime(PluginUtils::manifestPath(rootPath));
+    auto libraryTime = fileTime(soPath->second);
+    if (entry.manifestTime == manifestTime and entry.libraryTime == libraryTime
+        and entry.details == details)
+        return;
+    entry = {};
+    entry.manifestTime = manifestTime;
+    entry.libraryTime = libraryTime;
+    entry.details = details;
+    save();
+}
+
+void
+PluginIndex::setComponents(const std::string& rootPath,
+                           std::vector<std::string> components,
+                           std::vector<Handler> callMediaHandlers,
+                           std::vector<Handler> chatHandlers)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = entries_.find(rootPath);
+    if (it == entries_.end())
+        return;
+    auto& entry = it->second;
+    entry.indexed = true;
+    entry.components = std::move(components);
+    entry.callMediaHandlers = std::move(callMediaHandlers);
+    entry.chatHandlers = std::move(chatHandlers);
+    save();
+}
+
+void
+PluginIndex::remove(const std::string& rootPath)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (entries_.erase(rootPath))
+        save();
+}
+
+void
+PluginIndex::save() const
+{
+    msgpack::sbuffer buffer;
+    msgpack::pack(buffer, entries_);
+    // In order, not to save an older index last
+    std::lock_guard<std::mutex> lk(fileutils::getFileLock(path_));
+    fileutils::saveFile(path_, reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+}
+
+} // namespace jami
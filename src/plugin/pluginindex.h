@@ -0,0 +1,120 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+
+#include <msgpack.hpp>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jami {
+
+/**
+ * @class PluginIndex
+ * @brief Index of the installed plugins, saved in plugins/index.msgpack of the data directory,
+ * so that the daemon starts without parsing their manifests nor loading their libraries.
+ *
+ * An entry holds the details of the manifest of a plugin and, once its library was loaded,
+ * the handlers it registered. It is valid as long as the manifest and the library are not
+ * modified, i.e. until the plugin is reinstalled.
+ */
+class PluginIndex
+{
+public:
+    struct Handler
+    {
+        // MediaHandler::id() or ChatHandler::id()
+        std::string id;
+        std::map<std::string, std::string> details;
+
+        MSGPACK_DEFINE_MAP(id, details)
+    };
+
+    struct Entry
+    {
+        // Modification times of the manifest and of the library, in seconds
+        int64_t manifestTime {0};
+        int64_t libraryTime {0};
+        // See JamiPluginManager::getPluginDetails
+        std::map<std::string, std::string> details;
+        // Set once the library was loaded
+        bool indexed {false};
+        // Component managers of the components registered by the library
+        std::vector<std::string> components;
+        std::vector<Handler> callMediaHandlers;
+        std::vector<Handler> chatHandlers;
+
+        /**
+         * @return True if the library can be loaded when one of its handlers is first used:
+         * it registers call media or chat handlers only
+         */
+        bool lazy() const;
+
+        MSGPACK_DEFINE_MAP(
+            manifestTime, libraryTime, details, indexed, components, callMediaHandlers, chatHandlers)
+    };
+
+    PluginIndex();
+
+    /**
+     * @return the entry of a plugin, if valid
+     * @param rootPath
+     */
+    std::optional<Entry> get(const std::string& rootPath);
+
+    /**
+     * @brief Sets the details of the manifest of a plugin, its handlers being forgotten if it
+     * was reinstalled.
+     * @param rootPath
+     * @param details Including "soPath"
+     */
+    void setDetails(const std::string& rootPath, const std::map<std::string, std::string>& details);
+
+    /**
+     * @brief Sets the components of a plugin, after its library was loaded.
+     * @param rootPath
+     * @param components Component managers of the components
+     * @param callMediaHandlers
+     * @param chatHandlers
+     */
+    void setComponents(const std::string& rootPath,
+                       std::vector<std::string> components,
+                       std::vector<Handler> callMediaHandlers,
+                       std::vector<Handler> chatHandlers);
+
+    void remove(const std::string& rootPath);
+
+private:
+    NON_COPYABLE(PluginIndex);
+
+    bool isValid(const std::string& rootPath, const Entry& entry) const;
+    void save() const;
+
+    const std::string path_;
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+    bool loaded_ {false};
+};
+
+} // namespace jami
@@ -115,6 +115,13 @@ PluginManager::getLoadedPlugins() const
     return res;
 }
 
+PluginManager::ComponentPtrList
+PluginManager::getPluginComponents(const std::string& path) const
+{
+    auto it = pluginComponentsMap_.find(path);
+    return it != pluginComponentsMap_.end() ? it->second : ComponentPtrList {};
+}
+
 void
 PluginManager::destroyPluginComponents(const std::string& path)
 {
@@ -45,6 +45,9 @@ namespace jami {
 class PluginManager
 {
 public:
+    // A list of component type (MediaHandler or ChatHandler), and component pointer pairs
+    using ComponentPtrList = std::list<std::pair<std::string, void*>>;
+
     PluginManager();
     ~PluginManager();
 
@@ -58,9 +61,6 @@ private:
     // A ComponentFunction is a function that may start or end a component life.
     using ComponentFunction = std::function<int32_t(void*, std::mutex&)>;
 
-    // A list of component type (MediaHandler or ChatHandler), and component pointer pairs
-    using ComponentPtrList = std::list<std::pair<std::string, void*>>;
-
     struct ObjectFactory
     {
         JAMI_PluginObjectFactory data;
@@ -116,6 +116,13 @@ public:
      */
     bool checkLoadedPlugin(const std::string& rootPath) const;
 
+    /**
+     * @brief Returns the components registered by a loaded plugin, with the name of their
+     * component manager (e.g. "CallMediaHandlerManager")
+     * @param path
+     */
+    ComponentPtrList getPluginComponents(const std::string& path) const;
+
     /**
      * @brief Register a new service in the Plugin System.
      * @param name The service name
@@ -25,12 +25,24 @@
 #include <sstream>
 #include <fstream>
 #include <fmt/core.h>
+#include <chrono>
+#include <map>
+#include <mutex>
 
 #include "logger.h"
 #include "fileutils.h"
 
 namespace jami {
 
+namespace {
+// Parsed preferences.json files, by path and language, with their modification time
+std::mutex preferencesCacheMutex;
+std::map<std::string,
+         std::pair<std::chrono::system_clock::time_point,
+                   std::vector<std::map<std::string, std::string>>>>
+    preferencesCache;
+} // namespace
+
 std::string
 PluginPreferencesUtils::getPreferencesConfigFilePath(const std::string& rootPath,
                                                      const std::string& accountId)
@@ -187,6 +199,17 @@ PluginPreferencesUtils::getPreferences(const std::string& rootPath, const std::s
             lang = std::locale("").name();
 #endif // WIN32
         }
+
+        // Not parsed again until modified, i.e. until the plugin is reinstalled
+        const auto cacheKey = preferenceFilePath + '\n' + lang;
+        const auto time = fileutils::writeTime(preferenceFilePath);
+        {
+            std::lock_guard<std::mutex> lk(preferencesCacheMutex);
+            auto cached = preferencesCache.find(cacheKey);
+            if (cached != preferencesCache.end() and cached->second.first == time)
+                return cached->second.second;
+        }
+
         auto locales = getLocales(rootPath, std::string(string_remove_suffix(lang, '.')));
 
         // Read the file to a json format
@@ -227,6 +250,8 @@ PluginPreferencesUtils::getPreferences(const std::string& rootPath, const std::s
                     }
                 }
             }
+            std::lock_guard<std::mutex> lk(preferencesCacheMutex);
+            preferencesCache[cacheKey] = {time, preferences};
         } else {
             JAMI_ERR() << "PluginPreferencesParser:: Failed to parse preferences.json for plugin: "
                        << preferenceFilePath;
@@ -86,6 +86,18 @@ struct JamiMessage
         , fromPlugin {pPlugin}
     {}
 
+    JamiMessage(const std::string& accId,
+                const std::string& pId,
+                bool isReceived,
+                std::map<std::string, std::string>&& dataMap,
+                bool pPlugin)
+        : accountId {accId}
+        , peerId {pId}
+        , direction {isReceived}
+        , data {std::move(dataMap)}
+        , fromPlugin {pPlugin}
+    {}
+
     std::string accountId;
     std::string peerId;
     // True if it's a received message.
@@ -79,6 +79,7 @@ constexpr const char* const Preferences::CONFIG_LABEL;
 const char* const Preferences::DFT_ZONE = "North America";
 const char* const Preferences::REGISTRATION_EXPIRE_KEY = "registrationexpire";
 constexpr std::string_view DEFAULT_CONFERENCE_RESOLUTION {"1280x720"};
+constexpr std::string_view DEFAULT_DEGRADATION_PREFERENCE {"balanced"};
 
 // general preferences
 static constexpr const char* ORDER_KEY {"order"};
@@ -90,6 +91,7 @@ static constexpr const char* ZONE_TONE_CHOICE_KEY {"zoneToneChoice"};
 static constexpr const char* PORT_NUM_KEY {"portNum"};
 static constexpr const char* SEARCH_BAR_DISPLAY_KEY {"searchBarDisplay"};
 static constexpr const char* MD5_HASH_KEY {"md5Hash"};
+static constexpr const char* SHARED_DHT_KEY {"sharedDht"};
 
 // voip preferences
 constexpr const char* const VoipPreference::CONFIG_LABEL;
@@ -99,6 +101,7 @@ static constexpr const char* PLAY_TONES_KEY {"playTones"};
 static constexpr const char* PULSE_LENGTH_KEY {"pulseLength"};
 static constexpr const char* SYMMETRIC_RTP_KEY {"symmetric"};
 static constexpr const char* ZID_FILE_KEY {"zidFile"};
+static constexpr const char* SIP_EVENT_THREADS_KEY {"sipEventThreads"};
 
 // audio preferences
 constexpr const char* const AudioPreference::CONFIG_LABEL;
@@ -115,6 +118,7 @@ static constexpr const char* DEVICE_RECORD_KEY {"deviceRecord"};
 static constexpr const char* DEVICE_RINGTONE_KEY {"deviceRingtone"};
 static constexpr const char* RECORDPATH_KEY {"recordPath"};
 static constexpr const char* ALWAYS_RECORDING_KEY {"alwaysRecording"};
+static constexpr const char* RECORD_PASSTHROUGH_KEY {"recordPassthrough"};
 static constexpr const char* VOLUMEMIC_KEY {"volumeMic"};
 static constexpr const char* VOLUMESPKR_KEY {"volumeSpkr"};
 static constexpr const char* AUDIO_PROCESSOR_KEY {"audioProcessor"};
@@ -124,6 +128,8 @@ static constexpr const char* CAPTURE_MUTED_KEY {"captureMuted"};
 static constexpr const char* PLAYBACK_MUTED_KEY {"playbackMuted"};
 static constexpr const char* VAD_KEY {"voiceActivityDetection"};
 static constexpr const char* ECHO_CANCEL_KEY {"echoCancel"};
+static constexpr const char* LOW_LATENCY_KEY {"lowLatency"};
+static constexpr const char* LATENCY_PERIOD_KEY {"latencyPeriod"};
 
 #ifdef ENABLE_VIDEO
 // video preferences
@@ -132,7 +138,12 @@ static constexpr const char* DECODING_ACCELERATED_KEY {"decodingAccelerated"};
 static constexpr const char* ENCODING_ACCELERATED_KEY {"encodingAccelerated"};
 static constexpr const char* RECORD_PREVIEW_KEY {"recordPreview"};
 static constexpr const char* RECORD_QUALITY_KEY {"recordQuality"};
+static constexpr const char* RECORD_ENCODING_ACCELERATED_KEY {"recordEncodingAccelerated"};
 static constexpr const char* CONFERENCE_RESOLUTION_KEY {"conferenceResolution"};
+static constexpr const char* CONFERENCE_ENCODING_TIERS_KEY {"conferenceEncodingTiers"};
+static constexpr const char* CONFERENCE_FORWARDING_KEY {"conferenceForwarding"};
+static constexpr const char* SHARED_CALL_ENCODERS_KEY {"sharedCallEncoders"};
+static constexpr const char* DEGRADATION_PREFERENCE_KEY {"degradationPreference"};
 #endif
 
 #ifdef ENABLE_PLUGIN
@@ -159,6 +170,7 @@ Preferences::Preferences()
     , portNum_(sip_utils::DEFAULT_SIP_PORT)
     , searchBarDisplay_(true)
     , md5Hash_(false)
+    , sharedDht_(false)
 {}
 
 void
@@ -183,6 +195,7 @@ Preferences::verifyAccountOrder(const std::vector<std::string>& accountIDs)
     }
 
     if (drop) {
+        setDirty();
         accountOrder_.clear();
         for (const auto& t : tokens)
             accountOrder_ += t + '/';
@@ -193,6 +206,7 @@ void
 Preferences::addAccount(const std::string& newAccountID)
 {
     // Add the newly created account in the account order list
+    setDirty();
     if (not accountOrder_.empty())
         accountOrder_.insert(0, newAccountID + "/");
     else
@@ -204,8 +218,10 @@ Preferences::removeAccount(const std::string& oldAccountID)
 {
     // include the slash since we don't want to remove a partial match
     const size_t start = accountOrder_.find(oldAccountID + "/");
-    if (start != std::string::npos)
+    if (start != std::string::npos) {
         accountOrder_.erase(start, oldAccountID.length() + 1);
+        setDirty();
+    }
 }
 
 void
@@ -221,12 +237,14 @@ Preferences::serialize(YAML::Emitter& out) const
     out << YAML::Key << PORT_NUM_KEY << YAML::Value << portNum_;
     out << YAML::Key << SEARCH_BAR_DISPLAY_KEY << YAML::Value << searchBarDisplay_;
     out << YAML::Key << ZONE_TONE_CHOICE_KEY << YAML::Value << zoneToneChoice_;
+    out << YAML::Key << SHARED_DHT_KEY << YAML::Value << sharedDht_;
     out << YAML::EndMap;
 }
 
 void
 Preferences::unserialize(const YAML::Node& in)
 {
+    setDirty();
     const auto& node = in[CONFIG_LABEL];
 
     parseValue(node, ORDER_KEY, accountOrder_);
@@ -237,6 +255,7 @@ Preferences::unserialize(const YAML::Node& in)
     parseValue(node, PORT_NUM_KEY, portNum_);
     parseValue(node, SEARCH_BAR_DISPLAY_KEY, searchBarDisplay_);
     parseValue(node, MD5_HASH_KEY, md5Hash_);
+    parseValueOptional(node, SHARED_DHT_KEY, sharedDht_);
 }
 
 VoipPreference::VoipPreference()
@@ -245,6 +264,7 @@ VoipPreference::VoipPreference()
     , playTones_(true)
     , pulseLength_(PULSE_LENGTH_DEFAULT)
     , symmetricRtp_(true)
+    , sipEventThreads_(1)
 {}
 
 void
@@ -257,12 +277,14 @@ VoipPreference::serialize(YAML::Emitter& out) const
     out << YAML::Key << PULSE_LENGTH_KEY << YAML::Value << pulseLength_;
     out << YAML::Key << SYMMETRIC_RTP_KEY << YAML::Value << symmetricRtp_;
     out << YAML::Key << ZID_FILE_KEY << YAML::Value << zidFile_;
+    out << YAML::Key << SIP_EVENT_THREADS_KEY << YAML::Value << sipEventThreads_;
     out << YAML::EndMap;
 }
 
 void
 VoipPreference::unserialize(const YAML::Node& in)
 {
+    setDirty();
     const auto& node = in[CONFIG_LABEL];
     parseValue(node, DISABLE_SECURE_DLG_CHECK_KEY, disableSecureDlgCheck_);
     parseValue(node, PLAY_DTMF_KEY, playDtmf_);
@@ -270,6 +292,7 @@ VoipPreference::unserialize(const YAML::Node& in)
     parseValue(node, PULSE_LENGTH_KEY, pulseLength_);
     parseValue(node, SYMMETRIC_RTP_KEY, symmetricRtp_);
     parseValue(node, ZID_FILE_KEY, zidFile_);
+    parseValueOptional(node, SIP_EVENT_THREADS_KEY, sipEventThreads_);
 }
 
 AudioPreference::AudioPreference()
@@ -284,6 +307,7 @@ AudioPreference::AudioPreference()
     , pulseDeviceRingtone_("")
     , recordpath_("")
     , alwaysRecording_(false)
+    , recordPassthrough_(false)
     , volumemic_(1.0)
     , volumespkr_(1.0)
     , audioProcessor_("webrtc")
@@ -293,6 +317,8 @@ AudioPreference::AudioPreference()
     , echoCanceller_("auto")
     , captureMuted_(false)
     , playbackMuted_(false)
+    , lowLatency_(false)
+    , latencyPeriod_(DEFAULT_LATENCY_PERIOD)
 {}
 
 #if HAVE_ALSA
@@ -312,6 +338,8 @@ checkSoundCard(int& card, AudioDeviceType type)
 AudioLayer*
 AudioPreference::createAudioLayer()
 {
+    // The API may fall back to another one
+    setDirty();
 #if HAVE_OPENSL
     return new OpenSLLayer(*this);
 #else
@@ -427,9 +455,12 @@ AudioPreference::serialize(YAML::Emitter& out) const
 
     // common options
     out << YAML::Key << ALWAYS_RECORDING_KEY << YAML::Value << alwaysRecording_;
+    out << YAML::Key << RECORD_PASSTHROUGH_KEY << YAML::Value << recordPassthrough_;
     out << YAML::Key << AUDIO_API_KEY << YAML::Value << audioApi_;
     out << YAML::Key << CAPTURE_MUTED_KEY << YAML::Value << captureMuted_;
     out << YAML::Key << PLAYBACK_MUTED_KEY << YAML::Value << playbackMuted_;
+    out << YAML::Key << LOW_LATENCY_KEY << YAML::Value << lowLatency_;
+    out << YAML::Key << LATENCY_PERIOD_KEY << YAML::Value << latencyPeriod_;
 
     // pulse submap
     out << YAML::Key << PULSEMAP_KEY << YAML::Value << YAML::BeginMap;
@@ -464,7 +495,7 @@ AudioPreference::setRecordPath(const std::string& r)
 {
     std::string path = fileutils::expand_path(r);
     if (fileutils::isDirectoryWritable(path)) {
-        recordpath_ = path;
+        update(recordpath_, path);
         return true;
     } else {
         JAMI_ERR("%s is not writable, cannot be the recording path", path.c_str());
@@ -475,6 +506,7 @@ AudioPreference::setRecordPath(const std::string& r)
 void
 AudioPreference::unserialize(const YAML::Node& in)
 {
+    setDirty();
     const auto& node = in[CONFIG_LABEL];
 
     // alsa submap
@@ -488,11 +520,15 @@ AudioPreference::unserialize(const YAML::Node& in)
 
     // common options
     parseValue(node, ALWAYS_RECORDING_KEY, alwaysRecording_);
+    parseValueOptional(node, RECORD_PASSTHROUGH_KEY, recordPassthrough_);
     parseValue(node, AUDIO_API_KEY, audioApi_);
     parseValue(node, AGC_KEY, agcEnabled_);
     parseValue(node, CAPTURE_MUTED_KEY, captureMuted_);
     parseValue(node, NOISE_REDUCE_KEY, denoise_);
     parseValue(node, PLAYBACK_MUTED_KEY, playbackMuted_);
+    parseValueOptional(node, LOW_LATENCY_KEY, lowLatency_);
+    parseValueOptional(node, LATENCY_PERIOD_KEY, latencyPeriod_);
+    setLatencyPeriod(latencyPeriod_);
 
     // pulse submap
     const auto& pulse = node[PULSEMAP_KEY];
@@ -521,7 +557,12 @@ VideoPreferences::VideoPreferences()
     , encodingAccelerated_(false)
     , recordPreview_(true)
     , recordQuality_(0)
+    , recordEncodingAccelerated_(false)
     , conferenceResolution_(DEFAULT_CONFERENCE_RESOLUTION)
+    , conferenceEncodingTiers_(false)
+    , conferenceForwarding_(false)
+    , sharedCallEncoders_(false)
+    , degradationPreference_(DEFAULT_DEGRADATION_PREFERENCE)
 {}
 
 void
@@ -533,8 +574,14 @@ VideoPreferences::serialize(YAML::Emitter& out) const
 #ifdef RING_ACCEL
     out << YAML::Key << DECODING_ACCELERATED_KEY << YAML::Value << decodingAccelerated_;
     out << YAML::Key << ENCODING_ACCELERATED_KEY << YAML::Value << encodingAccelerated_;
+    out << YAML::Key << RECORD_ENCODING_ACCELERATED_KEY << YAML::Value
+        << recordEncodingAccelerated_;
 #endif
     out << YAML::Key << CONFERENCE_RESOLUTION_KEY << YAML::Value << conferenceResolution_;
+    out << YAML::Key << CONFERENCE_ENCODING_TIERS_KEY << YAML::Value << conferenceEncodingTiers_;
+    out << YAML::Key << CONFERENCE_FORWARDING_KEY << YAML::Value << conferenceForwarding_;
+    out << YAML::Key << SHARED_CALL_ENCODERS_KEY << YAML::Value << sharedCallEncoders_;
+    out << YAML::Key << DEGRADATION_PREFERENCE_KEY << YAML::Value << degradationPreference_;
     getVideoDeviceMonitor().serialize(out);
     out << YAML::EndMap;
 }
@@ -542,6 +589,7 @@ VideoPreferences::serialize(YAML::Emitter& out) const
 void
 VideoPreferences::unserialize(const YAML::Node& in)
 {
+    setDirty();
     // values may or may not be present
     const auto& node = in[CONFIG_LABEL];
     try {
@@ -559,12 +607,37 @@ VideoPreferences::unserialize(const YAML::Node& in)
         decodingAccelerated_ = true;
         encodingAccelerated_ = false;
     }
+    try {
+        parseValue(node, RECORD_ENCODING_ACCELERATED_KEY, recordEncodingAccelerated_);
+    } catch (...) {
+        recordEncodingAccelerated_ = false;
+    }
 #endif
     try {
         parseValue(node, CONFERENCE_RESOLUTION_KEY, conferenceResolution_);
     } catch (...) {
         conferenceResolution_ = DEFAULT_CONFERENCE_RESOLUTION;
     }
+    try {
+        parseValue(node, CONFERENCE_ENCODING_TIERS_KEY, conferenceEncodingTiers_);
+    } catch (...) {
+        conferenceEncodingTiers_ = false;
+    }
+    try {
+        parseValue(node, CONFERENCE_FORWARDING_KEY, conferenceForwarding_);
+    } catch (...) {
+        conferenceForwarding_ = false;
+    }
+    try {
+        parseValue(node, SHARED_CALL_ENCODERS_KEY, sharedCallEncoders_);
+    } catch (...) {
+        sharedCallEncoders_ = false;
+    }
+    try {
+        parseValue(node, DEGRADATION_PREFERENCE_KEY, degradationPreference_);
+    } catch (...) {
+        degradationPreference_ = DEFAULT_DEGRADATION_PREFERENCE;
+    }
     getVideoDeviceMonitor().unserialize(in);
 }
 #endif // ENABLE_VIDEO
@@ -587,6 +660,7 @@ PluginPreferences::serialize(YAML::Emitter& out) const
 void
 PluginPreferences::unserialize(const YAML::Node& in)
 {
+    setDirty();
     // values may or may not be present
     const auto& node = in[CONFIG_LABEL];
     try {
@@ -25,6 +25,8 @@
 
 #include "config/serializable.h"
 #include "client/ring_signal.h"
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <map>
 #include <set>
@@ -43,7 +45,7 @@ namespace jami {
 
 class AudioLayer;
 
-class Preferences : public Serializable
+class Preferences : public TrackedSerializable
 {
 public:
     static const char* const DFT_ZONE;
@@ -62,34 +64,40 @@ public:
     void addAccount(const std::string& acc);
     void removeAccount(const std::string& acc);
 
-    void setAccountOrder(const std::string& ord) { accountOrder_ = ord; }
+    void setAccountOrder(const std::string& ord) { update(accountOrder_, ord); }
 
     int getHistoryLimit() const { return historyLimit_; }
 
-    void setHistoryLimit(int lim) { historyLimit_ = lim; }
+    void setHistoryLimit(int lim) { update(historyLimit_, lim); }
 
     int getRingingTimeout() const { return ringingTimeout_; }
 
-    void setRingingTimeout(int timeout) { ringingTimeout_ = timeout; }
+    void setRingingTimeout(int timeout) { update(ringingTimeout_, timeout); }
 
     int getHistoryMaxCalls() const { return historyMaxCalls_; }
 
-    void setHistoryMaxCalls(int max) { historyMaxCalls_ = max; }
+    void setHistoryMaxCalls(int max) { update(historyMaxCalls_, max); }
 
     std::string getZoneToneChoice() const { return zoneToneChoice_; }
 
-    void setZoneToneChoice(const std::string& str) { zoneToneChoice_ = str; }
+    void setZoneToneChoice(const std::string& str) { update(zoneToneChoice_, str); }
 
     int getPortNum() const { return portNum_; }
 
-    void setPortNum(int port) { portNum_ = port; }
+    void setPortNum(int port) { update(portNum_, port); }
 
     bool getSearchBarDisplay() const { return searchBarDisplay_; }
 
-    void setSearchBarDisplay(bool search) { searchBarDisplay_ = search; }
+    void setSearchBarDisplay(bool search) { update(searchBarDisplay_, search); }
 
     bool getMd5Hash() const { return md5Hash_; }
-    void setMd5Hash(bool md5) { md5Hash_ = md5; }
+    void setMd5Hash(bool md5) { update(md5Hash_, md5); }
+
+    /**
+     * Run one DHT node for all the Jami accounts, instead of one per account
+     */
+    bool getSharedDht() const { return sharedDht_; }
+    void setSharedDht(bool shared) { update(sharedDht_, shared); }
 
 private:
     std::string accountOrder_;
@@ -100,10 +108,11 @@ private:
     int portNum_;
     bool searchBarDisplay_;
     bool md5Hash_;
+    bool sharedDht_;
     constexpr static const char* const CONFIG_LABEL = "preferences";
 };
 
-class VoipPreference : public Serializable
+class VoipPreference : public TrackedSerializable
 {
 public:
     VoipPreference();
@@ -112,25 +121,31 @@ public:
     void unserialize(const YAML::Node& in) override;
 
     bool getDisableSecureDlgCheck() const { return disableSecureDlgCheck_; }
-    void setDisableSecureDlgCheck(bool disable) { disableSecureDlgCheck_ = disable; }
+    void setDisableSecureDlgCheck(bool disable) { update(disableSecureDlgCheck_, disable); }
 
     bool getPlayDtmf() const { return playDtmf_; }
 
-    void setPlayDtmf(bool dtmf) { playDtmf_ = dtmf; }
+    void setPlayDtmf(bool dtmf) { update(playDtmf_, dtmf); }
 
     bool getPlayTones() const { return playTones_; }
 
-    void setPlayTones(bool tone) { playTones_ = tone; }
+    void setPlayTones(bool tone) { update(playTones_, tone); }
 
     int getPulseLength() const { return pulseLength_; }
 
-    void setPulseLength(int length) { pulseLength_ = length; }
+    void setPulseLength(int length) { update(pulseLength_, length); }
 
     bool getSymmetricRtp() const { return symmetricRtp_; }
-    void setSymmetricRtp(bool sym) { symmetricRtp_ = sym; }
+    void setSymmetricRtp(bool sym) { update(symmetricRtp_, sym); }
 
     std::string getZidFile() const { return zidFile_; }
-    void setZidFile(const std::string& file) { zidFile_ = file; }
+    void setZidFile(const std::string& file) { update(zidFile_, file); }
+
+    /**
+     * Threads handling the SIP events, e.g. for an account with many calls
+     */
+    unsigned getSipEventThreads() const { return sipEventThreads_; }
+    void setSipEventThreads(unsigned count) { update(sipEventThreads_, count); }
 
 private:
     bool disableSecureDlgCheck_;
@@ -139,10 +154,11 @@ private:
     int pulseLength_;
     bool symmetricRtp_;
     std::string zidFile_;
+    unsigned sipEventThreads_;
     constexpr static const char* const CONFIG_LABEL = "voipPreferences";
 };
 
-class AudioPreference : public Serializable
+class AudioPreference : public TrackedSerializable
 {
 public:
     AudioPreference();
@@ -152,7 +168,7 @@ public:
 
     const std::string& getAudioApi() const { return audioApi_; }
 
-    void setAudioApi(const std::string& api) { audioApi_ = api; }
+    void setAudioApi(const std::string& api) { update(audioApi_, api); }
 
     void serialize(YAML::Emitter& out) const override;
 
@@ -161,48 +177,48 @@ public:
     // alsa preference
     int getAlsaCardin() const { return alsaCardin_; }
 
-    void setAlsaCardin(int c) { alsaCardin_ = c; }
+    void setAlsaCardin(int c) { update(alsaCardin_, c); }
 
     int getAlsaCardout() const { return alsaCardout_; }
 
-    void setAlsaCardout(int c) { alsaCardout_ = c; }
+    void setAlsaCardout(int c) { update(alsaCardout_, c); }
 
     int getAlsaCardRingtone() const { return alsaCardRingtone_; }
 
-    void setAlsaCardRingtone(int c) { alsaCardRingtone_ = c; }
+    void setAlsaCardRingtone(int c) { update(alsaCardRingtone_, c); }
 
     const std::string& getAlsaPlugin() const { return alsaPlugin_; }
 
-    void setAlsaPlugin(const std::string& p) { alsaPlugin_ = p; }
+    void setAlsaPlugin(const std::string& p) { update(alsaPlugin_, p); }
 
     int getAlsaSmplrate() const { return alsaSmplrate_; }
 
-    void setAlsaSmplrate(int r) { alsaSmplrate_ = r; }
+    void setAlsaSmplrate(int r) { update(alsaSmplrate_, r); }
 
     // pulseaudio preference
     const std::string& getPulseDevicePlayback() const { return pulseDevicePlayback_; }
 
-    void setPulseDevicePlayback(const std::string& p) { pulseDevicePlayback_ = p; }
+    void setPulseDevicePlayback(const std::string& p) { update(pulseDevicePlayback_, p); }
 
     const std::string& getPulseDeviceRecord() const { return pulseDeviceRecord_; }
-    void setPulseDeviceRecord(const std::string& r) { pulseDeviceRecord_ = r; }
+    void setPulseDeviceRecord(const std::string& r) { update(pulseDeviceRecord_, r); }
 
     const std::string& getPulseDeviceRingtone() const { return pulseDeviceRingtone_; }
 
-    void setPulseDeviceRingtone(const std::string& r) { pulseDeviceRingtone_ = r; }
+    void setPulseDeviceRingtone(const std::string& r) { update(pulseDeviceRingtone_, r); }
 
     // portaudio preference
     const std::string& getPortAudioDevicePlayback() const { return portaudioDevicePlayback_; }
 
-    void setPortAudioDevicePlayback(const std::string& p) { portaudioDevicePlayback_ = p; }
+    void setPortAudioDevicePlayback(const std::string& p) { update(portaudioDevicePlayback_, p); }
 
     const std::string& getPortAudioDeviceRecord() const { return portaudioDeviceRecord_; }
 
-    void setPortAudioDeviceRecord(const std::string& r) { portaudioDeviceRecord_ = r; }
+    void setPortAudioDeviceRecord(const std::string& r) { update(portaudioDeviceRecord_, r); }
 
     const std::string& getPortAudioDeviceRingtone() const { return portaudioDeviceRingtone_; }
 
-    void setPortAudioDeviceRingtone(const std::string& r) { portaudioDeviceRingtone_ = r; }
+    void setPortAudioDeviceRingtone(const std::string& r) { update(portaudioDeviceRingtone_, r); }
 
     // general preference
     const std::string& getRecordPath() const { return recordpath_; }
@@ -212,41 +228,76 @@ public:
 
     bool getIsAlwaysRecording() const { return alwaysRecording_; }
 
-    void setIsAlwaysRecording(bool rec) { alwaysRecording_ = rec; }
+    void setIsAlwaysRecording(bool rec) { update(alwaysRecording_, rec); }
+
+    /**
+     * Whether the calls are recorded without being decoded and encoded again, their streams
+     * being written as they are received and sent
+     */
+    bool getRecordPassthrough() const { return recordPassthrough_; }
+
+    void setRecordPassthrough(bool passthrough) { update(recordPassthrough_, passthrough); }
 
     double getVolumemic() const { return volumemic_; }
-    void setVolumemic(double m) { volumemic_ = m; }
+    void setVolumemic(double m) { update(volumemic_, m); }
 
     double getVolumespkr() const { return volumespkr_; }
-    void setVolumespkr(double s) { volumespkr_ = s; }
+    void setVolumespkr(double s) { update(volumespkr_, s); }
 
     bool isAGCEnabled() const { return agcEnabled_; }
 
-    void setAGCState(bool enabled) { agcEnabled_ = enabled; }
+    void setAGCState(bool enabled) { update(agcEnabled_, enabled); }
 
     bool getNoiseReduce() const { return denoise_; }
 
-    void setNoiseReduce(bool enabled) { denoise_ = enabled; }
+    void setNoiseReduce(bool enabled) { update(denoise_, enabled); }
 
     bool getCaptureMuted() const { return captureMuted_; }
 
-    void setCaptureMuted(bool muted) { captureMuted_ = muted; }
+    void setCaptureMuted(bool muted) { update(captureMuted_, muted); }
 
     bool getPlaybackMuted() const { return playbackMuted_; }
 
-    void setPlaybackMuted(bool muted) { playbackMuted_ = muted; }
+    void setPlaybackMuted(bool muted) { update(playbackMuted_, muted); }
 
     const std::string& getAudioProcessor() const { return audioProcessor_; }
 
-    void setAudioProcessor(const std::string& ap) { audioProcessor_ = ap; }
+    void setAudioProcessor(const std::string& ap) { update(audioProcessor_, ap); }
 
     bool getVadEnabled() const { return vadEnabled_; }
 
-    void setVad(bool enable) { vadEnabled_ = enable; }
+    void setVad(bool enable) { update(vadEnabled_, enable); }
 
     const std::string& getEchoCanceller() const { return echoCanceller_; }
 
-    void setEchoCancel(std::string& canceller) { echoCanceller_ = canceller; }
+    void setEchoCancel(std::string& canceller) { update(echoCanceller_, canceller); }
+
+    // low-latency mode, for headsets: short periods, at the cost of more wake-ups
+    static constexpr int MIN_LATENCY_PERIOD {5};
+    static constexpr int MAX_LATENCY_PERIOD {20};
+    static constexpr int DEFAULT_LATENCY_PERIOD {10};
+
+    bool getLowLatency() const { return lowLatency_; }
+
+    void setLowLatency(bool enabled) { update(lowLatency_, enabled); }
+
+    /**
+     * Period of the audio devices in low-latency mode, in milliseconds
+     */
+    int getLatencyPeriod() const { return latencyPeriod_; }
+
+    void setLatencyPeriod(int ms)
+    {
+        update(latencyPeriod_, std::clamp(ms, MIN_LATENCY_PERIOD, MAX_LATENCY_PERIOD));
+    }
+
+    /**
+     * Period requested to the audio devices, zero for the default of their driver
+     */
+    std::chrono::milliseconds getDevicePeriod() const
+    {
+        return std::chrono::milliseconds(lowLatency_ ? latencyPeriod_ : 0);
+    }
 
 private:
     std::string audioApi_;
@@ -271,6 +322,7 @@ private:
     // general preference
     std::string recordpath_; //: /home/msavard/Bureau
     bool alwaysRecording_;
+    bool recordPassthrough_;
     double volumemic_;
     double volumespkr_;
 
@@ -283,11 +335,14 @@ private:
 
     bool captureMuted_;
     bool playbackMuted_;
+
+    bool lowLatency_;
+    int latencyPeriod_;
     constexpr static const char* const CONFIG_LABEL = "audio";
 };
 
 #ifdef ENABLE_VIDEO
-class VideoPreferences : public Serializable
+class VideoPreferences : public TrackedSerializable
 {
 public:
     VideoPreferences();
@@ -301,6 +356,7 @@ public:
     {
         if (decodingAccelerated_ != decodingAccelerated) {
             decodingAccelerated_ = decodingAccelerated;
+            setDirty();
             emitSignal<DRing::ConfigurationSignal::HardwareDecodingChanged>(decodingAccelerated_);
             return true;
         }
@@ -313,6 +369,7 @@ public:
     {
         if (encodingAccelerated_ != encodingAccelerated) {
             encodingAccelerated_ = encodingAccelerated;
+            setDirty();
             emitSignal<DRing::ConfigurationSignal::HardwareEncodingChanged>(encodingAccelerated_);
             return true;
         }
@@ -321,28 +378,68 @@ public:
 
     bool getRecordPreview() const { return recordPreview_; }
 
-    void setRecordPreview(bool rec) { recordPreview_ = rec; }
+    void setRecordPreview(bool rec) { update(recordPreview_, rec); }
 
     int getRecordQuality() const { return recordQuality_; }
 
-    void setRecordQuality(int rec) { recordQuality_ = rec; }
+    void setRecordQuality(int rec) { update(recordQuality_, rec); }
+
+    /**
+     * Whether the recordings are encoded by the hardware, when the encoding is accelerated
+     */
+    bool getRecordEncodingAccelerated() const { return recordEncodingAccelerated_; }
+
+    void setRecordEncodingAccelerated(bool accel) { update(recordEncodingAccelerated_, accel); }
 
     const std::string& getConferenceResolution() const { return conferenceResolution_; }
 
-    void setConferenceResolution(const std::string& res) { conferenceResolution_ = res; }
+    void setConferenceResolution(const std::string& res) { update(conferenceResolution_, res); }
+
+    bool getConferenceEncodingTiers() const { return conferenceEncodingTiers_; }
+
+    void setConferenceEncodingTiers(bool tiers) { update(conferenceEncodingTiers_, tiers); }
+
+    /**
+     * Whether the conferences forward the video of the participant shown to the
+     * others, instead of encoding the mix for each of them (see RtpForwarder)
+     */
+    bool getConferenceForwarding() const { return conferenceForwarding_; }
+
+    void setConferenceForwarding(bool forwarding) { update(conferenceForwarding_, forwarding); }
+
+    bool getSharedCallEncoders() const { return sharedCallEncoders_; }
+
+    void setSharedCallEncoders(bool shared) { update(sharedCallEncoders_, shared); }
+
+    /**
+     * What the video keeps below the bitrate its picture needs, as WebRTC's:
+     * "maintain-framerate", "maintain-resolution", or "balanced" (the resolution
+     * of the screens, else the frame rate while it is not too blurred)
+     */
+    const std::string& getDegradationPreference() const { return degradationPreference_; }
+
+    void setDegradationPreference(const std::string& preference)
+    {
+        update(degradationPreference_, preference);
+    }
 
 private:
     bool decodingAccelerated_;
     bool encodingAccelerated_;
     bool recordPreview_;
     int recordQuality_;
+    bool recordEncodingAccelerated_;
     std::string conferenceResolution_;
+    bool conferenceEncodingTiers_;
+    bool conferenceForwarding_;
+    bool sharedCallEncoders_;
+    std::string degradationPreference_;
     constexpr static const char* const CONFIG_LABEL = "video";
 };
 #endif // ENABLE_VIDEO
 
 #ifdef ENABLE_PLUGIN
-class PluginPreferences : public Serializable
+class PluginPreferences : public TrackedSerializable
 {
 public:
     PluginPreferences();
@@ -352,7 +449,7 @@ public:
 
     bool getPluginsEnabled() const { return pluginsEnabled_; }
 
-    void setPluginsEnabled(bool pluginsEnabled) { pluginsEnabled_ = pluginsEnabled; }
+    void setPluginsEnabled(bool pluginsEnabled) { update(pluginsEnabled_, pluginsEnabled); }
 
     std::vector<std::string> getLoadedPlugins() const
     {
@@ -371,10 +468,13 @@ public:
             if (loadedPlugins_.find(plugin) != loadedPlugins_.end())
                 return;
             loadedPlugins_.emplace(plugin);
+            setDirty();
         } else {
             auto it = loadedPlugins_.find(plugin);
-            if (it != loadedPlugins_.end())
+            if (it != loadedPlugins_.end()) {
                 loadedPlugins_.erase(it);
+                setDirty();
+            }
         }
     }
 
@@ -55,6 +55,10 @@ init(enum InitFlag flags) noexcept
         jami::Logger::setFileLog(log_file);
     }
 
+    // e.g. JAMI_LOG_MODULES=media=warning,sip=debug
+    if (const char* log_modules = getenv("JAMI_LOG_MODULES"))
+        jami::Logger::setModuleLevels(log_modules);
+
     // Following function create a local static variable inside
     // This var must have the same live as Manager.
     // So we call it now to create this var.
@@ -96,6 +100,7 @@ initialized() noexcept
 void
 fini() noexcept
 {
+    jami::signal_batching::flush();
     jami::Manager::instance().finish();
     jami::Logger::fini();
 }
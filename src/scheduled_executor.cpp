@@ -20,55 +20,344 @@
 #include "scheduled_executor.h"
 #include "logger.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace jami {
 
 std::atomic<uint64_t> task_cookie = {0};
 
-ScheduledExecutor::ScheduledExecutor(const std::string& name)
+/**
+ * Hierarchical timer wheel, of LEVELS levels of SLOTS slots, a slot of level L
+ * covering SLOTS^L ticks. A task is linked in the slot of its due tick at the
+ * level covering its delay, then moved down a level each time the wheel reaches
+ * its slot, until due. Scheduling and cancelling a task take constant time.
+ */
+class TimerWheel : public std::enable_shared_from_this<TimerWheel>
+{
+public:
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+
+    explicit TimerWheel(time_point start)
+        : start_(start)
+    {}
+
+    std::mutex mutex {};
+
+    /**
+     * @return false if the task is already due
+     * @note mutex must be locked
+     */
+    bool insert(const std::shared_ptr<Task>& task, time_point t, time_point now);
+    /**
+     * @note mutex must be locked
+     */
+    std::shared_ptr<Task> erase(Task& task);
+    /**
+     * Move the tasks due at now to due, in order
+     * @return when the next tasks may be due
+     * @note mutex must be locked
+     */
+    std::optional<time_point> advance(time_point now, std::vector<std::shared_ptr<Task>>& due);
+    /**
+     * @note mutex must be locked
+     */
+    std::vector<std::shared_ptr<Task>> clear();
+
+private:
+    static constexpr auto TICK = std::chrono::milliseconds(1);
+    static constexpr unsigned BITS {8};
+    static constexpr std::size_t SLOTS {1u << BITS};
+    static constexpr uint64_t MASK {SLOTS - 1};
+    static constexpr std::size_t LEVELS {4};
+    // Later tasks wait in the last level, and are moved again once there
+    static constexpr uint64_t MAX_DELAY {(uint64_t(1) << (BITS * LEVELS)) - 1};
+    static constexpr uint64_t NO_EVENT {std::numeric_limits<uint64_t>::max()};
+
+    struct Slot
+    {
+        Task* head {nullptr};
+        Task* tail {nullptr};
+    };
+
+    // First tick at or after t
+    uint64_t tickOf(time_point t) const
+    {
+        return t <= start_ ? 0 : (t - start_ + TICK - std::chrono::nanoseconds(1)) / TICK;
+    }
+    // Last tick at or before t
+    uint64_t lastTickOf(time_point t) const { return t <= start_ ? 0 : (t - start_) / TICK; }
+    void link(Task& task, uint64_t tick);
+    void unlink(Task& task);
+    void cascade(std::size_t level, std::size_t slot);
+    /**
+     * @return NO_EVENT if no task is linked
+     */
+    uint64_t nextEventTick() const;
+
+    const time_point start_;
+    uint64_t tick_ {0};
+    std::size_t count_ {0};
+    std::array<std::array<Slot, SLOTS>, LEVELS> slots_ {};
+};
+
+bool
+TimerWheel::insert(const std::shared_ptr<Task>& task, time_point t, time_point now)
+{
+    if (count_ == 0)
+        tick_ = std::max(tick_, lastTickOf(now));
+    auto tick = tickOf(t);
+    if (tick <= tick_)
+        return false;
+    task->wheel_ = weak_from_this();
+    task->when_ = t;
+    task->scheduled_ = task;
+    link(*task, tick);
+    ++count_;
+    return true;
+}
+
+void
+TimerWheel::link(Task& task, uint64_t tick)
+{
+    auto delay = std::min(tick - tick_, MAX_DELAY);
+    tick = tick_ + delay;
+    std::size_t level = 0;
+    while (level + 1 < LEVELS and delay >= (uint64_t(1) << (BITS * (level + 1))))
+        ++level;
+    auto& slot = slots_[level][(tick >> (BITS * level)) & MASK];
+    task.level_ = level;
+    task.slot_ = (tick >> (BITS * level)) & MASK;
+    task.prev_ = slot.tail;
+    task.next_ = nullptr;
+    if (slot.tail)
+        slot.tail->next_ = &task;
+    else
+        slot.head = &task;
+    slot.tail = &task;
+}
+
+void
+TimerWheel::unlink(Task& task)
+{
+    auto& slot = slots_[task.level_][task.slot_];
+    if (task.prev_)
+        task.prev_->next_ = task.next_;
+    else
+        slot.head = task.next_;
+    if (task.next_)
+        task.next_->prev_ = task.prev_;
+    else
+        slot.tail = task.prev_;
+    task.prev_ = task.next_ = nullptr;
+}
+
+std::shared_ptr<Task>
+TimerWheel::erase(Task& task)
+{
+    if (not task.scheduled_)
+        return {};
+    unlink(task);
+    --count_;
+    return std::move(task.scheduled_);
+}
+
+void
+TimerWheel::cascade(std::size_t level, std::size_t slot)
+{
+    auto* task = slots_[level][slot].head;
+    slots_[level][slot] = {};
+    while (task) {
+        auto* next = task->next_;
+        link(*task, tickOf(task->when_));
+        task = next;
+    }
+}
+
+uint64_t
+TimerWheel::nextEventTick() const
+{
+    auto next = NO_EVENT;
+    // A task of level 0 is due in less than SLOTS ticks, maybe past the end of the rotation
+    for (auto t = tick_ + 1; t < tick_ + SLOTS; ++t) {
+        if (slots_[0][t & MASK].head) {
+            next = t;
+            break;
+        }
+    }
+    // The next slot of each level reached by the wheel, lower digits being zero
+    for (std::size_t level = 1; level < LEVELS; ++level) {
+        auto shift = BITS * level;
+        for (uint64_t i = 1; i <= SLOTS; ++i) {
+            auto t = ((tick_ >> shift) + i) << shift;
+            if (t >= next)
+                break;
+            if (slots_[level][(t >> shift) & MASK].head) {
+                next = t;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+std::optional<TimerWheel::time_point>
+TimerWheel::advance(time_point now, std::vector<std::shared_ptr<Task>>& due)
+{
+    const auto target = lastTickOf(now);
+    while (count_ > 0) {
+        auto next = nextEventTick();
+        if (next == NO_EVENT) {
+            // Can't happen with tasks left, but waking up in the past would spin
+            JAMI_ERR("Timer wheel: %zu tasks not found", count_);
+            tick_ = std::max(tick_, target);
+            return start_ + (tick_ + SLOTS) * TICK;
+        }
+        if (next > target) {
+            tick_ = std::max(tick_, target);
+            return start_ + next * TICK;
+        }
+        tick_ = next;
+        for (std::size_t level = 1; level < LEVELS; ++level) {
+            auto shift = BITS * level;
+            if (tick_ & ((uint64_t(1) << shift) - 1))
+                break;
+            cascade(level, (tick_ >> shift) & MASK);
+        }
+        auto& slot = slots_[0][tick_ & MASK];
+        auto* task = slot.head;
+        slot = {};
+        while (task) {
+            auto* nextTask = task->next_;
+            task->prev_ = task->next_ = nullptr;
+            if (tickOf(task->when_) > tick_) {
+                // Past MAX_DELAY when scheduled
+                link(*task, tickOf(task->when_));
+            } else {
+                --count_;
+                due.emplace_back(std::move(task->scheduled_));
+            }
+            task = nextTask;
+        }
+    }
+    tick_ = std::max(tick_, target);
+    return std::nullopt;
+}
+
+std::vector<std::shared_ptr<Task>>
+TimerWheel::clear()
+{
+    std::vector<std::shared_ptr<Task>> tasks;
+    tasks.reserve(count_);
+    for (auto& level : slots_) {
+        for (auto& slot : level) {
+            for (auto* task = slot.head; task;) {
+                auto* next = task->next_;
+                task->prev_ = task->next_ = nullptr;
+                tasks.emplace_back(std::move(task->scheduled_));
+                task = next;
+            }
+            slot = {};
+        }
+    }
+    count_ = 0;
+    return tasks;
+}
+
+void
+Task::cancel()
+{
+    job_.reset();
+    if (auto wheel = wheel_.lock()) {
+        std::shared_ptr<Task> self;
+        std::lock_guard<std::mutex> lock(wheel->mutex);
+        self = wheel->erase(*this);
+    }
+}
+
+ScheduledExecutor::ScheduledExecutor(const std::string& name, std::size_t threads)
     : name_(name)
     , running_(std::make_shared<std::atomic<bool>>(true))
-    , thread_([this, is_running = running_] {
-        // The thread needs its own reference of `running_` in case the
-        // scheduler is destroyed within the thread because of a job
+    , timers_(std::make_shared<TimerWheel>(clock::now()))
+{
+    threads_.reserve(std::max<std::size_t>(threads, 1));
+    for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i) {
+        threads_.emplace_back([this, is_running = running_] {
+            // The thread needs its own reference of `running_` in case the
+            // scheduler is destroyed within the thread because of a job
 
-        while (*is_running)
-            loop();
-    })
-{}
+            while (*is_running)
+                loop();
+        });
+    }
+}
 
 ScheduledExecutor::~ScheduledExecutor()
 {
     stop();
 
-    if (not thread_.joinable()) {
-        return;
-    }
-
-    // Avoid deadlock
-    if (std::this_thread::get_id() == thread_.get_id()) {
-        thread_.detach();
-    } else {
-        thread_.join();
+    for (auto& thread : threads_) {
+        if (not thread.joinable())
+            continue;
+        // Avoid deadlock
+        if (std::this_thread::get_id() == thread.get_id()) {
+            thread.detach();
+        } else {
+            thread.join();
+        }
     }
 }
 
 void
 ScheduledExecutor::stop()
 {
+    // Released once unlocked, their jobs may use the executor
+    std::vector<std::shared_ptr<Task>> tasks;
     std::lock_guard<std::mutex> lock(jobLock_);
     *running_ = false;
-    jobs_.clear();
+    {
+        std::lock_guard<std::mutex> lk(timers_->mutex);
+        tasks = timers_->clear();
+    }
+    for (auto& queue : ready_)
+        queue.jobs.clear();
     cv_.notify_all();
 }
 
 void
 ScheduledExecutor::run(std::function<void()>&& job,
                        const char* filename, uint32_t linum)
+{
+    run(std::move(job), Priority::Normal, filename, linum);
+}
+
+void
+ScheduledExecutor::run(std::function<void()>&& job, Priority priority,
+                       const char* filename, uint32_t linum)
 {
     std::lock_guard<std::mutex> lock(jobLock_);
-    auto now = clock::now();
-    jobs_[now].emplace_back(std::move(job), filename, linum);
-    cv_.notify_all();
+    auto& queue = ready_[static_cast<std::size_t>(priority)];
+    queue.jobs.emplace_back(ReadyJob {{std::move(job), filename, linum}});
+    queue.stats.maxDepth = std::max(queue.stats.maxDepth, queue.jobs.size());
+    cv_.notify_one();
+}
+
+ScheduledExecutor::QueueStats
+ScheduledExecutor::getQueueStats(Priority priority) const
+{
+    std::lock_guard<std::mutex> lock(jobLock_);
+    const auto& queue = ready_[static_cast<std::size_t>(priority)];
+    auto stats = queue.stats;
+    stats.depth = queue.jobs.size();
+    return stats;
+}
+
+uint64_t
+ScheduledExecutor::getTimerWakeups() const
+{
+    std::lock_guard<std::mutex> lock(jobLock_);
+    return timerWakeups_;
 }
 
 std::shared_ptr<Task>
@@ -113,40 +402,165 @@ ScheduledExecutor::reschedule(std::shared_ptr<RepeatedTask> task, time_point t,
 void
 ScheduledExecutor::schedule(std::shared_ptr<Task> task, time_point t)
 {
-    const char* filename =  task->job().filename;
-    uint32_t linenum = task->job().linum;
     std::lock_guard<std::mutex> lock(jobLock_);
-    jobs_[t].emplace_back([task = std::move(task), this] { task->run(name_.c_str()); },
-                            filename, linenum);
+    if (not *running_)
+        return;
+    bool scheduled;
+    {
+        std::lock_guard<std::mutex> lk(timers_->mutex);
+        scheduled = timers_->insert(task, t, clock::now());
+    }
+    if (not scheduled) {
+        auto& queue = ready_[static_cast<std::size_t>(Priority::Normal)];
+        queue.jobs.emplace_back(ReadyJob {{{}, nullptr, 0}, std::move(task)});
+        queue.stats.maxDepth = std::max(queue.stats.maxDepth, queue.jobs.size());
+    }
     cv_.notify_all();
 }
 
+bool
+ScheduledExecutor::hasReadyJobs() const
+{
+    for (const auto& queue : ready_)
+        if (not queue.jobs.empty())
+            return true;
+    return false;
+}
+
+std::optional<ScheduledExecutor::time_point>
+ScheduledExecutor::queueDueJobs(time_point now)
+{
+    std::vector<std::shared_ptr<Task>> due;
+    std::optional<time_point> next;
+    {
+        std::lock_guard<std::mutex> lk(timers_->mutex);
+        next = timers_->advance(now, due);
+    }
+    auto& queue = ready_[static_cast<std::size_t>(Priority::Normal)];
+    for (auto& task : due)
+        queue.jobs.emplace_back(ReadyJob {{{}, nullptr, 0}, std::move(task)});
+    queue.stats.maxDepth = std::max(queue.stats.maxDepth, queue.jobs.size());
+    return next;
+}
+
+ScheduledExecutor::ReadyJob
+ScheduledExecutor::nextReadyJob()
+{
+    for (std::size_t p = 0; p < PRIORITY_COUNT; ++p) {
+        auto& queue = ready_[p];
+        if (queue.jobs.empty()) {
+            queue.served = 0;
+            continue;
+        }
+        // Past its budget, the queue gives its turn if a lower one waits
+        if (queue.served >= BUDGETS[p]) {
+            bool lowerWaiting = false;
+            for (auto l = p + 1; l < PRIORITY_COUNT; ++l)
+                lowerWaiting |= not ready_[l].jobs.empty();
+            queue.served = 0;
+            if (lowerWaiting)
+                continue;
+        }
+        ++queue.served;
+        ++queue.stats.count;
+        auto job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        return job;
+    }
+    return {{{}, nullptr, 0}};
+}
+
 void
 ScheduledExecutor::loop()
 {
-    std::vector<Job> jobs;
+    ReadyJob job {{{}, nullptr, 0}};
     {
         std::unique_lock<std::mutex> lock(jobLock_);
-        while (*running_ and (jobs_.empty() or jobs_.begin()->first > clock::now())) {
-            if (jobs_.empty())
+        while (*running_) {
+            auto next = queueDueJobs(clock::now());
+            if (hasReadyJobs())
+                break;
+            if (next and not timerWaiter_) {
+                timerWaiter_ = true;
+                cv_.wait_until(lock, *next);
+                timerWaiter_ = false;
+                ++timerWakeups_;
+            } else
                 cv_.wait(lock);
-            else {
-                auto nextJob = jobs_.begin()->first;
-                cv_.wait_until(lock, nextJob);
-            }
         }
         if (not *running_)
             return;
-        jobs = std::move(jobs_.begin()->second);
-        jobs_.erase(jobs_.begin());
+        job = nextReadyJob();
+        // For another worker to run the jobs left or to wait for the next tasks
+        if (threads_.size() > 1)
+            cv_.notify_one();
+    }
+    try {
+        if (job.task)
+            job.task->run(name_.c_str());
+        else if (job.job)
+            job.job.fn();
+    } catch (const std::exception& e) {
+        JAMI_ERR("Exception running job: %s", e.what());
     }
-    for (auto& job : jobs) {
+}
+
+struct Strand::State
+{
+    State(ScheduledExecutor& e, ScheduledExecutor::Priority p)
+        : executor(e)
+        , priority(p)
+    {}
+
+    ScheduledExecutor& executor;
+    const ScheduledExecutor::Priority priority;
+    std::mutex mutex {};
+    std::deque<Job> jobs {};
+    bool running {false};
+
+    static void post(const std::shared_ptr<State>& state)
+    {
+        const auto& job = state->jobs.front();
+        state->executor.run([state] { drain(state); }, state->priority, job.filename, job.linum);
+    }
+
+    // One job at a time, for the jobs of the other strands to run in between
+    static void drain(const std::shared_ptr<State>& state)
+    {
+        Job job {{}, nullptr, 0};
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            job = std::move(state->jobs.front());
+            state->jobs.pop_front();
+        }
         try {
             job.fn();
         } catch (const std::exception& e) {
             JAMI_ERR("Exception running job: %s", e.what());
         }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->jobs.empty())
+            state->running = false;
+        else
+            post(state);
     }
+};
+
+Strand::Strand(ScheduledExecutor& executor, ScheduledExecutor::Priority priority)
+    : state_(std::make_shared<State>(executor, priority))
+{}
+
+Strand::~Strand() = default;
+
+void
+Strand::run(std::function<void()>&& job, const char* filename, uint32_t linum)
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->jobs.emplace_back(std::move(job), filename, linum);
+    if (state_->running)
+        return;
+    state_->running = true;
+    State::post(state_);
 }
 
 } // namespace jami
@@ -22,6 +22,9 @@
 #include <thread>
 #include <functional>
 #include <map>
+#include <array>
+#include <deque>
+#include <optional>
 #include <vector>
 #include <chrono>
 #include <memory>
@@ -39,6 +42,8 @@ namespace jami {
 
 extern std::atomic<uint64_t> task_cookie;
 
+class TimerWheel;
+
 /**
  * A runnable function
  */
@@ -86,6 +91,8 @@ struct RepeatedJob {
 class Task
 {
 public:
+    using time_point = std::chrono::steady_clock::time_point;
+
     Task(std::function<void()>&& fn, const char* filename, uint32_t linum)
         : job_(std::move(fn), filename, linum)
         , cookie_(task_cookie++) { }
@@ -106,14 +113,29 @@ public:
     }
 #pragma GCC pop
 
-    void cancel() { job_.reset(); }
+    /**
+     * A scheduled task is removed from its executor at once
+     */
+    void cancel();
     bool isCancelled() const { return !job_; }
 
     Job& job() { return job_; }
 
 private:
+    NON_COPYABLE(Task);
+    friend class TimerWheel;
+
     Job job_;
     uint64_t cookie_;
+
+    // While scheduled, the task is linked in a slot of the timer wheel of its executor
+    std::weak_ptr<TimerWheel> wheel_ {};
+    std::shared_ptr<Task> scheduled_ {};
+    Task* prev_ {nullptr};
+    Task* next_ {nullptr};
+    std::size_t level_ {0};
+    std::size_t slot_ {0};
+    time_point when_ {};
 };
 
 /**
@@ -184,7 +206,28 @@ public:
     using time_point = clock::time_point;
     using duration = clock::duration;
 
-    ScheduledExecutor(const std::string& name_);
+    /**
+     * Jobs run ASAP are queued by priority, the timed jobs joining the Normal
+     * queue once due. A queue runs up to its budget of jobs in a row while
+     * lower ones wait, so that a burst doesn't starve them.
+     */
+    enum class Priority : unsigned {
+        High = 0, // e.g. call control
+        Normal,   // e.g. signals to the client
+        Low,      // e.g. progress of the file transfers
+        Count
+    };
+
+    struct QueueStats {
+        std::size_t depth {0};
+        std::size_t maxDepth {0};
+        uint64_t count {0};
+    };
+
+    /**
+     * @param threads   Workers running the jobs, in order with a single one
+     */
+    ScheduledExecutor(const std::string& name_, std::size_t threads = 1);
     ~ScheduledExecutor();
 
     /**
@@ -193,6 +236,10 @@ public:
     void run(std::function<void()>&& job,
              const char* filename=CURRENT_FILENAME(),
              uint32_t linum=CURRENT_LINE());
+    void run(std::function<void()>&& job,
+             Priority priority,
+             const char* filename=CURRENT_FILENAME(),
+             uint32_t linum=CURRENT_LINE());
 
     /**
      * Schedule job to be run at time t
@@ -221,19 +268,83 @@ public:
      */
     void stop();
 
+    /**
+     * @return jobs waiting in the queue, the most that waited and the jobs run
+     */
+    QueueStats getQueueStats(Priority priority) const;
+
+    /**
+     * @return times a worker woke up to check the timers, at most once per due tick
+     */
+    uint64_t getTimerWakeups() const;
+
 private:
     NON_COPYABLE(ScheduledExecutor);
 
     void loop();
     void schedule(std::shared_ptr<Task>, time_point t);
     void reschedule(std::shared_ptr<RepeatedTask>, time_point t, duration dt);
+    /**
+     * A job run ASAP or a due task, the latter run without wrapping it in a new job
+     */
+    struct ReadyJob {
+        Job job;
+        std::shared_ptr<Task> task {};
+    };
+
+    /**
+     * @note jobLock_ must be locked
+     */
+    bool hasReadyJobs() const;
+    /**
+     * @return when the next tasks may be due
+     */
+    std::optional<time_point> queueDueJobs(time_point now);
+    ReadyJob nextReadyJob();
+
+    static constexpr std::size_t PRIORITY_COUNT {static_cast<std::size_t>(Priority::Count)};
+    static constexpr std::array<unsigned, PRIORITY_COUNT> BUDGETS {16, 4, 1};
+
+    struct ReadyQueue {
+        std::deque<ReadyJob> jobs {};
+        unsigned served {0};
+        QueueStats stats {};
+    };
 
     std::string name_;
     std::shared_ptr<std::atomic<bool>> running_;
-    std::map<time_point, std::vector<Job>> jobs_ {};
-    std::mutex jobLock_ {};
+    std::shared_ptr<TimerWheel> timers_;
+    std::array<ReadyQueue, PRIORITY_COUNT> ready_ {};
+    mutable std::mutex jobLock_ {};
     std::condition_variable cv_ {};
-    std::thread thread_;
+    // A single idle worker waits for the next tasks, the others for jobs
+    bool timerWaiter_ {false};
+    uint64_t timerWakeups_ {0};
+    std::vector<std::thread> threads_;
+};
+
+/**
+ * Jobs run in order, one at a time, on the workers of an executor, e.g. the
+ * jobs of an account that must not run concurrently but can run beside the others.
+ */
+class Strand
+{
+public:
+    explicit Strand(ScheduledExecutor& executor,
+                    ScheduledExecutor::Priority priority = ScheduledExecutor::Priority::Normal);
+    /**
+     * The jobs left still run once the strand is destroyed
+     */
+    ~Strand();
+
+    void run(std::function<void()>&& job,
+             const char* filename=CURRENT_FILENAME(),
+             uint32_t linum=CURRENT_LINE());
+
+private:
+    NON_COPYABLE(Strand);
+    struct State;
+    std::shared_ptr<State> state_;
 };
 
 } // namespace jami
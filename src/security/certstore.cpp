@@ -25,16 +25,39 @@
 
 #include "fileutils.h"
 #include "logger.h"
+#include "jamidht/map_journal.h"
 
 #include <opendht/thread_pool.h>
 #include <gnutls/ocsp.h>
 
+#include <algorithm>
 #include <thread>
 #include <sstream>
 
 namespace jami {
 namespace tls {
 
+// Parsed certificates of the index kept in memory
+static constexpr std::size_t MAX_PARSED_CERTIFICATES {512};
+// Verified chains whose result is kept, and for how long
+static constexpr std::size_t MAX_CACHED_VERIFICATIONS {1024};
+static constexpr std::chrono::minutes VERIFICATION_TTL {10};
+
+/**
+ * @return false if an issuer of crt is missing, up to the self-signed one
+ */
+static bool
+hasFullChain(const crypto::Certificate& crt)
+{
+    auto c = &crt;
+    while (c->getUID() != c->getIssuerUID()) {
+        if (not c->issuer)
+            return false;
+        c = c->issuer.get();
+    }
+    return true;
+}
+
 CertificateStore&
 CertificateStore::instance()
 {
@@ -50,6 +73,8 @@ CertificateStore::CertificateStore()
     : certPath_(fileutils::get_data_dir() + DIR_SEPARATOR_CH + "certificates")
     , crlPath_(fileutils::get_data_dir() + DIR_SEPARATOR_CH + "crls")
     , ocspPath_(fileutils::get_data_dir() + DIR_SEPARATOR_CH + "ocsp")
+    , indexPath_(fileutils::get_data_dir() + DIR_SEPARATOR_CH + "certificates.index")
+    , indexJournal_(std::make_unique<MapJournal<IndexEntry>>(indexPath_))
 {
     fileutils::check_dir(certPath_.c_str());
     fileutils::check_dir(crlPath_.c_str());
@@ -57,37 +82,174 @@ CertificateStore::CertificateStore()
     loadLocalCertificates();
 }
 
+CertificateStore::~CertificateStore() = default;
+
 unsigned
 CertificateStore::loadLocalCertificates()
 {
-    std::lock_guard<std::mutex> l(lock_);
+    std::unique_lock l(lock_);
 
     auto dir_content = fileutils::readDirectory(certPath_);
-    unsigned n = 0;
+    std::set<std::string> files(dir_content.begin(), dir_content.end());
+    index_ = MapJournal<IndexEntry>::read(indexPath_);
+    auto size = index_.size();
+    std::set<std::string> indexed;
+    for (auto it = index_.begin(); it != index_.end();) {
+        if (files.find(it->second.file) == files.end()) {
+            it = index_.erase(it);
+        } else {
+            indexed.emplace(it->second.file);
+            ++it;
+        }
+    }
+    bool changed = size != index_.size();
+
+    // Only the files not indexed yet (e.g. saved by a previous version) are parsed
     for (const auto& f : dir_content) {
+        if (indexed.find(f) != indexed.end())
+            continue;
         try {
-            auto crt = std::make_shared<crypto::Certificate>(
-                fileutils::loadFile(certPath_ + DIR_SEPARATOR_CH + f));
-            auto id = crt->getId().toString();
-            auto longId = crt->getLongId().toString();
-            if (id != f && longId != f)
+            crypto::Certificate crt(fileutils::loadFile(certPath_ + DIR_SEPARATOR_CH + f));
+            if (crt.getId().toString() != f && crt.getLongId().toString() != f)
                 throw std::logic_error("Certificate id mismatch");
-            while (crt) {
-                id = crt->getId().toString();
-                longId = crt->getLongId().toString();
-                certs_.emplace(std::move(id), crt);
-                certs_.emplace(std::move(longId), crt);
-                loadRevocations(*crt);
-                crt = crt->issuer;
-                ++n;
-            }
+            indexCertificate(f, crt);
+            changed = true;
         } catch (const std::exception& e) {
             JAMI_WARN() << "Remove cert. " << e.what();
             remove((certPath_ + DIR_SEPARATOR_CH + f).c_str());
         }
     }
-    JAMI_DBG("CertificateStore: loaded %u local certificates.", n);
-    return n;
+    for (const auto& [id, entry] : index_)
+        longIds_.emplace(entry.longId, id);
+    if (changed)
+        saveIndex();
+    JAMI_DBG("CertificateStore: indexed %zu local certificates.", index_.size());
+    return index_.size();
+}
+
+void
+CertificateStore::indexCertificate(const std::string& file, const crypto::Certificate& crt)
+{
+    for (auto c = &crt; c; c = c->issuer.get()) {
+        auto id = c->getId().toString();
+        auto& entry = index_[id];
+        // An issuer saved in its own file is read from it
+        if (c != &crt && !entry.file.empty() && entry.file != file
+            && (entry.file == id || entry.file == entry.longId))
+            continue;
+        entry.file = file;
+        entry.longId = c->getLongId().toString();
+        entry.uid = c->getUID();
+        entry.name = c->getName();
+        entry.expiration = std::chrono::system_clock::to_time_t(c->getExpiration());
+        longIds_[entry.longId] = std::move(id);
+    }
+}
+
+void
+CertificateStore::saveIndex()
+{
+    try {
+        indexJournal_->save(index_);
+    } catch (const std::exception& e) {
+        JAMI_WARN("CertificateStore: can't save the index: %s", e.what());
+    }
+}
+
+std::shared_ptr<crypto::Certificate>
+CertificateStore::getCertificateLocked(const std::string& k) const
+{
+    auto lit = longIds_.find(k);
+    const auto& id = lit == longIds_.end() ? k : lit->second;
+    auto cit = certs_.find(k);
+    if (cit != certs_.end()) {
+        touch(id);
+        return cit->second;
+    }
+    auto entry = index_.find(id);
+    if (entry == index_.end())
+        return {};
+
+    std::shared_ptr<crypto::Certificate> crt;
+    try {
+        auto chain = std::make_shared<crypto::Certificate>(
+            fileutils::loadFile(certPath_ + DIR_SEPARATOR_CH + entry->second.file));
+        for (auto c = chain; c; c = c->issuer) {
+            auto cid = c->getId().toString();
+            auto inserted = certs_.emplace(cid, c).second;
+            if (inserted) {
+                certs_.emplace(c->getLongId().toString(), c);
+                loadRevocations(*c);
+            }
+            if (index_.find(cid) != index_.end())
+                touch(cid);
+            if (cid == id) {
+                crt = certs_[cid];
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        JAMI_WARN("CertificateStore: can't load %s: %s", entry->second.file.c_str(), e.what());
+    }
+    releaseUnusedCertificates();
+    return crt;
+}
+
+std::size_t
+CertificateStore::parsedCertificates() const
+{
+    std::shared_lock l(lock_);
+    // By id and long id
+    return certs_.size() / 2;
+}
+
+void
+CertificateStore::touch(const std::string& id) const
+{
+    if (index_.find(id) != index_.end())
+        lastUse_[id] = ++useCount_;
+}
+
+void
+CertificateStore::releaseUnusedCertificates() const
+{
+    if (lastUse_.size() <= MAX_PARSED_CERTIFICATES)
+        return;
+    std::vector<std::pair<uint64_t, std::string>> unused;
+    unused.reserve(lastUse_.size());
+    for (const auto& [id, lastUse] : lastUse_)
+        unused.emplace_back(lastUse.load(), id);
+    std::sort(unused.begin(), unused.end());
+    auto toRelease = lastUse_.size() - MAX_PARSED_CERTIFICATES;
+    for (const auto& [lastUse, id] : unused) {
+        if (toRelease == 0)
+            break;
+        auto cit = certs_.find(id);
+        auto entry = index_.find(id);
+        // Only referenced by certs_, by id and long id
+        if (cit != certs_.end() && cit->second.use_count() > 2)
+            continue;
+        certs_.erase(id);
+        if (entry != index_.end())
+            certs_.erase(entry->second.longId);
+        lastUse_.erase(id);
+        --toRelease;
+    }
+}
+
+std::string
+CertificateStore::findIndexed(const std::string& uid, const std::string& name) const
+{
+    const IndexEntry* found {nullptr};
+    const std::string* foundId {nullptr};
+    for (const auto& [id, entry] : index_) {
+        if ((!uid.empty() ? entry.uid != uid : entry.name != name)
+            || (found && found->expiration >= entry.expiration))
+            continue;
+        found = &entry;
+        foundId = &id;
+    }
+    return foundId ? *foundId : std::string {};
 }
 
 void
@@ -133,33 +295,42 @@ CertificateStore::loadRevocations(crypto::Certificate& crt) const
 std::vector<std::string>
 CertificateStore::getPinnedCertificates() const
 {
-    std::lock_guard<std::mutex> l(lock_);
+    std::shared_lock l(lock_);
 
-    std::vector<std::string> certIds;
-    certIds.reserve(certs_.size());
+    std::set<std::string> certIds;
     for (const auto& crt : certs_)
-        certIds.emplace_back(crt.first);
-    return certIds;
+        certIds.emplace(crt.first);
+    for (const auto& [id, entry] : index_) {
+        certIds.emplace(id);
+        certIds.emplace(entry.longId);
+    }
+    return {certIds.begin(), certIds.end()};
 }
 
 std::shared_ptr<crypto::Certificate>
 CertificateStore::getCertificate(const std::string& k)
 {
-    auto getCertificate_ = [this](const std::string& k) -> std::shared_ptr<crypto::Certificate> {
+    {
+        // Most lookups find a certificate already parsed, with its chain
+        std::shared_lock l(lock_);
         auto cit = certs_.find(k);
-        if (cit == certs_.cend())
-            return {};
-        return cit->second;
-    };
-    std::unique_lock<std::mutex> l(lock_);
-    auto crt = getCertificate_(k);
+        if (cit != certs_.end() && hasFullChain(*cit->second)) {
+            auto lit = longIds_.find(k);
+            auto used = lastUse_.find(lit == longIds_.end() ? k : lit->second);
+            if (used != lastUse_.end())
+                used->second = ++useCount_;
+            return cit->second;
+        }
+    }
+    std::unique_lock l(lock_);
+    auto crt = getCertificateLocked(k);
     // Check if certificate is complete
     // If the certificate has been splitted, reconstruct it
     auto top_issuer = crt;
     while (top_issuer && top_issuer->getUID() != top_issuer->getIssuerUID()) {
         if (top_issuer->issuer) {
             top_issuer = top_issuer->issuer;
-        } else if (auto cert = getCertificate_(top_issuer->getIssuerUID())) {
+        } else if (auto cert = getCertificateLocked(top_issuer->getIssuerUID())) {
             top_issuer->issuer = cert;
             top_issuer = cert;
         } else {
@@ -174,28 +345,45 @@ CertificateStore::getCertificate(const std::string& k)
 std::shared_ptr<crypto::Certificate>
 CertificateStore::findCertificateByName(const std::string& name, crypto::NameType type) const
 {
-    std::unique_lock<std::mutex> l(lock_);
-    for (auto& i : certs_) {
-        if (i.second->getName() == name)
-            return i.second;
-        if (type != crypto::NameType::UNKNOWN) {
-            for (const auto& alt : i.second->getAltNames())
-                if (alt.first == type and alt.second == name)
-                    return i.second;
+    std::string id;
+    {
+        std::shared_lock l(lock_);
+        for (auto& i : certs_) {
+            if (i.second->getName() == name)
+                return i.second;
+            // The alternative names are only known for the parsed certificates
+            if (type != crypto::NameType::UNKNOWN) {
+                for (const auto& alt : i.second->getAltNames())
+                    if (alt.first == type and alt.second == name)
+                        return i.second;
+            }
         }
+        id = findIndexed({}, name);
+        if (id.empty())
+            return {};
     }
-    return {};
+    std::unique_lock l(lock_);
+    return getCertificateLocked(id);
 }
 
 std::shared_ptr<crypto::Certificate>
 CertificateStore::findCertificateByUID(const std::string& uid) const
 {
-    std::unique_lock<std::mutex> l(lock_);
-    for (auto& i : certs_) {
-        if (i.second->getUID() == uid)
-            return i.second;
+    std::string id;
+    {
+        std::shared_lock l(lock_);
+        for (auto& i : certs_) {
+            if (i.second->getUID() == uid)
+                return i.second;
+        }
+        if (uid.empty())
+            return {};
+        id = findIndexed(uid, {});
+        if (id.empty())
+            return {};
     }
-    return {};
+    std::unique_lock l(lock_);
+    return getCertificateLocked(id);
 }
 
 std::shared_ptr<crypto::Certificate>
@@ -266,7 +454,7 @@ CertificateStore::pinCertificatePath(const std::string& path,
         ids.reserve(certs.size());
         scerts.reserve(certs.size());
         {
-            std::lock_guard<std::mutex> l(lock_);
+            std::unique_lock l(lock_);
 
             for (auto& cert : certs) {
                 auto shared = std::make_shared<crypto::Certificate>(std::move(cert));
@@ -288,7 +476,7 @@ CertificateStore::pinCertificatePath(const std::string& path,
 unsigned
 CertificateStore::unpinCertificatePath(const std::string& path)
 {
-    std::lock_guard<std::mutex> l(lock_);
+    std::unique_lock l(lock_);
 
     auto certs = paths_.find(path);
     if (certs == std::end(paths_))
@@ -327,7 +515,7 @@ CertificateStore::pinCertificate(const std::shared_ptr<crypto::Certificate>& cer
     std::vector<std::string> ids {};
     {
         auto c = cert;
-        std::lock_guard<std::mutex> l(lock_);
+        std::unique_lock l(lock_);
         while (c) {
             bool inserted;
             auto id = c->getId().toString();
@@ -349,9 +537,15 @@ CertificateStore::pinCertificate(const std::shared_ptr<crypto::Certificate>& cer
             sig |= inserted;
         }
         if (local) {
-            if (sig)
+            if (sig) {
                 fileutils::saveFile(certPath_ + DIR_SEPARATOR_CH + ids.front(), cert->getPacked());
+                indexCertificate(ids.front(), *cert);
+                saveIndex();
+            }
         }
+        for (const auto& id : ids)
+            touch(id);
+        releaseUnusedCertificates();
     }
     for (const auto& id : ids)
         emitSignal<DRing::ConfigurationSignal::CertificatePinned>(id);
@@ -361,10 +555,23 @@ CertificateStore::pinCertificate(const std::shared_ptr<crypto::Certificate>& cer
 bool
 CertificateStore::unpinCertificate(const std::string& id)
 {
-    std::lock_guard<std::mutex> l(lock_);
+    std::unique_lock l(lock_);
 
     certs_.erase(id);
-    return remove((certPath_ + DIR_SEPARATOR_CH + id).c_str()) == 0;
+    auto removed = remove((certPath_ + DIR_SEPARATOR_CH + id).c_str()) == 0;
+    auto lit = longIds_.find(id);
+    auto indexedId = lit == longIds_.end() ? id : lit->second;
+    for (auto it = index_.begin(); it != index_.end();) {
+        if (it->first == indexedId || (removed && it->second.file == id)) {
+            longIds_.erase(it->second.longId);
+            lastUse_.erase(it->first);
+            it = index_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    saveIndex();
+    return removed;
 }
 
 bool
@@ -372,10 +579,12 @@ CertificateStore::setTrustedCertificate(const std::string& id, TrustStatus statu
 {
     if (status == TrustStatus::TRUSTED) {
         if (auto crt = getCertificate(id)) {
+            std::unique_lock l(lock_);
             trustedCerts_.emplace_back(crt);
             return true;
         }
     } else {
+        std::unique_lock l(lock_);
         auto tc = std::find_if(trustedCerts_.begin(),
                                trustedCerts_.end(),
                                [&](const std::shared_ptr<crypto::Certificate>& crt) {
@@ -392,6 +601,7 @@ CertificateStore::setTrustedCertificate(const std::string& id, TrustStatus statu
 std::vector<gnutls_x509_crt_t>
 CertificateStore::getTrustedCertificates() const
 {
+    std::shared_lock l(lock_);
     std::vector<gnutls_x509_crt_t> crts;
     crts.reserve(trustedCerts_.size());
     for (auto& crt : trustedCerts_)
@@ -406,6 +616,7 @@ CertificateStore::pinRevocationList(const std::string& id,
     try {
         if (auto c = getCertificate(id))
             c->addRevocationList(crl);
+        ++revocationGeneration_;
         pinRevocationList(id, *crl);
     } catch (...) {
         JAMI_WARN("Can't add revocation list");
@@ -504,7 +715,9 @@ statusToStr(TrustStatus s)
 bool
 TrustStore::addRevocationList(dht::crypto::RevocationList&& crl)
 {
+    std::unique_lock lk(mutex_);
     allowed_.add(crl);
+    ++trustGeneration_;
     return true;
 }
 
@@ -531,7 +744,7 @@ TrustStore::setCertificateStatus(std::shared_ptr<crypto::Certificate> cert,
 {
     if (cert)
         CertificateStore::instance().pinCertificate(cert, local);
-    std::lock_guard<std::recursive_mutex> lk(mutex_);
+    std::unique_lock lk(mutex_);
     updateKnownCerts();
     bool dirty {false};
     if (status == PermissionStatus::UNDEFINED) {
@@ -562,7 +775,7 @@ TrustStore::setCertificateStatus(std::shared_ptr<crypto::Certificate> cert,
                 if (allowed) // Certificate is re-added after ban, rebuld needed
                     dirty = true;
                 else
-                    allowed_.remove(*s->second.first, false);
+                    setStoreCertStatus(*s->second.first, false);
             }
         }
     }
@@ -574,7 +787,13 @@ TrustStore::setCertificateStatus(std::shared_ptr<crypto::Certificate> cert,
 TrustStore::PermissionStatus
 TrustStore::getCertificateStatus(const std::string& cert_id) const
 {
-    std::lock_guard<std::recursive_mutex> lk(mutex_);
+    std::shared_lock lk(mutex_);
+    return getCertificateStatusLocked(cert_id);
+}
+
+TrustStore::PermissionStatus
+TrustStore::getCertificateStatusLocked(const std::string& cert_id) const
+{
     auto s = certStatus_.find(cert_id);
     if (s == std::end(certStatus_)) {
         auto us = unknownCertStatus_.find(cert_id);
@@ -588,7 +807,7 @@ TrustStore::getCertificateStatus(const std::string& cert_id) const
 std::vector<std::string>
 TrustStore::getCertificatesByStatus(TrustStore::PermissionStatus status) const
 {
-    std::lock_guard<std::recursive_mutex> lk(mutex_);
+    std::shared_lock lk(mutex_);
     std::vector<std::string> ret;
     for (const auto& i : certStatus_)
         if (i.second.second.allowed == (status == TrustStore::PermissionStatus::ALLOWED))
@@ -602,11 +821,20 @@ TrustStore::getCertificatesByStatus(TrustStore::PermissionStatus status) const
 bool
 TrustStore::isAllowed(const crypto::Certificate& crt, bool allowPublic)
 {
+    std::shared_lock lk(mutex_);
+    if (not unknownCertStatus_.empty()) {
+        lk.unlock();
+        {
+            std::unique_lock ulk(mutex_);
+            updateKnownCerts();
+        }
+        lk.lock();
+    }
+
     // Match by certificate pinning
-    std::lock_guard<std::recursive_mutex> lk(mutex_);
     bool allowed {allowPublic};
     for (auto c = &crt; c; c = c->issuer.get()) {
-        auto status = getCertificateStatus(c->getId().toString()); // lock mutex_
+        auto status = getCertificateStatusLocked(c->getId().toString());
         if (status == PermissionStatus::ALLOWED)
             allowed = true;
         else if (status == PermissionStatus::BANNED)
@@ -614,8 +842,7 @@ TrustStore::isAllowed(const crypto::Certificate& crt, bool allowPublic)
     }
 
     // Match by certificate chain
-    updateKnownCerts();
-    auto ret = allowed_.verify(crt);
+    auto ret = verify(crt);
     // Unknown issuer (only that) are accepted if allowPublic is true
     if (not ret
         and !(allowPublic and ret.result == (GNUTLS_CERT_INVALID | GNUTLS_CERT_SIGNER_NOT_FOUND))) {
@@ -647,15 +874,58 @@ TrustStore::setStoreCertStatus(const crypto::Certificate& crt, bool status)
         allowed_.add(crt);
     else
         allowed_.remove(crt, false);
+    ++trustGeneration_;
 }
 
 void
 TrustStore::rebuildTrust()
 {
     allowed_ = {};
+    ++trustGeneration_;
     for (const auto& c : certStatus_)
         setStoreCertStatus(*c.second.first, c.second.second.allowed);
 }
 
+dht::crypto::TrustList::VerifyResult
+TrustStore::verify(const crypto::Certificate& crt) const
+{
+    auto revocationGeneration = CertificateStore::instance().revocationGeneration();
+    auto now = std::chrono::system_clock::now();
+    auto chain = dht::PkId::get(crt.getPacked());
+    {
+        std::lock_guard<std::mutex> lk(verifyCacheMutex_);
+        auto it = verifyCache_.find(chain);
+        if (it != verifyCache_.end()) {
+            const auto& cached = it->second;
+            if (cached.trustGeneration == trustGeneration_
+                && cached.revocationGeneration == revocationGeneration && cached.expiration > now)
+                return cached.result;
+            verifyCache_.erase(it);
+        }
+    }
+
+    auto ret = allowed_.verify(crt);
+
+    // The result may change once a certificate of the chain expires
+    std::chrono::system_clock::time_point expiration = now + VERIFICATION_TTL;
+    for (auto c = &crt; c; c = c->issuer.get())
+        expiration = std::min(expiration, c->getExpiration());
+    std::lock_guard<std::mutex> lk(verifyCacheMutex_);
+    if (verifyCache_.size() >= MAX_CACHED_VERIFICATIONS) {
+        for (auto it = verifyCache_.begin(); it != verifyCache_.end();) {
+            if (it->second.trustGeneration != trustGeneration_
+                || it->second.revocationGeneration != revocationGeneration
+                || it->second.expiration <= now)
+                it = verifyCache_.erase(it);
+            else
+                ++it;
+        }
+        if (verifyCache_.size() >= MAX_CACHED_VERIFICATIONS)
+            verifyCache_.clear();
+    }
+    verifyCache_[chain] = {ret, trustGeneration_, revocationGeneration, expiration};
+    return ret;
+}
+
 } // namespace tls
 } // namespace jami
@@ -24,17 +24,25 @@
 #include "noncopyable.h"
 
 #include <opendht/crypto.h>
+#include <msgpack.hpp>
 
 #include <string>
 #include <vector>
 #include <map>
 #include <set>
+#include <atomic>
+#include <chrono>
 #include <future>
 #include <mutex>
+#include <shared_mutex>
 
 namespace crypto = ::dht::crypto;
 
 namespace jami {
+
+template<typename Value>
+class MapJournal;
+
 namespace tls {
 
 enum class TrustStatus { UNTRUSTED = 0, TRUSTED };
@@ -44,6 +52,9 @@ const char* statusToStr(TrustStatus s);
 /**
  * Global certificate store.
  * Stores system root CAs and any other encountred certificate
+ *
+ * The local certificates are indexed on the disk, and only parsed when used.
+ * The least recently used are released past a few hundreds.
  */
 class CertificateStore
 {
@@ -51,6 +62,7 @@ public:
     static CertificateStore& instance();
 
     CertificateStore();
+    ~CertificateStore();
 
     std::vector<std::string> getPinnedCertificates() const;
     /**
@@ -90,22 +102,74 @@ public:
 
     void loadRevocations(crypto::Certificate& crt) const;
 
+    /**
+     * Changes each time a revocation list is added to a certificate of the store
+     */
+    uint64_t revocationGeneration() const { return revocationGeneration_; }
+
+    /**
+     * @return number of the certificates kept parsed in memory
+     */
+    std::size_t parsedCertificates() const;
+
 private:
     NON_COPYABLE(CertificateStore);
 
+    /**
+     * What is known of a local certificate without parsing it
+     */
+    struct IndexEntry
+    {
+        std::string file;   // In certPath_, holding the certificate and its chain
+        std::string longId; // Also a key of certs_
+        std::string uid;
+        std::string name;
+        int64_t expiration {0}; // Seconds since epoch
+        MSGPACK_DEFINE_MAP(file, longId, uid, name, expiration)
+    };
+
     unsigned loadLocalCertificates();
     void pinRevocationList(const std::string& id, const dht::crypto::RevocationList& crl);
 
+    /**
+     * Index crt and its chain, saved in file
+     */
+    void indexCertificate(const std::string& file, const crypto::Certificate& crt);
+    void saveIndex();
+    /**
+     * @return certificate of certs_, parsed from the index if needed
+     */
+    std::shared_ptr<crypto::Certificate> getCertificateLocked(const std::string& k) const;
+    /**
+     * @param uid   Else, the name to look for
+     * @return id of the indexed certificate that expires last, or empty
+     */
+    std::string findIndexed(const std::string& uid, const std::string& name) const;
+    void touch(const std::string& id) const;
+    void releaseUnusedCertificates() const;
+
     const std::string certPath_;
     const std::string crlPath_;
     const std::string ocspPath_;
-
-    mutable std::mutex lock_;
-    std::map<std::string, std::shared_ptr<crypto::Certificate>> certs_;
+    const std::string indexPath_;
+
+    // Lookups share the lock, parsing a certificate of the index takes it
+    mutable std::shared_mutex lock_;
+    mutable std::map<std::string, std::shared_ptr<crypto::Certificate>> certs_;
+    // Certificates of certPath_, by id
+    std::map<std::string, IndexEntry> index_;
+    std::map<std::string, std::string> longIds_; // Long id to id
+    std::unique_ptr<MapJournal<IndexEntry>> indexJournal_;
+    // Certificates of the index currently in certs_, by id
+    // The values are also updated under the shared lock
+    mutable std::map<std::string, std::atomic<uint64_t>> lastUse_;
+    mutable std::atomic<uint64_t> useCount_ {0};
     std::map<std::string, std::vector<std::weak_ptr<crypto::Certificate>>> paths_;
 
     // globally trusted certificates (root CAs)
     std::vector<std::shared_ptr<crypto::Certificate>> trustedCerts_;
+
+    std::atomic<uint64_t> revocationGeneration_ {0};
 };
 
 /**
@@ -157,6 +221,7 @@ private:
     TrustStore(TrustStore&& o) = delete;
     TrustStore& operator=(TrustStore&& o) = delete;
 
+    PermissionStatus getCertificateStatusLocked(const std::string& cert_id) const;
     void updateKnownCerts();
     bool setCertificateStatus(std::shared_ptr<crypto::Certificate> cert,
                               const std::string& cert_id,
@@ -165,16 +230,35 @@ private:
     void setStoreCertStatus(const crypto::Certificate& crt, bool status);
     void rebuildTrust();
 
+    /**
+     * allowed_.verify(), with the result cached for the chain of crt
+     */
+    dht::crypto::TrustList::VerifyResult verify(const crypto::Certificate& crt) const;
+
     struct Status
     {
         bool allowed;
     };
 
+    struct CachedVerification
+    {
+        dht::crypto::TrustList::VerifyResult result;
+        uint64_t trustGeneration;
+        uint64_t revocationGeneration;
+        std::chrono::system_clock::time_point expiration;
+    };
+
     // unknown certificates with known status
-    mutable std::recursive_mutex mutex_;
+    // isAllowed() checks share the lock
+    mutable std::shared_mutex mutex_;
     std::map<std::string, Status> unknownCertStatus_;
     std::map<std::string, std::pair<std::shared_ptr<crypto::Certificate>, Status>> certStatus_;
     dht::crypto::TrustList allowed_;
+    uint64_t trustGeneration_ {0}; // Changes with allowed_
+
+    // By hash of the chain
+    mutable std::mutex verifyCacheMutex_;
+    mutable std::map<dht::PkId, CachedVerification> verifyCache_;
 };
 
 } // namespace tls
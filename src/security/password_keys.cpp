@@ -0,0 +1,231 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "password_keys.h"
+#include "memory.h"
+
+#include <opendht/crypto.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace jami {
+namespace secure {
+
+// Of dht::crypto::aesEncrypt() with a password
+static constexpr std::size_t SALT_LENGTH {16};
+
+static std::array<uint8_t, PasswordKeys::KEY_LENGTH>
+digest(const uint8_t* key, const std::string& password)
+{
+    std::vector<uint8_t> data;
+    data.reserve(PasswordKeys::KEY_LENGTH + password.size());
+    data.insert(data.end(), key, key + PasswordKeys::KEY_LENGTH);
+    data.insert(data.end(), password.begin(), password.end());
+    auto h = dht::crypto::hash(data, PasswordKeys::KEY_LENGTH);
+    memzero(data.data(), data.size());
+    std::array<uint8_t, PasswordKeys::KEY_LENGTH> ret;
+    std::copy_n(h.begin(), ret.size(), ret.begin());
+    return ret;
+}
+
+template<typename A, typename B>
+static bool
+constantTimeEqual(const A& a, const B& b)
+{
+    uint8_t diff = 0;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+PasswordKeys&
+PasswordKeys::instance()
+{
+    static PasswordKeys keys;
+    return keys;
+}
+
+PasswordKeys::PasswordKeys()
+    : secrets_(new Secret[MAX_KEYS])
+{
+    // Not swapped out, if allowed
+    auto size = sizeof(Secret) * MAX_KEYS;
+#ifdef _WIN32
+    locked_ = VirtualLock(secrets_.get(), size);
+#else
+    locked_ = mlock(secrets_.get(), size) == 0;
+#endif
+}
+
+PasswordKeys::~PasswordKeys()
+{
+    clear();
+    auto size = sizeof(Secret) * MAX_KEYS;
+    if (locked_) {
+#ifdef _WIN32
+        VirtualUnlock(secrets_.get(), size);
+#else
+        munlock(secrets_.get(), size);
+#endif
+    }
+}
+
+std::size_t
+PasswordKeys::find(const std::string& scope,
+                   const std::string& password,
+                   const std::vector<uint8_t>& salt) const
+{
+    std::size_t found = MAX_KEYS;
+    for (std::size_t i = 0; i < MAX_KEYS; ++i) {
+        const auto& slot = slots_[i];
+        if (not slot.used or slot.scope != scope or (not salt.empty() and slot.salt != salt))
+            continue;
+        if (not constantTimeEqual(digest(secrets_[i].key.data(), password), secrets_[i].digest))
+            continue;
+        // The most recent one, to encrypt
+        if (found == MAX_KEYS or slot.lastUse > slots_[found].lastUse)
+            found = i;
+    }
+    return found;
+}
+
+void
+PasswordKeys::insert(const std::string& scope,
+                     const std::string& password,
+                     std::vector<uint8_t> salt,
+                     const std::vector<uint8_t>& key)
+{
+    if (key.size() != KEY_LENGTH or find(scope, password, salt) != MAX_KEYS)
+        return;
+    // A free slot, or the least recently used one
+    auto it = std::min_element(slots_.begin(), slots_.end(), [](const Slot& a, const Slot& b) {
+        return std::make_pair(a.used, a.lastUse) < std::make_pair(b.used, b.lastUse);
+    });
+    auto i = static_cast<std::size_t>(it - slots_.begin());
+    erase(i);
+    std::copy(key.begin(), key.end(), secrets_[i].key.begin());
+    secrets_[i].digest = digest(secrets_[i].key.data(), password);
+    slots_[i] = {true, ++uses_, scope, std::move(salt)};
+}
+
+void
+PasswordKeys::erase(std::size_t slot)
+{
+    memzero(&secrets_[slot], sizeof(Secret));
+    slots_[slot] = {};
+}
+
+std::vector<uint8_t>
+PasswordKeys::stretch(const std::string& scope,
+                      const std::string& password,
+                      const std::vector<uint8_t>& salt)
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto i = find(scope, password, salt);
+        if (i != MAX_KEYS) {
+            slots_[i].lastUse = ++uses_;
+            return {secrets_[i].key.begin(), secrets_[i].key.end()};
+        }
+    }
+    // Without the lock, the other archives don't wait for this one
+    auto s = salt;
+    auto key = dht::crypto::stretchKey(password, s, KEY_LENGTH);
+    std::lock_guard<std::mutex> lk(mutex_);
+    insert(scope, password, std::move(s), key);
+    return key;
+}
+
+std::vector<uint8_t>
+PasswordKeys::encrypt(const std::string& scope,
+                      const std::vector<uint8_t>& data,
+                      const std::string& password)
+{
+    std::vector<uint8_t> salt;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto i = find(scope, password, {});
+        // Not the key of another use of stretch()
+        if (i != MAX_KEYS and slots_[i].salt.size() == SALT_LENGTH)
+            salt = slots_[i].salt;
+    }
+    // An empty salt is generated by stretchKey()
+    auto key = salt.empty() ? dht::crypto::stretchKey(password, salt, KEY_LENGTH)
+                            : stretch(scope, password, salt);
+    if (salt.size() != SALT_LENGTH)
+        throw std::runtime_error("Unexpected salt length");
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        insert(scope, password, salt, key);
+    }
+    auto ret = dht::crypto::aesEncrypt(data, key);
+    memzero(key.data(), key.size());
+    ret.insert(ret.begin(), salt.begin(), salt.end());
+    return ret;
+}
+
+std::vector<uint8_t>
+PasswordKeys::decrypt(const std::string& scope,
+                      const std::vector<uint8_t>& data,
+                      const std::string& password)
+{
+    if (data.size() <= SALT_LENGTH)
+        throw dht::crypto::DecryptError("Wrong data size");
+    std::vector<uint8_t> salt(data.begin(), data.begin() + SALT_LENGTH);
+    auto key = stretch(scope, password, salt);
+    try {
+        std::vector<uint8_t> encrypted(data.begin() + SALT_LENGTH, data.end());
+        auto ret = dht::crypto::aesDecrypt(encrypted, key);
+        memzero(key.data(), key.size());
+        return ret;
+    } catch (...) {
+        memzero(key.data(), key.size());
+        // Wrong password, not worth keeping
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto i = find(scope, password, salt);
+        if (i != MAX_KEYS)
+            erase(i);
+        throw;
+    }
+}
+
+void
+PasswordKeys::forget(const std::string& scope)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (std::size_t i = 0; i < MAX_KEYS; ++i)
+        if (slots_[i].used and slots_[i].scope == scope)
+            erase(i);
+}
+
+void
+PasswordKeys::clear()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    for (std::size_t i = 0; i < MAX_KEYS; ++i)
+        erase(i);
+}
+
+} // namespace secure
+} // namespace jami
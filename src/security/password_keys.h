@@ -0,0 +1,118 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace jami {
+namespace secure {
+
+/**
+ * Keys stretched from the passwords of the archives, kept for the session: stretching is
+ * slow on purpose (seconds on mobile), and an archive is read and saved again on each
+ * account load, device link, export or configuration change.
+ *
+ * A key belongs to the archive it protects, e.g. to an account: two accounts sharing a
+ * password don't share a salt nor a key. The keys are kept in locked memory, erased when
+ * evicted, forgotten or cleared. A key is only given for its password: a digest of the key
+ * and the password is checked first.
+ */
+class PasswordKeys
+{
+public:
+    static constexpr std::size_t KEY_LENGTH {256 / 8};
+    static constexpr std::size_t MAX_KEYS {8};
+
+    static PasswordKeys& instance();
+
+    PasswordKeys();
+    ~PasswordKeys();
+
+    /**
+     * @param scope     Archive of the key, e.g. its path
+     * @return key stretched from password and salt, as dht::crypto::stretchKey()
+     */
+    std::vector<uint8_t> stretch(const std::string& scope,
+                                 const std::string& password,
+                                 const std::vector<uint8_t>& salt);
+
+    /**
+     * As dht::crypto::aesEncrypt() and aesDecrypt() with a password: the data encrypted with
+     * the stretched key, after its salt. Encrypting the same archive again with a known
+     * password reuses its salt and key.
+     * @param scope     Archive of the data, e.g. its path
+     * @throw dht::crypto::DecryptError
+     */
+    std::vector<uint8_t> encrypt(const std::string& scope,
+                                 const std::vector<uint8_t>& data,
+                                 const std::string& password);
+    std::vector<uint8_t> decrypt(const std::string& scope,
+                                 const std::vector<uint8_t>& data,
+                                 const std::string& password);
+
+    /**
+     * Erase the keys of an archive, e.g. once its password changed or its account removed
+     */
+    void forget(const std::string& scope);
+    void clear();
+
+private:
+    NON_COPYABLE(PasswordKeys);
+
+    struct Secret
+    {
+        std::array<uint8_t, KEY_LENGTH> key;
+        std::array<uint8_t, KEY_LENGTH> digest; ///< of key and password
+    };
+    struct Slot
+    {
+        bool used {false};
+        uint64_t lastUse {0};
+        std::string scope;
+        std::vector<uint8_t> salt;
+    };
+
+    /**
+     * @param salt  Any if empty
+     * @return slot of password for scope, MAX_KEYS if none
+     */
+    std::size_t find(const std::string& scope,
+                     const std::string& password,
+                     const std::vector<uint8_t>& salt) const;
+    void insert(const std::string& scope,
+                const std::string& password,
+                std::vector<uint8_t> salt,
+                const std::vector<uint8_t>& key);
+    void erase(std::size_t slot);
+
+    mutable std::mutex mutex_;
+    std::array<Slot, MAX_KEYS> slots_;
+    std::unique_ptr<Secret[]> secrets_; ///< locked in memory
+    bool locked_ {false};
+    uint64_t uses_ {0};
+};
+
+} // namespace secure
+} // namespace jami
@@ -25,7 +25,6 @@
 
 #include "tls_session.h"
 
-#include "threadloop.h"
 #include "logger.h"
 #include "noncopyable.h"
 #include "compiler_intrinsics.h"
@@ -40,6 +39,7 @@
 #include <gnutls/crypto.h>
 #include <gnutls/ocsp.h>
 #include <opendht/http.h>
+#include <opendht/thread_pool.h>
 
 #include <list>
 #include <mutex>
@@ -94,12 +94,18 @@ static constexpr auto COOKIE_TIMEOUT = std::chrono::seconds(
     10); // Time to wait for a cookie packet from client
 static constexpr int MIN_MTU {
     512 - 20 - 8}; // minimal payload size of a DTLS packet carried by an IPv4 packet
-static constexpr uint8_t HEARTBEAT_TRIES = 1; // Number of tries at each heartbeat ping send
-static constexpr auto HEARTBEAT_RETRANS_TIMEOUT = std::chrono::milliseconds(
-    700); // gnutls heartbeat retransmission timeout for each ping (in milliseconds)
-static constexpr auto HEARTBEAT_TOTAL_TIMEOUT
-    = HEARTBEAT_RETRANS_TIMEOUT
-      * HEARTBEAT_TRIES; // gnutls heartbeat time limit for heartbeat procedure (in milliseconds)
+static constexpr int BASE_MTU {
+    1280 - 40 - 8}; // payload size of a DTLS packet expected on any path, carried by an IPv6 packet
+static constexpr int MAX_MTU {1500 - 20 - 8}; // largest payload size probed, over Ethernet
+static constexpr int PMTUD_RESOLUTION {32}; // search stops when the path MTU is known to this range
+static constexpr unsigned PMTUD_MAX_PROBES {3}; // lost probes of a size before it is considered too big
+static constexpr auto PMTUD_PROBE_TIMEOUT = std::chrono::milliseconds(
+    700); // Time to wait for the pong of a heartbeat probe
+static constexpr auto PMTUD_CONFIRM_PERIOD = std::chrono::seconds(
+    15); // Delay between two probes at the path MTU, to detect black holes
+static constexpr auto PMTUD_RAISE_PERIOD = std::chrono::minutes(
+    10); // Delay before searching for a larger path MTU, and lifetime of the cached path MTUs
+static constexpr std::size_t PMTUD_CACHE_SIZE {256}; // Maximum number of path MTUs cached
 static constexpr int MISS_ORDERING_LIMIT
     = 32; // maximal accepted distance of out-of-order packet (note: must be a signed type)
 static constexpr auto RX_OOO_TIMEOUT = std::chrono::milliseconds(1500);
@@ -199,6 +205,56 @@ private:
     T creds_;
 };
 
+// Path MTUs discovered by the previous sessions, by local and remote addresses.
+// A new session over the same path starts from it instead of searching again.
+class PathMtuCache
+{
+public:
+    static PathMtuCache& instance()
+    {
+        static PathMtuCache cache;
+        return cache;
+    }
+
+    // Return 0 if unknown or outdated
+    int get(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto it = entries_.find(path);
+        if (it == entries_.end())
+            return 0;
+        if (clock::now() - it->second.second >= PMTUD_RAISE_PERIOD) {
+            entries_.erase(it);
+            return 0;
+        }
+        return it->second.first;
+    }
+
+    void set(const std::string& path, int mtu)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (entries_.size() >= PMTUD_CACHE_SIZE and entries_.find(path) == entries_.end())
+            entries_.erase(std::min_element(entries_.begin(),
+                                            entries_.end(),
+                                            [](const auto& a, const auto& b) {
+                                                return a.second.second < b.second.second;
+                                            }));
+        entries_[path] = {mtu, clock::now()};
+    }
+
+    void erase(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        entries_.erase(path);
+    }
+
+private:
+    PathMtuCache() = default;
+    NON_COPYABLE(PathMtuCache);
+    std::mutex mutex_;
+    std::map<std::string, std::pair<int, clock::time_point>> entries_;
+};
+
 } // namespace
 
 //==============================================================================
@@ -259,6 +315,7 @@ public:
     std::list<clock::time_point> nextFlush_ {};
 
     std::size_t send(const ValueType*, std::size_t, std::error_code&);
+    std::size_t sendv(std::initializer_list<TlsSession::ConstBuffer>, std::error_code&);
     ssize_t sendRaw(const void*, size_t);
     ssize_t sendRawVec(const giovec_t*, int);
     ssize_t recvRaw(void*, size_t);
@@ -288,9 +345,14 @@ public:
 
     TlsSessionState setupClient();
     TlsSessionState setupServer();
+    /**
+     * Parameters given for the DHE key exchanges, nullptr to use the groups of RFC 7919
+     */
+    gnutls_dh_params_t dhParams() const;
     void initAnonymous();
     void initCredentials();
     bool commonSessionInit();
+    void saveSessionData();
 
     std::shared_ptr<dht::crypto::Certificate> peerCertificate(gnutls_session_t session) const;
 
@@ -313,18 +375,66 @@ public:
                          std::chrono::seconds timeout,
                          HttpResponse cb = {});
 
-    // FSM thread (TLS states)
-    ThreadLoop thread_; // ctor init.
+    // FSM executor (TLS states): the steps run one at a time on the thread pool, again and
+    // again until a handler waits for an event: packet received, state change or deadline
+    struct Waker
+    {
+        explicit Waker(TlsSessionImpl* s)
+            : session(s)
+        {}
+        std::mutex mutex;
+        TlsSessionImpl* session;
+    };
+    const std::shared_ptr<Waker> waker_ {std::make_shared<Waker>(this)};
+    std::mutex stepMutex_;
+    std::condition_variable stepCv_;
+    bool stepRunning_ {false};
+    bool stepPending_ {false}; ///< an event occurred during the step
+    bool finished_ {false};
+    // Accessed by the steps only
+    bool waiting_ {false};
+    bool cleanedUp_ {false};
+    std::shared_ptr<Task> wakeUpTask_ {};
+    clock::time_point cookieDeadline_ {};
+    clock::time_point cookieResume_ {};
     bool setup();
     void process();
     void cleanup();
+    /**
+     * Run a step of the FSM, for an event
+     */
+    void wakeUp();
+    /**
+     * Called by a handler: don't run the next step before an event or deadline
+     */
+    void waitUntil(clock::time_point deadline);
+    void runStep();
 
-    // Path mtu discovery
-    std::array<int, 3> MTUS_;
-    int mtuProbe_;
-    int hbPingRecved_ {0};
-    bool pmtudOver_ {false};
-    void pathMtuHeartbeat();
+    // Path mtu discovery, with heartbeats of the probed size (accessed by the FSM thread only)
+    struct PathMtu
+    {
+        int mtu {MIN_MTU};    ///< confirmed path MTU
+        int maxMtu {MIN_MTU}; ///< largest MTU probed
+        int low {MIN_MTU};    ///< largest MTU confirmed during the search
+        int high {MIN_MTU};   ///< smallest MTU lost during the search
+        int probe {0};        ///< MTU of the heartbeat waiting for its pong, 0 if none
+        unsigned failures {0};
+        bool searching {false};
+        clock::time_point searched {};
+        clock::time_point deadline {clock::time_point::max()};
+    } pmtu_ {};
+    std::string pathKey_ {};
+    int recordOverhead_ {0};
+    int mtuOffset_ {0};
+    std::atomic<int> dataMtu_ {MIN_MTU}; ///< application data per record, set from the path MTU
+    std::size_t skippedSeq_ {0}; ///< heartbeats received, protected by rxMutex_
+    void setPathMtu(int mtu);
+    void startPathMtuSearch();
+    void nextPathMtuProbe();
+    void sendPathMtuProbe(int mtu);
+    void onPathMtuPong();
+    void onPathMtuTimeout();
+    void onHeartbeatRecord();
 
     std::mutex requestsMtx_;
     std::set<std::shared_ptr<dht::http::Request>> requests_;
@@ -343,25 +453,30 @@ TlsSession::TlsSessionImpl::TlsSessionImpl(std::unique_ptr<SocketType>&& transpo
     , cacred_(nullptr)
     , sacred_(nullptr)
     , xcred_(nullptr)
-    , thread_([this] { return setup(); }, [this] { process(); }, [this] { cleanup(); })
 {
+    // The FSM handlers are set before a received packet can run the FSM
+    setup();
+
     if (not transport_->isReliable()) {
         transport_->setOnRecv([this](const ValueType* buf, size_t len) {
-            std::lock_guard<std::mutex> lk {rxMutex_};
-            if (rxQueue_.size() == INPUT_MAX_SIZE) {
-                rxQueue_.pop_front(); // drop oldest packet if input buffer is full
-                ++stRxRawPacketDropCnt_;
+            {
+                std::lock_guard<std::mutex> lk {rxMutex_};
+                if (rxQueue_.size() == INPUT_MAX_SIZE) {
+                    rxQueue_.pop_front(); // drop oldest packet if input buffer is full
+                    ++stRxRawPacketDropCnt_;
+                }
+                rxQueue_.emplace_back(buf, buf + len);
+                ++stRxRawPacketCnt_;
+                stRxRawBytesCnt_ += len;
+                rxCv_.notify_one();
             }
-            rxQueue_.emplace_back(buf, buf + len);
-            ++stRxRawPacketCnt_;
-            stRxRawBytesCnt_ += len;
-            rxCv_.notify_one();
+            wakeUp();
             return len;
         });
     }
 
-    // Run FSM into dedicated thread
-    thread_.start();
+    // Run FSM on the thread pool
+    wakeUp();
 }
 
 TlsSession::TlsSessionImpl::~TlsSessionImpl()
@@ -369,7 +484,17 @@ TlsSession::TlsSessionImpl::~TlsSessionImpl()
     state_ = TlsSessionState::SHUTDOWN;
     stateCondition_.notify_all();
     rxCv_.notify_all();
-    thread_.join();
+    wakeUp();
+    {
+        std::unique_lock<std::mutex> lk(stepMutex_);
+        stepCv_.wait(lk, [this] { return finished_; });
+    }
+    {
+        std::lock_guard<std::mutex> lk(waker_->mutex);
+        waker_->session = nullptr;
+    }
+    if (wakeUpTask_)
+        wakeUpTask_->cancel();
     if (not transport_->isReliable())
         transport_->setOnRecv(nullptr);
 }
@@ -397,9 +522,9 @@ TlsSession::TlsSessionImpl::setupClient()
 
     if (not transport_->isReliable()) {
         ret = gnutls_init(&session_, GNUTLS_CLIENT | GNUTLS_DATAGRAM);
-        // uncoment to reactivate PMTUD
-        // JAMI_DBG("[TLS] set heartbeat reception for retrocompatibility check on server");
-        // gnutls_heartbeat_enable(session_,GNUTLS_HB_PEER_ALLOWED_TO_SEND);
+        // Heartbeats are the path MTU probes, the peer answers them if it allows them too
+        if (ret == GNUTLS_E_SUCCESS)
+            gnutls_heartbeat_enable(session_, GNUTLS_HB_PEER_ALLOWED_TO_SEND);
     } else {
         ret = gnutls_init(&session_, GNUTLS_CLIENT);
     }
@@ -413,6 +538,34 @@ TlsSession::TlsSessionImpl::setupClient()
         return TlsSessionState::SHUTDOWN;
     }
 
+    if (not params_.session_data.empty()) {
+        ret = gnutls_session_set_data(session_,
+                                      params_.session_data.data(),
+                                      params_.session_data.size());
+        if (ret != GNUTLS_E_SUCCESS)
+            JAMI_WARN("[TLS] session data ignored: %s", gnutls_strerror(ret));
+    }
+
+#if GNUTLS_VERSION_NUMBER >= 0x030605
+    // With TLS 1.3 the ticket is only received after the handshake
+    if (callbacks_.onSessionData)
+        gnutls_handshake_set_hook_function(
+            session_,
+            GNUTLS_HANDSHAKE_NEW_SESSION_TICKET,
+            GNUTLS_HOOK_POST,
+            [](gnutls_session_t session,
+               unsigned /*htype*/,
+               unsigned /*when*/,
+               unsigned incoming,
+               const gnutls_datum_t* /*msg*/) -> int {
+                if (incoming and gnutls_protocol_get_version(session) == GNUTLS_TLS1_3) {
+                    auto this_ = reinterpret_cast<TlsSessionImpl*>(gnutls_session_get_ptr(session));
+                    this_->saveSessionData();
+                }
+                return 0;
+            });
+#endif
+
     return TlsSessionState::HANDSHAKE;
 }
 
@@ -423,10 +576,8 @@ TlsSession::TlsSessionImpl::setupServer()
 
     if (not transport_->isReliable()) {
         ret = gnutls_init(&session_, GNUTLS_SERVER | GNUTLS_DATAGRAM);
-
-        // uncoment to reactivate PMTUD
-        // JAMI_DBG("[TLS] set heartbeat reception");
-        // gnutls_heartbeat_enable(session_, GNUTLS_HB_PEER_ALLOWED_TO_SEND);
+        if (ret == GNUTLS_E_SUCCESS)
+            gnutls_heartbeat_enable(session_, GNUTLS_HB_PEER_ALLOWED_TO_SEND);
 
         gnutls_dtls_prestate_set(session_, &prestate_);
     } else {
@@ -440,12 +591,27 @@ TlsSession::TlsSessionImpl::setupServer()
 
     gnutls_certificate_server_set_request(session_, GNUTLS_CERT_REQUIRE);
 
+    // Let the clients resume this session later
+    if (params_.ticket_key) {
+        ret = params_.ticket_key->enableServer(session_);
+        if (ret != GNUTLS_E_SUCCESS)
+            JAMI_WARN("[TLS] session tickets disabled: %s", gnutls_strerror(ret));
+    }
+
     if (not commonSessionInit())
         return TlsSessionState::SHUTDOWN;
 
     return TlsSessionState::HANDSHAKE;
 }
 
+gnutls_dh_params_t
+TlsSession::TlsSessionImpl::dhParams() const
+{
+    if (not params_.dh_params.valid())
+        return nullptr;
+    return params_.dh_params.get().get();
+}
+
 void
 TlsSession::TlsSessionImpl::initAnonymous()
 {
@@ -457,10 +623,10 @@ TlsSession::TlsSessionImpl::initAnonymous()
 
     // Setup DH-params for anonymous authentification
     if (isServer_) {
-        if (const auto& dh_params = params_.dh_params.get().get())
+        if (auto dh_params = dhParams())
             gnutls_anon_set_server_dh_params(*sacred_, dh_params);
         else
-            JAMI_WARN("[TLS] DH params unavailable"); // YOMGUI: need to stop?
+            gnutls_anon_set_server_known_dh_params(*sacred_, GNUTLS_SEC_PARAM_HIGH);
     }
 }
 
@@ -530,10 +696,10 @@ TlsSession::TlsSessionImpl::initCredentials()
 
     // Setup DH-params (server only, may block on dh_params.get())
     if (isServer_) {
-        if (const auto& dh_params = params_.dh_params.get().get())
+        if (auto dh_params = dhParams())
             gnutls_certificate_set_dh_params(*xcred_, dh_params);
         else
-            JAMI_WARN("[TLS] DH params unavailable"); // YOMGUI: need to stop?
+            gnutls_certificate_set_known_dh_params(*xcred_, GNUTLS_SEC_PARAM_HIGH);
     }
 }
 
@@ -798,6 +964,21 @@ TlsSession::TlsSessionImpl::sendOcspRequest(const std::string& uri,
     request->send();
 }
 
+void
+TlsSession::TlsSessionImpl::saveSessionData()
+{
+    if (not callbacks_.onSessionData)
+        return;
+    gnutls_datum_t data {nullptr, 0};
+    auto ret = gnutls_session_get_data2(session_, &data);
+    if (ret != GNUTLS_E_SUCCESS) {
+        JAMI_WARN("[TLS] session data unavailable: %s", gnutls_strerror(ret));
+        return;
+    }
+    callbacks_.onSessionData(std::vector<uint8_t>(data.data, data.data + data.size));
+    gnutls_free(data.data);
+}
+
 std::shared_ptr<dht::crypto::Certificate>
 TlsSession::TlsSessionImpl::peerCertificate(gnutls_session_t session) const
 {
@@ -834,7 +1015,7 @@ TlsSession::TlsSessionImpl::send(const ValueType* tx_data, std::size_t tx_size,
     if (transport_->isReliable())
         max_tx_sz = tx_size;
     else
-        max_tx_sz = gnutls_dtls_get_data_mtu(session_);
+        max_tx_sz = dataMtu_;
 
     // Split incoming data into chunck suitable for the underlying transport
     while (total_written < tx_size) {
@@ -863,6 +1044,55 @@ TlsSession::TlsSessionImpl::send(const ValueType* tx_data, std::size_t tx_size,
     return total_written;
 }
 
+std::size_t
+TlsSession::TlsSessionImpl::sendv(std::initializer_list<TlsSession::ConstBuffer> bufs,
+                                  std::error_code& ec)
+{
+    // DTLS records must fit in the MTU, let send() split the data
+    if (not transport_->isReliable()) {
+        std::vector<ValueType> data;
+        for (const auto& buf : bufs)
+            data.insert(data.end(), buf.first, buf.first + buf.second);
+        return send(data.data(), data.size(), ec);
+    }
+
+    std::lock_guard<std::mutex> lk(sessionWriteMutex_);
+    if (state_ != TlsSessionState::ESTABLISHED) {
+        ec = std::error_code(GNUTLS_E_INVALID_SESSION, std::system_category());
+        return 0;
+    }
+
+    // While corked, GnuTLS only collects the plaintext, the records are
+    // built and sent on uncork
+    std::size_t total = 0;
+    gnutls_record_cork(session_);
+    for (const auto& buf : bufs) {
+        auto n = gnutls_record_send(session_, buf.first, buf.second);
+        if (n < 0) {
+            JAMI_ERR() << "[TLS] corked send failed: " << gnutls_strerror(n);
+            ec = std::error_code(n, std::system_category());
+            gnutls_record_uncork(session_, 0);
+            return 0;
+        }
+        total += n;
+    }
+
+    ssize_t nwritten;
+    do {
+        nwritten = gnutls_record_uncork(session_, GNUTLS_RECORD_WAIT);
+    } while ((nwritten == GNUTLS_E_INTERRUPTED and state_ != TlsSessionState::SHUTDOWN)
+             or nwritten == GNUTLS_E_AGAIN);
+    if (nwritten < 0) {
+        JAMI_ERR() << "[TLS] send failed (" << total << " bytes corked): "
+                   << gnutls_strerror(nwritten);
+        ec = std::error_code(nwritten, std::system_category());
+        return 0;
+    }
+
+    ec.clear();
+    return total;
+}
+
 // Called by GNUTLS to send encrypted packet to low-level transport.
 // Should return a positive number indicating the bytes sent, and -1 on error.
 ssize_t
@@ -1068,6 +1298,7 @@ TlsSession::TlsSessionImpl::handleStateSetup(UNUSED TlsSessionState state)
     // Extra step for DTLS-like transports
     if (transport_ and not transport_->isReliable()) {
         gnutls_key_generate(&cookie_key_, GNUTLS_COOKIE_KEY_SIZE);
+        cookieDeadline_ = clock::now() + COOKIE_TIMEOUT;
         return TlsSessionState::COOKIE;
     }
     return setupServer();
@@ -1076,23 +1307,28 @@ TlsSession::TlsSessionImpl::handleStateSetup(UNUSED TlsSessionState state)
 TlsSessionState
 TlsSession::TlsSessionImpl::handleStateCookie(TlsSessionState state)
 {
-    JAMI_DBG("[TLS] SYN cookie");
+    auto now = clock::now();
+    if (now < cookieResume_) {
+        waitUntil(cookieResume_); // flood attack protection
+        return state;
+    }
 
     std::size_t count;
     {
-        // block until rx packet or shutdown
-        std::unique_lock<std::mutex> lk {rxMutex_};
-        if (!rxCv_.wait_for(lk, COOKIE_TIMEOUT, [this] {
-                return !rxQueue_.empty() or state_ == TlsSessionState::SHUTDOWN;
-            })) {
-            JAMI_ERR("[TLS] SYN cookie failed: timeout");
-            return TlsSessionState::SHUTDOWN;
+        // wait for rx packet
+        std::lock_guard<std::mutex> lk {rxMutex_};
+        if (rxQueue_.empty()) {
+            if (now >= cookieDeadline_) {
+                JAMI_ERR("[TLS] SYN cookie failed: timeout");
+                return TlsSessionState::SHUTDOWN;
+            }
+            waitUntil(cookieDeadline_);
+            return state;
         }
-        // Shutdown state?
-        if (rxQueue_.empty())
-            return TlsSessionState::SHUTDOWN;
         count = rxQueue_.front().size();
     }
+    JAMI_DBG("[TLS] SYN cookie");
+    cookieDeadline_ = now + COOKIE_TIMEOUT;
 
     // Total bytes rx during cookie checking (see flood protection below)
     cookie_count_ += count;
@@ -1131,7 +1367,7 @@ TlsSession::TlsSessionImpl::handleStateCookie(TlsSessionState state)
             JAMI_WARN("[TLS] flood threshold reach (retry in %zds)",
                       std::chrono::duration_cast<std::chrono::seconds>(FLOOD_PAUSE).count());
             dump_io_stats();
-            std::this_thread::sleep_for(FLOOD_PAUSE); // flood attack protection
+            cookieResume_ = clock::now() + FLOOD_PAUSE;
         }
         return state;
     }
@@ -1187,9 +1423,25 @@ TlsSession::TlsSessionImpl::handleStateHandshake(TlsSessionState state)
     JAMI_DBG("[TLS] session established: %s", desc);
     gnutls_free(desc);
 
+    // Resumed sessions skip the certificate exchange and its verification
+    auto resumed = gnutls_session_is_resumed(session_) != 0;
+
     // Anonymous connection? rehandshake immediately with certificate authentification forced
     auto cred = gnutls_auth_get_type(session_);
-    if (cred == GNUTLS_CRD_ANON) {
+    if (resumed) {
+        // Still make sure the peer is the expected one, with the certificate of the session
+        if (callbacks_.verifyCertificate
+            and callbacks_.verifyCertificate(session_) != GNUTLS_E_SUCCESS) {
+            JAMI_ERR("[TLS] resumed session refused");
+            return TlsSessionState::SHUTDOWN;
+        }
+        pCert_ = peerCertificate(session_);
+        if (!pCert_) {
+            JAMI_ERR("[TLS] resumed session without certificate");
+            return TlsSessionState::SHUTDOWN;
+        }
+        JAMI_DBG("[TLS] session resumed");
+    } else if (cred == GNUTLS_CRD_ANON) {
         JAMI_DBG("[TLS] renogotiate with certificate authentification");
 
         // Re-setup TLS algorithms priority list with only certificate based cipher suites
@@ -1218,6 +1470,15 @@ TlsSession::TlsSessionImpl::handleStateHandshake(TlsSessionState state)
         return TlsSessionState::SHUTDOWN;
     }
 
+    // Before TLS 1.3 the ticket is part of the handshake
+    if (not isServer_
+        and (gnutls_session_get_flags(session_) & GNUTLS_SFLAGS_SESSION_TICKET)
+#if GNUTLS_VERSION_NUMBER >= 0x030605
+        and gnutls_protocol_get_version(session_) != GNUTLS_TLS1_3
+#endif
+    )
+        saveSessionData();
+
     // Aware about certificates updates
     if (callbacks_.onCertificatesUpdate) {
         unsigned int remote_count;
@@ -1237,110 +1498,177 @@ TlsSession::TlsSessionImpl::handleStateMtuDiscovery(UNUSED TlsSessionState state
         JAMI_WARN("No transport available when discovering the MTU");
         return TlsSessionState::SHUTDOWN;
     }
-    mtuProbe_ = transport_->maxPayload();
-    assert(mtuProbe_ >= MIN_MTU);
-    MTUS_ = {MIN_MTU, std::max((mtuProbe_ + MIN_MTU) / 2, MIN_MTU), mtuProbe_};
+    pmtu_.maxMtu = std::min(transport_->maxPayload(), MAX_MTU);
+    assert(pmtu_.maxMtu >= MIN_MTU);
 
-    // retrocompatibility check
-    if (gnutls_heartbeat_allowed(session_, GNUTLS_HB_LOCAL_ALLOWED_TO_SEND) == 1) {
-        if (!isServer_) {
-            pathMtuHeartbeat();
-            if (state_ == TlsSessionState::SHUTDOWN) {
-                JAMI_ERR("[TLS] session destroyed while performing PMTUD, shuting down");
-                return TlsSessionState::SHUTDOWN;
-            }
-            pmtudOver_ = true;
-        }
-    } else {
-        JAMI_ERR() << "[TLS] PEER HEARTBEAT DISABLED: using transport MTU value " << mtuProbe_;
-        pmtudOver_ = true;
+    // GnuTLS accepts records up to the largest probe, and the pongs of the peer's probes.
+    // send() splits the application data to fit in the path MTU.
+    gnutls_dtls_set_mtu(session_, pmtu_.maxMtu);
+    recordOverhead_ = pmtu_.maxMtu - static_cast<int>(gnutls_dtls_get_data_mtu(session_));
+
+    // when the remote (server) has a IPV6 interface selected by ICE, and local (client) has a IPV4
+    // selected, the path MTU discovery triggers errors for packets too big on server side because
+    // of different IP headers overhead. Hence we have to signal to the TLS session to reduce the
+    // MTU on client size accordingly.
+    auto localAddr = transport_->localAddr();
+    auto remoteAddr = transport_->remoteAddr();
+    if (localAddr.isIpv4() and remoteAddr.isIpv6()) {
+        mtuOffset_ = ASYMETRIC_TRANSPORT_MTU_OFFSET;
+        JAMI_WARN() << "[TLS] local/remote IP protocol version not alike, use an MTU offset of "
+                    << ASYMETRIC_TRANSPORT_MTU_OFFSET << " bytes to compensate";
     }
 
-    gnutls_dtls_set_mtu(session_, mtuProbe_);
-    maxPayload_ = gnutls_dtls_get_data_mtu(session_);
+    pathKey_ = localAddr.toString(true, true) + "|" + remoteAddr.toString(true, true);
+    auto cachedMtu = std::min(PathMtuCache::instance().get(pathKey_), pmtu_.maxMtu);
+    setPathMtu(cachedMtu >= MIN_MTU ? cachedMtu : std::min(BASE_MTU, pmtu_.maxMtu));
 
-    if (pmtudOver_) {
-        JAMI_DBG() << "[TLS] maxPayload: " << maxPayload_.load();
-        if (!initFromRecordState())
-            return TlsSessionState::SHUTDOWN;
+    if (!initFromRecordState())
+        return TlsSessionState::SHUTDOWN;
+
+    // retrocompatibility check
+    if (gnutls_heartbeat_allowed(session_, GNUTLS_HB_LOCAL_ALLOWED_TO_SEND) != 1) {
+        JAMI_WARN() << "[TLS] PMTUD: peer heartbeat disabled, using MTU " << pmtu_.mtu;
+    } else if (cachedMtu >= MIN_MTU) {
+        // Confirmed as the established session would
+        JAMI_DBG() << "[TLS] PMTUD: using cached MTU " << pmtu_.mtu;
+        pmtu_.searched = clock::now();
+        sendPathMtuProbe(pmtu_.mtu);
+    } else {
+        startPathMtuSearch();
     }
 
     return TlsSessionState::ESTABLISHED;
 }
 
-/*
- * Path MTU discovery heuristic
- * heuristic description:
- * The two members of the current tls connection will exchange dtls heartbeat messages
- * of increasing size until the heartbeat times out which will be considered as a packet
- * drop from the network due to the size of the packet. (one retry to test for a buffer issue)
- * when timeout happens or all the values have been tested, the mtu will be returned.
- * In case of unexpected error the first (and minimal) value of the mtu array
- */
 void
-TlsSession::TlsSessionImpl::pathMtuHeartbeat()
+TlsSession::TlsSessionImpl::setPathMtu(int mtu)
 {
-    JAMI_DBG() << "[TLS] PMTUD: starting probing with " << HEARTBEAT_RETRANS_TIMEOUT.count()
-               << "ms of retransmission timeout";
-
-    gnutls_heartbeat_set_timeouts(session_,
-                                  HEARTBEAT_RETRANS_TIMEOUT.count(),
-                                  HEARTBEAT_TOTAL_TIMEOUT.count());
+    pmtu_.mtu = mtu;
+    dataMtu_ = std::max(mtu - recordOverhead_ - mtuOffset_, 1);
+    maxPayload_ = dataMtu_.load();
+    JAMI_DBG() << "[TLS] PMTUD: mtu " << mtu << ", maxPayload: " << maxPayload_.load();
+}
 
-    int errno_send = GNUTLS_E_SUCCESS;
-    int mtuOffset = 0;
+/**
+ * Path MTU discovery
+ *
+ * Heartbeats of the probed size are sent: a probe whose pong is not received after
+ * PMTUD_MAX_PROBES tries is considered too big for the path. The search is a bisection
+ * between the current MTU and the largest one, starting with the largest one.
+ *
+ * Once found, the path MTU is probed every PMTUD_CONFIRM_PERIOD. If it is lost, the path
+ * changed (black hole): the MTU is dropped to the minimal one and searched again.
+ * The search is also restarted every PMTUD_RAISE_PERIOD, as the path may allow more.
+ */
+void
+TlsSession::TlsSessionImpl::startPathMtuSearch()
+{
+    JAMI_DBG() << "[TLS] PMTUD: searching from " << pmtu_.mtu << " to " << pmtu_.maxMtu;
+    pmtu_.searching = true;
+    pmtu_.searched = clock::now();
+    pmtu_.low = pmtu_.mtu;
+    pmtu_.high = pmtu_.maxMtu + 1;
+    nextPathMtuProbe();
+}
 
-    // when the remote (server) has a IPV6 interface selected by ICE, and local (client) has a IPV4
-    // selected, the path MTU discovery triggers errors for packets too big on server side because
-    // of different IP headers overhead. Hence we have to signal to the TLS session to reduce the
-    // MTU on client size accordingly.
-    if (transport_ and transport_->localAddr().isIpv4() and transport_->remoteAddr().isIpv6()) {
-        mtuOffset = ASYMETRIC_TRANSPORT_MTU_OFFSET;
-        JAMI_WARN() << "[TLS] local/remote IP protocol version not alike, use an MTU offset of "
-                    << ASYMETRIC_TRANSPORT_MTU_OFFSET << " bytes to compensate";
+void
+TlsSession::TlsSessionImpl::nextPathMtuProbe()
+{
+    if (pmtu_.high - pmtu_.low <= PMTUD_RESOLUTION) {
+        pmtu_.searching = false;
+        pmtu_.probe = 0;
+        pmtu_.deadline = clock::now() + PMTUD_CONFIRM_PERIOD;
+        PathMtuCache::instance().set(pathKey_, pmtu_.low);
+        JAMI_DBG() << "[TLS] PMTUD: path MTU " << pmtu_.low;
+        return;
     }
+    sendPathMtuProbe(pmtu_.high > pmtu_.maxMtu ? pmtu_.maxMtu : (pmtu_.low + pmtu_.high) / 2);
+}
 
-    mtuProbe_ = MTUS_[0];
-
-    for (auto mtu : MTUS_) {
-        gnutls_dtls_set_mtu(session_, mtu);
-        auto data_mtu = gnutls_dtls_get_data_mtu(session_);
-        JAMI_DBG() << "[TLS] PMTUD: mtu " << mtu << ", payload " << data_mtu;
-        auto bytesToSend = data_mtu - mtuOffset - 3; // want to know why -3? ask gnutls!
+void
+TlsSession::TlsSessionImpl::sendPathMtuProbe(int mtu)
+{
+    pmtu_.probe = mtu;
+    pmtu_.deadline = clock::now() + PMTUD_PROBE_TIMEOUT;
 
-        do {
-            errno_send = gnutls_heartbeat_ping(session_,
-                                               bytesToSend,
-                                               HEARTBEAT_TRIES,
-                                               GNUTLS_HEARTBEAT_WAIT);
-        } while (errno_send == GNUTLS_E_AGAIN
-                 || (errno_send == GNUTLS_E_INTERRUPTED && state_ != TlsSessionState::SHUTDOWN));
-
-        if (errno_send != GNUTLS_E_SUCCESS) {
-            JAMI_DBG() << "[TLS] PMTUD: mtu " << mtu << " [FAILED]";
-            break;
-        }
+    auto bytesToSend = mtu - recordOverhead_ - mtuOffset_ - 3; // want to know why -3? ask gnutls!
+    int ret;
+    {
+        // Not waiting for the pong, it is received by handleStateEstablished()
+        std::lock_guard<std::mutex> lk(sessionWriteMutex_);
+        ret = gnutls_heartbeat_ping(session_, bytesToSend, 1, 0);
+    }
+    if (ret != GNUTLS_E_SUCCESS and ret != GNUTLS_E_AGAIN and ret != GNUTLS_E_INTERRUPTED) {
+        JAMI_ERR() << "[TLS] PMTUD: failed with gnutls error '" << gnutls_strerror(ret)
+                   << "', keeping MTU " << pmtu_.mtu;
+        pmtu_.searching = false;
+        pmtu_.probe = 0;
+        pmtu_.deadline = clock::time_point::max();
+    }
+}
 
-        mtuProbe_ = mtu;
+void
+TlsSession::TlsSessionImpl::onPathMtuPong()
+{
+    if (pmtu_.probe == 0)
+        return;
+    auto mtu = pmtu_.probe;
+    pmtu_.probe = 0;
+    pmtu_.failures = 0;
+    if (pmtu_.searching) {
         JAMI_DBG() << "[TLS] PMTUD: mtu " << mtu << " [OK]";
+        pmtu_.low = mtu;
+        setPathMtu(mtu);
+        nextPathMtuProbe();
+    } else {
+        pmtu_.deadline = clock::now() + PMTUD_CONFIRM_PERIOD;
+        PathMtuCache::instance().set(pathKey_, pmtu_.mtu);
     }
+}
 
-    if (errno_send == GNUTLS_E_TIMEDOUT) { // timeout is considered as a packet loss, then the good
-                                           // mtu is the precedent
-        if (mtuProbe_ == MTUS_[0]) {
-            JAMI_WARN() << "[TLS] PMTUD: no response on first ping, using minimal MTU value "
-                        << mtuProbe_;
-        } else {
-            JAMI_WARN() << "[TLS] PMTUD: timed out, using last working mtu " << mtuProbe_;
-        }
-    } else if (errno_send != GNUTLS_E_SUCCESS) {
-        JAMI_ERR() << "[TLS] PMTUD: failed with gnutls error '" << gnutls_strerror(errno_send)
-                   << '\'';
+void
+TlsSession::TlsSessionImpl::onPathMtuTimeout()
+{
+    if (pmtu_.probe == 0) {
+        // Periodic probe
+        if (pmtu_.mtu < pmtu_.maxMtu and clock::now() - pmtu_.searched >= PMTUD_RAISE_PERIOD)
+            startPathMtuSearch();
+        else
+            sendPathMtuProbe(pmtu_.mtu);
+        return;
+    }
+
+    if (++pmtu_.failures < PMTUD_MAX_PROBES) {
+        sendPathMtuProbe(pmtu_.probe);
+        return;
+    }
+    pmtu_.failures = 0;
+    if (pmtu_.searching) {
+        JAMI_DBG() << "[TLS] PMTUD: mtu " << pmtu_.probe << " [FAILED]";
+        pmtu_.high = pmtu_.probe;
+        nextPathMtuProbe();
+    } else if (pmtu_.mtu > MIN_MTU) {
+        JAMI_WARN() << "[TLS] PMTUD: black hole detected at " << pmtu_.mtu
+                    << ", restarting from minimal MTU value " << MIN_MTU;
+        PathMtuCache::instance().erase(pathKey_);
+        setPathMtu(MIN_MTU);
+        startPathMtuSearch();
     } else {
-        JAMI_DBG() << "[TLS] PMTUD: reached maximal value";
+        // Nothing smaller to try, the peer may just be quiet
+        pmtu_.probe = 0;
+        pmtu_.deadline = clock::now() + PMTUD_CONFIRM_PERIOD;
     }
 }
 
+// Heartbeats take record sequence numbers, the gaps they leave are not losses
+void
+TlsSession::TlsSessionImpl::onHeartbeatRecord()
+{
+    std::unique_lock<std::mutex> lk {rxMutex_};
+    skippedSeq_ = std::min<std::size_t>(skippedSeq_ + 1, MISS_ORDERING_LIMIT);
+    flushRxQueue(lk);
+}
+
 void
 TlsSession::TlsSessionImpl::handleDataPacket(std::vector<ValueType>&& buf, uint64_t pkt_seq)
 {
@@ -1416,8 +1744,11 @@ TlsSession::TlsSessionImpl::flushRxQueue(std::unique_lock<std::mutex>& lk)
             JAMI_WARN("[TLS] %lu lost since 0x%lx", lost, gapOffset_);
         else
             JAMI_WARN("[TLS] slow flush");
-    } else if (next_offset != gapOffset_)
-        return;
+    } else if (next_offset != gapOffset_) {
+        if (next_offset < gapOffset_ or next_offset - gapOffset_ > skippedSeq_)
+            return;
+        skippedSeq_ -= next_offset - gapOffset_;
+    }
 
     // Loop on offset-ordered received packet until a discontinuity in sequence number
     while (item != std::end(reorderBuffer_) and item->first <= next_offset) {
@@ -1442,83 +1773,67 @@ TlsSession::TlsSessionImpl::flushRxQueue(std::unique_lock<std::mutex>& lk)
 TlsSessionState
 TlsSession::TlsSessionImpl::handleStateEstablished(TlsSessionState state)
 {
+    auto newState = newState_.exchange(TlsSessionState::NONE);
+    if (newState != TlsSessionState::NONE)
+        return newState;
+
     // Nothing to do in reliable mode, so just wait for state change
     if (transport_ and transport_->isReliable()) {
-        auto disconnected = [this]() -> bool {
-            return state_.load() != TlsSessionState::ESTABLISHED
-                   or newState_.load() != TlsSessionState::NONE;
-        };
-        std::unique_lock<std::mutex> lk(stateMutex_);
-        stateCondition_.wait(lk, disconnected);
-        auto oldState = state_.load();
-        if (oldState == TlsSessionState::ESTABLISHED) {
-            auto newState = newState_.load();
-            if (newState != TlsSessionState::NONE) {
-                newState_ = TlsSessionState::NONE;
-                return newState;
-            }
-        }
-        return oldState;
+        waitUntil(clock::time_point::max());
+        return state;
     }
 
-    // block until rx packet or state change
+    // wait for rx packet, state change or timeout
+    bool timeout = false;
+    bool pmtudTimeout = false;
     {
         std::unique_lock<std::mutex> lk {rxMutex_};
-        if (nextFlush_.empty())
-            rxCv_.wait(lk, [this] {
-                return state_ != TlsSessionState::ESTABLISHED or not rxQueue_.empty()
-                       or not nextFlush_.empty();
-            });
-        else
-            rxCv_.wait_until(lk, nextFlush_.front(), [this] {
-                return state_ != TlsSessionState::ESTABLISHED or !rxQueue_.empty();
-            });
-        state = state_.load();
-        if (state != TlsSessionState::ESTABLISHED)
+        auto now = clock::now();
+        if (not nextFlush_.empty() and nextFlush_.front() <= now) {
+            while (not nextFlush_.empty() and nextFlush_.front() <= now)
+                nextFlush_.pop_front();
+            flushRxQueue(lk);
+            timeout = true;
+        }
+        pmtudTimeout = pmtu_.deadline <= now;
+        if (not timeout and not pmtudTimeout and rxQueue_.empty()) {
+            auto deadline = pmtu_.deadline;
+            if (not nextFlush_.empty())
+                deadline = std::min(deadline, nextFlush_.front());
+            waitUntil(deadline);
             return state;
-
-        if (not nextFlush_.empty()) {
-            auto now = clock::now();
-            if (nextFlush_.front() <= now) {
-                while (nextFlush_.front() <= now)
-                    nextFlush_.pop_front();
-                flushRxQueue(lk);
-                return state;
-            }
         }
     }
+    if (pmtudTimeout) {
+        pmtu_.deadline = clock::time_point::max();
+        onPathMtuTimeout();
+    }
+    if (timeout or pmtudTimeout)
+        return state;
 
     std::array<uint8_t, 8> seq;
     rawPktBuf_.resize(RX_MAX_SIZE);
     auto ret = gnutls_record_recv_seq(session_, rawPktBuf_.data(), rawPktBuf_.size(), &seq[0]);
 
     if (ret > 0) {
-        // Are we in PMTUD phase?
-        if (!pmtudOver_) {
-            mtuProbe_ = MTUS_[std::max(0, hbPingRecved_ - 1)];
-            gnutls_dtls_set_mtu(session_, mtuProbe_);
-            maxPayload_ = gnutls_dtls_get_data_mtu(session_);
-            pmtudOver_ = true;
-            JAMI_DBG() << "[TLS] maxPayload: " << maxPayload_.load();
-
-            if (!initFromRecordState(-1))
-                return TlsSessionState::SHUTDOWN;
-        }
-
         rawPktBuf_.resize(ret);
         handleDataPacket(std::move(rawPktBuf_), array2uint(seq));
         // no state change
     } else if (ret == GNUTLS_E_HEARTBEAT_PING_RECEIVED) {
-        JAMI_DBG("[TLS] PMTUD: ping received sending pong");
-        auto errno_send = gnutls_heartbeat_pong(session_, 0);
-
-        if (errno_send != GNUTLS_E_SUCCESS) {
+        int errno_send;
+        {
+            std::lock_guard<std::mutex> lk(sessionWriteMutex_);
+            errno_send = gnutls_heartbeat_pong(session_, 0);
+        }
+        if (errno_send != GNUTLS_E_SUCCESS)
             JAMI_ERR("[TLS] PMTUD: failed on pong with error %d: %s",
                      errno_send,
                      gnutls_strerror(errno_send));
-        } else {
-            ++hbPingRecved_;
-        }
+        onHeartbeatRecord();
+        // no state change
+    } else if (ret == GNUTLS_E_HEARTBEAT_PONG_RECEIVED) {
+        onHeartbeatRecord();
+        onPathMtuPong();
         // no state change
     } else if (ret == 0) {
         JAMI_DBG("[TLS] eof");
@@ -1540,7 +1855,8 @@ TlsSession::TlsSessionImpl::handleStateShutdown(TlsSessionState state)
     JAMI_DBG("[TLS] shutdown");
 
     // Stop ourself
-    thread_.stop();
+    cleanup();
+    cleanedUp_ = true;
     return state;
 }
 
@@ -1561,6 +1877,107 @@ TlsSession::TlsSessionImpl::process()
         callbacks_.onStateChange(new_state);
 }
 
+void
+TlsSession::TlsSessionImpl::wakeUp()
+{
+    std::lock_guard<std::mutex> lk(stepMutex_);
+    if (finished_)
+        return;
+    if (stepRunning_) {
+        stepPending_ = true;
+        return;
+    }
+    stepRunning_ = true;
+    dht::ThreadPool::io().run([this] { runStep(); });
+}
+
+void
+TlsSession::TlsSessionImpl::waitUntil(clock::time_point deadline)
+{
+    waiting_ = true;
+    if (wakeUpTask_) {
+        wakeUpTask_->cancel();
+        wakeUpTask_.reset();
+    }
+    if (deadline == clock::time_point::max())
+        return;
+    wakeUpTask_ = Manager::instance().scheduler().schedule(
+        [w = std::weak_ptr<Waker>(waker_)] {
+            if (auto waker = w.lock()) {
+                std::lock_guard<std::mutex> lk(waker->mutex);
+                if (waker->session)
+                    waker->session->wakeUp();
+            }
+        },
+        deadline);
+}
+
+void
+TlsSession::TlsSessionImpl::runStep()
+{
+    waiting_ = false;
+    try {
+        process();
+    } catch (const std::exception& e) {
+        JAMI_ERR("[TLS] FSM error: %s", e.what());
+        state_ = TlsSessionState::SHUTDOWN;
+    }
+
+    std::lock_guard<std::mutex> lk(stepMutex_);
+    if (cleanedUp_) {
+        finished_ = true;
+        stepRunning_ = false;
+        stepCv_.notify_all();
+        return;
+    }
+    if (waiting_ and not stepPending_) {
+        stepRunning_ = false;
+        return;
+    }
+    stepPending_ = false;
+    // Next step after the other tasks of the pool
+    dht::ThreadPool::io().run([this] { runStep(); });
+}
+
+//==============================================================================
+
+SessionTicketKey::SessionTicketKey(std::chrono::seconds lifetime)
+    : lifetime_(lifetime)
+{}
+
+SessionTicketKey::~SessionTicketKey()
+{
+    clear();
+}
+
+void
+SessionTicketKey::clear()
+{
+    if (not key_.data)
+        return;
+    gnutls_memset(key_.data, 0, key_.size);
+    gnutls_free(key_.data);
+    key_ = {nullptr, 0};
+}
+
+int
+SessionTicketKey::enableServer(gnutls_session_t session)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto now = clock::now();
+    if (not key_.data or now - created_ >= lifetime_) {
+        clear();
+        auto ret = gnutls_session_ticket_key_generate(&key_);
+        if (ret != GNUTLS_E_SUCCESS) {
+            key_ = {nullptr, 0};
+            return ret;
+        }
+        created_ = now;
+    }
+    // Copied by the session
+    return gnutls_session_ticket_enable_server(session, &key_);
+}
+
 //==============================================================================
 
 TlsSession::TlsSession(std::unique_ptr<SocketType>&& transport,
@@ -1604,6 +2021,7 @@ TlsSession::shutdown()
     pimpl_->newState_ = TlsSessionState::SHUTDOWN;
     pimpl_->stateCondition_.notify_all();
     pimpl_->rxCv_.notify_one(); // unblock waiting FSM
+    pimpl_->wakeUp();
 }
 
 std::size_t
@@ -1612,6 +2030,12 @@ TlsSession::write(const ValueType* data, std::size_t size, std::error_code& ec)
     return pimpl_->send(data, size, ec);
 }
 
+std::size_t
+TlsSession::writev(std::initializer_list<ConstBuffer> bufs, std::error_code& ec)
+{
+    return pimpl_->sendv(bufs, ec);
+}
+
 std::size_t
 TlsSession::read(ValueType* data, std::size_t size, std::error_code& ec)
 {
@@ -1642,6 +2066,7 @@ TlsSession::read(ValueType* data, std::size_t size, std::error_code& ec)
                 pimpl_->newState_ = TlsSessionState::SHUTDOWN;
                 pimpl_->stateCondition_.notify_all();
                 pimpl_->rxCv_.notify_one(); // unblock waiting FSM
+                pimpl_->wakeUp();
             }
             error = std::errc::broken_pipe;
             break;
@@ -1650,12 +2075,14 @@ TlsSession::read(ValueType* data, std::size_t size, std::error_code& ec)
             pimpl_->newState_ = TlsSessionState::HANDSHAKE;
             pimpl_->rxCv_.notify_one(); // unblock waiting FSM
             pimpl_->stateCondition_.notify_all();
+            pimpl_->wakeUp();
         } else if (gnutls_error_is_fatal(ret)) {
             if (pimpl_ && pimpl_->state_ != TlsSessionState::SHUTDOWN) {
                 JAMI_ERR("[TLS] fatal error in recv: %s", gnutls_strerror(ret));
                 pimpl_->newState_ = TlsSessionState::SHUTDOWN;
                 pimpl_->stateCondition_.notify_all();
                 pimpl_->rxCv_.notify_one(); // unblock waiting FSM
+                pimpl_->wakeUp();
             }
             error = std::errc::io_error;
             break;
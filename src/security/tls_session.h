@@ -32,10 +32,13 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <future>
 #include <chrono>
 #include <vector>
 #include <array>
+#include <initializer_list>
+#include <utility>
 
 namespace dht {
 namespace crypto {
@@ -60,6 +63,37 @@ enum class TlsSessionState {
 using clock = std::chrono::steady_clock;
 using duration = clock::duration;
 
+/**
+ * Key encrypting the session tickets given by a server, e.g. one per account:
+ * a client is able to resume with any later session of the same server.
+ * Replaced by a new one once older than its lifetime, the tickets it encrypted
+ * are then refused and the client does a full handshake.
+ */
+class SessionTicketKey
+{
+public:
+    // The default lifetime of the tickets given by GnuTLS
+    static constexpr std::chrono::hours DEFAULT_LIFETIME {6};
+
+    explicit SessionTicketKey(std::chrono::seconds lifetime = DEFAULT_LIFETIME);
+    ~SessionTicketKey();
+
+    /**
+     * Let the clients of a server session resume it later, with the current key
+     * @return GNUTLS_E_SUCCESS or the error of GnuTLS
+     */
+    int enableServer(gnutls_session_t session);
+
+private:
+    NON_COPYABLE(SessionTicketKey);
+    void clear();
+
+    const std::chrono::seconds lifetime_;
+    std::mutex mutex_;
+    gnutls_datum_t key_ {nullptr, 0};
+    clock::time_point created_ {};
+};
+
 struct TlsParams
 {
     // User CA list for session credentials
@@ -71,7 +105,9 @@ struct TlsParams
     std::shared_ptr<dht::crypto::Certificate> cert;
     std::shared_ptr<dht::crypto::PrivateKey> cert_key;
 
-    // Diffie-Hellman computed by gnutls_dh_params_init/gnutls_dh_params_generateX
+    // Diffie-Hellman computed by gnutls_dh_params_init/gnutls_dh_params_generateX.
+    // Optional: the ECDHE key exchanges are preferred, and the DHE ones fall back to the
+    // FFDHE groups of RFC 7919 without it.
     std::shared_future<DhParams> dh_params;
 
     // handshake timeout
@@ -80,6 +116,13 @@ struct TlsParams
     // Callback for certificate checkings
     std::function<int(unsigned status, const gnutls_datum_t* cert_list, unsigned cert_list_size)>
         cert_check;
+
+    // Session of a previous connection to the same peer, resumed if the server accepts it.
+    // Client only, the peer certificate is still checked by verifyCertificate.
+    std::vector<uint8_t> session_data {};
+
+    // Server only, to give session tickets encrypted with it
+    std::shared_ptr<SessionTicketKey> ticket_key {};
 };
 
 /// TlsSession
@@ -97,9 +140,10 @@ public:
     using OnCertificatesUpdate
         = std::function<void(const gnutls_datum_t*, const gnutls_datum_t*, unsigned int)>;
     using VerifyCertificate = std::function<int(gnutls_session_t)>;
+    using OnSessionData = std::function<void(std::vector<uint8_t>&&)>;
 
     // ===> WARNINGS <===
-    // Following callbacks are called into the FSM thread context
+    // Following callbacks are called by the FSM, on the thread pool
     // Do not call blocking routines inside them.
     using TlsSessionCallbacks = struct
     {
@@ -107,6 +151,7 @@ public:
         OnRxDataFunc onRxData;
         OnCertificatesUpdate onCertificatesUpdate;
         VerifyCertificate verifyCertificate;
+        OnSessionData onSessionData; // client only, for TlsParams::session_data
     };
 
     TlsSession(std::unique_ptr<SocketType>&& transport,
@@ -115,7 +160,7 @@ public:
                bool anonymous = true);
     ~TlsSession();
 
-    /// Request TLS thread to stop and quit.
+    /// Request the TLS session to stop.
     /// \note IO operations return error after this call.
     void shutdown() override;
 
@@ -138,6 +183,13 @@ public:
     /// Return a positive number for number of bytes write, or 0 and \a ec set in case of error.
     std::size_t write(const ValueType* data, std::size_t size, std::error_code& ec) override;
 
+    using ConstBuffer = std::pair<const ValueType*, std::size_t>;
+
+    /// Synchronous gathered writing, without concatenating the buffers first.
+    /// On reliable transports the buffers are sent in as few records as possible.
+    /// Return the total number of bytes written, or 0 and \a ec set in case of error.
+    std::size_t writev(std::initializer_list<ConstBuffer> bufs, std::error_code& ec);
+
     /// Synchronous reading.
     /// Return a positive number for number of bytes read, or 0 and \a ec set in case of error.
     std::size_t read(ValueType* data, std::size_t size, std::error_code& ec) override;
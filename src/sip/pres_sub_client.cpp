@@ -32,6 +32,8 @@
 #include <pj/pool.h>
 #include <pjsip/sip_ua_layer.h>
 #include <pjsip-simple/evsub.h>
+#include <pjsip-simple/pidf.h>
+#include <pjlib-util/xml.h>
 #include <unistd.h>
 
 #include "pres_sub_client.h"
@@ -309,20 +311,23 @@ PresSubClient::pres_client_evsub_on_rx_notify(pjsip_evsub* sub,
     }
     /* No need to pres->lock() here since the client has a locked dialog*/
 
-    pjsip_pres_get_status(sub, &pres_client->status_);
-    pres_client->reportPresence();
+    if (pres_client->list_) {
+        pres_client->reportListPresence(rdata);
+    } else {
+        pjsip_pres_get_status(sub, &pres_client->status_);
+        pres_client->reportPresence();
+    }
 
     /* The default is to send 200 response to NOTIFY.
      * Just leave it there..
      */
-    PJ_UNUSED_ARG(rdata);
     PJ_UNUSED_ARG(p_st_code);
     PJ_UNUSED_ARG(p_st_text);
     PJ_UNUSED_ARG(res_hdr);
     PJ_UNUSED_ARG(p_body);
 }
 
-PresSubClient::PresSubClient(const std::string& uri, SIPPresence* pres)
+PresSubClient::PresSubClient(const std::string& uri, SIPPresence* pres, bool list)
     : pres_(pres)
     , uri_ {0, 0}
     , contact_ {0, 0}
@@ -340,6 +345,7 @@ PresSubClient::PresSubClient(const std::string& uri, SIPPresence* pres)
     , user_data_(NULL)
     , lock_count_(0)
     , lock_flag_(0)
+    , list_(list)
 {
     pj_caching_pool_init(&cp_, &pj_pool_factory_default_policy, 0);
     pool_ = pj_pool_create(&cp_.factory, "Pres_sub_client", 512, 512, NULL);
@@ -427,7 +433,7 @@ void
 PresSubClient::enable(bool flag)
 {
     JAMI_DBG("pres_client %.*s is %s monitored.", (int)getURI().size(), getURI().data(), flag ? "" : "NOT");
-    if (flag and not monitored_)
+    if (flag and not monitored_ and not list_)
         pres_->addPresSubClient(this);
     monitored_ = flag;
 }
@@ -439,6 +445,105 @@ PresSubClient::reportPresence()
     pres_->reportPresSubClientNotification(getURI(), &status_);
 }
 
+/* Parse a PIDF document, with the URI of its buddy */
+static bool
+parsePidf(pj_pool_t* pool,
+          const pjsip_msg_body* body,
+          std::string& entity,
+          pjsip_pres_status& status)
+{
+    constexpr pj_str_t APPLICATION = CONST_PJ_STR("application");
+    constexpr pj_str_t PIDF_XML = CONST_PJ_STR("pidf+xml");
+    constexpr pj_str_t ENTITY = CONST_PJ_STR("entity");
+
+    if (pj_stricmp(&body->content_type.type, &APPLICATION)
+        or pj_stricmp(&body->content_type.subtype, &PIDF_XML))
+        return false;
+
+    // Both parsers modify the text
+    auto* text = (char*) pj_pool_alloc(pool, body->len + 1);
+    pj_memcpy(text, body->data, body->len);
+    text[body->len] = '\0';
+    auto* pidf = pjpidf_parse(pool, text, body->len);
+    if (not pidf)
+        return false;
+    const auto* attr = pj_xml_find_attr(pidf, &ENTITY, nullptr);
+    if (not attr)
+        return false;
+    entity = std::string(sip_utils::as_view(attr->value));
+
+    pj_memcpy(text, body->data, body->len);
+    pj_bzero(&status, sizeof(status));
+    return pjsip_pres_parse_pidf2(text, body->len, pool, &status) == PJ_SUCCESS
+           and status.info_cnt > 0;
+}
+
+void
+PresSubClient::reportListPresence(pjsip_rx_data* rdata)
+{
+    const auto* body = rdata->msg_info.msg->body;
+    if (not body)
+        return;
+
+    // The RLMI document (application/rlmi+xml) is not needed: each buddy has
+    // its PIDF document, giving its URI
+    auto report = [&](const pjsip_msg_body* part) {
+        std::string entity;
+        pjsip_pres_status status;
+        if (parsePidf(rdata->tp_info.pool, part, entity, status)) {
+            pres_->addListResource(entity);
+            pres_->reportPresSubClientNotification(entity, &status);
+        }
+    };
+    constexpr pj_str_t MULTIPART = CONST_PJ_STR("multipart");
+    if (pj_stricmp(&body->content_type.type, &MULTIPART) == 0) {
+        for (auto* part = pjsip_multipart_get_first_part(body); part;
+             part = pjsip_multipart_get_next_part(body, part))
+            report(part->body);
+    } else {
+        report(body);
+    }
+}
+
+pj_status_t
+PresSubClient::initiate(int expires, pjsip_tx_data** tdata)
+{
+    if (not list_)
+        return pjsip_pres_initiate(sub_, expires, tdata);
+
+    pj_status_t status = pjsip_evsub_initiate(sub_, nullptr, expires, tdata);
+    if (status != PJ_SUCCESS)
+        return status;
+
+    // Notifications of the list, and of its buddies
+    auto* supported = pjsip_supported_hdr_create((*tdata)->pool);
+    supported->values[supported->count++] = CONST_PJ_STR("eventlist");
+    pjsip_msg_add_hdr((*tdata)->msg, (pjsip_hdr*) supported);
+    auto* accept = pjsip_accept_hdr_create((*tdata)->pool);
+    accept->values[accept->count++] = CONST_PJ_STR("multipart/related");
+    accept->values[accept->count++] = CONST_PJ_STR("application/rlmi+xml");
+    accept->values[accept->count++] = CONST_PJ_STR("application/pidf+xml");
+    pjsip_msg_add_hdr((*tdata)->msg, (pjsip_hdr*) accept);
+    return PJ_SUCCESS;
+}
+
+pj_status_t
+PresSubClient::sendRequest(pjsip_tx_data* tdata)
+{
+    if (list_)
+        return pjsip_evsub_send_request(sub_, tdata);
+    return pjsip_pres_send_request(sub_, tdata);
+}
+
+void
+PresSubClient::terminate()
+{
+    if (list_)
+        pjsip_evsub_terminate(sub_, PJ_FALSE);
+    else
+        pjsip_pres_terminate(sub_, PJ_FALSE);
+}
+
 bool
 PresSubClient::lock()
 {
@@ -512,15 +617,15 @@ PresSubClient::unsubscribe()
 
     /* Unsubscribe means send a subscribe with timeout=0s*/
     JAMI_WARN("pres_client %.*s: unsubscribing..", (int) uri_.slen, uri_.ptr);
-    retStatus = pjsip_pres_initiate(sub_, 0, &tdata);
+    retStatus = initiate(0, &tdata);
 
     if (retStatus == PJ_SUCCESS) {
         pres_->fillDoc(tdata, NULL);
-        retStatus = pjsip_pres_send_request(sub_, tdata);
+        retStatus = sendRequest(tdata);
     }
 
     if (retStatus != PJ_SUCCESS and sub_) {
-        pjsip_pres_terminate(sub_, PJ_FALSE);
+        terminate();
         sub_ = NULL;
         JAMI_WARN("Unable to unsubscribe presence (%d)", retStatus);
         unlock();
@@ -578,7 +683,13 @@ PresSubClient::subscribe()
      */
     pjsip_dlg_inc_lock(dlg_);
 
-    status = pjsip_pres_create_uac(dlg_, &pres_callback, PJSIP_EVSUB_NO_EVENT_ID, &sub_);
+    constexpr pj_str_t PRESENCE_EVENT = CONST_PJ_STR("presence");
+    status = list_ ? pjsip_evsub_create_uac(dlg_,
+                                            &pres_callback,
+                                            &PRESENCE_EVENT,
+                                            PJSIP_EVSUB_NO_EVENT_ID,
+                                            &sub_)
+                   : pjsip_pres_create_uac(dlg_, &pres_callback, PJSIP_EVSUB_NO_EVENT_ID, &sub_);
 
     if (status != PJ_SUCCESS) {
         sub_ = NULL;
@@ -614,12 +725,12 @@ PresSubClient::subscribe()
     // attach the client data to the sub
     pjsip_evsub_set_mod_data(sub_, modId_, this);
 
-    status = pjsip_pres_initiate(sub_, -1, &tdata);
+    status = initiate(-1, &tdata);
     if (status != PJ_SUCCESS) {
         if (dlg_)
             pjsip_dlg_dec_lock(dlg_);
         if (sub_)
-            pjsip_pres_terminate(sub_, PJ_FALSE);
+            terminate();
         sub_ = NULL;
         JAMI_WARN("Unable to create initial SUBSCRIBE (%d)", status);
         return false;
@@ -627,13 +738,13 @@ PresSubClient::subscribe()
 
     //    pjsua_process_msg_data(tdata, NULL);
 
-    status = pjsip_pres_send_request(sub_, tdata);
+    status = sendRequest(tdata);
 
     if (status != PJ_SUCCESS) {
         if (dlg_)
             pjsip_dlg_dec_lock(dlg_);
         if (sub_)
-            pjsip_pres_terminate(sub_, PJ_FALSE);
+            terminate();
         sub_ = NULL;
         JAMI_WARN("Unable to send initial SUBSCRIBE (%d)", status);
         return false;
@@ -42,8 +42,9 @@ public:
     /**
      * Constructor
      * @param uri   SIP uri of remote user that we want to subscribe,
+     * @param list  If uri is a resource list (RFC 4662), each of its buddies being reported
      */
-    PresSubClient(const std::string& uri, SIPPresence* pres);
+    PresSubClient(const std::string& uri, SIPPresence* pres, bool list = false);
     /**
      * Destructor.
      * Process the the unsubscription before the destruction.
@@ -136,6 +137,16 @@ private:
      * Tranfert info to the SIP account.
      */
     void reportPresence();
+    /**
+     * Report the presence of each buddy of a resource list notification
+     */
+    void reportListPresence(pjsip_rx_data* rdata);
+    /**
+     * The subscription requests, of the presence or of the list of presences
+     */
+    pj_status_t initiate(int expires, pjsip_tx_data** tdata);
+    pj_status_t sendRequest(pjsip_tx_data* tdata);
+    void terminate();
     /**
      * Process the un/subscribe request transmission.
      */
@@ -166,6 +177,7 @@ private:
     void* user_data_;          /**< Application data. */
     int lock_count_;
     int lock_flag_;
+    bool list_; /**< Resource list subscription */
     static int modId_; // used to extract data structure from event_subscription
 };
 
@@ -44,9 +44,10 @@ public:
     {}
 };
 
-enum CipherMode { AESCounterMode, AESF8Mode };
+enum CipherMode { AESCounterMode, AESF8Mode, AESGCMMode };
 
-enum MACMode { HMACSHA1 };
+// AEAD ciphers authenticate the packets themselves
+enum MACMode { HMACSHA1, AEAD };
 
 enum KeyMethod {
     Inline
@@ -79,6 +80,9 @@ static std::vector<CryptoSuiteDefinition> CryptoSuites = {
 
     {"AES_CM_128_HMAC_SHA1_32"sv, 128, 112, 48, 31, AESCounterMode, 128, HMACSHA1, 32, 80, 160, 160},
 
+    // RFC 7714, accepted when offered, the first suite being the one offered
+    {"AEAD_AES_128_GCM"sv, 128, 96, 48, 31, AESGCMMode, 128, AEAD, 128, 128, 0, 0},
+
     {"F8_128_HMAC_SHA1_80"sv, 128, 112, 48, 31, AESF8Mode, 128, HMACSHA1, 80, 80, 160, 160}};
 
 class SdesNegotiator
@@ -37,6 +37,8 @@
 #include "libav_utils.h"
 
 #include "media_codec.h"
+#include "socket_pair.h"
+#include "rtp_fec.h"
 #include "system_codec_container.h"
 #include "compiler_intrinsics.h" // for UNUSED
 
@@ -54,6 +56,8 @@ using std::stringstream;
 
 static constexpr int POOL_INITIAL_SIZE = 16384;
 static constexpr int POOL_INCREMENT_SIZE = POOL_INITIAL_SIZE;
+// Of the audio level header extension we receive, abs-send-time (3) is implicit
+static constexpr uint8_t AUDIO_LEVEL_EXT_ID {1};
 
 static std::map<MediaDirection, const char*> DIRECTION_STR {{MediaDirection::SENDRECV, "sendrecv"},
                                                             {MediaDirection::SENDONLY, "sendonly"},
@@ -125,6 +129,72 @@ Sdp::findCodecByPayload(const unsigned payloadType)
     return nullptr;
 }
 
+/**
+ * @param value     Of an extmap attribute: <id>[/<direction>] <uri> [<attributes>]
+ * @return id of the audio level extension, 0 if value maps another one
+ */
+static uint8_t
+parseAudioLevelExtmap(std::string_view value)
+{
+    auto sep = value.find(' ');
+    if (sep == std::string_view::npos)
+        return 0;
+    auto uri = value.substr(sep + 1);
+    uri = uri.substr(0, uri.find(' '));
+    if (uri != rtp_audio_level::URI)
+        return 0;
+    auto id = std::atoi(std::string(value.substr(0, value.find_first_of("/ "))).c_str());
+    // One-byte header extensions only
+    return id > 0 and id < 15 and id != 3 ? id : 0;
+}
+
+/**
+ * @return payload type of the retransmissions (RFC 4588) of payloadType, 0 if none
+ */
+static uint8_t
+findRtxPayloadType(const pjmedia_sdp_media* media, unsigned payloadType)
+{
+    for (unsigned i = 0; i < media->desc.fmt_count; i++) {
+        const auto& fmt = media->desc.fmt[i];
+        auto rtpmapAttr = pjmedia_sdp_attr_find2(media->attr_count, media->attr, "rtpmap", &fmt);
+        pjmedia_sdp_rtpmap rtpmap;
+        if (not rtpmapAttr or pjmedia_sdp_attr_get_rtpmap(rtpmapAttr, &rtpmap) != PJ_SUCCESS
+            or pj_stricmp2(&rtpmap.enc_name, "rtx") != 0)
+            continue;
+        auto fmtpAttr = pjmedia_sdp_attr_find2(media->attr_count, media->attr, "fmtp", &fmt);
+        pjmedia_sdp_fmtp fmtp;
+        if (not fmtpAttr or pjmedia_sdp_attr_get_fmtp(fmtpAttr, &fmtp) != PJ_SUCCESS)
+            continue;
+        auto params = sip_utils::as_view(fmtp.fmt_param);
+        auto apt = params.find("apt=");
+        if (apt == std::string_view::npos
+            or std::atoi(std::string(params.substr(apt + 4)).c_str()) != (int) payloadType)
+            continue;
+        auto pt = pj_strtoul(&fmt);
+        return pt >= 96 and pt < 128 ? pt : 0;
+    }
+    return 0;
+}
+
+/**
+ * @return payload type of the FlexFEC repair packets, 0 if none
+ */
+static uint8_t
+findFecPayloadType(const pjmedia_sdp_media* media)
+{
+    for (unsigned i = 0; i < media->desc.fmt_count; i++) {
+        const auto& fmt = media->desc.fmt[i];
+        auto rtpmapAttr = pjmedia_sdp_attr_find2(media->attr_count, media->attr, "rtpmap", &fmt);
+        pjmedia_sdp_rtpmap rtpmap;
+        if (not rtpmapAttr or pjmedia_sdp_attr_get_rtpmap(rtpmapAttr, &rtpmap) != PJ_SUCCESS
+            or pj_stricmp2(&rtpmap.enc_name, flexfec::ENCODING_NAME) != 0)
+            continue;
+        auto pt = pj_strtoul(&fmt);
+        return pt >= 96 and pt < 128 ? pt : 0;
+    }
+    return 0;
+}
+
 static void
 randomFill(std::vector<uint8_t>& dest)
 {
@@ -263,29 +333,67 @@ Sdp::addMediaDescription(const MediaAttribute& mediaAttr)
 
     JAMI_DBG("Add media description [%s]", mediaAttr.toString(true).c_str());
 
-    pjmedia_sdp_media* med = PJ_POOL_ZALLOC_T(memPool_.get(), pjmedia_sdp_media);
+    // Only the media header and the attributes after the template are new: the attributes
+    // of the template are shared, and never modified in place
+    auto med = PJ_POOL_ALLOC_T(memPool_.get(), pjmedia_sdp_media);
+    *med = *getMediaTemplate(type);
 
+    if (type == MediaType::MEDIA_AUDIO)
+        med->desc.port = mediaAttr.enabled_ ? localAudioRtpPort_ : 0;
+    else
+        med->desc.port = mediaAttr.enabled_ ? localVideoRtpPort_ : 0;
+
+    // Set the transport protocol of the media
+    med->desc.transport = secure ? sip_utils::CONST_PJ_STR("RTP/SAVP")
+                                 : sip_utils::CONST_PJ_STR("RTP/AVP");
+
+    char const* direction = mediaDirection(mediaAttr);
+
+    med->attr[med->attr_count++] = pjmedia_sdp_attr_create(memPool_.get(), direction, NULL);
+
+    if (secure) {
+        if (pjmedia_sdp_media_add_attr(med, generateSdesAttribute()) != PJ_SUCCESS)
+            throw SdpException("Could not add sdes attribute to media");
+    }
+
+    return med;
+}
+
+const pjmedia_sdp_media*
+Sdp::getMediaTemplate(MediaType type)
+{
+    MediaTemplate* tmpl;
+    const std::vector<std::shared_ptr<AccountCodecInfo>>* codecs;
+    uint16_t rtcpPort;
     switch (type) {
     case MediaType::MEDIA_AUDIO:
-        med->desc.media = sip_utils::CONST_PJ_STR("audio");
-        med->desc.port = mediaAttr.enabled_ ? localAudioRtpPort_ : 0;
-        med->desc.fmt_count = audio_codec_list_.size();
+        tmpl = &audioTemplate_;
+        codecs = &audio_codec_list_;
+        rtcpPort = localAudioRtcpPort_;
         break;
     case MediaType::MEDIA_VIDEO:
-        med->desc.media = sip_utils::CONST_PJ_STR("video");
-        med->desc.port = mediaAttr.enabled_ ? localVideoRtpPort_ : 0;
-        med->desc.fmt_count = video_codec_list_.size();
+        tmpl = &videoTemplate_;
+        codecs = &video_codec_list_;
+        rtcpPort = localVideoRtcpPort_;
         break;
     default:
         throw SdpException("Unsupported media type! Only audio and video are supported");
         break;
     }
 
-    med->desc.port_count = 1;
+    // Kept for the re-INVITEs, unless the codecs or the RTCP address changed
+    if (tmpl->media and tmpl->codecs == *codecs and tmpl->rtcpPort == rtcpPort
+        and tmpl->address == publishedIpAddr_)
+        return tmpl->media;
 
-    // Set the transport protocol of the media
-    med->desc.transport = secure ? sip_utils::CONST_PJ_STR("RTP/SAVP")
-                                 : sip_utils::CONST_PJ_STR("RTP/AVP");
+    pjmedia_sdp_media* med = PJ_POOL_ZALLOC_T(memPool_.get(), pjmedia_sdp_media);
+
+    if (type == MediaType::MEDIA_AUDIO)
+        med->desc.media = sip_utils::CONST_PJ_STR("audio");
+    else
+        med->desc.media = sip_utils::CONST_PJ_STR("video");
+    med->desc.fmt_count = codecs->size();
+    med->desc.port_count = 1;
 
     unsigned dynamic_payload = 96;
 
@@ -352,24 +460,67 @@ Sdp::addMediaDescription(const MediaAttribute& mediaAttr)
 #endif
     }
 
-    if (type == MediaType::MEDIA_AUDIO) {
-        setTelephoneEventRtpmap(med);
-        if (localAudioRtcpPort_) {
-            addRTCPAttribute(med, localAudioRtcpPort_);
+    if (type == MediaType::MEDIA_VIDEO) {
+        // Retransmission of the packets the peer reports lost, in their own payload type
+        for (unsigned i = 0, count = med->desc.fmt_count; i < count; i++) {
+            auto payload = pj_strtoul(&med->desc.fmt[i]);
+            auto rtxStr = std::to_string(dynamic_payload++);
+            auto pjRtx = sip_utils::CONST_PJ_STR(rtxStr);
+            auto& rtxFmt = med->desc.fmt[med->desc.fmt_count++];
+            pj_strdup(memPool_.get(), &rtxFmt, &pjRtx);
+
+            pjmedia_sdp_rtpmap rtpmap;
+            rtpmap.param.slen = 0;
+            rtpmap.pt = rtxFmt;
+            rtpmap.enc_name = sip_utils::CONST_PJ_STR("rtx");
+            rtpmap.clock_rate = 90000;
+            pjmedia_sdp_attr* attr;
+            pjmedia_sdp_rtpmap_to_attr(memPool_.get(), &rtpmap, &attr);
+            med->attr[med->attr_count++] = attr;
+
+            auto fmtp = fmt::format("fmtp:{} apt={}", rtxStr, payload);
+            med->attr[med->attr_count++] = pjmedia_sdp_attr_create(memPool_.get(),
+                                                                   fmtp.c_str(),
+                                                                   NULL);
+            auto feedback = fmt::format("rtcp-fb:{} nack", payload);
+            med->attr[med->attr_count++] = pjmedia_sdp_attr_create(memPool_.get(),
+                                                                   feedback.c_str(),
+                                                                   NULL);
         }
-    } else if (type == MediaType::MEDIA_VIDEO and localVideoRtcpPort_) {
-        addRTCPAttribute(med, localVideoRtcpPort_);
-    }
 
-    char const* direction = mediaDirection(mediaAttr);
+        // Repair packets of the stream, whatever its codec
+        auto fecStr = std::to_string(dynamic_payload++);
+        auto pjFec = sip_utils::CONST_PJ_STR(fecStr);
+        auto& fecFmt = med->desc.fmt[med->desc.fmt_count++];
+        pj_strdup(memPool_.get(), &fecFmt, &pjFec);
 
-    med->attr[med->attr_count++] = pjmedia_sdp_attr_create(memPool_.get(), direction, NULL);
+        pjmedia_sdp_rtpmap rtpmap;
+        rtpmap.param.slen = 0;
+        rtpmap.pt = fecFmt;
+        rtpmap.enc_name = sip_utils::CONST_PJ_STR(flexfec::ENCODING_NAME);
+        rtpmap.clock_rate = 90000;
+        pjmedia_sdp_attr* attr;
+        pjmedia_sdp_rtpmap_to_attr(memPool_.get(), &rtpmap, &attr);
+        med->attr[med->attr_count++] = attr;
 
-    if (secure) {
-        if (pjmedia_sdp_media_add_attr(med, generateSdesAttribute()) != PJ_SUCCESS)
-            throw SdpException("Could not add sdes attribute to media");
+        // In microseconds, the groups are closed within a few frames
+        auto fmtp = fmt::format("fmtp:{} repair-window=200000", fecStr);
+        med->attr[med->attr_count++] = pjmedia_sdp_attr_create(memPool_.get(), fmtp.c_str(), NULL);
+    }
+
+    if (type == MediaType::MEDIA_AUDIO) {
+        setTelephoneEventRtpmap(med);
+        auto extmap = fmt::format("{} {}", AUDIO_LEVEL_EXT_ID, rtp_audio_level::URI);
+        auto value = sip_utils::CONST_PJ_STR(extmap);
+        med->attr[med->attr_count++] = pjmedia_sdp_attr_create(memPool_.get(), "extmap", &value);
     }
+    if (rtcpPort)
+        addRTCPAttribute(med, rtcpPort);
 
+    tmpl->media = med;
+    tmpl->codecs = *codecs;
+    tmpl->rtcpPort = rtcpPort;
+    tmpl->address = publishedIpAddr_;
     return med;
 }
 
@@ -474,6 +625,10 @@ Sdp::getSdpDirectionStr(SdpDirection direction)
 void
 Sdp::printSession(const pjmedia_sdp_session* session, const char* header, SdpDirection direction)
 {
+    // Not worth a pool when not logged
+    if (not Logger::debugEnabled())
+        return;
+
     static constexpr size_t BUF_SZ = 4095;
     std::unique_ptr<pj_pool_t, decltype(pj_pool_release)&>
         tmpPool_(pj_pool_create(&Manager::instance().sipVoIPLink().getCachingPool()->factory,
@@ -865,6 +1020,8 @@ Sdp::getMediaDescriptions(const pjmedia_sdp_session* session, bool remote) const
                     const auto& v = fmtpAttr->value;
                     descr.parameters = std::string(v.ptr, v.ptr + v.slen);
                 }
+                descr.rtxPayloadType = findRtxPayloadType(media, descr.payload_type);
+                descr.fecPayloadType = findFecPayloadType(media);
             }
             // for now, just keep the first codec only
             descr.enabled = true;
@@ -880,6 +1037,8 @@ Sdp::getMediaDescriptions(const pjmedia_sdp_session* session, bool remote) const
             const auto attribute = media->attr[j];
             if (pj_stricmp2(&attribute->name, "crypto") == 0)
                 crypto.emplace_back(attribute->value.ptr, attribute->value.slen);
+            else if (descr.type == MEDIA_AUDIO and pj_stricmp2(&attribute->name, "extmap") == 0)
+                descr.audioLevelExtId = parseAudioLevelExtmap(sip_utils::as_view(attribute->value));
         }
         descr.crypto = SdesNegotiator::negotiate(crypto);
     }
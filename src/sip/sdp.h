@@ -264,6 +264,25 @@ private:
 
     void addRTCPAttribute(pjmedia_sdp_media* med, uint16_t port);
 
+    /**
+     * Codecs part of a media description of the local session: the media type and formats,
+     * their rtpmap and fmtp, and the rtcp attributes.
+     */
+    struct MediaTemplate
+    {
+        pjmedia_sdp_media* media {nullptr};
+        std::vector<std::shared_ptr<AccountCodecInfo>> codecs {};
+        uint16_t rtcpPort {0};
+        std::string address {};
+    };
+    /**
+     * @return template of the media descriptions of type, built again only when the codecs,
+     * the RTCP port or the published address changed, so that a re-INVITE (hold, resume,
+     * media change) doesn't format the codecs again
+     * @throw SdpException
+     */
+    const pjmedia_sdp_media* getMediaTemplate(MediaType type);
+
     std::shared_ptr<AccountCodecInfo> findCodecByPayload(const unsigned payloadType);
     std::shared_ptr<AccountCodecInfo> findCodecBySpec(std::string_view codecName,
                                                       const unsigned clockrate = 0) const;
@@ -293,6 +312,8 @@ private:
      */
     std::vector<std::shared_ptr<AccountCodecInfo>> audio_codec_list_;
     std::vector<std::shared_ptr<AccountCodecInfo>> video_codec_list_;
+    MediaTemplate audioTemplate_ {};
+    MediaTemplate videoTemplate_ {};
 
     std::string publishedIpAddr_;
     pj_uint16_t publishedIpAddrType_;
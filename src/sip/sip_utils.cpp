@@ -113,9 +113,7 @@ parseDisplayName(const pjsip_name_addr* sip_name_addr)
                              static_cast<size_t>(sip_name_addr->display.slen)};
 
     // Filter out invalid UTF-8 characters to avoid getting kicked from D-Bus
-    if (not utf8_validate(displayName))
-        return utf8_make_valid(displayName);
-
+    utf8_make_valid_in_place(displayName);
     return displayName;
 }
 
@@ -57,6 +57,7 @@
 
 #include "upnp/upnp_control.h"
 #include "ip_utils.h"
+#include "network_monitor.h"
 #include "string_utils.h"
 
 #include "im/instant_messaging.h"
@@ -92,6 +93,7 @@ static constexpr int MIN_REGISTRATION_TIME = 60;                  // seconds
 static constexpr unsigned DEFAULT_REGISTRATION_EXPIRE = 3600;     // seconds
 static constexpr unsigned REGISTRATION_FIRST_RETRY_INTERVAL = 60; // seconds
 static constexpr unsigned REGISTRATION_RETRY_INTERVAL = 300;      // seconds
+static constexpr std::size_t ICE_POOL_SIZE {1};
 static const char* const VALID_TLS_PROTOS[] = {"Default", "TLSv1.2", "TLSv1.1", "TLSv1"};
 constexpr const char* const SIPAccount::ACCOUNT_TYPE;
 
@@ -451,6 +453,7 @@ SIPAccount::serialize(YAML::Emitter& out) const
         << (presence_ and presence_->isSupported(PRESENCE_FUNCTION_PUBLISH));
     out << YAML::Key << Conf::PRESENCE_SUBSCRIBE_SUPPORTED_KEY << YAML::Value
         << (presence_ and presence_->isSupported(PRESENCE_FUNCTION_SUBSCRIBE));
+    out << YAML::Key << Conf::PRESENCE_LIST_URI_KEY << YAML::Value << presenceListUri_;
 
     out << YAML::Key << Conf::CONFIG_ACCOUNT_REGISTRATION_EXPIRE << YAML::Value
         << registrationExpire_;
@@ -551,6 +554,7 @@ SIPAccount::unserialize(const YAML::Node& node)
     parseValue(node, Conf::PRESENCE_PUBLISH_SUPPORTED_KEY, publishSupported);
     bool subscribeSupported = false;
     parseValue(node, Conf::PRESENCE_SUBSCRIBE_SUPPORTED_KEY, subscribeSupported);
+    parseValueOptional(node, Conf::PRESENCE_LIST_URI_KEY, presenceListUri_);
     if (presence_) {
         presence_->support(PRESENCE_FUNCTION_PUBLISH, publishSupported);
         presence_->support(PRESENCE_FUNCTION_SUBSCRIBE, subscribeSupported);
@@ -623,6 +627,7 @@ SIPAccount::setAccountDetails(const std::map<std::string, std::string>& details)
     bool presenceEnabled = false;
     parseBool(details, Conf::CONFIG_PRESENCE_ENABLED, presenceEnabled);
     enablePresence(presenceEnabled);
+    parseString(details, Conf::CONFIG_PRESENCE_LIST_URI, presenceListUri_);
 
     // TLS settings
     parseBool(details, Conf::CONFIG_TLS_ENABLE, tlsEnable_);
@@ -699,6 +704,7 @@ SIPAccount::getAccountDetails() const
     a.emplace(Conf::CONFIG_PRESENCE_SUBSCRIBE_SUPPORTED,
               presence_ and presence_->isSupported(PRESENCE_FUNCTION_SUBSCRIBE) ? TRUE_STR
                                                                                 : FALSE_STR);
+    a.emplace(Conf::CONFIG_PRESENCE_LIST_URI, presenceListUri_);
 
     auto tlsSettings(getTlsSettings());
     a.insert(tlsSettings.begin(), tlsSettings.end());
@@ -945,6 +951,7 @@ SIPAccount::doRegister2_()
     }
 
     if (presence_ and presence_->isEnabled()) {
+        presence_->subscribeList(presenceListUri_);
         presence_->subscribeClient(getFromUri(), true); // self presence subscription
         presence_->sendPresence(true, "");              // try to publish whatever the status is.
     }
@@ -968,6 +975,7 @@ SIPAccount::doUnregister(std::function<void(bool)> released_cb)
     if (transport_)
         setTransport();
     resetAutoRegistration();
+    Manager::instance().getIceTransportFactory().clearPool(getAccountID());
 
     lock.unlock();
     if (released_cb)
@@ -988,6 +996,14 @@ SIPAccount::connectivityChanged()
     });
 }
 
+void
+SIPAccount::networkChanged(const ConnectivityChange& change)
+{
+    // New addresses only matter to an account which couldn't register without them
+    if (change.disrupts() or (change.affects() and not isRegistered()))
+        connectivityChanged();
+}
+
 void
 SIPAccount::sendRegister()
 {
@@ -1155,6 +1171,7 @@ SIPAccount::onRegister(pjsip_regc_cbparam* param)
                                                                    link_.getPool()));
 
             setRegistrationState(RegistrationState::REGISTERED, param->code);
+            fillIcePool();
         }
     }
 
@@ -1906,6 +1923,18 @@ SIPAccount::resetAutoRegistration()
     }
 }
 
+void
+SIPAccount::fillIcePool()
+{
+    if (not isIceForMediaEnabled())
+        return;
+    // As for an outgoing call, with the default media
+    auto opts = getIceOptions();
+    opts.streamsCount = createDefaultMediaList(isVideoEnabled()).size();
+    opts.compCountPerStream = SIPCall::ICE_COMP_COUNT_PER_STREAM;
+    Manager::instance().getIceTransportFactory().fillPool(getAccountID(), opts, ICE_POOL_SIZE);
+}
+
 bool
 SIPAccount::checkNATAddress(pjsip_regc_cbparam* param, pj_pool_t* pool)
 {
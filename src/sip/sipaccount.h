@@ -110,6 +110,11 @@ public:
 
     void resetAutoRegistration();
 
+    /**
+     * Initialize media ICE transports in advance, for the next calls of the account
+     */
+    void fillIcePool();
+
     /**
      * Update NAT address, Via and Contact header from the REGISTER response
      * @param param pjsip reg cbparam
@@ -449,6 +454,7 @@ public:
                              bool onlyConnected = false) override;
 
     void connectivityChanged() override;
+    void networkChanged(const ConnectivityChange& change) override;
 
     std::string getUserUri() const override;
 
@@ -746,6 +752,11 @@ private:
      * Presence data structure
      */
     SIPPresence* presence_;
+    /**
+     * Resource list of the server giving the presence of the buddies, subscribed
+     * instead of each of them (RFC 4662)
+     */
+    std::string presenceListUri_ {};
 
     /**
      * SIP port actually used,
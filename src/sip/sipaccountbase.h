@@ -74,6 +74,7 @@ const char* const PRESENCE_PUBLISH_SUPPORTED_KEY = "presencePublishSupported";
 const char* const PRESENCE_SUBSCRIBE_SUPPORTED_KEY = "presenceSubscribeSupported";
 const char* const PRESENCE_STATUS_KEY = "presenceStatus";
 const char* const PRESENCE_NOTE_KEY = "presenceNote";
+const char* const PRESENCE_LIST_URI_KEY = "presenceListUri";
 
 // TODO: write an object to store tls params which implement serializable
 const char* const TLS_KEY = "tls";
@@ -252,6 +253,21 @@ public:
                              bool onlyConnected = false)
         = 0;
 
+    // Messages to the same peer, by id
+    using OutgoingMessages = std::vector<std::pair<uint64_t, std::map<std::string, std::string>>>;
+
+    /**
+     * Send several messages to the same peer, each reported to the message engine.
+     * By default, they are sent one by one.
+     */
+    virtual void sendMessages(const std::string& to,
+                              const OutgoingMessages& messages,
+                              bool retryOnTimeout = true)
+    {
+        for (const auto& [id, payloads] : messages)
+            sendMessage(to, payloads, id, retryOnTimeout);
+    }
+
     virtual uint64_t sendTextMessage(const std::string& to,
                                      const std::map<std::string, std::string>& payloads,
                                      uint64_t refreshToken = 0) override
@@ -85,7 +85,6 @@ static constexpr std::chrono::milliseconds EXPECTED_ICE_INIT_MAX_TIME {5000};
 static constexpr std::chrono::seconds DEFAULT_ICE_NEGO_TIMEOUT {60}; // seconds
 static constexpr std::chrono::milliseconds MS_BETWEEN_2_KEYFRAME_REQUEST {1000};
 static constexpr int ICE_COMP_ID_RTP {1};
-static constexpr int ICE_COMP_COUNT_PER_STREAM {2};
 static constexpr auto MULTISTREAM_REQUIRED_VERSION_STR = "10.0.2"sv;
 static const std::vector<unsigned> MULTISTREAM_REQUIRED_VERSION
     = split_string_to_unsigned(MULTISTREAM_REQUIRED_VERSION_STR, '.');
@@ -147,6 +146,7 @@ SIPCall::SIPCall(const std::shared_ptr<SIPAccountBase>& account,
              mediaList.size());
 
     initMediaStreams(mediaAttrList);
+    warmUpMedia();
 }
 
 SIPCall::~SIPCall()
@@ -1587,6 +1587,7 @@ SIPCall::removeCall()
 #endif
     std::lock_guard<std::recursive_mutex> lk {callMutex_};
     JAMI_DBG("[call:%s] removeCall()", getCallId().c_str());
+    releaseWarmUp();
     if (sdp_) {
         sdp_->setActiveLocalSdpSession(nullptr);
         sdp_->setActiveRemoteSdpSession(nullptr);
@@ -1607,13 +1608,15 @@ void
 SIPCall::onFailure(signed cause)
 {
     if (setState(CallState::MERROR, ConnectionState::DISCONNECTED, cause)) {
-        runOnMainThread([w = weak()] {
-            if (auto shared = w.lock()) {
-                auto& call = *shared;
-                Manager::instance().callFailure(call);
-                call.removeCall();
-            }
-        });
+        runOnMainThread(
+            [w = weak()] {
+                if (auto shared = w.lock()) {
+                    auto& call = *shared;
+                    Manager::instance().callFailure(call);
+                    call.removeCall();
+                }
+            },
+            ScheduledExecutor::Priority::High);
     }
 }
 
@@ -1625,41 +1628,47 @@ SIPCall::onBusyHere()
     else
         setState(CallState::BUSY, ConnectionState::DISCONNECTED);
 
-    runOnMainThread([w = weak()] {
-        if (auto shared = w.lock()) {
-            auto& call = *shared;
-            Manager::instance().callBusy(call);
-            call.removeCall();
-        }
-    });
+    runOnMainThread(
+        [w = weak()] {
+            if (auto shared = w.lock()) {
+                auto& call = *shared;
+                Manager::instance().callBusy(call);
+                call.removeCall();
+            }
+        },
+        ScheduledExecutor::Priority::High);
 }
 
 void
 SIPCall::onClosed()
 {
-    runOnMainThread([w = weak()] {
-        if (auto shared = w.lock()) {
-            auto& call = *shared;
-            Manager::instance().peerHungupCall(call);
-            call.removeCall();
-        }
-    });
+    runOnMainThread(
+        [w = weak()] {
+            if (auto shared = w.lock()) {
+                auto& call = *shared;
+                Manager::instance().peerHungupCall(call);
+                call.removeCall();
+            }
+        },
+        ScheduledExecutor::Priority::High);
 }
 
 void
 SIPCall::onAnswered()
 {
     JAMI_WARN("[call:%s] onAnswered()", getCallId().c_str());
-    runOnMainThread([w = weak()] {
-        if (auto shared = w.lock()) {
-            if (shared->getConnectionState() != ConnectionState::CONNECTED) {
-                shared->setState(CallState::ACTIVE, ConnectionState::CONNECTED);
-                if (not shared->isSubcall()) {
-                    Manager::instance().peerAnsweredCall(*shared);
+    runOnMainThread(
+        [w = weak()] {
+            if (auto shared = w.lock()) {
+                if (shared->getConnectionState() != ConnectionState::CONNECTED) {
+                    shared->setState(CallState::ACTIVE, ConnectionState::CONNECTED);
+                    if (not shared->isSubcall()) {
+                        Manager::instance().peerAnsweredCall(*shared);
+                    }
                 }
             }
-        }
-    });
+        },
+        ScheduledExecutor::Priority::High);
 }
 
 void
@@ -2171,6 +2180,9 @@ SIPCall::startAllMedia()
         }
     }
 
+    // The sessions hold the devices now
+    releaseWarmUp();
+
     // Media is restarted, we can process the last holding request.
     isWaitingForIceAndMedia_ = false;
     if (remainingRequest_ != Request::NoRequest) {
@@ -2219,6 +2231,7 @@ void
 SIPCall::stopAllMedia()
 {
     JAMI_DBG("[call:%s] Stopping all media", getCallId().c_str());
+    setStatsInterval({});
     if (Recordable::isRecording()) {
         deinitRecorder();
         stopRecording(); // if call stops, finish recording
@@ -2977,6 +2990,15 @@ SIPCall::getDetails() const
     auto details = Call::getDetails();
 
     details.emplace(DRing::Call::Details::PEER_HOLDING, peerHolding_ ? TRUE_STR : FALSE_STR);
+    {
+        std::lock_guard<std::mutex> lk {setupSuccessMutex_};
+        if (audioSetupDelay_)
+            details.emplace(DRing::Call::Details::AUDIO_SETUP_DELAY,
+                            std::to_string(audioSetupDelay_->count()));
+        if (videoSetupDelay_)
+            details.emplace(DRing::Call::Details::VIDEO_SETUP_DELAY,
+                            std::to_string(videoSetupDelay_->count()));
+    }
 
 #ifdef ENABLE_VIDEO
     for (auto const& stream : rtpStreams_) {
@@ -3152,6 +3174,36 @@ SIPCall::monitor() const
     }
 }
 
+std::vector<DRing::MediaStreamStats>
+SIPCall::getStats() const
+{
+    std::vector<DRing::MediaStreamStats> stats;
+    for (const auto& rtp : getRtpSessionList())
+        stats.emplace_back(rtp->getStats());
+    return stats;
+}
+
+void
+SIPCall::setStatsInterval(std::chrono::milliseconds interval)
+{
+    std::lock_guard<std::mutex> lk(statsMtx_);
+    if (auto task = std::move(statsTask_))
+        task->cancel();
+    if (interval.count() <= 0)
+        return;
+    statsTask_ = Manager::instance().scheduler().scheduleAtFixedRate(
+        [w = weak()] {
+            auto call = w.lock();
+            if (not call)
+                return false;
+            emitSignal<DRing::CallSignal::CallStats>(call->getAccountId(),
+                                                     call->getCallId(),
+                                                     call->getStats());
+            return true;
+        },
+        interval);
+}
+
 bool
 SIPCall::toggleRecording()
 {
@@ -3171,6 +3223,11 @@ SIPCall::toggleRecording()
                                  account->getUserUri(),
                                  peerUri_);
         recorder_->setMetadata(title, ""); // use default description
+        // Without decoding nor encoding, if all the codecs can be stored as they are
+        auto passthrough = Manager::instance().audioPreference.getRecordPassthrough();
+        for (const auto& rtpSession : getRtpSessionList())
+            passthrough = passthrough and rtpSession->canRecordPackets();
+        recorder_->passthrough(passthrough);
         for (const auto& rtpSession : getRtpSessionList())
             rtpSession->initRecorder(recorder_);
     } else {
@@ -3206,7 +3263,18 @@ SIPCall::createIceMediaTransport(bool isReinvite)
 {
     auto& iceTransportFactory = Manager::instance().getIceTransportFactory();
 
-    auto mediaTransport = iceTransportFactory.createTransport(getCallId().c_str());
+    // Initialized in advance for the calls of the account, its candidates gathered
+    std::shared_ptr<IceTransport> mediaTransport;
+    if (auto acc = getSIPAccount())
+        mediaTransport = iceTransportFactory.takeTransport(acc->getAccountID(),
+                                                           rtpStreams_.size(),
+                                                           ICE_COMP_COUNT_PER_STREAM);
+    if (mediaTransport)
+        JAMI_DBG("[call:%s] Using pooled media ICE transport [ice:%p]",
+                 getCallId().c_str(),
+                 mediaTransport.get());
+    else
+        mediaTransport = iceTransportFactory.createTransport(getCallId().c_str());
     if (mediaTransport) {
         JAMI_DBG("[call:%s] Successfully created media ICE transport [ice:%p]",
                  getCallId().c_str(),
@@ -3243,37 +3311,43 @@ SIPCall::initIceMediaTransport(bool master, std::optional<IceTransportOptions> o
     auto optOnInitDone = std::move(iceOptions.onInitDone);
     auto optOnNegoDone = std::move(iceOptions.onNegoDone);
     iceOptions.onInitDone = [w = weak(), cb = std::move(optOnInitDone)](bool ok) {
-        runOnMainThread([w = std::move(w), cb = std::move(cb), ok] {
-            auto call = w.lock();
-            if (cb)
-                cb(ok);
-            if (!ok or !call or !call->waitForIceInit_.exchange(false))
-                return;
+        runOnMainThread(
+            [w = std::move(w), cb = std::move(cb), ok] {
+                auto call = w.lock();
+                if (cb)
+                    cb(ok);
+                if (!ok or !call or !call->waitForIceInit_.exchange(false))
+                    return;
 
-            std::lock_guard<std::recursive_mutex> lk {call->callMutex_};
-            auto rem_ice_attrs = call->sdp_->getIceAttributes();
-            // Init done but no remote_ice_attributes, the ice->start will be triggered later
-            if (rem_ice_attrs.ufrag.empty() or rem_ice_attrs.pwd.empty())
-                return;
-            call->startIceMedia();
-        });
-    };
-    iceOptions.onNegoDone = [w = weak(), cb = std::move(optOnNegoDone)](bool ok) {
-        runOnMainThread([w = std::move(w), cb = std::move(cb), ok] {
-            if (cb)
-                cb(ok);
-            if (auto call = w.lock()) {
-                // The ICE is related to subcalls, but medias are handled by parent call
                 std::lock_guard<std::recursive_mutex> lk {call->callMutex_};
-                call = call->isSubcall() ? std::dynamic_pointer_cast<SIPCall>(call->parent_) : call;
-                if (!ok) {
-                    JAMI_ERR("[call:%s] Media ICE negotiation failed", call->getCallId().c_str());
-                    call->onFailure(EIO);
+                auto rem_ice_attrs = call->sdp_->getIceAttributes();
+                // Init done but no remote_ice_attributes, the ice->start will be triggered later
+                if (rem_ice_attrs.ufrag.empty() or rem_ice_attrs.pwd.empty())
                     return;
+                call->startIceMedia();
+            },
+            ScheduledExecutor::Priority::High);
+    };
+    iceOptions.onNegoDone = [w = weak(), cb = std::move(optOnNegoDone)](bool ok) {
+        runOnMainThread(
+            [w = std::move(w), cb = std::move(cb), ok] {
+                if (cb)
+                    cb(ok);
+                if (auto call = w.lock()) {
+                    // The ICE is related to subcalls, but medias are handled by parent call
+                    std::lock_guard<std::recursive_mutex> lk {call->callMutex_};
+                    call = call->isSubcall() ? std::dynamic_pointer_cast<SIPCall>(call->parent_)
+                                             : call;
+                    if (!ok) {
+                        JAMI_ERR("[call:%s] Media ICE negotiation failed",
+                                 call->getCallId().c_str());
+                        call->onFailure(EIO);
+                        return;
+                    }
+                    call->onIceNegoSucceed();
                 }
-                call->onIceNegoSucceed();
-            }
-        });
+            },
+            ScheduledExecutor::Priority::High);
     };
 
     iceOptions.master = master;
@@ -3281,6 +3355,17 @@ SIPCall::initIceMediaTransport(bool master, std::optional<IceTransportOptions> o
     // Each RTP stream requires a pair of ICE components (RTP + RTCP).
     iceOptions.compCountPerStream = ICE_COMP_COUNT_PER_STREAM;
 
+    if (iceMedia->isInitialized()) {
+        // From the pool, the options of the account
+        auto onInitDone = std::move(iceOptions.onInitDone);
+        iceMedia->setCallbacks({}, std::move(iceOptions.onNegoDone));
+        if (master ? iceMedia->setInitiatorSession() : iceMedia->setSlaveSession()) {
+            onInitDone(true);
+            return true;
+        }
+        return false;
+    }
+
     // Init ICE.
     iceMedia->initIceInstance(iceOptions);
 
@@ -3451,10 +3536,51 @@ SIPCall::newIceSocket(unsigned compId)
     return std::unique_ptr<IceSocket> {new IceSocket(getIceMedia(), compId)};
 }
 
+void
+SIPCall::warmUpMedia()
+{
+    auto& manager = Manager::instance();
+    warmUpPlayback_ = manager.startAudioStream(AudioDeviceType::PLAYBACK);
+    if (type_ != CallType::OUTGOING)
+        return;
+
+    warmUpCapture_ = manager.startAudioStream(AudioDeviceType::CAPTURE);
+#ifdef ENABLE_VIDEO
+    for (const auto& stream : rtpStreams_) {
+        const auto& media = *stream.mediaAttribute_;
+        if (media.type_ == MediaType::MEDIA_VIDEO and media.enabled_ and not media.muted_
+            and not media.sourceUri_.empty())
+            // The session of the stream gets the same input, already opened
+            warmUpVideo_.emplace_back(getVideoInput(media.sourceUri_));
+    }
+#endif
+}
+
+void
+SIPCall::releaseWarmUp()
+{
+    warmUpPlayback_.reset();
+    warmUpCapture_.reset();
+#ifdef ENABLE_VIDEO
+    warmUpVideo_.clear();
+#endif
+}
+
 void
 SIPCall::rtpSetupSuccess(MediaType type, bool isRemote)
 {
     std::lock_guard<std::mutex> lk {setupSuccessMutex_};
+    if (isRemote and duration_start_ != time_point::min()) {
+        auto& delay = type == MEDIA_AUDIO ? audioSetupDelay_ : videoSetupDelay_;
+        if (not delay) {
+            delay = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now()
+                                                                          - duration_start_);
+            JAMI_DBG("[call:%s] Remote %s set up %lld ms after the answer",
+                     getCallId().c_str(),
+                     type == MEDIA_AUDIO ? "audio" : "video",
+                     (long long) delay->count());
+        }
+    }
     if (type == MEDIA_AUDIO) {
         if (isRemote)
             mediaReady_.at("a:remote") = true;
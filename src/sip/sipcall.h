@@ -63,6 +63,7 @@ class SIPAccountBase;
 class SipTransport;
 class AudioRtpSession;
 class IceSocket;
+class RepeatedTask;
 
 using IceCandidate = pj_ice_sess_cand;
 
@@ -70,6 +71,10 @@ namespace upnp {
 class Controller;
 }
 
+namespace video {
+class VideoInput;
+}
+
 /**
  * @file sipcall.h
  * @brief SIPCall are SIP implementation of a normal Call
@@ -84,6 +89,8 @@ private:
 
 public:
     static constexpr LinkType LINK_TYPE = LinkType::SIP;
+    // RTP and RTCP
+    static constexpr unsigned ICE_COMP_COUNT_PER_STREAM {2};
 
     struct RtpStream
     {
@@ -175,6 +182,15 @@ public:
 
     void monitor() const override;
 
+    /**
+     * @return statistics of the media streams
+     */
+    std::vector<DRing::MediaStreamStats> getStats() const;
+    /**
+     * Emit CallStats at this interval until the media stop, 0 to stop now
+     */
+    void setStatsInterval(std::chrono::milliseconds interval);
+
     /**
      * Set peer's User-Agent found in the message header
      */
@@ -457,6 +473,9 @@ private:
     // Vector holding the current RTP sessions.
     std::vector<RtpStream> rtpStreams_;
 
+    std::mutex statsMtx_;
+    std::shared_ptr<RepeatedTask> statsTask_;
+
     /**
      * Hold the transport used for SIP communication.
      * Will be different from the account registration transport for
@@ -515,7 +534,26 @@ private:
     void resetMediaReady();
     void detachAudioFromConference();
 
-    std::mutex setupSuccessMutex_;
+    /**
+     * Open the devices of the call before the negotiation ends, for the media to start sooner.
+     * The capture devices are only opened for an outgoing call, placed by the user.
+     */
+    void warmUpMedia();
+    /**
+     * Once the media is started, or when the call ends
+     */
+    void releaseWarmUp();
+
+    std::unique_ptr<AudioDeviceGuard> warmUpPlayback_ {};
+    std::unique_ptr<AudioDeviceGuard> warmUpCapture_ {};
+#ifdef ENABLE_VIDEO
+    std::vector<std::shared_ptr<video::VideoInput>> warmUpVideo_ {};
+#endif
+
+    mutable std::mutex setupSuccessMutex_;
+    // From the answer to the setup of the first remote stream of the type
+    std::optional<std::chrono::milliseconds> audioSetupDelay_ {};
+    std::optional<std::chrono::milliseconds> videoSetupDelay_ {};
 #ifdef ENABLE_VIDEO
     int rotation_ {0};
 #endif
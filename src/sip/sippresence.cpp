@@ -33,11 +33,14 @@
 #include <opendht/crypto.h>
 #include <fmt/core.h>
 
+#include <algorithm>
 #include <thread>
 #include <sstream>
 
 #define MAX_N_SUB_SERVER 50
 #define MAX_N_SUB_CLIENT 50
+// Between two new subscriptions, plus up to as much at random
+#define SUB_INTERVAL_MS 200
 
 namespace jami {
 
@@ -74,6 +77,11 @@ SIPPresence::~SIPPresence()
     // Is the transport usable when the account is being destroyed?
     // for (const auto & c : sub_client_list_)
     //    delete(c);
+    if (sub_timer_.id) {
+        pjsip_endpt_cancel_timer(Manager::instance().sipVoIPLink().getEndpoint(), &sub_timer_);
+        sub_timer_.id = PJ_FALSE;
+    }
+    pending_subs_.clear();
     sub_client_list_.clear();
     sub_server_list_.clear();
 
@@ -215,6 +223,8 @@ SIPPresence::subscribeClient(const std::string& uri, bool flag)
         return;
     */
 
+    std::lock_guard<std::recursive_mutex> lk(mutex_);
+
     /* Check if the buddy was already subscribed */
     for (const auto& c : sub_client_list_) {
         if (c->getURI() == uri) {
@@ -227,19 +237,102 @@ SIPPresence::subscribeClient(const std::string& uri, bool flag)
         }
     }
 
-    if (sub_client_list_.size() >= MAX_N_SUB_CLIENT) {
+    auto pending = std::find(pending_subs_.begin(), pending_subs_.end(), uri);
+    if (not flag) {
+        if (pending != pending_subs_.end())
+            pending_subs_.erase(pending);
+        return;
+    }
+
+    if (list_resources_.find(uri) != list_resources_.end()) {
+        JAMI_DBG("PresSubClient %s is tracked by the list subscription", uri.c_str());
+        return;
+    }
+
+    if (sub_client_list_.size() + pending_subs_.size() >= MAX_N_SUB_CLIENT) {
         JAMI_WARN("Can't add PresSubClient, max number reached.");
         return;
     }
 
-    if (flag) {
-        PresSubClient* c = new PresSubClient(uri, this);
+    if (pending == pending_subs_.end()) {
+        pending_subs_.emplace_back(uri);
+        scheduleSubscription();
+    }
+}
+
+void
+SIPPresence::scheduleSubscription()
+{
+    if (sub_timer_.id or pending_subs_.empty())
+        return;
+
+    pj_timer_entry_init(&sub_timer_, 0, this, &subscribe_timer_cb);
+    pj_time_val delay;
+    delay.sec = 0;
+    delay.msec = SUB_INTERVAL_MS + rand() % SUB_INTERVAL_MS;
+    pj_time_val_normalize(&delay);
+    if (pjsip_endpt_schedule_timer(Manager::instance().sipVoIPLink().getEndpoint(),
+                                   &sub_timer_,
+                                   &delay)
+        == PJ_SUCCESS)
+        sub_timer_.id = PJ_TRUE;
+}
+
+void
+SIPPresence::subscribe_timer_cb(pj_timer_heap_t* /*th*/, pj_timer_entry* entry)
+{
+    auto* pres = static_cast<SIPPresence*>(entry->user_data);
+    std::lock_guard<std::recursive_mutex> lk(pres->mutex_);
+    entry->id = PJ_FALSE;
+    if (pres->pending_subs_.empty())
+        return;
+
+    auto uri = std::move(pres->pending_subs_.front());
+    pres->pending_subs_.pop_front();
+    // Maybe given by the list meanwhile
+    if (pres->list_resources_.find(uri) == pres->list_resources_.end()) {
+        PresSubClient* c = new PresSubClient(uri, pres);
         if (!(c->subscribe())) {
             JAMI_WARN("Failed send subscribe.");
             delete c;
         }
         // the buddy has to be accepted before being added in the list
     }
+    pres->scheduleSubscription();
+}
+
+void
+SIPPresence::subscribeList(const std::string& uri)
+{
+    std::lock_guard<std::recursive_mutex> lk(mutex_);
+    if (list_client_ and list_client_->getURI() == uri) {
+        list_client_->subscribe();
+        return;
+    }
+    // Unsubscribed once destroyed
+    delete list_client_;
+    list_client_ = nullptr;
+    list_resources_.clear();
+    if (uri.empty())
+        return;
+
+    list_client_ = new PresSubClient(uri, this, true);
+    if (not list_client_->subscribe()) {
+        JAMI_WARN("Failed to subscribe to the resource list %s", uri.c_str());
+        delete list_client_;
+        list_client_ = nullptr;
+    }
+}
+
+void
+SIPPresence::addListResource(std::string_view uri)
+{
+    std::lock_guard<std::recursive_mutex> lk(mutex_);
+    if (list_resources_.emplace(uri).second) {
+        auto pending = std::find(pending_subs_.begin(), pending_subs_.end(), uri);
+        if (pending != pending_subs_.end())
+            pending_subs_.erase(pending);
+    }
 }
 
 void
@@ -23,6 +23,8 @@
 
 #include <string>
 #include <list>
+#include <deque>
+#include <set>
 #include <mutex>
 
 #include "noncopyable.h"
@@ -148,10 +150,22 @@ public:
      */
     void reportPresSubClientNotification(std::string_view uri, pjsip_pres_status* status);
     /**
-     * Send a SUBSCRIBE request to PBX/IP2IP
+     * Send a SUBSCRIBE request to PBX/IP2IP.
+     * The new subscriptions are sent one by one, spreading them and their refreshes
+     * over time, unless the buddy is tracked by the list subscription.
      * @param buddyUri  Remote user that we want to subscribe
      */
     void subscribeClient(const std::string& uri, bool flag);
+    /**
+     * Subscribe to a resource list of the PBX (RFC 4662): one subscription gives the
+     * presence of all its buddies.
+     * @param uri   Resource list, empty for none
+     */
+    void subscribeList(const std::string& uri);
+    /**
+     * A buddy whose presence was given by the list subscription
+     */
+    void addListResource(std::string_view uri);
     /**
      * Add a buddy in the buddy list.
      * @param b     PresSubClient pointer
@@ -208,6 +222,12 @@ private:
     static pj_status_t publish(SIPPresence* pres);
     static void publish_cb(struct pjsip_publishc_cbparam* param);
     static pj_status_t send_publish(SIPPresence* pres);
+    static void subscribe_timer_cb(pj_timer_heap_t* th, pj_timer_entry* entry);
+
+    /**
+     * Plan the next subscription waiting, if any
+     */
+    void scheduleSubscription();
 
     pjsip_publishc* publish_sess_;  /**< Client publication session.*/
     pjsip_pres_status status_data_; /**< Presence Data to be published.*/
@@ -222,6 +242,11 @@ private:
     std::list<PresSubServer*> sub_server_list_; /**< Subscribers list.*/
     std::list<PresSubClient*> sub_client_list_; /**< Subcribed buddy list.*/
 
+    PresSubClient* list_client_ {nullptr};                 /**< Resource list subscription */
+    std::set<std::string, std::less<>> list_resources_ {}; /**< Buddies of the list */
+    std::deque<std::string> pending_subs_ {};              /**< Buddies to subscribe */
+    pj_timer_entry sub_timer_ {};                          /**< Next subscription */
+
     std::recursive_mutex mutex_;
     pj_caching_pool cp_;
     pj_pool_t* pool_;
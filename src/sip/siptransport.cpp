@@ -30,6 +30,7 @@
 
 #include "compiler_intrinsics.h"
 #include "sipvoiplink.h"
+#include "manager.h"
 
 #include <pjsip.h>
 #include <pjsip/sip_types.h>
@@ -61,6 +62,10 @@ constexpr const char* TRANSPORT_STATE_STR[] = {"CONNECTED",
                                                "UNKNOWN STATE"};
 constexpr const size_t TRANSPORT_STATE_SZ = std::size(TRANSPORT_STATE_STR);
 
+// Beyond the registration refresh of most servers, sooner than most NAT timeouts
+// the keep-alive of pjsip avoids
+static constexpr std::chrono::minutes TLS_TRANSPORT_IDLE_TIME {5};
+
 void
 SipTransport::deleteTransport(pjsip_transport* t)
 {
@@ -197,6 +202,8 @@ SipTransportBroker::~SipTransportBroker()
 
     udpTransports_.clear();
     transports_.clear();
+    if (purgeTask_)
+        purgeTask_->cancel();
 
     JAMI_DBG("destroying SipTransportBroker@%p", this);
 }
@@ -212,6 +219,8 @@ SipTransportBroker::transportStateChanged(pjsip_transport* tp,
     // and remove it from any mapping if destroy pending or done.
 
     std::shared_ptr<SipTransport> sipTransport;
+    // Released once unlocked, as releasing may destroy a transport
+    std::shared_ptr<SipTransport> unpooled;
     std::lock_guard<std::mutex> lock(transportMapMutex_);
     auto key = transports_.find(tp);
     if (key == transports_.end())
@@ -236,6 +245,17 @@ SipTransportBroker::transportStateChanged(pjsip_transport* tp,
                 udpTransports_.erase(updKey);
         }
     }
+    if (not SipTransport::isAlive(state)) {
+        const auto pooled = std::find_if(tlsTransports_.begin(),
+                                         tlsTransports_.end(),
+                                         [tp](const auto& item) {
+                                             return item.second.transport->get() == tp;
+                                         });
+        if (pooled != tlsTransports_.end()) {
+            unpooled = std::move(pooled->second.transport);
+            tlsTransports_.erase(pooled);
+        }
+    }
 
     // Propagate the event to the appropriate transport
     // Note the SipTransport may not be in our mappings if marked as dead
@@ -269,6 +289,8 @@ SipTransportBroker::addTransport(pjsip_transport* t)
 void
 SipTransportBroker::shutdown()
 {
+    // Released once unlocked
+    decltype(tlsTransports_) pooled;
     std::unique_lock<std::mutex> lock(transportMapMutex_);
     isDestroying_ = true;
     for (auto& t : transports_) {
@@ -276,6 +298,45 @@ SipTransportBroker::shutdown()
             pjsip_transport_shutdown(transport->get());
         }
     }
+    pooled = std::move(tlsTransports_);
+    tlsTransports_.clear();
+}
+
+void
+SipTransportBroker::purgeTlsTransports(std::vector<std::shared_ptr<SipTransport>>& released)
+{
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = tlsTransports_.begin(); it != tlsTransports_.end();) {
+        auto& pooled = it->second;
+        if (pooled.transport.use_count() > 1) {
+            // Idle from when it's not used anymore
+            pooled.lastUse = now;
+            ++it;
+        } else if (now - pooled.lastUse >= TLS_TRANSPORT_IDLE_TIME) {
+            JAMI_DBG("Releasing idle TLS transport@%p", pooled.transport->get());
+            released.emplace_back(std::move(pooled.transport));
+            it = tlsTransports_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+SipTransportBroker::schedulePurge()
+{
+    if (purgeTask_ or tlsTransports_.empty())
+        return;
+    purgeTask_ = Manager::instance().scheduleTaskIn(
+        [this] {
+            // Released once unlocked
+            std::vector<std::shared_ptr<SipTransport>> released;
+            std::lock_guard<std::mutex> lock(transportMapMutex_);
+            purgeTask_.reset();
+            purgeTlsTransports(released);
+            schedulePurge();
+        },
+        TLS_TRANSPORT_IDLE_TIME / 2);
 }
 
 std::shared_ptr<SipTransport>
@@ -367,6 +428,21 @@ SipTransportBroker::getTlsTransport(const std::shared_ptr<TlsListener>& l,
     if (remoteAddr.getPort() == 0)
         remoteAddr.setPort(pjsip_transport_get_default_port_for_type(l->get()->type));
 
+    TlsTransportKey key {l->get(), remoteAddr, remote_name};
+    {
+        std::lock_guard<std::mutex> lock(transportMapMutex_);
+        auto it = tlsTransports_.find(key);
+        if (it != tlsTransports_.end()) {
+            auto& pooled = it->second;
+            const auto* tp = pooled.transport->get();
+            if (not tp->is_shutdown and not tp->is_destroying) {
+                JAMI_DBG("Reusing TLS transport to %s", remoteAddr.toString(true).c_str());
+                pooled.lastUse = std::chrono::steady_clock::now();
+                return pooled.transport;
+            }
+        }
+    }
+
     JAMI_DBG("Get new TLS transport to %s", remoteAddr.toString(true).c_str());
     pjsip_tpselector sel;
     sel.type = PJSIP_TPSELECTOR_LISTENER;
@@ -391,9 +467,19 @@ SipTransportBroker::getTlsTransport(const std::shared_ptr<TlsListener>& l,
     }
     auto ret = std::make_shared<SipTransport>(transport, l);
     pjsip_transport_dec_ref(transport);
+    // Released once unlocked, if replaced
+    std::shared_ptr<SipTransport> replaced;
     {
         std::lock_guard<std::mutex> lock(transportMapMutex_);
         transports_[ret->get()] = ret;
+        if (not isDestroying_) {
+            auto& pooled = tlsTransports_[std::move(key)];
+            if (pooled.transport != ret)
+                replaced = std::move(pooled.transport);
+            pooled.transport = ret;
+            pooled.lastUse = std::chrono::steady_clock::now();
+            schedulePurge();
+        }
     }
     return ret;
 }
@@ -41,6 +41,8 @@
 #include <vector>
 #include <list>
 #include <memory>
+#include <chrono>
+#include <tuple>
 
 // OpenDHT
 namespace dht {
@@ -142,6 +144,7 @@ private:
 
 class IpAddr;
 class IceTransport;
+class Task;
 namespace tls {
 struct TlsParams;
 };
@@ -159,6 +162,10 @@ public:
 
     std::shared_ptr<TlsListener> getTlsListener(const IpAddr&, const pjsip_tls_setting*);
 
+    /**
+     * The connection to the remote is reused while alive, the transport being kept
+     * TLS_TRANSPORT_IDLE_TIME once unused, e.g. for the next registration refresh or call
+     */
     std::shared_ptr<SipTransport> getTlsTransport(const std::shared_ptr<TlsListener>&,
                                                   const IpAddr& remote,
                                                   const std::string& remote_name = {});
@@ -190,6 +197,16 @@ private:
      */
     std::shared_ptr<SipTransport> createUdpTransport(const IpAddr&);
 
+    /**
+     * Release the TLS transports unused for TLS_TRANSPORT_IDLE_TIME
+     * @note transportMapMutex_ must be locked
+     */
+    void purgeTlsTransports(std::vector<std::shared_ptr<SipTransport>>& released);
+    /**
+     * @note transportMapMutex_ must be locked
+     */
+    void schedulePurge();
+
     /**
      * List of transports so we can bubble the events up.
      */
@@ -202,6 +219,18 @@ private:
      */
     std::map<IpAddr, pjsip_transport*> udpTransports_;
 
+    /**
+     * TLS transports by listener (its certificate and settings), remote and server name
+     */
+    using TlsTransportKey = std::tuple<pjsip_tpfactory*, IpAddr, std::string>;
+    struct PooledTransport
+    {
+        std::shared_ptr<SipTransport> transport;
+        std::chrono::steady_clock::time_point lastUse;
+    };
+    std::map<TlsTransportKey, PooledTransport> tlsTransports_;
+    std::shared_ptr<Task> purgeTask_;
+
     pjsip_endpoint* endpt_;
     std::atomic_bool isDestroying_ {false};
 };
@@ -73,6 +73,11 @@ namespace jami {
 
 using sip_utils::CONST_PJ_STR;
 
+static constexpr unsigned MAX_EVENT_THREADS {16};
+// Released pools kept for reuse, up to this total capacity: the pools of the calls (SDP,
+// dialogs, transactions) are recycled instead of going back to the heap at each call
+static constexpr pj_size_t POOL_CACHE_CAPACITY {1024 * 1024};
+
 /**************** EXTERN VARIABLES AND FUNCTIONS (callbacks) **************************/
 
 static pjsip_endpoint* endpt_;
@@ -623,7 +628,7 @@ SIPVoIPLink::SIPVoIPLink()
             throw VoipLinkException(#ret " failed"); \
     } while (0)
 
-    pj_caching_pool_init(&cp_, &pj_pool_factory_default_policy, 0);
+    pj_caching_pool_init(&cp_, &pj_pool_factory_default_policy, POOL_CACHE_CAPACITY);
     pool_.reset(pj_pool_create(&cp_.factory, PACKAGE, 64 * 1024, 4096, nullptr));
     if (!pool_)
         throw VoipLinkException("UserAgent: Could not initialize memory pool");
@@ -734,10 +739,7 @@ SIPVoIPLink::SIPVoIPLink()
     TRY(pjsip_replaces_init_module(endpt_));
 #undef TRY
 
-    sipThread_ = std::thread([this] {
-        while (running_)
-            handleEvents();
-    });
+    setEventThreads(1);
 
     JAMI_DBG("SIPVoIPLink@%p", this);
 }
@@ -759,7 +761,12 @@ SIPVoIPLink::shutdown()
     pjsip_tpmgr_set_state_cb(pjsip_endpt_get_tpmgr(endpt_), nullptr);
 
     running_ = false;
-    sipThread_.join();
+    {
+        std::lock_guard<std::mutex> lk(sipThreadsMtx_);
+        for (auto& thread : sipThreads_)
+            thread.join();
+        sipThreads_.clear();
+    }
     pjsip_endpt_destroy(endpt_);
     pool_.reset();
     pj_caching_pool_destroy(&cp_);
@@ -815,6 +822,32 @@ SIPVoIPLink::handleEvents()
                  sip_utils::sip_strerror(ret).c_str());
 }
 
+void
+SIPVoIPLink::setEventThreads(unsigned count)
+{
+    count = std::clamp(count, 1u, MAX_EVENT_THREADS);
+    std::lock_guard<std::mutex> lk(sipThreadsMtx_);
+    if (count == sipThreads_.size())
+        return;
+    JAMI_DBG("Handling the SIP events with %u thread(s)", count);
+    // The threads past count stop after their current events
+    eventThreads_ = count;
+    while (sipThreads_.size() > count) {
+        sipThreads_.back().join();
+        sipThreads_.pop_back();
+    }
+    while (sipThreads_.size() < count) {
+        sipThreads_.emplace_back([this, index = sipThreads_.size()] {
+            pj_thread_desc desc {};
+            pj_thread_t* thread {nullptr};
+            if (not pj_thread_is_registered())
+                pj_thread_register("sip", desc, &thread);
+            while (running_ and index < eventThreads_)
+                handleEvents();
+        });
+    }
+}
+
 void
 SIPVoIPLink::registerKeepAliveTimer(pj_timer_entry& timer, pj_time_val& delay)
 {
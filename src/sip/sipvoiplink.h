@@ -44,6 +44,7 @@
 #endif
 #include <map>
 #include <mutex>
+#include <vector>
 #include <memory>
 #include <functional>
 #include <thread>
@@ -77,6 +78,14 @@ public:
      */
     void handleEvents();
 
+    /**
+     * Set the number of threads handling the SIP events, 1 by default.
+     * pjsip still handles the events of a dialog one at a time, the dialog being locked,
+     * but the calls progress in parallel.
+     * @note Not to be called from a SIP thread
+     */
+    void setEventThreads(unsigned count);
+
     /**
      * Register a new keepalive registration timer to this endpoint
      */
@@ -163,7 +172,9 @@ private:
     mutable pj_caching_pool cp_;
     std::unique_ptr<pj_pool_t, decltype(pj_pool_release)&> pool_;
     std::atomic_bool running_ {true};
-    std::thread sipThread_;
+    std::mutex sipThreadsMtx_;
+    std::atomic_uint eventThreads_ {0};
+    std::vector<std::thread> sipThreads_;
 
     friend class SIPTest;
 };
@@ -96,6 +96,13 @@ Smartools::setResolution(const std::string& id, int width, int height)
     }
 }
 
+void
+Smartools::setDecodeLatency(const std::string& /*id*/, int64_t latencyUs)
+{
+    std::lock_guard<std::mutex> lk(mutexInfo_);
+    information_["remote decode latency"] = std::to_string(latencyUs / 1000.) + " ms";
+}
+
 void
 Smartools::setRemoteAudioCodec(const std::string& remoteAudioCodec)
 {
@@ -110,6 +117,20 @@ Smartools::setLocalAudioCodec(const std::string& localAudioCodec)
     information_["local audio codec"] = localAudioCodec;
 }
 
+void
+Smartools::setPacketBatching(uint64_t sentPackets,
+                             uint64_t sendCalls,
+                             uint64_t receivedPackets,
+                             uint64_t recvCalls)
+{
+    std::lock_guard<std::mutex> lk(mutexInfo_);
+    if (sendCalls)
+        information_["packets per send"] = std::to_string((double) sentPackets / sendCalls);
+    if (recvCalls)
+        information_["packets per receive"] = std::to_string((double) receivedPackets
+                                                             / recvCalls);
+}
+
 void
 Smartools::setLocalVideoCodec(const std::string& localVideoCodec)
 {
@@ -19,6 +19,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <chrono>
 #include <mutex>
@@ -41,10 +42,15 @@ public:
     void stop();
     void setFrameRate(const std::string& id, const std::string& fps);
     void setResolution(const std::string& id, int width, int height);
+    void setDecodeLatency(const std::string& id, int64_t latencyUs);
     void setLocalVideoCodec(const std::string& localVideoCodec);
     void setRemoteVideoCodec(const std::string& remoteVideoCodec, const std::string& callID);
     void setRemoteAudioCodec(const std::string& remoteAudioCodec);
     void setLocalAudioCodec(const std::string& remoteAudioCodec);
+    void setPacketBatching(uint64_t sentPackets,
+                           uint64_t sendCalls,
+                           uint64_t receivedPackets,
+                           uint64_t recvCalls);
     void sendInfo();
 
 private:
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace jami {
+
+/**
+ * Bounded wait-free queue between one producer thread and one consumer thread,
+ * e.g. to hand frames from an audio callback to a processing thread.
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+    /**
+     * @param capacity  Rounded up to a power of two
+     */
+    explicit SpscQueue(size_t capacity)
+        : slots_(roundUp(capacity))
+        , mask_(slots_.size() - 1)
+    {}
+
+    /**
+     * From the producer. False if the queue is full, @value being left untouched.
+     */
+    bool push(T&& value)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size())
+            return false;
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * From the consumer
+     */
+    std::optional<T> pop()
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return std::nullopt;
+        std::optional<T> value {std::move(slots_[head & mask_])};
+        slots_[head & mask_] = T {};
+        head_.store(head + 1, std::memory_order_release);
+        return value;
+    }
+
+    /**
+     * Approximate from any thread, exact from the consumer when nothing is pushed
+     */
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    NON_COPYABLE(SpscQueue);
+
+    static size_t roundUp(size_t n)
+    {
+        size_t ret = 1;
+        while (ret < n)
+            ret <<= 1;
+        return ret;
+    }
+
+    std::vector<T> slots_;
+    const size_t mask_;
+    // Apart, not to bounce a cache line between the producer and the consumer
+    alignas(64) std::atomic<size_t> head_ {0};
+    alignas(64) std::atomic<size_t> tail_ {0};
+};
+
+} // namespace jami
@@ -88,7 +88,11 @@ to_string(double value)
 std::string
 to_hex_string(uint64_t id)
 {
-    return fmt::format("{:016x}", id);
+    static constexpr char DIGITS[] = "0123456789abcdef";
+    std::string str(16, '0');
+    for (auto it = str.rbegin(); it != str.rend(); ++it, id >>= 4)
+        *it = DIGITS[id & 0xf];
+    return str;
 }
 
 uint64_t
@@ -23,8 +23,246 @@
 
 #include <ciso646> // fix windows compiler bug
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <avrt.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <pthread/qos.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+#endif
+
 namespace jami {
 
+namespace {
+
+constexpr std::size_t ROLES {static_cast<std::size_t>(ThreadRole::VIDEO) + 1};
+constexpr const char* ROLE_NAMES[ROLES] {"default", "audio_io", "audio", "video"};
+// Longest name of a thread on Linux, without the terminating NUL
+constexpr std::size_t MAX_NAME_LEN {15};
+
+/**
+ * "2,3" or "4-7" or "0,4-7"
+ */
+std::vector<unsigned>
+parseCpus(const std::string& list)
+{
+    std::vector<unsigned> cpus;
+    std::istringstream ss(list);
+    for (std::string range; std::getline(ss, range, ',');) {
+        auto dash = range.find('-');
+        try {
+            auto first = std::stoul(range.substr(0, dash));
+            auto last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            for (auto cpu = first; cpu <= last; ++cpu)
+                cpus.emplace_back(cpu);
+        } catch (const std::exception&) {
+            JAMI_WARN("Invalid CPU range in JAMI_THREAD_AFFINITY: %s", range.c_str());
+        }
+    }
+    return cpus;
+}
+
+struct RolePolicies
+{
+    RolePolicies()
+    {
+        policies[static_cast<std::size_t>(ThreadRole::AUDIO_IO)].priority
+            = ThreadRolePolicy::Priority::REALTIME;
+        policies[static_cast<std::size_t>(ThreadRole::AUDIO)].priority
+            = ThreadRolePolicy::Priority::ELEVATED;
+        policies[static_cast<std::size_t>(ThreadRole::VIDEO)].priority
+            = ThreadRolePolicy::Priority::ELEVATED;
+
+        // e.g. "audio_io=2,3 video=4-7"
+        if (auto env = std::getenv("JAMI_THREAD_AFFINITY")) {
+            std::istringstream ss(env);
+            for (std::string entry; ss >> entry;) {
+                auto eq = entry.find('=');
+                auto name = entry.substr(0, eq);
+                auto role = std::find_if(std::begin(ROLE_NAMES),
+                                         std::end(ROLE_NAMES),
+                                         [&](const char* n) { return name == n; });
+                if (eq == std::string::npos or role == std::end(ROLE_NAMES)) {
+                    JAMI_WARN("Invalid entry in JAMI_THREAD_AFFINITY: %s", entry.c_str());
+                    continue;
+                }
+                policies[role - std::begin(ROLE_NAMES)].cpus = parseCpus(entry.substr(eq + 1));
+            }
+        }
+    }
+
+    std::mutex mutex;
+    std::array<ThreadRolePolicy, ROLES> policies;
+};
+
+RolePolicies&
+rolePolicies()
+{
+    static RolePolicies policies;
+    return policies;
+}
+
+void
+setThreadName(const char* name)
+{
+    std::string truncated(name, strnlen(name, MAX_NAME_LEN));
+#ifdef _WIN32
+#ifdef _MSC_VER
+    std::wstring wname(truncated.begin(), truncated.end());
+    SetThreadDescription(GetCurrentThread(), wname.c_str());
+#endif
+#elif defined(__APPLE__)
+    pthread_setname_np(truncated.c_str());
+#else
+    pthread_setname_np(pthread_self(), truncated.c_str());
+#endif
+}
+
+#ifdef _WIN32
+// Registered to MMCSS until the end of the thread
+struct MmcssTask
+{
+    ~MmcssTask()
+    {
+        if (handle)
+            AvRevertMmThreadCharacteristics(handle);
+    }
+    HANDLE handle {nullptr};
+};
+#endif
+
+/**
+ * @return false if the priority is not permitted
+ */
+bool
+setThreadPriority(ThreadRolePolicy::Priority priority)
+{
+    using Priority = ThreadRolePolicy::Priority;
+    if (priority == Priority::NORMAL)
+        return true;
+#ifdef _WIN32
+    if (priority == Priority::REALTIME) {
+        thread_local MmcssTask task;
+        DWORD taskIndex = 0;
+        if (not task.handle)
+            task.handle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+        if (task.handle and AvSetMmThreadPriority(task.handle, AVRT_PRIORITY_HIGH))
+            return true;
+    }
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL)
+           and priority != Priority::REALTIME;
+#elif defined(__APPLE__)
+    return pthread_set_qos_class_self_np(priority == Priority::REALTIME
+                                             ? QOS_CLASS_USER_INTERACTIVE
+                                             : QOS_CLASS_USER_INITIATED,
+                                         0)
+           == 0;
+#else
+    if (priority == Priority::REALTIME) {
+        // Low among the realtime threads: under the audio servers and the kernel ones.
+        // Reset on fork so that the children don't inherit it.
+        sched_param param {};
+        param.sched_priority = 10;
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) == 0)
+            return true;
+        rlimit limit;
+        if (getrlimit(RLIMIT_RTPRIO, &limit) == 0 and limit.rlim_cur > 0
+            and limit.rlim_cur < static_cast<rlim_t>(param.sched_priority)) {
+            param.sched_priority = limit.rlim_cur;
+            if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) == 0)
+                return true;
+        }
+    }
+    // The nice value is per thread on Linux
+    return setpriority(PRIO_PROCESS, syscall(SYS_gettid), -10) == 0
+           and priority != Priority::REALTIME;
+#endif
+}
+
+void
+setThreadAffinity(const std::vector<unsigned>& cpus)
+{
+    if (cpus.empty())
+        return;
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus)
+        if (cpu < sizeof(mask) * 8)
+            mask |= DWORD_PTR(1) << cpu;
+    if (not SetThreadAffinityMask(GetCurrentThread(), mask)) {
+        JAMI_WARN("Unable to set the CPU affinity of the thread: %lu", GetLastError());
+    }
+#elif !defined(__APPLE__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        JAMI_WARN("Unable to set the CPU affinity of the thread: %s", strerror(errno));
+    }
+#endif
+}
+
+} // namespace
+
+void
+setThreadRolePolicy(ThreadRole role, ThreadRolePolicy policy)
+{
+    auto& policies = rolePolicies();
+    std::lock_guard<std::mutex> lk(policies.mutex);
+    policies.policies[static_cast<std::size_t>(role)] = std::move(policy);
+}
+
+ThreadRolePolicy
+getThreadRolePolicy(ThreadRole role)
+{
+    auto& policies = rolePolicies();
+    std::lock_guard<std::mutex> lk(policies.mutex);
+    return policies.policies[static_cast<std::size_t>(role)];
+}
+
+void
+setCurrentThreadRole(ThreadRole role, const char* name)
+{
+    thread_local bool hasRole {false};
+    thread_local ThreadRole currentRole {ThreadRole::DEFAULT};
+    if (hasRole and currentRole == role)
+        return;
+    hasRole = true;
+    currentRole = role;
+
+    setThreadName(name);
+    auto policy = getThreadRolePolicy(role);
+    if (not setThreadPriority(policy.priority)) {
+        // Once per role, not for each of its threads
+        static std::array<std::atomic_bool, ROLES> warned {};
+        if (not warned[static_cast<std::size_t>(role)].exchange(true)) {
+            JAMI_WARN("Unable to raise the priority of the %s threads (%s), running them at a "
+                      "lower one",
+                      ROLE_NAMES[static_cast<std::size_t>(role)],
+                      name);
+        }
+    }
+    setThreadAffinity(policy.cpus);
+}
+
 void
 ThreadLoop::mainloop(std::thread::id& tid,
                      const std::function<bool()> setup,
@@ -32,6 +270,7 @@ ThreadLoop::mainloop(std::thread::id& tid,
                      const std::function<void()> cleanup)
 {
     tid = std::this_thread::get_id();
+    setCurrentThreadRole(role_, name_.c_str());
     try {
         if (setup()) {
             while (state_ == ThreadState::RUNNING)
@@ -50,10 +289,14 @@ ThreadLoop::mainloop(std::thread::id& tid,
 
 ThreadLoop::ThreadLoop(const std::function<bool()>& setup,
                        const std::function<void()>& process,
-                       const std::function<void()>& cleanup)
+                       const std::function<void()>& cleanup,
+                       ThreadRole role,
+                       const char* name)
     : setup_(setup)
     , process_(process)
     , cleanup_(cleanup)
+    , role_(role)
+    , name_(name)
     , thread_()
 {}
 
@@ -27,9 +27,54 @@
 #include <stdexcept>
 #include <condition_variable>
 #include <mutex>
+#include <string>
+#include <vector>
 
 namespace jami {
 
+/**
+ * What a thread does, deciding its scheduling
+ */
+enum class ThreadRole {
+    DEFAULT,
+    AUDIO_IO, // Audio device callbacks, realtime
+    AUDIO,    // Audio capture, decoding and mixing
+    VIDEO,    // Video capture, decoding and mixing
+};
+
+struct ThreadRolePolicy
+{
+    enum class Priority {
+        NORMAL,
+        // Above the other threads: a lower nice value, THREAD_PRIORITY_ABOVE_NORMAL,
+        // QOS_CLASS_USER_INITIATED
+        ELEVATED,
+        // SCHED_FIFO, MMCSS "Pro Audio", QOS_CLASS_USER_INTERACTIVE. ELEVATED if not
+        // permitted, e.g. without RLIMIT_RTPRIO on Linux
+        REALTIME,
+    };
+    Priority priority {Priority::NORMAL};
+    // CPUs the threads may run on, any if empty. Ignored on Apple platforms
+    std::vector<unsigned> cpus {};
+};
+
+/**
+ * Set the policy of a role, applied by the threads taking the role afterwards.
+ * By default AUDIO_IO is REALTIME, AUDIO and VIDEO are ELEVATED, on any CPU.
+ * The CPUs can be set by the environment, e.g.
+ * JAMI_THREAD_AFFINITY="audio_io=2,3 audio=2,3 video=4-7"
+ */
+void setThreadRolePolicy(ThreadRole role, ThreadRolePolicy policy);
+ThreadRolePolicy getThreadRolePolicy(ThreadRole role);
+
+/**
+ * Name the calling thread and apply the policy of the role to it.
+ * Cheap when the thread already has the role, so that it can be called from
+ * the callbacks of the threads of the audio APIs.
+ * @param name  For the debuggers and profilers, truncated to 15 characters
+ */
+void setCurrentThreadRole(ThreadRole role, const char* name);
+
 struct ThreadLoopException : public std::runtime_error
 {
     ThreadLoopException()
@@ -42,9 +87,14 @@ class ThreadLoop
 public:
     enum class ThreadState { READY, RUNNING, STOPPING };
 
+    /**
+     * @param name  Of the thread, see setCurrentThreadRole()
+     */
     ThreadLoop(const std::function<bool()>& setup,
                const std::function<void()>& process,
-               const std::function<void()>& cleanup);
+               const std::function<void()>& cleanup,
+               ThreadRole role = ThreadRole::DEFAULT,
+               const char* name = "jami:loop");
     virtual ~ThreadLoop();
 
     void start();
@@ -67,6 +117,8 @@ private:
     std::function<bool()> setup_;
     std::function<void()> process_;
     std::function<void()> cleanup_;
+    const ThreadRole role_;
+    const std::string name_;
 
     void mainloop(std::thread::id& tid,
                   const std::function<bool()> setup,
@@ -83,8 +135,10 @@ class InterruptedThreadLoop : public ThreadLoop
 public:
     InterruptedThreadLoop(const std::function<bool()>& setup,
                           const std::function<void()>& process,
-                          const std::function<void()>& cleanup)
-        : ThreadLoop::ThreadLoop(setup, process, cleanup)
+                          const std::function<void()>& cleanup,
+                          ThreadRole role = ThreadRole::DEFAULT,
+                          const char* name = "jami:loop")
+        : ThreadLoop::ThreadLoop(setup, process, cleanup, role, name)
     {}
 
     void stop() override;
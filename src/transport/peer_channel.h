@@ -21,19 +21,39 @@
 #include <mutex>
 #include <condition_variable>
 #include <deque>
+#include <memory>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+#include <utility>
 
 namespace jami {
 
+/**
+ * Stream of bytes received by a component, until read.
+ *
+ * Stored in fixed size chunks, used as a ring and never moved, so the data is
+ * copied with memcpy and peek() gives the oldest bytes without copy.
+ * The capacity is bounded: when full, write() waits for the reader, while
+ * append() goes past it for a stream that can't lose data.
+ */
 class PeerChannel
 {
 public:
-    PeerChannel() {}
+    static constexpr std::size_t DEFAULT_CAPACITY {4 * 1024 * 1024};
+
+    explicit PeerChannel(std::size_t capacity = DEFAULT_CAPACITY)
+        : capacity_(capacity)
+    {}
     ~PeerChannel() { stop(); }
     PeerChannel(PeerChannel&& o)
     {
         std::lock_guard<std::mutex> lk(o.mutex_);
-        stream_ = std::move(o.stream_);
+        chunks_ = std::move(o.chunks_);
+        spare_ = std::move(o.spare_);
+        size_ = std::exchange(o.size_, 0);
+        capacity_ = o.capacity_;
         stop_ = o.stop_;
         o.cv_.notify_all();
     }
@@ -42,25 +62,29 @@ public:
     ssize_t wait(Duration timeout, std::error_code& ec)
     {
         std::unique_lock<std::mutex> lk {mutex_};
-        cv_.wait_for(lk, timeout, [this] { return stop_ or not stream_.empty(); });
+        cv_.wait_for(lk, timeout, [this] { return stop_ or size_ != 0; });
         if (stop_) {
             ec = std::make_error_code(std::errc::interrupted);
             return -1;
         }
         ec.clear();
-        return stream_.size();
+        return size_;
     }
 
     ssize_t read(char* output, std::size_t size, std::error_code& ec)
     {
         std::unique_lock<std::mutex> lk {mutex_};
-        cv_.wait(lk, [this] { return stop_ or not stream_.empty(); });
-        if (stream_.size()) {
-            auto toRead = std::min(size, stream_.size());
-            if (toRead) {
-                auto endIt = stream_.begin() + toRead;
-                std::copy(stream_.begin(), endIt, output);
-                stream_.erase(stream_.begin(), endIt);
+        cv_.wait(lk, [this] { return stop_ or size_ != 0; });
+        if (size_) {
+            auto toRead = std::min(size, size_);
+            auto left = toRead;
+            while (left) {
+                auto& chunk = *chunks_.front();
+                auto n = std::min(left, chunk.end - chunk.begin);
+                std::memcpy(output, chunk.data + chunk.begin, n);
+                output += n;
+                left -= n;
+                consumeLocked(n);
             }
             ec.clear();
             return toRead;
@@ -73,17 +97,66 @@ public:
         return -1;
     }
 
-    ssize_t write(const char* data, std::size_t size, std::error_code& ec)
+    /**
+     * Oldest bytes, without copy. They stay valid until consume().
+     * Only for a single reader.
+     * @return data and size, empty if there is nothing to read
+     */
+    std::pair<const char*, std::size_t> peek() const
     {
         std::lock_guard<std::mutex> lk {mutex_};
-        if (stop_) {
-            ec = std::make_error_code(std::errc::broken_pipe);
+        if (size_ == 0)
+            return {nullptr, 0};
+        const auto& chunk = *chunks_.front();
+        return {chunk.data + chunk.begin, chunk.end - chunk.begin};
+    }
+
+    /**
+     * Drop the size oldest bytes, after a peek()
+     */
+    void consume(std::size_t size)
+    {
+        std::lock_guard<std::mutex> lk {mutex_};
+        size = std::min(size, size_);
+        while (size) {
+            auto n = std::min(size, chunks_.front()->end - chunks_.front()->begin);
+            consumeLocked(n);
+            size -= n;
+        }
+    }
+
+    /**
+     * Append data, waiting up to timeout while the channel is full.
+     * An empty channel always accepts data, even bigger than its capacity.
+     */
+    template<typename Duration>
+    ssize_t write(const char* data, std::size_t size, Duration timeout, std::error_code& ec)
+    {
+        std::unique_lock<std::mutex> lk {mutex_};
+        if (not cv_.wait_for(lk, timeout, [&] {
+                return stop_ or size_ == 0 or size_ + size <= capacity_;
+            })) {
+            ec = std::make_error_code(std::errc::no_buffer_space);
             return -1;
         }
-        stream_.insert(stream_.end(), data, data + size);
-        cv_.notify_all();
-        ec.clear();
-        return size;
+        return appendLocked(data, size, ec);
+    }
+
+    ssize_t write(const char* data, std::size_t size, std::error_code& ec)
+    {
+        return write(data, size, std::chrono::milliseconds::zero(), ec);
+    }
+
+    /**
+     * Append data at once, even if the channel is full
+     * @param full  Set if the channel is over its capacity after it
+     */
+    ssize_t append(const char* data, std::size_t size, bool& full, std::error_code& ec)
+    {
+        std::lock_guard<std::mutex> lk {mutex_};
+        auto ret = appendLocked(data, size, ec);
+        full = size_ > capacity_;
+        return ret;
     }
 
     void stop() noexcept
@@ -100,9 +173,60 @@ private:
     PeerChannel& operator=(const PeerChannel& o) = delete;
     PeerChannel& operator=(PeerChannel&& o) = delete;
 
-    std::mutex mutex_ {};
+    struct Chunk
+    {
+        static constexpr std::size_t SIZE {16 * 1024};
+        char data[SIZE];
+        std::size_t begin {0};
+        std::size_t end {0};
+    };
+
+    ssize_t appendLocked(const char* data, std::size_t size, std::error_code& ec)
+    {
+        if (stop_) {
+            ec = std::make_error_code(std::errc::broken_pipe);
+            return -1;
+        }
+        auto left = size;
+        while (left) {
+            if (chunks_.empty() or chunks_.back()->end == Chunk::SIZE)
+                chunks_.emplace_back(spare_ ? std::move(spare_) : std::make_unique<Chunk>());
+            auto& chunk = *chunks_.back();
+            auto n = std::min(left, Chunk::SIZE - chunk.end);
+            std::memcpy(chunk.data + chunk.end, data, n);
+            chunk.end += n;
+            data += n;
+            left -= n;
+        }
+        size_ += size;
+        cv_.notify_all();
+        ec.clear();
+        return size;
+    }
+
+    // n must fit in the first chunk
+    void consumeLocked(std::size_t n)
+    {
+        auto& chunk = *chunks_.front();
+        chunk.begin += n;
+        size_ -= n;
+        if (chunk.begin == chunk.end) {
+            chunk.begin = chunk.end = 0;
+            // Emptied chunks are reused by the next writes
+            if (chunks_.size() > 1) {
+                spare_ = std::move(chunks_.front());
+                chunks_.pop_front();
+            }
+        }
+        cv_.notify_all();
+    }
+
+    mutable std::mutex mutex_ {};
     std::condition_variable cv_ {};
-    std::deque<char> stream_;
+    std::deque<std::unique_ptr<Chunk>> chunks_ {};
+    std::unique_ptr<Chunk> spare_ {};
+    std::size_t size_ {0};
+    std::size_t capacity_ {DEFAULT_CAPACITY};
     bool stop_ {false};
 };
 
@@ -608,19 +608,30 @@ PUPnP::validateIgd(const std::string& location, IXML_Document* doc_container_ptr
 void
 PUPnP::requestMappingAdd(const Mapping& mapping)
 {
-    runOnPUPnPQueue([w = weak(), mapping] {
+    requestMappingsAdd({mapping});
+}
+
+void
+PUPnP::requestMappingsAdd(const std::list<Mapping>& mappings)
+{
+    runOnPUPnPQueue([w = weak(), mappings] {
         if (auto upnpThis = w.lock()) {
             if (not upnpThis->isRunning())
                 return;
-            Mapping mapRes(mapping);
-            if (upnpThis->actionAddPortMapping(mapRes)) {
-                mapRes.setState(MappingState::OPEN);
-                mapRes.setInternalAddress(upnpThis->getHostAddress().toString());
-                upnpThis->processAddMapAction(mapRes);
-            } else {
-                upnpThis->incrementErrorsCounter(mapRes.getIgd());
-                mapRes.setState(MappingState::FAILED);
-                upnpThis->processRequestMappingFailure(mapRes);
+            for (auto const& mapping : mappings) {
+                Mapping mapRes(mapping);
+                // Not sent once the IGD stopped answering, each request
+                // would wait for the timeout.
+                auto const& igd = mapRes.getIgd();
+                if (igd and igd->isValid() and upnpThis->actionAddPortMapping(mapRes)) {
+                    mapRes.setState(MappingState::OPEN);
+                    mapRes.setInternalAddress(upnpThis->getHostAddress().toString());
+                    upnpThis->processAddMapAction(mapRes);
+                } else {
+                    upnpThis->incrementErrorsCounter(igd);
+                    mapRes.setState(MappingState::FAILED);
+                    upnpThis->processRequestMappingFailure(mapRes);
+                }
             }
         }
     });
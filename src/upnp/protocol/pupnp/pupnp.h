@@ -109,6 +109,10 @@ public:
     // Request a new mapping.
     void requestMappingAdd(const Mapping& mapping) override;
 
+    // Request new mappings from a single job, the remaining ones failing at
+    // once if the IGD becomes invalid.
+    void requestMappingsAdd(const std::list<Mapping>& mappings) override;
+
     // Renew an allocated mapping.
     // Not implemented. Currently, UPNP allocations do not have expiration time.
     void requestMappingRenew([[maybe_unused]] const Mapping& mapping) override { assert(false); };
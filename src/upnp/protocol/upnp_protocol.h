@@ -116,6 +116,13 @@ public:
     // Sends a request to add a mapping.
     virtual void requestMappingAdd(const Mapping& map) = 0;
 
+    // Sends the requests to add mappings on the same IGD, in a row.
+    virtual void requestMappingsAdd(const std::list<Mapping>& mappings)
+    {
+        for (auto const& map : mappings)
+            requestMappingAdd(map);
+    }
+
     // Renew an allocated mapping.
     virtual void requestMappingRenew(const Mapping& mapping) = 0;
 
@@ -455,9 +455,17 @@ void
 UPnPContext::requestMapping(const Mapping::sharedPtr_t& map)
 {
     assert(map);
+    requestMappings({map});
+}
+
+void
+UPnPContext::requestMappings(const std::list<Mapping::sharedPtr_t>& maps)
+{
+    if (maps.empty())
+        return;
 
     if (not isValidThread()) {
-        runOnUpnpContextQueue([this, map] { requestMapping(map); });
+        runOnUpnpContextQueue([this, maps] { requestMappings(maps); });
         return;
     }
 
@@ -471,18 +479,22 @@ UPnPContext::requestMapping(const Mapping::sharedPtr_t& map)
         return;
     }
 
-    map->setIgd(igd);
+    std::list<Mapping> requests;
+    for (auto const& map : maps) {
+        map->setIgd(igd);
 
-    JAMI_DBG("Request mapping %s using protocol [%s] IGD [%s]",
-             map->toString().c_str(),
-             igd->getProtocolName(),
-             igd->toString().c_str());
+        JAMI_DBG("Request mapping %s using protocol [%s] IGD [%s]",
+                 map->toString().c_str(),
+                 igd->getProtocolName(),
+                 igd->toString().c_str());
 
-    if (map->getState() != MappingState::IN_PROGRESS)
-        updateMappingState(map, MappingState::IN_PROGRESS);
+        if (map->getState() != MappingState::IN_PROGRESS)
+            updateMappingState(map, MappingState::IN_PROGRESS);
+        requests.emplace_back(*map);
+    }
 
     auto const& protocol = protocolList_.at(igd->getProtocol());
-    protocol->requestMappingAdd(*map);
+    protocol->requestMappingsAdd(requests);
 }
 
 bool
@@ -492,20 +504,27 @@ UPnPContext::provisionNewMappings(PortType type, int portCount)
 
     assert(portCount > 0);
 
+    // Requested at once, rather than one at a time.
+    std::list<Mapping::sharedPtr_t> requestsList;
+    auto ready = isReady();
+
     while (portCount > 0) {
         auto port = getAvailablePortNumber(type);
         if (port > 0) {
             // Found an available port number
             portCount--;
             Mapping map(type, port, port, true);
-            registerMapping(map);
+            if (auto mapPtr = registerMapping(map, false); mapPtr and ready)
+                requestsList.emplace_back(std::move(mapPtr));
         } else {
             // Very unlikely to get here!
             JAMI_ERR("Can not find any available port to provision!");
+            requestMappings(requestsList);
             return false;
         }
     }
 
+    requestMappings(requestsList);
     return true;
 }
 
@@ -680,12 +699,15 @@ UPnPContext::updateMappingList(bool async)
     }
 
     // Prune the mapping list if needed
-    if (protocolList_.at(NatProtocolType::PUPNP)->isReady()) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPrune_ >= MAP_UPDATE_INTERVAL / 2
+        and protocolList_.at(NatProtocolType::PUPNP)->isReady()) {
 #if HAVE_LIBNATPMP
         // Dont perform if NAT-PMP is valid.
         if (not protocolList_.at(NatProtocolType::NAT_PMP)->isReady())
 #endif
         {
+            lastPrune_ = now;
             pruneMappingList();
         }
     }
@@ -860,9 +882,7 @@ UPnPContext::processPendingRequests(const std::shared_ptr<IGD>& igd)
     }
 
     // Process the pending requests.
-    for (auto const& map : requestsList) {
-        requestMapping(map);
-    }
+    requestMappings(requestsList);
 }
 
 void
@@ -1104,7 +1124,7 @@ UPnPContext::onMappingRemoved(const std::shared_ptr<IGD>& igd, const Mapping& ma
 }
 
 Mapping::sharedPtr_t
-UPnPContext::registerMapping(Mapping& map)
+UPnPContext::registerMapping(Mapping& map, bool request)
 {
     if (map.getExternalPort() == 0) {
         JAMI_DBG("Port number not set. Will set a random port number");
@@ -1135,7 +1155,7 @@ UPnPContext::registerMapping(Mapping& map)
     // when a IGD becomes available (in onIgdAdded() method).
     if (not isReady()) {
         JAMI_WARN("No IGD available. Mapping will be requested when an IGD becomes available");
-    } else {
+    } else if (request) {
         requestMapping(mapPtr);
     }
 
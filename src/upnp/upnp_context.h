@@ -146,8 +146,9 @@ private:
      */
     void stopUpnp(bool forceRelease = false);
 
-    // Create and register a new mapping.
-    Mapping::sharedPtr_t registerMapping(Mapping& map);
+    // Create and register a new mapping, requested at once if an IGD is
+    // available and request is true.
+    Mapping::sharedPtr_t registerMapping(Mapping& map, bool request = true);
 
     // Removes the mapping from the list.
     std::map<Mapping::key_t, Mapping::sharedPtr_t>::iterator unregisterMapping(
@@ -157,6 +158,9 @@ private:
     // Perform the request on the provided IGD.
     void requestMapping(const Mapping::sharedPtr_t& map);
 
+    // Perform the requests on the preferred IGD, in a single batch.
+    void requestMappings(const std::list<Mapping::sharedPtr_t>& maps);
+
     // Request a mapping remove from the IGD.
     void requestRemoveMapping(const Mapping::sharedPtr_t& map);
 
@@ -279,6 +283,10 @@ private:
 
     std::shared_ptr<Task> mappingListUpdateTimer_ {};
 
+    // Last time the mapping list was pruned. The pruning queries the whole
+    // list of the IGD, so it's not repeated on each reservation.
+    std::chrono::steady_clock::time_point lastPrune_ {};
+
     // Current preferred IGD. Can be null if there is no valid IGD.
     std::shared_ptr<IGD> preferredIgd_;
 
@@ -24,6 +24,17 @@
 #include <cassert>
 #include "utf8_utils.h"
 
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// Selected at runtime, the baseline being SSE2
+#define UTF8_X86 1
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define UTF8_NEON 1
+#endif
+
 #if defined(_MSC_VER)
 #include <BaseTsd.h>
 using ssize_t = SSIZE_T;
@@ -236,64 +247,341 @@ utf8_validate_c_str(const char* str, ssize_t max_len, const char** end)
         return true;
 }
 
-bool
-utf8_validate(const std::string& str)
+/*
+ * Vectorized validation, from J. Keiser and D. Lemire, "Validating UTF-8 In Less Than One
+ * Instruction Per Byte". Three lookups, by the nibbles of each byte and of the previous one,
+ * give the errors found in each pair of bytes; the third and fourth bytes of the sequences
+ * are checked against the bytes two and three positions before. Blocks of ASCII characters
+ * skip the lookups.
+ *
+ * A NUL is an error too, as for the byte by byte validation. On an error, the validation
+ * goes on byte by byte from the start of the sequence overlapping the block, to find the
+ * first invalid byte.
+ */
+
+// clang-format off
+// Errors found in a pair of bytes
+static constexpr uint8_t TOO_SHORT      {1 << 0}; // 11______ 0_______ or 11______ 11______
+static constexpr uint8_t TOO_LONG       {1 << 1}; // 0_______ 10______
+static constexpr uint8_t OVERLONG_3     {1 << 2}; // 11100000 100_____
+static constexpr uint8_t TOO_LARGE      {1 << 3}; // 11110100 1001____, 11110100 101_____...
+static constexpr uint8_t SURROGATE      {1 << 4}; // 11101101 101_____
+static constexpr uint8_t OVERLONG_2     {1 << 5}; // 1100000_ 10______
+static constexpr uint8_t TOO_LARGE_1000 {1 << 6}; // 11110101 1000____...
+static constexpr uint8_t OVERLONG_4     {1 << 6}; // 11110000 1000____
+static constexpr uint8_t TWO_CONTS      {1 << 7}; // 10______ 10______
+static constexpr uint8_t CARRY {TOO_SHORT | TOO_LONG | TWO_CONTS};
+
+// By the high nibble of the first byte
+static constexpr uint8_t BYTE_1_HIGH[16] {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+// By the low nibble of the first byte
+static constexpr uint8_t BYTE_1_LOW[16] {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+// By the high nibble of the second byte
+static constexpr uint8_t BYTE_2_HIGH[16] {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+// clang-format on
+// Largest bytes not starting a sequence needing the next 3, 2 and 1 bytes
+static constexpr uint8_t INCOMPLETE[3] {0xf0 - 1, 0xe0 - 1, 0xc0 - 1};
+
+/**
+ * Where to go on byte by byte once the blocks before @pos were validated: the lead byte of
+ * the sequence overlapping @pos, if any
+ */
+static size_t
+resume(const char* str, size_t pos)
 {
-    const char* p;
+    for (size_t k = 1; k <= 3 and k <= pos; ++k) {
+        auto c = static_cast<unsigned char>(str[pos - k]);
+        if ((c & 0xc0) == 0x80)
+            continue;
+        size_t len = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+        return len > k ? pos - k : pos;
+    }
+    return pos;
+}
+
+static size_t
+validPrefixScalar(const char* str, size_t len)
+{
+    return fast_validate_len(str, len) - str;
+}
+
+#ifdef UTF8_X86
 
-    p = fast_validate(str.c_str());
+#define UTF8_TARGET(t) __attribute__((target(t)))
 
-    return (*p == '\0');
+UTF8_TARGET("ssse3")
+static size_t
+validPrefixSsse3(const char* str, size_t len)
+{
+    const auto byte1High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH));
+    const auto byte1Low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW));
+    const auto byte2High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH));
+    const auto incomplete = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          INCOMPLETE[0], INCOMPLETE[1], INCOMPLETE[2]);
+    const auto nibble = _mm_set1_epi8(0x0f);
+    const auto zero = _mm_setzero_si128();
+
+    auto prev = zero;
+    auto prevIncomplete = zero;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+        auto error = _mm_cmpeq_epi8(input, zero);
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prevIncomplete);
+            prevIncomplete = zero;
+        } else {
+            auto prev1 = _mm_alignr_epi8(input, prev, 15);
+            auto cases = _mm_and_si128(
+                _mm_and_si128(
+                    _mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                    _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble))),
+                _mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+            auto prev2 = _mm_alignr_epi8(input, prev, 14);
+            auto prev3 = _mm_alignr_epi8(input, prev, 13);
+            // Third and fourth bytes, to be continuations
+            auto must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+                                       _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80)));
+            auto must23x80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+            error = _mm_or_si128(error, _mm_xor_si128(must23x80, cases));
+            prevIncomplete = _mm_subs_epu8(input, incomplete);
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xffff)
+            break;
+        prev = input;
+    }
+    auto pos = resume(str, i);
+    return pos + validPrefixScalar(str + pos, len - pos);
 }
 
-std::string
-utf8_make_valid(const std::string& name)
+UTF8_TARGET("avx2")
+static size_t
+validPrefixAvx2(const char* str, size_t len)
+{
+    const auto byte1High = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH)));
+    const auto byte1Low = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW)));
+    const auto byte2High = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH)));
+    const auto incomplete = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             -1, -1, -1, INCOMPLETE[0], INCOMPLETE[1],
+                                             INCOMPLETE[2]);
+    const auto nibble = _mm256_set1_epi8(0x0f);
+    const auto zero = _mm256_setzero_si256();
+
+    auto prev = zero;
+    auto prevIncomplete = zero;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+        auto error = _mm256_cmpeq_epi8(input, zero);
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prevIncomplete);
+            prevIncomplete = zero;
+        } else {
+            // The end of prev and the start of input, for the bytes before each lane
+            auto shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+            auto prev1 = _mm256_alignr_epi8(input, shifted, 15);
+            auto cases = _mm256_and_si256(
+                _mm256_and_si256(_mm256_shuffle_epi8(byte1High,
+                                                     _mm256_and_si256(_mm256_srli_epi16(prev1, 4),
+                                                                      nibble)),
+                                 _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble))),
+                _mm256_shuffle_epi8(byte2High,
+                                    _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+            auto prev2 = _mm256_alignr_epi8(input, shifted, 14);
+            auto prev3 = _mm256_alignr_epi8(input, shifted, 13);
+            auto must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+                                          _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80)));
+            auto must23x80 = _mm256_and_si256(must23,
+                                              _mm256_set1_epi8(static_cast<char>(0x80)));
+            error = _mm256_or_si256(error, _mm256_xor_si256(must23x80, cases));
+            prevIncomplete = _mm256_subs_epu8(input, incomplete);
+        }
+        if (not _mm256_testz_si256(error, error))
+            break;
+        prev = input;
+    }
+    auto pos = resume(str, i);
+    return pos + validPrefixScalar(str + pos, len - pos);
+}
+
+#elif defined(UTF8_NEON)
+
+static size_t
+validPrefixNeon(const char* str, size_t len)
 {
-    ssize_t remaining_bytes = name.size();
-    ssize_t valid_bytes;
-    const char* remainder = name.c_str();
-    const char* invalid;
-    char* str = NULL;
-    char* pos;
-
-    while (remaining_bytes != 0) {
-        if (utf8_validate_c_str(remainder, remaining_bytes, &invalid))
+    const auto byte1High = vld1q_u8(BYTE_1_HIGH);
+    const auto byte1Low = vld1q_u8(BYTE_1_LOW);
+    const auto byte2High = vld1q_u8(BYTE_2_HIGH);
+    const uint8_t incompleteBytes[16] {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                       0xff, 0xff, 0xff, INCOMPLETE[0], INCOMPLETE[1],
+                                       INCOMPLETE[2]};
+    const auto incomplete = vld1q_u8(incompleteBytes);
+    const auto nibble = vdupq_n_u8(0x0f);
+    const auto zero = vdupq_n_u8(0);
+
+    auto prev = zero;
+    auto prevIncomplete = zero;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        auto input = vld1q_u8(reinterpret_cast<const uint8_t*>(str + i));
+        auto error = vceqq_u8(input, zero);
+        if (vmaxvq_u8(input) < 0x80) {
+            error = vorrq_u8(error, prevIncomplete);
+            prevIncomplete = zero;
+        } else {
+            auto prev1 = vextq_u8(prev, input, 15);
+            auto cases = vandq_u8(vandq_u8(vqtbl1q_u8(byte1High, vshrq_n_u8(prev1, 4)),
+                                           vqtbl1q_u8(byte1Low, vandq_u8(prev1, nibble))),
+                                  vqtbl1q_u8(byte2High, vshrq_n_u8(input, 4)));
+            auto prev2 = vextq_u8(prev, input, 14);
+            auto prev3 = vextq_u8(prev, input, 13);
+            auto must23 = vorrq_u8(vqsubq_u8(prev2, vdupq_n_u8(0xe0 - 0x80)),
+                                   vqsubq_u8(prev3, vdupq_n_u8(0xf0 - 0x80)));
+            auto must23x80 = vandq_u8(must23, vdupq_n_u8(0x80));
+            error = vorrq_u8(error, veorq_u8(must23x80, cases));
+            prevIncomplete = vqsubq_u8(input, incomplete);
+        }
+        if (vmaxvq_u8(error))
             break;
+        prev = input;
+    }
+    auto pos = resume(str, i);
+    return pos + validPrefixScalar(str + pos, len - pos);
+}
 
-        valid_bytes = invalid - remainder;
+#endif
 
-        if (str == NULL)
-            // If every byte is replaced by U+FFFD, max(strlen(string)) == 3 * name.size()
-            str = new char[3 * remaining_bytes];
+struct Validator
+{
+    const char* name;
+    size_t (*validPrefix)(const char*, size_t);
+};
 
-        pos = str;
+static const Validator SCALAR {"scalar", validPrefixScalar};
+static std::atomic_bool forceScalar {false};
 
-        strncpy(pos, remainder, valid_bytes);
-        pos += valid_bytes;
+static const Validator&
+validator()
+{
+    static const Validator selected = [] {
+#ifdef UTF8_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Validator {"avx2", validPrefixAvx2};
+        if (__builtin_cpu_supports("ssse3"))
+            return Validator {"ssse3", validPrefixSsse3};
+#elif defined(UTF8_NEON)
+        return Validator {"neon", validPrefixNeon};
+#endif
+        return SCALAR;
+    }();
+    return forceScalar ? SCALAR : selected;
+}
 
-        /* append U+FFFD REPLACEMENT CHARACTER */
-        pos[0] = '\357';
-        pos[1] = '\277';
-        pos[2] = '\275';
+const char*
+utf8_implementation()
+{
+    return validator().name;
+}
 
-        pos += 3;
+void
+utf8_force_scalar(bool scalar)
+{
+    forceScalar = scalar;
+}
 
-        remaining_bytes -= valid_bytes + 1;
-        remainder = invalid + 1;
-    }
+size_t
+utf8_valid_prefix(std::string_view str)
+{
+    return validator().validPrefix(str.data(), str.size());
+}
 
-    if (str == NULL)
-        return std::string(name);
+bool
+utf8_validate(std::string_view str)
+{
+    return utf8_valid_prefix(str) == str.size();
+}
 
-    strncpy(pos, remainder, remaining_bytes);
-    pos += remaining_bytes;
+/* U+FFFD REPLACEMENT CHARACTER */
+static constexpr std::string_view REPLACEMENT {"\357\277\275"};
 
-    std::string answer(str, pos - str);
-    assert(utf8_validate_c_str(answer.c_str(), -1, NULL));
+/**
+ * Append @str to @out, each invalid byte replaced, from the first one at @valid
+ */
+static void
+appendRepaired(std::string& out, std::string_view str, size_t valid)
+{
+    while (true) {
+        out.append(str.substr(0, valid));
+        if (valid == str.size())
+            break;
+        out.append(REPLACEMENT);
+        str.remove_prefix(valid + 1);
+        valid = utf8_valid_prefix(str);
+    }
+}
 
-    delete[] str;
+std::string
+utf8_make_valid(std::string_view name)
+{
+    auto valid = utf8_valid_prefix(name);
+    if (valid == name.size())
+        return std::string(name);
 
+    std::string answer;
+    answer.reserve(name.size() + REPLACEMENT.size());
+    appendRepaired(answer, name, valid);
+    assert(utf8_validate(answer));
     return answer;
 }
 
+bool
+utf8_make_valid_in_place(std::string& str)
+{
+    auto valid = utf8_valid_prefix(str);
+    if (valid == str.size())
+        return true;
+
+    std::string repaired(str, 0, valid);
+    repaired.reserve(str.size() + REPLACEMENT.size());
+    appendRepaired(repaired, std::string_view(str).substr(valid), 0);
+    str = std::move(repaired);
+    return false;
+}
+
 } // namespace jami
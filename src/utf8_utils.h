@@ -25,13 +25,18 @@
 
 #include <cstdlib>
 #include <string>
+#include <string_view>
 
 namespace jami {
 
 /**
  * utf8_validate:
  *
- * Validates UTF-8 encoded text. @str is the text to validate;
+ * Validates UTF-8 encoded text. @str is the text to validate; a nul byte is
+ * invalid, as for D-Bus.
+ *
+ * Blocks of 16 or 32 bytes are validated at once where SIMD instructions are
+ * available, see utf8_implementation().
  *
  * Returns true if all of @str was valid. Dbus requires valid UTF-8 as input;
  * sip packets should also be encoded in utf8; so data read from a file or the
@@ -41,19 +46,54 @@ namespace jami {
  * Returns: true if the text was valid UTF-8
  */
 
-bool utf8_validate(const std::string& str);
+bool utf8_validate(std::string_view str);
+
+/**
+ * utf8_valid_prefix:
+ *
+ * Returns: the length of the valid UTF-8 text at the start of @str, i.e. the
+ * offset of the first invalid byte, or the size of @str if it is all valid.
+ */
+size_t utf8_valid_prefix(std::string_view str);
 
 /**
  * utf8_make_valid:
- * @name: a pointer to a nul delimited string.
+ * @name: the text to transform.
  *
- * Transforms a unknown c_string into a pretty utf8 encoded std::string.
+ * Transforms an unknown string into a pretty utf8 encoded std::string.
  * Every unreadable or invalid byte will be transformed into U+FFFD
  * (REPLACEMENT CHARACTER).
  *
  * Returns: a valid utf8 string.
  */
-std::string utf8_make_valid(const std::string& name);
+std::string utf8_make_valid(std::string_view name);
+
+/**
+ * utf8_make_valid_in_place:
+ * @str: the text to transform.
+ *
+ * Same as utf8_make_valid(), @str being left untouched, and not copied, when
+ * already valid.
+ *
+ * Returns: true if @str was valid.
+ */
+bool utf8_make_valid_in_place(std::string& str);
+
+/**
+ * utf8_implementation:
+ *
+ * Returns: the name of the validation selected for this CPU: "avx2", "ssse3",
+ * "neon" or "scalar".
+ */
+const char* utf8_implementation();
+
+/**
+ * utf8_force_scalar:
+ *
+ * Validates byte by byte, whatever the CPU, e.g. to compare both validations
+ * in tests.
+ */
+void utf8_force_scalar(bool scalar);
 
 } // namespace jami
 
@@ -18,26 +18,62 @@
  ***************************************************************************/
 
 #include "vcard.h"
+#include "base64.h"
 #include "string_utils.h"
 
 namespace vCard {
 
 namespace utils {
 
+std::string_view
+Field::name() const
+{
+    return key.substr(0, key.find(';'));
+}
+
+bool
+Field::isBase64() const
+{
+    return key.find(Property::BASE64) != std::string_view::npos;
+}
+
+std::vector<uint8_t>
+Field::decode() const
+{
+    return jami::base64::decode(value);
+}
+
+std::optional<Field>
+Parser::next()
+{
+    std::string_view line;
+    while (jami::getline(content_, line)) {
+        const auto dblptPos = line.find(':');
+        if (dblptPos == std::string_view::npos)
+            continue;
+        return Field {line.substr(0, dblptPos), line.substr(dblptPos + 1)};
+    }
+    return std::nullopt;
+}
+
+std::optional<Field>
+find(std::string_view content, std::string_view name)
+{
+    Parser parser(content);
+    while (auto field = parser.next())
+        if (field->name() == name)
+            return field;
+    return std::nullopt;
+}
+
 std::map<std::string, std::string>
 toMap(std::string_view content)
 {
     std::map<std::string, std::string> vCard;
 
-    std::string_view line;
-    while (jami::getline(content, line)) {
-        if (line.size()) {
-            const auto dblptPos = line.find(':');
-            if (dblptPos == std::string::npos)
-                continue;
-            vCard.emplace(line.substr(0, dblptPos), line.substr(dblptPos + 1));
-        }
-    }
+    Parser parser(content);
+    while (auto field = parser.next())
+        vCard.emplace(field->key, field->value);
     return vCard;
 }
 } // namespace utils
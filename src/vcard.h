@@ -18,9 +18,12 @@
  ***************************************************************************/
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <map>
+#include <optional>
+#include <vector>
 
 namespace vCard {
 
@@ -75,6 +78,52 @@ struct Property
 };
 
 namespace utils {
+
+/**
+ * A field of a vCard, viewing the content it was parsed from
+ */
+struct Field
+{
+    std::string_view key;   // name and parameters, e.g. PHOTO;ENCODING=BASE64;TYPE=PNG
+    std::string_view value; // e.g. the base64 representation of the photo
+
+    /**
+     * @return the key without the parameters, e.g. PHOTO
+     */
+    std::string_view name() const;
+    bool isBase64() const;
+    /**
+     * Decode the value of a base64 field, e.g. the photo. Only done when asked, most
+     * consumers only forwarding the base64 representation.
+     */
+    std::vector<uint8_t> decode() const;
+};
+
+/**
+ * Iterate over the fields of a vCard, without copying them: the content must outlive the
+ * parser and the fields.
+ */
+class Parser
+{
+public:
+    explicit Parser(std::string_view content)
+        : content_(content)
+    {}
+
+    /**
+     * @return the next field, std::nullopt at the end of the content
+     */
+    std::optional<Field> next();
+
+private:
+    std::string_view content_;
+};
+
+/**
+ * @return the first field named @name (parameters being ignored), if any
+ */
+std::optional<Field> find(std::string_view content, std::string_view name);
+
 /**
  * Payload to vCard
  * @param content payload
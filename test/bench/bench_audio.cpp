@@ -0,0 +1,126 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "audio/audio_frame_resizer.h"
+#include "audio/resampler.h"
+#include "audio/ringbuffer.h"
+#include "audio/ringbufferpool.h"
+#include "libav_deps.h"
+#include "media_buffer.h"
+#include "ring_types.h"
+
+#include <cmath>
+
+namespace jami {
+namespace bench {
+
+/**
+ * Frame of 20 ms of a 440 Hz tone, the size output by the ring buffers
+ */
+static std::shared_ptr<AudioFrame>
+toneFrame(const AudioFormat& format, int nbSamples = 0)
+{
+    if (nbSamples == 0)
+        nbSamples = format.sample_rate / 50;
+    auto frame = std::make_shared<AudioFrame>(format, nbSamples);
+    auto samples = reinterpret_cast<int16_t*>(frame->pointer()->data[0]);
+    for (int i = 0; i < nbSamples; ++i) {
+        auto v = static_cast<int16_t>(8192 * std::sin(2 * M_PI * 440 * i / format.sample_rate));
+        for (unsigned c = 0; c < format.nb_channels; ++c)
+            samples[i * format.nb_channels + c] = v;
+    }
+    return frame;
+}
+
+static void
+BM_RingBufferPutGet(benchmark::State& state)
+{
+    const auto mode = static_cast<RingBuffer::Mode>(state.range(0));
+    const auto format = AudioFormat::MONO();
+    RingBuffer rb("bench", SIZEBUF, format, mode);
+    rb.createReadOffset("reader");
+    const auto handle = rb.getReadHandle("reader");
+    const auto frame = toneFrame(format);
+    for (auto _ : state) {
+        rb.put(std::shared_ptr<AudioFrame>(frame));
+        benchmark::DoNotOptimize(rb.get(handle));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RingBufferPutGet)
+    ->ArgName("lock_free")
+    ->Arg(static_cast<int>(RingBuffer::Mode::LOCKED))
+    ->Arg(static_cast<int>(RingBuffer::Mode::LOCK_FREE));
+
+/**
+ * Reader of a conference mixing the frames of its participants
+ */
+static void
+BM_RingBufferPoolGetDataMix(benchmark::State& state)
+{
+    RingBufferPool pool;
+    const auto format = pool.getInternalAudioFormat();
+    const auto frame = toneFrame(format);
+    std::vector<std::shared_ptr<RingBuffer>> participants;
+    for (int i = 0; i < state.range(0); ++i) {
+        participants.emplace_back(pool.createRingBuffer("participant" + std::to_string(i)));
+        pool.bindHalfDuplexOut("reader", participants.back()->getId());
+    }
+    const auto handle = pool.getBindingHandle("reader");
+    for (auto _ : state) {
+        for (const auto& rb : participants)
+            rb->put(std::shared_ptr<AudioFrame>(frame));
+        benchmark::DoNotOptimize(pool.getData(handle));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RingBufferPoolGetDataMix)->ArgName("participants")->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+static void
+BM_Resample(benchmark::State& state)
+{
+    const AudioFormat in(state.range(0), 1);
+    const AudioFormat out(48000, 2);
+    const auto frame = toneFrame(in);
+    Resampler resampler;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(resampler.resample(std::shared_ptr<AudioFrame>(frame), out));
+    state.SetItemsProcessed(state.iterations() * frame->getFrameSize());
+}
+BENCHMARK(BM_Resample)->ArgName("rate")->Arg(16000)->Arg(44100)->Arg(48000);
+
+/**
+ * Frames of the capture period (10 ms) regrouped in frames of the encoder (20 ms)
+ */
+static void
+BM_AudioFrameResizer(benchmark::State& state)
+{
+    const auto format = AudioFormat::STEREO();
+    const auto frame = toneFrame(format, format.sample_rate / 100);
+    AudioFrameResizer resizer(format, format.sample_rate / 50);
+    for (auto _ : state) {
+        resizer.enqueue(std::shared_ptr<AudioFrame>(frame));
+        benchmark::DoNotOptimize(resizer.dequeue());
+    }
+    state.SetItemsProcessed(state.iterations() * frame->getFrameSize());
+}
+BENCHMARK(BM_AudioFrameResizer);
+
+} // namespace bench
+} // namespace jami
@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bench_common.h"
+
+#include "account_const.h"
+#include "configurationmanager_interface.h"
+#include "jami.h"
+#include "manager.h"
+#include "jamidht/connectionmanager.h"
+#include "jamidht/jamiaccount.h"
+#include "jamidht/multiplexed_socket.h"
+
+#include <atomic>
+#include <set>
+
+namespace jami {
+namespace bench {
+
+static std::map<std::string, std::string>
+loopbackAccountDetails(const std::string& name)
+{
+    auto details = DRing::getAccountTemplate("RING");
+    details[DRing::Account::ConfProperties::ALIAS] = name;
+    details[DRing::Account::ConfProperties::DISPLAYNAME] = name;
+    details[DRing::Account::ConfProperties::ARCHIVE_PASSWORD] = "";
+    // Reachable on the loopback only, without a server
+    details[DRing::Account::ConfProperties::UPNP_ENABLED] = "false";
+    details[DRing::Account::ConfProperties::TURN::ENABLED] = "false";
+    details[DRing::Account::ConfProperties::PROXY_ENABLED] = "false";
+    details[DRing::Account::ConfProperties::DHT_PEER_DISCOVERY] = "true";
+    details[DRing::Account::ConfProperties::ACCOUNT_PEER_DISCOVERY] = "true";
+    details[DRing::Account::ConfProperties::ACCOUNT_PUBLISH] = "true";
+    return details;
+}
+
+bool
+LoopbackAccounts::start(std::chrono::seconds timeout)
+{
+    std::set<std::string> announced;
+    std::map<std::string, std::shared_ptr<DRing::CallbackWrapperBase>> confHandlers;
+    confHandlers.insert(
+        DRing::exportable_callback<DRing::ConfigurationSignal::VolatileDetailsChanged>(
+            [&](const std::string& accountId, const std::map<std::string, std::string>& details) {
+                auto it = details.find(DRing::Account::VolatileProperties::DEVICE_ANNOUNCED);
+                if (it == details.end() or it->second != "true")
+                    return;
+                std::lock_guard<std::mutex> lk(mtx_);
+                announced.emplace(accountId);
+                cv_.notify_all();
+            }));
+    DRing::registerSignalHandlers(confHandlers);
+
+    aliceId_ = Manager::instance().addAccount(loopbackAccountDetails("alice"));
+    bobId_ = Manager::instance().addAccount(loopbackAccountDetails("bob"));
+
+    std::unique_lock<std::mutex> lk(mtx_);
+    auto ok = cv_.wait_for(lk, timeout, [&] {
+        return announced.count(aliceId_) and announced.count(bobId_);
+    });
+    lk.unlock();
+    DRing::unregisterSignalHandlers();
+    if (not ok)
+        return false;
+
+    for (const auto& account : {alice(), bob()}) {
+        account->connectionManager().onICERequest([](const DeviceId&) { return true; });
+        account->connectionManager().onChannelRequest(
+            [](const std::shared_ptr<dht::crypto::Certificate>&, const std::string&) {
+                return true;
+            });
+    }
+    bob()->connectionManager().onConnectionReady(
+        [this](const DeviceId&, const std::string& name, std::shared_ptr<ChannelSocket> socket) {
+            if (not socket)
+                return;
+            std::lock_guard<std::mutex> lk(mtx_);
+            accepted_[name] = std::move(socket);
+            cv_.notify_all();
+        });
+    return true;
+}
+
+void
+LoopbackAccounts::stop()
+{
+    std::atomic_bool removed {false};
+    auto target = Manager::instance().getAccountList().size() - 2;
+    std::map<std::string, std::shared_ptr<DRing::CallbackWrapperBase>> confHandlers;
+    confHandlers.insert(DRing::exportable_callback<DRing::ConfigurationSignal::AccountsChanged>([&] {
+        if (Manager::instance().getAccountList().size() <= target) {
+            std::lock_guard<std::mutex> lk(mtx_);
+            removed = true;
+            cv_.notify_all();
+        }
+    }));
+    DRing::registerSignalHandlers(confHandlers);
+    Manager::instance().removeAccount(aliceId_, true);
+    Manager::instance().removeAccount(bobId_, true);
+    std::unique_lock<std::mutex> lk(mtx_);
+    cv_.wait_for(lk, std::chrono::seconds(30), [&] { return removed.load(); });
+    lk.unlock();
+    DRing::unregisterSignalHandlers();
+    accepted_.clear();
+}
+
+std::shared_ptr<JamiAccount>
+LoopbackAccounts::alice() const
+{
+    return Manager::instance().getAccount<JamiAccount>(aliceId_);
+}
+
+std::shared_ptr<JamiAccount>
+LoopbackAccounts::bob() const
+{
+    return Manager::instance().getAccount<JamiAccount>(bobId_);
+}
+
+std::pair<std::shared_ptr<ChannelSocket>, std::shared_ptr<ChannelSocket>>
+LoopbackAccounts::connect(const std::string& name, std::chrono::seconds timeout, bool newSocket)
+{
+    struct Pending
+    {
+        bool done {false};
+        std::shared_ptr<ChannelSocket> socket;
+    };
+    // The callback may be called after a timeout
+    auto pending = std::make_shared<Pending>();
+    alice()->connectionManager().connectDevice(DeviceId(std::string(bob()->currentDeviceId())),
+                                               name,
+                                               [this, pending](std::shared_ptr<ChannelSocket> socket,
+                                                               const DeviceId&) {
+                                                   std::lock_guard<std::mutex> lk(mtx_);
+                                                   pending->socket = std::move(socket);
+                                                   pending->done = true;
+                                                   cv_.notify_all();
+                                               },
+                                               false,
+                                               newSocket);
+
+    std::unique_lock<std::mutex> lk(mtx_);
+    if (not cv_.wait_for(lk, timeout, [&] {
+            return pending->done and (not pending->socket or accepted_.count(name));
+        })
+        or not pending->socket)
+        return {};
+    auto it = accepted_.find(name);
+    auto bobSocket = std::move(it->second);
+    accepted_.erase(it);
+    return {std::move(pending->socket), std::move(bobSocket)};
+}
+
+} // namespace bench
+} // namespace jami
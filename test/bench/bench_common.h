@@ -0,0 +1,76 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace jami {
+
+class JamiAccount;
+class ChannelSocket;
+
+namespace bench {
+
+/**
+ * Two accounts of the daemon, alice and bob, reaching each other on the loopback
+ * as in the unit tests of the connection manager. Every ICE and channel request
+ * between them is accepted.
+ * @note The daemon must be started, and the accounts removed before it is stopped
+ */
+class LoopbackAccounts
+{
+public:
+    /**
+     * Create the accounts
+     * @return false if they were not announced before the timeout
+     */
+    bool start(std::chrono::seconds timeout = std::chrono::seconds(60));
+    void stop();
+
+    std::shared_ptr<JamiAccount> alice() const;
+    std::shared_ptr<JamiAccount> bob() const;
+
+    /**
+     * Open a channel from alice to bob
+     * @param name          Of the channel, not used by another pending one
+     * @param newSocket     To negotiate a new connection (ICE and TLS) for it
+     * @return the sockets of alice and bob, null on timeout
+     */
+    std::pair<std::shared_ptr<ChannelSocket>, std::shared_ptr<ChannelSocket>> connect(
+        const std::string& name,
+        std::chrono::seconds timeout = std::chrono::seconds(30),
+        bool newSocket = false);
+
+private:
+    std::string aliceId_;
+    std::string bobId_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    // Sockets of bob, by channel name, until taken by connect()
+    std::map<std::string, std::shared_ptr<ChannelSocket>> accepted_;
+};
+
+} // namespace bench
+} // namespace jami
@@ -0,0 +1,318 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks of the ConnectionManager and of the channels of a MultiplexedSocket,
+ * between alice and bob over ICE on the loopback. Both ends run in this process,
+ * so the CPU time reported covers the sender and the receiver.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "bench_common.h"
+
+#include "jami.h"
+#include "manager.h"
+#include "jamidht/connectionmanager.h"
+#include "jamidht/jamiaccount.h"
+#include "jamidht/multiplexed_socket.h"
+
+#include <fmt/core.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+namespace jami {
+namespace bench {
+
+static LoopbackAccounts accounts;
+static std::atomic_uint channelCount {0};
+
+// Written per iteration of BM_ChannelThroughput, among its channels
+static constexpr std::size_t BYTES_PER_ITERATION {16 * 1024 * 1024};
+static constexpr double GB {1024. * 1024. * 1024.};
+
+static std::string
+channelName()
+{
+    return fmt::format("bench://{}", channelCount++);
+}
+
+static double
+percentile(std::vector<double> samples, double p)
+{
+    if (samples.empty())
+        return 0;
+    std::sort(samples.begin(), samples.end());
+    auto idx = std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()));
+    return samples[idx];
+}
+
+/**
+ * @return user and system CPU time of the process, in seconds
+ */
+static double
+cpuTime()
+{
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+           + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Bytes received by one end of channels, waited for by the other
+ */
+struct Sink
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::size_t received {0};
+
+    void attach(const std::shared_ptr<ChannelSocket>& socket)
+    {
+        socket->setOnRecv([this](const uint8_t*, std::size_t len) {
+            std::lock_guard<std::mutex> lk(mtx);
+            received += len;
+            cv.notify_all();
+            return len;
+        });
+    }
+
+    bool waitFor(std::size_t bytes, std::chrono::seconds timeout = 60s)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        return cv.wait_for(lk, timeout, [&] { return received >= bytes; });
+    }
+};
+
+/**
+ * A new connection per iteration: ICE negotiation, TLS handshake and first channel.
+ * The difference with BM_OpenChannel is the cost of the connection itself.
+ */
+static void
+BM_ConnectDevice(benchmark::State& state)
+{
+    auto alice = accounts.alice();
+    auto bobUri = accounts.bob()->getUsername();
+    std::vector<double> samples;
+    for (auto _ : state) {
+        auto start = clock_type::now();
+        auto [aliceSocket, bobSocket] = accounts.connect(channelName(), 30s, true);
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+        if (not aliceSocket) {
+            state.SkipWithError("Couldn't connect");
+            break;
+        }
+        state.SetIterationTime(elapsed.count());
+        samples.emplace_back(elapsed.count() * 1e3);
+        alice->connectionManager().closeConnectionsWith(bobUri);
+    }
+    state.counters["p50_ms"] = percentile(samples, .5);
+    state.counters["p99_ms"] = percentile(samples, .99);
+}
+BENCHMARK(BM_ConnectDevice)->Iterations(100)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+/**
+ * A new channel per iteration, on an established connection
+ */
+static void
+BM_OpenChannel(benchmark::State& state)
+{
+    // Keeps the connection open
+    auto [warmAlice, warmBob] = accounts.connect(channelName());
+    if (not warmAlice) {
+        state.SkipWithError("Couldn't connect");
+        return;
+    }
+    std::vector<double> samples;
+    for (auto _ : state) {
+        auto start = clock_type::now();
+        auto [aliceSocket, bobSocket] = accounts.connect(channelName());
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+        if (not aliceSocket) {
+            state.SkipWithError("Couldn't open a channel");
+            break;
+        }
+        state.SetIterationTime(elapsed.count());
+        samples.emplace_back(elapsed.count() * 1e3);
+        aliceSocket->shutdown();
+    }
+    warmAlice->shutdown();
+    state.counters["p50_ms"] = percentile(samples, .5);
+    state.counters["p99_ms"] = percentile(samples, .99);
+}
+BENCHMARK(BM_OpenChannel)->Iterations(200)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+/**
+ * Bulk transfer from alice to bob, split among channels of the same connection
+ * @param payload   Bytes per write
+ * @param channels  Written concurrently, one thread each
+ */
+static void
+BM_ChannelThroughput(benchmark::State& state)
+{
+    const std::size_t payload = state.range(0);
+    const std::size_t channels = state.range(1);
+    const std::vector<uint8_t> data(payload, 'j');
+    const std::size_t writesPerChannel = BYTES_PER_ITERATION / channels / payload;
+    const std::size_t bytesPerIteration = writesPerChannel * payload * channels;
+
+    Sink sink;
+    std::vector<std::shared_ptr<ChannelSocket>> senders, receivers;
+    for (std::size_t i = 0; i < channels; ++i) {
+        auto [aliceSocket, bobSocket] = accounts.connect(channelName());
+        if (not aliceSocket) {
+            state.SkipWithError("Couldn't open a channel");
+            return;
+        }
+        sink.attach(bobSocket);
+        senders.emplace_back(std::move(aliceSocket));
+        receivers.emplace_back(std::move(bobSocket));
+    }
+
+    std::size_t expected = 0;
+    auto cpuStart = cpuTime();
+    for (auto _ : state) {
+        auto start = clock_type::now();
+        expected += bytesPerIteration;
+        std::atomic_bool failed {false};
+        std::vector<std::thread> writers;
+        for (const auto& socket : senders)
+            writers.emplace_back([&, socket] {
+                std::error_code ec;
+                for (std::size_t i = 0; i < writesPerChannel and not ec; ++i)
+                    socket->write(data.data(), data.size(), ec);
+                if (ec)
+                    failed = true;
+            });
+        for (auto& writer : writers)
+            writer.join();
+        if (failed or not sink.waitFor(expected)) {
+            state.SkipWithError("Couldn't transfer");
+            break;
+        }
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+        state.SetIterationTime(elapsed.count());
+    }
+    auto cpu = cpuTime() - cpuStart;
+
+    for (const auto& socket : senders)
+        socket->shutdown();
+    // Before the sink they write to
+    for (const auto& socket : receivers)
+        socket->setOnRecv({});
+    state.SetBytesProcessed(expected);
+    if (expected)
+        state.counters["cpu_s_per_GB"] = cpu / (expected / GB);
+}
+BENCHMARK(BM_ChannelThroughput)
+    ->ArgNames({"payload", "channels"})
+    ->Args({1280, 1})
+    ->Args({16384, 1})
+    ->Args({65535, 1})
+    ->Args({16384, 4})
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Small message of alice echoed by bob, from his receive callback: this also
+ * checks that a channel can be written from the event loop of its socket
+ * @param payload   Bytes per message
+ */
+static void
+BM_ChannelRoundTrip(benchmark::State& state)
+{
+    const std::vector<uint8_t> data(state.range(0), 'j');
+    auto [aliceSocket, bobSocket] = accounts.connect(channelName());
+    if (not aliceSocket) {
+        state.SkipWithError("Couldn't open a channel");
+        return;
+    }
+    bobSocket->setOnRecv([w = std::weak_ptr<ChannelSocket>(bobSocket)](const uint8_t* buf,
+                                                                        std::size_t len) {
+        if (auto socket = w.lock()) {
+            std::error_code ec;
+            socket->write(buf, len, ec);
+        }
+        return len;
+    });
+    Sink sink;
+    sink.attach(aliceSocket);
+
+    std::vector<double> samples;
+    std::size_t expected = 0;
+    for (auto _ : state) {
+        auto start = clock_type::now();
+        std::error_code ec;
+        aliceSocket->write(data.data(), data.size(), ec);
+        expected += data.size();
+        if (ec or not sink.waitFor(expected, 10s)) {
+            state.SkipWithError("No echo");
+            break;
+        }
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+        state.SetIterationTime(elapsed.count());
+        samples.emplace_back(elapsed.count() * 1e6);
+    }
+    aliceSocket->shutdown();
+    aliceSocket->setOnRecv({});
+    state.counters["p50_us"] = percentile(samples, .5);
+    state.counters["p99_us"] = percentile(samples, .99);
+}
+BENCHMARK(BM_ChannelRoundTrip)
+    ->ArgName("payload")
+    ->Arg(16)
+    ->Arg(256)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace bench
+} // namespace jami
+
+int
+main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    if (not DRing::init(DRing::InitFlag(0)) or not DRing::start())
+        return 1;
+
+    auto ret = 0;
+    if (jami::bench::accounts.start()) {
+        benchmark::RunSpecifiedBenchmarks();
+    } else {
+        std::cerr << "Accounts not announced" << std::endl;
+        ret = 1;
+    }
+    jami::bench::accounts.stop();
+    DRing::fini();
+    return ret;
+}
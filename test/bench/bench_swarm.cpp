@@ -0,0 +1,368 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks of the swarms on synthetic conversations of alice (members x
+ * messages x file interactions), cloned and fetched by bob over a GitServer on
+ * the loopback. The conversations are made once per size, then kept for the
+ * whole run.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "bench_common.h"
+
+#include "jami.h"
+#include "manager.h"
+#include "jamidht/conversationrepository.h"
+#include "jamidht/gitserver.h"
+#include "jamidht/jamiaccount.h"
+#include "jamidht/multiplexed_socket.h"
+
+#include <fmt/core.h>
+#include <json/json.h>
+#include <opendht/infohash.h>
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <tuple>
+
+namespace jami {
+namespace bench {
+
+static LoopbackAccounts accounts;
+
+// Messages committed at once while making a conversation
+static constexpr std::size_t COMMIT_BATCH {256};
+// Messages loaded per page, as by the clients
+static constexpr unsigned PAGE_SIZE {50};
+
+struct SyntheticSwarm
+{
+    std::unique_ptr<ConversationRepository> repository;
+    std::string middle; // commit in the middle of the history
+    std::shared_ptr<ChannelSocket> aliceSocket;
+    std::shared_ptr<ChannelSocket> bobSocket;
+    std::unique_ptr<GitServer> server; // of alice, over aliceSocket
+    std::unique_ptr<ConversationRepository> clone; // of bob
+};
+
+// By members, messages, file interactions and if the benchmark writes in it
+using SwarmSize = std::tuple<int64_t, int64_t, int64_t, bool>;
+static std::map<SwarmSize, SyntheticSwarm> swarms;
+
+static std::string
+toJson(const Json::Value& value)
+{
+    Json::StreamWriterBuilder wbuilder;
+    wbuilder["commentStyle"] = "None";
+    wbuilder["indentation"] = "";
+    return Json::writeString(wbuilder, value);
+}
+
+static std::string
+textMessage(std::size_t i)
+{
+    Json::Value json;
+    json["type"] = "text/plain";
+    // One message out of 100 is found by BM_SwarmSearch
+    json["body"] = fmt::format("message {}{}", i, i % 100 == 0 ? " needle" : "");
+    return toJson(json);
+}
+
+static std::string
+fileInteraction(std::size_t i)
+{
+    Json::Value json;
+    json["type"] = "application/data-transfer+json";
+    json["tid"] = std::to_string(i + 1);
+    json["displayName"] = fmt::format("file{}.bin", i);
+    json["totalSize"] = std::to_string(1024 * 1024);
+    json["sha3sum"] = dht::InfoHash::get(std::to_string(i)).toString();
+    return toJson(json);
+}
+
+/**
+ * @return the conversation of this size, made on the first call, null on failure
+ */
+static SyntheticSwarm*
+syntheticSwarm(int64_t members, int64_t messages, int64_t files, bool scratch = false)
+{
+    SwarmSize size {members, messages, files, scratch};
+    auto it = swarms.find(size);
+    if (it != swarms.end())
+        return &it->second;
+
+    auto alice = accounts.alice();
+    SyntheticSwarm swarm;
+    swarm.repository = ConversationRepository::createConversation(alice->weak());
+    if (not swarm.repository)
+        return nullptr;
+    // Invited, as the other members have no certificate
+    for (int64_t i = 0; i < members; ++i)
+        swarm.repository->addMember(dht::InfoHash::get(fmt::format("member{}", i)).toString());
+
+    // The file interactions are spread among the messages
+    std::vector<std::string> bodies;
+    auto total = static_cast<std::size_t>(messages + files);
+    auto fileEvery = files ? total / files : 0;
+    std::size_t text = 0, file = 0;
+    for (std::size_t i = 0; i < total; ++i) {
+        if (fileEvery and i % fileEvery == fileEvery - 1 and file < static_cast<std::size_t>(files))
+            bodies.emplace_back(fileInteraction(file++));
+        else
+            bodies.emplace_back(textMessage(text++));
+        if (bodies.size() == COMMIT_BATCH or i + 1 == total) {
+            auto commits = swarm.repository->commitMessages(bodies);
+            if (commits.empty() or commits.back().empty())
+                return nullptr;
+            if (swarm.middle.empty() and i + 1 >= total / 2)
+                swarm.middle = commits.back();
+            bodies.clear();
+        }
+    }
+
+    auto [aliceSocket, bobSocket] = accounts.connect(
+        fmt::format("git://{}/{}", accounts.bob()->currentDeviceId(), swarm.repository->id()));
+    if (not aliceSocket)
+        return nullptr;
+    auto aliceDevice = DeviceId(std::string(alice->currentDeviceId()));
+    accounts.bob()->addGitSocket(aliceDevice, swarm.repository->id(), bobSocket);
+    swarm.server = std::make_unique<GitServer>(alice->getAccountID(),
+                                               swarm.repository->id(),
+                                               aliceSocket);
+    swarm.aliceSocket = std::move(aliceSocket);
+    swarm.bobSocket = std::move(bobSocket);
+    return &swarms.emplace(size, std::move(swarm)).first->second;
+}
+
+static SyntheticSwarm*
+syntheticSwarm(benchmark::State& state)
+{
+    auto swarm = syntheticSwarm(state.range(0), state.range(1), state.range(2));
+    if (not swarm)
+        state.SkipWithError("Couldn't make the conversation");
+    return swarm;
+}
+
+static void
+SwarmSizes(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"members", "messages", "files"});
+    for (int64_t messages : {100, 1000, 10000})
+        b->Args({2, messages, messages / 10});
+    b->Args({32, 1000, 100});
+    b->Unit(benchmark::kMillisecond);
+}
+
+/**
+ * One page of messages, from the middle of the history
+ */
+static void
+BM_SwarmLogPage(benchmark::State& state)
+{
+    auto swarm = syntheticSwarm(state);
+    if (not swarm)
+        return;
+    for (auto _ : state) {
+        auto commits = swarm->repository->logN(swarm->middle, PAGE_SIZE);
+        benchmark::DoNotOptimize(commits);
+    }
+}
+BENCHMARK(BM_SwarmLogPage)->Apply(SwarmSizes);
+
+/**
+ * The whole history, page after page
+ */
+static void
+BM_SwarmLogPages(benchmark::State& state)
+{
+    auto swarm = syntheticSwarm(state);
+    if (not swarm)
+        return;
+    std::size_t loaded = 0;
+    for (auto _ : state) {
+        std::string from;
+        while (true) {
+            // From the oldest commit of the previous page, included
+            auto skip = from.empty() ? 0u : 1u;
+            auto commits = swarm->repository->logN(from, PAGE_SIZE + skip);
+            if (commits.size() <= skip)
+                break;
+            loaded += commits.size() - skip;
+            if (commits.back().parents.empty())
+                break;
+            from = commits.back().id;
+        }
+    }
+    state.SetItemsProcessed(loaded);
+}
+BENCHMARK(BM_SwarmLogPages)->Apply(SwarmSizes);
+
+/**
+ * Validation of the whole history, as after a clone
+ */
+static void
+BM_SwarmValidCommits(benchmark::State& state)
+{
+    auto swarm = syntheticSwarm(state);
+    if (not swarm)
+        return;
+    for (auto _ : state) {
+        if (not swarm->repository->validClone()) {
+            state.SkipWithError("Invalid history");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(1) + state.range(2)));
+}
+BENCHMARK(BM_SwarmValidCommits)->Apply(SwarmSizes);
+
+static void
+BM_SwarmSearch(benchmark::State& state)
+{
+    auto swarm = syntheticSwarm(state);
+    if (not swarm)
+        return;
+    Filter filter;
+    filter.regexSearch = "needle";
+    filter.type = "text/plain";
+    for (auto _ : state) {
+        auto found = swarm->repository->search(filter);
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(1) + state.range(2)));
+}
+BENCHMARK(BM_SwarmSearch)->Apply(SwarmSizes);
+
+/**
+ * Clone of bob over the GitServer of alice, without the validation
+ */
+static void
+BM_SwarmClone(benchmark::State& state)
+{
+    auto swarm = syntheticSwarm(state);
+    if (not swarm)
+        return;
+    auto bob = accounts.bob();
+    auto aliceDevice = std::string(accounts.alice()->currentDeviceId());
+    for (auto _ : state) {
+        auto clone = ConversationRepository::cloneConversation(bob->weak(),
+                                                               aliceDevice,
+                                                               swarm->repository->id());
+        state.PauseTiming();
+        if (not clone) {
+            state.SkipWithError("Couldn't clone");
+            state.ResumeTiming();
+            break;
+        }
+        clone->erase();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_SwarmClone)->Apply(SwarmSizes)->UseRealTime();
+
+/**
+ * New messages of alice fetched by bob, who wrote one meanwhile, then validated
+ * and merged as by Conversation::Impl::mergeHistory()
+ * @param new   Messages of alice per iteration
+ */
+static void
+BM_SwarmMergeHistory(benchmark::State& state)
+{
+    auto swarm = syntheticSwarm(state.range(0), state.range(1), state.range(1) / 10, true);
+    if (not swarm) {
+        state.SkipWithError("Couldn't make the conversation");
+        return;
+    }
+    auto bob = accounts.bob();
+    auto aliceDevice = std::string(accounts.alice()->currentDeviceId());
+    if (not swarm->clone)
+        swarm->clone = ConversationRepository::cloneConversation(bob->weak(),
+                                                                 aliceDevice,
+                                                                 swarm->repository->id());
+    if (not swarm->clone) {
+        state.SkipWithError("Couldn't clone");
+        return;
+    }
+    std::vector<std::string> bodies;
+    for (int64_t i = 0; i < state.range(2); ++i)
+        bodies.emplace_back(textMessage(i));
+    std::size_t fetched = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        swarm->repository->commitMessages(bodies);
+        swarm->clone->commitMessage(textMessage(0));
+        state.ResumeTiming();
+
+        if (not swarm->clone->fetch(aliceDevice)) {
+            state.SkipWithError("Couldn't fetch");
+            break;
+        }
+        auto remoteHead = swarm->clone->remoteHead(aliceDevice);
+        auto [newCommits, err] = swarm->clone->validFetch(aliceDevice);
+        if (err or newCommits.empty()) {
+            state.SkipWithError("Invalid history");
+            break;
+        }
+        auto [ok, cid] = swarm->clone->merge(remoteHead);
+        if (not ok) {
+            state.SkipWithError("Couldn't merge");
+            break;
+        }
+        fetched += newCommits.size();
+        auto result = swarm->clone->convCommitToMap(newCommits);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(fetched);
+}
+BENCHMARK(BM_SwarmMergeHistory)
+    ->ArgNames({"members", "messages", "new"})
+    ->Args({2, 1000, 1})
+    ->Args({2, 1000, 100})
+    ->Args({2, 10000, 1})
+    ->Args({2, 10000, 100})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace bench
+} // namespace jami
+
+int
+main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    if (not DRing::init(DRing::InitFlag(0)) or not DRing::start())
+        return 1;
+
+    auto ret = 0;
+    if (jami::bench::accounts.start()) {
+        benchmark::RunSpecifiedBenchmarks();
+    } else {
+        std::cerr << "Accounts not announced" << std::endl;
+        ret = 1;
+    }
+    // Before the accounts they belong to
+    jami::bench::swarms.clear();
+    jami::bench::accounts.stop();
+    DRing::fini();
+    return ret;
+}
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "transport/peer_channel.h"
+
+#include <msgpack.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace jami {
+namespace bench {
+
+/**
+ * Packets of a channel framed and parsed as by MultiplexedSocket: a msgpack
+ * array [channel, bin] whose header is packed apart of the payload, the payloads
+ * being read in place from the unpacker of the receiver.
+ */
+static void
+BM_MultiplexedFraming(benchmark::State& state)
+{
+    static constexpr std::size_t IO_BUFFER_SIZE {8192};
+    const std::size_t len = state.range(0);
+    const std::vector<uint8_t> payload(len, 'j');
+    const uint16_t channel = 42;
+    msgpack::unpacker pac;
+    std::size_t received = 0;
+    for (auto _ : state) {
+        msgpack::sbuffer header(16);
+        msgpack::packer<msgpack::sbuffer> pk(&header);
+        pk.pack_array(2);
+        pk.pack(channel);
+        pk.pack_bin(len);
+
+        // The wire, read by chunks of the TLS records
+        std::string wire;
+        wire.reserve(header.size() + len);
+        wire.append(header.data(), header.size());
+        wire.append(reinterpret_cast<const char*>(payload.data()), len);
+        for (std::size_t pos = 0; pos < wire.size(); pos += IO_BUFFER_SIZE) {
+            auto size = std::min(IO_BUFFER_SIZE, wire.size() - pos);
+            pac.reserve_buffer(size);
+            std::memcpy(pac.buffer(), wire.data() + pos, size);
+            pac.buffer_consumed(size);
+            msgpack::object_handle oh;
+            while (pac.next(oh)) {
+                const auto& o = oh.get();
+                if (o.via.array.ptr[0].as<uint16_t>() == channel)
+                    received += o.via.array.ptr[1].via.bin.size;
+            }
+        }
+    }
+    benchmark::DoNotOptimize(received);
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_MultiplexedFraming)->ArgName("payload")->Arg(64)->Arg(1280)->Arg(16384)->Arg(65535);
+
+/**
+ * Packets of the ICE transport written then read by the same thread
+ */
+static void
+BM_PeerChannelWriteRead(benchmark::State& state)
+{
+    const std::size_t len = state.range(0);
+    const std::vector<char> packet(len, 'j');
+    std::vector<char> output(len);
+    PeerChannel channel;
+    std::error_code ec;
+    for (auto _ : state) {
+        channel.write(packet.data(), len, ec);
+        benchmark::DoNotOptimize(channel.read(output.data(), len, ec));
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_PeerChannelWriteRead)->ArgName("packet")->Arg(1280)->Arg(16384)->Arg(65536);
+
+/**
+ * Writer thread feeding the reading benchmark thread, a full channel making
+ * the writer wait
+ */
+static void
+BM_PeerChannelThroughput(benchmark::State& state)
+{
+    static constexpr std::size_t PACKET_SIZE {1280};
+    const std::size_t capacity = state.range(0);
+    PeerChannel channel(capacity);
+    std::thread writer([&] {
+        const std::vector<char> packet(PACKET_SIZE, 'j');
+        std::error_code ec;
+        while (channel.write(packet.data(), packet.size(), std::chrono::hours(1), ec) >= 0)
+            ;
+    });
+    std::vector<char> output(64 * 1024);
+    std::size_t received = 0;
+    std::error_code ec;
+    for (auto _ : state) {
+        auto n = channel.read(output.data(), output.size(), ec);
+        if (n <= 0) {
+            state.SkipWithError("Channel stopped");
+            break;
+        }
+        received += n;
+    }
+    channel.stop();
+    writer.join();
+    state.SetBytesProcessed(received);
+}
+BENCHMARK(BM_PeerChannelThroughput)
+    ->ArgName("capacity")
+    ->Arg(64 * 1024)
+    ->Arg(PeerChannel::DEFAULT_CAPACITY)
+    ->UseRealTime();
+
+} // namespace bench
+} // namespace jami
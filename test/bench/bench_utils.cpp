@@ -0,0 +1,170 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "archiver.h"
+#include "base64.h"
+#include "utf8_utils.h"
+
+#include <opendht/infohash.h>
+
+#include <random>
+
+namespace jami {
+namespace bench {
+
+/**
+ * Same bytes at each run, so that the results of two commits are comparable
+ */
+static std::vector<uint8_t>
+randomBytes(std::size_t size)
+{
+    std::mt19937 rd(42);
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> bytes(size);
+    for (auto& b : bytes)
+        b = dist(rd);
+    return bytes;
+}
+
+static void
+BM_Base64Encode(benchmark::State& state)
+{
+    const auto data = randomBytes(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(base64::encode(data));
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Base64Encode)->ArgName("size")->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+static void
+BM_Base64Decode(benchmark::State& state)
+{
+    const auto encoded = base64::encode(randomBytes(state.range(0)));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(base64::decode(encoded));
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_Base64Decode)->ArgName("size")->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+/**
+ * Into a buffer of the caller, labeled with the implementation selected for the CPU
+ */
+static void
+BM_Base64EncodeInto(benchmark::State& state)
+{
+    const auto data = randomBytes(state.range(0));
+    std::string encoded(base64::encodedSize(data.size()), '\0');
+    for (auto _ : state) {
+        base64::encode(data.data(), data.size(), encoded.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.SetLabel(base64::implementation());
+}
+BENCHMARK(BM_Base64EncodeInto)->ArgName("size")->Arg(4096)->Arg(1 << 20);
+
+static void
+BM_Base64DecodeInto(benchmark::State& state)
+{
+    const auto encoded = base64::encode(randomBytes(state.range(0)));
+    std::vector<uint8_t> decoded(base64::decodedSize(encoded.size()));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(base64::decode(encoded, decoded.data()));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * encoded.size());
+    state.SetLabel(base64::implementation());
+}
+BENCHMARK(BM_Base64DecodeInto)->ArgName("size")->Arg(4096)->Arg(1 << 20);
+
+/**
+ * Text of a message: mostly ASCII, with accents, CJK and emojis
+ */
+static void
+BM_Utf8Validate(benchmark::State& state)
+{
+    static const std::string SAMPLE = u8"Salut, ça va ? 你好，世界 😀👍 ";
+    std::string text;
+    while (text.size() < static_cast<std::size_t>(state.range(0)))
+        text += SAMPLE;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(utf8_validate(text));
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Utf8Validate)->ArgName("size")->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+/**
+ * Like the archive of an account: its keys and certificates, then its contacts
+ */
+static std::string
+syntheticArchive(std::size_t contacts)
+{
+    std::string archive = "{\"ringAccountKey\":\"" + base64::encode(randomBytes(2400))
+                          + "\",\"ringAccountCert\":\"" + base64::encode(randomBytes(1800))
+                          + "\",\"ringAccountContacts\":{";
+    for (std::size_t i = 0; i < contacts; ++i) {
+        auto id = dht::InfoHash::get("contact" + std::to_string(i)).toString();
+        auto conversation = dht::InfoHash::get("conversation" + std::to_string(i)).toString();
+        archive += (i ? ",\"" : "\"") + id + "\":{\"added\":1650000000,\"confirmed\":true,"
+                   + "\"conversationId\":\"" + conversation + "\"}";
+    }
+    return archive + "}}";
+}
+
+/**
+ * Labeled with the codec used, zlib if zstd is not built in
+ */
+static void
+BM_ArchiveCompress(benchmark::State& state)
+{
+    const auto archive = syntheticArchive(state.range(1));
+    auto codec = static_cast<archiver::Codec>(state.range(0));
+    std::size_t compressed = 0;
+    for (auto _ : state)
+        compressed = archiver::compress(archive, codec).size();
+    state.SetBytesProcessed(state.iterations() * archive.size());
+    state.counters["ratio"] = static_cast<double>(archive.size()) / compressed;
+    state.SetLabel(archiver::hasCodec(codec) ? (codec == archiver::Codec::ZSTD ? "zstd" : "zlib")
+                                             : "zlib, zstd not built in");
+}
+BENCHMARK(BM_ArchiveCompress)
+    ->ArgNames({"codec", "contacts"})
+    ->ArgsProduct({{static_cast<int64_t>(archiver::Codec::ZLIB),
+                    static_cast<int64_t>(archiver::Codec::ZSTD)},
+                   {10, 1000}});
+
+static void
+BM_ArchiveDecompress(benchmark::State& state)
+{
+    const auto archive = syntheticArchive(state.range(1));
+    auto codec = static_cast<archiver::Codec>(state.range(0));
+    const auto compressed = archiver::compress(archive, codec);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(archiver::decompress(compressed));
+    state.SetBytesProcessed(state.iterations() * archive.size());
+    state.SetLabel(archiver::codecOf(compressed) == archiver::Codec::ZSTD ? "zstd" : "zlib");
+}
+BENCHMARK(BM_ArchiveDecompress)
+    ->ArgNames({"codec", "contacts"})
+    ->ArgsProduct({{static_cast<int64_t>(archiver::Codec::ZLIB),
+                    static_cast<int64_t>(archiver::Codec::ZSTD)},
+                   {10, 1000}});
+
+} // namespace bench
+} // namespace jami
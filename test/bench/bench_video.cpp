@@ -0,0 +1,137 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "libav_deps.h"
+#include "media_buffer.h"
+#include "video/video_scaler.h"
+
+namespace jami {
+namespace video {
+namespace bench {
+
+/**
+ * Decoded frames (YUV420P) scaled for the preview or a layout of the mixer
+ */
+static void
+BM_VideoScalerScale(benchmark::State& state)
+{
+    VideoFrame input, output;
+    input.reserve(AV_PIX_FMT_YUV420P, state.range(0), state.range(1));
+    output.reserve(AV_PIX_FMT_YUV420P, state.range(2), state.range(3));
+    VideoScaler scaler;
+    for (auto _ : state) {
+        scaler.scale(input, output);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VideoScalerScale)
+    ->ArgNames({"in_w", "in_h", "out_w", "out_h"})
+    ->Args({1280, 720, 640, 360})
+    ->Args({1920, 1080, 1280, 720})
+    ->Args({640, 480, 1280, 720});
+
+/**
+ * Conversion for a client expecting RGB frames
+ */
+static void
+BM_VideoScalerConvert(benchmark::State& state)
+{
+    VideoFrame input, output;
+    input.reserve(AV_PIX_FMT_YUV420P, 1280, 720);
+    output.reserve(AV_PIX_FMT_BGRA, 1280, 720);
+    VideoScaler scaler;
+    for (auto _ : state) {
+        scaler.scale(input, output);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VideoScalerConvert);
+
+struct Conversion
+{
+    AVPixelFormat inFormat;
+    int inWidth, inHeight;
+    AVPixelFormat outFormat;
+    int outWidth, outHeight;
+};
+
+// Done by VideoScaler without swscale
+static const Conversion FAST_CONVERSIONS[] = {
+    {AV_PIX_FMT_NV12, 1920, 1080, AV_PIX_FMT_YUV420P, 1920, 1080},
+    {AV_PIX_FMT_YUV420P, 1920, 1080, AV_PIX_FMT_NV12, 1920, 1080},
+    {AV_PIX_FMT_YUV420P, 1920, 1080, AV_PIX_FMT_YUV420P, 960, 540},
+    {AV_PIX_FMT_YUV420P, 1280, 720, AV_PIX_FMT_YUV420P, 640, 360},
+};
+
+static void
+BM_VideoScalerFastPath(benchmark::State& state)
+{
+    const auto& c = FAST_CONVERSIONS[state.range(0)];
+    VideoFrame input, output;
+    input.reserve(c.inFormat, c.inWidth, c.inHeight);
+    output.reserve(c.outFormat, c.outWidth, c.outHeight);
+    VideoScaler scaler;
+    for (auto _ : state) {
+        scaler.scale(input, output);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VideoScalerFastPath)->ArgName("conversion")->DenseRange(0, 3)->UseRealTime();
+
+/**
+ * The same conversions by swscale, as before
+ */
+static void
+BM_Swscale(benchmark::State& state)
+{
+    const auto& c = FAST_CONVERSIONS[state.range(0)];
+    VideoFrame input, output;
+    input.reserve(c.inFormat, c.inWidth, c.inHeight);
+    output.reserve(c.outFormat, c.outWidth, c.outHeight);
+    auto ctx = sws_getContext(c.inWidth,
+                              c.inHeight,
+                              c.inFormat,
+                              c.outWidth,
+                              c.outHeight,
+                              c.outFormat,
+                              SWS_FAST_BILINEAR,
+                              nullptr,
+                              nullptr,
+                              nullptr);
+    for (auto _ : state) {
+        sws_scale(ctx,
+                  input.pointer()->data,
+                  input.pointer()->linesize,
+                  0,
+                  c.inHeight,
+                  output.pointer()->data,
+                  output.pointer()->linesize);
+        benchmark::ClobberMemory();
+    }
+    sws_freeContext(ctx);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Swscale)->ArgName("conversion")->DenseRange(0, 3)->UseRealTime();
+
+} // namespace bench
+} // namespace video
+} // namespace jami
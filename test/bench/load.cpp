@@ -0,0 +1,879 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Load generator: N accounts of one daemon, made from an actors YAML fixture
+ * of the unit tests, reaching each other on the loopback, drive calls,
+ * conferences, file transfers and message storms. The latencies, failures and
+ * resources used are reported per scenario.
+ */
+
+#include "account_const.h"
+#include "call_const.h"
+#include "callmanager_interface.h"
+#include "configurationmanager_interface.h"
+#include "conversation_interface.h"
+#include "datatransfer_interface.h"
+#include "jami.h"
+#include "media_const.h"
+
+#include <json/json.h>
+#include <yaml-cpp/yaml.h>
+
+#include <getopt.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+struct Options
+{
+    std::string actors {"actors/alice-bob.yml"};
+    unsigned accounts {0}; // 0 for the accounts of the fixture
+    std::vector<std::string> scenarios {"calls", "conference", "transfers", "messages"};
+    std::chrono::seconds duration {60s};
+    unsigned conferenceSize {4};
+    unsigned messageRate {10}; // per conversation and second
+    std::size_t fileSize {1024 * 1024};
+    std::string output;
+};
+
+struct Actor
+{
+    std::string name;
+    std::string id;
+    std::string uri;
+};
+
+double
+seconds(clock_type::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+/**
+ * Latencies and outcomes of the operations of a scenario, by operation
+ */
+class Recorder
+{
+public:
+    void success(const std::string& op, clock_type::duration latency)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto& s = ops_[op];
+        s.latencies.emplace_back(seconds(latency));
+    }
+    void failure(const std::string& op)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        ops_[op].failures++;
+    }
+    /**
+     * Media packets lost among the ones expected, by the operation (e.g. the calls)
+     */
+    void losses(const std::string& op, uint64_t lost, uint64_t expected)
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto& s = ops_[op];
+        s.packetsLost += lost;
+        s.packetsExpected += expected;
+    }
+    void clear()
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        ops_.clear();
+    }
+
+    Json::Value report() const
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        Json::Value ret(Json::objectValue);
+        for (auto [op, s] : ops_) {
+            auto& r = ret[op];
+            auto total = s.latencies.size() + s.failures;
+            r["count"] = static_cast<Json::UInt64>(total);
+            r["failures"] = static_cast<Json::UInt64>(s.failures);
+            r["drop_rate"] = total ? static_cast<double>(s.failures) / total : 0.;
+            std::sort(s.latencies.begin(), s.latencies.end());
+            r["latency"]["p50"] = percentile(s.latencies, .5);
+            r["latency"]["p95"] = percentile(s.latencies, .95);
+            r["latency"]["p99"] = percentile(s.latencies, .99);
+            r["latency"]["max"] = s.latencies.empty() ? 0. : s.latencies.back();
+            if (s.packetsExpected)
+                r["packet_loss_rate"] = static_cast<double>(s.packetsLost) / s.packetsExpected;
+        }
+        return ret;
+    }
+
+private:
+    struct Operation
+    {
+        std::vector<double> latencies;
+        std::size_t failures {0};
+        uint64_t packetsLost {0};
+        uint64_t packetsExpected {0};
+    };
+
+    // Nearest-rank, of sorted values
+    static double percentile(const std::vector<double>& values, double p)
+    {
+        if (values.empty())
+            return 0.;
+        auto rank = static_cast<std::size_t>(p * values.size() + .999999);
+        return values[std::clamp<std::size_t>(rank, 1, values.size()) - 1];
+    }
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Operation> ops_;
+};
+
+/**
+ * CPU and memory used by the process, sampled every second while it lives
+ */
+class ResourceSampler
+{
+public:
+    ResourceSampler()
+        : thread_([this] { run(); })
+    {}
+    ~ResourceSampler()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    Json::Value report() const
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        Json::Value ret(Json::objectValue);
+        double cpuSum = 0, cpuMax = 0;
+        uint64_t rssMax = 0;
+        for (const auto& s : samples_) {
+            cpuSum += s.cpu;
+            cpuMax = std::max(cpuMax, s.cpu);
+            rssMax = std::max(rssMax, s.rss);
+        }
+        // In percents of one core
+        ret["cpu_mean"] = samples_.empty() ? 0. : cpuSum / samples_.size();
+        ret["cpu_max"] = cpuMax;
+        ret["rss_max_bytes"] = static_cast<Json::UInt64>(rssMax);
+        ret["rss_end_bytes"] = static_cast<Json::UInt64>(samples_.empty() ? 0
+                                                                           : samples_.back().rss);
+        return ret;
+    }
+
+private:
+    struct Sample
+    {
+        double cpu;
+        uint64_t rss;
+    };
+
+    static clock_type::duration cpuTime()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        auto tv = [](const timeval& t) {
+            return std::chrono::seconds(t.tv_sec) + std::chrono::microseconds(t.tv_usec);
+        };
+        return std::chrono::duration_cast<clock_type::duration>(tv(usage.ru_utime)
+                                                                + tv(usage.ru_stime));
+    }
+
+    static uint64_t rss()
+    {
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size = 0, resident = 0;
+        statm >> size >> resident;
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+
+    void run()
+    {
+        auto lastWall = clock_type::now();
+        auto lastCpu = cpuTime();
+        std::unique_lock<std::mutex> lk(mutex_);
+        while (not cv_.wait_for(lk, 1s, [this] { return stop_; })) {
+            auto wall = clock_type::now();
+            auto cpu = cpuTime();
+            samples_.push_back({100. * seconds(cpu - lastCpu) / seconds(wall - lastWall), rss()});
+            lastWall = wall;
+            lastCpu = cpu;
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ {false};
+    std::vector<Sample> samples_;
+    std::thread thread_;
+};
+
+/**
+ * Accounts of the fixture, the missing ones being copies of its default account
+ */
+std::vector<Actor>
+loadActors(const Options& opts)
+{
+    auto node = YAML::LoadFile(opts.actors);
+    auto defaults = DRing::getAccountTemplate("RING");
+    if (auto defaultAccount = node["default-account"]; defaultAccount.IsMap())
+        for (const auto& kv : defaultAccount)
+            defaults["Account." + kv.first.as<std::string>()] = kv.second.as<std::string>();
+
+    // Reachable on the loopback only, without a server
+    defaults[DRing::Account::ConfProperties::UPNP_ENABLED] = "false";
+    defaults[DRing::Account::ConfProperties::TURN::ENABLED] = "false";
+    defaults[DRing::Account::ConfProperties::PROXY_ENABLED] = "false";
+    defaults[DRing::Account::ConfProperties::DHT_PEER_DISCOVERY] = "true";
+    defaults[DRing::Account::ConfProperties::ACCOUNT_PEER_DISCOVERY] = "true";
+    defaults[DRing::Account::ConfProperties::ACCOUNT_PUBLISH] = "true";
+    defaults[DRing::Account::ConfProperties::AUTOANSWER] = "true";
+
+    std::vector<std::pair<std::string, std::map<std::string, std::string>>> details;
+    for (const auto& kv : node["accounts"]) {
+        auto account = defaults;
+        for (const auto& detail : kv.second)
+            account["Account." + detail.first.as<std::string>()] = detail.second.as<std::string>();
+        details.emplace_back(kv.first.as<std::string>(), std::move(account));
+    }
+    for (auto i = details.size(); i < opts.accounts; ++i) {
+        auto name = "actor" + std::to_string(i);
+        auto account = defaults;
+        account[DRing::Account::ConfProperties::ALIAS] = name;
+        account[DRing::Account::ConfProperties::DISPLAYNAME] = name;
+        details.emplace_back(std::move(name), std::move(account));
+    }
+    if (opts.accounts)
+        details.resize(opts.accounts);
+
+    std::vector<Actor> actors;
+    for (auto& [name, account] : details)
+        actors.push_back({name, DRing::addAccount(account), {}});
+    for (auto& actor : actors)
+        actor.uri = DRing::getAccountDetails(actor.id)[DRing::Account::ConfProperties::USERNAME];
+    return actors;
+}
+
+/**
+ * Drives the scenarios, the signals of the daemon completing their operations
+ */
+class Load
+{
+public:
+    explicit Load(const Options& opts)
+        : opts_(opts)
+    {
+        registerHandlers();
+    }
+
+    bool start(std::chrono::seconds timeout);
+    void stop();
+
+    Json::Value run(const std::string& scenario);
+
+private:
+    struct PlacedCall
+    {
+        std::string op;
+        clock_type::time_point start;
+        bool current {false};
+        bool over {false};
+    };
+
+    struct Conversation
+    {
+        std::string id;
+        const Actor* from {nullptr};
+        const Actor* to {nullptr};
+        bool ready {false};
+        // Transfer in progress, if any
+        clock_type::time_point transferStart {};
+        bool transferring {false};
+    };
+
+    void registerHandlers();
+    void setupConversations();
+
+    std::vector<std::string> placeCalls(const std::string& op,
+                                        const Actor& from,
+                                        const std::vector<const Actor*>& to);
+    void holdCalls(const std::string& op, const Actor& from, const std::vector<std::string>& calls);
+    void runCalls();
+    void runConference();
+    void runTransfers();
+    void runMessages();
+
+    const Options& opts_;
+    std::vector<Actor> actors_;
+    Recorder recorder_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::set<std::string> announced_;
+    std::map<std::string, PlacedCall> calls_;
+    std::vector<Conversation> conversations_;
+    std::map<std::string, clock_type::time_point> requests_;
+    // Sending time of the messages in flight, by body
+    std::map<std::string, clock_type::time_point> messages_;
+    std::string transferPath_;
+};
+
+void
+Load::registerHandlers()
+{
+    using namespace DRing;
+    std::map<std::string, std::shared_ptr<CallbackWrapperBase>> handlers;
+    handlers.insert(exportable_callback<ConfigurationSignal::VolatileDetailsChanged>(
+        [this](const std::string& accountId, const std::map<std::string, std::string>& details) {
+            auto it = details.find(Account::VolatileProperties::DEVICE_ANNOUNCED);
+            if (it == details.end() or it->second != "true")
+                return;
+            std::lock_guard<std::mutex> lk(mutex_);
+            announced_.emplace(accountId);
+            cv_.notify_all();
+        }));
+    handlers.insert(exportable_callback<CallSignal::StateChange>(
+        [this](const std::string&, const std::string& callId, const std::string& state, signed) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            auto it = calls_.find(callId);
+            if (it == calls_.end())
+                return;
+            auto& call = it->second;
+            if (state == Call::StateEvent::CURRENT and not call.current) {
+                call.current = true;
+                recorder_.success(call.op + "_setup", clock_type::now() - call.start);
+            } else if (state == Call::StateEvent::OVER or state == Call::StateEvent::HUNGUP
+                       or state == Call::StateEvent::FAILURE) {
+                call.over = true;
+            }
+            cv_.notify_all();
+        }));
+    handlers.insert(exportable_callback<ConversationSignal::ConversationRequestReceived>(
+        [this](const std::string& accountId,
+               const std::string& conversationId,
+               std::map<std::string, std::string>) {
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                requests_.emplace(conversationId, clock_type::now());
+            }
+            acceptConversationRequest(accountId, conversationId);
+        }));
+    handlers.insert(exportable_callback<ConversationSignal::ConversationReady>(
+        [this](const std::string& accountId, const std::string& conversationId) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            for (auto& conv : conversations_) {
+                if (conv.id == conversationId and conv.to->id == accountId and not conv.ready) {
+                    conv.ready = true;
+                    auto it = requests_.find(conversationId);
+                    if (it != requests_.end())
+                        recorder_.success("swarm_join", clock_type::now() - it->second);
+                }
+            }
+            cv_.notify_all();
+        }));
+    handlers.insert(exportable_callback<ConversationSignal::MessageReceived>(
+        [this](const std::string& accountId,
+               const std::string& conversationId,
+               std::map<std::string, std::string> message) {
+            std::unique_lock<std::mutex> lk(mutex_);
+            auto conv = std::find_if(conversations_.begin(),
+                                     conversations_.end(),
+                                     [&](const auto& c) { return c.id == conversationId; });
+            if (conv == conversations_.end() or conv->to->id != accountId)
+                return;
+            if (message["type"] == "text/plain") {
+                auto it = messages_.find(message["body"]);
+                if (it != messages_.end()) {
+                    recorder_.success("message", clock_type::now() - it->second);
+                    messages_.erase(it);
+                    cv_.notify_all();
+                }
+            } else if (message["type"] == "application/data-transfer+json") {
+                lk.unlock();
+                downloadFile(accountId,
+                             conversationId,
+                             message["id"],
+                             message["fileId"],
+                             transferPath_ + "." + accountId);
+            }
+        }));
+    handlers.insert(exportable_callback<DataTransferSignal::DataTransferEvent>(
+        [this](const std::string& accountId,
+               const std::string& conversationId,
+               const std::string&,
+               const std::string&,
+               int code) {
+            std::lock_guard<std::mutex> lk(mutex_);
+            for (auto& conv : conversations_) {
+                if (conv.id != conversationId or conv.to->id != accountId or not conv.transferring)
+                    continue;
+                if (code == static_cast<int>(DataTransferEventCode::finished)) {
+                    recorder_.success("transfer", clock_type::now() - conv.transferStart);
+                    conv.transferring = false;
+                } else if (code == static_cast<int>(DataTransferEventCode::closed_by_host)
+                           or code == static_cast<int>(DataTransferEventCode::closed_by_peer)
+                           or code == static_cast<int>(DataTransferEventCode::timeout_expired)
+                           or code == static_cast<int>(DataTransferEventCode::unjoinable_peer)) {
+                    recorder_.failure("transfer");
+                    conv.transferring = false;
+                }
+            }
+            cv_.notify_all();
+        }));
+    registerSignalHandlers(handlers);
+}
+
+bool
+Load::start(std::chrono::seconds timeout)
+{
+    actors_ = loadActors(opts_);
+    std::cout << "Waiting for the announcement of " << actors_.size() << " accounts" << std::endl;
+    std::unique_lock<std::mutex> lk(mutex_);
+    return cv_.wait_for(lk, timeout, [&] { return announced_.size() >= actors_.size(); });
+}
+
+void
+Load::stop()
+{
+    for (const auto& actor : actors_)
+        DRing::removeAccount(actor.id);
+    if (not transferPath_.empty()) {
+        std::remove(transferPath_.c_str());
+        for (const auto& actor : actors_)
+            std::remove((transferPath_ + "." + actor.id).c_str());
+    }
+}
+
+/**
+ * One conversation per pair of accounts: 0 with 1, 2 with 3...
+ */
+void
+Load::setupConversations()
+{
+    if (not conversations_.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        for (std::size_t i = 0; i + 1 < actors_.size(); i += 2)
+            conversations_.push_back({{}, &actors_[i], &actors_[i + 1]});
+    }
+    for (auto& conv : conversations_) {
+        auto id = DRing::startConversation(conv.from->id);
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            conv.id = id;
+        }
+        DRing::addConversationMember(conv.from->id, id, conv.to->uri);
+    }
+    std::unique_lock<std::mutex> lk(mutex_);
+    cv_.wait_for(lk, 60s, [&] {
+        return std::all_of(conversations_.begin(), conversations_.end(), [](const auto& c) {
+            return c.ready;
+        });
+    });
+    for (const auto& conv : conversations_)
+        if (not conv.ready)
+            recorder_.failure("swarm_join");
+}
+
+std::vector<std::string>
+Load::placeCalls(const std::string& op, const Actor& from, const std::vector<const Actor*>& to)
+{
+    std::vector<std::map<std::string, std::string>> mediaList {
+        {{DRing::Media::MediaAttributeKey::MEDIA_TYPE, DRing::Media::MediaAttributeValue::AUDIO},
+         {DRing::Media::MediaAttributeKey::ENABLED, "true"},
+         {DRing::Media::MediaAttributeKey::MUTED, "false"},
+         {DRing::Media::MediaAttributeKey::SOURCE, ""},
+         {DRing::Media::MediaAttributeKey::LABEL, "audio_0"}}};
+    std::vector<std::string> calls;
+    for (const auto* peer : to) {
+        // Under the lock, so that the state changes find the call
+        std::lock_guard<std::mutex> lk(mutex_);
+        auto callId = DRing::placeCallWithMedia(from.id, peer->uri, mediaList);
+        if (callId.empty()) {
+            recorder_.failure(op + "_setup");
+            continue;
+        }
+        calls_.emplace(callId, PlacedCall {op, clock_type::now()});
+        calls.emplace_back(std::move(callId));
+    }
+    return calls;
+}
+
+/**
+ * Wait for the calls to be answered then keep them for the duration of the scenario
+ */
+void
+Load::holdCalls(const std::string& op, const Actor& from, const std::vector<std::string>& calls)
+{
+    std::unique_lock<std::mutex> lk(mutex_);
+    auto end = clock_type::now() + opts_.duration;
+    cv_.wait_until(lk, end, [&] {
+        return std::all_of(calls.begin(), calls.end(), [&](const auto& id) {
+            return calls_[id].current or calls_[id].over;
+        });
+    });
+    cv_.wait_until(lk, end, [] { return false; });
+    for (const auto& id : calls) {
+        auto& call = calls_[id];
+        if (not call.current)
+            recorder_.failure(op + "_setup");
+        else if (call.over)
+            recorder_.failure(op + "_drop");
+        else
+            recorder_.success(op + "_drop", {});
+    }
+    lk.unlock();
+
+    for (const auto& id : calls) {
+        // Media losses seen by the caller
+        for (const auto& stream : DRing::getCallStats(from.id, id))
+            recorder_.losses(op + "_drop",
+                             stream.packetsLost,
+                             stream.packetsReceived + stream.packetsLost);
+        DRing::hangUp(from.id, id);
+    }
+    lk.lock();
+    for (const auto& id : calls)
+        calls_.erase(id);
+}
+
+/**
+ * Calls between the accounts of each pair
+ */
+void
+Load::runCalls()
+{
+    std::vector<std::pair<const Actor*, std::vector<std::string>>> calls;
+    for (std::size_t i = 0; i + 1 < actors_.size(); i += 2)
+        calls.emplace_back(&actors_[i], placeCalls("call", actors_[i], {&actors_[i + 1]}));
+    std::vector<std::thread> holders;
+    for (const auto& [from, ids] : calls)
+        holders.emplace_back([&, from = from, ids = ids] { holdCalls("call", *from, ids); });
+    for (auto& t : holders)
+        t.join();
+}
+
+/**
+ * The first account hosts a conference with the next ones
+ */
+void
+Load::runConference()
+{
+    const auto& host = actors_.front();
+    std::vector<const Actor*> participants;
+    for (std::size_t i = 1; i < std::min<std::size_t>(opts_.conferenceSize, actors_.size()); ++i)
+        participants.emplace_back(&actors_[i]);
+    auto calls = placeCalls("conference", host, participants);
+
+    std::thread join([&] {
+        std::unique_lock<std::mutex> lk(mutex_);
+        std::string confId;
+        std::string first;
+        for (const auto& id : calls) {
+            if (not cv_.wait_for(lk, 30s, [&] { return calls_[id].current or calls_[id].over; })
+                or calls_[id].over)
+                continue;
+            auto joinStart = clock_type::now();
+            lk.unlock();
+            bool joined = false;
+            if (first.empty()) {
+                first = id;
+                joined = true;
+            } else if (confId.empty()) {
+                joined = DRing::joinParticipant(host.id, first, host.id, id);
+                if (joined)
+                    confId = DRing::getConferenceId(host.id, id);
+            } else {
+                joined = DRing::addParticipant(host.id, id, host.id, confId);
+            }
+            if (joined)
+                recorder_.success("conference_join", clock_type::now() - joinStart);
+            else
+                recorder_.failure("conference_join");
+            lk.lock();
+        }
+    });
+    holdCalls("conference", host, calls);
+    join.join();
+}
+
+/**
+ * Transfers of a file in each conversation, one at a time per conversation
+ */
+void
+Load::runTransfers()
+{
+    setupConversations();
+    if (transferPath_.empty()) {
+        char path[] = "/tmp/jami-load-XXXXXX";
+        auto fd = mkstemp(path);
+        if (fd < 0)
+            return;
+        close(fd);
+        transferPath_ = path;
+        std::ofstream file(transferPath_, std::ios::binary);
+        file << std::string(opts_.fileSize, 'J');
+    }
+
+    auto end = clock_type::now() + opts_.duration;
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (clock_type::now() < end) {
+        for (auto& conv : conversations_) {
+            if (not conv.ready or conv.transferring)
+                continue;
+            conv.transferring = true;
+            conv.transferStart = clock_type::now();
+            lk.unlock();
+            DRing::sendFile(conv.from->id, conv.id, transferPath_, "load", "");
+            lk.lock();
+        }
+        cv_.wait_until(lk, std::min(end, clock_type::now() + 1s), [&] {
+            return std::any_of(conversations_.begin(), conversations_.end(), [](const auto& c) {
+                return c.ready and not c.transferring;
+            });
+        });
+    }
+    // The transfers still in progress get a minute to finish
+    cv_.wait_for(lk, 60s, [&] {
+        return std::none_of(conversations_.begin(), conversations_.end(), [](const auto& c) {
+            return c.transferring;
+        });
+    });
+    for (auto& conv : conversations_) {
+        if (conv.transferring) {
+            recorder_.failure("transfer");
+            conv.transferring = false;
+        }
+    }
+}
+
+/**
+ * Messages sent at a fixed rate in each conversation
+ */
+void
+Load::runMessages()
+{
+    setupConversations();
+    const auto interval = std::chrono::duration_cast<clock_type::duration>(1s) / opts_.messageRate;
+    auto end = clock_type::now() + opts_.duration;
+    uint64_t n = 0;
+    for (auto next = clock_type::now(); next < end; next += interval) {
+        std::this_thread::sleep_until(next);
+        for (const auto& conv : conversations_) {
+            if (not conv.ready)
+                continue;
+            auto body = "load " + std::to_string(n++);
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                messages_.emplace(body, clock_type::now());
+            }
+            DRing::sendMessage(conv.from->id, conv.id, body, "");
+        }
+    }
+    // The messages still in flight get 10 seconds to arrive
+    std::unique_lock<std::mutex> lk(mutex_);
+    cv_.wait_for(lk, 10s, [&] { return messages_.empty(); });
+    for (std::size_t i = 0; i < messages_.size(); ++i)
+        recorder_.failure("message");
+    messages_.clear();
+}
+
+Json::Value
+Load::run(const std::string& scenario)
+{
+    recorder_.clear();
+    ResourceSampler resources;
+    auto start = clock_type::now();
+    if (scenario == "calls")
+        runCalls();
+    else if (scenario == "conference")
+        runConference();
+    else if (scenario == "transfers")
+        runTransfers();
+    else if (scenario == "messages")
+        runMessages();
+    else
+        std::cerr << "Unknown scenario " << scenario << std::endl;
+
+    Json::Value ret(Json::objectValue);
+    ret["duration"] = seconds(clock_type::now() - start);
+    ret["operations"] = recorder_.report();
+    ret["resources"] = resources.report();
+    return ret;
+}
+
+void
+printReport(const std::string& scenario, const Json::Value& report)
+{
+    const auto& res = report["resources"];
+    std::printf("%s: %.1f s, CPU %.1f %% (max %.1f %%), RSS max %.1f MB\n",
+                scenario.c_str(),
+                report["duration"].asDouble(),
+                res["cpu_mean"].asDouble(),
+                res["cpu_max"].asDouble(),
+                res["rss_max_bytes"].asDouble() / (1024 * 1024));
+    std::printf("\t%-32s%8s%8s%10s%10s%10s%10s%10s\n",
+                "operation",
+                "count",
+                "failed",
+                "drop (%)",
+                "p50 (ms)",
+                "p95 (ms)",
+                "p99 (ms)",
+                "max (ms)");
+    for (const auto& op : report["operations"].getMemberNames()) {
+        const auto& r = report["operations"][op];
+        const auto& l = r["latency"];
+        std::printf("\t%-32s%8u%8u%10.2f%10.1f%10.1f%10.1f%10.1f\n",
+                    op.c_str(),
+                    r["count"].asUInt(),
+                    r["failures"].asUInt(),
+                    100 * r["drop_rate"].asDouble(),
+                    1000 * l["p50"].asDouble(),
+                    1000 * l["p95"].asDouble(),
+                    1000 * l["p99"].asDouble(),
+                    1000 * l["max"].asDouble());
+    }
+}
+
+void
+printUsage()
+{
+    std::cout << "Usage: jami_load [OPTION]... [ACTORS.yml]" << std::endl
+              << "-n, --accounts N \t- Accounts, the missing ones made from the default account"
+              << std::endl
+              << "-s, --scenarios LIST \t- Among calls,conference,transfers,messages" << std::endl
+              << "-t, --duration S \t- Duration of each scenario, in seconds" << std::endl
+              << "-c, --conference N \t- Participants of the conference, host included"
+              << std::endl
+              << "-r, --rate N \t- Messages per conversation and second" << std::endl
+              << "-f, --file-size B \t- Size of the transferred file" << std::endl
+              << "-o, --output FILE \t- Write the report in JSON" << std::endl
+              << "-h, --help \t- Print help" << std::endl;
+}
+
+bool
+parseArgs(int argc, char* argv[], Options& opts)
+{
+    const struct option longOptions[] = {{"accounts", required_argument, nullptr, 'n'},
+                                         {"scenarios", required_argument, nullptr, 's'},
+                                         {"duration", required_argument, nullptr, 't'},
+                                         {"conference", required_argument, nullptr, 'c'},
+                                         {"rate", required_argument, nullptr, 'r'},
+                                         {"file-size", required_argument, nullptr, 'f'},
+                                         {"output", required_argument, nullptr, 'o'},
+                                         {"help", no_argument, nullptr, 'h'},
+                                         {nullptr, 0, nullptr, 0}};
+    while (true) {
+        int optionIndex = 0;
+        auto c = getopt_long(argc, argv, "n:s:t:c:r:f:o:h", longOptions, &optionIndex);
+        if (c == -1)
+            break;
+        switch (c) {
+        case 'n':
+            opts.accounts = std::stoul(optarg);
+            break;
+        case 's': {
+            opts.scenarios.clear();
+            std::istringstream list(optarg);
+            for (std::string s; std::getline(list, s, ',');)
+                opts.scenarios.emplace_back(std::move(s));
+            break;
+        }
+        case 't':
+            opts.duration = std::chrono::seconds(std::stoul(optarg));
+            break;
+        case 'c':
+            opts.conferenceSize = std::stoul(optarg);
+            break;
+        case 'r':
+            opts.messageRate = std::max(1ul, std::stoul(optarg));
+            break;
+        case 'f':
+            opts.fileSize = std::stoull(optarg);
+            break;
+        case 'o':
+            opts.output = optarg;
+            break;
+        default:
+            printUsage();
+            return false;
+        }
+    }
+    if (optind < argc)
+        opts.actors = argv[optind];
+    return true;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    Options opts;
+    if (not parseArgs(argc, argv, opts))
+        return 1;
+
+    if (not DRing::init(DRing::InitFlag(DRing::DRING_FLAG_CONSOLE_LOG)) or not DRing::start())
+        return 1;
+
+    Json::Value report(Json::objectValue);
+    {
+        Load load(opts);
+        if (not load.start(120s)) {
+            std::cerr << "Accounts not announced" << std::endl;
+        } else {
+            for (const auto& scenario : opts.scenarios) {
+                std::cout << "Running " << scenario << std::endl;
+                report[scenario] = load.run(scenario);
+                printReport(scenario, report[scenario]);
+            }
+        }
+        load.stop();
+    }
+    DRing::fini();
+
+    if (not opts.output.empty()) {
+        std::ofstream out(opts.output);
+        out << report;
+    }
+    return report.empty() ? 1 : 0;
+}
@@ -37,6 +37,7 @@
 #include "fileutils.h"
 #include "account_const.h"
 #include "common.h"
+#include "jamidht/accountarchive.h"
 
 #include <git2.h>
 #include <filesystem>
@@ -75,6 +76,8 @@ private:
     void testExportDht();
     void testExportDhtWrongPassword();
     void testChangePassword();
+    void testCompressFallback();
+    void testPackedArchive();
 
     CPPUNIT_TEST_SUITE(AccountArchiveTest);
     CPPUNIT_TEST(testExportImportNoPassword);
@@ -84,6 +87,8 @@ private:
     CPPUNIT_TEST(testExportDht);
     CPPUNIT_TEST(testExportDhtWrongPassword);
     CPPUNIT_TEST(testChangePassword);
+    CPPUNIT_TEST(testCompressFallback);
+    CPPUNIT_TEST(testPackedArchive);
     CPPUNIT_TEST_SUITE_END();
 };
 
@@ -246,6 +251,34 @@ AccountArchiveTest::testChangePassword()
     CPPUNIT_ASSERT(DRing::changeAccountPassword(aliceId, "new", ""));
 }
 
+void
+AccountArchiveTest::testCompressFallback()
+{
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+    CPPUNIT_ASSERT(bobAccount->exportArchive("test.gz", "test"));
+    // Exported in zlib, for the versions built without zstd
+    auto exported = dht::crypto::aesDecrypt(fileutils::loadFile("test.gz"), "test");
+    CPPUNIT_ASSERT(archiver::codecOf(exported) == archiver::Codec::ZLIB);
+    auto data = fileutils::readArchive("test.gz", "test");
+    std::remove("test.gz");
+    std::string archive(data.begin(), data.end());
+
+    // zstd only if built in, zlib otherwise, both read back
+    for (auto codec : {archiver::Codec::ZLIB, archiver::Codec::ZSTD}) {
+        auto compressed = archiver::compress(archive, codec);
+        auto expected = archiver::hasCodec(codec) ? codec : archiver::Codec::ZLIB;
+        CPPUNIT_ASSERT(archiver::codecOf(compressed) == expected);
+        auto decompressed = archiver::decompress(compressed);
+        CPPUNIT_ASSERT(std::string(decompressed.begin(), decompressed.end()) == archive);
+    }
+
+    // The archives saved before zstd are still read
+    auto old = dht::crypto::aesEncrypt(archiver::compress(archive), "test");
+    fileutils::saveFile("test.gz", old);
+    CPPUNIT_ASSERT(fileutils::readArchive("test.gz", "test") == data);
+    std::remove("test.gz");
+}
+
 } // namespace test
 } // namespace jami
 
@@ -26,6 +26,8 @@
 
 #include "base64.h"
 
+#include <random>
+
 namespace jami { namespace test {
 
 class Base64Test : public CppUnit::TestFixture {
@@ -36,13 +38,23 @@ private:
     void encodingTest();
     void decodingTestSuccess();
     void decodingTestFail();
+    void roundTripTest();
+    void skippedCharactersTest();
+    void trailingSkippedCharactersTest();
 
     CPPUNIT_TEST_SUITE(Base64Test);
     CPPUNIT_TEST(encodingTest);
     CPPUNIT_TEST(decodingTestSuccess);
     CPPUNIT_TEST(decodingTestFail);
+    CPPUNIT_TEST(roundTripTest);
+    CPPUNIT_TEST(skippedCharactersTest);
+    CPPUNIT_TEST(trailingSkippedCharactersTest);
     CPPUNIT_TEST_SUITE_END();
 
+    std::vector<uint8_t> random(size_t n);
+
+    std::mt19937 rand_ {42};
+
     const std::vector<uint8_t> test_bytes = { 23, 45, 67, 87, 89, 34, 2, 45, 9, 10 };
     const std::string test_base64 = "Fy1DV1kiAi0JCg==";
     const std::string test_invalid_base64 = "ERSAÄÖöädt4-++asd==";
@@ -74,6 +86,81 @@ Base64Test::decodingTestFail()
     CPPUNIT_ASSERT(true);
 }
 
+std::vector<uint8_t>
+Base64Test::random(size_t n)
+{
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> ret(n);
+    for (auto& b : ret)
+        b = dist(rand_);
+    return ret;
+}
+
+// Bit by bit, as in RFC 4648
+static std::string
+reference(const std::vector<uint8_t>& data)
+{
+    static constexpr const char* alphabet
+        = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t bit = 0; bit < data.size() * 8; bit += 6) {
+        unsigned v = 0;
+        for (size_t b = bit; b < bit + 6; ++b)
+            v = (v << 1) | (b < data.size() * 8 ? (data[b / 8] >> (7 - b % 8)) & 1 : 0);
+        out += alphabet[v];
+    }
+    while (out.size() % 4)
+        out += '=';
+    return out;
+}
+
+void
+Base64Test::roundTripTest()
+{
+    // Sizes around the vector widths, to exercise the scalar tails
+    for (size_t n = 0; n < 200; ++n) {
+        auto data = random(n);
+        auto encoded = base64::encode(data);
+        CPPUNIT_ASSERT_EQUAL(reference(data), encoded);
+        CPPUNIT_ASSERT(base64::decode(encoded) == data);
+
+        // In a buffer of the caller
+        std::vector<uint8_t> out(base64::decodedSize(encoded.size()));
+        out.resize(base64::decode(encoded, out.data()));
+        CPPUNIT_ASSERT(out == data);
+    }
+}
+
+void
+Base64Test::skippedCharactersTest()
+{
+    // e.g. a folded vCard photo
+    auto data = random(300);
+    auto encoded = base64::encode(data);
+    std::string folded;
+    for (size_t i = 0; i < encoded.size(); i += 75)
+        folded += encoded.substr(i, 75) + "\r\n ";
+    CPPUNIT_ASSERT(base64::decode(folded) == data);
+}
+
+void
+Base64Test::trailingSkippedCharactersTest()
+{
+    auto bytes = [](const std::string& s) { return std::vector<uint8_t>(s.begin(), s.end()); };
+    // Skipped at the end too, instead of decoded as a value
+    CPPUNIT_ASSERT(base64::decode("QUJ\n") == bytes("AB"));
+    CPPUNIT_ASSERT(base64::decode("QUJ\r\n") == bytes("AB"));
+    CPPUNIT_ASSERT(base64::decode("QUI=\n") == bytes("AB"));
+    CPPUNIT_ASSERT(base64::decode("QQ==\r\n") == bytes("A"));
+    CPPUNIT_ASSERT(base64::decode("QUJD\n") == bytes("ABC"));
+    CPPUNIT_ASSERT(base64::decode("\n").empty());
+
+    // Same result past the vector widths
+    auto data = random(100);
+    auto encoded = base64::encode(data) + "\n";
+    CPPUNIT_ASSERT(base64::decode(encoded) == data);
+}
+
 }} // namespace jami::test
 
 RING_TEST_RUNNER(jami::test::Base64Test::name());
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "conference.h"
+#include "conference_protocol.h"
+
+#include "../../test_runner.h"
+
+namespace jami {
+namespace test {
+
+class ConferenceProtocolTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "conference_protocol"; }
+
+private:
+    void testForwardedOrders();
+    void testMergeConfInfo();
+    void testConfInfoDelta();
+
+    CPPUNIT_TEST_SUITE(ConferenceProtocolTest);
+    CPPUNIT_TEST(testForwardedOrders);
+    CPPUNIT_TEST(testMergeConfInfo);
+    CPPUNIT_TEST(testConfInfoDelta);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(ConferenceProtocolTest, ConferenceProtocolTest::name());
+
+static ParticipantInfo
+participant(const std::string& uri, const std::string& device, const std::string& sinkId)
+{
+    ParticipantInfo info;
+    info.uri = uri;
+    info.device = device;
+    info.sinkId = sinkId;
+    return info;
+}
+
+static Json::Value
+mediaOrder(Json::Value&& media)
+{
+    return ConfProtocolParser::mediaOrder("alice", "dev", "call_video_0", std::move(media));
+}
+
+void
+ConferenceProtocolTest::testForwardedOrders()
+{
+    std::vector<std::string> orders;
+    ConfProtocolParser parser;
+    parser.onCheckAuthorization([](std::string_view peerId) { return peerId == "host"; });
+    parser.onSetLayout([&](int) { orders.emplace_back("layout"); });
+    parser.onHangupParticipant([&](const std::string& uri, const std::string& device) {
+        orders.emplace_back("hangup " + uri + " " + device);
+    });
+    parser.onRaiseHand([&](const std::string& device, bool state) {
+        orders.emplace_back("raiseHand " + device + " " + (state ? "1" : "0"));
+    });
+    parser.onMuteStreamAudio([&](const std::string& uri,
+                                 const std::string& device,
+                                 const std::string& stream,
+                                 bool state) {
+        orders.emplace_back("mute " + uri + " " + device + " " + stream + " "
+                            + (state ? "1" : "0"));
+    });
+    parser.onSetActiveStream([&](const std::string& stream, bool state) {
+        orders.emplace_back("active " + stream + " " + (state ? "1" : "0"));
+    });
+
+    Json::Value media;
+    media["muteAudio"] = true;
+    parser.initData(mediaOrder(std::move(media)), "host");
+    parser.parse();
+    media = Json::Value();
+    media["active"] = true;
+    parser.initData(mediaOrder(std::move(media)), "host");
+    parser.parse();
+    Json::Value device;
+    device["raiseHand"] = false;
+    parser.initData(ConfProtocolParser::deviceOrder("alice", "dev", std::move(device)), "host");
+    parser.parse();
+    CPPUNIT_ASSERT((orders
+                    == std::vector<std::string> {"mute alice dev call_video_0 1",
+                                                 "active call_video_0 1",
+                                                 "raiseHand dev 0"}));
+
+    // Only from a moderator
+    orders.clear();
+    media = Json::Value();
+    media["muteAudio"] = true;
+    parser.initData(mediaOrder(std::move(media)), "bob");
+    parser.parse();
+    CPPUNIT_ASSERT(orders.empty());
+}
+
+void
+ConferenceProtocolTest::testMergeConfInfo()
+{
+    // Hosts A, B and C are linked, C also sends from A its participants known by B
+    ConfInfo info;
+    info.emplace_back(participant("a@ring.dht", "devA", "host_video_0"));
+    info.emplace_back(participant("alice@ring.dht", "devAlice", "ca_video_0"));
+    ConfInfo fromB;
+    fromB.emplace_back(participant("b@ring.dht", "devB", "host_video_0"));
+    fromB.emplace_back(participant("bob@ring.dht", "devBob", "cb_video_0"));
+    ConfInfo fromC;
+    fromC.emplace_back(participant("c@ring.dht", "devC", "host_video_0"));
+    fromC.emplace_back(participant("bob", "devBob", "cb_video_0"));
+    fromC.emplace_back(participant("alice@ring.dht", "devAlice", "ca_video_0"));
+
+    ConfProtocolParser::mergeConfInfo(info, fromB);
+    ConfProtocolParser::mergeConfInfo(info, fromC);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(5), info.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("b@ring.dht"), info[2].uri);
+    CPPUNIT_ASSERT_EQUAL(std::string("bob@ring.dht"), info[3].uri);
+    CPPUNIT_ASSERT_EQUAL(std::string("c@ring.dht"), info[4].uri);
+
+    // Another stream of a known device
+    ConfInfo screen;
+    screen.emplace_back(participant("bob@ring.dht", "devBob", "cb_video_1"));
+    ConfProtocolParser::mergeConfInfo(info, screen);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(6), info.size());
+}
+
+void
+ConferenceProtocolTest::testConfInfoDelta()
+{
+    ConfInfo base;
+    base.w = 1280;
+    base.h = 720;
+    base.emplace_back(participant("a@ring.dht", "devA", "host_video_0"));
+    base.emplace_back(participant("alice@ring.dht", "devAlice", "ca_video_0"));
+    base.emplace_back(participant("bob@ring.dht", "devBob", "cb_video_0"));
+    CPPUNIT_ASSERT(ConfProtocolParser::confInfoDelta(base, base).isNull());
+
+    // Alice raises her hand, Bob leaves and Carla joins
+    ConfInfo info = base;
+    info[1].handRaised = true;
+    info.pop_back();
+    info.emplace_back(participant("carla@ring.dht", "devCarla", "cc_video_0"));
+    auto delta = ConfProtocolParser::confInfoDelta(base, info);
+    CPPUNIT_ASSERT(not delta.isMember("p"));
+    CPPUNIT_ASSERT_EQUAL(2u, delta["u"].size());
+    CPPUNIT_ASSERT_EQUAL(1u, delta["r"].size());
+    CPPUNIT_ASSERT(not delta.isMember("w"));
+    ConfInfo received = base;
+    ConfProtocolParser::applyConfInfoDelta(received, delta);
+    CPPUNIT_ASSERT(received == info);
+    CPPUNIT_ASSERT_EQUAL(std::string("carla@ring.dht"), received[2].uri);
+
+    // In another order, with another size
+    info.w = 640;
+    std::swap(info[0], info[1]);
+    delta = ConfProtocolParser::confInfoDelta(received, info);
+    CPPUNIT_ASSERT_EQUAL(3u, delta["p"].size());
+    ConfProtocolParser::applyConfInfoDelta(received, delta);
+    CPPUNIT_ASSERT(received == info);
+    CPPUNIT_ASSERT_EQUAL(std::string("alice@ring.dht"), received[0].uri);
+    CPPUNIT_ASSERT_EQUAL(640, received.w);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::ConferenceProtocolTest::name());
@@ -37,10 +37,12 @@ public:
 private:
     void trustStoreTest();
     void getCertificateWithSplitted();
+    void testLazyLoading();
 
     CPPUNIT_TEST_SUITE(CertStoreTest);
     CPPUNIT_TEST(trustStoreTest);
     CPPUNIT_TEST(getCertificateWithSplitted);
+    CPPUNIT_TEST(testLazyLoading);
     CPPUNIT_TEST_SUITE_END();
 };
 
@@ -184,6 +186,31 @@ CertStoreTest::getCertificateWithSplitted()
                    && fullCert->issuer->issuer->getUID() == caCert->getUID());
 }
 
+void
+CertStoreTest::testLazyLoading()
+{
+    auto account = dht::crypto::generateIdentity("test account", {}, 4096, true);
+    auto device = dht::crypto::generateIdentity("test device", account);
+    auto id = device.second->getId().toString();
+    jami::tls::CertificateStore::instance().pinCertificate(device.second);
+
+    // A new store only reads the index
+    jami::tls::CertificateStore certStore;
+    auto pinned = certStore.getPinnedCertificates();
+    CPPUNIT_ASSERT(std::find(pinned.begin(), pinned.end(), id) != pinned.end());
+    CPPUNIT_ASSERT(std::find(pinned.begin(), pinned.end(), account.second->getId().toString())
+                   != pinned.end());
+
+    auto cert = certStore.getCertificate(id);
+    CPPUNIT_ASSERT(cert && cert->getId() == device.second->getId());
+    CPPUNIT_ASSERT(cert->issuer && cert->issuer->getId() == account.second->getId());
+    CPPUNIT_ASSERT(certStore.findCertificateByUID(account.second->getUID()));
+    CPPUNIT_ASSERT(certStore.getCertificate(device.second->getLongId().toString()) == cert);
+
+    CPPUNIT_ASSERT(certStore.unpinCertificate(device.second->getLongId().toString()));
+    CPPUNIT_ASSERT(!jami::tls::CertificateStore().getCertificate(id));
+}
+
 } // namespace test
 } // namespace jami
 
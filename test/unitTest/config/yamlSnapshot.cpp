@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "config/yaml_snapshot.h"
+#include "fileutils.h"
+#include "../../test_runner.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+static constexpr const char* CONFIG = R"(accounts:
+  - id: a
+    enabled: true
+    codecs: [1, 2, 3]
+    empty:
+    quoted: ""
+preferences:
+  order: a/b
+)";
+
+class YamlSnapshotTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "YamlSnapshot"; }
+
+    void tearDown();
+
+private:
+    void testRoundTrip();
+    void testLoadFile();
+
+    CPPUNIT_TEST_SUITE(YamlSnapshotTest);
+    CPPUNIT_TEST(testRoundTrip);
+    CPPUNIT_TEST(testLoadFile);
+    CPPUNIT_TEST_SUITE_END();
+
+    const std::string path_ {fileutils::get_cache_dir() + DIR_SEPARATOR_STR + "snapshot_test.yml"};
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(YamlSnapshotTest, YamlSnapshotTest::name());
+
+void
+YamlSnapshotTest::tearDown()
+{
+    fileutils::remove(path_);
+    fileutils::remove(yaml_utils::snapshotPath(path_));
+}
+
+static void
+checkConfig(const YAML::Node& root, const std::string& order)
+{
+    const auto& account = root["accounts"][0];
+    CPPUNIT_ASSERT_EQUAL(std::string("a"), account["id"].as<std::string>());
+    CPPUNIT_ASSERT(account["enabled"].as<bool>());
+    CPPUNIT_ASSERT_EQUAL(3, account["codecs"][2].as<int>());
+    CPPUNIT_ASSERT(account["empty"].IsNull());
+    CPPUNIT_ASSERT(account["quoted"].IsScalar());
+    CPPUNIT_ASSERT(not account["missing"]);
+    CPPUNIT_ASSERT_EQUAL(order, root["preferences"]["order"].as<std::string>());
+}
+
+void
+YamlSnapshotTest::testRoundTrip()
+{
+    auto root = YAML::Load(CONFIG);
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> pk(&buffer);
+    yaml_utils::packNode(pk, root);
+
+    auto oh = msgpack::unpack(buffer.data(), buffer.size());
+    checkConfig(yaml_utils::unpackNode(oh.get()), "a/b");
+}
+
+static void
+waitForFile(const std::string& path)
+{
+    for (auto i = 0; i < 100 and not fileutils::isFile(path); ++i)
+        std::this_thread::sleep_for(50ms);
+    CPPUNIT_ASSERT(fileutils::isFile(path));
+}
+
+void
+YamlSnapshotTest::testLoadFile()
+{
+    fileutils::recursive_mkdir(fileutils::get_cache_dir());
+    CPPUNIT_ASSERT(yaml_utils::loadFile(path_).IsNull());
+
+    std::string config(CONFIG);
+    fileutils::saveFile(path_, reinterpret_cast<const uint8_t*>(config.data()), config.size());
+    checkConfig(yaml_utils::loadFile(path_), "a/b");
+    auto snapshot = yaml_utils::snapshotPath(path_);
+    waitForFile(snapshot);
+
+    // Read from the snapshot
+    checkConfig(yaml_utils::loadFile(path_), "a/b");
+
+    // Modified within the same second, with the same size: the hash differs
+    config.replace(config.find("a/b"), 3, "b/a");
+    fileutils::saveFile(path_, reinterpret_cast<const uint8_t*>(config.data()), config.size());
+    checkConfig(yaml_utils::loadFile(path_), "b/a");
+
+    // Corrupted snapshot
+    fileutils::remove(snapshot);
+    std::vector<uint8_t> garbage {0x95, 0x01, 0x02};
+    fileutils::saveFile(snapshot, garbage);
+    checkConfig(yaml_utils::loadFile(path_), "b/a");
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::YamlSnapshotTest::name());
@@ -0,0 +1,97 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "jamidht/channel_handler_registry.h"
+#include "../../test_runner.h"
+
+namespace jami {
+namespace test {
+
+class ChannelHandlerRegistryTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "ChannelHandlerRegistry"; }
+
+private:
+    void testMatch();
+    void testReplace();
+
+    CPPUNIT_TEST_SUITE(ChannelHandlerRegistryTest);
+    CPPUNIT_TEST(testMatch);
+    CPPUNIT_TEST(testReplace);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(ChannelHandlerRegistryTest,
+                                      ChannelHandlerRegistryTest::name());
+
+static std::shared_ptr<ChannelCallbacks>
+handler()
+{
+    return std::make_shared<ChannelCallbacks>([](const auto&, const auto&) { return true; },
+                                              nullptr);
+}
+
+void
+ChannelHandlerRegistryTest::testMatch()
+{
+    ChannelHandlerRegistry registry;
+    auto git = handler();
+    auto sip = handler();
+    registry.add("git://", git);
+    registry.add("sip", sip);
+
+    CPPUNIT_ASSERT(registry.find("git://device/conversation") == git);
+    CPPUNIT_ASSERT(registry.find("git://") == git);
+    CPPUNIT_ASSERT(registry.find("sip") == sip);
+    CPPUNIT_ASSERT(not registry.find("sip2"));
+    CPPUNIT_ASSERT(not registry.find("git:/device"));
+    CPPUNIT_ASSERT(not registry.find("gitx://device"));
+    CPPUNIT_ASSERT(not registry.find("sync://device"));
+    CPPUNIT_ASSERT(registry.get("git://") == git);
+    CPPUNIT_ASSERT(not registry.get("git://device"));
+    CPPUNIT_ASSERT(registry.find("git://")->onRequest(nullptr, "git://"));
+}
+
+void
+ChannelHandlerRegistryTest::testReplace()
+{
+    ChannelHandlerRegistry registry;
+    auto first = handler();
+    auto second = handler();
+    registry.add("vcard://", first);
+    // Kept by the previous lookups
+    auto found = registry.find("vcard://1");
+    registry.add("vcard://", second);
+    CPPUNIT_ASSERT(found == first);
+    CPPUNIT_ASSERT(registry.find("vcard://1") == second);
+
+    registry.remove("vcard://");
+    CPPUNIT_ASSERT(not registry.find("vcard://1"));
+    registry.add("sip", first);
+    registry.clear();
+    CPPUNIT_ASSERT(not registry.find("sip"));
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::ChannelHandlerRegistryTest::name());
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "jamidht/channel_write_scheduler.h"
+#include "../../test_runner.h"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+class ChannelWriteSchedulerTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "ChannelWriteScheduler"; }
+
+private:
+    void testPriorities();
+    void testUrgentFirst();
+    void testWeightedBulk();
+
+    CPPUNIT_TEST_SUITE(ChannelWriteSchedulerTest);
+    CPPUNIT_TEST(testPriorities);
+    CPPUNIT_TEST(testUrgentFirst);
+    CPPUNIT_TEST(testWeightedBulk);
+    CPPUNIT_TEST_SUITE_END();
+
+    /**
+     * Queue one writer per priority while the endpoint is taken, one after the
+     * other, then return the order in which they were served.
+     */
+    std::vector<ChannelPriority> serve(const std::vector<ChannelPriority>& writers,
+                                       std::size_t size);
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(ChannelWriteSchedulerTest, ChannelWriteSchedulerTest::name());
+
+std::vector<ChannelPriority>
+ChannelWriteSchedulerTest::serve(const std::vector<ChannelPriority>& writers, std::size_t size)
+{
+    ChannelWriteScheduler scheduler;
+    std::mutex mtx;
+    std::vector<ChannelPriority> order;
+    std::vector<std::thread> threads;
+
+    scheduler.acquire(ChannelPriority::CONTROL, 0);
+    for (auto priority : writers) {
+        threads.emplace_back([&, priority] {
+            ChannelWriteScheduler::Guard turn(scheduler, priority, size);
+            std::lock_guard<std::mutex> lk(mtx);
+            order.emplace_back(priority);
+        });
+        // Keep the arrival order
+        std::this_thread::sleep_for(10ms);
+    }
+    scheduler.release();
+    for (auto& t : threads)
+        t.join();
+    return order;
+}
+
+void
+ChannelWriteSchedulerTest::testPriorities()
+{
+    CPPUNIT_ASSERT(channelPriority("sip") == ChannelPriority::SIP);
+    CPPUNIT_ASSERT(channelPriority("sync") == ChannelPriority::SYNC);
+    CPPUNIT_ASSERT(channelPriority("git://device/conversation") == ChannelPriority::GIT);
+    CPPUNIT_ASSERT(channelPriority("file://1234") == ChannelPriority::FILE);
+    CPPUNIT_ASSERT(channelPriority("data-transfer://1234") == ChannelPriority::FILE);
+    CPPUNIT_ASSERT(channelPriority("vcard://1234") == ChannelPriority::SYNC);
+    CPPUNIT_ASSERT(channelPriority("datagram://presence") == ChannelPriority::DATAGRAM);
+    CPPUNIT_ASSERT(ChannelWriteScheduler::maxChunkSize(ChannelPriority::FILE)
+                   < ChannelWriteScheduler::maxChunkSize(ChannelPriority::SIP));
+}
+
+void
+ChannelWriteSchedulerTest::testUrgentFirst()
+{
+    auto order = serve({ChannelPriority::FILE,
+                        ChannelPriority::GIT,
+                        ChannelPriority::SIP,
+                        ChannelPriority::CONTROL},
+                       1024);
+    CPPUNIT_ASSERT(order.size() == 4);
+    CPPUNIT_ASSERT(order[0] == ChannelPriority::CONTROL);
+    CPPUNIT_ASSERT(order[1] == ChannelPriority::SIP);
+}
+
+void
+ChannelWriteSchedulerTest::testWeightedBulk()
+{
+    std::vector<ChannelPriority> writers;
+    for (int i = 0; i < 8; ++i)
+        writers.emplace_back(ChannelPriority::FILE);
+    for (int i = 0; i < 8; ++i)
+        writers.emplace_back(ChannelPriority::SYNC);
+
+    auto order = serve(writers,
+                       ChannelWriteScheduler::maxChunkSize(ChannelPriority::FILE));
+    CPPUNIT_ASSERT(order.size() == writers.size());
+    // Sync gets 4 chunks per file chunk, file is not starved
+    int sync = 0, file = 0;
+    for (std::size_t i = 0; i < 5; ++i)
+        (order[i] == ChannelPriority::SYNC ? sync : file)++;
+    CPPUNIT_ASSERT(sync == 4 and file == 1);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::ChannelWriteSchedulerTest::name())
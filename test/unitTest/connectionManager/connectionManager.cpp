@@ -63,6 +63,7 @@ private:
     void testMultipleChannelsSameName();
     void testDeclineConnection();
     void testSendReceiveData();
+    void testWriteFromRecvCallback();
     void testAcceptsICERequest();
     void testDeclineICERequest();
     void testChannelRcvShutdown();
@@ -77,6 +78,10 @@ private:
     void testConnectivityChangeTriggerBeacon();
     void testOnNoBeaconTriggersShutdown();
     void testShutdownWhileNegotiating();
+    void testFlowControl();
+    void testEarlyData();
+    void testDatagramChannel();
+    void testTlsFailureOfBothConnections();
 
     CPPUNIT_TEST_SUITE(ConnectionManagerTest);
     CPPUNIT_TEST(testConnectDevice);
@@ -86,6 +91,7 @@ private:
     CPPUNIT_TEST(testMultipleChannelsSameName);
     CPPUNIT_TEST(testDeclineConnection);
     CPPUNIT_TEST(testSendReceiveData);
+    CPPUNIT_TEST(testWriteFromRecvCallback);
     CPPUNIT_TEST(testAcceptsICERequest);
     CPPUNIT_TEST(testDeclineICERequest);
     CPPUNIT_TEST(testChannelRcvShutdown);
@@ -100,6 +106,10 @@ private:
     CPPUNIT_TEST(testConnectivityChangeTriggerBeacon);
     CPPUNIT_TEST(testOnNoBeaconTriggersShutdown);
     CPPUNIT_TEST(testShutdownWhileNegotiating);
+    CPPUNIT_TEST(testFlowControl);
+    CPPUNIT_TEST(testEarlyData);
+    CPPUNIT_TEST(testDatagramChannel);
+    CPPUNIT_TEST(testTlsFailureOfBothConnections);
     CPPUNIT_TEST_SUITE_END();
 };
 
@@ -443,6 +453,69 @@ ConnectionManagerTest::testSendReceiveData()
     }));
 }
 
+void
+ConnectionManagerTest::testWriteFromRecvCallback()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+    auto bobDeviceId = DeviceId(std::string(bobAccount->currentDeviceId()));
+
+    bobAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+    aliceAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lk {mtx};
+    std::condition_variable cv;
+    std::shared_ptr<ChannelSocket> aliceSocket, bobSocket;
+    std::vector<uint8_t> echoed;
+    const std::vector<uint8_t> data {0x68, 0x69, 0x70, 0x71};
+
+    bobAccount->connectionManager().onChannelRequest(
+        [](const std::shared_ptr<dht::crypto::Certificate>&, const std::string&) { return true; });
+    bobAccount->connectionManager().onConnectionReady(
+        [&](const DeviceId&, const std::string& name, std::shared_ptr<ChannelSocket> socket) {
+            if (not socket or name != "echo")
+                return;
+            // Written from the event loop of the socket, as GitServer does
+            socket->setOnRecv([w = std::weak_ptr<ChannelSocket>(socket)](const uint8_t* buf,
+                                                                        size_t len) {
+                if (auto socket = w.lock()) {
+                    std::error_code ec;
+                    socket->write(buf, len, ec);
+                }
+                return len;
+            });
+            bobSocket = socket;
+        });
+
+    aliceAccount->connectionManager().connectDevice(bobDeviceId,
+                                                    "echo",
+                                                    [&](std::shared_ptr<ChannelSocket> socket,
+                                                        const DeviceId&) {
+                                                        std::lock_guard<std::mutex> lk {mtx};
+                                                        aliceSocket = socket;
+                                                        cv.notify_one();
+                                                    });
+    CPPUNIT_ASSERT(cv.wait_for(lk, 60s, [&] { return aliceSocket != nullptr; }));
+    aliceSocket->setOnRecv([&](const uint8_t* buf, size_t len) {
+        std::lock_guard<std::mutex> lk {mtx};
+        echoed.insert(echoed.end(), buf, buf + len);
+        cv.notify_one();
+        return len;
+    });
+
+    // Twice, the second echo needs the event loop of bob not to be stuck in the first one
+    for (auto i = 0; i < 2; ++i) {
+        std::error_code ec;
+        aliceSocket->write(data.data(), data.size(), ec);
+        CPPUNIT_ASSERT(!ec);
+        CPPUNIT_ASSERT(
+            cv.wait_for(lk, 10s, [&] { return echoed.size() == (i + 1) * data.size(); }));
+    }
+    CPPUNIT_ASSERT(std::equal(data.begin(), data.end(), echoed.begin()));
+    aliceSocket->setOnRecv({});
+}
+
 void
 ConnectionManagerTest::testDeclineConnection()
 {
@@ -1264,6 +1337,241 @@ ConnectionManagerTest::testShutdownWhileNegotiating()
     CPPUNIT_ASSERT(cv.wait_for(lk, 30s, [&] { return notConnected; }));
 }
 
+void
+ConnectionManagerTest::testFlowControl()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+    auto bobDeviceId = DeviceId(std::string(bobAccount->currentDeviceId()));
+
+    bobAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+    aliceAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lk {mtx};
+    std::condition_variable cv;
+    std::shared_ptr<ChannelSocket> aliceChannel, bobChannel;
+
+    bobAccount->connectionManager().onChannelRequest(
+        [&](const std::shared_ptr<dht::crypto::Certificate>&, const std::string&) { return true; });
+    bobAccount->connectionManager().onConnectionReady(
+        [&](const DeviceId&, const std::string& name, std::shared_ptr<ChannelSocket> socket) {
+            if (socket && name == "file://flow") {
+                std::lock_guard<std::mutex> lk {mtx};
+                bobChannel = socket;
+            }
+            cv.notify_one();
+        });
+
+    aliceAccount->connectionManager().connectDevice(bobDeviceId,
+                                                    "file://flow",
+                                                    [&](std::shared_ptr<ChannelSocket> socket,
+                                                        const DeviceId&) {
+                                                        std::lock_guard<std::mutex> lk {mtx};
+                                                        aliceChannel = socket;
+                                                        cv.notify_one();
+                                                    });
+    CPPUNIT_ASSERT(cv.wait_for(lk, 30s, [&] { return aliceChannel && bobChannel; }));
+    lk.unlock();
+    // Flow control is negotiated with the version
+    for (int i = 0; i < 100 && !aliceChannel->underlyingSocket()->canSendBeacon(); ++i)
+        std::this_thread::sleep_for(100ms);
+    CPPUNIT_ASSERT(aliceChannel->underlyingSocket()->canSendBeacon());
+
+    // Bob doesn't read, so Alice must stop after a window
+    constexpr std::size_t TOTAL = 4 * DEFAULT_CHANNEL_WINDOW;
+    std::atomic_bool written {false};
+    std::thread writer([&] {
+        std::vector<uint8_t> data(TOTAL, 'A');
+        std::error_code ec;
+        aliceChannel->write(data.data(), data.size(), ec);
+        written = true;
+    });
+    std::this_thread::sleep_for(3s);
+    std::error_code ec;
+    CPPUNIT_ASSERT(!written);
+    CPPUNIT_ASSERT(bobChannel->waitForData(0ms, ec) <= (int) DEFAULT_CHANNEL_WINDOW);
+
+    // Reading unblocks Alice
+    std::size_t received = 0;
+    std::vector<uint8_t> buf(64 * 1024);
+    auto deadline = std::chrono::steady_clock::now() + 60s;
+    while (received < TOTAL && std::chrono::steady_clock::now() < deadline) {
+        if (bobChannel->waitForData(100ms, ec) > 0)
+            received += bobChannel->read(buf.data(), buf.size(), ec);
+    }
+    writer.join();
+    CPPUNIT_ASSERT(written);
+    CPPUNIT_ASSERT(received == TOTAL);
+}
+
+void
+ConnectionManagerTest::testEarlyData()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+    auto bobDeviceId = DeviceId(std::string(bobAccount->currentDeviceId()));
+
+    bobAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+    aliceAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lk {mtx};
+    std::condition_variable cv;
+    std::atomic_bool accepted {false}, connectedBeforeAccept {false}, dataOk {false};
+    const uint8_t buf_test[] = {0x68, 0x69, 0x70, 0x71};
+
+    bobAccount->connectionManager().onChannelRequest(
+        [&](const std::shared_ptr<dht::crypto::Certificate>&, const std::string&) {
+            // Let Alice's data arrive first
+            std::this_thread::sleep_for(2s);
+            accepted = true;
+            return true;
+        });
+    bobAccount->connectionManager().onConnectionReady(
+        [&](const DeviceId&, const std::string& name, std::shared_ptr<ChannelSocket> socket) {
+            if (!socket || name != "git://*")
+                return;
+            std::error_code ec;
+            if (socket->waitForData(5s, ec) == 4) {
+                uint8_t buf[4];
+                socket->read(&buf[0], 4, ec);
+                dataOk = std::equal(std::begin(buf), std::end(buf), std::begin(buf_test));
+            }
+            cv.notify_one();
+        });
+
+    aliceAccount->connectionManager().connectDevice(
+        bobDeviceId,
+        "git://*",
+        [&](std::shared_ptr<ChannelSocket> socket, const DeviceId&) {
+            if (socket) {
+                connectedBeforeAccept = !accepted;
+                std::error_code ec;
+                socket->write(&buf_test[0], 4, ec);
+            }
+            cv.notify_one();
+        },
+        false,
+        false,
+        "",
+        true);
+    CPPUNIT_ASSERT(cv.wait_for(lk, 60s, [&] { return dataOk.load(); }));
+    CPPUNIT_ASSERT(connectedBeforeAccept);
+}
+
+void
+ConnectionManagerTest::testDatagramChannel()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+    auto bobDeviceId = DeviceId(std::string(bobAccount->currentDeviceId()));
+
+    bobAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+    aliceAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lk {mtx};
+    std::condition_variable cv;
+    std::shared_ptr<ChannelSocket> aliceChannel;
+    std::vector<std::vector<uint8_t>> messages;
+    std::atomic_bool bobReady {false};
+
+    bobAccount->connectionManager().onChannelRequest(
+        [](const std::shared_ptr<dht::crypto::Certificate>&, const std::string&) { return true; });
+    bobAccount->connectionManager().onConnectionReady(
+        [&](const DeviceId&, const std::string& name, std::shared_ptr<ChannelSocket> socket) {
+            if (!socket || name != "datagram://presence")
+                return;
+            socket->setOnRecv([&](const uint8_t* data, size_t size) {
+                std::lock_guard<std::mutex> lk {mtx};
+                messages.emplace_back(data, data + size);
+                cv.notify_one();
+                return size;
+            });
+            bobReady = true;
+            cv.notify_one();
+        });
+
+    aliceAccount->connectionManager().connectDevice(bobDeviceId,
+                                                    "datagram://presence",
+                                                    [&](std::shared_ptr<ChannelSocket> socket,
+                                                        const DeviceId&) {
+                                                        std::lock_guard<std::mutex> lk {mtx};
+                                                        aliceChannel = socket;
+                                                        cv.notify_one();
+                                                    });
+    CPPUNIT_ASSERT(cv.wait_for(lk, 30s, [&] { return aliceChannel && bobReady; }));
+    CPPUNIT_ASSERT(!aliceChannel->isReliable());
+    lk.unlock();
+
+    std::error_code ec;
+    std::vector<uint8_t> tooBig(UINT16_MAX + 1);
+    aliceChannel->write(tooBig.data(), tooBig.size(), ec);
+    CPPUNIT_ASSERT(ec == std::errc::message_size);
+
+    // Messages are delivered whole, in order, and the last one is never dropped
+    for (uint8_t i = 0; i < 50; ++i) {
+        std::vector<uint8_t> message(100, i);
+        ec = {};
+        CPPUNIT_ASSERT(aliceChannel->write(message.data(), message.size(), ec) == message.size());
+    }
+
+    lk.lock();
+    CPPUNIT_ASSERT(
+        cv.wait_for(lk, 30s, [&] { return !messages.empty() && messages.back()[0] == 49; }));
+    int last = -1;
+    for (const auto& message : messages) {
+        CPPUNIT_ASSERT(message.size() == 100);
+        CPPUNIT_ASSERT(std::all_of(message.begin(), message.end(), [&](auto b) {
+            return b == message[0];
+        }));
+        CPPUNIT_ASSERT(message[0] > last);
+        last = message[0];
+    }
+}
+
+void
+ConnectionManagerTest::testTlsFailureOfBothConnections()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+
+    bobAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+    aliceAccount->connectionManager().onICERequest([](const DeviceId&) { return true; });
+    bobAccount->connectionManager().onChannelRequest(
+        [](const std::shared_ptr<dht::crypto::Certificate>&, const std::string&) { return true; });
+
+    // Same key, so same device, but not the certificate presented by bob: both the early
+    // and the full connections fail their TLS handshake
+    auto bobIdentity = bobAccount->identity();
+    auto forged = std::make_shared<dht::crypto::Certificate>(
+        dht::crypto::Certificate::generate(*bobIdentity.first, "bob"));
+    CPPUNIT_ASSERT(forged->getLongId() == bobIdentity.second->getLongId());
+
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lk {mtx};
+    std::condition_variable cv;
+    int called = 0;
+    bool successfullyConnected = false;
+    aliceAccount->connectionManager().connectDevice(forged,
+                                                    "git://*",
+                                                    [&](std::shared_ptr<ChannelSocket> socket,
+                                                        const DeviceId&) {
+                                                        std::lock_guard<std::mutex> lk {mtx};
+                                                        called++;
+                                                        if (socket)
+                                                            successfullyConnected = true;
+                                                        cv.notify_one();
+                                                    });
+    CPPUNIT_ASSERT(cv.wait_for(lk, 60s, [&] { return called > 0; }));
+    CPPUNIT_ASSERT(!successfullyConnected);
+    // Called once, and nothing is left negotiating
+    CPPUNIT_ASSERT(!cv.wait_for(lk, 5s, [&] { return called > 1; }));
+    CPPUNIT_ASSERT(!aliceAccount->connectionManager().isConnecting(bobIdentity.second->getLongId(),
+                                                                   "git://*"));
+}
+
 } // namespace test
 } // namespace jami
 
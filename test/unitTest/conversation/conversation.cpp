@@ -35,6 +35,7 @@
 #include "common.h"
 #include "conversation/conversationcommon.h"
 #include "fileutils.h"
+#include "jamidht/conversation.h"
 #include "jami.h"
 #include "manager.h"
 #include "security/certstore.h"
@@ -112,6 +113,8 @@ private:
     void testRemoveReaddMultipleDevice();
     void testSendReply();
     void testSearchInConv();
+    void testSendMessagesPipeline();
+    void testClearPendingFetchEndsSync();
 
     CPPUNIT_TEST_SUITE(ConversationTest);
     CPPUNIT_TEST(testCreateConversation);
@@ -154,6 +157,8 @@ private:
     CPPUNIT_TEST(testRemoveReaddMultipleDevice);
     CPPUNIT_TEST(testSendReply);
     CPPUNIT_TEST(testSearchInConv);
+    CPPUNIT_TEST(testSendMessagesPipeline);
+    CPPUNIT_TEST(testClearPendingFetchEndsSync);
     CPPUNIT_TEST_SUITE_END();
 };
 
@@ -3175,6 +3180,113 @@ ConversationTest::testSearchInConv()
     CPPUNIT_ASSERT(cv.wait_for(lk, 30s, [&]() { return messages.size() == 0 && finished; }));
 }
 
+void
+ConversationTest::testSendMessagesPipeline()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto conversation = std::make_shared<Conversation>(aliceAccount->weak(),
+                                                       ConversationMode::INVITES_ONLY);
+    auto convId = conversation->id();
+
+    constexpr int MESSAGES = 20;
+    std::mutex mtx;
+    std::vector<std::string> committed;
+    std::vector<std::future<std::string>> futures;
+    for (int i = 0; i < MESSAGES; ++i)
+        futures.emplace_back(conversation->sendMessage("message " + std::to_string(i),
+                                                       "text/plain",
+                                                       "",
+                                                       [&](bool ok, const std::string& commitId) {
+                                                           std::lock_guard<std::mutex> lk(mtx);
+                                                           if (ok)
+                                                               committed.emplace_back(commitId);
+                                                       }));
+    // As if evicted while the messages are committed
+    std::weak_ptr<Conversation> weak = conversation;
+    conversation.reset();
+
+    std::vector<std::string> ids;
+    for (auto& future : futures) {
+        CPPUNIT_ASSERT(future.wait_for(30s) == std::future_status::ready);
+        ids.emplace_back(future.get());
+        CPPUNIT_ASSERT(!ids.back().empty());
+    }
+    {
+        // Called once per message, in order
+        std::lock_guard<std::mutex> lk(mtx);
+        CPPUNIT_ASSERT(committed == ids);
+    }
+    // Released once the messages are committed
+    for (int i = 0; i < 50 && !weak.expired(); ++i)
+        std::this_thread::sleep_for(100ms);
+    CPPUNIT_ASSERT(weak.expired());
+
+    // Every message is in the history, in order, on top of the initial commit
+    ConversationRepository repository(aliceAccount->weak(), convId);
+    auto commits = repository.logN("", MESSAGES + 1);
+    CPPUNIT_ASSERT(commits.size() == MESSAGES + 1);
+    for (int i = 0; i < MESSAGES; ++i) {
+        const auto& commit = commits[MESSAGES - 1 - i];
+        CPPUNIT_ASSERT(commit.id == ids[i]);
+        CPPUNIT_ASSERT(commit.commit_msg.find("message " + std::to_string(i)) != std::string::npos);
+    }
+    CPPUNIT_ASSERT(commits[MESSAGES].parents.empty());
+}
+
+void
+ConversationTest::testClearPendingFetchEndsSync()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+    auto aliceUri = aliceAccount->getUsername();
+    auto bobUri = bobAccount->getUsername();
+
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lk {mtx};
+    std::condition_variable cv;
+    std::map<std::string, std::shared_ptr<DRing::CallbackWrapperBase>> confHandlers;
+    bool requestReceived = false, conversationReady = false, syncFinished = false;
+    confHandlers.insert(
+        DRing::exportable_callback<DRing::ConversationSignal::ConversationRequestReceived>(
+            [&](const std::string& /*accountId*/,
+                const std::string& /* conversationId */,
+                std::map<std::string, std::string> /*metadatas*/) {
+                requestReceived = true;
+                cv.notify_one();
+            }));
+    confHandlers.insert(DRing::exportable_callback<DRing::ConversationSignal::ConversationReady>(
+        [&](const std::string& accountId, const std::string& /* conversationId */) {
+            if (accountId == bobId) {
+                conversationReady = true;
+                cv.notify_one();
+            }
+        }));
+    confHandlers.insert(
+        DRing::exportable_callback<DRing::ConversationSignal::ConversationSyncFinished>(
+            [&](const std::string& accountId) {
+                if (accountId == bobId) {
+                    syncFinished = true;
+                    cv.notify_one();
+                }
+            }));
+    DRing::registerSignalHandlers(confHandlers);
+
+    auto convId = DRing::startConversation(aliceId);
+    DRing::addConversationMember(aliceId, convId, bobUri);
+    CPPUNIT_ASSERT(cv.wait_for(lk, 30s, [&]() { return requestReceived; }));
+    DRing::acceptConversationRequest(bobId, convId);
+    CPPUNIT_ASSERT(cv.wait_for(lk, 30s, [&]() { return conversationReady; }));
+    // Wait for the fetches of the clone to end
+    cv.wait_for(lk, 30s, [&]() { return syncFinished; });
+
+    // A fetch from an unknown device is still connecting when cleared
+    syncFinished = false;
+    std::string unknownDevice(40, 'a');
+    bobAccount->convModule()->onNewCommit(aliceUri, unknownDevice, convId, "");
+    bobAccount->convModule()->clearPendingFetch();
+    CPPUNIT_ASSERT(cv.wait_for(lk, 5s, [&]() { return syncFinished; }));
+}
+
 } // namespace test
 } // namespace jami
 
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "jamidht/conversation_maintenance.h"
+#include "../../test_runner.h"
+
+#include <string>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+class ConversationMaintenanceTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "ConversationMaintenance"; }
+
+private:
+    void testOrder();
+    void testBudget();
+
+    CPPUNIT_TEST_SUITE(ConversationMaintenanceTest);
+    CPPUNIT_TEST(testOrder);
+    CPPUNIT_TEST(testBudget);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(ConversationMaintenanceTest,
+                                      ConversationMaintenanceTest::name());
+
+void
+ConversationMaintenanceTest::testOrder()
+{
+    ConversationMaintenance maintenance(1h, 10s);
+    auto now = ConversationMaintenance::clock::now();
+    std::vector<std::string> conversations {"a", "b", "c"};
+
+    CPPUNIT_ASSERT(maintenance.pass(conversations, now) == conversations);
+    maintenance.done("b", 1s, now);
+    maintenance.done("a", 1s, now + 10min);
+
+    // Never maintained first, then the oldest one, once per interval
+    now += 30min;
+    CPPUNIT_ASSERT((maintenance.pass(conversations, now) == std::vector<std::string> {"c"}));
+    now += 35min;
+    CPPUNIT_ASSERT((maintenance.pass(conversations, now) == std::vector<std::string> {"c", "b"}));
+    now += 10min;
+    CPPUNIT_ASSERT(
+        (maintenance.pass(conversations, now) == std::vector<std::string> {"c", "b", "a"}));
+
+    // Removed conversations are forgotten
+    CPPUNIT_ASSERT((maintenance.pass({"c"}, now) == std::vector<std::string> {"c"}));
+    CPPUNIT_ASSERT((maintenance.pass(conversations, now) == conversations));
+}
+
+void
+ConversationMaintenanceTest::testBudget()
+{
+    ConversationMaintenance maintenance(1h, 3s);
+    auto now = ConversationMaintenance::clock::now();
+    maintenance.pass({"a", "b", "c"}, now);
+    CPPUNIT_ASSERT(maintenance.done("a", 1s, now));
+    CPPUNIT_ASSERT(!maintenance.done("b", 2s, now));
+
+    // Spent again from the start
+    CPPUNIT_ASSERT((maintenance.pass({"a", "b", "c"}, now) == std::vector<std::string> {"c"}));
+    CPPUNIT_ASSERT(maintenance.done("c", 2s, now));
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::ConversationMaintenanceTest::name())
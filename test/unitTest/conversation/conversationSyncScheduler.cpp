@@ -0,0 +1,173 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "jamidht/conversation_sync_scheduler.h"
+#include "../../test_runner.h"
+
+#include <map>
+#include <vector>
+
+namespace jami {
+namespace test {
+
+class ConversationSyncSchedulerTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "ConversationSyncScheduler"; }
+
+private:
+    void testLimits();
+    void testMostRecentFirst();
+    void testProgress();
+    void testClearCancels();
+
+    CPPUNIT_TEST_SUITE(ConversationSyncSchedulerTest);
+    CPPUNIT_TEST(testLimits);
+    CPPUNIT_TEST(testMostRecentFirst);
+    CPPUNIT_TEST(testProgress);
+    CPPUNIT_TEST(testClearCancels);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(ConversationSyncSchedulerTest,
+                                      ConversationSyncSchedulerTest::name());
+
+void
+ConversationSyncSchedulerTest::testLimits()
+{
+    ConversationSyncScheduler scheduler(2, 3);
+    std::map<std::string, int> running;
+    std::vector<ConversationSyncScheduler::DoneCb> dones;
+    // Tasks are started from done()
+    dones.reserve(8);
+    auto task = [&](const std::string& device) {
+        return [&, device](auto&& done) {
+            running[device]++;
+            dones.emplace_back(std::move(done));
+        };
+    };
+    for (int i = 0; i < 3; ++i)
+        scheduler.schedule("device1", 0, task("device1"));
+    scheduler.schedule("device2", 0, task("device2"));
+    scheduler.schedule("device2", 0, task("device2"));
+
+    // 2 for device1, then 1 for device2 for a total of 3
+    CPPUNIT_ASSERT(running["device1"] == 2);
+    CPPUNIT_ASSERT(running["device2"] == 1);
+    CPPUNIT_ASSERT(scheduler.pending() == 5);
+
+    // Calling done twice releases only one slot
+    dones[0]();
+    dones[0]();
+    CPPUNIT_ASSERT(running["device1"] == 3);
+    CPPUNIT_ASSERT(running["device2"] == 1);
+    CPPUNIT_ASSERT(scheduler.pending() == 4);
+
+    dones[1]();
+    CPPUNIT_ASSERT(running["device2"] == 2);
+}
+
+void
+ConversationSyncSchedulerTest::testMostRecentFirst()
+{
+    ConversationSyncScheduler scheduler(1, 1);
+    std::vector<int64_t> order;
+    ConversationSyncScheduler::DoneCb first;
+    scheduler.schedule("device", 0, [&](auto&& done) { first = std::move(done); });
+    for (auto priority : {10, 30, 20, 30})
+        scheduler.schedule("device", priority, [&, priority](auto&& done) {
+            order.emplace_back(priority);
+            // Finished from the task, the next one is started by the same loop
+            done();
+        });
+    CPPUNIT_ASSERT(order.empty());
+    first();
+    CPPUNIT_ASSERT((order == std::vector<int64_t> {30, 30, 20, 10}));
+    CPPUNIT_ASSERT(scheduler.pending() == 0);
+}
+
+void
+ConversationSyncSchedulerTest::testProgress()
+{
+    ConversationSyncScheduler scheduler(1, 1);
+    std::vector<std::pair<std::size_t, std::size_t>> progress;
+    scheduler.onProgress([&](auto done, auto total) { progress.emplace_back(done, total); });
+    std::vector<ConversationSyncScheduler::DoneCb> dones;
+    dones.reserve(8);
+    for (int i = 0; i < 2; ++i)
+        scheduler.schedule("device", 0, [&](auto&& done) { dones.emplace_back(std::move(done)); });
+    dones[0]();
+    dones[1]();
+    CPPUNIT_ASSERT(progress.size() == 2);
+    CPPUNIT_ASSERT(progress[0].first == 1 && progress[0].second == 2);
+    CPPUNIT_ASSERT(progress[1].first == 2 && progress[1].second == 2);
+
+    // Counted again from the start once idle
+    scheduler.schedule("device", 0, [&](auto&& done) { done(); });
+    CPPUNIT_ASSERT(progress.size() == 3);
+    CPPUNIT_ASSERT(progress[2].first == 1 && progress[2].second == 1);
+
+    // Forgotten tasks are ignored
+    scheduler.schedule("device", 0, [&](auto&& done) { dones.emplace_back(std::move(done)); });
+    scheduler.clear();
+    dones.back()();
+    CPPUNIT_ASSERT(progress.size() == 3);
+    CPPUNIT_ASSERT(scheduler.pending() == 0);
+}
+
+void
+ConversationSyncSchedulerTest::testClearCancels()
+{
+    ConversationSyncScheduler scheduler(1, 1);
+    int cancelled = 0;
+    int started = 0;
+    ConversationSyncScheduler::DoneCb running;
+    auto task = [&](auto&& done) {
+        started++;
+        running = std::move(done);
+    };
+    auto cancel = [&] { cancelled++; };
+    scheduler.schedule("device", 0, task, cancel);
+    scheduler.schedule("device", 0, task, cancel);
+    scheduler.schedule("device", 0, task, cancel);
+    CPPUNIT_ASSERT(started == 1);
+
+    // The running task and the queued ones are all cancelled
+    scheduler.clear();
+    CPPUNIT_ASSERT(cancelled == 3);
+    CPPUNIT_ASSERT(scheduler.pending() == 0);
+
+    // Not finished, nor cancelled again, once done
+    running();
+    scheduler.clear();
+    CPPUNIT_ASSERT(cancelled == 3);
+    CPPUNIT_ASSERT(started == 1);
+
+    // Finished tasks are not cancelled
+    scheduler.schedule("device", 0, [&](auto&& done) { done(); }, cancel);
+    scheduler.clear();
+    CPPUNIT_ASSERT(cancelled == 3);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::ConversationSyncSchedulerTest::name())
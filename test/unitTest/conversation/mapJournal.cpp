@@ -0,0 +1,191 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "jamidht/conversation.h"
+#include "jamidht/map_journal.h"
+#include "fileutils.h"
+#include "../../test_runner.h"
+
+#include <fstream>
+#include <unistd.h>
+
+namespace jami {
+namespace test {
+
+class MapJournalTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "MapJournal"; }
+
+    void setUp();
+    void tearDown();
+
+private:
+    void testAppendChanges();
+    void testCompaction();
+    void testInterruptedAppend();
+    void testInfoHashKeys();
+
+    CPPUNIT_TEST_SUITE(MapJournalTest);
+    CPPUNIT_TEST(testAppendChanges);
+    CPPUNIT_TEST(testCompaction);
+    CPPUNIT_TEST(testInterruptedAppend);
+    CPPUNIT_TEST(testInfoHashKeys);
+    CPPUNIT_TEST_SUITE_END();
+
+    static ConvInfo info(const std::string& id, std::time_t created)
+    {
+        ConvInfo info;
+        info.id = id;
+        info.created = created;
+        info.members = {"alice", "bob"};
+        return info;
+    }
+
+    std::string dir_;
+    std::string path_;
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(MapJournalTest, MapJournalTest::name());
+
+void
+MapJournalTest::setUp()
+{
+    char templateName[] = {"ring_unit_tests_XXXXXX"};
+    auto directory = mkdtemp(templateName);
+    CPPUNIT_ASSERT(directory);
+    dir_ = directory;
+    path_ = dir_ + DIR_SEPARATOR_STR + "convInfo";
+}
+
+void
+MapJournalTest::tearDown()
+{
+    fileutils::removeAll(dir_);
+}
+
+void
+MapJournalTest::testAppendChanges()
+{
+    std::map<std::string, ConvInfo> convInfos;
+    for (int i = 0; i < 100; ++i)
+        convInfos[std::to_string(i)] = info(std::to_string(i), i);
+    // Written like before the journal
+    MapJournal<ConvInfo>::write(path_, convInfos);
+    auto snapshotSize = fileutils::loadFile(path_).size();
+
+    MapJournal<ConvInfo> journal(path_);
+    convInfos["1"].removed = 42;
+    convInfos.erase("2");
+    convInfos["new"] = info("new", 100);
+    journal.save(convInfos);
+    journal.save(convInfos);
+
+    // Only the changes are written
+    CPPUNIT_ASSERT(fileutils::loadFile(path_).size() == snapshotSize);
+    CPPUNIT_ASSERT(fileutils::isFile(path_ + ".journal"));
+    CPPUNIT_ASSERT(fileutils::loadFile(path_ + ".journal").size() < snapshotSize / 10);
+
+    auto loaded = MapJournal<ConvInfo>::read(path_);
+    CPPUNIT_ASSERT(loaded.size() == convInfos.size());
+    CPPUNIT_ASSERT(loaded["1"].removed == 42);
+    CPPUNIT_ASSERT(loaded.find("2") == loaded.end());
+    CPPUNIT_ASSERT(loaded["new"].created == 100);
+    CPPUNIT_ASSERT(loaded["new"].members.size() == 2);
+}
+
+void
+MapJournalTest::testCompaction()
+{
+    std::map<std::string, ConvInfo> convInfos {{"a", info("a", 0)}};
+    MapJournal<ConvInfo> journal(path_);
+    journal.save(convInfos);
+    for (int i = 1; i < 200; ++i) {
+        convInfos["a"].created = i;
+        journal.save(convInfos);
+    }
+    // Compacted, the journal is shorter than the number of saves
+    auto journalSize = fileutils::isFile(path_ + ".journal")
+                           ? fileutils::loadFile(path_ + ".journal").size()
+                           : 0;
+    CPPUNIT_ASSERT(journalSize < 100 * fileutils::loadFile(path_).size());
+    CPPUNIT_ASSERT(MapJournal<ConvInfo>::read(path_)["a"].created == 199);
+}
+
+void
+MapJournalTest::testInterruptedAppend()
+{
+    std::map<std::string, ConvInfo> convInfos {{"a", info("a", 0)}, {"b", info("b", 0)}};
+    {
+        MapJournal<ConvInfo> journal(path_);
+        journal.save(convInfos);
+        convInfos["a"].created = 1;
+        journal.save(convInfos);
+    }
+    // Partial record at the end of the journal
+    {
+        std::ofstream file(path_ + ".journal", std::ios::app | std::ios::binary);
+        file.write("\x92\xa1", 2);
+    }
+    auto loaded = MapJournal<ConvInfo>::read(path_);
+    CPPUNIT_ASSERT(loaded.size() == 2 && loaded["a"].created == 1);
+
+    // The next save rewrites the files
+    MapJournal<ConvInfo> journal(path_);
+    convInfos["b"].created = 2;
+    journal.save(convInfos);
+    CPPUNIT_ASSERT(!fileutils::isFile(path_ + ".journal"));
+    loaded = MapJournal<ConvInfo>::read(path_);
+    CPPUNIT_ASSERT(loaded["a"].created == 1 && loaded["b"].created == 2);
+}
+
+void
+MapJournalTest::testInfoHashKeys()
+{
+    std::map<dht::InfoHash, std::string> names {{dht::InfoHash::get("alice"), "alice"},
+                                                {dht::InfoHash::get("bob"), "bob"}};
+    // Written like before the journal, with binary keys
+    {
+        std::ofstream file(path_, std::ios::trunc | std::ios::binary);
+        msgpack::pack(file, names);
+    }
+    using Journal = MapJournal<std::string, dht::InfoHash>;
+    CPPUNIT_ASSERT(Journal::read(path_) == names);
+
+    Journal journal(path_);
+    names.erase(dht::InfoHash::get("alice"));
+    names[dht::InfoHash::get("carol")] = "carol";
+    journal.update({{dht::InfoHash::get("carol"), "carol"}}, {dht::InfoHash::get("alice")});
+    CPPUNIT_ASSERT(Journal::read(path_) == names);
+
+    // Still readable without the journal
+    names[dht::InfoHash::get("bob")] = "robert";
+    Journal::write(path_, names);
+    auto file = fileutils::loadFile(path_);
+    std::map<dht::InfoHash, std::string> legacy;
+    msgpack::unpack((const char*) file.data(), file.size()).get().convert(legacy);
+    CPPUNIT_ASSERT(legacy == names);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::MapJournalTest::name())
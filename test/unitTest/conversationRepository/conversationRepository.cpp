@@ -69,6 +69,8 @@ private:
     void testCloneViaChannelSocket();
     void testAddSomeMessages();
     void testLogMessages();
+    void testLogAfterNewCommits();
+    void testMemberRoles();
     void testFetch();
     void testMerge();
     void testFFMerge();
@@ -93,6 +95,8 @@ private:
     CPPUNIT_TEST(testCloneViaChannelSocket);
     CPPUNIT_TEST(testAddSomeMessages);
     CPPUNIT_TEST(testLogMessages);
+    CPPUNIT_TEST(testLogAfterNewCommits);
+    CPPUNIT_TEST(testMemberRoles);
     CPPUNIT_TEST(testFetch);
     CPPUNIT_TEST(testMerge);
     CPPUNIT_TEST(testFFMerge);
@@ -364,6 +368,65 @@ ConversationRepositoryTest::testLogMessages()
     CPPUNIT_ASSERT(messages[0].id == repository->id());
 }
 
+void
+ConversationRepositoryTest::testLogAfterNewCommits()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto repository = ConversationRepository::createConversation(aliceAccount->weak());
+
+    auto id1 = repository->commitMessage("Commit 1");
+    // Index the history
+    auto messages = repository->logN("", 1);
+    CPPUNIT_ASSERT(messages.size() == 1);
+    CPPUNIT_ASSERT(messages[0].id == id1);
+
+    // New commits are on top of the indexed history
+    auto id2 = repository->commitMessage("Commit 2");
+    auto id3 = repository->commitMessage("Commit 3");
+    messages = repository->logN("", 2);
+    CPPUNIT_ASSERT(messages.size() == 2);
+    CPPUNIT_ASSERT(messages[0].id == id3);
+    CPPUNIT_ASSERT(messages[0].linearized_parent == id2);
+    CPPUNIT_ASSERT(messages[1].id == id2);
+    CPPUNIT_ASSERT(messages[1].linearized_parent == id1);
+
+    // Next page, until the initial commit
+    messages = repository->logN(id1, 10);
+    CPPUNIT_ASSERT(messages.size() == 2);
+    CPPUNIT_ASSERT(messages[0].id == id1);
+    CPPUNIT_ASSERT(messages[1].id == repository->id());
+    CPPUNIT_ASSERT(messages[1].linearized_parent.empty());
+
+    // Bounded logs
+    CPPUNIT_ASSERT(repository->log(id3, id1).size() == 2);
+    CPPUNIT_ASSERT(repository->log(id1, id3).empty());
+    CPPUNIT_ASSERT(repository->log("", id2, false, true).size() == 1);
+}
+
+void
+ConversationRepositoryTest::testMemberRoles()
+{
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    auto bobAccount = Manager::instance().getAccount<JamiAccount>(bobId);
+    auto aliceUri = aliceAccount->getUsername();
+    auto bobUri = bobAccount->getUsername();
+    auto repository = ConversationRepository::createConversation(aliceAccount->weak());
+
+    CPPUNIT_ASSERT(repository->memberRole(aliceUri) == MemberRole::ADMIN);
+    CPPUNIT_ASSERT(!repository->memberRole(bobUri));
+
+    CPPUNIT_ASSERT(!repository->addMember(bobUri).empty());
+    CPPUNIT_ASSERT(repository->memberRole(bobUri) == MemberRole::INVITED);
+
+    // Same result when reloaded from the repository
+    repository->refreshMembers();
+    CPPUNIT_ASSERT(repository->memberRole(aliceUri) == MemberRole::ADMIN);
+    CPPUNIT_ASSERT(repository->memberRole(bobUri) == MemberRole::INVITED);
+
+    auto initialMembers = repository->getInitialMembers();
+    CPPUNIT_ASSERT(initialMembers.size() == 1 && initialMembers[0] == aliceUri);
+}
+
 void
 ConversationRepositoryTest::testFetch()
 {
@@ -77,6 +77,7 @@ private:
     void testCancelInTransfer();
     void testCancelOutTransfer();
     void testTransferInfo();
+    void testStuckRangeAskedAgain();
 
     CPPUNIT_TEST_SUITE(FileTransferTest);
     CPPUNIT_TEST(testFileTransfer);
@@ -90,6 +91,7 @@ private:
     CPPUNIT_TEST(testAskToMultipleParticipants);
     CPPUNIT_TEST(testCancelInTransfer);
     CPPUNIT_TEST(testTransferInfo);
+    CPPUNIT_TEST(testStuckRangeAskedAgain);
     CPPUNIT_TEST_SUITE_END();
 };
 
@@ -1267,6 +1269,70 @@ FileTransferTest::testTransferInfo()
     std::this_thread::sleep_for(std::chrono::seconds(5));
 }
 
+void
+FileTransferTest::testStuckRangeAskedAgain()
+{
+    DRing::DataTransferInfo info;
+    info.path = recvPath;
+    info.totalSize = 1000;
+    auto file = std::make_shared<IncomingFile>(nullptr, info, "fileId", "interactionId");
+
+    std::mutex mtx;
+    std::unique_lock<std::mutex> lk {mtx};
+    std::condition_variable cv;
+    std::vector<std::pair<std::size_t, std::size_t>> asked;
+    uint32_t finished = 0;
+    file->onFinished([&](uint32_t code) {
+        std::lock_guard<std::mutex> lk {mtx};
+        finished = code;
+        cv.notify_one();
+    });
+    file->setAskRange([&](const std::string& deviceId, std::size_t start, std::size_t end) {
+        std::lock_guard<std::mutex> lk {mtx};
+        CPPUNIT_ASSERT(deviceId.empty());
+        asked.emplace_back(start, end);
+        cv.notify_one();
+    });
+
+    // Receives 100 bytes, then nothing
+    auto channel = std::make_shared<ChannelSocket>(std::weak_ptr<MultiplexedSocket> {},
+                                                   "data-transfer://range",
+                                                   1);
+    CPPUNIT_ASSERT(file->addRange(channel, 0, 1000));
+    std::vector<uint8_t> data(100, 'a');
+    channel->onRecv(data.data(), data.size());
+
+    auto now = std::chrono::steady_clock::now();
+    lk.unlock();
+    CPPUNIT_ASSERT(file->checkRanges(now));
+    lk.lock();
+    CPPUNIT_ASSERT(!cv.wait_for(lk, std::chrono::seconds(1), [&] { return !asked.empty(); }));
+    lk.unlock();
+
+    // Interrupted, and asked again from where it stopped
+    CPPUNIT_ASSERT(file->checkRanges(now + IncomingFile::RANGE_TIMEOUT));
+    lk.lock();
+    CPPUNIT_ASSERT(cv.wait_for(lk, std::chrono::seconds(10), [&] { return !asked.empty(); }));
+    CPPUNIT_ASSERT(asked.size() == 1);
+    CPPUNIT_ASSERT(asked[0].first == 100 && asked[0].second == 1000);
+    lk.unlock();
+
+    // The rest received on another channel
+    channel = std::make_shared<ChannelSocket>(std::weak_ptr<MultiplexedSocket> {},
+                                              "data-transfer://range",
+                                              2);
+    CPPUNIT_ASSERT(file->addRange(channel, 100, 1000));
+    data.assign(900, 'a');
+    channel->onRecv(data.data(), data.size());
+    lk.lock();
+    CPPUNIT_ASSERT(cv.wait_for(lk, std::chrono::seconds(10), [&] { return finished != 0; }));
+    CPPUNIT_ASSERT(finished == uint32_t(DRing::DataTransferEventCode::finished));
+    CPPUNIT_ASSERT(fileutils::size(recvPath) == 1000);
+    lk.unlock();
+    file.reset();
+    std::remove(recvPath.c_str());
+}
+
 } // namespace test
 } // namespace jami
 
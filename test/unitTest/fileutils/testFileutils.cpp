@@ -26,6 +26,8 @@
 
 #include "jami.h"
 
+#include <atomic>
+#include <future>
 #include <string>
 #include <iostream>
 #include <cstdlib>
@@ -48,6 +50,9 @@ private:
     void testIsDirectoryWritable();
     void testGetCleanPath();
     void testFullPath();
+    void testSha3Hasher();
+    void testFileReader();
+    void testAsyncFileWriter();
 
     CPPUNIT_TEST_SUITE(FileutilsTest);
     CPPUNIT_TEST(testCheckDir);
@@ -57,6 +62,9 @@ private:
     CPPUNIT_TEST(testIsDirectoryWritable);
     CPPUNIT_TEST(testGetCleanPath);
     CPPUNIT_TEST(testFullPath);
+    CPPUNIT_TEST(testSha3Hasher);
+    CPPUNIT_TEST(testFileReader);
+    CPPUNIT_TEST(testAsyncFileWriter);
     CPPUNIT_TEST_SUITE_END();
 
     static constexpr auto tmpFileName = "temp_file";
@@ -178,6 +186,75 @@ FileutilsTest::testFullPath()
     CPPUNIT_ASSERT(getFullPath(NON_EXISTANT_PATH_BASE, "test").compare(NON_EXISTANT_PATH) == 0);
 }
 
+void
+FileutilsTest::testSha3Hasher()
+{
+    // Same sum by pieces as for the whole file
+    Sha3Hasher hasher;
+    hasher.update(reinterpret_cast<const uint8_t*>("RI"), 2);
+    hasher.update(reinterpret_cast<const uint8_t*>("NG"), 2);
+    auto sum = hasher.digest();
+    CPPUNIT_ASSERT(sum == sha3File(EXISTANT_FILE));
+    CPPUNIT_ASSERT(sum == sha3sum(loadFile(EXISTANT_FILE)));
+    // Restarted by digest()
+    CPPUNIT_ASSERT(hasher.digest() == sha3sum({}));
+    // By chunks
+    std::vector<std::string> chunkSums;
+    CPPUNIT_ASSERT(sha3File(EXISTANT_FILE, 3, chunkSums) == sum);
+    CPPUNIT_ASSERT(chunkSums.size() == 2);
+    CPPUNIT_ASSERT(chunkSums[0] == sha3sum({'R', 'I', 'N'}) && chunkSums[1] == sha3sum({'G'}));
+}
+
+void
+FileutilsTest::testFileReader()
+{
+    CPPUNIT_ASSERT(!FileReader(NON_EXISTANT_PATH));
+
+    FileReader file(EXISTANT_FILE);
+    CPPUNIT_ASSERT(file && file.size() == 4);
+    std::size_t len = 2;
+    auto data = file.read(1, len);
+    CPPUNIT_ASSERT(data && len == 2 && std::string((const char*) data, len) == "IN");
+    // Up to the end of the file
+    len = 16;
+    data = file.read(2, len);
+    CPPUNIT_ASSERT(data && len == 2 && std::string((const char*) data, len) == "NG");
+    len = 16;
+    CPPUNIT_ASSERT(!file.read(4, len) && len == 0);
+
+    // Truncated while read: ends sooner
+    CPPUNIT_ASSERT(truncate(EXISTANT_FILE.c_str(), 1) == 0);
+    len = 16;
+    data = file.read(0, len);
+    CPPUNIT_ASSERT(data && len == 1 && *data == 'R');
+    len = 16;
+    CPPUNIT_ASSERT(!file.read(1, len) && len == 0);
+}
+
+void
+FileutilsTest::testAsyncFileWriter()
+{
+    auto path = TEST_PATH + DIR_SEPARATOR_STR + "written";
+    std::atomic_size_t written {0};
+    std::promise<bool> closed;
+    {
+        AsyncFileWriter writer(path, std::ios::binary | std::ios::out, 0, [&](std::size_t len) {
+            written += len;
+        });
+        CPPUNIT_ASSERT(writer);
+        // Never waits for the disk, the data written is reported instead
+        std::vector<uint8_t> data(1024 * 1024, 'a');
+        for (int i = 0; i < 8; ++i)
+            CPPUNIT_ASSERT(writer.write(data.data(), data.size()));
+        writer.close([&](bool ok) { closed.set_value(ok); });
+        CPPUNIT_ASSERT(!writer.write(data.data(), data.size()));
+    }
+    CPPUNIT_ASSERT(closed.get_future().get());
+    CPPUNIT_ASSERT(written == 8 * 1024 * 1024);
+    CPPUNIT_ASSERT(loadFile(path).size() == 8 * 1024 * 1024);
+    unlink(path.c_str());
+}
+
 }}} // namespace jami::test::fileutils
 
 RING_TEST_RUNNER(jami::fileutils::test::FileutilsTest::name());
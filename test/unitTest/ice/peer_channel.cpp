@@ -0,0 +1,144 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "transport/peer_channel.h"
+#include "../../test_runner.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace jami {
+namespace test {
+
+class PeerChannelTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "PeerChannel"; }
+
+private:
+    void testReadWrite();
+    void testPeek();
+    void testCapacity();
+    void testAppend();
+
+    CPPUNIT_TEST_SUITE(PeerChannelTest);
+    CPPUNIT_TEST(testReadWrite);
+    CPPUNIT_TEST(testPeek);
+    CPPUNIT_TEST(testCapacity);
+    CPPUNIT_TEST(testAppend);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(PeerChannelTest, PeerChannelTest::name());
+
+void
+PeerChannelTest::testReadWrite()
+{
+    PeerChannel channel(100000);
+    std::vector<char> input(300000);
+    for (std::size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<char>(i * 7);
+
+    // Spans several chunks, and waits for the reader when full
+    std::vector<char> output;
+    std::thread reader([&] {
+        std::error_code ec;
+        char buf[5000];
+        while (output.size() < input.size()) {
+            auto n = channel.read(buf, sizeof(buf), ec);
+            if (n <= 0)
+                break;
+            output.insert(output.end(), buf, buf + n);
+        }
+    });
+    std::error_code ec;
+    for (std::size_t offset = 0; offset < input.size(); offset += 3000) {
+        auto size = std::min<std::size_t>(3000, input.size() - offset);
+        CPPUNIT_ASSERT(channel.write(input.data() + offset, size, std::chrono::seconds(5), ec)
+                       == static_cast<ssize_t>(size));
+    }
+    reader.join();
+    CPPUNIT_ASSERT(output == input);
+
+    channel.stop();
+    CPPUNIT_ASSERT(channel.write("a", 1, ec) < 0);
+    CPPUNIT_ASSERT(ec == std::errc::broken_pipe);
+}
+
+void
+PeerChannelTest::testPeek()
+{
+    PeerChannel channel;
+    std::error_code ec;
+    CPPUNIT_ASSERT(channel.peek().second == 0);
+    channel.write("abc", 3, ec);
+    auto data = channel.peek();
+    CPPUNIT_ASSERT(data.second == 3 && std::memcmp(data.first, "abc", 3) == 0);
+    channel.consume(2);
+    data = channel.peek();
+    CPPUNIT_ASSERT(data.second == 1 && *data.first == 'c');
+    CPPUNIT_ASSERT(channel.wait(std::chrono::milliseconds(0), ec) == 1);
+}
+
+void
+PeerChannelTest::testCapacity()
+{
+    PeerChannel channel(10);
+    std::error_code ec;
+    // Accepted when empty, even bigger than the capacity
+    CPPUNIT_ASSERT(channel.write("0123456789ab", 12, ec) == 12);
+    CPPUNIT_ASSERT(channel.write("z", 1, ec) < 0);
+    CPPUNIT_ASSERT(ec == std::errc::no_buffer_space);
+
+    char buf[12];
+    CPPUNIT_ASSERT(channel.read(buf, sizeof(buf), ec) == 12);
+    CPPUNIT_ASSERT(channel.write("z", 1, ec) == 1);
+}
+
+void
+PeerChannelTest::testAppend()
+{
+    PeerChannel channel(10);
+    std::error_code ec;
+    bool full = false;
+    CPPUNIT_ASSERT(channel.append("01234", 5, full, ec) == 5);
+    CPPUNIT_ASSERT(!full);
+    // Never dropped, even past the capacity
+    CPPUNIT_ASSERT(channel.append("56789ab", 7, full, ec) == 7);
+    CPPUNIT_ASSERT(full);
+    CPPUNIT_ASSERT(channel.write("z", 1, ec) < 0);
+
+    char buf[12];
+    CPPUNIT_ASSERT(channel.read(buf, sizeof(buf), ec) == 12);
+    CPPUNIT_ASSERT(std::memcmp(buf, "0123456789ab", 12) == 0);
+    CPPUNIT_ASSERT(channel.append("c", 1, full, ec) == 1);
+    CPPUNIT_ASSERT(!full);
+
+    channel.stop();
+    CPPUNIT_ASSERT(channel.append("d", 1, full, ec) < 0);
+    CPPUNIT_ASSERT(ec == std::errc::broken_pipe);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::PeerChannelTest::name())
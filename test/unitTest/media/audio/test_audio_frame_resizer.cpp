@@ -43,6 +43,7 @@ private:
     void testBiggerInput();
     void testBiggerOutput();
     void testDifferentFormat();
+    void testSplit();
 
     void gotFrame(std::shared_ptr<AudioFrame>&& framePtr);
     std::shared_ptr<AudioFrame> getFrame(int n);
@@ -52,6 +53,7 @@ private:
     CPPUNIT_TEST(testBiggerInput);
     CPPUNIT_TEST(testBiggerOutput);
     CPPUNIT_TEST(testDifferentFormat);
+    CPPUNIT_TEST(testSplit);
     CPPUNIT_TEST_SUITE_END();
 
     std::shared_ptr<AudioFrameResizer> q_;
@@ -129,6 +131,48 @@ AudioFrameResizerTest::testDifferentFormat()
     CPPUNIT_ASSERT(q_->samples() == 0);
 }
 
+void
+AudioFrameResizerTest::testSplit()
+{
+    // input.nb_samples == 2 * output.nb_samples, dequeued by the owner
+    q_.reset(new AudioFrameResizer(format_, outputSize_));
+    auto sample = [](const std::shared_ptr<AudioFrame>& f, int i) {
+        return reinterpret_cast<const int16_t*>(f->pointer()->data[0])[i];
+    };
+    auto numbered = [this](int n, int first) {
+        auto frame = getFrame(n);
+        auto data = reinterpret_cast<int16_t*>(frame->pointer()->data[0]);
+        for (int i = 0; i < n * (int) format_.nb_channels; ++i)
+            data[i] = first + i;
+        return frame;
+    };
+
+    auto in = numbered(2 * outputSize_, 0);
+    auto inData = in->pointer()->data[0];
+    q_->enqueue(std::move(in));
+    CPPUNIT_ASSERT(q_->samples() == 2 * outputSize_);
+
+    // Views into the input frame
+    auto first = q_->dequeue();
+    CPPUNIT_ASSERT(first && first->pointer()->nb_samples == outputSize_);
+    CPPUNIT_ASSERT(first->pointer()->data[0] == inData);
+    CPPUNIT_ASSERT(q_->samples() == outputSize_);
+
+    // A frame that can't be split is queued after the rest of the first one
+    q_->enqueue(numbered(outputSize_ + 100, 10000));
+    CPPUNIT_ASSERT(q_->samples() == 2 * outputSize_ + 100);
+    auto second = q_->dequeue();
+    CPPUNIT_ASSERT(second && second->pointer()->nb_samples == outputSize_);
+    CPPUNIT_ASSERT(sample(second, 0) == outputSize_ * (int) format_.nb_channels);
+    auto third = q_->dequeue();
+    CPPUNIT_ASSERT(third && sample(third, 0) == 10000);
+    CPPUNIT_ASSERT(!q_->dequeue());
+    CPPUNIT_ASSERT(q_->samples() == 100);
+
+    // Samples of the first frame are still referenced by its view
+    CPPUNIT_ASSERT(sample(first, 1) == 1);
+}
+
 }} // namespace jami::test
 
 RING_TEST_RUNNER(jami::test::AudioFrameResizerTest::name());
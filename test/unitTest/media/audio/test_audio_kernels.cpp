@@ -0,0 +1,235 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/audio_kernels.h"
+
+#include "../../../test_runner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace jami { namespace test {
+
+class AudioKernelsTest : public CppUnit::TestFixture {
+public:
+    static std::string name() { return "audio_kernels"; }
+    void tearDown() { audio_kernels::forceScalar(false); }
+
+private:
+    void testForceScalar();
+    void testMixS16();
+    void testMixFloat();
+    void testGainS16();
+    void testGainFloat();
+    void testInterleave();
+    void testDotS16();
+
+    CPPUNIT_TEST_SUITE(AudioKernelsTest);
+    CPPUNIT_TEST(testForceScalar);
+    CPPUNIT_TEST(testMixS16);
+    CPPUNIT_TEST(testMixFloat);
+    CPPUNIT_TEST(testGainS16);
+    CPPUNIT_TEST(testGainFloat);
+    CPPUNIT_TEST(testInterleave);
+    CPPUNIT_TEST(testDotS16);
+    CPPUNIT_TEST_SUITE_END();
+
+    std::vector<int16_t> random(size_t n, int min = std::numeric_limits<int16_t>::min(),
+                                int max = std::numeric_limits<int16_t>::max());
+    std::vector<float> randomFloat(size_t n);
+
+    /**
+     * Run f with the scalar kernels, then with the ones selected for this CPU,
+     * and check that both give the same result
+     */
+    template<typename F>
+    void checkSameAsScalar(F&& f)
+    {
+        audio_kernels::forceScalar(true);
+        auto expected = f();
+        audio_kernels::forceScalar(false);
+        CPPUNIT_ASSERT(expected == f());
+    }
+
+    std::mt19937 rand_ {42};
+    // Sizes around the vector widths to exercise the scalar tails
+    const std::vector<size_t> sizes_ {0, 1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 960};
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(AudioKernelsTest, AudioKernelsTest::name());
+
+std::vector<int16_t>
+AudioKernelsTest::random(size_t n, int min, int max)
+{
+    std::uniform_int_distribution<int> dist(min, max);
+    std::vector<int16_t> ret(n);
+    for (auto& s : ret)
+        s = dist(rand_);
+    return ret;
+}
+
+std::vector<float>
+AudioKernelsTest::randomFloat(size_t n)
+{
+    std::uniform_real_distribution<float> dist(-1.f, 1.f);
+    std::vector<float> ret(n);
+    for (auto& s : ret)
+        s = dist(rand_);
+    return ret;
+}
+
+void
+AudioKernelsTest::testForceScalar()
+{
+    std::string selected = audio_kernels::implementation();
+    audio_kernels::forceScalar(true);
+    CPPUNIT_ASSERT_EQUAL(std::string("scalar"), std::string(audio_kernels::implementation()));
+    audio_kernels::forceScalar(false);
+    CPPUNIT_ASSERT_EQUAL(selected, std::string(audio_kernels::implementation()));
+}
+
+void
+AudioKernelsTest::testMixS16()
+{
+    for (auto n : sizes_) {
+        auto a = random(n);
+        auto b = random(n);
+        checkSameAsScalar([&] {
+            auto mixed = a;
+            audio_kernels::mixS16(mixed.data(), b.data(), n);
+            return mixed;
+        });
+    }
+
+    // Saturation, at every position of a vector and of the tail
+    for (bool scalar : {true, false}) {
+        audio_kernels::forceScalar(scalar);
+        std::vector<int16_t> a(33, 32767), b(33, 1);
+        audio_kernels::mixS16(a.data(), b.data(), a.size());
+        CPPUNIT_ASSERT(a == std::vector<int16_t>(33, 32767));
+        std::vector<int16_t> c(33, -32768), d(33, -1);
+        audio_kernels::mixS16(c.data(), d.data(), c.size());
+        CPPUNIT_ASSERT(c == std::vector<int16_t>(33, -32768));
+    }
+}
+
+void
+AudioKernelsTest::testMixFloat()
+{
+    for (auto n : sizes_) {
+        auto a = randomFloat(n);
+        auto b = randomFloat(n);
+        checkSameAsScalar([&] {
+            auto mixed = a;
+            audio_kernels::mixFloat(mixed.data(), b.data(), n);
+            return mixed;
+        });
+    }
+}
+
+void
+AudioKernelsTest::testGainS16()
+{
+    for (auto n : sizes_) {
+        auto a = random(n);
+        for (double gain : {0., 0.5, -0.3, 0.999, 1., -1., 2.}) {
+            checkSameAsScalar([&] {
+                auto scaled = a;
+                audio_kernels::applyGainS16(scaled.data(), n, gain);
+                return scaled;
+            });
+        }
+    }
+
+    // The largest gains never overflow
+    for (bool scalar : {true, false}) {
+        audio_kernels::forceScalar(scalar);
+        std::vector<int16_t> a(33, -32768);
+        audio_kernels::applyGainS16(a.data(), a.size(), -1.);
+        CPPUNIT_ASSERT(a == std::vector<int16_t>(33, 32767));
+    }
+}
+
+void
+AudioKernelsTest::testGainFloat()
+{
+    for (auto n : sizes_) {
+        auto a = randomFloat(n);
+        checkSameAsScalar([&] {
+            auto scaled = a;
+            audio_kernels::applyGainFloat(scaled.data(), n, 0.7f);
+            return scaled;
+        });
+    }
+}
+
+void
+AudioKernelsTest::testInterleave()
+{
+    for (unsigned channels : {1u, 2u, 3u}) {
+        for (auto n : sizes_) {
+            std::vector<std::vector<int16_t>> planar;
+            std::vector<const int16_t*> in;
+            for (unsigned c = 0; c < channels; ++c) {
+                planar.emplace_back(random(n));
+                in.emplace_back(planar.back().data());
+            }
+            std::vector<int16_t> interleaved(n * channels);
+            checkSameAsScalar([&] {
+                audio_kernels::interleaveS16(in.data(), channels, n, interleaved.data());
+                return interleaved;
+            });
+            // The scalar interleaving is the reference: check it against its definition
+            for (size_t i = 0; i < n; ++i)
+                for (unsigned c = 0; c < channels; ++c)
+                    CPPUNIT_ASSERT_EQUAL(planar[c][i], interleaved[i * channels + c]);
+
+            std::vector<std::vector<int16_t>> back(channels, std::vector<int16_t>(n));
+            std::vector<int16_t*> out;
+            for (auto& channel : back)
+                out.emplace_back(channel.data());
+            checkSameAsScalar([&] {
+                audio_kernels::deinterleaveS16(interleaved.data(), channels, n, out.data());
+                return back;
+            });
+            CPPUNIT_ASSERT(back == planar);
+        }
+    }
+}
+
+void
+AudioKernelsTest::testDotS16()
+{
+    for (auto n : sizes_) {
+        auto a = random(n);
+        // Taps small enough for the sum to fit 32 bits
+        auto taps = random(n, -60, 60);
+        checkSameAsScalar([&] { return audio_kernels::dotS16(a.data(), taps.data(), n); });
+    }
+}
+
+}} // namespace jami::test
+
+RING_TEST_RUNNER(jami::test::AudioKernelsTest::name());
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/audio_profiler.h"
+#include "libav_deps.h"
+#include "metrics.h"
+
+#include "../../../test_runner.h"
+
+#include <thread>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+class AudioProfilerTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "audio_profiler"; }
+
+private:
+    void testUnderrunCauses();
+    void testStages();
+
+    CPPUNIT_TEST_SUITE(AudioProfilerTest);
+    CPPUNIT_TEST(testUnderrunCauses);
+    CPPUNIT_TEST(testStages);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(AudioProfilerTest, AudioProfilerTest::name());
+
+void
+AudioProfilerTest::testUnderrunCauses()
+{
+    using Cause = AudioProfiler::UnderrunCause;
+    AudioProfiler::setEnabled(true);
+    CPPUNIT_ASSERT(AudioProfiler::enabled());
+
+    // Nothing received yet
+    CPPUNIT_ASSERT(AudioProfiler::underrun() == Cause::IDLE);
+
+    // Received just before, consumed too fast
+    AVFrame frame {};
+    AudioProfiler::frameReceived(&frame, 1ms);
+    AudioProfiler::frameRead(&frame);
+    CPPUNIT_ASSERT(AudioProfiler::underrun() == Cause::DRAINED);
+
+    // 20 ms per call of the device, the next frame is late
+    AudioProfiler::played(AudioProfiler::clock::now(), 960, 48000);
+    std::this_thread::sleep_for(60ms);
+    CPPUNIT_ASSERT(AudioProfiler::underrun() == Cause::LATE);
+
+    AudioProfiler::setEnabled(false);
+}
+
+void
+AudioProfilerTest::testStages()
+{
+    AudioProfiler::setEnabled(true);
+    AVFrame frame {};
+    AudioProfiler::frameReceived(&frame, 2ms);
+    std::this_thread::sleep_for(5ms);
+    AudioProfiler::frameRead(&frame);
+    // Already read
+    AudioProfiler::frameRead(&frame);
+    AudioProfiler::framesMixed(100us);
+
+    auto text = metrics::Registry::instance().openMetrics();
+    auto contains = [&](const std::string& line) {
+        return text.find(line) != std::string::npos;
+    };
+    CPPUNIT_ASSERT(contains("jami_audio_profile_stage_seconds_count{stage=\"decode\"}"));
+    // Read at once by the first test, after 5 ms here
+    CPPUNIT_ASSERT(contains("jami_audio_profile_stage_seconds_count{stage=\"ring_buffer\"} 2"));
+    CPPUNIT_ASSERT(
+        contains("jami_audio_profile_stage_seconds_bucket{stage=\"ring_buffer\",le=\"0.0025\"} 1"));
+    CPPUNIT_ASSERT(contains("jami_audio_profile_stage_seconds_count{stage=\"mix\"} 1"));
+    CPPUNIT_ASSERT(contains("jami_audio_profile_underruns_total{cause=\"idle\"}"));
+    AudioProfiler::setEnabled(false);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::AudioProfilerTest::name());
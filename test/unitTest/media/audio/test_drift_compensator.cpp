@@ -0,0 +1,112 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/drift_compensator.h"
+#include "jami.h"
+#include "libav_deps.h"
+#include "libav_utils.h"
+#include "media_buffer.h"
+
+#include "../../../test_runner.h"
+
+namespace jami { namespace test {
+
+class DriftCompensatorTest : public CppUnit::TestFixture {
+public:
+    static std::string name() { return "drift_compensator"; }
+
+private:
+    void testSteady();
+    void testOverrun();
+    void testUnderrun();
+
+    CPPUNIT_TEST_SUITE(DriftCompensatorTest);
+    CPPUNIT_TEST(testSteady);
+    CPPUNIT_TEST(testOverrun);
+    CPPUNIT_TEST(testUnderrun);
+    CPPUNIT_TEST_SUITE_END();
+
+    std::shared_ptr<AudioFrame> getFrame() const
+    {
+        auto frame = std::make_shared<AudioFrame>(format_, format_.sample_rate / 50);
+        libav_utils::fillWithSilence(frame->pointer());
+        return frame;
+    }
+
+    /**
+     * Samples output for @frames frames, after the level settled at @fill
+     */
+    size_t run(DriftCompensator& drift, size_t fill, int frames);
+
+    AudioFormat format_ = AudioFormat::MONO();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(DriftCompensatorTest, DriftCompensatorTest::name());
+
+size_t
+DriftCompensatorTest::run(DriftCompensator& drift, size_t fill, int frames)
+{
+    size_t samples = 0;
+    for (int i = 0; i < frames; ++i)
+        samples += drift.resample(getFrame(), format_, fill)->pointer()->nb_samples;
+    return samples;
+}
+
+void
+DriftCompensatorTest::testSteady()
+{
+    DriftCompensator drift;
+    run(drift, 2, 300);
+    CPPUNIT_ASSERT(drift.correction() == 0);
+    // Frames are not even resampled
+    auto frame = getFrame();
+    CPPUNIT_ASSERT(drift.resample(std::shared_ptr<AudioFrame>(frame), format_, 2) == frame);
+}
+
+void
+DriftCompensatorTest::testOverrun()
+{
+    DriftCompensator drift;
+    run(drift, 2, 300);
+    // Frames accumulate: the output is shrunk
+    run(drift, 4, 300);
+    CPPUNIT_ASSERT(drift.correction() < 0);
+    CPPUNIT_ASSERT(drift.correction() >= -DriftCompensator::MAX_CORRECTION);
+    const int frames = 500;
+    CPPUNIT_ASSERT(run(drift, 4, frames) < frames * format_.sample_rate / 50);
+}
+
+void
+DriftCompensatorTest::testUnderrun()
+{
+    DriftCompensator drift;
+    run(drift, 0, 300);
+    for (int i = 0; i < 300; ++i)
+        drift.underrun();
+    CPPUNIT_ASSERT(drift.correction() > 0);
+
+    drift.reset();
+    CPPUNIT_ASSERT(drift.correction() == 0);
+}
+
+}} // namespace jami::test
+
+RING_TEST_RUNNER(jami::test::DriftCompensatorTest::name());
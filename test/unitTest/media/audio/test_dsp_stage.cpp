@@ -0,0 +1,122 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/audio-processing/dsp_stage.h"
+#include "audio/audio-processing/null_audio_processor.h"
+#include "jami.h"
+#include "libav_utils.h"
+
+#include "../../../test_runner.h"
+
+#include <condition_variable>
+#include <mutex>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami { namespace test {
+
+class DspStageTest : public CppUnit::TestFixture {
+public:
+    static std::string name() { return "dsp_stage"; }
+
+private:
+    void testProcessed();
+    void testDropped();
+
+    CPPUNIT_TEST_SUITE(DspStageTest);
+    CPPUNIT_TEST(testProcessed);
+    CPPUNIT_TEST(testDropped);
+    CPPUNIT_TEST_SUITE_END();
+
+    std::shared_ptr<AudioFrame> getFrame() const
+    {
+        auto frame = std::make_shared<AudioFrame>(format_, frameSize_);
+        libav_utils::fillWithSilence(frame->pointer());
+        return frame;
+    }
+
+    std::unique_ptr<DspStage> makeStage(DspStage::Output&& output) const
+    {
+        return std::make_unique<DspStage>(std::make_unique<NullAudioProcessor>(format_,
+                                                                               frameSize_),
+                                          std::move(output));
+    }
+
+    // 10 ms frames, as processed
+    AudioFormat format_ = AudioFormat::MONO();
+    unsigned frameSize_ = 480;
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(DspStageTest, DspStageTest::name());
+
+void
+DspStageTest::testProcessed()
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    unsigned processed = 0, wrongSize = 0;
+    auto stage = makeStage([&](std::shared_ptr<AudioFrame>&& frame) {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (frame->pointer()->nb_samples != (int) frameSize_)
+            ++wrongSize;
+        ++processed;
+        cv.notify_one();
+    });
+
+    // Like the device callbacks, 10 ms apart
+    for (int i = 0; i < 20; ++i) {
+        CPPUNIT_ASSERT(stage->putPlayback(getFrame()));
+        CPPUNIT_ASSERT(stage->putRecorded(getFrame()));
+        std::this_thread::sleep_for(10ms);
+    }
+
+    std::unique_lock<std::mutex> lk(mtx);
+    CPPUNIT_ASSERT(cv.wait_for(lk, 5s, [&] { return processed >= 10; }));
+    CPPUNIT_ASSERT(wrongSize == 0);
+    CPPUNIT_ASSERT(stage->dropped() == 0);
+    CPPUNIT_ASSERT(stage->latency() > 0us);
+}
+
+void
+DspStageTest::testDropped()
+{
+    std::mutex blocked;
+    std::unique_lock<std::mutex> block(blocked);
+    auto stage = makeStage([&](std::shared_ptr<AudioFrame>&&) {
+        std::lock_guard<std::mutex> lk(blocked);
+    });
+    stage->putPlayback(getFrame());
+    stage->putRecorded(getFrame());
+    stage->putPlayback(getFrame());
+
+    // The processing thread is stuck on the first output: the capture is not
+    for (size_t i = 0; i < 4 * DspStage::QUEUE_FRAMES; ++i) {
+        stage->putPlayback(getFrame());
+        stage->putRecorded(getFrame());
+        std::this_thread::sleep_for(1ms);
+    }
+    CPPUNIT_ASSERT(stage->dropped() > 0);
+    block.unlock();
+}
+
+}} // namespace jami::test
+
+RING_TEST_RUNNER(jami::test::DspStageTest::name());
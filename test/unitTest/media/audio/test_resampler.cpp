@@ -27,6 +27,9 @@
 #include "libav_deps.h"
 #include "audio/resampler.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "../test_runner.h"
 
 namespace jami { namespace test {
@@ -42,11 +45,15 @@ private:
     void testAudioBuffer();
     void testAudioFrame();
     void testRematrix();
+    void testFixedRatio();
+    void testRoutes();
 
     CPPUNIT_TEST_SUITE(ResamplerTest);
     CPPUNIT_TEST(testAudioBuffer);
     CPPUNIT_TEST(testAudioFrame);
     CPPUNIT_TEST(testRematrix);
+    CPPUNIT_TEST(testFixedRatio);
+    CPPUNIT_TEST(testRoutes);
     CPPUNIT_TEST_SUITE_END();
 
     std::unique_ptr<Resampler> resampler_;
@@ -132,6 +139,65 @@ ResamplerTest::testRematrix()
     CPPUNIT_ASSERT(output2->pointer()->data && output2->pointer()->data[0]);
 }
 
+void
+ResamplerTest::testFixedRatio()
+{
+    resampler_.reset(new Resampler);
+    const auto wide = AudioFormat::MONO();
+    const AudioFormat narrow(8000, 1);
+
+    // 1 kHz sine, 20 ms per frame
+    size_t t = 0;
+    auto sine = [&]() {
+        auto frame = std::make_unique<AudioFrame>(wide, 960);
+        auto data = reinterpret_cast<int16_t*>(frame->pointer()->data[0]);
+        for (int i = 0; i < 960; ++i, ++t)
+            data[i] = 10000 * std::sin(2 * M_PI * 1000 * t / 48000.);
+        return frame;
+    };
+
+    Resampler up;
+    for (int i = 0; i < 10; ++i) {
+        auto down = resampler_->resample(sine(), narrow);
+        CPPUNIT_ASSERT_EQUAL(160, down->pointer()->nb_samples);
+        auto back = up.resample(std::move(down), wide);
+        CPPUNIT_ASSERT_EQUAL(960, back->pointer()->nb_samples);
+        if (i == 9) {
+            // The tone is kept past the delay of the filters
+            auto data = reinterpret_cast<const int16_t*>(back->pointer()->data[0]);
+            int peak = *std::max_element(data, data + 960);
+            CPPUNIT_ASSERT(peak > 9800 && peak < 10200);
+        }
+    }
+}
+
+void
+ResamplerTest::testRoutes()
+{
+    resampler_.reset(new Resampler);
+
+    // Only the channel layout differs: the samples are not copied
+    auto input = std::make_unique<AudioFrame>(AudioFormat::MONO(), 960);
+    input->pointer()->channel_layout = 0;
+    AudioFrame output;
+    output.pointer()->format = AV_SAMPLE_FMT_S16;
+    output.pointer()->sample_rate = 48000;
+    output.pointer()->channel_layout = AV_CH_LAYOUT_MONO;
+    output.pointer()->channels = 1;
+    CPPUNIT_ASSERT(resampler_->resample(input->pointer(), output.pointer()) >= 0);
+    CPPUNIT_ASSERT(output.pointer()->data[0] == input->pointer()->data[0]);
+    CPPUNIT_ASSERT(output.pointer()->channel_layout == AV_CH_LAYOUT_MONO);
+
+    // Inputs alternating between formats switch between the contexts kept per route
+    for (int i = 0; i < 10; ++i) {
+        const AudioFormat format(i % 2 ? 44100 : 32000, 1);
+        auto in = std::make_unique<AudioFrame>(format, format.sample_rate / 50);
+        auto out = resampler_->resample(std::move(in), AudioFormat::STEREO());
+        CPPUNIT_ASSERT(out->pointer()->sample_rate == 48000);
+        CPPUNIT_ASSERT(out->pointer()->channels == 2);
+    }
+}
+
 }} // namespace jami::test
 
 RING_TEST_RUNNER(jami::test::ResamplerTest::name());
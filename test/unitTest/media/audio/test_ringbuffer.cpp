@@ -0,0 +1,231 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/ringbuffer.h"
+#include "jami.h"
+#include "libav_deps.h"
+#include "media_buffer.h"
+#include "ring_types.h"
+
+#include "../../../test_runner.h"
+
+#include <thread>
+
+namespace jami { namespace test {
+
+class RingBufferTest : public CppUnit::TestFixture {
+public:
+    static std::string name() { return "ringbuffer"; }
+
+private:
+    void testPutGet();
+    void testMultipleReaders();
+    void testOverflow();
+    void testHandles();
+    void testConcurrentLockFree();
+    void testFrameDuration();
+
+    CPPUNIT_TEST_SUITE(RingBufferTest);
+    CPPUNIT_TEST(testPutGet);
+    CPPUNIT_TEST(testMultipleReaders);
+    CPPUNIT_TEST(testOverflow);
+    CPPUNIT_TEST(testHandles);
+    CPPUNIT_TEST(testConcurrentLockFree);
+    CPPUNIT_TEST(testFrameDuration);
+    CPPUNIT_TEST_SUITE_END();
+
+    std::shared_ptr<AudioFrame> getFrame() const;
+
+    AudioFormat format_ = AudioFormat::MONO();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(RingBufferTest, RingBufferTest::name());
+
+std::shared_ptr<AudioFrame>
+RingBufferTest::getFrame() const
+{
+    // One frame is exactly what the ring buffer resizer outputs
+    return std::make_shared<AudioFrame>(format_, format_.sample_rate / 50);
+}
+
+void
+RingBufferTest::testPutGet()
+{
+    for (auto mode : {RingBuffer::Mode::LOCKED, RingBuffer::Mode::LOCK_FREE}) {
+        RingBuffer rb("test", SIZEBUF, format_, mode);
+        rb.createReadOffset("reader");
+        CPPUNIT_ASSERT(rb.availableForGet("reader") == 0);
+        CPPUNIT_ASSERT(not rb.get("reader"));
+
+        rb.put(getFrame());
+        rb.put(getFrame());
+        CPPUNIT_ASSERT(rb.availableForGet("reader") == 2);
+        CPPUNIT_ASSERT(rb.get("reader"));
+        CPPUNIT_ASSERT(rb.availableForGet("reader") == 1);
+        CPPUNIT_ASSERT(rb.discard(10, "reader") == 1);
+        CPPUNIT_ASSERT(rb.isEmpty());
+
+        rb.removeReadOffset("reader");
+        CPPUNIT_ASSERT(rb.readOffsetCount() == 0);
+        CPPUNIT_ASSERT(not rb.get("reader"));
+    }
+}
+
+void
+RingBufferTest::testMultipleReaders()
+{
+    for (auto mode : {RingBuffer::Mode::LOCKED, RingBuffer::Mode::LOCK_FREE}) {
+        RingBuffer rb("test", SIZEBUF, format_, mode);
+        rb.createReadOffset("a");
+        rb.put(getFrame());
+        rb.createReadOffset("b");
+        rb.put(getFrame());
+
+        CPPUNIT_ASSERT(rb.readOffsetCount() == 2);
+        CPPUNIT_ASSERT(rb.availableForGet("a") == 2);
+        CPPUNIT_ASSERT(rb.availableForGet("b") == 1);
+        CPPUNIT_ASSERT(rb.putLength() == 2);
+
+        rb.flush("a");
+        CPPUNIT_ASSERT(rb.availableForGet("a") == 0);
+        CPPUNIT_ASSERT(rb.availableForGet("b") == 1);
+        rb.flushAll();
+        CPPUNIT_ASSERT(rb.isEmpty());
+    }
+}
+
+void
+RingBufferTest::testOverflow()
+{
+    for (auto mode : {RingBuffer::Mode::LOCKED, RingBuffer::Mode::LOCK_FREE}) {
+        RingBuffer rb("test", SIZEBUF, format_, mode);
+        rb.createReadOffset("reader");
+        std::vector<std::shared_ptr<AudioFrame>> frames;
+        for (int i = 0; i < 40; ++i) {
+            frames.emplace_back(getFrame());
+            rb.put(std::shared_ptr<AudioFrame>(frames.back()));
+        }
+        // A late reader keeps the most recent frames
+        CPPUNIT_ASSERT(rb.isFull());
+        const auto available = rb.availableForGet("reader");
+        CPPUNIT_ASSERT(available > 0 and available < frames.size());
+        for (size_t i = frames.size() - available; i < frames.size(); ++i)
+            CPPUNIT_ASSERT(rb.get("reader") == frames[i]);
+        CPPUNIT_ASSERT(rb.isEmpty());
+    }
+}
+
+void
+RingBufferTest::testHandles()
+{
+    RingBuffer rb("test", SIZEBUF, format_, RingBuffer::Mode::LOCK_FREE);
+    CPPUNIT_ASSERT(rb.getReadHandle("reader") == RingBuffer::INVALID_HANDLE);
+    rb.createReadOffset("reader");
+    auto handle = rb.getReadHandle("reader");
+    CPPUNIT_ASSERT(handle != RingBuffer::INVALID_HANDLE);
+
+    rb.put(getFrame());
+    CPPUNIT_ASSERT(rb.availableForGet(handle) == 1);
+    CPPUNIT_ASSERT(rb.get(handle));
+    CPPUNIT_ASSERT(rb.availableForGet(handle) == 0);
+
+    rb.removeReadOffset("reader");
+    rb.put(getFrame());
+    CPPUNIT_ASSERT(not rb.get(handle));
+
+    // The slot of the removed read offset is reused, not its handle
+    rb.createReadOffset("other");
+    auto other = rb.getReadHandle("other");
+    CPPUNIT_ASSERT(other != handle);
+    rb.put(getFrame());
+    CPPUNIT_ASSERT(rb.availableForGet(handle) == 0);
+    CPPUNIT_ASSERT(not rb.get(handle));
+    CPPUNIT_ASSERT(rb.discard(1, handle) == 0);
+    CPPUNIT_ASSERT(rb.availableForGet(other) == 1);
+    CPPUNIT_ASSERT(rb.get(other));
+}
+
+void
+RingBufferTest::testConcurrentLockFree()
+{
+    static constexpr int FRAMES = 2000;
+    RingBuffer rb("test", SIZEBUF, format_, RingBuffer::Mode::LOCK_FREE);
+    std::vector<RingBuffer::ReadHandle> handles;
+    for (int i = 0; i < 4; ++i) {
+        auto id = std::to_string(i);
+        rb.createReadOffset(id);
+        handles.emplace_back(rb.getReadHandle(id));
+    }
+
+    std::atomic_bool done {false};
+    std::atomic_int received {0};
+    std::atomic_int missing {0};
+    std::vector<std::thread> readers;
+    for (auto handle : handles) {
+        readers.emplace_back([&, handle] {
+            while (not done) {
+                auto deadline = RingBuffer::clock::now() + std::chrono::milliseconds(10);
+                if (rb.waitForDataAvailable(handle, deadline) == 0)
+                    continue;
+                // Only the writer can move our cursor, and never past the end
+                if (rb.get(handle))
+                    ++received;
+                else
+                    ++missing;
+            }
+        });
+    }
+    for (int i = 0; i < FRAMES; ++i)
+        rb.put(getFrame());
+    done = true;
+    for (auto& t : readers)
+        t.join();
+    CPPUNIT_ASSERT(missing == 0);
+    CPPUNIT_ASSERT(received > 0);
+    CPPUNIT_ASSERT(rb.putLength() <= 16);
+}
+
+void
+RingBufferTest::testFrameDuration()
+{
+    RingBuffer rb("test", SIZEBUF, format_, RingBuffer::Mode::LOCK_FREE);
+    rb.createReadOffset("reader");
+
+    // The period of a low-latency device: a 20 ms frame gives 4 frames of 5 ms
+    rb.setFrameDuration(std::chrono::milliseconds(5));
+    rb.put(getFrame());
+    CPPUNIT_ASSERT(rb.availableForGet("reader") == 4);
+    auto frame = rb.get("reader");
+    CPPUNIT_ASSERT(frame);
+    CPPUNIT_ASSERT(frame->pointer()->nb_samples == (int) format_.sample_rate / 200);
+
+    // Kept when the format changes
+    const auto stereo = AudioFormat::STEREO();
+    rb.flushAll();
+    rb.setFormat(stereo);
+    rb.put(std::make_shared<AudioFrame>(stereo, stereo.sample_rate / 100));
+    CPPUNIT_ASSERT(rb.availableForGet("reader") == 2);
+}
+
+}} // namespace jami::test
+
+RING_TEST_RUNNER(jami::test::RingBufferTest::name());
@@ -0,0 +1,186 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA.
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/ringbufferpool.h"
+#include "audio/ringbuffer.h"
+#include "jami.h"
+#include "libav_deps.h"
+#include "media_buffer.h"
+
+#include "../../../test_runner.h"
+
+#include <string>
+#include <vector>
+
+namespace jami { namespace test {
+
+class RingBufferPoolTest : public CppUnit::TestFixture {
+public:
+    static std::string name() { return "ringbufferpool"; }
+
+private:
+    void testBindUnbind();
+    void testRebind();
+    void testSlotReuse();
+
+    CPPUNIT_TEST_SUITE(RingBufferPoolTest);
+    CPPUNIT_TEST(testBindUnbind);
+    CPPUNIT_TEST(testRebind);
+    CPPUNIT_TEST(testSlotReuse);
+    CPPUNIT_TEST_SUITE_END();
+
+    std::shared_ptr<AudioFrame> getFrame(const RingBufferPool& pool) const;
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(RingBufferPoolTest, RingBufferPoolTest::name());
+
+std::shared_ptr<AudioFrame>
+RingBufferPoolTest::getFrame(const RingBufferPool& pool) const
+{
+    auto format = pool.getInternalAudioFormat();
+    return std::make_shared<AudioFrame>(format, format.sample_rate / 50);
+}
+
+void
+RingBufferPoolTest::testBindUnbind()
+{
+    RingBufferPool pool;
+    auto rbA = pool.createRingBuffer("a");
+    auto rbB = pool.createRingBuffer("b");
+    CPPUNIT_ASSERT(not pool.isValid(RingBufferPool::INVALID_BINDING));
+    CPPUNIT_ASSERT(pool.getBindingHandle("a") == RingBufferPool::INVALID_BINDING);
+
+    // "a" reads "b", and "b" reads "a"
+    auto handleA = pool.bindCallID("a", "b");
+    CPPUNIT_ASSERT(pool.isValid(handleA));
+    CPPUNIT_ASSERT(pool.getBindingHandle("a") == handleA);
+    auto handleB = pool.getBindingHandle("b");
+    CPPUNIT_ASSERT(pool.isValid(handleB));
+    CPPUNIT_ASSERT(handleA != handleB);
+
+    auto frame = getFrame(pool);
+    rbB->put(std::shared_ptr<AudioFrame>(frame));
+    CPPUNIT_ASSERT(pool.availableForGet(handleA) == 1);
+    CPPUNIT_ASSERT(pool.availableForGet(handleB) == 0);
+    CPPUNIT_ASSERT(pool.getData(handleA) == frame);
+    CPPUNIT_ASSERT(pool.availableForGet(handleA) == 0);
+
+    // A process reading "a" has its own handle, kept when the call is unbound
+    auto handleP = pool.bindHalfDuplexOut("p", "a");
+    CPPUNIT_ASSERT(pool.isValid(handleP));
+
+    pool.unBindCallID("a", "b");
+    CPPUNIT_ASSERT(not pool.isValid(handleA));
+    CPPUNIT_ASSERT(not pool.isValid(handleB));
+    CPPUNIT_ASSERT(pool.getBindingHandle("a") == RingBufferPool::INVALID_BINDING);
+    CPPUNIT_ASSERT(pool.isValid(handleP));
+
+    // An invalidated handle reads nothing
+    rbB->put(getFrame(pool));
+    CPPUNIT_ASSERT(pool.availableForGet(handleA) == 0);
+    CPPUNIT_ASSERT(not pool.getData(handleA));
+    CPPUNIT_ASSERT(pool.discard(1, handleA) == 0);
+
+    pool.unBindHalfDuplexOut("p", "a");
+    CPPUNIT_ASSERT(not pool.isValid(handleP));
+}
+
+void
+RingBufferPoolTest::testRebind()
+{
+    RingBufferPool pool;
+    auto rbA = pool.createRingBuffer("a");
+    auto rbB = pool.createRingBuffer("b");
+
+    auto oldHandle = pool.bindCallID("a", "b");
+    pool.unBindCallID("a", "b");
+    auto newHandle = pool.bindCallID("a", "b");
+
+    // Same reader, maybe in the same slot: the old handle must not resolve to it
+    CPPUNIT_ASSERT(newHandle != oldHandle);
+    CPPUNIT_ASSERT(pool.isValid(newHandle));
+    CPPUNIT_ASSERT(not pool.isValid(oldHandle));
+    CPPUNIT_ASSERT(pool.getBindingHandle("a") == newHandle);
+
+    rbB->put(getFrame(pool));
+    CPPUNIT_ASSERT(pool.availableForGet(oldHandle) == 0);
+    CPPUNIT_ASSERT(not pool.getData(oldHandle));
+    CPPUNIT_ASSERT(pool.availableForGet(newHandle) == 1);
+    CPPUNIT_ASSERT(pool.getData(newHandle));
+
+    // Binding to a second buffer keeps the handle
+    auto rbC = pool.createRingBuffer("c");
+    CPPUNIT_ASSERT(pool.bindCallID("a", "c") == newHandle);
+    pool.unBindCallID("a", "b");
+    CPPUNIT_ASSERT(pool.isValid(newHandle));
+    pool.unBindAll("a");
+    CPPUNIT_ASSERT(not pool.isValid(newHandle));
+}
+
+void
+RingBufferPoolTest::testSlotReuse()
+{
+    RingBufferPool pool;
+    // Readers spread over a few buffers, each having at most RingBuffer::MAX_READERS
+    std::vector<std::shared_ptr<RingBuffer>> rbufs;
+    for (size_t i = 0; i < 4; ++i)
+        rbufs.emplace_back(pool.createRingBuffer("rb" + std::to_string(i)));
+    auto reader = [](size_t i) { return "p" + std::to_string(i); };
+    auto rbufOf = [](size_t i) { return "rb" + std::to_string(i % 4); };
+
+    std::vector<RingBufferPool::BindingHandle> handles;
+    for (size_t i = 0; i < RingBufferPool::MAX_BINDINGS; ++i) {
+        handles.emplace_back(pool.bindHalfDuplexOut(reader(i), rbufOf(i)));
+        CPPUNIT_ASSERT(pool.isValid(handles.back()));
+    }
+    // Every slot is used
+    CPPUNIT_ASSERT(pool.bindHalfDuplexOut("extra", "rb3") == RingBufferPool::INVALID_BINDING);
+
+    // The slot released by p7 is given to the next reader, with a new handle
+    pool.unBindHalfDuplexOut(reader(7), rbufOf(7));
+    CPPUNIT_ASSERT(not pool.isValid(handles[7]));
+    auto extra = pool.bindHalfDuplexOut("extra", "rb3");
+    CPPUNIT_ASSERT(pool.isValid(extra));
+    CPPUNIT_ASSERT(extra != handles[7]);
+    CPPUNIT_ASSERT(not pool.isValid(handles[7]));
+    CPPUNIT_ASSERT(pool.getBindingHandle(reader(7)) == RingBufferPool::INVALID_BINDING);
+
+    // The stale handle doesn't read the data of the new reader
+    rbufs[3]->put(getFrame(pool));
+    CPPUNIT_ASSERT(pool.availableForGet(extra) == 1);
+    CPPUNIT_ASSERT(pool.availableForGet(handles[7]) == 0);
+    CPPUNIT_ASSERT(not pool.getData(handles[7]));
+    CPPUNIT_ASSERT(pool.getData(extra));
+
+    // The other readers were not affected
+    for (size_t i = 0; i < handles.size(); ++i)
+        if (i != 7)
+            CPPUNIT_ASSERT(pool.isValid(handles[i]));
+
+    for (size_t i = 0; i < handles.size(); ++i)
+        pool.unBindHalfDuplexOut(reader(i), rbufOf(i));
+    pool.unBindHalfDuplexOut("extra", "rb3");
+    CPPUNIT_ASSERT(not pool.isValid(extra));
+}
+
+}} // namespace jami::test
+
+RING_TEST_RUNNER(jami::test::RingBufferPoolTest::name());
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/silence_detector.h"
+#include "jami.h"
+#include "libav_deps.h"
+#include "media_buffer.h"
+
+#include "../../../test_runner.h"
+
+#include <algorithm>
+
+namespace jami { namespace test {
+
+class SilenceDetectorTest : public CppUnit::TestFixture {
+public:
+    static std::string name() { return "silence_detector"; }
+
+private:
+    void testHangover();
+    void testVoice();
+
+    CPPUNIT_TEST_SUITE(SilenceDetectorTest);
+    CPPUNIT_TEST(testHangover);
+    CPPUNIT_TEST(testVoice);
+    CPPUNIT_TEST_SUITE_END();
+
+    /**
+     * 20 ms frame of constant @value
+     */
+    std::shared_ptr<AudioFrame> getFrame(int16_t value) const
+    {
+        auto frame = std::make_shared<AudioFrame>(format_, format_.sample_rate / 50);
+        auto f = frame->pointer();
+        auto data = reinterpret_cast<int16_t*>(f->data[0]);
+        std::fill(data, data + f->nb_samples, value);
+        return frame;
+    }
+
+    AudioFormat format_ = AudioFormat::MONO();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(SilenceDetectorTest, SilenceDetectorTest::name());
+
+void
+SilenceDetectorTest::testHangover()
+{
+    SilenceDetector silence;
+    // Under the threshold, but not for HANGOVER yet: 14 frames of 20 ms
+    for (int i = 0; i < 14; ++i)
+        CPPUNIT_ASSERT(not silence.silent(*getFrame(10)));
+    CPPUNIT_ASSERT(silence.level() < SilenceDetector::THRESHOLD);
+    CPPUNIT_ASSERT(silence.silent(*getFrame(10)));
+    CPPUNIT_ASSERT(silence.silent(*getFrame(0)));
+
+    // A loud frame restarts the hangover
+    CPPUNIT_ASSERT(not silence.silent(*getFrame(10000)));
+    CPPUNIT_ASSERT(silence.level() > SilenceDetector::THRESHOLD);
+    CPPUNIT_ASSERT(not silence.silent(*getFrame(0)));
+}
+
+void
+SilenceDetectorTest::testVoice()
+{
+    SilenceDetector silence;
+    for (int i = 0; i < 50; ++i) {
+        auto frame = getFrame(0);
+        frame->has_voice = true;
+        CPPUNIT_ASSERT(not silence.silent(*frame));
+    }
+}
+
+}} // namespace jami::test
+
+RING_TEST_RUNNER(jami::test::SilenceDetectorTest::name());
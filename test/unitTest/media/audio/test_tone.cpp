@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "audio/sound/tone.h"
+#include "jami.h"
+#include "libav_deps.h"
+#include "media_buffer.h"
+
+#include "../../../test_runner.h"
+
+namespace jami { namespace test {
+
+class ToneTest : public CppUnit::TestFixture {
+public:
+    static std::string name() { return "tone"; }
+
+private:
+    void testShared();
+    void testFrames();
+
+    CPPUNIT_TEST_SUITE(ToneTest);
+    CPPUNIT_TEST(testShared);
+    CPPUNIT_TEST(testFrames);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(ToneTest, ToneTest::name());
+
+void
+ToneTest::testShared()
+{
+    Tone a("440+480/2000,0/4000", 48000);
+    Tone b("440+480/2000,0/4000", 48000);
+    Tone c("440+480/2000,0/4000", 16000);
+    CPPUNIT_ASSERT(a.getSize() == 6 * 48000);
+    CPPUNIT_ASSERT(a.data() == b.data());
+    CPPUNIT_ASSERT(c.getSize() == 6 * 16000);
+    CPPUNIT_ASSERT(a.data() != c.data());
+}
+
+void
+ToneTest::testFrames()
+{
+    // 100 ms: 5 frames of 20 ms, the 6th one wraps around
+    Tone tone("440/100", 48000);
+    const auto frameSize = 960;
+    for (int i = 0; i < 5; ++i) {
+        auto frame = tone.getNext();
+        CPPUNIT_ASSERT(frame->pointer()->nb_samples == frameSize);
+        CPPUNIT_ASSERT(reinterpret_cast<const AudioSample*>(frame->pointer()->data[0])
+                       == tone.data() + i * frameSize);
+    }
+    tone.seek(90);
+    auto frame = tone.getNext();
+    auto samples = reinterpret_cast<const AudioSample*>(frame->pointer()->data[0]);
+    CPPUNIT_ASSERT(frame->pointer()->nb_samples == frameSize);
+    CPPUNIT_ASSERT(samples[0] == tone.data()[4320]);
+    CPPUNIT_ASSERT(samples[frameSize - 1] == tone.data()[frameSize - 1 - 480]);
+}
+
+}} // namespace jami::test
+
+RING_TEST_RUNNER(jami::test::ToneTest::name());
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "codec_threads.h"
+
+#include "../../test_runner.h"
+
+#include <array>
+
+namespace jami {
+namespace test {
+
+static constexpr int P720 {1280 * 720};
+
+class CodecThreadsTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "codec_threads"; }
+
+private:
+    void testShares();
+    void testRelease();
+    void testConference();
+
+    CPPUNIT_TEST_SUITE(CodecThreadsTest);
+    CPPUNIT_TEST(testShares);
+    CPPUNIT_TEST(testRelease);
+    CPPUNIT_TEST(testConference);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(CodecThreadsTest, CodecThreadsTest::name());
+
+void
+CodecThreadsTest::testShares()
+{
+    CodecThreads threads(8);
+    int encoder, decoder, audio;
+    // Alone, up to the budget
+    CPPUNIT_ASSERT_EQUAL(8u, threads.acquire(&encoder, P720, true));
+    // 720p encoders weigh 8, decoders 4
+    CPPUNIT_ASSERT_EQUAL(2u, threads.acquire(&decoder, P720, false));
+    CPPUNIT_ASSERT_EQUAL(1u, threads.acquire(&audio, 0, false));
+    CPPUNIT_ASSERT_EQUAL(10u, threads.used());
+}
+
+void
+CodecThreadsTest::testRelease()
+{
+    CodecThreads threads(8);
+    int a, b;
+    threads.acquire(&a, P720, false);
+    CPPUNIT_ASSERT_EQUAL(4u, threads.acquire(&b, P720, false));
+    threads.release(&a);
+    CPPUNIT_ASSERT_EQUAL(4u, threads.used());
+    // Reopened: the share of a codec alone
+    CPPUNIT_ASSERT_EQUAL(8u, threads.acquire(&b, P720, false));
+    CPPUNIT_ASSERT_EQUAL(8u, threads.used());
+    threads.release(&b);
+    threads.release(&b);
+    CPPUNIT_ASSERT_EQUAL(0u, threads.used());
+}
+
+void
+CodecThreadsTest::testConference()
+{
+    // Host of 10 participants on 8 cores, previously 10 * (16 + 8) threads
+    CodecThreads threads(8);
+    std::array<int, 10> encoders, decoders;
+    for (size_t i = 0; i < encoders.size(); ++i) {
+        threads.acquire(&encoders[i], P720, true);
+        threads.acquire(&decoders[i], P720, false);
+    }
+    CPPUNIT_ASSERT(threads.used() <= 40);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::CodecThreadsTest::name())
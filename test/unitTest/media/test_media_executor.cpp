@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "media_executor.h"
+
+#include "../../test_runner.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+class MediaExecutorTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "media_executor"; }
+
+private:
+    void testPeriodic();
+    void testEarliestFirst();
+    void testStopFromJob();
+
+    CPPUNIT_TEST_SUITE(MediaExecutorTest);
+    CPPUNIT_TEST(testPeriodic);
+    CPPUNIT_TEST(testEarliestFirst);
+    CPPUNIT_TEST(testStopFromJob);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(MediaExecutorTest, MediaExecutorTest::name());
+
+void
+MediaExecutorTest::testPeriodic()
+{
+    MediaExecutor executor(2);
+    std::atomic_int steps {0};
+    auto start = MediaLoop::clock::now();
+    MediaLoop::clock::time_point next = start;
+    MediaLoop loop(
+        [&] {
+            ++steps;
+            return next += 10ms;
+        },
+        ThreadRole::DEFAULT,
+        executor);
+    CPPUNIT_ASSERT(not loop.isRunning());
+    loop.start(start);
+    CPPUNIT_ASSERT(loop.isRunning());
+    std::this_thread::sleep_for(105ms);
+    loop.join();
+    CPPUNIT_ASSERT(not loop.isRunning());
+    // Steps at 0, 10... 100 ms
+    CPPUNIT_ASSERT(steps >= 9 and steps <= 12);
+    auto stopped = steps.load();
+    std::this_thread::sleep_for(30ms);
+    CPPUNIT_ASSERT_EQUAL(stopped, steps.load());
+
+    // Restarted
+    loop.start();
+    std::this_thread::sleep_for(5ms);
+    loop.join();
+    CPPUNIT_ASSERT(steps > stopped);
+}
+
+void
+MediaExecutorTest::testEarliestFirst()
+{
+    // A single worker, busy while both jobs get due
+    MediaExecutor executor(1);
+    std::mutex mutex;
+    std::vector<int> order;
+    auto now = MediaLoop::clock::now();
+    auto job = [&](int id) {
+        return [&, id] {
+            std::this_thread::sleep_for(id == 0 ? 50ms : 0ms);
+            std::lock_guard<std::mutex> lk(mutex);
+            order.emplace_back(id);
+            return MediaLoop::clock::time_point::max();
+        };
+    };
+    MediaLoop busy(job(0), ThreadRole::DEFAULT, executor);
+    MediaLoop late(job(2), ThreadRole::DEFAULT, executor);
+    MediaLoop early(job(1), ThreadRole::DEFAULT, executor);
+    busy.start(now);
+    late.start(now + 20ms);
+    early.start(now + 10ms);
+    std::this_thread::sleep_for(100ms);
+    std::lock_guard<std::mutex> lk(mutex);
+    CPPUNIT_ASSERT((order == std::vector<int> {0, 1, 2}));
+}
+
+void
+MediaExecutorTest::testStopFromJob()
+{
+    MediaExecutor executor(2);
+    std::atomic_int steps {0};
+    std::unique_ptr<MediaLoop> loop;
+    loop = std::make_unique<MediaLoop>(
+        [&] {
+            if (++steps == 3)
+                loop->join(); // Doesn't wait for itself
+            return MediaLoop::clock::now();
+        },
+        ThreadRole::DEFAULT,
+        executor);
+    loop->start();
+    std::this_thread::sleep_for(50ms);
+    CPPUNIT_ASSERT_EQUAL(3, steps.load());
+    CPPUNIT_ASSERT(not loop->isRunning());
+    loop.reset();
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::MediaExecutorTest::name());
@@ -22,10 +22,13 @@
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <cstring>
+
 #include "jami.h"
 #include "libav_deps.h"
 #include "media_buffer.h"
 #include "media_filter.h"
+#include "video/filter_transpose.h"
 
 #include "../../test_runner.h"
 
@@ -44,6 +47,7 @@ private:
     void testVideoFilter();
     void testFilterParams();
     void testReinit();
+    void testRotation();
 
     CPPUNIT_TEST_SUITE(MediaFilterTest);
     CPPUNIT_TEST(testAudioFilter);
@@ -51,6 +55,7 @@ private:
     CPPUNIT_TEST(testVideoFilter);
     CPPUNIT_TEST(testFilterParams);
     CPPUNIT_TEST(testReinit);
+    CPPUNIT_TEST(testRotation);
     CPPUNIT_TEST_SUITE_END();
 
     std::unique_ptr<MediaFilter> filter_;
@@ -339,6 +344,43 @@ MediaFilterTest::testReinit()
     CPPUNIT_ASSERT(filter_->feedInput(frame, "in1") >= 0);
 }
 
+void
+MediaFilterTest::testRotation()
+{
+    VideoFrame input;
+    input.reserve(AV_PIX_FMT_YUV420P, 64, 48);
+    fill_yuv_image(input.pointer()->data, input.pointer()->linesize, 64, 48, 0);
+
+    // Same pixels as the filter graph
+    for (int angle : {90, 180, 270}) {
+        auto rotated = video::rotateFrame(input, angle);
+        CPPUNIT_ASSERT(rotated);
+        auto filter = video::getTransposeFilter(angle, "in", 64, 48, AV_PIX_FMT_YUV420P, false);
+        CPPUNIT_ASSERT(filter);
+        CPPUNIT_ASSERT(filter->feedInput(input.pointer(), "in") >= 0);
+        auto expected = filter->readOutput();
+        CPPUNIT_ASSERT(expected);
+        auto a = rotated->pointer();
+        auto b = expected->pointer();
+        CPPUNIT_ASSERT(a->width == b->width && a->height == b->height);
+        for (int p = 0; p < 3; ++p) {
+            const int w = p ? a->width / 2 : a->width;
+            const int h = p ? a->height / 2 : a->height;
+            for (int y = 0; y < h; ++y)
+                CPPUNIT_ASSERT(std::memcmp(a->data[p] + y * a->linesize[p],
+                                           b->data[p] + y * b->linesize[p],
+                                           w)
+                               == 0);
+        }
+    }
+
+    // Left to the filter graph
+    CPPUNIT_ASSERT(not video::rotateFrame(input, 0));
+    VideoFrame packed;
+    packed.reserve(AV_PIX_FMT_YUYV422, 64, 48);
+    CPPUNIT_ASSERT(not video::rotateFrame(packed, 90));
+}
+
 }} // namespace jami::test
 
 RING_TEST_RUNNER(jami::test::MediaFilterTest::name());
@@ -28,6 +28,7 @@ extern "C" {
 }
 
 #include "audio/audiobuffer.h"
+#include "media_buffer.h"
 #include "jami.h"
 #include "videomanager_interface.h"
 
@@ -45,10 +46,12 @@ public:
 private:
     void testCopy();
     void testMix();
+    void testPool();
 
     CPPUNIT_TEST_SUITE(MediaFrameTest);
     CPPUNIT_TEST(testCopy);
     CPPUNIT_TEST(testMix);
+    CPPUNIT_TEST(testPool);
     CPPUNIT_TEST_SUITE_END();
 };
 
@@ -120,6 +123,38 @@ MediaFrameTest::testMix()
     CPPUNIT_ASSERT(d2[6] == std::numeric_limits<AudioSample>::max());
 }
 
+void
+MediaFrameTest::testPool()
+{
+    auto& pool = FramePool::instance();
+    auto before = pool.stats();
+    {
+        DRing::VideoFrame v1;
+        v1.reserve(AV_PIX_FMT_YUV420P, 98, 50);
+        DRing::VideoFrame v2;
+        v2.reserve(AV_PIX_FMT_YUV420P, 98, 50);
+        CPPUNIT_ASSERT(v1.pointer()->data[0] != v2.pointer()->data[0]);
+        CPPUNIT_ASSERT(v1.pointer()->linesize[0] >= 98);
+        // Same layout as av_frame_get_buffer()
+        CPPUNIT_ASSERT(v1.pointer()->data[1] - v1.pointer()->data[0]
+                       >= v1.pointer()->linesize[0] * 50);
+        v1.pointer()->data[2][v1.pointer()->linesize[2] * 24 + 48] = 42;
+    }
+    auto afterFirst = pool.stats();
+    CPPUNIT_ASSERT(afterFirst.misses - before.misses == 2);
+
+    // Buffers of the released frames are reused
+    DRing::VideoFrame v3;
+    v3.reserve(AV_PIX_FMT_YUV420P, 98, 50);
+    auto a1 = std::make_unique<DRing::AudioFrame>(AudioFormat::STEREO(), 960);
+    CPPUNIT_ASSERT(a1->pointer()->extended_data[0]);
+    a1.reset();
+    a1 = std::make_unique<DRing::AudioFrame>(AudioFormat::STEREO(), 960);
+    auto after = pool.stats();
+    CPPUNIT_ASSERT(after.hits - afterFirst.hits == 2);
+    CPPUNIT_ASSERT(after.misses - afterFirst.misses == 1);
+}
+
 }} // namespace jami::test
 
 RING_TEST_RUNNER(jami::test::MediaFrameTest::name());
@@ -0,0 +1,122 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "socket_pair.h"
+
+#include "../../test_runner.h"
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace jami {
+namespace test {
+
+class RtpAudioLevelTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "rtp_audio_level"; }
+
+private:
+    void testLevels();
+    void testWithoutExtension();
+    void testAfterAbsSendTime();
+
+    CPPUNIT_TEST_SUITE(RtpAudioLevelTest);
+    CPPUNIT_TEST(testLevels);
+    CPPUNIT_TEST(testWithoutExtension);
+    CPPUNIT_TEST(testAfterAbsSendTime);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(RtpAudioLevelTest, RtpAudioLevelTest::name());
+
+static std::vector<uint8_t>
+rtpPacket(bool absSendTime)
+{
+    std::vector<uint8_t> packet {0x80, 111, 0x12, 0x34, 0, 0, 0x03, 0xc0, 0xde, 0xad, 0xbe, 0xef};
+    if (absSendTime) {
+        // As written by the muxer
+        packet[0] |= 0x10;
+        packet.insert(packet.end(), {0xBE, 0xDE, 0x00, 0x01, 0x32, 0x01, 0x02, 0x03});
+    }
+    for (uint8_t i = 0; i < 40; ++i)
+        packet.emplace_back(i);
+    return packet;
+}
+
+void
+RtpAudioLevelTest::testLevels()
+{
+    CPPUNIT_ASSERT_EQUAL(0, (int) rtp_audio_level::fromRms(1));
+    CPPUNIT_ASSERT_EQUAL(20, (int) rtp_audio_level::fromRms(.1f));
+    CPPUNIT_ASSERT_EQUAL(127, (int) rtp_audio_level::fromRms(0));
+    CPPUNIT_ASSERT_EQUAL(127, (int) rtp_audio_level::fromRms(1e-9f));
+    CPPUNIT_ASSERT(std::abs(rtp_audio_level::toRms(20) - .1f) < 1e-6f);
+    CPPUNIT_ASSERT(rtp_audio_level::toRms(127) == 0);
+}
+
+void
+RtpAudioLevelTest::testWithoutExtension()
+{
+    auto packet = rtpPacket(false);
+    CPPUNIT_ASSERT_EQUAL(-1, rtp_audio_level::find(packet.data(), packet.size(), 1));
+
+    std::array<uint8_t, 256> out;
+    auto len = rtp_audio_level::add(packet.data(), packet.size(), 1, 42, true, out.data(), 256);
+    CPPUNIT_ASSERT_EQUAL(packet.size() + 8, len);
+    CPPUNIT_ASSERT(out[0] & 0x10);
+    CPPUNIT_ASSERT_EQUAL(0x80 | 42, rtp_audio_level::find(out.data(), len, 1));
+    CPPUNIT_ASSERT_EQUAL(-1, rtp_audio_level::find(out.data(), len, 2));
+    // Same payload
+    CPPUNIT_ASSERT(std::memcmp(out.data() + 20, packet.data() + 12, packet.size() - 12) == 0);
+
+    // No room
+    CPPUNIT_ASSERT_EQUAL((size_t) 0,
+                         rtp_audio_level::add(packet.data(),
+                                              packet.size(),
+                                              1,
+                                              42,
+                                              true,
+                                              out.data(),
+                                              packet.size() + 4));
+}
+
+void
+RtpAudioLevelTest::testAfterAbsSendTime()
+{
+    auto packet = rtpPacket(true);
+    std::array<uint8_t, 256> out;
+    auto len = rtp_audio_level::add(packet.data(), packet.size(), 1, 90, false, out.data(), 256);
+    CPPUNIT_ASSERT_EQUAL(packet.size() + 4, len);
+    // abs-send-time stays first
+    CPPUNIT_ASSERT(std::memcmp(out.data() + 12, "\xBE\xDE\x00\x02\x32\x01\x02\x03", 8) == 0);
+    CPPUNIT_ASSERT_EQUAL(90, rtp_audio_level::find(out.data(), len, 1));
+    CPPUNIT_ASSERT(std::memcmp(out.data() + 24, packet.data() + 20, packet.size() - 20) == 0);
+
+    // Truncated
+    CPPUNIT_ASSERT_EQUAL(-1, rtp_audio_level::find(out.data(), 20, 1));
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::RtpAudioLevelTest::name());
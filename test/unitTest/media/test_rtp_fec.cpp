@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "rtp_fec.h"
+
+#include "../../test_runner.h"
+
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+using Packet = std::vector<uint8_t>;
+
+static Packet
+rtpPacket(uint16_t seq, uint32_t timestamp, bool marker, std::size_t payloadSize)
+{
+    Packet packet {0x80,
+                   uint8_t((marker ? 0x80 : 0) | 96),
+                   uint8_t(seq >> 8),
+                   uint8_t(seq),
+                   uint8_t(timestamp >> 24),
+                   uint8_t(timestamp >> 16),
+                   uint8_t(timestamp >> 8),
+                   uint8_t(timestamp),
+                   0,
+                   0,
+                   0x12,
+                   0x34};
+    for (std::size_t i = 0; i < payloadSize; ++i)
+        packet.emplace_back(uint8_t(seq + i));
+    return packet;
+}
+
+class RtpFecTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "rtp_fec"; }
+
+private:
+    void testGroupSize();
+    void testRecover();
+    void testGroups();
+
+    CPPUNIT_TEST_SUITE(RtpFecTest);
+    CPPUNIT_TEST(testGroupSize);
+    CPPUNIT_TEST(testRecover);
+    CPPUNIT_TEST(testGroups);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(RtpFecTest, RtpFecTest::name());
+
+void
+RtpFecTest::testGroupSize()
+{
+    CPPUNIT_ASSERT_EQUAL(0u, flexfec::groupSize(0));
+    CPPUNIT_ASSERT_EQUAL(10u, flexfec::groupSize(0.02));
+    CPPUNIT_ASSERT_EQUAL(5u, flexfec::groupSize(0.05));
+    CPPUNIT_ASSERT_EQUAL(2u, flexfec::groupSize(0.3));
+}
+
+void
+RtpFecTest::testRecover()
+{
+    flexfec::Encoder encoder(0x5555, 7, 98);
+    encoder.setGroupSize(4);
+    auto now = flexfec::Encoder::clock::now();
+    // Of different sizes, the last one ending a frame
+    std::vector<Packet> packets {rtpPacket(100, 3000, false, 1000),
+                                 rtpPacket(101, 3000, false, 1200),
+                                 rtpPacket(102, 3000, false, 300),
+                                 rtpPacket(103, 3000, true, 50)};
+    uint8_t repair[2048];
+    std::size_t repairLen = 0;
+    for (const auto& p : packets) {
+        CPPUNIT_ASSERT_EQUAL(std::size_t(0), repairLen);
+        repairLen = encoder.protect(p.data(), p.size(), repair, sizeof(repair), now);
+    }
+    CPPUNIT_ASSERT_EQUAL(flexfec::OVERHEAD + 1200, repairLen);
+    CPPUNIT_ASSERT_EQUAL(uint8_t(98), repair[1]);
+    CPPUNIT_ASSERT_EQUAL(7, repair[2] << 8 | repair[3]);
+
+    // Each one of the packets is recovered from the others
+    for (std::size_t lost = 0; lost < packets.size(); ++lost) {
+        flexfec::Decoder decoder;
+        for (std::size_t i = 0; i < packets.size(); ++i)
+            if (i != lost)
+                decoder.onPacket(packets[i].data(), packets[i].size());
+        Packet p(repair, repair + repairLen);
+        auto len = decoder.recover(p.data(), p.size());
+        CPPUNIT_ASSERT_EQUAL(packets[lost].size(), len);
+        CPPUNIT_ASSERT((Packet(p.begin(), p.begin() + len) == packets[lost]));
+        // Then nothing is missing
+        p.assign(repair, repair + repairLen);
+        CPPUNIT_ASSERT_EQUAL(std::size_t(0), decoder.recover(p.data(), p.size()));
+    }
+
+    // Not with two missing
+    flexfec::Decoder decoder;
+    decoder.onPacket(packets[0].data(), packets[0].size());
+    decoder.onPacket(packets[1].data(), packets[1].size());
+    Packet p(repair, repair + repairLen);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0), decoder.recover(p.data(), p.size()));
+}
+
+void
+RtpFecTest::testGroups()
+{
+    flexfec::Encoder encoder(0x5555, 0, 98);
+    auto now = flexfec::Encoder::clock::now();
+    uint8_t repair[2048];
+    auto p = rtpPacket(1, 0, true, 100);
+    // Not protected
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0), encoder.protect(p.data(), p.size(), repair, 2048, now));
+
+    // A small frame waits for the next ones
+    encoder.setGroupSize(10);
+    p = rtpPacket(2, 0, true, 100);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0), encoder.protect(p.data(), p.size(), repair, 2048, now));
+    p = rtpPacket(3, 3000, true, 100);
+    auto later = now + flexfec::Encoder::MAX_GROUP_DELAY;
+    auto len = encoder.protect(p.data(), p.size(), repair, sizeof(repair), later);
+    CPPUNIT_ASSERT(len > 0);
+    // SN base and L
+    CPPUNIT_ASSERT_EQUAL(2, repair[24] << 8 | repair[25]);
+    CPPUNIT_ASSERT_EQUAL(uint8_t(2), repair[26]);
+
+    // A gap starts a new group
+    p = rtpPacket(4, 6000, false, 100);
+    encoder.protect(p.data(), p.size(), repair, sizeof(repair), later);
+    p = rtpPacket(6, 6000, true, 100);
+    len = encoder.protect(p.data(), p.size(), repair, sizeof(repair), later + 40ms);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0), len);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::RtpFecTest::name());
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "rtp_retransmission.h"
+
+#include "../../test_runner.h"
+
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+using Packet = std::vector<uint8_t>;
+
+static Packet
+rtpPacket(uint16_t seq, uint32_t ssrc, std::size_t payloadSize)
+{
+    Packet packet {0x80,
+                   0x80 | 96,
+                   uint8_t(seq >> 8),
+                   uint8_t(seq),
+                   0,
+                   0,
+                   0x12,
+                   0x34,
+                   uint8_t(ssrc >> 24),
+                   uint8_t(ssrc >> 16),
+                   uint8_t(ssrc >> 8),
+                   uint8_t(ssrc)};
+    for (std::size_t i = 0; i < payloadSize; ++i)
+        packet.emplace_back(uint8_t(i));
+    return packet;
+}
+
+class RtpRetransmissionTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "rtp_retransmission"; }
+
+private:
+    void testNack();
+    void testRetransmit();
+    void testBudget();
+
+    CPPUNIT_TEST_SUITE(RtpRetransmissionTest);
+    CPPUNIT_TEST(testNack);
+    CPPUNIT_TEST(testRetransmit);
+    CPPUNIT_TEST(testBudget);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(RtpRetransmissionTest, RtpRetransmissionTest::name());
+
+void
+RtpRetransmissionTest::testNack()
+{
+    // In the bitmask of 10, then wrapping around
+    std::vector<uint16_t> lost {10, 11, 26, 27, 65535, 0};
+    uint8_t buf[64];
+    auto len = rtcp_nack::write(1, 0xAABBCCDD, lost, buf, sizeof(buf));
+    CPPUNIT_ASSERT_EQUAL(std::size_t(12 + 3 * 4), len);
+
+    uint32_t ssrc = 0;
+    std::vector<uint16_t> seqs;
+    CPPUNIT_ASSERT(rtcp_nack::parse(buf, len, ssrc, seqs));
+    CPPUNIT_ASSERT_EQUAL(uint32_t(0xAABBCCDD), ssrc);
+    CPPUNIT_ASSERT((seqs == lost));
+
+    // Truncated, or another feedback
+    seqs.clear();
+    CPPUNIT_ASSERT(not rtcp_nack::parse(buf, len - 4, ssrc, seqs));
+    buf[0] = 0x80 | 15;
+    CPPUNIT_ASSERT(not rtcp_nack::parse(buf, len, ssrc, seqs));
+    CPPUNIT_ASSERT(seqs.empty());
+}
+
+void
+RtpRetransmissionTest::testRetransmit()
+{
+    RtxSender sender(0x5555, 1000, 97);
+    sender.setBitrate(1000);
+    auto now = RtxSender::clock::now();
+    auto packet = rtpPacket(42, 0x1234, 100);
+    sender.onSent(packet.data(), packet.size());
+
+    uint8_t out[2048];
+    // Not sent, or of another stream
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0), sender.retransmit(0x1234, 43, out, sizeof(out), now));
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0), sender.retransmit(0x4321, 42, out, sizeof(out), now));
+
+    auto len = sender.retransmit(0x1234, 42, out, sizeof(out), now + 100ms);
+    CPPUNIT_ASSERT_EQUAL(packet.size() + 2, len);
+    CPPUNIT_ASSERT_EQUAL(uint8_t(0x80 | 97), out[1]);
+    CPPUNIT_ASSERT_EQUAL(1000, out[2] << 8 | out[3]);
+    CPPUNIT_ASSERT_EQUAL(0x5555, out[10] << 8 | out[11]);
+    CPPUNIT_ASSERT_EQUAL(42, out[12] << 8 | out[13]);
+
+    // Not again before the retransmission could be received
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0),
+                         sender.retransmit(0x1234, 42, out, sizeof(out), now + 110ms));
+    CPPUNIT_ASSERT_EQUAL(len, sender.retransmit(0x1234, 42, out, sizeof(out), now + 200ms));
+    CPPUNIT_ASSERT_EQUAL(1001, out[2] << 8 | out[3]);
+
+    CPPUNIT_ASSERT_EQUAL(packet.size(), restoreRtxPacket(out, len, 96, 0x1234));
+    CPPUNIT_ASSERT((Packet(out, out + packet.size()) == packet));
+}
+
+void
+RtpRetransmissionTest::testBudget()
+{
+    RtxSender sender(0x5555, 0, 97);
+    auto now = RtxSender::clock::now();
+    for (uint16_t seq = 0; seq < 100; ++seq) {
+        auto packet = rtpPacket(seq, 0x1234, 1000);
+        sender.onSent(packet.data(), packet.size());
+    }
+    uint8_t out[2048];
+    // No target bitrate
+    CPPUNIT_ASSERT_EQUAL(std::size_t(0), sender.retransmit(0x1234, 0, out, sizeof(out), now));
+
+    // 1 Mbps: 31250 bytes per second, at most 6250 bytes at once
+    sender.setBitrate(1000);
+    unsigned sent = 0;
+    for (uint16_t seq = 0; seq < 100; ++seq)
+        sent += sender.retransmit(0x1234, seq, out, sizeof(out), now + 1s) ? 1 : 0;
+    CPPUNIT_ASSERT_EQUAL(6u, sent);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::RtpRetransmissionTest::name());
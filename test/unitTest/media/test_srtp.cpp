@@ -0,0 +1,191 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+extern "C" {
+#include "srtp.h"
+}
+
+#include "../../test_runner.h"
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+namespace jami {
+namespace test {
+
+// RFC 3711 appendix B.3
+static constexpr const char* AES_CM_KEY = "4fl6DT4Bi+DWT6MsBt5BOQ7Gda1Jiv7rtpYLOqvm";
+static constexpr uint8_t AES_CM_RTP_SALT[] {0x30, 0xCB, 0xBC, 0x08, 0x86, 0x3D, 0x8C,
+                                            0x85, 0xD4, 0x9D, 0xB3, 0x4A, 0x9A, 0xE1};
+// RFC 7714 section 16
+static constexpr const char* GCM_KEY = "AAECAwQFBgcICQoLDA0OD1F1aWQgcHJvIHF1bw==";
+
+class SrtpTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "srtp"; }
+
+    void setUp();
+    void tearDown();
+
+private:
+    void testKeyDerivation();
+    void testAesCm();
+    void testAesGcm();
+    void testRtcp();
+
+    void roundTrip(const char* suite, const char* key, int overhead);
+
+    CPPUNIT_TEST_SUITE(SrtpTest);
+    CPPUNIT_TEST(testKeyDerivation);
+    CPPUNIT_TEST(testAesCm);
+    CPPUNIT_TEST(testAesGcm);
+    CPPUNIT_TEST(testRtcp);
+    CPPUNIT_TEST_SUITE_END();
+
+    SRTPContext out_ {};
+    SRTPContext in_ {};
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(SrtpTest, SrtpTest::name());
+
+void
+SrtpTest::setUp()
+{
+    std::memset(&out_, 0, sizeof(out_));
+    std::memset(&in_, 0, sizeof(in_));
+}
+
+void
+SrtpTest::tearDown()
+{
+    ff_srtp_free(&out_);
+    ff_srtp_free(&in_);
+}
+
+static std::vector<uint8_t>
+rtpPacket(uint16_t seq, size_t payloadSize)
+{
+    std::vector<uint8_t> packet(12 + payloadSize);
+    packet[0] = 0x80;
+    packet[1] = 96;
+    packet[2] = seq >> 8;
+    packet[3] = seq & 0xff;
+    packet[8] = 0xde;
+    packet[9] = 0xad;
+    for (size_t i = 12; i < packet.size(); ++i)
+        packet[i] = i + seq;
+    return packet;
+}
+
+void
+SrtpTest::roundTrip(const char* suite, const char* key, int overhead)
+{
+    CPPUNIT_ASSERT(ff_srtp_set_crypto(&out_, suite, key) == 0);
+    CPPUNIT_ASSERT(ff_srtp_set_crypto(&in_, suite, key) == 0);
+    CPPUNIT_ASSERT_EQUAL(overhead, ff_srtp_overhead(&out_));
+
+    for (uint16_t seq = 65530; seq != 5; ++seq) {
+        auto plain = rtpPacket(seq, 160);
+        std::array<uint8_t, 2048> buf;
+        std::memcpy(buf.data(), plain.data(), plain.size());
+
+        // Protected in place
+        int len = ff_srtp_protect(&out_, buf.data(), plain.size(), buf.size());
+        CPPUNIT_ASSERT_EQUAL(static_cast<int>(plain.size()) + overhead, len);
+        CPPUNIT_ASSERT(std::memcmp(buf.data(), plain.data(), 12) == 0);
+        CPPUNIT_ASSERT(std::memcmp(buf.data() + 12, plain.data() + 12, 160) != 0);
+
+        CPPUNIT_ASSERT(ff_srtp_decrypt(&in_, buf.data(), &len) == 0);
+        CPPUNIT_ASSERT_EQUAL(static_cast<int>(plain.size()), len);
+        CPPUNIT_ASSERT(std::memcmp(buf.data(), plain.data(), len) == 0);
+    }
+
+    // Out of place
+    auto plain = rtpPacket(5, 100);
+    std::array<uint8_t, 2048> buf;
+    int len = ff_srtp_encrypt(&out_, plain.data(), plain.size(), buf.data(), buf.size());
+    CPPUNIT_ASSERT_EQUAL(static_cast<int>(plain.size()) + overhead, len);
+
+    // Forged
+    buf[20] ^= 1;
+    CPPUNIT_ASSERT(ff_srtp_decrypt(&in_, buf.data(), &len) < 0);
+
+    // No room for the tag
+    CPPUNIT_ASSERT_EQUAL(0, ff_srtp_protect(&out_, plain.data(), plain.size(), plain.size()));
+}
+
+void
+SrtpTest::testKeyDerivation()
+{
+    CPPUNIT_ASSERT(ff_srtp_set_crypto(&out_, "AES_CM_128_HMAC_SHA1_80", AES_CM_KEY) == 0);
+    CPPUNIT_ASSERT(std::memcmp(out_.rtp_salt, AES_CM_RTP_SALT, sizeof(AES_CM_RTP_SALT)) == 0);
+
+    // 30 bytes of key and salt instead of 28
+    CPPUNIT_ASSERT(ff_srtp_set_crypto(&out_, "AEAD_AES_128_GCM", AES_CM_KEY) < 0);
+    CPPUNIT_ASSERT(out_.suite == SRTP_SUITE_NONE);
+    CPPUNIT_ASSERT(ff_srtp_set_crypto(&out_, "F8_128_HMAC_SHA1_80", AES_CM_KEY) < 0);
+}
+
+void
+SrtpTest::testAesCm()
+{
+    roundTrip("AES_CM_128_HMAC_SHA1_80", AES_CM_KEY, 10);
+    roundTrip("AES_CM_128_HMAC_SHA1_32", AES_CM_KEY, 4);
+}
+
+void
+SrtpTest::testAesGcm()
+{
+    roundTrip("AEAD_AES_128_GCM", GCM_KEY, 16);
+}
+
+void
+SrtpTest::testRtcp()
+{
+    for (auto [suite, key] : {std::make_pair("AES_CM_128_HMAC_SHA1_80", AES_CM_KEY),
+                              std::make_pair("AEAD_AES_128_GCM", GCM_KEY)}) {
+        CPPUNIT_ASSERT(ff_srtp_set_crypto(&out_, suite, key) == 0);
+        CPPUNIT_ASSERT(ff_srtp_set_crypto(&in_, suite, key) == 0);
+
+        // Sender report
+        std::vector<uint8_t> plain(28);
+        plain[0] = 0x80;
+        plain[1] = 200;
+        plain[3] = 6;
+        for (size_t i = 4; i < plain.size(); ++i)
+            plain[i] = i;
+        std::array<uint8_t, 256> buf;
+        std::memcpy(buf.data(), plain.data(), plain.size());
+
+        int len = ff_srtp_protect(&out_, buf.data(), plain.size(), buf.size());
+        CPPUNIT_ASSERT_EQUAL(static_cast<int>(plain.size()) + out_.rtcp_hmac_size + 4, len);
+        CPPUNIT_ASSERT(ff_srtp_decrypt(&in_, buf.data(), &len) == 0);
+        CPPUNIT_ASSERT_EQUAL(static_cast<int>(plain.size()), len);
+        CPPUNIT_ASSERT(std::memcmp(buf.data(), plain.data(), len) == 0);
+    }
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::SrtpTest::name());
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "video/rtp_forwarder.h"
+
+#include "../../../test_runner.h"
+
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace video {
+namespace test {
+
+using Packet = std::vector<uint8_t>;
+
+static Packet
+rtpPacket(uint16_t seq, uint32_t timestamp, uint32_t ssrc, const Packet& payload)
+{
+    Packet packet {0x80,
+                   96,
+                   uint8_t(seq >> 8),
+                   uint8_t(seq),
+                   uint8_t(timestamp >> 24),
+                   uint8_t(timestamp >> 16),
+                   uint8_t(timestamp >> 8),
+                   uint8_t(timestamp),
+                   uint8_t(ssrc >> 24),
+                   uint8_t(ssrc >> 16),
+                   uint8_t(ssrc >> 8),
+                   uint8_t(ssrc)};
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    return packet;
+}
+
+static uint16_t
+seqOf(const Packet& p)
+{
+    return p[2] << 8 | p[3];
+}
+
+static uint32_t
+timestampOf(const Packet& p)
+{
+    return uint32_t(p[4]) << 24 | p[5] << 16 | p[6] << 8 | p[7];
+}
+
+static uint32_t
+ssrcOf(const Packet& p)
+{
+    return uint32_t(p[8]) << 24 | p[9] << 16 | p[10] << 8 | p[11];
+}
+
+// H264 NAL headers
+static const Packet IDR {0x65, 0};
+static const Packet SLICE {0x41, 0};
+
+class RtpForwarderTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "rtp_forwarder"; }
+
+private:
+    void testRewrite();
+    void testKeyFrames();
+    void testSwitchOnKeyFrame();
+
+    CPPUNIT_TEST_SUITE(RtpForwarderTest);
+    CPPUNIT_TEST(testRewrite);
+    CPPUNIT_TEST(testKeyFrames);
+    CPPUNIT_TEST(testSwitchOnKeyFrame);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(RtpForwarderTest, RtpForwarderTest::name());
+
+void
+RtpForwarderTest::testRewrite()
+{
+    RtpRewriter rewriter(0x1234, 100, 97);
+    auto now = RtpRewriter::clock::now();
+
+    auto p = rtpPacket(5000, 90000, 0xAAAA, SLICE);
+    rewriter.rewrite(p.data(), now);
+    CPPUNIT_ASSERT_EQUAL(uint16_t(100), seqOf(p));
+    CPPUNIT_ASSERT_EQUAL(uint32_t(0x1234), ssrcOf(p));
+    CPPUNIT_ASSERT_EQUAL(uint8_t(97), uint8_t(p[1] & 0x7f));
+    auto timestamp = timestampOf(p);
+
+    // A loss is kept
+    p = rtpPacket(5002, 93000, 0xAAAA, SLICE);
+    rewriter.rewrite(p.data(), now + 33ms);
+    CPPUNIT_ASSERT_EQUAL(uint16_t(102), seqOf(p));
+    CPPUNIT_ASSERT_EQUAL(timestamp + 3000, timestampOf(p));
+
+    // The new source goes on from the last packet sent
+    rewriter.switchSource();
+    p = rtpPacket(10, 7, 0xBBBB, IDR);
+    rewriter.rewrite(p.data(), now + 66ms);
+    CPPUNIT_ASSERT_EQUAL(uint16_t(103), seqOf(p));
+    CPPUNIT_ASSERT_EQUAL(timestamp + 3000 + 33 * 90, timestampOf(p));
+    CPPUNIT_ASSERT_EQUAL(uint32_t(0x1234), ssrcOf(p));
+
+    p = rtpPacket(11, 3007, 0xBBBB, SLICE);
+    rewriter.rewrite(p.data(), now + 99ms);
+    CPPUNIT_ASSERT_EQUAL(uint16_t(104), seqOf(p));
+    CPPUNIT_ASSERT_EQUAL(timestamp + 6000 + 33 * 90, timestampOf(p));
+}
+
+void
+RtpForwarderTest::testKeyFrames()
+{
+    auto isKey = [](std::string_view codec, const Packet& payload) {
+        auto p = rtpPacket(0, 0, 0, payload);
+        return RtpForwarder::startsKeyFrame(codec, p.data(), p.size());
+    };
+    // H264: IDR, SPS in a STAP-A, first and next fragments of an IDR
+    CPPUNIT_ASSERT(isKey("H264", IDR));
+    CPPUNIT_ASSERT(not isKey("H264", SLICE));
+    CPPUNIT_ASSERT(isKey("H264", {0x78, 0, 2, 0x67, 0, 0, 1, 0x68}));
+    CPPUNIT_ASSERT(isKey("H264", {0x7c, 0x85, 0}));
+    CPPUNIT_ASSERT(not isKey("H264", {0x7c, 0x05, 0}));
+    // H265: IDR_W_RADL, TRAIL_R
+    CPPUNIT_ASSERT(isKey("H265", {19 << 1, 1, 0}));
+    CPPUNIT_ASSERT(not isKey("H265", {1 << 1, 1, 0}));
+    // VP8: start of a key or inter frame, with a picture id
+    CPPUNIT_ASSERT(isKey("VP8", {0x90, 0x80, 0x81, 0x02, 0x00}));
+    CPPUNIT_ASSERT(not isKey("VP8", {0x90, 0x80, 0x81, 0x02, 0x01}));
+    CPPUNIT_ASSERT(not isKey("VP8", {0x80, 0x80, 0x81, 0x02, 0x00}));
+    // VP9: start of a key frame, of an inter one, both of FFmpeg; then with a picture id and
+    // the layer indices, of the profile 3
+    CPPUNIT_ASSERT(isKey("VP9", {0x08, 0x82, 0x49}));
+    CPPUNIT_ASSERT(not isKey("VP9", {0x08, 0x86, 0x00}));
+    CPPUNIT_ASSERT(not isKey("VP9", {0x04, 0x82, 0x49}));
+    CPPUNIT_ASSERT(isKey("VP9", {0xa8, 0x81, 0x02, 0x00, 0x00, 0xb0}));
+    CPPUNIT_ASSERT(not isKey("VP9", {0xa8, 0x81, 0x02, 0x00, 0x00, 0xb2}));
+    // Unknown
+    CPPUNIT_ASSERT(isKey("MP4V-ES", {0}));
+}
+
+void
+RtpForwarderTest::testSwitchOnKeyFrame()
+{
+    std::vector<std::string> requested;
+    RtpForwarder forwarder([&](const std::string& id) { requested.emplace_back(id); });
+    std::vector<std::pair<std::string, bool>> received;
+    for (const auto& id : {"a", "b", "c"}) {
+        forwarder.addDestination(id,
+                                 [&received, id = std::string(id)](const uint8_t*,
+                                                                   std::size_t,
+                                                                   bool newSource) {
+                                     received.emplace_back(id, newSource);
+                                 });
+    }
+    auto now = RtpForwarder::clock::now();
+    auto slice = rtpPacket(1, 0, 0, SLICE);
+    auto idr = rtpPacket(2, 0, 0, IDR);
+
+    forwarder.setSource("a", "H264");
+    CPPUNIT_ASSERT((requested == std::vector<std::string> {"a"}));
+    forwarder.onPacket("a", slice.data(), slice.size(), now);
+    forwarder.onPacket("b", idr.data(), idr.size(), now);
+    CPPUNIT_ASSERT(received.empty());
+    // From the keyframe of the source, to the others
+    forwarder.onPacket("a", idr.data(), idr.size(), now);
+    forwarder.onPacket("a", slice.data(), slice.size(), now);
+    using Received = std::vector<std::pair<std::string, bool>>;
+    CPPUNIT_ASSERT((received
+                    == Received {{"b", true}, {"c", true}, {"b", false}, {"c", false}}));
+
+    // a is forwarded until the keyframe of b
+    received.clear();
+    forwarder.setSource("b", "H264");
+    CPPUNIT_ASSERT_EQUAL(std::string("b"), forwarder.getSource());
+    forwarder.onPacket("b", slice.data(), slice.size(), now);
+    forwarder.onPacket("a", slice.data(), slice.size(), now);
+    CPPUNIT_ASSERT((received == Received {{"b", false}, {"c", false}}));
+    received.clear();
+    forwarder.onPacket("b", idr.data(), idr.size(), now);
+    forwarder.onPacket("a", slice.data(), slice.size(), now);
+    CPPUNIT_ASSERT((received == Received {{"a", true}, {"c", true}}));
+
+    // Without a keyframe, switched after the timeout
+    received.clear();
+    forwarder.setSource("c", "H264");
+    forwarder.onPacket("c",
+                       slice.data(),
+                       slice.size(),
+                       RtpForwarder::clock::now() + RtpForwarder::SWITCH_TIMEOUT);
+    CPPUNIT_ASSERT((received == Received {{"a", true}, {"b", true}}));
+}
+
+} // namespace test
+} // namespace video
+} // namespace jami
+
+RING_TEST_RUNNER(jami::video::test::RtpForwarderTest::name());
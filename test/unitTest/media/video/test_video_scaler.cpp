@@ -22,7 +22,10 @@
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <cstring>
+
 #include "jami.h"
+#include "libav_deps.h"
 #include "videomanager_interface.h"
 #include "video/video_scaler.h"
 
@@ -41,11 +44,15 @@ private:
     void testConvertFrame();
     void testScale();
     void testScaleWithAspect();
+    void testFastConversion();
+    void testHalve();
 
     CPPUNIT_TEST_SUITE(VideoScalerTest);
     CPPUNIT_TEST(testConvertFrame);
     CPPUNIT_TEST(testScale);
     CPPUNIT_TEST(testScaleWithAspect);
+    CPPUNIT_TEST(testFastConversion);
+    CPPUNIT_TEST(testHalve);
     CPPUNIT_TEST_SUITE_END();
 
     std::unique_ptr<VideoScaler> scaler_;
@@ -105,6 +112,54 @@ VideoScalerTest::testScaleWithAspect()
     CPPUNIT_ASSERT(output.height() == 360);
 }
 
+void
+VideoScalerTest::testFastConversion()
+{
+    scaler_.reset(new VideoScaler);
+
+    // Large enough to be converted by bands
+    DRing::VideoFrame input;
+    input.reserve(AV_PIX_FMT_NV12, 1920, 1080);
+    auto frame = input.pointer();
+    for (int p = 0; p < 2; ++p)
+        for (int y = 0; y < (p ? 540 : 1080); ++y)
+            for (int x = 0; x < 1920; ++x)
+                frame->data[p][y * frame->linesize[p] + x] = (x * 7 + y * 13 + p) & 0xff;
+
+    auto yuv = scaler_->convertFormat(input, AV_PIX_FMT_YUV420P);
+    auto nv12 = scaler_->convertFormat(*yuv, AV_PIX_FMT_NV12);
+    auto out = nv12->pointer();
+    for (int p = 0; p < 2; ++p)
+        for (int y = 0; y < (p ? 540 : 1080); ++y)
+            CPPUNIT_ASSERT(std::memcmp(frame->data[p] + y * frame->linesize[p],
+                                       out->data[p] + y * out->linesize[p],
+                                       1920)
+                           == 0);
+}
+
+void
+VideoScalerTest::testHalve()
+{
+    scaler_.reset(new VideoScaler);
+
+    DRing::VideoFrame input, output;
+    input.reserve(AV_PIX_FMT_YUV420P, 320, 240);
+    output.reserve(AV_PIX_FMT_YUV420P, 160, 120);
+    auto in = input.pointer();
+    // Columns alternately at 10 and 20
+    for (int p = 0; p < 3; ++p)
+        for (int y = 0; y < (p ? 120 : 240); ++y)
+            for (int x = 0; x < (p ? 160 : 320); ++x)
+                in->data[p][y * in->linesize[p] + x] = x % 2 ? 20 : 10;
+
+    scaler_->scale(input, output);
+    auto out = output.pointer();
+    for (int p = 0; p < 3; ++p)
+        for (int y = 0; y < (p ? 60 : 120); ++y)
+            for (int x = 0; x < (p ? 80 : 160); ++x)
+                CPPUNIT_ASSERT(out->data[p][y * out->linesize[p] + x] == 15);
+}
+
 }}} // namespace jami::test
 
 RING_TEST_RUNNER(jami::video::test::VideoScalerTest::name());
@@ -0,0 +1,162 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "metrics.h"
+#include "../../test_runner.h"
+
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace jami {
+namespace test {
+
+class MetricsTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "metrics"; }
+
+private:
+    void testCounterThreads();
+    void testGauge();
+    void testHistogram();
+    void testRegistry();
+    void testOpenMetrics();
+    void testCollector();
+
+    CPPUNIT_TEST_SUITE(MetricsTest);
+    CPPUNIT_TEST(testCounterThreads);
+    CPPUNIT_TEST(testGauge);
+    CPPUNIT_TEST(testHistogram);
+    CPPUNIT_TEST(testRegistry);
+    CPPUNIT_TEST(testOpenMetrics);
+    CPPUNIT_TEST(testCollector);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(MetricsTest, MetricsTest::name());
+
+void
+MetricsTest::testCounterThreads()
+{
+    metrics::Counter counter;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 32; ++t)
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10000; ++i)
+                counter.add();
+        });
+    for (auto& t : threads)
+        t.join();
+    CPPUNIT_ASSERT(counter.value() == 320000);
+}
+
+void
+MetricsTest::testGauge()
+{
+    metrics::Gauge gauge;
+    gauge.set(10);
+    std::thread([&] { gauge.add(5); }).join();
+    gauge.add(-2);
+    CPPUNIT_ASSERT(gauge.value() == 13);
+}
+
+void
+MetricsTest::testHistogram()
+{
+    metrics::Histogram histogram({1, 2, 5});
+    histogram.observe(0.5);
+    histogram.observe(1);
+    histogram.observe(3);
+    histogram.observe(100);
+    histogram.observe(std::chrono::milliseconds(1500));
+
+    auto s = histogram.snapshot();
+    CPPUNIT_ASSERT(s.counts.size() == 4);
+    // Upper bounds are inclusive
+    CPPUNIT_ASSERT(s.counts[0] == 2);
+    CPPUNIT_ASSERT(s.counts[1] == 1);
+    CPPUNIT_ASSERT(s.counts[2] == 1);
+    CPPUNIT_ASSERT(s.counts[3] == 1);
+    CPPUNIT_ASSERT(s.count == 5);
+    CPPUNIT_ASSERT(s.sum == 106);
+}
+
+void
+MetricsTest::testRegistry()
+{
+    auto& registry = metrics::Registry::instance();
+    auto& a = registry.counter("test_registry", "Test", {{"media", "audio"}});
+    auto& b = registry.counter("test_registry", "Test", {{"media", "video"}});
+    CPPUNIT_ASSERT(&a != &b);
+    CPPUNIT_ASSERT(&a == &registry.counter("test_registry", "Test", {{"media", "audio"}}));
+    CPPUNIT_ASSERT_THROW(registry.gauge("test_registry", "Test"), std::invalid_argument);
+}
+
+void
+MetricsTest::testOpenMetrics()
+{
+    auto& registry = metrics::Registry::instance();
+    registry.counter("test_export_packets", "Packets", {{"media", "a\"b"}}).add(3);
+    registry.gauge("test_export_depth", "Depth").set(-4);
+    auto& histogram = registry.histogram("test_export_seconds", "Duration", {0.5, 1});
+    histogram.observe(0.25);
+    histogram.observe(0.75);
+
+    auto text = registry.openMetrics();
+    auto contains = [&](const std::string& line) {
+        return text.find(line + "\n") != std::string::npos;
+    };
+    CPPUNIT_ASSERT(contains("# TYPE test_export_packets counter"));
+    CPPUNIT_ASSERT(contains("# HELP test_export_packets Packets"));
+    CPPUNIT_ASSERT(contains("test_export_packets_total{media=\"a\\\"b\"} 3"));
+    CPPUNIT_ASSERT(contains("# TYPE test_export_depth gauge"));
+    CPPUNIT_ASSERT(contains("test_export_depth -4"));
+    CPPUNIT_ASSERT(contains("test_export_seconds_bucket{le=\"0.5\"} 1"));
+    CPPUNIT_ASSERT(contains("test_export_seconds_bucket{le=\"1\"} 2"));
+    CPPUNIT_ASSERT(contains("test_export_seconds_bucket{le=\"+Inf\"} 2"));
+    CPPUNIT_ASSERT(contains("test_export_seconds_sum 1"));
+    CPPUNIT_ASSERT(contains("test_export_seconds_count 2"));
+    CPPUNIT_ASSERT(text.size() >= 6 and text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+}
+
+void
+MetricsTest::testCollector()
+{
+    auto& registry = metrics::Registry::instance();
+    // Kept by the registry after the test
+    auto calls = std::make_shared<int>(0);
+    registry.addCollector([calls] { metrics::memoryBytes("test_pool").set(++*calls * 1024); });
+
+    auto text = registry.openMetrics();
+    CPPUNIT_ASSERT_EQUAL(1, *calls);
+    CPPUNIT_ASSERT(text.find("jami_memory_bytes{pool=\"test_pool\"} 1024\n") != std::string::npos);
+    // Called again, with the current value
+    text = registry.openMetrics();
+    CPPUNIT_ASSERT_EQUAL(2, *calls);
+    CPPUNIT_ASSERT(text.find("jami_memory_bytes{pool=\"test_pool\"} 2048\n") != std::string::npos);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::MetricsTest::name())
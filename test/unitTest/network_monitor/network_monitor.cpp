@@ -0,0 +1,149 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "network_monitor.h"
+#include "../../test_runner.h"
+
+#include <algorithm>
+
+using namespace std::literals::chrono_literals;
+
+namespace jami {
+namespace test {
+
+static NetworkState
+state(std::vector<std::string> addrs, const std::string& local4, const std::string& local6 = {})
+{
+    NetworkState s;
+    for (const auto& a : addrs)
+        s.addresses.emplace_back(a);
+    std::sort(s.addresses.begin(), s.addresses.end());
+    if (not local4.empty())
+        s.local4 = IpAddr(local4);
+    if (not local6.empty())
+        s.local6 = IpAddr(local6);
+    return s;
+}
+
+class NetworkMonitorTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "network_monitor"; }
+
+private:
+    void testDiff();
+    void testSettle();
+    void testFlapping();
+    void testOffline();
+
+    CPPUNIT_TEST_SUITE(NetworkMonitorTest);
+    CPPUNIT_TEST(testDiff);
+    CPPUNIT_TEST(testSettle);
+    CPPUNIT_TEST(testFlapping);
+    CPPUNIT_TEST(testOffline);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(NetworkMonitorTest, NetworkMonitorTest::name());
+
+void
+NetworkMonitorTest::testDiff()
+{
+    auto from = state({"192.168.1.10", "2001:db8::10"}, "192.168.1.10", "2001:db8::10");
+    // A temporary IPv6 address, which doesn't break anything
+    auto to = from;
+    to.addresses.emplace_back("2001:db8::abcd");
+    std::sort(to.addresses.begin(), to.addresses.end());
+    auto change = ConnectivityChange::diff(from, to);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(1), change.added.size());
+    CPPUNIT_ASSERT(change.removed.empty());
+    CPPUNIT_ASSERT(change.affects(pj_AF_INET6()));
+    CPPUNIT_ASSERT(not change.affects(pj_AF_INET()));
+    CPPUNIT_ASSERT(not change.disrupts());
+
+    // Moved to another IPv4 network
+    to = state({"10.0.0.5", "2001:db8::10"}, "10.0.0.5", "2001:db8::10");
+    change = ConnectivityChange::diff(from, to);
+    CPPUNIT_ASSERT(change.local4Changed and not change.local6Changed);
+    CPPUNIT_ASSERT(change.disrupts(pj_AF_INET()));
+    CPPUNIT_ASSERT(not change.disrupts(pj_AF_INET6()));
+    CPPUNIT_ASSERT(change.disrupts(IpAddr("192.168.1.10:4000")));
+    CPPUNIT_ASSERT(not change.disrupts(IpAddr("[2001:db8::10]:4000")));
+}
+
+void
+NetworkMonitorTest::testSettle()
+{
+    auto now = ConnectivityFilter::clock::now();
+    auto home = state({"192.168.1.10"}, "192.168.1.10");
+    ConnectivityFilter filter(home);
+    CPPUNIT_ASSERT(not filter.observe(home, now));
+
+    auto work = state({"10.0.0.5"}, "10.0.0.5");
+    auto due = filter.observe(work, now);
+    CPPUNIT_ASSERT(due);
+    CPPUNIT_ASSERT(not filter.apply(now));
+    // Notified again, it isn't postponed
+    CPPUNIT_ASSERT(*filter.observe(work, now + 1s) == *due);
+    auto change = filter.apply(*due);
+    CPPUNIT_ASSERT(change);
+    CPPUNIT_ASSERT(change->removed.size() == 1 and change->added.size() == 1);
+    CPPUNIT_ASSERT(filter.applied() == work);
+    CPPUNIT_ASSERT(not filter.apply(*due + 1s));
+
+    // The next one waits for the minimum interval
+    due = filter.observe(home, *due + 1s);
+    CPPUNIT_ASSERT(due);
+    CPPUNIT_ASSERT(*due - now >= ConnectivityFilter::MIN_INTERVAL);
+}
+
+void
+NetworkMonitorTest::testFlapping()
+{
+    auto now = ConnectivityFilter::clock::now();
+    auto wifi = state({"192.168.1.10"}, "192.168.1.10");
+    ConnectivityFilter filter(wifi);
+    auto due = filter.observe(state({"192.168.1.11"}, "192.168.1.11"), now);
+    CPPUNIT_ASSERT(due);
+    // Back before it settled: nothing to do
+    CPPUNIT_ASSERT(not filter.observe(wifi, now + 1s));
+    CPPUNIT_ASSERT(not filter.apply(*due));
+}
+
+void
+NetworkMonitorTest::testOffline()
+{
+    auto now = ConnectivityFilter::clock::now();
+    auto wifi = state({"192.168.1.10"}, "192.168.1.10");
+    ConnectivityFilter filter(wifi);
+    auto due = filter.observe(state({}, {}), now);
+    CPPUNIT_ASSERT(due);
+    CPPUNIT_ASSERT(*due - now >= ConnectivityFilter::OFFLINE_GRACE);
+    CPPUNIT_ASSERT(not filter.apply(now + ConnectivityFilter::SETTLE_DELAY));
+    // Roamed to the same network
+    CPPUNIT_ASSERT(not filter.observe(wifi, now + 5s));
+    CPPUNIT_ASSERT(not filter.apply(*due));
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::NetworkMonitorTest::name());
@@ -0,0 +1,127 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "test_runner.h"
+
+#include "security/password_keys.h"
+
+#include <opendht/crypto.h>
+
+namespace jami {
+namespace test {
+
+class PasswordKeysTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "password_keys"; }
+
+private:
+    void testCompatibility();
+    void testWrongPassword();
+    void testForget();
+    void testSamePassword();
+
+    CPPUNIT_TEST_SUITE(PasswordKeysTest);
+    CPPUNIT_TEST(testCompatibility);
+    CPPUNIT_TEST(testWrongPassword);
+    CPPUNIT_TEST(testForget);
+    CPPUNIT_TEST(testSamePassword);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(PasswordKeysTest, PasswordKeysTest::name());
+
+static const std::vector<uint8_t> DATA {'a', 'r', 'c', 'h', 'i', 'v', 'e'};
+static const std::string ARCHIVE {"alice/archive.gz"};
+
+void
+PasswordKeysTest::testCompatibility()
+{
+    secure::PasswordKeys keys;
+    // Archives saved before, and by the other versions
+    auto saved = dht::crypto::aesEncrypt(DATA, "password");
+    CPPUNIT_ASSERT(keys.decrypt(ARCHIVE, saved, "password") == DATA);
+    // Saved again with the same key
+    auto resaved = keys.encrypt(ARCHIVE, DATA, "password");
+    CPPUNIT_ASSERT(std::equal(saved.begin(), saved.begin() + 16, resaved.begin()));
+    CPPUNIT_ASSERT(dht::crypto::aesDecrypt(resaved, "password") == DATA);
+    CPPUNIT_ASSERT(keys.decrypt(ARCHIVE, resaved, "password") == DATA);
+
+    std::vector<uint8_t> salt(saved.begin(), saved.begin() + 16);
+    auto stretched = salt;
+    CPPUNIT_ASSERT(keys.stretch(ARCHIVE, "password", salt)
+                   == dht::crypto::stretchKey("password", stretched, 256 / 8));
+}
+
+void
+PasswordKeysTest::testWrongPassword()
+{
+    secure::PasswordKeys keys;
+    auto saved = keys.encrypt(ARCHIVE, DATA, "password");
+    // The key of the salt is not given for another password
+    CPPUNIT_ASSERT_THROW(keys.decrypt(ARCHIVE, saved, "wrong"), dht::crypto::DecryptError);
+    CPPUNIT_ASSERT_THROW(keys.decrypt(ARCHIVE, saved, ""), dht::crypto::DecryptError);
+    CPPUNIT_ASSERT(keys.decrypt(ARCHIVE, saved, "password") == DATA);
+    // Nor another salt
+    auto other = keys.encrypt(ARCHIVE, DATA, "other");
+    CPPUNIT_ASSERT(not std::equal(saved.begin(), saved.begin() + 16, other.begin()));
+    CPPUNIT_ASSERT_THROW(keys.decrypt(ARCHIVE, other, "password"), dht::crypto::DecryptError);
+}
+
+void
+PasswordKeysTest::testForget()
+{
+    secure::PasswordKeys keys;
+    auto saved = keys.encrypt(ARCHIVE, DATA, "password");
+    keys.forget(ARCHIVE);
+    // A new key, with a new salt
+    auto resaved = keys.encrypt(ARCHIVE, DATA, "password");
+    CPPUNIT_ASSERT(not std::equal(saved.begin(), saved.begin() + 16, resaved.begin()));
+    // Both readable
+    CPPUNIT_ASSERT(keys.decrypt(ARCHIVE, saved, "password") == DATA);
+    keys.clear();
+    CPPUNIT_ASSERT(keys.decrypt(ARCHIVE, resaved, "password") == DATA);
+}
+
+void
+PasswordKeysTest::testSamePassword()
+{
+    secure::PasswordKeys keys;
+    const std::string bobArchive {"bob/archive.gz"};
+    auto alice = keys.encrypt(ARCHIVE, DATA, "password");
+    auto bob = keys.encrypt(bobArchive, DATA, "password");
+    // Each account has its own salt, thus its own key
+    CPPUNIT_ASSERT(not std::equal(alice.begin(), alice.begin() + 16, bob.begin()));
+    CPPUNIT_ASSERT(keys.decrypt(ARCHIVE, alice, "password") == DATA);
+    CPPUNIT_ASSERT(keys.decrypt(bobArchive, bob, "password") == DATA);
+
+    // Forgetting the keys of an account keeps the others
+    keys.forget(bobArchive);
+    auto aliceResaved = keys.encrypt(ARCHIVE, DATA, "password");
+    CPPUNIT_ASSERT(std::equal(alice.begin(), alice.begin() + 16, aliceResaved.begin()));
+    auto bobResaved = keys.encrypt(bobArchive, DATA, "password");
+    CPPUNIT_ASSERT(not std::equal(bob.begin(), bob.begin() + 16, bobResaved.begin()));
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::PasswordKeysTest::name())
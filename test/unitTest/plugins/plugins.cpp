@@ -20,12 +20,18 @@
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <filesystem>
+#include <set>
 #include <string>
+#include <thread>
 
 #include "manager.h"
 #include "plugin/jamipluginmanager.h"
+#include "plugin/mediaframeadapter.h"
+#include "media_buffer.h"
+#include "libav_utils.h"
 #include "jamidht/jamiaccount.h"
 #include "../../test_runner.h"
 #include "jami.h"
@@ -118,8 +124,11 @@ private:
     void testEnable();
     void testInstallAndLoad();
     void testHandlers();
+    void testLazyLoad();
     void testDetailsAndPreferences();
     void testTranslations();
+    void testFrameAdapter();
+    void testHandlerWorker();
     void testCall();
     void testMessage();
 
@@ -127,8 +136,11 @@ private:
     CPPUNIT_TEST(testEnable);
     CPPUNIT_TEST(testInstallAndLoad);
     CPPUNIT_TEST(testHandlers);
+    CPPUNIT_TEST(testLazyLoad);
     CPPUNIT_TEST(testDetailsAndPreferences);
     CPPUNIT_TEST(testTranslations);
+    CPPUNIT_TEST(testFrameAdapter);
+    CPPUNIT_TEST(testHandlerWorker);
     CPPUNIT_TEST(testCall);
     CPPUNIT_TEST(testMessage);
     CPPUNIT_TEST_SUITE_END();
@@ -353,6 +365,40 @@ PluginsTest::testHandlers()
     CPPUNIT_ASSERT(!Manager::instance().getJamiPluginManager().uninstallPlugin(installationPath_));
 }
 
+void
+PluginsTest::testLazyLoad()
+{
+    Manager::instance().pluginPreferences.setPluginsEnabled(true);
+    auto& pluginManager = Manager::instance().getJamiPluginManager();
+
+    // Indexed when loaded by the installation
+    pluginManager.installPlugin(jplPath_, true);
+    auto names = [&] {
+        std::set<std::string> names;
+        for (const auto& handler : pluginManager.getCallServicesManager().getCallMediaHandlers())
+            names.emplace(
+                pluginManager.getCallServicesManager().getCallMediaHandlerDetails(handler)["name"]);
+        for (const auto& handler : pluginManager.getChatServicesManager().getChatHandlers())
+            names.emplace(
+                pluginManager.getChatServicesManager().getChatHandlerDetails(handler)["name"]);
+        return names;
+    };
+    auto loadedNames = names();
+    CPPUNIT_ASSERT(pluginManager.unloadPlugin(installationPath_));
+    CPPUNIT_ASSERT(names().empty());
+
+    // The handlers are registered from the index
+    CPPUNIT_ASSERT(pluginManager.loadPlugin(installationPath_, true));
+    auto loadedPlugins = pluginManager.getLoadedPlugins();
+    CPPUNIT_ASSERT(std::find(loadedPlugins.begin(), loadedPlugins.end(), installationPath_)
+                   != loadedPlugins.end());
+    CPPUNIT_ASSERT(names() == loadedNames);
+
+    CPPUNIT_ASSERT(pluginManager.unloadPlugin(installationPath_));
+    CPPUNIT_ASSERT(names().empty());
+    CPPUNIT_ASSERT(!pluginManager.uninstallPlugin(installationPath_));
+}
+
 void
 PluginsTest::testDetailsAndPreferences()
 {
@@ -502,6 +548,85 @@ PluginsTest::waitForSignal(CallData& callData,
     return res;
 }
 
+void
+PluginsTest::testFrameAdapter()
+{
+    auto format = MediaHandlerFormat::fromDetails(
+        {{"pixelFormat", "rgb24"}, {"width", "320"}, {"height", "320"}});
+    CPPUNIT_ASSERT(format.readOnly());
+    CPPUNIT_ASSERT(not format.hardwareFrames);
+    CPPUNIT_ASSERT(format.pixelFormat == AV_PIX_FMT_RGB24);
+    CPPUNIT_ASSERT(not MediaHandlerFormat::fromDetails({{"hardwareFrames", "1"}}).readOnly());
+
+#ifdef ENABLE_VIDEO
+    PublishObservable<AVFrame*> stream;
+    auto adapter = std::make_shared<MediaFrameAdapter>(format);
+    stream.attach(adapter.get());
+
+    int width = 0, height = 0, pixelFormat = -1;
+    FuncObserver<AVFrame*> handler([&](AVFrame* const& frame) {
+        width = frame->width;
+        height = frame->height;
+        pixelFormat = frame->format;
+    });
+    adapter->attach(&handler);
+
+    VideoFrame frame;
+    frame.reserve(AV_PIX_FMT_YUV420P, 1280, 720);
+    libav_utils::fillWithBlack(frame.pointer());
+    stream.publish(frame.pointer());
+    // Downscaled to fit, keeping the aspect ratio
+    CPPUNIT_ASSERT_EQUAL(320, width);
+    CPPUNIT_ASSERT_EQUAL(180, height);
+    CPPUNIT_ASSERT_EQUAL((int) AV_PIX_FMT_RGB24, pixelFormat);
+    // The frame of the stream is untouched
+    CPPUNIT_ASSERT_EQUAL(1280, frame.width());
+
+    adapter->detach(&handler);
+    adapter.reset();
+    CPPUNIT_ASSERT(stream.getObserversCount() == 0);
+#endif
+}
+
+void
+PluginsTest::testHandlerWorker()
+{
+    auto format = MediaHandlerFormat::fromDetails({{"budget", "100"}, {"fallback", "input"}});
+    CPPUNIT_ASSERT(not format.readOnly());
+    CPPUNIT_ASSERT(format.budget == std::chrono::milliseconds(100));
+    CPPUNIT_ASSERT(not format.keepLast);
+
+#ifdef ENABLE_VIDEO
+    PublishObservable<AVFrame*> stream;
+    auto worker = std::make_shared<MediaHandlerWorker>("test", format);
+    stream.attach(worker.get());
+
+    std::atomic<std::chrono::milliseconds> delay {std::chrono::milliseconds(0)};
+    FuncObserver<AVFrame*> handler([&](AVFrame* const& frame) {
+        std::this_thread::sleep_for(delay.load());
+        frame->data[0][0] = 255;
+    });
+    worker->attach(&handler);
+
+    auto publish = [&] {
+        VideoFrame frame;
+        frame.reserve(AV_PIX_FMT_YUV420P, 320, 240);
+        libav_utils::fillWithBlack(frame.pointer());
+        stream.publish(frame.pointer());
+        return frame.pointer()->data[0][0];
+    };
+    // Processed within the budget
+    CPPUNIT_ASSERT_EQUAL((uint8_t) 255, publish());
+    // Too slow: the frame is passed unprocessed
+    delay = std::chrono::milliseconds(500);
+    CPPUNIT_ASSERT(publish() != 255);
+
+    worker->detach(&handler);
+    worker.reset();
+    CPPUNIT_ASSERT(stream.getObserversCount() == 0);
+#endif
+}
+
 void
 PluginsTest::testCall()
 {
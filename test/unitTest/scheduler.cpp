@@ -27,6 +27,9 @@
 #include "scheduled_executor.h"
 #include <opendht/rng.h>
 
+#include <optional>
+#include <thread>
+
 namespace jami { namespace test {
 
 class SchedulerTest : public CppUnit::TestFixture {
@@ -35,9 +38,17 @@ public:
 
 private:
     void schedulerTest();
+    void priorityTest();
+    void timerTest();
+    void timerRotationTest();
+    void strandTest();
 
     CPPUNIT_TEST_SUITE(SchedulerTest);
     CPPUNIT_TEST(schedulerTest);
+    CPPUNIT_TEST(priorityTest);
+    CPPUNIT_TEST(timerTest);
+    CPPUNIT_TEST(timerRotationTest);
+    CPPUNIT_TEST(strandTest);
     CPPUNIT_TEST_SUITE_END();
 };
 
@@ -87,6 +98,148 @@ SchedulerTest::schedulerTest()
     executor.stop();
 }
 
+void
+SchedulerTest::priorityTest()
+{
+    using Priority = jami::ScheduledExecutor::Priority;
+    jami::ScheduledExecutor executor("test");
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool released {false};
+    std::vector<Priority> order;
+
+    // Blocks the executor while the jobs are queued
+    executor.run([&]{
+        std::unique_lock<std::mutex> l(mtx);
+        cv.wait(l, [&]{ return released; });
+    });
+    auto job = [&](Priority p) {
+        return [&, p]{
+            std::lock_guard<std::mutex> l(mtx);
+            order.emplace_back(p);
+            cv.notify_all();
+        };
+    };
+    constexpr unsigned N = 4;
+    for (unsigned i=0; i<N; i++)
+        executor.run(job(Priority::Low), Priority::Low);
+    for (unsigned i=0; i<N; i++)
+        executor.run(job(Priority::High), Priority::High);
+    CPPUNIT_ASSERT(executor.getQueueStats(Priority::Low).depth == N);
+
+    std::unique_lock<std::mutex> lk(mtx);
+    released = true;
+    cv.notify_all();
+    CPPUNIT_ASSERT(cv.wait_for(lk, std::chrono::seconds(3), [&]{
+        return order.size() == 2 * N;
+    }));
+    for (unsigned i=0; i<N; i++) {
+        CPPUNIT_ASSERT(order[i] == Priority::High);
+        CPPUNIT_ASSERT(order[N + i] == Priority::Low);
+    }
+    lk.unlock();
+
+    auto stats = executor.getQueueStats(Priority::Low);
+    CPPUNIT_ASSERT(stats.depth == 0);
+    CPPUNIT_ASSERT(stats.maxDepth == N);
+    CPPUNIT_ASSERT(stats.count == N);
+}
+
+void
+SchedulerTest::timerTest()
+{
+    jami::ScheduledExecutor executor("test");
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<unsigned> order;
+    std::vector<std::shared_ptr<Task>> tasks;
+    const std::vector<unsigned> delays {300, 5, 0, 257, 600, 256, 70000, 1};
+    for (unsigned i=0; i<delays.size(); i++)
+        tasks.emplace_back(executor.scheduleIn([&, i]{
+            std::lock_guard<std::mutex> l(mtx);
+            order.emplace_back(i);
+            cv.notify_all();
+        }, std::chrono::milliseconds(delays[i])));
+
+    // Released by the executor at once
+    std::weak_ptr<Task> cancelled = tasks[4];
+    tasks[4]->cancel();
+    tasks[6]->cancel();
+    tasks[4].reset();
+    CPPUNIT_ASSERT(cancelled.expired());
+
+    std::unique_lock<std::mutex> lk(mtx);
+    CPPUNIT_ASSERT(cv.wait_for(lk, std::chrono::seconds(3), [&]{
+        return order.size() == delays.size() - 2;
+    }));
+    CPPUNIT_ASSERT((order == std::vector<unsigned> {2, 7, 1, 5, 3, 0}));
+}
+
+void
+SchedulerTest::timerRotationTest()
+{
+    // Ticks of 1 ms counted from the creation of the executor
+    auto start = std::chrono::steady_clock::now();
+    jami::ScheduledExecutor executor("test");
+
+    // Scheduled around tick 100, due past tick 256, the end of the first rotation
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(100));
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::optional<std::chrono::steady_clock::time_point> fired;
+    auto scheduled = std::chrono::steady_clock::now();
+    executor.scheduleIn([&]{
+        std::lock_guard<std::mutex> l(mtx);
+        fired = std::chrono::steady_clock::now();
+        cv.notify_all();
+    }, std::chrono::milliseconds(200));
+
+    std::unique_lock<std::mutex> lk(mtx);
+    CPPUNIT_ASSERT(cv.wait_for(lk, std::chrono::seconds(3), [&]{ return fired.has_value(); }));
+    CPPUNIT_ASSERT(*fired - scheduled >= std::chrono::milliseconds(200));
+    CPPUNIT_ASSERT(*fired - scheduled < std::chrono::milliseconds(300));
+    // The worker waited for the task, it didn't spin until the end of the rotation
+    CPPUNIT_ASSERT(executor.getTimerWakeups() < 10);
+}
+
+void
+SchedulerTest::strandTest()
+{
+    jami::ScheduledExecutor executor("test", 4);
+
+    // A long job doesn't delay the others
+    executor.run([]{ std::this_thread::sleep_for(std::chrono::milliseconds(500)); });
+
+    constexpr unsigned STRANDS = 4, N = 256;
+    std::vector<std::unique_ptr<Strand>> strands;
+    std::vector<std::vector<unsigned>> order(STRANDS);
+    std::vector<std::atomic_uint> running(STRANDS);
+    std::atomic_bool concurrent {false};
+    std::atomic_uint done {0};
+    for (unsigned s=0; s<STRANDS; s++)
+        strands.emplace_back(std::make_unique<Strand>(executor));
+    for (unsigned i=0; i<N; i++) {
+        for (unsigned s=0; s<STRANDS; s++) {
+            strands[s]->run([&, s, i]{
+                if (running[s]++)
+                    concurrent = true;
+                order[s].emplace_back(i);
+                running[s]--;
+                done++;
+            });
+        }
+    }
+    for (unsigned i=0; i<100 and done < STRANDS * N; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CPPUNIT_ASSERT(done == STRANDS * N);
+    CPPUNIT_ASSERT(not concurrent);
+    for (const auto& o : order)
+        for (unsigned i=0; i<N; i++)
+            CPPUNIT_ASSERT(o[i] == i);
+}
+
 }} // namespace jami::test
 
 RING_TEST_RUNNER(jami::test::SchedulerTest::name());
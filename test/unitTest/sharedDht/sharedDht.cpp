@@ -0,0 +1,148 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include "manager.h"
+#include "jamidht/account_dht.h"
+#include "jamidht/jamiaccount.h"
+#include "../../test_runner.h"
+#include "jami.h"
+#include "common.h"
+
+#include <opendht/crypto.h>
+
+namespace jami {
+namespace test {
+
+class SharedDhtTest : public CppUnit::TestFixture
+{
+public:
+    SharedDhtTest()
+    {
+        // Init daemon
+        DRing::init(DRing::InitFlag(DRing::DRING_FLAG_DEBUG | DRing::DRING_FLAG_CONSOLE_LOG));
+        if (not Manager::instance().initialized)
+            CPPUNIT_ASSERT(DRing::start("dring-sample.yml"));
+    }
+    ~SharedDhtTest() { DRing::fini(); }
+    static std::string name() { return "SharedDht"; }
+    void setUp();
+    void tearDown();
+
+private:
+    void testCertificateCancelledOnShutdown();
+    void testDhtReplacedWhileUsed();
+
+    CPPUNIT_TEST_SUITE(SharedDhtTest);
+    CPPUNIT_TEST(testCertificateCancelledOnShutdown);
+    CPPUNIT_TEST(testDhtReplacedWhileUsed);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(SharedDhtTest, SharedDhtTest::name());
+
+static bool
+waitFor(const std::function<bool()>& pred, std::chrono::seconds timeout = std::chrono::seconds(10))
+{
+    auto end = std::chrono::steady_clock::now() + timeout;
+    while (not pred()) {
+        if (std::chrono::steady_clock::now() > end)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return true;
+}
+
+void
+SharedDhtTest::setUp()
+{
+    Manager::instance().preferences.setSharedDht(true);
+}
+
+void
+SharedDhtTest::tearDown()
+{
+    Manager::instance().preferences.setSharedDht(false);
+}
+
+void
+SharedDhtTest::testCertificateCancelledOnShutdown()
+{
+    auto node = std::make_shared<SharedDhtNode>();
+    auto identity = dht::crypto::generateIdentity("shared");
+    auto certKey = identity.second->getPublicKey().getId();
+
+    dht::DhtRunner::Config config {};
+    config.dht_config.id = identity;
+    config.threaded = true;
+    auto accountDht = std::make_shared<AccountDht>(node);
+    accountDht->run(0, config, {});
+    CPPUNIT_ASSERT(waitFor([&] { return not node->runner()->getPut(certKey).empty(); }));
+
+    // The node keeps running for the other accounts, but stops announcing this one
+    accountDht->shutdown({});
+    CPPUNIT_ASSERT(node->runner()->isRunning());
+    CPPUNIT_ASSERT(waitFor([&] { return node->runner()->getPut(certKey).empty(); }));
+    node->join();
+}
+
+void
+SharedDhtTest::testDhtReplacedWhileUsed()
+{
+    auto actors = load_actors_and_wait_for_announcement("actors/alice-bob.yml");
+    auto aliceId = actors["alice"];
+    auto aliceAccount = Manager::instance().getAccount<JamiAccount>(aliceId);
+    CPPUNIT_ASSERT(aliceAccount->dht()->isShared());
+
+    // Each registration replaces the DHT of the account, while it's used
+    std::atomic_bool stop {false};
+    std::atomic_bool nullDht {false};
+    std::thread reader([&] {
+        while (not stop) {
+            auto dht = aliceAccount->dht();
+            if (not dht)
+                nullDht = true;
+            else
+                dht->getPublicKey();
+        }
+    });
+    for (auto i = 0; i < 5; ++i)
+        aliceAccount->doRegister();
+    stop = true;
+    reader.join();
+    CPPUNIT_ASSERT(not nullDht);
+
+    // Still announced: cancelling the puts of the replaced ones didn't remove it
+    auto node = Manager::instance().sharedDhtNode();
+    auto certKey = aliceAccount->identity().second->getPublicKey().getId();
+    CPPUNIT_ASSERT(waitFor([&] { return node->runner()->getPut(certKey).size() == 1; }));
+
+    wait_for_removal_of({aliceId, actors["bob"]});
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::SharedDhtTest::name())
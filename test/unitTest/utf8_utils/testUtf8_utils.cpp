@@ -22,6 +22,7 @@
 #include <cppunit/extensions/HelperMacros.h>
 
 #include <string>
+#include <string_view>
 
 #include "utf8_utils.h"
 #include "../../test_runner.h"
@@ -33,13 +34,21 @@ class Utf8UtilsTest : public CppUnit::TestFixture {
 public:
     static std::string name() { return "utf8_utils"; }
 
+    void tearDown() { utf8_force_scalar(false); }
+
 private:
     void utf8_validate_test();
     void utf8_make_valid_test();
+    void utf8_validate_scalar_test();
+    void utf8_make_valid_scalar_test();
+    void utf8_blocks_test();
 
     CPPUNIT_TEST_SUITE(Utf8UtilsTest);
     CPPUNIT_TEST(utf8_validate_test);
     CPPUNIT_TEST(utf8_make_valid_test);
+    CPPUNIT_TEST(utf8_validate_scalar_test);
+    CPPUNIT_TEST(utf8_make_valid_scalar_test);
+    CPPUNIT_TEST(utf8_blocks_test);
     CPPUNIT_TEST_SUITE_END();
 
     const std::string VALIDE_UTF8 = "çèềé{}()/\\*";
@@ -64,6 +73,59 @@ Utf8UtilsTest::utf8_make_valid_test()
     // invalid utf8 string in input
     std::string str = utf8_make_valid(INVALID_UTF8);
     CPPUNIT_ASSERT(utf8_validate(str));
+    CPPUNIT_ASSERT(str == "\xef\xbf\xbd(");
+
+    // in place
+    str = VALIDE_UTF8;
+    CPPUNIT_ASSERT(utf8_make_valid_in_place(str));
+    CPPUNIT_ASSERT(str == VALIDE_UTF8);
+    str = INVALID_UTF8;
+    CPPUNIT_ASSERT(!utf8_make_valid_in_place(str));
+    CPPUNIT_ASSERT(str == utf8_make_valid(INVALID_UTF8));
+}
+
+void
+Utf8UtilsTest::utf8_validate_scalar_test()
+{
+    utf8_force_scalar(true);
+    CPPUNIT_ASSERT(std::string(utf8_implementation()) == "scalar");
+    utf8_validate_test();
+}
+
+void
+Utf8UtilsTest::utf8_make_valid_scalar_test()
+{
+    utf8_force_scalar(true);
+    utf8_make_valid_test();
+}
+
+void
+Utf8UtilsTest::utf8_blocks_test()
+{
+    // Invalid sequences before, across and after the boundaries of the SIMD blocks
+    const std::string_view invalids[] {"\xc3\x28",
+                                       "\xe0\x80\x80",
+                                       "\xed\xa0\x80",
+                                       "\xf4\x90\x80\x80",
+                                       "\xf8\x88\x80\x80",
+                                       "\x80",
+                                       {"\0", 1}};
+    for (size_t offset = 0; offset < 70; ++offset) {
+        std::string valid(offset, 'a');
+        valid += "\xf0\x9f\x98\x80" + VALIDE_UTF8 + std::string(40, 'b');
+        for (bool scalar : {true, false}) {
+            utf8_force_scalar(scalar);
+            CPPUNIT_ASSERT(utf8_validate(valid));
+            // Truncated
+            CPPUNIT_ASSERT(!utf8_validate(std::string_view(valid).substr(0, offset + 3)));
+            for (auto invalid : invalids) {
+                auto str = std::string(offset, 'a') + std::string(invalid) + VALIDE_UTF8;
+                CPPUNIT_ASSERT(!utf8_validate(str));
+                CPPUNIT_ASSERT_EQUAL(offset, utf8_valid_prefix(str));
+                CPPUNIT_ASSERT(utf8_validate(utf8_make_valid(str)));
+            }
+        }
+    }
 }
 
 }} // namespace jami::test
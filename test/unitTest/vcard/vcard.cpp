@@ -0,0 +1,106 @@
+/*
+ *  Copyright (C) 2022 Savoir-faire Linux Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cppunit/TestAssert.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "vcard.h"
+#include "jamidht/conversationrepository.h"
+#include "../../test_runner.h"
+
+#include <string>
+
+namespace jami {
+namespace test {
+
+static constexpr std::string_view PROFILE = "BEGIN:VCARD\n"
+                                            "VERSION:2.1\n"
+                                            "FN:Alice\n"
+                                            "DESCRIPTION:a:b\n"
+                                            "no separator\n"
+                                            "\n"
+                                            "PHOTO;ENCODING=BASE64;TYPE=PNG:aGVsbG8=\n"
+                                            "FN:Bob\n"
+                                            "END:VCARD";
+
+class VCardTest : public CppUnit::TestFixture
+{
+public:
+    static std::string name() { return "vcard"; }
+
+private:
+    void testParser();
+    void testPhoto();
+    void testInfos();
+
+    CPPUNIT_TEST_SUITE(VCardTest);
+    CPPUNIT_TEST(testParser);
+    CPPUNIT_TEST(testPhoto);
+    CPPUNIT_TEST(testInfos);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(VCardTest, VCardTest::name());
+
+void
+VCardTest::testParser()
+{
+    vCard::utils::Parser parser(PROFILE);
+    std::vector<std::pair<std::string_view, std::string_view>> fields;
+    while (auto field = parser.next()) {
+        // Viewing the content
+        CPPUNIT_ASSERT(field->value.data() >= PROFILE.data()
+                       and field->value.data() < PROFILE.data() + PROFILE.size());
+        fields.emplace_back(field->key, field->value);
+    }
+    CPPUNIT_ASSERT_EQUAL(std::size_t(7), fields.size());
+    CPPUNIT_ASSERT(fields[3].first == "DESCRIPTION" and fields[3].second == "a:b");
+    CPPUNIT_ASSERT(fields[6].first == "END" and fields[6].second == "VCARD");
+
+    auto map = vCard::utils::toMap(PROFILE);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(6), map.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("Alice"), map[vCard::Property::FORMATTED_NAME]);
+}
+
+void
+VCardTest::testPhoto()
+{
+    auto photo = vCard::utils::find(PROFILE, vCard::Property::PHOTO);
+    CPPUNIT_ASSERT(photo);
+    CPPUNIT_ASSERT(photo->key == vCard::Property::PHOTO_PNG);
+    CPPUNIT_ASSERT(photo->isBase64());
+    auto data = photo->decode();
+    CPPUNIT_ASSERT_EQUAL(std::string("hello"), std::string(data.begin(), data.end()));
+
+    CPPUNIT_ASSERT(not vCard::utils::find(PROFILE, vCard::Property::NICKNAME));
+}
+
+void
+VCardTest::testInfos()
+{
+    auto infos = ConversationRepository::infosFromVCard(PROFILE);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(3), infos.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("Alice"), infos["title"]);
+    CPPUNIT_ASSERT_EQUAL(std::string("a:b"), infos["description"]);
+    CPPUNIT_ASSERT_EQUAL(std::string("aGVsbG8="), infos["avatar"]);
+}
+
+} // namespace test
+} // namespace jami
+
+RING_TEST_RUNNER(jami::test::VCardTest::name());